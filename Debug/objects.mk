@@ -4,5 +4,5 @@
 
 USER_OBJS :=
 
-LIBS := -luv -lm -lpcre -lcleri
+LIBS := -luv -lm -lpcre -lcleri -llz4
 
@@ -0,0 +1,24 @@
+################################################################################
+# Automatically-generated file. Do not edit!
+################################################################################
+
+# Add inputs and outputs from these tool invocations to the build variables
+C_SRCS += \
+../src/iset/iset.c
+
+OBJS += \
+./src/iset/iset.o
+
+C_DEPS += \
+./src/iset/iset.d
+
+
+# Each subdirectory must supply rules for building sources it contributes
+src/iset/%.o: ../src/iset/%.c
+	@echo 'Building file: $<'
+	@echo 'Invoking: GCC C Compiler'
+	gcc -DDEBUG=1 -I../include -O0 -g3 -Wall -Wextra $(CFLAGS) -c -fmessage-length=0 -MMD -MP -MF"$(@:%.o=%.d)" -MT"$(@)" -o "$@" "$<"
+	@echo 'Finished building: $<'
+	@echo ' '
+
+
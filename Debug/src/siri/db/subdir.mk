@@ -4,21 +4,39 @@
 
 # Add inputs and outputs from these tool invocations to the build variables
 C_SRCS += \
+../src/siri/db/acache.c \
 ../src/siri/db/access.c \
 ../src/siri/db/aggregate.c \
+../src/siri/db/arena.c \
+../src/siri/db/attach.c \
 ../src/siri/db/auth.c \
 ../src/siri/db/buffer.c \
+../src/siri/db/ccache.c \
+../src/siri/db/coalesce.c \
+../src/siri/db/compress.c \
+../src/siri/db/continuous.c \
+../src/siri/db/cpoints.c \
+../src/siri/db/crc32c.c \
 ../src/siri/db/db.c \
+../src/siri/db/downsample.c \
+../src/siri/db/durations.c \
+../src/siri/db/export.c \
+../src/siri/db/fetch.c \
 ../src/siri/db/ffile.c \
 ../src/siri/db/fifo.c \
 ../src/siri/db/forward.c \
 ../src/siri/db/group.c \
 ../src/siri/db/groups.c \
+../src/siri/db/hedge.c \
+../src/siri/db/hot.c \
+../src/siri/db/hotlog.c \
 ../src/siri/db/initsync.c \
 ../src/siri/db/insert.c \
 ../src/siri/db/lookup.c \
+../src/siri/db/mcache.c \
 ../src/siri/db/median.c \
 ../src/siri/db/misc.c \
+../src/siri/db/names.c \
 ../src/siri/db/nodes.c \
 ../src/siri/db/pcache.c \
 ../src/siri/db/points.c \
@@ -26,37 +44,68 @@ C_SRCS += \
 ../src/siri/db/pools.c \
 ../src/siri/db/presuf.c \
 ../src/siri/db/props.c \
+../src/siri/db/qcache.c \
+../src/siri/db/qplan.c \
 ../src/siri/db/query.c \
+../src/siri/db/ratelimit.c \
 ../src/siri/db/re.c \
 ../src/siri/db/reindex.c \
 ../src/siri/db/replicate.c \
+../src/siri/db/rollup.c \
 ../src/siri/db/series.c \
 ../src/siri/db/server.c \
 ../src/siri/db/servers.c \
+../src/siri/db/session.c \
 ../src/siri/db/shard.c \
 ../src/siri/db/shards.c \
+../src/siri/db/shash.c \
+../src/siri/db/slab.c \
+../src/siri/db/spill.c \
+../src/siri/db/startup.c \
+../src/siri/db/subscribe.c \
+../src/siri/db/tdigest.c \
 ../src/siri/db/time.c \
+../src/siri/db/tokens.c \
+../src/siri/db/trigrams.c \
 ../src/siri/db/user.c \
 ../src/siri/db/users.c \
 ../src/siri/db/variance.c \
 ../src/siri/db/walker.c
 
 OBJS += \
+./src/siri/db/acache.o \
 ./src/siri/db/access.o \
 ./src/siri/db/aggregate.o \
+./src/siri/db/arena.o \
+./src/siri/db/attach.o \
 ./src/siri/db/auth.o \
 ./src/siri/db/buffer.o \
+./src/siri/db/ccache.o \
+./src/siri/db/coalesce.o \
+./src/siri/db/compress.o \
+./src/siri/db/continuous.o \
+./src/siri/db/cpoints.o \
+./src/siri/db/crc32c.o \
 ./src/siri/db/db.o \
+./src/siri/db/downsample.o \
+./src/siri/db/durations.o \
+./src/siri/db/export.o \
+./src/siri/db/fetch.o \
 ./src/siri/db/ffile.o \
 ./src/siri/db/fifo.o \
 ./src/siri/db/forward.o \
 ./src/siri/db/group.o \
 ./src/siri/db/groups.o \
+./src/siri/db/hedge.o \
+./src/siri/db/hot.o \
+./src/siri/db/hotlog.o \
 ./src/siri/db/initsync.o \
 ./src/siri/db/insert.o \
 ./src/siri/db/lookup.o \
+./src/siri/db/mcache.o \
 ./src/siri/db/median.o \
 ./src/siri/db/misc.o \
+./src/siri/db/names.o \
 ./src/siri/db/nodes.o \
 ./src/siri/db/pcache.o \
 ./src/siri/db/points.o \
@@ -64,37 +113,68 @@ OBJS += \
 ./src/siri/db/pools.o \
 ./src/siri/db/presuf.o \
 ./src/siri/db/props.o \
+./src/siri/db/qcache.o \
+./src/siri/db/qplan.o \
 ./src/siri/db/query.o \
+./src/siri/db/ratelimit.o \
 ./src/siri/db/re.o \
 ./src/siri/db/reindex.o \
 ./src/siri/db/replicate.o \
+./src/siri/db/rollup.o \
 ./src/siri/db/series.o \
 ./src/siri/db/server.o \
 ./src/siri/db/servers.o \
+./src/siri/db/session.o \
 ./src/siri/db/shard.o \
 ./src/siri/db/shards.o \
+./src/siri/db/shash.o \
+./src/siri/db/slab.o \
+./src/siri/db/spill.o \
+./src/siri/db/startup.o \
+./src/siri/db/subscribe.o \
+./src/siri/db/tdigest.o \
 ./src/siri/db/time.o \
+./src/siri/db/tokens.o \
+./src/siri/db/trigrams.o \
 ./src/siri/db/user.o \
 ./src/siri/db/users.o \
 ./src/siri/db/variance.o \
 ./src/siri/db/walker.o
 
 C_DEPS += \
+./src/siri/db/acache.d \
 ./src/siri/db/access.d \
 ./src/siri/db/aggregate.d \
+./src/siri/db/arena.d \
+./src/siri/db/attach.d \
 ./src/siri/db/auth.d \
 ./src/siri/db/buffer.d \
+./src/siri/db/ccache.d \
+./src/siri/db/coalesce.d \
+./src/siri/db/compress.d \
+./src/siri/db/continuous.d \
+./src/siri/db/cpoints.d \
+./src/siri/db/crc32c.d \
 ./src/siri/db/db.d \
+./src/siri/db/downsample.d \
+./src/siri/db/durations.d \
+./src/siri/db/export.d \
+./src/siri/db/fetch.d \
 ./src/siri/db/ffile.d \
 ./src/siri/db/fifo.d \
 ./src/siri/db/forward.d \
 ./src/siri/db/group.d \
 ./src/siri/db/groups.d \
+./src/siri/db/hedge.d \
+./src/siri/db/hot.d \
+./src/siri/db/hotlog.d \
 ./src/siri/db/initsync.d \
 ./src/siri/db/insert.d \
 ./src/siri/db/lookup.d \
+./src/siri/db/mcache.d \
 ./src/siri/db/median.d \
 ./src/siri/db/misc.d \
+./src/siri/db/names.d \
 ./src/siri/db/nodes.d \
 ./src/siri/db/pcache.d \
 ./src/siri/db/points.d \
@@ -102,16 +182,29 @@ C_DEPS += \
 ./src/siri/db/pools.d \
 ./src/siri/db/presuf.d \
 ./src/siri/db/props.d \
+./src/siri/db/qcache.d \
+./src/siri/db/qplan.d \
 ./src/siri/db/query.d \
+./src/siri/db/ratelimit.d \
 ./src/siri/db/re.d \
 ./src/siri/db/reindex.d \
 ./src/siri/db/replicate.d \
+./src/siri/db/rollup.d \
 ./src/siri/db/series.d \
 ./src/siri/db/server.d \
 ./src/siri/db/servers.d \
+./src/siri/db/session.d \
 ./src/siri/db/shard.d \
 ./src/siri/db/shards.d \
+./src/siri/db/shash.d \
+./src/siri/db/slab.d \
+./src/siri/db/spill.d \
+./src/siri/db/startup.d \
+./src/siri/db/subscribe.d \
+./src/siri/db/tdigest.d \
 ./src/siri/db/time.d \
+./src/siri/db/tokens.d \
+./src/siri/db/trigrams.d \
 ./src/siri/db/user.d \
 ./src/siri/db/users.d \
 ./src/siri/db/variance.d \
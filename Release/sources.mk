@@ -20,6 +20,7 @@ src/cfgparser \
 src/ctree \
 src/expr \
 src/imap \
+src/iset \
 src/iso8601 \
 src/llist \
 src/lock \
@@ -0,0 +1,20 @@
+################################################################################
+# Automatically-generated file. Do not edit!
+################################################################################
+
+# The benchmark has its own main() so it is not part of OBJS
+BENCH_OBJS += \
+./src/bench/bench.o
+
+C_DEPS += \
+./src/bench/bench.d
+
+
+# Each subdirectory must supply rules for building sources it contributes
+src/bench/%.o: ../src/bench/%.c
+	@echo 'Building file: $<'
+	@echo 'Invoking: GCC C Compiler'
+	gcc -I../include -O3 -Wall -Wextra $(CFLAGS) -c -fmessage-length=0 -MMD -MP -MF"$(@:%.o=%.d)" -MT"$(@)" -o "$@" "$<"
+	@echo 'Finished building: $<'
+	@echo ' '
+
@@ -4,12 +4,15 @@
 
 # Add inputs and outputs from these tool invocations to the build variables
 C_SRCS += \
+../src/imap/dmap.c \
 ../src/imap/imap.c
 
 OBJS += \
+./src/imap/dmap.o \
 ./src/imap/imap.o
 
 C_DEPS += \
+./src/imap/dmap.d \
 ./src/imap/imap.d
 
 
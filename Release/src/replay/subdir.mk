@@ -0,0 +1,20 @@
+################################################################################
+# Automatically-generated file. Do not edit!
+################################################################################
+
+# The replay tool has its own main() so it is not part of OBJS
+REPLAY_OBJS += \
+./src/replay/replay.o
+
+C_DEPS += \
+./src/replay/replay.d
+
+
+# Each subdirectory must supply rules for building sources it contributes
+src/replay/%.o: ../src/replay/%.c
+	@echo 'Building file: $<'
+	@echo 'Invoking: GCC C Compiler'
+	gcc -I../include -O3 -Wall -Wextra $(CFLAGS) -c -fmessage-length=0 -MMD -MP -MF"$(@:%.o=%.d)" -MT"$(@)" -o "$@" "$<"
+	@echo 'Finished building: $<'
+	@echo ' '
+
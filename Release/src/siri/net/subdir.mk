@@ -5,7 +5,10 @@
 # Add inputs and outputs from these tool invocations to the build variables
 C_SRCS += \
 ../src/siri/net/bserver.c \
+../src/siri/net/capture.c \
 ../src/siri/net/clserver.c \
+../src/siri/net/fsend.c \
+../src/siri/net/metrics.c \
 ../src/siri/net/pkg.c \
 ../src/siri/net/promise.c \
 ../src/siri/net/promises.c \
@@ -14,7 +17,10 @@ C_SRCS += \
 
 OBJS += \
 ./src/siri/net/bserver.o \
+./src/siri/net/capture.o \
 ./src/siri/net/clserver.o \
+./src/siri/net/fsend.o \
+./src/siri/net/metrics.o \
 ./src/siri/net/pkg.o \
 ./src/siri/net/promise.o \
 ./src/siri/net/promises.o \
@@ -23,7 +29,10 @@ OBJS += \
 
 C_DEPS += \
 ./src/siri/net/bserver.d \
+./src/siri/net/capture.d \
 ./src/siri/net/clserver.d \
+./src/siri/net/fsend.d \
+./src/siri/net/metrics.d \
 ./src/siri/net/pkg.d \
 ./src/siri/net/promise.d \
 ./src/siri/net/promises.d \
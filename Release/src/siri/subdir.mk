@@ -4,30 +4,60 @@
 
 # Add inputs and outputs from these tool invocations to the build variables
 C_SRCS += \
+../src/siri/alloc.c \
 ../src/siri/async.c \
 ../src/siri/backup.c \
 ../src/siri/err.c \
+../src/siri/fsync.c \
 ../src/siri/heartbeat.c \
+../src/siri/latency.c \
+../src/siri/loop.c \
+../src/siri/mem.c \
+../src/siri/mutex.c \
+../src/siri/numa.c \
 ../src/siri/optimize.c \
+../src/siri/sched.c \
 ../src/siri/siri.c \
+../src/siri/throttle.c \
+../src/siri/verify.c \
 ../src/siri/version.c
 
 OBJS += \
+./src/siri/alloc.o \
 ./src/siri/async.o \
 ./src/siri/backup.o \
 ./src/siri/err.o \
+./src/siri/fsync.o \
 ./src/siri/heartbeat.o \
+./src/siri/latency.o \
+./src/siri/loop.o \
+./src/siri/mem.o \
+./src/siri/mutex.o \
+./src/siri/numa.o \
 ./src/siri/optimize.o \
+./src/siri/sched.o \
 ./src/siri/siri.o \
+./src/siri/throttle.o \
+./src/siri/verify.o \
 ./src/siri/version.o
 
 C_DEPS += \
+./src/siri/alloc.d \
 ./src/siri/async.d \
 ./src/siri/backup.d \
 ./src/siri/err.d \
+./src/siri/fsync.d \
 ./src/siri/heartbeat.d \
+./src/siri/latency.d \
+./src/siri/loop.d \
+./src/siri/mem.d \
+./src/siri/mutex.d \
+./src/siri/numa.d \
 ./src/siri/optimize.d \
+./src/siri/sched.d \
 ./src/siri/siri.d \
+./src/siri/throttle.d \
+./src/siri/verify.d \
 ./src/siri/version.d
 
 
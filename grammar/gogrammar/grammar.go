@@ -43,6 +43,7 @@ const (
 	GidCountStmt = iota
 	GidCountUsers = iota
 	GidCreateGroup = iota
+	GidCreateSnapshot = iota
 	GidCreateStmt = iota
 	GidCreateUser = iota
 	GidDropGroup = iota
@@ -51,17 +52,21 @@ const (
 	GidDropShards = iota
 	GidDropStmt = iota
 	GidDropUser = iota
+	GidExplainStmt = iota
 	GidFCount = iota
 	GidFDerivative = iota
 	GidFDifference = iota
 	GidFFilter = iota
 	GidFLimit = iota
+	GidFLttb = iota
 	GidFMax = iota
 	GidFMean = iota
 	GidFMedian = iota
 	GidFMedianHigh = iota
 	GidFMedianLow = iota
 	GidFMin = iota
+	GidFMinmax = iota
+	GidFPercentile = iota
 	GidFPoints = iota
 	GidFPvariance = iota
 	GidFSum = iota
@@ -88,6 +93,7 @@ const (
 	GidHelpCountUsers = iota
 	GidHelpCreate = iota
 	GidHelpCreateGroup = iota
+	GidHelpCreateSnapshot = iota
 	GidHelpCreateUser = iota
 	GidHelpDrop = iota
 	GidHelpDropGroup = iota
@@ -111,19 +117,25 @@ const (
 	GidHelpTimeit = iota
 	GidHelpTimezones = iota
 	GidIntExpr = iota
+	GidJoinExpr = iota
 	GidIntOperator = iota
 	GidKAccess = iota
 	GidKActiveHandles = iota
 	GidKAddress = iota
 	GidKAfter = iota
+	GidKAllocator = iota
 	GidKAlter = iota
 	GidKAnd = iota
 	GidKAs = iota
 	GidKBackupMode = iota
 	GidKBefore = iota
 	GidKBetween = iota
+	GidKBottom = iota
 	GidKBufferPath = iota
 	GidKBufferSize = iota
+	GidKChunkCacheHits = iota
+	GidKChunkCacheMisses = iota
+	GidKChunkCacheUsage = iota
 	GidKCount = iota
 	GidKCreate = iota
 	GidKCritical = iota
@@ -139,9 +151,15 @@ const (
 	GidKDurationNum = iota
 	GidKEnd = iota
 	GidKError = iota
+	GidKExpirationLog = iota
+	GidKExpirationNum = iota
+	GidKExplain = iota
 	GidKExpression = iota
 	GidKFalse = iota
 	GidKFifoFiles = iota
+	GidKFileHandleEvictions = iota
+	GidKFileHandleHits = iota
+	GidKFileHandleOpens = iota
 	GidKFilter = iota
 	GidKFloat = iota
 	GidKFor = iota
@@ -151,46 +169,68 @@ const (
 	GidKGroup = iota
 	GidKGroups = iota
 	GidKHelp = iota
+	GidKHotSeries = iota
 	GidKIgnoreThreshold = iota
 	GidKInfo = iota
 	GidKInsert = iota
+	GidKInsertQueue = iota
+	GidKInsertQueueSize = iota
 	GidKInteger = iota
 	GidKIntersection = iota
 	GidKIpSupport = iota
+	GidKJoin = iota
+	GidKKill = iota
+	GidKLatency = iota
 	GidKLength = iota
 	GidKLibuv = iota
 	GidKLimit = iota
 	GidKList = iota
 	GidKListLimit = iota
+	GidKLockContention = iota
 	GidKLog = iota
 	GidKLogLevel = iota
+	GidKLoop = iota
+	GidKLttb = iota
 	GidKMax = iota
 	GidKMaxOpenFiles = iota
 	GidKMean = iota
 	GidKMedian = iota
 	GidKMedianHigh = iota
 	GidKMedianLow = iota
+	GidKMemBuffer = iota
+	GidKMemGroups = iota
+	GidKMemInsert = iota
+	GidKMemNet = iota
+	GidKMemQuery = iota
+	GidKMemSeries = iota
+	GidKMemShard = iota
 	GidKMemUsage = iota
 	GidKMerge = iota
 	GidKMin = iota
+	GidKMinmax = iota
 	GidKModify = iota
 	GidKName = iota
 	GidKNow = iota
 	GidKNumber = iota
 	GidKOnline = iota
 	GidKOpenFiles = iota
+	GidKOptimizeProgress = iota
 	GidKOr = iota
 	GidKPassword = iota
+	GidKPercentile = iota
 	GidKPoints = iota
 	GidKPool = iota
 	GidKPools = iota
 	GidKPort = iota
 	GidKPrefix = iota
 	GidKPvariance = iota
+	GidKQueries = iota
+	GidKQuery = iota
 	GidKRead = iota
 	GidKReceivedPoints = iota
 	GidKReindexProgress = iota
 	GidKRevoke = iota
+	GidKRtt = iota
 	GidKSelect = iota
 	GidKSelectPointsLimit = iota
 	GidKSelectedPoints = iota
@@ -202,7 +242,9 @@ const (
 	GidKShow = iota
 	GidKSid = iota
 	GidKSize = iota
+	GidKSnapshot = iota
 	GidKStart = iota
+	GidKStartupProfile = iota
 	GidKStartupTime = iota
 	GidKStatus = iota
 	GidKString = iota
@@ -214,6 +256,7 @@ const (
 	GidKTimeit = iota
 	GidKTimezone = iota
 	GidKTo = iota
+	GidKTop = iota
 	GidKTrue = iota
 	GidKType = iota
 	GidKUnion = iota
@@ -228,9 +271,11 @@ const (
 	GidKWhere = iota
 	GidKWhoAmI = iota
 	GidKWrite = iota
+	GidKillStmt = iota
 	GidLimitExpr = iota
 	GidListGroups = iota
 	GidListPools = iota
+	GidListQueries = iota
 	GidListSeries = iota
 	GidListServers = iota
 	GidListShards = iota
@@ -256,6 +301,7 @@ const (
 	GidSTART = iota
 	GidSelectAggregate = iota
 	GidSelectStmt = iota
+	GidSeriesAfter = iota
 	GidSeriesColumns = iota
 	GidSeriesMatch = iota
 	GidSeriesName = iota
@@ -265,6 +311,8 @@ const (
 	GidSetAddress = iota
 	GidSetBackupMode = iota
 	GidSetDropThreshold = iota
+	GidSetExpirationLog = iota
+	GidSetExpirationNum = iota
 	GidSetExpression = iota
 	GidSetIgnoreThreshold = iota
 	GidSetListLimit = iota
@@ -281,6 +329,7 @@ const (
 	GidSuffixExpr = iota
 	GidTimeExpr = iota
 	GidTimeitStmt = iota
+	GidTopExpr = iota
 	GidUserColumns = iota
 	GidUuid = iota
 	GidWhereGroup = iota
@@ -307,6 +356,7 @@ func SiriGrammar() *goleri.Grammar {
 	kActiveHandles := goleri.NewKeyword(GidKActiveHandles, "active_handles", false)
 	kAddress := goleri.NewKeyword(GidKAddress, "address", false)
 	kAfter := goleri.NewKeyword(GidKAfter, "after", false)
+	kAllocator := goleri.NewKeyword(GidKAllocator, "allocator", false)
 	kAlter := goleri.NewKeyword(GidKAlter, "alter", false)
 	kAnd := goleri.NewKeyword(GidKAnd, "and", false)
 	kAs := goleri.NewKeyword(GidKAs, "as", false)
@@ -314,7 +364,11 @@ func SiriGrammar() *goleri.Grammar {
 	kBefore := goleri.NewKeyword(GidKBefore, "before", false)
 	kBufferSize := goleri.NewKeyword(GidKBufferSize, "buffer_size", false)
 	kBufferPath := goleri.NewKeyword(GidKBufferPath, "buffer_path", false)
+	kChunkCacheHits := goleri.NewKeyword(GidKChunkCacheHits, "chunk_cache_hits", false)
+	kChunkCacheMisses := goleri.NewKeyword(GidKChunkCacheMisses, "chunk_cache_misses", false)
+	kChunkCacheUsage := goleri.NewKeyword(GidKChunkCacheUsage, "chunk_cache_usage", false)
 	kBetween := goleri.NewKeyword(GidKBetween, "between", false)
+	kBottom := goleri.NewKeyword(GidKBottom, "bottom", false)
 	kCount := goleri.NewKeyword(GidKCount, "count", false)
 	kCreate := goleri.NewKeyword(GidKCreate, "create", false)
 	kCritical := goleri.NewKeyword(GidKCritical, "critical", false)
@@ -330,9 +384,15 @@ func SiriGrammar() *goleri.Grammar {
 	kDurationNum := goleri.NewKeyword(GidKDurationNum, "duration_num", false)
 	kEnd := goleri.NewKeyword(GidKEnd, "end", false)
 	kError := goleri.NewKeyword(GidKError, "error", false)
+	kExpirationLog := goleri.NewKeyword(GidKExpirationLog, "expiration_log", false)
+	kExpirationNum := goleri.NewKeyword(GidKExpirationNum, "expiration_num", false)
+	kExplain := goleri.NewKeyword(GidKExplain, "explain", false)
 	kExpression := goleri.NewKeyword(GidKExpression, "expression", false)
 	kFalse := goleri.NewKeyword(GidKFalse, "false", false)
 	kFifoFiles := goleri.NewKeyword(GidKFifoFiles, "fifo_files", false)
+	kFileHandleEvictions := goleri.NewKeyword(GidKFileHandleEvictions, "file_handle_evictions", false)
+	kFileHandleHits := goleri.NewKeyword(GidKFileHandleHits, "file_handle_hits", false)
+	kFileHandleOpens := goleri.NewKeyword(GidKFileHandleOpens, "file_handle_opens", false)
 	kFilter := goleri.NewKeyword(GidKFilter, "filter", false)
 	kFloat := goleri.NewKeyword(GidKFloat, "float", false)
 	kFor := goleri.NewKeyword(GidKFor, "for", false)
@@ -347,9 +407,12 @@ func SiriGrammar() *goleri.Grammar {
 		goleri.NewKeyword(NoGid, "help", false),
 		goleri.NewToken(NoGid, "?"),
 	)
+	kHotSeries := goleri.NewKeyword(GidKHotSeries, "hot_series", false)
 	kInfo := goleri.NewKeyword(GidKInfo, "info", false)
 	kIgnoreThreshold := goleri.NewKeyword(GidKIgnoreThreshold, "ignore_threshold", false)
 	kInsert := goleri.NewKeyword(GidKInsert, "insert", false)
+	kInsertQueue := goleri.NewKeyword(GidKInsertQueue, "insert_queue", false)
+	kInsertQueueSize := goleri.NewKeyword(GidKInsertQueueSize, "insert_queue_size", false)
 	kInteger := goleri.NewKeyword(GidKInteger, "integer", false)
 	kIntersection := goleri.NewChoice(
 		GidKIntersection,
@@ -358,40 +421,59 @@ func SiriGrammar() *goleri.Grammar {
 		goleri.NewKeyword(NoGid, "intersection", false),
 	)
 	kIpSupport := goleri.NewKeyword(GidKIpSupport, "ip_support", false)
+	kJoin := goleri.NewKeyword(GidKJoin, "join", false)
+	kKill := goleri.NewKeyword(GidKKill, "kill", false)
+	kLatency := goleri.NewKeyword(GidKLatency, "latency", false)
 	kLength := goleri.NewKeyword(GidKLength, "length", false)
 	kLibuv := goleri.NewKeyword(GidKLibuv, "libuv", false)
 	kLimit := goleri.NewKeyword(GidKLimit, "limit", false)
 	kList := goleri.NewKeyword(GidKList, "list", false)
 	kListLimit := goleri.NewKeyword(GidKListLimit, "list_limit", false)
+	kLockContention := goleri.NewKeyword(GidKLockContention, "lock_contention", false)
 	kLog := goleri.NewKeyword(GidKLog, "log", false)
 	kLogLevel := goleri.NewKeyword(GidKLogLevel, "log_level", false)
+	kLoop := goleri.NewKeyword(GidKLoop, "loop", false)
+	kLttb := goleri.NewKeyword(GidKLttb, "lttb", false)
 	kMax := goleri.NewKeyword(GidKMax, "max", false)
 	kMaxOpenFiles := goleri.NewKeyword(GidKMaxOpenFiles, "max_open_files", false)
 	kMean := goleri.NewKeyword(GidKMean, "mean", false)
 	kMedian := goleri.NewKeyword(GidKMedian, "median", false)
 	kMedianLow := goleri.NewKeyword(GidKMedianLow, "median_low", false)
 	kMedianHigh := goleri.NewKeyword(GidKMedianHigh, "median_high", false)
+	kMemBuffer := goleri.NewKeyword(GidKMemBuffer, "mem_buffer", false)
+	kMemGroups := goleri.NewKeyword(GidKMemGroups, "mem_groups", false)
+	kMemInsert := goleri.NewKeyword(GidKMemInsert, "mem_insert", false)
+	kMemNet := goleri.NewKeyword(GidKMemNet, "mem_net", false)
+	kMemQuery := goleri.NewKeyword(GidKMemQuery, "mem_query", false)
+	kMemSeries := goleri.NewKeyword(GidKMemSeries, "mem_series", false)
+	kMemShard := goleri.NewKeyword(GidKMemShard, "mem_shard", false)
 	kMemUsage := goleri.NewKeyword(GidKMemUsage, "mem_usage", false)
 	kMerge := goleri.NewKeyword(GidKMerge, "merge", false)
 	kMin := goleri.NewKeyword(GidKMin, "min", false)
+	kMinmax := goleri.NewKeyword(GidKMinmax, "minmax", false)
 	kModify := goleri.NewKeyword(GidKModify, "modify", false)
 	kName := goleri.NewKeyword(GidKName, "name", false)
 	kNow := goleri.NewKeyword(GidKNow, "now", false)
 	kNumber := goleri.NewKeyword(GidKNumber, "number", false)
 	kOnline := goleri.NewKeyword(GidKOnline, "online", false)
 	kOpenFiles := goleri.NewKeyword(GidKOpenFiles, "open_files", false)
+	kOptimizeProgress := goleri.NewKeyword(GidKOptimizeProgress, "optimize_progress", false)
 	kOr := goleri.NewKeyword(GidKOr, "or", false)
 	kPassword := goleri.NewKeyword(GidKPassword, "password", false)
+	kPercentile := goleri.NewKeyword(GidKPercentile, "percentile", false)
 	kPoints := goleri.NewKeyword(GidKPoints, "points", false)
 	kPool := goleri.NewKeyword(GidKPool, "pool", false)
 	kPools := goleri.NewKeyword(GidKPools, "pools", false)
 	kPort := goleri.NewKeyword(GidKPort, "port", false)
 	kPrefix := goleri.NewKeyword(GidKPrefix, "prefix", false)
 	kPvariance := goleri.NewKeyword(GidKPvariance, "pvariance", false)
+	kQueries := goleri.NewKeyword(GidKQueries, "queries", false)
+	kQuery := goleri.NewKeyword(GidKQuery, "query", false)
 	kRead := goleri.NewKeyword(GidKRead, "read", false)
 	kReceivedPoints := goleri.NewKeyword(GidKReceivedPoints, "received_points", false)
 	kReindexProgress := goleri.NewKeyword(GidKReindexProgress, "reindex_progress", false)
 	kRevoke := goleri.NewKeyword(GidKRevoke, "revoke", false)
+	kRtt := goleri.NewKeyword(GidKRtt, "rtt", false)
 	kSelect := goleri.NewKeyword(GidKSelect, "select", false)
 	kSelectPointsLimit := goleri.NewKeyword(GidKSelectPointsLimit, "select_points_limit", false)
 	kSelectedPoints := goleri.NewKeyword(GidKSelectedPoints, "selected_points", false)
@@ -403,7 +485,9 @@ func SiriGrammar() *goleri.Grammar {
 	kShards := goleri.NewKeyword(GidKShards, "shards", false)
 	kShow := goleri.NewKeyword(GidKShow, "show", false)
 	kSize := goleri.NewKeyword(GidKSize, "size", false)
+	kSnapshot := goleri.NewKeyword(GidKSnapshot, "snapshot", false)
 	kStart := goleri.NewKeyword(GidKStart, "start", false)
+	kStartupProfile := goleri.NewKeyword(GidKStartupProfile, "startup_profile", false)
 	kStartupTime := goleri.NewKeyword(GidKStartupTime, "startup_time", false)
 	kStatus := goleri.NewKeyword(GidKStatus, "status", false)
 	kString := goleri.NewKeyword(GidKString, "string", false)
@@ -420,6 +504,7 @@ func SiriGrammar() *goleri.Grammar {
 	kTimezone := goleri.NewKeyword(GidKTimezone, "timezone", false)
 	kTimePrecision := goleri.NewKeyword(GidKTimePrecision, "time_precision", false)
 	kTo := goleri.NewKeyword(GidKTo, "to", false)
+	kTop := goleri.NewKeyword(GidKTop, "top", false)
 	kTrue := goleri.NewKeyword(GidKTrue, "true", false)
 	kType := goleri.NewKeyword(GidKType, "type", false)
 	kUnion := goleri.NewChoice(
@@ -528,6 +613,9 @@ func SiriGrammar() *goleri.Grammar {
 		kStart,
 		kEnd,
 		kPool,
+		kMin,
+		kMax,
+		kSum,
 	), goleri.NewToken(NoGid, ","), 1, 0, false)
 	shardColumns := goleri.NewList(GidShardColumns, goleri.NewChoice(
 		NoGid,
@@ -558,6 +646,8 @@ func SiriGrammar() *goleri.Grammar {
 		kOnline,
 		kStartupTime,
 		kStatus,
+		kLatency,
+		kRtt,
 		kActiveHandles,
 		kFifoFiles,
 		kLogLevel,
@@ -679,6 +769,9 @@ func SiriGrammar() *goleri.Grammar {
 					false,
 					kLength,
 					kPool,
+					kMin,
+					kMax,
+					kSum,
 				),
 				intOperator,
 				intExpr,
@@ -745,8 +838,10 @@ func SiriGrammar() *goleri.Grammar {
 					kActiveHandles,
 					kBufferSize,
 					kFifoFiles,
+					kLatency,
 					kPort,
 					kPool,
+					kRtt,
 					kStartupTime,
 					kMaxOpenFiles,
 					kMemUsage,
@@ -942,11 +1037,33 @@ func SiriGrammar() *goleri.Grammar {
 		groupMatch,
 		seriesRe,
 	), seriesSep, 1, 0, false)
+	seriesAfter := goleri.NewSequence(
+		GidSeriesAfter,
+		kAfter,
+		string,
+	)
 	limitExpr := goleri.NewSequence(
 		GidLimitExpr,
 		kLimit,
 		intExpr,
 	)
+	topExpr := goleri.NewSequence(
+		GidTopExpr,
+		goleri.NewChoice(
+			NoGid,
+			true,
+			kTop,
+			kBottom,
+		),
+		rUinteger,
+	)
+	joinExpr := goleri.NewSequence(
+		GidJoinExpr,
+		kJoin,
+		goleri.NewList(NoGid, string, goleri.NewTokens(NoGid, "+ - * /"), 2, 0, false),
+		kAs,
+		string,
+	)
 	beforeExpr := goleri.NewSequence(
 		GidBeforeExpr,
 		kBefore,
@@ -1023,6 +1140,15 @@ func SiriGrammar() *goleri.Grammar {
 		timeExpr,
 		goleri.NewToken(NoGid, ")"),
 	)
+	fPercentile := goleri.NewSequence(
+		GidFPercentile,
+		kPercentile,
+		goleri.NewToken(NoGid, "("),
+		timeExpr,
+		goleri.NewToken(NoGid, ","),
+		rFloat,
+		goleri.NewToken(NoGid, ")"),
+	)
 	fSum := goleri.NewSequence(
 		GidFSum,
 		kSum,
@@ -1101,16 +1227,33 @@ func SiriGrammar() *goleri.Grammar {
 		),
 		goleri.NewToken(NoGid, ")"),
 	)
+	fLttb := goleri.NewSequence(
+		GidFLttb,
+		kLttb,
+		goleri.NewToken(NoGid, "("),
+		intExpr,
+		goleri.NewToken(NoGid, ")"),
+	)
+	fMinmax := goleri.NewSequence(
+		GidFMinmax,
+		kMinmax,
+		goleri.NewToken(NoGid, "("),
+		intExpr,
+		goleri.NewToken(NoGid, ")"),
+	)
 	aggregateFunctions := goleri.NewList(GidAggregateFunctions, goleri.NewChoice(
 		NoGid,
 		false,
 		fPoints,
 		fLimit,
+		fLttb,
+		fMinmax,
 		fMean,
 		fSum,
 		fMedian,
 		fMedianLow,
 		fMedianHigh,
+		fPercentile,
 		fMin,
 		fMax,
 		fCount,
@@ -1155,6 +1298,18 @@ func SiriGrammar() *goleri.Grammar {
 		kDropThreshold,
 		rFloat,
 	)
+	setExpirationLog := goleri.NewSequence(
+		GidSetExpirationLog,
+		kSet,
+		kExpirationLog,
+		rTimeStr,
+	)
+	setExpirationNum := goleri.NewSequence(
+		GidSetExpirationNum,
+		kSet,
+		kExpirationNum,
+		rTimeStr,
+	)
 	setExpression := goleri.NewSequence(
 		GidSetExpression,
 		kSet,
@@ -1216,6 +1371,8 @@ func SiriGrammar() *goleri.Grammar {
 			NoGid,
 			false,
 			setDropThreshold,
+			setExpirationLog,
+			setExpirationNum,
 			setListLimit,
 			setSelectPointsLimit,
 			setTimezone,
@@ -1325,6 +1482,10 @@ func SiriGrammar() *goleri.Grammar {
 		kFor,
 		rRegex,
 	)
+	createSnapshot := goleri.NewSequence(
+		GidCreateSnapshot,
+		kSnapshot,
+	)
 	createUser := goleri.NewSequence(
 		GidCreateUser,
 		kUser,
@@ -1377,12 +1538,17 @@ func SiriGrammar() *goleri.Grammar {
 		goleri.NewOptional(NoGid, poolColumns),
 		goleri.NewOptional(NoGid, wherePool),
 	)
+	listQueries := goleri.NewSequence(
+		GidListQueries,
+		kQueries,
+	)
 	listSeries := goleri.NewSequence(
 		GidListSeries,
 		kSeries,
 		goleri.NewOptional(NoGid, seriesColumns),
 		goleri.NewOptional(NoGid, seriesMatch),
 		goleri.NewOptional(NoGid, whereSeries),
+		goleri.NewOptional(NoGid, seriesAfter),
 	)
 	listServers := goleri.NewSequence(
 		GidListServers,
@@ -1446,6 +1612,7 @@ func SiriGrammar() *goleri.Grammar {
 			NoGid,
 			true,
 			createGroup,
+			createSnapshot,
 			createUser,
 		),
 	)
@@ -1473,6 +1640,12 @@ func SiriGrammar() *goleri.Grammar {
 			grantUser,
 		),
 	)
+	killStmt := goleri.NewSequence(
+		GidKillStmt,
+		kKill,
+		kQuery,
+		rUinteger,
+	)
 	listStmt := goleri.NewSequence(
 		GidListStmt,
 		kList,
@@ -1485,6 +1658,7 @@ func SiriGrammar() *goleri.Grammar {
 			listGroups,
 			listServers,
 			listPools,
+			listQueries,
 		),
 		goleri.NewOptional(NoGid, limitExpr),
 	)
@@ -1513,7 +1687,19 @@ func SiriGrammar() *goleri.Grammar {
 			betweenExpr,
 			beforeExpr,
 		)),
-		goleri.NewOptional(NoGid, mergeAs),
+		goleri.NewOptional(NoGid, limitExpr),
+		goleri.NewOptional(NoGid, goleri.NewChoice(
+			NoGid,
+			false,
+			topExpr,
+			mergeAs,
+			joinExpr,
+		)),
+	)
+	explainStmt := goleri.NewSequence(
+		GidExplainStmt,
+		kExplain,
+		selectStmt,
 	)
 	showStmt := goleri.NewSequence(
 		GidShowStmt,
@@ -1522,27 +1708,51 @@ func SiriGrammar() *goleri.Grammar {
 			NoGid,
 			false,
 			kActiveHandles,
+			kAllocator,
 			kBufferPath,
 			kBufferSize,
+			kChunkCacheHits,
+			kChunkCacheMisses,
+			kChunkCacheUsage,
 			kDbname,
 			kDbpath,
 			kDropThreshold,
 			kDurationLog,
 			kDurationNum,
+			kExpirationLog,
+			kExpirationNum,
 			kFifoFiles,
+			kFileHandleEvictions,
+			kFileHandleHits,
+			kFileHandleOpens,
+			kHotSeries,
+			kInsertQueue,
+			kInsertQueueSize,
 			kIpSupport,
+			kLatency,
 			kLibuv,
 			kListLimit,
+			kLockContention,
 			kLogLevel,
+			kLoop,
 			kMaxOpenFiles,
+			kMemBuffer,
+			kMemGroups,
+			kMemInsert,
+			kMemNet,
+			kMemQuery,
+			kMemSeries,
+			kMemShard,
 			kMemUsage,
 			kOpenFiles,
+			kOptimizeProgress,
 			kPool,
 			kReceivedPoints,
 			kReindexProgress,
 			kSelectedPoints,
 			kSelectPointsLimit,
 			kServer,
+			kStartupProfile,
 			kStartupTime,
 			kStatus,
 			kSyncProgress,
@@ -1621,6 +1831,7 @@ func SiriGrammar() *goleri.Grammar {
 	)
 	helpSelect := goleri.NewKeyword(GidHelpSelect, "select", false)
 	helpCreateGroup := goleri.NewKeyword(GidHelpCreateGroup, "group", false)
+	helpCreateSnapshot := goleri.NewKeyword(GidHelpCreateSnapshot, "snapshot", false)
 	helpCreateUser := goleri.NewKeyword(GidHelpCreateUser, "user", false)
 	helpCreate := goleri.NewSequence(
 		GidHelpCreate,
@@ -1629,6 +1840,7 @@ func SiriGrammar() *goleri.Grammar {
 			NoGid,
 			true,
 			helpCreateGroup,
+			helpCreateSnapshot,
 			helpCreateUser,
 		)),
 	)
@@ -1681,6 +1893,7 @@ func SiriGrammar() *goleri.Grammar {
 			NoGid,
 			false,
 			selectStmt,
+			explainStmt,
 			listStmt,
 			countStmt,
 			alterStmt,
@@ -1688,6 +1901,7 @@ func SiriGrammar() *goleri.Grammar {
 			dropStmt,
 			grantStmt,
 			revokeStmt,
+			killStmt,
 			showStmt,
 			calcStmt,
 			help,
@@ -48,6 +48,7 @@ class SiriGrammar(Grammar):
     k_active_handles = Keyword('active_handles')
     k_address = Keyword('address')
     k_after = Keyword('after')
+    k_allocator = Keyword('allocator')
     k_alter = Keyword('alter')
     k_and = Keyword('and')
     k_as = Keyword('as')
@@ -55,7 +56,11 @@ class SiriGrammar(Grammar):
     k_before = Keyword('before')
     k_buffer_size = Keyword('buffer_size')
     k_buffer_path = Keyword('buffer_path')
+    k_chunk_cache_hits = Keyword('chunk_cache_hits')
+    k_chunk_cache_misses = Keyword('chunk_cache_misses')
+    k_chunk_cache_usage = Keyword('chunk_cache_usage')
     k_between = Keyword('between')
+    k_bottom = Keyword('bottom')
     k_count = Keyword('count')
     k_create = Keyword('create')
     k_critical = Keyword('critical')
@@ -71,9 +76,15 @@ class SiriGrammar(Grammar):
     k_duration_num = Keyword('duration_num')
     k_end = Keyword('end')
     k_error = Keyword('error')
+    k_expiration_log = Keyword('expiration_log')
+    k_expiration_num = Keyword('expiration_num')
+    k_explain = Keyword('explain')
     k_expression = Keyword('expression')
     k_false = Keyword('false')
     k_fifo_files = Keyword('fifo_files')
+    k_file_handle_evictions = Keyword('file_handle_evictions')
+    k_file_handle_hits = Keyword('file_handle_hits')
+    k_file_handle_opens = Keyword('file_handle_opens')
     k_filter = Keyword('filter')
     k_float = Keyword('float')
     k_for = Keyword('for')
@@ -83,49 +94,71 @@ class SiriGrammar(Grammar):
     k_group = Keyword('group')
     k_groups = Keyword('groups')
     k_help = Choice(Keyword('help'), Token('?'))
+    k_hot_series = Keyword('hot_series')
     k_info = Keyword('info')
     k_ignore_threshold = Keyword('ignore_threshold')
     k_insert = Keyword('insert')
+    k_insert_queue = Keyword('insert_queue')
+    k_insert_queue_size = Keyword('insert_queue_size')
     k_integer = Keyword('integer')
     k_intersection = Choice(
         Token('&'),
         Keyword('intersection'),
         most_greedy=False)
     k_ip_support = Keyword('ip_support')
+    k_join = Keyword('join')
+    k_kill = Keyword('kill')
+    k_latency = Keyword('latency')
     k_length = Keyword('length')
     k_libuv = Keyword('libuv')
     k_limit = Keyword('limit')
     k_list = Keyword('list')
     k_list_limit = Keyword('list_limit')
+    k_lock_contention = Keyword('lock_contention')
     k_log = Keyword('log')
     k_log_level = Keyword('log_level')
+    k_loop = Keyword('loop')
+    k_lttb = Keyword('lttb')
     k_max = Keyword('max')
     k_max_open_files = Keyword('max_open_files')
     k_mean = Keyword('mean')
     k_median = Keyword('median')
     k_median_low = Keyword('median_low')
     k_median_high = Keyword('median_high')
+    k_mem_buffer = Keyword('mem_buffer')
+    k_mem_groups = Keyword('mem_groups')
+    k_mem_insert = Keyword('mem_insert')
+    k_mem_net = Keyword('mem_net')
+    k_mem_query = Keyword('mem_query')
+    k_mem_series = Keyword('mem_series')
+    k_mem_shard = Keyword('mem_shard')
     k_mem_usage = Keyword('mem_usage')
     k_merge = Keyword('merge')
     k_min = Keyword('min')
+    k_minmax = Keyword('minmax')
     k_modify = Keyword('modify')
     k_name = Keyword('name')
     k_now = Keyword('now')
     k_number = Keyword('number')
     k_online = Keyword('online')
     k_open_files = Keyword('open_files')
+    k_optimize_progress = Keyword('optimize_progress')
     k_or = Keyword('or')
     k_password = Keyword('password')
+    k_percentile = Keyword('percentile')
     k_points = Keyword('points')
     k_pool = Keyword('pool')
     k_pools = Keyword('pools')
     k_port = Keyword('port')
     k_prefix = Keyword('prefix')
     k_pvariance = Keyword('pvariance')
+    k_queries = Keyword('queries')
+    k_query = Keyword('query')
     k_read = Keyword('read')
     k_received_points = Keyword('received_points')
     k_reindex_progress = Keyword('reindex_progress')
     k_revoke = Keyword('revoke')
+    k_rtt = Keyword('rtt')
     k_select = Keyword('select')
     k_select_points_limit = Keyword('select_points_limit')
     k_selected_points = Keyword('selected_points')
@@ -137,7 +170,9 @@ class SiriGrammar(Grammar):
     k_shards = Keyword('shards')
     k_show = Keyword('show')
     k_size = Keyword('size')
+    k_snapshot = Keyword('snapshot')
     k_start = Keyword('start')
+    k_startup_profile = Keyword('startup_profile')
     k_startup_time = Keyword('startup_time')
     k_status = Keyword('status')
     k_string = Keyword('string')
@@ -152,6 +187,7 @@ class SiriGrammar(Grammar):
     k_timezone = Keyword('timezone')
     k_time_precision = Keyword('time_precision')
     k_to = Keyword('to')
+    k_top = Keyword('top')
     k_true = Keyword('true')
     k_type = Keyword('type')
     k_union = Choice(
@@ -223,6 +259,9 @@ class SiriGrammar(Grammar):
         k_start,
         k_end,
         k_pool,
+        k_min,
+        k_max,
+        k_sum,
         most_greedy=False), ',', 1)
 
     shard_columns = List(Choice(
@@ -252,6 +291,8 @@ class SiriGrammar(Grammar):
         k_online,
         k_startup_time,
         k_status,
+        k_latency,
+        k_rtt,
         # Remote properties
         k_active_handles,
         k_fifo_files,
@@ -309,7 +350,13 @@ class SiriGrammar(Grammar):
     # where series
     where_series = Sequence(k_where, Prio(
         Sequence(
-            Choice(k_length, k_pool, most_greedy=False),
+            Choice(
+                k_length,
+                k_pool,
+                k_min,
+                k_max,
+                k_sum,
+                most_greedy=False),
             int_operator,
             int_expr),
         Sequence(k_name, str_operator, string),
@@ -331,8 +378,10 @@ class SiriGrammar(Grammar):
             k_active_handles,
             k_buffer_size,
             k_fifo_files,
+            k_latency,
             k_port,
             k_pool,
+            k_rtt,
             k_startup_time,
             k_max_open_files,
             k_mem_usage,
@@ -402,7 +451,14 @@ class SiriGrammar(Grammar):
     series_match = List(
         Choice(series_name, group_match, series_re, most_greedy=False),
         series_sep, 1)
+    series_after = Sequence(k_after, string)
     limit_expr = Sequence(k_limit, int_expr)
+    top_expr = Sequence(Choice(k_top, k_bottom), r_uinteger)
+    join_expr = Sequence(
+        k_join,
+        List(string, Tokens('+ - * /'), 2),
+        k_as,
+        string)
 
     before_expr = Sequence(k_before, time_expr)
     after_expr = Sequence(k_after, time_expr)
@@ -439,6 +495,9 @@ class SiriGrammar(Grammar):
     f_median_high = Sequence(
         k_median_high,
         '(', time_expr, ')')
+    f_percentile = Sequence(
+        k_percentile,
+        '(', time_expr, ',', r_float, ')')
     f_sum = Sequence(
         k_sum,
         '(', time_expr, ')')
@@ -485,15 +544,24 @@ class SiriGrammar(Grammar):
             k_pvariance,
             most_greedy=False),
         ')')
+    f_lttb = Sequence(
+        k_lttb,
+        '(', int_expr, ')')
+    f_minmax = Sequence(
+        k_minmax,
+        '(', int_expr, ')')
 
     aggregate_functions = List(Choice(
         f_points,
         f_limit,
+        f_lttb,
+        f_minmax,
         f_mean,
         f_sum,
         f_median,
         f_median_low,
         f_median_high,
+        f_percentile,
         f_min,
         f_max,
         f_count,
@@ -518,6 +586,8 @@ class SiriGrammar(Grammar):
     set_address = Sequence(k_set, k_address, string)
     set_backup_mode = Sequence(k_set, k_backup_mode, _boolean)
     set_drop_threshold = Sequence(k_set, k_drop_threshold, r_float)
+    set_expiration_log = Sequence(k_set, k_expiration_log, r_time_str)
+    set_expiration_num = Sequence(k_set, k_expiration_num, r_time_str)
     set_expression = Sequence(k_set, k_expression, r_regex)
     set_ignore_threshold = Sequence(k_set, k_ignore_threshold, _boolean)
     set_list_limit = Sequence(k_set, k_list_limit, r_uinteger)
@@ -531,6 +601,8 @@ class SiriGrammar(Grammar):
 
     alter_database = Sequence(k_database, Choice(
         set_drop_threshold,
+        set_expiration_log,
+        set_expiration_num,
         set_list_limit,
         set_select_points_limit,
         set_timezone,
@@ -585,6 +657,7 @@ class SiriGrammar(Grammar):
 
     create_group = Sequence(
         k_group, group_name, k_for, r_regex)
+    create_snapshot = Sequence(k_snapshot)
     create_user = Sequence(
         k_user, string, set_password)
 
@@ -609,11 +682,13 @@ class SiriGrammar(Grammar):
         k_groups, Optional(group_columns), Optional(where_group))
     list_pools = Sequence(
         k_pools, Optional(pool_columns), Optional(where_pool))
+    list_queries = Sequence(k_queries)
     list_series = Sequence(
         k_series,
         Optional(series_columns),
         Optional(series_match),
-        Optional(where_series))
+        Optional(where_series),
+        Optional(series_after))
     list_servers = Sequence(
         k_servers, Optional(server_columns), Optional(where_server))
     list_shards = Sequence(
@@ -648,6 +723,7 @@ class SiriGrammar(Grammar):
 
     create_stmt = Sequence(k_create, Choice(
         create_group,
+        create_snapshot,
         create_user))
 
     drop_stmt = Sequence(k_drop, Choice(
@@ -662,6 +738,8 @@ class SiriGrammar(Grammar):
         grant_user,
         most_greedy=False))
 
+    kill_stmt = Sequence(k_kill, k_query, r_uinteger)
+
     list_stmt = Sequence(k_list, Choice(
         list_series,
         list_users,
@@ -669,6 +747,7 @@ class SiriGrammar(Grammar):
         list_groups,
         list_servers,
         list_pools,
+        list_queries,
         most_greedy=False
     ), Optional(limit_expr))
 
@@ -687,31 +766,62 @@ class SiriGrammar(Grammar):
             between_expr,
             before_expr,
             most_greedy=False)),
-        Optional(merge_as))
+        Optional(limit_expr),
+        Optional(Choice(
+            top_expr,
+            merge_as,
+            join_expr,
+            most_greedy=False)))
+
+    explain_stmt = Sequence(k_explain, select_stmt)
 
     show_stmt = Sequence(k_show, List(Choice(
         k_active_handles,
+        k_allocator,
         k_buffer_path,
         k_buffer_size,
+        k_chunk_cache_hits,
+        k_chunk_cache_misses,
+        k_chunk_cache_usage,
         k_dbname,
         k_dbpath,
         k_drop_threshold,
         k_duration_log,
         k_duration_num,
+        k_expiration_log,
+        k_expiration_num,
         k_fifo_files,
+        k_file_handle_evictions,
+        k_file_handle_hits,
+        k_file_handle_opens,
+        k_hot_series,
+        k_insert_queue,
+        k_insert_queue_size,
         k_ip_support,
+        k_latency,
         k_libuv,
         k_list_limit,
+        k_lock_contention,
         k_log_level,
+        k_loop,
         k_max_open_files,
+        k_mem_buffer,
+        k_mem_groups,
+        k_mem_insert,
+        k_mem_net,
+        k_mem_query,
+        k_mem_series,
+        k_mem_shard,
         k_mem_usage,
         k_open_files,
+        k_optimize_progress,
         k_pool,
         k_received_points,
         k_reindex_progress,
         k_selected_points,
         k_select_points_limit,
         k_server,
+        k_startup_profile,
         k_startup_time,
         k_status,
         k_sync_progress,
@@ -772,6 +882,7 @@ _set_attribute(SiriGrammar, 'START', Sequence(
     Optional(SiriGrammar.timeit_stmt),
     Optional(Choice(
         SiriGrammar.select_stmt,
+        SiriGrammar.explain_stmt,
         SiriGrammar.list_stmt,
         SiriGrammar.count_stmt,
         SiriGrammar.alter_stmt,
@@ -779,6 +890,7 @@ _set_attribute(SiriGrammar, 'START', Sequence(
         SiriGrammar.drop_stmt,
         SiriGrammar.grant_stmt,
         SiriGrammar.revoke_stmt,
+        SiriGrammar.kill_stmt,
         SiriGrammar.show_stmt,
         SiriGrammar.calc_stmt,
         SiriGrammar.help,
@@ -43,6 +43,27 @@ typedef int (*cexpr_cb_prop_t)(uint32_t prop);
 
 typedef struct cexpr_s cexpr_t;
 
+/*
+ * Flat program of an expression. Each instruction tests a condition and
+ * continues with 'on_true' or 'on_false', which is either the index of the
+ * next instruction or CEXPR_PROG_TRUE / CEXPR_PROG_FALSE.
+ */
+#define CEXPR_PROG_FALSE (UINT32_MAX - 1)
+#define CEXPR_PROG_TRUE UINT32_MAX
+
+typedef struct cexpr_instr_s
+{
+    cexpr_condition_t * cond;
+    uint32_t on_true;
+    uint32_t on_false;
+} cexpr_instr_t;
+
+typedef struct cexpr_prog_s
+{
+    uint32_t n;
+    cexpr_instr_t instr[];
+} cexpr_prog_t;
+
 typedef struct cexpr_list_s
 {
     size_t len;
@@ -62,6 +83,7 @@ typedef struct cexpr_s
     int8_t tp_b;
     cexpr_via_t via_a;
     cexpr_via_t via_b;
+    cexpr_prog_t * prog;        // only set on the root of an expression
 } cexpr_t;
 
 cexpr_t * cexpr_from_node(cleri_node_t * node);
@@ -82,6 +104,8 @@ int cexpr_bool_cmp(
         const int64_t a,
         const int64_t b);
 int cexpr_run(cexpr_t * cexpr, cexpr_cb_t cb, void * obj);
+int cexpr_compile(cexpr_t * cexpr);
 int cexpr_contains(cexpr_t * cexpr, cexpr_cb_prop_t cb);
+int cexpr_can_match(cexpr_t * cexpr, uint32_t prop, int64_t value);
 void cexpr_free(cexpr_t * cexpr);
 cexpr_operator_t cexpr_operator_fn(cleri_node_t * node);
@@ -22,18 +22,40 @@ enum
     CT_EXISTS,
 };
 
+/* nodes with more children use blocks of 32 children */
+#define CT_SMALL_SZ 16
+
+enum
+{
+    CT_NODE_SMALL,
+    CT_NODE_BLOCKS
+};
+
 typedef struct ct_s ct_t;
 typedef struct ct_node_s ct_node_t;
+typedef struct ct_small_s ct_small_t;
 typedef struct ct_node_s * ct_nodes_t[32];
 
+struct ct_small_s
+{
+    uint8_t len;                    /* used children, some can be NULL */
+    uint8_t size;                   /* allocated children */
+    uint8_t keys[CT_SMALL_SZ];      /* sorted characters of the children */
+    ct_node_t * children[];
+};
+
 struct ct_node_s
 {
     uint8_t offset;
     uint8_t n;
     uint8_t size;
-    uint8_t pad0;
+    uint8_t tp;                     /* CT_NODE_SMALL or CT_NODE_BLOCKS */
     uint32_t len;
-    ct_nodes_t * nodes;
+    union
+    {
+        ct_nodes_t * nodes;         /* when tp is CT_NODE_BLOCKS */
+        ct_small_t * small;         /* when tp is CT_NODE_SMALL */
+    };
     char * key;
     void * data;
 };
@@ -65,4 +87,10 @@ void * ct_pop(ct_t * ct, const char * key);
 int ct_items(ct_t * ct, ct_item_cb cb, void * args);
 int ct_values(ct_t * ct, ct_val_cb cb, void * args);
 void ct_valuesn(ct_t * ct, size_t * n, ct_val_cb cb, void * args);
+void ct_valuesn_after(
+        ct_t * ct,
+        const char * key,
+        size_t * n,
+        ct_val_cb cb,
+        void * args);
 
@@ -0,0 +1,57 @@
+/*
+ * dmap.h - map for dense uint64_t integer keys
+ *
+ * author       : Jeroen van der Heijden
+ * email        : jeroen@transceptor.technology
+ * copyright    : 2016, Transceptor Technology
+ *
+ * changes
+ *  - initial version, 14-10-2016
+ *
+ */
+#pragma once
+
+#include <imap/imap.h>
+#include <inttypes.h>
+#include <stddef.h>
+#include <slist/slist.h>
+
+#define DMAP_CHUNK_BITS 10
+#define DMAP_CHUNK_SZ (1 << DMAP_CHUNK_BITS)
+#define DMAP_CHUNK_MASK (DMAP_CHUNK_SZ - 1)
+
+typedef struct dmap_chunk_s dmap_chunk_t;
+typedef struct dmap_s dmap_t;
+
+struct dmap_chunk_s
+{
+    size_t len;
+    void * data[DMAP_CHUNK_SZ];
+};
+
+struct dmap_s
+{
+    size_t len;
+    slist_t * slist;
+    size_t n;                   /* number of chunk pointers */
+    dmap_chunk_t ** chunks;     /* chunk by key >> DMAP_CHUNK_BITS or NULL */
+};
+
+dmap_t * dmap_new(void);
+void dmap_free(dmap_t * dmap, imap_free_cb cb);
+int dmap_add(dmap_t * dmap, uint64_t id, void * data);
+void * dmap_pop(dmap_t * dmap, uint64_t id);
+int dmap_walk(dmap_t * dmap, imap_cb cb, void * data);
+slist_t * dmap_slist(dmap_t * dmap);
+slist_t * dmap_2slist(dmap_t * dmap);
+slist_t * dmap_2slist_ref(dmap_t * dmap);
+
+/*
+ * Returns an item or NULL if the key does not exist.
+ */
+static inline void * dmap_get(dmap_t * dmap, uint64_t id)
+{
+    uint64_t pos = id >> DMAP_CHUNK_BITS;
+    return (pos < dmap->n && dmap->chunks[pos] != NULL) ?
+            dmap->chunks[pos]->data[id & DMAP_CHUNK_MASK] : NULL;
+}
@@ -0,0 +1,47 @@
+/*
+ * iset.h - compressed set for uint32_t integer ids
+ *
+ * author       : Jeroen van der Heijden
+ * email        : jeroen@transceptor.technology
+ * copyright    : 2016, Transceptor Technology
+ *
+ * changes
+ *  - initial version, 14-10-2016
+ *
+ */
+#pragma once
+
+#include <inttypes.h>
+#include <stddef.h>
+
+/* a container with more ids is stored as a bitmap */
+#define ISET_ARRAY_MAX 4096
+
+typedef struct iset_container_s iset_container_t;
+typedef struct iset_s iset_t;
+
+typedef int (*iset_cb)(uint32_t id, void * args);
+
+struct iset_container_s
+{
+    uint16_t key;               /* high 16 bits of the ids */
+    uint16_t pad0;
+    uint32_t len;               /* number of ids in the container */
+    uint32_t size;              /* allocated ids, 0 for a bitmap */
+    uint32_t pad1;
+    void * data;                /* sorted uint16_t array or uint64_t bitmap */
+};
+
+struct iset_s
+{
+    size_t len;
+    uint32_t n;
+    uint32_t size;
+    iset_container_t * containers;  /* sorted by key */
+};
+
+iset_t * iset_new(void);
+void iset_free(iset_t * iset);
+int iset_add(iset_t * iset, uint32_t id);
+int iset_has(iset_t * iset, uint32_t id);
+int iset_walk(iset_t * iset, iset_cb cb, void * args);
@@ -11,6 +11,8 @@
  */
 #pragma once
 
+#include <stddef.h>
+
 #ifdef __APPLE__
 #define _LOGGER_IO_FILE __sFILE
 #else
@@ -26,6 +28,7 @@
 #define LOGGER_NUM_LEVELS 5
 
 #define LOGGER_FLAG_COLORED 1
+#define LOGGER_FLAG_ASYNC 2
 
 typedef struct logger_s
 {
@@ -35,11 +38,23 @@ typedef struct logger_s
     int flags;
 } logger_t;
 
+/* log file which is rotated when it reaches max_size bytes */
+typedef struct logger_file_s
+{
+    struct _LOGGER_IO_FILE * ostream;
+    char * fn;
+    size_t size;
+    size_t max_size;
+    int max_files;      /* number of rotated files to keep (fn.1, fn.2...) */
+} logger_file_t;
+
 const char * LOGGER_LEVEL_NAMES[LOGGER_NUM_LEVELS];
 
 void logger_init(struct _LOGGER_IO_FILE * ostream, int log_level);
 void logger_set_level(int log_level);
 const char * logger_level_name(int log_level);
+int logger_async_start(size_t size);
+void logger_async_stop(void);
 
 void log__debug(char * fmt, ...);
 void log__info(char * fmt, ...);
@@ -47,6 +62,13 @@ void log__warning(char * fmt, ...);
 void log__error(char * fmt, ...);
 void log__critical(char * fmt, ...);
 
+logger_file_t * logger_file_new(
+        const char * fn,
+        size_t max_size,
+        int max_files);
+void logger_file_free(logger_file_t * lfile);
+void logger_file_write(logger_file_t * lfile, int log_level, char * fmt, ...);
+
 extern logger_t Logger;
 
 #define log_debug(fmt, ...)                 \
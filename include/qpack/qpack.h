@@ -102,6 +102,13 @@ typedef struct qp_packer_s
     char * buffer;
 } qp_packer_t;
 
+typedef struct qp_funpacker_s
+{
+    qp_unpacker_t unpacker; // window on the file
+    FILE * fp;
+    size_t size;            // maximum size of the window
+} qp_funpacker_t;
+
 typedef FILE qp_fpacker_t;
 #define qp_open fopen    // returns NULL in case of an error
 #define qp_close fclose   // 0 if successful, EOF in case of an error
@@ -112,16 +119,24 @@ qp_packer_t * qp_packer_new(size_t alloc_size);
 void qp_packer_free(qp_packer_t * packer);
 int qp_packer_extend(qp_packer_t * packer, qp_packer_t * source);
 int qp_packer_extend_fu(qp_packer_t * packer, qp_unpacker_t * unpacker);
+int qp_packer_extend_mem(qp_packer_t * packer, const char * data, size_t size);
 
 /* unpacker: create and destroy functions */
 void qp_unpacker_init(qp_unpacker_t * unpacker, char * pt, size_t len);
 void qp_unpacker_ff_free(qp_unpacker_t * unpacker);
 qp_unpacker_t * qp_unpacker_ff(const char * fn);
+qp_funpacker_t * qp_funpacker_new(const char * fn, size_t size);
+void qp_funpacker_free(qp_funpacker_t * funpacker);
+int qp_funpacker_fill(qp_funpacker_t * funpacker, size_t n);
 
 /* step functions to be used with an unpacker */
 qp_types_t qp_next(qp_unpacker_t * unpacker, qp_obj_t * qp_obj);
 qp_types_t qp_current(qp_unpacker_t * unpacker);
 qp_types_t qp_skip_next(qp_unpacker_t * unpacker);
+size_t qp_unpack_array2_numbers(
+        qp_unpacker_t * unpacker,
+        void * pairs,
+        size_t n);
 
 /* print function */
 void qp_print(char * pt, size_t len);
@@ -177,6 +192,12 @@ int qp_add_int8(qp_packer_t * packer, int8_t integer);
 int qp_add_int16(qp_packer_t * packer, int16_t integer);
 int qp_add_int32(qp_packer_t * packer, int32_t integer);
 int qp_add_int64(qp_packer_t * packer, int64_t integer);
+int qp_packer_reserve(qp_packer_t * packer, size_t size);
+int qp_add_array2_int64(qp_packer_t * packer, const void * pairs, size_t n);
+int qp_add_array2_int64_double(
+        qp_packer_t * packer,
+        const void * pairs,
+        size_t n);
 int qp_add_true(qp_packer_t * packer);
 int qp_add_false(qp_packer_t * packer);
 int qp_add_null(qp_packer_t * packer);
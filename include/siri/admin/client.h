@@ -17,10 +17,14 @@
 #include <siri/net/pkg.h>
 #include <uuid/uuid.h>
 
+/* number of request slots, requests are used as pid for the responses */
+#define SIRI_ADMIN_CLIENT_REQUESTS 8
+
 typedef struct siri_admin_client_s
 {
     uint8_t request;
     uint8_t flags;
+    uint8_t pending;  // number of pipelined requests without a response
     uint16_t pid;
     uint16_t port;
     uuid_t uuid;
@@ -31,7 +35,7 @@ typedef struct siri_admin_client_s
     char * dbname;
     char * dbpath;
     uv_stream_t * client;
-    sirinet_pkg_t * pkg;
+    sirinet_pkg_t * responses[SIRI_ADMIN_CLIENT_REQUESTS];
 } siri_admin_client_t;
 
 int siri_admin_client_request(
@@ -23,7 +23,10 @@ typedef enum
     ADMIN_NEW_REPLICA,
     ADMIN_GET_VERSION=64,
     ADMIN_GET_ACCOUNTS,
-    ADMIN_GET_DATABASES
+    ADMIN_GET_DATABASES,
+    ADMIN_GET_MEMORY,
+    ADMIN_GET_LATENCY,
+    ADMIN_GET_SYNC
 } admin_request_t;
 
 int siri_admin_request_init(void);
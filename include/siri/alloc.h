@@ -0,0 +1,31 @@
+/*
+ * alloc.h - Statistics and purging for the memory allocator.
+ *
+ * author       : Jeroen van der Heijden
+ * email        : jeroen@transceptor.technology
+ * copyright    : 2016, Transceptor Technology
+ *
+ * changes
+ *  - initial version, 14-10-2016
+ *
+ */
+#pragma once
+
+#include <inttypes.h>
+#include <stddef.h>
+
+typedef struct siri_alloc_stats_s
+{
+    size_t allocated;       /* bytes in use by the application */
+    size_t active;          /* bytes in pages which are in use */
+    size_t resident;        /* bytes which are resident in memory */
+    size_t mapped;          /* bytes which are mapped by the allocator */
+    size_t retained;        /* bytes which are kept but not in use */
+    uint32_t arenas;        /* 0 when not known */
+} siri_alloc_stats_t;
+
+const char * siri_alloc_name(void);
+void siri_alloc_stats(siri_alloc_stats_t * stats);
+double siri_alloc_fragmentation(const siri_alloc_stats_t * stats);
+void siri_alloc_purge(void);
+char * siri_alloc_summary(void);
@@ -21,3 +21,4 @@ int siri_backup_init(siri_t * siri);
 void siri_backup_destroy(siri_t * siri);
 int siri_backup_enable(siri_t * siri, siridb_t * siridb);
 int siri_backup_disable(siri_t * siri, siridb_t * siridb);
+int siri_backup_snapshot(siridb_t * siridb, char * err_msg);
@@ -7,14 +7,74 @@
 typedef struct siri_s siri_t;
 
 #define SIRI_CFG_MAX_LEN_ADDRESS 256
+#define SIRI_CFG_MAX_LEN_SEPARATORS 32
+#define SIRI_CFG_MAX_LEN_SOCKET 108  /* size of sun_path in sockaddr_un */
 
 typedef struct siri_cfg_s
 {
     uint16_t listen_client_port;
+    char listen_client_socket[SIRI_CFG_MAX_LEN_SOCKET];
     uint16_t listen_backend_port;
+    uint16_t listen_metrics_port;
     uint16_t heartbeat_interval;
     uint16_t max_open_files;
+    uint16_t optimize_threads;
+    uint8_t optimize_compact_threshold;
+    uint16_t optimize_min_chunk_points;
+    uint16_t optimize_max_chunk_points;
+    uint32_t optimize_io_limit;
+    uint32_t reindex_io_limit;
+    uint32_t initsync_io_limit;
+    uint32_t verify_io_limit;
+    uint8_t background_io_priority;
+    uint16_t shard_load_threads;
+    uint16_t select_threads;
+    uint16_t sched_threads;
+    uint16_t sched_heavy_threads;
+    uint8_t sched_numa;
+    uint16_t insert_threads;
+    uint16_t insert_window;
+    uint16_t insert_coalesce_window;
+    uint32_t max_insert_queue;
+    uint32_t max_insert_queue_size;
+    uint32_t max_fifo_files;
+    uint32_t backend_compression_threshold;
+    uint32_t backend_lanes;
+    uint32_t select_heavy_points;
+    uint32_t query_timeout;
+    uint32_t query_hedge_delay;
+    uint32_t query_step_budget;
+    uint32_t query_memory_limit;
+    uint32_t query_memory_total;
+    uint32_t slow_query_threshold;
+    uint32_t slow_query_log_size;
+    uint32_t async_log_lines;
+    char slow_query_log[PATH_MAX];
+    uint32_t capture_max_size;
+    char capture_file[PATH_MAX];
+    uint8_t lock_stats;
+    uint32_t alloc_purge_interval;
+    uint32_t auth_session_ttl;
+    uint32_t count_cache_age;
+    uint32_t cold_shard_age;
+    uint32_t index_memory_limit;
+    uint8_t fsync_mode;
+    uint32_t fsync_interval;
+    uint32_t fsync_bytes;
+    uint8_t buffer_mmap;
+    uint8_t buffer_hot_log;
+    uint32_t shard_prealloc_size;
     uint32_t optimize_interval;
+    uint32_t verify_interval;
+    uint32_t chunk_cache_size;
+    uint32_t query_cache_size;
+    uint32_t aggregate_cache_size;
+    uint32_t match_cache_size;
+    uint32_t plan_cache_size;
+    uint16_t last_points_cache;
+    uint8_t series_name_index;
+    char series_name_separators[SIRI_CFG_MAX_LEN_SEPARATORS];
+    uint8_t series_hash_index;
     uint8_t ip_support;
     char server_address[SIRI_CFG_MAX_LEN_ADDRESS];
     char default_db_path[PATH_MAX];
@@ -0,0 +1,68 @@
+/*
+ * acache.h - Cache for aggregated groups of historical series data.
+ *
+ * author       : Jeroen van der Heijden
+ * email        : jeroen@transceptor.technology
+ * copyright    : 2016, Transceptor Technology
+ *
+ * changes
+ *  - initial version, 14-10-2016
+ *
+ */
+#pragma once
+
+#include <inttypes.h>
+#include <siri/db/aggregate.h>
+#include <siri/db/points.h>
+#include <stddef.h>
+#include <uv.h>
+
+/* must be a power of 2 */
+#define SIRIDB_ACACHE_BUCKETS 4096
+
+typedef struct siridb_s siridb_t;
+typedef struct siridb_series_s siridb_series_t;
+typedef struct siridb_acache_entry_s siridb_acache_entry_t;
+
+typedef struct siridb_acache_s
+{
+    uv_mutex_t mutex;
+    size_t max_size;
+    size_t size;                        /* bytes used by the entries */
+    uint64_t hits;
+    uint64_t misses;
+    siridb_acache_entry_t * head;       /* most recently used */
+    siridb_acache_entry_t * tail;       /* least recently used */
+    siridb_acache_entry_t * buckets[SIRIDB_ACACHE_BUCKETS];
+} siridb_acache_t;
+
+siridb_acache_t * siridb_acache_new(size_t max_size);
+void siridb_acache_free(siridb_acache_t * acache);
+int siridb_acache_init(siridb_t * siridb);
+int siridb_acache_save(siridb_t * siridb);
+int siridb_acache_can_use(siridb_aggr_t * aggr);
+siridb_points_t * siridb_acache_get(
+        siridb_acache_t * acache,
+        uint32_t series_id,
+        siridb_aggr_t * aggr,
+        uint64_t * lo,
+        uint64_t * hi);
+void siridb_acache_set(
+        siridb_acache_t * acache,
+        uint32_t series_id,
+        siridb_aggr_t * aggr,
+        uint64_t lo,
+        uint64_t hi,
+        siridb_points_t * points);
+void siridb_acache_drop(
+        siridb_acache_t * acache,
+        uint32_t series_id,
+        uint64_t start_ts,
+        uint64_t end_ts);
+siridb_points_t * siridb_acache_select(
+        siridb_t *__restrict siridb,
+        siridb_series_t *__restrict series,
+        siridb_aggr_t *__restrict aggr,
+        uint64_t *__restrict start_ts,
+        uint64_t *__restrict end_ts,
+        char * err_msg);
@@ -29,13 +29,63 @@ typedef struct siridb_aggr_s
     uint64_t limit;
     uint64_t offset;
     double timespan;  // used for derivative
+    double percentile;  // used for percentile
+    uint64_t target;  // used for lttb and minmax
     qp_via_t filter_via;
 } siridb_aggr_t;
 
+/* returns the group time-stamp for a given time-stamp */
+#define SIRIDB_AGGR_GROUP_TS(aggr, ts) \
+    (((ts) + (aggr)->group_by - 1) / (aggr)->group_by * (aggr)->group_by + \
+    (aggr)->offset)
+
 siridb_points_t * siridb_aggregate_run(
         siridb_points_t * source,
         siridb_aggr_t * aggr,
         char * err_msg);
+siridb_points_t * siridb_aggregate_run_list(
+        siridb_points_t * source,
+        slist_t * alist,
+        size_t start,
+        char * err_msg);
+
+int siridb_aggregate_can_use_stats(siridb_aggr_t * aggr);
+int siridb_aggregate_filter_stats(
+        siridb_aggr_t * aggr,
+        points_tp tp,
+        const siridb_points_stats_t * stats);
+int siridb_aggregate_can_merge(siridb_aggr_t * aggr);
+void siridb_aggregate_stats_val(
+        qp_via_t * val,
+        siridb_points_stats_t * stats,
+        uint32_t len,
+        uint32_t gid);
+int siridb_aggregate_combine_val(
+        qp_via_t * val,
+        qp_via_t * other,
+        uint32_t gid,
+        points_tp tp,
+        char * err_msg);
+siridb_points_t * siridb_aggregate_combine(
+        siridb_points_t * a,
+        siridb_points_t * b,
+        uint32_t gid,
+        char * err_msg);
+siridb_points_t * siridb_aggregate_combine_partial(
+        siridb_points_t * a,
+        siridb_points_t * b,
+        uint32_t gid,
+        char * err_msg);
+int siridb_aggregate_stream(
+        siridb_points_t ** points,
+        siridb_points_t ** counts,
+        siridb_points_t * batch,
+        siridb_aggr_t * aggr,
+        char * err_msg);
+siridb_points_t * siridb_aggregate_stream_mean(
+        siridb_points_t * points,
+        siridb_points_t * counts,
+        char * err_msg);
 
 void siridb_init_aggregates(void);
 slist_t * siridb_aggregate_list(cleri_children_t * children, char * err_msg);
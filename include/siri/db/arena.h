@@ -0,0 +1,29 @@
+/*
+ * arena.h - Allocate memory which is released at once.
+ *
+ * author       : Jeroen van der Heijden
+ * email        : jeroen@transceptor.technology
+ * copyright    : 2016, Transceptor Technology
+ *
+ * changes
+ *  - initial version, 14-10-2016
+ *
+ */
+#pragma once
+
+#include <stddef.h>
+
+/* default size for a block, larger allocations get their own block */
+#define SIRIDB_ARENA_BLOCK_SZ 65536
+
+typedef struct siridb_arena_block_s siridb_arena_block_t;
+
+typedef struct siridb_arena_s
+{
+    siridb_arena_block_t * block;   /* current block, linked to older ones */
+    size_t size;                    /* total bytes allocated in blocks */
+} siridb_arena_t;
+
+siridb_arena_t * siridb_arena_new(void);
+void siridb_arena_free(siridb_arena_t * arena);
+void * siridb_arena_alloc(siridb_arena_t * arena, size_t size);
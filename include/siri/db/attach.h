@@ -0,0 +1,34 @@
+/*
+ * attach.h - Attach shard files which are produced outside the server.
+ *
+ * author       : Jeroen van der Heijden
+ * email        : jeroen@transceptor.technology
+ * copyright    : 2016, Transceptor Technology
+ *
+ * changes
+ *  - initial version, 14-10-2016
+ *
+ */
+#pragma once
+
+#include <inttypes.h>
+#include <sys/types.h>
+
+#define SIRIDB_ATTACH_SERIES_FN "series.map"
+
+typedef struct siridb_s siridb_t;
+typedef struct siridb_series_s siridb_series_t;
+
+/*
+ * A series from the series map of the shard files which are attached.
+ */
+typedef struct siridb_attach_series_s
+{
+    uint32_t id;                /* local series id, 0 for a new series */
+    uint16_t mask;
+    uint8_t tp;
+    char * name;
+    siridb_series_t * series;   /* NULL until the series exists */
+} siridb_attach_series_t;
+
+ssize_t siridb_attach(siridb_t * siridb, const char * path, char * err_msg);
@@ -14,12 +14,20 @@
 #include <stddef.h>
 #include <siri/net/clserver.h>
 #include <qpack/qpack.h>
+#include <siri/net/pkg.h>
 #include <siri/net/protocol.h>
 
-cproto_server_t siridb_auth_user_request(
+void siridb_auth_user_request(
         uv_stream_t * client,
+        sirinet_pkg_t * pkg,
         qp_obj_t * qp_username,
         qp_obj_t * qp_password,
+        qp_obj_t * qp_dbname,
+        int session);
+void siridb_auth_session_request(
+        uv_stream_t * client,
+        sirinet_pkg_t * pkg,
+        qp_obj_t * qp_token,
         qp_obj_t * qp_dbname);
 
 bproto_server_t siridb_auth_server_request(
@@ -17,6 +17,30 @@
 
 #define MAX_BUFFER_SZ 10485760
 
+#define SIRIDB_BUFFER_FN "buffer.dat"
+
+/* number of points which fit in the buffer of a series (in memory) */
+#define siridb_buffer_len(siridb, series) \
+    ((siridb)->buffer_len << (series)->bf_class)
+
+/* memory allocated for the buffer of a series in bytes */
+#define siridb_buffer_mem(siridb, series) \
+    ((size_t) (series)->bf_cap * sizeof(siridb_point_t))
+
+/*
+ * Buffers are allocated on the first write, starting with this number of
+ * points, and grow by doubling up to siridb_buffer_len().
+ */
+#define SIRIDB_BUFFER_MIN_CAP 16
+
+/*
+ * Make room for 'n' more points in the buffer of a series.
+ * Returns 0 if successful or -1 and a SIGNAL is raised in case of an error.
+ */
+#define siridb_buffer_reserve(siridb, series, n__)                  \
+    (((series)->buffer->len + (n__) <= (series)->bf_cap) ? 0 :      \
+            siridb__buffer_grow(siridb, series, n__))
+
 typedef struct siridb_s siridb_t;
 typedef struct siridb_series_s siridb_series_t;
 typedef struct siridb_points_s siridb_points_t;
@@ -29,6 +53,19 @@ int siridb_buffer_open(siridb_t * siridb);
 
 int siridb_buffer_load(siridb_t * siridb);
 
+int siridb_buffer_reset(
+        siridb_t * siridb,
+        siridb_series_t * series);
+
+int siridb__buffer_grow(
+        siridb_t * siridb,
+        siridb_series_t * series,
+        size_t n);
+
+int siridb_buffer_close(siridb_t * siridb);
+
+int siridb_buffer_sync(siridb_t * siridb);
+
 int siridb_buffer_write_len(
         siridb_t * siridb,
         siridb_series_t * series);
@@ -39,3 +76,9 @@ int siridb_buffer_write_point(
         siridb_series_t * series,
         uint64_t * ts,
         qp_via_t * val);
+
+int siridb_buffer_write_points(
+        siridb_t * siridb,
+        siridb_series_t * series,
+        siridb_point_t * points,
+        size_t n);
@@ -0,0 +1,57 @@
+/*
+ * ccache.h - Cache for decoded shard chunks.
+ *
+ * author       : Jeroen van der Heijden
+ * email        : jeroen@transceptor.technology
+ * copyright    : 2016, Transceptor Technology
+ *
+ * changes
+ *  - initial version, 14-10-2016
+ *
+ */
+#pragma once
+
+#include <inttypes.h>
+#include <stddef.h>
+#include <uv.h>
+#include <siri/db/points.h>
+
+/* must be a power of 2 */
+#define SIRIDB_CCACHE_BUCKETS 4096
+
+typedef struct siridb_shard_s siridb_shard_t;
+typedef struct siridb_ccache_entry_s siridb_ccache_entry_t;
+
+typedef struct siridb_ccache_s
+{
+    uv_mutex_t mutex;
+    size_t max_size;
+    size_t size;                        /* bytes used by the entries */
+    uint64_t hits;
+    uint64_t misses;
+    siridb_ccache_entry_t * head;       /* most recently used */
+    siridb_ccache_entry_t * tail;       /* least recently used */
+    siridb_ccache_entry_t * buckets[SIRIDB_CCACHE_BUCKETS];
+} siridb_ccache_t;
+
+siridb_ccache_t * siridb_ccache_new(size_t max_size);
+void siridb_ccache_free(siridb_ccache_t * ccache);
+int siridb_ccache_get(
+        siridb_ccache_t * ccache,
+        siridb_shard_t * shard,
+        uint32_t pos,
+        siridb_point_t * dest,
+        uint16_t len);
+void siridb_ccache_set(
+        siridb_ccache_t * ccache,
+        siridb_shard_t * shard,
+        uint32_t pos,
+        const siridb_point_t * points,
+        uint16_t len);
+void siridb_ccache_drop(
+        siridb_ccache_t * ccache,
+        siridb_shard_t * shard,
+        uint32_t pos);
+void siridb_ccache_drop_shard(
+        siridb_ccache_t * ccache,
+        siridb_shard_t * shard);
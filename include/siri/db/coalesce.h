@@ -0,0 +1,41 @@
+/*
+ * coalesce.h - Merge inserts which are forwarded to the same pool.
+ *
+ * author       : Jeroen van der Heijden
+ * email        : jeroen@transceptor.technology
+ * copyright    : 2016, Transceptor Technology
+ *
+ * changes
+ *  - initial version, 14-10-2016
+ *
+ */
+#pragma once
+
+#include <inttypes.h>
+#include <qpack/qpack.h>
+#include <siri/db/db.h>
+#include <siri/net/promises.h>
+#include <slist/slist.h>
+#include <uv.h>
+
+#define SIRIDB_COALESCE_MAX_SIZE 1048576  // 1 MB
+
+typedef struct siridb_s siridb_t;
+typedef struct sirinet_promises_s sirinet_promises_t;
+
+typedef struct siridb_coalesce_s
+{
+    uint16_t pool;              /* pool index, pools can be re-allocated */
+    uint8_t tp;                 /* package type for the merged insert */
+    siridb_t * siridb;
+    qp_packer_t * packer;       /* merged insert map */
+    slist_t * waiters;          /* sirinet_promises_t waiting for the pool */
+    uv_timer_t * timer;
+} siridb_coalesce_t;
+
+int siridb_coalesce_add(
+        siridb_t * siridb,
+        uint16_t pool,
+        uint8_t tp,
+        qp_packer_t * packer,
+        sirinet_promises_t * promises);
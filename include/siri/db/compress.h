@@ -0,0 +1,90 @@
+/*
+ * compress.h - Compression for shard chunks.
+ *
+ * author       : Jeroen van der Heijden
+ * email        : jeroen@transceptor.technology
+ * copyright    : 2016, Transceptor Technology
+ *
+ * changes
+ *  - initial version, 14-10-2016
+ *
+ */
+#pragma once
+
+#include <inttypes.h>
+#include <stddef.h>
+#include <siri/db/points.h>
+
+/*
+ * Returns the maximum number of bytes required to compress a chunk of
+ * 'len' points. One point uses at most 69 bits for the time-stamp and 77 bits
+ * for the value, the first point uses at most 128 bits. One byte is added
+ * for the encoding, see siridb_compress_chunk().
+ */
+#define SIRIDB_COMPRESS_MAX_SZ(len) ((len) * 19 + 17)
+
+/* encoding of a chunk written by siridb_compress_chunk() */
+#define SIRIDB_COMPRESS_ENC_XOR 0   /* delta-of-delta and XOR values */
+#define SIRIDB_COMPRESS_ENC_FOR 1   /* frame of reference, integers only */
+
+/*
+ * Maximum number of bytes which are stored for a log value. Together with
+ * DEFAULT_MAX_CHUNK_SZ_LOG this makes sure a log chunk always fits in the
+ * uint16_t LOG_SZ field of the index.
+ */
+#define SIRIDB_COMPRESS_LOG_MAX_LEN 999
+
+/*
+ * Returns the maximum number of bytes required for a log chunk of 'len'
+ * points where 'values_sz' is the result of siridb_compress_log_values_sz().
+ */
+#define SIRIDB_COMPRESS_LOG_MAX_SZ(len, ts_sz, values_sz) \
+    ((len) * ((ts_sz) + 2) + 2 + (values_sz))
+
+size_t siridb_compress_num(
+        unsigned char * buf,
+        siridb_points_t * points,
+        uint_fast32_t start,
+        uint_fast32_t end,
+        size_t ts_sz);
+
+int siridb_compress_num_decode(
+        siridb_point_t * dest,
+        const unsigned char * buf,
+        size_t size,
+        uint16_t len,
+        size_t ts_sz);
+
+size_t siridb_compress_chunk(
+        unsigned char * buf,
+        siridb_points_t * points,
+        uint_fast32_t start,
+        uint_fast32_t end,
+        size_t ts_sz);
+
+int siridb_compress_chunk_decode(
+        siridb_point_t * dest,
+        const unsigned char * buf,
+        size_t size,
+        uint16_t len,
+        size_t ts_sz);
+
+size_t siridb_compress_log_values_sz(
+        siridb_points_t * points,
+        uint_fast32_t start,
+        uint_fast32_t end);
+
+size_t siridb_compress_log(
+        unsigned char * buf,
+        siridb_points_t * points,
+        uint_fast32_t start,
+        uint_fast32_t end,
+        size_t ts_sz);
+
+int siridb_compress_log_decode(
+        siridb_points_t * points,
+        siridb_point_t * dest,
+        const unsigned char * buf,
+        size_t size,
+        uint16_t len,
+        size_t ts_sz);
@@ -0,0 +1,42 @@
+/*
+ * continuous.h - Continuous queries executed by the server.
+ *
+ * author       : Jeroen van der Heijden
+ * email        : jeroen@transceptor.technology
+ * copyright    : 2016, Transceptor Technology
+ *
+ * changes
+ *  - initial version, 14-10-2016
+ *
+ */
+#pragma once
+
+#include <cfgparser/cfgparser.h>
+#include <inttypes.h>
+#include <siri/db/re.h>
+#include <slist/slist.h>
+#include <stddef.h>
+
+#define SIRIDB_CONTINUOUS_SECTION "continuous"
+
+typedef struct siridb_s siridb_t;
+
+/*
+ * A continuous query, read from the [continuous] section in database.conf.
+ * The result for a series is written to a series named "<name>.<series>".
+ */
+typedef struct siridb_continuous_s
+{
+    char * name;
+    char * source;          /* regular expression or group name */
+    size_t name_len;
+    uint64_t interval;      /* in the time precision of the database */
+    uint64_t last;          /* intervals up to 'last' are written */
+    uint32_t gid;           /* aggregate function */
+    siridb_re_t * re;
+} siridb_continuous_t;
+
+int siridb_continuous_read(siridb_t * siridb, cfgparser_t * cfgparser);
+int siridb_continuous_init(siridb_t * siridb);
+void siridb_continuous_run(siridb_t * siridb);
+void siridb_continuous_free(slist_t * continuous);
@@ -0,0 +1,62 @@
+/*
+ * cpoints.h - Columnar points for processing values.
+ *
+ * author       : Jeroen van der Heijden
+ * email        : jeroen@transceptor.technology
+ * copyright    : 2016, Transceptor Technology
+ *
+ * changes
+ *  - initial version, 14-10-2016
+ *
+ */
+#pragma once
+
+#include <siri/db/points.h>
+#include <siri/db/variance.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct siridb_cpoints_s
+{
+    size_t len;
+    points_tp tp;       /* TP_INT or TP_DOUBLE */
+    uint64_t * ts;
+    union
+    {
+        int64_t * int64;
+        double * real;
+    } val;
+} siridb_cpoints_t;
+
+void siridb_cpoints_init(void);
+const char * siridb_cpoints_kernels(void);
+siridb_cpoints_t * siridb_cpoints_from_points(siridb_points_t * points);
+void siridb_cpoints_free(siridb_cpoints_t * cpoints);
+size_t siridb_cpoints_group_end(
+        siridb_cpoints_t * cpoints,
+        size_t start,
+        uint64_t group_ts);
+void siridb_cpoints_max(
+        siridb_cpoints_t * cpoints,
+        size_t start,
+        size_t end,
+        qp_via_t * val);
+void siridb_cpoints_min(
+        siridb_cpoints_t * cpoints,
+        size_t start,
+        size_t end,
+        qp_via_t * val);
+int siridb_cpoints_sum(
+        siridb_cpoints_t * cpoints,
+        size_t start,
+        size_t end,
+        qp_via_t * val);
+double siridb_cpoints_mean(
+        siridb_cpoints_t * cpoints,
+        size_t start,
+        size_t end);
+void siridb_cpoints_variance(
+        siridb_cpoints_t * cpoints,
+        size_t start,
+        size_t end,
+        siridb_variance_t * state);
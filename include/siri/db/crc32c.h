@@ -0,0 +1,19 @@
+/*
+ * crc32c.h - CRC32C (Castagnoli) checksums for shard chunks.
+ *
+ * author       : Jeroen van der Heijden
+ * email        : jeroen@transceptor.technology
+ * copyright    : 2016, Transceptor Technology
+ *
+ * changes
+ *  - initial version, 14-10-2016
+ *
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+void siridb_crc32c_init(void);
+const char * siridb_crc32c_impl(void);
+uint32_t siridb_crc32c(uint32_t crc, const void * data, size_t n);
@@ -18,6 +18,7 @@
 #include <siri/db/server.h>
 #include <siri/db/pools.h>
 #include <ctree/ctree.h>
+#include <imap/dmap.h>
 #include <imap/imap.h>
 #include <imap/imap.h>
 #include <iso8601/iso8601.h>
@@ -28,16 +29,29 @@
 #include <siri/db/replicate.h>
 #include <siri/db/reindex.h>
 #include <siri/db/groups.h>
+#include <siri/mutex.h>
+#include <siri/sched.h>
+#include <siri/db/startup.h>
+#include <siri/throttle.h>
 
 #define SIRIDB_MAX_SIZE_ERR_MSG 1024
 #define SIRIDB_MAX_DBNAME_LEN 256  // 255 + NULL
 #define SIRIDB_SCHEMA 2
 #define SIRIDB_FLAG_REINDEXING 1
+#define SIRIDB_FLAG_COMPACTING 2
 
 #define DEF_DROP_THRESHOLD 1.0              // 100%
 #define DEF_SELECT_POINTS_LIMIT 1000000     // one million
 #define DEF_LIST_LIMIT 10000                // ten thousand
 
+#define SIRIDB_RESOURCES_SECTION "resources"
+
+/* buffer slots of class n are 2^n times the buffer_size */
+#define SIRIDB_BUFFER_CLASSES 4
+
+/* number of series types: TP_INT, TP_DOUBLE and TP_STRING */
+#define SIRIDB_SERIES_TP_NUM 3
+
 #define SIRIDB_GET_FN(FN, __path, FILENAME)                         \
     char FN[strlen(__path) + strlen(FILENAME) + 1];                 \
     sprintf(FN, "%s%s", __path, FILENAME);
@@ -66,17 +80,30 @@ typedef struct siridb_pools_s siridb_pools_t;
 typedef struct ct_node_s ct_node_t;
 typedef struct imap_s imap_t;
 typedef struct imap_s imap_t;
+typedef struct dmap_s dmap_t;
 typedef struct siridb_fifo_s siridb_fifo_t;
 typedef struct siridb_replicate_s siridb_replicate_t;
 typedef struct siridb_reindex_s siridb_reindex_t;
 typedef struct siridb_groups_s siridb_groups_t;
+typedef struct siridb_qcache_s siridb_qcache_t;
+typedef struct siridb_acache_s siridb_acache_t;
+typedef struct siridb_mcache_s siridb_mcache_t;
+typedef struct siridb_downsample_s siridb_downsample_t;
+typedef struct siridb_trigrams_s siridb_trigrams_t;
+typedef struct siridb_names_s siridb_names_t;
+typedef struct siridb_tokens_s siridb_tokens_t;
+typedef struct siridb_shash_s siridb_shash_t;
+typedef struct siridb_subscriptions_s siridb_subscriptions_t;
+typedef struct siridb_hotlog_s siridb_hotlog_t;
+typedef struct siridb_hot_s siridb_hot_t;
 
 typedef struct siridb_s
 {
     uint16_t ref;
     uint8_t flags;
-    uint8_t pad0;
+    uint8_t pool_hash;                  // SIRIDB_LOOKUP_HASH_SUM or _FNV
     uint32_t max_series_id;
+    uint32_t store_pending;             // new series not flushed to the store
     uint16_t active_tasks;
     uint16_t insert_tasks;
     uint16_t shard_mask_num;
@@ -88,15 +115,23 @@ typedef struct siridb_s
     size_t buffer_size;
     size_t buffer_len;
     time_t start_ts;                    // in seconds, to calculate up-time.
+    siridb_startup_t startup;           // time spent in each loading phase
     uint64_t duration_num;              // number duration in s, ms, us or ns
     uint64_t duration_log;              // log duration in s, ms, us or ns
+    uint64_t expiration_num;            // drop older number shards, 0=never
+    uint64_t expiration_log;            // drop older log shards, 0=never
     char * dbname;
     char * dbpath;
     char * buffer_path;
     double drop_threshold;
     size_t received_points;
     size_t selected_points;
-    slist_t * empty_buffers;
+    uint32_t insert_queue;              // client inserts in progress
+    size_t insert_queue_size;           // bytes used by insert_queue
+    uint64_t data_version;              // incremented on each series change
+    uint64_t series_gen;                // incremented on series create/drop
+    uint64_t query_id;                  // id of the last started query
+    slist_t * empty_buffers[SIRIDB_BUFFER_CLASSES];
     siridb_time_t * time;
     siridb_server_t * server;
     siridb_server_t * replica;
@@ -104,24 +139,49 @@ typedef struct siridb_s
     llist_t * servers;
     siridb_pools_t * pools;
     ct_t * series;
-    imap_t * series_map;
-    uv_mutex_t series_mutex;
-    uv_mutex_t shards_mutex;
+    dmap_t * series_map;
+    siridb_names_t * names;             // storage for the series names
+    siridb_trigrams_t * trigrams;       // series name index or NULL
+    siridb_tokens_t * tokens;           // name component index or NULL
+    siridb_shash_t * shash;             // series name hash index or NULL
+    dmap_t * series_tp[SIRIDB_SERIES_TP_NUM];  // series by type or NULL
+    siri_rwlock_t series_mutex;         // shared while selects read points
+    siri_mutex_t shards_mutex;
     imap_t * shards;
+    uint64_t shards_gen;                // incremented on shard add/replace/pop
+    size_t cold_shards;                 // shards with an index not loaded
+    uint16_t shard_dclasses;            // bit for each used shard duration
+    uint32_t index_memory_limit;        // in MB, 0=use the global limit
+    siri_sched_limit_t sched_limit;     // scheduler threads for selects
+    siri_throttle_t optimize_throttle;  // optimize I/O limit in MB/s
     FILE * buffer_fp;
+    char * buffer_map;                  // mapped buffer file or NULL
+    size_t buffer_map_sz;
+    siridb_hotlog_t * hotlog;           // log for hot series or NULL
     FILE * dropped_fp;
     qp_fpacker_t * store;
     siridb_fifo_t * fifo;
     siridb_replicate_t * replicate;
     siridb_reindex_t * reindex;
     siridb_groups_t * groups;
+    slist_t * rollups;                  // rollup definitions or NULL
+    slist_t * durations;                // shard durations or NULL
+    slist_t * continuous;               // continuous queries or NULL
+    siridb_downsample_t * downsample;   // downsample policy or NULL
+    siridb_qcache_t * qcache;           // select result cache or NULL
+    siridb_acache_t * acache;           // aggregated groups cache or NULL
+    siridb_mcache_t * mcache;           // regex match cache or NULL
+    imap_t * queries;                   // running queries by id
+    siridb_subscriptions_t * subscriptions;  // push subscriptions or NULL
+    ct_t * sessions;                    // auth session tokens or NULL
+    siridb_hot_t * hot;                 // series with the most points
 } siridb_t;
 
 int siridb_is_db_path(const char * dbpath);
 siridb_t * siridb_new(const char * dbpath, int lock_flags);
 siridb_t * siridb_get(llist_t * siridb_list, const char * dbname);
 void siridb_decref_cb(siridb_t * siridb, void * args);
-ssize_t siridb_get_file(char ** buffer, siridb_t * siridb);
+void siridb_get_fn(char * fn, siridb_t * siridb);
 int siridb_open_files(siridb_t * siridb);
 int siridb_save(siridb_t * siridb);
 void siridb__free(siridb_t * siridb);
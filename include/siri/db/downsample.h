@@ -0,0 +1,52 @@
+/*
+ * downsample.h - Downsample old number shards while optimizing.
+ *
+ * author       : Jeroen van der Heijden
+ * email        : jeroen@transceptor.technology
+ * copyright    : 2016, Transceptor Technology
+ *
+ * changes
+ *  - initial version, 14-10-2016
+ *
+ */
+#pragma once
+
+#include <cfgparser/cfgparser.h>
+#include <inttypes.h>
+#include <siri/db/points.h>
+#include <slist/slist.h>
+#include <stddef.h>
+
+#define SIRIDB_DOWNSAMPLE_SECTION "downsample"
+
+typedef struct siridb_s siridb_t;
+typedef struct siridb_shard_s siridb_shard_t;
+
+typedef enum
+{
+    SIRIDB_DOWNSAMPLE_MEAN,
+    SIRIDB_DOWNSAMPLE_MIN,
+    SIRIDB_DOWNSAMPLE_MAX,
+    SIRIDB_DOWNSAMPLE_LAST
+} siridb_downsample_tp_t;
+
+/*
+ * The downsample policy, read from the [downsample] section in
+ * database.conf. Only the optimize task uses 'cutoff' and 'done'.
+ */
+typedef struct siridb_downsample_s
+{
+    uint64_t age;           /* in the time precision of the database */
+    uint64_t interval;      /* in the time precision of the database */
+    siridb_downsample_tp_t tp;
+    uint64_t cutoff;        /* shards ending before are downsampled */
+    uint64_t done;          /* shards ending before are already downsampled */
+} siridb_downsample_t;
+
+int siridb_downsample_read(siridb_t * siridb, cfgparser_t * cfgparser);
+void siridb_downsample_prepare(siridb_t * siridb, slist_t * shards);
+int siridb_downsample_shard(siridb_t * siridb, siridb_shard_t * shard);
+int siridb_downsample_commit(siridb_t * siridb);
+size_t siridb_downsample_points(
+        siridb_downsample_t * downsample,
+        siridb_points_t * points);
@@ -0,0 +1,51 @@
+/*
+ * durations.h - Shard durations for groups of number series.
+ *
+ * author       : Jeroen van der Heijden
+ * email        : jeroen@transceptor.technology
+ * copyright    : 2016, Transceptor Technology
+ *
+ * changes
+ *  - initial version, 14-10-2016
+ *
+ */
+#pragma once
+
+#include <cfgparser/cfgparser.h>
+#include <inttypes.h>
+#include <siri/db/re.h>
+#include <slist/slist.h>
+
+#define SIRIDB_DURATIONS_SECTION "shard_duration"
+
+/* number of shard durations which can be used, see durations_hours */
+#define SIRIDB_DURATIONS_SZ 12
+
+typedef struct siridb_s siridb_t;
+typedef struct siridb_series_s siridb_series_t;
+
+/*
+ * A shard duration for the series matching a regular expression or group,
+ * read from the [shard_duration] section in database.conf.
+ */
+typedef struct siridb_duration_s
+{
+    char * name;
+    char * source;          /* regular expression or group name */
+    uint8_t dclass;         /* 1 + the position in durations_hours */
+    siridb_re_t * re;
+} siridb_duration_t;
+
+int siridb_durations_read(siridb_t * siridb, cfgparser_t * cfgparser);
+int siridb_durations_init(siridb_t * siridb);
+void siridb_durations_free(slist_t * durations);
+void siridb_durations_add_series(siridb_t * siridb, siridb_series_t * series);
+uint64_t siridb_durations_get(siridb_t * siridb, uint8_t dclass);
+uint8_t siridb_durations_class(siridb_t * siridb, uint64_t id);
+uint64_t siridb_durations_by_id(siridb_t * siridb, uint8_t tp, uint64_t id);
+uint16_t siridb_durations_mask(siridb_t * siridb, uint8_t tp, uint64_t id);
+uint64_t siridb_durations_shard_id(
+        siridb_t * siridb,
+        siridb_series_t * series,
+        uint64_t ts,
+        uint64_t * duration);
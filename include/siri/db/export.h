@@ -0,0 +1,42 @@
+/*
+ * export.h - Binary export and import of series data.
+ *
+ * author       : Jeroen van der Heijden
+ * email        : jeroen@transceptor.technology
+ * copyright    : 2016, Transceptor Technology
+ *
+ * changes
+ *  - initial version, 14-10-2016
+ *
+ */
+#pragma once
+
+#include <inttypes.h>
+#include <qpack/qpack.h>
+#include <siri/db/points.h>
+#include <siri/db/time.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+#define SIRIDB_EXPORT_VERSION 0
+
+typedef struct siridb_s siridb_t;
+
+int siridb_export_points(
+        qp_packer_t * packer,
+        siridb_points_t * points,
+        siridb_time_t * time);
+siridb_points_t * siridb_export_unpack(
+        const char * data,
+        size_t size,
+        siridb_time_t * time,
+        char * err_msg);
+int siridb_export(
+        siridb_t * siridb,
+        qp_unpacker_t * unpacker,
+        qp_packer_t * packer,
+        char * err_msg);
+ssize_t siridb_import(
+        siridb_t * siridb,
+        qp_unpacker_t * unpacker,
+        char * err_msg);
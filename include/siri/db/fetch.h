@@ -0,0 +1,43 @@
+/*
+ * fetch.h - Fetch points for series by name without a query.
+ *
+ * author       : Jeroen van der Heijden
+ * email        : jeroen@transceptor.technology
+ * copyright    : 2016, Transceptor Technology
+ *
+ * changes
+ *  - initial version, 14-10-2016
+ *
+ */
+#pragma once
+
+#include <qpack/qpack.h>
+#include <siri/db/aggregate.h>
+#include <siri/latency.h>
+#include <siri/net/pkg.h>
+#include <uv.h>
+
+#define SIRIDB_FETCH_TIMEOUT 10000  // 10 seconds
+
+typedef struct siridb_s siridb_t;
+
+typedef struct siridb_fetch_s
+{
+    siridb_t * siridb;
+    uv_stream_t * client;
+    uint16_t pid;
+    uint16_t npools;            /* number of pools which are requested */
+    qp_packer_t * packer;       /* response map */
+    siri_latency_timer_t latency;
+} siridb_fetch_t;
+
+int siridb_fetch(
+        siridb_t * siridb,
+        uv_stream_t * client,
+        sirinet_pkg_t * pkg,
+        char * err_msg);
+int siridb_fetch_local(
+        siridb_t * siridb,
+        qp_unpacker_t * unpacker,
+        qp_packer_t * packer,
+        char * err_msg);
@@ -28,9 +28,14 @@ typedef struct siridb_ffile_s
     FILE * fp;
     int fd;
     long int size;
+    char * map;         // shared memory map of the file, or NULL
+    size_t map_size;
+    long int pop_end;   // end of the package for siridb_ffile_pop_next()
+    uint32_t pop_size;  // size of the package for siridb_ffile_pop_next()
 } siridb_ffile_t;
 
 void siridb_ffile_open(siridb_ffile_t * ffile, const char * opentype);
+int siridb_ffile_close(siridb_ffile_t * ffile);
 siridb_ffile_t * siridb_ffile_new(
         uint64_t id,
         const char * path,
@@ -39,6 +44,7 @@ int siridb_ffile_check_fn(const char * fn);
 void siridb_ffile_free(siridb_ffile_t * ffile);
 void siridb_ffile_unlink(siridb_ffile_t * ffile);
 sirinet_pkg_t * siridb_ffile_pop(siridb_ffile_t * ffile);
+sirinet_pkg_t * siridb_ffile_pop_next(siridb_ffile_t * ffile);
 int siridb_ffile_pop_commit(siridb_ffile_t * ffile);
 siridb_ffile_result_t siridb_ffile_append(
         siridb_ffile_t * ffile,
@@ -13,7 +13,7 @@
 
 #include <slist/slist.h>
 #include <siri/db/series.h>
-#include <pcre.h>
+#include <siri/db/re.h>
 
 #define GROUP_FLAG_INIT 1
 #define GROUP_FLAG_DROPPED 2
@@ -28,8 +28,7 @@ typedef struct siridb_group_s
     char * name;
     char * source;  /* pattern/flags representation */
     slist_t * series;
-    pcre * regex;
-    pcre_extra * regex_extra;
+    siridb_re_t * re;
 } siridb_group_t;
 
 siridb_group_t * siridb_group_new(
@@ -25,6 +25,7 @@ typedef enum
 } siridb_groups_status_t;
 
 
+/* all groups must be cleaned since dropped series could not be tracked */
 #define GROUPS_FLAG_DROPPED_SERIES 1
 
 typedef struct siridb_groups_s
@@ -35,6 +36,7 @@ typedef struct siridb_groups_s
     char * fn;
     ct_t * groups;
     slist_t * nseries;  /* list of series we need to assign to groups */
+    slist_t * dseries;  /* list of series we need to remove from groups */
     slist_t * ngroups;  /* list of groups which need initialization */
     uv_mutex_t mutex;
     uv_work_t work;
@@ -43,7 +45,7 @@ typedef struct siridb_groups_s
 siridb_groups_t * siridb_groups_new(siridb_t * siridb);
 void siridb_groups_start(siridb_groups_t * groups);
 int siridb_groups_save(siridb_groups_t * groups);
-ssize_t siridb_groups_get_file(char ** buffer, siridb_t * siridb);
+void siridb_groups_get_fn(char * fn, siridb_t * siridb);
 void siridb_groups_init_nseries(siridb_groups_t * groups);
 sirinet_pkg_t * siridb_groups_pkg(siridb_groups_t * groups, uint16_t pid);
 int siridb_groups_drop_group(
@@ -61,3 +63,6 @@ int siridb_groups_add_group(
 int siridb_groups_add_series(
         siridb_groups_t * groups,
         siridb_series_t * series);
+void siridb_groups_drop_series(
+        siridb_groups_t * groups,
+        siridb_series_t * series);
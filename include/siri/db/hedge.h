@@ -0,0 +1,44 @@
+/*
+ * hedge.h - Send a query to both servers in a pool when one is slow.
+ *
+ * author       : Jeroen van der Heijden
+ * email        : jeroen@transceptor.technology
+ * copyright    : 2016, Transceptor Technology
+ *
+ * changes
+ *  - initial version, 14-10-2016
+ *
+ */
+#pragma once
+
+#include <inttypes.h>
+#include <siri/db/pool.h>
+#include <siri/db/server.h>
+#include <siri/net/pkg.h>
+#include <siri/net/promises.h>
+#include <uv.h>
+
+typedef struct siridb_pool_s siridb_pool_t;
+typedef struct siridb_server_s siridb_server_t;
+typedef struct sirinet_promises_s sirinet_promises_t;
+
+typedef struct siridb_hedge_s
+{
+    uint8_t n;                  /* sent requests without a response */
+    uint8_t sent;               /* number of servers which got the query */
+    uint8_t done;               /* a response is passed to 'promises' */
+    int flags;
+    uint64_t timeout;
+    siridb_server_t * server;   /* server which received the query */
+    siridb_server_t * other;    /* server for the hedged request */
+    sirinet_pkg_t * pkg;        /* copy which is owned by the hedge */
+    sirinet_promises_t * promises;
+    uv_timer_t * timer;
+} siridb_hedge_t;
+
+int siridb_hedge_send(
+        siridb_pool_t * pool,
+        sirinet_pkg_t * pkg,
+        uint64_t timeout,
+        sirinet_promises_t * promises,
+        int flags);
@@ -0,0 +1,71 @@
+/*
+ * hot.h - Heavy hitter sketches for inserted and selected points.
+ *
+ * author       : Jeroen van der Heijden
+ * email        : jeroen@transceptor.technology
+ * copyright    : 2016, Transceptor Technology
+ *
+ * changes
+ *  - initial version, 14-10-2016
+ *
+ */
+#pragma once
+
+#include <imap/imap.h>
+#include <inttypes.h>
+#include <stddef.h>
+#include <uv.h>
+
+#define SIRIDB_HOT_SIZE 128         // counters for each sketch
+#define SIRIDB_HOT_TOP 10           // series in the summary
+#define SIRIDB_HOT_DECAY 300        // seconds, counts are halved
+
+typedef struct siridb_s siridb_t;
+
+/* Warning: do not change the order! (maps to hot_str) */
+typedef enum
+{
+    SIRIDB_HOT_INSERT,
+    SIRIDB_HOT_SELECT,
+
+    SIRIDB_HOT_END
+} siridb_hot_tp_t;
+
+typedef struct siridb_hot_counter_s
+{
+    uint32_t series_id;
+    uint32_t pos;                   /* position in the heap */
+    uint64_t count;
+    uint64_t error;                 /* count might be too high by this */
+} siridb_hot_counter_t;
+
+typedef struct siridb_hot_sketch_s
+{
+    uint64_t total;                 /* points, also for untracked series */
+    uint32_t len;
+    imap_t * counters;              /* counters by series id */
+    siridb_hot_counter_t * heap[SIRIDB_HOT_SIZE];   /* min-heap on count */
+    siridb_hot_counter_t counter[SIRIDB_HOT_SIZE];
+} siridb_hot_sketch_t;
+
+typedef struct siridb_hot_s
+{
+    uv_mutex_t lock;
+    uint64_t decayed;               /* uv_now() of the last decay */
+    siridb_hot_sketch_t sketch[SIRIDB_HOT_END];
+} siridb_hot_t;
+
+siridb_hot_t * siridb_hot_new(void);
+void siridb_hot_free(siridb_hot_t * hot);
+void siridb_hot_add(
+        siridb_hot_t * hot,
+        siridb_hot_tp_t tp,
+        uint32_t series_id,
+        uint64_t n);
+void siridb_hot_decay(siridb_hot_t * hot);
+size_t siridb_hot_top(
+        siridb_hot_t * hot,
+        siridb_hot_tp_t tp,
+        siridb_hot_counter_t * top,
+        size_t n);
+char * siridb_hot_summary(siridb_t * siridb);
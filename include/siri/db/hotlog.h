@@ -0,0 +1,74 @@
+/*
+ * hotlog.h - Sequential log for series which fill their buffer constantly.
+ *
+ * author       : Jeroen van der Heijden
+ * email        : jeroen@transceptor.technology
+ * copyright    : 2016, Transceptor Technology
+ *
+ * changes
+ *  - initial version, 14-10-2016
+ *
+ */
+#pragma once
+
+#include <imap/imap.h>
+#include <inttypes.h>
+#include <siri/db/points.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#define SIRIDB_HOTLOG_FN "hotlog.dat"
+
+/* the log is rotated after an insert when it grows beyond this size */
+#define SIRIDB_HOTLOG_MAX_SZ 67108864
+
+/* size of the log header (generation) */
+#define SIRIDB_HOTLOG_HEADER_SZ sizeof(uint64_t)
+
+/*
+ * The buffer slot of a hot series has a marker in the length field. The
+ * marker holds the generation of the log and the position of the first
+ * record for the points in memory. The buffer class is stored above the
+ * marker, in the same way as for the length.
+ */
+#define SIRIDB_HOTLOG_HOT_BIT (((size_t) 1) << 55)
+#define SIRIDB_HOTLOG_POS_BITS 39
+#define SIRIDB_HOTLOG_POS_MASK ((((size_t) 1) << SIRIDB_HOTLOG_POS_BITS) - 1)
+
+#define siridb_hotlog_marker(gen, pos)                          \
+    (SIRIDB_HOTLOG_HOT_BIT |                                    \
+    ((size_t) (uint16_t) (gen) << SIRIDB_HOTLOG_POS_BITS) |     \
+    ((size_t) (pos) & SIRIDB_HOTLOG_POS_MASK))
+#define siridb_hotlog_marker_gen(marker) \
+    ((uint16_t) ((marker) >> SIRIDB_HOTLOG_POS_BITS))
+#define siridb_hotlog_marker_pos(marker) \
+    ((size_t) (marker) & SIRIDB_HOTLOG_POS_MASK)
+
+/* true when points for hot series can be written to the log */
+#define siridb_hotlog_is_open(siridb) \
+    ((siridb)->hotlog != NULL && (siridb)->hotlog->fp != NULL)
+
+typedef struct siridb_s siridb_t;
+typedef struct siridb_series_s siridb_series_t;
+
+typedef struct siridb_hotlog_s
+{
+    FILE * fp;                      /* NULL when the log is not used */
+    imap_t * series;                /* hot series by id */
+    imap_t * markers;               /* markers by series id, while loading */
+    size_t size;                    /* size of the log file */
+    uint16_t gen;                   /* generation of the log */
+} siridb_hotlog_t;
+
+siridb_hotlog_t * siridb_hotlog_new(void);
+void siridb_hotlog_free(siridb_hotlog_t * hotlog);
+int siridb_hotlog_load(siridb_t * siridb);
+int siridb_hotlog_add(siridb_hotlog_t * hotlog, siridb_series_t * series);
+void siridb_hotlog_remove(siridb_hotlog_t * hotlog, siridb_series_t * series);
+int siridb_hotlog_write(
+        siridb_hotlog_t * hotlog,
+        uint32_t id,
+        siridb_point_t * points,
+        size_t n);
+int siridb_hotlog_commit(siridb_t * siridb);
+int siridb_hotlog_sync(siridb_hotlog_t * hotlog);
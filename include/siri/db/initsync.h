@@ -27,7 +27,9 @@ typedef struct siridb_initsync_s
     char * fn;
     int fd;
     long int size;
-    uint32_t * next_series_id;
+    long int start_size;    /* size when the synchronization was opened */
+    uint64_t start;         /* loop time in milliseconds when opened */
+    uint32_t pending;       /* number of series ids handled by 'pkg' */
     sirinet_pkg_t * pkg;
 } siridb_initsync_t;
 
@@ -14,8 +14,10 @@
 #include <siri/db/db.h>
 #include <qpack/qpack.h>
 #include <siri/db/forward.h>
+#include <siri/net/socket.h>
 #include <uv.h>
 #include <siri/db/pcache.h>
+#include <siri/latency.h>
 
 #define INSERT_FLAG_TEST 1
 #define INSERT_FLAG_TESTED 2
@@ -24,7 +26,8 @@
 
 typedef enum
 {
-    ERR_EXPECTING_ARRAY=-9,
+    ERR_EXPECTING_COLUMNS=-10,
+    ERR_EXPECTING_ARRAY,
     ERR_EXPECTING_SERIES_NAME,
     ERR_EXPECTING_MAP_OR_ARRAY,
     ERR_EXPECTING_INTEGER_TS,
@@ -54,8 +57,12 @@ typedef struct siridb_insert_s
     uint8_t ref;
     uint8_t flags;
     uint16_t pid;
-    uv_stream_t * client;
+    siridb_t * siridb;
+    uv_stream_t * client;   /* NULL for an insert by the server itself */
+    sirinet_socket_pending_t * pending; /* response slot on the client */
     size_t npoints;        /* number of points */
+    size_t size;           /* bytes counted in siridb->insert_queue_size */
+    siri_latency_timer_t latency;
     uint16_t packer_size; /* number of packers (one for each pool) */
     qp_packer_t * packer[];
 } siridb_insert_t;
@@ -72,6 +79,7 @@ typedef struct siridb_insert_local_s
     sirinet_promise_t * promise;
     siridb_forward_t * forward;
     siridb_pcache_t * pcache;
+    siri_latency_timer_t latency;
 } siridb_insert_local_t;
 
 ssize_t siridb_insert_assign_pools(
@@ -79,6 +87,11 @@ ssize_t siridb_insert_assign_pools(
         qp_unpacker_t * unpacker,
         qp_packer_t * packer[]);
 
+ssize_t siridb_insert_assign_columns(
+        siridb_t * siridb,
+        qp_unpacker_t * unpacker,
+        qp_packer_t * packer[]);
+
 const char * siridb_insert_err_msg(siridb_insert_err_t err);
 
 siridb_insert_t * siridb_insert_new(
@@ -86,6 +99,8 @@ siridb_insert_t * siridb_insert_new(
         uint16_t pid,
         uv_stream_t * client);
 void siridb_insert_free(siridb_insert_t * insert);
+uint32_t siridb_insert_busy(siridb_t * siridb);
+uint32_t siridb_insert_busy(siridb_t * siridb);
 int siridb_insert_points_to_pools(siridb_insert_t * insert, size_t npoints);
 int insert_init_backend_local(
         siridb_t * siridb,
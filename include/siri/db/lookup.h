@@ -16,12 +16,32 @@
 
 #define SIRIDB_LOOKUP_SZ 8192
 
-typedef uint_fast16_t siridb_lookup_t[SIRIDB_LOOKUP_SZ];
+/*
+ * Hash which is used to map a series name to a slot in the lookup table.
+ * Warning: do not change the order, the value is saved in database.dat.
+ */
+enum
+{
+    SIRIDB_LOOKUP_HASH_SUM,     /* sum of the characters (default) */
+    SIRIDB_LOOKUP_HASH_FNV      /* FNV-1a hash of the name */
+};
+
+typedef struct siridb_lookup_s
+{
+    uint8_t hash;
+    uint_fast16_t pool[SIRIDB_LOOKUP_SZ];
+} siridb_lookup_t;
 
 uint16_t siridb_lookup_sn(siridb_lookup_t * lookup, const char * sn);
 uint16_t siridb_lookup_sn_raw(
         siridb_lookup_t * lookup,
         const char * sn,
         size_t len);
-siridb_lookup_t * siridb_lookup_new(uint_fast16_t num_pools);
+siridb_lookup_t * siridb_lookup_new(uint_fast16_t num_pools, uint8_t hash);
 void siridb_lookup_free(siridb_lookup_t * lookup);
+const char * siridb_lookup_hash_str(uint8_t hash);
+
+/* returns a pool id for a series name by its siridb_shash_key_t */
+#define siridb_lookup_key(lookup, key) \
+    (lookup)->pool[(((lookup)->hash == SIRIDB_LOOKUP_HASH_FNV) ? \
+            (key)->hash : (key)->sum) % SIRIDB_LOOKUP_SZ]
@@ -0,0 +1,54 @@
+/*
+ * mcache.h - Cache for series matched by regular expressions.
+ *
+ * author       : Jeroen van der Heijden
+ * email        : jeroen@transceptor.technology
+ * copyright    : 2016, Transceptor Technology
+ *
+ * changes
+ *  - initial version, 14-10-2016
+ *
+ */
+#pragma once
+
+#include <ctree/ctree.h>
+#include <inttypes.h>
+#include <slist/slist.h>
+#include <stddef.h>
+
+typedef struct siridb_mcache_entry_s siridb_mcache_entry_t;
+
+struct siridb_mcache_entry_s
+{
+    char * key;                         /* regular expression */
+    uint64_t gen;                       /* series generation when matched */
+    size_t n;                           /* number of series */
+    uint32_t * ids;                     /* sorted series ids */
+    siridb_mcache_entry_t * prev;       /* towards head (more recent) */
+    siridb_mcache_entry_t * next;       /* towards tail (less recent) */
+};
+
+typedef struct siridb_mcache_s
+{
+    size_t max_size;
+    size_t size;                        /* bytes used by the entries */
+    uint64_t hits;
+    uint64_t misses;
+    ct_t * entries;
+    siridb_mcache_entry_t * head;       /* most recently used */
+    siridb_mcache_entry_t * tail;       /* least recently used */
+} siridb_mcache_t;
+
+siridb_mcache_t * siridb_mcache_new(size_t max_size);
+void siridb_mcache_free(siridb_mcache_t * mcache);
+siridb_mcache_entry_t * siridb_mcache_get(
+        siridb_mcache_t * mcache,
+        const char * key,
+        size_t len,
+        uint64_t gen);
+void siridb_mcache_set(
+        siridb_mcache_t * mcache,
+        const char * key,
+        size_t len,
+        uint64_t gen,
+        slist_t * slist);
@@ -0,0 +1,35 @@
+/*
+ * names.h - Append-only storage for series names.
+ *
+ * author       : Jeroen van der Heijden
+ * email        : jeroen@transceptor.technology
+ * copyright    : 2016, Transceptor Technology
+ *
+ * changes
+ *  - initial version, 14-10-2016
+ *
+ */
+#pragma once
+
+#include <inttypes.h>
+#include <stddef.h>
+
+/*
+ * Chunks are aligned at their size so the chunk of a name can be found from
+ * the name. A chunk must fit the largest series name, including the
+ * terminator and the chunk header.
+ */
+#define SIRIDB_NAMES_CHUNK_SZ 131072
+
+typedef struct siridb_names_chunk_s siridb_names_chunk_t;
+
+typedef struct siridb_names_s
+{
+    siridb_names_chunk_t * chunk;   /* current chunk or NULL */
+    size_t len;                     /* bytes used in the current chunk */
+} siridb_names_t;
+
+siridb_names_t * siridb_names_new(void);
+void siridb_names_free(siridb_names_t * names);
+char * siridb_names_add(siridb_names_t * names, const char * name, size_t len);
+void siridb_names_release(char * name);
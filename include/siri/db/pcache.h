@@ -17,6 +17,7 @@ typedef struct siridb_pcache_s
 {
     size_t len;
     points_tp tp;
+    uint8_t flags;
     char * content;     /* string content */
     siridb_point_t * data;
     size_t size;   /* addition to normal points type */
@@ -30,6 +31,21 @@ int siridb_pcache_add_point(
         uint64_t * ts,
         qp_via_t * val);
 
+int siridb_pcache_append_point(
+        siridb_pcache_t * pcache,
+        uint64_t * ts,
+        qp_via_t * val);
+
+int siridb_pcache_unpack_points(
+        siridb_pcache_t * pcache,
+        qp_unpacker_t * unpacker);
+
+int siridb_pcache_add_points(
+        siridb_pcache_t *__restrict pcache,
+        siridb_points_t *__restrict points);
+
+void siridb_pcache_sort(siridb_pcache_t * pcache);
+
 #define siridb_pcache_free(pcache) \
     siridb_points_free((siridb_points_t *) pcache)
 
@@ -14,6 +14,9 @@
 #include <inttypes.h>
 #include <qpack/qpack.h>
 #include <slist/slist.h>
+#include <siri/db/arena.h>
+
+typedef struct siridb_aggr_s siridb_aggr_t;
 
 typedef enum
 {
@@ -28,22 +31,101 @@ typedef struct siridb_point_s
     qp_via_t val;
 } siridb_point_t;
 
+/*
+ * Statistics for a range of points. When the statistics are not available,
+ * for example an overflow in the sum of integer values, then min is set to 1
+ * and max to 0. (as int64, this is impossible for both int and double)
+ */
+typedef struct siridb_points_stats_s
+{
+    qp_via_t min;
+    qp_via_t max;
+    qp_via_t sum;
+} siridb_points_stats_t;
+
+#define siridb_points_stats_invalidate(stats)   \
+    (stats)->min.int64 = 1;                     \
+    (stats)->max.int64 = 0;                     \
+    (stats)->sum.int64 = 0
+
+#define siridb_points_stats_ok(stats)           \
+    ((stats)->min.int64 != 1 || (stats)->max.int64 != 0)
+
+/* points are allocated from an arena and released together with the arena */
+#define SIRIDB_POINTS_FLAG_ARENA 1
+
+/* data is mapped from a temporary file, see spill.c */
+#define SIRIDB_POINTS_FLAG_SPILLED 2
+
 typedef struct siridb_points_s
 {
     size_t len;
     points_tp tp;
-    char * content;     /* string content */
+    uint8_t flags;      /* must be at the same position as for pcache */
+    char * content;     /* string content blocks, see siridb_points_content */
     siridb_point_t * data;
 } siridb_points_t;
 
 siridb_points_t * siridb_points_new(size_t size, points_tp tp);
+siridb_points_t * siridb_points_arena_new(
+        siridb_arena_t * arena,
+        size_t size,
+        points_tp tp);
 void siridb_points_free(siridb_points_t * points);
+size_t siridb_points_size(siridb_points_t * points);
+char * siridb_points_content(siridb_points_t * points, size_t size);
+void siridb_points_content_move(
+        siridb_points_t *__restrict dest,
+        siridb_points_t *__restrict src);
 void siridb_points_add_point(
         siridb_points_t *__restrict points,
         uint64_t * ts,
         qp_via_t * val);
+void siridb_points_add_sorted(
+        siridb_points_t *__restrict points,
+        const siridb_point_t *__restrict data,
+        size_t n);
+int siridb_points_merge_runs(
+        siridb_points_t * points,
+        size_t * offsets,
+        size_t n);
 siridb_points_t * siridb_points_copy(siridb_points_t * points);
+siridb_points_t * siridb_points_arena_copy(
+        siridb_arena_t * arena,
+        siridb_points_t * points);
 int siridb_points_pack(siridb_points_t * points, qp_packer_t * packer);
+int siridb_points_pack_columns(
+        siridb_points_t * points,
+        qp_packer_t * packer,
+        int compress);
 void siridb_points_ts_correction(siridb_points_t * points, double factor);
 int siridb_points_raw_pack(siridb_points_t * points, qp_packer_t * packer);
 siridb_points_t * siridb_points_merge(slist_t * plist, char * err_msg);
+siridb_points_t * siridb_points_merge_aggr(
+        slist_t * plist,
+        siridb_aggr_t * aggr,
+        char * err_msg);
+int siridb_points_merge_variance(
+        slist_t * plist,
+        siridb_aggr_t * aggr,
+        siridb_points_t ** parts,
+        char * err_msg);
+siridb_points_t * siridb_points_merge_partial(
+        slist_t * plist,
+        siridb_aggr_t * aggr,
+        siridb_points_t ** counts,
+        char * err_msg);
+siridb_points_t * siridb_points_join(
+        siridb_points_t * points_a,
+        siridb_points_t * points_b,
+        char op,
+        char * err_msg);
+void siridb_points_stats(
+        siridb_points_stats_t * stats,
+        siridb_points_t * points,
+        size_t start,
+        size_t end);
+void siridb_points_stats_merge(
+        siridb_points_stats_t *__restrict stats,
+        const siridb_points_stats_t *__restrict other,
+        points_tp tp);
@@ -23,6 +23,7 @@ typedef struct siridb_s siridb_t;
 typedef struct siridb_server_s siridb_server_t;
 typedef struct cexpr_condition_s cexpr_condition_t;
 typedef struct sirinet_promise_s sirinet_promise_t;
+typedef struct siridb_coalesce_s siridb_coalesce_t;
 
 typedef void (* sirinet_promise_cb)(
         sirinet_promise_t * promise,
@@ -33,6 +34,7 @@ typedef struct siridb_pool_s
 {
     uint16_t len;
     siridb_server_t * server[2];
+    siridb_coalesce_t * coalesce;   /* merged insert which is not sent */
 } siridb_pool_t;
 
 typedef struct siridb_pool_walker_s
@@ -54,4 +56,7 @@ int siridb_pool_send_pkg(
         sirinet_promise_cb cb,
         void * data,
         int flags);
+siridb_server_t * siridb_pool_least_busy(
+        siridb_server_t * a,
+        siridb_server_t * b);
 void siridb_pool_add_server(siridb_pool_t * pool, siridb_server_t * server);
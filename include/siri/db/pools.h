@@ -28,6 +28,12 @@ typedef void (* sirinet_promises_cb)(
         slist_t * promises,
         void * data);
 
+typedef struct sirinet_promise_s sirinet_promise_t;
+
+typedef void (* sirinet_promises_each_cb)(
+        sirinet_promise_t * promise,
+        void * data);
+
 typedef struct siridb_pools_s
 {
     uint16_t len;
@@ -50,6 +56,7 @@ void siridb_pools_send_pkg(
         sirinet_pkg_t * pkg,
         uint64_t timeout,
         sirinet_promises_cb cb,
+        sirinet_promises_each_cb each,
         void * data,
         int flags);
 void siridb_pools_send_pkg_2some(
@@ -57,5 +64,6 @@ void siridb_pools_send_pkg_2some(
         sirinet_pkg_t * pkg,
         uint64_t timeout,
         sirinet_promises_cb cb,
+        sirinet_promises_each_cb each,
         void * data,
         int flags);
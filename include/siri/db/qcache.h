@@ -0,0 +1,65 @@
+/*
+ * qcache.h - Cache for select query results.
+ *
+ * author       : Jeroen van der Heijden
+ * email        : jeroen@transceptor.technology
+ * copyright    : 2016, Transceptor Technology
+ *
+ * changes
+ *  - initial version, 14-10-2016
+ *
+ */
+#pragma once
+
+#include <ctree/ctree.h>
+#include <inttypes.h>
+#include <slist/slist.h>
+#include <stddef.h>
+
+/* maximum length for a normalized query */
+#define SIRIDB_QCACHE_MAX_KEY 8192
+
+typedef struct siridb_qcache_entry_s siridb_qcache_entry_t;
+
+struct siridb_qcache_entry_s
+{
+    char * key;                         /* normalized query */
+    float factor;
+    uint64_t version;                   /* data version before selecting */
+    size_t n;                           /* number of series */
+    uint32_t * ids;                     /* sorted series ids */
+    size_t len;                         /* length of the packed result */
+    char * data;                        /* packed result */
+    siridb_qcache_entry_t * prev;       /* towards head (more recent) */
+    siridb_qcache_entry_t * next;       /* towards tail (less recent) */
+};
+
+typedef struct siridb_qcache_s
+{
+    size_t max_size;
+    size_t size;                        /* bytes used by the entries */
+    uint64_t hits;
+    uint64_t misses;
+    ct_t * entries;
+    siridb_qcache_entry_t * head;       /* most recently used */
+    siridb_qcache_entry_t * tail;       /* least recently used */
+} siridb_qcache_t;
+
+siridb_qcache_t * siridb_qcache_new(size_t max_size);
+void siridb_qcache_free(siridb_qcache_t * qcache);
+siridb_qcache_entry_t * siridb_qcache_get(
+        siridb_qcache_t * qcache,
+        const char * key,
+        float factor,
+        slist_t * slist);
+siridb_qcache_entry_t * siridb_qcache_entry_new(
+        const char * key,
+        float factor,
+        uint64_t version,
+        slist_t * slist);
+void siridb_qcache_entry_free(siridb_qcache_entry_t * entry);
+void siridb_qcache_set(
+        siridb_qcache_t * qcache,
+        siridb_qcache_entry_t * entry,
+        const char * data,
+        size_t len);
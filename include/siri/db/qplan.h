@@ -0,0 +1,59 @@
+/*
+ * qplan.h - Cache for parsed queries.
+ *
+ * author       : Jeroen van der Heijden
+ * email        : jeroen@transceptor.technology
+ * copyright    : 2016, Transceptor Technology
+ *
+ * changes
+ *  - initial version, 14-10-2016
+ *
+ */
+#pragma once
+
+#include <cleri/cleri.h>
+#include <ctree/ctree.h>
+#include <inttypes.h>
+#include <stddef.h>
+
+typedef struct siridb_qplan_s siridb_qplan_t;
+
+/* position and length of an integer literal in a query */
+typedef struct siridb_qplan_lit_s
+{
+    size_t pos;
+    size_t len;
+} siridb_qplan_lit_t;
+
+struct siridb_qplan_s
+{
+    char * key;                     /* query with integer literals as '?' */
+    char * q;                       /* query text used by the parse tree */
+    size_t len;                     /* length of q */
+    size_t n;                       /* number of literals */
+    siridb_qplan_lit_t * lits;
+    cleri_parse_t * pr;
+    uint8_t in_use;                 /* the tree is used by a query */
+    siridb_qplan_t * prev;          /* towards head (more recent) */
+    siridb_qplan_t * next;          /* towards tail (less recent) */
+};
+
+typedef struct siridb_qplans_s
+{
+    size_t max_len;
+    size_t len;
+    uint64_t hits;
+    uint64_t misses;
+    ct_t * plans;
+    siridb_qplan_t * head;          /* most recently used */
+    siridb_qplan_t * tail;          /* least recently used */
+} siridb_qplans_t;
+
+siridb_qplans_t * siridb_qplans_new(size_t max_len);
+void siridb_qplans_free(siridb_qplans_t * qplans);
+siridb_qplan_t * siridb_qplans_get(siridb_qplans_t * qplans, const char * q);
+siridb_qplan_t * siridb_qplans_add(
+        siridb_qplans_t * qplans,
+        const char * q,
+        cleri_parse_t * pr);
+void siridb_qplans_release(siridb_qplans_t * qplans, siridb_qplan_t * plan);
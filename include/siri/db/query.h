@@ -15,6 +15,16 @@
 #define SIRIDB_QUERY_FLAG_REBUILD 2
 #define SIRIDB_QUERY_FLAG_UPDATE_REPLICA 4
 #define SIRIDB_QUERY_FLAG_ERR 8
+#define SIRIDB_QUERY_FLAG_EXPLAIN 16
+#define SIRIDB_QUERY_FLAG_STREAM 32
+#define SIRIDB_QUERY_FLAG_KILLED 64
+#define SIRIDB_QUERY_FLAG_FORWARDED 128
+
+/* formats for the points in a select response */
+#define SIRIDB_QUERY_FMT_ROWS 0             // [[ts, value], ...]
+#define SIRIDB_QUERY_FMT_COLUMNS 1          // [tp, ts, values]
+#define SIRIDB_QUERY_FMT_COLUMNS_LZ4 2      // [tp, n, ts, values]
+#define SIRIDB_QUERY_FMT_END 3
 
 /*
  * Note(*) : servers must be 'accessible' unless FLAG_ONLY_CHECK_ONLINE is used
@@ -23,7 +33,7 @@ typedef enum
 {
     SIRIDB_QUERY_FWD_SERVERS,       // Forward to all 'online' servers
     SIRIDB_QUERY_FWD_POOLS,         // Forward to all pools(*)
-    SIRIDB_QUERY_FWD_SOME_POOLS,    // Forward to some pools(*)
+    SIRIDB_QUERY_FWD_SOME_POOLS,    // Forward to the pools in pmap(*)
     SIRIDB_QUERY_FWD_UPDATE         // Forward to all pools, update replicas(*)
 } siridb_query_fwd_t;
 
@@ -33,13 +43,22 @@ typedef enum
 #include <sys/time.h>
 #include <cleri/cleri.h>
 #include <qpack/qpack.h>
+#include <siri/db/arena.h>
 #include <siri/db/time.h>
 #include <siri/db/nodes.h>
+#include <siri/db/qplan.h>
 #include <siri/db/series.h>
+#include <siri/db/shard.h>
 #include <siri/db/db.h>
+#include <siri/latency.h>
 #include <siri/net/protocol.h>
 
+/* shard statistics are collected for timeit and for the slow query log */
+#define SIRIDB_QUERY_HAS_STATS(query) \
+    ((query)->timeit != NULL || siri.cfg->slow_query_threshold)
+
 typedef struct cleri_parse_s cleri_parse_t;
+typedef struct siridb_qplan_s siridb_qplan_t;
 typedef struct siridb_node_list_s siridb_node_list_t;
 
 typedef enum siridb_err_tp
@@ -54,6 +73,20 @@ typedef enum siridb_err_tp
 
 } siridb_err_t;
 
+/* time spent in each stage of a query in nanoseconds, used by timeit */
+typedef struct siridb_query_stages_s
+{
+    uint64_t parse;             /* parsing and walking the query */
+    uint64_t match;             /* finding the series to use */
+    uint64_t aggregate;         /* reading and aggregating points */
+    uint64_t merge;             /* unpacking results from other servers */
+    uint64_t pack;              /* packing the result */
+    uint64_t wait;              /* waiting for other servers */
+    uint64_t mark;              /* start of the running stage or 0 */
+    uint64_t series;            /* number of series which are selected */
+    siridb_shard_stats_t shards;
+} siridb_query_stages_t;
+
 typedef struct siridb_query_s
 {
     uv_close_cb free_cb;    /* must be on top */
@@ -61,15 +94,25 @@ typedef struct siridb_query_s
     uint8_t flags;
     uint16_t pid;
     float factor;
+    uint8_t fmt;                /* format for points, SIRIDB_QUERY_FMT_... */
+    uint64_t id;                /* unique for running queries on a server */
+    uint64_t origin_id;         /* query id on the forwarding server or 0 */
+    uint64_t trace_id;          /* equal for a query and forwarded queries */
     void * data;
     uv_stream_t * client;
     char * q;
     char err_msg[SIRIDB_MAX_SIZE_ERR_MSG];
     qp_packer_t * packer;
     qp_packer_t * timeit;
+    qp_packer_t * waits;        /* [server, seconds] for each response */
     cleri_parse_t * pr;
+    siridb_qplan_t * plan;      /* set when pr is owned by a plan */
     siridb_nodes_t * nodes;
+    siridb_arena_t * arena;     /* created when required */
     struct timespec start;
+    siridb_query_stages_t stages;
+    siri_latency_timer_t latency;
+    uint64_t slice;             /* timeit_ns() when the query got the loop */
 } siridb_query_t;
 
 void siridb_query_run(
@@ -78,8 +121,12 @@ void siridb_query_run(
         const char * q,
         size_t q_len,
         float factor,
-        int flags);
+        int flags,
+        uint8_t fmt,
+        uint64_t origin_id,
+        uint64_t trace_id);
 void siridb_query_free(uv_handle_t * handle);
+void siridb_query_next_node(uv_async_t * handle);
 void siridb_send_query_result(uv_async_t * handle);
 void siridb_query_send_error(
         uv_async_t * handle,
@@ -89,7 +136,20 @@ void siridb_query_forward(
         siridb_query_fwd_t fwd,
         sirinet_promises_cb cb,
         int flags);
+void siridb_query_forward_each(
+        uv_async_t * handle,
+        siridb_query_fwd_t fwd,
+        sirinet_promises_cb cb,
+        sirinet_promises_each_cb each,
+        int flags);
 void siridb_query_timeit_from_unpacker(
         siridb_query_t * query,
         qp_unpacker_t * unpacker);
+siridb_arena_t * siridb_query_arena(siridb_query_t * query);
+void siridb_query_add_waits(siridb_query_t * query, slist_t * promises);
 int siridb_query_err_from_pkg(siridb_query_t * query, sirinet_pkg_t * pkg);
+int siridb_query_normalize(siridb_query_t * query, char * buf, size_t size);
+int siridb_query_is_cancelled(siridb_query_t * query, char * err_msg);
+void siridb_query_kill(siridb_query_t * query);
+void siridb_query_kill_forwarded(siridb_query_t * query);
+void siridb_query_kill_client(siridb_t * siridb, uv_stream_t * client);
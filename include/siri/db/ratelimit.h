@@ -0,0 +1,45 @@
+/*
+ * ratelimit.h - Token bucket rate limits for database users.
+ *
+ * author       : Jeroen van der Heijden
+ * email        : jeroen@transceptor.technology
+ * copyright    : 2016, Transceptor Technology
+ *
+ * changes
+ *  - initial version, 14-10-2016
+ *
+ */
+#pragma once
+
+#include <inttypes.h>
+#include <stddef.h>
+
+/*
+ * A bucket holds at most one second of tokens. The number of points for
+ * an insert or select is only known after the request is accepted, so the
+ * tokens can become negative in which case new requests are refused until
+ * the bucket is refilled.
+ */
+typedef struct siridb_ratelimit_s
+{
+    double rate;        /* tokens per second, 0 when not limited */
+    double tokens;
+    uint64_t last;      /* time of the last refill in milliseconds */
+} siridb_ratelimit_t;
+
+typedef struct siridb_ratelimits_s
+{
+    siridb_ratelimit_t points;      /* inserted points per second */
+    siridb_ratelimit_t queries;     /* queries per second */
+    siridb_ratelimit_t selected;    /* selected points per second */
+} siridb_ratelimits_t;
+
+int siridb_ratelimits_parse(siridb_ratelimits_t * limits, const char * str);
+uint32_t siridb_ratelimits_query(
+        siridb_ratelimits_t * limits,
+        const char ** limit);
+uint32_t siridb_ratelimits_insert(
+        siridb_ratelimits_t * limits,
+        const char ** limit);
+void siridb_ratelimits_points(siridb_ratelimits_t * limits, size_t n);
+void siridb_ratelimits_selected(siridb_ratelimits_t * limits, size_t n);
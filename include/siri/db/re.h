@@ -11,8 +11,48 @@
  */
 #pragma once
 
+#include <ctree/ctree.h>
+#include <inttypes.h>
 #include <pcre.h>
 #include <stddef.h>
+#include <uv.h>
+
+/* number of compiled expressions kept in the cache by default */
+#define SIRIDB_RE_CACHE_SIZE 256
+
+/* flags for the text found by siridb_re_literals() */
+#define SIRIDB_RE_LITERAL_START 1   /* text is at the start of the subject */
+#define SIRIDB_RE_LITERAL_END 2     /* text is at the end of the subject */
+
+typedef struct siridb_re_s siridb_re_t;
+
+typedef void (*siridb_re_literal_cb)(
+        const char * text,
+        size_t n,
+        int flags,
+        void * args);
+
+struct siridb_re_s
+{
+    uint32_t ref;
+    char * key;                     /* source text */
+    pcre * regex;
+    pcre_extra * regex_extra;
+    siridb_re_t * prev;             /* towards head (more recent) */
+    siridb_re_t * next;             /* towards tail (less recent) */
+};
+
+typedef struct siridb_re_cache_s
+{
+    size_t max_len;
+    size_t len;
+    uint64_t hits;
+    uint64_t misses;
+    uv_mutex_t mutex;
+    ct_t * entries;
+    siridb_re_t * head;             /* most recently used */
+    siridb_re_t * tail;             /* least recently used */
+} siridb_re_cache_t;
 
 int siridb_re_compile(
         pcre ** regex,
@@ -20,3 +60,25 @@ int siridb_re_compile(
         const char * source,
         size_t len,
         char * err_msg);
+void siridb_re_free_extra(pcre_extra * regex_extra);
+int siridb_re_exec(
+        pcre * regex,
+        pcre_extra * regex_extra,
+        const char * subject,
+        size_t len);
+siridb_re_cache_t * siridb_re_cache_new(size_t max_len);
+void siridb_re_cache_free(siridb_re_cache_t * re_cache);
+siridb_re_t * siridb_re_get(
+        siridb_re_cache_t * re_cache,
+        const char * source,
+        size_t len,
+        char * err_msg);
+void siridb_re_decref(siridb_re_cache_t * re_cache, siridb_re_t * re);
+int siridb_re_literals(
+        const char * source,
+        size_t len,
+        siridb_re_literal_cb cb,
+        void * args);
+
+#define siridb_re_match(re, subject, len) \
+    siridb_re_exec((re)->regex, (re)->regex_extra, subject, len)
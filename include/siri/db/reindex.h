@@ -15,21 +15,41 @@
 #include <uv.h>
 #include <siri/db/db.h>
 #include <siri/db/series.h>
+#include <siri/net/pkg.h>
+#include <slist/slist.h>
 
 #define REINDEX_FN ".reindex"
 
 typedef struct siridb_s siridb_t;
 typedef struct siridb_series_s siridb_series_t;
 
+/* a package with the series which are moved using one insert */
+typedef struct siridb_reindex_batch_s
+{
+    long int offset;        /* file size when the batch is finished */
+    uint8_t done;
+    uint8_t resend;         /* sending has failed, try again later */
+    uint64_t sent;          /* loop time in milliseconds when sent */
+    siridb_t * siridb;
+    sirinet_pkg_t * pkg;
+    slist_t * series;       /* prepared drops, committed when finished */
+    struct siridb_reindex_batch_s * next;
+} siridb_reindex_batch_t;
+
 typedef struct siridb_reindex_s
 {
     FILE * fp;
     char * fn;
     int fd;
-    long int size;
-    uint32_t * next_series_id;
-    sirinet_pkg_t * pkg;
-    siridb_series_t * series;
+    long int size;          /* size of the series ids which are not read */
+    long int start_size;    /* size when the re-index was opened */
+    uint64_t start;         /* loop time in milliseconds when opened */
+    uint16_t window;        /* maximum number of batches in progress */
+    uint16_t batches_n;     /* batches in progress */
+    uint32_t delay;         /* milliseconds to wait before the next batch */
+    uint64_t throttle;      /* loop time before which no batch is created */
+    siridb_reindex_batch_t * first;     /* oldest batch, in file order */
+    siridb_reindex_batch_t * last;
     siridb_server_t * server;
     uv_timer_t * timer;
 } siridb_reindex_t;
@@ -33,6 +33,7 @@ typedef enum
 typedef struct siridb_replicate_s
 {
     siridb_replicate_status_t status;
+    uint32_t pending;           /* fifo packages in the sent package */
     uv_timer_t * timer;
     siridb_initsync_t * initsync;
 } siridb_replicate_t;
@@ -0,0 +1,103 @@
+/*
+ * rollup.h - Downsampled statistics for series.
+ *
+ * author       : Jeroen van der Heijden
+ * email        : jeroen@transceptor.technology
+ * copyright    : 2016, Transceptor Technology
+ *
+ * changes
+ *  - initial version, 14-10-2016
+ *
+ */
+#pragma once
+
+#include <cfgparser/cfgparser.h>
+#include <inttypes.h>
+#include <siri/db/aggregate.h>
+#include <siri/db/points.h>
+#include <siri/db/re.h>
+#include <slist/slist.h>
+#include <stddef.h>
+
+#define SIRIDB_ROLLUP_SECTION "rollup"
+
+typedef struct siridb_s siridb_t;
+typedef struct siridb_series_s siridb_series_t;
+
+/* returns the time-stamp of the bucket for a given time-stamp */
+#define SIRIDB_ROLLUP_TS(interval, ts) \
+    (((ts) + (interval) - 1) / (interval) * (interval))
+
+/*
+ * A rollup definition, read from the [rollup] section in database.conf.
+ */
+typedef struct siridb_rollup_s
+{
+    char * name;
+    char * source;          /* regular expression or group name */
+    uint64_t interval;      /* in the time precision of the database */
+    siridb_re_t * re;
+} siridb_rollup_t;
+
+/*
+ * Statistics for the points in ((ts - interval), ts], this is the same
+ * range as a group by with the interval of the rollup.
+ */
+typedef struct siridb_rollup_bucket_s
+{
+    uint64_t ts;
+    uint32_t len;
+    siridb_points_stats_t stats;
+} siridb_rollup_bucket_t;
+
+/*
+ * The rollup for a series. All points with a time-stamp of at least 'start'
+ * are included in the buckets. The start is always the first time-stamp of
+ * a bucket.
+ */
+typedef struct siridb_rollup_data_s
+{
+    siridb_rollup_t * rollup;
+    uint64_t start;
+    size_t len;
+    size_t size;
+    siridb_rollup_bucket_t * buckets;
+} siridb_rollup_data_t;
+
+int siridb_rollups_read(siridb_t * siridb, cfgparser_t * cfgparser);
+int siridb_rollups_init(siridb_t * siridb);
+int siridb_rollups_save(siridb_t * siridb);
+void siridb_rollups_free(slist_t * rollups);
+void siridb_rollups_add_series(siridb_t * siridb, siridb_series_t * series);
+
+siridb_rollup_data_t * siridb_rollup_data_new(
+        siridb_rollup_t * rollup,
+        uint64_t start);
+void siridb_rollup_data_free(siridb_rollup_data_t * data);
+void siridb_rollup_add_point(
+        siridb_rollup_data_t * data,
+        points_tp tp,
+        uint64_t ts,
+        qp_via_t * val);
+void siridb_rollup_add_points(
+        siridb_rollup_data_t * data,
+        points_tp tp,
+        siridb_point_t * points,
+        size_t len);
+void siridb_rollup_remove(siridb_rollup_data_t * data, uint64_t end_ts);
+int siridb_rollup_range(
+        siridb_rollup_data_t * data,
+        siridb_aggr_t * aggr,
+        uint64_t * start_ts,
+        uint64_t * end_ts,
+        uint64_t * lo,
+        uint64_t * hi);
+int siridb_rollup_get(
+        siridb_rollup_data_t * data,
+        siridb_aggr_t * aggr,
+        points_tp tp,
+        uint64_t lo,
+        uint64_t hi,
+        siridb_points_t ** points,
+        siridb_points_t ** counts,
+        char * err_msg);
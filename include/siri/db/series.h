@@ -16,6 +16,7 @@
 #include <siri/db/points.h>
 #include <siri/db/pcache.h>
 #include <siri/db/buffer.h>
+#include <siri/db/rollup.h>
 #include <qpack/qpack.h>
 #include <cexpr/cexpr.h>
 
@@ -23,9 +24,13 @@ typedef struct siridb_s siridb_t;
 typedef struct siridb_buffer_s siridb_buffer_t;
 typedef struct siridb_points_s siridb_points_t;
 typedef struct siridb_shard_s siridb_shard_t;
+typedef struct siridb_aggr_s siridb_aggr_t;
+typedef struct siridb_downsample_s siridb_downsample_t;
 
 typedef points_tp series_tp;
 
+#define SIRIDB_SERIES_FN "series.dat"
+
 /* Series Flags */
 #define SIRIDB_SERIES_HAS_OVERLAP 1
 #define SIRIDB_SERIES_IS_DROPPED 2
@@ -37,6 +42,12 @@ typedef points_tp series_tp;
 /* the max length including terminator char */
 #define SIRIDB_SERIES_NAME_LEN_MAX 65535
 
+/* number of series in a block of the series allocator */
+#define SIRIDB_SERIES_SLAB_SZ 1024
+
+/* maximum for last_points_cache, the newest points kept for each series */
+#define SIRIDB_SERIES_LAST_MAX 1024
+
 #define siridb_series_isnum(series) (series->tp != TP_STRING)
 
 #define SIRIDB_QP_MAP2_TP(TP)                                 \
@@ -50,32 +61,77 @@ typedef struct idx_s
     siridb_shard_t * shard;
     uint32_t pos;
     uint16_t len;
-    uint16_t log_sz;  /* reserved for log values */
+    uint16_t chunk_sz;  /* size in bytes for compressed or log chunks */
     uint64_t start_ts;
     uint64_t end_ts;
+    siridb_points_stats_t stats;  /* only available for compressed chunks */
 } idx_t;
 
+/* estimated cost for reading series, see siridb_series_cost() */
+typedef struct siridb_series_cost_s
+{
+    uint64_t series;
+    uint64_t shards;                    // shards read, counted per series
+    uint64_t chunks;
+    uint64_t points;                    // upper bound
+    uint64_t min_points;                // points at least read
+} siridb_series_cost_t;
+
+/* replaced chunks which are read by siridb_series_optimize_read() */
+typedef struct siridb_series_optimize_s
+{
+    siridb_points_t * points;           // NULL when no points are read
+    size_t size;                        // number of points which are read
+    uint64_t check;                     // the replaced indexes
+} siridb_series_optimize_t;
+
+#define SIRIDB_SERIES_OPTIMIZE_INIT {NULL, 0, 0}
+
+/*
+ * The fields which are read for each series when series are filtered by a
+ * where expression, matched to groups or selected are in the first 64 bytes
+ * (SIRIDB_SERIES_HOT_SZ) so a scan over many series reads one cache line of
+ * each series. Fields for inserts follow, rarely used fields are last.
+ */
+#define SIRIDB_SERIES_HOT_SZ 64
+
 typedef struct siridb_series_s
 {
+    /* hot: filters, group matching and selects */
     uint32_t ref;  /* keep ref on top */
     uint32_t id;
-    uint16_t mask;
     uint16_t pool;
-    uint16_t name_len;
     uint8_t flags;
     uint8_t tp;
+    uint32_t length;
     uint64_t start;
     uint64_t end;
-    uint32_t length;
-    uint32_t idx_len;
-    long int bf_offset;
-    siridb_points_t * buffer;
     char * name;
+    siridb_points_t * buffer;
     idx_t * idx;
+    uint32_t idx_len;
+    uint32_t bf_cap;                    // points allocated for the buffer
+    /* inserts */
+    uint64_t version;                   // data version of the last change
+    long int bf_offset;
+    siridb_rollup_data_t * rollup;      // NULL when the series has no rollup
+    siridb_points_t * last;             // newest points or NULL
+    siridb_points_stats_t stats;        // all loaded points, if available
+    siridb_shard_t * shard;             // last shard written, see shards_gen
+    uint64_t shard_gen;                 // shards_gen when 'shard' is set
+    uint8_t bf_class;                   // buffer size class
+    uint8_t bf_hot;                     // points are written to the hot log
+    uint8_t narrow_reads;               // recent selects using a small part
+    uint8_t dclass;                     // shard duration, see durations.c
+    uint16_t mask;
+    uint16_t name_len;
+    /* cold */
+    uint32_t bf_flush_ts;               // last time the buffer was full
     siridb_t * siridb;
 } siridb_series_t;
 
 int siridb_series_load(siridb_t * siridb);
+int siridb_series_save_snapshot(siridb_t * siridb);
 
 siridb_series_t * siridb_series_new(
         siridb_t * siridb,
@@ -88,7 +144,9 @@ int siridb_series_add_idx(
         uint64_t start_ts,
         uint64_t end_ts,
         uint32_t pos,
-        uint16_t len);
+        uint16_t len,
+        uint16_t chunk_sz,
+        const siridb_points_stats_t * stats);
 
 int siridb_series_add_point(
         siridb_t *__restrict siridb,
@@ -100,32 +158,105 @@ int siridb_series_add_pcache(
         siridb_t *__restrict siridb,
         siridb_series_t *__restrict series,
         siridb_pcache_t *__restrict pcache);
+int siridb_series_import(
+        siridb_t *__restrict siridb,
+        siridb_series_t *__restrict series,
+        siridb_points_t *__restrict points);
+int siridb_series_add_pcache_buffered(
+        siridb_t *__restrict siridb,
+        siridb_series_t *__restrict series,
+        siridb_pcache_t *__restrict pcache);
 
+void siridb_series_prefetch(
+        siridb_series_t ** series,
+        size_t n,
+        uint64_t * start_ts,
+        uint64_t * end_ts);
 siridb_points_t * siridb_series_get_points(
+        siridb_t *__restrict siridb,
+        siridb_series_t *__restrict series,
+        uint64_t *__restrict start_ts,
+        uint64_t *__restrict end_ts);
+siridb_points_t * siridb_series_get_last(
+        siridb_t *__restrict siridb,
+        siridb_series_t *__restrict series,
+        uint64_t *__restrict start_ts,
+        uint64_t *__restrict end_ts,
+        size_t limit);
+siridb_points_t * siridb_series_get_filtered(
+        siridb_t *__restrict siridb,
         siridb_series_t *__restrict series,
+        siridb_aggr_t *__restrict filter,
         uint64_t *__restrict start_ts,
         uint64_t *__restrict end_ts);
+siridb_points_t * siridb_series_get_aggr(
+        siridb_t *__restrict siridb,
+        siridb_series_t *__restrict series,
+        siridb_aggr_t *__restrict aggr,
+        uint64_t *__restrict start_ts,
+        uint64_t *__restrict end_ts,
+        char * err_msg);
+void siridb_series_cost(
+        siridb_series_t *__restrict series,
+        uint64_t *__restrict start_ts,
+        uint64_t *__restrict end_ts,
+        siridb_series_cost_t *__restrict cost);
 
 void siridb_series_remove_shard(
         siridb_t *__restrict siridb,
         siridb_series_t *__restrict series,
         siridb_shard_t *__restrict shard);
+void siridb_series_remove_replaced(
+        siridb_t *__restrict siridb,
+        siridb_series_t *__restrict series,
+        siridb_shard_t *__restrict shard,
+        size_t size);
+void siridb_series_remove_shards(
+        siridb_t *__restrict siridb,
+        siridb_series_t *__restrict series,
+        imap_t *__restrict shards);
+int siridb_series_evict_cold(siridb_series_t * series, void * args);
 
+int siridb_series_optimize_read(
+        siridb_series_t *__restrict series,
+        siridb_shard_t *__restrict shard,
+        siridb_series_optimize_t * optimize);
 int siridb_series_optimize_shard(
         siridb_t *__restrict siridb,
         siridb_series_t *__restrict series,
-        siridb_shard_t *__restrict shard);
+        siridb_shard_t *__restrict shard,
+        siridb_downsample_t * downsample,
+        siridb_series_optimize_t * optimize);
+int siridb_series_need_merge(
+        siridb_series_t * series,
+        siridb_shard_t * shard);
+int siridb_series_merge_shard(
+        siridb_t *__restrict siridb,
+        siridb_series_t *__restrict series,
+        siridb_shard_t *__restrict shard,
+        idx_t ** dead,
+        uint_fast32_t * n);
 
 
 void siridb_series_update_props(siridb_t * siridb, siridb_series_t * series);
 int siridb_series_cexpr_cb(siridb_series_t * series, cexpr_condition_t * cond);
+slist_t * siridb_series_candidates(siridb_t * siridb, cexpr_t * where_expr);
+qp_via_t * siridb_series_stat(siridb_series_t * series, uint32_t prop);
 int siridb_series_replicate_file(siridb_t * siridb);
 int siridb_series_drop(siridb_t * siridb, siridb_series_t * series);
 void siridb_series_drop_prepare(siridb_t * siridb, siridb_series_t * series);
 int siridb_series_drop_commit(siridb_t * siridb, siridb_series_t * series);
+int siridb_series_drop_n(
+        siridb_t * siridb,
+        siridb_series_t ** series,
+        size_t n);
 int siridb_series_flush_dropped(siridb_t * siridb);
+void siridb_series_compact(siridb_t * siridb);
 uint8_t siridb_series_server_id_by_name(const char * name);
+uint16_t siridb_series_mask(siridb_t * siridb, const char * name, uint8_t tp);
+void siridb_series_attached(siridb_t * siridb, siridb_series_t * series);
 int siridb_series_open_store(siridb_t * siridb);
+int siridb_series_commit(siridb_t * siridb);
 void siridb__series_free(siridb_series_t *__restrict series);
 void siridb__series_decref(siridb_series_t * series);
 /*
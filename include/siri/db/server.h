@@ -16,6 +16,7 @@
 #include <siri/db/db.h>
 #include <imap/imap.h>
 #include <cexpr/cexpr.h>
+#include <qpack/qpack.h>
 #include <uv.h>
 #include <siri/net/promise.h>
 #include <siri/net/pkg.h>
@@ -43,7 +44,7 @@
 
 
 /*
- * Server is 'connected' when at least connected.
+ * Server is 'connected' when at least connected. (the control lane)
  */
 #define siridb_server_is_connected(server) \
     (server->socket != NULL)
@@ -85,6 +86,20 @@
 (server->flags == SERVER__SELF_ONLINE || server->flags == SERVER__SELF_REINDEXING)
 
 
+/*
+ * Counters which are sent with each flags update so unfiltered count
+ * statements can be answered without asking the other servers.
+ */
+typedef enum
+{
+    SIRIDB_SERVER_COUNT_SERIES,
+    SIRIDB_SERVER_COUNT_SHARDS,
+    SIRIDB_SERVER_COUNT_SHARDS_SIZE,
+    SIRIDB_SERVER_COUNT_RECEIVED,
+    SIRIDB_SERVER_COUNT_SELECTED,
+
+    SIRIDB_SERVER_COUNT_END
+} siridb_server_count_tp_t;
 
 typedef struct siridb_s siridb_t;
 typedef struct sirinet_promise_s sirinet_promise_t;
@@ -103,18 +118,23 @@ typedef struct siridb_server_s
     char * name; /* this is a format for address:port but we use it a lot */
     char * address;
     imap_t * promises;
-    uv_tcp_t * socket;
+    uv_tcp_t * socket;  /* control lane */
+    uv_tcp_t * bulk;    /* bulk lane for queries and inserts, or NULL */
     uint16_t pid;
     /* fixed server properties */
     uint8_t ip_support;
-    uint8_t pad0;
+    uint8_t bulk_ready; /* the bulk lane is authenticated */
     uint32_t startup_time;
+    uint32_t latency;   /* estimated 95th percentile response time in ms */
+    uint32_t rtt;       /* estimated 95th percentile round-trip time in ms */
     char * libuv;
     char * version;
     char * dbpath;
     char * buffer_path;
     size_t buffer_size;
     uuid_t uuid;
+    uint64_t counts_ts; /* uv_now() when counts are received, 0=unknown */
+    uint64_t counts[SIRIDB_SERVER_COUNT_END];
 } siridb_server_t;
 
 typedef struct siridb_server_walker_s
@@ -148,6 +168,8 @@ static inline int siridb_server_cmp(siridb_server_t * sa, siridb_server_t * sb)
 }
 
 void siridb_server_connect(siridb_t * siridb, siridb_server_t * server);
+void siridb_server_connect_bulk(siridb_t * siridb, siridb_server_t * server);
+void siridb_server_lane_closed(siridb_server_t * server, uv_tcp_t * lane);
 int siridb_server_send_pkg(
         siridb_server_t * server,
         sirinet_pkg_t * pkg,
@@ -156,6 +178,10 @@ int siridb_server_send_pkg(
         void * data,
         int flags);
 void siridb_server_send_flags(siridb_server_t * server);
+void siridb_server_counts_update(siridb_t * siridb);
+void siridb_server_counts_read(
+        siridb_server_t * server,
+        qp_unpacker_t * unpacker);
 int siridb_server_update_address(
         siridb_t * siridb,
         siridb_server_t * server,
@@ -32,9 +32,13 @@ void siridb_servers_send_pkg(
         sirinet_promises_cb cb,
         void * data);
 void siridb_servers_send_flags(llist_t * servers);
-ssize_t siridb_servers_get_file(char ** buffer, siridb_t * siridb);
+void siridb_servers_get_fn(char * fn, siridb_t * siridb);
 int siridb_servers_online(siridb_t * siridb);
 int siridb_servers_available(siridb_t * siridb);
+int siridb_servers_cached_count(
+        siridb_t * siridb,
+        siridb_server_count_tp_t tp,
+        size_t * n);
 int siridb_servers_list(siridb_server_t * server, uv_async_t * handle);
 int siridb_servers_check_version(siridb_t * siridb, char * version);
 int siridb_servers_save(siridb_t * siridb);
@@ -0,0 +1,36 @@
+/*
+ * session.h - Short-lived session tokens for client authentication.
+ *
+ * author       : Jeroen van der Heijden
+ * email        : jeroen@transceptor.technology
+ * copyright    : 2016, Transceptor Technology
+ *
+ * changes
+ *  - initial version, 14-10-2016
+ *
+ */
+#pragma once
+
+#include <ctree/ctree.h>
+#include <inttypes.h>
+#include <siri/db/db.h>
+#include <siri/db/user.h>
+
+#define SIRIDB_SESSION_SZ 32        // token length without terminator
+#define SIRIDB_SESSIONS_MAX 65536   // tokens per database
+
+typedef struct siridb_s siridb_t;
+typedef struct siridb_user_s siridb_user_t;
+
+typedef struct siridb_session_s
+{
+    uint64_t expire;            /* uv_now() in milliseconds */
+    char token[SIRIDB_SESSION_SZ + 1];
+    siridb_user_t * user;
+    char * password;            /* encrypted password when issued */
+} siridb_session_t;
+
+int siridb_session_new(siridb_t * siridb, siridb_user_t * user, char * token);
+siridb_user_t * siridb_session_pop(siridb_t * siridb, const char * token);
+void siridb_sessions_cleanup(siridb_t * siridb);
+void siridb_sessions_free(ct_t * sessions);
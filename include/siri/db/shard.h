@@ -11,6 +11,8 @@
  */
 #pragma once
 
+#include <imap/imap.h>
+#include <iset/iset.h>
 #include <siri/db/db.h>
 #include <siri/db/points.h>
 #include <siri/db/series.h>
@@ -26,6 +28,7 @@
 #define SIRIDB_SHARD_IS_REMOVED 16
 #define SIRIDB_SHARD_IS_LOADING 32
 #define SIRIDB_SHARD_IS_CORRUPT 64
+#define SIRIDB_SHARD_IS_COMPRESSED 128
 
 // HAS_OVERLAP + HAS_NEW_VALUES + HAS_DROPPED_SERIES + IS_CORRUPT
 #define SIRIDB_SHARD_NEED_OPTIMIZE 78
@@ -34,10 +37,45 @@
 #define SIRIDB_SHARD_TP_NUMBER 0
 #define SIRIDB_SHARD_TP_LOG 1
 
+/*
+ * Once a shard is created the chunk_size is saved (and after a restart loaded)
+ * from the shard. Its not possible to shrink the chunk size for an existing
+ * shard since we assume the index will not grow when optimizing. It is
+ * possible to set a larger chunk size for an existing shard.
+ *
+ * New shards can be created using a lower max_chunk size.
+ *
+ * Max 65535 since uint16_t is used to store this value
+ */
+#define DEFAULT_MAX_CHUNK_SZ_NUM 800
+
+/*
+ * Log chunks hold at most this number of points so a chunk with values of
+ * SIRIDB_COMPRESS_LOG_MAX_LEN bytes still fits an uint16_t.
+ */
+#define DEFAULT_MAX_CHUNK_SZ_LOG 64
+
+/*
+ * Optimize may write a different number of points per chunk for each series,
+ * see optimize_min_chunk_points and optimize_max_chunk_points. The compressed
+ * size of a chunk with this number of points still fits an uint16_t.
+ */
+#define SIRIDB_SHARD_MAX_CHUNK_POINTS 3448
+
 extern const char shard_type_map[2][7];
 
 #define SIRIDB_SHARD_STATUS_STR_MAX 128
 
+/* number of chunks which are prefetched at once while reading a series */
+#define SIRIDB_SHARD_PREFETCH 16
+
+/* maximum number of chunks which are prefetched at once for many series */
+#define SIRIDB_SHARD_PREFETCH_BATCH 256
+
+/* returns the first time-stamp which can be written to a shard */
+#define SIRIDB_SHARD_START(shard) \
+    ((shard)->id - (shard)->id % (shard)->duration)
+
 typedef struct siridb_shard_flags_repr_s
 {
     const char * repr;
@@ -59,12 +97,52 @@ typedef struct siridb_shard_s
     uint8_t flags;
     uint16_t max_chunk_sz;
     uint64_t id;
+    uint64_t duration;  /* see durations.c, can differ from the database */
     size_t size;
+    size_t dead_size;   /* bytes used by chunks which are marked as dead */
     siri_fp_t * fp;
     char * fn;
     siridb_shard_t * replacing;
+    uint8_t is_cold;    /* the index is not loaded, see cold_shard_age */
+    uint8_t schema;     /* schema of the shard file */
+    uint32_t accessed;  /* last time points are read or written */
+    size_t nidx;        /* number of indexes, see siridb_shards_evict() */
+    uint32_t new_chunks;    /* chunks added since the last optimize */
+    uint32_t overlaps;      /* chunks added which overlap another chunk */
+    size_t new_size;        /* bytes in chunks added since the last optimize */
+    iset_t * series;        /* ids of series which might have chunks */
+    idx_t * dropped;        /* chunks of dropped series, not yet dead */
+    size_t dropped_n;       /* protected by the shards_mutex */
+    size_t dropped_sz;
+    size_t verified;        /* checksums are verified up to this position */
+    off_t verified_idx;     /* verified part of the index file, -1 when done */
 } siridb_shard_t;
 
+/* statistics for reading chunks, see siridb_shard_stats */
+typedef struct siridb_shard_stats_s
+{
+    uint64_t chunks;    /* number of chunks read */
+    uint64_t bytes;     /* number of bytes read */
+    uint64_t io;        /* nanoseconds spent reading chunks */
+    uint64_t decode;    /* nanoseconds spent decoding chunks */
+    uint64_t points;    /* number of points in the chunks which are read */
+    uint64_t shards;    /* shards read, subsequent reads are counted once */
+    siridb_shard_t * shard;     /* last shard which is read */
+} siridb_shard_stats_t;
+
+/*
+ * When set, reading chunks by the current thread is counted in the given
+ * statistics. This is used for profiling queries with timeit.
+ */
+extern __thread siridb_shard_stats_t * siridb_shard_stats;
+
+/*
+ * Must be set by a thread which reads chunks while holding the series_mutex
+ * for reading. Other readers might open, close or map the same files at the
+ * same time, so chunks are then read one at a time and copied.
+ */
+extern __thread int siridb_shard_shared;
+
 typedef struct siridb_shard_view_s
 {
     siridb_shard_t * shard;
@@ -84,7 +162,22 @@ int siridb_shard_cexpr_cb(
         cexpr_condition_t * cond);
 int siridb_shard_status(char * str, siridb_shard_t * shard);
 int siridb_shard_load(siridb_t * siridb, uint64_t id);
+int siridb_shard_load_cold(siridb_t * siridb, siridb_shard_t * shard);
+int siridb_shard_attach(
+        siridb_t * siridb,
+        const char * fn,
+        uint64_t id,
+        imap_t * ids,
+        int write,
+        char * err_msg);
+int siridb_shard_can_evict(siridb_shard_t * shard);
+void siridb_shard_evict(siridb_shard_t * shard);
+int siridb_shard_add_series(siridb_shard_t * shard, uint32_t series_id);
 void siridb_shard_drop(siridb_shard_t * shard, siridb_t * siridb);
+int siridb_shard_drop_expired(
+        siridb_t * siridb,
+        uint64_t num_ts,
+        uint64_t log_ts);
 
 long int siridb_shard_write_points(
         siridb_t * siridb,
@@ -93,6 +186,7 @@ long int siridb_shard_write_points(
         siridb_points_t * points,
         uint_fast32_t start,
         uint_fast32_t end,
+        const siridb_points_stats_t * stats,
         FILE * idx_fp);
 
 typedef int (*siridb_shard_get_points_cb)(
@@ -116,6 +210,20 @@ int siridb_shard_get_points_num64(
         uint64_t * end_ts,
         uint8_t has_overlap);
 
+int siridb_shard_get_points_cnum32(
+        siridb_points_t * points,
+        idx_t * idx,
+        uint64_t * start_ts,
+        uint64_t * end_ts,
+        uint8_t has_overlap);
+
+int siridb_shard_get_points_cnum64(
+        siridb_points_t * points,
+        idx_t * idx,
+        uint64_t * start_ts,
+        uint64_t * end_ts,
+        uint8_t has_overlap);
+
 int siridb_shard_get_points_log32(
         siridb_points_t * points,
         idx_t * idx,
@@ -129,8 +237,16 @@ int siridb_shard_get_points_log64(
         uint64_t * start_ts,
         uint64_t * end_ts,
         uint8_t has_overlap);
+void siridb_shard_prefetch(idx_t * idx, uint32_t n, const uint8_t * skip);
+void siridb_shard_prefetch_list(idx_t ** list, uint32_t n);
 
+int siridb_shard_need_optimize(siridb_shard_t * shard);
+uint64_t siridb_shard_optimize_benefit(siridb_shard_t * shard);
+uint64_t siridb_shard_optimize_score(siridb_shard_t * shard);
+uint64_t siridb_shard_optimize_bytes(siridb_shard_t * shard);
 int siridb_shard_optimize(siridb_shard_t * shard, siridb_t * siridb);
+int siridb_shard_drop_chunk(siridb_shard_t * shard, const idx_t * idx);
+size_t siridb_shard_verify(siridb_shard_t * shard, siridb_t * siridb);
 void siridb__shard_free(siridb_shard_t * shard);
 void siridb__shard_decref(siridb_shard_t * shard);
 
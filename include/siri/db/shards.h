@@ -22,3 +22,15 @@ int siridb_shards_add_points(
         siridb_t * siridb,
         siridb_series_t * series,
         siridb_points_t * points);
+int siridb_shards_load_cold(
+        siridb_t * siridb,
+        siridb_series_t * series,
+        uint64_t * start_ts,
+        uint64_t * end_ts);
+int siridb_shards_has_cold(
+        siridb_t * siridb,
+        siridb_series_t * series,
+        uint64_t * start_ts,
+        uint64_t * end_ts);
+int siridb_shards_evict(siridb_t * siridb);
+int siridb_shards_expire(siridb_t * siridb);
@@ -0,0 +1,55 @@
+/*
+ * shash.h - Hash index on series names.
+ *
+ * author       : Jeroen van der Heijden
+ * email        : jeroen@transceptor.technology
+ * copyright    : 2016, Transceptor Technology
+ *
+ * changes
+ *  - initial version, 14-10-2016
+ *
+ */
+#pragma once
+
+#include <inttypes.h>
+#include <siri/db/series.h>
+#include <stddef.h>
+
+typedef struct siridb_series_s siridb_series_t;
+
+typedef struct siridb_shash_key_s
+{
+    uint32_t hash;                  /* hash used by the index */
+    uint32_t sum;                   /* sum used by the pool lookup */
+} siridb_shash_key_t;
+
+typedef struct siridb_shash_entry_s
+{
+    uint32_t hash;
+    siridb_series_t * series;       /* NULL when the entry is empty */
+} siridb_shash_entry_t;
+
+typedef struct siridb_shash_s
+{
+    uint8_t is_valid;               /* 0 when a series could not be added */
+    uint32_t len;                   /* number of series */
+    uint32_t mask;                  /* size of entries - 1 */
+    siridb_shash_entry_t * entries;
+} siridb_shash_t;
+
+siridb_shash_t * siridb_shash_new(void);
+void siridb_shash_free(siridb_shash_t * shash);
+void siridb_shash_key(
+        siridb_shash_key_t * key,
+        const char * name,
+        size_t len);
+void siridb_shash_add(siridb_shash_t * shash, siridb_series_t * series);
+void siridb_shash_remove(siridb_shash_t * shash, siridb_series_t * series);
+siridb_series_t * siridb_shash_get(
+        siridb_shash_t * shash,
+        siridb_shash_key_t * key,
+        const char * name,
+        size_t len);
+
+/* returns 1 when the index can be used for lookups, 0 if not */
+#define siridb_shash_is_used(shash) ((shash) != NULL && (shash)->is_valid)
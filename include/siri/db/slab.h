@@ -0,0 +1,32 @@
+/*
+ * slab.h - Allocate objects of a fixed size from large blocks.
+ *
+ * author       : Jeroen van der Heijden
+ * email        : jeroen@transceptor.technology
+ * copyright    : 2016, Transceptor Technology
+ *
+ * changes
+ *  - initial version, 14-10-2016
+ *
+ */
+#pragma once
+
+#include <stddef.h>
+#include <uv.h>
+
+typedef struct siridb_slab_block_s siridb_slab_block_t;
+
+typedef struct siridb_slab_s
+{
+    uv_mutex_t lock;
+    size_t size;                    /* aligned object size */
+    size_t n;                       /* number of objects in a block */
+    size_t len;                     /* number of objects in use */
+    void * free;                    /* released objects, linked list */
+    siridb_slab_block_t * block;    /* current block, linked to older ones */
+} siridb_slab_t;
+
+siridb_slab_t * siridb_slab_new(size_t size, size_t n);
+void siridb_slab_free(siridb_slab_t * slab);
+void * siridb_slab_alloc(siridb_slab_t * slab);
+void siridb_slab_release(siridb_slab_t * slab, void * obj);
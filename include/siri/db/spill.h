@@ -0,0 +1,36 @@
+/*
+ * spill.h - Move select results to a temporary file.
+ *
+ * author       : Jeroen van der Heijden
+ * email        : jeroen@transceptor.technology
+ * copyright    : 2016, Transceptor Technology
+ *
+ * changes
+ *  - initial version, 14-10-2016
+ *
+ */
+#pragma once
+
+#include <siri/db/points.h>
+#include <stddef.h>
+#include <uv.h>
+
+/* smaller results stay in memory, a mapping for each would cost more */
+#define SIRIDB_SPILL_MIN_SIZE 65536
+
+typedef struct siridb_spill_s
+{
+    uv_mutex_t lock;
+    int fd;                 /* -1 until the first points are spilled */
+    size_t size;            /* bytes written to the file */
+} siridb_spill_t;
+
+siridb_spill_t * siridb_spill_new(void);
+void siridb_spill_free(siridb_spill_t * spill);
+int siridb_spill_can_use(points_tp tp, size_t len);
+siridb_points_t * siridb_spill_points(
+        siridb_spill_t * spill,
+        points_tp tp,
+        size_t len,
+        const void * data);
+void siridb_spill_unmap(siridb_point_t * data);
@@ -0,0 +1,57 @@
+/*
+ * startup.h - Time, bytes and objects for each phase of loading a database.
+ *
+ * author       : Jeroen van der Heijden
+ * email        : jeroen@transceptor.technology
+ * copyright    : 2016, Transceptor Technology
+ *
+ * changes
+ *  - initial version, 14-10-2016
+ *
+ */
+#pragma once
+
+#include <inttypes.h>
+#include <stddef.h>
+
+/* Warning: do not change the order! (maps to startup_str) */
+typedef enum
+{
+    SIRIDB_STARTUP_DATABASE,    /* database.dat and database.conf */
+    SIRIDB_STARTUP_USERS,
+    SIRIDB_STARTUP_SERVERS,
+    SIRIDB_STARTUP_SERIES,      /* series, dropped and snapshot files */
+    SIRIDB_STARTUP_BUFFER,
+    SIRIDB_STARTUP_SHARDS,
+    SIRIDB_STARTUP_HOTLOG,
+    SIRIDB_STARTUP_GROUPS,      /* groups, rollups and continuous queries */
+    SIRIDB_STARTUP_PROPS,       /* caches and series properties */
+    SIRIDB_STARTUP_POOLS,
+    SIRIDB_STARTUP_PEERS,       /* until authenticated with all servers */
+    SIRIDB_STARTUP_END
+} siridb_startup_phase_t;
+
+typedef struct siridb_startup_stat_s
+{
+    uint64_t ns;
+    uint64_t bytes;     /* size of the files which are read */
+    size_t objects;
+} siridb_startup_stat_t;
+
+typedef struct siridb_startup_s
+{
+    uint64_t start;     /* timeit_ns() at the start of the current phase */
+    uint64_t loaded;    /* timeit_ns() when loading has finished */
+    siridb_startup_stat_t phase[SIRIDB_STARTUP_END];
+} siridb_startup_t;
+
+typedef struct siridb_s siridb_t;
+
+void siridb_startup_init(siridb_startup_t * startup, uint64_t start);
+void siridb_startup_phase(
+        siridb_t * siridb,
+        siridb_startup_phase_t phase,
+        size_t objects);
+void siridb_startup_loaded(siridb_t * siridb);
+void siridb_startup_peers(siridb_t * siridb);
+char * siridb_startup_summary(siridb_t * siridb);
@@ -0,0 +1,76 @@
+/*
+ * subscribe.h - Push newly inserted points to subscribed clients.
+ *
+ * author       : Jeroen van der Heijden
+ * email        : jeroen@transceptor.technology
+ * copyright    : 2016, Transceptor Technology
+ *
+ * changes
+ *  - initial version, 14-10-2016
+ *
+ */
+#pragma once
+
+#include <imap/imap.h>
+#include <inttypes.h>
+#include <qpack/qpack.h>
+#include <siri/db/re.h>
+#include <slist/slist.h>
+#include <stddef.h>
+#include <uv.h>
+
+/* series set types for a subscribe request */
+#define SIRIDB_SUBSCRIBE_SERIES 0   /* a series name */
+#define SIRIDB_SUBSCRIBE_REGEX 1    /* a regular expression, like /cpu/i */
+#define SIRIDB_SUBSCRIBE_GROUP 2    /* a group name */
+
+#define SIRIDB_SUBSCRIBE_MAX 1024           // subscriptions per database
+#define SIRIDB_SUBSCRIBE_INTERVAL 100       // milliseconds between pushes
+#define SIRIDB_SUBSCRIBE_BUF_SZ 1048576     // 1 MB buffered per subscription
+#define SIRIDB_SUBSCRIBE_MAX_QUEUED 16      // packages queued on the socket
+
+/* true when the database has subscriptions */
+#define siridb_subscribe_has(siridb)                    \
+    ((siridb)->subscriptions != NULL &&                 \
+    (siridb)->subscriptions->slist->len)
+
+typedef struct siridb_s siridb_t;
+typedef struct siridb_series_s siridb_series_t;
+
+typedef struct siridb_subscription_s
+{
+    uint16_t pid;                   /* pid of the subscribe request */
+    uint8_t tp;
+    uv_stream_t * client;
+    char * name;                    /* series name or NULL */
+    siridb_re_t * re;               /* regular expression or NULL */
+    qp_packer_t * packer;           /* points waiting to be pushed or NULL */
+    size_t dropped;                 /* points dropped since the last push */
+} siridb_subscription_t;
+
+typedef struct siridb_subscriptions_s
+{
+    slist_t * slist;                /* subscriptions */
+    imap_t * matches;               /* series id -> subscriptions */
+    uv_timer_t * timer;
+} siridb_subscriptions_t;
+
+siridb_subscriptions_t * siridb_subscriptions_new(void);
+void siridb_subscriptions_close(siridb_subscriptions_t * subscriptions);
+void siridb_subscriptions_free(siridb_subscriptions_t * subscriptions);
+int siridb_subscribe(
+        siridb_t * siridb,
+        uv_stream_t * client,
+        uint16_t pid,
+        qp_unpacker_t * unpacker,
+        char * err_msg);
+int siridb_unsubscribe(
+        siridb_t * siridb,
+        uv_stream_t * client,
+        uint16_t pid);
+void siridb_subscribe_kill_client(siridb_t * siridb, uv_stream_t * client);
+void siridb_subscribe_points(
+        siridb_t * siridb,
+        siridb_series_t * series,
+        char * pt,
+        char * end);
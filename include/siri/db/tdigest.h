@@ -0,0 +1,42 @@
+/*
+ * tdigest.h - Approximate percentiles using a t-digest.
+ *
+ * author       : Jeroen van der Heijden
+ * email        : jeroen@transceptor.technology
+ * copyright    : 2016, Transceptor Technology
+ *
+ * changes
+ *  - initial version, 14-10-2016
+ *
+ */
+#pragma once
+
+#include <stddef.h>
+
+/* higher values give more accurate percentiles using more centroids */
+#define SIRIDB_TDIGEST_COMPRESSION 100
+
+/* a digest never has more than COMPRESSION + 1 centroids */
+#define SIRIDB_TDIGEST_CENTROIDS (2 * SIRIDB_TDIGEST_COMPRESSION)
+#define SIRIDB_TDIGEST_BUFFER (5 * SIRIDB_TDIGEST_COMPRESSION)
+
+typedef struct siridb_tdigest_c_s
+{
+    double mean;
+    double weight;
+} siridb_tdigest_c_t;
+
+typedef struct siridb_tdigest_s
+{
+    size_t n;               /* number of centroids */
+    size_t nbuf;            /* number of values which are not merged yet */
+    double min;
+    double max;
+    siridb_tdigest_c_t c[SIRIDB_TDIGEST_CENTROIDS];
+    siridb_tdigest_c_t buf[SIRIDB_TDIGEST_BUFFER];
+} siridb_tdigest_t;
+
+void siridb_tdigest_init(siridb_tdigest_t * td);
+void siridb_tdigest_add(siridb_tdigest_t * td, double val, double weight);
+void siridb_tdigest_merge(siridb_tdigest_t * td, siridb_tdigest_t * other);
+double siridb_tdigest_quantile(siridb_tdigest_t * td, double q);
@@ -0,0 +1,38 @@
+/*
+ * tokens.h - Token index on series name components.
+ *
+ * author       : Jeroen van der Heijden
+ * email        : jeroen@transceptor.technology
+ * copyright    : 2016, Transceptor Technology
+ *
+ * changes
+ *  - initial version, 14-10-2016
+ *
+ */
+#pragma once
+
+#include <ctree/ctree.h>
+#include <inttypes.h>
+#include <siri/db/series.h>
+#include <slist/slist.h>
+#include <stddef.h>
+
+typedef struct siridb_series_s siridb_series_t;
+
+typedef struct siridb_tokens_s
+{
+    uint8_t is_valid;               /* 0 when a series could not be added */
+    char * separators;              /* characters between name components */
+    ct_t * lists;                   /* imap_t with series by token */
+} siridb_tokens_t;
+
+siridb_tokens_t * siridb_tokens_new(const char * separators);
+void siridb_tokens_free(siridb_tokens_t * tokens);
+void siridb_tokens_add(siridb_tokens_t * tokens, siridb_series_t * series);
+void siridb_tokens_remove(
+        siridb_tokens_t * tokens,
+        siridb_series_t * series);
+slist_t * siridb_tokens_match(
+        siridb_tokens_t * tokens,
+        const char * source,
+        size_t len);
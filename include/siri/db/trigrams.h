@@ -0,0 +1,46 @@
+/*
+ * trigrams.h - Trigram index on series names.
+ *
+ * author       : Jeroen van der Heijden
+ * email        : jeroen@transceptor.technology
+ * copyright    : 2016, Transceptor Technology
+ *
+ * changes
+ *  - initial version, 14-10-2016
+ *
+ */
+#pragma once
+
+#include <imap/imap.h>
+#include <inttypes.h>
+#include <siri/db/series.h>
+#include <stddef.h>
+
+typedef struct siridb_series_s siridb_series_t;
+
+/* sorted series ids */
+typedef struct siridb_trigrams_ids_s
+{
+    size_t len;
+    size_t size;
+    uint32_t ids[];
+} siridb_trigrams_ids_t;
+
+typedef struct siridb_trigrams_s
+{
+    uint8_t is_valid;               /* 0 when a series could not be added */
+    imap_t * lists;                 /* siridb_trigrams_ids_t by trigram */
+} siridb_trigrams_t;
+
+siridb_trigrams_t * siridb_trigrams_new(void);
+void siridb_trigrams_free(siridb_trigrams_t * trigrams);
+void siridb_trigrams_add(
+        siridb_trigrams_t * trigrams,
+        siridb_series_t * series);
+void siridb_trigrams_remove(
+        siridb_trigrams_t * trigrams,
+        siridb_series_t * series);
+siridb_trigrams_ids_t * siridb_trigrams_match(
+        siridb_trigrams_t * trigrams,
+        const char * source,
+        size_t len);
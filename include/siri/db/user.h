@@ -15,6 +15,7 @@
 #include <inttypes.h>
 #include <siri/db/db.h>
 #include <siri/db/access.h>
+#include <siri/db/ratelimit.h>
 #include <cexpr/cexpr.h>
 
 typedef struct siridb_s siridb_t;
@@ -22,10 +23,12 @@ typedef struct siridb_s siridb_t;
 typedef struct siridb_user_s
 {
     uint16_t ref;
-    uint16_t pad0;
+    uint8_t sched;      /* scheduler class for selects */
+    uint8_t pad0;
     uint32_t access_bit;
     char * name;
     char * password; /* keeps an encrypted password */
+    siridb_ratelimits_t * ratelimits;   /* NULL when not limited */
 } siridb_user_t;
 
 siridb_user_t * siridb_user_new(void);
@@ -11,6 +11,7 @@
  */
 #pragma once
 
+#include <cfgparser/cfgparser.h>
 #include <inttypes.h>
 #include <siri/db/db.h>
 #include <siri/db/user.h>
@@ -19,7 +20,14 @@
 typedef struct siridb_s siridb_t;
 typedef struct siridb_user_s siridb_user_t;
 
+#define SIRIDB_USERS_SCHED_SECTION "scheduler"
+#define SIRIDB_USERS_RATELIMIT_SECTION "ratelimit"
+
 int siridb_users_load(siridb_t * siridb);
+void siridb_users_read_sched(siridb_t * siridb, cfgparser_t * cfgparser);
+void siridb_users_read_ratelimit(
+        siridb_t * siridb,
+        cfgparser_t * cfgparser);
 void siridb_users_free(llist_t * users);
 int siridb_users_add_user(
         siridb_t * siridb,
@@ -33,5 +41,8 @@ siridb_user_t * siridb_users_get_user(
         llist_t * users,
         const char * username,
         const char * password);
+int siridb_users_check_password(
+        const char * password,
+        const char * encrypted);
 int siridb_users_save(siridb_t * siridb);
-ssize_t siridb_users_get_file(char ** buffer, siridb_t * siridb);
+void siridb_users_get_fn(char * fn, siridb_t * siridb);
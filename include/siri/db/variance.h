@@ -11,6 +11,52 @@
  */
 #pragma once
 
+#include <inttypes.h>
 #include <siri/db/points.h>
 
-double siridb_variance(siridb_points_t * points);
+/* values which are processed at once, fits in the L1 cache */
+#define SIRIDB_VARIANCE_BLOCK 512
+
+/* a partial variance is a count, mean and m2 for each group */
+#define SIRIDB_VARIANCE_PARTS 3
+
+typedef struct siridb_aggr_s siridb_aggr_t;
+
+/*
+ * State for the variance of a range of values which can be merged with the
+ * state for another range. (Chan et al.)
+ */
+typedef struct siridb_variance_s
+{
+    uint64_t n;
+    double mean;
+    double m2;          /* sum of the squared differences from the mean */
+} siridb_variance_t;
+
+#define SIRIDB_VARIANCE_INIT {0, 0.0, 0.0}
+
+void siridb_variance_points(
+        siridb_variance_t * state,
+        siridb_points_t * points,
+        size_t start,
+        size_t end);
+void siridb_variance_merge(
+        siridb_variance_t *__restrict state,
+        const siridb_variance_t *__restrict other);
+double siridb_variance_sample(const siridb_variance_t * state);
+double siridb_variance_population(const siridb_variance_t * state);
+int siridb_variance_is_gid(uint32_t gid);
+int siridb_variance_parts_new(siridb_points_t ** parts, size_t size);
+void siridb_variance_parts_free(siridb_points_t ** parts);
+void siridb_variance_parts_add(
+        siridb_points_t ** parts,
+        siridb_points_t * batch,
+        siridb_aggr_t * aggr);
+int siridb_variance_parts_combine(
+        siridb_points_t ** parts,
+        siridb_points_t ** other,
+        char * err_msg);
+siridb_points_t * siridb_variance_parts_finish(
+        siridb_points_t ** parts,
+        uint32_t gid,
+        char * err_msg);
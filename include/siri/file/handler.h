@@ -17,8 +17,11 @@
 typedef struct siri_fh_s
 {
     uint16_t size;
-    uint16_t idx;
+    uint16_t idx;           /* clock hand, the next position to check */
     siri_fp_t ** fpointers;
+    uint64_t opens;
+    uint64_t evictions;
+    uint64_t hits;
 } siri_fh_t;
 
 siri_fh_t * siri_fh_new(uint16_t size);
@@ -30,4 +33,9 @@ int siri_fopen(
         siri_fp_t * fp,
         const char * fn,
         const char * modes);
+int siri_fh_open(
+        siri_fh_t * fh,
+        siri_fp_t * fp,
+        const char * fn,
+        const char * modes);
 
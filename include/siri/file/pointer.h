@@ -12,6 +12,7 @@
 #pragma once
 
 #include <stdio.h>
+#include <stddef.h>
 #include <inttypes.h>
 
 
@@ -19,6 +20,11 @@ typedef struct siri_fp_s
 {
     FILE * fp;
     uint8_t ref;
+    uint8_t used;   /* set when the open file is used, see handler.c */
+    uint16_t slot;  /* position in the file handler while open */
+    size_t map_sz;  /* size of the read-only mapping, 0 if not mapped */
+    char * map;
+    size_t alloc_sz;    /* preallocated end of the file, 0 if none */
 } siri_fp_t;
 
 
@@ -26,3 +32,9 @@ siri_fp_t * siri_fp_new(void);
 /* closes the file pointer, decrement reference counter and free if needed */
 void siri_fp_decref(siri_fp_t * fp);
 void siri_fp_close(siri_fp_t * fp);
+int siri_fp_prealloc(siri_fp_t * fp, size_t size, size_t len, size_t extent);
+const char * siri_fp_map(
+        siri_fp_t * fp,
+        size_t pos,
+        size_t len,
+        size_t size);
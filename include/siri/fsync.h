@@ -0,0 +1,30 @@
+/*
+ * fsync.h - Group commit for shard and buffer files.
+ *
+ * author       : Jeroen van der Heijden
+ * email        : jeroen@transceptor.technology
+ * copyright    : 2016, Transceptor Technology
+ *
+ * changes
+ *  - initial version, 14-10-2016
+ *
+ */
+#pragma once
+
+#include <siri/siri.h>
+#include <stddef.h>
+
+typedef enum
+{
+    SIRI_FSYNC_NONE,        /* leave writing to disk to the OS */
+    SIRI_FSYNC_INTERVAL,    /* sync every fsync_interval milliseconds */
+    SIRI_FSYNC_BYTES        /* sync after fsync_bytes are written */
+} siri_fsync_mode_t;
+
+typedef struct siri_s siri_t;
+
+void siri_fsync_init(siri_t * siri);
+void siri_fsync_stop(siri_t * siri);
+void siri_fsync_add(const char * fn, size_t size);
+void siri_fsync_insert_done(void);
+const char * siri_fsync_mode_str(siri_fsync_mode_t mode);
@@ -42,6 +42,7 @@ enum cleri_grammar_ids {
     CLERI_GID_COUNT_STMT,
     CLERI_GID_COUNT_USERS,
     CLERI_GID_CREATE_GROUP,
+    CLERI_GID_CREATE_SNAPSHOT,
     CLERI_GID_CREATE_STMT,
     CLERI_GID_CREATE_USER,
     CLERI_GID_C_DIFFERENCE,
@@ -51,17 +52,21 @@ enum cleri_grammar_ids {
     CLERI_GID_DROP_SHARDS,
     CLERI_GID_DROP_STMT,
     CLERI_GID_DROP_USER,
+    CLERI_GID_EXPLAIN_STMT,
     CLERI_GID_F_COUNT,
     CLERI_GID_F_DERIVATIVE,
     CLERI_GID_F_DIFFERENCE,
     CLERI_GID_F_FILTER,
     CLERI_GID_F_LIMIT,
+    CLERI_GID_F_LTTB,
     CLERI_GID_F_MAX,
     CLERI_GID_F_MEAN,
     CLERI_GID_F_MEDIAN,
     CLERI_GID_F_MEDIAN_HIGH,
     CLERI_GID_F_MEDIAN_LOW,
     CLERI_GID_F_MIN,
+    CLERI_GID_F_MINMAX,
+    CLERI_GID_F_PERCENTILE,
     CLERI_GID_F_POINTS,
     CLERI_GID_F_PVARIANCE,
     CLERI_GID_F_SUM,
@@ -88,6 +93,7 @@ enum cleri_grammar_ids {
     CLERI_GID_HELP_COUNT_USERS,
     CLERI_GID_HELP_CREATE,
     CLERI_GID_HELP_CREATE_GROUP,
+    CLERI_GID_HELP_CREATE_SNAPSHOT,
     CLERI_GID_HELP_CREATE_USER,
     CLERI_GID_HELP_DROP,
     CLERI_GID_HELP_DROP_GROUP,
@@ -111,19 +117,26 @@ enum cleri_grammar_ids {
     CLERI_GID_HELP_TIMEIT,
     CLERI_GID_HELP_TIMEZONES,
     CLERI_GID_INT_EXPR,
+    CLERI_GID_JOIN_EXPR,
     CLERI_GID_INT_OPERATOR,
+    CLERI_GID_KILL_STMT,
     CLERI_GID_K_ACCESS,
     CLERI_GID_K_ACTIVE_HANDLES,
     CLERI_GID_K_ADDRESS,
     CLERI_GID_K_AFTER,
+    CLERI_GID_K_ALLOCATOR,
     CLERI_GID_K_ALTER,
     CLERI_GID_K_AND,
     CLERI_GID_K_AS,
     CLERI_GID_K_BACKUP_MODE,
     CLERI_GID_K_BEFORE,
     CLERI_GID_K_BETWEEN,
+    CLERI_GID_K_BOTTOM,
     CLERI_GID_K_BUFFER_PATH,
     CLERI_GID_K_BUFFER_SIZE,
+    CLERI_GID_K_CHUNK_CACHE_HITS,
+    CLERI_GID_K_CHUNK_CACHE_MISSES,
+    CLERI_GID_K_CHUNK_CACHE_USAGE,
     CLERI_GID_K_COUNT,
     CLERI_GID_K_CREATE,
     CLERI_GID_K_CRITICAL,
@@ -139,9 +152,15 @@ enum cleri_grammar_ids {
     CLERI_GID_K_DURATION_NUM,
     CLERI_GID_K_END,
     CLERI_GID_K_ERROR,
+    CLERI_GID_K_EXPIRATION_LOG,
+    CLERI_GID_K_EXPIRATION_NUM,
+    CLERI_GID_K_EXPLAIN,
     CLERI_GID_K_EXPRESSION,
     CLERI_GID_K_FALSE,
     CLERI_GID_K_FIFO_FILES,
+    CLERI_GID_K_FILE_HANDLE_EVICTIONS,
+    CLERI_GID_K_FILE_HANDLE_HITS,
+    CLERI_GID_K_FILE_HANDLE_OPENS,
     CLERI_GID_K_FILTER,
     CLERI_GID_K_FLOAT,
     CLERI_GID_K_FOR,
@@ -151,46 +170,68 @@ enum cleri_grammar_ids {
     CLERI_GID_K_GROUP,
     CLERI_GID_K_GROUPS,
     CLERI_GID_K_HELP,
+    CLERI_GID_K_HOT_SERIES,
     CLERI_GID_K_IGNORE_THRESHOLD,
     CLERI_GID_K_INFO,
     CLERI_GID_K_INSERT,
+    CLERI_GID_K_INSERT_QUEUE,
+    CLERI_GID_K_INSERT_QUEUE_SIZE,
     CLERI_GID_K_INTEGER,
     CLERI_GID_K_INTERSECTION,
     CLERI_GID_K_IP_SUPPORT,
+    CLERI_GID_K_JOIN,
+    CLERI_GID_K_KILL,
+    CLERI_GID_K_LATENCY,
     CLERI_GID_K_LENGTH,
     CLERI_GID_K_LIBUV,
     CLERI_GID_K_LIMIT,
     CLERI_GID_K_LIST,
     CLERI_GID_K_LIST_LIMIT,
+    CLERI_GID_K_LOCK_CONTENTION,
     CLERI_GID_K_LOG,
     CLERI_GID_K_LOG_LEVEL,
+    CLERI_GID_K_LOOP,
+    CLERI_GID_K_LTTB,
     CLERI_GID_K_MAX,
     CLERI_GID_K_MAX_OPEN_FILES,
     CLERI_GID_K_MEAN,
     CLERI_GID_K_MEDIAN,
     CLERI_GID_K_MEDIAN_HIGH,
     CLERI_GID_K_MEDIAN_LOW,
+    CLERI_GID_K_MEM_BUFFER,
+    CLERI_GID_K_MEM_GROUPS,
+    CLERI_GID_K_MEM_INSERT,
+    CLERI_GID_K_MEM_NET,
+    CLERI_GID_K_MEM_QUERY,
+    CLERI_GID_K_MEM_SERIES,
+    CLERI_GID_K_MEM_SHARD,
     CLERI_GID_K_MEM_USAGE,
     CLERI_GID_K_MERGE,
     CLERI_GID_K_MIN,
+    CLERI_GID_K_MINMAX,
     CLERI_GID_K_MODIFY,
     CLERI_GID_K_NAME,
     CLERI_GID_K_NOW,
     CLERI_GID_K_NUMBER,
     CLERI_GID_K_ONLINE,
     CLERI_GID_K_OPEN_FILES,
+    CLERI_GID_K_OPTIMIZE_PROGRESS,
     CLERI_GID_K_OR,
     CLERI_GID_K_PASSWORD,
+    CLERI_GID_K_PERCENTILE,
     CLERI_GID_K_POINTS,
     CLERI_GID_K_POOL,
     CLERI_GID_K_POOLS,
     CLERI_GID_K_PORT,
     CLERI_GID_K_PREFIX,
     CLERI_GID_K_PVARIANCE,
+    CLERI_GID_K_QUERIES,
+    CLERI_GID_K_QUERY,
     CLERI_GID_K_READ,
     CLERI_GID_K_RECEIVED_POINTS,
     CLERI_GID_K_REINDEX_PROGRESS,
     CLERI_GID_K_REVOKE,
+    CLERI_GID_K_RTT,
     CLERI_GID_K_SELECT,
     CLERI_GID_K_SELECTED_POINTS,
     CLERI_GID_K_SELECT_POINTS_LIMIT,
@@ -202,7 +243,9 @@ enum cleri_grammar_ids {
     CLERI_GID_K_SHOW,
     CLERI_GID_K_SID,
     CLERI_GID_K_SIZE,
+    CLERI_GID_K_SNAPSHOT,
     CLERI_GID_K_START,
+    CLERI_GID_K_STARTUP_PROFILE,
     CLERI_GID_K_STARTUP_TIME,
     CLERI_GID_K_STATUS,
     CLERI_GID_K_STRING,
@@ -214,6 +257,7 @@ enum cleri_grammar_ids {
     CLERI_GID_K_TIMEZONE,
     CLERI_GID_K_TIME_PRECISION,
     CLERI_GID_K_TO,
+    CLERI_GID_K_TOP,
     CLERI_GID_K_TRUE,
     CLERI_GID_K_TYPE,
     CLERI_GID_K_UNION,
@@ -231,6 +275,7 @@ enum cleri_grammar_ids {
     CLERI_GID_LIMIT_EXPR,
     CLERI_GID_LIST_GROUPS,
     CLERI_GID_LIST_POOLS,
+    CLERI_GID_LIST_QUERIES,
     CLERI_GID_LIST_SERIES,
     CLERI_GID_LIST_SERVERS,
     CLERI_GID_LIST_SHARDS,
@@ -255,6 +300,7 @@ enum cleri_grammar_ids {
     CLERI_GID_R_UUID_STR,
     CLERI_GID_SELECT_AGGREGATE,
     CLERI_GID_SELECT_STMT,
+    CLERI_GID_SERIES_AFTER,
     CLERI_GID_SERIES_COLUMNS,
     CLERI_GID_SERIES_MATCH,
     CLERI_GID_SERIES_NAME,
@@ -264,6 +310,8 @@ enum cleri_grammar_ids {
     CLERI_GID_SET_ADDRESS,
     CLERI_GID_SET_BACKUP_MODE,
     CLERI_GID_SET_DROP_THRESHOLD,
+    CLERI_GID_SET_EXPIRATION_LOG,
+    CLERI_GID_SET_EXPIRATION_NUM,
     CLERI_GID_SET_EXPRESSION,
     CLERI_GID_SET_IGNORE_THRESHOLD,
     CLERI_GID_SET_LIST_LIMIT,
@@ -281,6 +329,7 @@ enum cleri_grammar_ids {
     CLERI_GID_SUFFIX_EXPR,
     CLERI_GID_TIMEIT_STMT,
     CLERI_GID_TIME_EXPR,
+    CLERI_GID_TOP_EXPR,
     CLERI_GID_USER_COLUMNS,
     CLERI_GID_UUID,
     CLERI_GID_WHERE_GROUP,
@@ -0,0 +1,127 @@
+/*
+ * latency.h - Latency histograms for each request type.
+ *
+ * author       : Jeroen van der Heijden
+ * email        : jeroen@transceptor.technology
+ * copyright    : 2016, Transceptor Technology
+ *
+ * changes
+ *  - initial version, 14-10-2016
+ *
+ */
+#pragma once
+
+#include <inttypes.h>
+#include <qpack/qpack.h>
+#include <timeit/timeit.h>
+
+/* values below 2^(SUB_BITS + 1) micro seconds are exact */
+#define SIRI_LATENCY_SUB_BITS 5
+#define SIRI_LATENCY_SUB (1 << SIRI_LATENCY_SUB_BITS)
+#define SIRI_LATENCY_MAX_BITS 40  /* about 12 days in micro seconds */
+#define SIRI_LATENCY_BUCKETS \
+    (SIRI_LATENCY_SUB * (SIRI_LATENCY_MAX_BITS - SIRI_LATENCY_SUB_BITS + 1))
+
+typedef enum
+{
+    /* client requests */
+    SIRI_LATENCY_QUERY,
+    SIRI_LATENCY_INSERT,
+    SIRI_LATENCY_AUTH,
+    SIRI_LATENCY_PING,
+    SIRI_LATENCY_INFO,
+    SIRI_LATENCY_LOADDB,
+    SIRI_LATENCY_REGISTER_SERVER,
+    SIRI_LATENCY_FILE,
+    SIRI_LATENCY_ADMIN,
+    SIRI_LATENCY_FETCH,
+
+    /* back-end requests */
+    SIRI_LATENCY_BACKEND_AUTH,
+    SIRI_LATENCY_BACKEND_FLAGS,
+    SIRI_LATENCY_BACKEND_LOG_LEVEL,
+    SIRI_LATENCY_BACKEND_REPL_FINISHED,
+    SIRI_LATENCY_BACKEND_QUERY,
+    SIRI_LATENCY_BACKEND_INSERT,
+    SIRI_LATENCY_BACKEND_REGISTER_SERVER,
+    SIRI_LATENCY_BACKEND_DROP_SERIES,
+    SIRI_LATENCY_BACKEND_GROUPS,
+    SIRI_LATENCY_BACKEND_BACKUP_MODE,
+    SIRI_LATENCY_BACKEND_KILL_QUERY,
+    SIRI_LATENCY_BACKEND_FETCH,
+
+    /* query statements, both from clients and other servers */
+    SIRI_LATENCY_STMT_SELECT,
+    SIRI_LATENCY_STMT_LIST,
+    SIRI_LATENCY_STMT_COUNT,
+    SIRI_LATENCY_STMT_DROP,
+    SIRI_LATENCY_STMT_OTHER,
+
+    SIRI_LATENCY_END
+} siri_latency_tp_t;
+
+typedef struct siri_latency_hist_s
+{
+    uint64_t n;
+    uint64_t max;
+    uint64_t sum;
+    uint32_t buckets[SIRI_LATENCY_BUCKETS];
+} siri_latency_hist_t;
+
+typedef struct siri_latency_s
+{
+    siri_latency_hist_t wait;   /* until the request is handled */
+    siri_latency_hist_t exec;   /* handling the request */
+} siri_latency_t;
+
+/*
+ * Timer for requests which are queued in the event loop before they are
+ * handled. Only the first time in the queue is counted as wait time.
+ */
+typedef struct siri_latency_timer_s
+{
+    uint64_t start;
+    uint64_t queued;
+    uint64_t wait;
+} siri_latency_timer_t;
+
+const char * siri_latency_str(siri_latency_tp_t tp);
+void siri_latency_add(siri_latency_tp_t tp, uint64_t wait, uint64_t exec);
+uint64_t siri_latency_count_le(siri_latency_hist_t * hist, uint64_t us);
+uint64_t siri_latency_percentile(siri_latency_hist_t * hist, double p);
+char * siri_latency_summary(void);
+int siri_latency_pack(qp_packer_t * packer);
+
+extern siri_latency_t siri_latency[SIRI_LATENCY_END];
+
+static inline void siri_latency_start(siri_latency_timer_t * timer)
+{
+    timer->start = timeit_ns();
+    timer->queued = 0;
+    timer->wait = 0;
+}
+
+static inline void siri_latency_queue(siri_latency_timer_t * timer)
+{
+    if (!timer->wait)
+    {
+        timer->queued = timeit_ns();
+    }
+}
+
+static inline void siri_latency_dequeue(siri_latency_timer_t * timer)
+{
+    if (timer->queued)
+    {
+        timer->wait = timeit_ns() - timer->queued;
+        timer->queued = 0;
+    }
+}
+
+static inline void siri_latency_done(
+        siri_latency_timer_t * timer,
+        siri_latency_tp_t tp)
+{
+    uint64_t total = timeit_ns() - timer->start;
+    siri_latency_add(tp, timer->wait, total - timer->wait);
+}
@@ -0,0 +1,80 @@
+/*
+ * loop.h - Event loop lag and time spent per callback category.
+ *
+ * author       : Jeroen van der Heijden
+ * email        : jeroen@transceptor.technology
+ * copyright    : 2016, Transceptor Technology
+ *
+ * changes
+ *  - initial version, 14-10-2016
+ *
+ */
+#pragma once
+
+#include <inttypes.h>
+#include <siri/siri.h>
+#include <timeit/timeit.h>
+
+#define SIRI_LOOP_PROBE_INTERVAL 100    // milliseconds between two probes
+#define SIRI_LOOP_SLOW_LAG 250          // milliseconds, lag is logged
+#define SIRI_LOOP_SLOW_CB 100           // milliseconds, callback is logged
+#define SIRI_LOOP_WARN_INTERVAL 10      // seconds between two warnings
+
+typedef struct siri_s siri_t;
+
+typedef enum
+{
+    SIRI_LOOP_READ,         /* reading and handling packages of a socket */
+    SIRI_LOOP_INSERT,       /* insert tasks */
+    SIRI_LOOP_LISTENER,     /* parsing a query and the listener steps */
+    SIRI_LOOP_PROMISE,      /* responses and time-outs of promises */
+    SIRI_LOOP_TIMER,        /* heart-beat, optimize, fsync and others */
+
+    SIRI_LOOP_END
+} siri_loop_tp_t;
+
+typedef struct siri_loop_stat_s
+{
+    uint64_t n;
+    uint64_t ns;
+    uint64_t max_ns;
+    uint64_t slow;          /* callbacks which took SIRI_LOOP_SLOW_CB */
+} siri_loop_stat_t;
+
+/*
+ * A frame is started when a callback is entered. Time spent in a nested
+ * callback, like a promise which is resolved while a socket is read, is
+ * counted for the nested category only.
+ */
+typedef struct siri_loop_frame_s
+{
+    uint64_t start;
+    uint64_t inner;
+} siri_loop_frame_t;
+
+typedef struct siri_loop_s
+{
+    uint64_t start;             /* ns, start of the statistics */
+    uint64_t inner;             /* ns, spent in nested callbacks */
+    uint64_t probe;             /* ns, when the probe is expected */
+    uint64_t lag_n;
+    uint64_t lag_ns;
+    uint64_t lag_max_ns;
+    uint64_t lag_slow;          /* probes with a lag of SIRI_LOOP_SLOW_LAG */
+    uint64_t warned;            /* ns, last warning in the log */
+    siri_loop_stat_t stat[SIRI_LOOP_END];
+} siri_loop_t;
+
+void siri_loop_init(siri_t * siri);
+void siri_loop_stop(void);
+void siri_loop_done(siri_loop_tp_t tp, siri_loop_frame_t * frame);
+char * siri_loop_summary(void);
+
+extern siri_loop_t siri_loop;
+
+static inline void siri_loop_enter(siri_loop_frame_t * frame)
+{
+    frame->start = timeit_ns();
+    frame->inner = siri_loop.inner;
+    siri_loop.inner = 0;
+}
@@ -0,0 +1,40 @@
+/*
+ * mem.h - Memory usage counters for each subsystem.
+ *
+ * author       : Jeroen van der Heijden
+ * email        : jeroen@transceptor.technology
+ * copyright    : 2016, Transceptor Technology
+ *
+ * changes
+ *  - initial version, 14-10-2016
+ *
+ */
+#pragma once
+
+#include <qpack/qpack.h>
+#include <stddef.h>
+
+typedef enum
+{
+    SIRI_MEM_SERIES,    /* series objects and names */
+    SIRI_MEM_SHARD,     /* shard objects and series indexes */
+    SIRI_MEM_BUFFER,    /* series buffers */
+    SIRI_MEM_INSERT,    /* inserts which are not finished */
+    SIRI_MEM_QUERY,     /* running queries and their points */
+    SIRI_MEM_NET,       /* sockets and read buffers */
+    SIRI_MEM_GROUPS,    /* groups and their series lists */
+    SIRI_MEM_END
+} siri_mem_tp_t;
+
+extern size_t siri_mem[SIRI_MEM_END];
+
+/* counters are updated by multiple threads */
+#define siri_mem_add(tp, size) \
+    __atomic_add_fetch(&siri_mem[tp], (size), __ATOMIC_RELAXED)
+#define siri_mem_sub(tp, size) \
+    __atomic_sub_fetch(&siri_mem[tp], (size), __ATOMIC_RELAXED)
+#define siri_mem_get(tp) \
+    __atomic_load_n(&siri_mem[tp], __ATOMIC_RELAXED)
+
+const char * siri_mem_str(siri_mem_tp_t tp);
+int siri_mem_pack(qp_packer_t * packer);
@@ -0,0 +1,88 @@
+/*
+ * mutex.h - Mutex and reader-writer lock which record wait and hold time for
+ *           each call site.
+ *
+ * author       : Jeroen van der Heijden
+ * email        : jeroen@transceptor.technology
+ * copyright    : 2016, Transceptor Technology
+ *
+ * changes
+ *  - initial version, 14-10-2016
+ *
+ */
+#pragma once
+
+#include <inttypes.h>
+#include <stddef.h>
+#include <uv.h>
+
+/* number of call sites returned by show lock_contention */
+#define SIRI_MUTEX_TOP 10
+
+typedef struct siri_mutex_site_s siri_mutex_site_t;
+
+/* statistics for a place in the code where a mutex is locked */
+typedef struct siri_mutex_site_s
+{
+    const char * name;          /* name of the mutex */
+    const char * file;
+    int line;
+    int registered;             /* set when added to the list of sites */
+    uint64_t n;                 /* number of times the mutex is locked */
+    uint64_t contended;         /* number of times the lock had to wait */
+    uint64_t wait;              /* nanoseconds waiting for the lock */
+    uint64_t max_wait;          /* longest wait in nanoseconds */
+    uint64_t hold;              /* nanoseconds holding the lock */
+    siri_mutex_site_t * next;
+} siri_mutex_site_t;
+
+typedef struct siri_mutex_s
+{
+    uv_mutex_t mutex;
+    siri_mutex_site_t * site;   /* site which holds the lock */
+    uint64_t locked;            /* time in nanoseconds the lock is taken */
+} siri_mutex_t;
+
+/* hold time is only recorded for the write lock */
+typedef struct siri_rwlock_s
+{
+    uv_rwlock_t rwlock;
+    siri_mutex_site_t * site;   /* site which holds the write lock */
+    uint64_t locked;            /* time in nanoseconds the lock is taken */
+} siri_rwlock_t;
+
+void siri_mutex_enable(int enable);
+int siri_mutex_init(siri_mutex_t * mutex);
+void siri_mutex_destroy(siri_mutex_t * mutex);
+void siri_mutex_lock_site(siri_mutex_t * mutex, siri_mutex_site_t * site);
+void siri_mutex_unlock(siri_mutex_t * mutex);
+int siri_rwlock_init(siri_rwlock_t * rwlock);
+void siri_rwlock_destroy(siri_rwlock_t * rwlock);
+void siri_rwlock_rdlock_site(siri_rwlock_t * rwlock, siri_mutex_site_t * site);
+void siri_rwlock_rdunlock(siri_rwlock_t * rwlock);
+void siri_rwlock_wrlock_site(siri_rwlock_t * rwlock, siri_mutex_site_t * site);
+void siri_rwlock_wrunlock(siri_rwlock_t * rwlock);
+size_t siri_mutex_top(siri_mutex_site_t ** sites, size_t n);
+char * siri_mutex_summary(void);
+
+/*
+ * Call 'fn' with a static site for this call site. The site is named after
+ * the lock expression, for example &siridb->series_mutex is shown as
+ * 'series_mutex'.
+ */
+#define SIRI_MUTEX_SITE(fn, lock)                                       \
+{                                                                       \
+    static siri_mutex_site_t site__ = {                                 \
+            .name=#lock,                                                \
+            .file=__FILE__,                                             \
+            .line=__LINE__};                                            \
+    fn(lock, &site__);                                                  \
+}
+
+/* lock and record the statistics for this call site when enabled */
+#define siri_mutex_lock(mutex) \
+    SIRI_MUTEX_SITE(siri_mutex_lock_site, mutex)
+#define siri_rwlock_rdlock(rwlock) \
+    SIRI_MUTEX_SITE(siri_rwlock_rdlock_site, rwlock)
+#define siri_rwlock_wrlock(rwlock) \
+    SIRI_MUTEX_SITE(siri_rwlock_wrlock_site, rwlock)
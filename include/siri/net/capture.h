@@ -0,0 +1,34 @@
+/*
+ * capture.h - Capture client packages so they can be replayed.
+ *
+ * author       : Jeroen van der Heijden
+ * email        : jeroen@transceptor.technology
+ * copyright    : 2016, Transceptor Technology
+ *
+ * changes
+ *  - initial version, 14-10-2016
+ *
+ */
+#pragma once
+
+#include <inttypes.h>
+#include <siri/net/pkg.h>
+#include <stddef.h>
+#include <uv.h>
+
+/*
+ * A capture file starts with SIRINET_CAPTURE_MAGIC followed by a version
+ * byte. Each record has the nanoseconds since the capture was started, the
+ * connection id and the package (header and data), all in host byte order.
+ * Authentication packages only contain the database name.
+ */
+#define SIRINET_CAPTURE_MAGIC "SIRICAP"
+#define SIRINET_CAPTURE_MAGIC_SZ 7
+#define SIRINET_CAPTURE_VERSION 1
+#define SIRINET_CAPTURE_HEADER_SZ (SIRINET_CAPTURE_MAGIC_SZ + 1)
+#define SIRINET_CAPTURE_REC_SZ \
+    (sizeof(uint64_t) + sizeof(uint32_t) + sizeof(sirinet_pkg_t))
+
+int sirinet_capture_init(const char * fn, size_t max_size);
+void sirinet_capture_pkg(uv_stream_t * client, sirinet_pkg_t * pkg);
+void sirinet_capture_close(void);
@@ -18,4 +18,5 @@ typedef struct siri_s siri_t;
 
 int sirinet_clserver_init(siri_t * siri);
 
-typedef ssize_t (*sirinet_clserver_getfile)(char ** buffer, siridb_t * siridb);
+/* writes the file name to 'fn' which has at least PATH_MAX bytes */
+typedef void (*sirinet_clserver_getfn)(char * fn, siridb_t * siridb);
@@ -0,0 +1,36 @@
+/*
+ * fsend.h - Send a file as the data of a package in chunks.
+ *
+ * author       : Jeroen van der Heijden
+ * email        : jeroen@transceptor.technology
+ * copyright    : 2016, Transceptor Technology
+ *
+ * changes
+ *  - initial version, 14-10-2016
+ *
+ */
+#pragma once
+
+#include <siri/net/pkg.h>
+#include <uv.h>
+
+#define SIRINET_FSEND_CHUNK 65536   // bytes read and written at once
+
+typedef struct sirinet_fsend_s
+{
+    uv_fs_t req;
+    uv_write_t wreq;
+    uv_stream_t * client;
+    uv_file fd;
+    uint32_t size;
+    uint32_t offset;
+    uint8_t header_sent;
+    char header[sizeof(sirinet_pkg_t)];
+    char buf[SIRINET_FSEND_CHUNK];
+} sirinet_fsend_t;
+
+int sirinet_fsend(
+        uv_stream_t * client,
+        uint16_t pid,
+        uint8_t tp,
+        const char * fn);
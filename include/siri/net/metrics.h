@@ -0,0 +1,19 @@
+/*
+ * metrics.h - HTTP listener serving metrics in the OpenMetrics text format.
+ *
+ * author       : Jeroen van der Heijden
+ * email        : jeroen@transceptor.technology
+ * copyright    : 2016, Transceptor Technology
+ *
+ * changes
+ *  - initial version, 14-10-2016
+ *
+ */
+#pragma once
+
+#include <siri/siri.h>
+
+typedef struct siri_s siri_t;
+
+int sirinet_metrics_init(siri_t * siri);
+char * sirinet_metrics_text(size_t * size);
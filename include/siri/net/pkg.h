@@ -15,6 +15,12 @@
 #include <qpack/qpack.h>
 #include <uv.h>
 
+/*
+ * The check bit of a compressed package is XOR'ed with this flag. Compressed
+ * packages are only sent between servers which have negotiated compression.
+ */
+#define SIRINET_PKG_COMPRESSED 0x80
+
 typedef struct sirinet_pkg_s
 {
     uint32_t len;   // length of data, sizeof(sirinet_pkg_t) is not included
@@ -41,7 +47,12 @@ sirinet_pkg_t * sirinet_pkg_err(
         const char * data);
 
 int sirinet_pkg_send(uv_stream_t * client, sirinet_pkg_t * pkg);
+void sirinet_pkg_flush(uv_stream_t * client, int status);
 sirinet_pkg_t * sirinet_pkg_dup(sirinet_pkg_t * pkg);
+sirinet_pkg_t * sirinet_pkg_compress(
+        uv_stream_t * client,
+        sirinet_pkg_t * pkg);
+sirinet_pkg_t * sirinet_pkg_decompress(sirinet_pkg_t * pkg);
 
 /* Shortcut to print an packer object */
 #define sn_packer_print(packer)             \
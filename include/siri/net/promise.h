@@ -36,12 +36,19 @@ typedef void (* sirinet_promise_cb)(
         sirinet_pkg_t * pkg,
         int status);
 
+typedef void (* sirinet_promise_timeout_cb)(sirinet_promise_t * promise);
+
 /* the callback will always be called and is responsible to free the promise */
 typedef struct sirinet_promise_s
 {
     uint16_t pid;
     uint16_t ref;
-    uv_timer_t * timer;
+    uint64_t expire;    /* timeout tick, 0 when not in the timeout wheel */
+    uint64_t sent;      /* loop time in ms when the package is sent */
+    uint64_t received;  /* loop time in ms when the response is handled */
+    sirinet_promise_t * prev;
+    sirinet_promise_t * next;
+    sirinet_promise_timeout_cb on_timeout;
     sirinet_promise_cb cb;
     siridb_server_t * server;
     sirinet_pkg_t * pkg;
@@ -49,6 +56,11 @@ typedef struct sirinet_promise_s
 } sirinet_promise_t;
 
 const char * sirinet_promise_strstatus(sirinet_promise_status_t status);
+int sirinet_promise_timeout_start(
+        sirinet_promise_t * promise,
+        uint64_t timeout,
+        sirinet_promise_timeout_cb on_timeout);
+void sirinet_promise_timeout_stop(sirinet_promise_t * promise);
 
 #define sirinet_promise_incref(promise) promise->ref++
 #define sirinet_promise_decref(promise) if (!--promise->ref) free(promise)
@@ -22,9 +22,14 @@ typedef void (* sirinet_promises_cb)(
         slist_t * promises,
         void * data);
 
+typedef void (* sirinet_promises_each_cb)(
+        sirinet_promise_t * promise,
+        void * data);
+
 typedef struct sirinet_promises_s
 {
     sirinet_promises_cb cb;
+    sirinet_promises_each_cb each;  /* called on each response or NULL */
     slist_t * promises;
     void * data;
     sirinet_pkg_t * pkg;
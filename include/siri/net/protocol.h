@@ -13,9 +13,10 @@
 
 typedef enum
 {
-    CPROTO_REQ_QUERY,                           // (query, time_precision)
+    CPROTO_REQ_QUERY,                           // (query, precision[, format])
     CPROTO_REQ_INSERT,                          // series with points map/array
-    CPROTO_REQ_AUTH,                            // (user, password, dbname)
+    CPROTO_REQ_AUTH,                            // (user, password, dbname
+                                                //  [, session])
     CPROTO_REQ_PING,                            // empty
     CPROTO_REQ_INFO,                            // empty
     CPROTO_REQ_LOADDB,                          // database path
@@ -24,6 +25,15 @@ typedef enum
     CPROTO_REQ_FILE_USERS,                      // empty
     CPROTO_REQ_FILE_GROUPS,                     // empty
     CPROTO_REQ_FILE_DATABASE,                   // empty
+    CPROTO_REQ_QUERY_STREAM,                    // (query, precision[, format])
+    CPROTO_REQ_INSERT_COLUMNS,                  // {series: [tp, ts, values]}
+    CPROTO_REQ_EXPORT,                          // (start, end, series, ...)
+    CPROTO_REQ_IMPORT,                          // {series: chunks, ...}
+    CPROTO_REQ_ATTACH_SHARDS,                   // path
+    CPROTO_REQ_SUBSCRIBE,                       // (tp, series set)
+    CPROTO_REQ_UNSUBSCRIBE,                     // pid of the subscription
+    CPROTO_REQ_FETCH,                           // (start, end, aggr, series...)
+    CPROTO_REQ_AUTH_SESSION,                    // (token, dbname)
     /* Administrative API request */
     CPROTO_REQ_ADMIN=32,                       // (user, password, request, {...})
 } cproto_client_t;
@@ -33,10 +43,14 @@ typedef enum
     /* success */
     CPROTO_RES_QUERY,                           // {query response data}
     CPROTO_RES_INSERT,                          // {"success_msg": ...}
-    CPROTO_RES_AUTH_SUCCESS,                    // empty
+    CPROTO_RES_AUTH_SUCCESS,                    // empty or session token
     CPROTO_RES_ACK,                             // empty
     CPROTO_RES_INFO,                            // [version, [dnname1, ...]]
     CPROTO_RES_FILE,                            // file content
+    CPROTO_RES_QUERY_PART,                      // {series: points, ...}
+    CPROTO_RES_EXPORT,                          // {series: chunks, ...}
+    CPROTO_RES_SUBSCRIBE,                       // {"points": ..., ...}
+    CPROTO_RES_FETCH,                           // {series: [tp, ts, values]}
 
     /* Administrative API success */
     CPROTO_ACK_ADMIN=32,                        // empty
@@ -55,6 +69,10 @@ typedef enum
     CPROTO_ERR_AUTH_UNKNOWN_DB,                 // empty
     CPROTO_ERR_LOADING_DB,                      // empty
     CPROTO_ERR_FILE,                            // empty
+    CPROTO_ERR_BUSY,                            // {"error_msg": ...,
+                                                //  "retry_after": ms}
+    CPROTO_ERR_THROTTLED,                       // {"error_msg": ...,
+                                                //  "retry_after": ms}
 
     /* Administrative API errors */
     CPROTO_ERR_ADMIN=96,                        // {"error_msg": ...}
@@ -68,7 +86,7 @@ typedef enum
                                                 min_version, dbpath, buffer_path,
                                                 buffer_size, startup_time,
                                                 address, port) */
-    BPROTO_FLAGS_UPDATE,                        // flags
+    BPROTO_FLAGS_UPDATE,                        // flags, [counts...]
     BPROTO_LOG_LEVEL_UPDATE,                    // log_level
     BPROTO_REPL_FINISHED,                       // empty
     BPROTO_QUERY_SERVER,                        // (query, time_precision)
@@ -84,6 +102,8 @@ typedef enum
     BPROTO_REQ_GROUPS,                          // empty
     BPROTO_ENABLE_BACKUP_MODE,                  // empty
     BPROTO_DISABLE_BACKUP_MODE,                 // empty
+    BPROTO_KILL_QUERY,                          // query_id
+    BPROTO_FETCH_SERVER,                        // (start, end, aggr, series...)
 } bproto_client_t;
 
 /*
@@ -100,6 +120,7 @@ typedef enum
     /* Mappings to client protocol messages */
     /* success */
     BPROTO_RES_QUERY=CPROTO_RES_QUERY,          // {query response data}
+    BPROTO_RES_FETCH=CPROTO_RES_FETCH,          // {series: [tp, ts, values]}
 
     /* errors */
     BPROTO_ERR_QUERY=CPROTO_ERR_QUERY,          // {"error_msg": ...}
@@ -119,6 +140,7 @@ typedef enum
     BPROTO_ERR_DROP_SERIES,                     // empty
     BPROTO_ERR_ENABLE_BACKUP_MODE,              // empty
     BPROTO_ERR_DISABLE_BACKUP_MODE,             // empty
+    BPROTO_ERR_FETCH,                           // empty
 
     /* success */
     BPROTO_AUTH_SUCCESS=192,                    // empty
@@ -130,7 +152,8 @@ typedef enum
     BPROTO_ACK_DROP_SERIES,                     // empty
     BPROTO_ACK_ENABLE_BACKUP_MODE,              // empty
     BPROTO_ACK_DISABLE_BACKUP_MODE,             // empty
-    BPROTO_RES_GROUPS                           // [[name, series], ...]
+    BPROTO_RES_GROUPS,                          // [[name, series], ...]
+    BPROTO_ACK_KILL_QUERY                       // empty
 
 } bproto_server_t;
 
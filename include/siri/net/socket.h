@@ -14,6 +14,7 @@
 #include <uv.h>
 #include <siri/db/db.h>
 #include <siri/net/pkg.h>
+#include <slist/slist.h>
 
 #define ADDR_BUF_SZ 54
 #define RESET_BUF_SIZE 1048576  // 1 MB
@@ -36,9 +37,18 @@ typedef enum sirinet_socket_tp
 
 typedef struct siridb_s siridb_t;
 typedef struct siridb_user_s siridb_user_t;
+typedef struct sirinet_fsend_s sirinet_fsend_t;
 
 typedef void (* on_data_cb_t)(uv_stream_t * client, sirinet_pkg_t * pkg);
 
+/* a response slot for a request in progress, responses are sent in order */
+typedef struct sirinet_socket_pending_s
+{
+    sirinet_pkg_t * pkg;
+    uint8_t done;
+    struct sirinet_socket_pending_s * next;
+} sirinet_socket_pending_t;
+
 typedef struct sirinet_socket_s
 {
     sirinet_socket_tp_t tp;
@@ -49,7 +59,20 @@ typedef struct sirinet_socket_s
     char * buf;
     size_t len;
     size_t size;
-    uv_tcp_t tcp;
+    uint32_t capture_id;    /* connection id in the capture file or 0 */
+    uint16_t pending_n;
+    uint8_t is_paused;  /* reading is stopped until pending_n is reduced */
+    uint8_t compress;   /* the peer can read compressed packages */
+    uint8_t is_writing; /* packages are queued in 'out' while writing */
+    sirinet_fsend_t * fsend;    /* file transfer in progress or NULL */
+    sirinet_socket_pending_t * pending_first;
+    sirinet_socket_pending_t * pending_last;
+    slist_t * out;
+    union
+    {
+        uv_tcp_t tcp;
+        uv_pipe_t pipe;     /* client connected to listen_client_socket */
+    } handle;
 } sirinet_socket_t;
 
 int dns_req_family_map[3];
@@ -65,6 +88,13 @@ void sirinet_socket_on_data(
         uv_stream_t * client,
         ssize_t nread,
         const uv_buf_t * buf);
+sirinet_socket_pending_t * sirinet_socket_pending_new(
+        uv_stream_t * client,
+        uint16_t window);
+void sirinet_socket_pending_done(
+        uv_stream_t * client,
+        sirinet_socket_pending_t * pending,
+        sirinet_pkg_t * pkg);
 void sirinet__socket_free(uv_stream_t * client);
 
 #define sirinet_socket_incref(client) \
@@ -0,0 +1,32 @@
+/*
+ * numa.h - NUMA nodes and thread placement.
+ *
+ * author       : Jeroen van der Heijden
+ * email        : jeroen@transceptor.technology
+ * copyright    : 2016, Transceptor Technology
+ *
+ * changes
+ *  - initial version, 14-10-2016
+ *
+ */
+#pragma once
+
+#include <inttypes.h>
+#include <stddef.h>
+
+#define SIRI_NUMA_MAX_NODES 64
+#define SIRI_NUMA_MAX_CPUS 1024
+#define SIRI_NUMA_WORDS (SIRI_NUMA_MAX_CPUS / 64)
+
+/* processors of a node as a bit for each processor number */
+typedef struct siri_numa_node_s
+{
+    uint64_t cpus[SIRI_NUMA_WORDS];
+    uint32_t ncpus;
+    uint32_t arena;         /* jemalloc arena or 0 when not created */
+} siri_numa_node_t;
+
+void siri_numa_init(void);
+uint16_t siri_numa_nodes(void);
+int siri_numa_bind(uint16_t node);
+int siri_numa_parse_cpus(const char * list, siri_numa_node_t * node);
@@ -21,6 +21,30 @@
 #define SIRI_OPTIMIZE_PAUSED 3  /* only set in 'siri_optimize_wait' */
 #define SIRI_OPTIMIZE_PAUSED_MAIN 4
 
+/* Warning: do not change the order! (maps to optimize_reason_str) */
+typedef enum
+{
+    SIRI_OPTIMIZE_REASON_OVERLAP,           /* SIRIDB_SHARD_HAS_OVERLAP */
+    SIRI_OPTIMIZE_REASON_NEW_VALUES,        /* SIRIDB_SHARD_HAS_NEW_VALUES */
+    SIRI_OPTIMIZE_REASON_DROPPED_SERIES,    /* SIRIDB_SHARD_HAS_DROPPED_... */
+    SIRI_OPTIMIZE_REASON_CORRUPT,           /* SIRIDB_SHARD_IS_CORRUPT */
+    SIRI_OPTIMIZE_REASON_DROPPED_CHUNKS,    /* chunks to mark as dead */
+    SIRI_OPTIMIZE_REASON_DEAD,              /* optimize_compact_threshold */
+    SIRI_OPTIMIZE_REASON_DOWNSAMPLE,
+    SIRI_OPTIMIZE_REASON_END
+} siri_optimize_reason_t;
+
+/* cost of optimizing one shard or the totals for all optimized shards */
+typedef struct siri_optimize_stats_s
+{
+    uint64_t shards;
+    uint64_t series;
+    uint64_t bytes_read;        /* chunks which are read */
+    uint64_t bytes_written;     /* chunks which are written */
+    uint64_t ns;
+    uint64_t reasons[SIRI_OPTIMIZE_REASON_END];
+} siri_optimize_stats_t;
+
 typedef struct siri_s siri_t;
 
 typedef struct siri_optimize_s
@@ -30,8 +54,16 @@ typedef struct siri_optimize_s
     time_t start;
     uv_work_t work;
     uint16_t pause;
-    FILE * idx_fp;
-    char * idx_fn;
+    uint16_t running;   /* number of running optimize threads */
+    uint16_t waiting;   /* number of threads waiting in siri_optimize_wait */
+    uv_mutex_t lock;
+    size_t shards_queued;   /* shards queued by the running or last task */
+    size_t shards_done;     /* atomic, read with siri_optimize_progress() */
+    uint64_t task_start;    /* timeit_ns() when the queued shards start */
+    uint64_t bytes_queued;  /* estimated bytes to read for the queue */
+    uint64_t bytes_done;    /* atomic, estimated bytes for handled shards */
+    uint64_t tasks;         /* protected by optimize.lock */
+    siri_optimize_stats_t total;    /* protected by optimize.lock */
 } siri_optimize_t;
 
 void siri_optimize_init(siri_t * siri);
@@ -40,6 +72,14 @@ void siri_optimize_pause(void);
 void siri_optimize_continue(void);
 int siri_optimize_wait(void);
 int siri_optimize_create_idx(const char * fn);
+int siri_optimize_resume_idx(const char * fn);
 int siri_optimize_finish_idx(const char * fn, int remove_old);
+FILE * siri_optimize_idx_fp(void);
+void siri_optimize_progress(size_t * queued, size_t * done);
+double siri_optimize_eta(void);
+void siri_optimize_count(uint64_t bytes_read, uint64_t bytes_written);
+void siri_optimize_totals(siri_optimize_stats_t * total, uint64_t * tasks);
+const char * siri_optimize_reason_str(siri_optimize_reason_t reason);
+char * siri_optimize_summary(void);
 
 #define SIRI_OPTIMZE_IS_PAUSED (siri.optimize->status >= SIRI_OPTIMIZE_PAUSED)
@@ -14,17 +14,23 @@
 #include <uv.h>
 #include <inttypes.h>
 #include <imap/imap.h>
+#include <iset/iset.h>
 #include <slist/slist.h>
 #include <cexpr/cexpr.h>
 #include <cleri/cleri.h>
 #include <ctree/ctree.h>
 #include <siri/db/presuf.h>
 #include <siri/db/group.h>
+#include <siri/db/qcache.h>
+#include <siri/db/re.h>
 #include <siri/db/series.h>
+#include <siri/db/spill.h>
 #include <siri/db/user.h>
 
 #define QUERIES_IGNORE_DROP_THRESHOLD 1
 
+typedef struct query_stream_s query_stream_t;
+
 enum
 {
     QUERIES_ALTER,
@@ -48,13 +54,14 @@ typedef enum
 uint8_t tp;                 \
 imap_t * series_map;        \
 imap_t * series_tmp;        \
+iset_t * series_set;        \
 imap_t * pmap;              \
 slist_t * slist;            \
 size_t slist_index;         \
 imap_update_cb update_cb;   \
 cexpr_t * where_expr;       \
-pcre * regex;               \
-pcre_extra * regex_extra;
+siridb_re_t * re;           \
+uint64_t series_gen;
 
 
 /* wrappers */
@@ -98,6 +105,9 @@ typedef struct query_list_s
     QUERY_DEF
     slist_t * props;  // will be freed
     size_t limit;
+    char * after;  // list series after this name or NULL, will be freed
+    size_t offset;  // position of the first series in the packer
+    int error_tp;  // first error received from a pool or 0
 } query_list_t;
 
 typedef struct query_select_s
@@ -113,6 +123,21 @@ typedef struct query_select_s
     imap_t * points_map;    // points_map for caching
     slist_t * alist;        // aggregation list (can be used multiple times)
     slist_t * mlist;        // merge aggregation list
+    siridb_qcache_entry_t * qentry; // entry for the query cache or NULL
+    siridb_series_cost_t cost;      // estimated cost, used by explain
+    uint8_t is_heavy;               // reads many points, use one worker
+    query_stream_t * stream;        // result is sent in parts when set
+    ct_t * partial;                 // partial merge aggregates or NULL
+    size_t err_count;               // failed responses from other pools
+    size_t limit;                   // newest points per series or 0
+    size_t top;                     // series to return for top/bottom or 0
+    int8_t top_sign;                // 1 for top, -1 for bottom
+    char * join_as;                 // name of the joined series or NULL
+    slist_t * join;                 // names of the series which are joined
+    char * join_ops;                // operator before each next series
+    siridb_spill_t * spill;         // used with a memory budget or NULL
+    size_t mem;                     // bytes of the results of this pool
+    int spill_err;                  // moving points to the file failed
 } query_select_t;
 
 query_alter_t * query_alter_new(void);
@@ -0,0 +1,47 @@
+/*
+ * sched.h - Scheduler and thread pool for background work.
+ *
+ * author       : Jeroen van der Heijden
+ * email        : jeroen@transceptor.technology
+ * copyright    : 2016, Transceptor Technology
+ *
+ * changes
+ *  - initial version, 14-10-2016
+ *
+ */
+#pragma once
+
+#include <inttypes.h>
+#include <uv.h>
+
+/* Warning: do not change the order! (maps to sched_class_names) */
+typedef enum
+{
+    SIRI_SCHED_INGEST,
+    SIRI_SCHED_INTERACTIVE,
+    SIRI_SCHED_HEAVY,
+    SIRI_SCHED_BACKGROUND,
+    SIRI_SCHED_SERVICE,     /* runs until stopped, has its own thread */
+    SIRI_SCHED_CLASSES
+} siri_sched_class_t;
+
+/* number of pool threads a group of works, like a database, may use */
+typedef struct siri_sched_limit_s
+{
+    uint16_t threads;       /* 0 for no limit */
+    uint16_t running;
+} siri_sched_limit_t;
+
+int siri_sched_init(void);
+void siri_sched_free(void);
+int siri_sched_class_by_name(const char * name);
+const char * siri_sched_class_str(siri_sched_class_t cls);
+void siri_sched_queue(
+        siri_sched_class_t cls,
+        siri_sched_limit_t * limit,
+        uv_work_t * work,
+        uv_work_cb work_cb,
+        uv_after_work_cb after_work_cb);
+int siri_sched_cancel(uv_work_t * work);
+void siri_sched_ingest_start(void);
+void siri_sched_ingest_done(void);
@@ -21,6 +21,10 @@
 #include <siri/heartbeat.h>
 #include <siri/cfg/cfg.h>
 #include <siri/args/args.h>
+#include <siri/db/ccache.h>
+#include <siri/db/qplan.h>
+#include <siri/db/re.h>
+#include <siri/db/slab.h>
 #include <llist/llist.h>
 
 #define SIRI_MAX_SIZE_ERR_MSG 1024
@@ -35,7 +39,12 @@ typedef struct siri_heartbeat_s siri_heartbeat_t;
 typedef struct siri_backup_s siri_backup_t;
 typedef struct siri_cfg_s siri_cfg_t;
 typedef struct siri_args_s siri_args_t;
+typedef struct siridb_ccache_s siridb_ccache_t;
+typedef struct siridb_qplans_s siridb_qplans_t;
+typedef struct siridb_re_cache_s siridb_re_cache_t;
+typedef struct siridb_slab_s siridb_slab_t;
 typedef struct llist_s llist_t;
+typedef struct logger_file_s logger_file_t;
 
 typedef enum
 {
@@ -51,9 +60,15 @@ typedef struct siri_s
     cleri_grammar_t * grammar;
     llist_t * siridb_list;
     siri_fh_t * fh;
+    siridb_ccache_t * ccache;
+    siridb_qplans_t * qplans;
+    siridb_re_cache_t * re_cache;
+    siridb_slab_t * series_slab;
+    logger_file_t * slowlog;    /* NULL when using the default log */
     siri_optimize_t * optimize;
     uv_timer_t * backup;
     uv_timer_t * heartbeat;
+    uv_timer_t * fsync;
     siri_cfg_t * cfg;
     siri_args_t * args;
     uv_mutex_t siridb_mutex;
@@ -0,0 +1,36 @@
+/*
+ * throttle.h - Disk bandwidth limits for background tasks.
+ *
+ * author       : Jeroen van der Heijden
+ * email        : jeroen@transceptor.technology
+ * copyright    : 2016, Transceptor Technology
+ *
+ * changes
+ *  - initial version, 14-10-2016
+ *
+ */
+#pragma once
+
+#include <inttypes.h>
+#include <stddef.h>
+
+typedef enum
+{
+    SIRI_THROTTLE_OPTIMIZE,
+    SIRI_THROTTLE_REINDEX,
+    SIRI_THROTTLE_INITSYNC,
+    SIRI_THROTTLE_VERIFY,
+    SIRI_THROTTLE_END
+} siri_throttle_tp_t;
+
+/* token bucket with its own limit, for example for one database */
+typedef struct siri_throttle_s
+{
+    uint32_t limit;         /* MB/s, 0 for no limit */
+    uint64_t full;          /* atomic, see throttle.c */
+} siri_throttle_t;
+
+uint64_t siri_throttle_delay(siri_throttle_tp_t tp, size_t bytes);
+void siri_throttle_wait(siri_throttle_tp_t tp, size_t bytes);
+void siri_throttle_wait_bucket(siri_throttle_t * throttle, size_t bytes);
+void siri_throttle_background(int enable);
@@ -0,0 +1,54 @@
+/*
+ * trace.h - Static trace points for SystemTap, bpftrace and perf.
+ *
+ * author       : Jeroen van der Heijden
+ * email        : jeroen@transceptor.technology
+ * copyright    : 2016, Transceptor Technology
+ *
+ * The trace points are compiled in when SIRI_USDT is defined, for example
+ * with CFLAGS="-DSIRI_USDT", and <sys/sdt.h> is required in that case
+ * (systemtap-sdt-dev on Ubuntu). A trace point is a single nop instruction
+ * while no tracer is attached, without SIRI_USDT nothing is compiled in.
+ *
+ * All trace points use provider 'siridb':
+ *
+ *  pkg__received(pid, tp, len)             a package is read
+ *  pkg__sent(pid, tp, len)                 a package is written
+ *  query__start(query, q)                  a query is received
+ *  query__done(query, q)                   a query is finished
+ *  chunk__read__start(shard_id, len)       a chunk is read
+ *  chunk__read__done(n)                    'n' points are in the range
+ *  chunk__write__start(shard_id, len)      a chunk is written
+ *  chunk__write__done(shard_id, pos)       only when successful
+ *  buffer__flush__start(series_id, len)    points are written to shards
+ *  buffer__flush__done(series_id, err)     err is 0 when successful
+ *  optimize__start(shard_id)               a shard is optimized
+ *  optimize__done(shard_id, rc)            rc is 0 when successful
+ *
+ * Example:
+ *  bpftrace -e 'usdt:./siridb-server:siridb:query__start { ... }'
+ *
+ * changes
+ *  - initial version, 14-10-2016
+ *
+ */
+#pragma once
+
+#ifdef SIRI_USDT
+
+#include <sys/sdt.h>
+
+#define SIRI_TRACE1(name, a) \
+    DTRACE_PROBE1(siridb, name, a)
+#define SIRI_TRACE2(name, a, b) \
+    DTRACE_PROBE2(siridb, name, a, b)
+#define SIRI_TRACE3(name, a, b, c) \
+    DTRACE_PROBE3(siridb, name, a, b, c)
+
+#else
+
+#define SIRI_TRACE1(name, a)
+#define SIRI_TRACE2(name, a, b)
+#define SIRI_TRACE3(name, a, b, c)
+
+#endif
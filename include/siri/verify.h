@@ -0,0 +1,19 @@
+/*
+ * verify.h - Background verification of shard checksums.
+ *
+ * author       : Jeroen van der Heijden
+ * email        : jeroen@transceptor.technology
+ * copyright    : 2016, Transceptor Technology
+ *
+ * changes
+ *  - initial version, 14-10-2016
+ *
+ */
+#pragma once
+
+#include <siri/siri.h>
+
+typedef struct siri_s siri_t;
+
+void siri_verify_init(siri_t * siri);
+void siri_verify_stop(void);
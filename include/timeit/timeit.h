@@ -11,12 +11,14 @@
  */
 #pragma once
 
+#include <inttypes.h>
 #include <sys/time.h>
 
 typedef struct timeval timeit_t;
 
 void timeit_start(timeit_t * start);
 float timeit_stop(timeit_t * start);
+uint64_t timeit_ns(void);
 
 
 
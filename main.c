@@ -71,6 +71,12 @@ int main(int argc, char * argv[])
     /* read siridb main application configuration */
     siri_cfg_init(&siri);
 
+    if (    siri.cfg->async_log_lines &&
+            logger_async_start(siri.cfg->async_log_lines))
+    {
+        log_error("Cannot start asynchronous logging");
+    }
+
     /* start SiriDB. (this start the event loop etc.) */
     if (siri_start() && !siri_err)
     {
@@ -91,5 +97,8 @@ int main(int argc, char * argv[])
 
     log_info("Bye! (%d)\n", siri_err);
 
+    /* write the remaining log lines */
+    logger_async_stop();
+
     return siri_err;
 }
@@ -0,0 +1,722 @@
+/*
+ * bench.c - Micro benchmarks for the SiriDB hot paths.
+ *
+ * author       : Jeroen van der Heijden
+ * email        : jeroen@transceptor.technology
+ * copyright    : 2016, Transceptor Technology
+ *
+ * Run with 'make bench' from the Release folder. The input is generated with
+ * a fixed seed so each run works on the same data and the results, which
+ * are written as JSON to stdout, can be compared between builds.
+ *
+ * changes
+ *  - initial version, 14-10-2016
+ *
+ */
+#include <ctree/ctree.h>
+#include <imap/imap.h>
+#include <inttypes.h>
+#include <logger/logger.h>
+#include <qpack/qpack.h>
+#include <siri/db/aggregate.h>
+#include <siri/db/ccache.h>
+#include <siri/db/db.h>
+#include <siri/db/median.h>
+#include <siri/db/points.h>
+#include <siri/db/series.h>
+#include <siri/db/shard.h>
+#include <siri/db/shards.h>
+#include <siri/file/handler.h>
+#include <siri/grammar/grammar.h>
+#include <siri/mutex.h>
+#include <siri/siri.h>
+#include <siri/version.h>
+#include <slist/slist.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <timeit/timeit.h>
+#include <unistd.h>
+
+#define BENCH_SEED 0x5eedULL
+#define BENCH_NPOINTS 1000000
+#define BENCH_NSHARD 400000     /* must be a multiple of the chunk size */
+#define BENCH_CHUNK DEFAULT_MAX_CHUNK_SZ_NUM
+#define BENCH_NMERGE 8
+#define BENCH_NKEYS 200000
+#define BENCH_NPACK 1000000
+#define BENCH_NLOCK 1000000
+#define BENCH_NTHREADS 4
+
+static uint64_t bench_rnd = BENCH_SEED;
+static size_t bench_count = 0;
+
+static void BENCH_report(const char * name, size_t ops, uint64_t ns);
+static inline uint64_t BENCH_rand(void);
+static siridb_points_t * BENCH_points(size_t n, points_tp tp);
+static void BENCH_shard(
+        const char * dbpath,
+        siridb_timep_t precision,
+        int compressed);
+static void BENCH_merge(void);
+static void BENCH_aggregate(
+        const char * name,
+        siridb_points_t * points,
+        siridb_aggr_t * aggr);
+static void BENCH_aggregates(void);
+static void BENCH_median(void);
+static void BENCH_ctree(void);
+static void BENCH_imap(void);
+static void BENCH_qpack(void);
+static void BENCH_mutex(void);
+static void BENCH_mutex_work(void * arg);
+static void BENCH_contention(void);
+
+int main(void)
+{
+    static siri_cfg_t cfg;      /* zero, fsync_mode is SIRI_FSYNC_NONE */
+    char dbpath[] = "/tmp/siridb-bench-XXXXXX/";
+    char fn[sizeof(dbpath) + sizeof(SIRIDB_SHARDS_PATH)];
+
+    logger_init(stderr, LOGGER_ERROR);
+
+    siri.cfg = &cfg;
+    siri.fh = siri_fh_new(8);
+    siri.ccache = siridb_ccache_new(0);  /* disabled */
+
+    if (siri.fh == NULL || siri.ccache == NULL)
+    {
+        fprintf(stderr, "Cannot initialize SiriDB\n");
+        return 1;
+    }
+
+    siridb_init_aggregates();
+
+    /* remove the trailing slash for mkdtemp() */
+    dbpath[sizeof(dbpath) - 2] = '\0';
+    if (mkdtemp(dbpath) == NULL)
+    {
+        fprintf(stderr, "Cannot create a temporary directory\n");
+        return 1;
+    }
+    dbpath[sizeof(dbpath) - 2] = '/';
+
+    sprintf(fn, "%s%s", dbpath, SIRIDB_SHARDS_PATH);
+    if (mkdir(fn, 0700))
+    {
+        fprintf(stderr, "Cannot create directory: '%s'\n", fn);
+        return 1;
+    }
+
+    printf("{\"version\": \"%s\", \"benchmarks\": [", SIRIDB_VERSION);
+
+    BENCH_shard(dbpath, SIRIDB_TIME_SECONDS, 0);
+    BENCH_shard(dbpath, SIRIDB_TIME_MILLISECONDS, 0);
+    BENCH_shard(dbpath, SIRIDB_TIME_SECONDS, 1);
+    BENCH_shard(dbpath, SIRIDB_TIME_MILLISECONDS, 1);
+    BENCH_merge();
+    BENCH_aggregates();
+    BENCH_median();
+    BENCH_ctree();
+    BENCH_imap();
+    BENCH_qpack();
+    BENCH_mutex();
+
+    printf("\n]");
+    BENCH_contention();
+    printf("}\n");
+
+    rmdir(fn);
+    dbpath[sizeof(dbpath) - 2] = '\0';
+    rmdir(dbpath);
+
+    siridb_ccache_free(siri.ccache);
+    siri_fh_free(siri.fh);
+
+    return 0;
+}
+
+/*
+ * Write one benchmark result as a JSON object.
+ */
+static void BENCH_report(const char * name, size_t ops, uint64_t ns)
+{
+    printf("%s\n    {\"name\": \"%s\", \"ops\": %zu, "
+            "\"ns\": %" PRIu64 ", \"ns_per_op\": %.3f}",
+            bench_count++ ? "," : "",
+            name,
+            ops,
+            ns,
+            (double) ns / ops);
+    fflush(stdout);
+}
+
+/*
+ * Linear congruential generator so each run uses the same input.
+ */
+static inline uint64_t BENCH_rand(void)
+{
+    bench_rnd = bench_rnd * 6364136223846793005ULL + 1442695040888963407ULL;
+    return bench_rnd >> 33;
+}
+
+/*
+ * Returns sorted points with unique time-stamps. Values are between 0 and
+ * 1000 so some values are equal, like most real series.
+ */
+static siridb_points_t * BENCH_points(size_t n, points_tp tp)
+{
+    siridb_points_t * points = siridb_points_new(n, tp);
+    uint64_t ts = 1476403200;
+    siridb_point_t * point;
+
+    if (points == NULL)
+    {
+        abort();
+    }
+
+    for (size_t i = 0; i < n; i++)
+    {
+        ts += 1 + BENCH_rand() % 10;
+        point = points->data + i;
+        point->ts = ts;
+        if (tp == TP_INT)
+        {
+            point->val.int64 = (int64_t) (BENCH_rand() % 1000);
+        }
+        else
+        {
+            point->val.real = (double) (BENCH_rand() % 1000000) / 1000;
+        }
+    }
+    points->len = n;
+
+    return points;
+}
+
+/*
+ * Write points to a new shard in chunks of the maximum chunk size and read
+ * all chunks back with the reader which is used for the shard type.
+ */
+static void BENCH_shard(
+        const char * dbpath,
+        siridb_timep_t precision,
+        int compressed)
+{
+    siridb_t * siridb = (siridb_t *) calloc(1, sizeof(siridb_t));
+    siridb_series_t * series = (siridb_series_t *) calloc(
+            1,
+            sizeof(siridb_series_t));
+    size_t nchunks = BENCH_NSHARD / BENCH_CHUNK;
+    idx_t * idx = (idx_t *) malloc(nchunks * sizeof(idx_t));
+    siridb_points_t * points = BENCH_points(BENCH_NSHARD, TP_INT);
+    siridb_points_t * result = siridb_points_new(BENCH_CHUNK, TP_INT);
+    siridb_points_stats_t stats;
+    siridb_shard_get_points_cb get_points;
+    siridb_shard_t * shard;
+    char name[64];
+    uint64_t ns, total = 0;
+    long int pos;
+    int is32 = precision == SIRIDB_TIME_SECONDS;
+
+    if (    siridb == NULL ||
+            series == NULL ||
+            idx == NULL ||
+            result == NULL ||
+            (siridb->time = siridb_time_new(precision)) == NULL ||
+            (siridb->shards = imap_new()) == NULL)
+    {
+        abort();
+    }
+
+    siridb->dbpath = (char *) dbpath;
+    series->id = 1;
+    series->tp = TP_INT;
+    series->flags = is32 ? SIRIDB_SERIES_IS_32BIT_TS : 0;
+
+    if (!is32)
+    {
+        /* use milliseconds which do not fit in 32 bit */
+        for (size_t i = 0; i < points->len; i++)
+        {
+            points->data[i].ts *= 1000;
+        }
+    }
+
+    shard = siridb_shard_create(
+            siridb,
+            points->data[0].ts,
+            siridb->time->factor * 604800,
+            SIRIDB_SHARD_TP_NUMBER,
+            NULL);
+
+    if (shard == NULL)
+    {
+        abort();
+    }
+
+    if (compressed)
+    {
+        get_points = is32 ?
+                siridb_shard_get_points_cnum32 :
+                siridb_shard_get_points_cnum64;
+    }
+    else
+    {
+        /* the raw number format is still read for older shards */
+        shard->flags &= ~SIRIDB_SHARD_IS_COMPRESSED;
+        get_points = is32 ?
+                siridb_shard_get_points_num32 :
+                siridb_shard_get_points_num64;
+    }
+
+    for (size_t i = 0; i < nchunks; i++)
+    {
+        size_t start = i * BENCH_CHUNK;
+        size_t end = start + BENCH_CHUNK;
+
+        siridb_points_stats(&stats, points, start, end);
+
+        ns = timeit_ns();
+        pos = siridb_shard_write_points(
+                siridb,
+                series,
+                shard,
+                points,
+                start,
+                end,
+                &stats,
+                NULL);
+        total += timeit_ns() - ns;
+
+        if (pos == EOF)
+        {
+            abort();
+        }
+
+        idx[i].shard = shard;
+        idx[i].pos = (uint32_t) pos;
+        idx[i].len = BENCH_CHUNK;
+        idx[i].chunk_sz = (uint16_t) (shard->size - pos);
+        idx[i].start_ts = points->data[start].ts;
+        idx[i].end_ts = points->data[end - 1].ts;
+        idx[i].stats = stats;
+    }
+
+    sprintf(name, "shard_write_points_%snum%d",
+            compressed ? "c" : "", is32 ? 32 : 64);
+    BENCH_report(name, BENCH_NSHARD, total);
+
+    total = 0;
+    for (size_t i = 0; i < nchunks; i++)
+    {
+        result->len = 0;
+        ns = timeit_ns();
+        if ((*get_points)(result, idx + i, NULL, NULL, 0))
+        {
+            abort();
+        }
+        total += timeit_ns() - ns;
+    }
+
+    sprintf(name, "shard_get_points_%snum%d",
+            compressed ? "c" : "", is32 ? 32 : 64);
+    BENCH_report(name, BENCH_NSHARD, total);
+
+    unlink(shard->fn);
+    imap_free(siridb->shards, NULL);
+    siridb_shard_decref(shard);
+    siridb_points_free(result);
+    siridb_points_free(points);
+    free(siridb->time);
+    free(siridb);
+    free(series);
+    free(idx);
+}
+
+/*
+ * Merge points from a number of shards, like a select on a single series.
+ */
+static void BENCH_merge(void)
+{
+    char err_msg[SIRIDB_MAX_SIZE_ERR_MSG];
+    siridb_points_t * source[BENCH_NMERGE];
+    siridb_points_t * points;
+    slist_t * plist;
+    uint64_t ns, total = 0;
+
+    for (size_t i = 0; i < BENCH_NMERGE; i++)
+    {
+        source[i] = BENCH_points(BENCH_NPOINTS / BENCH_NMERGE, TP_INT);
+    }
+
+    for (int run = 0; run < 4; run++)
+    {
+        /* the list and points are consumed by the merge */
+        if ((plist = slist_new(BENCH_NMERGE)) == NULL)
+        {
+            abort();
+        }
+        for (size_t i = 0; i < BENCH_NMERGE; i++)
+        {
+            slist_append(plist, siridb_points_copy(source[i]));
+        }
+
+        ns = timeit_ns();
+        points = siridb_points_merge(plist, err_msg);
+        total += timeit_ns() - ns;
+
+        if (points == NULL)
+        {
+            abort();
+        }
+
+        siridb_points_free(points);
+        slist_free(plist);
+    }
+
+    BENCH_report("points_merge", 4 * BENCH_NPOINTS, total);
+
+    for (size_t i = 0; i < BENCH_NMERGE; i++)
+    {
+        siridb_points_free(source[i]);
+    }
+}
+
+static void BENCH_aggregate(
+        const char * name,
+        siridb_points_t * points,
+        siridb_aggr_t * aggr)
+{
+    char err_msg[SIRIDB_MAX_SIZE_ERR_MSG];
+    siridb_points_t * result;
+    uint64_t ns = timeit_ns();
+
+    result = siridb_aggregate_run(points, aggr, err_msg);
+    ns = timeit_ns() - ns;
+
+    if (result == NULL)
+    {
+        fprintf(stderr, "Aggregate %s has failed: %s\n", name, err_msg);
+        abort();
+    }
+
+    BENCH_report(name, points->len, ns);
+    siridb_points_free(result);
+}
+
+/*
+ * Run each aggregate function on the same points. The group-by is chosen so
+ * each group has about 50 points.
+ */
+static void BENCH_aggregates(void)
+{
+    static const struct
+    {
+        const char * name;
+        uint32_t gid;
+    } group_aggrs[] = {
+        {"aggregate_count", CLERI_GID_F_COUNT},
+        {"aggregate_max", CLERI_GID_F_MAX},
+        {"aggregate_mean", CLERI_GID_F_MEAN},
+        {"aggregate_median", CLERI_GID_F_MEDIAN},
+        {"aggregate_median_high", CLERI_GID_F_MEDIAN_HIGH},
+        {"aggregate_median_low", CLERI_GID_F_MEDIAN_LOW},
+        {"aggregate_min", CLERI_GID_F_MIN},
+        {"aggregate_percentile", CLERI_GID_F_PERCENTILE},
+        {"aggregate_pvariance", CLERI_GID_F_PVARIANCE},
+        {"aggregate_sum", CLERI_GID_F_SUM},
+        {"aggregate_variance", CLERI_GID_F_VARIANCE},
+    };
+    siridb_points_t * points = BENCH_points(BENCH_NPOINTS, TP_INT);
+    siridb_aggr_t aggr;
+
+    memset(&aggr, 0, sizeof(siridb_aggr_t));
+    aggr.group_by = 300;
+    aggr.percentile = 90.0;
+
+    for (size_t i = 0; i < sizeof(group_aggrs) / sizeof(group_aggrs[0]); i++)
+    {
+        aggr.gid = group_aggrs[i].gid;
+        BENCH_aggregate(group_aggrs[i].name, points, &aggr);
+    }
+
+    aggr.group_by = 0;
+
+    aggr.gid = CLERI_GID_F_DIFFERENCE;
+    BENCH_aggregate("aggregate_difference", points, &aggr);
+
+    aggr.gid = CLERI_GID_F_DERIVATIVE;
+    aggr.timespan = 1.0;
+    BENCH_aggregate("aggregate_derivative", points, &aggr);
+
+    /* limit is set on the aggregate which is used for the groups */
+    aggr.gid = CLERI_GID_F_MEAN;
+    aggr.limit = 20000;
+    BENCH_aggregate("aggregate_limit", points, &aggr);
+
+    memset(&aggr, 0, sizeof(siridb_aggr_t));
+    aggr.gid = CLERI_GID_F_FILTER;
+    aggr.filter_opr = CEXPR_GT;
+    aggr.filter_tp = TP_INT;
+    aggr.filter_via.int64 = 500;
+    BENCH_aggregate("aggregate_filter", points, &aggr);
+
+    siridb_points_free(points);
+}
+
+/*
+ * Median and percentile selection used by the median aggregates.
+ */
+static void BENCH_median(void)
+{
+    siridb_points_t * points = BENCH_points(BENCH_NPOINTS / 10, TP_DOUBLE);
+    siridb_point_t point;
+    uint64_t ns;
+
+    ns = timeit_ns();
+    for (int run = 0; run < 10; run++)
+    {
+        if (siridb_median_find_n(&point, points, points->len / 2))
+        {
+            abort();
+        }
+    }
+    BENCH_report("median_find_n", 10 * points->len, timeit_ns() - ns);
+
+    ns = timeit_ns();
+    for (int run = 0; run < 10; run++)
+    {
+        if (siridb_median_real(&point, points, 50.0))
+        {
+            abort();
+        }
+    }
+    BENCH_report("median_real", 10 * points->len, timeit_ns() - ns);
+
+    siridb_points_free(points);
+}
+
+/*
+ * Series names are stored in a ctree so use keys which look like names.
+ */
+static void BENCH_ctree(void)
+{
+    char (* keys)[32] = malloc(BENCH_NKEYS * 32);
+    ct_t * ct = ct_new();
+    uint64_t ns;
+
+    if (keys == NULL || ct == NULL)
+    {
+        abort();
+    }
+
+    for (size_t i = 0; i < BENCH_NKEYS; i++)
+    {
+        sprintf(keys[i],
+                "host%03" PRIu64 ".cpu%02" PRIu64 ".load-%zu",
+                BENCH_rand() % 1000,
+                BENCH_rand() % 64,
+                i);
+    }
+
+    ns = timeit_ns();
+    for (size_t i = 0; i < BENCH_NKEYS; i++)
+    {
+        if (ct_add(ct, keys[i], keys[i]) == CT_ERR)
+        {
+            abort();
+        }
+    }
+    BENCH_report("ct_add", BENCH_NKEYS, timeit_ns() - ns);
+
+    ns = timeit_ns();
+    for (size_t i = 0; i < BENCH_NKEYS; i++)
+    {
+        if (ct_get(ct, keys[i]) != keys[i])
+        {
+            abort();
+        }
+    }
+    BENCH_report("ct_get", BENCH_NKEYS, timeit_ns() - ns);
+
+    ct_free(ct, NULL);
+    free(keys);
+}
+
+/*
+ * Shards are stored in an imap by their id, which are sparse.
+ */
+static void BENCH_imap(void)
+{
+    uint64_t * keys = (uint64_t *) malloc(BENCH_NKEYS * sizeof(uint64_t));
+    imap_t * imap = imap_new();
+    uint64_t ns;
+
+    if (keys == NULL || imap == NULL)
+    {
+        abort();
+    }
+
+    for (size_t i = 0; i < BENCH_NKEYS; i++)
+    {
+        keys[i] = (BENCH_rand() << 20) ^ BENCH_rand();
+    }
+
+    ns = timeit_ns();
+    for (size_t i = 0; i < BENCH_NKEYS; i++)
+    {
+        if (imap_set(imap, keys[i], keys + i) == -1)
+        {
+            abort();
+        }
+    }
+    BENCH_report("imap_set", BENCH_NKEYS, timeit_ns() - ns);
+
+    ns = timeit_ns();
+    for (size_t i = 0; i < BENCH_NKEYS; i++)
+    {
+        if (imap_get(imap, keys[i]) == NULL)
+        {
+            abort();
+        }
+    }
+    BENCH_report("imap_get", BENCH_NKEYS, timeit_ns() - ns);
+
+    imap_free(imap, NULL);
+    free(keys);
+}
+
+/*
+ * Pack and unpack [time-stamp, value] pairs like a query response.
+ */
+static void BENCH_qpack(void)
+{
+    qp_packer_t * packer = qp_packer_new(QP_SUGGESTED_SIZE);
+    qp_unpacker_t unpacker;
+    qp_obj_t qp_obj;
+    uint64_t ns;
+    size_t n = 0;
+
+    if (packer == NULL)
+    {
+        abort();
+    }
+
+    ns = timeit_ns();
+    qp_add_type(packer, QP_ARRAY_OPEN);
+    for (size_t i = 0; i < BENCH_NPACK; i++)
+    {
+        qp_add_type(packer, QP_ARRAY2);
+        qp_add_int64(packer, (int64_t) (1476403200 + i));
+        qp_add_double(packer, (double) (BENCH_rand() % 1000000) / 1000);
+    }
+    qp_add_type(packer, QP_ARRAY_CLOSE);
+    BENCH_report("qpack_pack", BENCH_NPACK, timeit_ns() - ns);
+
+    ns = timeit_ns();
+    qp_unpacker_init(&unpacker, packer->buffer, packer->len);
+    while (qp_next(&unpacker, &qp_obj) != QP_END)
+    {
+        n++;
+    }
+    BENCH_report("qpack_unpack", BENCH_NPACK, timeit_ns() - ns);
+
+    if (n != 3 * BENCH_NPACK + 2)
+    {
+        abort();
+    }
+
+    qp_packer_free(packer);
+}
+
+/*
+ * Lock and unlock a mutex with and without lock statistics, and finally
+ * from several threads at the same time so the statistics show contention.
+ */
+static void BENCH_mutex(void)
+{
+    siri_mutex_t mutex;
+    uv_thread_t threads[BENCH_NTHREADS];
+    uint64_t ns;
+
+    if (siri_mutex_init(&mutex))
+    {
+        abort();
+    }
+
+    ns = timeit_ns();
+    for (size_t i = 0; i < BENCH_NLOCK; i++)
+    {
+        siri_mutex_lock(&mutex);
+        siri_mutex_unlock(&mutex);
+    }
+    BENCH_report("mutex_lock", BENCH_NLOCK, timeit_ns() - ns);
+
+    siri_mutex_enable(1);
+
+    ns = timeit_ns();
+    for (size_t i = 0; i < BENCH_NLOCK; i++)
+    {
+        siri_mutex_lock(&mutex);
+        siri_mutex_unlock(&mutex);
+    }
+    BENCH_report("mutex_lock_stats", BENCH_NLOCK, timeit_ns() - ns);
+
+    ns = timeit_ns();
+    for (size_t i = 0; i < BENCH_NTHREADS; i++)
+    {
+        uv_thread_create(threads + i, BENCH_mutex_work, &mutex);
+    }
+    for (size_t i = 0; i < BENCH_NTHREADS; i++)
+    {
+        uv_thread_join(threads + i);
+    }
+    BENCH_report(
+            "mutex_lock_contended",
+            BENCH_NTHREADS * BENCH_NLOCK,
+            timeit_ns() - ns);
+
+    siri_mutex_enable(0);
+    siri_mutex_destroy(&mutex);
+}
+
+static void BENCH_mutex_work(void * arg)
+{
+    siri_mutex_t * mutex = (siri_mutex_t *) arg;
+
+    for (size_t i = 0; i < BENCH_NLOCK; i++)
+    {
+        siri_mutex_lock(mutex);
+        bench_rnd++;    /* some work while holding the lock */
+        siri_mutex_unlock(mutex);
+    }
+}
+
+/*
+ * Write the call sites with the most time waiting for a lock as JSON.
+ */
+static void BENCH_contention(void)
+{
+    siri_mutex_site_t * sites[SIRI_MUTEX_TOP];
+    size_t n = siri_mutex_top(sites, SIRI_MUTEX_TOP);
+
+    printf(", \"lock_contention\": [");
+    for (size_t i = 0; i < n; i++)
+    {
+        printf("%s\n    {\"name\": \"%s\", \"line\": %d, "
+                "\"n\": %" PRIu64 ", \"contended\": %" PRIu64 ", "
+                "\"wait_ns\": %" PRIu64 ", \"max_wait_ns\": %" PRIu64 ", "
+                "\"hold_ns\": %" PRIu64 "}",
+                i ? "," : "",
+                sites[i]->name,
+                sites[i]->line,
+                sites[i]->n,
+                sites[i]->contended,
+                sites[i]->wait,
+                sites[i]->max_wait,
+                sites[i]->hold);
+    }
+    printf("\n]");
+}
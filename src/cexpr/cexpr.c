@@ -52,6 +52,20 @@ static cexpr_t * CEXPR_walk_node(
         cexpr_list_t * list,
         cexpr_condition_t ** condition,
         int * expecting);
+static uint32_t CEXPR_count(int8_t tp, cexpr_via_t via);
+static uint32_t CEXPR_cost(int8_t tp, cexpr_via_t via);
+static uint32_t CEXPR_emit(
+        cexpr_prog_t * prog,
+        uint32_t * pos,
+        int8_t tp,
+        cexpr_via_t via,
+        uint32_t on_true,
+        uint32_t on_false);
+static int CEXPR_can_match(
+        int8_t tp,
+        cexpr_via_t via,
+        uint32_t prop,
+        int64_t value);
 
 cexpr_t * cexpr_from_node(cleri_node_t * node)
 {
@@ -98,6 +112,8 @@ cexpr_t * cexpr_from_node(cleri_node_t * node)
 #ifdef DEBUG
         assert (list.len == 0 && condition == NULL);
 #endif
+        /* without a program the tree is used, which gives the same result */
+        cexpr_compile(cexpr);
     }
     else if (condition != NULL)
     {
@@ -239,6 +255,22 @@ int cexpr_bool_cmp(
  */
 int cexpr_run(cexpr_t * cexpr, cexpr_cb_t cb, void * obj)
 {
+    if (cexpr->prog != NULL)
+    {
+        cexpr_instr_t * instr;
+        uint32_t pc = 0;
+
+        /* instructions only jump forward so this always finishes */
+        do
+        {
+            instr = cexpr->prog->instr + pc;
+            pc = cb(obj, instr->cond) ? instr->on_true : instr->on_false;
+        }
+        while (pc < CEXPR_PROG_FALSE);
+
+        return pc == CEXPR_PROG_TRUE;
+    }
+
     switch (cexpr->operator)
     {
     case CEXPR_AND:
@@ -270,6 +302,55 @@ int cexpr_run(cexpr_t * cexpr, cexpr_cb_t cb, void * obj)
     return -1; /* this should NEVER happen */
 }
 
+/*
+ * Compile the expression to a flat program which is used by cexpr_run().
+ * Each condition is tested at most once for an object and the program jumps
+ * to the result as soon as it is known. The operands of AND and OR are
+ * ordered so cheap conditions are tested first. Conditions have no side
+ * effects so the order does not change the result.
+ *
+ * Returns 0 if successful or -1 in case the program cannot be allocated in
+ * which case cexpr_run() keeps using the tree.
+ */
+int cexpr_compile(cexpr_t * cexpr)
+{
+    cexpr_via_t via = {.cexpr = cexpr};
+    uint32_t n = CEXPR_count(VIA_CEXPR, via), pos = n;
+    cexpr_prog_t * prog;
+
+    if (n == 0 || n >= CEXPR_PROG_FALSE)
+    {
+        return -1;
+    }
+
+    prog = (cexpr_prog_t *) malloc(
+            sizeof(cexpr_prog_t) + n * sizeof(cexpr_instr_t));
+    if (prog == NULL)
+    {
+        return -1;
+    }
+
+    prog->n = n;
+
+    /* instructions are written from the end, the entry is the first */
+    pos = CEXPR_emit(
+            prog,
+            &pos,
+            VIA_CEXPR,
+            via,
+            CEXPR_PROG_TRUE,
+            CEXPR_PROG_FALSE);
+
+#ifdef DEBUG
+    assert (pos == 0);
+#endif
+
+    free(cexpr->prog);
+    cexpr->prog = prog;
+
+    return 0;
+}
+
 int cexpr_contains(cexpr_t * cexpr, cexpr_cb_prop_t cb)
 {
     /* should return either 1 or 0. (true or false) */
@@ -293,6 +374,18 @@ int cexpr_contains(cexpr_t * cexpr, cexpr_cb_prop_t cb)
     return 0;
 }
 
+/*
+ * Returns 0 when an object with 'value' for integer property 'prop' can
+ * never match the expression or 1 if it might. Only conditions which every
+ * match must pass are tested, so conditions on 'prop' below an OR are
+ * ignored. This is used to skip objects before the expression is run.
+ */
+int cexpr_can_match(cexpr_t * cexpr, uint32_t prop, int64_t value)
+{
+    cexpr_via_t via = {.cexpr = cexpr};
+    return CEXPR_can_match(VIA_CEXPR, via, prop, value);
+}
+
 void cexpr_free(cexpr_t * cexpr)
 {
     switch (cexpr->tp_a)
@@ -307,6 +400,7 @@ void cexpr_free(cexpr_t * cexpr)
     case VIA_COND: CEXPR_condition_free(cexpr->via_b.cond); break;
     }
 
+    free(cexpr->prog);
     free(cexpr);
 }
 
@@ -580,13 +674,158 @@ static cexpr_t * CEXPR_new(void)
         cexpr->tp_a = VIA_NULL;
         cexpr->tp_b = VIA_NULL;
         cexpr->via_a.cexpr = NULL;
+        cexpr->prog = NULL;
     }
     return cexpr;
 }
 
+/*
+ * Returns the number of conditions.
+ */
+static uint32_t CEXPR_count(int8_t tp, cexpr_via_t via)
+{
+    switch (tp)
+    {
+    case VIA_COND:
+        return 1;
+    case VIA_CEXPR:
+        return  CEXPR_count(via.cexpr->tp_a, via.cexpr->via_a) +
+                CEXPR_count(via.cexpr->tp_b, via.cexpr->via_b);
+    }
+    return 0;
+}
+
+/*
+ * Returns a rough estimate for the time it takes to test the conditions.
+ * Comparing strings takes longer than comparing integers and statistics of
+ * a series might need a look at the shards.
+ */
+static uint32_t CEXPR_cost(int8_t tp, cexpr_via_t via)
+{
+    switch (tp)
+    {
+    case VIA_COND:
+        switch (via.cond->prop)
+        {
+        case CLERI_GID_K_MIN:
+        case CLERI_GID_K_MAX:
+        case CLERI_GID_K_SUM:
+            return 8;
+        }
+        if (via.cond->str == NULL)
+        {
+            return 1;
+        }
+        return (via.cond->operator == CEXPR_IN ||
+                via.cond->operator == CEXPR_NI) ? 4 : 2;
+    case VIA_CEXPR:
+        return  CEXPR_cost(via.cexpr->tp_a, via.cexpr->via_a) +
+                CEXPR_cost(via.cexpr->tp_b, via.cexpr->via_b);
+    }
+    return 0;
+}
+
+/*
+ * Write the instructions for 'via' before position 'pos' in the program.
+ * The instructions continue with 'on_true' or 'on_false' when the result is
+ * known.
+ *
+ * Returns the index of the first instruction to run.
+ */
+static uint32_t CEXPR_emit(
+        cexpr_prog_t * prog,
+        uint32_t * pos,
+        int8_t tp,
+        cexpr_via_t via,
+        uint32_t on_true,
+        uint32_t on_false)
+{
+    cexpr_t * cexpr;
+    cexpr_instr_t * instr;
+    uint32_t next;
+    int swap;
+
+    if (tp == VIA_COND)
+    {
+        instr = prog->instr + --(*pos);
+        instr->cond = via.cond;
+        instr->on_true = on_true;
+        instr->on_false = on_false;
+        return *pos;
+    }
+
+    cexpr = via.cexpr;
+
+    if (cexpr->tp_b == VIA_NULL)
+    {
+        return CEXPR_emit(
+                prog,
+                pos,
+                cexpr->tp_a,
+                cexpr->via_a,
+                on_true,
+                on_false);
+    }
+
+    /* the cheapest operand goes first and thus is written last */
+    swap =  CEXPR_cost(cexpr->tp_b, cexpr->via_b) <
+            CEXPR_cost(cexpr->tp_a, cexpr->via_a);
+
+    next = CEXPR_emit(
+            prog,
+            pos,
+            swap ? cexpr->tp_a : cexpr->tp_b,
+            swap ? cexpr->via_a : cexpr->via_b,
+            on_true,
+            on_false);
+
+    return (cexpr->operator == CEXPR_AND) ?
+            CEXPR_emit(
+                prog,
+                pos,
+                swap ? cexpr->tp_b : cexpr->tp_a,
+                swap ? cexpr->via_b : cexpr->via_a,
+                next,
+                on_false) :
+            CEXPR_emit(
+                prog,
+                pos,
+                swap ? cexpr->tp_b : cexpr->tp_a,
+                swap ? cexpr->via_b : cexpr->via_a,
+                on_true,
+                next);
+}
+
 /*
  * Returns NULL in case of an error
  */
+static int CEXPR_can_match(
+        int8_t tp,
+        cexpr_via_t via,
+        uint32_t prop,
+        int64_t value)
+{
+    switch (tp)
+    {
+    case VIA_COND:
+        return  via.cond->prop != prop ||
+                cexpr_int_cmp(via.cond->operator, value, via.cond->int64);
+    case VIA_CEXPR:
+        return  via.cexpr->operator != CEXPR_AND || (
+                CEXPR_can_match(
+                        via.cexpr->tp_a,
+                        via.cexpr->via_a,
+                        prop,
+                        value) &&
+                CEXPR_can_match(
+                        via.cexpr->tp_b,
+                        via.cexpr->via_b,
+                        prop,
+                        value));
+    }
+    return 1;
+}
+
 static cexpr_condition_t * CEXPR_condition_new(void)
 {
     cexpr_condition_t * condition =
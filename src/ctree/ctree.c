@@ -5,6 +5,12 @@
  * email        : jeroen@transceptor.technology
  * copyright    : 2016, Transceptor Technology
  *
+ * Keys are stored path compressed so a node holds the part of the key which
+ * is shared by all its children. Most nodes have only a few children so
+ * they are stored in a small sorted list. When a node gets more than
+ * CT_SMALL_SZ children, blocks of BLOCKSZ child pointers are used which can
+ * be indexed by the key character. The root always uses blocks.
+ *
  * changes
  *  - initial version, 18-03-2016
  *
@@ -21,9 +27,14 @@
 /* initial buffer size, this is not fixed but can grow if needed */
 #define CT_BUF_SIZE 128
 #define BLOCKSZ 32
+#define CT_SMALL_INITIAL_SIZE 2
 
 static ct_node_t * CT_node_new(const char * key, size_t len, void * data);
 static int CT_node_resize(ct_node_t * node, uint8_t pos);
+static int CT_node_blocks(ct_node_t * node);
+static ct_node_t ** CT_slot(ct_node_t * node, uint8_t k);
+static ct_node_t ** CT_slot_add(ct_node_t * node, uint8_t k);
+static void CT_small_compact(ct_small_t * small);
 static int CT_add(
         ct_node_t * node,
         const char * key,
@@ -47,8 +58,41 @@ static void CT_valuesn(
         size_t * n,
         ct_val_cb cb,
         void * args);
+static void CT_valuesn_after(
+        ct_node_t * node,
+        const char * key,
+        size_t * n,
+        ct_val_cb cb,
+        void * args);
 static void CT_free(ct_node_t * node, ct_free_cb cb);
 
+/*
+ * Returns the number of child positions of a node. (some can be NULL)
+ */
+static inline uint_fast16_t CT_end(ct_node_t * node)
+{
+    return (node->nodes == NULL) ? 0 : (node->tp == CT_NODE_SMALL) ?
+            node->small->len : node->n * BLOCKSZ;
+}
+
+/*
+ * Returns the child at position 'i' (can be NULL) and sets 'k' to the key
+ * character of the child.
+ */
+static inline ct_node_t * CT_child(
+        ct_node_t * node,
+        uint_fast16_t i,
+        char * k)
+{
+    if (node->tp == CT_NODE_SMALL)
+    {
+        *k = (char) node->small->keys[i];
+        return node->small->children[i];
+    }
+    *k = (char) (i + node->offset * BLOCKSZ);
+    return (*node->nodes)[i];
+}
+
 /*
  * Returns NULL in case an error has occurred.
  */
@@ -167,17 +211,15 @@ void ** ct_getaddr(ct_t * ct, const char * key)
         key += nd->len;
 
         if (!*key) return &nd->data;
-        if (!nd->nodes) return NULL;
 
-        k = (uint8_t) *key;
-        pos = k / BLOCKSZ;
+        ct_node_t ** slot = CT_slot(nd, (uint8_t) *key);
 
-        if (pos < nd->offset || pos >= nd->offset + nd->n)
+        if (slot == NULL)
         {
             return NULL;
         }
 
-        nd = (*nd->nodes)[k - nd->offset * BLOCKSZ];
+        nd = *slot;
     }
 
     return NULL;
@@ -211,18 +253,16 @@ void * ct_getn(ct_t * ct, const char * key, size_t n)
         }
 
         if (nd->len == n) return nd->data;
-        if (!nd->nodes) return NULL;
 
-        k = (uint8_t) key[nd->len];
-        pos = k / BLOCKSZ;
+        ct_node_t ** slot = CT_slot(nd, (uint8_t) key[nd->len]);
 
-        if (pos < nd->offset || pos >= nd->offset + nd->n)
+        if (slot == NULL)
         {
             return NULL;
         }
 
         diff = nd->len + 1; /* n - diff is at least 0 */
-        nd = (*nd->nodes)[k - nd->offset * BLOCKSZ];
+        nd = *slot;
     }
 
     return NULL;
@@ -338,6 +378,38 @@ void ct_valuesn(ct_t * ct, size_t * n, ct_val_cb cb, void * args)
     }
 }
 
+/*
+ * Like ct_valuesn() but the walk starts at the first key which is greater
+ * than 'key'. Values are visited in the order of their keys so only the
+ * path to 'key' is used to skip the smaller keys.
+ */
+void ct_valuesn_after(
+        ct_t * ct,
+        const char * key,
+        size_t * n,
+        ct_val_cb cb,
+        void * args)
+{
+    ct_node_t * nd;
+    uint_fast16_t k = (uint8_t) *key;
+
+    for (uint_fast16_t i = 0, end = ct->n * BLOCKSZ; *n && i < end; i++)
+    {
+        if ((nd = (*ct->nodes)[i]) == NULL)
+        {
+            continue;
+        }
+        if (i + ct->offset * BLOCKSZ > k)
+        {
+            CT_valuesn(nd, n, cb, args);
+        }
+        else if (i + ct->offset * BLOCKSZ == k)
+        {
+            CT_valuesn_after(nd, key + 1, n, cb, args);
+        }
+    }
+}
+
 /*
  * Loop over all items in the tree and perform the call-back on each item.
  * Walking stops either when the call-back is called on each item or
@@ -379,13 +451,12 @@ static int CT_items(
         ct_node_t * nd;
         int rc;
 
-        for (uint_fast16_t i = 0, end = node->n * BLOCKSZ; i < end; i++)
+        for (uint_fast16_t i = 0, end = CT_end(node); i < end; i++)
         {
-            if ((nd = (*node->nodes)[i]) == NULL)
+            if ((nd = CT_child(node, i, *buffer + len)) == NULL)
             {
                 continue;
             }
-            *(*buffer + len) = (char) (i + node->offset * BLOCKSZ);
             rc = CT_items(nd, len + 1, buffer_sz, buffer, cb, args);
             if (rc)
             {
@@ -417,10 +488,11 @@ static int CT_values(
     if (node->nodes != NULL)
     {
         ct_node_t * nd;
+        char k;
 
-        for (uint_fast16_t i = 0, end = node->n * BLOCKSZ; i < end; i++)
+        for (uint_fast16_t i = 0, end = CT_end(node); i < end; i++)
         {
-            if ((nd = (*node->nodes)[i]) == NULL)
+            if ((nd = CT_child(node, i, &k)) == NULL)
             {
                 continue;
             }
@@ -448,10 +520,11 @@ static void CT_valuesn(
     if (node->nodes != NULL)
     {
         ct_node_t * nd;
+        char k;
 
-        for (uint_fast16_t i = 0, end = node->n * BLOCKSZ; *n && i < end; i++)
+        for (uint_fast16_t i = 0, end = CT_end(node); *n && i < end; i++)
         {
-            if ((nd = (*node->nodes)[i]) == NULL)
+            if ((nd = CT_child(node, i, &k)) == NULL)
             {
                 continue;
             }
@@ -460,6 +533,54 @@ static void CT_valuesn(
     }
 }
 
+/*
+ * Argument 'key' is the part of the key after the character of 'node'.
+ */
+static void CT_valuesn_after(
+        ct_node_t * node,
+        const char * key,
+        size_t * n,
+        ct_val_cb cb,
+        void * args)
+{
+    int rc = strncmp(node->key, key, node->len);
+
+    if (rc)
+    {
+        /* all keys in this node are either greater or smaller than key */
+        if (rc > 0)
+        {
+            CT_valuesn(node, n, cb, args);
+        }
+        return;
+    }
+
+    /* the value of this node is equal to or smaller than key */
+    key += node->len;
+
+    if (node->nodes != NULL)
+    {
+        ct_node_t * nd;
+        char k;
+
+        for (uint_fast16_t i = 0, end = CT_end(node); *n && i < end; i++)
+        {
+            if ((nd = CT_child(node, i, &k)) == NULL)
+            {
+                continue;
+            }
+            if (!*key || (uint8_t) k > (uint8_t) *key)
+            {
+                CT_valuesn(nd, n, cb, args);
+            }
+            else if (k == *key)
+            {
+                CT_valuesn_after(nd, key + 1, n, cb, args);
+            }
+        }
+    }
+}
+
 /*
  * Returns CT_OK when the item is added, CT_EXISTS if the item already exists,
  * or CT_ERR in case or an error.
@@ -476,21 +597,23 @@ static int CT_add(
         if (*key != *pt)
         {
             size_t new_sz;
-            uint8_t k = (uint8_t) *pt;
+            ct_node_t ** slot;
 
             /* create new nodes */
-            ct_nodes_t * new_nodes =
-                    (ct_nodes_t *) calloc(1, sizeof(ct_nodes_t));
-            if (new_nodes == NULL)
+            ct_small_t * small = (ct_small_t *) malloc(
+                    sizeof(ct_small_t) +
+                    CT_SMALL_INITIAL_SIZE * sizeof(ct_node_t *));
+            if (small == NULL)
             {
                 return CT_ERR;
             }
 
             /* create new nodes with rest of node pt */
-            ct_node_t * nd = (*new_nodes)[k % BLOCKSZ] =
+            ct_node_t * nd =
                     CT_node_new(pt + 1, node->len - n - 1, node->data);
             if (nd == NULL)
             {
+                free(small);
                 return CT_ERR;
             }
 
@@ -499,11 +622,18 @@ static int CT_add(
             nd->size = node->size;
             nd->offset = node->offset;
             nd->n = node->n;
+            nd->tp = node->tp;
 
             /* the current nodes should become the new nodes */
-            node->nodes = new_nodes;
-            node->offset = k / BLOCKSZ;
-            node->n = 1;
+            small->len = 1;
+            small->size = CT_SMALL_INITIAL_SIZE;
+            small->keys[0] = (uint8_t) *pt;
+            small->children[0] = nd;
+
+            node->small = small;
+            node->tp = CT_NODE_SMALL;
+            node->offset = UINT8_MAX;
+            node->n = 0;
 
             if (!*key)
             {
@@ -516,9 +646,9 @@ static int CT_add(
                 /* we have more, make sure data for this node is NULL and
                  * add rest of our key to the nodes.
                  */
-                k = (uint8_t) *key;
+                node->size = 1;
 
-                if (CT_node_resize(node, k / BLOCKSZ))
+                if ((slot = CT_slot_add(node, (uint8_t) *key)) == NULL)
                 {
                     return CT_ERR;
                 }
@@ -531,7 +661,7 @@ static int CT_add(
 
                 node->size = 2;
                 node->data = NULL;
-                (*node->nodes)[k - node->offset * BLOCKSZ] = nd;
+                *slot = nd;
             }
 
             /* re-allocate the key to free some space */
@@ -556,33 +686,13 @@ static int CT_add(
 
     if (*key)
     {
-        uint8_t k = (uint8_t) *key;
-
-        if (node->nodes == NULL)
-        {
-            if (CT_node_resize(node, k / BLOCKSZ))
-            {
-                return CT_ERR;
-            }
-            key++;
-            ct_node_t * nd = CT_node_new(key, strlen(key), data);
-            if (nd == NULL)
-            {
-                return CT_ERR;
-            }
-
-            node->size = 1;
-            (*node->nodes)[k - node->offset * BLOCKSZ ] = nd;
-
-            return CT_OK;
-        }
+        ct_node_t ** nd = CT_slot_add(node, (uint8_t) *key);
 
-        if (CT_node_resize(node, k / BLOCKSZ))
+        if (nd == NULL)
         {
             return CT_ERR;
         }
 
-        ct_node_t ** nd = &(*node->nodes)[k - node->offset * BLOCKSZ];
         key++;
 
         if (*nd != NULL)
@@ -624,19 +734,18 @@ static void CT_merge_node(ct_node_t * node)
     assert(node->size == 1 && node->data == NULL);
 #endif
 
-    ct_node_t * child_node;
+    ct_node_t * child_node = NULL;
     char * tmp;
-    uint_fast16_t i, end;
+    char k = 0;
 
-    for (i = 0, end = node->n * BLOCKSZ; i < end; i++)
+    for (uint_fast16_t i = 0, end = CT_end(node); i < end; i++)
     {
-        if ((*node->nodes)[i] != NULL)
+        if ((child_node = CT_child(node, i, &k)) != NULL)
         {
             break;
         }
     }
     /* this is the child node we need to merge */
-    child_node = (*node->nodes)[i];
 
     /* re-allocate enough space for the key + child_key + 1 char */
     tmp = (char *) realloc(node->key, node->len + child_node->len + 1);
@@ -648,7 +757,7 @@ static void CT_merge_node(ct_node_t * node)
     node->key = tmp;
 
     /* set node char */
-    node->key[node->len++] = (char) (i + node->offset * BLOCKSZ);
+    node->key[node->len++] = k;
 
     /* append rest of the child key */
     memcpy(node->key + node->len, child_node->key, child_node->len);
@@ -663,6 +772,7 @@ static void CT_merge_node(ct_node_t * node)
     node->size = child_node->size;
     node->offset = child_node->offset;
     node->n = child_node->n;
+    node->tp = child_node->tp;
     node->data = child_node->data;
 
     /* free child key */
@@ -685,6 +795,11 @@ static void CT_dec_node(ct_node_t * node)
 
     node->size--;
 
+    if (node->tp == CT_NODE_SMALL)
+    {
+        CT_small_compact(node->small);
+    }
+
     if (node->size == 0)
     {
         /* we can free nodes since they are no longer used */
@@ -742,21 +857,10 @@ static void * CT_pop(ct_node_t * parent, ct_node_t ** nd, const char * key)
         return data;
     }
 
-    if (node->nodes != NULL)
-    {
-        uint8_t k = (uint8_t) *key;
-        uint8_t pos = k / BLOCKSZ;
+    ct_node_t ** next = CT_slot(node, (uint8_t) *key);
 
-        if (pos < node->offset || pos >= node->offset + node->n)
-        {
-            return NULL;
-        }
-
-        ct_node_t ** next = &(*node->nodes)[k - node->offset * BLOCKSZ];
-
-        return (*next == NULL) ? NULL : CT_pop(node, next, key + 1);
-    }
-    return NULL;
+    return (next == NULL || *next == NULL) ?
+            NULL : CT_pop(node, next, key + 1);
 }
 
 /*
@@ -774,6 +878,7 @@ static ct_node_t * CT_node_new(const char * key, size_t len, void * data)
     node->size = 0;
     node->offset = UINT8_MAX;
     node->n = 0;
+    node->tp = CT_NODE_SMALL;
     node->nodes = NULL;
     if (len)
     {
@@ -870,11 +975,14 @@ static void CT_free(ct_node_t * node, ct_free_cb cb)
 {
     if (node->nodes != NULL)
     {
-        for (uint_fast16_t i = 0, end = node->n * BLOCKSZ; i < end; i++)
+        ct_node_t * nd;
+        char k;
+
+        for (uint_fast16_t i = 0, end = CT_end(node); i < end; i++)
         {
-            if ((*node->nodes)[i] != NULL)
+            if ((nd = CT_child(node, i, &k)) != NULL)
             {
-                CT_free((*node->nodes)[i], cb);
+                CT_free(nd, cb);
             }
         }
         free(node->nodes);
@@ -887,3 +995,166 @@ static void CT_free(ct_node_t * node, ct_free_cb cb)
     free(node);
 }
 
+/*
+ * Returns the address of the child for key character 'k' or NULL when the
+ * node has no position for this child.
+ */
+static ct_node_t ** CT_slot(ct_node_t * node, uint8_t k)
+{
+    if (node->nodes == NULL)
+    {
+        return NULL;
+    }
+
+    if (node->tp == CT_NODE_SMALL)
+    {
+        ct_small_t * small = node->small;
+
+        for (uint_fast8_t i = 0; i < small->len; i++)
+        {
+            if (small->keys[i] == k)
+            {
+                return small->children + i;
+            }
+        }
+
+        return NULL;
+    }
+
+    uint8_t pos = k / BLOCKSZ;
+
+    if (pos < node->offset || pos >= node->offset + node->n)
+    {
+        return NULL;
+    }
+
+    return &(*node->nodes)[k - node->offset * BLOCKSZ];
+}
+
+/*
+ * Returns the address of the child for key character 'k'. A position for the
+ * child is created when needed in which case the address points to NULL.
+ *
+ * Returns NULL in case of an error. (the node remains unchanged)
+ */
+static ct_node_t ** CT_slot_add(ct_node_t * node, uint8_t k)
+{
+    ct_small_t * small;
+    uint_fast8_t i;
+
+    if (node->nodes == NULL)
+    {
+        small = (ct_small_t *) malloc(
+                sizeof(ct_small_t) +
+                CT_SMALL_INITIAL_SIZE * sizeof(ct_node_t *));
+        if (small == NULL)
+        {
+            return NULL;
+        }
+        small->len = 0;
+        small->size = CT_SMALL_INITIAL_SIZE;
+        node->small = small;
+        node->tp = CT_NODE_SMALL;
+    }
+    else if (node->tp == CT_NODE_BLOCKS)
+    {
+        return (CT_node_resize(node, k / BLOCKSZ)) ?
+                NULL : &(*node->nodes)[k - node->offset * BLOCKSZ];
+    }
+
+    small = node->small;
+
+    for (i = 0; i < small->len && small->keys[i] < k; i++);
+
+    if (i < small->len && small->keys[i] == k)
+    {
+        return small->children + i;
+    }
+
+    if (small->len == CT_SMALL_SZ)
+    {
+        return (CT_node_blocks(node)) ? NULL : CT_slot_add(node, k);
+    }
+
+    if (small->len == small->size)
+    {
+        uint8_t size = small->size * 2;
+        if (size > CT_SMALL_SZ)
+        {
+            size = CT_SMALL_SZ;
+        }
+        small = (ct_small_t *) realloc(
+                small,
+                sizeof(ct_small_t) + size * sizeof(ct_node_t *));
+        if (small == NULL)
+        {
+            return NULL;
+        }
+        small->size = size;
+        node->small = small;
+    }
+
+    memmove(small->keys + i + 1, small->keys + i, small->len - i);
+    memmove(small->children + i + 1,
+            small->children + i,
+            (small->len - i) * sizeof(ct_node_t *));
+
+    small->keys[i] = k;
+    small->children[i] = NULL;
+    small->len++;
+
+    return small->children + i;
+}
+
+/*
+ * Convert the small list with children of a node to blocks.
+ *
+ * Returns 0 is successful or -1 in case of an error. (the node remains
+ * unchanged)
+ */
+static int CT_node_blocks(ct_node_t * node)
+{
+    ct_small_t * small = node->small;
+    uint8_t offset = small->keys[0] / BLOCKSZ;
+    uint8_t n = small->keys[small->len - 1] / BLOCKSZ - offset + 1;
+    ct_nodes_t * nodes = (ct_nodes_t *) calloc(n, sizeof(ct_nodes_t));
+
+    if (nodes == NULL)
+    {
+        return -1;
+    }
+
+    for (uint_fast8_t i = 0; i < small->len; i++)
+    {
+        (*nodes)[small->keys[i] - offset * BLOCKSZ] = small->children[i];
+    }
+
+    free(small);
+
+    node->nodes = nodes;
+    node->tp = CT_NODE_BLOCKS;
+    node->offset = offset;
+    node->n = n;
+
+    return 0;
+}
+
+/*
+ * Remove the positions of children which are removed.
+ */
+static void CT_small_compact(ct_small_t * small)
+{
+    uint_fast8_t i, n;
+
+    for (i = 0, n = 0; i < small->len; i++)
+    {
+        if (small->children[i] != NULL)
+        {
+            small->keys[n] = small->keys[i];
+            small->children[n] = small->children[i];
+            n++;
+        }
+    }
+
+    small->len = n;
+}
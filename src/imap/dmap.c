@@ -0,0 +1,269 @@
+/*
+ * dmap.c - map for dense uint64_t integer keys
+ *
+ * author       : Jeroen van der Heijden
+ * email        : jeroen@transceptor.technology
+ * copyright    : 2016, Transceptor Technology
+ *
+ * Keys are used as index in chunks of DMAP_CHUNK_SZ items so a lookup
+ * requires only two loads. This uses less memory than an imap_t when keys
+ * are mostly contiguous, like series ids, but should not be used for
+ * sparse keys since a chunk is allocated for each used range of keys.
+ *
+ * The functions behave like their imap_t equivalents, including the cached
+ * s-list which is updated when items are added.
+ *
+ * changes
+ *  - initial version, 14-10-2016
+ *
+ */
+#include <imap/dmap.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Returns NULL in case an error has occurred.
+ */
+dmap_t * dmap_new(void)
+{
+    dmap_t * dmap = (dmap_t *) calloc(1, sizeof(dmap_t));
+    return dmap;
+}
+
+/*
+ * Destroy dmap with optional call-back function.
+ */
+void dmap_free(dmap_t * dmap, imap_free_cb cb)
+{
+    dmap_chunk_t * chunk;
+
+    for (size_t i = 0; i < dmap->n; i++)
+    {
+        chunk = dmap->chunks[i];
+
+        if (chunk == NULL)
+        {
+            continue;
+        }
+
+        if (cb != NULL)
+        {
+            for (size_t j = 0; j < DMAP_CHUNK_SZ; j++)
+            {
+                if (chunk->data[j] != NULL)
+                {
+                    (*cb)(chunk->data[j]);
+                }
+            }
+        }
+
+        free(chunk);
+    }
+
+    free(dmap->chunks);
+    slist_free(dmap->slist);
+    free(dmap);
+}
+
+/*
+ * Add data by id to the map.
+ *
+ * Returns 0 when data is added. Data will NOT be overwritten.
+ *
+ * In case of a memory error we return -1. When the id already exists -2 will
+ * be returned.
+ */
+int dmap_add(dmap_t * dmap, uint64_t id, void * data)
+{
+    uint64_t pos = id >> DMAP_CHUNK_BITS;
+    dmap_chunk_t * chunk;
+
+    if (pos >= dmap->n)
+    {
+        /* grow with at least a quarter to reduce re-allocations */
+        size_t n = pos + 1 + dmap->n / 4;
+        dmap_chunk_t ** chunks = (dmap_chunk_t **) realloc(
+                dmap->chunks,
+                n * sizeof(dmap_chunk_t *));
+
+        if (chunks == NULL)
+        {
+            return -1;
+        }
+
+        memset(chunks + dmap->n, 0, (n - dmap->n) * sizeof(dmap_chunk_t *));
+        dmap->chunks = chunks;
+        dmap->n = n;
+    }
+
+    chunk = dmap->chunks[pos];
+
+    if (chunk == NULL)
+    {
+        chunk = (dmap_chunk_t *) calloc(1, sizeof(dmap_chunk_t));
+
+        if (chunk == NULL)
+        {
+            return -1;
+        }
+
+        dmap->chunks[pos] = chunk;
+    }
+    else if (chunk->data[id & DMAP_CHUNK_MASK] != NULL)
+    {
+        return -2;
+    }
+
+    if (dmap->slist != NULL && slist_append_safe(&dmap->slist, data))
+    {
+        slist_free(dmap->slist);
+        dmap->slist = NULL;
+    }
+
+    chunk->data[id & DMAP_CHUNK_MASK] = data;
+    chunk->len++;
+    dmap->len++;
+
+    return 0;
+}
+
+/*
+ * Remove and return an item by id or return NULL in case the id is not found.
+ */
+void * dmap_pop(dmap_t * dmap, uint64_t id)
+{
+    uint64_t pos = id >> DMAP_CHUNK_BITS;
+    dmap_chunk_t * chunk;
+    void * data;
+
+    if (pos >= dmap->n || (chunk = dmap->chunks[pos]) == NULL)
+    {
+        return NULL;
+    }
+
+    data = chunk->data[id & DMAP_CHUNK_MASK];
+
+    if (data != NULL)
+    {
+        chunk->data[id & DMAP_CHUNK_MASK] = NULL;
+        dmap->len--;
+
+        if (!--chunk->len)
+        {
+            free(chunk);
+            dmap->chunks[pos] = NULL;
+        }
+
+        if (dmap->slist != NULL)
+        {
+            slist_free(dmap->slist);
+            dmap->slist = NULL;
+        }
+    }
+
+    return data;
+}
+
+/*
+ * Run the call-back function on all items in the map, ordered by id.
+ *
+ * All the results are added together and are returned as the result of
+ * this function.
+ */
+int dmap_walk(dmap_t * dmap, imap_cb cb, void * data)
+{
+    int rc = 0;
+    dmap_chunk_t * chunk;
+
+    for (size_t i = 0; i < dmap->n; i++)
+    {
+        chunk = dmap->chunks[i];
+
+        if (chunk == NULL)
+        {
+            continue;
+        }
+
+        for (size_t j = 0; j < DMAP_CHUNK_SZ; j++)
+        {
+            if (chunk->data[j] != NULL)
+            {
+                rc += (*cb)(chunk->data[j], data);
+            }
+        }
+    }
+
+    return rc;
+}
+
+/*
+ * Returns NULL in case an error has occurred.
+ *
+ * When successful a BORROWED pointer to slist is returned.
+ */
+slist_t * dmap_slist(dmap_t * dmap)
+{
+    if (dmap->slist == NULL)
+    {
+        dmap->slist = slist_new(dmap->len);
+
+        if (dmap->slist != NULL)
+        {
+            dmap_chunk_t * chunk;
+
+            for (size_t i = 0; i < dmap->n; i++)
+            {
+                chunk = dmap->chunks[i];
+
+                if (chunk == NULL)
+                {
+                    continue;
+                }
+
+                for (size_t j = 0; j < DMAP_CHUNK_SZ; j++)
+                {
+                    if (chunk->data[j] != NULL)
+                    {
+                        slist_append(dmap->slist, chunk->data[j]);
+                    }
+                }
+            }
+        }
+    }
+    return dmap->slist;
+}
+
+/*
+ * Returns NULL in case an error has occurred.
+ *
+ * When successful a NEW slist is returned.
+ */
+slist_t * dmap_2slist(dmap_t * dmap)
+{
+    slist_t * slist = dmap_slist(dmap);
+    if (slist != NULL)
+    {
+        slist = slist_copy(slist);
+    }
+    return slist;
+}
+
+/*
+ * Use this function to create a s-list copy and update the ref count
+ * for each object. We expect each object to have object->ref (uint_xxx_t) on
+ * top of the object definition.
+ *
+ * Returns NULL in case an error has occurred.
+ */
+slist_t * dmap_2slist_ref(dmap_t * dmap)
+{
+    slist_t * slist = dmap_2slist(dmap);
+    if (slist != NULL)
+    {
+        for (size_t i = 0; i < slist->len; i++)
+        {
+            slist_object_incref(slist->data[i]);
+        }
+    }
+    return slist;
+}
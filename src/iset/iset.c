@@ -0,0 +1,371 @@
+/*
+ * iset.c - compressed set for uint32_t integer ids
+ *
+ * author       : Jeroen van der Heijden
+ * email        : jeroen@transceptor.technology
+ * copyright    : 2016, Transceptor Technology
+ *
+ * Ids are stored in containers by their high 16 bits, like a roaring bitmap.
+ * A container stores the low 16 bits in a sorted array until the array has
+ * ISET_ARRAY_MAX ids. From then a bitmap of 8KB is used. Both use at most
+ * two bytes for each id and testing an id is cheap compared to an imap_t
+ * which uses a node tree.
+ *
+ * changes
+ *  - initial version, 14-10-2016
+ *
+ */
+#include <iset/iset.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ISET_BITMAP_WORDS 1024  /* 65536 bits */
+#define ISET_INITIAL_SIZE 4
+
+static iset_container_t * ISET_get(
+        iset_t * iset,
+        uint16_t key,
+        uint32_t * pos);
+static iset_container_t * ISET_insert(
+        iset_t * iset,
+        uint16_t key,
+        uint32_t pos);
+static uint32_t ISET_find(iset_container_t * container, uint16_t low);
+static int ISET_to_bitmap(iset_container_t * container);
+
+/*
+ * Returns NULL in case an error has occurred.
+ */
+iset_t * iset_new(void)
+{
+    iset_t * iset = (iset_t *) calloc(1, sizeof(iset_t));
+    return iset;
+}
+
+/*
+ * Destroy the set.
+ */
+void iset_free(iset_t * iset)
+{
+    if (iset == NULL)
+    {
+        return;
+    }
+
+    for (uint32_t i = 0; i < iset->n; i++)
+    {
+        free(iset->containers[i].data);
+    }
+    free(iset->containers);
+    free(iset);
+}
+
+/*
+ * Returns 1 if the id is added or 0 when the id already exists.
+ *
+ * In case of an error we return -1.
+ */
+int iset_add(iset_t * iset, uint32_t id)
+{
+    uint16_t low = (uint16_t) id;
+    uint32_t pos;
+    uint16_t * array;
+    iset_container_t * container = ISET_get(iset, id >> 16, &pos);
+
+    if (container == NULL &&
+            (container = ISET_insert(iset, id >> 16, pos)) == NULL)
+    {
+        return -1;
+    }
+
+    if (!container->size)
+    {
+        uint64_t * bitmap = (uint64_t *) container->data;
+        uint64_t bit = 1ULL << (low & 63);
+
+        if (bitmap[low >> 6] & bit)
+        {
+            return 0;
+        }
+
+        bitmap[low >> 6] |= bit;
+        container->len++;
+        iset->len++;
+
+        return 1;
+    }
+
+    array = (uint16_t *) container->data;
+
+    /* ids are often added in order so in most cases the id is appended */
+    pos = (!container->len || array[container->len - 1] < low) ?
+            container->len : ISET_find(container, low);
+
+    if (pos < container->len && array[pos] == low)
+    {
+        return 0;
+    }
+
+    if (container->len == ISET_ARRAY_MAX)
+    {
+        if (ISET_to_bitmap(container))
+        {
+            return -1;
+        }
+        return iset_add(iset, id);
+    }
+
+    if (container->len == container->size)
+    {
+        uint32_t size = container->size * 2;
+
+        if (size > ISET_ARRAY_MAX)
+        {
+            size = ISET_ARRAY_MAX;
+        }
+
+        array = (uint16_t *) realloc(array, size * sizeof(uint16_t));
+
+        if (array == NULL)
+        {
+            return -1;
+        }
+
+        container->data = array;
+        container->size = size;
+    }
+
+    memmove(array + pos + 1,
+            array + pos,
+            (container->len - pos) * sizeof(uint16_t));
+    array[pos] = low;
+    container->len++;
+    iset->len++;
+
+    return 1;
+}
+
+/*
+ * Returns 1 when the id is in the set or 0 if not.
+ */
+int iset_has(iset_t * iset, uint32_t id)
+{
+    uint16_t low = (uint16_t) id;
+    uint32_t pos;
+    iset_container_t * container = ISET_get(iset, id >> 16, &pos);
+
+    if (container == NULL)
+    {
+        return 0;
+    }
+
+    if (!container->size)
+    {
+        uint64_t * bitmap = (uint64_t *) container->data;
+        return (bitmap[low >> 6] >> (low & 63)) & 1;
+    }
+
+    pos = ISET_find(container, low);
+
+    return pos < container->len && ((uint16_t *) container->data)[pos] == low;
+}
+
+/*
+ * Run the call-back function on all ids in the set, in order.
+ *
+ * All the results are added together and are returned as the result of
+ * this function.
+ */
+int iset_walk(iset_t * iset, iset_cb cb, void * args)
+{
+    int rc = 0;
+    iset_container_t * container;
+    uint32_t high;
+
+    for (uint32_t i = 0; i < iset->n; i++)
+    {
+        container = iset->containers + i;
+        high = (uint32_t) container->key << 16;
+
+        if (container->size)
+        {
+            uint16_t * array = (uint16_t *) container->data;
+
+            for (uint32_t j = 0; j < container->len; j++)
+            {
+                rc += (*cb)(high | array[j], args);
+            }
+        }
+        else
+        {
+            uint64_t * bitmap = (uint64_t *) container->data;
+            uint64_t word;
+
+            for (uint32_t j = 0; j < ISET_BITMAP_WORDS; j++)
+            {
+                for (word = bitmap[j]; word; word &= word - 1)
+                {
+                    rc += (*cb)(
+                            high | (j << 6) | __builtin_ctzll(word),
+                            args);
+                }
+            }
+        }
+    }
+
+    return rc;
+}
+
+/*
+ * Returns the container for 'key' or NULL when not found in which case 'pos'
+ * is set to the position where the container should be inserted.
+ */
+static iset_container_t * ISET_get(
+        iset_t * iset,
+        uint16_t key,
+        uint32_t * pos)
+{
+    uint32_t lo = 0;
+    uint32_t hi = iset->n;
+    uint32_t mid;
+
+    /* ids are often added in order so first check the last container */
+    if (hi && iset->containers[hi - 1].key <= key)
+    {
+        if (iset->containers[hi - 1].key == key)
+        {
+            return iset->containers + hi - 1;
+        }
+        *pos = hi;
+        return NULL;
+    }
+
+    while (lo < hi)
+    {
+        mid = lo + (hi - lo) / 2;
+        if (iset->containers[mid].key < key)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+
+    if (lo < iset->n && iset->containers[lo].key == key)
+    {
+        return iset->containers + lo;
+    }
+
+    *pos = lo;
+    return NULL;
+}
+
+/*
+ * Returns a new and empty array container at 'pos' or NULL in case of an
+ * error.
+ */
+static iset_container_t * ISET_insert(
+        iset_t * iset,
+        uint16_t key,
+        uint32_t pos)
+{
+    iset_container_t * container;
+    uint16_t * array = (uint16_t *) malloc(
+            ISET_INITIAL_SIZE * sizeof(uint16_t));
+
+    if (array == NULL)
+    {
+        return NULL;
+    }
+
+    if (iset->n == iset->size)
+    {
+        uint32_t size = iset->size ? iset->size * 2 : ISET_INITIAL_SIZE;
+        container = (iset_container_t *) realloc(
+                iset->containers,
+                size * sizeof(iset_container_t));
+
+        if (container == NULL)
+        {
+            free(array);
+            return NULL;
+        }
+
+        iset->containers = container;
+        iset->size = size;
+    }
+
+    container = iset->containers + pos;
+
+    memmove(container + 1,
+            container,
+            (iset->n - pos) * sizeof(iset_container_t));
+
+    iset->n++;
+
+    container->key = key;
+    container->len = 0;
+    container->size = ISET_INITIAL_SIZE;
+    container->data = array;
+
+    return container;
+}
+
+/*
+ * Returns the position of 'low' in an array container or the position where
+ * 'low' should be inserted.
+ */
+static uint32_t ISET_find(iset_container_t * container, uint16_t low)
+{
+    uint16_t * array = (uint16_t *) container->data;
+    uint32_t lo = 0;
+    uint32_t hi = container->len;
+    uint32_t mid;
+
+    while (lo < hi)
+    {
+        mid = lo + (hi - lo) / 2;
+        if (array[mid] < low)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+
+    return lo;
+}
+
+/*
+ * Convert an array container to a bitmap container.
+ *
+ * Returns 0 if successful or -1 in case of an error. (in case of an error
+ * the container is unchanged)
+ */
+static int ISET_to_bitmap(iset_container_t * container)
+{
+    uint16_t * array = (uint16_t *) container->data;
+    uint64_t * bitmap = (uint64_t *) calloc(
+            ISET_BITMAP_WORDS,
+            sizeof(uint64_t));
+
+    if (bitmap == NULL)
+    {
+        return -1;
+    }
+
+    for (uint32_t i = 0; i < container->len; i++)
+    {
+        bitmap[array[i] >> 6] |= 1ULL << (array[i] & 63);
+    }
+
+    free(array);
+    container->data = bitmap;
+    container->size = 0;
+
+    return 0;
+}
@@ -516,12 +516,34 @@ static const char * tz_common[] = {
         return get_ts(str, tz_fmt, TZ_UTC, offset * sign);      \
     }
 
+/* seconds in a day, the range of a time-zone cache entry */
+#define TZ_DAY 86400
+
+#define TZ_D2(pt) (((pt)[0] - '0') * 10 + (pt)[1] - '0')
+
+/* The UTC offset of a time-zone is only known after switching the TZ
+ * environment variable which requires reading the zone information. Each
+ * time-zone therefore caches the offset for one day, as long as the offset
+ * does not change during that day. The range [start, end) is in seconds of
+ * the date, read as if it was UTC. Only the main thread parses dates.
+ */
+typedef struct tz_cache_s
+{
+    int64_t start;
+    int64_t end;
+    int64_t gmtoff;
+} tz_cache_t;
+
+static tz_cache_t tz_cache[TZ_LEN];
 
 static int64_t get_ts(
         const char * str,
         const char * fmt,
         iso8601_tz_t tz,
         int64_t offset);
+static int parse_fixed(const char * str, int64_t * ts);
+static int64_t get_gmtoff(iso8601_tz_t tz, int64_t ts);
+static int64_t get_localoff(int64_t ts);
 
 iso8601_tz_t iso8601_tz(const char * tzname)
 {
@@ -578,6 +600,13 @@ int64_t iso8601_parse_date(const char * str, iso8601_tz_t tz)
     int64_t offset;
     int sign = -1;
     int use_t = 0;
+    int64_t ts;
+
+    /* most dates are written like YYYY-MM-DD or YYYY-MM-DD HH:MM:SS */
+    if (parse_fixed(str, &ts) == 0)
+    {
+        return (tz == TZ_UTC) ? ts : ts - get_gmtoff(tz, ts);
+    }
 
     /* read year */
     TZ_DIGITS
@@ -701,21 +730,132 @@ static int64_t get_ts(
         return ts + offset;
     }
 
+    return ts - get_gmtoff(tz, ts);
+}
+
+/*
+ * Parse a date written as YYYY-MM-DD or YYYY-MM-DD HH:MM:SS (or with a T
+ * as separator) without time-zone information. The time-stamp is set as if
+ * the date is in UTC.
+ *
+ * Returns 0 if successful or -1 when the date has another format or a
+ * value is out of range. In that case the date should be parsed with
+ * strptime() which gives the same result for the dates accepted here.
+ */
+static int parse_fixed(const char * str, int64_t * ts)
+{
+    static const char fmt[] = "0000-00-00 00:00:00";
+    int64_t year, month, day, hour = 0, minute = 0, second = 0;
+    int64_t era, yoe, doy, doe;
+    size_t i;
+
+    for (i = 0; str[i]; i++)
+    {
+        if (i == sizeof(fmt) - 1)
+        {
+            return -1;
+        }
+        if (fmt[i] == '0')
+        {
+            if (!isdigit(str[i]))
+            {
+                return -1;
+            }
+        }
+        else if (str[i] != fmt[i] && (i != 10 || str[i] != 'T'))
+        {
+            return -1;
+        }
+    }
+
+    if (i != 10 && i != sizeof(fmt) - 1)
+    {
+        return -1;
+    }
+
+    year = TZ_D2(str) * 100 + TZ_D2(str + 2);
+    month = TZ_D2(str + 5);
+    day = TZ_D2(str + 8);
+
+    if (i != 10)
+    {
+        hour = TZ_D2(str + 11);
+        minute = TZ_D2(str + 14);
+        second = TZ_D2(str + 17);
+    }
+
+    if (    month < 1 || month > 12 ||
+            day < 1 || day > 31 ||
+            hour > 23 || minute > 59 || second > 59)
+    {
+        return -1;
+    }
+
+    /* days since 1970-01-01, a year starts in March so leap days are last.
+     * Like mktime(), the 31th of a shorter month continues in the next.
+     */
+    year -= month <= 2;
+    era = ((year >= 0) ? year : year - 399) / 400;
+    yoe = year - era * 400;
+    doy = (153 * (month + ((month > 2) ? -3 : 9)) + 2) / 5 + day - 1;
+    doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+
+    *ts = (era * 146097 + doe - 719468) * TZ_DAY +
+            hour * 3600 + minute * 60 + second;
+
+    return 0;
+}
+
+/*
+ * Returns the UTC offset in seconds for time-zone 'tz' at time-stamp 'ts',
+ * including daylight saving time.
+ */
+static int64_t get_gmtoff(iso8601_tz_t tz, int64_t ts)
+{
+    tz_cache_t * cache = &tz_cache[tz];
+    int64_t start, gmtoff;
+
+    if (ts >= cache->start && ts < cache->end)
+    {
+        return cache->gmtoff;
+    }
+
     /* set custom timezone */
     putenv((char *) tz_common[tz]);
     tzset();
 
-    /* localize the timestamp so we get the correct offset including
-     * daylight saving time.
-     */
-    memset(&tm, 0, sizeof(struct tm));
-    localtime_r(&ts, &tm);
+    gmtoff = get_localoff(ts);
+
+    /* cache the offset when it is the same for the whole day */
+    start = ts - ((ts % TZ_DAY) + TZ_DAY) % TZ_DAY;
+    if (    get_localoff(start) == gmtoff &&
+            get_localoff(start + TZ_DAY - 1) == gmtoff)
+    {
+        cache->start = start;
+        cache->end = start + TZ_DAY;
+        cache->gmtoff = gmtoff;
+    }
 
     /* set environment back to UTC */
     putenv("TZ=:UTC");
     tzset();
 
-    ts -= tm.tm_gmtoff;
+    return gmtoff;
+}
+
+/*
+ * Returns the UTC offset for 'ts' in the time-zone set with tzset().
+ */
+static int64_t get_localoff(int64_t ts)
+{
+    struct tm tm;
+    time_t t = (time_t) ts;
+
+    /* localize the timestamp so we get the correct offset including
+     * daylight saving time.
+     */
+    memset(&tm, 0, sizeof(struct tm));
+    localtime_r(&t, &tm);
 
-    return ts;
+    return tm.tm_gmtoff;
 }
@@ -5,15 +5,25 @@
  * email        : jeroen@transceptor.technology
  * copyright    : 2016, Transceptor Technology
  *
+ * In asynchronous mode, started with logger_async_start(), log lines are
+ * formatted by the thread which logs and written to a ring buffer. A writer
+ * thread writes the lines to the output stream so logging never waits for
+ * the stream. Lines are dropped when the ring buffer is full and a message
+ * with the same format is logged at most LOGGER_RATE_LIMIT times a second.
+ * The writer reports the number of dropped lines.
+ *
  * changes
  *  - initial version, 08-03-2016
  *
  */
+#include <inttypes.h>
 #include <logger/logger.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdarg.h>
+#include <string.h>
 #include <time.h>
+#include <uv.h>
 
 logger_t Logger = {
         .level=10,
@@ -24,6 +34,50 @@ logger_t Logger = {
 
 #define LOGGER_CHR_MAP "DIWECU"
 
+/* maximum length of an asynchronous log line, longer lines are truncated */
+#define LOGGER_LINE_SZ 1024
+
+/* number of lines with the same format which may be logged each second */
+#define LOGGER_RATE_LIMIT 20
+#define LOGGER_RATE_SLOTS 256
+
+typedef struct logger_line_s
+{
+    uint64_t seq;       /* position which may use the slot, atomic */
+    int len;
+    char line[LOGGER_LINE_SZ];
+} logger_line_t;
+
+typedef struct logger_rate_s
+{
+    const char * fmt;   /* atomic */
+    uint64_t second;    /* atomic */
+    uint32_t n;         /* atomic */
+} logger_rate_t;
+
+/*
+ * Bounded queue with many producers and a single consumer. The sequence of
+ * a slot tells if the slot is free for the producer at position 'seq' or if
+ * the slot holds the line for the consumer at position 'seq - 1'.
+ */
+typedef struct logger_ring_s
+{
+    size_t mask;
+    logger_line_t * lines;
+    uint64_t head;      /* next position for a producer, atomic */
+    uint64_t tail;      /* next position for the writer */
+    uint64_t dropped;   /* lines dropped since the last report, atomic */
+    int stop;           /* atomic */
+    uv_sem_t sem;
+    uv_thread_t writer;
+} logger_ring_t;
+
+static logger_ring_t * logger_ring = NULL;
+static logger_rate_t logger_rate[LOGGER_RATE_SLOTS];
+
+static void LOGGER_async(int level, const char * fmt, va_list args);
+static void LOGGER_writer(void * arg);
+
 #define KNRM  "\x1B[0m"     // normal
 #define KRED  "\x1B[31m"    // error
 #define KGRN  "\x1B[32m"    // info
@@ -41,6 +95,14 @@ const char * LOGGER_COLOR_MAP[LOGGER_NUM_LEVELS] =
 
 #define LOGGER_LOG_STUFF(LEVEL)                                 \
 {                                                               \
+    if (Logger.flags & LOGGER_FLAG_ASYNC)                       \
+    {                                                           \
+        va_list args;                                           \
+        va_start(args, fmt);                                    \
+        LOGGER_async(LEVEL, fmt, args);                         \
+        va_end(args);                                           \
+        return;                                                 \
+    }                                                           \
     time_t t = time(NULL);                                      \
     struct tm tm = *localtime(&t);                              \
     if (Logger.flags & LOGGER_FLAG_COLORED)                     \
@@ -104,6 +166,96 @@ const char * logger_level_name(int log_level)
     return LOGGER_LEVEL_NAMES[log_level];
 }
 
+/*
+ * Start writing log lines from a writer thread. Argument 'size' is the number
+ * of lines the ring buffer can hold and is rounded up to a power of two.
+ * Must be called from the main thread before other threads start logging.
+ *
+ * Returns 0 if successful or -1 in case of an error, the logger then keeps
+ * writing log lines directly.
+ */
+int logger_async_start(size_t size)
+{
+    logger_ring_t * ring;
+    size_t n = 1;
+
+    if (logger_ring != NULL)
+    {
+        return 0;
+    }
+
+    while (n < size)
+    {
+        n <<= 1;
+    }
+
+    ring = (logger_ring_t *) malloc(sizeof(logger_ring_t));
+    if (ring == NULL ||
+        (ring->lines = (logger_line_t *) malloc(
+                sizeof(logger_line_t) * n)) == NULL)
+    {
+        free(ring);
+        return -1;
+    }
+
+    for (size_t i = 0; i < n; i++)
+    {
+        ring->lines[i].seq = i;
+    }
+
+    ring->mask = n - 1;
+    ring->head = 0;
+    ring->tail = 0;
+    ring->dropped = 0;
+    ring->stop = 0;
+
+    if (uv_sem_init(&ring->sem, 0))
+    {
+        free(ring->lines);
+        free(ring);
+        return -1;
+    }
+
+    if (uv_thread_create(&ring->writer, LOGGER_writer, ring))
+    {
+        uv_sem_destroy(&ring->sem);
+        free(ring->lines);
+        free(ring);
+        return -1;
+    }
+
+    logger_ring = ring;
+    Logger.flags |= LOGGER_FLAG_ASYNC;
+
+    return 0;
+}
+
+/*
+ * Write the remaining log lines and stop the writer thread. Must be called
+ * from the main thread when other threads no longer log.
+ */
+void logger_async_stop(void)
+{
+    logger_ring_t * ring = logger_ring;
+
+    if (ring == NULL)
+    {
+        return;
+    }
+
+    __atomic_store_n(&ring->stop, 1, __ATOMIC_RELEASE);
+    uv_sem_post(&ring->sem);
+    uv_thread_join(&ring->writer);
+
+    Logger.flags &= ~LOGGER_FLAG_ASYNC;
+
+    uv_sem_destroy(&ring->sem);
+    free(ring->lines);
+    free(ring);
+
+    logger_ring = NULL;
+}
+
 void log__debug(char * fmt, ...)
     LOGGER_LOG_STUFF(LOGGER_DEBUG)
 
@@ -119,3 +271,308 @@ void log__error(char * fmt, ...)
 void log__critical(char * fmt, ...)
     LOGGER_LOG_STUFF(LOGGER_CRITICAL)
 
+
+/*
+ * Write the start of a log line, like LOGGER_LOG_STUFF, to 'buf' which must
+ * have space for LOGGER_LINE_SZ bytes.
+ *
+ * Returns the number of bytes written.
+ */
+static int LOGGER_prefix(char * buf, int level, time_t t)
+{
+    struct tm tm;
+    int n;
+
+    localtime_r(&t, &tm);
+
+    if (Logger.flags & LOGGER_FLAG_COLORED)
+    {
+        n = snprintf(buf, LOGGER_LINE_SZ,
+            "%s[%c %d-%0*d-%0*d %0*d:%0*d:%0*d]" KNRM " ",
+            LOGGER_COLOR_MAP[level],
+            LOGGER_CHR_MAP[level],
+            tm.tm_year + 1900,
+            2, tm.tm_mon + 1,
+            2, tm.tm_mday,
+            2, tm.tm_hour,
+            2, tm.tm_min,
+            2, tm.tm_sec);
+    }
+    else
+    {
+        n = snprintf(buf, LOGGER_LINE_SZ,
+            "[%c %d-%0*d-%0*d %0*d:%0*d:%0*d] ",
+            LOGGER_CHR_MAP[level],
+            tm.tm_year + 1900,
+            2, tm.tm_mon + 1,
+            2, tm.tm_mday,
+            2, tm.tm_hour,
+            2, tm.tm_min,
+            2, tm.tm_sec);
+    }
+
+    return (n < 0) ? 0 : n;
+}
+
+/*
+ * Returns 1 when a line with format 'fmt' should not be logged because the
+ * format is already logged LOGGER_RATE_LIMIT times in the current second.
+ * Formats which share a slot can reset each others count which only makes
+ * the limit less strict.
+ */
+static int LOGGER_rate_limited(const char * fmt, uint64_t second)
+{
+    logger_rate_t * rate =
+            &logger_rate[((uintptr_t) fmt >> 4) % LOGGER_RATE_SLOTS];
+
+    if (    __atomic_load_n(&rate->fmt, __ATOMIC_RELAXED) != fmt ||
+            __atomic_load_n(&rate->second, __ATOMIC_RELAXED) != second)
+    {
+        __atomic_store_n(&rate->fmt, fmt, __ATOMIC_RELAXED);
+        __atomic_store_n(&rate->second, second, __ATOMIC_RELAXED);
+        __atomic_store_n(&rate->n, 1, __ATOMIC_RELAXED);
+        return 0;
+    }
+
+    return __atomic_add_fetch(&rate->n, 1, __ATOMIC_RELAXED) >
+            LOGGER_RATE_LIMIT;
+}
+
+/*
+ * Format a log line and add the line to the ring buffer. The line is dropped
+ * when the ring buffer is full.
+ */
+static void LOGGER_async(int level, const char * fmt, va_list args)
+{
+    logger_ring_t * ring = logger_ring;
+    logger_line_t * line;
+    time_t t = time(NULL);
+    uint64_t pos, seq;
+    int n;
+
+    if (LOGGER_rate_limited(fmt, (uint64_t) t))
+    {
+        __atomic_add_fetch(&ring->dropped, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    pos = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+    while (1)
+    {
+        line = &ring->lines[pos & ring->mask];
+        seq = __atomic_load_n(&line->seq, __ATOMIC_ACQUIRE);
+
+        if (seq == pos)
+        {
+            if (__atomic_compare_exchange_n(
+                    &ring->head,
+                    &pos,
+                    pos + 1,
+                    0,
+                    __ATOMIC_RELAXED,
+                    __ATOMIC_RELAXED))
+            {
+                break;
+            }
+        }
+        else if (seq < pos)
+        {
+            /* the writer has not yet written the line in this slot */
+            __atomic_add_fetch(&ring->dropped, 1, __ATOMIC_RELAXED);
+            return;
+        }
+        else
+        {
+            pos = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+        }
+    }
+
+    n = LOGGER_prefix(line->line, level, t);
+    if (n < LOGGER_LINE_SZ)
+    {
+        int m = vsnprintf(line->line + n, LOGGER_LINE_SZ - n, fmt, args);
+        if (m > 0)
+        {
+            n += m;
+        }
+    }
+    line->len = (n >= LOGGER_LINE_SZ) ? LOGGER_LINE_SZ - 1 : n;
+
+    __atomic_store_n(&line->seq, pos + 1, __ATOMIC_RELEASE);
+    uv_sem_post(&ring->sem);
+}
+
+static void LOGGER_writer(void * arg)
+{
+    logger_ring_t * ring = (logger_ring_t *) arg;
+    logger_line_t * line;
+    uint64_t dropped;
+    char buf[LOGGER_LINE_SZ];
+    int stop, n;
+
+    do
+    {
+        uv_sem_wait(&ring->sem);
+
+        stop = __atomic_load_n(&ring->stop, __ATOMIC_ACQUIRE);
+
+        while (1)
+        {
+            line = &ring->lines[ring->tail & ring->mask];
+            if (__atomic_load_n(&line->seq, __ATOMIC_ACQUIRE) !=
+                    ring->tail + 1)
+            {
+                break;
+            }
+
+            fwrite(line->line, 1, line->len, Logger.ostream);
+            fputc('\n', Logger.ostream);
+
+            __atomic_store_n(
+                    &line->seq,
+                    ring->tail + ring->mask + 1,
+                    __ATOMIC_RELEASE);
+            ring->tail++;
+        }
+
+        dropped = __atomic_exchange_n(&ring->dropped, 0, __ATOMIC_RELAXED);
+        if (dropped)
+        {
+            n = LOGGER_prefix(buf, LOGGER_WARNING, time(NULL));
+            fprintf(Logger.ostream,
+                    "%.*s%" PRIu64 " log line(s) are dropped\n",
+                    n,
+                    buf,
+                    dropped);
+        }
+
+        fflush(Logger.ostream);
+    }
+    while (!stop);
+}
+
+/*
+ * Returns a new log file which is opened for appending or NULL in case of
+ * an error.
+ */
+logger_file_t * logger_file_new(
+        const char * fn,
+        size_t max_size,
+        int max_files)
+{
+    logger_file_t * lfile = (logger_file_t *) malloc(sizeof(logger_file_t));
+    long pos;
+
+    if (lfile == NULL)
+    {
+        return NULL;
+    }
+
+    lfile->fn = strdup(fn);
+    lfile->ostream = fopen(fn, "a");
+    lfile->max_size = max_size;
+    lfile->max_files = max_files;
+
+    if (    lfile->fn == NULL ||
+            lfile->ostream == NULL ||
+            (pos = ftell(lfile->ostream)) < 0)
+    {
+        logger_file_free(lfile);
+        return NULL;
+    }
+
+    lfile->size = (size_t) pos;
+
+    return lfile;
+}
+
+void logger_file_free(logger_file_t * lfile)
+{
+    if (lfile != NULL)
+    {
+        if (lfile->ostream != NULL)
+        {
+            fclose(lfile->ostream);
+        }
+        free(lfile->fn);
+        free(lfile);
+    }
+}
+
+/*
+ * Write a log line to the file. The file is rotated after the line when the
+ * file has reached max_size bytes. The oldest file is removed and the other
+ * files are renamed so 'fn.1' is always the most recent rotated file.
+ */
+void logger_file_write(logger_file_t * lfile, int log_level, char * fmt, ...)
+{
+    time_t t = time(NULL);
+    struct tm tm = *localtime(&t);
+    size_t len = strlen(lfile->fn) + 12;
+    char src[len], dst[len];
+    va_list args;
+    int n;
+
+    if (lfile->ostream == NULL)
+    {
+        return;  /* the file could not be re-opened after rotating */
+    }
+
+    n = fprintf(lfile->ostream,
+            "[%c %d-%0*d-%0*d %0*d:%0*d:%0*d] ",
+            LOGGER_CHR_MAP[log_level],
+            tm.tm_year + 1900,
+            2, tm.tm_mon + 1,
+            2, tm.tm_mday,
+            2, tm.tm_hour,
+            2, tm.tm_min,
+            2, tm.tm_sec);
+    if (n > 0)
+    {
+        lfile->size += n;
+    }
+
+    va_start(args, fmt);
+    n = vfprintf(lfile->ostream, fmt, args);
+    va_end(args);
+    if (n > 0)
+    {
+        lfile->size += n;
+    }
+
+    fputc('\n', lfile->ostream);
+    fflush(lfile->ostream);
+    lfile->size++;
+
+    if (lfile->size < lfile->max_size)
+    {
+        return;
+    }
+
+    fclose(lfile->ostream);
+
+    for (n = lfile->max_files; n > 1; n--)
+    {
+        sprintf(src, "%s.%d", lfile->fn, n - 1);
+        sprintf(dst, "%s.%d", lfile->fn, n);
+        rename(src, dst);
+    }
+
+    if (lfile->max_files)
+    {
+        sprintf(dst, "%s.1", lfile->fn);
+        rename(lfile->fn, dst);
+    }
+    else
+    {
+        remove(lfile->fn);
+    }
+
+    lfile->ostream = fopen(lfile->fn, "a");
+    lfile->size = 0;
+
+    if (lfile->ostream == NULL)
+    {
+        log_error("Cannot open log file after rotating: '%s'", lfile->fn);
+    }
+}
@@ -26,6 +26,9 @@
 
 #define QPACK_MAX_FMT_SIZE 1024
 
+/* maximum size of an array with two integers or doubles */
+#define QP_ARRAY2_MAX_SZ 19
+
 #define QP_RESIZE(LEN)                                                  \
 if (packer->len + LEN > packer->buffer_size)                            \
 {                                                                       \
@@ -218,6 +221,102 @@ qp_unpacker_t * qp_unpacker_ff(const char * fn)
     return unpacker;
 }
 
+/*
+ * Returns a file unpacker object which reads file 'fn' in parts of at most
+ * 'size' bytes, or NULL in case an error occurred. The error message will
+ * logged using at least log_error().
+ *
+ * Unlike qp_unpacker_ff() which needs memory for the complete file, the
+ * memory used is bounded by 'size'. The unpacker in the returned object can
+ * be used with the normal unpack functions but it only holds a window on the
+ * file. Use qp_funpacker_fill() to make sure the window contains the next
+ * objects.
+ *
+ * In case and only in case of a memory (malloc) error, a signal will be raised.
+ */
+qp_funpacker_t * qp_funpacker_new(const char * fn, size_t size)
+{
+    qp_funpacker_t * funpacker;
+    FILE * fp = fopen(fn, "r");
+
+    if (fp == NULL)
+    {
+        log_error("Could not read '%s'", fn);
+        return NULL;
+    }
+
+    funpacker = (qp_funpacker_t *) malloc(sizeof(qp_funpacker_t));
+    if (funpacker == NULL ||
+        (funpacker->unpacker.source = (char *) malloc(size)) == NULL)
+    {
+        ERR_ALLOC
+        free(funpacker);
+        fclose(fp);
+        return NULL;
+    }
+
+    funpacker->fp = fp;
+    funpacker->size = size;
+    funpacker->unpacker.pt = funpacker->unpacker.source;
+    funpacker->unpacker.end = funpacker->unpacker.source;
+
+    return funpacker;
+}
+
+/*
+ * Destroy file unpacker object. (parsing NULL is not allowed)
+ */
+void qp_funpacker_free(qp_funpacker_t * funpacker)
+{
+    free(funpacker->unpacker.source);
+    fclose(funpacker->fp);
+    free(funpacker);
+}
+
+/*
+ * Make sure the window of the unpacker contains at least the next 'n' bytes
+ * of the file, or all remaining bytes when the file has less. Argument 'n'
+ * cannot be larger than the size used to create the file unpacker. Objects
+ * which are unpacked before calling this function are no longer valid when
+ * the window is moved.
+ *
+ * Returns 0 if successful or -1 in case the file cannot be read.
+ */
+int qp_funpacker_fill(qp_funpacker_t * funpacker, size_t n)
+{
+    qp_unpacker_t * unpacker = &funpacker->unpacker;
+    size_t len = unpacker->end - unpacker->pt;
+    size_t nread;
+
+#ifdef DEBUG
+    assert(n <= funpacker->size);
+#endif
+
+    if (len >= n || feof(funpacker->fp))
+    {
+        return 0;
+    }
+
+    memmove(unpacker->source, unpacker->pt, len);
+
+    nread = fread(
+            unpacker->source + len,
+            1,
+            funpacker->size - len,
+            funpacker->fp);
+
+    unpacker->pt = unpacker->source;
+    unpacker->end = unpacker->source + len + nread;
+
+    if (ferror(funpacker->fp))
+    {
+        log_error("Cannot read from file");
+        return -1;
+    }
+
+    return 0;
+}
+
 /*
  * Returns a new packer object or NULL in case of an error.
  */
@@ -289,6 +388,20 @@ int qp_packer_extend_fu(qp_packer_t * packer, qp_unpacker_t * unpacker)
     return 0;
 }
 
+/*
+ * Extend packer with data which is already packed, for example a part of
+ * an unpacker.
+ *
+ * Returns 0 if successful; -1 and a SIGNAL is raised in case an error occurred.
+ */
+int qp_packer_extend_mem(qp_packer_t * packer, const char * data, size_t size)
+{
+    QP_RESIZE(size)
+    memcpy(packer->buffer + packer->len, data, size);
+    packer->len += size;
+    return 0;
+}
+
 /*
  * Print qpack content.
  */
@@ -360,6 +473,140 @@ qp_types_t qp_skip_next(qp_unpacker_t * unpacker)
     }
 }
 
+/*
+ * Read an integer or double at 'pt' into 'dest', which has space for eight
+ * bytes. Argument 'pt' is moved to the end of the number.
+ *
+ * Returns QP_INT64 or QP_DOUBLE, or QP_ERR when 'pt' is not at a complete
+ * integer or double.
+ */
+static inline qp_types_t QP_read_number(
+        const char ** pt,
+        const char * end,
+        void * dest)
+{
+    uint8_t tp = (uint8_t) **pt;
+    int64_t i64;
+    size_t sz;
+
+    if (tp < 64)
+    {
+        i64 = (int64_t) tp;
+        memcpy(dest, &i64, sizeof(int64_t));
+        (*pt)++;
+        return QP_INT64;
+    }
+    if (tp < QP_HOOK)
+    {
+        i64 = (int64_t) 63 - tp;
+        memcpy(dest, &i64, sizeof(int64_t));
+        (*pt)++;
+        return QP_INT64;
+    }
+    if (tp >= QP_DOUBLE_N1 && tp <= QP_DOUBLE_1)
+    {
+        double real = (double) (tp - QP_DOUBLE_0);
+        memcpy(dest, &real, sizeof(double));
+        (*pt)++;
+        return QP_DOUBLE;
+    }
+
+    switch (tp)
+    {
+    case QP_INT8:   sz = sizeof(int8_t);    break;
+    case QP_INT16:  sz = sizeof(int16_t);   break;
+    case QP_INT32:  sz = sizeof(int32_t);   break;
+    case QP_INT64:  sz = sizeof(int64_t);   break;
+    case QP_DOUBLE: sz = sizeof(double);    break;
+    default:
+        return QP_ERR;
+    }
+
+    if (*pt + 1 + sz > end)
+    {
+        return QP_ERR;
+    }
+
+    if (tp == QP_DOUBLE)
+    {
+        memcpy(dest, *pt + 1, sizeof(double));
+        *pt += 1 + sizeof(double);
+        return QP_DOUBLE;
+    }
+
+    switch (tp)
+    {
+    case QP_INT8:
+        i64 = (int8_t) (*pt)[1];
+        break;
+    case QP_INT16:
+        {
+            int16_t i16;
+            memcpy(&i16, *pt + 1, sizeof(int16_t));
+            i64 = i16;
+        }
+        break;
+    case QP_INT32:
+        {
+            int32_t i32;
+            memcpy(&i32, *pt + 1, sizeof(int32_t));
+            i64 = i32;
+        }
+        break;
+    default:
+        memcpy(&i64, *pt + 1, sizeof(int64_t));
+    }
+
+    memcpy(dest, &i64, sizeof(int64_t));
+    *pt += 1 + sz;
+    return QP_INT64;
+}
+
+/*
+ * Unpack at most 'n' arrays with an integer followed by an integer or double,
+ * like [ts, value], without returning each object. Each array is written to
+ * 'pairs' as 16 bytes: the integer as int64_t and the value as an int64_t or
+ * double with the type it was packed with.
+ *
+ * Unpacking stops at the first object which is not such an array and the
+ * unpacker is left at the start of this object, so qp_next() can be used to
+ * read it.
+ *
+ * Returns the number of unpacked arrays.
+ */
+size_t qp_unpack_array2_numbers(
+        qp_unpacker_t * unpacker,
+        void * pairs,
+        size_t n)
+{
+    char * dest = (char *) pairs;
+    const char * pt = unpacker->pt;
+    const char * end = unpacker->end;
+    const char * next;
+    size_t i;
+
+    for (i = 0; i < n; i++, dest += 2 * sizeof(int64_t))
+    {
+        /* a complete pair needs at least three bytes */
+        if (pt + 3 > end || (uint8_t) *pt != QP_ARRAY2)
+        {
+            break;
+        }
+
+        next = pt + 1;
+        if (    QP_read_number(&next, end, dest) != QP_INT64 ||
+                next >= end ||
+                QP_read_number(&next, end, dest + sizeof(int64_t)) == QP_ERR)
+        {
+            break;
+        }
+        pt = next;
+    }
+
+    unpacker->pt = (char *) pt;
+    return i;
+}
+
 /*
  * This function will not add more than QPACK_MAX_FMT_SIZE and will still
  * return 0 in case longer strings are parsed.
@@ -447,29 +694,77 @@ int qp_add_raw_term(qp_packer_t * packer, const char * raw, size_t len_raw)
 }
 
 /*
- * Returns 0 if successful; -1 and a SIGNAL is raised in case an error occurred.
+ * Write a double to 'pt' which must have space for at least 9 bytes.
+ *
+ * Returns the number of bytes written.
  */
-int qp_add_double(qp_packer_t * packer, double real)
+static inline size_t QP_put_double(char * pt, double real)
 {
-    QP_RESIZE(9)
     if (real == 0.0)
     {
-        packer->buffer[packer->len++] = QP_DOUBLE_0;
+        *pt = QP_DOUBLE_0;
+        return 1;
     }
-    else if (real == 1.0)
+    if (real == 1.0)
     {
-        packer->buffer[packer->len++] = QP_DOUBLE_1;
+        *pt = QP_DOUBLE_1;
+        return 1;
     }
-    else if (real == -1.0)
+    if (real == -1.0)
     {
-        packer->buffer[packer->len++] = QP_DOUBLE_N1;
+        *pt = QP_DOUBLE_N1;
+        return 1;
     }
-    else
+    *pt = QP_DOUBLE;
+    memcpy(pt + 1, &real, sizeof(double));
+    return 1 + sizeof(double);
+}
+
+/*
+ * Write an integer to 'pt' which must have space for at least 9 bytes. The
+ * smallest type which can hold the integer is used.
+ *
+ * Returns the number of bytes written.
+ */
+static inline size_t QP_put_int64(char * pt, int64_t integer)
+{
+    if (integer >= -60 && integer < 64)
     {
-        packer->buffer[packer->len++] = QP_DOUBLE;
-        memcpy(packer->buffer + packer->len, &real, sizeof(double));
-        packer->len += sizeof(double);
+        *pt = (integer >= 0) ? integer : 63 - integer;
+        return 1;
     }
+    if (integer >= INT8_MIN && integer <= INT8_MAX)
+    {
+        *pt = QP_INT8;
+        pt[1] = (int8_t) integer;
+        return 2;
+    }
+    if (integer >= INT16_MIN && integer <= INT16_MAX)
+    {
+        int16_t i16 = (int16_t) integer;
+        *pt = QP_INT16;
+        memcpy(pt + 1, &i16, sizeof(int16_t));
+        return 1 + sizeof(int16_t);
+    }
+    if (integer >= INT32_MIN && integer <= INT32_MAX)
+    {
+        int32_t i32 = (int32_t) integer;
+        *pt = QP_INT32;
+        memcpy(pt + 1, &i32, sizeof(int32_t));
+        return 1 + sizeof(int32_t);
+    }
+    *pt = QP_INT64;
+    memcpy(pt + 1, &integer, sizeof(int64_t));
+    return 1 + sizeof(int64_t);
+}
+
+/*
+ * Returns 0 if successful; -1 and a SIGNAL is raised in case an error occurred.
+ */
+int qp_add_double(qp_packer_t * packer, double real)
+{
+    QP_RESIZE(9)
+    packer->len += QP_put_double(packer->buffer + packer->len, real);
     return 0;
 }
 
@@ -546,23 +841,78 @@ int qp_add_int32(qp_packer_t * packer, int32_t integer)
  */
 int qp_add_int64(qp_packer_t * packer, int64_t integer)
 {
-    int8_t i8;
-    if ((i8 = (int8_t) integer) == integer)
-        QP_ADD_INT8(packer, i8)
+    QP_RESIZE(9)
+    packer->len += QP_put_int64(packer->buffer + packer->len, integer);
+    return 0;
+}
 
-    int16_t i16;
-    if ((i16 = (int16_t) integer) == integer)
-        QP_ADD_INT16(packer, i16)
+/*
+ * Make room for at least 'size' more bytes so adding objects of up to 'size'
+ * bytes in total does not re-allocate the buffer.
+ *
+ * Returns 0 if successful; -1 and a SIGNAL is raised in case an error occurred.
+ */
+int qp_packer_reserve(qp_packer_t * packer, size_t size)
+{
+    QP_RESIZE(size)
+    return 0;
+}
 
-    int32_t i32;
-    if ((i32 = (int32_t) integer) == integer)
-        QP_ADD_INT32(packer, i32)
+/*
+ * Adds 'n' arrays with two integers. Argument 'pairs' must point to 'n'
+ * pairs of 16 bytes, each pair an int64_t followed by an int64_t, like
+ * [[pair0a, pair0b], [pair1a, pair1b], ...]. The buffer is resized once.
+ *
+ * Returns 0 if successful; -1 and a SIGNAL is raised in case an error occurred.
+ */
+int qp_add_array2_int64(qp_packer_t * packer, const void * pairs, size_t n)
+{
+    const char * src = (const char *) pairs;
+    char * pt;
+    int64_t a, b;
 
+    QP_RESIZE(n * QP_ARRAY2_MAX_SZ)
 
-    QP_RESIZE(9)
-    packer->buffer[packer->len++] = QP_INT64;
-    memcpy(packer->buffer + packer->len, &integer, sizeof(int64_t));
-    packer->len += sizeof(int64_t);
+    pt = packer->buffer + packer->len;
+    for (; n--; src += 2 * sizeof(int64_t))
+    {
+        memcpy(&a, src, sizeof(int64_t));
+        memcpy(&b, src + sizeof(int64_t), sizeof(int64_t));
+        *pt++ = QP_ARRAY2;
+        pt += QP_put_int64(pt, a);
+        pt += QP_put_int64(pt, b);
+    }
+    packer->len = pt - packer->buffer;
+    return 0;
+}
+
+/*
+ * Like qp_add_array2_int64() but the second value of each pair is a double.
+ *
+ * Returns 0 if successful; -1 and a SIGNAL is raised in case an error occurred.
+ */
+int qp_add_array2_int64_double(
+        qp_packer_t * packer,
+        const void * pairs,
+        size_t n)
+{
+    const char * src = (const char *) pairs;
+    char * pt;
+    int64_t a;
+    double b;
+
+    QP_RESIZE(n * QP_ARRAY2_MAX_SZ)
+
+    pt = packer->buffer + packer->len;
+    for (; n--; src += sizeof(int64_t) + sizeof(double))
+    {
+        memcpy(&a, src, sizeof(int64_t));
+        memcpy(&b, src + sizeof(int64_t), sizeof(double));
+        *pt++ = QP_ARRAY2;
+        pt += QP_put_int64(pt, a);
+        pt += QP_put_double(pt, b);
+    }
+    packer->len = pt - packer->buffer;
     return 0;
 }
 
@@ -0,0 +1,710 @@
+/*
+ * replay.c - Replay a capture file against a SiriDB server.
+ *
+ * author       : Jeroen van der Heijden
+ * email        : jeroen@transceptor.technology
+ * copyright    : 2016, Transceptor Technology
+ *
+ * Build with 'make siridb-replay' from the Release folder and run:
+ *
+ *  siridb-replay [-H host] [-p port] [-u user] [-w password] [-d dbname]
+ *                [-s speed] [-t timeout] capture_file
+ *
+ * Each connection in the capture file is replayed on its own connection
+ * and authenticated with the given user and password, since these are not
+ * captured. Connections which were authenticated before capturing started
+ * use the database given with -d, or are skipped without -d. The packages
+ * are sent at the recorded time divided by 'speed', a speed of 0 sends the
+ * packages as fast as possible. The result is written as JSON to stdout.
+ *
+ * changes
+ *  - initial version, 14-10-2016
+ *
+ */
+#include <imap/imap.h>
+#include <inttypes.h>
+#include <logger/logger.h>
+#include <netdb.h>
+#include <qpack/qpack.h>
+#include <siri/net/capture.h>
+#include <siri/net/pkg.h>
+#include <siri/net/protocol.h>
+#include <siri/net/socket.h>
+#include <siri/siri.h>
+#include <siri/version.h>
+#include <slist/slist.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <timeit/timeit.h>
+#include <unistd.h>
+#include <uv.h>
+
+/* number of packages sent before the loop handles the responses */
+#define REPLAY_BATCH 256
+
+enum
+{
+    REPLAY_AUTH,        /* connecting or waiting for the authentication */
+    REPLAY_READY,
+    REPLAY_FAILED
+};
+
+/* Warning: do not change the order! (maps to replay_stats names) */
+enum
+{
+    REPLAY_QUERY,
+    REPLAY_INSERT,
+    REPLAY_END
+};
+
+typedef struct replay_conn_s
+{
+    uint32_t id;
+    uint8_t state;
+    uint8_t reading;    /* the read callback holds a socket reference */
+    uint16_t pid;
+    uv_tcp_t * tcp;
+    slist_t * queue;    /* packages waiting for the authentication */
+    imap_t * sent;      /* pid -> replay_req_t */
+    char * dbname;
+} replay_conn_t;
+
+typedef struct replay_req_s
+{
+    uint64_t ns;
+    int stat;
+} replay_req_t;
+
+typedef struct replay_stat_s
+{
+    const char * name;
+    size_t count;
+    size_t errors;
+    uint64_t total;
+    uint64_t max;
+} replay_stat_t;
+
+static int REPLAY_read(void);
+static void REPLAY_next(void);
+static void REPLAY_on_timer(uv_timer_t * handle);
+static void REPLAY_on_drain(uv_timer_t * handle);
+static void REPLAY_send(uint32_t id, sirinet_pkg_t * pkg);
+static replay_conn_t * REPLAY_conn_new(
+        uint32_t id,
+        const char * dbname,
+        size_t len);
+static void REPLAY_conn_send(replay_conn_t * conn, sirinet_pkg_t * pkg);
+static void REPLAY_conn_fail(replay_conn_t * conn);
+static int REPLAY_conn_close(replay_conn_t * conn, void * args);
+static int REPLAY_conn_free(replay_conn_t * conn);
+static void REPLAY_on_connect(uv_connect_t * req, int status);
+static void REPLAY_on_data(uv_stream_t * client, sirinet_pkg_t * pkg);
+static void REPLAY_check_done(void);
+static void REPLAY_report(uint64_t ns);
+
+static uv_loop_t * loop;
+static uv_timer_t replay_timer;
+static uv_timer_t replay_drain;
+static struct sockaddr_storage replay_addr;
+static imap_t * replay_conns;
+static FILE * replay_fp;
+
+static const char * replay_fn;
+static const char * replay_user = "iris";
+static const char * replay_password = "siri";
+static const char * replay_dbname = NULL;
+static double replay_speed = 1.0;
+static uint64_t replay_timeout = 60;
+
+static uint64_t replay_start;
+static uint64_t replay_max_lag = 0;
+static uint64_t replay_rec_ns;
+static uint32_t replay_rec_conn;
+static sirinet_pkg_t * replay_rec_pkg = NULL;
+static int replay_eof = 0;
+
+static size_t replay_nconns = 0;
+static size_t replay_pending = 0;   /* sent, waiting for a response */
+static size_t replay_queued = 0;    /* waiting for the authentication */
+static size_t replay_skipped = 0;
+static size_t replay_lost = 0;
+
+static replay_stat_t replay_stats[REPLAY_END] = {
+        {.name="query"},
+        {.name="insert"}
+};
+
+int main(int argc, char * argv[])
+{
+    static siri_cfg_t cfg;      /* zero, packages are not compressed */
+    const char * host = "localhost";
+    const char * port = "9000";
+    char header[SIRINET_CAPTURE_HEADER_SZ];
+    struct addrinfo * res;
+    struct addrinfo hints = {
+            .ai_family=AF_UNSPEC,
+            .ai_socktype=SOCK_STREAM
+    };
+    int opt;
+
+    while ((opt = getopt(argc, argv, "H:p:u:w:d:s:t:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'H': host = optarg; break;
+        case 'p': port = optarg; break;
+        case 'u': replay_user = optarg; break;
+        case 'w': replay_password = optarg; break;
+        case 'd': replay_dbname = optarg; break;
+        case 's': replay_speed = atof(optarg); break;
+        case 't': replay_timeout = strtoull(optarg, NULL, 10); break;
+        default:
+            fprintf(stderr,
+                    "usage: %s [-H host] [-p port] [-u user] [-w password] "
+                    "[-d dbname] [-s speed] [-t timeout] capture_file\n",
+                    argv[0]);
+            return 1;
+        }
+    }
+
+    if (optind + 1 != argc || replay_speed < 0.0)
+    {
+        fprintf(stderr, "Expecting one capture file and a positive speed\n");
+        return 1;
+    }
+
+    replay_fn = argv[optind];
+
+    logger_init(stderr, LOGGER_WARNING);
+    siri.cfg = &cfg;
+
+    replay_fp = fopen(replay_fn, "r");
+    if (replay_fp == NULL)
+    {
+        fprintf(stderr, "Cannot open capture file: '%s'\n", replay_fn);
+        return 1;
+    }
+
+    if (    fread(header, sizeof(header), 1, replay_fp) != 1 ||
+            memcmp(header, SIRINET_CAPTURE_MAGIC, SIRINET_CAPTURE_MAGIC_SZ) ||
+            header[SIRINET_CAPTURE_MAGIC_SZ] != SIRINET_CAPTURE_VERSION)
+    {
+        fprintf(stderr, "Not a valid capture file: '%s'\n", replay_fn);
+        fclose(replay_fp);
+        return 1;
+    }
+
+    if (getaddrinfo(host, port, &hints, &res))
+    {
+        fprintf(stderr, "Cannot resolve: '%s:%s'\n", host, port);
+        fclose(replay_fp);
+        return 1;
+    }
+    memcpy(&replay_addr, res->ai_addr, res->ai_addrlen);
+    freeaddrinfo(res);
+
+    replay_conns = imap_new();
+    if (replay_conns == NULL)
+    {
+        fprintf(stderr, "Memory allocation error\n");
+        fclose(replay_fp);
+        return 1;
+    }
+
+    loop = uv_default_loop();
+    uv_timer_init(loop, &replay_timer);
+    uv_timer_init(loop, &replay_drain);
+
+    replay_start = timeit_ns();
+
+    REPLAY_read();
+    REPLAY_next();
+    uv_run(loop, UV_RUN_DEFAULT);
+
+    REPLAY_report(timeit_ns() - replay_start);
+
+    uv_loop_close(loop);
+    imap_free(replay_conns, (imap_free_cb) REPLAY_conn_free);
+    free(replay_rec_pkg);
+    fclose(replay_fp);
+
+    return replay_lost ? 2 : 0;
+}
+
+/*
+ * Read the next record into replay_rec_*.
+ *
+ * Returns 0 if successful or -1 at the end of the file.
+ */
+static int REPLAY_read(void)
+{
+    char rec[SIRINET_CAPTURE_REC_SZ];
+    sirinet_pkg_t tmp;
+    char * pt = rec;
+    size_t n = fread(rec, 1, sizeof(rec), replay_fp);
+
+    replay_rec_pkg = NULL;
+
+    if (n != sizeof(rec))
+    {
+        if (n)
+        {
+            log_warning("Capture file is truncated, last record is skipped");
+        }
+        return -1;
+    }
+
+    memcpy(&replay_rec_ns, pt, sizeof(uint64_t));
+    pt += sizeof(uint64_t);
+    memcpy(&replay_rec_conn, pt, sizeof(uint32_t));
+    pt += sizeof(uint32_t);
+    memcpy(&tmp, pt, sizeof(sirinet_pkg_t));
+
+    replay_rec_pkg = (sirinet_pkg_t *) malloc(sizeof(sirinet_pkg_t) + tmp.len);
+    if (replay_rec_pkg == NULL)
+    {
+        log_critical("Memory allocation error");
+        return -1;
+    }
+
+    memcpy(replay_rec_pkg, &tmp, sizeof(sirinet_pkg_t));
+
+    if (tmp.len && fread(replay_rec_pkg->data, tmp.len, 1, replay_fp) != 1)
+    {
+        log_warning("Capture file is truncated, last record is skipped");
+        free(replay_rec_pkg);
+        replay_rec_pkg = NULL;
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Send the records which are due and start the timer for the next record.
+ */
+static void REPLAY_next(void)
+{
+    uint64_t due, now;
+
+    for (size_t n = 0; replay_rec_pkg != NULL; n++)
+    {
+        due = replay_speed > 0.0 ?
+                (uint64_t) (replay_rec_ns / replay_speed) : 0;
+        now = timeit_ns() - replay_start;
+
+        if (due > now + 1000000 || n == REPLAY_BATCH)
+        {
+            uv_timer_start(
+                    &replay_timer,
+                    REPLAY_on_timer,
+                    due > now ? (due - now) / 1000000 : 0,
+                    0);
+            return;
+        }
+
+        if (now > due && now - due > replay_max_lag)
+        {
+            replay_max_lag = now - due;
+        }
+
+        REPLAY_send(replay_rec_conn, replay_rec_pkg);
+        REPLAY_read();
+    }
+
+    replay_eof = 1;
+    uv_close((uv_handle_t *) &replay_timer, NULL);
+    uv_timer_start(&replay_drain, REPLAY_on_drain, replay_timeout * 1000, 0);
+    REPLAY_check_done();
+}
+
+static void REPLAY_on_timer(uv_timer_t * handle __attribute__((unused)))
+{
+    REPLAY_next();
+}
+
+/*
+ * Called when the responses did not arrive within the timeout.
+ */
+static void REPLAY_on_drain(uv_timer_t * handle __attribute__((unused)))
+{
+    log_warning(
+            "No response received for %zu request(s) within %" PRIu64
+            " seconds",
+            replay_pending + replay_queued,
+            replay_timeout);
+    replay_lost = replay_pending + replay_queued;
+    replay_pending = replay_queued = 0;
+    REPLAY_check_done();
+}
+
+/*
+ * Send or queue a captured package. The package is freed.
+ */
+static void REPLAY_send(uint32_t id, sirinet_pkg_t * pkg)
+{
+    replay_conn_t * conn = (replay_conn_t *) imap_get(replay_conns, id);
+
+    if (pkg->tp == CPROTO_REQ_AUTH)
+    {
+        if (conn == NULL)
+        {
+            REPLAY_conn_new(id, pkg->data, pkg->len);
+        }
+        free(pkg);
+        return;
+    }
+
+    if (conn == NULL && replay_dbname != NULL)
+    {
+        conn = REPLAY_conn_new(id, replay_dbname, strlen(replay_dbname));
+    }
+
+    if (conn == NULL || conn->state == REPLAY_FAILED)
+    {
+        replay_skipped++;
+        free(pkg);
+    }
+    else if (conn->state == REPLAY_READY)
+    {
+        REPLAY_conn_send(conn, pkg);
+    }
+    else if (slist_append_safe(&conn->queue, pkg) == 0)
+    {
+        replay_queued++;
+    }
+    else
+    {
+        replay_skipped++;
+        free(pkg);
+    }
+}
+
+/*
+ * Returns a new connection which is connecting to the server, or NULL in
+ * case of an error.
+ */
+static replay_conn_t * REPLAY_conn_new(
+        uint32_t id,
+        const char * dbname,
+        size_t len)
+{
+    replay_conn_t * conn = (replay_conn_t *) malloc(sizeof(replay_conn_t));
+    uv_connect_t * req = (uv_connect_t *) malloc(sizeof(uv_connect_t));
+
+    if (conn == NULL || req == NULL)
+    {
+        free(conn);
+        free(req);
+        return NULL;
+    }
+
+    conn->id = id;
+    conn->state = REPLAY_AUTH;
+    conn->reading = 0;
+    conn->pid = 0;
+    conn->queue = slist_new(SLIST_DEFAULT_SIZE);
+    conn->sent = imap_new();
+    conn->dbname = strndup(dbname, len);
+    conn->tcp = sirinet_socket_new(SOCKET_CLIENT, REPLAY_on_data);
+
+    if (    conn->queue == NULL ||
+            conn->sent == NULL ||
+            conn->dbname == NULL ||
+            conn->tcp == NULL ||
+            imap_add(replay_conns, id, conn))
+    {
+        free(req);
+        if (conn->tcp != NULL)
+        {
+            /* the socket was not initialized */
+            free(conn->tcp->data);
+            conn->tcp = NULL;
+        }
+        REPLAY_conn_free(conn);
+        return NULL;
+    }
+
+    /* responses are matched to the connection by this id */
+    ((sirinet_socket_t *) conn->tcp->data)->capture_id = id;
+
+    replay_nconns++;
+    uv_tcp_init(loop, conn->tcp);
+    req->data = conn;
+    uv_tcp_connect(
+            req,
+            conn->tcp,
+            (const struct sockaddr *) &replay_addr,
+            REPLAY_on_connect);
+
+    return conn;
+}
+
+/*
+ * Send a package on an authenticated connection. The package is freed.
+ */
+static void REPLAY_conn_send(replay_conn_t * conn, sirinet_pkg_t * pkg)
+{
+    replay_req_t * req = (replay_req_t *) malloc(sizeof(replay_req_t));
+
+    if (req == NULL)
+    {
+        replay_skipped++;
+        free(pkg);
+        return;
+    }
+
+    /* pid 0 is used for the authentication request */
+    if (!++conn->pid)
+    {
+        conn->pid = 1;
+    }
+
+    req->ns = timeit_ns();
+    req->stat = (
+            pkg->tp == CPROTO_REQ_INSERT ||
+            pkg->tp == CPROTO_REQ_INSERT_COLUMNS) ?
+                    REPLAY_INSERT : REPLAY_QUERY;
+
+    /* a request without a response after the pid has wrapped is lost */
+    free(imap_pop(conn->sent, conn->pid));
+    if (imap_add(conn->sent, conn->pid, req))
+    {
+        free(req);
+        free(pkg);
+        replay_skipped++;
+        return;
+    }
+
+    pkg->pid = conn->pid;
+    replay_pending++;
+    sirinet_pkg_send((uv_stream_t *) conn->tcp, pkg);
+}
+
+/*
+ * Skip the queued packages of a connection which cannot be used.
+ */
+static void REPLAY_conn_fail(replay_conn_t * conn)
+{
+    conn->state = REPLAY_FAILED;
+    replay_skipped += conn->queue->len;
+    replay_queued -= conn->queue->len;
+
+    for (size_t i = 0; i < conn->queue->len; i++)
+    {
+        free(conn->queue->data[i]);
+    }
+    conn->queue->len = 0;
+
+    REPLAY_check_done();
+}
+
+static int REPLAY_conn_close(
+        replay_conn_t * conn,
+        void * args __attribute__((unused)))
+{
+    sirinet_socket_t * ssocket;
+
+    if (conn->tcp == NULL)
+    {
+        return 0;
+    }
+
+    ssocket = (sirinet_socket_t *) conn->tcp->data;
+
+    /* on_data is NULL when the read callback has released its reference */
+    if (conn->reading && ssocket->on_data != NULL)
+    {
+        ssocket->on_data = NULL;
+        uv_read_stop((uv_stream_t *) conn->tcp);
+        sirinet_socket_decref(conn->tcp);
+    }
+
+    sirinet_socket_decref(conn->tcp);
+    conn->tcp = NULL;
+    return 0;
+}
+
+static int REPLAY_conn_free(replay_conn_t * conn)
+{
+    if (conn->queue != NULL)
+    {
+        for (size_t i = 0; i < conn->queue->len; i++)
+        {
+            free(conn->queue->data[i]);
+        }
+        slist_free(conn->queue);
+    }
+    if (conn->sent != NULL)
+    {
+        imap_free(conn->sent, (imap_free_cb) free);
+    }
+    free(conn->dbname);
+    free(conn);
+    return 0;
+}
+
+/*
+ * Send the authentication request when connected.
+ */
+static void REPLAY_on_connect(uv_connect_t * req, int status)
+{
+    replay_conn_t * conn = (replay_conn_t *) req->data;
+    qp_packer_t * packer;
+
+    free(req);
+
+    if (status)
+    {
+        log_error(
+                "Connection %" PRIu32 " failed: %s",
+                conn->id,
+                uv_strerror(status));
+        REPLAY_conn_close(conn, NULL);
+        REPLAY_conn_fail(conn);
+        return;
+    }
+
+    /* a closed connection is detected without a dangling socket */
+    sirinet_socket_incref(conn->tcp);
+    conn->reading = 1;
+    uv_read_start(
+            (uv_stream_t *) conn->tcp,
+            sirinet_socket_alloc_buffer,
+            sirinet_socket_on_data);
+
+    packer = sirinet_packer_new(512);
+    if (packer == NULL)
+    {
+        REPLAY_conn_fail(conn);
+        return;
+    }
+
+    if (    qp_add_type(packer, QP_ARRAY3) ||
+            qp_add_string(packer, replay_user) ||
+            qp_add_string(packer, replay_password) ||
+            qp_add_string(packer, conn->dbname))
+    {
+        qp_packer_free(packer);
+        REPLAY_conn_fail(conn);
+        return;
+    }
+
+    sirinet_pkg_send(
+            (uv_stream_t *) conn->tcp,
+            sirinet_packer2pkg(packer, 0, CPROTO_REQ_AUTH));
+}
+
+static void REPLAY_on_data(uv_stream_t * client, sirinet_pkg_t * pkg)
+{
+    uint32_t id = ((sirinet_socket_t *) client->data)->capture_id;
+    replay_conn_t * conn = (replay_conn_t *) imap_get(replay_conns, id);
+    replay_req_t * req;
+    replay_stat_t * stat;
+    uint64_t ns;
+
+    if (conn == NULL)
+    {
+        return;
+    }
+
+    if (conn->state == REPLAY_AUTH)
+    {
+        if (pkg->tp != CPROTO_RES_AUTH_SUCCESS)
+        {
+            log_error(
+                    "Authentication for connection %" PRIu32 " on database "
+                    "'%s' failed (%s)",
+                    conn->id,
+                    conn->dbname,
+                    sirinet_cproto_server_str(pkg->tp));
+            REPLAY_conn_fail(conn);
+            return;
+        }
+
+        conn->state = REPLAY_READY;
+        replay_queued -= conn->queue->len;
+
+        for (size_t i = 0; i < conn->queue->len; i++)
+        {
+            REPLAY_conn_send(conn, conn->queue->data[i]);
+        }
+        conn->queue->len = 0;
+        return;
+    }
+
+    /* streamed query parts are followed by the final response */
+    if (pkg->tp == CPROTO_RES_QUERY_PART)
+    {
+        return;
+    }
+
+    req = (replay_req_t *) imap_pop(conn->sent, pkg->pid);
+    if (req == NULL)
+    {
+        return;
+    }
+
+    ns = timeit_ns() - req->ns;
+    stat = replay_stats + req->stat;
+    stat->count++;
+    stat->total += ns;
+    stat->errors += pkg->tp >= CPROTO_ERR_MSG;
+    if (ns > stat->max)
+    {
+        stat->max = ns;
+    }
+
+    free(req);
+
+    if (replay_pending)
+    {
+        replay_pending--;
+    }
+
+    REPLAY_check_done();
+}
+
+/*
+ * Close the connections when all records are sent and answered.
+ */
+static void REPLAY_check_done(void)
+{
+    if (replay_eof && !replay_pending && !replay_queued)
+    {
+        uv_close((uv_handle_t *) &replay_drain, NULL);
+        imap_walk(replay_conns, (imap_cb) REPLAY_conn_close, NULL);
+        replay_eof = 0;     /* only close once */
+    }
+}
+
+static void REPLAY_report(uint64_t ns)
+{
+    printf("{\"version\": \"%s\", \"file\": \"%s\", \"speed\": %.3f, "
+            "\"ms\": %.3f, \"connections\": %zu, \"skipped\": %zu, "
+            "\"lost\": %zu, \"max_lag_ms\": %.3f, \"requests\": [",
+            SIRIDB_VERSION,
+            replay_fn,
+            replay_speed,
+            ns / 1e6,
+            replay_nconns,
+            replay_skipped,
+            replay_lost,
+            replay_max_lag / 1e6);
+
+    for (int i = 0; i < REPLAY_END; i++)
+    {
+        replay_stat_t * stat = replay_stats + i;
+        printf("%s\n    {\"name\": \"%s\", \"count\": %zu, \"errors\": %zu, "
+                "\"avg_ms\": %.3f, \"max_ms\": %.3f}",
+                i ? "," : "",
+                stat->name,
+                stat->count,
+                stat->errors,
+                stat->count ? stat->total / 1e6 / stat->count : 0.0,
+                stat->max / 1e6);
+    }
+
+    printf("\n]}\n");
+}
@@ -25,8 +25,14 @@
 #define CLIENT_REQUEST_TIMEOUT 15000
 #define CLIENT_FLAGS_TIMEOUT 1
 #define CLIENT_FLAGS_NO_ROLLBACK 2
+#define CLIENT_FLAGS_ERR 4
 #define MAX_VERSION_LEN 12
 
+/*
+ * The requests from status up to the database file are sent at once after
+ * authentication, using the request as pid, and are handled in this order
+ * when all responses are received.
+ */
 enum
 {
     CLIENT_REQUEST_INIT,
@@ -63,22 +69,26 @@ static void CLIENT_on_error_msg(
         siri_admin_client_t * adm_client,
         sirinet_pkg_t * pkg);
 static void CLIENT_on_register_server(siri_admin_client_t * adm_client);
+static void CLIENT_on_response(
+        siri_admin_client_t * adm_client,
+        sirinet_pkg_t * pkg);
+static sirinet_pkg_t * CLIENT_request_pkg(int request);
 static void CLIENT_on_file_database(
         siri_admin_client_t * adm_client,
         sirinet_pkg_t * pkg);
-static void CLIENT_on_file_servers(
+static int CLIENT_on_file_servers(
         siri_admin_client_t * adm_client,
         sirinet_pkg_t * pkg);
-static void CLIENT_on_file_groups(
+static int CLIENT_on_file_groups(
         siri_admin_client_t * adm_client,
         sirinet_pkg_t * pkg);
-static void CLIENT_on_file_users(
+static int CLIENT_on_file_users(
         siri_admin_client_t * adm_client,
         sirinet_pkg_t * pkg);
-static void CLIENT_on_request_pools(
+static int CLIENT_on_request_pools(
         siri_admin_client_t * adm_client,
         sirinet_pkg_t * pkg);
-static void CLIENT_on_request_status(
+static int CLIENT_on_request_status(
         siri_admin_client_t * adm_client,
         sirinet_pkg_t * pkg);
 
@@ -139,6 +149,8 @@ int siri_admin_client_request(
     adm_client->client = client;
     adm_client->request = CLIENT_REQUEST_INIT;
     adm_client->flags = 0;
+    adm_client->pending = 0;
+    memset(adm_client->responses, 0, sizeof(adm_client->responses));
     adm_client->pool = pool;
     memcpy(&adm_client->uuid, uuid, 16);
 
@@ -233,6 +245,10 @@ void siri_admin_client_free(siri_admin_client_t * adm_client)
         free(adm_client->password);
         free(adm_client->dbname);
         free(adm_client->dbpath);
+        for (int i = 0; i < SIRI_ADMIN_CLIENT_REQUESTS; i++)
+        {
+            free(adm_client->responses[i]);
+        }
         free(adm_client);
     }
 }
@@ -358,6 +374,9 @@ static void CLIENT_err(
 
     log_error(err_msg);
 
+    /* other requests in progress are cancelled */
+    adm_client->flags |= CLIENT_FLAGS_ERR;
+
     if (~adm_client->flags & CLIENT_FLAGS_NO_ROLLBACK)
     {
         siri_admin_request_rollback(adm_client->dbpath);
@@ -371,8 +390,8 @@ static void CLIENT_err(
 /*
  * Send a package to the 'other' SiriDB server. This function can be used for
  * sending api requests for all database information required to create the
- * database. Note that all packages are send with the same pid so packages
- * should be send in sequence, not parallel.
+ * database. Packages can be sent without waiting for a response when each
+ * package has its own pid. The timeout is restarted for each package.
  *
  * Note: pkg will be freed by calling this function.
  */
@@ -385,10 +404,9 @@ static void CLIENT_send_pkg(
     {
         free(pkg);
         CLIENT_err(adm_client, "memory allocation error");
+        return;
     }
-    req->data = adm_client;
-
-    adm_client->pkg = pkg;
+    req->data = pkg;
 
     /* set the correct check bit */
     pkg->checkbit = pkg->tp ^ 255;
@@ -418,15 +436,17 @@ static void CLIENT_send_pkg(
  */
 static void CLIENT_write_cb(uv_write_t * req, int status)
 {
-    siri_admin_client_t * adm_client = (siri_admin_client_t *)  req->data;
+    sirinet_socket_t * ssocket = req->handle->data;
+    siri_admin_client_t * adm_client = (siri_admin_client_t *) ssocket->origin;
 
-    if (status)
+    /* only the first error is reported, other writes are cancelled */
+    if (status && (~adm_client->flags & CLIENT_FLAGS_ERR))
     {
         uv_timer_stop(&siri.timer);
         CLIENT_err(adm_client, "socket write error: %s", uv_strerror(status));
     }
 
-    free(adm_client->pkg);
+    free(req->data);
     free(req);
 }
 
@@ -506,6 +526,10 @@ static void CLIENT_on_data(uv_stream_t * client, sirinet_pkg_t * pkg)
     {
         log_error("Client response received which was timed-out earlier");
     }
+    else if (adm_client->flags & CLIENT_FLAGS_ERR)
+    {
+        log_debug("Client response received after an error, skip");
+    }
     else
     {
         uv_timer_stop(&siri.timer);
@@ -516,36 +540,8 @@ static void CLIENT_on_data(uv_stream_t * client, sirinet_pkg_t * pkg)
             CLIENT_on_auth_success(adm_client);
             break;
         case CPROTO_RES_QUERY:
-            switch (adm_client->request)
-            {
-            case CLIENT_REQUEST_STATUS:
-                CLIENT_on_request_status(adm_client, pkg);
-                break;
-            case CLIENT_REQUEST_POOLS:
-                CLIENT_on_request_pools(adm_client, pkg);
-                break;
-            default:
-                CLIENT_err(adm_client, "unexpected query response");
-            }
-            break;
         case CPROTO_RES_FILE:
-            switch (adm_client->request)
-            {
-            case CLIENT_REQUEST_FILE_USERS:
-                CLIENT_on_file_users(adm_client, pkg);
-                break;
-            case CLIENT_REQUEST_FILE_GROUPS:
-                CLIENT_on_file_groups(adm_client, pkg);
-                break;
-            case CLIENT_REQUEST_FILE_SERVERS:
-                CLIENT_on_file_servers(adm_client, pkg);
-                break;
-            case CLIENT_REQUEST_FILE_DATABASE:
-                CLIENT_on_file_database(adm_client, pkg);
-                break;
-            default:
-                CLIENT_err(adm_client, "unexpected query response");
-            }
+            CLIENT_on_response(adm_client, pkg);
             break;
         case CPROTO_RES_ACK:
             switch (adm_client->request)
@@ -708,7 +704,7 @@ static void CLIENT_on_file_database(
 /*
  * Called when servers.dat is received.
  */
-static void CLIENT_on_file_servers(
+static int CLIENT_on_file_servers(
         siri_admin_client_t * adm_client,
         sirinet_pkg_t * pkg)
 {
@@ -723,7 +719,7 @@ static void CLIENT_on_file_servers(
     if (fp == NULL)
     {
         CLIENT_err(adm_client, "cannot write or create file: %s", fn);
-        return;
+        return -1;
     }
 
     qp_unpacker_init(&unpacker, pkg->data, pkg->len);
@@ -735,7 +731,7 @@ static void CLIENT_on_file_servers(
     else if (tp != QP_ARRAY_OPEN)
     {
         CLIENT_err(adm_client, "invalid server status response");
-        return;
+        return -1;
     }
 
     /* schema checking is not required at this moment but can be done here */
@@ -746,7 +742,7 @@ static void CLIENT_on_file_servers(
     if (!qp_is_array(tp))
     {
         CLIENT_err(adm_client, "invalid server status response");
-        return;
+        return -1;
     }
 
     close_num = (tp == QP_ARRAY_OPEN) ? 1 : 0;
@@ -773,27 +769,15 @@ static void CLIENT_on_file_servers(
     if (rc)
     {
         CLIENT_err(adm_client, "cannot write or create file: %s", fn);
+        return -1;
     }
-    else
-    {
-        sirinet_pkg_t * package;
-        adm_client->request = CLIENT_REQUEST_FILE_DATABASE;
-        package = sirinet_pkg_new(0, 0, CPROTO_REQ_FILE_DATABASE, NULL);
-        if (package == NULL)
-        {
-            CLIENT_err(adm_client, "memory allocation error");
-        }
-        else
-        {
-            CLIENT_send_pkg(adm_client, package);
-        }
-    }
+    return 0;
 }
 
 /*
  * Called when groups.dat is received.
  */
-static void CLIENT_on_file_groups(
+static int CLIENT_on_file_groups(
         siri_admin_client_t * adm_client,
         sirinet_pkg_t * pkg)
 {
@@ -801,40 +785,29 @@ static void CLIENT_on_file_groups(
     char fn[strlen(adm_client->dbpath) + 11]; // 11 = strlen("groups.dat") + 1
     sprintf(fn, "%sgroups.dat", adm_client->dbpath);
 
+    int rc;
+
     fp = fopen(fn, "w");
     if (fp == NULL)
     {
         CLIENT_err(adm_client, "cannot write or create file: %s", fn);
+        return -1;
     }
-    else
-    {
-        int rc = fwrite(pkg->data, pkg->len, 1, fp);
 
-        if (fclose(fp) || rc != 1)
-        {
-            CLIENT_err(adm_client, "cannot write data to file: %s", fn);
-        }
-        else
-        {
-            adm_client->request = CLIENT_REQUEST_FILE_SERVERS;
-            sirinet_pkg_t * package =
-                    sirinet_pkg_new(0, 0, CPROTO_REQ_FILE_SERVERS, NULL);
-            if (package == NULL)
-            {
-                CLIENT_err(adm_client, "memory allocation error");
-            }
-            else
-            {
-                CLIENT_send_pkg(adm_client, package);
-            }
-        }
+    rc = fwrite(pkg->data, pkg->len, 1, fp);
+
+    if (fclose(fp) || rc != 1)
+    {
+        CLIENT_err(adm_client, "cannot write data to file: %s", fn);
+        return -1;
     }
+    return 0;
 }
 
 /*
  * Called when users.dat is received.
  */
-static void CLIENT_on_file_users(
+static int CLIENT_on_file_users(
         siri_admin_client_t * adm_client,
         sirinet_pkg_t * pkg)
 {
@@ -842,34 +815,23 @@ static void CLIENT_on_file_users(
     char fn[strlen(adm_client->dbpath) + 10]; // 10 = strlen("users.dat") + 1
     sprintf(fn, "%susers.dat", adm_client->dbpath);
 
+    int rc;
+
     fp = fopen(fn, "w");
     if (fp == NULL)
     {
         CLIENT_err(adm_client, "cannot write or create file: %s", fn);
+        return -1;
     }
-    else
-    {
-        int rc = fwrite(pkg->data, pkg->len, 1, fp);
 
-        if (fclose(fp) || rc != 1)
-        {
-            CLIENT_err(adm_client, "cannot write data to file: %s", fn);
-        }
-        else
-        {
-            adm_client->request = CLIENT_REQUEST_FILE_GROUPS;
-            sirinet_pkg_t * package =
-                    sirinet_pkg_new(0, 0, CPROTO_REQ_FILE_GROUPS, NULL);
-            if (package == NULL)
-            {
-                CLIENT_err(adm_client, "memory allocation error");
-            }
-            else
-            {
-                CLIENT_send_pkg(adm_client, package);
-            }
-        }
+    rc = fwrite(pkg->data, pkg->len, 1, fp);
+
+    if (fclose(fp) || rc != 1)
+    {
+        CLIENT_err(adm_client, "cannot write data to file: %s", fn);
+        return -1;
     }
+    return 0;
 }
 
 /*
@@ -877,7 +839,7 @@ static void CLIENT_on_file_users(
  * This function will check which pool number will be assigned for a new pool
  * or checks if a given pool for a new replica is valid.
  */
-static void CLIENT_on_request_pools(
+static int CLIENT_on_request_pools(
         siri_admin_client_t * adm_client,
         sirinet_pkg_t * pkg)
 {
@@ -892,7 +854,7 @@ static void CLIENT_on_request_pools(
     if (!qp_is_map(qp_next(&unpacker, NULL)))
     {
         CLIENT_err(adm_client, "invalid server status response");
-        return;
+        return -1;
     }
 
     qp_next(&unpacker, &qp_val);
@@ -943,7 +905,7 @@ static void CLIENT_on_request_pools(
                                         " servers",
                                         adm_client->pool,
                                         qp_servers.via.int64);
-                                return;
+                                return -1;
                             }
                             else
                             {
@@ -955,7 +917,7 @@ static void CLIENT_on_request_pools(
                 else
                 {
                     CLIENT_err(adm_client, "invalid server status response");
-                    return;
+                    return -1;
                 }
                 if (qp_next(&unpacker, &qp_val) == QP_ARRAY_CLOSE)
                 {
@@ -970,47 +932,34 @@ static void CLIENT_on_request_pools(
         }
 
         CLIENT_err(adm_client, "invalid server status response");
-        return;
+        return -1;
     }
 
     if (!columns_found)
     {
         CLIENT_err(adm_client, "invalid server status response");
+        return -1;
     }
-    else
-    {
-        sirinet_pkg_t * package;
-
-        if (adm_client->pool < 0)
-        {
-            if (validate_pool == -1)
-            {
-                CLIENT_err(adm_client, "invalid server status response");
-                return;
-            }
-            /* set new correct pool in case we request a new pool */
-            adm_client->pool = validate_pool + 1;
-        }
-        else if (validate_pool == -1)
-        {
-            CLIENT_err(
-                    adm_client,
-                    "pool %d does not exist",
-                    adm_client->pool);
-            return;
-        }
 
-        adm_client->request = CLIENT_REQUEST_FILE_USERS;
-        package = sirinet_pkg_new(0, 0, CPROTO_REQ_FILE_USERS, NULL);
-        if (package == NULL)
-        {
-            CLIENT_err(adm_client, "memory allocation error");
-        }
-        else
+    if (adm_client->pool < 0)
+    {
+        if (validate_pool == -1)
         {
-            CLIENT_send_pkg(adm_client, package);
+            CLIENT_err(adm_client, "invalid server status response");
+            return -1;
         }
+        /* set new correct pool in case we request a new pool */
+        adm_client->pool = validate_pool + 1;
     }
+    else if (validate_pool == -1)
+    {
+        CLIENT_err(
+                adm_client,
+                "pool %d does not exist",
+                adm_client->pool);
+        return -1;
+    }
+    return 0;
 }
 
 /*
@@ -1019,7 +968,7 @@ static void CLIENT_on_request_pools(
  * (this is a pre-check, the final register call does check for all servers
  * to have the running status once more)
  */
-static void CLIENT_on_request_status(
+static int CLIENT_on_request_status(
         siri_admin_client_t * adm_client,
         sirinet_pkg_t * pkg)
 {
@@ -1036,7 +985,7 @@ static void CLIENT_on_request_status(
     if (!qp_is_map(qp_next(&unpacker, NULL)))
     {
         CLIENT_err(adm_client, "invalid server status response");
-        return;
+        return -1;
     }
 
     qp_next(&unpacker, &qp_val);
@@ -1086,7 +1035,7 @@ static void CLIENT_on_request_status(
                                 qp_name.via.raw,
                                 version,
                                 SIRIDB_VERSION);
-                        return;
+                        return -1;
                     }
 
                     if (strncmp(
@@ -1101,14 +1050,14 @@ static void CLIENT_on_request_status(
                                 qp_name.via.raw,
                                 (int) qp_status.len,
                                 qp_status.via.raw);
-                        return;
+                        return -1;
                     }
                     servers_found++;
                 }
                 else
                 {
                     CLIENT_err(adm_client, "invalid server status response");
-                    return;
+                    return -1;
                 }
                 if (qp_next(&unpacker, &qp_val) == QP_ARRAY_CLOSE)
                 {
@@ -1123,32 +1072,15 @@ static void CLIENT_on_request_status(
         }
 
         CLIENT_err(adm_client, "invalid server status response");
-        return;
+        return -1;
     }
 
     if (!servers_found || !columns_found)
     {
         CLIENT_err(adm_client, "invalid server status response");
+        return -1;
     }
-    else
-    {
-        sirinet_pkg_t * package;
-        qp_packer_t * packer = sirinet_packer_new(512);
-        if (packer == NULL)
-        {
-            CLIENT_err(adm_client, "memory allocation error");
-        }
-        else
-        {
-            adm_client->request = CLIENT_REQUEST_POOLS;
-
-            /* no need to check since this will always fit */
-            qp_add_type(packer, QP_ARRAY1);
-            qp_add_string(packer, "list pools pool, servers");
-            package = sirinet_packer2pkg(packer, 0, CPROTO_REQ_QUERY);
-            CLIENT_send_pkg(adm_client, package);
-        }
-    }
+    return 0;
 }
 
 /*
@@ -1190,20 +1122,124 @@ static void CLIENT_on_error_msg(
 static void CLIENT_on_auth_success(siri_admin_client_t * adm_client)
 {
     sirinet_pkg_t * pkg;
-    qp_packer_t * packer = sirinet_packer_new(512);
-    if (packer == NULL)
+    int request;
+
+    /*
+     * All requests are sent without waiting for a response. Each request
+     * uses its own pid so the responses can be collected in any order.
+     */
+    for (request = CLIENT_REQUEST_STATUS;
+         request <= CLIENT_REQUEST_FILE_DATABASE;
+         request++)
     {
-        CLIENT_err(adm_client, "memory allocation error");
+        pkg = CLIENT_request_pkg(request);
+        if (pkg == NULL)
+        {
+            CLIENT_err(adm_client, "memory allocation error");
+            return;
+        }
+        CLIENT_send_pkg(adm_client, pkg);
+        if (adm_client->flags & CLIENT_FLAGS_ERR)
+        {
+            return;
+        }
+        adm_client->pending++;
     }
-    else
-    {
-        adm_client->request = CLIENT_REQUEST_STATUS;
+    adm_client->request = CLIENT_REQUEST_STATUS;
+}
 
+/*
+ * Returns a package for one of the pipelined requests or NULL in case of
+ * an allocation error. The request is used as pid.
+ */
+static sirinet_pkg_t * CLIENT_request_pkg(int request)
+{
+    qp_packer_t * packer;
+
+    switch (request)
+    {
+    case CLIENT_REQUEST_STATUS:
+    case CLIENT_REQUEST_POOLS:
+        packer = sirinet_packer_new(512);
+        if (packer == NULL)
+        {
+            return NULL;
+        }
         /* no need to check since this will always fit */
         qp_add_type(packer, QP_ARRAY1);
-        qp_add_string(packer, "list servers name, status, version");
-        pkg = sirinet_packer2pkg(packer, 0, CPROTO_REQ_QUERY);
-        CLIENT_send_pkg(adm_client, pkg);
+        qp_add_string(packer, (request == CLIENT_REQUEST_STATUS) ?
+                "list servers name, status, version" :
+                "list pools pool, servers");
+        return sirinet_packer2pkg(packer, request, CPROTO_REQ_QUERY);
+    case CLIENT_REQUEST_FILE_USERS:
+        return sirinet_pkg_new(request, 0, CPROTO_REQ_FILE_USERS, NULL);
+    case CLIENT_REQUEST_FILE_GROUPS:
+        return sirinet_pkg_new(request, 0, CPROTO_REQ_FILE_GROUPS, NULL);
+    case CLIENT_REQUEST_FILE_SERVERS:
+        return sirinet_pkg_new(request, 0, CPROTO_REQ_FILE_SERVERS, NULL);
+    case CLIENT_REQUEST_FILE_DATABASE:
+        return sirinet_pkg_new(request, 0, CPROTO_REQ_FILE_DATABASE, NULL);
+    }
+    return NULL;
+}
+
+/*
+ * Called when a response on one of the pipelined requests is received. The
+ * responses are handled in order once all of them are received since for
+ * example the pool is required for writing servers.dat.
+ */
+static void CLIENT_on_response(
+        siri_admin_client_t * adm_client,
+        sirinet_pkg_t * pkg)
+{
+    if (    adm_client->request != CLIENT_REQUEST_STATUS ||
+            pkg->pid < CLIENT_REQUEST_STATUS ||
+            pkg->pid > CLIENT_REQUEST_FILE_DATABASE ||
+            adm_client->responses[pkg->pid] != NULL ||
+            pkg->tp != ((pkg->pid <= CLIENT_REQUEST_POOLS) ?
+                    CPROTO_RES_QUERY : CPROTO_RES_FILE))
+    {
+        CLIENT_err(adm_client, "unexpected query response");
+        return;
+    }
+
+    adm_client->responses[pkg->pid] = sirinet_pkg_dup(pkg);
+    if (adm_client->responses[pkg->pid] == NULL)
+    {
+        CLIENT_err(adm_client, "memory allocation error");
+        return;
+    }
+
+    if (--adm_client->pending)
+    {
+        /* restart the timeout while waiting for the other responses */
+        uv_timer_start(
+                &siri.timer,
+                CLIENT_request_timeout,
+                CLIENT_REQUEST_TIMEOUT,
+                0);
+        return;
+    }
+
+    if (    CLIENT_on_request_status(
+                adm_client,
+                adm_client->responses[CLIENT_REQUEST_STATUS]) == 0 &&
+            CLIENT_on_request_pools(
+                adm_client,
+                adm_client->responses[CLIENT_REQUEST_POOLS]) == 0 &&
+            CLIENT_on_file_users(
+                adm_client,
+                adm_client->responses[CLIENT_REQUEST_FILE_USERS]) == 0 &&
+            CLIENT_on_file_groups(
+                adm_client,
+                adm_client->responses[CLIENT_REQUEST_FILE_GROUPS]) == 0 &&
+            CLIENT_on_file_servers(
+                adm_client,
+                adm_client->responses[CLIENT_REQUEST_FILE_SERVERS]) == 0)
+    {
+        CLIENT_on_file_database(
+                adm_client,
+                adm_client->responses[CLIENT_REQUEST_FILE_DATABASE]);
     }
 }
 
@@ -16,6 +16,7 @@
 #include <siri/siri.h>
 #include <logger/logger.h>
 #include <pcre.h>
+#include <siri/db/re.h>
 #include <lock/lock.h>
 #include <xmath/xmath.h>
 #include <unistd.h>
@@ -24,6 +25,11 @@
 #include <siri/db/buffer.h>
 #include <siri/version.h>
 #include <siri/db/reindex.h>
+#include <siri/db/initsync.h>
+#include <siri/db/replicate.h>
+#include <siri/db/lookup.h>
+#include <siri/mem.h>
+#include <siri/latency.h>
 
 #define DEFAULT_TIME_PRECISION 1
 #define DEFAULT_BUFFER_SIZE 1024
@@ -31,6 +37,7 @@
 #define DEFAULT_DURATION_LOG 86400
 #define DB_CONF_FN "database.conf"
 #define DB_DAT_FN "database.dat"
+#define DBNAME_REGEX "/[a-zA-Z][a-zA-Z0-9-_]{0,18}[a-zA-Z0-9]/"
 #define DEFAULT_CONF \
 "#\n" \
 "# Welcome to the SiriDB configuration file\n" \
@@ -43,15 +50,11 @@
 "# path = <buffer_path>\n"
 
 #define CHECK_DBNAME_AND_CREATE_PATH                                        \
-    pcre_exec_ret = pcre_exec(                                              \
+    pcre_exec_ret = siridb_re_exec(                                         \
             siri.dbname_regex,                                              \
             siri.dbname_regex_extra,                                        \
             qp_dbname.via.raw,                                              \
-            qp_dbname.len,                                                  \
-            0,                                                              \
-            0,                                                              \
-            sub_str_vec,                                                    \
-            2);                                                             \
+            qp_dbname.len);                                                 \
                                                                             \
     if (pcre_exec_ret < 0)                                                  \
     {                                                                       \
@@ -165,9 +168,28 @@ static cproto_server_t ADMIN_on_get_databases(
         qp_unpacker_t * qp_unpacker,
         qp_packer_t ** packaddr,
         char * err_msg);
+static cproto_server_t ADMIN_on_get_memory(
+        qp_unpacker_t * qp_unpacker,
+        qp_packer_t ** packaddr,
+        char * err_msg);
+static cproto_server_t ADMIN_on_get_latency(
+        qp_unpacker_t * qp_unpacker,
+        qp_packer_t ** packaddr,
+        char * err_msg);
+static cproto_server_t ADMIN_on_get_sync(
+        qp_unpacker_t * qp_unpacker,
+        qp_packer_t ** packaddr,
+        char * err_msg);
 static int8_t ADMIN_time_precision(qp_obj_t * qp_time_precision);
+static int8_t ADMIN_pool_hash(qp_obj_t * qp_pool_hash);
 static int64_t ADMIN_duration(qp_obj_t * qp_duration, uint8_t time_precision);
 static int ADMIN_list_databases(siridb_t * siridb, qp_packer_t * packer);
+static int ADMIN_list_sync(siridb_t * siridb, qp_packer_t * packer);
+static int ADMIN_pack_sync(
+        qp_packer_t * packer,
+        long int size,
+        long int start_size,
+        uint64_t start);
 static int ADMIN_find_database(siridb_t * siridb, qp_obj_t * dbname);
 static int ADMIN_list_accounts(
         siri_admin_account_t * account,
@@ -186,32 +208,18 @@ int siri_admin_request_init(void)
             strlen(DB_DAT_FN),
             strlen(REINDEX_FN));
 
-    const char * pcre_error_str;
-    int pcre_error_offset;
-
+    char err_msg[SIRIDB_MAX_SIZE_ERR_MSG];
     pcre * regex;
     pcre_extra * regex_extra;
 
-    regex = pcre_compile(
-                "^[a-zA-Z][a-zA-Z0-9-_]{0,18}[a-zA-Z0-9]$",
-                0,
-                &pcre_error_str,
-                &pcre_error_offset,
-                NULL);
-    if (regex == NULL)
-    {
-        return -1;
-    }
-    regex_extra = pcre_study(regex, 0, &pcre_error_str);
-
-    /* pcre_study() returns NULL for both errors and when it can not
-     * optimize the regex.  The last argument is how one checks for
-     * errors (it is NULL if everything works, and points to an error
-     * string otherwise. */
-    if(pcre_error_str != NULL)
+    if (siridb_re_compile(
+            &regex,
+            &regex_extra,
+            DBNAME_REGEX,
+            strlen(DBNAME_REGEX),
+            err_msg))
     {
-        free(regex_extra);
-        free(regex);
+        log_critical("%s", err_msg);
         return -1;
     }
 
@@ -227,7 +235,7 @@ int siri_admin_request_init(void)
 void siri_admin_request_destroy(void)
 {
     free(siri.dbname_regex);
-    free(siri.dbname_regex_extra);
+    siridb_re_free_extra(siri.dbname_regex_extra);
 }
 
 /*
@@ -274,6 +282,12 @@ cproto_server_t siri_admin_request(
         return ADMIN_on_get_accounts(qp_unpacker, packaddr, err_msg);
     case ADMIN_GET_DATABASES:
         return ADMIN_on_get_databases(qp_unpacker, packaddr, err_msg);
+    case ADMIN_GET_MEMORY:
+        return ADMIN_on_get_memory(qp_unpacker, packaddr, err_msg);
+    case ADMIN_GET_LATENCY:
+        return ADMIN_on_get_latency(qp_unpacker, packaddr, err_msg);
+    case ADMIN_GET_SYNC:
+        return ADMIN_on_get_sync(qp_unpacker, packaddr, err_msg);
     default:
         return CPROTO_ERR_ADMIN_INVALID_REQUEST;
     }
@@ -441,13 +455,13 @@ static cproto_server_t ADMIN_on_new_database(
         qp_time_precision,
         qp_buffer_size,
         qp_duration_num,
-        qp_duration_log;
+        qp_duration_log,
+        qp_pool_hash;
     size_t dbpath_len;
     int pcre_exec_ret;
-    int sub_str_vec[2];
     int rc;
     struct stat st = {0};
-    int8_t time_precision;
+    int8_t time_precision, pool_hash;
     int64_t buffer_size, duration_num, duration_log;
     siridb_t * siridb;
     uuid_t uuid;
@@ -465,6 +479,7 @@ static cproto_server_t ADMIN_on_new_database(
     qp_buffer_size.tp = QP_HOOK;
     qp_duration_num.tp = QP_HOOK;
     qp_duration_log.tp = QP_HOOK;
+    qp_pool_hash.tp = QP_HOOK;
 
     if (!qp_is_map(qp_next(qp_unpacker, NULL)))
     {
@@ -498,6 +513,11 @@ static cproto_server_t ADMIN_on_new_database(
         {
             continue;
         }
+        if (    strncmp(qp_key.via.raw, "pool_hash", qp_key.len) == 0 &&
+                qp_next(qp_unpacker, &qp_pool_hash) == QP_RAW)
+        {
+            continue;
+        }
         return CPROTO_ERR_ADMIN_INVALID_REQUEST;
     }
 
@@ -551,6 +571,19 @@ static cproto_server_t ADMIN_on_new_database(
         return CPROTO_ERR_ADMIN;
     }
 
+    pool_hash = (qp_pool_hash.tp == QP_HOOK) ?
+            SIRIDB_LOOKUP_HASH_SUM : ADMIN_pool_hash(&qp_pool_hash);
+    if (pool_hash == -1)
+    {
+        snprintf(
+                err_msg,
+                SIRI_MAX_SIZE_ERR_MSG,
+                "invalid pool hash: '%.*s' (expecting sum or fnv)",
+                (int) qp_pool_hash.len,
+                qp_pool_hash.via.raw);
+        return CPROTO_ERR_ADMIN;
+    }
+
     buffer_size = (qp_buffer_size.tp == QP_HOOK) ?
             DEFAULT_BUFFER_SIZE : qp_buffer_size.via.int64;
 
@@ -593,6 +626,7 @@ static cproto_server_t ADMIN_on_new_database(
         qp_fadd_double(fp, DEF_DROP_THRESHOLD) ||
         qp_fadd_int64(fp, DEF_SELECT_POINTS_LIMIT) ||
         qp_fadd_int64(fp, DEF_LIST_LIMIT) ||
+        qp_fadd_int8(fp, pool_hash) ||
         qp_fadd_type(fp, QP_ARRAY_CLOSE))
     {
         rc = -1;
@@ -648,7 +682,6 @@ static cproto_server_t ADMIN_on_new_replica_or_pool(
         qp_password;
     size_t dbpath_len;
     int pcre_exec_ret;
-    int sub_str_vec[2];
     int rc;
     struct stat st = {0};
     uint16_t port;
@@ -858,6 +891,87 @@ static cproto_server_t ADMIN_on_get_databases(
     return CPROTO_ERR_ADMIN;
 }
 
+/*
+ * Returns a map with the memory in bytes used by each subsystem.
+ */
+static cproto_server_t ADMIN_on_get_memory(
+        qp_unpacker_t * qp_unpacker __attribute__((unused)),
+        qp_packer_t ** packaddr,
+        char * err_msg)
+{
+    qp_packer_t * packer = sirinet_packer_new(256);
+
+    if (packer != NULL)
+    {
+        if (!siri_mem_pack(packer))
+        {
+            *packaddr = packer;
+            return CPROTO_ACK_ADMIN_DATA;
+        }
+
+        /* error, free packer */
+        qp_packer_free(packer);
+    }
+    sprintf(err_msg, "memory allocation error");
+    return CPROTO_ERR_ADMIN;
+}
+
+/*
+ * Returns a map with the latency percentiles for each request type.
+ */
+static cproto_server_t ADMIN_on_get_latency(
+        qp_unpacker_t * qp_unpacker __attribute__((unused)),
+        qp_packer_t ** packaddr,
+        char * err_msg)
+{
+    qp_packer_t * packer = sirinet_packer_new(1024);
+
+    if (packer != NULL)
+    {
+        if (!siri_latency_pack(packer))
+        {
+            *packaddr = packer;
+            return CPROTO_ACK_ADMIN_DATA;
+        }
+
+        /* error, free packer */
+        qp_packer_free(packer);
+    }
+    sprintf(err_msg, "memory allocation error");
+    return CPROTO_ERR_ADMIN;
+}
+
+/*
+ * Returns a map with the re-index and synchronization progress for each
+ * database. The progress is nil when not in progress.
+ */
+static cproto_server_t ADMIN_on_get_sync(
+        qp_unpacker_t * qp_unpacker __attribute__((unused)),
+        qp_packer_t ** packaddr,
+        char * err_msg)
+{
+    qp_packer_t * packer = sirinet_packer_new(256);
+
+    if (packer != NULL)
+    {
+        qp_add_type(packer, QP_MAP_OPEN);
+
+        if (!llist_walk(
+                siri.siridb_list,
+                (llist_cb) ADMIN_list_sync,
+                packer))
+        {
+            *packaddr = packer;
+            return CPROTO_ACK_ADMIN_DATA;
+        }
+
+        /* error, free packer */
+        qp_packer_free(packer);
+    }
+    sprintf(err_msg, "memory allocation error");
+    return CPROTO_ERR_ADMIN;
+}
+
 void siri_admin_request_rollback(const char * dbpath)
 {
     size_t dbpath_len = strlen(dbpath);
@@ -875,6 +989,22 @@ void siri_admin_request_rollback(const char * dbpath)
     }
 }
 
+static int8_t ADMIN_pool_hash(qp_obj_t * qp_pool_hash)
+{
+    if (qp_pool_hash->len == 3)
+    {
+        if (strncmp(qp_pool_hash->via.raw, "sum", 3) == 0)
+        {
+            return SIRIDB_LOOKUP_HASH_SUM;
+        }
+        if (strncmp(qp_pool_hash->via.raw, "fnv", 3) == 0)
+        {
+            return SIRIDB_LOOKUP_HASH_FNV;
+        }
+    }
+    return -1;
+}
+
 static int8_t ADMIN_time_precision(qp_obj_t * qp_time_precision)
 {
     if (qp_time_precision->tp != QP_RAW)
@@ -934,6 +1064,69 @@ static int ADMIN_list_databases(siridb_t * siridb, qp_packer_t * packer)
     return qp_add_string(packer, siridb->dbname);
 }
 
+static int ADMIN_list_sync(siridb_t * siridb, qp_packer_t * packer)
+{
+    siridb_reindex_t * reindex = siridb->reindex;
+    siridb_initsync_t * initsync = (siridb->replicate == NULL) ?
+            NULL : siridb->replicate->initsync;
+    int rc;
+
+    rc = qp_add_string(packer, siridb->dbname) ||
+         qp_add_type(packer, QP_MAP2) ||
+         qp_add_raw(packer, "reindex", 7);
+
+    if (rc == 0)
+    {
+        rc = (reindex != NULL && reindex->timer != NULL && reindex->size) ?
+                ADMIN_pack_sync(
+                        packer,
+                        reindex->size,
+                        reindex->start_size,
+                        reindex->start) :
+                qp_add_null(packer);
+    }
+
+    if (rc == 0)
+    {
+        rc = qp_add_raw(packer, "initsync", 8) || ((initsync != NULL) ?
+                ADMIN_pack_sync(
+                        packer,
+                        initsync->size,
+                        initsync->start_size,
+                        initsync->start) :
+                qp_add_null(packer));
+    }
+
+    return rc;
+}
+
+/*
+ * Pack the number of series which are not yet processed, the average number
+ * of processed series per second and an estimated number of seconds until
+ * finished, or -1 when nothing is processed yet.
+ */
+static int ADMIN_pack_sync(
+        qp_packer_t * packer,
+        long int size,
+        long int start_size,
+        uint64_t start)
+{
+    int64_t remaining = size / sizeof(uint32_t);
+    int64_t processed = (start_size - size) / (long int) sizeof(uint32_t);
+    uint64_t elapsed = uv_now(siri.loop) - start;
+    double rate = (processed > 0 && elapsed) ?
+            (double) processed * 1000 / elapsed : 0.0;
+
+    return (qp_add_type(packer, QP_MAP3) ||
+            qp_add_raw(packer, "series_remaining", 16) ||
+            qp_add_int64(packer, remaining) ||
+            qp_add_raw(packer, "series_per_second", 17) ||
+            qp_add_double(packer, rate) ||
+            qp_add_raw(packer, "eta", 3) ||
+            qp_add_int64(packer, (rate > 0.0) ?
+                    (int64_t) (remaining / rate) : -1));
+}
+
 static int ADMIN_find_database(siridb_t * siridb, qp_obj_t * dbname)
 {
     return (
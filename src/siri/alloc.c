@@ -0,0 +1,184 @@
+/*
+ * alloc.c - Statistics and purging for the memory allocator.
+ *
+ * author       : Jeroen van der Heijden
+ * email        : jeroen@transceptor.technology
+ * copyright    : 2016, Transceptor Technology
+ *
+ * SiriDB can be linked with jemalloc or mimalloc, see ALLOCATOR in the
+ * makefile, which defines SIRI_JEMALLOC or SIRI_MIMALLOC. Without one of
+ * them, the statistics are read from glibc when available.
+ *
+ * The fragmentation is the part of the active bytes which is not allocated
+ * by the application. Retained bytes are kept by the allocator for re-use
+ * and are returned to the system by siri_alloc_purge(), which is called
+ * from the heart-beat each alloc_purge_interval seconds.
+ *
+ * changes
+ *  - initial version, 14-10-2016
+ *
+ */
+#include <siri/alloc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(SIRI_JEMALLOC)
+#include <jemalloc/jemalloc.h>
+#elif defined(SIRI_MIMALLOC)
+#include <mimalloc.h>
+#elif defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+#define ALLOC_SUMMARY_SZ 256
+
+#ifdef SIRI_JEMALLOC
+static size_t ALLOC_je_size(const char * name);
+#endif
+
+const char * siri_alloc_name(void)
+{
+#if defined(SIRI_JEMALLOC)
+    return "jemalloc";
+#elif defined(SIRI_MIMALLOC)
+    return "mimalloc";
+#elif defined(__GLIBC__)
+    return "glibc";
+#else
+    return "libc";
+#endif
+}
+
+/*
+ * Fill 'stats' with the current allocator statistics. Values which are not
+ * available for the allocator are 0 (zero).
+ */
+void siri_alloc_stats(siri_alloc_stats_t * stats)
+{
+    memset(stats, 0, sizeof(siri_alloc_stats_t));
+
+#if defined(SIRI_JEMALLOC)
+    uint64_t epoch = 1;
+    size_t sz = sizeof(epoch);
+    unsigned int narenas = 0;
+
+    /* jemalloc caches the statistics until the epoch is updated */
+    mallctl("epoch", &epoch, &sz, &epoch, sz);
+
+    stats->allocated = ALLOC_je_size("stats.allocated");
+    stats->active = ALLOC_je_size("stats.active");
+    stats->resident = ALLOC_je_size("stats.resident");
+    stats->mapped = ALLOC_je_size("stats.mapped");
+    stats->retained = ALLOC_je_size("stats.retained");
+
+    sz = sizeof(narenas);
+    if (mallctl("arenas.narenas", &narenas, &sz, NULL, 0) == 0)
+    {
+        stats->arenas = narenas;
+    }
+#elif defined(SIRI_MIMALLOC)
+    size_t elapsed, user, system, peak_rss, peak_commit, faults;
+
+    /* mimalloc does not count the allocated bytes without MI_STAT */
+    mi_process_info(
+            &elapsed,
+            &user,
+            &system,
+            &stats->resident,
+            &peak_rss,
+            &stats->mapped,
+            &peak_commit,
+            &faults);
+#elif defined(__GLIBC__)
+#if __GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33)
+    struct mallinfo2 info = mallinfo2();
+#else
+    struct mallinfo info = mallinfo();
+#endif
+    stats->allocated = (size_t) info.uordblks + (size_t) info.hblkhd;
+    stats->active = (size_t) info.arena + (size_t) info.hblkhd;
+    stats->mapped = stats->active;
+    stats->retained = (size_t) info.fordblks;
+#endif
+}
+
+/*
+ * Returns the fragmentation as a value between 0 and 1, or 0 when the
+ * allocator does not count the allocated bytes.
+ */
+double siri_alloc_fragmentation(const siri_alloc_stats_t * stats)
+{
+    return (stats->allocated && stats->active > stats->allocated) ?
+            (double) (stats->active - stats->allocated) / stats->active : 0.0;
+}
+
+/*
+ * Return memory which is not in use to the system.
+ */
+void siri_alloc_purge(void)
+{
+#if defined(SIRI_JEMALLOC)
+    char name[32];
+#ifdef MALLCTL_ARENAS_ALL
+    snprintf(name, sizeof(name), "arena.%u.purge", MALLCTL_ARENAS_ALL);
+#else
+    unsigned int narenas = 0;
+    size_t sz = sizeof(narenas);
+
+    /* older versions use the number of arenas for all arenas */
+    mallctl("arenas.narenas", &narenas, &sz, NULL, 0);
+    snprintf(name, sizeof(name), "arena.%u.purge", narenas);
+#endif
+    mallctl(name, NULL, NULL, NULL, 0);
+#elif defined(SIRI_MIMALLOC)
+    mi_collect(true);
+#elif defined(__GLIBC__)
+    malloc_trim(0);
+#endif
+}
+
+/*
+ * Returns a summary of the allocator statistics, or NULL in case of an
+ * allocation error.
+ *
+ * The return value must be freed by the caller.
+ */
+char * siri_alloc_summary(void)
+{
+    char * buf = (char *) malloc(ALLOC_SUMMARY_SZ);
+    siri_alloc_stats_t stats;
+
+    if (buf == NULL)
+    {
+        return NULL;
+    }
+
+    siri_alloc_stats(&stats);
+
+    snprintf(
+            buf,
+            ALLOC_SUMMARY_SZ,
+            "%s: allocated=%zu active=%zu resident=%zu mapped=%zu "
+            "retained=%zu arenas=%" PRIu32 " fragmentation=%.2f%%",
+            siri_alloc_name(),
+            stats.allocated,
+            stats.active,
+            stats.resident,
+            stats.mapped,
+            stats.retained,
+            stats.arenas,
+            100.0 * siri_alloc_fragmentation(&stats));
+
+    return buf;
+}
+
+#ifdef SIRI_JEMALLOC
+static size_t ALLOC_je_size(const char * name)
+{
+    size_t value = 0;
+    size_t sz = sizeof(value);
+
+    return mallctl(name, &value, &sz, NULL, 0) ? 0 : value;
+}
+#endif
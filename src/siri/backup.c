@@ -5,27 +5,87 @@
  * email        : jeroen@transceptor.technology
  * copyright    : 2016, Transceptor Technology
  *
+ * Instead of backup mode, a snapshot can be created. Shard files and the
+ * series file are only appended to while they are linked by a snapshot (an
+ * incremental optimize rewrites a linked shard instead of marking chunks as
+ * dead) so these files are hard-linked together with their size. Other
+ * files are small or written in place and are copied. The snapshot is made
+ * from the main thread with the optimize task locked out of the shards, so
+ * the files are the same as after a crash at that moment.
+ *
  * changes
  *  - initial version, 27-09-2016
  *
  */
 #include <assert.h>
+#include <ctree/ctree.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
 #include <logger/logger.h>
 #include <siri/backup.h>
+#include <siri/db/buffer.h>
 #include <siri/db/replicate.h>
+#include <siri/db/series.h>
 #include <siri/db/server.h>
 #include <siri/db/servers.h>
 #include <siri/db/shard.h>
+#include <siri/db/shards.h>
+#include <siri/err.h>
 #include <siri/optimize.h>
 #include <siri/siri.h>
 #include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
 
 uv_timer_t backup;
 
 #define BACKUP_LOOP_TIMEOUT 3000
 
+#define BACKUP_SNAPSHOT_PATH "snapshot/"
+#define BACKUP_SNAPSHOT_NEW "snapshot_/"
+#define BACKUP_SNAPSHOT_OLD "snapshot__/"
+#define BACKUP_MANIFEST_FN "manifest"
+#define BACKUP_LOCK_FN ".lock"
+#define BACKUP_COPY_SZ 65536
+
+typedef struct backup_snapshot_s
+{
+    siridb_t * siridb;
+    FILE * manifest;
+    ct_t * prev;            /* sizes from the previous manifest */
+    char * path;            /* the new snapshot */
+    char * current;         /* the previous snapshot */
+    size_t linked;
+    size_t copied;
+    size_t changed;
+} backup_snapshot_t;
+
 static void BACKUP_cb(uv_timer_t * timer);
 static void BACKUP_walk(siridb_t * siridb, void * args);
+static void BACKUP_flush(siridb_t * siridb);
+static int BACKUP_snapshot_dir(
+        backup_snapshot_t * snap,
+        const char * path,
+        const char * dir);
+static int BACKUP_snapshot_file(
+        backup_snapshot_t * snap,
+        const char * src,
+        const char * rel,
+        int is_append);
+static int BACKUP_is_append(const char * dir, const char * name);
+static int BACKUP_copy(const char * src, const char * dst, off_t * size);
+static ct_t * BACKUP_read_manifest(const char * fn);
+static int BACKUP_removed(
+        const char * key,
+        size_t len,
+        uint64_t * size,
+        backup_snapshot_t * snap);
+static int BACKUP_rmtree(const char * path);
 
 int siri_backup_init(siri_t * siri)
 {
@@ -158,6 +218,177 @@ int siri_backup_disable(siri_t * siri, siridb_t * siridb)
     return rc;
 }
 
+/*
+ * Create a snapshot of the database files in '<dbpath>/snapshot/' together
+ * with a manifest. Each line in the manifest has the state of the file
+ * compared to the previous snapshot ('new', 'changed' or 'same'), the size
+ * and the path relative to the snapshot. Files from the previous snapshot
+ * which no longer exist are listed as 'removed'.
+ *
+ * Hard-linked files may grow after the snapshot is created and must be
+ * restored with the size from the manifest. Replica fifo files are not
+ * included.
+ *
+ * Returns 0 if successful or -1 and an error message is set in case of an
+ * error. This function must be called from the main thread.
+ */
+int siri_backup_snapshot(siridb_t * siridb, char * err_msg)
+{
+    SIRIDB_GET_FN(path, siridb->dbpath, BACKUP_SNAPSHOT_NEW)
+    SIRIDB_GET_FN(current, siridb->dbpath, BACKUP_SNAPSHOT_PATH)
+    SIRIDB_GET_FN(old, siridb->dbpath, BACKUP_SNAPSHOT_OLD)
+    SIRIDB_GET_FN(shards, path, SIRIDB_SHARDS_PATH)
+    SIRIDB_GET_FN(current_fn, current, BACKUP_MANIFEST_FN)
+    SIRIDB_GET_FN(fn, path, BACKUP_MANIFEST_FN)
+    backup_snapshot_t snap = {
+        .siridb=siridb,
+        .manifest=NULL,
+        .prev=NULL,
+        .path=path,
+        .current=current,
+        .linked=0,
+        .copied=0,
+        .changed=0
+    };
+    slist_t * shard_list;
+    int rc;
+
+    /* left-overs from a snapshot which has failed */
+    if (BACKUP_rmtree(path) || BACKUP_rmtree(old))
+    {
+        snprintf(err_msg, SIRIDB_MAX_SIZE_ERR_MSG,
+                "Cannot remove an incomplete snapshot from '%s'",
+                siridb->dbpath);
+        return -1;
+    }
+
+    if (mkdir(path, 0700) || mkdir(shards, 0700))
+    {
+        snprintf(err_msg, SIRIDB_MAX_SIZE_ERR_MSG,
+                "Cannot create snapshot directory '%s'", path);
+        BACKUP_rmtree(path);
+        return -1;
+    }
+
+    if ((snap.manifest = fopen(fn, "w")) == NULL)
+    {
+        snprintf(err_msg, SIRIDB_MAX_SIZE_ERR_MSG,
+                "Cannot create snapshot manifest '%s'", fn);
+        BACKUP_rmtree(path);
+        return -1;
+    }
+
+    snap.prev = BACKUP_read_manifest(current_fn);
+    if (snap.prev == NULL)
+    {
+        sprintf(err_msg, "Memory allocation error.");
+        fclose(snap.manifest);
+        BACKUP_rmtree(path);
+        return -1;
+    }
+
+    fprintf(snap.manifest,
+            "# SiriDB snapshot of database '%s' on server '%s' at %lld\n",
+            siridb->dbname,
+            siridb->server->name,
+            (long long) time(NULL));
+
+    /*
+     * Points and series are only added by the main thread. While we hold
+     * the locks the optimize task cannot write to the shards either.
+     */
+    siri_rwlock_wrlock(&siridb->series_mutex);
+    siri_mutex_lock(&siridb->shards_mutex);
+
+    shard_list = imap_2slist(siridb->shards);
+    if (shard_list == NULL)
+    {
+        ERR_ALLOC
+        rc = -1;
+    }
+    else
+    {
+        for (size_t i = 0; i < shard_list->len; i++)
+        {
+            siridb_shard_t * shard = (siridb_shard_t *) shard_list->data[i];
+
+            if (shard->fp->fp != NULL)
+            {
+                fflush(shard->fp->fp);
+            }
+
+            if (shard->replacing != NULL && shard->replacing->fp->fp != NULL)
+            {
+                fflush(shard->replacing->fp->fp);
+            }
+        }
+        slist_free(shard_list);
+
+        BACKUP_flush(siridb);
+
+        rc = BACKUP_snapshot_dir(&snap, siridb->dbpath, SIRIDB_SHARDS_PATH);
+    }
+
+    siri_mutex_unlock(&siridb->shards_mutex);
+    siri_rwlock_wrunlock(&siridb->series_mutex);
+
+    if (rc == 0)
+    {
+        rc = BACKUP_snapshot_dir(&snap, siridb->dbpath, "");
+    }
+
+    if (rc == 0 && strcmp(siridb->buffer_path, siridb->dbpath))
+    {
+        SIRIDB_GET_FN(buffer_fn, siridb->buffer_path, SIRIDB_BUFFER_FN)
+        rc = BACKUP_snapshot_file(&snap, buffer_fn, SIRIDB_BUFFER_FN, 0);
+    }
+
+    if (rc == 0)
+    {
+        rc = ct_items(snap.prev, (ct_item_cb) BACKUP_removed, &snap);
+    }
+
+    ct_free(snap.prev, free);
+
+    if (fclose(snap.manifest))
+    {
+        rc = -1;
+    }
+
+    if (rc)
+    {
+        snprintf(err_msg, SIRIDB_MAX_SIZE_ERR_MSG,
+                "Cannot write snapshot to '%s'", path);
+        BACKUP_rmtree(path);
+        return -1;
+    }
+
+    /* the previous snapshot is removed once the new one is in place */
+    if (    (rename(current, old) && errno != ENOENT) ||
+            rename(path, current))
+    {
+        snprintf(err_msg, SIRIDB_MAX_SIZE_ERR_MSG,
+                "Cannot move snapshot to '%s'", current);
+        BACKUP_rmtree(path);
+        return -1;
+    }
+
+    if (BACKUP_rmtree(old))
+    {
+        log_warning("Cannot remove the previous snapshot: '%s'", old);
+    }
+
+    log_info(
+            "Snapshot created for database '%s': %zu files linked, "
+            "%zu files copied, %zu new or changed",
+            siridb->dbname,
+            snap.linked,
+            snap.copied,
+            snap.changed);
+
+    return 0;
+}
+
 static void BACKUP_cb(uv_timer_t * timer)
 {
     llist_walk((llist_t *) timer->data, (llist_cb) BACKUP_walk, NULL);
@@ -175,11 +406,7 @@ static void BACKUP_walk(siridb_t * siridb, void * args __attribute__((unused)))
 
     if (siridb->buffer_fp != NULL)
     {
-        if (fclose(siridb->buffer_fp) == 0)
-        {
-            siridb->buffer_fp = NULL;
-        }
-        else
+        if (siridb_buffer_close(siridb))
         {
             log_critical("Cannot close buffer file");
         }
@@ -243,3 +470,346 @@ static void BACKUP_walk(siridb_t * siridb, void * args __attribute__((unused)))
         slist_free(shard_list);
     }
 }
+
+/*
+ * Flush files which are written by the main thread so the snapshot and the
+ * files on disk are the same.
+ */
+static void BACKUP_flush(siridb_t * siridb)
+{
+    if (siridb->buffer_fp != NULL)
+    {
+        fflush(siridb->buffer_fp);
+    }
+
+    if (siridb->dropped_fp != NULL)
+    {
+        fflush(siridb->dropped_fp);
+    }
+
+    if (siridb->store != NULL)
+    {
+        fflush(siridb->store);
+    }
+}
+
+/*
+ * Add the regular files in directory 'dir' of 'path' to the snapshot.
+ *
+ * Returns 0 if successful or -1 in case of an error.
+ */
+static int BACKUP_snapshot_dir(
+        backup_snapshot_t * snap,
+        const char * path,
+        const char * dir)
+{
+    char src[PATH_MAX];
+    char rel[PATH_MAX];
+    struct dirent * entry;
+    struct stat st;
+    DIR * dirp;
+    int rc = 0;
+
+    snprintf(src, PATH_MAX, "%s%s", path, dir);
+
+    if ((dirp = opendir(src)) == NULL)
+    {
+        /* a database without shards has no shards directory */
+        return (errno == ENOENT) ? 0 : -1;
+    }
+
+    while (!rc && (entry = readdir(dirp)) != NULL)
+    {
+        if (    *dir == '\0' &&
+                strcmp(entry->d_name, BACKUP_LOCK_FN) == 0)
+        {
+            continue;
+        }
+
+        if (    snprintf(src, PATH_MAX, "%s%s%s",
+                    path, dir, entry->d_name) >= PATH_MAX ||
+                snprintf(rel, PATH_MAX, "%s%s",
+                    dir, entry->d_name) >= PATH_MAX)
+        {
+            rc = -1;
+            break;
+        }
+
+        /* directories like shards/ and the replica fifo are skipped */
+        if (stat(src, &st) || !S_ISREG(st.st_mode))
+        {
+            continue;
+        }
+
+        rc = BACKUP_snapshot_file(
+                snap,
+                src,
+                rel,
+                BACKUP_is_append(dir, entry->d_name));
+    }
+
+    closedir(dirp);
+
+    return rc;
+}
+
+/*
+ * Link or copy file 'src' to the snapshot as 'rel' and add the file to the
+ * manifest.
+ *
+ * Returns 0 if successful or -1 in case of an error.
+ */
+static int BACKUP_snapshot_file(
+        backup_snapshot_t * snap,
+        const char * src,
+        const char * rel,
+        int is_append)
+{
+    char dst[PATH_MAX];
+    char prev[PATH_MAX];
+    const char * state = "new";
+    struct stat st, prev_st;
+    uint64_t * size;
+    ino_t ino = 0;
+    off_t sz;
+
+    snprintf(dst, PATH_MAX, "%s%s", snap->path, rel);
+
+    if (is_append)
+    {
+        if (link(src, dst) || stat(dst, &st))
+        {
+            log_error("Cannot link '%s' to '%s'", src, dst);
+            return -1;
+        }
+        sz = st.st_size;
+        ino = st.st_ino;
+        snap->linked++;
+    }
+    else
+    {
+        if (BACKUP_copy(src, dst, &sz))
+        {
+            log_error("Cannot copy '%s' to '%s'", src, dst);
+            return -1;
+        }
+        snap->copied++;
+    }
+
+    size = (uint64_t *) ct_pop(snap->prev, rel);
+    if (size != NULL)
+    {
+        snprintf(prev, PATH_MAX, "%s%s", snap->current, rel);
+
+        /* copied files are written in place so they are always changed */
+        state = (   is_append &&
+                    *size == (uint64_t) sz &&
+                    stat(prev, &prev_st) == 0 &&
+                    prev_st.st_ino == ino) ? "same" : "changed";
+        free(size);
+    }
+
+    if (*state != 's')
+    {
+        snap->changed++;
+    }
+
+    return (fprintf(
+            snap->manifest,
+            "%s %" PRIu64 " %s\n",
+            state,
+            (uint64_t) sz,
+            rel) < 0) ? -1 : 0;
+}
+
+/*
+ * Returns 1 when the file is only appended to, and written in place by a
+ * complete rewrite to a new file, or 0 if not.
+ */
+static int BACKUP_is_append(const char * dir, const char * name)
+{
+    size_t len = strlen(name);
+
+    if (*dir == '\0')
+    {
+        return strcmp(name, SIRIDB_SERIES_FN) == 0;
+    }
+
+    /* shard and index files, the optimize checkpoint is written in place */
+    return len > 4 && (
+            strcmp(name + len - 4, ".sdb") == 0 ||
+            strcmp(name + len - 4, ".idx") == 0);
+}
+
+/*
+ * Copy file 'src' to 'dst' and set the size which is copied.
+ *
+ * Returns 0 if successful or -1 in case of an error.
+ */
+static int BACKUP_copy(const char * src, const char * dst, off_t * size)
+{
+    char buf[BACKUP_COPY_SZ];
+    ssize_t n = 0;
+    int fd_src, fd_dst;
+    int rc = 0;
+
+    if ((fd_src = open(src, O_RDONLY)) < 0)
+    {
+        return -1;
+    }
+
+    if ((fd_dst = open(dst, O_WRONLY | O_CREAT | O_TRUNC, 0600)) < 0)
+    {
+        close(fd_src);
+        return -1;
+    }
+
+    *size = 0;
+
+    while ((n = read(fd_src, buf, BACKUP_COPY_SZ)) > 0)
+    {
+        if (write(fd_dst, buf, n) != n)
+        {
+            rc = -1;
+            break;
+        }
+        *size += n;
+    }
+
+    if (n < 0)
+    {
+        rc = -1;
+    }
+
+    close(fd_src);
+
+    return (close(fd_dst) || rc) ? -1 : 0;
+}
+
+/*
+ * Returns the sizes by path from a manifest. The tree is empty when the
+ * manifest does not exist or NULL and a SIGNAL is raised in case of a
+ * memory allocation error.
+ */
+static ct_t * BACKUP_read_manifest(const char * fn)
+{
+    char line[PATH_MAX + 64];
+    char state[16];
+    uint64_t sz, * size;
+    size_t len;
+    FILE * fp;
+    int n;
+    ct_t * ct = ct_new();
+
+    if (ct == NULL)
+    {
+        ERR_ALLOC
+        return NULL;
+    }
+
+    if ((fp = fopen(fn, "r")) == NULL)
+    {
+        return ct;
+    }
+
+    while (fgets(line, sizeof(line), fp) != NULL)
+    {
+        len = strlen(line);
+        if (len && line[len - 1] == '\n')
+        {
+            line[--len] = '\0';
+        }
+
+        if (    *line == '#' ||
+                sscanf(line, "%15s %" SCNu64 " %n", state, &sz, &n) != 2 ||
+                strcmp(state, "removed") == 0)
+        {
+            continue;
+        }
+
+        size = (uint64_t *) malloc(sizeof(uint64_t));
+        if (size == NULL)
+        {
+            ERR_ALLOC
+            ct_free(ct, free);
+            ct = NULL;
+            break;
+        }
+
+        *size = sz;
+
+        if (ct_add(ct, line + n, size))
+        {
+            free(size);
+        }
+    }
+
+    fclose(fp);
+
+    return ct;
+}
+
+/*
+ * Write files from the previous manifest which are not found anymore.
+ * (this function is used in ct_items())
+ */
+static int BACKUP_removed(
+        const char * key,
+        size_t len,
+        uint64_t * size __attribute__((unused)),
+        backup_snapshot_t * snap)
+{
+    snap->changed++;
+
+    return (fprintf(
+            snap->manifest,
+            "removed 0 %.*s\n",
+            (int) len,
+            key) < 0) ? -1 : 0;
+}
+
+/*
+ * Remove a snapshot directory. Only files and directories with files are
+ * expected.
+ *
+ * Returns 0 if successful or when the directory does not exist, or -1 in
+ * case of an error.
+ */
+static int BACKUP_rmtree(const char * path)
+{
+    char fn[PATH_MAX];
+    struct dirent * entry;
+    struct stat st;
+    DIR * dirp;
+    int rc = 0;
+
+    if ((dirp = opendir(path)) == NULL)
+    {
+        return (errno == ENOENT) ? 0 : -1;
+    }
+
+    while ((entry = readdir(dirp)) != NULL)
+    {
+        if (    strcmp(entry->d_name, ".") == 0 ||
+                strcmp(entry->d_name, "..") == 0)
+        {
+            continue;
+        }
+
+        snprintf(fn, PATH_MAX, "%s%s", path, entry->d_name);
+
+        if (stat(fn, &st) == 0 && S_ISDIR(st.st_mode))
+        {
+            strncat(fn, "/", PATH_MAX - strlen(fn) - 1);
+            rc += BACKUP_rmtree(fn);
+        }
+        else
+        {
+            rc += unlink(fn);
+        }
+    }
+
+    closedir(dirp);
+
+    return (rc || rmdir(path)) ? -1 : 0;
+}
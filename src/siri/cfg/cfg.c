@@ -3,6 +3,9 @@
 #include <limits.h>
 #include <logger/logger.h>
 #include <siri/cfg/cfg.h>
+#include <siri/db/series.h>
+#include <siri/db/shard.h>
+#include <siri/fsync.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <strextra/strextra.h>
@@ -20,10 +23,68 @@
 
 static siri_cfg_t siri_cfg = {
         .listen_client_port=9000,
+        .listen_client_socket="",
         .listen_backend_port=9010,
+        .listen_metrics_port=0,
         .heartbeat_interval=30,
         .max_open_files=DEFAULT_OPEN_FILES_LIMIT,
         .optimize_interval=3600,
+        .verify_interval=3600,
+        .optimize_threads=1,
+        .optimize_compact_threshold=25,
+        .optimize_min_chunk_points=200,
+        .optimize_max_chunk_points=3200,
+        .optimize_io_limit=0,
+        .reindex_io_limit=0,
+        .initsync_io_limit=0,
+        .verify_io_limit=10,
+        .background_io_priority=0,
+        .shard_load_threads=4,
+        .select_threads=4,
+        .sched_threads=0,
+        .sched_heavy_threads=2,
+        .sched_numa=0,
+        .insert_threads=1,
+        .insert_window=16,
+        .insert_coalesce_window=0,
+        .max_insert_queue=10000,
+        .max_insert_queue_size=1024,
+        .max_fifo_files=0,
+        .backend_compression_threshold=0,
+        .backend_lanes=2,
+        .select_heavy_points=10000000,
+        .query_timeout=0,
+        .query_hedge_delay=0,
+        .query_step_budget=1000,
+        .query_memory_limit=0,
+        .query_memory_total=0,
+        .slow_query_threshold=0,
+        .slow_query_log_size=64,
+        .slow_query_log="",
+        .capture_max_size=1024,
+        .capture_file="",
+        .async_log_lines=0,
+        .lock_stats=0,
+        .alloc_purge_interval=300,
+        .auth_session_ttl=300,
+        .count_cache_age=0,
+        .cold_shard_age=0,
+        .index_memory_limit=0,
+        .fsync_mode=SIRI_FSYNC_NONE,
+        .fsync_interval=1000,
+        .fsync_bytes=1048576,
+        .buffer_mmap=0,
+        .buffer_hot_log=0,
+        .shard_prealloc_size=1024,
+        .chunk_cache_size=64,
+        .query_cache_size=0,
+        .aggregate_cache_size=0,
+        .match_cache_size=16,
+        .plan_cache_size=1024,
+        .last_points_cache=1,
+        .series_name_index=1,
+        .series_name_separators="",
+        .series_hash_index=0,
         .ip_support=IP_SUPPORT_ALL,
         .server_address="localhost",
         .default_db_path="/var/lib/siridb/"
@@ -43,6 +104,11 @@ static void SIRI_CFG_read_address_port(
 static void SIRI_CFG_read_default_db_path(cfgparser_t * cfgparser);
 static void SIRI_CFG_read_max_open_files(cfgparser_t * cfgparser);
 static void SIRI_CFG_read_ip_support(cfgparser_t * cfgparser);
+static void SIRI_CFG_read_fsync_mode(cfgparser_t * cfgparser);
+static void SIRI_CFG_read_series_name_separators(cfgparser_t * cfgparser);
+static void SIRI_CFG_read_listen_client_socket(cfgparser_t * cfgparser);
+static void SIRI_CFG_read_slow_query_log(cfgparser_t * cfgparser);
+static void SIRI_CFG_read_capture_file(cfgparser_t * cfgparser);
 
 void siri_cfg_init(siri_t * siri)
 {
@@ -80,6 +146,17 @@ void siri_cfg_init(siri_t * siri)
             &tmp);
     siri_cfg.listen_client_port = (uint16_t) tmp;
 
+    SIRI_CFG_read_listen_client_socket(cfgparser);
+
+    tmp = siri_cfg.listen_metrics_port;
+    SIRI_CFG_read_uint(
+            cfgparser,
+            "listen_metrics_port",
+            0,
+            65535,
+            &tmp);
+    siri_cfg.listen_metrics_port = (uint16_t) tmp;
+
     SIRI_CFG_read_uint(
             cfgparser,
             "optimize_interval",
@@ -87,6 +164,408 @@ void siri_cfg_init(siri_t * siri)
             2419200,  /* 4 weeks */
             &siri_cfg.optimize_interval);
 
+    SIRI_CFG_read_uint(
+            cfgparser,
+            "verify_interval",
+            0,
+            2419200,  /* 4 weeks */
+            &siri_cfg.verify_interval);
+
+    tmp = siri_cfg.optimize_threads;
+    SIRI_CFG_read_uint(
+            cfgparser,
+            "optimize_threads",
+            1,
+            64,
+            &tmp);
+    siri_cfg.optimize_threads = (uint16_t) tmp;
+
+    tmp = siri_cfg.optimize_compact_threshold;
+    SIRI_CFG_read_uint(
+            cfgparser,
+            "optimize_compact_threshold",
+            0,
+            100,
+            &tmp);
+    siri_cfg.optimize_compact_threshold = (uint8_t) tmp;
+
+    tmp = siri_cfg.optimize_min_chunk_points;
+    SIRI_CFG_read_uint(
+            cfgparser,
+            "optimize_min_chunk_points",
+            1,
+            SIRIDB_SHARD_MAX_CHUNK_POINTS,
+            &tmp);
+    siri_cfg.optimize_min_chunk_points = (uint16_t) tmp;
+
+    tmp = siri_cfg.optimize_max_chunk_points;
+    SIRI_CFG_read_uint(
+            cfgparser,
+            "optimize_max_chunk_points",
+            1,
+            SIRIDB_SHARD_MAX_CHUNK_POINTS,
+            &tmp);
+    siri_cfg.optimize_max_chunk_points = (uint16_t) tmp;
+
+    SIRI_CFG_read_uint(
+            cfgparser,
+            "optimize_io_limit",
+            0,
+            100000,
+            &siri_cfg.optimize_io_limit);
+
+    SIRI_CFG_read_uint(
+            cfgparser,
+            "reindex_io_limit",
+            0,
+            100000,
+            &siri_cfg.reindex_io_limit);
+
+    SIRI_CFG_read_uint(
+            cfgparser,
+            "initsync_io_limit",
+            0,
+            100000,
+            &siri_cfg.initsync_io_limit);
+
+    SIRI_CFG_read_uint(
+            cfgparser,
+            "verify_io_limit",
+            0,
+            100000,
+            &siri_cfg.verify_io_limit);
+
+    tmp = siri_cfg.background_io_priority;
+    SIRI_CFG_read_uint(
+            cfgparser,
+            "background_io_priority",
+            0,
+            1,
+            &tmp);
+    siri_cfg.background_io_priority = (uint8_t) tmp;
+
+    tmp = siri_cfg.shard_load_threads;
+    SIRI_CFG_read_uint(
+            cfgparser,
+            "shard_load_threads",
+            1,
+            64,
+            &tmp);
+    siri_cfg.shard_load_threads = (uint16_t) tmp;
+
+    tmp = siri_cfg.select_threads;
+    SIRI_CFG_read_uint(
+            cfgparser,
+            "select_threads",
+            1,
+            64,
+            &tmp);
+    siri_cfg.select_threads = (uint16_t) tmp;
+
+    tmp = siri_cfg.sched_threads;
+    SIRI_CFG_read_uint(
+            cfgparser,
+            "sched_threads",
+            0,
+            1024,
+            &tmp);
+    siri_cfg.sched_threads = (uint16_t) tmp;
+
+    tmp = siri_cfg.sched_heavy_threads;
+    SIRI_CFG_read_uint(
+            cfgparser,
+            "sched_heavy_threads",
+            1,
+            128,
+            &tmp);
+    siri_cfg.sched_heavy_threads = (uint16_t) tmp;
+
+    tmp = siri_cfg.sched_numa;
+    SIRI_CFG_read_uint(
+            cfgparser,
+            "sched_numa",
+            0,
+            1,
+            &tmp);
+    siri_cfg.sched_numa = (uint8_t) tmp;
+
+    tmp = siri_cfg.insert_threads;
+    SIRI_CFG_read_uint(
+            cfgparser,
+            "insert_threads",
+            1,
+            64,
+            &tmp);
+    siri_cfg.insert_threads = (uint16_t) tmp;
+
+    tmp = siri_cfg.insert_window;
+    SIRI_CFG_read_uint(
+            cfgparser,
+            "insert_window",
+            0,
+            UINT16_MAX,
+            &tmp);
+    siri_cfg.insert_window = (uint16_t) tmp;
+
+    tmp = siri_cfg.insert_coalesce_window;
+    SIRI_CFG_read_uint(
+            cfgparser,
+            "insert_coalesce_window",
+            0,
+            1000,
+            &tmp);
+    siri_cfg.insert_coalesce_window = (uint16_t) tmp;
+
+    SIRI_CFG_read_uint(
+            cfgparser,
+            "max_insert_queue",
+            0,
+            INT32_MAX,
+            &siri_cfg.max_insert_queue);
+
+    SIRI_CFG_read_uint(
+            cfgparser,
+            "max_insert_queue_size",
+            0,
+            1048576,
+            &siri_cfg.max_insert_queue_size);
+
+    SIRI_CFG_read_uint(
+            cfgparser,
+            "max_fifo_files",
+            0,
+            INT32_MAX,
+            &siri_cfg.max_fifo_files);
+
+    SIRI_CFG_read_uint(
+            cfgparser,
+            "backend_compression_threshold",
+            0,
+            INT32_MAX,
+            &siri_cfg.backend_compression_threshold);
+
+    SIRI_CFG_read_uint(
+            cfgparser,
+            "backend_lanes",
+            1,
+            2,
+            &siri_cfg.backend_lanes);
+
+    SIRI_CFG_read_uint(
+            cfgparser,
+            "select_heavy_points",
+            0,
+            INT32_MAX,
+            &siri_cfg.select_heavy_points);
+
+    SIRI_CFG_read_uint(
+            cfgparser,
+            "query_timeout",
+            0,
+            INT32_MAX,
+            &siri_cfg.query_timeout);
+
+    SIRI_CFG_read_uint(
+            cfgparser,
+            "query_hedge_delay",
+            0,
+            60000,
+            &siri_cfg.query_hedge_delay);
+
+    SIRI_CFG_read_uint(
+            cfgparser,
+            "query_step_budget",
+            0,
+            1000000,  /* 1 second */
+            &siri_cfg.query_step_budget);
+
+    SIRI_CFG_read_uint(
+            cfgparser,
+            "query_memory_limit",
+            0,
+            1048576,  /* 1 TB */
+            &siri_cfg.query_memory_limit);
+
+    SIRI_CFG_read_uint(
+            cfgparser,
+            "query_memory_total",
+            0,
+            1048576,  /* 1 TB */
+            &siri_cfg.query_memory_total);
+
+    SIRI_CFG_read_uint(
+            cfgparser,
+            "slow_query_threshold",
+            0,
+            3600000,  /* 1 hour */
+            &siri_cfg.slow_query_threshold);
+
+    SIRI_CFG_read_uint(
+            cfgparser,
+            "slow_query_log_size",
+            1,
+            4096,
+            &siri_cfg.slow_query_log_size);
+
+    SIRI_CFG_read_uint(
+            cfgparser,
+            "capture_max_size",
+            0,
+            1048576,  /* 1 TB */
+            &siri_cfg.capture_max_size);
+
+    SIRI_CFG_read_uint(
+            cfgparser,
+            "async_log_lines",
+            0,
+            1048576,
+            &siri_cfg.async_log_lines);
+
+    tmp = siri_cfg.lock_stats;
+    SIRI_CFG_read_uint(
+            cfgparser,
+            "lock_stats",
+            0,
+            1,
+            &tmp);
+    siri_cfg.lock_stats = (uint8_t) tmp;
+
+    SIRI_CFG_read_uint(
+            cfgparser,
+            "alloc_purge_interval",
+            0,
+            86400,
+            &siri_cfg.alloc_purge_interval);
+
+    SIRI_CFG_read_uint(
+            cfgparser,
+            "auth_session_ttl",
+            0,
+            86400,
+            &siri_cfg.auth_session_ttl);
+
+    SIRI_CFG_read_uint(
+            cfgparser,
+            "count_cache_age",
+            0,
+            86400,
+            &siri_cfg.count_cache_age);
+
+    SIRI_CFG_read_uint(
+            cfgparser,
+            "cold_shard_age",
+            0,
+            INT32_MAX,
+            &siri_cfg.cold_shard_age);
+
+    SIRI_CFG_read_uint(
+            cfgparser,
+            "index_memory_limit",
+            0,
+            1048576,
+            &siri_cfg.index_memory_limit);
+
+    SIRI_CFG_read_uint(
+            cfgparser,
+            "fsync_interval",
+            1,
+            3600000,  /* 1 hour */
+            &siri_cfg.fsync_interval);
+
+    SIRI_CFG_read_uint(
+            cfgparser,
+            "fsync_bytes",
+            1,
+            INT32_MAX,
+            &siri_cfg.fsync_bytes);
+
+    tmp = siri_cfg.buffer_mmap;
+    SIRI_CFG_read_uint(
+            cfgparser,
+            "buffer_mmap",
+            0,
+            1,
+            &tmp);
+    siri_cfg.buffer_mmap = (uint8_t) tmp;
+
+    tmp = siri_cfg.buffer_hot_log;
+    SIRI_CFG_read_uint(
+            cfgparser,
+            "buffer_hot_log",
+            0,
+            1,
+            &tmp);
+    siri_cfg.buffer_hot_log = (uint8_t) tmp;
+
+    SIRI_CFG_read_uint(
+            cfgparser,
+            "shard_prealloc_size",
+            0,
+            65536,
+            &siri_cfg.shard_prealloc_size);
+
+    SIRI_CFG_read_uint(
+            cfgparser,
+            "chunk_cache_size",
+            0,
+            65536,  /* 64 GB */
+            &siri_cfg.chunk_cache_size);
+
+    SIRI_CFG_read_uint(
+            cfgparser,
+            "query_cache_size",
+            0,
+            65536,  /* 64 GB */
+            &siri_cfg.query_cache_size);
+
+    SIRI_CFG_read_uint(
+            cfgparser,
+            "aggregate_cache_size",
+            0,
+            65536,  /* 64 GB */
+            &siri_cfg.aggregate_cache_size);
+
+    SIRI_CFG_read_uint(
+            cfgparser,
+            "match_cache_size",
+            0,
+            65536,  /* 64 GB */
+            &siri_cfg.match_cache_size);
+
+    SIRI_CFG_read_uint(
+            cfgparser,
+            "plan_cache_size",
+            0,
+            1048576,
+            &siri_cfg.plan_cache_size);
+
+    tmp = siri_cfg.last_points_cache;
+    SIRI_CFG_read_uint(
+            cfgparser,
+            "last_points_cache",
+            0,
+            SIRIDB_SERIES_LAST_MAX,
+            &tmp);
+    siri_cfg.last_points_cache = (uint16_t) tmp;
+
+    tmp = siri_cfg.series_name_index;
+    SIRI_CFG_read_uint(
+            cfgparser,
+            "series_name_index",
+            0,
+            1,
+            &tmp);
+    siri_cfg.series_name_index = (uint8_t) tmp;
+
+    tmp = siri_cfg.series_hash_index;
+    SIRI_CFG_read_uint(
+            cfgparser,
+            "series_hash_index",
+            0,
+            1,
+            &tmp);
+    siri_cfg.series_hash_index = (uint8_t) tmp;
+
     tmp = siri_cfg.heartbeat_interval;
     SIRI_CFG_read_uint(
             cfgparser,
@@ -99,6 +578,10 @@ void siri_cfg_init(siri_t * siri)
     SIRI_CFG_read_default_db_path(cfgparser);
     SIRI_CFG_read_max_open_files(cfgparser);
     SIRI_CFG_read_ip_support(cfgparser);
+    SIRI_CFG_read_fsync_mode(cfgparser);
+    SIRI_CFG_read_series_name_separators(cfgparser);
+    SIRI_CFG_read_slow_query_log(cfgparser);
+    SIRI_CFG_read_capture_file(cfgparser);
 
     cfgparser_free(cfgparser);
 }
@@ -478,3 +961,232 @@ static void SIRI_CFG_read_address_port(
 
     }
 }
+
+static void SIRI_CFG_read_fsync_mode(cfgparser_t * cfgparser)
+{
+    cfgparser_option_t * option;
+    cfgparser_return_t rc;
+    rc = cfgparser_get_option(
+                &option,
+                cfgparser,
+                "siridb",
+                "fsync_mode");
+    if (rc != CFGPARSER_SUCCESS)
+    {
+        log_warning(
+                "Error reading '%s' in '%s': %s. "
+                "Using default value: '%s'",
+                "fsync_mode",
+                siri.args->config,
+                cfgparser_errmsg(rc),
+                siri_fsync_mode_str(siri_cfg.fsync_mode));
+    }
+    else if (option->tp != CFGPARSER_TP_STRING)
+    {
+        log_warning(
+                "Error reading '%s' in '%s': %s. "
+                "Using default value: '%s'",
+                "fsync_mode",
+                siri.args->config,
+                "error: expecting a string value",
+                siri_fsync_mode_str(siri_cfg.fsync_mode));
+    }
+    else
+    {
+        if (strcmp(option->val->string, "NONE") == 0)
+        {
+            siri_cfg.fsync_mode = SIRI_FSYNC_NONE;
+        }
+        else if (strcmp(option->val->string, "INTERVAL") == 0)
+        {
+            siri_cfg.fsync_mode = SIRI_FSYNC_INTERVAL;
+        }
+        else if (strcmp(option->val->string, "BYTES") == 0)
+        {
+            siri_cfg.fsync_mode = SIRI_FSYNC_BYTES;
+        }
+        else
+        {
+            log_warning(
+                    "Error reading '%s' in '%s': "
+                    "error: expecting NONE, INTERVAL or BYTES but got '%s'. "
+                    "Using default value: '%s'",
+                    "fsync_mode",
+                    siri.args->config,
+                    option->val->string,
+                    siri_fsync_mode_str(siri_cfg.fsync_mode));
+        }
+    }
+}
+
+static void SIRI_CFG_read_series_name_separators(cfgparser_t * cfgparser)
+{
+    cfgparser_option_t * option;
+    cfgparser_return_t rc;
+    rc = cfgparser_get_option(
+                &option,
+                cfgparser,
+                "siridb",
+                "series_name_separators");
+    if (rc != CFGPARSER_SUCCESS)
+    {
+        /* the option is not required, the token index is disabled */
+        log_debug(
+                "Option '%s' not found in '%s', the token index is disabled",
+                "series_name_separators",
+                siri.args->config);
+    }
+    else if (option->tp != CFGPARSER_TP_STRING)
+    {
+        log_warning(
+                "Error reading '%s' in '%s': %s. "
+                "The token index is disabled",
+                "series_name_separators",
+                siri.args->config,
+                "error: expecting a string value");
+    }
+    else if (strlen(option->val->string) >= SIRI_CFG_MAX_LEN_SEPARATORS)
+    {
+        log_warning(
+                "Error reading '%s' in '%s': "
+                "error: expecting at most %d characters but got '%s'. "
+                "The token index is disabled",
+                "series_name_separators",
+                siri.args->config,
+                SIRI_CFG_MAX_LEN_SEPARATORS - 1,
+                option->val->string);
+    }
+    else
+    {
+        strcpy(siri_cfg.series_name_separators, option->val->string);
+    }
+}
+
+static void SIRI_CFG_read_listen_client_socket(cfgparser_t * cfgparser)
+{
+    cfgparser_option_t * option;
+    cfgparser_return_t rc;
+    rc = cfgparser_get_option(
+                &option,
+                cfgparser,
+                "siridb",
+                "listen_client_socket");
+    if (rc != CFGPARSER_SUCCESS)
+    {
+        /* the option is not required, only the tcp port is used */
+        log_debug(
+                "Option '%s' not found in '%s', no unix socket is used",
+                "listen_client_socket",
+                siri.args->config);
+    }
+    else if (option->tp != CFGPARSER_TP_STRING)
+    {
+        log_warning(
+                "Error reading '%s' in '%s': %s. "
+                "No unix socket is used",
+                "listen_client_socket",
+                siri.args->config,
+                "error: expecting a string value");
+    }
+    else if (strlen(option->val->string) >= SIRI_CFG_MAX_LEN_SOCKET)
+    {
+        log_warning(
+                "Error reading '%s' in '%s': "
+                "error: expecting at most %d characters but got '%s'. "
+                "No unix socket is used",
+                "listen_client_socket",
+                siri.args->config,
+                SIRI_CFG_MAX_LEN_SOCKET - 1,
+                option->val->string);
+    }
+    else
+    {
+        strcpy(siri_cfg.listen_client_socket, option->val->string);
+    }
+}
+
+static void SIRI_CFG_read_slow_query_log(cfgparser_t * cfgparser)
+{
+    cfgparser_option_t * option;
+    cfgparser_return_t rc;
+    rc = cfgparser_get_option(
+                &option,
+                cfgparser,
+                "siridb",
+                "slow_query_log");
+    if (rc != CFGPARSER_SUCCESS)
+    {
+        /* the option is not required, slow queries use the default log */
+        log_debug(
+                "Option '%s' not found in '%s', slow queries are written to "
+                "the default log",
+                "slow_query_log",
+                siri.args->config);
+    }
+    else if (option->tp != CFGPARSER_TP_STRING)
+    {
+        log_warning(
+                "Error reading '%s' in '%s': %s. "
+                "Slow queries are written to the default log",
+                "slow_query_log",
+                siri.args->config,
+                "error: expecting a string value");
+    }
+    else if (strlen(option->val->string) >= PATH_MAX)
+    {
+        log_warning(
+                "Error reading '%s' in '%s': "
+                "error: expecting at most %d characters. "
+                "Slow queries are written to the default log",
+                "slow_query_log",
+                siri.args->config,
+                PATH_MAX - 1);
+    }
+    else
+    {
+        strcpy(siri_cfg.slow_query_log, option->val->string);
+    }
+}
+
+static void SIRI_CFG_read_capture_file(cfgparser_t * cfgparser)
+{
+    cfgparser_option_t * option;
+    cfgparser_return_t rc;
+    rc = cfgparser_get_option(
+                &option,
+                cfgparser,
+                "siridb",
+                "capture_file");
+    if (rc != CFGPARSER_SUCCESS)
+    {
+        /* the option is not required, capturing is disabled by default */
+        log_debug(
+                "Option '%s' not found in '%s', client packages are not "
+                "captured",
+                "capture_file",
+                siri.args->config);
+    }
+    else if (option->tp != CFGPARSER_TP_STRING)
+    {
+        log_warning(
+                "Error reading '%s' in '%s': %s. "
+                "Client packages are not captured",
+                "capture_file",
+                siri.args->config,
+                "error: expecting a string value");
+    }
+    else if (strlen(option->val->string) >= PATH_MAX)
+    {
+        log_warning(
+                "Error reading '%s' in '%s': "
+                "error: expecting at most %d characters. "
+                "Client packages are not captured",
+                "capture_file",
+                siri.args->config,
+                PATH_MAX - 1);
+    }
+    else
+    {
+        strcpy(siri_cfg.capture_file, option->val->string);
+    }
+}
@@ -0,0 +1,897 @@
+/*
+ * acache.c - Cache for aggregated groups of historical series data.
+ *
+ * author       : Jeroen van der Heijden
+ * email        : jeroen@transceptor.technology
+ * copyright    : 2016, Transceptor Technology
+ *
+ * Dashboards select the same aggregate, for example mean(1h), over a long
+ * range again and again while only the newest groups have changed. This
+ * cache keeps the aggregated groups for each series and aggregate so only
+ * the groups which are not in the cache need to be calculated.
+ *
+ * An entry holds all groups for a range of group time-stamps, groups
+ * without points are simply missing. Only complete groups are cached and
+ * only when all points of the group are older than the buffer of the series
+ * and are not in a shard with new values which still has to be optimized.
+ * New values are written to a shard by siridb_shards_add_points(), this
+ * removes the entries with groups for the new points. Removing points, for
+ * example when a shard is dropped, removes the entries for those points.
+ *
+ * The cache is used by the select workers and is protected by its own mutex.
+ * The entries are written to disk when the database is closed and the file
+ * is removed when loaded, so after a crash the cache starts empty.
+ *
+ * changes
+ *  - initial version, 14-10-2016
+ *
+ */
+#include <logger/logger.h>
+#include <siri/db/acache.h>
+#include <siri/db/db.h>
+#include <siri/db/misc.h>
+#include <siri/db/series.h>
+#include <siri/db/shard.h>
+#include <siri/err.h>
+#include <siri/grammar/grammar.h>
+#include <siri/siri.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <xpath/xpath.h>
+
+#define SIRIDB_ACACHE_FN "acache.dat"
+#define SIRIDB_ACACHE_SCHEMA 1
+
+struct siridb_acache_entry_s
+{
+    uint32_t series_id;
+    uint32_t gid;
+    uint64_t group_by;
+    double percentile;
+    uint64_t lo;                        /* first group time-stamp */
+    uint64_t hi;                        /* last group time-stamp */
+    points_tp tp;
+    size_t len;
+    siridb_point_t * data;              /* groups between lo and hi */
+    siridb_acache_entry_t * prev;       /* towards head (more recent) */
+    siridb_acache_entry_t * next;       /* towards tail (less recent) */
+    siridb_acache_entry_t * hnext;      /* next in bucket */
+};
+
+#define ACACHE_ENTRY_SZ(len) \
+    (sizeof(siridb_acache_entry_t) + (len) * sizeof(siridb_point_t))
+
+#define ACACHE_BUCKET(acache, series_id) \
+    ((acache)->buckets + \
+        (((series_id) * 2654435761U) & (SIRIDB_ACACHE_BUCKETS - 1)))
+
+/* first time-stamp of the points in group 'ts' */
+#define ACACHE_GROUP_START(group_by, ts) ((ts) - (group_by) + 1)
+
+static siridb_acache_entry_t ** ACACHE_find(
+        siridb_acache_t * acache,
+        uint32_t series_id,
+        siridb_aggr_t * aggr);
+static void ACACHE_unlink(
+        siridb_acache_t * acache,
+        siridb_acache_entry_t ** entry);
+static void ACACHE_head(
+        siridb_acache_t * acache,
+        siridb_acache_entry_t * entry);
+static size_t ACACHE_find_ts(
+        const siridb_point_t * data,
+        size_t len,
+        uint64_t ts);
+static int ACACHE_load(siridb_t * siridb);
+static uint64_t ACACHE_stable(siridb_series_t * series);
+static siridb_points_t * ACACHE_read(
+        siridb_t *__restrict siridb,
+        siridb_series_t *__restrict series,
+        siridb_aggr_t *__restrict aggr,
+        uint64_t * start_ts,
+        uint64_t * end_ts,
+        char * err_msg);
+static siridb_points_t * ACACHE_join(
+        siridb_points_t * prefix,
+        siridb_points_t * cached,
+        siridb_points_t * suffix,
+        char * err_msg);
+
+/*
+ * Returns NULL and raises a SIGNAL in case an error has occurred.
+ */
+siridb_acache_t * siridb_acache_new(size_t max_size)
+{
+    siridb_acache_t * acache =
+            (siridb_acache_t *) calloc(1, sizeof(siridb_acache_t));
+    if (acache == NULL)
+    {
+        ERR_ALLOC
+    }
+    else
+    {
+        acache->max_size = max_size;
+        uv_mutex_init(&acache->mutex);
+    }
+    return acache;
+}
+
+void siridb_acache_free(siridb_acache_t * acache)
+{
+    if (acache == NULL)
+    {
+        return;
+    }
+
+    siridb_acache_entry_t * entry = acache->head;
+    siridb_acache_entry_t * next;
+
+    for (; entry != NULL; entry = next)
+    {
+        next = entry->next;
+        free(entry->data);
+        free(entry);
+    }
+
+    uv_mutex_destroy(&acache->mutex);
+    free(acache);
+}
+
+/*
+ * Create the cache when enabled and restore the entries written when the
+ * database was closed. Must be called after the series are loaded. When the
+ * cache is disabled, the file is removed since the entries would be outdated
+ * once the cache is enabled again.
+ *
+ * Returns 0 if successful or -1 in case of an error. A SIGNAL is raised when
+ * the cache cannot be created.
+ */
+int siridb_acache_init(siridb_t * siridb)
+{
+    SIRIDB_GET_FN(fn, siridb->dbpath, SIRIDB_ACACHE_FN)
+
+    if (siri.cfg->aggregate_cache_size)
+    {
+        siridb->acache = siridb_acache_new(
+                (size_t) siri.cfg->aggregate_cache_size * 1024 * 1024);
+        if (siridb->acache == NULL)
+        {
+            return -1;  /* signal is raised */
+        }
+        return ACACHE_load(siridb);
+    }
+
+    if (xpath_file_exist(fn) && unlink(fn))
+    {
+        log_error("Cannot remove file: '%s'", fn);
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Write the entries to disk, the least recently used entries are written
+ * first so those are the first to be removed when restored.
+ *
+ * Returns 0 if successful or EOF in case of an error.
+ */
+int siridb_acache_save(siridb_t * siridb)
+{
+    SIRIDB_GET_FN(fn, siridb->dbpath, SIRIDB_ACACHE_FN)
+    siridb_acache_t * acache = siridb->acache;
+    siridb_acache_entry_t * entry;
+    qp_fpacker_t * fpacker;
+    int rc;
+
+    log_debug("Write aggregate cache to file: '%s'", fn);
+
+    if (    (fpacker = qp_open(fn, "w")) == NULL ||
+            qp_fadd_type(fpacker, QP_ARRAY_OPEN) ||
+            qp_fadd_int16(fpacker, SIRIDB_ACACHE_SCHEMA))
+    {
+        if (fpacker != NULL)
+        {
+            qp_close(fpacker);
+        }
+        return EOF;
+    }
+
+    uv_mutex_lock(&acache->mutex);
+
+    for (rc = 0, entry = acache->tail; !rc && entry; entry = entry->prev)
+    {
+        rc = (
+            qp_fadd_type(fpacker, QP_ARRAY5) ||
+            qp_fadd_int32(fpacker, (int32_t) entry->series_id) ||
+            qp_fadd_type(fpacker, QP_ARRAY4) ||
+            qp_fadd_int32(fpacker, (int32_t) entry->gid) ||
+            qp_fadd_int64(fpacker, (int64_t) entry->group_by) ||
+            qp_fadd_double(fpacker, entry->percentile) ||
+            qp_fadd_int8(fpacker, (int8_t) entry->tp) ||
+            qp_fadd_int64(fpacker, (int64_t) entry->lo) ||
+            qp_fadd_int64(fpacker, (int64_t) entry->hi) ||
+            qp_fadd_raw(
+                    fpacker,
+                    (const char *) entry->data,
+                    entry->len * sizeof(siridb_point_t)));
+    }
+
+    uv_mutex_unlock(&acache->mutex);
+
+    return (qp_close(fpacker) || rc) ? EOF : 0;
+}
+
+/*
+ * Returns 1 (true) when the groups of aggregate 'aggr' can be cached or 0
+ * (false) if not. The aggregate must have a group by and the value of each
+ * group must only depend on the points in the group.
+ */
+int siridb_acache_can_use(siridb_aggr_t * aggr)
+{
+    if (!aggr->group_by || aggr->limit || aggr->offset)
+    {
+        return 0;
+    }
+
+    switch (aggr->gid)
+    {
+    case CLERI_GID_F_COUNT:
+    case CLERI_GID_F_MAX:
+    case CLERI_GID_F_MEAN:
+    case CLERI_GID_F_MEDIAN:
+    case CLERI_GID_F_MEDIAN_HIGH:
+    case CLERI_GID_F_MEDIAN_LOW:
+    case CLERI_GID_F_MIN:
+    case CLERI_GID_F_PERCENTILE:
+    case CLERI_GID_F_PVARIANCE:
+    case CLERI_GID_F_SUM:
+    case CLERI_GID_F_VARIANCE:
+        return 1;
+    }
+
+    return 0;
+}
+
+/*
+ * Returns a copy of the cached groups for series 'series_id' and aggregate
+ * 'aggr' between the group time-stamps 'lo' and 'hi'. On return, 'lo' and
+ * 'hi' are set to the range which is found in the cache. Groups without
+ * points are missing in the result, so the result can be empty.
+ *
+ * Returns NULL when the cache has no groups in the range, or raises a SIGNAL
+ * and returns NULL when allocating memory has failed.
+ */
+siridb_points_t * siridb_acache_get(
+        siridb_acache_t * acache,
+        uint32_t series_id,
+        siridb_aggr_t * aggr,
+        uint64_t * lo,
+        uint64_t * hi)
+{
+    siridb_acache_entry_t * entry;
+    siridb_points_t * points = NULL;
+    size_t start, end;
+
+    uv_mutex_lock(&acache->mutex);
+
+    entry = *ACACHE_find(acache, series_id, aggr);
+
+    if (entry == NULL || entry->lo > *hi || entry->hi < *lo)
+    {
+        acache->misses++;
+        goto done;
+    }
+
+    if (entry->lo > *lo)
+    {
+        *lo = entry->lo;
+    }
+
+    if (entry->hi < *hi)
+    {
+        *hi = entry->hi;
+    }
+
+    start = ACACHE_find_ts(entry->data, entry->len, *lo);
+    end = ACACHE_find_ts(entry->data, entry->len, *hi + 1);
+
+    points = siridb_points_new(end - start, entry->tp);
+    if (points == NULL)
+    {
+        goto done;  /* signal is raised */
+    }
+
+    memcpy(points->data,
+            entry->data + start,
+            (end - start) * sizeof(siridb_point_t));
+    points->len = end - start;
+
+    ACACHE_head(acache, entry);
+    acache->hits++;
+
+done:
+    uv_mutex_unlock(&acache->mutex);
+    return points;
+}
+
+/*
+ * Store the groups of 'points' between the group time-stamps 'lo' and 'hi'
+ * for series 'series_id' and aggregate 'aggr'. The points must be sorted and
+ * remain owned by the caller. An existing entry which overlaps or adjoins the
+ * range is extended, otherwise the range replaces the entry.
+ *
+ * The cache is not critical so when allocating memory fails the groups are
+ * simply not cached.
+ */
+void siridb_acache_set(
+        siridb_acache_t * acache,
+        uint32_t series_id,
+        siridb_aggr_t * aggr,
+        uint64_t lo,
+        uint64_t hi,
+        siridb_points_t * points)
+{
+    siridb_acache_entry_t ** entry, * tmp;
+    siridb_point_t * data;
+    size_t start, end, head = 0, tail = 0, len;
+
+    start = ACACHE_find_ts(points->data, points->len, lo);
+    end = ACACHE_find_ts(points->data, points->len, hi + 1);
+
+    uv_mutex_lock(&acache->mutex);
+
+    entry = ACACHE_find(acache, series_id, aggr);
+    tmp = *entry;
+
+    if (tmp != NULL)
+    {
+        ACACHE_unlink(acache, entry);
+
+        /* keep the groups of the entry outside the given range */
+        if (    tmp->tp == points->tp &&
+                tmp->lo <= hi + aggr->group_by &&
+                tmp->hi + aggr->group_by >= lo)
+        {
+            head = ACACHE_find_ts(tmp->data, tmp->len, lo);
+            tail = tmp->len - ACACHE_find_ts(tmp->data, tmp->len, hi + 1);
+            if (tmp->lo < lo)
+            {
+                lo = tmp->lo;
+            }
+            if (tmp->hi > hi)
+            {
+                hi = tmp->hi;
+            }
+        }
+    }
+    else if ((tmp = (siridb_acache_entry_t *) malloc(
+            sizeof(siridb_acache_entry_t))) == NULL)
+    {
+        goto done;
+    }
+    else
+    {
+        tmp->series_id = series_id;
+        tmp->gid = aggr->gid;
+        tmp->group_by = aggr->group_by;
+        tmp->percentile = aggr->percentile;
+        tmp->len = 0;
+        tmp->data = NULL;
+    }
+
+    len = head + (end - start) + tail;
+
+    if (ACACHE_ENTRY_SZ(len) > acache->max_size ||
+        (data = (siridb_point_t *) malloc(
+                len * sizeof(siridb_point_t))) == NULL)
+    {
+        free(tmp->data);
+        free(tmp);
+        goto done;
+    }
+
+    memcpy(data, tmp->data, head * sizeof(siridb_point_t));
+    memcpy(data + head,
+            points->data + start,
+            (end - start) * sizeof(siridb_point_t));
+    memcpy(data + head + (end - start),
+            tmp->data + tmp->len - tail,
+            tail * sizeof(siridb_point_t));
+
+    free(tmp->data);
+    tmp->data = data;
+    tmp->len = len;
+    tmp->tp = points->tp;
+    tmp->lo = lo;
+    tmp->hi = hi;
+
+    while (acache->size + ACACHE_ENTRY_SZ(len) > acache->max_size)
+    {
+        siridb_acache_entry_t * last = acache->tail;
+        entry = ACACHE_BUCKET(acache, last->series_id);
+
+        for (; *entry != last; entry = &(*entry)->hnext);
+
+        ACACHE_unlink(acache, entry);
+        free(last->data);
+        free(last);
+    }
+
+    tmp->hnext = *ACACHE_BUCKET(acache, series_id);
+    *ACACHE_BUCKET(acache, series_id) = tmp;
+    tmp->prev = NULL;
+    tmp->next = NULL;
+    acache->size += ACACHE_ENTRY_SZ(len);
+    ACACHE_head(acache, tmp);
+
+done:
+    uv_mutex_unlock(&acache->mutex);
+}
+
+/*
+ * Remove the entries for series 'series_id' with groups which include points
+ * between 'start_ts' and 'end_ts'. (both inclusive)
+ */
+void siridb_acache_drop(
+        siridb_acache_t * acache,
+        uint32_t series_id,
+        uint64_t start_ts,
+        uint64_t end_ts)
+{
+    siridb_acache_entry_t ** entry = ACACHE_BUCKET(acache, series_id);
+    siridb_acache_entry_t * tmp;
+
+    uv_mutex_lock(&acache->mutex);
+
+    while ((tmp = *entry) != NULL)
+    {
+        if (    tmp->series_id == series_id &&
+                tmp->hi >= start_ts &&
+                ACACHE_GROUP_START(tmp->group_by, tmp->lo) <= end_ts)
+        {
+            ACACHE_unlink(acache, entry);
+            free(tmp->data);
+            free(tmp);
+            continue;
+        }
+        entry = &tmp->hnext;
+    }
+
+    uv_mutex_unlock(&acache->mutex);
+}
+
+/*
+ * Returns the result of aggregate 'aggr' for the points of 'series' between
+ * 'start_ts' and 'end_ts'. Complete groups are taken from the cache, the
+ * other groups are calculated and stored in the cache when they cannot
+ * change anymore.
+ *
+ * Returns NULL and raises a SIGNAL in case an error has occurred.
+ * (err_msg is set)
+ *
+ * This function can be used by multiple threads at the same time while holding
+ * the series_mutex for reading.
+ */
+siridb_points_t * siridb_acache_select(
+        siridb_t *__restrict siridb,
+        siridb_series_t *__restrict series,
+        siridb_aggr_t *__restrict aggr,
+        uint64_t *__restrict start_ts,
+        uint64_t *__restrict end_ts,
+        char * err_msg)
+{
+    uint64_t version = __atomic_load_n(&series->version, __ATOMIC_RELAXED);
+    uint64_t start = (start_ts == NULL) ? 0 : *start_ts;
+    uint64_t end = ACACHE_stable(series);
+    uint64_t lo, hi, pend, sstart;
+    siridb_points_t * cached = NULL;
+    siridb_points_t * prefix = NULL;
+    siridb_points_t * suffix = NULL;
+    siridb_points_t * points;
+
+    if (end_ts != NULL && *end_ts < end)
+    {
+        end = *end_ts;
+    }
+
+    /* groups after the last point would be removed by each new point */
+    if (series->end < end)
+    {
+        end = series->end + 1;
+    }
+
+    /* the first and last complete group which cannot change anymore */
+    lo = SIRIDB_AGGR_GROUP_TS(aggr, start + aggr->group_by - 1);
+    hi = (end) ? (end - 1) / aggr->group_by * aggr->group_by : 0;
+
+    if (lo > hi)
+    {
+        return ACACHE_read(siridb, series, aggr, start_ts, end_ts, err_msg);
+    }
+
+    pend = lo;
+    sstart = hi;
+
+    cached = siridb_acache_get(
+            siridb->acache,
+            series->id,
+            aggr,
+            &pend,
+            &sstart);
+
+    if (cached == NULL)
+    {
+        points = ACACHE_read(siridb, series, aggr, start_ts, end_ts, err_msg);
+    }
+    else
+    {
+        pend = ACACHE_GROUP_START(aggr->group_by, pend);
+        sstart++;
+
+        if (    (start_ts != NULL && *start_ts >= pend) ||
+                (prefix = ACACHE_read(
+                        siridb,
+                        series,
+                        aggr,
+                        start_ts,
+                        &pend,
+                        err_msg)) != NULL)
+        {
+            if (    (end_ts != NULL && *end_ts <= sstart) ||
+                    (suffix = ACACHE_read(
+                            siridb,
+                            series,
+                            aggr,
+                            &sstart,
+                            end_ts,
+                            err_msg)) != NULL)
+            {
+                points = ACACHE_join(prefix, cached, suffix, err_msg);
+            }
+            else
+            {
+                points = NULL;
+            }
+        }
+        else
+        {
+            points = NULL;
+        }
+
+        siridb_points_free(cached);
+        if (prefix != NULL)
+        {
+            siridb_points_free(prefix);
+        }
+        if (suffix != NULL)
+        {
+            siridb_points_free(suffix);
+        }
+    }
+
+    /* the groups are not stored when points are added while reading */
+    if (    points != NULL &&
+            points->len &&
+            version == __atomic_load_n(&series->version, __ATOMIC_RELAXED))
+    {
+        siridb_acache_set(siridb->acache, series->id, aggr, lo, hi, points);
+    }
+
+    return points;
+}
+
+/*
+ * Returns the address of the pointer to the entry for series 'series_id'
+ * and aggregate 'aggr'. The pointer is NULL when no entry is found.
+ */
+static siridb_acache_entry_t ** ACACHE_find(
+        siridb_acache_t * acache,
+        uint32_t series_id,
+        siridb_aggr_t * aggr)
+{
+    siridb_acache_entry_t ** entry = ACACHE_BUCKET(acache, series_id);
+
+    for (; *entry != NULL; entry = &(*entry)->hnext)
+    {
+        if (    (*entry)->series_id == series_id &&
+                (*entry)->gid == aggr->gid &&
+                (*entry)->group_by == aggr->group_by &&
+                (*entry)->percentile == aggr->percentile)
+        {
+            break;
+        }
+    }
+    return entry;
+}
+
+/*
+ * Remove an entry from its bucket and the list but do not free the entry.
+ */
+static void ACACHE_unlink(
+        siridb_acache_t * acache,
+        siridb_acache_entry_t ** entry)
+{
+    siridb_acache_entry_t * tmp = *entry;
+
+    *entry = tmp->hnext;
+
+    if (tmp->prev == NULL)
+    {
+        acache->head = tmp->next;
+    }
+    else
+    {
+        tmp->prev->next = tmp->next;
+    }
+
+    if (tmp->next == NULL)
+    {
+        acache->tail = tmp->prev;
+    }
+    else
+    {
+        tmp->next->prev = tmp->prev;
+    }
+
+    acache->size -= ACACHE_ENTRY_SZ(tmp->len);
+}
+
+/*
+ * Move an entry to the head of the list, the entry might not be in the
+ * list yet in which case 'prev' and 'next' must be NULL.
+ */
+static void ACACHE_head(
+        siridb_acache_t * acache,
+        siridb_acache_entry_t * entry)
+{
+    if (entry == acache->head)
+    {
+        return;
+    }
+
+    if (entry->prev != NULL)
+    {
+        entry->prev->next = entry->next;
+        if (entry->next == NULL)
+        {
+            acache->tail = entry->prev;
+        }
+        else
+        {
+            entry->next->prev = entry->prev;
+        }
+    }
+
+    entry->prev = NULL;
+    entry->next = acache->head;
+    if (acache->head == NULL)
+    {
+        acache->tail = entry;
+    }
+    else
+    {
+        acache->head->prev = entry;
+    }
+    acache->head = entry;
+}
+
+/*
+ * Returns the position of the first point with a time-stamp of at least
+ * 'ts' or 'len' when all points are older.
+ */
+static size_t ACACHE_find_ts(
+        const siridb_point_t * data,
+        size_t len,
+        uint64_t ts)
+{
+    size_t lo = 0, mid;
+
+    while (lo < len)
+    {
+        mid = lo + (len - lo) / 2;
+        if (data[mid].ts < ts)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            len = mid;
+        }
+    }
+    return lo;
+}
+
+/*
+ * Returns 0 if successful or -1 in case of an error. Entries for series
+ * which do not exist anymore are skipped.
+ */
+static int ACACHE_load(siridb_t * siridb)
+{
+    SIRIDB_GET_FN(fn, siridb->dbpath, SIRIDB_ACACHE_FN)
+    qp_unpacker_t * unpacker;
+    qp_obj_t qp_id, qp_gid, qp_group_by, qp_percentile, qp_tp;
+    qp_obj_t qp_lo, qp_hi, qp_data;
+    siridb_points_t points;
+    siridb_aggr_t aggr;
+    size_t n = 0;
+
+    if (!xpath_file_exist(fn))
+    {
+        return 0;
+    }
+
+    if ((unpacker = siridb_misc_open_schema_file(
+            SIRIDB_ACACHE_SCHEMA,
+            fn)) == NULL)
+    {
+        return -1;
+    }
+
+    memset(&aggr, 0, sizeof(siridb_aggr_t));
+
+    while ( qp_is_array(qp_next(unpacker, NULL)) &&
+            qp_next(unpacker, &qp_id) == QP_INT64 &&
+            qp_is_array(qp_next(unpacker, NULL)) &&
+            qp_next(unpacker, &qp_gid) == QP_INT64 &&
+            qp_next(unpacker, &qp_group_by) == QP_INT64 &&
+            qp_next(unpacker, &qp_percentile) == QP_DOUBLE &&
+            qp_next(unpacker, &qp_tp) == QP_INT64 &&
+            qp_next(unpacker, &qp_lo) == QP_INT64 &&
+            qp_next(unpacker, &qp_hi) == QP_INT64 &&
+            qp_next(unpacker, &qp_data) == QP_RAW)
+    {
+        aggr.gid = (uint32_t) qp_gid.via.int64;
+        aggr.group_by = (uint64_t) qp_group_by.via.int64;
+        aggr.percentile = qp_percentile.via.real;
+
+        if (    dmap_get(
+                    siridb->series_map,
+                    (uint64_t) qp_id.via.int64) == NULL ||
+                !siridb_acache_can_use(&aggr) ||
+                qp_data.len % sizeof(siridb_point_t) ||
+                qp_lo.via.int64 > qp_hi.via.int64)
+        {
+            continue;
+        }
+
+        points.tp = (points_tp) qp_tp.via.int64;
+        points.len = qp_data.len / sizeof(siridb_point_t);
+        points.data = (siridb_point_t *) qp_data.via.raw;
+
+        siridb_acache_set(
+                siridb->acache,
+                (uint32_t) qp_id.via.int64,
+                &aggr,
+                (uint64_t) qp_lo.via.int64,
+                (uint64_t) qp_hi.via.int64,
+                &points);
+        n++;
+    }
+
+    qp_unpacker_ff_free(unpacker);
+
+    if (unlink(fn))
+    {
+        log_error("Cannot remove file: '%s'", fn);
+        return -1;
+    }
+
+    log_info("Restored %zu aggregate cache entries", n);
+
+    return 0;
+}
+
+/*
+ * Returns the first time-stamp of 'series' which might still change. These
+ * are the points in the buffer and in shards with new values.
+ */
+static uint64_t ACACHE_stable(siridb_series_t * series)
+{
+    uint64_t ts = (series->buffer != NULL && series->buffer->len) ?
+            series->buffer->data[0].ts : UINT64_MAX;
+    idx_t * idx = series->idx;
+    idx_t * end = idx + series->idx_len;
+
+    /* the index is sorted by start time-stamp */
+    for (; idx < end && idx->start_ts < ts; idx++)
+    {
+        if (idx->shard->flags & SIRIDB_SHARD_HAS_NEW_VALUES)
+        {
+            return idx->start_ts;
+        }
+    }
+
+    return ts;
+}
+
+/*
+ * Returns the result of aggregate 'aggr' for the points of 'series' between
+ * 'start_ts' and 'end_ts', without using the cache.
+ *
+ * Returns NULL and raises a SIGNAL in case an error has occurred.
+ * (err_msg is set)
+ */
+static siridb_points_t * ACACHE_read(
+        siridb_t *__restrict siridb,
+        siridb_series_t *__restrict series,
+        siridb_aggr_t *__restrict aggr,
+        uint64_t * start_ts,
+        uint64_t * end_ts,
+        char * err_msg)
+{
+    siridb_points_t * points, * result;
+
+    if (siridb_aggregate_can_use_stats(aggr))
+    {
+        return siridb_series_get_aggr(
+                siridb,
+                series,
+                aggr,
+                start_ts,
+                end_ts,
+                err_msg);
+    }
+
+    points = siridb_series_get_points(siridb, series, start_ts, end_ts);
+    if (points == NULL)
+    {
+        sprintf(err_msg, "Memory allocation error.");
+        return NULL;  /* signal is raised */
+    }
+
+    if (!points->len)
+    {
+        return points;
+    }
+
+    result = siridb_aggregate_run(points, aggr, err_msg);
+    siridb_points_free(points);
+    return result;
+}
+
+/*
+ * Returns new points with the points of 'prefix', 'cached' and 'suffix'.
+ * Arguments 'prefix' and 'suffix' may be NULL and all points remain owned
+ * by the caller.
+ *
+ * Returns NULL and raises a SIGNAL in case an error has occurred.
+ * (err_msg is set)
+ */
+static siridb_points_t * ACACHE_join(
+        siridb_points_t * prefix,
+        siridb_points_t * cached,
+        siridb_points_t * suffix,
+        char * err_msg)
+{
+    size_t plen = (prefix == NULL) ? 0 : prefix->len;
+    size_t slen = (suffix == NULL) ? 0 : suffix->len;
+    siridb_points_t * points = siridb_points_new(
+            plen + cached->len + slen,
+            cached->tp);
+
+    if (points == NULL)
+    {
+        sprintf(err_msg, "Memory allocation error.");
+        return NULL;  /* signal is raised */
+    }
+
+    if (plen)
+    {
+        memcpy(points->data, prefix->data, plen * sizeof(siridb_point_t));
+    }
+    memcpy(points->data + plen,
+            cached->data,
+            cached->len * sizeof(siridb_point_t));
+    if (slen)
+    {
+        memcpy(points->data + plen + cached->len,
+                suffix->data,
+                slen * sizeof(siridb_point_t));
+    }
+    points->len = plen + cached->len + slen;
+
+    return points;
+}
@@ -12,8 +12,11 @@
 #include <assert.h>
 #include <limits.h>
 #include <logger/logger.h>
+#include <math.h>
 #include <siri/db/aggregate.h>
+#include <siri/db/cpoints.h>
 #include <siri/db/median.h>
+#include <siri/db/tdigest.h>
 #include <siri/db/variance.h>
 #include <siri/grammar/grammar.h>
 #include <slist/slist.h>
@@ -43,13 +46,44 @@ typedef int (* AGGR_cb)(
         siridb_aggr_t * aggr,
         char * err_msg);
 
-#define GROUP_TS(point) \
-    (point->ts + aggr->group_by - 1) / aggr->group_by * aggr->group_by + \
-    aggr->offset
+#define GROUP_TS(point) SIRIDB_AGGR_GROUP_TS(aggr, point->ts)
 
 static AGGR_cb AGGREGATES[F_OFFSET];
 
+/*
+ * State for a filter, difference or derivative (without group by) in a
+ * fused chain of aggregates. (see siridb_aggregate_run_list())
+ */
+typedef struct aggr_stage_s
+{
+    siridb_aggr_t * aggr;
+    points_tp tp;               /* type of the input points */
+    uint8_t has_prev;
+    qp_via_t value;             /* filter value for the input type */
+    siridb_point_t prev;        /* previous input point */
+} aggr_stage_t;
+
 static siridb_aggr_t * AGGREGATE_new(uint32_t gid);
+static points_tp AGGREGATE_group_tp(uint32_t gid, points_tp tp);
+static size_t AGGREGATE_fusable(
+        siridb_points_t * source,
+        slist_t * alist,
+        size_t start);
+static siridb_points_t * AGGREGATE_fused(
+        siridb_points_t * source,
+        slist_t * alist,
+        size_t start,
+        size_t n,
+        char * err_msg);
+static inline int AGGREGATE_stage(
+        aggr_stage_t * stage,
+        siridb_point_t * point,
+        char * err_msg);
+static siridb_points_t * AGGREGATE_merge(
+        siridb_points_t * points,
+        siridb_points_t * source,
+        siridb_aggr_t * aggr,
+        char * err_msg);
 static void AGGREGATE_free(siridb_aggr_t * aggr);
 static int AGGREGATE_init_filter(
         siridb_aggr_t * aggr,
@@ -59,6 +93,14 @@ static siridb_points_t * AGGREGATE_limit(
         siridb_points_t * source,
         siridb_aggr_t * aggr,
         char * err_msg);
+static siridb_points_t * AGGREGATE_lttb(
+        siridb_points_t * source,
+        siridb_aggr_t * aggr,
+        char * err_msg);
+static siridb_points_t * AGGREGATE_minmax(
+        siridb_points_t * source,
+        siridb_aggr_t * aggr,
+        char * err_msg);
 static siridb_points_t * AGGREGATE_derivative(
         siridb_points_t * source,
         siridb_aggr_t * aggr,
@@ -74,6 +116,11 @@ static siridb_points_t * AGGREGATE_group_by(
         siridb_points_t * source,
         siridb_aggr_t * aggr,
         char * err_msg);
+static int AGGREGATE_group_by_cpoints(
+        siridb_points_t * source,
+        siridb_points_t * points,
+        siridb_aggr_t * aggr,
+        char * err_msg);
 
 static int aggr_count(
         siridb_point_t * point,
@@ -129,6 +176,12 @@ static int aggr_min(
         siridb_aggr_t * aggr,
         char * err_msg);
 
+static int aggr_percentile(
+        siridb_point_t * point,
+        siridb_points_t * points,
+        siridb_aggr_t * aggr,
+        char * err_msg);
+
 static int aggr_pvariance(
         siridb_point_t * point,
         siridb_points_t * points,
@@ -167,9 +220,13 @@ void siridb_init_aggregates(void)
     AGGREGATES[CLERI_GID_F_MEDIAN_HIGH - F_OFFSET] = aggr_median_high;
     AGGREGATES[CLERI_GID_F_MEDIAN_LOW - F_OFFSET] = aggr_median_low;
     AGGREGATES[CLERI_GID_F_MIN - F_OFFSET] = aggr_min;
+    AGGREGATES[CLERI_GID_F_PERCENTILE - F_OFFSET] = aggr_percentile;
     AGGREGATES[CLERI_GID_F_PVARIANCE - F_OFFSET] = aggr_pvariance;
     AGGREGATES[CLERI_GID_F_SUM - F_OFFSET] = aggr_sum;
     AGGREGATES[CLERI_GID_F_VARIANCE - F_OFFSET] = aggr_variance;
+
+    /* select vectorized kernels for the columnar group by */
+    siridb_cpoints_init();
 }
 
 /*
@@ -400,6 +457,66 @@ slist_t * siridb_aggregate_list(cleri_children_t * children, char * err_msg)
 
             break;
 
+        case CLERI_GID_F_PERCENTILE:
+            AGGR_NEW
+            aggr->group_by = children->node->children->node->children->
+                    next->next->node->result;
+
+            if (!aggr->group_by)
+            {
+                sprintf(err_msg,
+                        "Group by time must be an integer value "
+                        "larger than zero.");
+                AGGREGATE_free(aggr);
+                siridb_aggregate_list_free(slist);
+                return NULL;
+            }
+
+            {
+                cleri_node_t * pnode = children->node->children->node->
+                        children->next->next->next->next->node;
+
+                aggr->percentile = strx_to_double(pnode->str, pnode->len);
+
+                if (aggr->percentile < 0.0 || aggr->percentile > 100.0)
+                {
+                    sprintf(err_msg,
+                            "Percentile must be a value between 0 and 100.");
+                    AGGREGATE_free(aggr);
+                    siridb_aggregate_list_free(slist);
+                    return NULL;
+                }
+            }
+
+            SLIST_APPEND
+
+            break;
+
+        case CLERI_GID_F_LTTB:
+        case CLERI_GID_F_MINMAX:
+            AGGR_NEW
+            {
+                int64_t target = children->node->children->node->
+                    children->next->next->node->result;
+
+                if (target < ((gid == CLERI_GID_F_MINMAX) ? 2 : 1))
+                {
+                    sprintf(err_msg,
+                            "Number of points must be an integer value "
+                            "larger than %s.",
+                            (gid == CLERI_GID_F_MINMAX) ? "one" : "zero");
+                    AGGREGATE_free(aggr);
+                    siridb_aggregate_list_free(slist);
+                    return NULL;
+                }
+
+                aggr->target = target;
+            }
+
+            SLIST_APPEND
+
+            break;
+
         case CLERI_GID_F_POINTS:
             break;
 
@@ -466,12 +583,812 @@ siridb_points_t * siridb_aggregate_run(
     case CLERI_GID_F_FILTER:
         return AGGREGATE_filter(source, aggr, err_msg);
 
+    case CLERI_GID_F_LTTB:
+        return AGGREGATE_lttb(source, aggr, err_msg);
+
+    case CLERI_GID_F_MINMAX:
+        return AGGREGATE_minmax(source, aggr, err_msg);
+
+    default:
+        assert (0);
+        break;
+    }
+
+    return NULL;
+}
+
+/*
+ * Run the aggregates in 'alist', starting at index 'start', on 'source'.
+ * Argument 'source' is destroyed, unless it is returned as the result.
+ *
+ * A chain of filter, difference and derivative functions (without group
+ * by), optionally followed by a group by aggregate, is fused into a single
+ * pass over the points which only keeps the points of the current group.
+ * The source points are used as buffer, no intermediate points are created.
+ *
+ * In case of an error NULL is returned and an error message is set or a
+ * signal is raised.
+ */
+siridb_points_t * siridb_aggregate_run_list(
+        siridb_points_t * source,
+        slist_t * alist,
+        size_t start,
+        char * err_msg)
+{
+    siridb_points_t * points;
+    size_t n;
+
+    while (start < alist->len && source->len)
+    {
+        n = AGGREGATE_fusable(source, alist, start);
+
+        if (n > 1)
+        {
+            points = AGGREGATE_fused(source, alist, start, n, err_msg);
+        }
+        else
+        {
+            n = 1;
+            points = siridb_aggregate_run(
+                    source,
+                    (siridb_aggr_t *) alist->data[start],
+                    err_msg);
+        }
+
+        if (points != source)
+        {
+            siridb_points_free(source);
+        }
+
+        if (points == NULL)
+        {
+            return NULL;  /* err_msg is set or a signal is raised */
+        }
+
+        source = points;
+        start += n;
+    }
+
+    return source;
+}
+
+/*
+ * Returns 1 (true) when the aggregate can be calculated using the statistics
+ * of chunks (min, max, sum and length) or 0 (false) if not.
+ */
+int siridb_aggregate_can_use_stats(siridb_aggr_t * aggr)
+{
+    if (!aggr->group_by || aggr->limit)
+    {
+        return 0;
+    }
+
+    switch (aggr->gid)
+    {
+    case CLERI_GID_F_COUNT:
+    case CLERI_GID_F_MAX:
+    case CLERI_GID_F_MEAN:
+    case CLERI_GID_F_MIN:
+    case CLERI_GID_F_SUM:
+        return 1;
+    }
+
+    return 0;
+}
+
+/*
+ * Returns 1 (true) when a chunk with statistics 'stats' and points of type
+ * 'tp' might have points which pass filter 'aggr', or 0 (false) when none
+ * of the points can pass and the chunk can be skipped. The filter value is
+ * converted like AGGREGATE_filter() does. Without statistics, 1 is returned.
+ */
+int siridb_aggregate_filter_stats(
+        siridb_aggr_t * aggr,
+        points_tp tp,
+        const siridb_points_stats_t * stats)
+{
+    if (    tp == TP_STRING ||
+            aggr->filter_tp == TP_STRING ||
+            !siridb_points_stats_ok(stats))
+    {
+        return 1;
+    }
+
+    if (tp == TP_INT)
+    {
+        int64_t min = stats->min.int64;
+        int64_t max = stats->max.int64;
+        int64_t value = (aggr->filter_tp == TP_INT) ?
+                aggr->filter_via.int64 : (int64_t) aggr->filter_via.real;
+
+        switch (aggr->filter_opr)
+        {
+        case CEXPR_EQ:
+            return min <= value && value <= max;
+        case CEXPR_NE:
+            return min != value || max != value;
+        case CEXPR_GT:
+            return max > value;
+        case CEXPR_LT:
+            return min < value;
+        case CEXPR_GE:
+            return max >= value;
+        case CEXPR_LE:
+            return min <= value;
+        default:
+            return 1;
+        }
+    }
+
+    double min = stats->min.real;
+    double max = stats->max.real;
+    double value = (aggr->filter_tp == TP_DOUBLE) ?
+            aggr->filter_via.real : (double) aggr->filter_via.int64;
+
+    /* a NaN value passes a not equal filter and is not in the range */
+    if (isnan(min) || isnan(max))
+    {
+        return 1;
+    }
+
+    switch (aggr->filter_opr)
+    {
+    case CEXPR_EQ:
+        return min <= value && value <= max;
+    case CEXPR_GT:
+        return max > value;
+    case CEXPR_LT:
+        return min < value;
+    case CEXPR_GE:
+        return max >= value;
+    case CEXPR_LE:
+        return min <= value;
+    default:
+        return 1;
+    }
+}
+
+/*
+ * Returns 1 (true) if merged series can be aggregated without creating all
+ * merged points and other pools can send a partial aggregate. This is true
+ * for the aggregates which can use statistics and for a variance or
+ * pvariance with a group by, which use a partial variance.
+ * (see siridb_variance_parts_add())
+ */
+int siridb_aggregate_can_merge(siridb_aggr_t * aggr)
+{
+    return siridb_aggregate_can_use_stats(aggr) || (
+            aggr->group_by &&
+            !aggr->limit &&
+            siridb_variance_is_gid(aggr->gid));
+}
+
+/*
+ * Set 'val' to the aggregated value of a chunk with 'len' points and the
+ * given statistics. Argument 'gid' must be count, max, min or sum.
+ */
+void siridb_aggregate_stats_val(
+        qp_via_t * val,
+        siridb_points_stats_t * stats,
+        uint32_t len,
+        uint32_t gid)
+{
+    switch (gid)
+    {
+    case CLERI_GID_F_COUNT:
+        val->int64 = len;
+        break;
+    case CLERI_GID_F_MAX:
+        *val = stats->max;
+        break;
+    case CLERI_GID_F_MIN:
+        *val = stats->min;
+        break;
+    case CLERI_GID_F_SUM:
+        *val = stats->sum;
+        break;
+    default:
+        assert (0);
+        break;
+    }
+}
+
+/*
+ * Combine 'other' into 'val'. Both values must be the result of aggregate
+ * 'gid' (count, max, min or sum) for different points in the same group.
+ * Argument 'tp' is the type of the values.
+ *
+ * Returns 0 if successful or -1 and err_msg is set in case of an overflow.
+ */
+int siridb_aggregate_combine_val(
+        qp_via_t * val,
+        qp_via_t * other,
+        uint32_t gid,
+        points_tp tp,
+        char * err_msg)
+{
+    switch (gid)
+    {
+    case CLERI_GID_F_COUNT:
+        val->int64 += other->int64;
+        break;
+
+    case CLERI_GID_F_MAX:
+        if ((tp == TP_INT) ?
+                other->int64 > val->int64 : other->real > val->real)
+        {
+            *val = *other;
+        }
+        break;
+
+    case CLERI_GID_F_MIN:
+        if ((tp == TP_INT) ?
+                other->int64 < val->int64 : other->real < val->real)
+        {
+            *val = *other;
+        }
+        break;
+
+    case CLERI_GID_F_SUM:
+        if (tp == TP_INT)
+        {
+            int64_t tmp = other->int64;
+            if ((tmp > 0 && val->int64 > LLONG_MAX - tmp) ||
+                    (tmp < 0 && val->int64 < LLONG_MIN - tmp))
+            {
+                sprintf(err_msg, "Overflow detected while using sum().");
+                return -1;
+            }
+            val->int64 += tmp;
+        }
+        else
+        {
+            val->real += other->real;
+        }
+        break;
+
+    default:
+        assert (0);
+        break;
+    }
+
+    return 0;
+}
+
+/*
+ * Returns new points with the merge of 'a' and 'b'. Both 'a' and 'b' must be
+ * sorted results of aggregate 'gid' (count, max, min or sum) and points with
+ * equal time-stamps (groups) are combined.
+ *
+ * Returns NULL in case an error has occurred and the err_msg is set.
+ */
+siridb_points_t * siridb_aggregate_combine(
+        siridb_points_t * a,
+        siridb_points_t * b,
+        uint32_t gid,
+        char * err_msg)
+{
+    siridb_point_t * pa = a->data;
+    siridb_point_t * pb = b->data;
+    siridb_point_t * ea = a->data + a->len;
+    siridb_point_t * eb = b->data + b->len;
+    siridb_point_t * point;
+    siridb_points_t * points = siridb_points_new(a->len + b->len, a->tp);
+
+    if (points == NULL)
+    {
+        sprintf(err_msg, "Memory allocation error.");
+        return NULL;  /* signal is raised */
+    }
+
+    while (pa < ea || pb < eb)
+    {
+        point = points->data + points->len;
+
+        if (pb == eb || (pa < ea && pa->ts < pb->ts))
+        {
+            *point = *pa;
+            pa++;
+        }
+        else if (pa == ea || pb->ts < pa->ts)
+        {
+            *point = *pb;
+            pb++;
+        }
+        else
+        {
+            *point = *pa;
+            if (siridb_aggregate_combine_val(
+                    &point->val,
+                    &pb->val,
+                    gid,
+                    points->tp,
+                    err_msg))
+            {
+                siridb_points_free(points);
+                return NULL;
+            }
+            pa++;
+            pb++;
+        }
+
+        points->len++;
+    }
+
+    return points;
+}
+
+/*
+ * Returns new points with the combination of the partial aggregates 'a' and
+ * 'b', see siridb_points_merge_partial(). Unlike siridb_aggregate_combine()
+ * the types of 'a' and 'b' may differ in which case integer values are
+ * promoted to double. Both 'a' and 'b' remain owned by the caller.
+ *
+ * Returns NULL in case an error has occurred and the err_msg is set.
+ */
+siridb_points_t * siridb_aggregate_combine_partial(
+        siridb_points_t * a,
+        siridb_points_t * b,
+        uint32_t gid,
+        char * err_msg)
+{
+    if (a->tp != b->tp)
+    {
+        siridb_points_t * points = (a->tp == TP_INT) ? a : b;
+
+        if (a->tp == TP_STRING || b->tp == TP_STRING)
+        {
+            sprintf(err_msg, "Cannot merge string and number series.");
+            return NULL;
+        }
+
+        for (size_t i = 0; i < points->len; i++)
+        {
+            points->data[i].val.real = (double) points->data[i].val.int64;
+        }
+        points->tp = TP_DOUBLE;
+    }
+
+    return siridb_aggregate_combine(a, b, gid, err_msg);
+}
+
+/*
+ * Aggregate a batch of points and merge the result with 'points' (and with
+ * 'counts' for a mean). The batch is empty afterwards. Argument 'aggr' must
+ * be an aggregate for which siridb_aggregate_can_use_stats() is true, with
+ * sum instead of mean since a mean is calculated from the sum and 'counts'.
+ * (see siridb_aggregate_stream_mean())
+ *
+ * Returns 0 if successful or -1 in case of an error, in which case 'points'
+ * and 'counts' are destroyed. (err_msg is set)
+ */
+int siridb_aggregate_stream(
+        siridb_points_t ** points,
+        siridb_points_t ** counts,
+        siridb_points_t * batch,
+        siridb_aggr_t * aggr,
+        char * err_msg)
+{
+    siridb_aggr_t count_aggr;
+
+    if (!batch->len)
+    {
+        return 0;
+    }
+
+    if ((*points = AGGREGATE_merge(*points, batch, aggr, err_msg)) == NULL)
+    {
+        if (*counts != NULL)
+        {
+            siridb_points_free(*counts);
+        }
+        return -1;
+    }
+
+    if (*counts != NULL)
+    {
+        count_aggr = *aggr;
+        count_aggr.gid = CLERI_GID_F_COUNT;
+        *counts = AGGREGATE_merge(*counts, batch, &count_aggr, err_msg);
+        if (*counts == NULL)
+        {
+            siridb_points_free(*points);
+            return -1;
+        }
+    }
+
+    batch->len = 0;
+
+    return 0;
+}
+
+/*
+ * Returns the mean for each group from the sums in 'points' and the number
+ * of points in 'counts'. Both 'points' and 'counts' are destroyed.
+ *
+ * Returns NULL and raises a SIGNAL in case an error has occurred.
+ * (err_msg is set)
+ */
+siridb_points_t * siridb_aggregate_stream_mean(
+        siridb_points_t * points,
+        siridb_points_t * counts,
+        char * err_msg)
+{
+    siridb_point_t * point;
+    siridb_points_t * mean;
+
+#ifdef DEBUG
+    assert (points->len == counts->len);
+#endif
+
+    mean = siridb_points_new(points->len, TP_DOUBLE);
+
+    if (mean == NULL)
+    {
+        sprintf(err_msg, "Memory allocation error.");
+    }
+    else for (; mean->len < points->len; mean->len++)
+    {
+        point = mean->data + mean->len;
+        point->ts = points->data[mean->len].ts;
+        point->val.real = ((points->tp == TP_INT) ?
+                (double) points->data[mean->len].val.int64 :
+                points->data[mean->len].val.real) /
+                counts->data[mean->len].val.int64;
+    }
+
+    siridb_points_free(points);
+    siridb_points_free(counts);
+
+    return mean;
+}
+
+/*
+ * Returns a merge of 'points', which are already aggregated, and 'source'
+ * aggregated with 'aggr'. Argument 'points' is destroyed by this function
+ * but 'source' is not.
+ *
+ * Returns NULL in case of an error. (err_msg is set)
+ */
+static siridb_points_t * AGGREGATE_merge(
+        siridb_points_t * points,
+        siridb_points_t * source,
+        siridb_aggr_t * aggr,
+        char * err_msg)
+{
+    siridb_points_t * aggr_points;
+    siridb_points_t * merged;
+
+    aggr_points = siridb_aggregate_run(source, aggr, err_msg);
+
+    if (aggr_points == NULL || !points->len)
+    {
+        siridb_points_free(points);
+        return aggr_points;
+    }
+
+    merged = siridb_aggregate_combine(points, aggr_points, aggr->gid, err_msg);
+
+    siridb_points_free(points);
+    siridb_points_free(aggr_points);
+
+    return merged;
+}
+
+/*
+ * Returns the type of the points created by a group by aggregate on points
+ * of type 'tp'.
+ */
+static points_tp AGGREGATE_group_tp(uint32_t gid, points_tp tp)
+{
+    switch(gid)
+    {
+    case CLERI_GID_F_MEAN:
+    case CLERI_GID_F_MEDIAN:
+    case CLERI_GID_F_PERCENTILE:
+    case CLERI_GID_F_PVARIANCE:
+    case CLERI_GID_F_VARIANCE:
+    case CLERI_GID_F_DERIVATIVE:
+        return TP_DOUBLE;
+    case CLERI_GID_F_COUNT:
+        return TP_INT;
+    case CLERI_GID_F_MEDIAN_HIGH:
+    case CLERI_GID_F_MAX:
+    case CLERI_GID_F_MEDIAN_LOW:
+    case CLERI_GID_F_MIN:
+    case CLERI_GID_F_SUM:
+    case CLERI_GID_F_DIFFERENCE:
+        return tp;
+    default:
+        assert (0);
+        return tp;
+    }
+}
+
+/*
+ * Returns the number of aggregates, starting at 'start', which can be
+ * fused. These are filter, difference and derivative without group by,
+ * optionally followed by one group by aggregate. String points and string
+ * filters are not fused.
+ */
+static size_t AGGREGATE_fusable(
+        siridb_points_t * source,
+        slist_t * alist,
+        size_t start)
+{
+    siridb_aggr_t * aggr;
+    size_t i;
+
+    if (source->tp == TP_STRING)
+    {
+        return 0;
+    }
+
+    for (i = start; i < alist->len; i++)
+    {
+        aggr = (siridb_aggr_t * ) alist->data[i];
+
+        if (aggr->limit || aggr->target)
+        {
+            break;
+        }
+
+        if (aggr->group_by)
+        {
+            /* a group by aggregate ends the chain */
+            i++;
+            break;
+        }
+
+        if (aggr->gid == CLERI_GID_F_FILTER && aggr->filter_tp == TP_STRING)
+        {
+            break;
+        }
+    }
+
+    return i - start;
+}
+
+/*
+ * Run 'n' fusable aggregates from 'alist' on 'source'. (see
+ * AGGREGATE_fusable())
+ *
+ * Points which pass all filter, difference and derivative stages are written
+ * back to the start of the source. Without a group by aggregate the source
+ * is returned, otherwise the points of a group are aggregated as soon as the
+ * group is complete and the source is re-used for the next group.
+ *
+ * Returns NULL in case an error has occurred. (err_msg is set or a signal is
+ * raised)
+ */
+static siridb_points_t * AGGREGATE_fused(
+        siridb_points_t * source,
+        slist_t * alist,
+        size_t start,
+        size_t n,
+        char * err_msg)
+{
+    siridb_aggr_t * aggr = (siridb_aggr_t *) alist->data[start + n - 1];
+    siridb_points_t * points = NULL;
+    siridb_points_t group;
+    siridb_point_t * dst = source->data;
+    siridb_point_t point;
+    size_t nstages = n;
+    size_t i, k;
+    uint64_t group_ts = 0;
+    uint64_t max_sz;
+    AGGR_cb aggr_cb = NULL;
+    points_tp tp = source->tp;
+    int rc;
+
+    if (aggr->group_by)
+    {
+        nstages--;
+    }
+    else
+    {
+        aggr = NULL;
+    }
+
+    aggr_stage_t stages[nstages];
+
+    for (k = 0; k < nstages; k++)
+    {
+        stages[k].aggr = (siridb_aggr_t *) alist->data[start + k];
+        stages[k].tp = tp;
+        stages[k].has_prev = 0;
+        stages[k].value = stages[k].aggr->filter_via;
+
+        switch (stages[k].aggr->gid)
+        {
+        case CLERI_GID_F_FILTER:
+            if (stages[k].aggr->filter_tp == TP_INT && tp == TP_DOUBLE)
+            {
+                stages[k].value.real = (double) stages[k].value.int64;
+            }
+            else if (stages[k].aggr->filter_tp == TP_DOUBLE && tp == TP_INT)
+            {
+                stages[k].value.int64 = (int64_t) stages[k].value.real;
+            }
+            break;
+
+        case CLERI_GID_F_DERIVATIVE:
+            tp = TP_DOUBLE;
+            break;
+        }
+    }
+
+    if (aggr != NULL)
+    {
+        max_sz = ((source->data + source->len - 1)->ts - source->data->ts)
+                / aggr->group_by + 2;
+
+        if (max_sz > source->len)
+        {
+            max_sz = source->len;
+        }
+
+        points = siridb_points_new(max_sz, AGGREGATE_group_tp(aggr->gid, tp));
+
+        if (points == NULL)
+        {
+            sprintf(err_msg, "Memory allocation error.");
+            return NULL;  /* signal is raised */
+        }
+
+        aggr_cb = AGGREGATES[aggr->gid - F_OFFSET];
+        group.tp = tp;
+        group.data = source->data;
+    }
+
+    for (i = 0; i < source->len; i++)
+    {
+        point = source->data[i];
+
+        for (k = 0; k < nstages; k++)
+        {
+            if ((rc = AGGREGATE_stage(stages + k, &point, err_msg)) != 1)
+            {
+                break;
+            }
+        }
+
+        if (k < nstages)
+        {
+            if (rc < 0)
+            {
+                if (points != NULL)
+                {
+                    siridb_points_free(points);
+                }
+                return NULL;  /* err_msg is set */
+            }
+            continue;  /* the point is filtered */
+        }
+
+        if (aggr != NULL)
+        {
+            if (dst != source->data && point.ts > group_ts)
+            {
+                group.len = dst - source->data;
+                points->data[points->len].ts = group_ts;
+                if (aggr_cb(
+                        points->data + points->len,
+                        &group,
+                        aggr,
+                        err_msg))
+                {
+                    siridb_points_free(points);
+                    return NULL;  /* err_msg is set */
+                }
+                points->len++;
+                dst = source->data;
+            }
+
+            if (dst == source->data)
+            {
+                group_ts = SIRIDB_AGGR_GROUP_TS(aggr, point.ts);
+            }
+        }
+
+        /* never overwrites a point which is not read yet */
+        *dst = point;
+        dst++;
+    }
+
+    if (aggr == NULL)
+    {
+        source->len = dst - source->data;
+        source->tp = tp;
+        return source;
+    }
+
+    if (dst != source->data)
+    {
+        group.len = dst - source->data;
+        points->data[points->len].ts = group_ts;
+        if (aggr_cb(points->data + points->len, &group, aggr, err_msg))
+        {
+            siridb_points_free(points);
+            return NULL;  /* err_msg is set */
+        }
+        points->len++;
+    }
+
+    return points;
+}
+
+/*
+ * Apply a filter, difference or derivative stage on 'point'.
+ *
+ * Returns 1 when the point passes the stage, 0 when the point is dropped or
+ * -1 in case of an error. (err_msg is set)
+ */
+static inline int AGGREGATE_stage(
+        aggr_stage_t * stage,
+        siridb_point_t * point,
+        char * err_msg)
+{
+    siridb_point_t prev = stage->prev;
+
+    switch (stage->aggr->gid)
+    {
+    case CLERI_GID_F_FILTER:
+        return (stage->tp == TP_INT) ?
+                cexpr_int_cmp(
+                        stage->aggr->filter_opr,
+                        point->val.int64,
+                        stage->value.int64) != 0 :
+                cexpr_double_cmp(
+                        stage->aggr->filter_opr,
+                        point->val.real,
+                        stage->value.real) != 0;
+
+    case CLERI_GID_F_DIFFERENCE:
+    case CLERI_GID_F_DERIVATIVE:
+        stage->prev = *point;
+
+        if (!stage->has_prev)
+        {
+            stage->has_prev = 1;
+            return 0;
+        }
+        break;
+
     default:
         assert (0);
-        break;
+        return -1;
     }
 
-    return NULL;
+    if (stage->aggr->gid == CLERI_GID_F_DIFFERENCE)
+    {
+        if (stage->tp == TP_INT)
+        {
+            if ((prev.val.int64 > 0 &&
+                    point->val.int64 < LLONG_MIN + prev.val.int64) ||
+                (prev.val.int64 < 0 &&
+                    point->val.int64 > LLONG_MAX + prev.val.int64))
+            {
+                sprintf(err_msg,
+                    "Overflow detected while using difference().");
+                return -1;
+            }
+            point->val.int64 -= prev.val.int64;
+        }
+        else
+        {
+            point->val.real -= prev.val.real;
+        }
+    }
+    else
+    {
+        point->val.real = ((stage->tp == TP_INT) ?
+                ((double) point->val.int64 - prev.val.int64) :
+                (point->val.real - prev.val.real)) /
+                (double) (point->ts - prev.ts) * stage->aggr->timespan;
+    }
+
+    return 1;
 }
 
 /*
@@ -489,6 +1406,8 @@ static siridb_aggr_t * AGGREGATE_new(uint32_t gid)
     aggr->limit = 0;
     aggr->offset = 0;
     aggr->timespan = 1.0;
+    aggr->percentile = 0.0;
+    aggr->target = 0;
     aggr->filter_tp = TP_INT;  /* when string we must
                                 * malloc/free * aggr->filter_via.raw */
     return aggr;
@@ -567,10 +1486,209 @@ static siridb_points_t * AGGREGATE_limit(
     uint64_t timespan =
             source->data[source->len - 1].ts - source->data[0].ts;
 
-    aggr->group_by = timespan / aggr->limit + 1;
-    aggr->offset = (source->data[0].ts - 1) % aggr->group_by;
+    /*
+     * The group by depends on the source so we use a copy, this way the
+     * same aggregate can be used by multiple threads at the same time.
+     */
+    siridb_aggr_t limit_aggr = *aggr;
+
+    limit_aggr.group_by = timespan / aggr->limit + 1;
+    limit_aggr.offset = (source->data[0].ts - 1) % limit_aggr.group_by;
+
+    return AGGREGATE_group_by(source, &limit_aggr, err_msg);
+}
+
+/*
+ * Returns the value of a number point as double.
+ */
+static inline double AGGREGATE_real(siridb_point_t * point, points_tp tp)
+{
+    return (tp == TP_INT) ? (double) point->val.int64 : point->val.real;
+}
+
+/*
+ * Largest-Triangle-Three-Buckets. The first and last points are kept and
+ * the other points are divided in 'target - 2' buckets with the same number
+ * of points. From each bucket the point is selected which forms the largest
+ * triangle with the previous selected point and the average of the next
+ * bucket. This keeps the visual shape, including spikes, of the series.
+ *
+ * The source is returned when it has no more than 'target' points.
+ */
+static siridb_points_t * AGGREGATE_lttb(
+        siridb_points_t * source,
+        siridb_aggr_t * aggr,
+        char * err_msg)
+{
+    siridb_points_t * points;
+    siridb_point_t * a;
+    siridb_point_t * pt;
+    siridb_point_t * selected;
+    uint64_t t0;
+    size_t i, k, start, end, nstart, nend;
+    double every, ax, ay, nx, ny, area, max_area;
+
+    if (source->tp == TP_STRING)
+    {
+        sprintf(err_msg, "Cannot use lttb() on string type.");
+        return NULL;
+    }
+
+    if (source->len <= aggr->target)
+    {
+        return source;
+    }
+
+    points = siridb_points_new(aggr->target, source->tp);
+    if (points == NULL)
+    {
+        sprintf(err_msg, "Memory allocation error.");
+        return NULL;
+    }
+
+    points->data[points->len++] = source->data[0];
+
+    if (aggr->target < 3)
+    {
+        if (aggr->target == 2)
+        {
+            points->data[points->len++] = source->data[source->len - 1];
+        }
+        return points;
+    }
+
+    /* time-stamps are relative to the first point to keep the precision */
+    t0 = source->data[0].ts;
+    every = (double) (source->len - 2) / (aggr->target - 2);
+    a = source->data;
+
+    for (i = 0; i < aggr->target - 2; i++)
+    {
+        start = (size_t) (i * every) + 1;
+        end = (size_t) ((i + 1) * every) + 1;
+        nstart = end;
+        nend = (size_t) ((i + 2) * every) + 1;
+
+        if (nend > source->len - 1)
+        {
+            /* the next bucket of the last bucket is the last point */
+            nstart = source->len - 1;
+            nend = source->len;
+        }
+
+        nx = ny = 0.0;
+        for (k = nstart, pt = source->data + k; k < nend; k++, pt++)
+        {
+            nx += (double) (pt->ts - t0);
+            ny += AGGREGATE_real(pt, source->tp);
+        }
+        nx /= nend - nstart;
+        ny /= nend - nstart;
+
+        ax = (double) (a->ts - t0);
+        ay = AGGREGATE_real(a, source->tp);
+
+        selected = source->data + start;
+        max_area = -1.0;
+        for (k = start, pt = source->data + k; k < end; k++, pt++)
+        {
+            /* twice the area, only used for comparing */
+            area = fabs(
+                    (ax - nx) * (AGGREGATE_real(pt, source->tp) - ay) -
+                    (ax - (double) (pt->ts - t0)) * (ny - ay));
+            if (area > max_area)
+            {
+                max_area = area;
+                selected = pt;
+            }
+        }
+
+        points->data[points->len++] = *selected;
+        a = selected;
+    }
+
+    points->data[points->len++] = source->data[source->len - 1];
+
+    return points;
+}
+
+/*
+ * Divides the points in 'target / 2' buckets with the same number of points
+ * and keeps the minimum and maximum of each bucket in time order. A bucket
+ * where both are the same point returns one point.
+ *
+ * The source is returned when it has no more than 'target' points.
+ */
+static siridb_points_t * AGGREGATE_minmax(
+        siridb_points_t * source,
+        siridb_aggr_t * aggr,
+        char * err_msg)
+{
+    siridb_points_t * points;
+    siridb_point_t * pt;
+    siridb_point_t * pmin;
+    siridb_point_t * pmax;
+    size_t nbuckets, i, k, start, end;
+    double val, vmin, vmax;
+
+    if (source->tp == TP_STRING)
+    {
+        sprintf(err_msg, "Cannot use minmax() on string type.");
+        return NULL;
+    }
+
+    if (source->len <= aggr->target)
+    {
+        return source;
+    }
+
+    nbuckets = aggr->target / 2;
+
+    points = siridb_points_new(nbuckets * 2, source->tp);
+    if (points == NULL)
+    {
+        sprintf(err_msg, "Memory allocation error.");
+        return NULL;
+    }
+
+    for (i = 0, start = 0; i < nbuckets; i++, start = end)
+    {
+        end = (i + 1) * source->len / nbuckets;
+
+        pmin = pmax = source->data + start;
+        vmin = vmax = AGGREGATE_real(pmin, source->tp);
+
+        for (k = start + 1, pt = pmin + 1; k < end; k++, pt++)
+        {
+            val = AGGREGATE_real(pt, source->tp);
+            if (val < vmin)
+            {
+                vmin = val;
+                pmin = pt;
+            }
+            else if (val > vmax)
+            {
+                vmax = val;
+                pmax = pt;
+            }
+        }
+
+        if (pmin < pmax)
+        {
+            points->data[points->len++] = *pmin;
+            points->data[points->len++] = *pmax;
+        }
+        else
+        {
+            points->data[points->len++] = *pmax;
+            if (pmin != pmax)
+            {
+                points->data[points->len++] = *pmin;
+            }
+        }
+    }
 
-    return AGGREGATE_group_by(source, aggr, err_msg);
+    return points;
 }
 
 static siridb_points_t * AGGREGATE_derivative(
@@ -856,30 +1974,7 @@ static siridb_points_t * AGGREGATE_group_by(
     AGGR_cb aggr_cb = AGGREGATES[aggr->gid - F_OFFSET];
 
     /* create new points with max possible size after re-indexing */
-    switch(aggr->gid)
-    {
-    case CLERI_GID_F_MEAN:
-    case CLERI_GID_F_MEDIAN:
-    case CLERI_GID_F_PVARIANCE:
-    case CLERI_GID_F_VARIANCE:
-    case CLERI_GID_F_DERIVATIVE:
-        points = siridb_points_new(max_sz, TP_DOUBLE);
-        break;
-    case CLERI_GID_F_COUNT:
-        points = siridb_points_new(max_sz, TP_INT);
-        break;
-    case CLERI_GID_F_MEDIAN_HIGH:
-    case CLERI_GID_F_MAX:
-    case CLERI_GID_F_MEDIAN_LOW:
-    case CLERI_GID_F_MIN:
-    case CLERI_GID_F_SUM:
-    case CLERI_GID_F_DIFFERENCE:
-        points = siridb_points_new(max_sz, group.tp);
-        break;
-    default:
-        assert (0);
-        points = NULL;
-    }
+    points = siridb_points_new(max_sz, AGGREGATE_group_tp(aggr->gid, group.tp));
 
     if (points == NULL)
     {
@@ -887,39 +1982,51 @@ static siridb_points_t * AGGREGATE_group_by(
         return NULL;  /* signal is raised */
     }
 
-    goup_ts = GROUP_TS(source->data);
-
-    for(start = end = 0; end < source->len; end++)
+    switch (AGGREGATE_group_by_cpoints(source, points, aggr, err_msg))
     {
-        if ((source->data + end)->ts > goup_ts)
+    case 0:
+        break;
+
+    case -1:
+        /* error occurred, return NULL */
+        siridb_points_free(points);
+        return NULL;
+
+    default:
+        goup_ts = GROUP_TS(source->data);
+
+        for(start = end = 0; end < source->len; end++)
         {
-            group.data = (source->data + start);
-            group.len = end - start;
-            point = points->data + points->len;
-            point->ts = goup_ts;
-            if (aggr_cb(point, &group, aggr, err_msg))
+            if ((source->data + end)->ts > goup_ts)
             {
-                /* error occurred, return NULL */
-                siridb_points_free(points);
-                return NULL;
+                group.data = (source->data + start);
+                group.len = end - start;
+                point = points->data + points->len;
+                point->ts = goup_ts;
+                if (aggr_cb(point, &group, aggr, err_msg))
+                {
+                    /* error occurred, return NULL */
+                    siridb_points_free(points);
+                    return NULL;
+                }
+                points->len++;
+                start = end;
+                goup_ts = GROUP_TS((source->data + end));
             }
-            points->len++;
-            start = end;
-            goup_ts = GROUP_TS((source->data + end));
         }
-    }
 
-    group.data = (source->data + start);
-    group.len = end - start;
-    point = points->data + points->len;
-    point->ts = goup_ts;
-    if (aggr_cb(point, &group, aggr, err_msg))
-    {
-        /* error occurred, return NULL */
-        siridb_points_free(points);
-        return NULL;
+        group.data = (source->data + start);
+        group.len = end - start;
+        point = points->data + points->len;
+        point->ts = goup_ts;
+        if (aggr_cb(point, &group, aggr, err_msg))
+        {
+            /* error occurred, return NULL */
+            siridb_points_free(points);
+            return NULL;
+        }
+        points->len++;
     }
-    points->len++;
 
     if (points->len < max_sz)
     {
@@ -947,6 +2054,96 @@ static siridb_points_t * AGGREGATE_group_by(
     return points;
 }
 
+/*
+ * Group by using columnar points for aggregates which only need the values
+ * of numeric points. The results are added to 'points'.
+ *
+ * Returns 0 if successful, -1 in case of an error or 1 when the aggregate is
+ * not supported and AGGREGATE_group_by() should group the normal points.
+ */
+static int AGGREGATE_group_by_cpoints(
+        siridb_points_t * source,
+        siridb_points_t * points,
+        siridb_aggr_t * aggr,
+        char * err_msg)
+{
+    siridb_cpoints_t * cpoints;
+    siridb_point_t * point;
+    siridb_variance_t state;
+    size_t start, end;
+
+    switch (aggr->gid)
+    {
+    case CLERI_GID_F_COUNT:
+    case CLERI_GID_F_MAX:
+    case CLERI_GID_F_MEAN:
+    case CLERI_GID_F_MIN:
+    case CLERI_GID_F_PVARIANCE:
+    case CLERI_GID_F_SUM:
+    case CLERI_GID_F_VARIANCE:
+        break;
+    default:
+        return 1;
+    }
+
+    if (source->tp == TP_STRING ||
+        (cpoints = siridb_cpoints_from_points(source)) == NULL)
+    {
+        return 1;
+    }
+
+    for (start = 0; start < cpoints->len; start = end)
+    {
+        point = points->data + points->len++;
+        point->ts = SIRIDB_AGGR_GROUP_TS(aggr, cpoints->ts[start]);
+        end = siridb_cpoints_group_end(cpoints, start, point->ts);
+
+        switch (aggr->gid)
+        {
+        case CLERI_GID_F_COUNT:
+            point->val.int64 = end - start;
+            break;
+
+        case CLERI_GID_F_MAX:
+            siridb_cpoints_max(cpoints, start, end, &point->val);
+            break;
+
+        case CLERI_GID_F_MEAN:
+            point->val.real = siridb_cpoints_mean(cpoints, start, end);
+            break;
+
+        case CLERI_GID_F_MIN:
+            siridb_cpoints_min(cpoints, start, end, &point->val);
+            break;
+
+        case CLERI_GID_F_PVARIANCE:
+            state = (siridb_variance_t) SIRIDB_VARIANCE_INIT;
+            siridb_cpoints_variance(cpoints, start, end, &state);
+            point->val.real = siridb_variance_population(&state);
+            break;
+
+        case CLERI_GID_F_SUM:
+            if (siridb_cpoints_sum(cpoints, start, end, &point->val))
+            {
+                sprintf(err_msg, "Overflow detected while using sum().");
+                siridb_cpoints_free(cpoints);
+                return -1;
+            }
+            break;
+
+        case CLERI_GID_F_VARIANCE:
+            state = (siridb_variance_t) SIRIDB_VARIANCE_INIT;
+            siridb_cpoints_variance(cpoints, start, end, &state);
+            point->val.real = siridb_variance_sample(&state);
+            break;
+        }
+    }
+
+    siridb_cpoints_free(cpoints);
+
+    return 0;
+}
+
 static int aggr_count(
         siridb_point_t * point,
         siridb_points_t * points,
@@ -1305,12 +2502,61 @@ static int aggr_min(
     return 0;
 }
 
+/*
+ * The percentile is approximated using a t-digest so memory is bounded no
+ * matter how many points are in a group. (see tdigest.c)
+ */
+static int aggr_percentile(
+        siridb_point_t * point,
+        siridb_points_t * points,
+        siridb_aggr_t * aggr,
+        char * err_msg)
+{
+#ifdef DEBUG
+    assert (points->len);
+#endif
+    siridb_tdigest_t td;
+    size_t i;
+
+    if (points->tp == TP_STRING)
+    {
+        sprintf(err_msg, "Cannot use percentile() on string type.");
+        return -1;
+    }
+
+    siridb_tdigest_init(&td);
+
+    if (points->tp == TP_INT)
+    {
+        for (i = 0; i < points->len; i++)
+        {
+            siridb_tdigest_add(
+                    &td,
+                    (double) points->data[i].val.int64,
+                    1.0);
+        }
+    }
+    else
+    {
+        for (i = 0; i < points->len; i++)
+        {
+            siridb_tdigest_add(&td, points->data[i].val.real, 1.0);
+        }
+    }
+
+    point->val.real = siridb_tdigest_quantile(&td, aggr->percentile / 100.0);
+
+    return 0;
+}
+
 static int aggr_pvariance(
         siridb_point_t * point,
         siridb_points_t * points,
         siridb_aggr_t * aggr __attribute__((unused)),
         char * err_msg)
 {
+    siridb_variance_t state = SIRIDB_VARIANCE_INIT;
+
 #ifdef DEBUG
     assert (points->len);
 #endif
@@ -1323,7 +2569,8 @@ static int aggr_pvariance(
 
     case TP_INT:
     case TP_DOUBLE:
-        point->val.real = siridb_variance(points) / points->len;
+        siridb_variance_points(&state, points, 0, points->len);
+        point->val.real = siridb_variance_population(&state);
         break;
 
     default:
@@ -1394,6 +2641,8 @@ static int aggr_variance(
         siridb_aggr_t * aggr __attribute__((unused)),
         char * err_msg)
 {
+    siridb_variance_t state = SIRIDB_VARIANCE_INIT;
+
 #ifdef DEBUG
     assert (points->len);
 #endif
@@ -1406,8 +2655,8 @@ static int aggr_variance(
 
     case TP_INT:
     case TP_DOUBLE:
-        point->val.real = (points->len > 1) ?
-                siridb_variance(points) / (points->len - 1) : 0.0;
+        siridb_variance_points(&state, points, 0, points->len);
+        point->val.real = siridb_variance_sample(&state);
         break;
 
     default:
@@ -0,0 +1,163 @@
+/*
+ * arena.c - Allocate memory which is released at once.
+ *
+ * author       : Jeroen van der Heijden
+ * email        : jeroen@transceptor.technology
+ * copyright    : 2016, Transceptor Technology
+ *
+ * A select query creates many point lists which all live until the query
+ * is finished. Allocating those from an arena, which is bound to the query,
+ * keeps them together in a few large blocks and releases them with a single
+ * free() for each block instead of one for each list.
+ *
+ * Memory from an arena cannot be re-allocated or freed on its own. An arena
+ * is not thread safe.
+ *
+ * Since arenas are bound to queries, blocks are counted as query memory.
+ *
+ * changes
+ *  - initial version, 14-10-2016
+ *
+ */
+#include <siri/db/arena.h>
+#include <siri/err.h>
+#include <siri/mem.h>
+#include <stdlib.h>
+
+/* alignment for all allocations, this is the size of a siridb_point_t */
+#define ARENA_ALIGN 16
+#define ARENA_ALIGNED(sz) (((sz) + (ARENA_ALIGN - 1)) & ~(ARENA_ALIGN - 1))
+
+struct siridb_arena_block_s
+{
+    siridb_arena_block_t * prev;
+    size_t size;
+    size_t len;
+    size_t pad_;        /* makes data aligned at ARENA_ALIGN */
+    char data[];
+};
+
+static siridb_arena_block_t * ARENA_new_block(
+        siridb_arena_t * arena,
+        size_t size);
+
+/*
+ * Returns NULL and raises a SIGNAL in case an error has occurred.
+ */
+siridb_arena_t * siridb_arena_new(void)
+{
+    siridb_arena_t * arena =
+            (siridb_arena_t *) malloc(sizeof(siridb_arena_t));
+    if (arena == NULL)
+    {
+        ERR_ALLOC
+    }
+    else
+    {
+        arena->block = NULL;
+        arena->size = 0;
+    }
+    return arena;
+}
+
+/*
+ * Destroy the arena and all memory allocated from it. (parsing NULL is
+ * allowed)
+ */
+void siridb_arena_free(siridb_arena_t * arena)
+{
+    siridb_arena_block_t * block;
+    siridb_arena_block_t * prev;
+
+    if (arena == NULL)
+    {
+        return;
+    }
+
+    for (block = arena->block; block != NULL; block = prev)
+    {
+        prev = block->prev;
+        free(block);
+    }
+
+    siri_mem_sub(SIRI_MEM_QUERY, arena->size);
+    free(arena);
+}
+
+/*
+ * Returns 'size' bytes, aligned at 16 bytes, from the arena.
+ *
+ * Returns NULL and raises a SIGNAL in case an error has occurred.
+ */
+void * siridb_arena_alloc(siridb_arena_t * arena, size_t size)
+{
+    siridb_arena_block_t * block = arena->block;
+    void * data;
+
+    size = ARENA_ALIGNED(size);
+
+    if (block == NULL || block->size - block->len < size)
+    {
+        if (size > SIRIDB_ARENA_BLOCK_SZ / 4)
+        {
+            /*
+             * Large allocations get their own block which is placed behind
+             * the current block so the space left in the current block can
+             * still be used.
+             */
+            block = ARENA_new_block(arena, size);
+            if (block == NULL)
+            {
+                return NULL;
+            }
+            if (arena->block != NULL)
+            {
+                block->prev = arena->block->prev;
+                arena->block->prev = block;
+            }
+            else
+            {
+                arena->block = block;
+            }
+        }
+        else
+        {
+            block = ARENA_new_block(arena, SIRIDB_ARENA_BLOCK_SZ);
+            if (block == NULL)
+            {
+                return NULL;
+            }
+            block->prev = arena->block;
+            arena->block = block;
+        }
+    }
+
+    data = block->data + block->len;
+    block->len += size;
+
+    return data;
+}
+
+/*
+ * Returns NULL and raises a SIGNAL in case an error has occurred.
+ */
+static siridb_arena_block_t * ARENA_new_block(
+        siridb_arena_t * arena,
+        size_t size)
+{
+    siridb_arena_block_t * block = (siridb_arena_block_t *) malloc(
+            sizeof(siridb_arena_block_t) + size);
+    if (block == NULL)
+    {
+        ERR_ALLOC
+    }
+    else
+    {
+        block->prev = NULL;
+        block->size = size;
+        block->len = 0;
+        arena->size += size;
+        siri_mem_add(SIRI_MEM_QUERY, size);
+    }
+    return block;
+}
@@ -0,0 +1,523 @@
+/*
+ * attach.c - Attach shard files which are produced outside the server.
+ *
+ * author       : Jeroen van der Heijden
+ * email        : jeroen@transceptor.technology
+ * copyright    : 2016, Transceptor Technology
+ *
+ * Historical data can be converted to shard files outside the server and
+ * attached to a running database so it does not need to be inserted. The
+ * directory with the files contains:
+ *
+ *  series.map      QPack array with [id, name, tp] for each series where 'id'
+ *                  is the series id which is used in the shard files and
+ *                  'tp' is 0 (integer), 1 (float) or 2 (string).
+ *  <id>.sdb        Shard files, optionally with an <id>.idx index file.
+ *
+ * The shard files must be written like the server writes them, using the
+ * time precision and durations of the database and a series mask which is
+ * equal to the shard id modulo the duration. All series must belong to the
+ * pool of 'this' server and the shards may not exist yet.
+ *
+ * All files are checked first. Next, the series which do not exist are
+ * created and the series ids in the files are replaced with the local ids.
+ * The files are then moved to the shards directory, so the directory must be
+ * on the same file system as the database, and loaded as if the server has
+ * just started.
+ *
+ * changes
+ *  - initial version, 14-10-2016
+ *
+ */
+#include <ctree/ctree.h>
+#include <ctype.h>
+#include <dirent.h>
+#include <imap/imap.h>
+#include <limits.h>
+#include <logger/logger.h>
+#include <qpack/qpack.h>
+#include <siri/db/attach.h>
+#include <siri/db/db.h>
+#include <siri/db/lookup.h>
+#include <siri/db/misc.h>
+#include <siri/db/pools.h>
+#include <siri/db/series.h>
+#include <siri/db/server.h>
+#include <siri/db/shard.h>
+#include <siri/db/shards.h>
+#include <siri/err.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <xpath/xpath.h>
+
+/* enough for an uint64_t shard id, the extension and a terminator */
+#define ATTACH_SHARD_FN_SZ 26
+
+static int ATTACH_read_series(
+        siridb_t * siridb,
+        const char * fn,
+        imap_t * ids,
+        char * err_msg);
+static int ATTACH_shard_id(const char * fn, uint64_t * id);
+static int ATTACH_move(
+        const char * src,
+        const char * dest,
+        const char * ext,
+        char * err_msg);
+static int ATTACH_create_series(
+        siridb_attach_series_t * aseries,
+        siridb_t * siridb);
+static int ATTACH_update_series(
+        siridb_attach_series_t * aseries,
+        siridb_t * siridb);
+static int ATTACH_series_free(siridb_attach_series_t * aseries);
+
+/*
+ * Attach the shard files in directory 'path'.
+ *
+ * Returns the number of attached shards or -1 and 'err_msg' is set in case of
+ * an error. Nothing is changed when a file is found invalid, but in case of a
+ * critical error some shards might be attached. (a SIGNAL might be raised)
+ */
+ssize_t siridb_attach(siridb_t * siridb, const char * path, char * err_msg)
+{
+    char dir[PATH_MAX], src[PATH_MAX], dest[PATH_MAX], fn[PATH_MAX];
+    struct dirent ** shard_list;
+    struct stat st_dir, st_shards;
+    uint64_t * shard_ids = NULL;
+    size_t len = strlen(path);
+    ssize_t attached = 0;
+    size_t n = 0, i;
+    imap_t * ids;
+    int total, rc, created = 0;
+
+    if (siridb_is_reindexing(siridb))
+    {
+        sprintf(err_msg,
+                "Cannot attach shards while the database is re-indexing.");
+        return -1;
+    }
+
+    if (!len || len >= PATH_MAX - ATTACH_SHARD_FN_SZ - 1)
+    {
+        sprintf(err_msg, "Expecting a valid directory.");
+        return -1;
+    }
+
+    snprintf(dir, PATH_MAX, "%s%s", path, (path[len - 1] == '/') ? "" : "/");
+
+    SIRIDB_GET_FN(shards_path, siridb->dbpath, SIRIDB_SHARDS_PATH);
+
+    if (    stat(dir, &st_dir) ||
+            !S_ISDIR(st_dir.st_mode) ||
+            stat(shards_path, &st_shards))
+    {
+        snprintf(err_msg, SIRIDB_MAX_SIZE_ERR_MSG,
+                "Cannot find directory: '%s'", dir);
+        return -1;
+    }
+
+    if (st_dir.st_ino == st_shards.st_ino && st_dir.st_dev == st_shards.st_dev)
+    {
+        sprintf(err_msg, "Cannot attach the shards of the database itself.");
+        return -1;
+    }
+
+    /* the files are moved, not copied */
+    if (st_dir.st_dev != st_shards.st_dev)
+    {
+        sprintf(err_msg,
+                "The directory must be on the same file system as the "
+                "database.");
+        return -1;
+    }
+
+    ids = imap_new();
+    if (ids == NULL)
+    {
+        sprintf(err_msg, "Memory allocation error.");
+        return -1;  /* signal is raised */
+    }
+
+    snprintf(src, PATH_MAX, "%s%s", dir, SIRIDB_ATTACH_SERIES_FN);
+
+    rc = ATTACH_read_series(siridb, src, ids, err_msg);
+
+    if (rc == 0)
+    {
+        total = scandir(dir, &shard_list, NULL, alphasort);
+        if (total < 0)
+        {
+            /* no need to free shard_list when total < 0 */
+            snprintf(err_msg, SIRIDB_MAX_SIZE_ERR_MSG,
+                    "Cannot read directory: '%s'", dir);
+            rc = -1;
+        }
+        else
+        {
+            /* never zero so we do not have to check for NULL */
+            shard_ids = (uint64_t *) malloc((total + 1) * sizeof(uint64_t));
+            if (shard_ids == NULL)
+            {
+                ERR_ALLOC
+                sprintf(err_msg, "Memory allocation error.");
+                rc = -1;
+            }
+
+            for (int k = 0; k < total; k++)
+            {
+                if (    shard_ids != NULL &&
+                        ATTACH_shard_id(shard_list[k]->d_name, &shard_ids[n]))
+                {
+                    n++;
+                }
+                free(shard_list[k]);
+            }
+            free(shard_list);
+        }
+    }
+
+    if (rc == 0 && !n)
+    {
+        snprintf(err_msg, SIRIDB_MAX_SIZE_ERR_MSG,
+                "No shard files found in: '%s'", dir);
+        rc = -1;
+    }
+
+    /* check all shards before anything is changed */
+    for (i = 0; rc == 0 && i < n; i++)
+    {
+        siri_mutex_lock(&siridb->shards_mutex);
+        rc = imap_get(siridb->shards, shard_ids[i]) != NULL;
+        siri_mutex_unlock(&siridb->shards_mutex);
+
+        snprintf(dest, PATH_MAX, "%s%" PRIu64 ".sdb",
+                shards_path, shard_ids[i]);
+
+        if (rc || xpath_file_exist(dest))
+        {
+            snprintf(err_msg, SIRIDB_MAX_SIZE_ERR_MSG,
+                    "Shard %" PRIu64 " already exists.", shard_ids[i]);
+            rc = -1;
+            break;
+        }
+
+        snprintf(src, PATH_MAX, "%s%" PRIu64 ".sdb", dir, shard_ids[i]);
+
+        rc = siridb_shard_attach(siridb, src, shard_ids[i], ids, 0, err_msg);
+    }
+
+    if (rc == 0 && siridb->store == NULL && siridb_series_open_store(siridb))
+    {
+        ERR_FILE
+        sprintf(err_msg, "Cannot open the series store.");
+        rc = -1;
+    }
+
+    if (rc == 0)
+    {
+        siri_rwlock_wrlock(&siridb->series_mutex);
+        rc = imap_walk(ids, (imap_cb) ATTACH_create_series, siridb);
+        if (siridb_series_commit(siridb))
+        {
+            rc = -1;  /* signal is raised */
+        }
+        siri_rwlock_wrunlock(&siridb->series_mutex);
+
+        if (rc)
+        {
+            sprintf(err_msg, "Critical error while creating series.");
+        }
+        created = 1;
+    }
+
+    for (i = 0; rc == 0 && i < n; i++)
+    {
+        snprintf(src, PATH_MAX, "%s%" PRIu64, dir, shard_ids[i]);
+        snprintf(dest, PATH_MAX, "%s%" PRIu64, shards_path, shard_ids[i]);
+        snprintf(fn, PATH_MAX, "%s.sdb", src);
+
+        /* the index file must be in place before the shard is loaded */
+        if (    siridb_shard_attach(
+                    siridb, fn, shard_ids[i], ids, 1, err_msg) ||
+                ATTACH_move(src, dest, ".idx", err_msg) ||
+                ATTACH_move(src, dest, ".sdb", err_msg))
+        {
+            log_critical("Error attaching shard %" PRIu64 ": %s",
+                    shard_ids[i],
+                    err_msg);
+            rc = -1;
+        }
+        else if (siridb_shard_load(siridb, shard_ids[i]))
+        {
+            log_critical("Cannot load attached shard %" PRIu64, shard_ids[i]);
+            snprintf(err_msg, SIRIDB_MAX_SIZE_ERR_MSG,
+                    "Cannot load attached shard %" PRIu64 " (%zd shard(s) "
+                    "are attached).",
+                    shard_ids[i],
+                    attached);
+            rc = -1;
+        }
+        else
+        {
+            attached++;
+        }
+    }
+
+    if (created)
+    {
+        siri_rwlock_wrlock(&siridb->series_mutex);
+        imap_walk(ids, (imap_cb) ATTACH_update_series, siridb);
+        siri_rwlock_wrunlock(&siridb->series_mutex);
+
+        log_info("Attached %zd shard(s) from '%s'", attached, dir);
+    }
+
+    free(shard_ids);
+    imap_free(ids, (imap_free_cb) ATTACH_series_free);
+
+    return rc ? -1 : attached;
+}
+
+/*
+ * Read the series map into 'ids'.
+ *
+ * Returns 0 if successful or -1 and 'err_msg' is set in case of an error.
+ */
+static int ATTACH_read_series(
+        siridb_t * siridb,
+        const char * fn,
+        imap_t * ids,
+        char * err_msg)
+{
+    siridb_attach_series_t * aseries;
+    siridb_series_t * series;
+    qp_unpacker_t * unpacker;
+    qp_obj_t qp_id, qp_name, qp_tp;
+    int tp, rc = 0;
+
+    unpacker = qp_unpacker_ff(fn);
+    if (unpacker == NULL)
+    {
+        snprintf(err_msg, SIRIDB_MAX_SIZE_ERR_MSG,
+                "Cannot read series map: '%s'", fn);
+        return -1;
+    }
+
+    if (!qp_is_array(qp_next(unpacker, NULL)))
+    {
+        snprintf(err_msg, SIRIDB_MAX_SIZE_ERR_MSG,
+                "Expecting an array in series map: '%s'", fn);
+        qp_unpacker_ff_free(unpacker);
+        return -1;
+    }
+
+    while (qp_is_array(tp = qp_next(unpacker, NULL)))
+    {
+        if (    qp_next(unpacker, &qp_id) != QP_INT64 ||
+                qp_next(unpacker, &qp_name) != QP_RAW ||
+                qp_next(unpacker, &qp_tp) != QP_INT64 ||
+                qp_id.via.int64 <= 0 ||
+                qp_id.via.int64 > UINT32_MAX ||
+                qp_tp.via.int64 < TP_INT ||
+                qp_tp.via.int64 > TP_STRING)
+        {
+            rc = -1;
+            break;
+        }
+
+        /* the length of a terminated raw name includes the terminator */
+        if (qp_is_raw_term(&qp_name))
+        {
+            qp_name.len--;
+        }
+
+        if (!qp_name.len || qp_name.len >= SIRIDB_SERIES_NAME_LEN_MAX)
+        {
+            rc = -1;
+            break;
+        }
+
+        char name[qp_name.len + 1];
+        memcpy(name, qp_name.via.raw, qp_name.len);
+        name[qp_name.len] = '\0';
+
+        if (siridb_lookup_sn(siridb->pools->lookup, name) !=
+                siridb->server->pool)
+        {
+            snprintf(err_msg, SIRIDB_MAX_SIZE_ERR_MSG,
+                    "Series '%s' does not belong to the pool of this "
+                    "server.", name);
+            qp_unpacker_ff_free(unpacker);
+            return -1;
+        }
+
+        series = (siridb_series_t *) ct_get(siridb->series, name);
+
+        if (series != NULL && series->tp != qp_tp.via.int64)
+        {
+            snprintf(err_msg, SIRIDB_MAX_SIZE_ERR_MSG,
+                    "Series '%s' has another type than in the series map.",
+                    name);
+            qp_unpacker_ff_free(unpacker);
+            return -1;
+        }
+
+        aseries = (siridb_attach_series_t *) malloc(
+                sizeof(siridb_attach_series_t));
+
+        if (aseries == NULL || (aseries->name = strdup(name)) == NULL)
+        {
+            ERR_ALLOC
+            free(aseries);
+            sprintf(err_msg, "Memory allocation error.");
+            qp_unpacker_ff_free(unpacker);
+            return -1;
+        }
+
+        aseries->id = (series == NULL) ? 0 : series->id;
+        aseries->tp = (uint8_t) qp_tp.via.int64;
+        aseries->mask = siridb_series_mask(siridb, name, aseries->tp);
+        aseries->series = series;
+
+        switch (imap_add(ids, (uint64_t) qp_id.via.int64, aseries))
+        {
+        case 0:
+            continue;
+        case -2:
+            snprintf(err_msg, SIRIDB_MAX_SIZE_ERR_MSG,
+                    "Series id %" PRId64 " is used more than once in the "
+                    "series map.", qp_id.via.int64);
+            break;
+        default:
+            sprintf(err_msg, "Memory allocation error.");
+        }
+
+        ATTACH_series_free(aseries);
+        qp_unpacker_ff_free(unpacker);
+        return -1;
+    }
+
+    if (rc || (tp != QP_END && tp != QP_ARRAY_CLOSE))
+    {
+        snprintf(err_msg, SIRIDB_MAX_SIZE_ERR_MSG,
+                "Expecting [id, name, tp] for each series in series map: "
+                "'%s'", fn);
+        rc = -1;
+    }
+
+    qp_unpacker_ff_free(unpacker);
+
+    return rc;
+}
+
+/*
+ * Returns 1 and sets 'id' when 'fn' is a shard file name or 0 if not.
+ */
+static int ATTACH_shard_id(const char * fn, uint64_t * id)
+{
+    const char * pt = fn;
+
+    if (!isdigit(*pt) || strlen(fn) >= ATTACH_SHARD_FN_SZ)
+    {
+        return 0;
+    }
+
+    while (isdigit(*pt))
+    {
+        pt++;
+    }
+
+    if (strcmp(pt, ".sdb"))
+    {
+        return 0;
+    }
+
+    *id = strtoull(fn, NULL, 10);
+
+    return 1;
+}
+
+/*
+ * Move file 'src' with extension 'ext' to 'dest'. A missing index file is
+ * not an error, a shard which requires an index has been checked already.
+ *
+ * Returns 0 if successful or -1 and 'err_msg' is set in case of an error.
+ */
+static int ATTACH_move(
+        const char * src,
+        const char * dest,
+        const char * ext,
+        char * err_msg)
+{
+    char src_fn[PATH_MAX], dest_fn[PATH_MAX];
+
+    snprintf(src_fn, PATH_MAX, "%s%s", src, ext);
+    snprintf(dest_fn, PATH_MAX, "%s%s", dest, ext);
+
+    if (strcmp(ext, ".idx") == 0 && !xpath_file_exist(src_fn))
+    {
+        return 0;
+    }
+
+    if (rename(src_fn, dest_fn))
+    {
+        snprintf(err_msg, SIRIDB_MAX_SIZE_ERR_MSG,
+                "Cannot move '%s' to '%s'", src_fn, dest_fn);
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Call-back function: imap_cb
+ */
+static int ATTACH_create_series(
+        siridb_attach_series_t * aseries,
+        siridb_t * siridb)
+{
+    if (aseries->series == NULL)
+    {
+        aseries->series = siridb_series_new(
+                siridb,
+                aseries->name,
+                aseries->tp);
+
+        if (aseries->series == NULL)
+        {
+            log_critical("Error creating series: '%s'", aseries->name);
+            return -1;  /* signal is raised */
+        }
+
+        aseries->id = aseries->series->id;
+    }
+    return 0;
+}
+
+/*
+ * Call-back function: imap_cb
+ */
+static int ATTACH_update_series(
+        siridb_attach_series_t * aseries,
+        siridb_t * siridb)
+{
+    if (aseries->series != NULL)
+    {
+        siridb_series_attached(siridb, aseries->series);
+    }
+    aseries->series = NULL;  /* the series might be destroyed */
+    return 0;
+}
+
+/*
+ * Call-back function: imap_free_cb
+ */
+static int ATTACH_series_free(siridb_attach_series_t * aseries)
+{
+    free(aseries->name);
+    free(aseries);
+    return 0;
+}
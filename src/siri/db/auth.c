@@ -14,22 +14,67 @@
 #include <siri/db/auth.h>
 #include <siri/db/db.h>
 #include <siri/db/servers.h>
+#include <siri/db/session.h>
 #include <siri/db/users.h>
 #include <siri/net/protocol.h>
 #include <siri/net/socket.h>
+#include <siri/sched.h>
 #include <siri/siri.h>
 #include <siri/version.h>
 #include <stdlib.h>
 #include <string.h>
 
-cproto_server_t siridb_auth_user_request(
+typedef struct auth_work_s
+{
+    uv_work_t work;
+    uv_stream_t * client;
+    siridb_t * siridb;
+    sirinet_socket_pending_t * pending;
+    uint16_t pid;
+    uint8_t session;
+    int valid;
+    char * username;
+    char * password;
+    char * encrypted;
+} auth_work_t;
+
+static void AUTH_work(uv_work_t * work);
+static void AUTH_work_finish(uv_work_t * work, int status);
+static void AUTH_work_free(auth_work_t * awork);
+static void AUTH_success(
+        uv_stream_t * client,
+        siridb_t * siridb,
+        siridb_user_t * user);
+static void AUTH_send(
         uv_stream_t * client,
+        sirinet_socket_pending_t * pending,
+        uint16_t pid,
+        cproto_server_t tp,
+        const char * token);
+
+/*
+ * Start a user authentication request. The password is verified on a worker
+ * thread so hashing passwords does not block the event loop, the response
+ * is sent when the password is verified. Reading from the client is stopped
+ * until then so no request is handled before the authentication is done.
+ *
+ * When 'session' is 1 (true), a session token is returned with a successful
+ * response, see siridb_auth_session_request().
+ *
+ * This function can raise a SIGNAL.
+ */
+void siridb_auth_user_request(
+        uv_stream_t * client,
+        sirinet_pkg_t * pkg,
         qp_obj_t * qp_username,
         qp_obj_t * qp_password,
-        qp_obj_t * qp_dbname)
+        qp_obj_t * qp_dbname,
+        int session)
 {
     siridb_t * siridb;
     siridb_user_t * user;
+    auth_work_t * awork;
+    sirinet_socket_pending_t * pending;
 
     char dbname[qp_dbname->len + 1];
     memcpy(dbname, qp_dbname->via.raw, qp_dbname->len);
@@ -39,30 +84,140 @@ cproto_server_t siridb_auth_user_request(
     memcpy(username, qp_username->via.raw, qp_username->len);
     username[qp_username->len] = 0;
 
-    char password[qp_password->len + 1];
-    memcpy(password, qp_password->via.raw, qp_password->len);
-    password[qp_password->len] = 0;
+    /* the response must be sent in order with the other responses */
+    pending = sirinet_socket_pending_new(client, 1);
+    if (pending == NULL)
+    {
+        return;  /* signal is raised */
+    }
 
     if ((siridb = siridb_get(siri.siridb_list, dbname)) == NULL)
     {
         log_warning("User authentication request failed: unknown database");
-        return CPROTO_ERR_AUTH_UNKNOWN_DB;
+        AUTH_send(client, pending, pkg->pid, CPROTO_ERR_AUTH_UNKNOWN_DB, NULL);
+        return;
     }
 
-    if ((user = siridb_users_get_user(
-            siridb->users,
-            username,
-            password)) == NULL)
+    if ((user = siridb_users_get_user(siridb->users, username, NULL)) == NULL)
     {
         log_warning("User authentication request failed: invalid credentials");
-        return CPROTO_ERR_AUTH_CREDENTIALS;
+        AUTH_send(
+                client,
+                pending,
+                pkg->pid,
+                CPROTO_ERR_AUTH_CREDENTIALS,
+                NULL);
+        return;
     }
 
-    ((sirinet_socket_t *) client->data)->siridb = siridb;
-    ((sirinet_socket_t *) client->data)->origin = user;
-    siridb_user_incref(user);
+    awork = (auth_work_t *) malloc(sizeof(auth_work_t));
+    if (awork == NULL)
+    {
+        ERR_ALLOC
+        AUTH_send(client, pending, pkg->pid, CPROTO_ERR, NULL);
+        return;
+    }
+
+    awork->username = strdup(username);
+    awork->password = strndup(qp_password->via.raw, qp_password->len);
+    awork->encrypted = strdup(user->password);
 
-    return CPROTO_RES_AUTH_SUCCESS;
+    if (    awork->username == NULL ||
+            awork->password == NULL ||
+            awork->encrypted == NULL)
+    {
+        ERR_ALLOC
+        AUTH_work_free(awork);
+        AUTH_send(client, pending, pkg->pid, CPROTO_ERR, NULL);
+        return;
+    }
+
+    awork->client = client;
+    awork->siridb = siridb;
+    awork->pending = pending;
+    awork->pid = pkg->pid;
+    awork->session = (uint8_t) session;
+    awork->valid = 0;
+    awork->work.data = awork;
+
+    sirinet_socket_incref(client);
+    siridb_incref(siridb);
+
+    siri_sched_queue(
+            SIRI_SCHED_INTERACTIVE,
+            NULL,
+            &awork->work,
+            AUTH_work,
+            AUTH_work_finish);
+}
+
+/*
+ * Authenticate with a session token which is returned by an earlier
+ * authentication. The token can be used once, a successful response has a
+ * new token.
+ *
+ * This function can raise a SIGNAL.
+ */
+void siridb_auth_session_request(
+        uv_stream_t * client,
+        sirinet_pkg_t * pkg,
+        qp_obj_t * qp_token,
+        qp_obj_t * qp_dbname)
+{
+    siridb_t * siridb;
+    siridb_user_t * user;
+    sirinet_socket_pending_t * pending;
+
+    char dbname[qp_dbname->len + 1];
+    memcpy(dbname, qp_dbname->via.raw, qp_dbname->len);
+    dbname[qp_dbname->len] = 0;
+
+    char token[SIRIDB_SESSION_SZ + 1];
+
+    pending = sirinet_socket_pending_new(client, 1);
+    if (pending == NULL)
+    {
+        return;  /* signal is raised */
+    }
+
+    if ((siridb = siridb_get(siri.siridb_list, dbname)) == NULL)
+    {
+        log_warning("Session authentication request failed: unknown database");
+        AUTH_send(client, pending, pkg->pid, CPROTO_ERR_AUTH_UNKNOWN_DB, NULL);
+        return;
+    }
+
+    if (qp_token->len != SIRIDB_SESSION_SZ)
+    {
+        user = NULL;
+    }
+    else
+    {
+        memcpy(token, qp_token->via.raw, SIRIDB_SESSION_SZ);
+        token[SIRIDB_SESSION_SZ] = 0;
+        user = siridb_session_pop(siridb, token);
+    }
+
+    if (user == NULL)
+    {
+        log_warning("Session authentication request failed: invalid token");
+        AUTH_send(
+                client,
+                pending,
+                pkg->pid,
+                CPROTO_ERR_AUTH_CREDENTIALS,
+                NULL);
+        return;
+    }
+
+    AUTH_success(client, siridb, user);
+
+    AUTH_send(
+            client,
+            pending,
+            pkg->pid,
+            CPROTO_RES_AUTH_SUCCESS,
+            (siridb_session_new(siridb, user, token) == 0) ? token : NULL);
 }
 
 /*
@@ -124,3 +279,118 @@ bproto_server_t siridb_auth_server_request(
     return BPROTO_AUTH_SUCCESS;
 }
 
+
+static void AUTH_work(uv_work_t * work)
+{
+    /*
+     * Worker Thread
+     */
+    auth_work_t * awork = (auth_work_t *) work->data;
+
+    awork->valid = siridb_users_check_password(
+            awork->password,
+            awork->encrypted);
+}
+
+static void AUTH_work_finish(uv_work_t * work, int status)
+{
+    /*
+     * Main Thread
+     */
+    auth_work_t * awork = (auth_work_t *) work->data;
+    siridb_t * siridb = awork->siridb;
+    siridb_user_t * user;
+    cproto_server_t tp;
+    char token[SIRIDB_SESSION_SZ + 1];
+    int has_token = 0;
+
+    /* the user might be dropped or changed while the password is checked */
+    user = siridb_users_get_user(siridb->users, awork->username, NULL);
+
+    if (status)
+    {
+        log_error("Cannot verify password: %s", uv_strerror(status));
+        tp = CPROTO_ERR;
+    }
+    else if (
+            !awork->valid ||
+            user == NULL ||
+            strcmp(user->password, awork->encrypted) != 0)
+    {
+        log_warning("User authentication request failed: invalid credentials");
+        tp = CPROTO_ERR_AUTH_CREDENTIALS;
+    }
+    else
+    {
+        AUTH_success(awork->client, siridb, user);
+        has_token = awork->session &&
+                siridb_session_new(siridb, user, token) == 0;
+        tp = CPROTO_RES_AUTH_SUCCESS;
+    }
+
+    AUTH_send(
+            awork->client,
+            awork->pending,
+            awork->pid,
+            tp,
+            has_token ? token : NULL);
+
+    sirinet_socket_decref(awork->client);
+    siridb_decref(siridb);
+    AUTH_work_free(awork);
+}
+
+static void AUTH_work_free(auth_work_t * awork)
+{
+    if (awork->password != NULL)
+    {
+        /* do not leave the plain password in memory */
+        memset(awork->password, 0, strlen(awork->password));
+        free(awork->password);
+    }
+    free(awork->username);
+    free(awork->encrypted);
+    free(awork);
+}
+
+static void AUTH_success(
+        uv_stream_t * client,
+        siridb_t * siridb,
+        siridb_user_t * user)
+{
+    sirinet_socket_t * ssocket = (sirinet_socket_t *) client->data;
+
+    siridb_user_incref(user);
+
+    /* a client may authenticate again on the same connection */
+    if (ssocket->origin != NULL)
+    {
+        siridb_user_t * prev = (siridb_user_t *) ssocket->origin;
+        siridb_user_decref(prev);
+    }
+
+    ssocket->siridb = siridb;
+    ssocket->origin = user;
+}
+
+/*
+ * Send the response with the token as data when 'token' is not NULL.
+ */
+static void AUTH_send(
+        uv_stream_t * client,
+        sirinet_socket_pending_t * pending,
+        uint16_t pid,
+        cproto_server_t tp,
+        const char * token)
+{
+    sirinet_pkg_t * package = (token == NULL) ?
+            sirinet_pkg_new(pid, 0, tp, NULL) :
+            sirinet_pkg_new(
+                    pid,
+                    SIRIDB_SESSION_SZ,
+                    tp,
+                    token);
+
+    /* the slot must be done, also when package is NULL (signal is raised) */
+    sirinet_socket_pending_done(client, pending, package);
+}
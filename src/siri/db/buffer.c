@@ -9,23 +9,103 @@
  *  - initial version, 01-04-2016
  *
  */
+#include <assert.h>
+#include <fcntl.h>
 #include <logger/logger.h>
 #include <siri/db/buffer.h>
 #include <siri/db/db.h>
+#include <siri/db/hotlog.h>
 #include <siri/db/shard.h>
+#include <siri/mem.h>
 #include <siri/siri.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
 #include <unistd.h>
+#include <uv.h>
 #include <xpath/xpath.h>
 
-#define SIRIDB_BUFFER_FN "buffer.dat"
-
 /* when set to 1, no caching is done. 1 is the minimum value. */
 #define SIRIDB_BUFFER_CACHE 64
 
-static int BUFFER_create_new(siridb_t * siridb, siridb_series_t * series);
+/* at most this number of positions is allocated for a burst of new series */
+#define SIRIDB_BUFFER_BURST 4096
+
+static int BUFFER_create_new(
+        siridb_t * siridb,
+        siridb_series_t * series,
+        long int burst);
 static int BUFFER_use_empty(siridb_t * siridb, siridb_series_t * series);
+static int BUFFER_map(siridb_t * siridb, size_t size);
+static void BUFFER_release(siridb_series_t * series);
+static int BUFFER_set_class(
+        siridb_t * siridb,
+        siridb_series_t * series,
+        uint8_t bf_class);
+static int BUFFER_write_header(
+        siridb_t * siridb,
+        long int offset,
+        uint32_t id,
+        size_t len);
+
+/* position of the length and the first point in a series buffer */
+#define BUFFER_LEN_POS(series) ((series)->bf_offset + sizeof(uint32_t))
+#define BUFFER_POINTS_POS(series) (BUFFER_LEN_POS(series) + sizeof(size_t))
+
+/*
+ * The size class of a series buffer is stored in the high byte of the length
+ * so buffer files without classes are read as class 0. A hot series has a
+ * marker for the hot log instead of the length.
+ */
+#define BUFFER_CLASS_SHIFT 56
+#define BUFFER_LEN_MASK ((((size_t) 1) << BUFFER_CLASS_SHIFT) - 1)
+#define BUFFER_LEN_FIELD(siridb, series)                            \
+    (((series)->bf_hot ?                                            \
+        siridb_hotlog_marker(                                       \
+                (siridb)->hotlog->gen,                              \
+                (siridb)->hotlog->size) :                           \
+        (series)->buffer->len) |                                    \
+        ((size_t) (series)->bf_class << BUFFER_CLASS_SHIFT))
+
+/* number of slots a buffer load thread handles at once */
+#define BUFFER_LOAD_BATCH 1024
+
+typedef struct buffer_slot_s
+{
+    siridb_series_t * series;
+    size_t pos;                 /* position in the old buffer file */
+    size_t len;                 /* number of points */
+} buffer_slot_t;
+
+typedef struct buffer_load_s
+{
+    siridb_t * siridb;
+    char * map;
+    size_t size;
+    buffer_slot_t * slots;
+    size_t len;
+    size_t next;
+    off_t offset;               /* size of the new buffer file */
+    int fd;
+    int rc;
+    uv_mutex_t lock;
+} buffer_load_t;
+
+static int BUFFER_load_scan(buffer_load_t * load);
+static void BUFFER_load_worker(void * arg);
+static int BUFFER_load_write(
+        buffer_load_t * load,
+        size_t pos,
+        size_t size,
+        off_t offset);
+
+/* a buffer which is full within this time is moved to a larger class */
+#define BUFFER_PROMOTE_SEC 60
+
+/* a buffer which needs more than this time to fill moves to a smaller class */
+#define BUFFER_DEMOTE_SEC 3600
 
 
 /*
@@ -35,14 +115,24 @@ int siridb_buffer_write_len(
         siridb_t * siridb,
         siridb_series_t * series)
 {
+    size_t len = BUFFER_LEN_FIELD(siridb, series);
+
+    if (siridb->buffer_map != NULL)
+    {
+        memcpy( siridb->buffer_map + BUFFER_LEN_POS(series),
+                &len,
+                sizeof(size_t));
+        return 0;
+    }
+
     return (
         /* go to the series position in buffer */
         fseeko(  siridb->buffer_fp,
-                series->bf_offset + sizeof(uint32_t),
+                BUFFER_LEN_POS(series),
                 SEEK_SET) ||
 
         /* write new length */
-        fwrite( &series->buffer->len,
+        fwrite( &len,
                 sizeof(size_t),
                 1,
                 siridb->buffer_fp) != 1) ? EOF : 0;
@@ -52,6 +142,9 @@ int siridb_buffer_write_len(
  * Waring: we must check if the new point fits inside the buffer before using
  * the 'siridb_buffer_write_point()' function.
  *
+ * When the buffer is mapped, the point is written before the length so a
+ * crash never results in a length which includes a point not written.
+ *
  * Returns 0 if success or EOF in case of an error.
  */
 int siridb_buffer_write_point(
@@ -60,6 +153,15 @@ int siridb_buffer_write_point(
         uint64_t * ts,
         qp_via_t * val)
 {
+    if (siridb->buffer_map != NULL)
+    {
+        char * pt = siridb->buffer_map +
+                BUFFER_POINTS_POS(series) + 16 * (series->buffer->len - 1);
+        memcpy(pt, ts, sizeof(uint64_t));
+        memcpy(pt + sizeof(uint64_t), val, sizeof(qp_via_t));
+        return siridb_buffer_write_len(siridb, series);
+    }
+
     return (
         siridb_buffer_write_len(siridb, series) ||
 
@@ -75,21 +177,187 @@ int siridb_buffer_write_point(
         fwrite(val, sizeof(qp_via_t), 1, siridb->buffer_fp) != 1) ? EOF : 0;
 }
 
+/*
+ * Write the last 'n' points of the series buffer to the buffer file using one
+ * write and update the length once. Argument 'points' must hold those 'n'
+ * points. (order is not important since the buffer is sorted when loaded)
+ *
+ * Waring: we must check if the new points fit inside the buffer before using
+ * the 'siridb_buffer_write_points()' function.
+ *
+ * Returns 0 if success or EOF in case of an error.
+ */
+int siridb_buffer_write_points(
+        siridb_t * siridb,
+        siridb_series_t * series,
+        siridb_point_t * points,
+        size_t n)
+{
+#ifdef DEBUG
+    /* points are written as they are stored in memory */
+    assert (sizeof(siridb_point_t) == 16);
+    assert (n && n <= series->buffer->len);
+#endif
+    size_t offset = BUFFER_POINTS_POS(series) + 16 * (series->buffer->len - n);
+
+    if (siridb->buffer_map != NULL)
+    {
+        memcpy(siridb->buffer_map + offset, points, 16 * n);
+        return siridb_buffer_write_len(siridb, series);
+    }
+
+    return (
+        /* jump to position where to write the new points */
+        fseeko(siridb->buffer_fp, offset, SEEK_SET) ||
+
+        /* write all points at once */
+        fwrite(points, 16, n, siridb->buffer_fp) != n ||
+
+        /* write new length */
+        siridb_buffer_write_len(siridb, series)) ? EOF : 0;
+}
+
 /*
  * Returns 0 if successful; -1 and a SIGNAL is raised in case an error occurred.
  */
 int siridb_buffer_new_series(siridb_t * siridb, siridb_series_t * series)
 {
-    /* allocate new buffer */
-    series->buffer = siridb_points_new(siridb->buffer_len, series->tp);
+    /* the points are allocated on the first write */
+    series->buffer = siridb_points_new(0, series->tp);
     if (series->buffer == NULL)
     {
         return -1;  /* signal is raised */
     }
 
-    return (siridb->empty_buffers->len) ?
+    /*
+     * The new series which are not yet committed are used as an estimate for
+     * the number of series which are created in the same burst.
+     */
+    return (siridb->empty_buffers[series->bf_class]->len) ?
             BUFFER_use_empty(siridb, series) :
-            BUFFER_create_new(siridb, series);
+            BUFFER_create_new(siridb, series, siridb->store_pending);
+}
+
+/*
+ * Use siridb_buffer_reserve() which only calls this function when the buffer
+ * is too small for 'n' more points. The capacity is doubled, starting with
+ * SIRIDB_BUFFER_MIN_CAP, until the points fit and is at most the number of
+ * points for the buffer class.
+ *
+ * Returns 0 if successful or -1 and a SIGNAL is raised in case of an error.
+ */
+int siridb__buffer_grow(
+        siridb_t * siridb,
+        siridb_series_t * series,
+        size_t n)
+{
+    size_t need = series->buffer->len + n;
+    size_t max = siridb_buffer_len(siridb, series);
+    size_t cap = (series->bf_cap) ? series->bf_cap : SIRIDB_BUFFER_MIN_CAP;
+    siridb_point_t * data;
+
+#ifdef DEBUG
+    assert (need <= max);
+#endif
+
+    while (cap < need)
+    {
+        cap <<= 1;
+    }
+
+    if (cap > max)
+    {
+        cap = max;
+    }
+
+    data = (siridb_point_t *) realloc(
+            series->buffer->data,
+            cap * sizeof(siridb_point_t));
+    if (data == NULL)
+    {
+        ERR_ALLOC
+        return -1;
+    }
+
+    siri_mem_sub(SIRI_MEM_BUFFER, siridb_buffer_mem(siridb, series));
+    series->buffer->data = data;
+    series->bf_cap = (uint32_t) cap;
+    siri_mem_add(SIRI_MEM_BUFFER, siridb_buffer_mem(siridb, series));
+
+    return 0;
+}
+
+/*
+ * Should be called when the points in the buffer are written to the shards.
+ * The buffer length is set to 0 and, depending on how fast the buffer was
+ * filled, the series is moved to a larger or smaller buffer class. Larger
+ * buffers for series with many points result in fewer and fuller chunks.
+ *
+ * Memory for the points is only kept for a series which has filled the
+ * buffer within BUFFER_PROMOTE_SEC since such a series fills it again soon.
+ *
+ * When the hot log is used, a series which fills the largest class within
+ * BUFFER_PROMOTE_SEC becomes hot and its points are written to the log until
+ * the buffer takes longer to fill.
+ *
+ * Returns 0 if successful or -1 and a signal is raised in case of an error.
+ */
+int siridb_buffer_reset(siridb_t * siridb, siridb_series_t * series)
+{
+    uint32_t now = (uint32_t) time(NULL);
+    uint8_t bf_class = series->bf_class;
+
+    series->buffer->len = 0;
+
+    if (    !series->bf_flush_ts ||
+            now - series->bf_flush_ts >= BUFFER_PROMOTE_SEC)
+    {
+        BUFFER_release(series);
+    }
+
+    if (series->bf_flush_ts)
+    {
+        uint32_t elapsed = now - series->bf_flush_ts;
+
+        if (series->bf_hot && elapsed >= BUFFER_PROMOTE_SEC)
+        {
+            siridb_hotlog_remove(siridb->hotlog, series);
+        }
+
+        if (    elapsed < BUFFER_PROMOTE_SEC &&
+                bf_class + 1 < SIRIDB_BUFFER_CLASSES &&
+                (siridb->buffer_len << (bf_class + 1)) <=
+                        DEFAULT_MAX_CHUNK_SZ_NUM)
+        {
+            bf_class++;
+        }
+        else if (   elapsed < BUFFER_PROMOTE_SEC &&
+                    !series->bf_hot &&
+                    siridb_hotlog_is_open(siridb) &&
+                    siridb_hotlog_add(siridb->hotlog, series))
+        {
+            return -1;  /* signal is raised */
+        }
+        else if (elapsed > BUFFER_DEMOTE_SEC && bf_class)
+        {
+            bf_class--;
+        }
+    }
+
+    series->bf_flush_ts = now;
+
+    if (bf_class != series->bf_class)
+    {
+        return BUFFER_set_class(siridb, series, bf_class);
+    }
+
+    if (siridb_buffer_write_len(siridb, series))
+    {
+        ERR_FILE
+        return -1;
+    }
+
+    return 0;
 }
 
 /*
@@ -105,23 +373,94 @@ int siridb_buffer_open(siridb_t * siridb)
         return -1;
     }
 
+    if (siri.cfg->buffer_mmap)
+    {
+        struct stat st;
+
+        if (fstat(fileno(siridb->buffer_fp), &st) ||
+            BUFFER_map(siridb, (size_t) st.st_size))
+        {
+            log_critical("Cannot map buffer file '%s'", fn);
+            fclose(siridb->buffer_fp);
+            siridb->buffer_fp = NULL;
+            return -1;
+        }
+    }
+
     return 0;
 }
 
+/*
+ * Unmap (when mapped) and close the buffer file.
+ *
+ * Returns 0 if successful or -1 in case of an error.
+ */
+int siridb_buffer_close(siridb_t * siridb)
+{
+    int rc = siridb_hotlog_is_open(siridb) ?
+            siridb_hotlog_sync(siridb->hotlog) : 0;
+
+    if (siridb->buffer_map != NULL)
+    {
+        rc = munmap(siridb->buffer_map, siridb->buffer_map_sz);
+        siridb->buffer_map = NULL;
+        siridb->buffer_map_sz = 0;
+    }
+
+    if (fclose(siridb->buffer_fp))
+    {
+        rc = -1;
+    }
+    siridb->buffer_fp = NULL;
+
+    return rc;
+}
+
+/*
+ * Synchronize the buffer file and the hot log with the disk.
+ *
+ * Returns 0 if successful or -1 in case of an error.
+ */
+int siridb_buffer_sync(siridb_t * siridb)
+{
+    if (siridb_hotlog_is_open(siridb) && siridb_hotlog_sync(siridb->hotlog))
+    {
+        return -1;
+    }
+
+    if (siridb->buffer_map != NULL)
+    {
+        return msync(siridb->buffer_map, siridb->buffer_map_sz, MS_SYNC);
+    }
+
+    return (fflush(siridb->buffer_fp) ||
+            fsync(fileno(siridb->buffer_fp))) ? -1 : 0;
+}
+
 /*
  * Returns 0 if successful or -1 in case of an error.
  * (signal might be raised)
+ *
+ * The buffer file is mapped and scanned once for the slots in use, which are
+ * compacted into a new buffer file. Reading the points and writing the new
+ * file is done using siri.cfg->shard_load_threads threads.
  */
 int siridb_buffer_load(siridb_t * siridb)
 {
-    FILE * fp;
-    FILE * fp_temp;
-    size_t read_at_once = 8;
-    size_t num, i, j;
-    char buffer[siridb->buffer_size * read_at_once];
-    char * pt;
-    long int offset = 0;
-    siridb_series_t * series;
+    int fd;
+    struct stat st;
+    uint16_t nthreads = siri.cfg->shard_load_threads;
+    uv_thread_t threads[nthreads];
+    uint16_t n;
+    buffer_load_t load = {
+            .siridb=siridb,
+            .map=NULL,
+            .slots=NULL,
+            .len=0,
+            .next=0,
+            .fd=-1,
+            .rc=0
+    };
 
     log_info("Loading and cleanup buffer");
 
@@ -136,8 +475,10 @@ int siridb_buffer_load(siridb_t * siridb)
         return -1;
     }
 
-    if ((fp = fopen(fn, "r")) == NULL)
+    if ((fd = open(fn, O_RDONLY)) == -1)
     {
+        FILE * fp;
+
         if (siridb->series_map->len)
         {
             log_critical("Buffer file '%s' not found.", fn);
@@ -153,75 +494,99 @@ int siridb_buffer_load(siridb_t * siridb)
         return fclose(fp);
     }
 
-    if ((fp_temp = fopen(fn_temp, "w")) == NULL)
+    if (fstat(fd, &st))
     {
-        log_critical("Cannot open '%s' for writing", fn_temp);
-        fclose(fp);
+        log_critical("Cannot read the size of buffer file '%s'", fn);
+        close(fd);
         return -1;
     }
 
-    while ((num = fread(buffer, siridb->buffer_size, read_at_once, fp)))
+    load.size = (size_t) st.st_size;
+
+    if (load.size)
     {
-        for (i = 0; i < num; i++)
+        load.map = (char *) mmap(
+                NULL,
+                load.size,
+                PROT_READ,
+                MAP_PRIVATE,
+                fd,
+                0);
+
+        if (load.map == MAP_FAILED)
         {
+            log_critical("Cannot map buffer file '%s'", fn);
+            close(fd);
+            return -1;
+        }
 
-            pt = buffer + i * siridb->buffer_size;
+        /* the file is mostly read in order */
+        madvise(load.map, load.size, MADV_SEQUENTIAL);
+    }
 
-            series = (siridb_series_t *)
-                    imap_get(siridb->series_map, *((uint32_t *) pt));
+    /* the mapping stays valid after the descriptor is closed */
+    close(fd);
 
-            if (series == NULL)
-            {
-                continue;
-            }
+    if ((load.fd = open(fn_temp, O_WRONLY | O_CREAT | O_TRUNC, 0644)) == -1)
+    {
+        log_critical("Cannot open '%s' for writing", fn_temp);
+        load.rc = -1;
+    }
+    else if (BUFFER_load_scan(&load) || ftruncate(load.fd, load.offset))
+    {
+        log_critical("Cannot load buffer file '%s'", fn);
+        load.rc = -1;
+    }
+    else
+    {
+        /* never start more threads than we have points to read */
+        if (nthreads > load.len / BUFFER_LOAD_BATCH + 1)
+        {
+            nthreads = load.len / BUFFER_LOAD_BATCH + 1;
+        }
 
-            series->buffer = siridb_points_new(siridb->buffer_len, series->tp);
-            if (series->buffer == NULL)
-            {
-                log_critical("Cannot allocate a buffer for series id %u",
-                        series->id);
-                fclose(fp);
-                fclose(fp_temp);
+        uv_mutex_init(&load.lock);
 
-                return -1;  /* signal is raised */
+        for (n = 0; n < nthreads - 1; n++)
+        {
+            if (uv_thread_create(&threads[n], BUFFER_load_worker, &load))
+            {
+                log_error(
+                        "Cannot create thread for loading the buffer, "
+                        "continue with %d thread(s)", n + 1);
+                break;
             }
+        }
 
-            series->bf_offset = offset;
+        /* this thread loads the buffer as well */
+        BUFFER_load_worker(&load);
 
-            pt += sizeof(uint32_t);
+        while (n--)
+        {
+            uv_thread_join(&threads[n]);
+        }
 
-            for (   j = (size_t) *pt, pt += sizeof(size_t);
-                    j--;
-                    pt += 16)
-            {
-                siridb_points_add_point(
-                        series->buffer,
-                        (uint64_t *) pt,
-                        (qp_via_t *) (pt + 8));
-            }
+        uv_mutex_destroy(&load.lock);
+    }
 
-            offset += siridb->buffer_size;
+    if (load.map != NULL)
+    {
+        munmap(load.map, load.size);
+    }
 
-            /* increment series->length which is 0 at this time */
-            series->length += series->buffer->len;
+    free(load.slots);
 
-            /* write to output file and check if write was successful */
-            if ((fwrite(buffer + i * siridb->buffer_size,
-                    siridb->buffer_size, 1, fp_temp) != 1))
-            {
-                log_critical("Could not write to temporary buffer file: '%s'",
-                        fn_temp);
-                fclose(fp);
-                fclose(fp_temp);
+    if (load.fd != -1 && close(load.fd))
+    {
+        load.rc = -1;
+    }
 
-                return -1;
-            }
-        }
+    if (load.rc)
+    {
+        return -1;
     }
 
-    if (fclose(fp) ||
-        fclose(fp_temp) ||
-        rename(fn_temp, fn))
+    if (rename(fn_temp, fn))
     {
         log_critical("Could not rename '%s' to '%s'.", fn_temp, fn);
         return -1;
@@ -242,28 +607,15 @@ int siridb_buffer_load(siridb_t * siridb)
  */
 static int BUFFER_use_empty(siridb_t * siridb, siridb_series_t * series)
 {
-    series->bf_offset = (long int) slist_pop(siridb->empty_buffers);
-
-    /* jump to the correct buffer position */
-    if (fseeko(siridb->buffer_fp, series->bf_offset, SEEK_SET))
-    {
-        ERR_FILE
-        return -1;
-    }
+    series->bf_offset = (long int) slist_pop(
+            siridb->empty_buffers[series->bf_class]);
 
-    /* write series ID to buffer */
-    if (fwrite(&series->id, sizeof(uint32_t), 1, siridb->buffer_fp) != 1)
-    {
-        ERR_FILE
-        return -1;
-    }
-
-    /* write 0 length */
-    if (fwrite(
-            &series->buffer->len,
-            sizeof(size_t),
-            1,
-            siridb->buffer_fp) != 1)
+    /* write series ID and length to buffer */
+    if (BUFFER_write_header(
+            siridb,
+            series->bf_offset,
+            series->id,
+            BUFFER_LEN_FIELD(siridb, series)))
     {
         ERR_FILE
         return -1;
@@ -275,13 +627,27 @@ static int BUFFER_use_empty(siridb_t * siridb, siridb_series_t * series)
 /*
  * Create new space in the buffer and use one position for the new series.
  * The number of positions that will be allocated is defined by
- * SIRIDB_BUFFER_CACHE and must be at least one to hold the new series.
+ * SIRIDB_BUFFER_CACHE and must be at least one to hold the new series. For a
+ * burst of new series, at least 'burst' positions (with a maximum of
+ * SIRIDB_BUFFER_BURST) are allocated so the file is extended and synced
+ * less often.
  *
  * Returns 0 if successful or -1 and a signal is raised in case of an error.
  */
-static int BUFFER_create_new(siridb_t * siridb, siridb_series_t * series)
+static int BUFFER_create_new(
+        siridb_t * siridb,
+        siridb_series_t * series,
+        long int burst)
 {
     long int buffer_pos;
+    long int slot_sz = siridb->buffer_size << series->bf_class;
+    long int num = SIRIDB_BUFFER_CACHE >> series->bf_class;
+
+    if (burst > num)
+    {
+        num = (burst < SIRIDB_BUFFER_BURST) ? burst : SIRIDB_BUFFER_BURST;
+    }
+
     /* get file descriptor */
     int buffer_fd = fileno(siridb->buffer_fp);
 
@@ -305,33 +671,410 @@ static int BUFFER_create_new(siridb_t * siridb, siridb_series_t * series)
         return -1;
     }
 
-    /* write series ID to buffer */
-    if (fwrite(&series->id, sizeof(uint32_t), 1, siridb->buffer_fp) != 1)
+    buffer_pos = series->bf_offset + slot_sz * (num ? num : 1);
+
+    /* fill buffer with zeros */
+    if (ftruncate(buffer_fd, buffer_pos))
     {
         ERR_FILE
         return -1;
     }
 
-    buffer_pos = series->bf_offset + siridb->buffer_size * SIRIDB_BUFFER_CACHE;
+    /* commit changes to disk */
+    if (fsync(buffer_fd))
+    {
+        ERR_FILE
+        return -1;
+    }
 
-    /* fill buffer with zeros */
-    if (ftruncate(buffer_fd, buffer_pos))
+    if (siri.cfg->buffer_mmap && BUFFER_map(siridb, (size_t) buffer_pos))
     {
         ERR_FILE
         return -1;
     }
 
-    /* commit changes to disk */
-    if (fsync(buffer_fd))
+    /* write series ID and length to buffer */
+    if (BUFFER_write_header(
+            siridb,
+            series->bf_offset,
+            series->id,
+            BUFFER_LEN_FIELD(siridb, series)))
+    {
+        ERR_FILE
+        return -1;
+    }
+
+    while ((buffer_pos -= slot_sz) > series->bf_offset)
+    {
+        slist_append_safe(
+                &siridb->empty_buffers[series->bf_class],
+                (void *) buffer_pos);
+    }
+
+    return 0;
+}
+
+/*
+ * (Re)map the buffer file using 'size' bytes. The map is NULL when 'size' is
+ * zero since an empty file cannot be mapped.
+ *
+ * Returns 0 if successful or -1 in case of an error.
+ */
+static int BUFFER_map(siridb_t * siridb, size_t size)
+{
+    char * map;
+
+    if (siridb->buffer_map != NULL)
+    {
+        munmap(siridb->buffer_map, siridb->buffer_map_sz);
+        siridb->buffer_map = NULL;
+        siridb->buffer_map_sz = 0;
+    }
+
+    if (size == 0)
+    {
+        return 0;
+    }
+
+    map = (char *) mmap(
+            NULL,
+            size,
+            PROT_READ | PROT_WRITE,
+            MAP_SHARED,
+            fileno(siridb->buffer_fp),
+            0);
+
+    if (map == MAP_FAILED)
+    {
+        log_critical("Cannot map %zu bytes of the buffer file", size);
+        return -1;
+    }
+
+    siridb->buffer_map = map;
+    siridb->buffer_map_sz = size;
+
+    return 0;
+}
+
+/*
+ * Move an empty series buffer to a slot of another class. The old slot is
+ * released after the new slot is written so a crash in between leaves both
+ * slots, which are both empty, and the extra slot is skipped at load.
+ *
+ * Returns 0 if successful or -1 and a signal is raised in case of an error.
+ */
+static int BUFFER_set_class(
+        siridb_t * siridb,
+        siridb_series_t * series,
+        uint8_t bf_class)
+{
+    long int offset = series->bf_offset;
+    uint8_t old_class = series->bf_class;
+    size_t max = siridb->buffer_len << bf_class;
+
+    /* the buffer is empty, memory of a larger class is not kept */
+    if (series->bf_cap > max)
+    {
+        siridb_point_t * data = (siridb_point_t *) realloc(
+                series->buffer->data,
+                sizeof(siridb_point_t) * max);
+
+        if (data == NULL)
+        {
+            ERR_ALLOC
+            return -1;
+        }
+
+        siri_mem_sub(SIRI_MEM_BUFFER, siridb_buffer_mem(siridb, series));
+        series->buffer->data = data;
+        series->bf_cap = (uint32_t) max;
+        siri_mem_add(SIRI_MEM_BUFFER, siridb_buffer_mem(siridb, series));
+    }
+
+    series->bf_class = bf_class;
+
+    if ((siridb->empty_buffers[bf_class]->len) ?
+            BUFFER_use_empty(siridb, series) :
+            BUFFER_create_new(siridb, series, 0))
+    {
+        return -1;  /* signal is raised */
+    }
+
+    /* release the old slot, the class is kept to skip the slot at load */
+    if (BUFFER_write_header(
+            siridb,
+            offset,
+            0,
+            (size_t) old_class << BUFFER_CLASS_SHIFT))
     {
         ERR_FILE
         return -1;
     }
 
-    while ((buffer_pos -= siridb->buffer_size) > series->bf_offset)
+    slist_append_safe(&siridb->empty_buffers[old_class], (void *) offset);
+
+    log_debug(
+            "Buffer for series id %u moved to class %u (%zu points)",
+            series->id,
+            bf_class,
+            siridb->buffer_len << bf_class);
+
+    return 0;
+}
+
+/*
+ * Release the memory of an empty buffer. Memory is allocated again by
+ * siridb_buffer_reserve() on the next write.
+ */
+static void BUFFER_release(siridb_series_t * series)
+{
+    siri_mem_sub(SIRI_MEM_BUFFER, siridb_buffer_mem(series->siridb, series));
+    free(series->buffer->data);
+    series->buffer->data = NULL;
+    series->bf_cap = 0;
+}
+
+/*
+ * Write the series id and length field of the slot at 'offset'.
+ *
+ * Returns 0 if success or EOF in case of an error.
+ */
+static int BUFFER_write_header(
+        siridb_t * siridb,
+        long int offset,
+        uint32_t id,
+        size_t len)
+{
+    if (siridb->buffer_map != NULL)
     {
-        slist_append_safe(&siridb->empty_buffers, (void *) buffer_pos);
+        memcpy(siridb->buffer_map + offset, &id, sizeof(uint32_t));
+        memcpy( siridb->buffer_map + offset + sizeof(uint32_t),
+                &len,
+                sizeof(size_t));
+        return 0;
     }
 
+    return (
+        fseeko(siridb->buffer_fp, offset, SEEK_SET) ||
+        fwrite(&id, sizeof(uint32_t), 1, siridb->buffer_fp) != 1 ||
+        fwrite(&len, sizeof(size_t), 1, siridb->buffer_fp) != 1) ? EOF : 0;
+}
+
+/*
+ * Scan the mapped buffer file for slots which are in use. Buffers for the
+ * series are allocated and bound to their position in the new buffer file.
+ *
+ * Returns 0 if successful or -1 in case of an error.
+ * (signal might be raised)
+ */
+static int BUFFER_load_scan(buffer_load_t * load)
+{
+    siridb_t * siridb = load->siridb;
+    siridb_series_t * series;
+    size_t pos, len, bf_class, slot_sz, marker;
+    size_t size = 0;
+    uint32_t id;
+
+    load->offset = 0;
+
+    for (   pos = 0;
+            pos + siridb->buffer_size <= load->size;
+            pos += slot_sz)
+    {
+        memcpy(&id, load->map + pos, sizeof(uint32_t));
+        memcpy(&len, load->map + pos + sizeof(uint32_t), sizeof(size_t));
+
+        bf_class = len >> BUFFER_CLASS_SHIFT;
+        len &= BUFFER_LEN_MASK;
+
+        /* the points of a hot series are read from the hot log */
+        marker = (len & SIRIDB_HOTLOG_HOT_BIT) ? len : 0;
+        if (marker)
+        {
+            len = 0;
+        }
+
+        if (bf_class >= SIRIDB_BUFFER_CLASSES)
+        {
+            log_critical("Invalid buffer class found at position %zu", pos);
+            return -1;
+        }
+
+        slot_sz = siridb->buffer_size << bf_class;
+
+        if (pos + slot_sz > load->size)
+        {
+            log_critical("Unexpected end of buffer at position %zu", pos);
+            return -1;
+        }
+
+        series = (siridb_series_t *) dmap_get(siridb->series_map, id);
+
+        if (series == NULL)
+        {
+            continue;
+        }
+
+        if (series->buffer != NULL)
+        {
+            /* left behind when moving the series to another buffer class */
+            log_warning("Skip extra buffer for series id %u", series->id);
+            continue;
+        }
+
+        if (len > (slot_sz - sizeof(uint32_t) - sizeof(size_t)) / 16)
+        {
+            log_critical("Invalid buffer length for series id %u", series->id);
+            return -1;
+        }
+
+        series->buffer = siridb_points_new(0, series->tp);
+        series->bf_offset = load->offset;
+        series->bf_class = (uint8_t) bf_class;
+
+        /* only series with points in the buffer allocate memory */
+        if (    series->buffer == NULL ||
+                (len && siridb__buffer_grow(siridb, series, len)))
+        {
+            log_critical("Cannot allocate a buffer for series id %u",
+                    series->id);
+            return -1;  /* signal is raised */
+        }
+
+        if (    marker &&
+                imap_add(siridb->hotlog->markers, id, (void *) marker) == -1)
+        {
+            ERR_ALLOC
+            return -1;
+        }
+
+        if (load->len == size)
+        {
+            buffer_slot_t * tmp;
+            size = (size) ? size * 2 : BUFFER_LOAD_BATCH;
+            tmp = (buffer_slot_t *) realloc(
+                    load->slots,
+                    size * sizeof(buffer_slot_t));
+            if (tmp == NULL)
+            {
+                ERR_ALLOC
+                return -1;
+            }
+            load->slots = tmp;
+        }
+
+        load->slots[load->len].series = series;
+        load->slots[load->len].pos = pos;
+        load->slots[load->len].len = len;
+        load->len++;
+
+        load->offset += slot_sz;
+    }
+
+    return 0;
+}
+
+/*
+ * Thread for loading the buffer. Each thread takes the next batch of slots
+ * until all slots are loaded or an error has occurred. Each slot belongs to
+ * another series so series can be changed without a lock.
+ */
+static void BUFFER_load_worker(void * arg)
+{
+    buffer_load_t * load = (buffer_load_t *) arg;
+    siridb_t * siridb = load->siridb;
+    buffer_slot_t * slot;
+    siridb_series_t * series;
+    size_t i, end, j, slot_sz;
+    size_t run_pos, run_sz;
+    off_t run_offset;
+    char * pt;
+
+    while (1)
+    {
+        uv_mutex_lock(&load->lock);
+
+        if (load->rc || siri_err || load->next == load->len)
+        {
+            uv_mutex_unlock(&load->lock);
+            return;
+        }
+
+        i = load->next;
+        end = load->next = (load->len - i > BUFFER_LOAD_BATCH) ?
+                i + BUFFER_LOAD_BATCH : load->len;
+
+        uv_mutex_unlock(&load->lock);
+
+        run_pos = load->slots[i].pos;
+        run_offset = load->slots[i].series->bf_offset;
+        run_sz = 0;
+
+        for (; i < end; i++)
+        {
+            slot = load->slots + i;
+            series = slot->series;
+            slot_sz = siridb->buffer_size << series->bf_class;
+
+            for (   j = slot->len,
+                    pt = load->map + slot->pos +
+                        sizeof(uint32_t) + sizeof(size_t);
+                    j--;
+                    pt += 16)
+            {
+                siridb_points_add_point(
+                        series->buffer,
+                        (uint64_t *) pt,
+                        (qp_via_t *) (pt + 8));
+            }
+
+            /* increment series->length which is 0 at this time */
+            series->length += series->buffer->len;
+
+            /* slots which are in order are written to the new file at once */
+            if (run_pos + run_sz != slot->pos)
+            {
+                if (BUFFER_load_write(load, run_pos, run_sz, run_offset))
+                {
+                    return;
+                }
+                run_pos = slot->pos;
+                run_offset = series->bf_offset;
+                run_sz = 0;
+            }
+
+            run_sz += slot_sz;
+        }
+
+        if (BUFFER_load_write(load, run_pos, run_sz, run_offset))
+        {
+            return;
+        }
+    }
+}
+
+/*
+ * Write 'size' bytes at position 'pos' in the old buffer file to 'offset' in
+ * the new buffer file.
+ *
+ * Returns 0 if successful or -1 in case of an error.
+ */
+static int BUFFER_load_write(
+        buffer_load_t * load,
+        size_t pos,
+        size_t size,
+        off_t offset)
+{
+    if (pwrite(load->fd, load->map + pos, size, offset) != (ssize_t) size)
+    {
+        log_critical(
+                "Could not write to temporary buffer file for database '%s'",
+                load->siridb->dbname);
+
+        uv_mutex_lock(&load->lock);
+        load->rc = -1;
+        uv_mutex_unlock(&load->lock);
+        return -1;
+    }
     return 0;
 }
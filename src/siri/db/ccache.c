@@ -0,0 +1,315 @@
+/*
+ * ccache.c - Cache for decoded shard chunks.
+ *
+ * author       : Jeroen van der Heijden
+ * email        : jeroen@transceptor.technology
+ * copyright    : 2016, Transceptor Technology
+ *
+ * Decoding a compressed chunk is relatively expensive and the same chunks,
+ * for example the last hours of popular series, are selected over and over
+ * again. This cache holds decoded chunks and is shared by all databases.
+ *
+ * Entries are identified by the shard and the position of the chunk within
+ * the shard file. Data at a given position in a shard file never changes
+ * until the shard is replaced by an optimize task or the shard is dropped,
+ * so entries must be removed in those cases. When the cache is full the
+ * least recently used entries are removed.
+ *
+ * The cache is protected by its own mutex since it is used by both the main
+ * and the optimize thread.
+ *
+ * changes
+ *  - initial version, 14-10-2016
+ *
+ */
+#include <siri/db/ccache.h>
+#include <siri/db/shard.h>
+#include <siri/err.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct siridb_ccache_entry_s
+{
+    siridb_shard_t * shard;
+    uint32_t pos;
+    uint16_t len;
+    siridb_ccache_entry_t * prev;   /* towards head (more recent) */
+    siridb_ccache_entry_t * next;   /* towards tail (less recent) */
+    siridb_ccache_entry_t * hnext;  /* next in bucket */
+    siridb_point_t data[];
+};
+
+#define CCACHE_ENTRY_SZ(len) \
+    (sizeof(siridb_ccache_entry_t) + (len) * sizeof(siridb_point_t))
+
+#define CCACHE_BUCKET(ccache, shard, pos)                                   \
+    ((ccache)->buckets +                                                    \
+        (((shard)->id * 2654435761U + (pos)) & (SIRIDB_CCACHE_BUCKETS - 1)))
+
+static siridb_ccache_entry_t ** CCACHE_find(
+        siridb_ccache_t * ccache,
+        siridb_shard_t * shard,
+        uint32_t pos);
+static void CCACHE_unlink(
+        siridb_ccache_t * ccache,
+        siridb_ccache_entry_t ** entry);
+
+/*
+ * Returns NULL and raises a SIGNAL in case an error has occurred.
+ *
+ * A 'max_size' of 0 (zero) disables the cache.
+ */
+siridb_ccache_t * siridb_ccache_new(size_t max_size)
+{
+    siridb_ccache_t * ccache =
+            (siridb_ccache_t *) calloc(1, sizeof(siridb_ccache_t));
+    if (ccache == NULL)
+    {
+        ERR_ALLOC
+    }
+    else
+    {
+        ccache->max_size = max_size;
+        uv_mutex_init(&ccache->mutex);
+    }
+    return ccache;
+}
+
+void siridb_ccache_free(siridb_ccache_t * ccache)
+{
+    if (ccache == NULL)
+    {
+        return;
+    }
+
+    siridb_ccache_entry_t * entry = ccache->head;
+    siridb_ccache_entry_t * next;
+
+    for (; entry != NULL; entry = next)
+    {
+        next = entry->next;
+        free(entry);
+    }
+
+    uv_mutex_destroy(&ccache->mutex);
+    free(ccache);
+}
+
+/*
+ * Copy the cached points for the chunk at 'pos' in 'shard' to 'dest'.
+ * Argument 'dest' must have space for 'len' points.
+ *
+ * Returns 0 when found or -1 if the chunk is not in the cache.
+ */
+int siridb_ccache_get(
+        siridb_ccache_t * ccache,
+        siridb_shard_t * shard,
+        uint32_t pos,
+        siridb_point_t * dest,
+        uint16_t len)
+{
+    siridb_ccache_entry_t * entry;
+    int rc = -1;
+
+    uv_mutex_lock(&ccache->mutex);
+
+    entry = *CCACHE_find(ccache, shard, pos);
+
+    if (entry != NULL && entry->len == len)
+    {
+        memcpy(dest, entry->data, len * sizeof(siridb_point_t));
+
+        /* move the entry to the head of the list */
+        if (entry != ccache->head)
+        {
+            entry->prev->next = entry->next;
+            if (entry->next == NULL)
+            {
+                ccache->tail = entry->prev;
+            }
+            else
+            {
+                entry->next->prev = entry->prev;
+            }
+            entry->prev = NULL;
+            entry->next = ccache->head;
+            ccache->head->prev = entry;
+            ccache->head = entry;
+        }
+
+        ccache->hits++;
+        rc = 0;
+    }
+    else
+    {
+        ccache->misses++;
+    }
+
+    uv_mutex_unlock(&ccache->mutex);
+
+    return rc;
+}
+
+/*
+ * Add decoded points for the chunk at 'pos' in 'shard' to the cache. Least
+ * recently used entries are removed to make room for the new entry.
+ *
+ * The cache is not critical so when allocating memory fails the points are
+ * simply not cached.
+ */
+void siridb_ccache_set(
+        siridb_ccache_t * ccache,
+        siridb_shard_t * shard,
+        uint32_t pos,
+        const siridb_point_t * points,
+        uint16_t len)
+{
+    size_t size = CCACHE_ENTRY_SZ(len);
+    siridb_ccache_entry_t ** bucket;
+    siridb_ccache_entry_t * entry;
+
+    if (size > ccache->max_size)
+    {
+        return;
+    }
+
+    uv_mutex_lock(&ccache->mutex);
+
+    if (*CCACHE_find(ccache, shard, pos) == NULL)
+    {
+        while (ccache->size + size > ccache->max_size)
+        {
+            entry = ccache->tail;
+            CCACHE_unlink(
+                    ccache,
+                    CCACHE_find(ccache, entry->shard, entry->pos));
+        }
+
+        entry = (siridb_ccache_entry_t *) malloc(size);
+
+        if (entry != NULL)
+        {
+            entry->shard = shard;
+            entry->pos = pos;
+            entry->len = len;
+            memcpy(entry->data, points, len * sizeof(siridb_point_t));
+
+            bucket = CCACHE_BUCKET(ccache, shard, pos);
+            entry->hnext = *bucket;
+            *bucket = entry;
+
+            entry->prev = NULL;
+            entry->next = ccache->head;
+            if (ccache->head == NULL)
+            {
+                ccache->tail = entry;
+            }
+            else
+            {
+                ccache->head->prev = entry;
+            }
+            ccache->head = entry;
+
+            ccache->size += size;
+        }
+    }
+
+    uv_mutex_unlock(&ccache->mutex);
+}
+
+/*
+ * Remove the chunk at 'pos' in 'shard' from the cache, if cached.
+ */
+void siridb_ccache_drop(
+        siridb_ccache_t * ccache,
+        siridb_shard_t * shard,
+        uint32_t pos)
+{
+    siridb_ccache_entry_t ** entry;
+
+    uv_mutex_lock(&ccache->mutex);
+
+    entry = CCACHE_find(ccache, shard, pos);
+    if (*entry != NULL)
+    {
+        CCACHE_unlink(ccache, entry);
+    }
+
+    uv_mutex_unlock(&ccache->mutex);
+}
+
+/*
+ * Remove all chunks for 'shard' from the cache.
+ */
+void siridb_ccache_drop_shard(
+        siridb_ccache_t * ccache,
+        siridb_shard_t * shard)
+{
+    siridb_ccache_entry_t * entry;
+    siridb_ccache_entry_t * next;
+
+    uv_mutex_lock(&ccache->mutex);
+
+    for (entry = ccache->head; entry != NULL; entry = next)
+    {
+        next = entry->next;
+        if (entry->shard == shard)
+        {
+            CCACHE_unlink(ccache, CCACHE_find(ccache, shard, entry->pos));
+        }
+    }
+
+    uv_mutex_unlock(&ccache->mutex);
+}
+
+/*
+ * Returns the address of the pointer to the entry, or the address of the
+ * NULL pointer which ends the bucket when the entry is not found.
+ */
+static siridb_ccache_entry_t ** CCACHE_find(
+        siridb_ccache_t * ccache,
+        siridb_shard_t * shard,
+        uint32_t pos)
+{
+    siridb_ccache_entry_t ** entry = CCACHE_BUCKET(ccache, shard, pos);
+
+    for (;  *entry != NULL &&
+            ((*entry)->shard != shard || (*entry)->pos != pos);
+            entry = &(*entry)->hnext);
+
+    return entry;
+}
+
+/*
+ * Remove and free an entry. Argument 'entry' must be the address returned
+ * by CCACHE_find() for an existing entry.
+ */
+static void CCACHE_unlink(
+        siridb_ccache_t * ccache,
+        siridb_ccache_entry_t ** entry)
+{
+    siridb_ccache_entry_t * tmp = *entry;
+
+    *entry = tmp->hnext;
+
+    if (tmp->prev == NULL)
+    {
+        ccache->head = tmp->next;
+    }
+    else
+    {
+        tmp->prev->next = tmp->next;
+    }
+
+    if (tmp->next == NULL)
+    {
+        ccache->tail = tmp->prev;
+    }
+    else
+    {
+        tmp->next->prev = tmp->prev;
+    }
+
+    ccache->size -= CCACHE_ENTRY_SZ(tmp->len);
+    free(tmp);
+}
@@ -0,0 +1,283 @@
+/*
+ * coalesce.c - Merge inserts which are forwarded to the same pool.
+ *
+ * author       : Jeroen van der Heijden
+ * email        : jeroen@transceptor.technology
+ * copyright    : 2016, Transceptor Technology
+ *
+ * Each client insert is split by pool and without merging, each part for
+ * another pool is sent as a package with its own promise and timer. Many
+ * small inserts therefore result in many small packages between servers.
+ *
+ * When insert_coalesce_window is set, the parts for a pool are appended to
+ * a single open insert map for this pool. The map is sent when the window
+ * has passed or when the map has reached SIRIDB_COALESCE_MAX_SIZE. The
+ * response of the pool is passed to each of the merged inserts.
+ *
+ * changes
+ *  - initial version, 14-10-2016
+ *
+ */
+#include <logger/logger.h>
+#include <siri/db/coalesce.h>
+#include <siri/db/pool.h>
+#include <siri/err.h>
+#include <siri/net/pkg.h>
+#include <siri/net/promise.h>
+#include <siri/siri.h>
+#include <stdlib.h>
+
+#define COALESCE_TIMEOUT 300000  // 5 minutes, equal to the insert timeout
+
+static siridb_coalesce_t * COALESCE_new(
+        siridb_t * siridb,
+        uint16_t pool,
+        uint8_t tp);
+static void COALESCE_free(siridb_coalesce_t * coalesce);
+static void COALESCE_on_timer(uv_timer_t * timer);
+static void COALESCE_flush(siridb_coalesce_t * coalesce);
+static void COALESCE_on_response(
+        sirinet_promise_t * promise,
+        sirinet_pkg_t * pkg,
+        int status);
+static void COALESCE_resolve(
+        siridb_coalesce_t * coalesce,
+        siridb_server_t * server,
+        sirinet_pkg_t * pkg);
+
+/*
+ * Append the points in 'packer' to the merged insert for 'pool'. A promise is
+ * added to 'promises' when the pool has responded, just as for a package
+ * which is sent with sirinet_promises_on_response() as call-back.
+ *
+ * The packer is destroyed by this function, also when an error has occurred.
+ *
+ * Returns 0 if successful or -1 and a SIGNAL is raised in case of an error.
+ */
+int siridb_coalesce_add(
+        siridb_t * siridb,
+        uint16_t pool,
+        uint8_t tp,
+        qp_packer_t * packer,
+        sirinet_promises_t * promises)
+{
+    siridb_coalesce_t * coalesce = siridb->pools->pool[pool].coalesce;
+
+    /* skip the package header and the QP_MAP_OPEN of the packer */
+    size_t offset = sizeof(sirinet_pkg_t) + 1;
+
+    if (coalesce != NULL && coalesce->tp != tp)
+    {
+        COALESCE_flush(coalesce);
+        coalesce = NULL;
+    }
+
+    if (    (coalesce == NULL &&
+            (coalesce = COALESCE_new(siridb, pool, tp)) == NULL) ||
+            slist_append_safe(&coalesce->waiters, promises))
+    {
+        if (coalesce != NULL)
+        {
+            ERR_ALLOC
+        }
+        qp_packer_free(packer);
+        return -1;
+    }
+
+    if (qp_packer_extend_mem(
+            coalesce->packer,
+            packer->buffer + offset,
+            packer->len - offset))
+    {
+        ERR_ALLOC
+        coalesce->waiters->len--;
+        qp_packer_free(packer);
+        return -1;
+    }
+
+    qp_packer_free(packer);
+
+    if (coalesce->packer->len >= SIRIDB_COALESCE_MAX_SIZE)
+    {
+        COALESCE_flush(coalesce);
+    }
+
+    return 0;
+}
+
+/*
+ * Returns NULL and raises a SIGNAL in case an error has occurred.
+ */
+static siridb_coalesce_t * COALESCE_new(
+        siridb_t * siridb,
+        uint16_t pool,
+        uint8_t tp)
+{
+    siridb_coalesce_t * coalesce =
+            (siridb_coalesce_t *) malloc(sizeof(siridb_coalesce_t));
+
+    if (coalesce == NULL)
+    {
+        ERR_ALLOC
+        return NULL;
+    }
+
+    coalesce->pool = pool;
+    coalesce->tp = tp;
+    coalesce->siridb = siridb;
+    coalesce->packer = sirinet_packer_new(QP_SUGGESTED_SIZE);
+    coalesce->waiters = slist_new(SLIST_DEFAULT_SIZE);
+    coalesce->timer = (uv_timer_t *) malloc(sizeof(uv_timer_t));
+
+    if (    coalesce->packer == NULL ||
+            coalesce->waiters == NULL ||
+            coalesce->timer == NULL)
+    {
+        ERR_ALLOC
+        if (coalesce->packer != NULL)
+        {
+            qp_packer_free(coalesce->packer);
+        }
+        free(coalesce->waiters);
+        free(coalesce->timer);
+        free(coalesce);
+        return NULL;
+    }
+
+    /* cannot raise a signal since enough space is allocated */
+    qp_add_type(coalesce->packer, QP_MAP_OPEN);
+
+    /* the database cannot be destroyed while the insert is not sent */
+    siridb_incref(siridb);
+
+    siridb->pools->pool[pool].coalesce = coalesce;
+
+    coalesce->timer->data = coalesce;
+    uv_timer_init(siri.loop, coalesce->timer);
+    uv_timer_start(
+            coalesce->timer,
+            COALESCE_on_timer,
+            siri.cfg->insert_coalesce_window,
+            0);
+
+    return coalesce;
+}
+
+static void COALESCE_free(siridb_coalesce_t * coalesce)
+{
+    siridb_t * siridb = coalesce->siridb;
+
+    if (coalesce->packer != NULL)
+    {
+        qp_packer_free(coalesce->packer);
+    }
+    slist_free(coalesce->waiters);
+    free(coalesce);
+
+    siridb_decref(siridb);
+}
+
+static void COALESCE_on_timer(uv_timer_t * timer)
+{
+    COALESCE_flush((siridb_coalesce_t *) timer->data);
+}
+
+/*
+ * Send the merged insert to the pool. From now on new inserts for the pool
+ * are merged into a new insert.
+ */
+static void COALESCE_flush(siridb_coalesce_t * coalesce)
+{
+    siridb_pool_t * pool = coalesce->siridb->pools->pool + coalesce->pool;
+    sirinet_pkg_t * pkg;
+
+    pool->coalesce = NULL;
+
+    uv_timer_stop(coalesce->timer);
+    uv_close((uv_handle_t *) coalesce->timer, (uv_close_cb) free);
+
+    pkg = sirinet_packer2pkg(coalesce->packer, 0, coalesce->tp);
+    coalesce->packer = NULL;
+
+    if (siridb_pool_send_pkg(
+            pool,
+            pkg,
+            COALESCE_TIMEOUT,
+            COALESCE_on_response,
+            coalesce,
+            0))
+    {
+        free(pkg);
+        log_error(
+                "Cannot send %zu merged insert(s) to pool %u",
+                coalesce->waiters->len,
+                coalesce->pool);
+        COALESCE_resolve(coalesce, pool->server[0], NULL);
+    }
+}
+
+static void COALESCE_on_response(
+        sirinet_promise_t * promise,
+        sirinet_pkg_t * pkg,
+        int status)
+{
+    siridb_coalesce_t * coalesce = (siridb_coalesce_t *) promise->data;
+
+    if (status)
+    {
+        /* we already have a log entry so this can be a debug log */
+        log_debug(
+                "Error occurred while sending package to '%s' (%s)",
+                promise->server->name,
+                sirinet_promise_strstatus((sirinet_promise_status_t) status));
+    }
+
+    COALESCE_resolve(coalesce, promise->server, status ? NULL : pkg);
+
+    sirinet_promise_decref(promise);
+}
+
+/*
+ * Add a promise with a copy of the response to each of the merged inserts.
+ * A response of NULL is used when sending has failed. The promises are
+ * destroyed by the callback of the inserts and 'coalesce' is destroyed by
+ * this function.
+ */
+static void COALESCE_resolve(
+        siridb_coalesce_t * coalesce,
+        siridb_server_t * server,
+        sirinet_pkg_t * pkg)
+{
+    sirinet_promises_t * promises;
+    sirinet_promise_t * promise;
+
+    for (size_t i = 0; i < coalesce->waiters->len; i++)
+    {
+        promises = (sirinet_promises_t *) coalesce->waiters->data[i];
+        promise = (sirinet_promise_t *) malloc(sizeof(sirinet_promise_t));
+
+        if (promise == NULL)
+        {
+            /* the insert reports a critical error for a NULL promise */
+            ERR_ALLOC
+        }
+        else
+        {
+            promise->pid = 0;
+            promise->ref = 1;
+            promise->expire = 0;
+            promise->cb = NULL;
+            promise->server = server;
+            promise->pkg = NULL;
+
+            /* we can ignore errors from sirinet_pkg_dup() */
+            promise->data = (pkg == NULL) ? NULL : sirinet_pkg_dup(pkg);
+        }
+
+        slist_append(promises->promises, (void *) promise);
+
+        SIRINET_PROMISES_CHECK(promises)
+    }
+
+    COALESCE_free(coalesce);
+}
@@ -0,0 +1,959 @@
+/*
+ * compress.c - Compression for shard chunks.
+ *
+ * author       : Jeroen van der Heijden
+ * email        : jeroen@transceptor.technology
+ * copyright    : 2016, Transceptor Technology
+ *
+ * Time-stamps are stored as delta-of-delta values and values are stored as
+ * the XOR with the previous value. (both integer and float values) Most
+ * series are written at a regular interval, so a delta-of-delta is usually
+ * zero and requires only one bit.
+ *
+ * Chunk layout (bit stream, most significant bit first):
+ *
+ *  first point:
+ *      ts_sz * 8 bits      time-stamp
+ *      64 bits             value
+ *
+ *  each next point:
+ *      time-stamp, zigzag encoded delta-of-delta 'd':
+ *          '0'             d == 0
+ *          '10'            + 7 bits
+ *          '110'           + 9 bits
+ *          '1110'          + 12 bits
+ *          '11110'         + 32 bits
+ *          '11111'         + 64 bits
+ *
+ *      value, 'x' is the XOR with the previous value:
+ *          '0'             x == 0
+ *          '10'            + meaningful bits using the previous window
+ *          '11'            + 5 bits leading zeros
+ *                          + 6 bits number of meaningful bits minus one
+ *                          + meaningful bits
+ *
+ * Shards with schema 21 or higher start a compressed chunk with one byte for
+ * the encoding, see siridb_compress_chunk(). Counters and status codes often
+ * have a small range of values within a chunk, so integer chunks are written
+ * with a frame of reference encoding when this is smaller:
+ *
+ *      ts_sz * 8 bits      time-stamp of the first point
+ *      64 bits             base, the minimum value in the chunk
+ *      8 bits              width 'w'
+ *      len * w bits        value minus base for each point, packed with the
+ *                          least significant bit first and padded to a byte
+ *      time-stamps of the next points, like above
+ *
+ * A packed value can be read from a single unaligned 64 bit word, so values
+ * are unpacked without branches and each value is independent.
+ *
+ * Log chunks use a dictionary with the distinct string values of the chunk
+ * since log series usually repeat a small number of event or status values.
+ *
+ * Log chunk layout (bytes):
+ *
+ *      len * ts_sz         time-stamps
+ *      2                   number of distinct values 'n'
+ *      len * 1 or 2        dictionary index for each point (2 when n > 256)
+ *      n values            the distinct values, each terminated by a zero
+ *
+ * changes
+ *  - initial version, 14-10-2016
+ *
+ */
+#include <siri/db/compress.h>
+#include <siri/err.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* a packed value and its bit offset must fit in one 64 bit word */
+#define COMPRESS_FOR_MAX_WIDTH 56
+
+typedef struct compress_writer_s
+{
+    unsigned char * pt;
+    uint64_t acc;
+    int nbits;
+} compress_writer_t;
+
+typedef struct compress_reader_s
+{
+    const unsigned char * pt;
+    const unsigned char * end;
+    uint64_t acc;
+    int nbits;
+    int bad;
+} compress_reader_t;
+
+static inline void COMPRESS_write32(
+        compress_writer_t * writer,
+        uint64_t val,
+        int n);
+static inline void COMPRESS_write(
+        compress_writer_t * writer,
+        uint64_t val,
+        int n);
+static inline uint64_t COMPRESS_read32(compress_reader_t * reader, int n);
+static inline uint64_t COMPRESS_read(compress_reader_t * reader, int n);
+static inline void COMPRESS_write_dod(compress_writer_t * writer, uint64_t zz);
+static inline int COMPRESS_dod_bits(uint64_t zz);
+static inline uint64_t COMPRESS_read_dod(compress_reader_t * reader);
+static int COMPRESS_for_width(
+        siridb_points_t * points,
+        uint_fast32_t start,
+        uint_fast32_t end,
+        uint64_t * base);
+static size_t COMPRESS_for_sz(
+        siridb_points_t * points,
+        uint_fast32_t start,
+        uint_fast32_t end,
+        size_t ts_sz,
+        int w);
+static size_t COMPRESS_for(
+        unsigned char * buf,
+        siridb_points_t * points,
+        uint_fast32_t start,
+        uint_fast32_t end,
+        size_t ts_sz,
+        uint64_t base,
+        int w);
+static int COMPRESS_for_decode(
+        siridb_point_t * dest,
+        const unsigned char * buf,
+        size_t size,
+        uint16_t len,
+        size_t ts_sz);
+static void COMPRESS_for_unpack(
+        siridb_point_t * dest,
+        const unsigned char * pt,
+        size_t size,
+        uint16_t len,
+        int w,
+        uint64_t base);
+
+/*
+ * Compress points from 'start' up to 'end' into 'buf'. Argument 'buf' must
+ * have a size of at least SIRIDB_COMPRESS_MAX_SZ(end - start).
+ *
+ * Returns the number of bytes written to 'buf'.
+ */
+size_t siridb_compress_num(
+        unsigned char * buf,
+        siridb_points_t * points,
+        uint_fast32_t start,
+        uint_fast32_t end,
+        size_t ts_sz)
+{
+    compress_writer_t writer = {.pt=buf, .acc=0, .nbits=0};
+    siridb_point_t * point = points->data + start;
+    uint64_t prev_ts, prev_delta, delta, zz, prev_val, x;
+    int w_lead, w_trail, lead, trail, sig;
+
+    prev_ts = point->ts;
+    prev_val = (uint64_t) point->val.int64;
+    prev_delta = 0;
+    w_lead = -1;
+    w_trail = 0;
+
+    COMPRESS_write(&writer, prev_ts, ts_sz * 8);
+    COMPRESS_write(&writer, prev_val, 64);
+
+    for (point++, start++; start < end; start++, point++)
+    {
+        delta = point->ts - prev_ts;
+        zz = delta - prev_delta;
+        zz = (zz << 1) ^ (uint64_t) ((int64_t) zz >> 63);
+
+        COMPRESS_write_dod(&writer, zz);
+
+        prev_delta = delta;
+        prev_ts = point->ts;
+
+        x = (uint64_t) point->val.int64 ^ prev_val;
+        prev_val = (uint64_t) point->val.int64;
+
+        if (x == 0)
+        {
+            COMPRESS_write32(&writer, 0, 1);
+            continue;
+        }
+
+        lead = __builtin_clzll(x);
+        trail = __builtin_ctzll(x);
+
+        if (lead > 31)
+        {
+            lead = 31;
+        }
+
+        if (w_lead >= 0 && lead >= w_lead && trail >= w_trail)
+        {
+            COMPRESS_write32(&writer, 0x2, 2);
+            COMPRESS_write(&writer, x >> w_trail, 64 - w_lead - w_trail);
+        }
+        else
+        {
+            sig = 64 - lead - trail;
+            COMPRESS_write32(
+                    &writer,
+                    (0x3 << 11) | (lead << 6) | (sig - 1),
+                    2 + 5 + 6);
+            COMPRESS_write(&writer, x >> trail, sig);
+            w_lead = lead;
+            w_trail = trail;
+        }
+    }
+
+    if (writer.nbits)
+    {
+        *writer.pt = (unsigned char) (writer.acc << (8 - writer.nbits));
+        writer.pt++;
+    }
+
+    return writer.pt - buf;
+}
+
+/*
+ * Decode 'len' points from 'buf' into 'dest'. Argument 'dest' must have
+ * space for at least 'len' points.
+ *
+ * Returns 0 if successful or -1 when the data in 'buf' is not valid.
+ */
+int siridb_compress_num_decode(
+        siridb_point_t * dest,
+        const unsigned char * buf,
+        size_t size,
+        uint16_t len,
+        size_t ts_sz)
+{
+    compress_reader_t reader = {
+            .pt=buf,
+            .end=buf + size,
+            .acc=0,
+            .nbits=0,
+            .bad=0};
+    uint64_t prev_ts, prev_delta, zz, prev_val, x;
+    int w_lead, w_trail, lead, sig;
+
+    if (!len)
+    {
+        return 0;
+    }
+
+    prev_ts = COMPRESS_read(&reader, ts_sz * 8);
+    prev_val = COMPRESS_read(&reader, 64);
+    prev_delta = 0;
+    w_lead = -1;
+    w_trail = 0;
+
+    dest->ts = prev_ts;
+    dest->val.int64 = (int64_t) prev_val;
+
+    for (dest++, len--; len && !reader.bad; len--, dest++)
+    {
+        zz = COMPRESS_read_dod(&reader);
+        prev_delta += (zz >> 1) ^ -(zz & 1);
+        prev_ts += prev_delta;
+        dest->ts = prev_ts;
+
+        if (COMPRESS_read32(&reader, 1))
+        {
+            if (COMPRESS_read32(&reader, 1))
+            {
+                lead = (int) COMPRESS_read32(&reader, 5);
+                sig = (int) COMPRESS_read32(&reader, 6) + 1;
+                if (lead + sig > 64)
+                {
+                    return -1;
+                }
+                w_lead = lead;
+                w_trail = 64 - lead - sig;
+            }
+            else if (w_lead < 0)
+            {
+                return -1;
+            }
+            x = COMPRESS_read(&reader, 64 - w_lead - w_trail) << w_trail;
+            prev_val ^= x;
+        }
+
+        dest->val.int64 = (int64_t) prev_val;
+    }
+
+    return -reader.bad;
+}
+
+/*
+ * Compress points from 'start' up to 'end' into 'buf' for a shard which
+ * starts compressed chunks with the encoding. Integer chunks are written
+ * with a frame of reference encoding when the result is smaller than the
+ * XOR encoding. Argument 'buf' must have a size of at least
+ * SIRIDB_COMPRESS_MAX_SZ(end - start).
+ *
+ * Returns the number of bytes written to 'buf'.
+ */
+size_t siridb_compress_chunk(
+        unsigned char * buf,
+        siridb_points_t * points,
+        uint_fast32_t start,
+        uint_fast32_t end,
+        size_t ts_sz)
+{
+    uint64_t base;
+    size_t size;
+    int w = (points->tp == TP_INT) ?
+            COMPRESS_for_width(points, start, end, &base) : -1;
+
+    *buf = SIRIDB_COMPRESS_ENC_XOR;
+    size = siridb_compress_num(buf + 1, points, start, end, ts_sz) + 1;
+
+    if (w >= 0 && COMPRESS_for_sz(points, start, end, ts_sz, w) + 1 < size)
+    {
+        *buf = SIRIDB_COMPRESS_ENC_FOR;
+        size = COMPRESS_for(buf + 1, points, start, end, ts_sz, base, w) + 1;
+    }
+
+    return size;
+}
+
+/*
+ * Decode 'len' points from a chunk written by siridb_compress_chunk() into
+ * 'dest'. Argument 'dest' must have space for at least 'len' points.
+ *
+ * Returns 0 if successful or -1 when the data in 'buf' is not valid.
+ */
+int siridb_compress_chunk_decode(
+        siridb_point_t * dest,
+        const unsigned char * buf,
+        size_t size,
+        uint16_t len,
+        size_t ts_sz)
+{
+    if (!len)
+    {
+        return 0;
+    }
+
+    if (!size)
+    {
+        return -1;
+    }
+
+    switch (*buf)
+    {
+    case SIRIDB_COMPRESS_ENC_XOR:
+        return siridb_compress_num_decode(dest, buf + 1, size - 1, len, ts_sz);
+    case SIRIDB_COMPRESS_ENC_FOR:
+        return COMPRESS_for_decode(dest, buf + 1, size - 1, len, ts_sz);
+    }
+
+    return -1;
+}
+
+/*
+ * Returns the number of bytes for the values of the points from 'start' up
+ * to 'end' in a log chunk when no value would be repeated. Values are
+ * truncated to SIRIDB_COMPRESS_LOG_MAX_LEN bytes.
+ */
+size_t siridb_compress_log_values_sz(
+        siridb_points_t * points,
+        uint_fast32_t start,
+        uint_fast32_t end)
+{
+    size_t size = 0;
+
+    for (; start < end; start++)
+    {
+        size += strnlen(
+                points->data[start].val.raw,
+                SIRIDB_COMPRESS_LOG_MAX_LEN) + 1;
+    }
+
+    return size;
+}
+
+/*
+ * Write points from 'start' up to 'end' as a log chunk into 'buf'. Argument
+ * 'buf' must have a size of at least SIRIDB_COMPRESS_LOG_MAX_SZ(). Values
+ * are truncated to SIRIDB_COMPRESS_LOG_MAX_LEN bytes.
+ *
+ * Chunks are small so the distinct values are found by comparing each value
+ * with the values which are already in the dictionary.
+ *
+ * Returns the number of bytes written to 'buf' or 0 and a SIGNAL is raised
+ * in case of an allocation error.
+ */
+size_t siridb_compress_log(
+        unsigned char * buf,
+        siridb_points_t * points,
+        uint_fast32_t start,
+        uint_fast32_t end,
+        size_t ts_sz)
+{
+    uint_fast32_t len = end - start;
+    const char ** dict = (const char **) malloc(len * sizeof(char *));
+    size_t * sizes = (size_t *) malloc(len * sizeof(size_t));
+    uint16_t * map = (uint16_t *) malloc(len * sizeof(uint16_t));
+    siridb_point_t * point = points->data + start;
+    unsigned char * pt = buf;
+    uint16_t n = 0, k;
+    size_t sz;
+
+    if (dict == NULL || sizes == NULL || map == NULL)
+    {
+        ERR_ALLOC
+        free(dict);
+        free(sizes);
+        free(map);
+        return 0;
+    }
+
+    for (uint_fast32_t i = 0; i < len; i++, point++)
+    {
+        /* time-stamps are in little endian order, like in number chunks */
+        memcpy(pt, &point->ts, ts_sz);
+        pt += ts_sz;
+
+        sz = strnlen(point->val.raw, SIRIDB_COMPRESS_LOG_MAX_LEN);
+        for (k = 0; k < n; k++)
+        {
+            if (sizes[k] == sz && memcmp(dict[k], point->val.raw, sz) == 0)
+            {
+                break;
+            }
+        }
+
+        if (k == n)
+        {
+            dict[n] = point->val.raw;
+            sizes[n] = sz;
+            n++;
+        }
+
+        map[i] = k;
+    }
+
+    memcpy(pt, &n, sizeof(uint16_t));
+    pt += sizeof(uint16_t);
+
+    for (uint_fast32_t i = 0; i < len; i++)
+    {
+        if (n > 256)
+        {
+            memcpy(pt, &map[i], sizeof(uint16_t));
+            pt += sizeof(uint16_t);
+        }
+        else
+        {
+            *pt++ = (unsigned char) map[i];
+        }
+    }
+
+    for (k = 0; k < n; k++)
+    {
+        memcpy(pt, dict[k], sizes[k]);
+        pt += sizes[k];
+        *pt++ = '\0';
+    }
+
+    free(dict);
+    free(sizes);
+    free(map);
+
+    return pt - buf;
+}
+
+/*
+ * Decode a log chunk with 'len' points into 'dest'. The distinct values are
+ * copied to a new content block for 'points' so the values of 'dest' stay
+ * valid as long as 'points' exists.
+ *
+ * Returns 0 if successful or -1 when the chunk is corrupt or in case of an
+ * allocation error. (a SIGNAL is raised in case of an allocation error)
+ */
+int siridb_compress_log_decode(
+        siridb_points_t * points,
+        siridb_point_t * dest,
+        const unsigned char * buf,
+        size_t size,
+        uint16_t len,
+        size_t ts_sz)
+{
+    const unsigned char * end = buf + size;
+    const unsigned char * idx;
+    char ** dict;
+    char * content, * pt;
+    size_t isz, dict_sz;
+    uint16_t n, k;
+
+    if (!len)
+    {
+        return 0;
+    }
+
+    if (size < len * ts_sz + sizeof(uint16_t))
+    {
+        return -1;
+    }
+
+    for (uint16_t i = 0; i < len; i++, buf += ts_sz)
+    {
+        dest[i].ts = 0;
+        memcpy(&dest[i].ts, buf, ts_sz);
+    }
+
+    memcpy(&n, buf, sizeof(uint16_t));
+    buf += sizeof(uint16_t);
+
+    isz = (n > 256) ? sizeof(uint16_t) : 1;
+    idx = buf;
+
+    if (!n || n > len || (size_t) (end - buf) < len * isz + n)
+    {
+        return -1;
+    }
+
+    buf += len * isz;
+    dict_sz = end - buf;
+
+    /* the dictionary must end with a terminated value */
+    if (end[-1] != '\0')
+    {
+        return -1;
+    }
+
+    dict = (char **) malloc(n * sizeof(char *));
+    if (dict == NULL)
+    {
+        ERR_ALLOC
+        return -1;
+    }
+
+    content = siridb_points_content(points, dict_sz);
+    if (content == NULL)
+    {
+        free(dict);
+        return -1;  /* signal is raised */
+    }
+
+    memcpy(content, buf, dict_sz);
+
+    for (k = 0, pt = content; k < n; k++)
+    {
+        if (pt >= content + dict_sz)
+        {
+            free(dict);
+            return -1;
+        }
+        dict[k] = pt;
+        pt += strlen(pt) + 1;
+    }
+
+    for (uint16_t i = 0; i < len; i++, idx += isz)
+    {
+        if (isz == 1)
+        {
+            k = *idx;
+        }
+        else
+        {
+            memcpy(&k, idx, sizeof(uint16_t));
+        }
+
+        if (k >= n)
+        {
+            free(dict);
+            return -1;
+        }
+
+        dest[i].val.raw = dict[k];
+    }
+
+    free(dict);
+
+    return 0;
+}
+
+/*
+ * Write the lowest 'n' bits of 'val'. (n <= 32)
+ */
+static inline void COMPRESS_write32(
+        compress_writer_t * writer,
+        uint64_t val,
+        int n)
+{
+    writer->acc = (writer->acc << n) | (val & ((1ULL << n) - 1));
+    writer->nbits += n;
+
+    while (writer->nbits >= 8)
+    {
+        writer->nbits -= 8;
+        *writer->pt = (unsigned char) (writer->acc >> writer->nbits);
+        writer->pt++;
+    }
+}
+
+/*
+ * Write the lowest 'n' bits of 'val'. (n <= 64)
+ */
+static inline void COMPRESS_write(
+        compress_writer_t * writer,
+        uint64_t val,
+        int n)
+{
+    if (n > 32)
+    {
+        COMPRESS_write32(writer, val >> 32, n - 32);
+        n = 32;
+    }
+    COMPRESS_write32(writer, val, n);
+}
+
+/*
+ * Read 'n' bits. (n <= 32)
+ *
+ * When reading beyond the end of the buffer, 'bad' will be set and zero
+ * bits are returned.
+ */
+static inline uint64_t COMPRESS_read32(compress_reader_t * reader, int n)
+{
+    while (reader->nbits < n)
+    {
+        if (reader->pt == reader->end)
+        {
+            reader->bad = 1;
+            return 0;
+        }
+        reader->acc = (reader->acc << 8) | *reader->pt;
+        reader->pt++;
+        reader->nbits += 8;
+    }
+
+    reader->nbits -= n;
+
+    return (reader->acc >> reader->nbits) & ((1ULL << n) - 1);
+}
+
+/*
+ * Read 'n' bits. (n <= 64)
+ */
+static inline uint64_t COMPRESS_read(compress_reader_t * reader, int n)
+{
+    uint64_t val = 0;
+
+    if (n > 32)
+    {
+        val = COMPRESS_read32(reader, n - 32) << 32;
+        n = 32;
+    }
+
+    return val | COMPRESS_read32(reader, n);
+}
+
+/*
+ * Write a zigzag encoded delta-of-delta time-stamp.
+ */
+static inline void COMPRESS_write_dod(compress_writer_t * writer, uint64_t zz)
+{
+    if (zz == 0)
+    {
+        COMPRESS_write32(writer, 0, 1);
+    }
+    else if (zz < (1ULL << 7))
+    {
+        COMPRESS_write32(writer, (0x2 << 7) | zz, 2 + 7);
+    }
+    else if (zz < (1ULL << 9))
+    {
+        COMPRESS_write32(writer, (0x6 << 9) | zz, 3 + 9);
+    }
+    else if (zz < (1ULL << 12))
+    {
+        COMPRESS_write32(writer, (0xe << 12) | zz, 4 + 12);
+    }
+    else if (zz < (1ULL << 32))
+    {
+        COMPRESS_write32(writer, 0x1e, 5);
+        COMPRESS_write32(writer, zz, 32);
+    }
+    else
+    {
+        COMPRESS_write32(writer, 0x1f, 5);
+        COMPRESS_write(writer, zz, 64);
+    }
+}
+
+/*
+ * Returns the number of bits COMPRESS_write_dod() uses for 'zz'.
+ */
+static inline int COMPRESS_dod_bits(uint64_t zz)
+{
+    return (zz == 0) ? 1 :
+            (zz < (1ULL << 7)) ? 2 + 7 :
+            (zz < (1ULL << 9)) ? 3 + 9 :
+            (zz < (1ULL << 12)) ? 4 + 12 :
+            (zz < (1ULL << 32)) ? 5 + 32 : 5 + 64;
+}
+
+/*
+ * Read a zigzag encoded delta-of-delta time-stamp.
+ */
+static inline uint64_t COMPRESS_read_dod(compress_reader_t * reader)
+{
+    int n;
+
+    /* count the number of leading ones, with a maximum of 5 */
+    for (n = 0; n < 5 && COMPRESS_read32(reader, 1); n++);
+
+    switch (n)
+    {
+    case 0:
+        return 0;
+    case 1:
+        return COMPRESS_read32(reader, 7);
+    case 2:
+        return COMPRESS_read32(reader, 9);
+    case 3:
+        return COMPRESS_read32(reader, 12);
+    case 4:
+        return COMPRESS_read32(reader, 32);
+    }
+
+    return COMPRESS_read(reader, 64);
+}
+
+/*
+ * Returns the number of bits required for the values of an integer chunk
+ * relative to the minimum value, or -1 when the range is too large for a
+ * frame of reference encoding. The minimum value is set to 'base'.
+ */
+static int COMPRESS_for_width(
+        siridb_points_t * points,
+        uint_fast32_t start,
+        uint_fast32_t end,
+        uint64_t * base)
+{
+    int64_t min, max;
+    uint64_t range;
+
+    min = max = points->data[start].val.int64;
+
+    for (start++; start < end; start++)
+    {
+        int64_t val = points->data[start].val.int64;
+        min = (val < min) ? val : min;
+        max = (val > max) ? val : max;
+    }
+
+    *base = (uint64_t) min;
+    range = (uint64_t) max - (uint64_t) min;
+
+    if (!range)
+    {
+        return 0;
+    }
+
+    return (__builtin_clzll(range) < 64 - COMPRESS_FOR_MAX_WIDTH) ?
+            -1 : 64 - __builtin_clzll(range);
+}
+
+/*
+ * Returns the number of bytes COMPRESS_for() writes.
+ */
+static size_t COMPRESS_for_sz(
+        siridb_points_t * points,
+        uint_fast32_t start,
+        uint_fast32_t end,
+        size_t ts_sz,
+        int w)
+{
+    siridb_point_t * point = points->data + start;
+    uint64_t prev_ts, prev_delta, delta, zz;
+    size_t nbits = 0;
+    size_t len = end - start;
+
+    prev_ts = point->ts;
+    prev_delta = 0;
+
+    for (point++, start++; start < end; start++, point++)
+    {
+        delta = point->ts - prev_ts;
+        zz = delta - prev_delta;
+        zz = (zz << 1) ^ (uint64_t) ((int64_t) zz >> 63);
+        nbits += COMPRESS_dod_bits(zz);
+        prev_delta = delta;
+        prev_ts = point->ts;
+    }
+
+    return ts_sz + 8 + 1 + (len * w + 7) / 8 + (nbits + 7) / 8;
+}
+
+/*
+ * Write points with a frame of reference encoding. Argument 'w' must be
+ * the result of COMPRESS_for_width().
+ *
+ * Returns the number of bytes written to 'buf'.
+ */
+static size_t COMPRESS_for(
+        unsigned char * buf,
+        siridb_points_t * points,
+        uint_fast32_t start,
+        uint_fast32_t end,
+        size_t ts_sz,
+        uint64_t base,
+        int w)
+{
+    compress_writer_t writer = {.pt=buf, .acc=0, .nbits=0};
+    siridb_point_t * point = points->data + start;
+    uint64_t prev_ts, prev_delta, delta, zz, acc = 0;
+    uint_fast32_t i;
+    int nbits = 0;
+
+    COMPRESS_write(&writer, point->ts, ts_sz * 8);
+    COMPRESS_write(&writer, base, 64);
+    COMPRESS_write32(&writer, (uint64_t) w, 8);
+
+    /* the header is a whole number of bytes so 'writer.pt' is aligned */
+    for (i = start; i < end; i++)
+    {
+        acc |= ((uint64_t) points->data[i].val.int64 - base) << nbits;
+        nbits += w;
+
+        while (nbits >= 8)
+        {
+            *writer.pt = (unsigned char) acc;
+            writer.pt++;
+            acc >>= 8;
+            nbits -= 8;
+        }
+    }
+
+    if (nbits)
+    {
+        *writer.pt = (unsigned char) acc;
+        writer.pt++;
+    }
+
+    prev_ts = point->ts;
+    prev_delta = 0;
+
+    for (point++, start++; start < end; start++, point++)
+    {
+        delta = point->ts - prev_ts;
+        zz = delta - prev_delta;
+        zz = (zz << 1) ^ (uint64_t) ((int64_t) zz >> 63);
+        COMPRESS_write_dod(&writer, zz);
+        prev_delta = delta;
+        prev_ts = point->ts;
+    }
+
+    if (writer.nbits)
+    {
+        *writer.pt = (unsigned char) (writer.acc << (8 - writer.nbits));
+        writer.pt++;
+    }
+
+    return writer.pt - buf;
+}
+
+/*
+ * Returns 0 if successful or -1 when the data in 'buf' is not valid.
+ */
+static int COMPRESS_for_decode(
+        siridb_point_t * dest,
+        const unsigned char * buf,
+        size_t size,
+        uint16_t len,
+        size_t ts_sz)
+{
+    compress_reader_t reader = {
+            .pt=buf,
+            .end=buf + size,
+            .acc=0,
+            .nbits=0,
+            .bad=0};
+    uint64_t prev_ts, prev_delta, base, zz;
+    size_t header_sz = ts_sz + 8 + 1;
+    size_t packed_sz;
+    int w;
+
+    prev_ts = COMPRESS_read(&reader, ts_sz * 8);
+    base = COMPRESS_read(&reader, 64);
+    w = (int) COMPRESS_read32(&reader, 8);
+    packed_sz = ((size_t) len * w + 7) / 8;
+
+    if (    reader.bad ||
+            w > COMPRESS_FOR_MAX_WIDTH ||
+            header_sz + packed_sz > size)
+    {
+        return -1;
+    }
+
+    COMPRESS_for_unpack(dest, buf + header_sz, size - header_sz, len, w, base);
+
+    /* the time-stamps follow the packed values */
+    reader.pt = buf + header_sz + packed_sz;
+    prev_delta = 0;
+    dest->ts = prev_ts;
+
+    for (dest++, len--; len && !reader.bad; len--, dest++)
+    {
+        zz = COMPRESS_read_dod(&reader);
+        prev_delta += (zz >> 1) ^ -(zz & 1);
+        prev_ts += prev_delta;
+        dest->ts = prev_ts;
+    }
+
+    return -reader.bad;
+}
+
+/*
+ * Unpack 'len' values of 'w' bits. Argument 'size' is the number of bytes
+ * available at 'pt' which must be at least enough for the packed values.
+ */
+static void COMPRESS_for_unpack(
+        siridb_point_t * dest,
+        const unsigned char * pt,
+        size_t size,
+        uint16_t len,
+        int w,
+        uint64_t base)
+{
+    const uint64_t mask = (1ULL << w) - 1;
+    size_t i, n, bit, k;
+    uint64_t word;
+
+    if (!w)
+    {
+        for (i = 0; i < len; i++)
+        {
+            dest[i].val.int64 = (int64_t) base;
+        }
+        return;
+    }
+
+    /* values for which a whole word can be read from the buffer */
+    n = (size < 8) ? 0 : ((size - 7) * 8 + w - 1) / w;
+    n = (n < len) ? n : len;
+
+    for (i = 0; i < n; i++)
+    {
+        bit = i * w;
+        memcpy(&word, pt + (bit >> 3), sizeof(uint64_t));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        word = __builtin_bswap64(word);
+#endif
+        dest[i].val.int64 = (int64_t) (base + ((word >> (bit & 7)) & mask));
+    }
+
+    for (; i < len; i++)
+    {
+        bit = i * w;
+        word = 0;
+        for (k = 0; k < 8 && (bit >> 3) + k < size; k++)
+        {
+            word |= (uint64_t) pt[(bit >> 3) + k] << (k * 8);
+        }
+        dest[i].val.int64 = (int64_t) (base + ((word >> (bit & 7)) & mask));
+    }
+}
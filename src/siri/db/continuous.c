@@ -0,0 +1,614 @@
+/*
+ * continuous.c - Continuous queries executed by the server.
+ *
+ * author       : Jeroen van der Heijden
+ * email        : jeroen@transceptor.technology
+ * copyright    : 2016, Transceptor Technology
+ *
+ * A continuous query writes an aggregate for each interval of the series
+ * matching a regular expression or a group. Continuous queries are defined
+ * in the [continuous] section of database.conf, for example:
+ *
+ *      [continuous]
+ *      cpu_5m = 5m mean /^cpu.*$/
+ *      web_1h = 1h max web_servers
+ *
+ * The aggregate is one of count, max, mean, median, median_high, median_low,
+ * min, pvariance, sum or variance. The heart-beat task runs the queries for
+ * the intervals which are closed since the last run. The result is equal to
+ * a select with 'aggregate(interval)' and is inserted in the series named
+ * "<name>.<series>" like any other insert, so the result series can be used
+ * for subscriptions and other continuous queries. Series starting with
+ * "<name>." are never used as a source for the query with that name.
+ *
+ * Each server only runs the queries for the series it is responsible for so
+ * the result is inserted once. An interval is computed once, points which are
+ * inserted later for a closed interval are not included. The queries start
+ * with the intervals closed after the database is loaded.
+ *
+ * changes
+ *  - initial version, 14-10-2016
+ *
+ */
+#include <logger/logger.h>
+#include <siri/db/aggregate.h>
+#include <siri/db/continuous.h>
+#include <siri/db/db.h>
+#include <siri/db/group.h>
+#include <siri/db/groups.h>
+#include <siri/db/insert.h>
+#include <siri/db/pools.h>
+#include <siri/db/series.h>
+#include <siri/db/server.h>
+#include <siri/db/time.h>
+#include <siri/err.h>
+#include <siri/siri.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+typedef struct
+{
+    const char * name;
+    uint32_t gid;
+} CONTINUOUS_aggr_t;
+
+static const CONTINUOUS_aggr_t CONTINUOUS_aggregates[] = {
+        {"count", CLERI_GID_F_COUNT},
+        {"max", CLERI_GID_F_MAX},
+        {"mean", CLERI_GID_F_MEAN},
+        {"median", CLERI_GID_F_MEDIAN},
+        {"median_high", CLERI_GID_F_MEDIAN_HIGH},
+        {"median_low", CLERI_GID_F_MEDIAN_LOW},
+        {"min", CLERI_GID_F_MIN},
+        {"pvariance", CLERI_GID_F_PVARIANCE},
+        {"sum", CLERI_GID_F_SUM},
+        {"variance", CLERI_GID_F_VARIANCE},
+        {NULL, 0}
+};
+
+static siridb_continuous_t * CONTINUOUS_new(
+        siridb_t * siridb,
+        const char * name,
+        const char * val);
+static void CONTINUOUS_free(siridb_continuous_t * continuous);
+static int CONTINUOUS_compile(
+        siridb_t * siridb,
+        siridb_continuous_t * continuous);
+static int CONTINUOUS_run(
+        siridb_t * siridb,
+        siridb_continuous_t * continuous,
+        slist_t * slist,
+        uint64_t end);
+static int CONTINUOUS_use_series(
+        siridb_t * siridb,
+        siridb_continuous_t * continuous,
+        siridb_series_t * series);
+static int CONTINUOUS_insert(siridb_t * siridb, qp_packer_t * packer);
+
+/*
+ * Read the continuous queries from the [continuous] section in
+ * database.conf. Invalid definitions are logged and ignored.
+ *
+ * Returns 0 if successful or -1 and a SIGNAL is raised in case of an error.
+ */
+int siridb_continuous_read(siridb_t * siridb, cfgparser_t * cfgparser)
+{
+    cfgparser_section_t * section;
+    cfgparser_option_t * option;
+    siridb_continuous_t * continuous;
+
+    if (cfgparser_get_section(
+            &section,
+            cfgparser,
+            SIRIDB_CONTINUOUS_SECTION) != CFGPARSER_SUCCESS)
+    {
+        return 0;  /* no continuous queries */
+    }
+
+    for (option = section->options; option != NULL; option = option->next)
+    {
+        if (option->tp != CFGPARSER_TP_STRING)
+        {
+            log_error(
+                    "Invalid continuous query '%s', expecting an interval, "
+                    "an aggregate and a regular expression or group name",
+                    option->name);
+            continue;
+        }
+
+        continuous = CONTINUOUS_new(siridb, option->name, option->val->string);
+
+        if (continuous == NULL)
+        {
+            continue;  /* logging is done or a signal is raised */
+        }
+
+        if (siridb->continuous == NULL &&
+            (siridb->continuous = slist_new(SLIST_DEFAULT_SIZE)) == NULL)
+        {
+            CONTINUOUS_free(continuous);
+            ERR_ALLOC
+            return -1;
+        }
+
+        if (slist_append_safe(&siridb->continuous, continuous))
+        {
+            CONTINUOUS_free(continuous);
+            ERR_ALLOC
+            return -1;
+        }
+    }
+
+    return siri_err;
+}
+
+/*
+ * Compile the continuous queries. Must be called after the groups are loaded.
+ * The queries start with the next interval.
+ *
+ * Returns 0 if successful or -1 and a SIGNAL is raised in case of an error.
+ */
+int siridb_continuous_init(siridb_t * siridb)
+{
+    siridb_continuous_t * continuous;
+    struct timespec now;
+    uint64_t ts;
+
+    if (siridb->continuous == NULL)
+    {
+        return 0;
+    }
+
+    clock_gettime(CLOCK_REALTIME, &now);
+    ts = siridb_time_now(siridb, now);
+
+    for (size_t i = 0; i < siridb->continuous->len;)
+    {
+        continuous = (siridb_continuous_t *) siridb->continuous->data[i];
+
+        if (CONTINUOUS_compile(siridb, continuous))
+        {
+            memmove(siridb->continuous->data + i,
+                    siridb->continuous->data + i + 1,
+                    (--siridb->continuous->len - i) * sizeof(void *));
+            CONTINUOUS_free(continuous);
+            continue;
+        }
+
+        continuous->last =
+                (ts - 1) / continuous->interval * continuous->interval;
+
+        log_info(
+                "Using continuous query '%s' for series matching '%s'",
+                continuous->name,
+                continuous->source);
+        i++;
+    }
+
+    return siri_err;
+}
+
+/*
+ * Run the continuous queries for the intervals which are closed since the
+ * last run. The queries are skipped when the database cannot accept inserts
+ * and will be run on a next call.
+ *
+ * This function can raise a SIGNAL.
+ */
+void siridb_continuous_run(siridb_t * siridb)
+{
+    siridb_continuous_t * continuous;
+    slist_t * slist = NULL;
+    struct timespec now;
+    uint64_t ts, end;
+
+    if (    siridb->continuous == NULL ||
+            (siridb->server->flags & ~SERVER_FLAG_REINDEXING) !=
+                SERVER_FLAG_RUNNING ||
+            !siridb_pools_accessible(siridb) ||
+            siridb_insert_busy(siridb))
+    {
+        return;
+    }
+
+    clock_gettime(CLOCK_REALTIME, &now);
+    ts = siridb_time_now(siridb, now);
+
+    for (size_t i = 0; i < siridb->continuous->len; i++)
+    {
+        continuous = (siridb_continuous_t *) siridb->continuous->data[i];
+
+        /* the last interval which cannot receive new time-stamps */
+        end = (ts - 1) / continuous->interval * continuous->interval;
+
+        if (end <= continuous->last)
+        {
+            continue;
+        }
+
+        if (slist == NULL &&
+            (slist = dmap_2slist(siridb->series_map)) == NULL)
+        {
+            return;  /* signal is raised */
+        }
+
+        if (CONTINUOUS_run(siridb, continuous, slist, end))
+        {
+            break;  /* signal is raised */
+        }
+
+        continuous->last = end;
+    }
+
+    if (slist != NULL)
+    {
+        slist_free(slist);
+    }
+}
+
+/*
+ * Destroy continuous queries. (parsing NULL is allowed)
+ */
+void siridb_continuous_free(slist_t * continuous)
+{
+    if (continuous != NULL)
+    {
+        for (size_t i = 0; i < continuous->len; i++)
+        {
+            CONTINUOUS_free((siridb_continuous_t *) continuous->data[i]);
+        }
+        slist_free(continuous);
+    }
+}
+
+/*
+ * Returns NULL in case of an error. (the error is logged)
+ *
+ * The value is expected like "<interval> <aggregate> <regex or group name>"
+ * where the interval is a number followed by s, m, h, d or w.
+ */
+static siridb_continuous_t * CONTINUOUS_new(
+        siridb_t * siridb,
+        const char * name,
+        const char * val)
+{
+    siridb_continuous_t * continuous;
+    const CONTINUOUS_aggr_t * aggr;
+    const char * pt = val;
+    uint64_t interval;
+    size_t len;
+
+    for (; *pt >= '0' && *pt <= '9'; pt++);
+
+    if (pt == val || strchr("smhdw", *pt) == NULL || *pt == '\0' ||
+            (pt[1] != ' ' && pt[1] != '\t'))
+    {
+        log_error(
+                "Invalid interval for continuous query '%s': '%s' (expecting "
+                "for example '5m')",
+                name,
+                val);
+        return NULL;
+    }
+
+    interval = siridb_time_parse(val, pt - val + 1) * siridb->time->factor;
+
+    if (!interval)
+    {
+        log_error(
+                "Interval for continuous query '%s' must be greater than zero",
+                name);
+        return NULL;
+    }
+
+    for (pt++; *pt == ' ' || *pt == '\t'; pt++);
+
+    for (len = 0; pt[len] && pt[len] != ' ' && pt[len] != '\t'; len++);
+
+    for (aggr = CONTINUOUS_aggregates; aggr->name != NULL; aggr++)
+    {
+        if (strlen(aggr->name) == len && strncmp(aggr->name, pt, len) == 0)
+        {
+            break;
+        }
+    }
+
+    if (aggr->name == NULL)
+    {
+        log_error(
+                "Invalid aggregate for continuous query '%s', expecting "
+                "count, max, mean, median, median_high, median_low, min, "
+                "pvariance, sum or variance",
+                name);
+        return NULL;
+    }
+
+    for (pt += len; *pt == ' ' || *pt == '\t'; pt++);
+
+    if (*pt == '\0')
+    {
+        log_error(
+                "Missing a regular expression or group name for continuous "
+                "query '%s'",
+                name);
+        return NULL;
+    }
+
+    continuous = (siridb_continuous_t *) malloc(sizeof(siridb_continuous_t));
+
+    if (continuous == NULL)
+    {
+        ERR_ALLOC
+        return NULL;
+    }
+
+    continuous->interval = interval;
+    continuous->last = 0;
+    continuous->gid = aggr->gid;
+    continuous->re = NULL;
+    continuous->name = strdup(name);
+    continuous->name_len = strlen(name);
+    continuous->source = strdup(pt);
+
+    if (continuous->name == NULL || continuous->source == NULL)
+    {
+        ERR_ALLOC
+        CONTINUOUS_free(continuous);
+        return NULL;
+    }
+
+    return continuous;
+}
+
+static void CONTINUOUS_free(siridb_continuous_t * continuous)
+{
+    free(continuous->name);
+    free(continuous->source);
+    if (continuous->re != NULL)
+    {
+        siridb_re_decref(siri.re_cache, continuous->re);
+    }
+    free(continuous);
+}
+
+/*
+ * A source starting with a slash is a regular expression, otherwise the
+ * expression of the group with that name is used. Changes to the group are
+ * used after a restart.
+ *
+ * Returns 0 if successful or -1 in case of an error. (the error is logged)
+ */
+static int CONTINUOUS_compile(
+        siridb_t * siridb,
+        siridb_continuous_t * continuous)
+{
+    char err_msg[SIRIDB_MAX_SIZE_ERR_MSG];
+    siridb_group_t * group;
+    const char * source = continuous->source;
+
+    if (*source != '/')
+    {
+        group = (siridb_group_t *) ct_get(siridb->groups->groups, source);
+
+        if (group == NULL)
+        {
+            log_error(
+                    "Cannot find group '%s' for continuous query '%s'",
+                    source,
+                    continuous->name);
+            return -1;
+        }
+
+        source = group->source;
+    }
+
+    if ((continuous->re = siridb_re_get(
+            siri.re_cache,
+            source,
+            strlen(source),
+            err_msg)) == NULL)
+    {
+        log_error(
+                "Invalid continuous query '%s': %s",
+                continuous->name,
+                err_msg);
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Insert the aggregates for the intervals in (continuous->last, end] for
+ * the series in 'slist'. An error for a single series is logged and the
+ * series is skipped.
+ *
+ * Returns 0 if successful or -1 and a SIGNAL is raised in case of an error.
+ */
+static int CONTINUOUS_run(
+        siridb_t * siridb,
+        siridb_continuous_t * continuous,
+        slist_t * slist,
+        uint64_t end)
+{
+    char err_msg[SIRIDB_MAX_SIZE_ERR_MSG];
+    siridb_series_t * series;
+    siridb_points_t * points;
+    siridb_points_t * result;
+    qp_packer_t * packer;
+    siridb_aggr_t aggr;
+    uint64_t start_ts = continuous->last + 1;
+    uint64_t end_ts = end + 1;
+    int rc = 0;
+
+    memset(&aggr, 0, sizeof(siridb_aggr_t));
+    aggr.gid = continuous->gid;
+    aggr.group_by = continuous->interval;
+
+    if ((packer = qp_packer_new(QP_SUGGESTED_SIZE)) == NULL)
+    {
+        ERR_ALLOC
+        return -1;
+    }
+
+    qp_add_type(packer, QP_MAP_OPEN);
+
+    for (size_t i = 0; i < slist->len; i++)
+    {
+        series = (siridb_series_t *) slist->data[i];
+
+        if (    series->end < start_ts ||
+                series->start >= end_ts ||
+                !CONTINUOUS_use_series(siridb, continuous, series))
+        {
+            continue;
+        }
+
+        siri_rwlock_wrlock(&siridb->series_mutex);
+
+        points = siridb_series_get_points(siridb, series, &start_ts, &end_ts);
+
+        siri_rwlock_wrunlock(&siridb->series_mutex);
+
+        if (points == NULL)
+        {
+            rc = -1;  /* signal is raised */
+            break;
+        }
+
+        if (!points->len)
+        {
+            siridb_points_free(points);
+            continue;
+        }
+
+        result = siridb_aggregate_run(points, &aggr, err_msg);
+
+        siridb_points_free(points);
+
+        if (result == NULL)
+        {
+            if (siri_err)
+            {
+                rc = -1;
+                break;
+            }
+            else
+            {
+                log_error(
+                        "Continuous query '%s' failed for series '%s': %s",
+                        continuous->name,
+                        series->name,
+                        err_msg);
+            }
+            continue;
+        }
+
+        if (result->len)
+        {
+            char name[continuous->name_len + series->name_len + 2];
+            memcpy(name, continuous->name, continuous->name_len);
+            name[continuous->name_len] = '.';
+            memcpy(name + continuous->name_len + 1,
+                    series->name,
+                    series->name_len);
+
+            rc = qp_add_raw(
+                    packer,
+                    name,
+                    continuous->name_len + series->name_len + 1) ||
+                siridb_points_pack(result, packer);
+        }
+
+        siridb_points_free(result);
+
+        if (rc)
+        {
+            break;  /* signal is raised */
+        }
+    }
+
+    if (rc == 0)
+    {
+        qp_add_type(packer, QP_MAP_CLOSE);
+        rc = CONTINUOUS_insert(siridb, packer);
+    }
+
+    qp_packer_free(packer);
+
+    return rc;
+}
+
+/*
+ * Returns 1 (true) when the continuous query must run for a series or
+ * 0 (false) if not.
+ */
+static int CONTINUOUS_use_series(
+        siridb_t * siridb,
+        siridb_continuous_t * continuous,
+        siridb_series_t * series)
+{
+    return (
+        siridb_series_isnum(series) &&
+        series->name_len + continuous->name_len < SIRIDB_SERIES_NAME_LEN_MAX &&
+
+        /* never use a result of this continuous query as source */
+        (   series->name_len <= continuous->name_len ||
+            series->name[continuous->name_len] != '.' ||
+            strncmp(
+                series->name,
+                continuous->name,
+                continuous->name_len) != 0) &&
+
+        /* the series must be on 'this' server */
+        (   siridb->replica == NULL ||
+            siridb_series_server_id(series) == siridb->server->id) &&
+
+        siridb_re_match(
+                continuous->re,
+                series->name,
+                series->name_len) == 0);
+}
+
+/*
+ * Insert the points in 'packer', the insert has no client so nothing is
+ * returned when the insert is finished.
+ *
+ * Returns 0 if successful or -1 and a SIGNAL is raised in case of an error.
+ */
+static int CONTINUOUS_insert(siridb_t * siridb, qp_packer_t * packer)
+{
+    siridb_insert_t * insert;
+    qp_unpacker_t unpacker;
+    ssize_t rc;
+
+    qp_unpacker_init(&unpacker, packer->buffer, packer->len);
+
+    if ((insert = siridb_insert_new(siridb, 0, NULL)) == NULL)
+    {
+        return -1;  /* signal is raised */
+    }
+
+    rc = siridb_insert_assign_pools(siridb, &unpacker, insert->packer);
+
+    if (rc <= 0)
+    {
+        if (rc < 0)
+        {
+            log_error(
+                    "Cannot insert the result of a continuous query: %s",
+                    siridb_insert_err_msg((siridb_insert_err_t) rc));
+        }
+        siridb_insert_free(insert);
+        return siri_err;
+    }
+
+    if (siridb_insert_points_to_pools(insert, (size_t) rc))
+    {
+        siridb_insert_free(insert);
+        return -1;  /* signal is raised */
+    }
+
+    return 0;
+}
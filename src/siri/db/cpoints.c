@@ -0,0 +1,757 @@
+/*
+ * cpoints.c - Columnar points for processing values.
+ *
+ * author       : Jeroen van der Heijden
+ * email        : jeroen@transceptor.technology
+ * copyright    : 2016, Transceptor Technology
+ *
+ * Points are normally stored with the time-stamp and value interleaved which
+ * is what the shards, the buffer and the protocol use. Aggregating values
+ * over many points only needs the values, so for group by aggregates the
+ * points are converted once to separate arrays for time-stamps and values.
+ * The loops over a value array can be vectorized by the compiler and only
+ * half of the memory is read.
+ *
+ * Kernels for double values and int64 min/max use AVX2 (x86_64, selected at
+ * runtime by siridb_cpoints_init()) or NEON (aarch64, always available).
+ * Integer sums are not vectorized since each step is checked for overflow.
+ *
+ * changes
+ *  - initial version, 14-10-2016
+ *
+ */
+#include <assert.h>
+#include <limits.h>
+#include <siri/db/cpoints.h>
+#include <stdlib.h>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define CPOINTS_AVX2 1
+#include <immintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#define CPOINTS_NEON 1
+#include <arm_neon.h>
+#endif
+
+typedef struct cpoints_kernels_s
+{
+    const char * name;
+    int64_t (*max_int64)(const int64_t * v, size_t n);
+    int64_t (*min_int64)(const int64_t * v, size_t n);
+    double (*max_real)(const double * v, size_t n);
+    double (*min_real)(const double * v, size_t n);
+    double (*sum_real)(const double * v, size_t n);
+    double (*sqdiff_real)(const double * v, size_t n, double mean);
+} cpoints_kernels_t;
+
+static int64_t CPOINTS_max_int64(const int64_t * v, size_t n);
+static int64_t CPOINTS_min_int64(const int64_t * v, size_t n);
+static double CPOINTS_max_real(const double * v, size_t n);
+static double CPOINTS_min_real(const double * v, size_t n);
+static double CPOINTS_sum_real(const double * v, size_t n);
+static double CPOINTS_sqdiff_real(const double * v, size_t n, double mean);
+
+#ifdef CPOINTS_AVX2
+static int64_t CPOINTS_max_int64_avx2(const int64_t * v, size_t n);
+static int64_t CPOINTS_min_int64_avx2(const int64_t * v, size_t n);
+static double CPOINTS_max_real_avx2(const double * v, size_t n);
+static double CPOINTS_min_real_avx2(const double * v, size_t n);
+static double CPOINTS_sum_real_avx2(const double * v, size_t n);
+static double CPOINTS_sqdiff_real_avx2(
+        const double * v,
+        size_t n,
+        double mean);
+#endif
+
+#ifdef CPOINTS_NEON
+static int64_t CPOINTS_max_int64_neon(const int64_t * v, size_t n);
+static int64_t CPOINTS_min_int64_neon(const int64_t * v, size_t n);
+static double CPOINTS_max_real_neon(const double * v, size_t n);
+static double CPOINTS_min_real_neon(const double * v, size_t n);
+static double CPOINTS_sum_real_neon(const double * v, size_t n);
+static double CPOINTS_sqdiff_real_neon(
+        const double * v,
+        size_t n,
+        double mean);
+#endif
+
+static cpoints_kernels_t kernels = {
+        .name="scalar",
+        .max_int64=CPOINTS_max_int64,
+        .min_int64=CPOINTS_min_int64,
+        .max_real=CPOINTS_max_real,
+        .min_real=CPOINTS_min_real,
+        .sum_real=CPOINTS_sum_real,
+        .sqdiff_real=CPOINTS_sqdiff_real
+};
+
+/*
+ * Select the kernels for the current CPU. Without calling this function the
+ * scalar kernels are used.
+ */
+void siridb_cpoints_init(void)
+{
+#ifdef CPOINTS_AVX2
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    {
+        kernels.name = "avx2";
+        kernels.max_int64 = CPOINTS_max_int64_avx2;
+        kernels.min_int64 = CPOINTS_min_int64_avx2;
+        kernels.max_real = CPOINTS_max_real_avx2;
+        kernels.min_real = CPOINTS_min_real_avx2;
+        kernels.sum_real = CPOINTS_sum_real_avx2;
+        kernels.sqdiff_real = CPOINTS_sqdiff_real_avx2;
+    }
+#endif
+#ifdef CPOINTS_NEON
+    kernels.name = "neon";
+    kernels.max_int64 = CPOINTS_max_int64_neon;
+    kernels.min_int64 = CPOINTS_min_int64_neon;
+    kernels.max_real = CPOINTS_max_real_neon;
+    kernels.min_real = CPOINTS_min_real_neon;
+    kernels.sum_real = CPOINTS_sum_real_neon;
+    kernels.sqdiff_real = CPOINTS_sqdiff_real_neon;
+#endif
+}
+
+/*
+ * Returns the name of the kernels in use. (scalar, avx2 or neon)
+ */
+const char * siridb_cpoints_kernels(void)
+{
+    return kernels.name;
+}
+
+/*
+ * Returns NULL in case of an allocation error. No signal is raised since
+ * the normal points can still be used.
+ *
+ * Only numeric points can be converted.
+ */
+siridb_cpoints_t * siridb_cpoints_from_points(siridb_points_t * points)
+{
+#ifdef DEBUG
+    assert (points->tp != TP_STRING);
+#endif
+    siridb_cpoints_t * cpoints =
+            (siridb_cpoints_t *) malloc(sizeof(siridb_cpoints_t));
+    if (cpoints == NULL)
+    {
+        return NULL;
+    }
+
+    cpoints->len = points->len;
+    cpoints->tp = points->tp;
+    cpoints->ts = (uint64_t *) malloc(sizeof(uint64_t) * points->len);
+    cpoints->val.int64 = (int64_t *) malloc(sizeof(int64_t) * points->len);
+
+    if (cpoints->ts == NULL || cpoints->val.int64 == NULL)
+    {
+        siridb_cpoints_free(cpoints);
+        return NULL;
+    }
+
+    /* int64 and double have the same size so values are copied as int64 */
+    for (size_t i = 0; i < points->len; i++)
+    {
+        cpoints->ts[i] = points->data[i].ts;
+        cpoints->val.int64[i] = points->data[i].val.int64;
+    }
+
+    return cpoints;
+}
+
+void siridb_cpoints_free(siridb_cpoints_t * cpoints)
+{
+    free(cpoints->ts);
+    free(cpoints->val.int64);
+    free(cpoints);
+}
+
+/*
+ * Returns the position of the first point after 'start' with a time-stamp
+ * larger than 'group_ts' or cpoints->len if no such point exists.
+ */
+size_t siridb_cpoints_group_end(
+        siridb_cpoints_t * cpoints,
+        size_t start,
+        uint64_t group_ts)
+{
+    const uint64_t * ts = cpoints->ts;
+    size_t end = start;
+
+    while (end < cpoints->len && ts[end] <= group_ts)
+    {
+        end++;
+    }
+
+    return end;
+}
+
+/*
+ * Set 'val' to the maximum value in range 'start' to 'end'.
+ * (range must not be empty)
+ */
+void siridb_cpoints_max(
+        siridb_cpoints_t * cpoints,
+        size_t start,
+        size_t end,
+        qp_via_t * val)
+{
+    if (cpoints->tp == TP_INT)
+    {
+        val->int64 = kernels.max_int64(
+                cpoints->val.int64 + start,
+                end - start);
+    }
+    else
+    {
+        val->real = kernels.max_real(cpoints->val.real + start, end - start);
+    }
+}
+
+/*
+ * Set 'val' to the minimum value in range 'start' to 'end'.
+ * (range must not be empty)
+ */
+void siridb_cpoints_min(
+        siridb_cpoints_t * cpoints,
+        size_t start,
+        size_t end,
+        qp_via_t * val)
+{
+    if (cpoints->tp == TP_INT)
+    {
+        val->int64 = kernels.min_int64(
+                cpoints->val.int64 + start,
+                end - start);
+    }
+    else
+    {
+        val->real = kernels.min_real(cpoints->val.real + start, end - start);
+    }
+}
+
+/*
+ * Set 'val' to the sum of values in range 'start' to 'end'.
+ *
+ * Returns 0 if successful or -1 when an integer overflow is detected.
+ */
+int siridb_cpoints_sum(
+        siridb_cpoints_t * cpoints,
+        size_t start,
+        size_t end,
+        qp_via_t * val)
+{
+    if (cpoints->tp == TP_INT)
+    {
+        const int64_t * v = cpoints->val.int64;
+        int64_t sum = 0;
+        for (size_t i = start; i < end; i++)
+        {
+            if ((v[i] > 0 && sum > LLONG_MAX - v[i]) ||
+                    (v[i] < 0 && sum < LLONG_MIN - v[i]))
+            {
+                return -1;
+            }
+            sum += v[i];
+        }
+        val->int64 = sum;
+    }
+    else
+    {
+        val->real = kernels.sum_real(cpoints->val.real + start, end - start);
+    }
+    return 0;
+}
+
+/*
+ * Returns the mean value in range 'start' to 'end'.
+ * (range must not be empty)
+ */
+double siridb_cpoints_mean(
+        siridb_cpoints_t * cpoints,
+        size_t start,
+        size_t end)
+{
+    double sum = 0.0;
+
+    if (cpoints->tp == TP_INT)
+    {
+        const int64_t * v = cpoints->val.int64;
+        for (size_t i = start; i < end; i++)
+        {
+            sum += v[i];
+        }
+    }
+    else
+    {
+        sum = kernels.sum_real(cpoints->val.real + start, end - start);
+    }
+
+    return sum / (end - start);
+}
+
+/*
+ * Add the values in range 'start' to 'end' to a variance state. Each block
+ * of SIRIDB_VARIANCE_BLOCK values uses the sum and squared difference
+ * kernels while the block is in the cache, and is merged with 'state'.
+ */
+void siridb_cpoints_variance(
+        siridb_cpoints_t * cpoints,
+        size_t start,
+        size_t end,
+        siridb_variance_t * state)
+{
+    siridb_variance_t block;
+    double d;
+
+    for (; start < end; start += block.n)
+    {
+        block.n = (end - start < SIRIDB_VARIANCE_BLOCK) ?
+                end - start : SIRIDB_VARIANCE_BLOCK;
+
+        if (cpoints->tp == TP_INT)
+        {
+            const int64_t * v = cpoints->val.int64 + start;
+            block.mean = 0.0;
+            block.m2 = 0.0;
+            for (size_t i = 0; i < block.n; i++)
+            {
+                block.mean += v[i];
+            }
+            block.mean /= block.n;
+            for (size_t i = 0; i < block.n; i++)
+            {
+                d = (double) v[i] - block.mean;
+                block.m2 += d * d;
+            }
+        }
+        else
+        {
+            const double * v = cpoints->val.real + start;
+            block.mean = kernels.sum_real(v, block.n) / block.n;
+            block.m2 = kernels.sqdiff_real(v, block.n, block.mean);
+        }
+
+        siridb_variance_merge(state, &block);
+    }
+}
+
+static int64_t CPOINTS_max_int64(const int64_t * v, size_t n)
+{
+    int64_t max = v[0];
+    for (size_t i = 1; i < n; i++)
+    {
+        max = (v[i] > max) ? v[i] : max;
+    }
+    return max;
+}
+
+static int64_t CPOINTS_min_int64(const int64_t * v, size_t n)
+{
+    int64_t min = v[0];
+    for (size_t i = 1; i < n; i++)
+    {
+        min = (v[i] < min) ? v[i] : min;
+    }
+    return min;
+}
+
+static double CPOINTS_max_real(const double * v, size_t n)
+{
+    double max = v[0];
+    for (size_t i = 1; i < n; i++)
+    {
+        max = (v[i] > max) ? v[i] : max;
+    }
+    return max;
+}
+
+static double CPOINTS_min_real(const double * v, size_t n)
+{
+    double min = v[0];
+    for (size_t i = 1; i < n; i++)
+    {
+        min = (v[i] < min) ? v[i] : min;
+    }
+    return min;
+}
+
+static double CPOINTS_sum_real(const double * v, size_t n)
+{
+    double sum = 0.0;
+    for (size_t i = 0; i < n; i++)
+    {
+        sum += v[i];
+    }
+    return sum;
+}
+
+static double CPOINTS_sqdiff_real(const double * v, size_t n, double mean)
+{
+    double sum = 0.0;
+    double d;
+    for (size_t i = 0; i < n; i++)
+    {
+        d = v[i] - mean;
+        sum += d * d;
+    }
+    return sum;
+}
+
+#ifdef CPOINTS_AVX2
+
+/*
+ * The AVX2 kernels handle 4 values at once and use the scalar kernels for
+ * small ranges and the remaining values.
+ */
+
+__attribute__((target("avx2")))
+static int64_t CPOINTS_max_int64_avx2(const int64_t * v, size_t n)
+{
+    if (n < 8)
+    {
+        return CPOINTS_max_int64(v, n);
+    }
+
+    __m256i max = _mm256_loadu_si256((const __m256i *) v);
+    __m256i x;
+    int64_t tmp[4];
+    int64_t rest;
+    size_t i;
+
+    for (i = 4; i + 4 <= n; i += 4)
+    {
+        x = _mm256_loadu_si256((const __m256i *) (v + i));
+        max = _mm256_blendv_epi8(max, x, _mm256_cmpgt_epi64(x, max));
+    }
+
+    _mm256_storeu_si256((__m256i *) tmp, max);
+    tmp[0] = CPOINTS_max_int64(tmp, 4);
+
+    if (i < n)
+    {
+        rest = CPOINTS_max_int64(v + i, n - i);
+        return (rest > tmp[0]) ? rest : tmp[0];
+    }
+
+    return tmp[0];
+}
+
+__attribute__((target("avx2")))
+static int64_t CPOINTS_min_int64_avx2(const int64_t * v, size_t n)
+{
+    if (n < 8)
+    {
+        return CPOINTS_min_int64(v, n);
+    }
+
+    __m256i min = _mm256_loadu_si256((const __m256i *) v);
+    __m256i x;
+    int64_t tmp[4];
+    int64_t rest;
+    size_t i;
+
+    for (i = 4; i + 4 <= n; i += 4)
+    {
+        x = _mm256_loadu_si256((const __m256i *) (v + i));
+        min = _mm256_blendv_epi8(min, x, _mm256_cmpgt_epi64(min, x));
+    }
+
+    _mm256_storeu_si256((__m256i *) tmp, min);
+    tmp[0] = CPOINTS_min_int64(tmp, 4);
+
+    if (i < n)
+    {
+        rest = CPOINTS_min_int64(v + i, n - i);
+        return (rest < tmp[0]) ? rest : tmp[0];
+    }
+
+    return tmp[0];
+}
+
+__attribute__((target("avx2")))
+static double CPOINTS_max_real_avx2(const double * v, size_t n)
+{
+    if (n < 8)
+    {
+        return CPOINTS_max_real(v, n);
+    }
+
+    __m256d max = _mm256_loadu_pd(v);
+    double tmp[4];
+    double rest;
+    size_t i;
+
+    for (i = 4; i + 4 <= n; i += 4)
+    {
+        /* same as the scalar kernel: (x > max) ? x : max */
+        max = _mm256_max_pd(_mm256_loadu_pd(v + i), max);
+    }
+
+    _mm256_storeu_pd(tmp, max);
+    tmp[0] = CPOINTS_max_real(tmp, 4);
+
+    if (i < n)
+    {
+        rest = CPOINTS_max_real(v + i, n - i);
+        return (rest > tmp[0]) ? rest : tmp[0];
+    }
+
+    return tmp[0];
+}
+
+__attribute__((target("avx2")))
+static double CPOINTS_min_real_avx2(const double * v, size_t n)
+{
+    if (n < 8)
+    {
+        return CPOINTS_min_real(v, n);
+    }
+
+    __m256d min = _mm256_loadu_pd(v);
+    double tmp[4];
+    double rest;
+    size_t i;
+
+    for (i = 4; i + 4 <= n; i += 4)
+    {
+        /* same as the scalar kernel: (x < min) ? x : min */
+        min = _mm256_min_pd(_mm256_loadu_pd(v + i), min);
+    }
+
+    _mm256_storeu_pd(tmp, min);
+    tmp[0] = CPOINTS_min_real(tmp, 4);
+
+    if (i < n)
+    {
+        rest = CPOINTS_min_real(v + i, n - i);
+        return (rest < tmp[0]) ? rest : tmp[0];
+    }
+
+    return tmp[0];
+}
+
+__attribute__((target("avx2")))
+static double CPOINTS_sum_real_avx2(const double * v, size_t n)
+{
+    __m256d sum0 = _mm256_setzero_pd();
+    __m256d sum1 = _mm256_setzero_pd();
+    double tmp[4];
+    size_t i;
+
+    /* two accumulators to hide the latency of the additions */
+    for (i = 0; i + 8 <= n; i += 8)
+    {
+        sum0 = _mm256_add_pd(sum0, _mm256_loadu_pd(v + i));
+        sum1 = _mm256_add_pd(sum1, _mm256_loadu_pd(v + i + 4));
+    }
+
+    _mm256_storeu_pd(tmp, _mm256_add_pd(sum0, sum1));
+
+    return (tmp[0] + tmp[1]) + (tmp[2] + tmp[3]) +
+            CPOINTS_sum_real(v + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static double CPOINTS_sqdiff_real_avx2(
+        const double * v,
+        size_t n,
+        double mean)
+{
+    __m256d m = _mm256_set1_pd(mean);
+    __m256d sum0 = _mm256_setzero_pd();
+    __m256d sum1 = _mm256_setzero_pd();
+    __m256d d0, d1;
+    double tmp[4];
+    size_t i;
+
+    for (i = 0; i + 8 <= n; i += 8)
+    {
+        d0 = _mm256_sub_pd(_mm256_loadu_pd(v + i), m);
+        d1 = _mm256_sub_pd(_mm256_loadu_pd(v + i + 4), m);
+        sum0 = _mm256_add_pd(sum0, _mm256_mul_pd(d0, d0));
+        sum1 = _mm256_add_pd(sum1, _mm256_mul_pd(d1, d1));
+    }
+
+    _mm256_storeu_pd(tmp, _mm256_add_pd(sum0, sum1));
+
+    return (tmp[0] + tmp[1]) + (tmp[2] + tmp[3]) +
+            CPOINTS_sqdiff_real(v + i, n - i, mean);
+}
+
+#endif  /* CPOINTS_AVX2 */
+
+#ifdef CPOINTS_NEON
+
+/*
+ * The NEON kernels handle 2 values at once and use the scalar kernels for
+ * small ranges and the remaining values.
+ */
+
+static int64_t CPOINTS_max_int64_neon(const int64_t * v, size_t n)
+{
+    if (n < 4)
+    {
+        return CPOINTS_max_int64(v, n);
+    }
+
+    int64x2_t max = vld1q_s64(v);
+    int64x2_t x;
+    int64_t tmp[2];
+    int64_t rest;
+    size_t i;
+
+    for (i = 2; i + 2 <= n; i += 2)
+    {
+        x = vld1q_s64(v + i);
+        max = vbslq_s64(vcgtq_s64(x, max), x, max);
+    }
+
+    vst1q_s64(tmp, max);
+    tmp[0] = CPOINTS_max_int64(tmp, 2);
+
+    if (i < n)
+    {
+        rest = CPOINTS_max_int64(v + i, n - i);
+        return (rest > tmp[0]) ? rest : tmp[0];
+    }
+
+    return tmp[0];
+}
+
+static int64_t CPOINTS_min_int64_neon(const int64_t * v, size_t n)
+{
+    if (n < 4)
+    {
+        return CPOINTS_min_int64(v, n);
+    }
+
+    int64x2_t min = vld1q_s64(v);
+    int64x2_t x;
+    int64_t tmp[2];
+    int64_t rest;
+    size_t i;
+
+    for (i = 2; i + 2 <= n; i += 2)
+    {
+        x = vld1q_s64(v + i);
+        min = vbslq_s64(vcltq_s64(x, min), x, min);
+    }
+
+    vst1q_s64(tmp, min);
+    tmp[0] = CPOINTS_min_int64(tmp, 2);
+
+    if (i < n)
+    {
+        rest = CPOINTS_min_int64(v + i, n - i);
+        return (rest < tmp[0]) ? rest : tmp[0];
+    }
+
+    return tmp[0];
+}
+
+static double CPOINTS_max_real_neon(const double * v, size_t n)
+{
+    if (n < 4)
+    {
+        return CPOINTS_max_real(v, n);
+    }
+
+    float64x2_t max = vld1q_f64(v);
+    float64x2_t x;
+    double tmp[2];
+    double rest;
+    size_t i;
+
+    for (i = 2; i + 2 <= n; i += 2)
+    {
+        x = vld1q_f64(v + i);
+        max = vbslq_f64(vcgtq_f64(x, max), x, max);
+    }
+
+    vst1q_f64(tmp, max);
+    tmp[0] = CPOINTS_max_real(tmp, 2);
+
+    if (i < n)
+    {
+        rest = CPOINTS_max_real(v + i, n - i);
+        return (rest > tmp[0]) ? rest : tmp[0];
+    }
+
+    return tmp[0];
+}
+
+static double CPOINTS_min_real_neon(const double * v, size_t n)
+{
+    if (n < 4)
+    {
+        return CPOINTS_min_real(v, n);
+    }
+
+    float64x2_t min = vld1q_f64(v);
+    float64x2_t x;
+    double tmp[2];
+    double rest;
+    size_t i;
+
+    for (i = 2; i + 2 <= n; i += 2)
+    {
+        x = vld1q_f64(v + i);
+        min = vbslq_f64(vcltq_f64(x, min), x, min);
+    }
+
+    vst1q_f64(tmp, min);
+    tmp[0] = CPOINTS_min_real(tmp, 2);
+
+    if (i < n)
+    {
+        rest = CPOINTS_min_real(v + i, n - i);
+        return (rest < tmp[0]) ? rest : tmp[0];
+    }
+
+    return tmp[0];
+}
+
+static double CPOINTS_sum_real_neon(const double * v, size_t n)
+{
+    float64x2_t sum0 = vdupq_n_f64(0.0);
+    float64x2_t sum1 = vdupq_n_f64(0.0);
+    size_t i;
+
+    for (i = 0; i + 4 <= n; i += 4)
+    {
+        sum0 = vaddq_f64(sum0, vld1q_f64(v + i));
+        sum1 = vaddq_f64(sum1, vld1q_f64(v + i + 2));
+    }
+
+    return vaddvq_f64(vaddq_f64(sum0, sum1)) +
+            CPOINTS_sum_real(v + i, n - i);
+}
+
+static double CPOINTS_sqdiff_real_neon(
+        const double * v,
+        size_t n,
+        double mean)
+{
+    float64x2_t m = vdupq_n_f64(mean);
+    float64x2_t sum0 = vdupq_n_f64(0.0);
+    float64x2_t sum1 = vdupq_n_f64(0.0);
+    float64x2_t d0, d1;
+    size_t i;
+
+    for (i = 0; i + 4 <= n; i += 4)
+    {
+        d0 = vsubq_f64(vld1q_f64(v + i), m);
+        d1 = vsubq_f64(vld1q_f64(v + i + 2), m);
+        sum0 = vaddq_f64(sum0, vmulq_f64(d0, d0));
+        sum1 = vaddq_f64(sum1, vmulq_f64(d1, d1));
+    }
+
+    return vaddvq_f64(vaddq_f64(sum0, sum1)) +
+            CPOINTS_sqdiff_real(v + i, n - i, mean);
+}
+
+#endif  /* CPOINTS_NEON */
@@ -0,0 +1,159 @@
+/*
+ * crc32c.c - CRC32C (Castagnoli) checksums for shard chunks.
+ *
+ * author       : Jeroen van der Heijden
+ * email        : jeroen@transceptor.technology
+ * copyright    : 2016, Transceptor Technology
+ *
+ * The checksum is calculated with the SSE 4.2 crc32 instruction (x86_64,
+ * selected at runtime by siridb_crc32c_init()) or the CRC extension when
+ * the compiler targets it (aarch64). Otherwise a lookup table is used.
+ *
+ * A checksum can be continued by passing the result of a previous call as
+ * 'crc', start with 0.
+ *
+ * changes
+ *  - initial version, 14-10-2016
+ *
+ */
+#include <siri/db/crc32c.h>
+#include <string.h>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define CRC32C_SSE42 1
+#include <nmmintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#define CRC32C_ARM 1
+#include <arm_acle.h>
+#endif
+
+/* reversed Castagnoli polynomial */
+#define CRC32C_POLY 0x82f63b78
+
+static uint32_t CRC32C_table(uint32_t crc, const void * data, size_t n);
+
+#ifdef CRC32C_SSE42
+static uint32_t CRC32C_sse42(uint32_t crc, const void * data, size_t n);
+#endif
+
+#ifdef CRC32C_ARM
+static uint32_t CRC32C_arm(uint32_t crc, const void * data, size_t n);
+#endif
+
+static uint32_t crc32c_table[256];
+
+static const char * crc32c_impl = "table";
+static uint32_t (*crc32c_fn)(uint32_t, const void *, size_t) = CRC32C_table;
+
+/*
+ * Build the lookup table and select the implementation for the current CPU.
+ * This function must be called once before checksums are calculated.
+ */
+void siridb_crc32c_init(void)
+{
+    uint32_t crc;
+
+    for (uint32_t i = 0; i < 256; i++)
+    {
+        crc = i;
+        for (int j = 0; j < 8; j++)
+        {
+            crc = (crc & 1) ? (crc >> 1) ^ CRC32C_POLY : crc >> 1;
+        }
+        crc32c_table[i] = crc;
+    }
+
+#ifdef CRC32C_SSE42
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse4.2"))
+    {
+        crc32c_impl = "sse4.2";
+        crc32c_fn = CRC32C_sse42;
+    }
+#endif
+#ifdef CRC32C_ARM
+    crc32c_impl = "arm";
+    crc32c_fn = CRC32C_arm;
+#endif
+}
+
+/*
+ * Returns the name of the implementation in use. (table, sse4.2 or arm)
+ */
+const char * siridb_crc32c_impl(void)
+{
+    return crc32c_impl;
+}
+
+/*
+ * Returns the checksum of 'n' bytes at 'data', continued from 'crc'.
+ */
+uint32_t siridb_crc32c(uint32_t crc, const void * data, size_t n)
+{
+    return ~(*crc32c_fn)(~crc, data, n);
+}
+
+static uint32_t CRC32C_table(uint32_t crc, const void * data, size_t n)
+{
+    const unsigned char * pt = (const unsigned char *) data;
+
+    while (n--)
+    {
+        crc = crc32c_table[(crc ^ *pt++) & 0xff] ^ (crc >> 8);
+    }
+
+    return crc;
+}
+
+#ifdef CRC32C_SSE42
+
+__attribute__((target("sse4.2")))
+static uint32_t CRC32C_sse42(uint32_t crc, const void * data, size_t n)
+{
+    const unsigned char * pt = (const unsigned char *) data;
+    uint64_t crc64 = crc;
+    uint64_t v;
+
+    /* chunks are not aligned so the words are copied */
+    for (; n >= sizeof(uint64_t); n -= sizeof(uint64_t))
+    {
+        memcpy(&v, pt, sizeof(uint64_t));
+        crc64 = _mm_crc32_u64(crc64, v);
+        pt += sizeof(uint64_t);
+    }
+
+    crc = (uint32_t) crc64;
+
+    while (n--)
+    {
+        crc = _mm_crc32_u8(crc, *pt++);
+    }
+
+    return crc;
+}
+
+#endif
+
+#ifdef CRC32C_ARM
+
+static uint32_t CRC32C_arm(uint32_t crc, const void * data, size_t n)
+{
+    const unsigned char * pt = (const unsigned char *) data;
+    uint64_t v;
+
+    for (; n >= sizeof(uint64_t); n -= sizeof(uint64_t))
+    {
+        memcpy(&v, pt, sizeof(uint64_t));
+        crc = __crc32cd(crc, v);
+        pt += sizeof(uint64_t);
+    }
+
+    while (n--)
+    {
+        crc = __crc32cb(crc, *pt++);
+    }
+
+    return crc;
+}
+
+#endif
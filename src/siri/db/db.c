@@ -19,18 +19,36 @@
 #include <logger/logger.h>
 #include <math.h>
 #include <procinfo/procinfo.h>
+#include <siri/db/acache.h>
+#include <siri/db/continuous.h>
 #include <siri/db/db.h>
+#include <siri/db/downsample.h>
+#include <siri/db/durations.h>
+#include <siri/db/hot.h>
+#include <siri/db/hotlog.h>
+#include <siri/db/lookup.h>
+#include <siri/db/mcache.h>
+#include <siri/db/names.h>
+#include <siri/db/qcache.h>
+#include <siri/db/trigrams.h>
+#include <siri/db/rollup.h>
 #include <siri/db/series.h>
 #include <siri/db/servers.h>
+#include <siri/db/session.h>
 #include <siri/db/shard.h>
 #include <siri/db/shards.h>
+#include <siri/db/shash.h>
+#include <siri/db/startup.h>
+#include <siri/db/subscribe.h>
 #include <siri/db/time.h>
+#include <siri/db/tokens.h>
 #include <siri/db/users.h>
 #include <siri/err.h>
 #include <siri/siri.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <timeit/timeit.h>
 #include <uuid/uuid.h>
 #include <xpath/xpath.h>
 #include <slist/slist.h>
@@ -46,6 +64,12 @@
  */
 
 static siridb_t * SIRIDB_new(void);
+static void SIRIDB_read_resources(siridb_t * siridb, cfgparser_t * cfgparser);
+static uint32_t SIRIDB_read_resource(
+        siridb_t * siridb,
+        cfgparser_t * cfgparser,
+        const char * name,
+        uint32_t max_value);
 
 static int SIRIDB_from_unpacker(
         qp_unpacker_t * unpacker,
@@ -100,6 +124,7 @@ siridb_t * siridb_new(const char * dbpath, int lock_flags)
     qp_unpacker_t * unpacker;
     siridb_t * siridb;
     char err_msg[512];
+    uint64_t start = timeit_ns();
     int rc;
 
     if (!len || dbpath[len - 1] != '/')
@@ -183,6 +208,8 @@ siridb_t * siridb_new(const char * dbpath, int lock_flags)
 
     qp_unpacker_ff_free(unpacker);
 
+    siridb_startup_init(&siridb->startup, start);
+
     if (rc > 0 && siridb_save(siridb))
     {
         log_error("Could not write file: %s", buffer);
@@ -221,24 +248,48 @@ siridb_t * siridb_new(const char * dbpath, int lock_flags)
         siridb->buffer_path = siridb->dbpath;
     }
 
-    /* free cfgparser */
-    cfgparser_free(cfgparser);
-
-    if (siridb->buffer_path == NULL)
+    /*
+     * read rollup definitions, shard durations, the downsample policy and
+     * continuous queries
+     */
+    if (    siridb_rollups_read(siridb, cfgparser) ||
+            siridb_durations_read(siridb, cfgparser) ||
+            siridb_downsample_read(siridb, cfgparser) ||
+            siridb_continuous_read(siridb, cfgparser))
     {
-        ERR_ALLOC
+        cfgparser_free(cfgparser);
         siridb_decref(siridb);
-        return NULL;
+        return NULL;  /* signal is raised */
     }
 
+    siridb_startup_phase(siridb, SIRIDB_STARTUP_DATABASE, 1);
+
     /* load users */
     if (siridb_users_load(siridb))
     {
         log_error("Could not read users for database '%s'", siridb->dbname);
+        cfgparser_free(cfgparser);
+        siridb_decref(siridb);
+        return NULL;
+    }
+
+    /* the scheduler class and rate limits are read after the users */
+    siridb_users_read_sched(siridb, cfgparser);
+    siridb_users_read_ratelimit(siridb, cfgparser);
+    SIRIDB_read_resources(siridb, cfgparser);
+
+    /* free cfgparser */
+    cfgparser_free(cfgparser);
+
+    if (siridb->buffer_path == NULL)
+    {
+        ERR_ALLOC
         siridb_decref(siridb);
         return NULL;
     }
 
+    siridb_startup_phase(siridb, SIRIDB_STARTUP_USERS, siridb->users->len);
+
     /* load servers */
     if (siridb_servers_load(siridb))
     {
@@ -247,6 +298,50 @@ siridb_t * siridb_new(const char * dbpath, int lock_flags)
         return NULL;
     }
 
+    siridb_startup_phase(
+            siridb,
+            SIRIDB_STARTUP_SERVERS,
+            siridb->servers->len);
+
+    if ((siridb->names = siridb_names_new()) == NULL)
+    {
+        siridb_decref(siridb);
+        return NULL;  /* signal is raised */
+    }
+
+    /* the series name index must exist before loading the series */
+    if (    siri.cfg->series_name_index &&
+            (siridb->trigrams = siridb_trigrams_new()) == NULL)
+    {
+        siridb_decref(siridb);
+        return NULL;  /* signal is raised */
+    }
+
+    if (    *siri.cfg->series_name_separators &&
+            (siridb->tokens = siridb_tokens_new(
+                    siri.cfg->series_name_separators)) == NULL)
+    {
+        siridb_decref(siridb);
+        return NULL;  /* signal is raised */
+    }
+
+    if (    siri.cfg->series_hash_index &&
+            (siridb->shash = siridb_shash_new()) == NULL)
+    {
+        siridb_decref(siridb);
+        return NULL;  /* signal is raised */
+    }
+
+    for (int tp = 0; tp < SIRIDB_SERIES_TP_NUM; tp++)
+    {
+        if ((siridb->series_tp[tp] = dmap_new()) == NULL)
+        {
+            ERR_ALLOC
+            siridb_decref(siridb);
+            return NULL;
+        }
+    }
+
     /* load series */
     if (siridb_series_load(siridb))
     {
@@ -255,6 +350,18 @@ siridb_t * siridb_new(const char * dbpath, int lock_flags)
         return NULL;
     }
 
+    siridb_startup_phase(
+            siridb,
+            SIRIDB_STARTUP_SERIES,
+            siridb->series_map->len);
+
+    /* markers for the hot log are read while loading the buffer */
+    if ((siridb->hotlog = siridb_hotlog_new()) == NULL)
+    {
+        siridb_decref(siridb);
+        return NULL;  /* signal is raised */
+    }
+
     /* load buffer */
     if (siridb_buffer_load(siridb))
     {
@@ -271,6 +378,11 @@ siridb_t * siridb_new(const char * dbpath, int lock_flags)
         return NULL;
     }
 
+    siridb_startup_phase(
+            siridb,
+            SIRIDB_STARTUP_BUFFER,
+            siridb->series_map->len);
+
     /* load shards */
     if (siridb_shards_load(siridb))
     {
@@ -279,6 +391,20 @@ siridb_t * siridb_new(const char * dbpath, int lock_flags)
         return NULL;
     }
 
+    siridb_startup_phase(siridb, SIRIDB_STARTUP_SHARDS, siridb->shards->len);
+
+    /* replay the hot log, this must be done after loading shards */
+    if (siridb_hotlog_load(siridb))
+    {
+        log_error(
+                "Cannot read hot series log for database '%s'",
+                siridb->dbname);
+        siridb_decref(siridb);
+        return NULL;
+    }
+
+    siridb_startup_phase(siridb, SIRIDB_STARTUP_HOTLOG, 0);
+
     /* load groups */
     if ((siridb->groups = siridb_groups_new(siridb)) == NULL)
     {
@@ -287,11 +413,87 @@ siridb_t * siridb_new(const char * dbpath, int lock_flags)
         return NULL;
     }
 
+    /* attach rollups, this must be done after loading groups */
+    if (siridb_rollups_init(siridb))
+    {
+        log_error("Cannot read rollups for database '%s'", siridb->dbname);
+        siridb_decref(siridb);
+        return NULL;
+    }
+
+    /* set shard durations, this must be done after loading groups */
+    if (siridb_durations_init(siridb))
+    {
+        log_error(
+                "Cannot read shard durations for database '%s'",
+                siridb->dbname);
+        siridb_decref(siridb);
+        return NULL;
+    }
+
+    /* compile continuous queries, this must be done after loading groups */
+    if (siridb_continuous_init(siridb))
+    {
+        log_error(
+                "Cannot read continuous queries for database '%s'",
+                siridb->dbname);
+        siridb_decref(siridb);
+        return NULL;
+    }
+
+    siridb_startup_phase(
+            siridb,
+            SIRIDB_STARTUP_GROUPS,
+            siridb->groups->groups->len);
+
+    /* create the select result cache when enabled (size is set in MB) */
+    if (    siri.cfg->query_cache_size &&
+            (siridb->qcache = siridb_qcache_new(
+                (size_t) siri.cfg->query_cache_size * 1024 * 1024)) == NULL)
+    {
+        siridb_decref(siridb);
+        return NULL;  /* signal is raised */
+    }
+
+    /* create the aggregate cache when enabled and restore the entries */
+    if (siridb_acache_init(siridb))
+    {
+        log_error(
+                "Cannot restore the aggregate cache for database '%s'",
+                siridb->dbname);
+        siridb_decref(siridb);
+        return NULL;
+    }
+
+    /* create the regular expression match cache (size is set in MB) */
+    if (    siri.cfg->match_cache_size &&
+            (siridb->mcache = siridb_mcache_new(
+                (size_t) siri.cfg->match_cache_size * 1024 * 1024)) == NULL)
+    {
+        siridb_decref(siridb);
+        return NULL;  /* signal is raised */
+    }
+
+    /* running queries are registered so they can be killed */
+    if ((siridb->queries = imap_new()) == NULL)
+    {
+        ERR_ALLOC
+        siridb_decref(siridb);
+        return NULL;
+    }
+
+    /* series with the most inserted and selected points */
+    if ((siridb->hot = siridb_hot_new()) == NULL)
+    {
+        siridb_decref(siridb);
+        return NULL;  /* signal is raised */
+    }
+
     /* update series props */
     log_info("Updating series properties");
 
     /* create a copy since 'siridb_series_update_props' might drop a series */
-    slist_t * slist = imap_2slist(siridb->series_map);
+    slist_t * slist = dmap_2slist(siridb->series_map);
 
     if (slist == NULL)
     {
@@ -306,6 +508,8 @@ siridb_t * siridb_new(const char * dbpath, int lock_flags)
         siridb_series_update_props(siridb, (siridb_series_t * )slist->data[i]);
     }
 
+    siridb_startup_phase(siridb, SIRIDB_STARTUP_PROPS, slist->len);
+
     slist_free(slist);
 
     /* generate pools, this can raise a signal */
@@ -321,6 +525,11 @@ siridb_t * siridb_new(const char * dbpath, int lock_flags)
         }
     }
 
+    siridb_startup_phase(
+            siridb,
+            SIRIDB_STARTUP_POOLS,
+            (siridb->pools == NULL) ? 0 : siridb->pools->len);
+
     siridb->start_ts = time(NULL);
 
     uv_mutex_lock(&siri.siridb_mutex);
@@ -338,6 +547,7 @@ siridb_t * siridb_new(const char * dbpath, int lock_flags)
     siridb_groups_start(siridb->groups);
 
     log_info("Finished loading database: '%s'", siridb->dbname);
+    siridb_startup_loaded(siridb);
 
     return siridb;
 }
@@ -530,6 +740,29 @@ static int SIRIDB_from_unpacker(
             READ_DB_EXIT_WITH_ERROR("cannot read list limit.")
         }
         (*siridb)->list_limit = qp_obj.via.int64;
+
+        /* read pool hash, older database files do not have a pool hash */
+        if (qp_next(unpacker, &qp_obj) == QP_INT64)
+        {
+            if (    qp_obj.via.int64 != SIRIDB_LOOKUP_HASH_SUM &&
+                    qp_obj.via.int64 != SIRIDB_LOOKUP_HASH_FNV)
+            {
+                READ_DB_EXIT_WITH_ERROR("cannot read pool hash.")
+            }
+            (*siridb)->pool_hash = (uint8_t) qp_obj.via.int64;
+
+            /* read expiration, older database files do not have these */
+            if (qp_next(unpacker, &qp_obj) == QP_INT64)
+            {
+                (*siridb)->expiration_num = (uint64_t) qp_obj.via.int64;
+
+                if (qp_next(unpacker, &qp_obj) != QP_INT64)
+                {
+                    READ_DB_EXIT_WITH_ERROR("cannot read log expiration.")
+                }
+                (*siridb)->expiration_log = (uint64_t) qp_obj.via.int64;
+            }
+        }
     }
 
     return (qp_schema.via.int64 == SIRIDB_SCHEMA) ? 0 : qp_schema.via.int64;
@@ -565,19 +798,13 @@ void siridb_decref_cb(siridb_t * siridb, void * args __attribute__((unused)))
 }
 
 /*
- * Typedef: sirinet_clserver_get_file
- *
- * Returns the length of the content for a file and set buffer with the file
- * content. Note that malloc is used to allocate memory for the buffer.
+ * Typedef: sirinet_clserver_getfn
  *
- * In case of an error -1 is returned and buffer will be set to NULL.
+ * Writes the file name to 'fn' which has at least PATH_MAX bytes.
  */
-ssize_t siridb_get_file(char ** buffer, siridb_t * siridb)
+void siridb_get_fn(char * fn, siridb_t * siridb)
 {
-    /* get servers file name */
-    SIRIDB_GET_FN(fn, siridb->dbpath, "database.dat")
-
-    return xpath_get_content(buffer, fn);
+    snprintf(fn, PATH_MAX, "%sdatabase.dat", siridb->dbpath);
 }
 
 /*
@@ -630,6 +857,9 @@ int siridb_save(siridb_t * siridb)
             qp_fadd_double(fpacker, siridb->drop_threshold) ||
             qp_fadd_int64(fpacker, siridb->select_points_limit) ||
             qp_fadd_int64(fpacker, siridb->list_limit) ||
+            qp_fadd_int8(fpacker, siridb->pool_hash) ||
+            qp_fadd_int64(fpacker, siridb->expiration_num) ||
+            qp_fadd_int64(fpacker, siridb->expiration_log) ||
             qp_fadd_type(fpacker, QP_ARRAY_CLOSE) ||
             qp_close(fpacker));
 }
@@ -645,10 +875,35 @@ void siridb__free(siridb_t * siridb)
     log_debug("Free database: '%s'", siridb->dbname);
 #endif
 
+    /* rollups are only written when no siri_err has occurred */
+    if (    siridb->rollups != NULL &&
+            siridb->series_map != NULL &&
+            !siri_err &&
+            siridb_rollups_save(siridb))
+    {
+        log_error("Cannot write rollups for database '%s'", siridb->dbname);
+    }
+
+    if (    siridb->acache != NULL &&
+            !siri_err &&
+            siridb_acache_save(siridb))
+    {
+        log_error(
+                "Cannot write the aggregate cache for database '%s'",
+                siridb->dbname);
+    }
+
     /* first we should close all open files */
     if (siridb->buffer_fp != NULL)
     {
-        fclose(siridb->buffer_fp);
+        siridb_buffer_close(siridb);
+    }
+
+    /* series are freed later on and skip the hot log when it is NULL */
+    if (siridb->hotlog != NULL)
+    {
+        siridb_hotlog_free(siridb->hotlog);
+        siridb->hotlog = NULL;
     }
 
     if (siridb->dropped_fp != NULL)
@@ -659,6 +914,14 @@ void siridb__free(siridb_t * siridb)
     if (siridb->store != NULL)
     {
         qp_close(siridb->store);
+
+        /* the snapshot is only written when no siri_err has occurred */
+        if (!siri_err && siridb_series_save_snapshot(siridb))
+        {
+            log_error(
+                    "Cannot write series snapshot for database '%s'",
+                    siridb->dbname);
+        }
     }
 
     /* free users */
@@ -668,7 +931,10 @@ void siridb__free(siridb_t * siridb)
     }
 
     /* free buffer positions */
-    slist_free(siridb->empty_buffers);
+    for (int c = 0; c < SIRIDB_BUFFER_CLASSES; c++)
+    {
+        slist_free(siridb->empty_buffers[c]);
+    }
 
     /* we do not need to free server and replica since they exist in
      * this list and therefore will be freed.
@@ -709,7 +975,19 @@ void siridb__free(siridb_t * siridb)
     /* free imap (series) */
     if (siridb->series_map != NULL)
     {
-        imap_free(siridb->series_map, NULL);
+        dmap_free(siridb->series_map, NULL);
+    }
+
+    siridb_trigrams_free(siridb->trigrams);
+    siridb_tokens_free(siridb->tokens);
+    siridb_shash_free(siridb->shash);
+
+    for (int tp = 0; tp < SIRIDB_SERIES_TP_NUM; tp++)
+    {
+        if (siridb->series_tp[tp] != NULL)
+        {
+            dmap_free(siridb->series_tp[tp], NULL);
+        }
     }
 
     /* free c-tree lookup and series */
@@ -718,6 +996,9 @@ void siridb__free(siridb_t * siridb)
         ct_free(siridb->series, (ct_free_cb) &siridb__series_decref);
     }
 
+    /* chunks with names of series still in use are freed later */
+    siridb_names_free(siridb->names);
+
     /* free shards using imap walk an free the imap */
     if (siridb->shards != NULL)
     {
@@ -735,6 +1016,23 @@ void siridb__free(siridb_t * siridb)
         siridb_groups_decref(siridb->groups);
     }
 
+    siridb_rollups_free(siridb->rollups);
+    siridb_durations_free(siridb->durations);
+    siridb_continuous_free(siridb->continuous);
+    free(siridb->downsample);
+    siridb_qcache_free(siridb->qcache);
+    siridb_acache_free(siridb->acache);
+    siridb_mcache_free(siridb->mcache);
+
+    if (siridb->queries != NULL)
+    {
+        imap_free(siridb->queries, NULL);
+    }
+
+    siridb_subscriptions_free(siridb->subscriptions);
+    siridb_sessions_free(siridb->sessions);
+    siridb_hot_free(siridb->hot);
+
     /* unlock the database in case no siri_err occurred */
     if (!siri_err)
     {
@@ -749,8 +1047,8 @@ void siridb__free(siridb_t * siridb)
     free(siridb->dbname);
     free(siridb->time);
 
-    uv_mutex_destroy(&siridb->series_mutex);
-    uv_mutex_destroy(&siridb->shards_mutex);
+    siri_rwlock_destroy(&siridb->series_mutex);
+    siri_mutex_destroy(&siridb->shards_mutex);
 
     free(siridb);
 }
@@ -758,6 +1056,96 @@ void siridb__free(siridb_t * siridb)
 /*
  * Returns NULL and raises a SIGNAL in case an error has occurred.
  */
+/*
+ * Read the resources for this database from the [resources] section in
+ * database.conf, for example:
+ *
+ *      [resources]
+ *      threads = 2
+ *      index_memory_limit = 512
+ *      optimize_io_limit = 20
+ *
+ * 'threads' is the number of scheduler threads the selects for this database
+ * may use at the same time, 'index_memory_limit' in MB replaces the global
+ * limit for this database and 'optimize_io_limit' in MB/s is used in
+ * addition to the global limit. A value of 0 or a missing option means no
+ * limit for this database. Invalid options are logged.
+ */
+static void SIRIDB_read_resources(siridb_t * siridb, cfgparser_t * cfgparser)
+{
+    cfgparser_section_t * section;
+
+    if (cfgparser_get_section(
+            &section,
+            cfgparser,
+            SIRIDB_RESOURCES_SECTION) != CFGPARSER_SUCCESS)
+    {
+        return;
+    }
+
+    siridb->sched_limit.threads = (uint16_t) SIRIDB_read_resource(
+            siridb,
+            cfgparser,
+            "threads",
+            UINT16_MAX);
+    siridb->index_memory_limit = SIRIDB_read_resource(
+            siridb,
+            cfgparser,
+            "index_memory_limit",
+            INT32_MAX);
+    siridb->optimize_throttle.limit = SIRIDB_read_resource(
+            siridb,
+            cfgparser,
+            "optimize_io_limit",
+            INT32_MAX);
+
+    if (siridb->sched_limit.threads)
+    {
+        log_info(
+                "Database '%s' may use %u scheduler thread(s)",
+                siridb->dbname,
+                siridb->sched_limit.threads);
+    }
+}
+
+/*
+ * Returns the value for an option in the [resources] section or 0 when the
+ * option is missing or invalid.
+ */
+static uint32_t SIRIDB_read_resource(
+        siridb_t * siridb,
+        cfgparser_t * cfgparser,
+        const char * name,
+        uint32_t max_value)
+{
+    cfgparser_option_t * option;
+
+    if (cfgparser_get_option(
+            &option,
+            cfgparser,
+            SIRIDB_RESOURCES_SECTION,
+            name) != CFGPARSER_SUCCESS)
+    {
+        return 0;
+    }
+
+    if (    option->tp != CFGPARSER_TP_INTEGER ||
+            option->val->integer < 0 ||
+            (uint32_t) option->val->integer > max_value)
+    {
+        log_error(
+                "Invalid '%s' in section [%s] for database '%s', expecting "
+                "an integer value between 0 and %" PRIu32,
+                name,
+                SIRIDB_RESOURCES_SECTION,
+                siridb->dbname,
+                max_value);
+        return 0;
+    }
+
+    return (uint32_t) option->val->integer;
+}
+
 static siridb_t * SIRIDB_new(void)
 {
     siridb_t * siridb = (siridb_t *) malloc(sizeof(siridb_t));
@@ -776,7 +1164,7 @@ static siridb_t * SIRIDB_new(void)
         }
         else
         {
-            siridb->series_map = imap_new();
+            siridb->series_map = dmap_new();
             if (siridb->series_map == NULL)
             {
                 ct_free(siridb->series, NULL);
@@ -789,7 +1177,7 @@ static siridb_t * SIRIDB_new(void)
                 siridb->shards = imap_new();
                 if (siridb->shards == NULL)
                 {
-                    imap_free(siridb->series_map, NULL);
+                    dmap_free(siridb->series_map, NULL);
                     ct_free(siridb->series, NULL);
                     free(siridb);
                     siridb = NULL;
@@ -798,12 +1186,25 @@ static siridb_t * SIRIDB_new(void)
                 }
                 else
                 {
-                    /* allocate a list for buffer positions */
-                    siridb->empty_buffers = slist_new(SLIST_DEFAULT_SIZE);
-                    if (siridb->empty_buffers == NULL)
+                    /* allocate a list for buffer positions per class */
+                    int c;
+                    for (c = 0; c < SIRIDB_BUFFER_CLASSES; c++)
+                    {
+                        siridb->empty_buffers[c] =
+                                slist_new(SLIST_DEFAULT_SIZE);
+                        if (siridb->empty_buffers[c] == NULL)
+                        {
+                            break;
+                        }
+                    }
+                    if (c < SIRIDB_BUFFER_CLASSES)
                     {
+                        while (c--)
+                        {
+                            slist_free(siridb->empty_buffers[c]);
+                        }
                         imap_free(siridb->shards, NULL);
-                        imap_free(siridb->series_map, NULL);
+                        dmap_free(siridb->series_map, NULL);
                         ct_free(siridb->series, NULL);
                         free(siridb);
                         siridb = NULL;
@@ -823,11 +1224,28 @@ static siridb_t * SIRIDB_new(void)
                         siridb->servers = NULL;
                         siridb->pools = NULL;
                         siridb->max_series_id = 0;
+                        siridb->store_pending = 0;
                         siridb->received_points = 0;
                         siridb->selected_points = 0;
+                        siridb->insert_queue = 0;
+                        siridb->insert_queue_size = 0;
+                        siridb->data_version = 0;
+                        siridb->series_gen = 0;
+                        siridb->query_id = 0;
+                        siridb->shards_gen = 0;
+                        siridb->cold_shards = 0;
+                        siridb->shard_dclasses = 0;
+                        siridb->index_memory_limit = 0;
+                        siridb->sched_limit.threads = 0;
+                        siridb->sched_limit.running = 0;
+                        siridb->optimize_throttle.limit = 0;
+                        siridb->optimize_throttle.full = 0;
                         siridb->drop_threshold = DEF_DROP_THRESHOLD;
                         siridb->select_points_limit = DEF_SELECT_POINTS_LIMIT;
                         siridb->list_limit = DEF_LIST_LIMIT;
+                        siridb->pool_hash = SIRIDB_LOOKUP_HASH_SUM;
+                        siridb->expiration_num = 0;
+                        siridb->expiration_log = 0;
                         siridb->buffer_size = -1;
                         siridb->tz = -1;
                         siridb->server = NULL;
@@ -836,14 +1254,36 @@ static siridb_t * SIRIDB_new(void)
                         siridb->replicate = NULL;
                         siridb->reindex = NULL;
                         siridb->groups = NULL;
+                        siridb->rollups = NULL;
+                        siridb->durations = NULL;
+                        siridb->continuous = NULL;
+                        siridb->downsample = NULL;
+                        siridb->qcache = NULL;
+                        siridb->acache = NULL;
+                        siridb->mcache = NULL;
+                        siridb->queries = NULL;
+                        siridb->subscriptions = NULL;
+                        siridb->sessions = NULL;
+                        siridb->hot = NULL;
+                        siridb->trigrams = NULL;
+                        siridb->tokens = NULL;
+                        siridb->shash = NULL;
+                        siridb->names = NULL;
+                        for (int tp = 0; tp < SIRIDB_SERIES_TP_NUM; tp++)
+                        {
+                            siridb->series_tp[tp] = NULL;
+                        }
 
                         /* make file pointers are NULL when file is closed */
                         siridb->buffer_fp = NULL;
+                        siridb->buffer_map = NULL;
+                        siridb->buffer_map_sz = 0;
+                        siridb->hotlog = NULL;
                         siridb->dropped_fp = NULL;
                         siridb->store = NULL;
 
-                        uv_mutex_init(&siridb->series_mutex);
-                        uv_mutex_init(&siridb->shards_mutex);
+                        siri_rwlock_init(&siridb->series_mutex);
+                        siri_mutex_init(&siridb->shards_mutex);
                     }
                 }
             }
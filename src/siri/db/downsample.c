@@ -0,0 +1,446 @@
+/*
+ * downsample.c - Downsample old number shards while optimizing.
+ *
+ * author       : Jeroen van der Heijden
+ * email        : jeroen@transceptor.technology
+ * copyright    : 2016, Transceptor Technology
+ *
+ * Number shards which end before a given age are rewritten by the optimize
+ * task with one point per interval for each series. The policy is defined in
+ * the [downsample] section of database.conf, for example:
+ *
+ *      [downsample]
+ *      age = 4w
+ *      interval = 1h
+ *      aggregate = mean
+ *
+ * The aggregate is one of mean, min, max or last, the default is mean. The
+ * point for an interval gets the time-stamp of the last point in the
+ * interval, so group by queries with the same or a larger interval return
+ * almost the same result as before.
+ *
+ * The interval must fit an exact number of times in the shard duration so
+ * an interval never covers two shards. Shards with another duration, see
+ * durations.c, are skipped when the interval does not fit. Each shard is
+ * downsampled once. The end of the last downsampled shard is written to
+ * downsample.dat when the optimize task has finished, so changing the policy
+ * only affects shards which are not downsampled yet. Points which are
+ * inserted in a shard after it is downsampled are kept.
+ *
+ * changes
+ *  - initial version, 14-10-2016
+ *
+ */
+#include <logger/logger.h>
+#include <math.h>
+#include <siri/db/db.h>
+#include <siri/db/downsample.h>
+#include <siri/db/misc.h>
+#include <siri/db/shard.h>
+#include <siri/db/time.h>
+#include <siri/err.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <xpath/xpath.h>
+
+#define SIRIDB_DOWNSAMPLE_FN "downsample.dat"
+#define SIRIDB_DOWNSAMPLE_SCHEMA 1
+
+static int DOWNSAMPLE_time(
+        siridb_t * siridb,
+        cfgparser_t * cfgparser,
+        const char * name,
+        uint64_t * ts);
+static int DOWNSAMPLE_tp(cfgparser_t * cfgparser, siridb_downsample_tp_t * tp);
+static uint64_t DOWNSAMPLE_end(siridb_shard_t * shard);
+static void DOWNSAMPLE_load(siridb_t * siridb);
+
+/*
+ * Read the downsample policy from the [downsample] section in database.conf.
+ * An invalid policy is logged and downsampling is disabled.
+ *
+ * Returns 0 if successful or -1 and a SIGNAL is raised in case of an error.
+ */
+int siridb_downsample_read(siridb_t * siridb, cfgparser_t * cfgparser)
+{
+    cfgparser_section_t * section;
+    siridb_downsample_t * downsample;
+    uint64_t age, interval;
+    siridb_downsample_tp_t tp;
+
+    if (cfgparser_get_section(
+            &section,
+            cfgparser,
+            SIRIDB_DOWNSAMPLE_SECTION) != CFGPARSER_SUCCESS)
+    {
+        return 0;  /* no downsampling */
+    }
+
+    if (    DOWNSAMPLE_time(siridb, cfgparser, "age", &age) ||
+            DOWNSAMPLE_time(siridb, cfgparser, "interval", &interval) ||
+            DOWNSAMPLE_tp(cfgparser, &tp))
+    {
+        return 0;  /* logging is done */
+    }
+
+    if (siridb->duration_num % interval)
+    {
+        log_error(
+                "Downsample interval for database '%s' must fit an exact "
+                "number of times in the shard duration",
+                siridb->dbname);
+        return 0;
+    }
+
+    downsample = (siridb_downsample_t *) malloc(sizeof(siridb_downsample_t));
+
+    if (downsample == NULL)
+    {
+        ERR_ALLOC
+        return -1;
+    }
+
+    downsample->age = age;
+    downsample->interval = interval;
+    downsample->tp = tp;
+    downsample->cutoff = 0;
+    downsample->done = 0;
+
+    siridb->downsample = downsample;
+
+    DOWNSAMPLE_load(siridb);
+
+    log_info(
+            "Downsample shards older than %" PRIu32 " seconds for database "
+            "'%s' to one point per %" PRIu32 " seconds",
+            siridb_time_in_seconds(siridb, (int64_t) age),
+            siridb->dbname,
+            siridb_time_in_seconds(siridb, (int64_t) interval));
+
+    return 0;
+}
+
+/*
+ * Set the cutoff for the shards which are downsampled by the optimize task.
+ * A cold shard cannot be downsampled, so the cutoff is moved before the
+ * first cold shard which should be downsampled. The shard will be
+ * downsampled by a next optimize task after it is loaded.
+ *
+ * The series_mutex must be locked while calling this function.
+ */
+void siridb_downsample_prepare(siridb_t * siridb, slist_t * shards)
+{
+    siridb_downsample_t * downsample = siridb->downsample;
+    siridb_shard_t * shard;
+    struct timespec now;
+    uint64_t ts, end;
+
+    if (downsample == NULL)
+    {
+        return;
+    }
+
+    clock_gettime(CLOCK_REALTIME, &now);
+    ts = siridb_time_now(siridb, now);
+
+    downsample->cutoff = (ts > downsample->age) ? ts - downsample->age : 0;
+
+    for (size_t i = 0; i < shards->len; i++)
+    {
+        shard = (siridb_shard_t *) shards->data[i];
+
+        if (!shard->is_cold || shard->tp != SIRIDB_SHARD_TP_NUMBER)
+        {
+            continue;
+        }
+
+        end = DOWNSAMPLE_end(shard);
+
+        if (end <= downsample->cutoff && end > downsample->done)
+        {
+            downsample->cutoff = end - shard->duration;
+        }
+    }
+}
+
+/*
+ * Returns 1 (true) when the shard should be downsampled or 0 if not.
+ */
+int siridb_downsample_shard(siridb_t * siridb, siridb_shard_t * shard)
+{
+    siridb_downsample_t * downsample = siridb->downsample;
+    uint64_t end;
+
+    if (    downsample == NULL ||
+            shard->is_cold ||
+            shard->tp != SIRIDB_SHARD_TP_NUMBER ||
+            shard->duration % downsample->interval)
+    {
+        return 0;
+    }
+
+    end = DOWNSAMPLE_end(shard);
+
+    return end <= downsample->cutoff && end > downsample->done;
+}
+
+/*
+ * Mark the shards up to the cutoff as downsampled. Must be called when the
+ * optimize task has finished all shards.
+ *
+ * Returns 0 if successful or EOF in case of an error.
+ */
+int siridb_downsample_commit(siridb_t * siridb)
+{
+    siridb_downsample_t * downsample = siridb->downsample;
+    qp_fpacker_t * fpacker;
+
+    if (downsample == NULL || downsample->cutoff <= downsample->done)
+    {
+        return 0;
+    }
+
+    downsample->done = downsample->cutoff;
+
+    SIRIDB_GET_FN(fn, siridb->dbpath, SIRIDB_DOWNSAMPLE_FN)
+
+    log_debug("Write downsample state to file: '%s'", fn);
+
+    return (
+        (fpacker = qp_open(fn, "w")) == NULL ||
+
+        /* open a new array */
+        qp_fadd_type(fpacker, QP_ARRAY_OPEN) ||
+
+        /* write the current schema */
+        qp_fadd_int16(fpacker, SIRIDB_DOWNSAMPLE_SCHEMA) ||
+
+        qp_fadd_int64(fpacker, (int64_t) downsample->done) ||
+
+        /* close file pointer */
+        qp_close(fpacker)) ? EOF : 0;
+}
+
+/*
+ * Replace the points, which must be sorted by time-stamp, with one point for
+ * each interval. Returns the new number of points.
+ */
+size_t siridb_downsample_points(
+        siridb_downsample_t * downsample,
+        siridb_points_t * points)
+{
+    siridb_point_t * point = points->data;
+    siridb_point_t * end = points->data + points->len;
+    siridb_point_t * first;
+    siridb_point_t * dest = points->data;
+    uint64_t window;
+    long double sum;
+    size_t n;
+
+    while (point < end)
+    {
+        window = point->ts - point->ts % downsample->interval;
+        first = point;
+        *dest = *point;
+        sum = 0.0;
+
+        for (n = 0;
+             point < end && point->ts - point->ts % downsample->interval ==
+                window;
+             point++, n++)
+        {
+            switch (downsample->tp)
+            {
+            case SIRIDB_DOWNSAMPLE_MEAN:
+                sum += (points->tp == TP_INT) ?
+                        (long double) point->val.int64 : point->val.real;
+                break;
+            case SIRIDB_DOWNSAMPLE_MIN:
+                if ((points->tp == TP_INT) ?
+                        point->val.int64 < dest->val.int64 :
+                        point->val.real < dest->val.real)
+                {
+                    dest->val = point->val;
+                }
+                break;
+            case SIRIDB_DOWNSAMPLE_MAX:
+                if ((points->tp == TP_INT) ?
+                        point->val.int64 > dest->val.int64 :
+                        point->val.real > dest->val.real)
+                {
+                    dest->val = point->val;
+                }
+                break;
+            case SIRIDB_DOWNSAMPLE_LAST:
+                dest->val = point->val;
+                break;
+            }
+        }
+
+        if (downsample->tp == SIRIDB_DOWNSAMPLE_MEAN && n > 1)
+        {
+            if (points->tp == TP_INT)
+            {
+                dest->val.int64 = (int64_t) llroundl(sum / n);
+            }
+            else
+            {
+                dest->val.real = (double) (sum / n);
+            }
+        }
+
+        /* the last time-stamp keeps the end of the series the same */
+        dest->ts = first[n - 1].ts;
+        dest++;
+    }
+
+    points->len = dest - points->data;
+
+    return points->len;
+}
+
+/*
+ * Read a time option like '4w' from the [downsample] section.
+ *
+ * Returns 0 if successful or -1 when the option is missing or invalid.
+ */
+static int DOWNSAMPLE_time(
+        siridb_t * siridb,
+        cfgparser_t * cfgparser,
+        const char * name,
+        uint64_t * ts)
+{
+    cfgparser_option_t * option;
+    const char * pt;
+
+    if (cfgparser_get_option(
+            &option,
+            cfgparser,
+            SIRIDB_DOWNSAMPLE_SECTION,
+            name) != CFGPARSER_SUCCESS ||
+        option->tp != CFGPARSER_TP_STRING)
+    {
+        log_error(
+                "Missing or invalid '%s' in section [%s] for database '%s' "
+                "(expecting for example '4w')",
+                name,
+                SIRIDB_DOWNSAMPLE_SECTION,
+                siridb->dbname);
+        return -1;
+    }
+
+    for (pt = option->val->string; *pt >= '0' && *pt <= '9'; pt++);
+
+    if (    pt == option->val->string ||
+            *pt == '\0' ||
+            strchr("smhdw", *pt) == NULL ||
+            pt[1] != '\0')
+    {
+        log_error(
+                "Invalid '%s' in section [%s] for database '%s': '%s' "
+                "(expecting for example '4w')",
+                name,
+                SIRIDB_DOWNSAMPLE_SECTION,
+                siridb->dbname,
+                option->val->string);
+        return -1;
+    }
+
+    *ts = siridb_time_parse(option->val->string, pt - option->val->string + 1)
+            * siridb->time->factor;
+
+    if (!*ts)
+    {
+        log_error(
+                "Option '%s' in section [%s] must be greater than zero",
+                name,
+                SIRIDB_DOWNSAMPLE_SECTION);
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Read the optional aggregate from the [downsample] section.
+ *
+ * Returns 0 if successful or -1 when the aggregate is invalid.
+ */
+static int DOWNSAMPLE_tp(cfgparser_t * cfgparser, siridb_downsample_tp_t * tp)
+{
+    cfgparser_option_t * option;
+    const char * names[] = {"mean", "min", "max", "last"};
+
+    if (cfgparser_get_option(
+            &option,
+            cfgparser,
+            SIRIDB_DOWNSAMPLE_SECTION,
+            "aggregate") != CFGPARSER_SUCCESS)
+    {
+        *tp = SIRIDB_DOWNSAMPLE_MEAN;
+        return 0;
+    }
+
+    for (int i = 0;
+         option->tp == CFGPARSER_TP_STRING &&
+         i <= SIRIDB_DOWNSAMPLE_LAST;
+         i++)
+    {
+        if (strcmp(option->val->string, names[i]) == 0)
+        {
+            *tp = (siridb_downsample_tp_t) i;
+            return 0;
+        }
+    }
+
+    log_error(
+            "Invalid 'aggregate' in section [%s], expecting mean, min, max "
+            "or last",
+            SIRIDB_DOWNSAMPLE_SECTION);
+    return -1;
+}
+
+/*
+ * Returns the end of the time range for a number shard.
+ */
+static uint64_t DOWNSAMPLE_end(siridb_shard_t * shard)
+{
+    return SIRIDB_SHARD_START(shard) + shard->duration;
+}
+
+/*
+ * Read the end of the last downsampled shard. The file is not critical,
+ * without the file all old shards are downsampled again which gives the
+ * same result.
+ */
+static void DOWNSAMPLE_load(siridb_t * siridb)
+{
+    SIRIDB_GET_FN(fn, siridb->dbpath, SIRIDB_DOWNSAMPLE_FN)
+    qp_unpacker_t * unpacker;
+    qp_obj_t qp_done;
+
+    if (!xpath_file_exist(fn))
+    {
+        return;
+    }
+
+    if ((unpacker = siridb_misc_open_schema_file(
+            SIRIDB_DOWNSAMPLE_SCHEMA,
+            fn)) == NULL)
+    {
+        log_error("Cannot read downsample state: '%s'", fn);
+        return;
+    }
+
+    if (qp_next(unpacker, &qp_done) == QP_INT64 && qp_done.via.int64 >= 0)
+    {
+        siridb->downsample->done = (uint64_t) qp_done.via.int64;
+    }
+    else
+    {
+        log_error("Invalid downsample state: '%s'", fn);
+    }
+
+    qp_unpacker_ff_free(unpacker);
+}
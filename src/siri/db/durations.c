@@ -0,0 +1,429 @@
+/*
+ * durations.c - Shard durations for groups of number series.
+ *
+ * author       : Jeroen van der Heijden
+ * email        : jeroen@transceptor.technology
+ * copyright    : 2016, Transceptor Technology
+ *
+ * Number series matching a regular expression or a group can use another
+ * shard duration than the database, for example smaller shards for series
+ * with many points and larger shards for series with only a few points.
+ * Shard durations are defined in the [shard_duration] section of
+ * database.conf, the first matching definition is used:
+ *
+ *      [shard_duration]
+ *      sensors = 1d /^sensor\..*$/
+ *      daily = 26w daily_series
+ *
+ * Only the durations in durations_hours can be used. Each duration has its
+ * own range of shard ids: the id of a shard is the start of the shard plus
+ * 'dclass * shard_mask_num + mask', so the duration of a shard follows from
+ * the id modulo one hour. Shards of the database duration have class 0 and
+ * keep the ids they always had.
+ *
+ * Changes are used after a restart. Existing points stay in the shards they
+ * are written to, only new points are written to shards with the new
+ * duration. Points which are added before the groups are loaded, while the
+ * hot log is replayed, use the duration of the database.
+ *
+ * changes
+ *  - initial version, 14-10-2016
+ *
+ */
+#include <logger/logger.h>
+#include <siri/db/db.h>
+#include <siri/db/durations.h>
+#include <siri/db/group.h>
+#include <siri/db/groups.h>
+#include <siri/db/series.h>
+#include <siri/db/shard.h>
+#include <siri/db/time.h>
+#include <siri/err.h>
+#include <siri/siri.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DURATIONS_HOUR(siridb) ((uint64_t) 3600 * (siridb)->time->factor)
+
+static const uint32_t durations_hours[SIRIDB_DURATIONS_SZ] = {
+        1, 2, 3, 6, 12, 24, 48, 168, 336, 672, 4368, 8736};
+
+static siridb_duration_t * DURATIONS_new(const char * name, const char * val);
+static void DURATIONS_free(siridb_duration_t * duration);
+static int DURATIONS_compile(siridb_t * siridb, siridb_duration_t * duration);
+
+/*
+ * Read the shard durations from the [shard_duration] section in
+ * database.conf. Invalid definitions are logged and ignored.
+ *
+ * Returns 0 if successful or -1 and a SIGNAL is raised in case of an error.
+ */
+int siridb_durations_read(siridb_t * siridb, cfgparser_t * cfgparser)
+{
+    cfgparser_section_t * section;
+    cfgparser_option_t * option;
+    siridb_duration_t * duration;
+
+    if (cfgparser_get_section(
+            &section,
+            cfgparser,
+            SIRIDB_DURATIONS_SECTION) != CFGPARSER_SUCCESS)
+    {
+        return 0;  /* no shard durations */
+    }
+
+    /* all classes must fit in the ids of one hour */
+    if ((uint64_t) (SIRIDB_DURATIONS_SZ + 1) * siridb->shard_mask_num >
+            DURATIONS_HOUR(siridb))
+    {
+        log_error(
+                "Shard durations cannot be used for database '%s' since the "
+                "number duration is too large",
+                siridb->dbname);
+        return 0;
+    }
+
+    for (option = section->options; option != NULL; option = option->next)
+    {
+        if (option->tp != CFGPARSER_TP_STRING)
+        {
+            log_error(
+                    "Invalid shard duration '%s', expecting a duration and a "
+                    "regular expression or group name",
+                    option->name);
+            continue;
+        }
+
+        duration = DURATIONS_new(option->name, option->val->string);
+
+        if (duration == NULL)
+        {
+            continue;  /* logging is done or a signal is raised */
+        }
+
+        if (siridb->durations == NULL &&
+            (siridb->durations = slist_new(SLIST_DEFAULT_SIZE)) == NULL)
+        {
+            DURATIONS_free(duration);
+            ERR_ALLOC
+            return -1;
+        }
+
+        if (slist_append_safe(&siridb->durations, duration))
+        {
+            DURATIONS_free(duration);
+            ERR_ALLOC
+            return -1;
+        }
+    }
+
+    return siri_err;
+}
+
+/*
+ * Compile the shard durations and set the duration class of all series.
+ * Must be called after the groups are loaded.
+ *
+ * Returns 0 if successful or -1 and a SIGNAL is raised in case of an error.
+ */
+int siridb_durations_init(siridb_t * siridb)
+{
+    siridb_duration_t * duration;
+    slist_t * slist;
+    size_t i;
+
+    if (siridb->durations == NULL)
+    {
+        return 0;
+    }
+
+    for (i = 0; i < siridb->durations->len;)
+    {
+        duration = (siridb_duration_t *) siridb->durations->data[i];
+
+        if (DURATIONS_compile(siridb, duration))
+        {
+            /* the order of shard durations is preserved */
+            memmove(siridb->durations->data + i,
+                    siridb->durations->data + i + 1,
+                    (--siridb->durations->len - i) * sizeof(void *));
+            DURATIONS_free(duration);
+            continue;
+        }
+
+        log_info(
+                "Using shard duration '%s' (%" PRIu32 "h) for series "
+                "matching '%s'",
+                duration->name,
+                durations_hours[duration->dclass - 1],
+                duration->source);
+        i++;
+    }
+
+    slist = dmap_2slist(siridb->series_map);
+
+    if (slist == NULL)
+    {
+        return -1;  /* signal is raised */
+    }
+
+    for (i = 0; i < slist->len; i++)
+    {
+        siridb_durations_add_series(
+                siridb,
+                (siridb_series_t *) slist->data[i]);
+    }
+
+    slist_free(slist);
+
+    return 0;
+}
+
+/*
+ * Destroy shard durations. (parsing NULL is allowed)
+ */
+void siridb_durations_free(slist_t * durations)
+{
+    if (durations != NULL)
+    {
+        for (size_t i = 0; i < durations->len; i++)
+        {
+            DURATIONS_free((siridb_duration_t *) durations->data[i]);
+        }
+        slist_free(durations);
+    }
+}
+
+/*
+ * Set the duration class of the first matching shard duration for a number
+ * series, or 0 when no shard duration matches.
+ */
+void siridb_durations_add_series(siridb_t * siridb, siridb_series_t * series)
+{
+    siridb_duration_t * duration;
+
+    series->dclass = 0;
+
+    if (siridb->durations == NULL || !siridb_series_isnum(series))
+    {
+        return;
+    }
+
+    for (size_t i = 0; i < siridb->durations->len; i++)
+    {
+        duration = (siridb_duration_t *) siridb->durations->data[i];
+
+        if (    duration->re != NULL &&
+                siridb_re_match(
+                    duration->re,
+                    series->name,
+                    series->name_len) == 0)
+        {
+            series->dclass = duration->dclass;
+            return;
+        }
+    }
+}
+
+/*
+ * Returns the number shard duration for a duration class.
+ */
+uint64_t siridb_durations_get(siridb_t * siridb, uint8_t dclass)
+{
+    return (dclass) ?
+            durations_hours[dclass - 1] * DURATIONS_HOUR(siridb) :
+            siridb->duration_num;
+}
+
+/*
+ * Returns the duration class of a number shard with 'id'. The class is
+ * larger than SIRIDB_DURATIONS_SZ for an invalid id.
+ */
+uint8_t siridb_durations_class(siridb_t * siridb, uint64_t id)
+{
+    uint64_t dclass = id % DURATIONS_HOUR(siridb) / siridb->shard_mask_num;
+
+    return (dclass <= SIRIDB_DURATIONS_SZ) ?
+            (uint8_t) dclass : SIRIDB_DURATIONS_SZ + 1;
+}
+
+/*
+ * Returns the duration for a shard with 'id' and type 'tp', or 0 when the
+ * id does not belong to a duration class.
+ */
+uint64_t siridb_durations_by_id(siridb_t * siridb, uint8_t tp, uint64_t id)
+{
+    uint8_t dclass;
+
+    if (tp != SIRIDB_SHARD_TP_NUMBER)
+    {
+        return siridb->duration_log;
+    }
+
+    dclass = siridb_durations_class(siridb, id);
+
+    return (dclass <= SIRIDB_DURATIONS_SZ) ?
+            siridb_durations_get(siridb, dclass) : 0;
+}
+
+/*
+ * Returns the mask of the series which are written to a shard with 'id' and
+ * type 'tp'. The mask is the same for all shard durations.
+ */
+uint16_t siridb_durations_mask(siridb_t * siridb, uint8_t tp, uint64_t id)
+{
+    return (tp == SIRIDB_SHARD_TP_NUMBER) ?
+            (uint16_t) (id % DURATIONS_HOUR(siridb) % siridb->shard_mask_num) :
+            (uint16_t) (id % siridb->duration_log);
+}
+
+/*
+ * Returns the id of the shard for a point with time-stamp 'ts' of a series.
+ * The shard duration is set to 'duration'.
+ */
+uint64_t siridb_durations_shard_id(
+        siridb_t * siridb,
+        siridb_series_t * series,
+        uint64_t ts,
+        uint64_t * duration)
+{
+    if (!siridb_series_isnum(series))
+    {
+        *duration = siridb->duration_log;
+        return ts - ts % *duration + series->mask;
+    }
+
+    *duration = siridb_durations_get(siridb, series->dclass);
+
+    return ts - ts % *duration + series->mask +
+            (uint64_t) series->dclass * siridb->shard_mask_num;
+}
+
+static siridb_duration_t * DURATIONS_new(const char * name, const char * val)
+{
+    siridb_duration_t * duration;
+    const char * pt = val;
+    uint64_t hours;
+    uint8_t dclass;
+
+    for (; *pt >= '0' && *pt <= '9'; pt++);
+
+    if (pt == val || strchr("hdw", *pt) == NULL || *pt == '\0' ||
+            (pt[1] != ' ' && pt[1] != '\t'))
+    {
+        log_error(
+                "Invalid duration for shard duration '%s': '%s' (expecting "
+                "for example '1d')",
+                name,
+                val);
+        return NULL;
+    }
+
+    hours = siridb_time_parse(val, pt - val + 1) / 3600;
+
+    for (dclass = 0; dclass < SIRIDB_DURATIONS_SZ; dclass++)
+    {
+        if (durations_hours[dclass] == hours)
+        {
+            break;
+        }
+    }
+
+    if (dclass == SIRIDB_DURATIONS_SZ)
+    {
+        log_error(
+                "Unsupported duration for shard duration '%s': '%.*s' "
+                "(expecting 1h, 2h, 3h, 6h, 12h, 1d, 2d, 1w, 2w, 4w, 26w "
+                "or 52w)",
+                name,
+                (int) (pt - val + 1),
+                val);
+        return NULL;
+    }
+
+    for (pt++; *pt == ' ' || *pt == '\t'; pt++);
+
+    if (*pt == '\0')
+    {
+        log_error(
+                "Missing a regular expression or group name for shard "
+                "duration '%s'",
+                name);
+        return NULL;
+    }
+
+    duration = (siridb_duration_t *) malloc(sizeof(siridb_duration_t));
+
+    if (duration == NULL)
+    {
+        ERR_ALLOC
+        return NULL;
+    }
+
+    duration->dclass = dclass + 1;
+    duration->re = NULL;
+    duration->name = strdup(name);
+    duration->source = strdup(pt);
+
+    if (duration->name == NULL || duration->source == NULL)
+    {
+        ERR_ALLOC
+        DURATIONS_free(duration);
+        return NULL;
+    }
+
+    return duration;
+}
+
+static void DURATIONS_free(siridb_duration_t * duration)
+{
+    free(duration->name);
+    free(duration->source);
+    if (duration->re != NULL)
+    {
+        siridb_re_decref(siri.re_cache, duration->re);
+    }
+    free(duration);
+}
+
+/*
+ * A source starting with a slash is a regular expression, otherwise the
+ * expression of the group with that name is used. Changes to the group are
+ * used after a restart.
+ *
+ * Returns 0 if successful or -1 in case of an error. (the error is logged)
+ */
+static int DURATIONS_compile(siridb_t * siridb, siridb_duration_t * duration)
+{
+    char err_msg[SIRIDB_MAX_SIZE_ERR_MSG];
+    siridb_group_t * group;
+    const char * source = duration->source;
+
+    if (*source != '/')
+    {
+        group = (siridb_group_t *) ct_get(siridb->groups->groups, source);
+
+        if (group == NULL)
+        {
+            log_error(
+                    "Cannot find group '%s' for shard duration '%s'",
+                    source,
+                    duration->name);
+            return -1;
+        }
+
+        source = group->source;
+    }
+
+    if ((duration->re = siridb_re_get(
+            siri.re_cache,
+            source,
+            strlen(source),
+            err_msg)) == NULL)
+    {
+        log_error("Invalid shard duration '%s': %s", duration->name, err_msg);
+        return -1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,564 @@
+/*
+ * export.c - Binary export and import of series data.
+ *
+ * author       : Jeroen van der Heijden
+ * email        : jeroen@transceptor.technology
+ * copyright    : 2016, Transceptor Technology
+ *
+ * Moving many points between databases using select and insert is slow since
+ * each point is packed and unpacked with QPack. An export returns a QPack map
+ * with for each series the data in the same compressed chunks as used in the
+ * shards, an import writes the decoded points directly to the shards and
+ * does not use the buffer or a pcache.
+ *
+ * The data for one series starts with a header of three bytes:
+ *
+ *  version (uint8) | time precision (uint8) | points type (uint8)
+ *
+ * followed by the chunks, each with a header of six bytes:
+ *
+ *  number of points (uint16) | size (uint32) | compressed data
+ *
+ * Numbers are written in the byte order of the machine, like in the shards.
+ * Only series on 'this' server are exported and an import only accepts series
+ * which belong to the pool of 'this' server, so a client sends the requests
+ * to each pool.
+ *
+ * changes
+ *  - initial version, 14-10-2016
+ *
+ */
+#include <logger/logger.h>
+#include <siri/db/compress.h>
+#include <siri/db/db.h>
+#include <siri/db/export.h>
+#include <siri/db/lookup.h>
+#include <siri/db/pools.h>
+#include <siri/db/replicate.h>
+#include <siri/db/series.h>
+#include <siri/db/server.h>
+#include <siri/db/shard.h>
+#include <siri/err.h>
+#include <siri/net/pkg.h>
+#include <siri/net/protocol.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define EXPORT_HEADER_SZ 3
+#define EXPORT_CHUNK_HEADER_SZ (sizeof(uint16_t) + sizeof(uint32_t))
+
+static void EXPORT_replicate(siridb_t * siridb, qp_packer_t * packer);
+
+/*
+ * Add the export data for 'points' as raw to 'packer'.
+ *
+ * Returns 0 if successful or -1 and a SIGNAL is raised in case of an error.
+ */
+int siridb_export_points(
+        qp_packer_t * packer,
+        siridb_points_t * points,
+        siridb_time_t * time)
+{
+    int is_log = points->tp == TP_STRING;
+    uint_fast32_t chunk_len = is_log ?
+            DEFAULT_MAX_CHUNK_SZ_LOG : DEFAULT_MAX_CHUNK_SZ_NUM;
+    uint_fast32_t start, end;
+    size_t size = EXPORT_HEADER_SZ;
+    unsigned char * data, * pt;
+    uint16_t len;
+    uint32_t chunk_sz;
+    size_t n;
+    int rc;
+
+    /* reserve the maximum size which is required for the chunks */
+    for (start = 0; start < points->len; start = end)
+    {
+        end = (points->len - start > chunk_len) ?
+                start + chunk_len : points->len;
+
+        size += EXPORT_CHUNK_HEADER_SZ + (is_log ?
+                SIRIDB_COMPRESS_LOG_MAX_SZ(
+                        end - start,
+                        time->ts_sz,
+                        siridb_compress_log_values_sz(points, start, end)) :
+                SIRIDB_COMPRESS_MAX_SZ(end - start));
+    }
+
+    data = (unsigned char *) malloc(size);
+    if (data == NULL)
+    {
+        ERR_ALLOC
+        return -1;
+    }
+
+    pt = data;
+    *pt++ = SIRIDB_EXPORT_VERSION;
+    *pt++ = (unsigned char) time->precision;
+    *pt++ = (unsigned char) points->tp;
+
+    for (start = 0; start < points->len; start = end)
+    {
+        end = (points->len - start > chunk_len) ?
+                start + chunk_len : points->len;
+
+        n = is_log ?
+                siridb_compress_log(
+                        pt + EXPORT_CHUNK_HEADER_SZ,
+                        points,
+                        start,
+                        end,
+                        time->ts_sz) :
+                siridb_compress_num(
+                        pt + EXPORT_CHUNK_HEADER_SZ,
+                        points,
+                        start,
+                        end,
+                        time->ts_sz);
+
+        if (!n)
+        {
+            free(data);
+            return -1;  /* signal is raised */
+        }
+
+        len = (uint16_t) (end - start);
+        chunk_sz = (uint32_t) n;
+        memcpy(pt, &len, sizeof(uint16_t));
+        memcpy(pt + sizeof(uint16_t), &chunk_sz, sizeof(uint32_t));
+        pt += EXPORT_CHUNK_HEADER_SZ + n;
+    }
+
+    rc = qp_add_raw(packer, (const char *) data, pt - data);
+    free(data);
+
+    return rc;
+}
+
+/*
+ * Returns the points from export data or NULL in case of an error. The
+ * points are sorted by time-stamp.
+ *
+ * In case of an error, 'err_msg' is set. (a SIGNAL might be raised)
+ */
+siridb_points_t * siridb_export_unpack(
+        const char * data,
+        size_t size,
+        siridb_time_t * time,
+        char * err_msg)
+{
+    const unsigned char * pt = (const unsigned char *) data;
+    const unsigned char * end = pt + size;
+    const unsigned char * chunk;
+    siridb_points_t * points;
+    siridb_point_t * dest;
+    size_t n = 0;
+    uint16_t len;
+    uint32_t chunk_sz;
+    points_tp tp;
+    int rc;
+
+    if (size < EXPORT_HEADER_SZ || pt[0] != SIRIDB_EXPORT_VERSION)
+    {
+        sprintf(err_msg, "Unsupported export data.");
+        return NULL;
+    }
+
+    if (pt[1] != (unsigned char) time->precision)
+    {
+        sprintf(err_msg,
+                "Export data has a time precision of '%s', the database "
+                "uses '%s'.",
+                (pt[1] < SIRIDB_TIME_END) ?
+                        siridb_time_short_map[pt[1]] : "unknown",
+                siridb_time_short_map[time->precision]);
+        return NULL;
+    }
+
+    if (pt[2] > TP_STRING)
+    {
+        sprintf(err_msg, "Unsupported points type in export data.");
+        return NULL;
+    }
+
+    tp = (points_tp) pt[2];
+    pt += EXPORT_HEADER_SZ;
+
+    /* check the chunk headers and count the points */
+    for (chunk = pt; chunk < end; chunk += EXPORT_CHUNK_HEADER_SZ + chunk_sz)
+    {
+        if ((size_t) (end - chunk) < EXPORT_CHUNK_HEADER_SZ)
+        {
+            sprintf(err_msg, "Export data is corrupt.");
+            return NULL;
+        }
+
+        memcpy(&len, chunk, sizeof(uint16_t));
+        memcpy(&chunk_sz, chunk + sizeof(uint16_t), sizeof(uint32_t));
+
+        if (    !len ||
+                (size_t) (end - chunk) - EXPORT_CHUNK_HEADER_SZ < chunk_sz)
+        {
+            sprintf(err_msg, "Export data is corrupt.");
+            return NULL;
+        }
+
+        n += len;
+    }
+
+    points = siridb_points_new(n, tp);
+    if (points == NULL)
+    {
+        sprintf(err_msg, "Memory allocation error.");
+        return NULL;  /* signal is raised */
+    }
+
+    for (; pt < end; pt += EXPORT_CHUNK_HEADER_SZ + chunk_sz)
+    {
+        memcpy(&len, pt, sizeof(uint16_t));
+        memcpy(&chunk_sz, pt + sizeof(uint16_t), sizeof(uint32_t));
+
+        dest = points->data + points->len;
+
+        rc = (tp == TP_STRING) ?
+                siridb_compress_log_decode(
+                        points,
+                        dest,
+                        pt + EXPORT_CHUNK_HEADER_SZ,
+                        chunk_sz,
+                        len,
+                        time->ts_sz) :
+                siridb_compress_num_decode(
+                        dest,
+                        pt + EXPORT_CHUNK_HEADER_SZ,
+                        chunk_sz,
+                        len,
+                        time->ts_sz);
+
+        if (rc)
+        {
+            sprintf(err_msg, siri_err ?
+                    "Memory allocation error." :
+                    "Export data is corrupt.");
+            siridb_points_free(points);
+            return NULL;
+        }
+
+        for (; len--; dest++, points->len++)
+        {
+            if (!siridb_int64_valid_ts(time, (int64_t) dest->ts))
+            {
+                sprintf(err_msg,
+                        "Export data has a time-stamp out-of-range.");
+                siridb_points_free(points);
+                return NULL;
+            }
+
+            if (points->len && dest->ts < dest[-1].ts)
+            {
+                sprintf(err_msg,
+                        "Points in export data must be sorted by "
+                        "time-stamp.");
+                siridb_points_free(points);
+                return NULL;
+            }
+        }
+    }
+
+    return points;
+}
+
+/*
+ * Export the series on 'this' server to 'packer'. The unpacker must contain
+ * an array with a start time-stamp, an end time-stamp and the series names.
+ * Series which do not exist on 'this' server are ignored.
+ *
+ * Returns 0 if successful or -1 and 'err_msg' is set in case of an error.
+ * (a SIGNAL might be raised)
+ */
+int siridb_export(
+        siridb_t * siridb,
+        qp_unpacker_t * unpacker,
+        qp_packer_t * packer,
+        char * err_msg)
+{
+    siridb_series_t * series;
+    siridb_points_t * points;
+    qp_obj_t qp_start, qp_end, qp_name;
+    uint64_t start_ts, end_ts;
+    int rc = 0;
+
+    if (    !qp_is_array(qp_next(unpacker, NULL)) ||
+            qp_next(unpacker, &qp_start) != QP_INT64 ||
+            qp_next(unpacker, &qp_end) != QP_INT64 ||
+            !siridb_int64_valid_ts(siridb->time, qp_start.via.int64) ||
+            !siridb_int64_valid_ts(siridb->time, qp_end.via.int64))
+    {
+        sprintf(err_msg,
+                "Expecting an array with a start time-stamp, an end "
+                "time-stamp and series names.");
+        return -1;
+    }
+
+    start_ts = (uint64_t) qp_start.via.int64;
+    end_ts = (uint64_t) qp_end.via.int64;
+
+    qp_add_type(packer, QP_MAP_OPEN);
+
+    while ( qp_next(unpacker, &qp_name) == QP_RAW &&
+            qp_name.len &&
+            qp_name.len < SIRIDB_SERIES_NAME_LEN_MAX)
+    {
+        char name[qp_name.len + 1];
+        memcpy(name, qp_name.via.raw, qp_name.len);
+        name[qp_name.len] = '\0';
+
+        series = (siridb_series_t *) ct_get(siridb->series, name);
+        if (series == NULL)
+        {
+            continue;
+        }
+
+        siri_rwlock_wrlock(&siridb->series_mutex);
+
+        points = siridb_series_get_points(siridb, series, &start_ts, &end_ts);
+
+        siri_rwlock_wrunlock(&siridb->series_mutex);
+
+        if (points == NULL)
+        {
+            rc = -1;  /* signal is raised */
+            break;
+        }
+
+        if (points->len)
+        {
+            rc = qp_add_raw(packer, series->name, series->name_len) ||
+                    siridb_export_points(packer, points, siridb->time);
+        }
+
+        siridb_points_free(points);
+
+        if (rc)
+        {
+            break;  /* signal is raised */
+        }
+    }
+
+    if (rc)
+    {
+        sprintf(err_msg, "Memory allocation error.");
+    }
+
+    return rc;
+}
+
+/*
+ * Import the export data in a map with series names. Points are written
+ * directly to the shards and new series are created when required. All
+ * series must belong to the pool of 'this' server.
+ *
+ * In case of an error, series before the series which has caused the error
+ * are imported.
+ *
+ * Returns the number of imported points or -1 and 'err_msg' is set in case of
+ * an error. (a SIGNAL might be raised)
+ */
+ssize_t siridb_import(
+        siridb_t * siridb,
+        qp_unpacker_t * unpacker,
+        char * err_msg)
+{
+    siridb_series_t * series;
+    siridb_points_t * points;
+    qp_packer_t * repl_packer = NULL;
+    qp_obj_t qp_name, qp_data;
+    ssize_t count = 0;
+    size_t nseries = 0;
+    uint16_t pool;
+    int tp, rc;
+
+    if (siridb_is_reindexing(siridb))
+    {
+        sprintf(err_msg,
+                "Cannot import data while the database is re-indexing.");
+        return -1;
+    }
+
+    if (!qp_is_map(qp_next(unpacker, NULL)))
+    {
+        sprintf(err_msg,
+                "Expecting a map with series names and export data.");
+        return -1;
+    }
+
+    if (siridb->store == NULL && siridb_series_open_store(siridb))
+    {
+        ERR_FILE
+        sprintf(err_msg, "Cannot open the series store.");
+        return -1;
+    }
+
+    if (siridb->replica != NULL)
+    {
+        repl_packer = sirinet_packer_new(QP_SUGGESTED_SIZE);
+        if (repl_packer == NULL)
+        {
+            sprintf(err_msg, "Memory allocation error.");
+            return -1;  /* signal is raised */
+        }
+        qp_add_type(repl_packer, QP_MAP_OPEN);
+    }
+
+    tp = qp_next(unpacker, &qp_name);
+
+    while (tp == QP_RAW)
+    {
+        /* the length of a terminated raw name includes the terminator */
+        if (qp_is_raw_term(&qp_name))
+        {
+            qp_name.len--;
+        }
+
+        if (!qp_name.len || qp_name.len >= SIRIDB_SERIES_NAME_LEN_MAX)
+        {
+            tp = QP_ERR;
+            break;
+        }
+
+        char name[qp_name.len + 1];
+        memcpy(name, qp_name.via.raw, qp_name.len);
+        name[qp_name.len] = '\0';
+
+        if (qp_next(unpacker, &qp_data) != QP_RAW)
+        {
+            snprintf(err_msg, SIRIDB_MAX_SIZE_ERR_MSG,
+                    "Expecting export data for series '%s'.", name);
+            count = -1;
+            break;
+        }
+
+        pool = siridb_lookup_sn(siridb->pools->lookup, name);
+        if (pool != siridb->server->pool)
+        {
+            snprintf(err_msg, SIRIDB_MAX_SIZE_ERR_MSG,
+                    "Series '%s' belongs to pool %u and must be imported "
+                    "on a server in that pool.", name, pool);
+            count = -1;
+            break;
+        }
+
+        points = siridb_export_unpack(
+                qp_data.via.raw,
+                qp_data.len,
+                siridb->time,
+                err_msg);
+
+        if (points == NULL)
+        {
+            count = -1;
+            break;
+        }
+
+        siri_rwlock_wrlock(&siridb->series_mutex);
+        siri_mutex_lock(&siridb->shards_mutex);
+
+        series = (siridb_series_t *) ct_get(siridb->series, name);
+
+        if (series == NULL)
+        {
+            series = siridb_series_new(siridb, name, points->tp);
+            rc = (series == NULL) ? -1 :  /* signal is raised */
+                    siridb_series_import(siridb, series, points);
+        }
+        else if (series->tp != points->tp)
+        {
+            snprintf(err_msg, SIRIDB_MAX_SIZE_ERR_MSG,
+                    "Export data for series '%s' has another type than "
+                    "the existing series.", name);
+            rc = 1;
+        }
+        else
+        {
+            rc = siridb_series_import(siridb, series, points);
+        }
+
+        siri_mutex_unlock(&siridb->shards_mutex);
+        siri_rwlock_wrunlock(&siridb->series_mutex);
+
+        if (rc == 0 && repl_packer != NULL && (
+                qp_add_raw_term(repl_packer, name, qp_name.len) ||
+                siridb_points_pack(points, repl_packer)))
+        {
+            rc = -1;  /* signal is raised */
+        }
+
+        if (rc == 0)
+        {
+            count += points->len;
+            nseries++;
+        }
+        else if (rc < 0)
+        {
+            log_critical("Error importing series: '%s'", name);
+            sprintf(err_msg, "Critical error while importing points.");
+        }
+
+        siridb_points_free(points);
+
+        if (rc)
+        {
+            count = -1;
+            break;
+        }
+
+        tp = qp_next(unpacker, &qp_name);
+    }
+
+    if (count >= 0 && tp != QP_END && tp != QP_MAP_CLOSE)
+    {
+        sprintf(err_msg, "Expecting a series name.");
+        count = -1;
+    }
+
+    /* new series are flushed to the store once for each import */
+    if (siridb_series_commit(siridb) && count >= 0)
+    {
+        sprintf(err_msg, "Critical error while importing points.");
+        count = -1;
+    }
+
+    if (repl_packer != NULL)
+    {
+        if (nseries && !siri_err)
+        {
+            /* the replica receives the imported points as an insert */
+            EXPORT_replicate(siridb, repl_packer);
+        }
+        else
+        {
+            qp_packer_free(repl_packer);
+        }
+    }
+
+    return count;
+}
+
+/*
+ * The packer is destroyed by this function.
+ */
+static void EXPORT_replicate(siridb_t * siridb, qp_packer_t * packer)
+{
+    sirinet_pkg_t * pkg, * repl_pkg;
+
+    pkg = sirinet_packer2pkg(packer, 0, BPROTO_INSERT_SERVER);
+
+    repl_pkg = siridb->replicate->initsync == NULL ? NULL :
+            siridb_replicate_pkg_filter(siridb, pkg->data, pkg->len, 0);
+
+    /* use repl_pkg if needed */
+    siridb_replicate_pkg(siridb, repl_pkg == NULL ? pkg : repl_pkg);
+
+    free(repl_pkg);
+    free(pkg);
+}
@@ -0,0 +1,709 @@
+/*
+ * fetch.c - Fetch points for series by name without a query.
+ *
+ * author       : Jeroen van der Heijden
+ * email        : jeroen@transceptor.technology
+ * copyright    : 2016, Transceptor Technology
+ *
+ * A client which knows the series names can fetch the points without the
+ * query language, so no query is parsed and no listener is used. A fetch
+ * request is an array with a start time-stamp, an end time-stamp, an optional
+ * aggregate and the series names:
+ *
+ *  [start, end, aggregate, name, ...]
+ *
+ * Points with start <= ts < end are returned. The aggregate is nil or an
+ * array with the name of an aggregate function and the group by time, or the
+ * number of points for lttb and minmax, for example ["mean", 3600].
+ *
+ * The response is a map with the points of each series which is found, in
+ * the same columns as an insert request with columns:
+ *
+ *  {name: [tp, ts, values], ...}
+ *
+ * The time-stamps are deltas from the previous time-stamp, packed as raw
+ * int64 values in the byte order of the machine, the values are packed as
+ * raw int64 or double values. For string series the values are an array of
+ * strings.
+ *
+ * Series in other pools are fetched with one back-end request for each pool
+ * and the responses are appended to the response map.
+ *
+ * changes
+ *  - initial version, 14-10-2016
+ *
+ */
+#include <logger/logger.h>
+#include <siri/db/db.h>
+#include <siri/db/fetch.h>
+#include <siri/db/lookup.h>
+#include <siri/db/pools.h>
+#include <siri/db/series.h>
+#include <siri/db/server.h>
+#include <siri/err.h>
+#include <siri/grammar/grammar.h>
+#include <siri/net/promises.h>
+#include <siri/net/protocol.h>
+#include <siri/net/socket.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct
+{
+    const char * name;
+    uint32_t gid;
+} FETCH_aggr_t;
+
+static const FETCH_aggr_t FETCH_aggregates[] = {
+        {"count", CLERI_GID_F_COUNT},
+        {"lttb", CLERI_GID_F_LTTB},
+        {"max", CLERI_GID_F_MAX},
+        {"mean", CLERI_GID_F_MEAN},
+        {"median", CLERI_GID_F_MEDIAN},
+        {"median_high", CLERI_GID_F_MEDIAN_HIGH},
+        {"median_low", CLERI_GID_F_MEDIAN_LOW},
+        {"min", CLERI_GID_F_MIN},
+        {"minmax", CLERI_GID_F_MINMAX},
+        {"pvariance", CLERI_GID_F_PVARIANCE},
+        {"sum", CLERI_GID_F_SUM},
+        {"variance", CLERI_GID_F_VARIANCE},
+        {NULL, 0}
+};
+
+/* time range and aggregate of a fetch request */
+typedef struct fetch_req_s
+{
+    uint64_t start_ts;
+    uint64_t end_ts;
+    siridb_aggr_t * aggr;   /* NULL or points to 'aggr_' */
+    siridb_aggr_t aggr_;
+} fetch_req_t;
+
+static int FETCH_header(
+        siridb_t * siridb,
+        qp_unpacker_t * unpacker,
+        fetch_req_t * req,
+        char * err_msg);
+static int FETCH_aggregate(
+        qp_unpacker_t * unpacker,
+        fetch_req_t * req,
+        char * err_msg);
+static qp_types_t FETCH_next_name(qp_unpacker_t * unpacker, qp_obj_t * qp_name);
+static int FETCH_series(
+        siridb_t * siridb,
+        qp_packer_t * packer,
+        qp_obj_t * qp_name,
+        fetch_req_t * req,
+        char * err_msg);
+static int FETCH_pack(
+        qp_packer_t * packer,
+        qp_obj_t * qp_name,
+        siridb_points_t * points);
+static void FETCH_forward(siridb_fetch_t * fetch, qp_packer_t ** forward);
+static void FETCH_on_response(slist_t * promises, siridb_fetch_t * fetch);
+static void FETCH_send(siridb_fetch_t * fetch, int failed);
+
+/*
+ * Start a fetch request from a client. Series in the pool of 'this' server
+ * are fetched immediately, the other pools receive a back-end request. The
+ * response is sent to the client when all pools have responded.
+ *
+ * Returns 0 if successful or -1 and 'err_msg' is set in case the request is
+ * invalid. (a SIGNAL might be raised)
+ */
+int siridb_fetch(
+        siridb_t * siridb,
+        uv_stream_t * client,
+        sirinet_pkg_t * pkg,
+        char * err_msg)
+{
+    siridb_fetch_t * fetch;
+    qp_packer_t ** forward;
+    qp_unpacker_t unpacker;
+    qp_obj_t qp_name;
+    fetch_req_t req;
+    const char * header;
+    size_t header_sz;
+    uint16_t pool;
+    qp_types_t tp;
+    int rc = 0;
+
+    if (siridb_is_reindexing(siridb))
+    {
+        sprintf(err_msg,
+                "Cannot fetch points while the database is re-indexing.");
+        return -1;
+    }
+
+    qp_unpacker_init(&unpacker, pkg->data, pkg->len);
+
+    if (!qp_is_array(qp_next(&unpacker, NULL)))
+    {
+        sprintf(err_msg,
+                "Expecting an array with a start time-stamp, an end "
+                "time-stamp, an aggregate and series names.");
+        return -1;
+    }
+
+    /* the header is copied to the requests for other pools */
+    header = unpacker.pt;
+
+    if (FETCH_header(siridb, &unpacker, &req, err_msg))
+    {
+        return -1;
+    }
+
+    header_sz = unpacker.pt - header;
+
+    fetch = (siridb_fetch_t *) malloc(sizeof(siridb_fetch_t));
+    forward = (qp_packer_t **) calloc(
+            siridb->pools->len,
+            sizeof(qp_packer_t *));
+
+    if (    fetch == NULL ||
+            forward == NULL ||
+            (fetch->packer = sirinet_packer_new(QP_SUGGESTED_SIZE)) == NULL)
+    {
+        sprintf(err_msg, "Memory allocation error.");
+        free(fetch);
+        free(forward);
+        return -1;
+    }
+
+    fetch->siridb = siridb;
+    fetch->client = client;
+    fetch->pid = pkg->pid;
+    fetch->npools = 0;
+    siri_latency_start(&fetch->latency);
+
+    qp_add_type(fetch->packer, QP_MAP_OPEN);
+
+    while ((tp = FETCH_next_name(&unpacker, &qp_name)) == QP_RAW)
+    {
+        pool = siridb_lookup_sn_raw(
+                siridb->pools->lookup,
+                qp_name.via.raw,
+                qp_name.len);
+
+        if (pool == siridb->server->pool)
+        {
+            rc = FETCH_series(siridb, fetch->packer, &qp_name, &req, err_msg);
+        }
+        else
+        {
+            if (forward[pool] == NULL)
+            {
+                forward[pool] = sirinet_packer_new(1024);
+                fetch->npools++;
+                rc = forward[pool] == NULL ||
+                        qp_add_type(forward[pool], QP_ARRAY_OPEN) ||
+                        qp_packer_extend_mem(forward[pool], header, header_sz);
+            }
+
+            if (rc || qp_add_raw(forward[pool], qp_name.via.raw, qp_name.len))
+            {
+                sprintf(err_msg, "Memory allocation error.");
+                rc = -1;
+            }
+        }
+
+        if (rc)
+        {
+            break;
+        }
+    }
+
+    if (!rc && tp != QP_END && tp != QP_ARRAY_CLOSE)
+    {
+        sprintf(err_msg, "Expecting series names.");
+        rc = -1;
+    }
+
+    if (rc)
+    {
+        for (pool = 0; pool < siridb->pools->len; pool++)
+        {
+            if (forward[pool] != NULL)
+            {
+                qp_packer_free(forward[pool]);
+            }
+        }
+        qp_packer_free(fetch->packer);
+        free(fetch);
+    }
+    else if (fetch->npools)
+    {
+        /* the forward packers are destroyed */
+        sirinet_socket_incref(client);
+        FETCH_forward(fetch, forward);
+    }
+    else
+    {
+        sirinet_socket_incref(client);
+        FETCH_send(fetch, 0);
+    }
+
+    free(forward);
+
+    return rc;
+}
+
+/*
+ * Fetch the points for series on 'this' server. The unpacker must contain a
+ * fetch request, the response map is written to 'packer'. Series which do
+ * not exist on 'this' server are ignored.
+ *
+ * Returns 0 if successful or -1 and 'err_msg' is set in case of an error.
+ * (a SIGNAL might be raised)
+ */
+int siridb_fetch_local(
+        siridb_t * siridb,
+        qp_unpacker_t * unpacker,
+        qp_packer_t * packer,
+        char * err_msg)
+{
+    qp_obj_t qp_name;
+    fetch_req_t req;
+    qp_types_t tp;
+
+    if (!qp_is_array(qp_next(unpacker, NULL)))
+    {
+        sprintf(err_msg, "Expecting an array with a fetch request.");
+        return -1;
+    }
+
+    if (FETCH_header(siridb, unpacker, &req, err_msg))
+    {
+        return -1;
+    }
+
+    qp_add_type(packer, QP_MAP_OPEN);
+
+    while ((tp = FETCH_next_name(unpacker, &qp_name)) == QP_RAW)
+    {
+        if (FETCH_series(siridb, packer, &qp_name, &req, err_msg))
+        {
+            return -1;
+        }
+    }
+
+    if (tp != QP_END && tp != QP_ARRAY_CLOSE)
+    {
+        sprintf(err_msg, "Expecting series names.");
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Read the start and end time-stamp and the aggregate.
+ *
+ * Returns 0 if successful or -1 and 'err_msg' is set in case of an error.
+ */
+static int FETCH_header(
+        siridb_t * siridb,
+        qp_unpacker_t * unpacker,
+        fetch_req_t * req,
+        char * err_msg)
+{
+    qp_obj_t qp_start, qp_end;
+
+    if (    qp_next(unpacker, &qp_start) != QP_INT64 ||
+            qp_next(unpacker, &qp_end) != QP_INT64 ||
+            !siridb_int64_valid_ts(siridb->time, qp_start.via.int64) ||
+            !siridb_int64_valid_ts(siridb->time, qp_end.via.int64))
+    {
+        sprintf(err_msg,
+                "Expecting an array with a start time-stamp, an end "
+                "time-stamp, an aggregate and series names.");
+        return -1;
+    }
+
+    req->start_ts = (uint64_t) qp_start.via.int64;
+    req->end_ts = (uint64_t) qp_end.via.int64;
+
+    return FETCH_aggregate(unpacker, req, err_msg);
+}
+
+/*
+ * Read the aggregate which is nil or [name, value].
+ *
+ * Returns 0 if successful or -1 and 'err_msg' is set in case of an error.
+ */
+static int FETCH_aggregate(
+        qp_unpacker_t * unpacker,
+        fetch_req_t * req,
+        char * err_msg)
+{
+    const FETCH_aggr_t * faggr;
+    qp_obj_t qp_aggr, qp_val;
+    qp_types_t tp = qp_next(unpacker, NULL);
+
+    req->aggr = NULL;
+
+    if (tp == QP_NULL)
+    {
+        return 0;
+    }
+
+    if (    tp != QP_ARRAY2 ||
+            qp_next(unpacker, &qp_aggr) != QP_RAW ||
+            qp_next(unpacker, &qp_val) != QP_INT64 ||
+            qp_val.via.int64 <= 0)
+    {
+        sprintf(err_msg,
+                "Expecting nil or an array with the name of an aggregate "
+                "function and an integer value larger than zero.");
+        return -1;
+    }
+
+    for (faggr = FETCH_aggregates; faggr->name != NULL; faggr++)
+    {
+        if (    strlen(faggr->name) == qp_aggr.len &&
+                strncmp(faggr->name, qp_aggr.via.raw, qp_aggr.len) == 0)
+        {
+            break;
+        }
+    }
+
+    if (faggr->name == NULL)
+    {
+        snprintf(err_msg, SIRIDB_MAX_SIZE_ERR_MSG,
+                "Unknown aggregate function: '%.*s'",
+                (int) qp_aggr.len,
+                qp_aggr.via.raw);
+        return -1;
+    }
+
+    memset(&req->aggr_, 0, sizeof(siridb_aggr_t));
+    req->aggr_.gid = faggr->gid;
+    req->aggr_.timespan = 1.0;
+
+    switch (faggr->gid)
+    {
+    case CLERI_GID_F_MINMAX:
+        if (qp_val.via.int64 < 2)
+        {
+            sprintf(err_msg,
+                    "Number of points must be an integer value "
+                    "larger than one.");
+            return -1;
+        }
+        /* no break */
+    case CLERI_GID_F_LTTB:
+        req->aggr_.target = (uint64_t) qp_val.via.int64;
+        break;
+    default:
+        req->aggr_.group_by = (uint64_t) qp_val.via.int64;
+    }
+
+    req->aggr = &req->aggr_;
+
+    return 0;
+}
+
+/*
+ * Returns QP_RAW when a valid series name is read.
+ */
+static qp_types_t FETCH_next_name(qp_unpacker_t * unpacker, qp_obj_t * qp_name)
+{
+    qp_types_t tp = qp_next(unpacker, qp_name);
+
+    if (tp == QP_RAW)
+    {
+        /* the length of a terminated raw name includes the terminator */
+        if (qp_is_raw_term(qp_name))
+        {
+            qp_name->len--;
+        }
+
+        if (!qp_name->len || qp_name->len >= SIRIDB_SERIES_NAME_LEN_MAX)
+        {
+            return QP_ERR;
+        }
+    }
+
+    return tp;
+}
+
+/*
+ * Add the points of a series on 'this' server to the response map.
+ *
+ * Returns 0 if successful or -1 and 'err_msg' is set in case of an error.
+ * (a SIGNAL might be raised)
+ */
+static int FETCH_series(
+        siridb_t * siridb,
+        qp_packer_t * packer,
+        qp_obj_t * qp_name,
+        fetch_req_t * req,
+        char * err_msg)
+{
+    siridb_series_t * series;
+    siridb_points_t * points;
+    siridb_points_t * result;
+    int rc = 0;
+
+    series = (siridb_series_t *) ct_getn(
+            siridb->series,
+            qp_name->via.raw,
+            qp_name->len);
+
+    if (    series == NULL ||
+            series->end < req->start_ts ||
+            series->start >= req->end_ts)
+    {
+        return 0;
+    }
+
+    siri_rwlock_wrlock(&siridb->series_mutex);
+
+    points = siridb_series_get_points(
+            siridb,
+            series,
+            &req->start_ts,
+            &req->end_ts);
+
+    siri_rwlock_wrunlock(&siridb->series_mutex);
+
+    if (points == NULL)
+    {
+        sprintf(err_msg, "Memory allocation error.");
+        return -1;  /* signal is raised */
+    }
+
+    if (points->len && req->aggr != NULL)
+    {
+        result = siridb_aggregate_run(points, req->aggr, err_msg);
+
+        if (result != points)
+        {
+            siridb_points_free(points);
+        }
+
+        if (result == NULL)
+        {
+            return -1;  /* err_msg is set or a signal is raised */
+        }
+
+        points = result;
+    }
+
+    if (points->len && FETCH_pack(packer, qp_name, points))
+    {
+        sprintf(err_msg, "Memory allocation error.");
+        rc = -1;
+    }
+
+    siridb_points_free(points);
+
+    return rc;
+}
+
+/*
+ * Add the name and columns for 'points' to 'packer'.
+ *
+ * Returns 0 if successful or -1 in case of an error.
+ */
+static int FETCH_pack(
+        qp_packer_t * packer,
+        qp_obj_t * qp_name,
+        siridb_points_t * points)
+{
+    size_t size = points->len * sizeof(int64_t);
+    int64_t * column = (int64_t *) malloc(size);
+    uint64_t prev = 0;
+    size_t i;
+    int rc;
+
+    if (column == NULL)
+    {
+        ERR_ALLOC
+        return -1;
+    }
+
+    for (i = 0; i < points->len; i++)
+    {
+        column[i] = (int64_t) (points->data[i].ts - prev);
+        prev = points->data[i].ts;
+    }
+
+    rc = qp_add_raw(packer, qp_name->via.raw, qp_name->len) ||
+            qp_add_type(packer, QP_ARRAY3) ||
+            qp_add_int64(packer, points->tp) ||
+            qp_add_raw(packer, (const char *) column, size);
+
+    if (rc)
+    {
+        /* error is set below */
+    }
+    else if (points->tp == TP_STRING)
+    {
+        rc = qp_add_type(packer, QP_ARRAY_OPEN);
+        for (i = 0; !rc && i < points->len; i++)
+        {
+            rc = qp_add_string(packer, points->data[i].val.raw);
+        }
+        rc = rc || qp_add_type(packer, QP_ARRAY_CLOSE);
+    }
+    else
+    {
+        for (i = 0; i < points->len; i++)
+        {
+            memcpy(column + i, &points->data[i].val, sizeof(int64_t));
+        }
+        rc = qp_add_raw(packer, (const char *) column, size);
+    }
+
+    free(column);
+
+    return rc ? -1 : 0;
+}
+
+/*
+ * Send the requests for other pools. The packers in 'forward' are destroyed.
+ * (a SIGNAL might be raised)
+ */
+static void FETCH_forward(siridb_fetch_t * fetch, qp_packer_t ** forward)
+{
+    siridb_t * siridb = fetch->siridb;
+    sirinet_promises_t * promises;
+    sirinet_pkg_t * pkg;
+    size_t count = 0;
+
+    promises = sirinet_promises_new(
+            fetch->npools,
+            (sirinet_promises_cb) FETCH_on_response,
+            fetch,
+            NULL);
+
+    for (uint16_t n = 0; n < siridb->pools->len; n++)
+    {
+        if (forward[n] == NULL)
+        {
+            continue;
+        }
+
+        if (promises == NULL)
+        {
+            qp_packer_free(forward[n]);
+            continue;
+        }
+
+        pkg = sirinet_packer2pkg(forward[n], 0, BPROTO_FETCH_SERVER);
+
+        if (siridb_pool_send_pkg(
+                siridb->pools->pool + n,
+                pkg,
+                SIRIDB_FETCH_TIMEOUT,
+                sirinet_promises_on_response,
+                promises,
+                0))
+        {
+            log_error("Cannot fetch points from pool %u", n);
+            free(pkg);
+        }
+        else
+        {
+            count++;
+        }
+    }
+
+    if (promises == NULL)
+    {
+        FETCH_send(fetch, 1);  /* signal is raised */
+        return;
+    }
+
+    /* count is never larger than the initial promises->size */
+    promises->promises->size = count;
+
+    SIRINET_PROMISES_CHECK(promises)
+}
+
+/*
+ * Call-back function: sirinet_promises_cb
+ *
+ * The response maps of the other pools are appended to the response map.
+ */
+static void FETCH_on_response(slist_t * promises, siridb_fetch_t * fetch)
+{
+    sirinet_promise_t * promise;
+    sirinet_pkg_t * pkg;
+    int failed = promises == NULL || promises->len < fetch->npools;
+
+    for (size_t i = 0; promises != NULL && i < promises->len; i++)
+    {
+        promise = promises->data[i];
+        if (promise == NULL)
+        {
+            failed = 1;
+            continue;
+        }
+
+        pkg = (sirinet_pkg_t *) promise->data;
+
+        /* the first byte of the response is the open map */
+        if (    pkg == NULL ||
+                pkg->tp != BPROTO_RES_FETCH ||
+                !pkg->len ||
+                (unsigned char) pkg->data[0] != QP_MAP_OPEN)
+        {
+            failed = 1;
+        }
+        else if (!failed && qp_packer_extend_mem(
+                fetch->packer,
+                pkg->data + 1,
+                pkg->len - 1))
+        {
+            ERR_ALLOC
+            failed = 1;
+        }
+
+        /* make sure we free the promise and data */
+        free(promise->data);
+        sirinet_promise_decref(promise);
+    }
+
+    FETCH_send(fetch, failed);
+}
+
+/*
+ * Send the response to the client and destroy the fetch.
+ */
+static void FETCH_send(siridb_fetch_t * fetch, int failed)
+{
+    sirinet_pkg_t * package;
+
+    if (failed)
+    {
+        const char * err_msg = "Cannot fetch points from at least one pool.";
+
+        qp_packer_free(fetch->packer);
+        package = sirinet_pkg_err(
+                fetch->pid,
+                strlen(err_msg),
+                CPROTO_ERR_POOL,
+                err_msg);
+    }
+    else
+    {
+        package = sirinet_packer2pkg(
+                fetch->packer,
+                fetch->pid,
+                CPROTO_RES_FETCH);
+    }
+
+    if (package != NULL)
+    {
+        /* ignore result code, signal can be raised */
+        sirinet_pkg_send(fetch->client, package);
+    }
+
+    siri_latency_done(&fetch->latency, SIRI_LATENCY_FETCH);
+
+    sirinet_socket_decref(fetch->client);
+    free(fetch);
+}
@@ -20,17 +20,27 @@
 #include <siri/err.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 #define FFILE_DEFAULT_SIZE 104857600  // 100 MB
 #define FFILE_NUMBERS 9  // how much numbers are used to generate the file.
 
+static int FFILE_map(siridb_ffile_t * ffile);
+
 /*
  * Open the fifo file. (set both the file pointer and file descriptor
  * In case of and error, fifo->fp is set to NULL
+ *
+ * A file which is not empty is mapped into memory so packages can be
+ * appended and read without system calls.
  */
 void siridb_ffile_open(siridb_ffile_t * ffile, const char * opentype)
 {
+    struct stat st;
+
+    ffile->map = NULL;
     ffile->fp = fopen(ffile->fn, opentype);
     if (ffile->fp != NULL)
     {
@@ -41,7 +51,39 @@ void siridb_ffile_open(siridb_ffile_t * ffile, const char * opentype)
             fclose(ffile->fp);
             ffile->fp = NULL;
         }
+        else if (fstat(ffile->fd, &st) || (
+                (ffile->map_size = (size_t) st.st_size) && FFILE_map(ffile)))
+        {
+            log_critical("Error mapping file: '%s'", ffile->fn);
+            fclose(ffile->fp);
+            ffile->fp = NULL;
+        }
+    }
+}
+
+/*
+ * Close the fifo file and remove the memory map. Since the map is shared,
+ * appended packages are in the file as soon as they are copied to the map.
+ *
+ * returns 0 if successful or EOF in case of an error.
+ */
+int siridb_ffile_close(siridb_ffile_t * ffile)
+{
+    int rc = 0;
+
+    if (ffile->map != NULL)
+    {
+        rc = munmap(ffile->map, ffile->map_size) ? EOF : 0;
+        ffile->map = NULL;
     }
+
+    if (fclose(ffile->fp))
+    {
+        rc = EOF;
+    }
+    ffile->fp = NULL;
+
+    return rc;
 }
 
 /*
@@ -73,6 +115,8 @@ siridb_ffile_t * siridb_ffile_new(
 
     ffile->id = id;
     ffile->next_size = 0;
+    ffile->pop_end = 0;
+    ffile->pop_size = 0;
 
     siridb_ffile_open(ffile, "r+");
 
@@ -100,44 +144,45 @@ siridb_ffile_t * siridb_ffile_new(
             /* set free space to a value is will always fit */
             ffile->size = ffile->free_space = (size > FFILE_DEFAULT_SIZE) ?
                     size : FFILE_DEFAULT_SIZE;
+        }
+
+        /* allocate the (sparse) file at once so it can be mapped */
+        ffile->map_size = (size_t) ffile->size;
+        if (ftruncate(ffile->fd, ffile->size) || FFILE_map(ffile))
+        {
+            ERR_FILE
+            log_critical("Cannot allocate fifo file: '%s'", ffile->fn);
+            siridb_ffile_free(ffile);
+            return NULL;
+        }
 
-            /* because we has enough free space, this should always work */
-            if (siridb_ffile_append(ffile, pkg) != FFILE_SUCCESS)
-            {
-                ERR_FILE;
-                siridb_ffile_free(ffile);
-                return NULL;
-            }
+        /* because we has enough free space, this should always work */
+        if (pkg != NULL && siridb_ffile_append(ffile, pkg) != FFILE_SUCCESS)
+        {
+            ERR_FILE;
+            siridb_ffile_free(ffile);
+            return NULL;
         }
     }
     else
     {
         /* reading existing fifo file */
+        if ((ffile->size = (long int) ffile->map_size) >=
+                (long int) sizeof(uint32_t))
+        {
+            ffile->free_space = 0;
+            memcpy( &ffile->next_size,
+                    ffile->map + ffile->size - sizeof(uint32_t),
+                    sizeof(uint32_t));
+        }
 
-        if (fseeko(ffile->fp, 0, SEEK_END))
+        if (siridb_ffile_close(ffile))
         {
             ERR_FILE
             siridb_ffile_free(ffile);
             return NULL;
         }
 
-        if ((ffile->size = ftello(ffile->fp)) >= (off_t) sizeof(uint32_t))
-        {
-            ffile->free_space = 0;
-            if (    fseeko(ffile->fp, -(long int) sizeof(uint32_t), SEEK_END) ||
-                    fread(  &ffile->next_size,
-                            sizeof(uint32_t),
-                            1,
-                            ffile->fp) != 1 ||
-                    fclose(ffile->fp))
-            {
-                ERR_FILE
-                siridb_ffile_free(ffile);
-                return NULL;
-            }
-            ffile->fp = NULL;
-        }
-
         if (!ffile->next_size)
         {
             log_debug("Empty fifo found, removing: '%s'", ffile->fn);
@@ -156,6 +201,8 @@ siridb_ffile_t * siridb_ffile_new(
 /*
  * returns a result code, usually FFILE_ERROR is critical but signal
  * will never be set by this function.
+ *
+ * The package is copied to the shared map so no system call is needed.
  */
 siridb_ffile_result_t siridb_ffile_append(
         siridb_ffile_t * ffile,
@@ -173,19 +220,19 @@ siridb_ffile_result_t siridb_ffile_append(
         return FFILE_NO_FREE_SPACE;
     }
 
+    if (ffile->map == NULL)
+    {
+        return FFILE_ERROR;
+    }
+
     if (!ffile->next_size)
     {
         ffile->next_size = size;
     }
     ffile->free_space -= size + sizeof(uint32_t);
 
-    if (    fseeko(ffile->fp, (off_t) ffile->free_space, SEEK_SET) ||
-            fwrite((unsigned char *) pkg, size, 1, ffile->fp) != 1 ||
-            fwrite(&size, sizeof(uint32_t), 1, ffile->fp) != 1 ||
-            fflush(ffile->fp))
-    {
-        return FFILE_ERROR;
-    }
+    memcpy(ffile->map + ffile->free_space, pkg, size);
+    memcpy(ffile->map + ffile->free_space + size, &size, sizeof(uint32_t));
 
     return FFILE_SUCCESS;
 }
@@ -215,34 +262,51 @@ sirinet_pkg_t * siridb_ffile_pop(siridb_ffile_t * ffile)
     assert (ffile->next_size);
     assert (ffile->fp != NULL);
 #endif
-    if (fseeko(
-            ffile->fp,
-            -(long int) (ffile->next_size + sizeof(uint32_t)),
-            SEEK_END))
+    ffile->pop_end = ffile->size;
+    ffile->pop_size = ffile->next_size;
+
+    return siridb_ffile_pop_next(ffile);
+}
+
+/*
+ * Returns the package after the last package returned by siridb_ffile_pop()
+ * or siridb_ffile_pop_next(). This can be used to read ahead, the packages
+ * must still be committed in order with siridb_ffile_pop_commit().
+ *
+ * returns NULL when there are no more packages or in case of an error.
+ * (signal is set in case of a malloc error, not in case of a file error)
+ */
+sirinet_pkg_t * siridb_ffile_pop_next(siridb_ffile_t * ffile)
+{
+#ifdef DEBUG
+    assert (ffile->fp != NULL);
+#endif
+    uint32_t size = ffile->pop_size;
+
+    if (!size)
     {
-        log_critical("Seek error in '%s'", ffile->fn);
         return NULL;
     }
-    sirinet_pkg_t * pkg = (sirinet_pkg_t *) malloc(ffile->next_size);
 
-    if (pkg == NULL)
+    if (    ffile->map == NULL ||
+            ffile->pop_end < (long int) (size + 2 * sizeof(uint32_t)))
     {
-        ERR_ALLOC
+        log_critical("Corrupt package in fifo: '%s' ", ffile->fn);
         return NULL;
     }
 
-    if (fread(pkg, ffile->next_size, 1, ffile->fp) != 1)
+    sirinet_pkg_t * pkg = (sirinet_pkg_t *) malloc(size);
+
+    if (pkg == NULL)
     {
-        log_critical(
-                "Error while reading %" PRIu32 " bytes from '%s'",
-                ffile->next_size,
-                ffile->fn);
-        free(pkg);
+        ERR_ALLOC
         return NULL;
     }
 
-    if (    ffile->next_size < sizeof(sirinet_pkg_t) ||
-            pkg->len != ffile->next_size - sizeof(sirinet_pkg_t))
+    memcpy(pkg, ffile->map + ffile->pop_end - size - sizeof(uint32_t), size);
+
+    if (    size < sizeof(sirinet_pkg_t) ||
+            pkg->len != size - sizeof(sirinet_pkg_t))
     {
         log_critical(
                 "Corrupt package in fifo: '%s' ", ffile->fn);
@@ -250,6 +314,13 @@ sirinet_pkg_t * siridb_ffile_pop(siridb_ffile_t * ffile)
         return NULL;
     }
 
+    /* the size of the next package is stored just before this package,
+     * a fifo file starts with a zero size so this is always valid */
+    ffile->pop_end -= size + sizeof(uint32_t);
+    memcpy( &ffile->pop_size,
+            ffile->map + ffile->pop_end - sizeof(uint32_t),
+            sizeof(uint32_t));
+
     return pkg;
 }
 
@@ -266,13 +337,17 @@ int siridb_ffile_pop_commit(siridb_ffile_t * ffile)
 
     ffile->size -= ffile->next_size + sizeof(uint32_t);
 
-    return (fseeko(
-                ffile->fp,
-                ffile->size - sizeof(uint32_t),
-                SEEK_SET) ||
-            fread(&ffile->next_size, sizeof(uint32_t), 1, ffile->fp) != 1 ||
-            ftruncate(ffile->fd, ffile->size)) ?
-                    -1 : 0;
+    if (ffile->map == NULL)
+    {
+        return -1;
+    }
+
+    /* the map stays valid, consumed pages beyond the file are not used */
+    memcpy( &ffile->next_size,
+            ffile->map + ffile->size - sizeof(uint32_t),
+            sizeof(uint32_t));
+
+    return ftruncate(ffile->fd, ffile->size) ? -1 : 0;
 }
 
 
@@ -281,7 +356,7 @@ int siridb_ffile_pop_commit(siridb_ffile_t * ffile)
  */
 void siridb_ffile_unlink(siridb_ffile_t * ffile)
 {
-    if (ffile->fp != NULL && fclose(ffile->fp))
+    if (ffile->fp != NULL && siridb_ffile_close(ffile))
     {
         ERR_FILE
     }
@@ -299,10 +374,35 @@ void siridb_ffile_unlink(siridb_ffile_t * ffile)
  */
 void siridb_ffile_free(siridb_ffile_t * ffile)
 {
-    if (ffile->fp != NULL && fclose(ffile->fp))
+    if (ffile->fp != NULL && siridb_ffile_close(ffile))
     {
         ERR_FILE
     }
     free(ffile->fn);
     free(ffile);
 }
+
+/*
+ * Map 'map_size' bytes of the file into memory.
+ *
+ * returns 0 if successful or -1 in case of an error.
+ */
+static int FFILE_map(siridb_ffile_t * ffile)
+{
+    void * map = mmap(
+            NULL,
+            ffile->map_size,
+            PROT_READ | PROT_WRITE,
+            MAP_SHARED,
+            ffile->fd,
+            0);
+
+    if (map == MAP_FAILED)
+    {
+        ffile->map = NULL;
+        return -1;
+    }
+
+    ffile->map = (char *) map;
+    return 0;
+}
@@ -121,11 +121,10 @@ int siridb_fifo_append(siridb_fifo_t * fifo, sirinet_pkg_t * pkg)
     case FFILE_NO_FREE_SPACE:
         if (fifo->in != fifo->out)
         {
-            if (fclose(fifo->in->fp))
+            if (siridb_ffile_close(fifo->in))
             {
                 ERR_FILE
             }
-            fifo->in->fp = NULL;
         }
 
         fifo->in = siridb_ffile_new(++fifo->max_id, fifo->path, pkg);
@@ -174,6 +173,23 @@ sirinet_pkg_t * siridb_fifo_pop(siridb_fifo_t * fifo)
     return pkg;
 }
 
+/*
+ * Returns the package after the last popped package without committing
+ * the previous packages. Only packages from the current 'out' fifo file are
+ * returned so NULL is returned when there are no more packages in this file.
+ * (signal is set in case of a malloc error, not in case of a file error)
+ *
+ * Each package must be committed, in order, with siridb_fifo_commit() or
+ * siridb_fifo_commit_err().
+ *
+ * warning:
+ *      only call this function after a successful siridb_fifo_pop().
+ */
+sirinet_pkg_t * siridb_fifo_pop_next(siridb_fifo_t * fifo)
+{
+    return siridb_ffile_pop_next(fifo->out);
+}
+
 /*
  * returns 0 if successful or another value in case of errors.
  * (signal can be set when result is not 0)
@@ -247,14 +263,12 @@ int siridb_fifo_close(siridb_fifo_t * fifo)
     int rc = 0;
 
     /* close the 'in' fifo */
-    rc += fclose(fifo->in->fp);
-    fifo->in->fp = NULL;
+    rc += siridb_ffile_close(fifo->in);
 
     /* if 'out' is not the same as 'in', we also need to close 'out' */
     if (fifo->out->fp != NULL)
     {
-        rc += fclose(fifo->out->fp);
-        fifo->out->fp = NULL;
+        rc += siridb_ffile_close(fifo->out);
     }
 
     /* return 0 if successful or a negative value in case of errors */
@@ -16,6 +16,8 @@
 #include <siri/db/series.h>
 #include <siri/err.h>
 #include <siri/grammar/grammar.h>
+#include <siri/mem.h>
+#include <siri/siri.h>
 #include <slist/slist.h>
 #include <stdlib.h>
 #include <strextra/strextra.h>
@@ -41,14 +43,14 @@ siridb_group_t * siridb_group_new(
     }
     else
     {
+        siri_mem_add(SIRI_MEM_GROUPS, sizeof(siridb_group_t));
         group->ref = 1;
         group->n = 0;
         group->flags = GROUP_FLAG_INIT;
         group->name = NULL;
         group->source = strndup(source, source_len);
         group->series = slist_new(SLIST_DEFAULT_SIZE);
-        group->regex = NULL;
-        group->regex_extra = NULL;
+        group->re = NULL;
 
         if (    group->source == NULL ||
                 group->series == NULL)
@@ -58,12 +60,11 @@ siridb_group_t * siridb_group_new(
             siridb__group_free(group);
             group = NULL;
         }
-        else if (siridb_re_compile(
-                &group->regex,
-                &group->regex_extra,
+        else if ((group->re = siridb_re_get(
+                siri.re_cache,
                 source,
                 source_len,
-                err_msg))
+                err_msg)) == NULL)
         {
             /* not critical, err_msg is set */
             siridb__group_free(group);
@@ -185,6 +186,7 @@ void siridb_group_cleanup(siridb_group_t * group)
     }
 
     group->series->len -= dropped;
+    siri_mem_sub(SIRI_MEM_GROUPS, dropped * sizeof(siridb_series_t *));
 
     slist_compact(&group->series);
 }
@@ -195,15 +197,10 @@ void siridb_group_cleanup(siridb_group_t * group)
 int siridb_group_test_series(siridb_group_t * group, siridb_series_t * series)
 {
     /* skip if group has flags set. (DROPPED or INIT) */
-    int rc = (group->flags) ? -2 : pcre_exec(
-            group->regex,
-            group->regex_extra,
+    int rc = (group->flags) ? -2 : siridb_re_match(
+            group->re,
             series->name,
-            series->name_len,
-            0,                     // start looking at this point
-            0,                     // OPTIONS
-            NULL,
-            0);                    // length of sub_str_vec
+            series->name_len);
 
     if (!rc)
     {
@@ -217,6 +214,7 @@ int siridb_group_test_series(siridb_group_t * group, siridb_series_t * series)
         }
         else
         {
+            siri_mem_add(SIRI_MEM_GROUPS, sizeof(siridb_series_t *));
             siridb_series_incref(series);
         }
     }
@@ -238,8 +236,7 @@ int siridb_group_update_expression(
         char * err_msg)
 {
     char * new_source = strndup(source, source_len);
-    pcre * new_regex;
-    pcre_extra * new_regex_extra;
+    siridb_re_t * new_re;
     siridb_series_t * series;
 
     if (new_source == NULL)
@@ -249,12 +246,11 @@ int siridb_group_update_expression(
         return -1;
     }
 
-    if (siridb_re_compile(
-            &new_regex,
-            &new_regex_extra,
+    if ((new_re = siridb_re_get(
+            siri.re_cache,
             source,
             source_len,
-            err_msg))
+            err_msg)) == NULL)
     {
         free(new_source);
         return -1;  /* err_msg is set */
@@ -264,12 +260,10 @@ int siridb_group_update_expression(
 
     /* replace group expression */
     free(group->source);
-    free(group->regex);
-    free(group->regex_extra);
+    siridb_re_decref(siri.re_cache, group->re);
 
     group->source = new_source;
-    group->regex = new_regex;
-    group->regex_extra = new_regex_extra;
+    group->re = new_re;
 
     for (size_t i = 0; i < group->series->len; i++)
     {
@@ -277,6 +271,9 @@ int siridb_group_update_expression(
         siridb_series_decref(series);
     }
 
+    siri_mem_sub(
+            SIRI_MEM_GROUPS,
+            group->series->len * sizeof(siridb_series_t *));
     group->series->len = 0;
 
     slist_compact(&group->series);
@@ -369,10 +366,16 @@ void siridb__group_free(siridb_group_t * group)
             series = (siridb_series_t *) group->series->data[i];
             siridb_series_decref(series);
         }
+        siri_mem_sub(
+                SIRI_MEM_GROUPS,
+                group->series->len * sizeof(siridb_series_t *));
         slist_free(group->series);
     }
 
-    free(group->regex);
-    free(group->regex_extra);
+    if (group->re != NULL)
+    {
+        siridb_re_decref(siri.re_cache, group->re);
+    }
+    siri_mem_sub(SIRI_MEM_GROUPS, sizeof(siridb_group_t));
     free(group);
 }
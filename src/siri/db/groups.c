@@ -13,12 +13,14 @@
  *  Main thread:
  *      groups->groups :    read (no lock)      write (lock)
  *      groups->nseries :   read (lock)         write (lock)
+ *      groups->dseries :   read (lock)         write (lock)
  *      groups->ngroups :   read (lock)         write (lock)
  *      group->series :     read (lock)         write (not allowed)
 
  *  Other threads:
  *      groups->groups :    read (lock)         write (not allowed)
  *      groups->nseries :   read (lock)         write (lock)
+ *      groups->dseries :   read (lock)         write (lock)
  *      groups->ngroups :   read (lock)         write (lock)
  *
  *  Group thread:
@@ -39,6 +41,7 @@
 #include <siri/db/series.h>
 #include <siri/err.h>
 #include <siri/net/protocol.h>
+#include <siri/sched.h>
 #include <siri/siri.h>
 #include <slist/slist.h>
 #include <stdlib.h>
@@ -63,6 +66,7 @@ static void GROUPS_init_groups(siridb_t * siridb);
 static void GROUPS_init_series(siridb_t * siridb);
 static int GROUPS_2slist(siridb_group_t * group, slist_t * groups_list);
 static void GROUPS_cleanup(siridb_groups_t * groups);
+static void GROUPS_drop_series(siridb_groups_t * groups);
 /*
  * In case of an error the return value is NULL and a SIGNAL is raised.
  */
@@ -82,11 +86,15 @@ siridb_groups_t * siridb_groups_new(siridb_t * siridb)
         groups->fn = NULL;
         groups->groups = ct_new();
         groups->nseries = slist_new(SLIST_DEFAULT_SIZE);
+        groups->dseries = slist_new(SLIST_DEFAULT_SIZE);
         groups->ngroups = slist_new(SLIST_DEFAULT_SIZE);
         uv_mutex_init(&groups->mutex);
         groups->work.data = (siridb_t *) siridb;
 
-        if (!groups->groups || !groups->nseries || !groups->ngroups)
+        if (    !groups->groups ||
+                !groups->nseries ||
+                !groups->dseries ||
+                !groups->ngroups)
         {
             ERR_ALLOC
             GROUPS_free(groups);
@@ -118,8 +126,9 @@ siridb_groups_t * siridb_groups_new(siridb_t * siridb)
  */
 void siridb_groups_start(siridb_groups_t * groups)
 {
-    uv_queue_work(
-            siri.loop,
+    siri_sched_queue(
+            SIRI_SCHED_SERVICE,
+            NULL,
             &groups->work,
             GROUPS_loop,
             GROUPS_loop_finish);
@@ -152,6 +161,32 @@ int siridb_groups_add_series(
     return rc;
 }
 
+/*
+ * Register a dropped series so it will be removed from the groups it belongs
+ * to. The series must be flagged as dropped.
+ *
+ * When the series cannot be registered, all groups will be cleaned.
+ */
+void siridb_groups_drop_series(
+        siridb_groups_t * groups,
+        siridb_series_t * series)
+{
+    uv_mutex_lock(&groups->mutex);
+
+    if (slist_append_safe(&groups->dseries, series) == 0)
+    {
+        siridb_series_incref(series);
+    }
+    else
+    {
+        log_error("Cannot register dropped series '%s' for groups",
+                series->name);
+        groups->flags |= GROUPS_FLAG_DROPPED_SERIES;
+    }
+
+    uv_mutex_unlock(&groups->mutex);
+}
+
 /*
  * Returns 0 if successful or -1 in case of an error.
  * (a signal might be raised)
@@ -256,16 +291,13 @@ int siridb_groups_save(siridb_groups_t * groups)
 }
 
 /*
- * Typedef: sirinet_clserver_get_file
+ * Typedef: sirinet_clserver_getfn
  *
- * Returns the length of the content for a file and set buffer with the file
- * content. Note that malloc is used to allocate memory for the buffer.
- *
- * In case of an error -1 is returned and buffer will be set to NULL.
+ * Writes the file name to 'fn' which has at least PATH_MAX bytes.
  */
-ssize_t siridb_groups_get_file(char ** buffer, siridb_t * siridb)
+void siridb_groups_get_fn(char * fn, siridb_t * siridb)
 {
-    return xpath_get_content(buffer, siridb->groups->fn);
+    snprintf(fn, PATH_MAX, "%s", siridb->groups->fn);
 }
 
 /*
@@ -392,6 +424,17 @@ static void GROUPS_free(siridb_groups_t * groups)
         slist_free(groups->nseries);
     }
 
+    if (groups->dseries != NULL)
+    {
+        siridb_series_t * series;
+        for (size_t i = 0; i < groups->dseries->len; i++)
+        {
+            series = (siridb_series_t *) groups->dseries->data[i];
+            siridb_series_decref(series);
+        }
+        slist_free(groups->dseries);
+    }
+
     if (groups->groups != NULL)
     {
         ct_free(groups->groups, (ct_free_cb) siridb__group_decref);
@@ -462,6 +505,10 @@ static void GROUPS_loop(uv_work_t * work)
             {
                 GROUPS_cleanup(siridb->groups);
             }
+            else if (groups->dseries->len)
+            {
+                GROUPS_drop_series(siridb->groups);
+            }
             break;
 
         case GROUPS_STOPPING:
@@ -603,12 +650,12 @@ static void GROUPS_init_groups(siridb_t * siridb)
 
     slist_t * series_list;
     siridb_series_t * series;
-    uv_mutex_lock(&siridb->series_mutex);
+    siri_rwlock_wrlock(&siridb->series_mutex);
 
     series_list = (groups->nseries->len) ?
-            NULL : imap_2slist_ref(siridb->series_map);
+            NULL : dmap_2slist_ref(siridb->series_map);
 
-    uv_mutex_unlock(&siridb->series_mutex);
+    siri_rwlock_wrunlock(&siridb->series_mutex);
 
     if (series_list == NULL)
     {
@@ -636,7 +683,10 @@ static void GROUPS_init_groups(siridb_t * siridb)
             {
                 series = (siridb_series_t *) series_list->data[i];
 
-                siridb_group_test_series(group, series);
+                if (~series->flags & SIRIDB_SERIES_IS_DROPPED)
+                {
+                    siridb_group_test_series(group, series);
+                }
 
                 if (i % GROUPS_RE_BATCH_SZ == 0)
                 {
@@ -678,6 +728,15 @@ static void GROUPS_cleanup(siridb_groups_t * groups)
 
     groups->flags &= ~GROUPS_FLAG_DROPPED_SERIES;
 
+    /* the dropped series are removed by the cleanup */
+    for (size_t i = 0; i < groups->dseries->len; i++)
+    {
+        siridb_series_t * series =
+                (siridb_series_t *) groups->dseries->data[i];
+        siridb_series_decref(series);
+    }
+    groups->dseries->len = 0;
+
     slist_t * groups_list = slist_new(groups->groups->len);
 
     if (groups_list != NULL)
@@ -716,3 +775,80 @@ static void GROUPS_cleanup(siridb_groups_t * groups)
 
     slist_free(groups_list);
 }
+
+/*
+ * Group thread.
+ *
+ * Remove the dropped series from the groups. Only groups with an expression
+ * matching at least one of the dropped series can contain dropped series so
+ * other groups do not need a cleanup.
+ */
+static void GROUPS_drop_series(siridb_groups_t * groups)
+{
+    slist_t * dseries;
+    slist_t * groups_list;
+    siridb_group_t * group;
+    siridb_series_t * series;
+
+    uv_mutex_lock(&groups->mutex);
+
+    dseries = groups->dseries;
+    groups->dseries = slist_new(SLIST_DEFAULT_SIZE);
+    groups_list = slist_new(groups->groups->len);
+
+    if (groups->dseries == NULL || groups_list == NULL)
+    {
+        log_error("Cannot remove dropped series from groups, "
+                "all groups will be cleaned");
+        slist_free(groups_list);
+        slist_free(groups->dseries);
+        groups->dseries = dseries;
+        groups->flags |= GROUPS_FLAG_DROPPED_SERIES;
+        uv_mutex_unlock(&groups->mutex);
+        return;
+    }
+
+    ct_values(groups->groups, (ct_val_cb) GROUPS_2slist, groups_list);
+
+    uv_mutex_unlock(&groups->mutex);
+
+    while (groups_list->len)
+    {
+        group = (siridb_group_t *) slist_pop(groups_list);
+
+        if (!group->flags)
+        {
+            for (size_t i = 0; i < dseries->len; i++)
+            {
+                series = (siridb_series_t *) dseries->data[i];
+
+                if (siridb_re_match(
+                        group->re,
+                        series->name,
+                        series->name_len) == 0)
+                {
+                    uv_mutex_lock(&groups->mutex);
+
+                    siridb_group_cleanup(group);
+
+                    uv_mutex_unlock(&groups->mutex);
+
+                    usleep(10000);  // 10ms
+                    break;
+                }
+            }
+        }
+
+        siridb_group_decref(group);
+    }
+
+    slist_free(groups_list);
+
+    for (size_t i = 0; i < dseries->len; i++)
+    {
+        series = (siridb_series_t *) dseries->data[i];
+        siridb_series_decref(series);
+    }
+
+    slist_free(dseries);
+}
@@ -0,0 +1,226 @@
+/*
+ * hedge.c - Send a query to both servers in a pool when one is slow.
+ *
+ * author       : Jeroen van der Heijden
+ * email        : jeroen@transceptor.technology
+ * copyright    : 2016, Transceptor Technology
+ *
+ * A query for another pool is sent to one server in the pool. When this
+ * server has not responded within a delay, the query is also sent to the
+ * other server in the pool and the first response is used. The delay is the
+ * maximum of query_hedge_delay and an estimate of the 95th percentile of the
+ * response times of the server. (see siridb_server_t latency)
+ *
+ * Both requests use a copy of the package which is owned by the hedge since
+ * the package of the promises might be destroyed while the request to the
+ * slow server is still waiting to be written.
+ *
+ * changes
+ *  - initial version, 14-10-2016
+ *
+ */
+#include <logger/logger.h>
+#include <siri/db/hedge.h>
+#include <siri/err.h>
+#include <siri/siri.h>
+#include <stdlib.h>
+
+static int HEDGE_send_other(siridb_hedge_t * hedge);
+static void HEDGE_on_timer(uv_timer_t * timer);
+static void HEDGE_on_response(
+        sirinet_promise_t * promise,
+        sirinet_pkg_t * pkg,
+        int status);
+static void HEDGE_stop(siridb_hedge_t * hedge);
+static void HEDGE_free(siridb_hedge_t * hedge);
+
+#define HEDGE_usable(server, flags) ((flags & FLAG_ONLY_CHECK_ONLINE) ? \
+        siridb_server_is_online(server) : siridb_server_is_accessible(server))
+
+/*
+ * Send a package to a pool, like siridb_pool_send_pkg() with
+ * sirinet_promises_on_response() as call-back. The package is hedged when
+ * both servers in the pool can be used. Exactly one promise is added to
+ * 'promises' when 0 is returned.
+ *
+ * Returns 0 if successful or -1 when the package is not sent. (a SIGNAL is
+ * raised in case of an allocation error)
+ */
+int siridb_hedge_send(
+        siridb_pool_t * pool,
+        sirinet_pkg_t * pkg,
+        uint64_t timeout,
+        sirinet_promises_t * promises,
+        int flags)
+{
+    siridb_hedge_t * hedge;
+    siridb_server_t * server;
+    uint32_t delay;
+
+    if (    pool->len != 2 ||
+            !HEDGE_usable(pool->server[0], flags) ||
+            !HEDGE_usable(pool->server[1], flags))
+    {
+        return siridb_pool_send_pkg(
+                pool,
+                pkg,
+                timeout,
+                sirinet_promises_on_response,
+                promises,
+                FLAG_KEEP_PKG | flags);
+    }
+
+    hedge = (siridb_hedge_t *) malloc(sizeof(siridb_hedge_t));
+    if (hedge == NULL)
+    {
+        ERR_ALLOC
+        return -1;
+    }
+
+    hedge->timer = (uv_timer_t *) malloc(sizeof(uv_timer_t));
+    hedge->pkg = sirinet_pkg_dup(pkg);
+
+    if (hedge->timer == NULL || hedge->pkg == NULL)
+    {
+        ERR_ALLOC
+        free(hedge->timer);
+        free(hedge->pkg);
+        free(hedge);
+        return -1;
+    }
+
+    /* start with the server which is expected to respond first */
+    server = siridb_pool_least_busy(pool->server[0], pool->server[1]);
+
+    hedge->n = 1;
+    hedge->sent = 1;
+    hedge->done = 0;
+    hedge->flags = flags;
+    hedge->timeout = timeout;
+    hedge->server = server;
+    hedge->other = pool->server[server == pool->server[0]];
+    hedge->promises = promises;
+
+    if (siridb_server_send_pkg(
+            server,
+            hedge->pkg,
+            timeout,
+            HEDGE_on_response,
+            hedge,
+            FLAG_KEEP_PKG | flags))
+    {
+        free(hedge->timer);
+        free(hedge->pkg);
+        free(hedge);
+        return -1;
+    }
+
+    /* the servers are used by the hedge until all responses are received */
+    siridb_server_incref(hedge->server);
+    siridb_server_incref(hedge->other);
+
+    delay = (server->latency > siri.cfg->query_hedge_delay) ?
+            server->latency : siri.cfg->query_hedge_delay;
+
+    hedge->timer->data = hedge;
+    uv_timer_init(siri.loop, hedge->timer);
+    uv_timer_start(hedge->timer, HEDGE_on_timer, delay, 0);
+
+    return 0;
+}
+
+/*
+ * Send the query to the other server in the pool. This is done only once.
+ *
+ * Returns 0 if the query is sent or -1 if not.
+ */
+static int HEDGE_send_other(siridb_hedge_t * hedge)
+{
+    HEDGE_stop(hedge);
+
+    if (    hedge->sent == 2 ||
+            !HEDGE_usable(hedge->other, hedge->flags))
+    {
+        return -1;
+    }
+
+    hedge->sent = 2;
+
+    log_debug("Hedge query for '%s' to '%s'",
+            hedge->server->name,
+            hedge->other->name);
+
+    if (siridb_server_send_pkg(
+            hedge->other,
+            hedge->pkg,
+            hedge->timeout,
+            HEDGE_on_response,
+            hedge,
+            FLAG_KEEP_PKG | hedge->flags))
+    {
+        return -1;
+    }
+
+    hedge->n++;
+
+    return 0;
+}
+
+static void HEDGE_on_timer(uv_timer_t * timer)
+{
+    HEDGE_send_other((siridb_hedge_t *) timer->data);
+}
+
+/*
+ * The first successful response is passed to the promises. A failed request
+ * is sent to the other server, if not done already.
+ */
+static void HEDGE_on_response(
+        sirinet_promise_t * promise,
+        sirinet_pkg_t * pkg,
+        int status)
+{
+    siridb_hedge_t * hedge = (siridb_hedge_t *) promise->data;
+
+    hedge->n--;
+
+    if (hedge->done || (status && HEDGE_send_other(hedge) == 0))
+    {
+        /* a response is passed already or the other server is asked */
+        sirinet_promise_decref(promise);
+    }
+    else
+    {
+        hedge->done = 1;
+        HEDGE_stop(hedge);
+
+        promise->data = hedge->promises;
+        sirinet_promises_on_response(promise, pkg, status);
+    }
+
+    if (!hedge->n)
+    {
+        HEDGE_free(hedge);
+    }
+}
+
+static void HEDGE_stop(siridb_hedge_t * hedge)
+{
+    if (hedge->timer != NULL)
+    {
+        uv_timer_stop(hedge->timer);
+        uv_close((uv_handle_t *) hedge->timer, (uv_close_cb) free);
+        hedge->timer = NULL;
+    }
+}
+
+static void HEDGE_free(siridb_hedge_t * hedge)
+{
+    HEDGE_stop(hedge);
+    free(hedge->pkg);
+
+    siridb_server_decref(hedge->server);
+    siridb_server_decref(hedge->other);
+
+    free(hedge);
+}
@@ -0,0 +1,359 @@
+/*
+ * hot.c - Heavy hitter sketches for inserted and selected points.
+ *
+ * author       : Jeroen van der Heijden
+ * email        : jeroen@transceptor.technology
+ * copyright    : 2016, Transceptor Technology
+ *
+ * For inserted points and for points read by selects, a space-saving sketch
+ * keeps SIRIDB_HOT_SIZE counters for the series with the most points. When
+ * a series without a counter is added, the counter with the lowest count is
+ * taken over; the new count starts at the old count which is also kept as
+ * the error. A series with more than total / SIRIDB_HOT_SIZE points always
+ * has a counter and its count is never too low.
+ *
+ * The counters are a min-heap so the lowest counter is found in constant time
+ * and an update only moves the counter in the heap. The heart-beat halves all
+ * counts each SIRIDB_HOT_DECAY seconds so the sketch follows a changing load.
+ *
+ * Inserts update the sketch from the event loop and selects also from the
+ * scheduler threads, so the sketch has a lock.
+ *
+ * changes
+ *  - initial version, 14-10-2016
+ *
+ */
+#include <logger/logger.h>
+#include <siri/db/db.h>
+#include <siri/db/hot.h>
+#include <siri/db/series.h>
+#include <siri/err.h>
+#include <siri/siri.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define HOT_LINE_SZ 64      // size of a line, excluding the series name
+
+static const char * hot_str[SIRIDB_HOT_END] = {
+        "insert",
+        "select"};
+
+static void HOT_sift_up(siridb_hot_sketch_t * sketch, uint32_t pos);
+static void HOT_sift_down(siridb_hot_sketch_t * sketch, uint32_t pos);
+static void HOT_swap(siridb_hot_sketch_t * sketch, uint32_t a, uint32_t b);
+static int HOT_cmp(
+        const siridb_hot_counter_t * a,
+        const siridb_hot_counter_t * b);
+
+/*
+ * Returns NULL and raises a SIGNAL in case an error has occurred.
+ */
+siridb_hot_t * siridb_hot_new(void)
+{
+    siridb_hot_t * hot = (siridb_hot_t *) calloc(1, sizeof(siridb_hot_t));
+    if (hot == NULL)
+    {
+        ERR_ALLOC
+        return NULL;
+    }
+
+    for (int tp = 0; tp < SIRIDB_HOT_END; tp++)
+    {
+        hot->sketch[tp].counters = imap_new();
+        if (hot->sketch[tp].counters == NULL)
+        {
+            while (tp--)
+            {
+                imap_free(hot->sketch[tp].counters, NULL);
+            }
+            free(hot);
+            ERR_ALLOC
+            return NULL;
+        }
+    }
+
+    hot->decayed = (siri.loop == NULL) ? 0 : uv_now(siri.loop);
+    uv_mutex_init(&hot->lock);
+
+    return hot;
+}
+
+void siridb_hot_free(siridb_hot_t * hot)
+{
+    if (hot != NULL)
+    {
+        for (int tp = 0; tp < SIRIDB_HOT_END; tp++)
+        {
+            imap_free(hot->sketch[tp].counters, NULL);
+        }
+        uv_mutex_destroy(&hot->lock);
+        free(hot);
+    }
+}
+
+/*
+ * Add 'n' points for a series. A failed allocation is logged and the points
+ * are only counted in the total, no signal is raised since this function is
+ * also called from the scheduler threads.
+ */
+void siridb_hot_add(
+        siridb_hot_t * hot,
+        siridb_hot_tp_t tp,
+        uint32_t series_id,
+        uint64_t n)
+{
+    siridb_hot_sketch_t * sketch = hot->sketch + tp;
+    siridb_hot_counter_t * counter;
+
+    uv_mutex_lock(&hot->lock);
+
+    sketch->total += n;
+
+    if ((counter = imap_get(sketch->counters, series_id)) != NULL)
+    {
+        counter->count += n;
+        HOT_sift_down(sketch, counter->pos);
+    }
+    else if (sketch->len < SIRIDB_HOT_SIZE)
+    {
+        counter = sketch->counter + sketch->len;
+
+        if (imap_add(sketch->counters, series_id, counter))
+        {
+            log_error("Cannot add series %" PRIu32 " to the sketch",
+                    series_id);
+        }
+        else
+        {
+            counter->series_id = series_id;
+            counter->count = n;
+            counter->error = 0;
+            counter->pos = sketch->len;
+            sketch->heap[sketch->len++] = counter;
+            HOT_sift_up(sketch, counter->pos);
+        }
+    }
+    else
+    {
+        /* take over the counter with the lowest count */
+        counter = sketch->heap[0];
+
+        if (imap_add(sketch->counters, series_id, counter))
+        {
+            log_error("Cannot add series %" PRIu32 " to the sketch",
+                    series_id);
+        }
+        else
+        {
+            imap_pop(sketch->counters, counter->series_id);
+            counter->series_id = series_id;
+            counter->error = counter->count;
+            counter->count += n;
+            HOT_sift_down(sketch, 0);
+        }
+    }
+
+    uv_mutex_unlock(&hot->lock);
+}
+
+/*
+ * Halve all counts. The order of the counters does not change.
+ */
+void siridb_hot_decay(siridb_hot_t * hot)
+{
+    siridb_hot_sketch_t * sketch;
+
+    uv_mutex_lock(&hot->lock);
+
+    for (int tp = 0; tp < SIRIDB_HOT_END; tp++)
+    {
+        sketch = hot->sketch + tp;
+        sketch->total >>= 1;
+        for (uint32_t i = 0; i < sketch->len; i++)
+        {
+            sketch->counter[i].count >>= 1;
+            sketch->counter[i].error >>= 1;
+        }
+    }
+
+    uv_mutex_unlock(&hot->lock);
+}
+
+/*
+ * Copy at most 'n' counters with the highest counts to 'top', ordered by
+ * count from high to low. Counters with a count of 0 (zero) are skipped.
+ *
+ * Returns the number of counters which are copied.
+ */
+size_t siridb_hot_top(
+        siridb_hot_t * hot,
+        siridb_hot_tp_t tp,
+        siridb_hot_counter_t * top,
+        size_t n)
+{
+    siridb_hot_sketch_t * sketch = hot->sketch + tp;
+    siridb_hot_counter_t counters[SIRIDB_HOT_SIZE];
+    size_t len;
+
+    uv_mutex_lock(&hot->lock);
+    len = sketch->len;
+    memcpy(counters, sketch->counter, len * sizeof(siridb_hot_counter_t));
+    uv_mutex_unlock(&hot->lock);
+
+    qsort(counters,
+            len,
+            sizeof(siridb_hot_counter_t),
+            (int (*)(const void *, const void *)) HOT_cmp);
+
+    while (len && !counters[len - 1].count)
+    {
+        len--;
+    }
+
+    if (len > n)
+    {
+        len = n;
+    }
+
+    memcpy(top, counters, len * sizeof(siridb_hot_counter_t));
+
+    return len;
+}
+
+/*
+ * Returns a summary with the total and the top series for inserts and for
+ * selects, or NULL in case of an allocation error. Series which are dropped
+ * are not included.
+ *
+ * The return value must be freed by the caller.
+ */
+char * siridb_hot_summary(siridb_t * siridb)
+{
+    siridb_hot_counter_t top[SIRIDB_HOT_END][SIRIDB_HOT_TOP];
+    size_t n[SIRIDB_HOT_END];
+    size_t size = 1;
+    siridb_series_t * series;
+    uint64_t total[SIRIDB_HOT_END];
+    char * buf;
+    char * pt;
+    int len;
+
+    for (int tp = 0; tp < SIRIDB_HOT_END; tp++)
+    {
+        n[tp] = siridb_hot_top(siridb->hot, tp, top[tp], SIRIDB_HOT_TOP);
+
+        uv_mutex_lock(&siridb->hot->lock);
+        total[tp] = siridb->hot->sketch[tp].total;
+        uv_mutex_unlock(&siridb->hot->lock);
+
+        size += HOT_LINE_SZ;
+        for (size_t i = 0; i < n[tp]; i++)
+        {
+            series = dmap_get(siridb->series_map, top[tp][i].series_id);
+            size += HOT_LINE_SZ + ((series == NULL) ? 0 : series->name_len);
+        }
+    }
+
+    buf = (char *) malloc(size);
+    if (buf == NULL)
+    {
+        return NULL;
+    }
+
+    pt = buf;
+    *pt = '\0';
+
+    for (int tp = 0; tp < SIRIDB_HOT_END; tp++)
+    {
+        len = sprintf(
+                pt,
+                "%s%s: total=%" PRIu64,
+                tp ? "\n" : "",
+                hot_str[tp],
+                total[tp]);
+        pt += len;
+
+        for (size_t i = 0; i < n[tp]; i++)
+        {
+            series = dmap_get(siridb->series_map, top[tp][i].series_id);
+            if (series == NULL)
+            {
+                continue;
+            }
+            len = sprintf(
+                    pt,
+                    "\n  %s: count=%" PRIu64 " error=%" PRIu64,
+                    series->name,
+                    top[tp][i].count,
+                    top[tp][i].error);
+            pt += len;
+        }
+    }
+
+    return buf;
+}
+
+static void HOT_sift_up(siridb_hot_sketch_t * sketch, uint32_t pos)
+{
+    uint32_t parent;
+
+    while (pos)
+    {
+        parent = (pos - 1) / 2;
+        if (sketch->heap[parent]->count <= sketch->heap[pos]->count)
+        {
+            break;
+        }
+        HOT_swap(sketch, parent, pos);
+        pos = parent;
+    }
+}
+
+static void HOT_sift_down(siridb_hot_sketch_t * sketch, uint32_t pos)
+{
+    uint32_t child, smallest;
+
+    for (;;)
+    {
+        smallest = pos;
+        child = 2 * pos + 1;
+
+        if (    child < sketch->len &&
+                sketch->heap[child]->count < sketch->heap[smallest]->count)
+        {
+            smallest = child;
+        }
+
+        if (    ++child < sketch->len &&
+                sketch->heap[child]->count < sketch->heap[smallest]->count)
+        {
+            smallest = child;
+        }
+
+        if (smallest == pos)
+        {
+            break;
+        }
+
+        HOT_swap(sketch, smallest, pos);
+        pos = smallest;
+    }
+}
+
+static void HOT_swap(siridb_hot_sketch_t * sketch, uint32_t a, uint32_t b)
+{
+    siridb_hot_counter_t * tmp = sketch->heap[a];
+
+    sketch->heap[a] = sketch->heap[b];
+    sketch->heap[b] = tmp;
+    sketch->heap[a]->pos = a;
+    sketch->heap[b]->pos = b;
+}
+
+static int HOT_cmp(
+        const siridb_hot_counter_t * a,
+        const siridb_hot_counter_t * b)
+{
+    return (a->count < b->count) - (a->count > b->count);
+}
@@ -0,0 +1,491 @@
+/*
+ * hotlog.c - Sequential log for series which fill their buffer constantly.
+ *
+ * author       : Jeroen van der Heijden
+ * email        : jeroen@transceptor.technology
+ * copyright    : 2016, Transceptor Technology
+ *
+ * changes
+ *  - initial version, 14-10-2016
+ *
+ * Points for hot series are kept in memory and appended to the log instead of
+ * being written to their buffer slot. The log is flushed once for each insert
+ * so writes for all hot series are combined. The slot of a hot series holds a
+ * marker with the log position of the first record for the points in memory,
+ * so only records after this position are replayed when loading.
+ */
+#include <logger/logger.h>
+#include <siri/db/buffer.h>
+#include <siri/db/db.h>
+#include <siri/db/hotlog.h>
+#include <siri/db/series.h>
+#include <siri/db/shards.h>
+#include <siri/err.h>
+#include <siri/siri.h>
+#include <slist/slist.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <xpath/xpath.h>
+
+typedef struct hotlog_rec_s
+{
+    uint32_t id;                    /* series id */
+    uint32_t n;                     /* number of points in the record */
+} hotlog_rec_t;
+
+static int HOTLOG_replay(siridb_t * siridb, FILE * fp);
+static int HOTLOG_replay_points(
+        siridb_t * siridb,
+        siridb_series_t * series,
+        siridb_point_t * points,
+        size_t n);
+static int HOTLOG_create(siridb_hotlog_t * hotlog, const char * fn);
+static int HOTLOG_rotate(siridb_t * siridb);
+static int HOTLOG_rotate_series(siridb_series_t * series, siridb_t * siridb);
+
+/*
+ * Returns NULL and raises a signal in case of an error.
+ */
+siridb_hotlog_t * siridb_hotlog_new(void)
+{
+    siridb_hotlog_t * hotlog =
+            (siridb_hotlog_t *) malloc(sizeof(siridb_hotlog_t));
+    if (hotlog == NULL)
+    {
+        ERR_ALLOC
+        return NULL;
+    }
+
+    hotlog->fp = NULL;
+    hotlog->size = 0;
+    hotlog->gen = 0;
+    hotlog->series = imap_new();
+    hotlog->markers = imap_new();
+
+    if (hotlog->series == NULL || hotlog->markers == NULL)
+    {
+        ERR_ALLOC
+        siridb_hotlog_free(hotlog);
+        return NULL;
+    }
+
+    return hotlog;
+}
+
+/*
+ * Close the log and free the hot log. Points of hot series which are only
+ * in memory are still in the log and will be replayed at the next load.
+ */
+void siridb_hotlog_free(siridb_hotlog_t * hotlog)
+{
+    if (hotlog->fp != NULL && fclose(hotlog->fp))
+    {
+        log_critical("Cannot close the hot series log");
+    }
+
+    if (hotlog->series != NULL)
+    {
+        imap_free(hotlog->series, NULL);
+    }
+
+    if (hotlog->markers != NULL)
+    {
+        imap_free(hotlog->markers, NULL);
+    }
+
+    free(hotlog);
+}
+
+/*
+ * Replay the log using the markers found while loading the buffer and start
+ * a new log generation. This must be done after the shards are loaded since
+ * replayed points might need to be written to the shards.
+ *
+ * The log is replayed even when buffer_hot_log is disabled, in which case
+ * the log file is removed afterwards.
+ *
+ * Returns 0 if successful or -1 in case of an error.
+ * (signal might be raised)
+ */
+int siridb_hotlog_load(siridb_t * siridb)
+{
+    siridb_hotlog_t * hotlog = siridb->hotlog;
+    FILE * fp;
+    int rc = 0;
+
+    SIRIDB_GET_FN(fn, siridb->buffer_path, SIRIDB_HOTLOG_FN)
+
+    if ((fp = fopen(fn, "r")) != NULL)
+    {
+        log_info("Replay hot series log");
+        rc = HOTLOG_replay(siridb, fp);
+        fclose(fp);
+    }
+
+    imap_free(hotlog->markers, NULL);
+    hotlog->markers = NULL;
+
+    if (rc)
+    {
+        log_critical("Cannot replay hot series log '%s'", fn);
+        return -1;
+    }
+
+    if (!siri.cfg->buffer_hot_log)
+    {
+        if (xpath_file_exist(fn) && unlink(fn))
+        {
+            log_critical("Cannot remove hot series log '%s'", fn);
+            return -1;
+        }
+        return 0;
+    }
+
+    /* the new generation makes all markers in the buffer file stale */
+    hotlog->gen++;
+
+    return HOTLOG_create(hotlog, fn);
+}
+
+/*
+ * Mark a series as hot. The buffer of the series must be empty and the
+ * marker must be written afterwards.
+ *
+ * Returns 0 if successful or -1 and a signal is raised in case of an error.
+ */
+int siridb_hotlog_add(siridb_hotlog_t * hotlog, siridb_series_t * series)
+{
+    if (imap_add(hotlog->series, series->id, series) == -1)
+    {
+        ERR_ALLOC
+        return -1;
+    }
+
+    series->bf_hot = 1;
+
+    log_debug("Series id %u is written to the hot log", series->id);
+
+    return 0;
+}
+
+/*
+ * The points in the buffer of the series must be written to the buffer file
+ * or shards when the series is used in the buffer file again.
+ */
+void siridb_hotlog_remove(siridb_hotlog_t * hotlog, siridb_series_t * series)
+{
+    imap_pop(hotlog->series, series->id);
+    series->bf_hot = 0;
+}
+
+/*
+ * Append points to the log. The points are written to the disk when the log
+ * is committed.
+ *
+ * Returns 0 if success or EOF in case of an error.
+ */
+int siridb_hotlog_write(
+        siridb_hotlog_t * hotlog,
+        uint32_t id,
+        siridb_point_t * points,
+        size_t n)
+{
+    hotlog_rec_t rec = {.id=id, .n=(uint32_t) n};
+
+    if (    fwrite(&rec, sizeof(hotlog_rec_t), 1, hotlog->fp) != 1 ||
+            fwrite(points, sizeof(siridb_point_t), n, hotlog->fp) != n)
+    {
+        return EOF;
+    }
+
+    hotlog->size += sizeof(hotlog_rec_t) + n * sizeof(siridb_point_t);
+
+    return 0;
+}
+
+/*
+ * Flush the records written by an insert and rotate the log when it is too
+ * large. Must be called while holding the series (write) lock.
+ *
+ * Returns 0 if successful or -1 and a signal is raised in case of an error.
+ */
+int siridb_hotlog_commit(siridb_t * siridb)
+{
+    siridb_hotlog_t * hotlog = siridb->hotlog;
+
+    if (fflush(hotlog->fp))
+    {
+        ERR_FILE
+        log_critical("Cannot write to the hot series log");
+        return -1;
+    }
+
+    return (hotlog->size > SIRIDB_HOTLOG_MAX_SZ) ? HOTLOG_rotate(siridb) : 0;
+}
+
+/*
+ * Returns 0 if successful or -1 in case of an error.
+ */
+int siridb_hotlog_sync(siridb_hotlog_t * hotlog)
+{
+    return (fflush(hotlog->fp) || fsync(fileno(hotlog->fp))) ? -1 : 0;
+}
+
+/*
+ * Read all records from the log and add the points to the series which have
+ * a marker of this generation at or before the record. The replayed series
+ * are written to their buffer slot so they no longer depend on the log.
+ *
+ * Returns 0 if successful or -1 in case of an error.
+ * (signal might be raised)
+ */
+static int HOTLOG_replay(siridb_t * siridb, FILE * fp)
+{
+    siridb_hotlog_t * hotlog = siridb->hotlog;
+    siridb_series_t * series;
+    siridb_point_t * points = NULL;
+    size_t sz = 0, pos = SIRIDB_HOTLOG_HEADER_SZ, marker, i;
+    uint64_t gen;
+    hotlog_rec_t rec;
+    slist_t * replayed;
+    int rc = 0;
+
+    if (fread(&gen, sizeof(uint64_t), 1, fp) != 1)
+    {
+        return 0;  /* empty log */
+    }
+
+    /* the next generation must be different from this log */
+    hotlog->gen = (uint16_t) gen;
+
+    if ((replayed = slist_new(SLIST_DEFAULT_SIZE)) == NULL)
+    {
+        ERR_ALLOC
+        return -1;
+    }
+
+    /* an incomplete record at the end of the log is ignored */
+    while (fread(&rec, sizeof(hotlog_rec_t), 1, fp) == 1)
+    {
+        if (rec.n > sz)
+        {
+            siridb_point_t * tmp = (siridb_point_t *) realloc(
+                    points,
+                    sizeof(siridb_point_t) * rec.n);
+            if (tmp == NULL)
+            {
+                ERR_ALLOC
+                rc = -1;
+                break;
+            }
+            points = tmp;
+            sz = rec.n;
+        }
+
+        if (fread(points, sizeof(siridb_point_t), rec.n, fp) != rec.n)
+        {
+            break;
+        }
+
+        marker = (size_t) imap_get(hotlog->markers, rec.id);
+        series = (siridb_series_t *) dmap_get(siridb->series_map, rec.id);
+
+        if (    marker &&
+                series != NULL &&
+                series->buffer != NULL &&
+                siridb_hotlog_marker_gen(marker) == hotlog->gen &&
+                siridb_hotlog_marker_pos(marker) <= pos)
+        {
+            /* bf_hot is used to add each series only once */
+            if (!series->bf_hot)
+            {
+                series->bf_hot = 1;
+                if (slist_append_safe(&replayed, series))
+                {
+                    ERR_ALLOC
+                    rc = -1;
+                    break;
+                }
+            }
+
+            if (HOTLOG_replay_points(siridb, series, points, rec.n))
+            {
+                rc = -1;  /* signal is raised */
+                break;
+            }
+        }
+
+        pos += sizeof(hotlog_rec_t) + rec.n * sizeof(siridb_point_t);
+    }
+
+    free(points);
+
+    for (i = 0; i < replayed->len; i++)
+    {
+        series = (siridb_series_t *) replayed->data[i];
+        series->bf_hot = 0;
+
+        if (    !rc &&
+                (series->buffer->len ?
+                    siridb_buffer_write_points(
+                            siridb,
+                            series,
+                            series->buffer->data,
+                            series->buffer->len) :
+                    siridb_buffer_write_len(siridb, series)))
+        {
+            log_critical(
+                    "Cannot write replayed points for series id %u",
+                    series->id);
+            rc = -1;
+        }
+    }
+
+    log_info("Replayed %zu hot series", replayed->len);
+
+    slist_free(replayed);
+
+    return rc;
+}
+
+/*
+ * Add replayed points to the series buffer. A full buffer is written to the
+ * shards, like it would have been when the points were inserted.
+ *
+ * Returns 0 if successful or -1 and a signal is raised in case of an error.
+ */
+static int HOTLOG_replay_points(
+        siridb_t * siridb,
+        siridb_series_t * series,
+        siridb_point_t * points,
+        size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        if (siridb_buffer_reserve(siridb, series, 1))
+        {
+            return -1;  /* signal is raised */
+        }
+
+        siridb_points_add_point(
+                series->buffer,
+                &points[i].ts,
+                &points[i].val);
+
+        series->length++;
+
+        if (series->buffer->len == siridb_buffer_len(siridb, series))
+        {
+            if (siridb_shards_add_points(siridb, series, series->buffer))
+            {
+                return -1;  /* signal is raised */
+            }
+            series->buffer->len = 0;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Create a new log file with the current generation.
+ *
+ * Returns 0 if successful or -1 in case of an error.
+ */
+static int HOTLOG_create(siridb_hotlog_t * hotlog, const char * fn)
+{
+    uint64_t gen = hotlog->gen;
+
+    if ((hotlog->fp = fopen(fn, "w")) == NULL)
+    {
+        log_critical("Cannot create hot series log '%s'", fn);
+        return -1;
+    }
+
+    if (    fwrite(&gen, sizeof(uint64_t), 1, hotlog->fp) != 1 ||
+            fflush(hotlog->fp))
+    {
+        log_critical("Cannot write to hot series log '%s'", fn);
+        fclose(hotlog->fp);
+        hotlog->fp = NULL;
+        return -1;
+    }
+
+    hotlog->size = SIRIDB_HOTLOG_HEADER_SZ;
+
+    return 0;
+}
+
+/*
+ * Write the points of all hot series to the shards and start a new log
+ * generation. The markers for the new generation are synced before the log
+ * is truncated, so a crash in between never loses points.
+ *
+ * Returns 0 if successful or -1 and a signal is raised in case of an error.
+ */
+static int HOTLOG_rotate(siridb_t * siridb)
+{
+    siridb_hotlog_t * hotlog = siridb->hotlog;
+    uint64_t gen;
+
+    hotlog->gen++;
+    hotlog->size = SIRIDB_HOTLOG_HEADER_SZ;
+    gen = hotlog->gen;
+
+    log_debug(
+            "Rotate hot series log for database '%s' (%zu series)",
+            siridb->dbname,
+            hotlog->series->len);
+
+    if (imap_walk(
+            hotlog->series,
+            (imap_cb) HOTLOG_rotate_series,
+            (void *) siridb))
+    {
+        return -1;  /* signal is raised */
+    }
+
+    if (siridb_buffer_sync(siridb))
+    {
+        ERR_FILE
+        log_critical("Cannot sync the buffer file before rotating the log");
+        return -1;
+    }
+
+    if (    ftruncate(fileno(hotlog->fp), 0) ||
+            fseeko(hotlog->fp, 0, SEEK_SET) ||
+            fwrite(&gen, sizeof(uint64_t), 1, hotlog->fp) != 1 ||
+            fflush(hotlog->fp))
+    {
+        ERR_FILE
+        log_critical("Cannot rotate the hot series log");
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Write the points of a hot series to the shards and write a marker for the
+ * new log generation.
+ *
+ * Returns 0 if successful or -1 and a signal is raised in case of an error.
+ */
+static int HOTLOG_rotate_series(siridb_series_t * series, siridb_t * siridb)
+{
+    if (series->buffer->len)
+    {
+        if (siridb_shards_add_points(siridb, series, series->buffer))
+        {
+            return -1;  /* signal is raised */
+        }
+        series->buffer->len = 0;
+    }
+
+    if (siridb_buffer_write_len(siridb, series))
+    {
+        ERR_FILE
+        return -1;
+    }
+
+    return 0;
+}
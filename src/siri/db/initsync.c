@@ -22,17 +22,20 @@
 #include <stdio.h>
 #include <siri/siri.h>
 #include <siri/optimize.h>
+#include <siri/throttle.h>
 #include <qpack/qpack.h>
 
 #define INITSYNC_SLEEP 100          // 100 milliseconds * active tasks
 #define INITSYNC_TIMEOUT 120000     // 2 minutes
 #define INITSYNC_RETRY 30000        // 30 seconds
 #define INITSYC_FN ".initsync"
+#define INITSYNC_BATCH_IDS 1024     // series ids read for one package
+#define INITSYNC_BATCH_SIZE 1048576 // 1 MB
 
 void siridb_initsync_fopen(siridb_initsync_t * initsync, const char * opentype);
 static int INITSYNC_create_cb(siridb_series_t * series, FILE * fp);
 static void INITSYNC_work(uv_timer_t * timer);
-static void INITSYNC_next_series_id(siridb_t * siridb);
+static void INITSYNC_next(siridb_t * siridb);
 static int INITSYNC_unlink(siridb_initsync_t * initsync);
 static inline int INITSYNC_fn(siridb_t * siridb, siridb_initsync_t * initsync);
 static void INITSYNC_pause(siridb_replicate_t * replicate);
@@ -42,7 +45,6 @@ static void INITSYNC_on_insert_response(
         sirinet_pkg_t * pkg,
         int status);
 
-static const long int SIZE2 = 2 * sizeof(uint32_t);
 static char sync_progress[30];
 
 
@@ -64,8 +66,10 @@ siridb_initsync_t * siridb_initsync_open(siridb_t * siridb, int create_new)
     {
         initsync->fn = NULL;
         initsync->fp = NULL;
-        initsync->next_series_id = NULL;
+        initsync->pending = 0;
         initsync->pkg = NULL;
+        initsync->start_size = 0;
+        initsync->start = 0;
 
         if (INITSYNC_fn(siridb, initsync) < 0)
         {
@@ -81,16 +85,9 @@ siridb_initsync_t * siridb_initsync_open(siridb_t * siridb, int create_new)
             }
             else
             {
-                initsync->next_series_id =
-                        (uint32_t *) malloc(sizeof(uint32_t));
-                if (initsync->next_series_id == NULL)
+                if (create_new)
                 {
-                    ERR_ALLOC
-                    siridb_initsync_free(&initsync);
-                }
-                else if (create_new)
-                {
-                    if (imap_walk(
+                    if (dmap_walk(
                                 siridb->series_map,
                                 (imap_cb) INITSYNC_create_cb,
                                 initsync->fp) || fflush(initsync->fp))
@@ -109,7 +106,7 @@ siridb_initsync_t * siridb_initsync_open(siridb_t * siridb, int create_new)
                             1,
                             initsync->fp) == 1)
                     {
-                        series = imap_get(
+                        series = dmap_get(
                                 siridb->series_map,
                                 series_id);
 
@@ -135,19 +132,9 @@ siridb_initsync_t * siridb_initsync_open(siridb_t * siridb, int create_new)
                     }
                     else
                     {
-                        if (fseeko(initsync->fp, -sizeof(uint32_t), SEEK_END) ||
-                            fread(  initsync->next_series_id,
-                                    sizeof(uint32_t),
-                                    1,
-                                    initsync->fp) != 1)
-                        {
-                            ERR_FILE
-                            siridb_initsync_free(&initsync);
-                        }
-                        else
-                        {
-                            siri_optimize_pause();
-                        }
+                        initsync->start_size = initsync->size;
+                        initsync->start = uv_now(siri.loop);
+                        siri_optimize_pause();
                     }
                 }
             }
@@ -169,7 +156,6 @@ void siridb_initsync_free(siridb_initsync_t ** initsync)
         ERR_FILE
     }
     free((*initsync)->fn);
-    free((*initsync)->next_series_id);
     free((*initsync)->pkg);
     free(*initsync);
     *initsync = NULL;
@@ -231,13 +217,13 @@ void siridb_initsync_fopen(siridb_initsync_t * initsync, const char * opentype)
 }
 
 /*
- * Read the next series id and truncate the synchronization file to remove
- * the last synchronization id.
+ * Truncate the synchronization file to remove the series ids which are
+ * handled by the last package and continue with the next package.
  *
  * This function might destroy 'replicate->initsync' when initial
  * synchronization is finished.
  */
-static void INITSYNC_next_series_id(siridb_t * siridb)
+static void INITSYNC_next(siridb_t * siridb)
 {
 #ifdef DEBUG
     assert (siridb->replicate != NULL);
@@ -247,27 +233,20 @@ static void INITSYNC_next_series_id(siridb_t * siridb)
 
     siridb_initsync_t * initsync = siridb->replicate->initsync;
 
-#ifdef DEUBUG
-    assert (initsync->size == fseeko(initsync->fp, 0, SEEK_END);
-#endif
-
     /* free the current package (can be NULL already) */
     free(initsync->pkg);
     initsync->pkg = NULL;
 
-    if (initsync->size >= SIZE2)
+    initsync->size -= initsync->pending * sizeof(uint32_t);
+    initsync->pending = 0;
+
+    if (initsync->size > 0)
     {
-        initsync->size -= sizeof(uint32_t);
-        if (fseeko(initsync->fp, -SIZE2, SEEK_END) ||
-            fread(  initsync->next_series_id,
-                    sizeof(uint32_t),
-                    1,
-                    initsync->fp) != 1 ||
-            ftruncate(initsync->fd, initsync->size))
+        if (ftruncate(initsync->fd, initsync->size))
         {
             ERR_FILE
             log_critical(
-                    "Reading next series id has failed "
+                    "Truncating the synchronization file has failed "
                     "(replicate status: %d)",
                     siridb->replicate->status);
         }
@@ -374,58 +353,100 @@ static void INITSYNC_work(uv_timer_t * timer)
 
     siridb_initsync_t * initsync = siridb->replicate->initsync;
     siridb_series_t * series;
+    siridb_points_t * points;
+    qp_packer_t * packer = NULL;
+    uint32_t ids[INITSYNC_BATCH_IDS];
+    size_t n = initsync->size / sizeof(uint32_t);
 
-    series = imap_get(siridb->series_map, *initsync->next_series_id);
+    if (n > INITSYNC_BATCH_IDS)
+    {
+        n = INITSYNC_BATCH_IDS;
+    }
 
-    if (series != NULL)
+    if (fseeko(initsync->fp, initsync->size - n * sizeof(uint32_t), SEEK_SET) ||
+        fread(ids, sizeof(uint32_t), n, initsync->fp) != n)
     {
-        uv_mutex_lock(&siridb->series_mutex);
+        ERR_FILE
+        log_critical("Reading next series ids has failed");
+        return;
+    }
 
-        siridb_points_t * points = siridb_series_get_points(
-                series,
-                NULL,
-                NULL);
+    /*
+     * Pack the series for as many ids as fit in one package. The ids are
+     * only removed from the file when the replica has responded.
+     */
+    while (n-- && !siri_err)
+    {
+        initsync->pending++;
+        series = dmap_get(siridb->series_map, ids[n]);
 
-        uv_mutex_unlock(&siridb->series_mutex);
+        if (series == NULL)
+        {
+            continue;
+        }
 
-        if (points != NULL)
+        if (packer == NULL)
         {
-            qp_packer_t * packer = sirinet_packer_new(QP_SUGGESTED_SIZE);
-            if (packer != NULL)
+            packer = sirinet_packer_new(QP_SUGGESTED_SIZE);
+            if (packer == NULL)
             {
-                qp_add_type(packer, QP_MAP1);
+                break;  /* signal is raised */
+            }
+            qp_add_type(packer, QP_MAP_OPEN);
+        }
 
-                /* add name including string terminator */
-                qp_add_raw(packer, series->name, series->name_len + 1);
+        siri_rwlock_wrlock(&siridb->series_mutex);
 
-                if (siridb_points_pack(points, packer) == 0)
-                {
-                    series->flags &= ~SIRIDB_SERIES_INIT_REPL;
+        points = siridb_series_get_points(siridb, series, NULL, NULL);
+
+        siri_rwlock_wrunlock(&siridb->series_mutex);
 
-                    initsync->pkg = sirinet_packer2pkg(
-                            packer,
-                            0,
-                            BPROTO_INSERT_SERVER);
+        if (points == NULL)
+        {
+            break;  /* signal is raised */
+        }
 
-                    uv_timer_start(
-                            siridb->replicate->timer,
-                            INITSYNC_send,
-                            0,
-                            0);
+        /* add name including string terminator */
+        if (    qp_add_raw(packer, series->name, series->name_len + 1) == 0 &&
+                siridb_points_pack(points, packer) == 0)
+        {
+            series->flags &= ~SIRIDB_SERIES_INIT_REPL;
 
-                }
-                else
-                {
-                    qp_packer_free(packer);  /* signal is raised */
-                }
+            if (packer->len >= INITSYNC_BATCH_SIZE)
+            {
+                n = 0;
             }
-            siridb_points_free(points);
         }
+
+        siridb_points_free(points);
     }
-    else
+
+    if (siri_err)
     {
-        INITSYNC_next_series_id(siridb);
+        if (packer != NULL)
+        {
+            qp_packer_free(packer);
+        }
+        return;  /* signal is raised */
+    }
+
+    if (packer == NULL)
+    {
+        /* none of the series exist anymore */
+        INITSYNC_next(siridb);
+        return;
     }
+
+    initsync->pkg = sirinet_packer2pkg(packer, 0, BPROTO_INSERT_SERVER);
+
+    /* wait before sending when the initsync_io_limit is reached */
+    uv_timer_start(
+            siridb->replicate->timer,
+            INITSYNC_send,
+            siri_throttle_delay(
+                    SIRI_THROTTLE_INITSYNC,
+                    sizeof(sirinet_pkg_t) + initsync->pkg->len),
+            0);
 }
 
 /*
@@ -468,7 +489,7 @@ static void INITSYNC_on_insert_response(
         log_error("Error occurred while sending series to the replica (%d)",
                 status);
         /* TODO: maybe write pkg to an error queue ? */
-        INITSYNC_next_series_id(siridb);
+        INITSYNC_next(siridb);
         break;
     case PROMISE_SUCCESS:
         if (sirinet_protocol_is_error(pkg->tp))
@@ -478,7 +499,7 @@ static void INITSYNC_on_insert_response(
                     "(response type: %u)", pkg->tp);
             /* TODO: maybe write pkg to an error queue ? */
         }
-        INITSYNC_next_series_id(siridb);
+        INITSYNC_next(siridb);
         break;
     default:
         assert (0);
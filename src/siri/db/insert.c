@@ -13,15 +13,25 @@
 #include <logger/logger.h>
 #include <qpack/qpack.h>
 #include <siri/async.h>
+#include <siri/db/coalesce.h>
 #include <siri/db/forward.h>
+#include <siri/db/fifo.h>
+#include <siri/db/hot.h>
+#include <siri/db/hotlog.h>
 #include <siri/db/insert.h>
 #include <siri/db/points.h>
 #include <siri/db/replicate.h>
 #include <siri/db/series.h>
+#include <siri/db/shash.h>
+#include <siri/db/subscribe.h>
 #include <siri/err.h>
+#include <siri/fsync.h>
+#include <siri/loop.h>
+#include <siri/mem.h>
 #include <siri/net/promises.h>
 #include <siri/net/protocol.h>
 #include <siri/net/socket.h>
+#include <siri/sched.h>
 #include <siri/siri.h>
 #include <stdio.h>
 #include <string.h>
@@ -31,6 +41,30 @@
 #define INSERT_AT_ONCE 3000    // one point counts as 1, a series as 100
 #define WEIGHT_SERIES 50
 #define WEIGHT_NEW_SERIES 100
+#define BUSY_RETRY_MIN 100      // milliseconds
+#define BUSY_RETRY_MAX 10000    // milliseconds
+
+typedef struct
+{
+    siridb_series_t * series;
+    char * pt;                      /* start of the points in the package */
+    uint8_t done;                   /* 1 when the points are added */
+} insert_job_t;
+
+typedef struct
+{
+    siridb_t * siridb;
+    insert_job_t * jobs;
+    size_t n;
+    char * end;                     /* end of the package */
+    uint16_t nthreads;
+} insert_work_t;
+
+typedef struct
+{
+    insert_work_t * work;
+    uint16_t nr;                    /* jobs for series with id % nthreads */
+} insert_worker_t;
 
 #define SERIES_UPDATE_TS(series)    \
 if (*ts < series->start)            \
@@ -44,8 +78,14 @@ if (*ts > series->end)              \
 
 static void INSERT_free(uv_handle_t * handle);
 static void INSERT_points_to_pools(uv_async_t * handle);
+static void INSERT_pools_step(uv_async_t * handle);
 static void INSERT_on_response(slist_t * promises, uv_async_t * handle);
 static uint16_t INSERT_get_pool(siridb_t * siridb, qp_obj_t * qp_series_name);
+static inline siridb_series_t * INSERT_get_series(
+        siridb_t * siridb,
+        siridb_shash_key_t * key,
+        const char * name,
+        size_t len);
 
 static void INSERT_local_free_cb(uv_async_t * handle);
 static int8_t INSERT_local_work(
@@ -59,7 +99,24 @@ static int INSERT_local_work_test(
         qp_obj_t * qp_series_name,
         siridb_pcache_t ** pcache,
         siridb_forward_t ** forward);
+static int8_t INSERT_local_work_threaded(
+        siridb_t * siridb,
+        qp_unpacker_t * unpacker,
+        qp_obj_t * qp_series_name,
+        siridb_pcache_t ** pcache);
+static void INSERT_local_worker(void * arg);
+static int INSERT_unpack_pcache(
+        qp_unpacker_t * unpacker,
+        siridb_series_t * series,
+        siridb_pcache_t * pcache,
+        qp_obj_t * qp_series_name);
+static int INSERT_read_pcache(
+        qp_unpacker_t * unpacker,
+        siridb_series_t * series,
+        siridb_pcache_t ** pcache,
+        qp_obj_t * qp_series_name);
 static void INSERT_local_task(uv_async_t * handle);
+static void INSERT_local_step(uv_async_t * handle);
 static void INSERT_local_promise_cb(
         sirinet_promise_t * promise,
         sirinet_pkg_t * pkg,
@@ -101,6 +158,9 @@ const char * siridb_insert_err_msg(siridb_insert_err_t err)
 {
     switch (err)
     {
+    case ERR_EXPECTING_COLUMNS:
+        return  "Expecting a series name with an array containing the value "
+                "type, the time-stamps and the values.";
     case ERR_EXPECTING_ARRAY:
         return  "Expecting an array with points.";
     case ERR_EXPECTING_SERIES_NAME:
@@ -134,6 +194,12 @@ const char * siridb_insert_err_msg(siridb_insert_err_t err)
  */
 void siridb_insert_free(siridb_insert_t * insert)
 {
+    /* release the response slot when no response is sent */
+    if (insert->pending != NULL)
+    {
+        sirinet_socket_pending_done(insert->client, insert->pending, NULL);
+    }
+
     /* free packer */
     for (size_t n = 0; n < insert->packer_size; n++)
     {
@@ -151,6 +217,31 @@ void siridb_insert_free(siridb_insert_t * insert)
 #endif
 }
 
+/*
+ * Returns 0 when a new insert can be accepted or the time in milliseconds
+ * after which the client should retry when the server is overloaded. The
+ * time grows with the number of inserts in progress.
+ */
+uint32_t siridb_insert_busy(siridb_t * siridb)
+{
+    uint32_t retry_after;
+
+    if (    (   !siri.cfg->max_insert_queue ||
+                siridb->insert_queue < siri.cfg->max_insert_queue) &&
+            (   !siri.cfg->max_insert_queue_size ||
+                siridb->insert_queue_size <
+                    (size_t) siri.cfg->max_insert_queue_size * 1048576) &&
+            (   !siri.cfg->max_fifo_files ||
+                siridb_fifo_size(siridb->fifo) < siri.cfg->max_fifo_files))
+    {
+        return 0;
+    }
+
+    retry_after = BUSY_RETRY_MIN + siridb->insert_queue;
+
+    return (retry_after < BUSY_RETRY_MAX) ? retry_after : BUSY_RETRY_MAX;
+}
+
 /*
  * Returns a negative value in case of an error or a value equal to zero or
  * higher representing the number of points processed.
@@ -196,6 +287,115 @@ ssize_t siridb_insert_assign_pools(
     return (siri_err) ? ERR_MEM_ALLOC : rc;
 }
 
+/*
+ * Returns a negative value in case of an error or a value equal to zero or
+ * higher representing the number of points processed.
+ *
+ * Columns are expected as a map with for each series an array containing the
+ * value type (TP_INT or TP_DOUBLE), the time-stamps and the values. Both
+ * time-stamps and values are raw data with 8 bytes (little-endian) for each
+ * point. Except for the first time-stamp, each time-stamp is stored as the
+ * difference with the previous time-stamp.
+ *
+ * The columns are packed for the pools like other inserts so the rest of the
+ * insert is equal.
+ *
+ * This function can set a SIGNAL when not enough space in the packer can be
+ * allocated for the points and ERR_MEM_ALLOC will be the return value if this
+ * is the case.
+ */
+ssize_t siridb_insert_assign_columns(
+        siridb_t * siridb,
+        qp_unpacker_t * unpacker,
+        qp_packer_t * packer[])
+{
+    int tp;  /* use int instead of qp_types_t for negative values */
+    uint16_t pool;
+    ssize_t count = 0;
+    size_t i, n;
+    uint64_t ts;
+    int64_t delta;
+    qp_obj_t qp_series_name;
+    qp_obj_t qp_tp;
+    qp_obj_t qp_ts;
+    qp_obj_t qp_values;
+
+    if (!qp_is_map(qp_next(unpacker, NULL)))
+    {
+        return ERR_EXPECTING_MAP_OR_ARRAY;
+    }
+
+    tp = qp_next(unpacker, &qp_series_name);
+
+    while ( tp == QP_RAW &&
+            qp_series_name.len &&
+            qp_series_name.len < SIRIDB_SERIES_NAME_LEN_MAX)
+    {
+        if (    qp_next(unpacker, NULL) != QP_ARRAY3 ||
+                qp_next(unpacker, &qp_tp) != QP_INT64 ||
+                (qp_tp.via.int64 != TP_INT && qp_tp.via.int64 != TP_DOUBLE) ||
+                qp_next(unpacker, &qp_ts) != QP_RAW ||
+                qp_next(unpacker, &qp_values) != QP_RAW ||
+                qp_ts.len != qp_values.len ||
+                qp_ts.len % 8)
+        {
+            return ERR_EXPECTING_COLUMNS;
+        }
+
+        if (!(n = qp_ts.len / 8))
+        {
+            return ERR_EXPECTING_AT_LEAST_ONE_POINT;
+        }
+
+        pool = INSERT_get_pool(siridb, &qp_series_name);
+
+        qp_add_raw_term(packer[pool],
+                qp_series_name.via.raw,
+                qp_series_name.len);
+
+        qp_add_type(packer[pool], QP_ARRAY_OPEN);
+
+        for (i = 0, ts = 0; i < n; i++)
+        {
+            memcpy(&delta, qp_ts.via.raw + i * 8, 8);
+            ts += (uint64_t) delta;
+
+            if (!siridb_int64_valid_ts(siridb->time, (int64_t) ts))
+            {
+                return ERR_TIMESTAMP_OUT_OF_RANGE;
+            }
+
+            qp_add_type(packer[pool], QP_ARRAY2);
+            qp_add_int64(packer[pool], (int64_t) ts);
+
+            if (qp_tp.via.int64 == TP_INT)
+            {
+                int64_t value;
+                memcpy(&value, qp_values.via.raw + i * 8, 8);
+                qp_add_int64(packer[pool], value);
+            }
+            else
+            {
+                double value;
+                memcpy(&value, qp_values.via.raw + i * 8, 8);
+                qp_add_double(packer[pool], value);
+            }
+        }
+
+        qp_add_type(packer[pool], QP_ARRAY_CLOSE);
+
+        count += n;
+        tp = qp_next(unpacker, &qp_series_name);
+    }
+
+    if (tp != QP_END && tp != QP_MAP_CLOSE)
+    {
+        return ERR_EXPECTING_SERIES_NAME;
+    }
+
+    return (siri_err) ? ERR_MEM_ALLOC : count;
+}
+
 /*
  * Returns NULL and raises a SIGNAL in case an error has occurred.
  */
@@ -222,10 +422,15 @@ siridb_insert_t * siridb_insert_new(
 
         /* n-points will be set later to the correct value */
         insert->npoints = 0;
+        insert->size = 0;
 
         /* save PID and client so we can respond to the client */
+        insert->siridb = siridb;
         insert->pid = pid;
         insert->client = client;
+        insert->pending = NULL;
+
+        siri_latency_start(&insert->latency);
 
         /*
          * we keep the packer size because the number of pools might change and
@@ -270,12 +475,28 @@ int siridb_insert_points_to_pools(siridb_insert_t * insert, size_t npoints)
     /* bind the number of points to insert object */
     insert->npoints= npoints;
 
+    /* the insert is queued until all pools have responded */
+    siridb_t * siridb = insert->siridb;
+
+    for (size_t n = 0; n < insert->packer_size; n++)
+    {
+        insert->size += insert->packer[n]->len;
+    }
+    siridb->insert_queue++;
+    siridb->insert_queue_size += insert->size;
+    siri_sched_ingest_start();
+    siri_mem_add(SIRI_MEM_INSERT, sizeof(siridb_insert_t) + insert->size);
+
     /* increment the client reference counter */
-    sirinet_socket_incref(insert->client);
+    if (insert->client != NULL)
+    {
+        sirinet_socket_incref(insert->client);
+    }
 
     uv_async_init(siri.loop, handle, INSERT_points_to_pools);
     handle->data = (void *) insert;
 
+    siri_latency_queue(&insert->latency);
     uv_async_send(handle);
     return 0;
 }
@@ -320,6 +541,7 @@ int insert_init_backend_local(
     ilocal->status = INSERT_LOCAL_CANCELLED;
     ilocal->forward = NULL;
     ilocal->pcache = NULL;
+    siri_latency_start(&ilocal->latency);
 
     promise->pkg = sirinet_pkg_dup(pkg);
     if (promise->pkg == NULL)
@@ -338,7 +560,7 @@ int insert_init_backend_local(
     promise->cb = (sirinet_promise_cb) INSERT_local_promise_backend_cb;
     promise->pid = promise->pkg->pid;
     promise->ref = 1;
-    promise->timer = NULL;
+    promise->expire = 0;
     promise->server = NULL;
 
     handle->data = ilocal;
@@ -350,6 +572,7 @@ int insert_init_backend_local(
     siridb->insert_tasks++;
 
     uv_async_init(siri.loop, handle, INSERT_local_task);
+    siri_latency_queue(&ilocal->latency);
     uv_async_send(handle);
 
     return 0;
@@ -367,8 +590,7 @@ static void INSERT_on_response(slist_t * promises, uv_async_t * handle)
         sirinet_pkg_t * pkg;
         sirinet_promise_t * promise;
         siridb_insert_t * insert = (siridb_insert_t *) handle->data;
-        siridb_t * siridb =
-                ((sirinet_socket_t *) insert->client->data)->siridb;
+        siridb_t * siridb = insert->siridb;
 
         int n = 0;
         char msg[MAX_INSERT_MSG];
@@ -428,14 +650,34 @@ static void INSERT_on_response(slist_t * promises, uv_async_t * handle)
                 siridb->received_points += insert->npoints;
             }
 
-            qp_add_raw(packer, msg, (n < MAX_INSERT_MSG) ? n : MAX_INSERT_MSG);
-
-            sirinet_pkg_t * response_pkg = sirinet_packer2pkg(
-                    packer,
-                    insert->pid,
-                    tp);
-
-            sirinet_pkg_send((uv_stream_t *) insert->client, response_pkg);
+            if (insert->client == NULL)
+            {
+                /* an insert by the server itself has nobody to respond to */
+                if (tp == CPROTO_ERR_INSERT)
+                {
+                    log_error(msg);
+                }
+                qp_packer_free(packer);
+            }
+            else
+            {
+                qp_add_raw(
+                        packer,
+                        msg,
+                        (n < MAX_INSERT_MSG) ? n : MAX_INSERT_MSG);
+
+                sirinet_pkg_t * response_pkg = sirinet_packer2pkg(
+                        packer,
+                        insert->pid,
+                        tp);
+
+                /* responses are sent in the order the inserts are received */
+                sirinet_socket_pending_done(
+                        insert->client,
+                        insert->pending,
+                        response_pkg);
+                insert->pending = NULL;
+            }
         }
     }
 
@@ -469,6 +711,12 @@ static void INSERT_local_free_cb(uv_async_t * handle)
         }
     }
 
+    if (ilocal->promise->cb ==
+            (sirinet_promise_cb) INSERT_local_promise_backend_cb)
+    {
+        siri_latency_done(&ilocal->latency, SIRI_LATENCY_BACKEND_INSERT);
+    }
+
     ilocal->promise->cb(ilocal->promise, NULL, ilocal->status);
 
     ilocal->siridb->active_tasks--;
@@ -490,11 +738,14 @@ static int8_t INSERT_local_work(
         qp_obj_t * qp_series_name,
         siridb_pcache_t ** pcache)
 {
-    qp_types_t tp;
+    int tp;  /* use int instead of qp_types_t for negative values */
     siridb_series_t * series;
+    siridb_shash_key_t key;
     qp_obj_t qp_series_ts;
     qp_obj_t qp_series_val;
     uint64_t * ts;
+    char * pt;
+    uint64_t npoints;
     int n = INSERT_AT_ONCE;
 
     /*
@@ -507,9 +758,19 @@ static int8_t INSERT_local_work(
             qp_series_name->via.raw[0] != '\0' &&
             (n -= WEIGHT_SERIES) > 0)
     {
-        series = (siridb_series_t *) ct_get(
-            siridb->series,
-            qp_series_name->via.raw);
+        /* the length of a terminated raw name includes the terminator */
+        siridb_shash_key(
+                &key,
+                qp_series_name->via.raw,
+                qp_series_name->len - 1);
+        series = INSERT_get_series(
+                siridb,
+                &key,
+                qp_series_name->via.raw,
+                qp_series_name->len - 1);
+
+        /* start of the points, used for subscriptions */
+        pt = unpacker->pt;
 
         qp_next(unpacker, NULL); // array open
         qp_next(unpacker, NULL); // first point array2
@@ -546,7 +807,13 @@ static int8_t INSERT_local_work(
             return INSERT_LOCAL_ERROR;  /* signal is raised */
         }
 
-        if ((tp = qp_next(unpacker, qp_series_name)) == QP_ARRAY2)
+        npoints = 1;
+
+        if (qp_current(unpacker) != QP_ARRAY2)
+        {
+            tp = qp_next(unpacker, qp_series_name);
+        }
+        else
         {
             if (*pcache == NULL)
             {
@@ -562,25 +829,17 @@ static int8_t INSERT_local_work(
                 (*pcache)->len = 0;
             }
 
-            do
+            if ((tp = INSERT_unpack_pcache(
+                    unpacker,
+                    series,
+                    *pcache,
+                    qp_series_name)) < 0)
             {
-                qp_next(unpacker, &qp_series_ts); // ts
-                qp_next(unpacker, &qp_series_val); // val
-
-                ts = (uint64_t *) &qp_series_ts.via.int64;
-                SERIES_UPDATE_TS(series)
-
-                if (siridb_pcache_add_point(
-                        *pcache,
-                        ts,
-                        &qp_series_val.via))
-                {
-                    return INSERT_LOCAL_ERROR;  /* signal is raised */
-                }
-
-                n--;
+                return INSERT_LOCAL_ERROR;  /* signal is raised */
             }
-            while ((tp = qp_next(unpacker, qp_series_name)) == QP_ARRAY2);
+
+            n -= (*pcache)->len;
+            npoints += (*pcache)->len;
 
             if (siridb_series_add_pcache(
                     siridb,
@@ -591,6 +850,13 @@ static int8_t INSERT_local_work(
             }
         }
 
+        siridb_hot_add(siridb->hot, SIRIDB_HOT_INSERT, series->id, npoints);
+
+        if (siridb_subscribe_has(siridb))
+        {
+            siridb_subscribe_points(siridb, series, pt, unpacker->end);
+        }
+
 
         if (tp == QP_ARRAY_CLOSE)
         {
@@ -611,14 +877,16 @@ static int INSERT_local_work_test(
         siridb_pcache_t ** pcache,
         siridb_forward_t ** forward)
 {
-    qp_types_t tp;
+    int tp;  /* use int instead of qp_types_t for negative values */
     siridb_series_t * series;
+    siridb_shash_key_t key;
     uint16_t pool;
     uint64_t * ts;
     const char * series_name;
     char * pt;
     qp_obj_t qp_series_ts;
     qp_obj_t qp_series_val;
+    uint64_t npoints;
     int n = INSERT_AT_ONCE;
 
     /*
@@ -631,11 +899,16 @@ static int INSERT_local_work_test(
             (n -= WEIGHT_SERIES) > 0)
     {
         series_name = qp_series_name->via.raw;
-        series = (siridb_series_t *) ct_get(siridb->series, series_name);
+        siridb_shash_key(&key, series_name, qp_series_name->len - 1);
+        series = INSERT_get_series(
+                siridb,
+                &key,
+                series_name,
+                qp_series_name->len - 1);
         if (series == NULL)
         {
             /* the series does not exist so check what to do... */
-            pool = siridb_lookup_sn(siridb->pools->lookup, series_name);
+            pool = siridb_lookup_key(siridb->pools->lookup, &key);
 
             if (pool == siridb->server->pool)
             {
@@ -704,6 +977,9 @@ static int INSERT_local_work_test(
             }
         }
 
+        /* start of the points, used for subscriptions */
+        pt = unpacker->pt;
+
         qp_next(unpacker, NULL); // array open
         qp_next(unpacker, NULL); // first point array2
         qp_next(unpacker, &qp_series_ts); // first ts
@@ -721,7 +997,13 @@ static int INSERT_local_work_test(
             return INSERT_LOCAL_ERROR;  /* signal is raised */
         }
 
-        if ((tp = qp_next(unpacker, qp_series_name)) == QP_ARRAY2)
+        npoints = 1;
+
+        if (qp_current(unpacker) != QP_ARRAY2)
+        {
+            tp = qp_next(unpacker, qp_series_name);
+        }
+        else
         {
             if (*pcache == NULL)
             {
@@ -737,25 +1019,17 @@ static int INSERT_local_work_test(
                 (*pcache)->len = 0;
             }
 
-            do
+            if ((tp = INSERT_unpack_pcache(
+                    unpacker,
+                    series,
+                    *pcache,
+                    qp_series_name)) < 0)
             {
-                qp_next(unpacker, &qp_series_ts); // ts
-                qp_next(unpacker, &qp_series_val); // val
-
-                ts = (uint64_t *) &qp_series_ts.via.int64;
-                SERIES_UPDATE_TS(series)
-
-                if (siridb_pcache_add_point(
-                        *pcache,
-                        ts,
-                        &qp_series_val.via))
-                {
-                    return INSERT_LOCAL_ERROR;  /* signal is raised */
-                }
-
-                n--;
+                return INSERT_LOCAL_ERROR;  /* signal is raised */
             }
-            while ((tp = qp_next(unpacker, qp_series_name)) == QP_ARRAY2);
+
+            n -= (*pcache)->len;
+            npoints += (*pcache)->len;
 
             if (siridb_series_add_pcache(
                     siridb,
@@ -766,21 +1040,365 @@ static int INSERT_local_work_test(
             }
         }
 
+        siridb_hot_add(siridb->hot, SIRIDB_HOT_INSERT, series->id, npoints);
+
+        if (siridb_subscribe_has(siridb))
+        {
+            siridb_subscribe_points(siridb, series, pt, unpacker->end);
+        }
+
+        if (tp == QP_ARRAY_CLOSE)
+        {
+            qp_next(unpacker, qp_series_name);
+        }
+    }
+
+    return siri_err;  /* expected to be 0 */
+}
+
+/*
+ * Returns insert->status
+ *
+ * Like INSERT_local_work() but the points are added using
+ * siri.cfg->insert_threads threads. The series are first looked up or
+ * created by this thread. Each worker then adds the points for the series
+ * with (series id % number of threads) equal to the worker number, as long
+ * as the points fit in the series buffer. Since a series has its own region
+ * in the mapped buffer file the workers do not share any data. Points which
+ * cause the buffer to be written to the shards are left to this thread and
+ * are added when all workers are finished.
+ */
+static int8_t INSERT_local_work_threaded(
+        siridb_t * siridb,
+        qp_unpacker_t * unpacker,
+        qp_obj_t * qp_series_name,
+        siridb_pcache_t ** pcache)
+{
+    qp_types_t tp;
+    siridb_series_t * series;
+    siridb_shash_key_t key;
+    qp_obj_t qp_series_val;
+    qp_unpacker_t job_unpacker;
+    insert_job_t * job;
+    uint16_t nthreads = siri.cfg->insert_threads;
+    uint16_t i;
+    uint64_t npoints;
+    int n = INSERT_AT_ONCE * nthreads;
+    insert_work_t work = {
+            .siridb=siridb,
+            .jobs=(insert_job_t *) malloc(
+                    (n / WEIGHT_SERIES + 1) * sizeof(insert_job_t)),
+            .n=0,
+            .end=unpacker->end,
+            .nthreads=nthreads};
+
+    if (work.jobs == NULL)
+    {
+        ERR_ALLOC
+        return INSERT_LOCAL_ERROR;
+    }
+
+    while ( !siri_err &&
+            qp_is_raw_term(qp_series_name) &&
+            qp_series_name->via.raw[0] != '\0' &&
+            (n -= WEIGHT_SERIES) > 0)
+    {
+        siridb_shash_key(
+                &key,
+                qp_series_name->via.raw,
+                qp_series_name->len - 1);
+        series = INSERT_get_series(
+                siridb,
+                &key,
+                qp_series_name->via.raw,
+                qp_series_name->len - 1);
+
+        job = work.jobs + work.n;
+        job->pt = unpacker->pt;
+        job->done = 0;
+
+        qp_next(unpacker, NULL); // array open
+        qp_next(unpacker, NULL); // first point array2
+        qp_next(unpacker, NULL); // first ts
+        qp_next(unpacker, &qp_series_val); // first val
+
+        if (series == NULL)
+        {
+            series = siridb_series_new(
+                    siridb,
+                    qp_series_name->via.raw,
+                    SIRIDB_QP_MAP2_TP(qp_series_val.tp));
+
+            if (series == NULL)
+            {
+                log_critical(
+                        "Error creating series: '%s'",
+                        qp_series_name->via.raw);
+                free(work.jobs);
+                return INSERT_LOCAL_ERROR;  /* signal is raised */
+            }
+
+            n -= WEIGHT_NEW_SERIES;
+        }
+
+        job->series = series;
+        work.n++;
+        npoints = 1;
+
+        /* skip the other points, these are read by the workers */
+        while ((tp = qp_next(unpacker, qp_series_name)) == QP_ARRAY2)
+        {
+            qp_next(unpacker, NULL); // ts
+            qp_next(unpacker, NULL); // val
+            n--;
+            npoints++;
+        }
+
+        siridb_hot_add(siridb->hot, SIRIDB_HOT_INSERT, series->id, npoints);
+
         if (tp == QP_ARRAY_CLOSE)
         {
             qp_next(unpacker, qp_series_name);
         }
     }
 
+    /* never start more threads than we have series */
+    if (work.nthreads > work.n)
+    {
+        work.nthreads = work.n;
+    }
+
+    if (!siri_err && work.nthreads)
+    {
+        uv_thread_t threads[work.nthreads];
+        insert_worker_t workers[work.nthreads];
+
+        for (i = 0; i < work.nthreads; i++)
+        {
+            workers[i].work = &work;
+            workers[i].nr = i;
+        }
+
+        for (i = 1; i < work.nthreads; i++)
+        {
+            if (uv_thread_create(
+                    &threads[i],
+                    INSERT_local_worker,
+                    &workers[i]))
+            {
+                /* the remaining jobs are added by this thread */
+                log_error("Cannot create thread for inserting points");
+                break;
+            }
+        }
+
+        /* this thread is the first worker */
+        INSERT_local_worker(&workers[0]);
+
+        while (--i)
+        {
+            uv_thread_join(&threads[i]);
+        }
+    }
+
+    /* add the points which are not added by a worker */
+    for (size_t j = 0; !siri_err && j < work.n; j++)
+    {
+        job = work.jobs + j;
+
+        if (job->done)
+        {
+            continue;
+        }
+
+        qp_unpacker_init(&job_unpacker, job->pt, work.end - job->pt);
+
+        if (    INSERT_read_pcache(
+                    &job_unpacker,
+                    job->series,
+                    pcache,
+                    &qp_series_val) ||
+                siridb_series_add_pcache(siridb, job->series, *pcache))
+        {
+            break;  /* signal is raised */
+        }
+    }
+
+    if (!siri_err && siridb_subscribe_has(siridb))
+    {
+        for (size_t j = 0; j < work.n; j++)
+        {
+            job = work.jobs + j;
+            siridb_subscribe_points(siridb, job->series, job->pt, work.end);
+        }
+    }
+
+    free(work.jobs);
+
     return siri_err;  /* expected to be 0 */
 }
 
+/*
+ * Add the points of the jobs for this worker which fit in the series buffer.
+ */
+static void INSERT_local_worker(void * arg)
+{
+    insert_worker_t * worker = (insert_worker_t *) arg;
+    insert_work_t * work = worker->work;
+    siridb_pcache_t * pcache = NULL;
+    qp_unpacker_t unpacker;
+    qp_obj_t qp_obj;
+    insert_job_t * job;
+    int rc;
+
+    for (size_t i = 0; !siri_err && i < work->n; i++)
+    {
+        job = work->jobs + i;
+
+        if (job->series->id % work->nthreads != worker->nr)
+        {
+            continue;
+        }
+
+        qp_unpacker_init(&unpacker, job->pt, work->end - job->pt);
+
+        if (    INSERT_read_pcache(&unpacker, job->series, &pcache, &qp_obj) ||
+                (rc = siridb_series_add_pcache_buffered(
+                        work->siridb,
+                        job->series,
+                        pcache)) < 0)
+        {
+            break;  /* signal is raised */
+        }
+
+        job->done = rc;
+    }
+
+    if (pcache != NULL)
+    {
+        siridb_pcache_free(pcache);
+    }
+}
+
+/*
+ * Append the points at the current position of the unpacker, starting with
+ * the QP_ARRAY2 of a point, to 'pcache' and update the start and end of the
+ * series. Points with an integer or double value are unpacked in runs, other
+ * points one by one. The object after the last point is read into
+ * 'qp_series_name'.
+ *
+ * Returns the type of this object or -1 and a SIGNAL is raised in case of an
+ * error.
+ */
+static int INSERT_unpack_pcache(
+        qp_unpacker_t * unpacker,
+        siridb_series_t * series,
+        siridb_pcache_t * pcache,
+        qp_obj_t * qp_series_name)
+{
+    qp_types_t tp;
+    qp_obj_t qp_series_ts;
+    qp_obj_t qp_series_val;
+    uint64_t * ts;
+    size_t i;
+
+    while (1)
+    {
+        i = pcache->len;
+
+        if (siridb_pcache_unpack_points(pcache, unpacker))
+        {
+            return -1;  /* signal is raised */
+        }
+
+        for (; i < pcache->len; i++)
+        {
+            ts = &pcache->data[i].ts;
+            SERIES_UPDATE_TS(series)
+        }
+
+        if ((tp = qp_next(unpacker, qp_series_name)) != QP_ARRAY2)
+        {
+            return tp;
+        }
+
+        qp_next(unpacker, &qp_series_ts); // ts
+        qp_next(unpacker, &qp_series_val); // val
+
+        ts = (uint64_t *) &qp_series_ts.via.int64;
+        SERIES_UPDATE_TS(series)
+
+        if (siridb_pcache_append_point(pcache, ts, &qp_series_val.via))
+        {
+            return -1;  /* signal is raised */
+        }
+    }
+}
+
+/*
+ * Read all points for a series in pcache. The unpacker should be at the start
+ * of the points and 'qp_series_name' is set to the next object, which is the
+ * next series name in case there is one.
+ *
+ * Returns 0 if successful or -1 and a SIGNAL is raised in case of an error.
+ */
+static int INSERT_read_pcache(
+        qp_unpacker_t * unpacker,
+        siridb_series_t * series,
+        siridb_pcache_t ** pcache,
+        qp_obj_t * qp_series_name)
+{
+    int tp;  /* use int instead of qp_types_t for negative values */
+
+    if (*pcache == NULL)
+    {
+        *pcache = siridb_pcache_new(series->tp);
+        if (*pcache == NULL)
+        {
+            return -1;  /* signal is raised */
+        }
+    }
+    else
+    {
+        (*pcache)->tp = series->tp;
+        (*pcache)->len = 0;
+    }
+
+    qp_next(unpacker, NULL); // array open
+
+    if ((tp = INSERT_unpack_pcache(
+            unpacker,
+            series,
+            *pcache,
+            qp_series_name)) < 0)
+    {
+        return -1;  /* signal is raised */
+    }
+
+    if (tp == QP_ARRAY_CLOSE)
+    {
+        qp_next(unpacker, qp_series_name);
+    }
+
+    return 0;
+}
+
 static void INSERT_local_task(uv_async_t * handle)
 {
+    siri_loop_frame_t frame;
+
+    siri_loop_enter(&frame);
+    INSERT_local_step(handle);
+    siri_loop_done(SIRI_LOOP_INSERT, &frame);
+}
 
+static void INSERT_local_step(uv_async_t * handle)
+{
     siridb_insert_local_t * ilocal = (siridb_insert_local_t *) handle->data;
     qp_unpacker_t * unpacker = &ilocal->unpacker;
 
+    siri_latency_dequeue(&ilocal->latency);
+
     /*
      * we check for siri_err because siridb_series_add_point()
      * should never be called twice on the same series after an
@@ -796,6 +1414,9 @@ static void INSERT_local_task(uv_async_t * handle)
     {
         ilocal->status = INSERT_LOCAL_SUCESS;
         uv_close((uv_handle_t *) handle, siri_async_close);
+
+        /* in 'bytes' mode, written files are synced here */
+        siri_fsync_insert_done();
         return;
     }
 
@@ -817,8 +1438,8 @@ static void INSERT_local_task(uv_async_t * handle)
         return;
     }
 
-    uv_mutex_lock(&siridb->series_mutex);
-    uv_mutex_lock(&siridb->shards_mutex);
+    siri_rwlock_wrlock(&siridb->series_mutex);
+    siri_mutex_lock(&siridb->shards_mutex);
 
     if ((ilocal->flags & INSERT_FLAG_TEST) || (
             (siridb->flags & SIRIDB_FLAG_REINDEXING) &&
@@ -838,6 +1459,18 @@ static void INSERT_local_task(uv_async_t * handle)
             ilocal->status = INSERT_LOCAL_ERROR;
         }
     }
+    else if (siri.cfg->insert_threads > 1 && siridb->buffer_map != NULL)
+    {
+        /* siri_err is raised in case of an error */
+        if (INSERT_local_work_threaded(
+                siridb,
+                unpacker,
+                &ilocal->qp_series_name,
+                &ilocal->pcache))
+        {
+            ilocal->status = INSERT_LOCAL_ERROR;
+        }
+    }
     else
     {
         /* siri_err is raised in case of an error */
@@ -850,8 +1483,21 @@ static void INSERT_local_task(uv_async_t * handle)
             ilocal->status = INSERT_LOCAL_ERROR;
         }
     }
-    uv_mutex_unlock(&siridb->series_mutex);
-    uv_mutex_unlock(&siridb->shards_mutex);
+
+    /* new series are flushed to the store once for each insert */
+    if (siridb_series_commit(siridb))
+    {
+        ilocal->status = INSERT_LOCAL_ERROR;
+    }
+
+    /* points for hot series are written to the disk once for each insert */
+    if (siridb_hotlog_is_open(siridb) && siridb_hotlog_commit(siridb))
+    {
+        ilocal->status = INSERT_LOCAL_ERROR;
+    }
+
+    siri_rwlock_wrunlock(&siridb->series_mutex);
+    siri_mutex_unlock(&siridb->shards_mutex);
 
     uv_async_send(handle);
 }
@@ -948,6 +1594,7 @@ static int INSERT_init_local(
     ilocal->status = INSERT_LOCAL_CANCELLED;
     ilocal->forward = NULL;
     ilocal->pcache = NULL;
+    siri_latency_start(&ilocal->latency);
 
     promise->pkg = pkg;
     promise->data = promises;
@@ -956,7 +1603,7 @@ static int INSERT_init_local(
     promise->cb = (sirinet_promise_cb) INSERT_local_promise_cb;
     promise->pid = 0;
     promise->ref = 1;
-    promise->timer = NULL;
+    promise->expire = 0;
 
     handle->data = ilocal;
 
@@ -966,6 +1613,7 @@ static int INSERT_init_local(
     siridb->active_tasks++;
     siridb->insert_tasks++;
     uv_async_init(siri.loop, handle, INSERT_local_task);
+    siri_latency_queue(&ilocal->latency);
     uv_async_send(handle);
 
     return 0;
@@ -980,12 +1628,25 @@ static int INSERT_init_local(
  * be send to the client.
  */
 static void INSERT_points_to_pools(uv_async_t * handle)
+{
+    siri_loop_frame_t frame;
+
+    siri_loop_enter(&frame);
+    INSERT_pools_step(handle);
+    siri_loop_done(SIRI_LOOP_INSERT, &frame);
+}
+
+static void INSERT_pools_step(uv_async_t * handle)
 {
     siridb_insert_t * insert = (siridb_insert_t *) handle->data;
-    siridb_t * siridb = ((sirinet_socket_t *) insert->client->data)->siridb;
+    siridb_t * siridb = insert->siridb;
     uint16_t pool = siridb->server->pool;
     sirinet_pkg_t * pkg, * repl_pkg;
-    sirinet_promises_t * promises = sirinet_promises_new(
+    sirinet_promises_t * promises;
+
+    siri_latency_dequeue(&insert->latency);
+
+    promises = sirinet_promises_new(
             siridb->pools->len,
             (sirinet_promises_cb) INSERT_on_response,
             handle,
@@ -1049,6 +1710,20 @@ static void INSERT_points_to_pools(uv_async_t * handle)
                 pool_count++;
             }
         }
+        else if (siri.cfg->insert_coalesce_window)
+        {
+            /* the packer is destroyed, also in case of an error */
+            if (siridb_coalesce_add(
+                    siridb,
+                    n,
+                    (insert->flags & INSERT_FLAG_TEST) ?
+                            BPROTO_INSERT_TEST_POOL : BPROTO_INSERT_POOL,
+                    insert->packer[n],
+                    promises) == 0)
+            {
+                pool_count++;
+            }
+        }
         else
         {
             pkg = sirinet_packer2pkg(
@@ -1091,19 +1766,21 @@ static void INSERT_points_to_pools(uv_async_t * handle)
 static uint16_t INSERT_get_pool(siridb_t * siridb, qp_obj_t * qp_series_name)
 {
     uint16_t pool;
+    siridb_shash_key_t key;
+
+    /* the key is created once and used for both the pool and series */
+    siridb_shash_key(&key, qp_series_name->via.raw, qp_series_name->len);
 
     if (~siridb->flags & SIRIDB_FLAG_REINDEXING)
     {
         /* when not re-indexing, select the correct pool */
-        pool = siridb_lookup_sn_raw(
-                siridb->pools->lookup,
-                qp_series_name->via.raw,
-                qp_series_name->len);
+        pool = siridb_lookup_key(siridb->pools->lookup, &key);
     }
     else
     {
-        if (ct_getn(
-                siridb->series,
+        if (INSERT_get_series(
+                siridb,
+                &key,
                 qp_series_name->via.raw,
                 qp_series_name->len) != NULL)
         {
@@ -1125,23 +1802,34 @@ static uint16_t INSERT_get_pool(siridb_t * siridb, qp_obj_t * qp_series_name)
 #ifdef DEBUG
             assert (siridb->pools->prev_lookup != NULL);
 #endif
-            pool = siridb_lookup_sn_raw(
-                    siridb->pools->prev_lookup,
-                    qp_series_name->via.raw,
-                    qp_series_name->len);
+            pool = siridb_lookup_key(siridb->pools->prev_lookup, &key);
 
             if (pool == siridb->server->pool)
             {
-                pool = siridb_lookup_sn_raw(
-                        siridb->pools->lookup,
-                        qp_series_name->via.raw,
-                        qp_series_name->len);
+                pool = siridb_lookup_key(siridb->pools->lookup, &key);
             }
         }
     }
     return pool;
 }
 
+/*
+ * Returns the series or NULL when not found. The hash index is used when
+ * enabled, otherwise the series tree.
+ *
+ * Note: 'name' does not need to be terminated.
+ */
+static inline siridb_series_t * INSERT_get_series(
+        siridb_t * siridb,
+        siridb_shash_key_t * key,
+        const char * name,
+        size_t len)
+{
+    return (siridb_shash_is_used(siridb->shash)) ?
+            siridb_shash_get(siridb->shash, key, name, len) :
+            (siridb_series_t *) ct_getn(siridb->series, name, len);
+}
+
 /*
  * Returns a negative value in case of an error or a value equal to zero or
  * higher representing the number of points processed.
@@ -1298,6 +1986,8 @@ static int INSERT_read_points(
         ssize_t * count)
 {
     qp_types_t tp;
+    const char * start;
+    const char * end;
 
     if (!qp_is_array(qp_next(unpacker, NULL)))
     {
@@ -1306,6 +1996,13 @@ static int INSERT_read_points(
 
     qp_add_type(packer, QP_ARRAY_OPEN);
 
+    /*
+     * The points are only validated here. Each point is an array with two
+     * values and can be copied as it is, so all points are written to the
+     * packer at once instead of packing each value again.
+     */
+    start = end = unpacker->pt;
+
     if ((tp = qp_next(unpacker, NULL)) != QP_ARRAY2)
     {
         return ERR_EXPECTING_AT_LEAST_ONE_POINT;
@@ -1313,8 +2010,6 @@ static int INSERT_read_points(
 
     for (; tp == QP_ARRAY2; (*count)++, tp = qp_next(unpacker, qp_obj))
     {
-        qp_add_type(packer, QP_ARRAY2);
-
         if (qp_next(unpacker, qp_obj) != QP_INT64)
         {
             return ERR_EXPECTING_INTEGER_TS;
@@ -1325,8 +2020,6 @@ static int INSERT_read_points(
             return ERR_TIMESTAMP_OUT_OF_RANGE;
         }
 
-        qp_add_int64(packer, qp_obj->via.int64);
-
         switch (qp_next(unpacker, qp_obj))
         {
         case QP_RAW:
@@ -1336,18 +2029,19 @@ static int INSERT_read_points(
 //            break;
 
         case QP_INT64:
-            qp_add_int64(packer, qp_obj->via.int64);
-            break;
-
         case QP_DOUBLE:
-            qp_add_double(packer, qp_obj->via.real);
             break;
 
         default:
             return ERR_UNSUPPORTED_VALUE;
         }
+
+        /* end of the last valid point */
+        end = unpacker->pt;
     }
 
+    qp_packer_extend_mem(packer, start, end - start);
+
     if (tp == QP_ARRAY_CLOSE)
     {
         tp = qp_next(unpacker, qp_obj);
@@ -1364,13 +2058,25 @@ static int INSERT_read_points(
 static void INSERT_free(uv_handle_t * handle)
 {
     siridb_insert_t * insert = (siridb_insert_t *) handle->data;
+    uv_stream_t * client = insert->client;
+    siridb_t * siridb = insert->siridb;
 
-    /* decrement the client reference counter */
-    sirinet_socket_decref(insert->client);
+    siridb->insert_queue--;
+    siridb->insert_queue_size -= insert->size;
+    siri_mem_sub(SIRI_MEM_INSERT, sizeof(siridb_insert_t) + insert->size);
+    siri_sched_ingest_done();
 
-    /* free insert */
+    siri_latency_done(&insert->latency, SIRI_LATENCY_INSERT);
+
+    /* free insert, this might release the response slot on the client */
     siridb_insert_free(insert);
 
+    /* decrement the client reference counter */
+    if (client != NULL)
+    {
+        sirinet_socket_decref(client);
+    }
+
     /* free handle */
     free((uv_async_t *) handle);
 
@@ -10,6 +10,7 @@
  *
  */
 #include <siri/db/lookup.h>
+#include <siri/db/shash.h>
 #include <siri/err.h>
 #include <stdlib.h>
 #include <string.h>
@@ -19,12 +20,7 @@
  */
 uint16_t siridb_lookup_sn(siridb_lookup_t * lookup, const char * sn)
 {
-    uint32_t n = 0;
-    for (; *sn; sn++)
-    {
-        n += *sn;
-    }
-    return (*lookup)[n % SIRIDB_LOOKUP_SZ];
+    return siridb_lookup_sn_raw(lookup, sn, strlen(sn));
 }
 
 /*
@@ -35,20 +31,22 @@ uint16_t siridb_lookup_sn_raw(
         const char * sn,
         size_t len)
 {
-    uint32_t n = 0;
-    while (len--)
-    {
-        n += sn[len];
-    }
-    return (*lookup)[n % SIRIDB_LOOKUP_SZ];
+    siridb_shash_key_t key;
+    siridb_shash_key(&key, sn, len);
+    return siridb_lookup_key(lookup, &key);
 }
 
 /*
  * Returns NULL and raises a SIGNAL in case an error has occurred.
  *
  * (Algorithm to create pools lookup array.)
+ *
+ * Each time a pool is added, every m-th slot of each existing pool is moved
+ * to the new pool. Therefore only the series in about 1/m of the slots move
+ * when a pool is added. The hash only decides how names are spread over the
+ * slots and never changes for an existing database.
  */
-siridb_lookup_t * siridb_lookup_new(uint_fast16_t num_pools)
+siridb_lookup_t * siridb_lookup_new(uint_fast16_t num_pools, uint8_t hash)
 {
     siridb_lookup_t * lookup =
             (siridb_lookup_t *) calloc(1, sizeof(siridb_lookup_t));
@@ -62,6 +60,8 @@ siridb_lookup_t * siridb_lookup_new(uint_fast16_t num_pools)
         uint_fast16_t n, i, m;
         uint_fast16_t counters[num_pools - 1];
 
+        lookup->hash = hash;
+
         for (n = 1, m = 2; n < num_pools; n++, m++)
         {
             for (i = 0; i < n; i++)
@@ -71,9 +71,9 @@ siridb_lookup_t * siridb_lookup_new(uint_fast16_t num_pools)
 
             for (i = 0; i < SIRIDB_LOOKUP_SZ; i++)
             {
-                if (++counters[ (*lookup)[i] ] % m == 0)
+                if (++counters[ lookup->pool[i] ] % m == 0)
                 {
-                    (*lookup)[i] = n;
+                    lookup->pool[i] = n;
                 }
             }
         }
@@ -89,4 +89,12 @@ void siridb_lookup_free(siridb_lookup_t * lookup)
     free(lookup);
 }
 
-
+const char * siridb_lookup_hash_str(uint8_t hash)
+{
+    switch (hash)
+    {
+    case SIRIDB_LOOKUP_HASH_SUM: return "sum";
+    case SIRIDB_LOOKUP_HASH_FNV: return "fnv";
+    default: return "unknown";
+    }
+}
@@ -0,0 +1,252 @@
+/*
+ * mcache.c - Cache for series matched by regular expressions.
+ *
+ * author       : Jeroen van der Heijden
+ * email        : jeroen@transceptor.technology
+ * copyright    : 2016, Transceptor Technology
+ *
+ * Dashboards select the same regular expressions over and over again while
+ * the series in the database hardly change. This cache holds the ids of the
+ * series which matched an expression so the names do not need to be matched
+ * again.
+ *
+ * Entries are identified by the regular expression, including the slashes
+ * and flags. An entry is only valid when no series is created or dropped
+ * since the entry was made, which is checked with the series generation of
+ * the database.
+ *
+ * The cache is only used by the main thread. When the cache is full the
+ * least recently used entries are removed.
+ *
+ * changes
+ *  - initial version, 14-10-2016
+ *
+ */
+#include <logger/logger.h>
+#include <siri/db/mcache.h>
+#include <siri/db/series.h>
+#include <siri/err.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MCACHE_ENTRY_SZ(entry)          \
+    (sizeof(siridb_mcache_entry_t) +    \
+    strlen((entry)->key) + 1 +          \
+    (entry)->n * sizeof(uint32_t))
+
+static void MCACHE_entry_free(siridb_mcache_entry_t * entry);
+static void MCACHE_unlink(
+        siridb_mcache_t * mcache,
+        siridb_mcache_entry_t * entry);
+
+/*
+ * Returns NULL and raises a SIGNAL in case an error has occurred.
+ */
+siridb_mcache_t * siridb_mcache_new(size_t max_size)
+{
+    siridb_mcache_t * mcache =
+            (siridb_mcache_t *) calloc(1, sizeof(siridb_mcache_t));
+    if (mcache == NULL)
+    {
+        ERR_ALLOC
+    }
+    else
+    {
+        mcache->max_size = max_size;
+        mcache->entries = ct_new();
+        if (mcache->entries == NULL)
+        {
+            ERR_ALLOC
+            free(mcache);
+            mcache = NULL;
+        }
+    }
+    return mcache;
+}
+
+void siridb_mcache_free(siridb_mcache_t * mcache)
+{
+    if (mcache == NULL)
+    {
+        return;
+    }
+
+    ct_free(mcache->entries, (ct_free_cb) &MCACHE_entry_free);
+    free(mcache);
+}
+
+/*
+ * Returns the cached entry for the regular expression 'key' with length
+ * 'len' or NULL when not found or when series are created or dropped after
+ * the entry was made. Stale entries are removed from the cache.
+ */
+siridb_mcache_entry_t * siridb_mcache_get(
+        siridb_mcache_t * mcache,
+        const char * key,
+        size_t len,
+        uint64_t gen)
+{
+    siridb_mcache_entry_t * entry =
+            (siridb_mcache_entry_t *) ct_getn(mcache->entries, key, len);
+
+    if (entry == NULL)
+    {
+        mcache->misses++;
+        return NULL;
+    }
+
+    if (entry->gen != gen)
+    {
+        MCACHE_unlink(mcache, entry);
+        MCACHE_entry_free(entry);
+        mcache->misses++;
+        return NULL;
+    }
+
+    /* move the entry to the head of the list */
+    if (entry != mcache->head)
+    {
+        entry->prev->next = entry->next;
+        if (entry->next == NULL)
+        {
+            mcache->tail = entry->prev;
+        }
+        else
+        {
+            entry->next->prev = entry->prev;
+        }
+        entry->prev = NULL;
+        entry->next = mcache->head;
+        mcache->head->prev = entry;
+        mcache->head = entry;
+    }
+
+    mcache->hits++;
+    return entry;
+}
+
+/*
+ * Store the series in 'slist' as the result for the regular expression
+ * 'key' with length 'len'. The 'gen' should be the series generation of the
+ * database from before the series were matched. Argument 'slist' must
+ * contain the matching series, sorted by id.
+ *
+ * An existing entry for the same key is replaced. Least recently used
+ * entries are removed to make room. The cache is not critical so when
+ * allocating memory fails the result is simply not cached.
+ */
+void siridb_mcache_set(
+        siridb_mcache_t * mcache,
+        const char * key,
+        size_t len,
+        uint64_t gen,
+        slist_t * slist)
+{
+    siridb_mcache_entry_t * entry, * tmp;
+    size_t size;
+
+    size = sizeof(siridb_mcache_entry_t) + len + 1 +
+            slist->len * sizeof(uint32_t);
+    if (size > mcache->max_size)
+    {
+        return;
+    }
+
+    entry = (siridb_mcache_entry_t *) malloc(sizeof(siridb_mcache_entry_t));
+    if (entry == NULL)
+    {
+        return;
+    }
+
+    entry->gen = gen;
+    entry->n = slist->len;
+    entry->prev = NULL;
+    entry->next = NULL;
+    entry->key = strndup(key, len);
+    entry->ids = (uint32_t *) malloc(slist->len * sizeof(uint32_t));
+
+    if (entry->key == NULL || (entry->ids == NULL && slist->len))
+    {
+        log_error("Cannot allocate an entry for the match cache");
+        MCACHE_entry_free(entry);
+        return;
+    }
+
+    for (size_t i = 0; i < slist->len; i++)
+    {
+        entry->ids[i] = ((siridb_series_t *) slist->data[i])->id;
+    }
+
+    tmp = (siridb_mcache_entry_t *) ct_get(mcache->entries, entry->key);
+    if (tmp != NULL)
+    {
+        MCACHE_unlink(mcache, tmp);
+        MCACHE_entry_free(tmp);
+    }
+
+    while (mcache->size + size > mcache->max_size)
+    {
+        tmp = mcache->tail;
+        MCACHE_unlink(mcache, tmp);
+        MCACHE_entry_free(tmp);
+    }
+
+    if (ct_add(mcache->entries, entry->key, entry))
+    {
+        MCACHE_entry_free(entry);
+        return;
+    }
+
+    entry->next = mcache->head;
+    if (mcache->head == NULL)
+    {
+        mcache->tail = entry;
+    }
+    else
+    {
+        mcache->head->prev = entry;
+    }
+    mcache->head = entry;
+
+    mcache->size += size;
+}
+
+static void MCACHE_entry_free(siridb_mcache_entry_t * entry)
+{
+    if (entry != NULL)
+    {
+        free(entry->key);
+        free(entry->ids);
+        free(entry);
+    }
+}
+
+/*
+ * Remove an entry from the lookup and the list but do not free the entry.
+ */
+static void MCACHE_unlink(
+        siridb_mcache_t * mcache,
+        siridb_mcache_entry_t * entry)
+{
+    ct_pop(mcache->entries, entry->key);
+
+    if (entry->prev == NULL)
+    {
+        mcache->head = entry->next;
+    }
+    else
+    {
+        entry->prev->next = entry->next;
+    }
+
+    if (entry->next == NULL)
+    {
+        mcache->tail = entry->prev;
+    }
+    else
+    {
+        entry->next->prev = entry->prev;
+    }
+
+    mcache->size -= MCACHE_ENTRY_SZ(entry);
+}
@@ -0,0 +1,141 @@
+/*
+ * names.c - Append-only storage for series names.
+ *
+ * author       : Jeroen van der Heijden
+ * email        : jeroen@transceptor.technology
+ * copyright    : 2016, Transceptor Technology
+ *
+ * With millions of series, a malloc() for each series name costs a header
+ * and padding for each name and spreads the names over the heap. Names are
+ * therefore appended to large chunks instead.
+ *
+ * A chunk counts the names which are still in use, plus one while it is the
+ * current chunk for new names. The chunk is freed when the last name is
+ * released, so the memory of dropped series is returned in bulk. Names can
+ * be released by any thread but must be added by a single thread.
+ *
+ * changes
+ *  - initial version, 14-10-2016
+ *
+ */
+#include <assert.h>
+#include <siri/db/names.h>
+#include <siri/db/series.h>
+#include <siri/err.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct siridb_names_chunk_s
+{
+    uint32_t ref;       /* names in use, plus one for the current chunk */
+    uint32_t pad_;
+    char data[];
+};
+
+#define NAMES_DATA_SZ (SIRIDB_NAMES_CHUNK_SZ - sizeof(siridb_names_chunk_t))
+#define NAMES_CHUNK(name) ((siridb_names_chunk_t *) \
+        ((uintptr_t) (name) & ~((uintptr_t) SIRIDB_NAMES_CHUNK_SZ - 1)))
+
+static void NAMES_decref(siridb_names_chunk_t * chunk);
+
+/*
+ * Returns NULL and raises a SIGNAL in case an error has occurred.
+ */
+siridb_names_t * siridb_names_new(void)
+{
+    siridb_names_t * names = (siridb_names_t *) malloc(sizeof(siridb_names_t));
+    if (names == NULL)
+    {
+        ERR_ALLOC
+    }
+    else
+    {
+        names->chunk = NULL;
+        names->len = 0;
+    }
+    return names;
+}
+
+/*
+ * Destroy the names storage. Chunks with names which are still in use are
+ * freed when the last name is released. (parsing NULL is allowed)
+ */
+void siridb_names_free(siridb_names_t * names)
+{
+    if (names == NULL)
+    {
+        return;
+    }
+
+    if (names->chunk != NULL)
+    {
+        NAMES_decref(names->chunk);
+    }
+
+    free(names);
+}
+
+/*
+ * Returns a copy of 'name' with 'len' the length of the name without the
+ * terminator. The copy must be released with siridb_names_release().
+ *
+ * Returns NULL and raises a SIGNAL in case an error has occurred.
+ */
+char * siridb_names_add(siridb_names_t * names, const char * name, size_t len)
+{
+    siridb_names_chunk_t * chunk = names->chunk;
+    char * pt;
+
+#ifdef DEBUG
+    assert (len <= SIRIDB_SERIES_NAME_LEN_MAX);
+#endif
+
+    if (chunk == NULL || names->len + len + 1 > NAMES_DATA_SZ)
+    {
+        chunk = (siridb_names_chunk_t *) aligned_alloc(
+                SIRIDB_NAMES_CHUNK_SZ,
+                SIRIDB_NAMES_CHUNK_SZ);
+
+        if (chunk == NULL)
+        {
+            ERR_ALLOC
+            return NULL;
+        }
+
+        chunk->ref = 1;
+
+        if (names->chunk != NULL)
+        {
+            NAMES_decref(names->chunk);
+        }
+
+        names->chunk = chunk;
+        names->len = 0;
+    }
+
+    pt = chunk->data + names->len;
+    memcpy(pt, name, len);
+    pt[len] = '\0';
+
+    names->len += len + 1;
+    __atomic_add_fetch(&chunk->ref, 1, __ATOMIC_RELAXED);
+
+    return pt;
+}
+
+/*
+ * Release a name which is returned by siridb_names_add().
+ */
+void siridb_names_release(char * name)
+{
+    NAMES_decref(NAMES_CHUNK(name));
+}
+
+static void NAMES_decref(siridb_names_chunk_t * chunk)
+{
+    if (!__atomic_sub_fetch(&chunk->ref, 1, __ATOMIC_ACQ_REL))
+    {
+        free(chunk);
+    }
+}
@@ -14,9 +14,18 @@
 #include <siri/db/pcache.h>
 #include <siri/err.h>
 #include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
 
 #define PCACHE_DEFAULT_SIZE 64
 
+/* below this number of points an insertion sort is used */
+#define PCACHE_RADIX_MIN 64
+
+static int PCACHE_reserve(siridb_pcache_t * pcache, size_t size);
+static void PCACHE_insertion_sort(siridb_pcache_t * pcache);
+static int PCACHE_radix_sort(siridb_pcache_t * pcache);
+
 /*
  * Returns NULL and raises a SIGNAL in case an error has occurred.
  *
@@ -35,6 +44,7 @@ siridb_pcache_t * siridb_pcache_new(points_tp tp)
         pcache->size = PCACHE_DEFAULT_SIZE;
         pcache->len = 0;
         pcache->tp = tp;
+        pcache->flags = 0;
         pcache->content = NULL;
         pcache->data = (siridb_point_t *) malloc(
                 sizeof(siridb_point_t) * PCACHE_DEFAULT_SIZE);
@@ -60,28 +70,227 @@ int siridb_pcache_add_point(
         uint64_t * ts,
         qp_via_t * val)
 {
-    if (pcache->len == pcache->size)
+    if (    pcache->len == pcache->size &&
+            PCACHE_reserve(pcache, pcache->size * 2))
     {
-        pcache->size *= 2;
-        siridb_point_t * tmp = (siridb_point_t *) realloc(
-                        pcache->data,
-                        sizeof(siridb_point_t) * pcache->size);
-        if (tmp == NULL)
-        {
-            log_error(
-                    "Cannot re-allocate memory for %lu points",
-                    pcache->size);
+        return -1;  /* signal is raised */
+    }
 
-            ERR_ALLOC
-            /* restore original size */
-            pcache->size /= 2;
-            return -1;
+    siridb_points_add_point((siridb_points_t *) pcache, ts, val);
+
+    return 0;
+}
+
+/*
+ * Add a point to the end of points without sorting. This is cheap for points
+ * out of order but siridb_pcache_sort() must be called before the pcache can
+ * be used as normal points.
+ *
+ * Returns 0 if successful or -1 and a signal is raised in case of an error.
+ */
+int siridb_pcache_append_point(
+        siridb_pcache_t * pcache,
+        uint64_t * ts,
+        qp_via_t * val)
+{
+    siridb_point_t * point;
+
+    if (    pcache->len == pcache->size &&
+            PCACHE_reserve(pcache, pcache->size * 2))
+    {
+        return -1;  /* signal is raised */
+    }
+
+    point = pcache->data + pcache->len++;
+    point->ts = *ts;
+    point->val = *val;
+
+    return 0;
+}
+
+/*
+ * Append the points at the current position of 'unpacker' to the end of
+ * points without sorting, like siridb_pcache_append_point(). Only points
+ * with an integer or double value are read, in one go, and the unpacker is
+ * left at the first object which is not such a point.
+ *
+ * Returns 0 if successful or -1 and a signal is raised in case of an error.
+ */
+int siridb_pcache_unpack_points(
+        siridb_pcache_t * pcache,
+        qp_unpacker_t * unpacker)
+{
+    size_t n;
+
+    do
+    {
+        if (    pcache->len == pcache->size &&
+                PCACHE_reserve(pcache, pcache->size * 2))
+        {
+            return -1;  /* signal is raised */
         }
-        pcache->data = tmp;
+
+        /* a point has the same layout as an unpacked pair */
+        n = qp_unpack_array2_numbers(
+                unpacker,
+                pcache->data + pcache->len,
+                pcache->size - pcache->len);
+        pcache->len += n;
     }
+    while (pcache->len == pcache->size);
 
-    siridb_points_add_point((siridb_points_t *) pcache, ts, val);
+    return 0;
+}
+
+/*
+ * Add sorted points to a sorted pcache.
+ *
+ * Returns 0 if successful or -1 and a signal is raised in case of an error.
+ */
+int siridb_pcache_add_points(
+        siridb_pcache_t *__restrict pcache,
+        siridb_points_t *__restrict points)
+{
+    if (pcache->len + points->len > pcache->size &&
+        PCACHE_reserve(pcache, pcache->len + points->len))
+    {
+        return -1;  /* signal is raised */
+    }
+
+    siridb_points_add_sorted(
+            (siridb_points_t *) pcache,
+            points->data,
+            points->len);
+
+    return 0;
+}
+
+/*
+ * Sort the points by timestamp. Points with equal timestamps keep their
+ * order. A radix sort is used so sorting takes linear time, also for badly
+ * ordered points from a backfill.
+ */
+void siridb_pcache_sort(siridb_pcache_t * pcache)
+{
+    size_t i;
 
+    /* most inserts are already in order */
+    for (   i = 1;
+            i < pcache->len && pcache->data[i - 1].ts <= pcache->data[i].ts;
+            i++);
+
+    if (i >= pcache->len)
+    {
+        return;
+    }
+
+    if (pcache->len < PCACHE_RADIX_MIN || PCACHE_radix_sort(pcache))
+    {
+        PCACHE_insertion_sort(pcache);
+    }
+}
+
+/*
+ * Returns 0 if successful or -1 and a signal is raised in case of an error.
+ */
+static int PCACHE_reserve(siridb_pcache_t * pcache, size_t size)
+{
+    siridb_point_t * tmp = (siridb_point_t *) realloc(
+                    pcache->data,
+                    sizeof(siridb_point_t) * size);
+    if (tmp == NULL)
+    {
+        log_error("Cannot re-allocate memory for %lu points", size);
+        ERR_ALLOC
+        return -1;
+    }
+    pcache->data = tmp;
+    pcache->size = size;
     return 0;
 }
 
+static void PCACHE_insertion_sort(siridb_pcache_t * pcache)
+{
+    siridb_point_t tmp;
+    size_t i, j;
+
+    for (i = 1; i < pcache->len; i++)
+    {
+        tmp = pcache->data[i];
+        for (j = i; j && pcache->data[j - 1].ts > tmp.ts; j--)
+        {
+            pcache->data[j] = pcache->data[j - 1];
+        }
+        pcache->data[j] = tmp;
+    }
+}
+
+/*
+ * LSD radix sort using 8 bit digits. Passes for digits which are equal for
+ * all points, like the high bytes of time-stamps close to each other, are
+ * skipped.
+ *
+ * Returns 0 if successful or -1 when no memory could be allocated, in which
+ * case the points are not changed. (no signal is raised)
+ */
+static int PCACHE_radix_sort(siridb_pcache_t * pcache)
+{
+    size_t count[8][256];
+    size_t len = pcache->len;
+    size_t i, pos, tmp;
+    siridb_point_t * src = pcache->data;
+    siridb_point_t * dst;
+    siridb_point_t * buf;
+    int d;
+
+    buf = (siridb_point_t *) malloc(sizeof(siridb_point_t) * len);
+    if (buf == NULL)
+    {
+        return -1;
+    }
+    dst = buf;
+
+    memset(count, 0, sizeof(count));
+
+    for (i = 0; i < len; i++)
+    {
+        for (d = 0; d < 8; d++)
+        {
+            count[d][(src[i].ts >> (d * 8)) & 0xff]++;
+        }
+    }
+
+    for (d = 0; d < 8; d++)
+    {
+        if (count[d][(src[0].ts >> (d * 8)) & 0xff] == len)
+        {
+            continue;  /* all points have the same digit */
+        }
+
+        /* convert the counts to start positions */
+        for (i = 0, pos = 0; i < 256; i++)
+        {
+            tmp = count[d][i];
+            count[d][i] = pos;
+            pos += tmp;
+        }
+
+        for (i = 0; i < len; i++)
+        {
+            dst[count[d][(src[i].ts >> (d * 8)) & 0xff]++] = src[i];
+        }
+
+        siridb_point_t * swap = src;
+        src = dst;
+        dst = swap;
+    }
+
+    if (src != pcache->data)
+    {
+        memcpy(pcache->data, src, sizeof(siridb_point_t) * len);
+    }
+
+    free(buf);
+
+    return 0;
+}
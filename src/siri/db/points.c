@@ -9,26 +9,89 @@
  *  - initial version, 04-04-2016
  *
  */
+#include <siri/db/aggregate.h>
 #include <siri/db/points.h>
+#include <siri/db/spill.h>
+#include <siri/db/variance.h>
 #include <logger/logger.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <assert.h>
+#include <limits.h>
+#include <lz4.h>
 #include <siri/err.h>
+#include <siri/grammar/grammar.h>
 #include <unistd.h>
 #include <string.h>
 
 #define MAX_ITERATE_MERGE_COUNT 1000
-#define POINTS_MAX_QSORT 250000
 
-static void POINTS_sort_while_merge(slist_t * plist, siridb_points_t * points);
-static void POINTS_merge_and_sort(slist_t * plist, siridb_points_t * points);
-static void POINTS_simple_sort(siridb_points_t * points);
-static inline int POINTS_compare(const void * a, const void * b);
-static void POINTS_highest_and_merge(slist_t * plist, siridb_points_t * points);
+/* number of merged points which are aggregated at once */
+#define POINTS_MERGE_BATCH 65536
+
+typedef struct points_src_s
+{
+    siridb_point_t * pt;        /* next point */
+    siridb_point_t * end;
+} points_src_t;
+
+/*
+ * Binary heap for a k-way merge, the source with the oldest next point is
+ * the first source.
+ */
+typedef struct points_heap_s
+{
+    size_t n;
+    points_src_t src[];
+} points_heap_t;
+
+static int POINTS_merge_prepare(
+        slist_t * plist,
+        points_tp * tp,
+        size_t * n,
+        char * err_msg);
+static points_heap_t * POINTS_heap_new(slist_t * plist);
+static void POINTS_heap_down(points_heap_t * heap, size_t i);
+static size_t POINTS_heap_pop(
+        points_heap_t * heap,
+        siridb_point_t * dest,
+        size_t max);
+static void POINTS_merge_done(slist_t * plist);
+static size_t POINTS_max_groups(
+        slist_t * plist,
+        siridb_aggr_t * aggr,
+        size_t n);
+static int POINTS_pack_column(
+        qp_packer_t * packer,
+        const char * data,
+        size_t size,
+        char * cbuf,
+        int bound);
+static void POINTS_content_free(char * block);
+static int POINTS_copy_content(
+        siridb_points_t *__restrict cpoints,
+        siridb_points_t *__restrict points);
+static void POINTS_merge_two(
+        siridb_point_t *__restrict dest,
+        const siridb_point_t * a,
+        const siridb_point_t * b,
+        const siridb_point_t * end);
+static void POINTS_free_all(
+        siridb_points_t * a,
+        siridb_points_t * b,
+        siridb_points_t * c);
+static inline void POINTS_ts_mul(
+        siridb_point_t * point,
+        siridb_point_t * end,
+        const uint64_t mul);
+static inline void POINTS_ts_div(
+        siridb_point_t * point,
+        siridb_point_t * end,
+        const uint64_t div);
 
 /*
  * Returns NULL and raises a SIGNAL in case an error has occurred.
+ * (data is NULL when 'size' is 0)
  */
 siridb_points_t * siridb_points_new(size_t size, points_tp tp)
 {
@@ -42,10 +105,12 @@ siridb_points_t * siridb_points_new(size_t size, points_tp tp)
     {
         points->len = 0;
         points->tp = tp;
+        points->flags = 0;
         points->content = NULL;
-        points->data =
-                (siridb_point_t *) malloc(sizeof(siridb_point_t) * size);
-        if (points->data == NULL)
+        points->data = (size) ?
+                (siridb_point_t *) malloc(sizeof(siridb_point_t) * size) :
+                NULL;
+        if (size && points->data == NULL)
         {
             ERR_ALLOC
             free(points);
@@ -59,6 +124,95 @@ siridb_points_t * siridb_points_new(size_t size, points_tp tp)
  * Returns a copy of points or NULL in case of an error. NULL is also returned
  * if points is NULL.
  */
+/*
+ * Sort the points from offsets[0] up to the end of 'points' which consist of
+ * 'n' sorted runs. Run 'i' starts at offsets[i] and ends where the next run
+ * starts. Argument 'offsets' must have space for n + 1 values and is changed
+ * by this function.
+ *
+ * Runs are merged in pairs so this takes O(m log n) time for 'm' points.
+ * Unlike the heap which is used for merging series, points with the same
+ * time-stamp keep the order of their runs.
+ *
+ * Returns 0 if successful or -1 and a SIGNAL is raised in case of an
+ * allocation error. (the points are not changed in this case)
+ */
+int siridb_points_merge_runs(
+        siridb_points_t * points,
+        size_t * offsets,
+        size_t n)
+{
+    siridb_point_t * data, * src, * dest, * swap, * tmp;
+    size_t i, j, start;
+
+    if (n < 2)
+    {
+        return 0;
+    }
+
+    start = offsets[0];
+    data = points->data + start;
+
+    offsets[n] = points->len;
+
+    tmp = (siridb_point_t *) malloc(
+            (offsets[n] - start) * sizeof(siridb_point_t));
+    if (tmp == NULL)
+    {
+        ERR_ALLOC
+        return -1;
+    }
+
+    for (i = 0; i <= n; i++)
+    {
+        offsets[i] -= start;
+    }
+
+    src = data;
+    dest = tmp;
+
+    while (n > 1)
+    {
+        for (i = 0, j = 0; i < n; i += 2, j++)
+        {
+            if (i + 1 == n)
+            {
+                /* the last run has no partner in this pass */
+                memcpy(
+                        dest + offsets[i],
+                        src + offsets[i],
+                        (offsets[n] - offsets[i]) * sizeof(siridb_point_t));
+            }
+            else
+            {
+                POINTS_merge_two(
+                        dest + offsets[i],
+                        src + offsets[i],
+                        src + offsets[i + 1],
+                        src + offsets[i + 2]);
+            }
+            offsets[j] = offsets[i];
+        }
+
+        offsets[j] = offsets[n];
+        n = j;
+
+        /* the merged runs are the source for the next pass */
+        swap = src;
+        src = dest;
+        dest = swap;
+    }
+
+    if (src != data)
+    {
+        memcpy(data, src, offsets[1] * sizeof(siridb_point_t));
+    }
+
+    free(tmp);
+
+    return 0;
+}
+
 siridb_points_t * siridb_points_copy(siridb_points_t * points)
 {
     if (points == NULL)
@@ -72,6 +226,7 @@ siridb_points_t * siridb_points_copy(siridb_points_t * points)
         size_t sz = sizeof(siridb_point_t) * points->len;
         cpoints->len = points->len;
         cpoints->tp = points->tp;
+        cpoints->flags = 0;
         cpoints->content = NULL;
         cpoints->data = (siridb_point_t *) malloc(sz);
         if (cpoints->data == NULL)
@@ -82,21 +237,172 @@ siridb_points_t * siridb_points_copy(siridb_points_t * points)
         else
         {
             memcpy(cpoints->data, points->data, sz);
+
+            if (    points->tp == TP_STRING &&
+                    POINTS_copy_content(cpoints, points))
+            {
+                siridb_points_free(cpoints);
+                cpoints = NULL;
+            }
         }
     }
     return cpoints;
 }
 
+/*
+ * Returns points with space for 'size' points allocated from 'arena'. The
+ * points are released with the arena, siridb_points_free() does nothing for
+ * these points and the data cannot be re-allocated. Points from an arena
+ * cannot have string content.
+ *
+ * Returns NULL and raises a SIGNAL in case an error has occurred. NULL is
+ * also returned if 'arena' is NULL, which is the case when creating the
+ * arena has failed.
+ */
+siridb_points_t * siridb_points_arena_new(
+        siridb_arena_t * arena,
+        size_t size,
+        points_tp tp)
+{
+    siridb_points_t * points = (arena == NULL) ?
+            NULL : (siridb_points_t *) siridb_arena_alloc(
+                    arena,
+                    sizeof(siridb_points_t) + sizeof(siridb_point_t) * size);
+    if (points != NULL)
+    {
+        points->len = 0;
+        points->tp = tp;
+        points->flags = SIRIDB_POINTS_FLAG_ARENA;
+        points->content = NULL;
+        points->data = (siridb_point_t *) (points + 1);
+    }
+    return points;
+}
+
+/*
+ * Returns a copy of points allocated from 'arena'. (see
+ * siridb_points_arena_new() and argument 'points' must not have string
+ * content)
+ *
+ * Returns NULL and raises a SIGNAL in case an error has occurred.
+ */
+siridb_points_t * siridb_points_arena_copy(
+        siridb_arena_t * arena,
+        siridb_points_t * points)
+{
+    siridb_points_t * cpoints =
+            siridb_points_arena_new(arena, points->len, points->tp);
+    if (cpoints != NULL)
+    {
+        cpoints->len = points->len;
+        memcpy(
+                cpoints->data,
+                points->data,
+                sizeof(siridb_point_t) * points->len);
+    }
+    return cpoints;
+}
+
 /*
  * Destroy points. (parsing NULL is NOT allowed)
+ *
+ * Points allocated from an arena are left alone, they are released together
+ * with the arena.
  */
 void siridb_points_free(siridb_points_t * points)
 {
-    free(points->content);
+    if (points->flags & SIRIDB_POINTS_FLAG_ARENA)
+    {
+        return;
+    }
+    if (points->flags & SIRIDB_POINTS_FLAG_SPILLED)
+    {
+        siridb_spill_unmap(points->data);
+        free(points);
+        return;
+    }
+    POINTS_content_free(points->content);
     free(points->data);
     free(points);
 }
 
+/*
+ * Returns the bytes in memory used by 'points', including the string values.
+ * Spilled points only count the object itself.
+ */
+size_t siridb_points_size(siridb_points_t * points)
+{
+    size_t size = sizeof(siridb_points_t);
+
+    if (points->flags & SIRIDB_POINTS_FLAG_SPILLED)
+    {
+        return size;
+    }
+
+    size += points->len * sizeof(siridb_point_t);
+
+    if (points->tp == TP_STRING)
+    {
+        for (size_t i = 0; i < points->len; i++)
+        {
+            size += strlen(points->data[i].val.raw) + 1;
+        }
+    }
+
+    return size;
+}
+
+/*
+ * Returns space for 'size' bytes of string content which is released
+ * together with 'points'. Content is allocated in blocks, usually one for
+ * each chunk which is read, so string values in existing blocks are never
+ * moved. Each block starts with a pointer to the next block.
+ *
+ * Returns NULL and raises a SIGNAL in case an error has occurred.
+ */
+char * siridb_points_content(siridb_points_t * points, size_t size)
+{
+    char * block = (char *) malloc(sizeof(char *) + size);
+
+    if (block == NULL)
+    {
+        ERR_ALLOC
+        return NULL;
+    }
+
+    memcpy(block, &points->content, sizeof(char *));
+    points->content = block;
+
+    return block + sizeof(char *);
+}
+
+/*
+ * Move the string content from 'src' to 'dest'. This must be used when the
+ * string values of 'src' are added to 'dest' and 'src' is destroyed.
+ */
+void siridb_points_content_move(
+        siridb_points_t *__restrict dest,
+        siridb_points_t *__restrict src)
+{
+    char * block = src->content;
+    char * next;
+
+    if (block == NULL)
+    {
+        return;
+    }
+
+    /* find the last block of 'src' and link the blocks of 'dest' */
+    while (memcpy(&next, block, sizeof(char *)), next != NULL)
+    {
+        block = next;
+    }
+
+    memcpy(block, &dest->content, sizeof(char *));
+    dest->content = src->content;
+    src->content = NULL;
+}
+
 /*
  * Add a point to points. (points are sorted by timestamp so the new point
  * will be inserted at the correct position.
@@ -125,6 +431,32 @@ void siridb_points_add_point(
     point->val = *val;
 }
 
+/*
+ * Add 'n' points from 'data' which must be sorted by timestamp. The points
+ * are merged so this takes linear time, also when the new points are older
+ * than the existing points. Existing points are kept in front of new points
+ * with the same timestamp, like siridb_points_add_point() does.
+ *
+ * Warning: 'points' must have space for 'n' more points.
+ */
+void siridb_points_add_sorted(
+        siridb_points_t *__restrict points,
+        const siridb_point_t *__restrict data,
+        size_t n)
+{
+    size_t i = points->len;
+    size_t k = points->len + n;
+
+    points->len = k;
+
+    /* merge from the end so no points need to be moved twice */
+    while (n)
+    {
+        points->data[--k] = (i && points->data[i - 1].ts > data[n - 1].ts) ?
+                points->data[--i] : data[--n];
+    }
+}
+
 /*
  * Returns siri_err and raises a SIGNAL in case an error has occurred.
  */
@@ -136,26 +468,22 @@ int siridb_points_pack(siridb_points_t * points, qp_packer_t * packer)
         siridb_point_t * point = points->data;
         switch (points->tp)
         {
+        /* a point is a timestamp followed by a 64bit value, exactly the
+         * pair layout which the qpack array functions expect */
         case TP_INT:
-            for (size_t i = 0; i < points->len; i++, point++)
-            {
-                qp_add_type(packer, QP_ARRAY2);
-                qp_add_int64(packer, (int64_t) point->ts);
-                qp_add_int64(packer, point->val.int64);
-            }
+            qp_add_array2_int64(packer, point, points->len);
             break;
         case TP_DOUBLE:
+            qp_add_array2_int64_double(packer, point, points->len);
+            break;
+        case TP_STRING:
             for (size_t i = 0; i < points->len; i++, point++)
             {
                 qp_add_type(packer, QP_ARRAY2);
                 qp_add_int64(packer, (int64_t) point->ts);
-                qp_add_double(packer, point->val.real);
+                qp_add_string(packer, point->val.raw);
             }
             break;
-        case TP_STRING:
-            /* TODO: handle string type */
-            assert (0);
-            break;
         }
     }
     qp_add_type(packer, QP_ARRAY_CLOSE);
@@ -163,368 +491,1028 @@ int siridb_points_pack(siridb_points_t * points, qp_packer_t * packer)
     return siri_err;
 }
 
-void siridb_points_ts_correction(siridb_points_t * points, double factor)
+/*
+ * Pack points as columns, in the same layout as the columns for an insert:
+ * [tp, ts, values]. The time-stamps are raw data with 8 bytes (little-endian)
+ * for each point and, except for the first time-stamp, each time-stamp is
+ * stored as the difference with the previous time-stamp. Integer and float
+ * values are raw data with 8 bytes for each point, strings are packed as an
+ * array.
+ *
+ * When 'compress' is true the raw columns are LZ4 blocks, and the number of
+ * points is added to the array so the size of the columns is known:
+ * [tp, n, ts, values].
+ *
+ * Returns 0 if successful or -1 and a signal is raised in case of an error.
+ */
+int siridb_points_pack_columns(
+        siridb_points_t * points,
+        qp_packer_t * packer,
+        int compress)
 {
-    siridb_point_t * point = points->data;
-    for (size_t i = 0; i < points->len; i++, point++)
+    size_t i, size = points->len * sizeof(uint64_t);
+    uint64_t prev = 0, delta;
+    char * cbuf = NULL;
+    int bound = 0;
+    int rc;
+    char * buf = (char *) malloc(size ? size : 1);
+
+    if (buf == NULL)
     {
-        point->ts *= factor;
+        ERR_ALLOC
+        return -1;
+    }
+
+    /* a larger column is packed without compression */
+    if (compress && size <= LZ4_MAX_INPUT_SIZE)
+    {
+        bound = LZ4_compressBound((int) size);
+        if ((cbuf = (char *) malloc(bound)) == NULL)
+        {
+            ERR_ALLOC
+            free(buf);
+            return -1;
+        }
+    }
+
+    for (i = 0; i < points->len; i++)
+    {
+        delta = points->data[i].ts - prev;
+        prev = points->data[i].ts;
+        memcpy(buf + i * sizeof(uint64_t), &delta, sizeof(uint64_t));
+    }
+
+    rc = -(qp_add_type(packer, (cbuf == NULL) ? QP_ARRAY3 : QP_ARRAY4) ||
+            qp_add_int64(packer, points->tp) ||
+            (cbuf != NULL && qp_add_int64(packer, (int64_t) points->len)) ||
+            POINTS_pack_column(packer, buf, size, cbuf, bound));
+
+    if (rc == 0 && points->tp == TP_STRING)
+    {
+        qp_add_type(packer, QP_ARRAY_OPEN);
+        for (i = 0; i < points->len; i++)
+        {
+            qp_add_string(packer, points->data[i].val.raw);
+        }
+        rc = qp_add_type(packer, QP_ARRAY_CLOSE);
+    }
+    else if (rc == 0)
+    {
+        for (i = 0; i < points->len; i++)
+        {
+            memcpy( buf + i * sizeof(uint64_t),
+                    &points->data[i].val,
+                    sizeof(uint64_t));
+        }
+        rc = POINTS_pack_column(packer, buf, size, cbuf, bound);
     }
+
+    free(cbuf);
+    free(buf);
+
+    return (rc || siri_err) ? -1 : 0;
 }
 
 /*
- * Returns 0 if successful or -1 and a SIGNAL is raised in case of an error.
+ * Convert the time-stamps of points to another time precision. The factor
+ * is a power of 1000 so the time-stamps are scaled with an integer multiply
+ * or division by a constant. Multiplying with the factor as a float is not
+ * exact, 0.001f is a bit more than 0.001 which is notable for time-stamps
+ * in seconds converted from milliseconds.
  */
-int siridb_points_raw_pack(siridb_points_t * points, qp_packer_t * packer)
+void siridb_points_ts_correction(siridb_points_t * points, double factor)
 {
-    return -(qp_add_type(packer, QP_ARRAY_OPEN) ||
-            qp_add_int8(packer, points->tp) ||
-            qp_add_int32(packer, points->len) ||
-            qp_add_raw(
-                packer,
-                (char *) points->data,
-                points->len * sizeof(siridb_point_t)) ||
-            qp_add_type(packer, QP_ARRAY_CLOSE));
+    siridb_point_t * point = points->data;
+    siridb_point_t * end = point + points->len;
+
+    switch ((factor >= 1.0) ?
+            (int64_t) (factor + 0.5) :
+            -(int64_t) (1.0 / factor + 0.5))
+    {
+    case 1:
+    case -1:
+        return;
+    case 1000:
+        POINTS_ts_mul(point, end, 1000);
+        return;
+    case 1000000:
+        POINTS_ts_mul(point, end, 1000000);
+        return;
+    case 1000000000:
+        POINTS_ts_mul(point, end, 1000000000);
+        return;
+    case -1000:
+        POINTS_ts_div(point, end, 1000);
+        return;
+    case -1000000:
+        POINTS_ts_div(point, end, 1000000);
+        return;
+    case -1000000000:
+        POINTS_ts_div(point, end, 1000000000);
+        return;
+    }
+
+    /* not a power of 1000 */
+    for (; point < end; point++)
+    {
+        point->ts *= factor;
+    }
 }
 
 /*
- * Returns NULL and raises a SIGNAL in case an error has occurred.
- * (err_msg is set when an error has occurred)
- * Use this function only when having at least two 'series' in the list.
+ * Set the min, max and sum for points from 'start' up to 'end'. (end > start)
+ *
+ * The statistics are marked as not available for string points or when the
+ * sum of integer points overflows.
  */
-siridb_points_t * siridb_points_merge(slist_t * plist, char * err_msg)
+void siridb_points_stats(
+        siridb_points_stats_t * stats,
+        siridb_points_t * points,
+        size_t start,
+        size_t end)
 {
-#ifdef DEBUG
-    assert (plist->len >= 2);
-#endif
-    siridb_points_t * points;
-    siridb_points_t * tpts = NULL;
-    size_t n = 0;
-    size_t i;
-    uint8_t int2double = 0;
+    siridb_point_t * point = points->data + start;
+    siridb_point_t * last = points->data + end;
 
-    for (i = 0; i < plist->len; )
+    switch (points->tp)
     {
-        points = (siridb_points_t *) plist->data[i];
-
-        if (!points->len)
+    case TP_INT:
         {
-            if (!--plist->len)
-            {
-                /* all series are empty, return the last one */
-                return plist->data[i];
-            }
-            /* cleanup empty points */
-            siridb_points_free(plist->data[i]);
+            int64_t min, max, sum, tmp;
 
-            /* shrink plist length and fill gap */
-            plist->data[i] = plist->data[plist->len];
+            min = max = sum = point->val.int64;
 
-            continue;
+            for (point++; point < last; point++)
+            {
+                tmp = point->val.int64;
+                if ((tmp > 0 && sum > LLONG_MAX - tmp) ||
+                        (tmp < 0 && sum < LLONG_MIN - tmp))
+                {
+                    siridb_points_stats_invalidate(stats);
+                    return;
+                }
+                sum += tmp;
+                if (tmp < min)
+                {
+                    min = tmp;
+                }
+                else if (tmp > max)
+                {
+                    max = tmp;
+                }
+            }
+            stats->min.int64 = min;
+            stats->max.int64 = max;
+            stats->sum.int64 = sum;
         }
+        break;
 
-        n += points->len;
-
-        if (tpts != NULL && tpts->tp != points->tp)
+    case TP_DOUBLE:
         {
-            if (tpts->tp == TP_STRING || points->tp == TP_STRING)
+            double min, max, sum, tmp;
+
+            min = max = sum = point->val.real;
+
+            for (point++; point < last; point++)
             {
-                sprintf(err_msg, "Cannot merge string and number series.");
-                return NULL;
+                tmp = point->val.real;
+                sum += tmp;
+                if (tmp < min)
+                {
+                    min = tmp;
+                }
+                else if (tmp > max)
+                {
+                    max = tmp;
+                }
             }
-            int2double = 1;
+            stats->min.real = min;
+            stats->max.real = max;
+            stats->sum.real = sum;
         }
+        break;
 
-        /*
-         * Decrement the points->len so we can use this not truly as length
-         * property but as position of the last element.
-         */
-        points->len--;
-        tpts = points;
-        i++;
+    default:
+        siridb_points_stats_invalidate(stats);
+        break;
     }
+}
 
-#ifdef DEBUG
-    /* we have at least one series left */
-    assert (plist->len >= 1);
-#endif
-
-    if (plist->len == 1)
+/*
+ * Add the statistics 'other' to 'stats', both for points of type 'tp'. The
+ * statistics become unavailable when one of them is not available or when
+ * the sum of integer values overflows.
+ */
+void siridb_points_stats_merge(
+        siridb_points_stats_t *__restrict stats,
+        const siridb_points_stats_t *__restrict other,
+        points_tp tp)
+{
+    if (!siridb_points_stats_ok(stats))
     {
-        /*
-         * Return the only left points since there is nothing to merge as set
-         * list length to 0. We do have to restore the points length since
-         * this is decremented by one.
-         */
-        points = (siridb_points_t *) slist_pop(plist);
-        points->len++;
-        return points;
+        return;
     }
 
-    points = siridb_points_new(n, (int2double) ? TP_DOUBLE : tpts->tp);
-
-
-    if (points == NULL)
+    if (!siridb_points_stats_ok(other))
     {
-        sprintf(err_msg, "Memory allocation error.");
+        siridb_points_stats_invalidate(stats);
+        return;
     }
-    else
-    {
-        usleep(1000);
 
-        /*
-         * When both series from type double and type integer are merged
-         * we need to promote the integer series to double.
-         */
-        if (int2double)
+    switch (tp)
+    {
+    case TP_INT:
         {
-            size_t j;
-            for (i = 0; i < plist->len; i++)
+            int64_t tmp = other->sum.int64;
+
+            if ((tmp > 0 && stats->sum.int64 > LLONG_MAX - tmp) ||
+                    (tmp < 0 && stats->sum.int64 < LLONG_MIN - tmp))
             {
-                tpts = (siridb_points_t *) plist->data[i];
-                if (tpts->tp == TP_INT)
-                {
-                    for (j = 0; j <= tpts->len; j++)
-                    {
-                        tpts->data[j].val.real =
-                                (double) tpts->data[j].val.int64;
-                    }
-                    usleep(100);
-                }
+                siridb_points_stats_invalidate(stats);
+                return;
+            }
+            stats->sum.int64 += tmp;
+            if (other->min.int64 < stats->min.int64)
+            {
+                stats->min.int64 = other->min.int64;
+            }
+            if (other->max.int64 > stats->max.int64)
+            {
+                stats->max.int64 = other->max.int64;
             }
         }
+        break;
 
-        points->len = n;
-
-        /*
-         * Select a merge method depending on the ratio series and points.
-         */
-        if (plist->len < 4)
-        {
-            POINTS_sort_while_merge(plist, points);
-        }
-        else if (n == plist->len || n < POINTS_MAX_QSORT)
+    case TP_DOUBLE:
+        stats->sum.real += other->sum.real;
+        if (other->min.real < stats->min.real)
         {
-            POINTS_merge_and_sort(plist, points);
+            stats->min.real = other->min.real;
         }
-        else
+        if (other->max.real > stats->max.real)
         {
-            POINTS_highest_and_merge(plist, points);
+            stats->max.real = other->max.real;
         }
+        break;
+
+    default:
+        siridb_points_stats_invalidate(stats);
+        break;
     }
-    return points;
 }
 
 /*
- * This merge method works best when having both a lot of series and having
- * any number of points for each series.
+ * Returns 0 if successful or -1 and a SIGNAL is raised in case of an error.
  */
-static void POINTS_highest_and_merge(slist_t * plist, siridb_points_t * points)
+int siridb_points_raw_pack(siridb_points_t * points, qp_packer_t * packer)
 {
-    siridb_points_t ** m = NULL;
-    size_t i, n, l = 0;
-    siridb_points_t ** tpts;
-    uint64_t highest = 0;
-    n = points->len;
+    return -(qp_add_type(packer, QP_ARRAY_OPEN) ||
+            qp_add_int8(packer, points->tp) ||
+            qp_add_int32(packer, points->len) ||
+            qp_add_raw(
+                packer,
+                (char *) points->data,
+                points->len * sizeof(siridb_point_t)) ||
+            qp_add_type(packer, QP_ARRAY_CLOSE));
+}
 
-    while (plist->len)
+/*
+ * Returns NULL and raises a SIGNAL in case an error has occurred.
+ * (err_msg is set when an error has occurred)
+ * Use this function only when having at least two 'series' in the list.
+ *
+ * The points in 'plist' are destroyed and 'plist' is empty afterwards,
+ * except when an error has occurred.
+ */
+siridb_points_t * siridb_points_merge(slist_t * plist, char * err_msg)
+{
+    siridb_points_t * points;
+    points_heap_t * heap;
+    points_tp tp;
+    size_t n;
+
+    if (POINTS_merge_prepare(plist, &tp, &n, err_msg))
+    {
+        return NULL;  /* err_msg is set */
+    }
+
+    if (plist->len == 1)
+    {
+        /* return the only left points since there is nothing to merge */
+        return (siridb_points_t *) slist_pop(plist);
+    }
+
+    if ((heap = POINTS_heap_new(plist)) == NULL)
+    {
+        sprintf(err_msg, "Memory allocation error.");
+        return NULL;  /* signal is raised */
+    }
+
+    points = siridb_points_new(n, tp);
+
+    if (points == NULL)
+    {
+        sprintf(err_msg, "Memory allocation error.");
+    }
+    else
     {
-        if (m != NULL)
+        points->len = POINTS_heap_pop(heap, points->data, n);
+#ifdef DEBUG
+        assert (points->len == n);
+#endif
+        /* string values must stay valid when the lists are destroyed */
+        for (size_t i = 0; tp == TP_STRING && i < plist->len; i++)
         {
-            tpts = m;
-            m = NULL;
-            for (; l < plist->len; l++, tpts++)
-            {
-                if (((*tpts)->data + (*tpts)->len)->ts == highest)
-                {
-                    m = tpts;
-                    break;
-                }
-            }
+            siridb_points_content_move(
+                    points,
+                    (siridb_points_t *) plist->data[i]);
         }
+        POINTS_merge_done(plist);
+    }
+
+    free(heap);
+
+    return points;
+}
+
+/*
+ * Returns the merged points from 'plist' aggregated with 'aggr'. The points
+ * are merged and aggregated in batches so the merged points are never all
+ * in memory at the same time. Argument 'aggr' must be an aggregate for which
+ * siridb_aggregate_can_use_stats() is true.
+ *
+ * Returns NULL and raises a SIGNAL in case an error has occurred.
+ * (err_msg is set when an error has occurred)
+ * Use this function only when having at least two 'series' in the list.
+ *
+ * The points in 'plist' are destroyed and 'plist' is empty afterwards,
+ * except when an error has occurred.
+ */
+siridb_points_t * siridb_points_merge_aggr(
+        slist_t * plist,
+        siridb_aggr_t * aggr,
+        char * err_msg)
+{
+    siridb_points_t * points;
+    siridb_points_t * counts;
+    siridb_points_t * batch;
+    points_tp tp;
+    size_t n;
 
-        if (m == NULL)
+    if (POINTS_merge_prepare(plist, &tp, &n, err_msg))
+    {
+        return NULL;  /* err_msg is set */
+    }
+
+    if (plist->len == 1)
+    {
+        batch = (siridb_points_t *) slist_pop(plist);
+        points = siridb_aggregate_run(batch, aggr, err_msg);
+        if (points != batch)
         {
-            m = (siridb_points_t **) plist->data;
+            siridb_points_free(batch);
+        }
+        return points;
+    }
 
-            for (i = 1, tpts = m + 1; i < plist->len; i++, tpts++)
-            {
-                if (((*tpts)->data + (*tpts)->len)->ts >
-                    ((*m)->data + (*m)->len)->ts)
-                {
-                    m = tpts;
-                    l = i;
-                    highest = ((*m)->data + (*m)->len)->ts;
-                }
-            }
+    if (siridb_variance_is_gid(aggr->gid))
+    {
+        siridb_points_t * parts[SIRIDB_VARIANCE_PARTS];
+
+        if (siridb_points_merge_variance(plist, aggr, parts, err_msg))
+        {
+            return NULL;  /* err_msg is set */
         }
 
-        points->data[--n] = (*m)->data[(*m)->len];
+        points = siridb_variance_parts_finish(parts, aggr->gid, err_msg);
+        siridb_variance_parts_free(parts);
+
+        return points;
+    }
+
+    points = siridb_points_merge_partial(plist, aggr, &counts, err_msg);
+
+    return (points == NULL || counts == NULL) ?
+            points : siridb_aggregate_stream_mean(points, counts, err_msg);
+}
+
+/*
+ * Set 'parts' to the partial variance of the merged points from 'plist'
+ * which can be combined with the partial variance for other points of the
+ * same merge. (see siridb_variance_parts_combine()) Argument 'aggr' must be
+ * a variance or pvariance for which siridb_aggregate_can_merge() is true.
+ *
+ * Returns 0 if successful or -1 in case of an error. (err_msg is set and a
+ * SIGNAL might be raised)
+ *
+ * The points in 'plist' are destroyed and 'plist' is empty afterwards,
+ * except when an error has occurred.
+ */
+int siridb_points_merge_variance(
+        slist_t * plist,
+        siridb_aggr_t * aggr,
+        siridb_points_t ** parts,
+        char * err_msg)
+{
+    siridb_points_t * batch;
+    points_heap_t * heap = NULL;
+    points_tp tp;
+    size_t n;
+
+    if (plist->len == 1)
+    {
+        tp = ((siridb_points_t *) plist->data[0])->tp;
+        n = ((siridb_points_t *) plist->data[0])->len;
+    }
+    else if (POINTS_merge_prepare(plist, &tp, &n, err_msg))
+    {
+        return -1;  /* err_msg is set */
+    }
+
+    if (tp == TP_STRING)
+    {
+        sprintf(err_msg, "Cannot use %s() on string type.",
+                (aggr->gid == CLERI_GID_F_VARIANCE) ?
+                        "variance" : "pvariance");
+        return -1;
+    }
+
+    if (n && (heap = POINTS_heap_new(plist)) == NULL)
+    {
+        sprintf(err_msg, "Memory allocation error.");
+        return -1;  /* signal is raised */
+    }
+
+    batch = siridb_points_new(
+            (n < POINTS_MERGE_BATCH) ? n : POINTS_MERGE_BATCH,
+            tp);
 
-        if ((*m)->len--)
+    if (batch == NULL || siridb_variance_parts_new(
+            parts,
+            POINTS_max_groups(plist, aggr, n)))
+    {
+        sprintf(err_msg, "Memory allocation error.");
+        if (batch != NULL)
         {
-            m++;
-            l++;
+            siridb_points_free(batch);
         }
-        else
+        free(heap);
+        return -1;  /* signal is raised */
+    }
+
+    while (heap != NULL && heap->n)
+    {
+        batch->len = POINTS_heap_pop(heap, batch->data, POINTS_MERGE_BATCH);
+        siridb_variance_parts_add(parts, batch, aggr);
+        usleep(1000);
+    }
+
+    siridb_points_free(batch);
+    free(heap);
+
+    POINTS_merge_done(plist);
+
+    return 0;
+}
+
+/*
+ * Returns the points 'points_a' <op> 'points_b' for the time-stamps which
+ * both have, where 'op' is one of '+', '-', '*' or '/'. Both must be sorted
+ * and the result is of type double. Points with an equal time-stamp are
+ * joined in order, a division by zero is skipped.
+ *
+ * Returns NULL in case of an error. (err_msg is set and a SIGNAL might be
+ * raised)
+ */
+siridb_points_t * siridb_points_join(
+        siridb_points_t * points_a,
+        siridb_points_t * points_b,
+        char op,
+        char * err_msg)
+{
+    siridb_points_t * points;
+    siridb_point_t * a = points_a->data;
+    siridb_point_t * b = points_b->data;
+    siridb_point_t * end_a = a + points_a->len;
+    siridb_point_t * end_b = b + points_b->len;
+    double va, vb;
+
+    if (points_a->tp == TP_STRING || points_b->tp == TP_STRING)
+    {
+        sprintf(err_msg, "Cannot use a join on string series.");
+        return NULL;
+    }
+
+    points = siridb_points_new(
+            (points_a->len < points_b->len) ? points_a->len : points_b->len,
+            TP_DOUBLE);
+    if (points == NULL)
+    {
+        sprintf(err_msg, "Memory allocation error.");
+        return NULL;  /* signal is raised */
+    }
+
+    while (a < end_a && b < end_b)
+    {
+        if (a->ts < b->ts)
         {
-            siridb_points_free(*m);
+            a++;
+            continue;
+        }
 
-            if (--plist->len)
-            {
-                *m = (siridb_points_t *) plist->data[plist->len];
-            }
+        if (b->ts < a->ts)
+        {
+            b++;
+            continue;
         }
 
-        if (!(n % MAX_ITERATE_MERGE_COUNT))
+        va = (points_a->tp == TP_INT) ? (double) a->val.int64 : a->val.real;
+        vb = (points_b->tp == TP_INT) ? (double) b->val.int64 : b->val.real;
+
+        if (op != '/' || vb != 0.0)
         {
-            usleep(3000);
+            points->data[points->len].ts = a->ts;
+            points->data[points->len].val.real =
+                    (op == '+') ? va + vb :
+                    (op == '-') ? va - vb :
+                    (op == '*') ? va * vb : va / vb;
+            points->len++;
         }
+
+        a++;
+        b++;
     }
-#ifdef DEBUG
-    /* size should be exactly zero */
-    assert (n == 0);
-#endif
-}
 
+    return points;
+}
 
 /*
- * This merge method works best for only a few series with possible a lot
- * of points.
+ * Returns the partial aggregate of the merged points from 'plist' which can
+ * be combined with partial aggregates for other points of the same merge.
+ * (see siridb_aggregate_combine_partial()) For a mean the sum is returned
+ * and 'counts' is set to the number of points for each group, for other
+ * aggregates 'counts' is set to NULL. Argument 'aggr' must be an aggregate
+ * for which siridb_aggregate_can_use_stats() is true.
+ *
+ * Returns NULL and raises a SIGNAL in case an error has occurred.
+ * (err_msg is set when an error has occurred)
+ *
+ * The points in 'plist' are destroyed and 'plist' is empty afterwards,
+ * except when an error has occurred.
  */
-static void POINTS_sort_while_merge(slist_t * plist, siridb_points_t * points)
+siridb_points_t * siridb_points_merge_partial(
+        slist_t * plist,
+        siridb_aggr_t * aggr,
+        siridb_points_t ** counts,
+        char * err_msg)
 {
-    siridb_points_t ** m;
-    size_t i, n;
-    siridb_points_t ** tpts;
-    n = points->len;
+    siridb_points_t * points;
+    siridb_points_t * batch = NULL;
+    points_heap_t * heap = NULL;
+    siridb_aggr_t base;
+    points_tp tp;
+    size_t n;
+    int is_mean = aggr->gid == CLERI_GID_F_MEAN;
 
-    while (plist->len)
+    *counts = NULL;
+
+    if (plist->len == 1)
     {
-        m = (siridb_points_t **) plist->data;
+        tp = ((siridb_points_t *) plist->data[0])->tp;
+        n = ((siridb_points_t *) plist->data[0])->len;
+    }
+    else if (POINTS_merge_prepare(plist, &tp, &n, err_msg))
+    {
+        return NULL;  /* err_msg is set */
+    }
+
+    /* the mean is calculated from the sum and count */
+    base = *aggr;
+    base.gid = is_mean ? CLERI_GID_F_SUM : aggr->gid;
+
+    if (n && (heap = POINTS_heap_new(plist)) == NULL)
+    {
+        sprintf(err_msg, "Memory allocation error.");
+        return NULL;  /* signal is raised */
+    }
+
+    batch = siridb_points_new(
+            (n < POINTS_MERGE_BATCH) ? n : POINTS_MERGE_BATCH,
+            tp);
+    points = siridb_points_new(0, (base.gid == CLERI_GID_F_COUNT) ?
+            TP_INT : tp);
+    *counts = is_mean ? siridb_points_new(0, TP_INT) : NULL;
+
+    if (batch == NULL || points == NULL || (is_mean && *counts == NULL))
+    {
+        sprintf(err_msg, "Memory allocation error.");
+        POINTS_free_all(batch, points, *counts);
+        *counts = NULL;
+        free(heap);
+        return NULL;  /* signal is raised */
+    }
+
+    while (heap != NULL && heap->n)
+    {
+        batch->len = POINTS_heap_pop(heap, batch->data, POINTS_MERGE_BATCH);
+
+        if (siridb_aggregate_stream(&points, counts, batch, &base, err_msg))
+        {
+            /* points and counts are destroyed */
+            *counts = NULL;
+            siridb_points_free(batch);
+            free(heap);
+            return NULL;  /* err_msg is set */
+        }
+
+        usleep(1000);
+    }
+
+    siridb_points_free(batch);
+    free(heap);
+
+    POINTS_merge_done(plist);
+
+    return points;
+}
 
-        for (i = 1, tpts = m + 1; i < plist->len; i++, tpts++)
+/*
+ * Returns the maximum number of groups for merging 'n' points from 'plist',
+ * which is at most the number of points.
+ */
+static size_t POINTS_max_groups(
+        slist_t * plist,
+        siridb_aggr_t * aggr,
+        size_t n)
+{
+    siridb_points_t * points;
+    uint64_t first = UINT64_MAX, last = 0, groups;
+
+    for (size_t i = 0; i < plist->len; i++)
+    {
+        points = (siridb_points_t *) plist->data[i];
+        if (points->len)
         {
-            if (((*tpts)->data + (*tpts)->len)->ts >
-                ((*m)->data + (*m)->len)->ts)
+            if (points->data[0].ts < first)
+            {
+                first = points->data[0].ts;
+            }
+            if (points->data[points->len - 1].ts > last)
             {
-                m = tpts;
+                last = points->data[points->len - 1].ts;
             }
         }
+    }
+
+    if (first > last)
+    {
+        return 0;
+    }
+
+    groups = (SIRIDB_AGGR_GROUP_TS(aggr, last) -
+            SIRIDB_AGGR_GROUP_TS(aggr, first)) / aggr->group_by + 1;
+
+    return (groups < n) ? groups : n;
+}
+
+/*
+ * Remove empty points from 'plist' and set the type and total number of
+ * points for merging 'plist'. At least one points is left in 'plist'. When
+ * both series from type double and type integer are merged, the integer
+ * points are promoted to double.
+ *
+ * Returns 0 if successful or -1 when string and number series are mixed.
+ * (err_msg is set)
+ */
+static int POINTS_merge_prepare(
+        slist_t * plist,
+        points_tp * tp,
+        size_t * n,
+        char * err_msg)
+{
+#ifdef DEBUG
+    assert (plist->len >= 2);
+#endif
+    siridb_points_t * points;
+    siridb_points_t * tpts = NULL;
+    uint8_t int2double = 0;
+    size_t i, j;
+
+    *n = 0;
 
-        points->data[--n] = (*m)->data[(*m)->len];
+    for (i = 0; i < plist->len; )
+    {
+        points = (siridb_points_t *) plist->data[i];
 
-        if (!(*m)->len--)
+        if (!points->len && plist->len > 1)
         {
-            siridb_points_free(*m);
+            /* cleanup empty points and fill the gap */
+            siridb_points_free(points);
+            plist->data[i] = plist->data[--plist->len];
+            continue;
+        }
 
-            if (--plist->len)
+        if (tpts != NULL && tpts->tp != points->tp)
+        {
+            if (tpts->tp == TP_STRING || points->tp == TP_STRING)
             {
-                *m = (siridb_points_t *) plist->data[plist->len];
+                sprintf(err_msg, "Cannot merge string and number series.");
+                return -1;
             }
+            int2double = 1;
         }
 
-        if (!(n % MAX_ITERATE_MERGE_COUNT))
+        *n += points->len;
+        tpts = points;
+        i++;
+    }
+
+    *tp = (int2double) ? TP_DOUBLE : tpts->tp;
+
+    for (i = 0; int2double && i < plist->len; i++)
+    {
+        points = (siridb_points_t *) plist->data[i];
+        if (points->tp == TP_INT)
         {
-            usleep(3000);
+            for (j = 0; j < points->len; j++)
+            {
+                points->data[j].val.real = (double) points->data[j].val.int64;
+            }
+            points->tp = TP_DOUBLE;
         }
     }
-#ifdef DEBUG
-    /* size should be exactly zero */
-    assert (n == 0);
-#endif
+
+    return 0;
 }
 
 /*
- * This merge method works best when having a lot of series with only one point
- * or when the total number of points it not so high.
+ * Returns a heap for a k-way merge of the points in 'plist'. All points in
+ * 'plist' must have at least one point.
+ *
+ * Returns NULL and raises a SIGNAL in case an error has occurred.
  */
-static void POINTS_merge_and_sort(slist_t * plist, siridb_points_t * points)
+static points_heap_t * POINTS_heap_new(slist_t * plist)
 {
-    siridb_points_t ** m;
-    size_t i, n;
-    n = points->len;
-    uint8_t use_simple_sort = n == plist->len;
+    size_t i;
+    siridb_points_t * points;
+    points_heap_t * heap = (points_heap_t *) malloc(
+            sizeof(points_heap_t) + plist->len * sizeof(points_src_t));
 
-    while (plist->len)
+    if (heap == NULL)
     {
-        for (i = 0; i < plist->len; i++)
+        ERR_ALLOC
+        return NULL;
+    }
+
+    heap->n = plist->len;
+
+    for (i = 0; i < plist->len; i++)
+    {
+        points = (siridb_points_t *) plist->data[i];
+        heap->src[i].pt = points->data;
+        heap->src[i].end = points->data + points->len;
+    }
+
+    for (i = heap->n / 2; i--;)
+    {
+        POINTS_heap_down(heap, i);
+    }
+
+    return heap;
+}
+
+/*
+ * Move the source at position 'i' down until the heap is restored.
+ */
+static void POINTS_heap_down(points_heap_t * heap, size_t i)
+{
+    points_src_t tmp = heap->src[i];
+    size_t c;
+
+    while ((c = 2 * i + 1) < heap->n)
+    {
+        if (c + 1 < heap->n && heap->src[c + 1].pt->ts < heap->src[c].pt->ts)
         {
-            m = (siridb_points_t **) &plist->data[i];
+            c++;
+        }
+        if (tmp.pt->ts <= heap->src[c].pt->ts)
+        {
+            break;
+        }
+        heap->src[i] = heap->src[c];
+        i = c;
+    }
 
-            points->data[--n] = (*m)->data[(*m)->len];
+    heap->src[i] = tmp;
+}
 
-            if (!(*m)->len--)
-            {
-                siridb_points_free(*m);
-                if (--plist->len)
-                {
-                    *m = (siridb_points_t *) plist->data[plist->len];
-                }
-            }
+/*
+ * Write at most 'max' merged points to 'dest'.
+ *
+ * Points are copied from the top of the heap as long as they are not newer
+ * than the oldest point of both children. This way non overlapping series
+ * are copied without restoring the heap for each point.
+ *
+ * Returns the number of points written to 'dest'.
+ */
+static size_t POINTS_heap_pop(
+        points_heap_t * heap,
+        siridb_point_t * dest,
+        size_t max)
+{
+    points_src_t * top = heap->src;
+    siridb_point_t * start = dest;
+    siridb_point_t * end = dest + max;
+    uint64_t limit;
+    size_t count = 0;
 
-            if (!(n % MAX_ITERATE_MERGE_COUNT))
-            {
-                usleep(3000);
-            }
+    while (heap->n && dest < end)
+    {
+        limit = (heap->n == 1) ? UINT64_MAX : heap->src[1].pt->ts;
+        if (heap->n > 2 && heap->src[2].pt->ts < limit)
+        {
+            limit = heap->src[2].pt->ts;
+        }
+
+        do
+        {
+            *dest = *top->pt;
+            dest++;
+            top->pt++;
+        }
+        while (top->pt < top->end && top->pt->ts <= limit && dest < end);
+
+        if (top->pt == top->end)
+        {
+            *top = heap->src[--heap->n];
+        }
+
+        if (heap->n)
+        {
+            POINTS_heap_down(heap, 0);
+        }
+
+        if (++count % MAX_ITERATE_MERGE_COUNT == 0)
+        {
+            usleep(100);
         }
     }
 
-#ifdef DEBUG
-    /* size should be exactly zero */
-    assert (n == 0);
-#endif
+    return dest - start;
+}
 
-    usleep(5000);
+/*
+ * Destroy the points in 'plist' after merging them, 'plist' is empty
+ * afterwards.
+ */
+/*
+ * Add a column as raw data, compressed when 'cbuf' is not NULL. The buffer
+ * 'cbuf' must be able to hold 'bound' bytes.
+ *
+ * Returns 0 if successful or -1 in case of an error.
+ */
+static int POINTS_pack_column(
+        qp_packer_t * packer,
+        const char * data,
+        size_t size,
+        char * cbuf,
+        int bound)
+{
+    int n;
 
-    if (use_simple_sort)
+    if (cbuf == NULL)
     {
-        POINTS_simple_sort(points);
+        return qp_add_raw(packer, data, size);
     }
-    else
+
+    n = LZ4_compress_default(data, cbuf, (int) size, bound);
+
+    return (n <= 0) ? -1 : qp_add_raw(packer, cbuf, (size_t) n);
+}
+
+static void POINTS_merge_done(slist_t * plist)
+{
+    while (plist->len)
     {
-        qsort(  points->data,
-                points->len,
-                sizeof(siridb_point_t),
-                &POINTS_compare);
+        siridb_points_free((siridb_points_t *) slist_pop(plist));
     }
 }
 
-static inline int POINTS_compare(const void * a, const void * b)
+/*
+ * Free a chain of content blocks. (see siridb_points_content)
+ */
+static void POINTS_content_free(char * block)
 {
-    return (((siridb_point_t *) a)->ts - ((siridb_point_t *) b)->ts);
+    char * next;
+
+    while (block != NULL)
+    {
+        memcpy(&next, block, sizeof(char *));
+        free(block);
+        block = next;
+    }
 }
+
 /*
- * Sort points by time-stamp.
+ * Copy the string values of 'points' to a single content block for the copy
+ * 'cpoints' and update the values of the copy.
  *
- * Warning: this function should only be used in another thread.
+ * Returns 0 if successful or -1 and a SIGNAL is raised in case of an error.
  */
-static void POINTS_simple_sort(siridb_points_t * points)
+static int POINTS_copy_content(
+        siridb_points_t *__restrict cpoints,
+        siridb_points_t *__restrict points)
 {
-    if (points->len < 2)
+    size_t size = 0, n;
+    char * pt;
+
+    for (size_t i = 0; i < points->len; i++)
     {
-        return;  /* nothing to do... */
+        size += strlen(points->data[i].val.raw) + 1;
     }
-    size_t n = 0;
-    size_t i;
-    siridb_point_t * pa, * pb;
-    siridb_point_t tmp;
-    while(++n < points->len)
+
+    if ((pt = siridb_points_content(cpoints, size)) == NULL)
     {
-        pa = points->data + n - 1;
-        pb = points->data + n;
-        if (pa->ts > pb->ts)
-        {
-            tmp = points->data[n];
-            i = n;
-            do
-            {
-                points->data[i] = points->data[i - 1];
-            }
-            while (--i && points->data[i - 1].ts > tmp.ts);
-            points->data[i] = tmp;
+        return -1;
+    }
 
-            usleep(100);
-        }
+    for (size_t i = 0; i < points->len; i++)
+    {
+        n = strlen(points->data[i].val.raw) + 1;
+        memcpy(pt, points->data[i].val.raw, n);
+        cpoints->data[i].val.raw = pt;
+        pt += n;
+    }
+
+    return 0;
+}
+
+/*
+ * Destroy points used by siridb_points_merge_partial(). (any may be NULL)
+ */
+static void POINTS_free_all(
+        siridb_points_t * a,
+        siridb_points_t * b,
+        siridb_points_t * c)
+{
+    if (a != NULL)
+    {
+        siridb_points_free(a);
+    }
+    if (b != NULL)
+    {
+        siridb_points_free(b);
+    }
+    if (c != NULL)
+    {
+        siridb_points_free(c);
+    }
+}
+
+/*
+ * Merge the sorted runs from 'a' up to 'b' and from 'b' up to 'end' into
+ * 'dest'. Points from 'a' are written first when time-stamps are equal.
+ */
+static void POINTS_merge_two(
+        siridb_point_t *__restrict dest,
+        const siridb_point_t * a,
+        const siridb_point_t * b,
+        const siridb_point_t * end)
+{
+    const siridb_point_t * mid = b;
+
+    while (a < mid && b < end)
+    {
+        *dest++ = (b->ts < a->ts) ? *b++ : *a++;
+    }
+
+    memcpy(dest, a, (mid - a) * sizeof(siridb_point_t));
+    dest += mid - a;
+    memcpy(dest, b, (end - b) * sizeof(siridb_point_t));
+}
+
+/*
+ * The multiplier and divisor are constants after inlining so the compiler
+ * uses shifts or a multiply instead of a division and can vectorize.
+ */
+static inline void POINTS_ts_mul(
+        siridb_point_t * point,
+        siridb_point_t * end,
+        const uint64_t mul)
+{
+    for (; point < end; point++)
+    {
+        point->ts *= mul;
+    }
+}
+
+static inline void POINTS_ts_div(
+        siridb_point_t * point,
+        siridb_point_t * end,
+        const uint64_t div)
+{
+    for (; point < end; point++)
+    {
+        point->ts /= div;
     }
 }
@@ -19,7 +19,6 @@
 #include <string.h>
 #include <siri/db/server.h>
 
-
 /*
  * Returns 1 (true) if at least one server in the pool is online, 0 (false)
  * if no server in the pool is online.
@@ -151,6 +150,9 @@ void siridb_pool_add_server(siridb_pool_t * pool, siridb_server_t * server)
  * server in the pool. The package will be send only to one server, even if
  * the pool has more servers 're-indexing'.
  *
+ * When both servers are accessible, the server with the least open promises
+ * is used so the load is divided between a server and its replica.
+ *
  * This function can raise a SIGNAL when allocation errors occur but be aware
  * that 0 can still be returned in this case.
  *
@@ -184,10 +186,27 @@ int siridb_pool_send_pkg(
                 siridb_server_is_accessible(pool->server[i]))
         {
             server = (server == NULL) ?
-                    pool->server[i] : pool->server[rand() % 2];
+                    pool->server[i] :
+                    siridb_pool_least_busy(server, pool->server[i]);
         }
     }
 
     return (server == NULL) ?
             -1: siridb_server_send_pkg(server, pkg, timeout, cb, data, flags);
 }
+
+/*
+ * Returns the server which is expected to respond first or a random server
+ * when both are expected to be equally fast. The open promises are weighted
+ * with the estimated response time of the server, so a degraded server is
+ * avoided even when it has less open promises.
+ */
+siridb_server_t * siridb_pool_least_busy(
+        siridb_server_t * a,
+        siridb_server_t * b)
+{
+    uint64_t ca = (uint64_t) (a->promises->len + 1) * (a->latency + 1);
+    uint64_t cb = (uint64_t) (b->promises->len + 1) * (b->latency + 1);
+
+    return (ca == cb) ? ((rand() % 2) ? a : b) : (ca < cb) ? a : b;
+}
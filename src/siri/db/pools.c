@@ -12,16 +12,25 @@
 #include <assert.h>
 #include <llist/llist.h>
 #include <logger/logger.h>
+#include <siri/db/hedge.h>
 #include <siri/db/pools.h>
 #include <siri/db/server.h>
 #include <siri/net/promises.h>
+#include <siri/net/protocol.h>
 #include <siri/optimize.h>
+#include <siri/siri.h>
 #include <stdlib.h>
 #include <string.h>
 #include <siri/err.h>
 
 static void POOLS_max_pool(siridb_server_t * server, uint16_t * max_pool);
 static void POOLS_arrange(siridb_server_t * server, siridb_t * siridb);
+static int POOLS_send(
+        siridb_pool_t * pool,
+        sirinet_pkg_t * pkg,
+        uint64_t timeout,
+        sirinet_promises_t * promises,
+        int flags);
 
 /*
  * This function can raise an ALLOC signal.
@@ -65,6 +74,7 @@ void siridb_pools_init(siridb_t * siridb)
     for (n = 0; n < siridb->pools->len; n++)
     {
         siridb->pools->pool[n].len = 0;
+        siridb->pools->pool[n].coalesce = NULL;
     }
 
     /* signal can be raised if creating a fifo buffer fails */
@@ -73,7 +83,9 @@ void siridb_pools_init(siridb_t * siridb)
     siridb->pools->prev_lookup = NULL;
 
     /* generate pool lookup for series */
-    siridb->pools->lookup = siridb_lookup_new(siridb->pools->len);
+    siridb->pools->lookup = siridb_lookup_new(
+            siridb->pools->len,
+            siridb->pool_hash);
     if (siridb->pools->lookup == NULL)
     {
         siridb_pools_free(siridb->pools);
@@ -107,7 +119,9 @@ siridb_pool_t * siridb_pools_append(
         siridb_server_t * server)
 {
     siridb_pool_t * pool = NULL;
-    siridb_lookup_t * lookup = siridb_lookup_new(pools->len + 1);
+    siridb_lookup_t * lookup = siridb_lookup_new(
+            pools->len + 1,
+            pools->lookup->hash);
     if (lookup != NULL)
     {
         pool = (siridb_pool_t *)
@@ -122,6 +136,7 @@ siridb_pool_t * siridb_pools_append(
             pools->pool = pool;
             pool = &pools->pool[pools->len];
             pool->len = 0;
+            pool->coalesce = NULL;
             siridb_pool_add_server(pool, server);
             pools->len++;
 #ifdef DEBUG
@@ -202,6 +217,8 @@ int siridb_pools_accessible(siridb_t * siridb)
  *
  * If promises could not be created, the 'cb' function with cb(NULL, data)
  *
+ * An optional 'each' function is called for each response. (may be NULL)
+ *
  * Note that 'pkg->pid' will be overwritten with a new package id and pkg
  * will always be destroyed.
  */
@@ -210,6 +227,7 @@ void siridb_pools_send_pkg(
         sirinet_pkg_t * pkg,
         uint64_t timeout,
         sirinet_promises_cb cb,
+        sirinet_promises_each_cb each,
         void * data,
         int flags)
 {
@@ -225,6 +243,8 @@ void siridb_pools_send_pkg(
     {
         siridb_pool_t * pool;
 
+        promises->each = each;
+
         for (uint16_t pid = 0; pid < siridb->pools->len; pid++)
         {
             if (pid == siridb->server->pool)
@@ -234,13 +254,7 @@ void siridb_pools_send_pkg(
 
             pool = siridb->pools->pool + pid;
 
-            if (siridb_pool_send_pkg(
-                    pool,
-                    pkg,
-                    timeout,
-                    sirinet_promises_on_response,
-                    promises,
-                    FLAG_KEEP_PKG | flags))
+            if (POOLS_send(pool, pkg, timeout, promises, flags))
             {
                 log_debug(
                         "Cannot send package to pool '%u' "
@@ -265,6 +279,8 @@ void siridb_pools_send_pkg(
  *
  * If promises could not be created, the 'cb' function with cb(NULL, data)
  *
+ * An optional 'each' function is called for each response. (may be NULL)
+ *
  * Note that 'pkg->pid' will be overwritten with a new package id and pkg
  * will always be destroyed.
  */
@@ -273,6 +289,7 @@ void siridb_pools_send_pkg_2some(
         sirinet_pkg_t * pkg,
         uint64_t timeout,
         sirinet_promises_cb cb,
+        sirinet_promises_each_cb each,
         void * data,
         int flags)
 {
@@ -288,17 +305,13 @@ void siridb_pools_send_pkg_2some(
     {
         siridb_pool_t * pool;
 
+        promises->each = each;
+
         for (size_t i = 0; i < slist->len; i++)
         {
             pool = slist->data[i];
 
-            if (siridb_pool_send_pkg(
-                    pool,
-                    pkg,
-                    timeout,
-                    sirinet_promises_on_response,
-                    promises,
-                    FLAG_KEEP_PKG | flags))
+            if (POOLS_send(pool, pkg, timeout, promises, flags))
             {
                 log_debug(
                         "Cannot send package to at least on pool "
@@ -311,6 +324,30 @@ void siridb_pools_send_pkg_2some(
     }
 }
 
+/*
+ * Send a package to one server in a pool for siridb_pools_send_pkg() and
+ * siridb_pools_send_pkg_2some(). Queries are hedged when query_hedge_delay
+ * is set.
+ *
+ * Returns 0 if successful or -1 if the package could not be sent.
+ */
+static int POOLS_send(
+        siridb_pool_t * pool,
+        sirinet_pkg_t * pkg,
+        uint64_t timeout,
+        sirinet_promises_t * promises,
+        int flags)
+{
+    return (pkg->tp == BPROTO_QUERY_SERVER && siri.cfg->query_hedge_delay) ?
+            siridb_hedge_send(pool, pkg, timeout, promises, flags) :
+            siridb_pool_send_pkg(
+                    pool,
+                    pkg,
+                    timeout,
+                    sirinet_promises_on_response,
+                    promises,
+                    FLAG_KEEP_PKG | flags);
+}
 
 static void POOLS_max_pool(siridb_server_t * server, uint16_t * max_pool)
 {
@@ -12,12 +12,20 @@
 #include <assert.h>
 #include <logger/logger.h>
 #include <procinfo/procinfo.h>
+#include <siri/alloc.h>
 #include <siri/db/initsync.h>
 #include <siri/db/props.h>
 #include <siri/db/reindex.h>
+#include <siri/db/startup.h>
 #include <siri/db/time.h>
 #include <siri/grammar/grammar.h>
 #include <siri/db/fifo.h>
+#include <siri/db/hot.h>
+#include <siri/latency.h>
+#include <siri/loop.h>
+#include <siri/mem.h>
+#include <siri/mutex.h>
+#include <siri/optimize.h>
 #include <siri/siri.h>
 #include <siri/version.h>
 #include <stdio.h>
@@ -38,6 +46,10 @@ static void prop_active_handles(
         siridb_t * siridb,
         qp_packer_t * packer,
         int map);
+static void prop_allocator(
+        siridb_t * siridb,
+        qp_packer_t * packer,
+        int map);
 static void prop_buffer_path(
         siridb_t * siridb,
         qp_packer_t * packer,
@@ -46,6 +58,18 @@ static void prop_buffer_size(
         siridb_t * siridb,
         qp_packer_t * packer,
         int map);
+static void prop_chunk_cache_hits(
+        siridb_t * siridb,
+        qp_packer_t * packer,
+        int map);
+static void prop_chunk_cache_misses(
+        siridb_t * siridb,
+        qp_packer_t * packer,
+        int map);
+static void prop_chunk_cache_usage(
+        siridb_t * siridb,
+        qp_packer_t * packer,
+        int map);
 static void prop_dbname(
         siridb_t * siridb,
         qp_packer_t * packer,
@@ -66,14 +90,50 @@ static void prop_duration_num(
         siridb_t * siridb,
         qp_packer_t * packer,
         int map);
+static void prop_expiration_log(
+        siridb_t * siridb,
+        qp_packer_t * packer,
+        int map);
+static void prop_expiration_num(
+        siridb_t * siridb,
+        qp_packer_t * packer,
+        int map);
 static void prop_fifo_files(
         siridb_t * siridb,
         qp_packer_t * packer,
         int map);
+static void prop_file_handle_evictions(
+        siridb_t * siridb,
+        qp_packer_t * packer,
+        int map);
+static void prop_file_handle_hits(
+        siridb_t * siridb,
+        qp_packer_t * packer,
+        int map);
+static void prop_file_handle_opens(
+        siridb_t * siridb,
+        qp_packer_t * packer,
+        int map);
+static void prop_hot_series(
+        siridb_t * siridb,
+        qp_packer_t * packer,
+        int map);
+static void prop_insert_queue(
+        siridb_t * siridb,
+        qp_packer_t * packer,
+        int map);
+static void prop_insert_queue_size(
+        siridb_t * siridb,
+        qp_packer_t * packer,
+        int map);
 static void prop_ip_support(
         siridb_t * siridb,
         qp_packer_t * packer,
         int map);
+static void prop_latency(
+        siridb_t * siridb,
+        qp_packer_t * packer,
+        int map);
 static void prop_libuv(
         siridb_t * siridb,
         qp_packer_t * packer,
@@ -82,14 +142,50 @@ static void prop_list_limit(
         siridb_t * siridb,
         qp_packer_t * packer,
         int map);
+static void prop_lock_contention(
+        siridb_t * siridb,
+        qp_packer_t * packer,
+        int map);
 static void prop_log_level(
         siridb_t * siridb,
         qp_packer_t * packer,
         int map);
+static void prop_loop(
+        siridb_t * siridb,
+        qp_packer_t * packer,
+        int map);
 static void prop_max_open_files(
         siridb_t * siridb,
         qp_packer_t * packer,
         int map);
+static void prop_mem_buffer(
+        siridb_t * siridb,
+        qp_packer_t * packer,
+        int map);
+static void prop_mem_groups(
+        siridb_t * siridb,
+        qp_packer_t * packer,
+        int map);
+static void prop_mem_insert(
+        siridb_t * siridb,
+        qp_packer_t * packer,
+        int map);
+static void prop_mem_net(
+        siridb_t * siridb,
+        qp_packer_t * packer,
+        int map);
+static void prop_mem_query(
+        siridb_t * siridb,
+        qp_packer_t * packer,
+        int map);
+static void prop_mem_series(
+        siridb_t * siridb,
+        qp_packer_t * packer,
+        int map);
+static void prop_mem_shard(
+        siridb_t * siridb,
+        qp_packer_t * packer,
+        int map);
 static void prop_mem_usage(
         siridb_t * siridb,
         qp_packer_t * packer,
@@ -98,6 +194,10 @@ static void prop_open_files(
         siridb_t * siridb,
         qp_packer_t * packer,
         int map);
+static void prop_optimize_progress(
+        siridb_t * siridb,
+        qp_packer_t * packer,
+        int map);
 static void prop_pool(
         siridb_t * siridb,
         qp_packer_t * packer,
@@ -122,6 +222,10 @@ static void prop_server(
         siridb_t * siridb,
         qp_packer_t * packer,
         int map);
+static void prop_startup_profile(
+        siridb_t * siridb,
+        qp_packer_t * packer,
+        int map);
 static void prop_startup_time(
         siridb_t * siridb,
         qp_packer_t * packer,
@@ -168,10 +272,18 @@ void siridb_init_props(void)
 
     siridb_props[CLERI_GID_K_ACTIVE_HANDLES - KW_OFFSET] =
             prop_active_handles;
+    siridb_props[CLERI_GID_K_ALLOCATOR - KW_OFFSET] =
+            prop_allocator;
     siridb_props[CLERI_GID_K_BUFFER_PATH - KW_OFFSET] =
             prop_buffer_path;
     siridb_props[CLERI_GID_K_BUFFER_SIZE - KW_OFFSET] =
             prop_buffer_size;
+    siridb_props[CLERI_GID_K_CHUNK_CACHE_HITS - KW_OFFSET] =
+            prop_chunk_cache_hits;
+    siridb_props[CLERI_GID_K_CHUNK_CACHE_MISSES - KW_OFFSET] =
+            prop_chunk_cache_misses;
+    siridb_props[CLERI_GID_K_CHUNK_CACHE_USAGE - KW_OFFSET] =
+            prop_chunk_cache_usage;
     siridb_props[CLERI_GID_K_DBNAME - KW_OFFSET] =
             prop_dbname;
     siridb_props[CLERI_GID_K_DBPATH - KW_OFFSET] =
@@ -182,22 +294,60 @@ void siridb_init_props(void)
             prop_duration_log;
     siridb_props[CLERI_GID_K_DURATION_NUM - KW_OFFSET] =
             prop_duration_num;
+    siridb_props[CLERI_GID_K_EXPIRATION_LOG - KW_OFFSET] =
+            prop_expiration_log;
+    siridb_props[CLERI_GID_K_EXPIRATION_NUM - KW_OFFSET] =
+            prop_expiration_num;
     siridb_props[CLERI_GID_K_FIFO_FILES - KW_OFFSET] =
             prop_fifo_files;
+    siridb_props[CLERI_GID_K_FILE_HANDLE_EVICTIONS - KW_OFFSET] =
+            prop_file_handle_evictions;
+    siridb_props[CLERI_GID_K_FILE_HANDLE_HITS - KW_OFFSET] =
+            prop_file_handle_hits;
+    siridb_props[CLERI_GID_K_FILE_HANDLE_OPENS - KW_OFFSET] =
+            prop_file_handle_opens;
+    siridb_props[CLERI_GID_K_HOT_SERIES - KW_OFFSET] =
+            prop_hot_series;
+    siridb_props[CLERI_GID_K_INSERT_QUEUE - KW_OFFSET] =
+            prop_insert_queue;
+    siridb_props[CLERI_GID_K_INSERT_QUEUE_SIZE - KW_OFFSET] =
+            prop_insert_queue_size;
     siridb_props[CLERI_GID_K_IP_SUPPORT - KW_OFFSET] =
             prop_ip_support;
+    siridb_props[CLERI_GID_K_LATENCY - KW_OFFSET] =
+            prop_latency;
     siridb_props[CLERI_GID_K_LIBUV - KW_OFFSET] =
             prop_libuv;
     siridb_props[CLERI_GID_K_LIST_LIMIT - KW_OFFSET] =
             prop_list_limit;
+    siridb_props[CLERI_GID_K_LOCK_CONTENTION - KW_OFFSET] =
+            prop_lock_contention;
+    siridb_props[CLERI_GID_K_LOOP - KW_OFFSET] =
+            prop_loop;
     siridb_props[CLERI_GID_K_MAX_OPEN_FILES - KW_OFFSET] =
             prop_max_open_files;
+    siridb_props[CLERI_GID_K_MEM_BUFFER - KW_OFFSET] =
+            prop_mem_buffer;
+    siridb_props[CLERI_GID_K_MEM_GROUPS - KW_OFFSET] =
+            prop_mem_groups;
+    siridb_props[CLERI_GID_K_MEM_INSERT - KW_OFFSET] =
+            prop_mem_insert;
+    siridb_props[CLERI_GID_K_MEM_NET - KW_OFFSET] =
+            prop_mem_net;
+    siridb_props[CLERI_GID_K_MEM_QUERY - KW_OFFSET] =
+            prop_mem_query;
+    siridb_props[CLERI_GID_K_MEM_SERIES - KW_OFFSET] =
+            prop_mem_series;
+    siridb_props[CLERI_GID_K_MEM_SHARD - KW_OFFSET] =
+            prop_mem_shard;
     siridb_props[CLERI_GID_K_MEM_USAGE - KW_OFFSET] =
             prop_mem_usage;
     siridb_props[CLERI_GID_K_LOG_LEVEL - KW_OFFSET] =
             prop_log_level;
     siridb_props[CLERI_GID_K_OPEN_FILES - KW_OFFSET] =
             prop_open_files;
+    siridb_props[CLERI_GID_K_OPTIMIZE_PROGRESS - KW_OFFSET] =
+            prop_optimize_progress;
     siridb_props[CLERI_GID_K_POOL - KW_OFFSET] =
             prop_pool;
     siridb_props[CLERI_GID_K_RECEIVED_POINTS - KW_OFFSET] =
@@ -210,6 +360,8 @@ void siridb_init_props(void)
             prop_select_points_limit;
     siridb_props[CLERI_GID_K_SERVER - KW_OFFSET] =
             prop_server;
+    siridb_props[CLERI_GID_K_STARTUP_PROFILE - KW_OFFSET] =
+            prop_startup_profile;
     siridb_props[CLERI_GID_K_STARTUP_TIME - KW_OFFSET] =
             prop_startup_time;
     siridb_props[CLERI_GID_K_STATUS - KW_OFFSET] =
@@ -239,6 +391,17 @@ static void prop_active_handles(
     qp_add_int32(packer, (int32_t) siri.loop->active_handles);
 }
 
+static void prop_allocator(
+        siridb_t * siridb __attribute__((unused)),
+        qp_packer_t * packer,
+        int map)
+{
+    SIRIDB_PROP_MAP("allocator", 9)
+    char * allocator = siri_alloc_summary();
+    qp_add_string(packer, (allocator == NULL) ? "" : allocator);
+    free(allocator);
+}
+
 static void prop_buffer_path(
         siridb_t * siridb,
         qp_packer_t * packer,
@@ -257,6 +420,33 @@ static void prop_buffer_size(
     qp_add_int32(packer, (int32_t) siridb->buffer_size);
 }
 
+static void prop_chunk_cache_hits(
+        siridb_t * siridb __attribute__((unused)),
+        qp_packer_t * packer,
+        int map)
+{
+    SIRIDB_PROP_MAP("chunk_cache_hits", 16)
+    qp_add_int64(packer, (int64_t) siri.ccache->hits);
+}
+
+static void prop_chunk_cache_misses(
+        siridb_t * siridb __attribute__((unused)),
+        qp_packer_t * packer,
+        int map)
+{
+    SIRIDB_PROP_MAP("chunk_cache_misses", 18)
+    qp_add_int64(packer, (int64_t) siri.ccache->misses);
+}
+
+static void prop_chunk_cache_usage(
+        siridb_t * siridb __attribute__((unused)),
+        qp_packer_t * packer,
+        int map)
+{
+    SIRIDB_PROP_MAP("chunk_cache_usage", 17)
+    qp_add_int64(packer, (int64_t) siri.ccache->size);
+}
+
 static void prop_dbname(
         siridb_t * siridb,
         qp_packer_t * packer,
@@ -302,6 +492,24 @@ static void prop_duration_num(
     qp_add_int64(packer, (int64_t) siridb->duration_num);
 }
 
+static void prop_expiration_log(
+        siridb_t * siridb,
+        qp_packer_t * packer,
+        int map)
+{
+    SIRIDB_PROP_MAP("expiration_log", 14)
+    qp_add_int64(packer, (int64_t) siridb->expiration_log);
+}
+
+static void prop_expiration_num(
+        siridb_t * siridb,
+        qp_packer_t * packer,
+        int map)
+{
+    SIRIDB_PROP_MAP("expiration_num", 14)
+    qp_add_int64(packer, (int64_t) siridb->expiration_num);
+}
+
 static void prop_fifo_files(
         siridb_t * siridb,
         qp_packer_t * packer,
@@ -311,6 +519,62 @@ static void prop_fifo_files(
     qp_add_int32(packer, (int32_t) siridb_fifo_size(siridb->fifo));
 }
 
+static void prop_file_handle_evictions(
+        siridb_t * siridb __attribute__((unused)),
+        qp_packer_t * packer,
+        int map)
+{
+    SIRIDB_PROP_MAP("file_handle_evictions", 21)
+    qp_add_int64(packer, (int64_t) siri.fh->evictions);
+}
+
+static void prop_file_handle_hits(
+        siridb_t * siridb __attribute__((unused)),
+        qp_packer_t * packer,
+        int map)
+{
+    SIRIDB_PROP_MAP("file_handle_hits", 16)
+    qp_add_int64(packer, (int64_t) siri.fh->hits);
+}
+
+static void prop_file_handle_opens(
+        siridb_t * siridb __attribute__((unused)),
+        qp_packer_t * packer,
+        int map)
+{
+    SIRIDB_PROP_MAP("file_handle_opens", 17)
+    qp_add_int64(packer, (int64_t) siri.fh->opens);
+}
+
+static void prop_hot_series(
+        siridb_t * siridb,
+        qp_packer_t * packer,
+        int map)
+{
+    SIRIDB_PROP_MAP("hot_series", 10)
+    char * hot = siridb_hot_summary(siridb);
+    qp_add_string(packer, (hot == NULL) ? "" : hot);
+    free(hot);
+}
+
+static void prop_insert_queue(
+        siridb_t * siridb,
+        qp_packer_t * packer,
+        int map)
+{
+    SIRIDB_PROP_MAP("insert_queue", 12)
+    qp_add_int64(packer, (int64_t) siridb->insert_queue);
+}
+
+static void prop_insert_queue_size(
+        siridb_t * siridb,
+        qp_packer_t * packer,
+        int map)
+{
+    SIRIDB_PROP_MAP("insert_queue_size", 17)
+    qp_add_int64(packer, (int64_t) siridb->insert_queue_size);
+}
+
 static void prop_ip_support(
         siridb_t * siridb __attribute__((unused)),
         qp_packer_t * packer,
@@ -320,6 +584,17 @@ static void prop_ip_support(
     qp_add_string(packer, sirinet_socket_ip_support_str(siri.cfg->ip_support));
 }
 
+static void prop_latency(
+        siridb_t * siridb __attribute__((unused)),
+        qp_packer_t * packer,
+        int map)
+{
+    SIRIDB_PROP_MAP("latency", 7)
+    char * latency = siri_latency_summary();
+    qp_add_string(packer, (latency == NULL) ? "" : latency);
+    free(latency);
+}
+
 static void prop_libuv(
         siridb_t * siridb __attribute__((unused)),
         qp_packer_t * packer,
@@ -338,6 +613,17 @@ static void prop_list_limit(
     qp_add_int64(packer, (int64_t) siridb->list_limit);
 }
 
+static void prop_lock_contention(
+        siridb_t * siridb __attribute__((unused)),
+        qp_packer_t * packer,
+        int map)
+{
+    SIRIDB_PROP_MAP("lock_contention", 15)
+    char * contention = siri_mutex_summary();
+    qp_add_string(packer, (contention == NULL) ? "" : contention);
+    free(contention);
+}
+
 static void prop_log_level(
         siridb_t * siridb __attribute__((unused)),
         qp_packer_t * packer,
@@ -347,6 +633,17 @@ static void prop_log_level(
     qp_add_string(packer, Logger.level_name);
 }
 
+static void prop_loop(
+        siridb_t * siridb __attribute__((unused)),
+        qp_packer_t * packer,
+        int map)
+{
+    SIRIDB_PROP_MAP("loop", 4)
+    char * loop = siri_loop_summary();
+    qp_add_string(packer, (loop == NULL) ? "" : loop);
+    free(loop);
+}
+
 static void prop_max_open_files(
         siridb_t * siridb __attribute__((unused)),
         qp_packer_t * packer,
@@ -356,6 +653,69 @@ static void prop_max_open_files(
     qp_add_int32(packer, (int32_t) siri.cfg->max_open_files);
 }
 
+static void prop_mem_buffer(
+        siridb_t * siridb __attribute__((unused)),
+        qp_packer_t * packer,
+        int map)
+{
+    SIRIDB_PROP_MAP("mem_buffer", 10)
+    qp_add_int64(packer, (int64_t) siri_mem_get(SIRI_MEM_BUFFER));
+}
+
+static void prop_mem_groups(
+        siridb_t * siridb __attribute__((unused)),
+        qp_packer_t * packer,
+        int map)
+{
+    SIRIDB_PROP_MAP("mem_groups", 10)
+    qp_add_int64(packer, (int64_t) siri_mem_get(SIRI_MEM_GROUPS));
+}
+
+static void prop_mem_insert(
+        siridb_t * siridb __attribute__((unused)),
+        qp_packer_t * packer,
+        int map)
+{
+    SIRIDB_PROP_MAP("mem_insert", 10)
+    qp_add_int64(packer, (int64_t) siri_mem_get(SIRI_MEM_INSERT));
+}
+
+static void prop_mem_net(
+        siridb_t * siridb __attribute__((unused)),
+        qp_packer_t * packer,
+        int map)
+{
+    SIRIDB_PROP_MAP("mem_net", 7)
+    qp_add_int64(packer, (int64_t) siri_mem_get(SIRI_MEM_NET));
+}
+
+static void prop_mem_query(
+        siridb_t * siridb __attribute__((unused)),
+        qp_packer_t * packer,
+        int map)
+{
+    SIRIDB_PROP_MAP("mem_query", 9)
+    qp_add_int64(packer, (int64_t) siri_mem_get(SIRI_MEM_QUERY));
+}
+
+static void prop_mem_series(
+        siridb_t * siridb __attribute__((unused)),
+        qp_packer_t * packer,
+        int map)
+{
+    SIRIDB_PROP_MAP("mem_series", 10)
+    qp_add_int64(packer, (int64_t) siri_mem_get(SIRI_MEM_SERIES));
+}
+
+static void prop_mem_shard(
+        siridb_t * siridb __attribute__((unused)),
+        qp_packer_t * packer,
+        int map)
+{
+    SIRIDB_PROP_MAP("mem_shard", 9)
+    qp_add_int64(packer, (int64_t) siri_mem_get(SIRI_MEM_SHARD));
+}
+
 static void prop_mem_usage(
         siridb_t * siridb __attribute__((unused)),
         qp_packer_t * packer,
@@ -374,6 +734,17 @@ static void prop_open_files(
     qp_add_int32(packer, (int32_t) siridb_open_files(siridb));
 }
 
+static void prop_optimize_progress(
+        siridb_t * siridb __attribute__((unused)),
+        qp_packer_t * packer,
+        int map)
+{
+    SIRIDB_PROP_MAP("optimize_progress", 17)
+    char * progress = siri_optimize_summary();
+    qp_add_string(packer, (progress == NULL) ? "" : progress);
+    free(progress);
+}
+
 static void prop_pool(
         siridb_t * siridb,
         qp_packer_t * packer,
@@ -428,6 +799,17 @@ static void prop_server(
     qp_add_string(packer, siridb->server->name);
 }
 
+static void prop_startup_profile(
+        siridb_t * siridb,
+        qp_packer_t * packer,
+        int map)
+{
+    SIRIDB_PROP_MAP("startup_profile", 15)
+    char * profile = siridb_startup_summary(siridb);
+    qp_add_string(packer, (profile == NULL) ? "" : profile);
+    free(profile);
+}
+
 static void prop_startup_time(
         siridb_t * siridb __attribute__((unused)),
         qp_packer_t * packer,
@@ -0,0 +1,312 @@
+/*
+ * qcache.c - Cache for select query results.
+ *
+ * author       : Jeroen van der Heijden
+ * email        : jeroen@transceptor.technology
+ * copyright    : 2016, Transceptor Technology
+ *
+ * Dashboards tend to send the same select queries over and over again while
+ * most of the selected series did not receive new points. This cache holds
+ * the packed result for such queries so they can be answered by copying the
+ * result.
+ *
+ * Entries are identified by the normalized query, which is the query with
+ * all time expressions replaced by their values, and the time precision
+ * factor. An entry stores the data version of the database from before the
+ * series were read together with the selected series ids. The entry is only
+ * valid when the same series are selected and none of them has a version
+ * newer than the entry. (series versions are updated on each write)
+ *
+ * The cache is only used by the main thread. When the cache is full the
+ * least recently used entries are removed.
+ *
+ * changes
+ *  - initial version, 14-10-2016
+ *
+ */
+#include <logger/logger.h>
+#include <siri/db/qcache.h>
+#include <siri/db/series.h>
+#include <siri/err.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define QCACHE_ENTRY_SZ(entry)          \
+    (sizeof(siridb_qcache_entry_t) +    \
+    strlen((entry)->key) + 1 +          \
+    (entry)->n * sizeof(uint32_t) +     \
+    (entry)->len)
+
+static int QCACHE_is_valid(siridb_qcache_entry_t * entry, slist_t * slist);
+static void QCACHE_unlink(
+        siridb_qcache_t * qcache,
+        siridb_qcache_entry_t * entry);
+
+/*
+ * Returns NULL and raises a SIGNAL in case an error has occurred.
+ */
+siridb_qcache_t * siridb_qcache_new(size_t max_size)
+{
+    siridb_qcache_t * qcache =
+            (siridb_qcache_t *) calloc(1, sizeof(siridb_qcache_t));
+    if (qcache == NULL)
+    {
+        ERR_ALLOC
+    }
+    else
+    {
+        qcache->max_size = max_size;
+        qcache->entries = ct_new();
+        if (qcache->entries == NULL)
+        {
+            ERR_ALLOC
+            free(qcache);
+            qcache = NULL;
+        }
+    }
+    return qcache;
+}
+
+void siridb_qcache_free(siridb_qcache_t * qcache)
+{
+    if (qcache == NULL)
+    {
+        return;
+    }
+
+    ct_free(qcache->entries, (ct_free_cb) &siridb_qcache_entry_free);
+    free(qcache);
+}
+
+/*
+ * Returns the cached entry for 'key' and 'factor' or NULL when not found or
+ * when the entry is no longer valid for the series in 'slist'. Stale entries
+ * are removed from the cache.
+ *
+ * Argument 'slist' must contain the selected series, sorted by id.
+ */
+siridb_qcache_entry_t * siridb_qcache_get(
+        siridb_qcache_t * qcache,
+        const char * key,
+        float factor,
+        slist_t * slist)
+{
+    siridb_qcache_entry_t * entry =
+            (siridb_qcache_entry_t *) ct_get(qcache->entries, key);
+
+    if (entry == NULL)
+    {
+        qcache->misses++;
+        return NULL;
+    }
+
+    if (entry->factor != factor || !QCACHE_is_valid(entry, slist))
+    {
+        QCACHE_unlink(qcache, entry);
+        siridb_qcache_entry_free(entry);
+        qcache->misses++;
+        return NULL;
+    }
+
+    /* move the entry to the head of the list */
+    if (entry != qcache->head)
+    {
+        entry->prev->next = entry->next;
+        if (entry->next == NULL)
+        {
+            qcache->tail = entry->prev;
+        }
+        else
+        {
+            entry->next->prev = entry->prev;
+        }
+        entry->prev = NULL;
+        entry->next = qcache->head;
+        qcache->head->prev = entry;
+        qcache->head = entry;
+    }
+
+    qcache->hits++;
+    return entry;
+}
+
+/*
+ * Returns a new entry without a result or NULL when allocation has failed.
+ * The 'version' should be the data version of the database before reading
+ * the series in 'slist'.
+ *
+ * The cache is not critical so a memory error is logged but not raised.
+ */
+siridb_qcache_entry_t * siridb_qcache_entry_new(
+        const char * key,
+        float factor,
+        uint64_t version,
+        slist_t * slist)
+{
+    siridb_qcache_entry_t * entry =
+            (siridb_qcache_entry_t *) malloc(sizeof(siridb_qcache_entry_t));
+
+    if (entry == NULL)
+    {
+        log_error("Cannot allocate an entry for the query cache");
+        return NULL;
+    }
+
+    entry->factor = factor;
+    entry->version = version;
+    entry->n = slist->len;
+    entry->len = 0;
+    entry->data = NULL;
+    entry->prev = NULL;
+    entry->next = NULL;
+    entry->key = strdup(key);
+    entry->ids = (uint32_t *) malloc(slist->len * sizeof(uint32_t));
+
+    if (entry->key == NULL || (entry->ids == NULL && slist->len))
+    {
+        log_error("Cannot allocate an entry for the query cache");
+        siridb_qcache_entry_free(entry);
+        return NULL;
+    }
+
+    for (size_t i = 0; i < slist->len; i++)
+    {
+        entry->ids[i] = ((siridb_series_t *) slist->data[i])->id;
+    }
+
+    return entry;
+}
+
+void siridb_qcache_entry_free(siridb_qcache_entry_t * entry)
+{
+    if (entry != NULL)
+    {
+        free(entry->key);
+        free(entry->ids);
+        free(entry->data);
+        free(entry);
+    }
+}
+
+/*
+ * Store the packed result 'data' for 'entry'. The data is copied and the
+ * cache takes ownership of the entry, an existing entry for the same key is
+ * replaced. Least recently used entries are removed to make room.
+ *
+ * The cache is not critical so when allocating memory fails the result is
+ * simply not cached.
+ */
+void siridb_qcache_set(
+        siridb_qcache_t * qcache,
+        siridb_qcache_entry_t * entry,
+        const char * data,
+        size_t len)
+{
+    siridb_qcache_entry_t * tmp;
+    size_t size;
+
+    entry->data = (char *) malloc(len);
+    if (entry->data == NULL && len)
+    {
+        siridb_qcache_entry_free(entry);
+        return;
+    }
+    memcpy(entry->data, data, len);
+    entry->len = len;
+
+    size = QCACHE_ENTRY_SZ(entry);
+    if (size > qcache->max_size)
+    {
+        siridb_qcache_entry_free(entry);
+        return;
+    }
+
+    tmp = (siridb_qcache_entry_t *) ct_get(qcache->entries, entry->key);
+    if (tmp != NULL)
+    {
+        QCACHE_unlink(qcache, tmp);
+        siridb_qcache_entry_free(tmp);
+    }
+
+    while (qcache->size + size > qcache->max_size)
+    {
+        tmp = qcache->tail;
+        QCACHE_unlink(qcache, tmp);
+        siridb_qcache_entry_free(tmp);
+    }
+
+    if (ct_add(qcache->entries, entry->key, entry))
+    {
+        siridb_qcache_entry_free(entry);
+        return;
+    }
+
+    entry->prev = NULL;
+    entry->next = qcache->head;
+    if (qcache->head == NULL)
+    {
+        qcache->tail = entry;
+    }
+    else
+    {
+        qcache->head->prev = entry;
+    }
+    qcache->head = entry;
+
+    qcache->size += size;
+}
+
+/*
+ * Returns 1 when 'slist' contains the same series as the entry and none of
+ * the series is written after the entry was created, 0 otherwise.
+ */
+static int QCACHE_is_valid(siridb_qcache_entry_t * entry, slist_t * slist)
+{
+    siridb_series_t * series;
+
+    if (entry->n != slist->len)
+    {
+        return 0;
+    }
+
+    for (size_t i = 0; i < slist->len; i++)
+    {
+        series = (siridb_series_t *) slist->data[i];
+        if (series->id != entry->ids[i] || series->version > entry->version)
+        {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+/*
+ * Remove an entry from the lookup and the list but do not free the entry.
+ */
+static void QCACHE_unlink(
+        siridb_qcache_t * qcache,
+        siridb_qcache_entry_t * entry)
+{
+    ct_pop(qcache->entries, entry->key);
+
+    if (entry->prev == NULL)
+    {
+        qcache->head = entry->next;
+    }
+    else
+    {
+        entry->prev->next = entry->next;
+    }
+
+    if (entry->next == NULL)
+    {
+        qcache->tail = entry->prev;
+    }
+    else
+    {
+        entry->next->prev = entry->prev;
+    }
+
+    qcache->size -= QCACHE_ENTRY_SZ(entry);
+}
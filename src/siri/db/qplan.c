@@ -0,0 +1,546 @@
+/*
+ * qplan.c - Cache for parsed queries.
+ *
+ * author       : Jeroen van der Heijden
+ * email        : jeroen@transceptor.technology
+ * copyright    : 2016, Transceptor Technology
+ *
+ * Monitoring tools send the same queries over and over again where only the
+ * time window changes. Parsing such a query with the full grammar is
+ * relatively expensive so the parse trees for these queries are kept.
+ *
+ * Plans are identified by the query where each integer literal outside a
+ * string or regular expression is replaced by a '?'. When a query has the
+ * same key, the tree of the plan is moved to the new query text: strings in
+ * the tree are pointed to the new text and regular expressions containing a
+ * literal are checked against the new text. If a regular expression does not
+ * match exactly the same part, the query is parsed as usual.
+ *
+ * A tree is walked again for each query since the walker evaluates the time
+ * expressions and creates the list of nodes. While a query is using a tree,
+ * the plan cannot be used by another query or be removed.
+ *
+ * Only select, list and count queries are cached. Plans are used on the main
+ * thread only.
+ *
+ * changes
+ *  - initial version, 14-10-2016
+ *
+ */
+#include <ctype.h>
+#include <logger/logger.h>
+#include <pcre.h>
+#include <siri/db/qplan.h>
+#include <siri/err.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define QPLAN_IS_NAME_CHR(c) (isalnum((unsigned char) (c)) || (c) == '_')
+
+typedef struct qplan_ctx_s
+{
+    const char * old_q;
+    size_t old_len;
+    const char * new_q;
+    size_t new_len;
+    siridb_qplan_lit_t * old_lits;
+    siridb_qplan_lit_t * new_lits;
+    size_t n;
+} qplan_ctx_t;
+
+static char * QPLAN_key(
+        const char * q,
+        size_t len,
+        siridb_qplan_lit_t ** lits,
+        size_t * n);
+static size_t QPLAN_map(qplan_ctx_t * ctx, size_t pos);
+static int QPLAN_check(qplan_ctx_t * ctx, cleri_node_t * node);
+static void QPLAN_rebase(qplan_ctx_t * ctx, cleri_node_t * node);
+static void QPLAN_unlink(siridb_qplans_t * qplans, siridb_qplan_t * plan);
+static void QPLAN_free(siridb_qplan_t * plan);
+
+/*
+ * Returns NULL and raises a SIGNAL in case an error has occurred.
+ */
+siridb_qplans_t * siridb_qplans_new(size_t max_len)
+{
+    siridb_qplans_t * qplans =
+            (siridb_qplans_t *) calloc(1, sizeof(siridb_qplans_t));
+    if (qplans == NULL)
+    {
+        ERR_ALLOC
+    }
+    else
+    {
+        qplans->max_len = max_len;
+        qplans->plans = ct_new();
+        if (qplans->plans == NULL)
+        {
+            ERR_ALLOC
+            free(qplans);
+            qplans = NULL;
+        }
+    }
+    return qplans;
+}
+
+/*
+ * Plans should not be in use when the cache is destroyed.
+ */
+void siridb_qplans_free(siridb_qplans_t * qplans)
+{
+    if (qplans == NULL)
+    {
+        return;
+    }
+
+    ct_free(qplans->plans, (ct_free_cb) &QPLAN_free);
+    free(qplans);
+}
+
+/*
+ * Returns a plan with a parse tree for query 'q' or NULL when no usable plan
+ * is found. The returned plan is in use and must be given back using
+ * siridb_qplans_release() when the query is finished.
+ */
+siridb_qplan_t * siridb_qplans_get(siridb_qplans_t * qplans, const char * q)
+{
+    siridb_qplan_t * plan;
+    siridb_qplan_lit_t * lits;
+    qplan_ctx_t ctx;
+    size_t n;
+    size_t len = strlen(q);
+    char * key = QPLAN_key(q, len, &lits, &n);
+    char * dup;
+
+    if (key == NULL)
+    {
+        return NULL;
+    }
+
+    plan = (siridb_qplan_t *) ct_get(qplans->plans, key);
+
+    free(key);
+
+    if (plan == NULL || plan->in_use || (dup = strdup(q)) == NULL)
+    {
+        free(lits);
+        qplans->misses++;
+        return NULL;
+    }
+
+    ctx.old_q = plan->q;
+    ctx.old_len = plan->len;
+    ctx.new_q = dup;
+    ctx.new_len = len;
+    ctx.old_lits = plan->lits;
+    ctx.new_lits = lits;
+    ctx.n = n;
+
+    if (QPLAN_check(&ctx, plan->pr->tree))
+    {
+        free(dup);
+        free(lits);
+        qplans->misses++;
+        return NULL;
+    }
+
+    QPLAN_rebase(&ctx, plan->pr->tree);
+    plan->pr->str = dup;
+
+    free(plan->q);
+    free(plan->lits);
+    plan->q = dup;
+    plan->len = len;
+    plan->lits = lits;
+    plan->in_use = 1;
+
+    /* move the plan to the head of the list */
+    if (plan != qplans->head)
+    {
+        plan->prev->next = plan->next;
+        if (plan->next == NULL)
+        {
+            qplans->tail = plan->prev;
+        }
+        else
+        {
+            plan->next->prev = plan->prev;
+        }
+        plan->prev = NULL;
+        plan->next = qplans->head;
+        qplans->head->prev = plan;
+        qplans->head = plan;
+    }
+
+    qplans->hits++;
+    return plan;
+}
+
+/*
+ * Add the parse result 'pr' for query 'q' to the cache. Argument 'pr' must
+ * be a valid parse result.
+ *
+ * Returns the new plan, which is in use, or NULL when the query cannot be
+ * cached. Only when a plan is returned the cache takes ownership of 'pr'
+ * and the tree is used with a copy of 'q'.
+ *
+ * The cache is not critical so memory errors are logged but not raised.
+ */
+siridb_qplan_t * siridb_qplans_add(
+        siridb_qplans_t * qplans,
+        const char * q,
+        cleri_parse_t * pr)
+{
+    siridb_qplan_t * plan;
+    qplan_ctx_t ctx;
+
+    if (!qplans->max_len)
+    {
+        return NULL;
+    }
+
+    plan = (siridb_qplan_t *) malloc(sizeof(siridb_qplan_t));
+    if (plan == NULL)
+    {
+        log_error("Cannot allocate a query plan");
+        return NULL;
+    }
+
+    plan->len = strlen(q);
+    plan->key = QPLAN_key(q, plan->len, &plan->lits, &plan->n);
+
+    if (plan->key == NULL || ct_get(qplans->plans, plan->key) != NULL)
+    {
+        /* not a query we cache or a plan for this key is in use */
+        free(plan->key);
+        free(plan->lits);
+        free(plan);
+        return NULL;
+    }
+
+    if (qplans->len == qplans->max_len)
+    {
+        siridb_qplan_t * tmp = qplans->tail;
+
+        /* remove the least recently used plan which is not in use */
+        while (tmp != NULL && tmp->in_use)
+        {
+            tmp = tmp->prev;
+        }
+
+        if (tmp == NULL)
+        {
+            free(plan->key);
+            free(plan->lits);
+            free(plan);
+            return NULL;
+        }
+
+        QPLAN_unlink(qplans, tmp);
+        QPLAN_free(tmp);
+    }
+
+    plan->q = strdup(q);
+    plan->pr = NULL;
+
+    if (plan->q == NULL || ct_add(qplans->plans, plan->key, plan))
+    {
+        log_error("Cannot allocate a query plan");
+        QPLAN_free(plan);
+        return NULL;
+    }
+
+    /* copy has the same literals so no checks are required */
+    ctx.old_q = q;
+    ctx.old_len = plan->len;
+    ctx.new_q = plan->q;
+    ctx.new_len = plan->len;
+    ctx.old_lits = plan->lits;
+    ctx.new_lits = plan->lits;
+    ctx.n = plan->n;
+
+    QPLAN_rebase(&ctx, pr->tree);
+    pr->str = plan->q;
+
+    plan->pr = pr;
+    plan->in_use = 1;
+
+    plan->prev = NULL;
+    plan->next = qplans->head;
+    if (qplans->head == NULL)
+    {
+        qplans->tail = plan;
+    }
+    else
+    {
+        qplans->head->prev = plan;
+    }
+    qplans->head = plan;
+
+    qplans->len++;
+
+    return plan;
+}
+
+/*
+ * Give back a plan so it can be used by another query.
+ */
+void siridb_qplans_release(
+        siridb_qplans_t * qplans __attribute__((unused)),
+        siridb_qplan_t * plan)
+{
+    plan->in_use = 0;
+}
+
+/*
+ * Returns the key for query 'q' or NULL when the query is not cached or
+ * in case of a memory error. The literals are returned by 'lits' and 'n'
+ * when successful and 'lits' must be freed.
+ */
+static char * QPLAN_key(
+        const char * q,
+        size_t len,
+        siridb_qplan_lit_t ** lits,
+        size_t * n)
+{
+    const char * pt = q;
+    char * key;
+    char * dest;
+    char quote = 0;
+    size_t size = 8;
+
+    *lits = NULL;
+
+    /* skip white space */
+    for (; isspace((unsigned char) *pt); pt++);
+
+    if (    (strncmp(pt, "select", 6) || QPLAN_IS_NAME_CHR(pt[6])) &&
+            (strncmp(pt, "list", 4) || QPLAN_IS_NAME_CHR(pt[4])) &&
+            (strncmp(pt, "count", 5) || QPLAN_IS_NAME_CHR(pt[5])))
+    {
+        return NULL;
+    }
+
+    key = (char *) malloc(len + 1);
+    *lits = (siridb_qplan_lit_t *) malloc(size * sizeof(siridb_qplan_lit_t));
+    *n = 0;
+
+    if (key == NULL || *lits == NULL)
+    {
+        free(key);
+        free(*lits);
+        return NULL;
+    }
+
+    for (pt = q, dest = key; *pt; pt++)
+    {
+        if (quote)
+        {
+            if (*pt == '\\' && quote == '/' && pt[1])
+            {
+                *dest++ = *pt++;
+            }
+            else if (*pt == quote)
+            {
+                quote = 0;
+            }
+        }
+        else if (*pt == '\'' || *pt == '"' || *pt == '`' || *pt == '/')
+        {
+            quote = *pt;
+        }
+        else if (   isdigit((unsigned char) *pt) &&
+                    (pt == q || !QPLAN_IS_NAME_CHR(pt[-1])))
+        {
+            if (*n == size)
+            {
+                siridb_qplan_lit_t * tmp;
+                size *= 2;
+                tmp = (siridb_qplan_lit_t *) realloc(
+                        *lits,
+                        size * sizeof(siridb_qplan_lit_t));
+                if (tmp == NULL)
+                {
+                    free(key);
+                    free(*lits);
+                    return NULL;
+                }
+                *lits = tmp;
+            }
+
+            (*lits)[*n].pos = pt - q;
+            for (; isdigit((unsigned char) pt[1]); pt++);
+            (*lits)[*n].len = pt - q - (*lits)[*n].pos + 1;
+            (*n)++;
+
+            *dest++ = '?';
+            continue;
+        }
+
+        *dest++ = *pt;
+    }
+
+    *dest = '\0';
+
+    return key;
+}
+
+/*
+ * Returns the position in the new query for a position in the old query.
+ * Literals starting before the position are assumed to end before or at the
+ * position.
+ */
+static size_t QPLAN_map(qplan_ctx_t * ctx, size_t pos)
+{
+    size_t i;
+    size_t new_pos = pos;
+
+    for (i = 0; i < ctx->n && ctx->old_lits[i].pos < pos; i++)
+    {
+        new_pos = new_pos - ctx->old_lits[i].len + ctx->new_lits[i].len;
+    }
+
+    return new_pos;
+}
+
+/*
+ * Returns 0 when the tree can be used with the new query or -1 if not.
+ */
+static int QPLAN_check(qplan_ctx_t * ctx, cleri_node_t * node)
+{
+    cleri_children_t * current;
+    siridb_qplan_lit_t * lit;
+    size_t start, end;
+    int ovector[3];
+    int has_lit = 0;
+
+    /* empty nodes may not point to the query */
+    if (    node->str < ctx->old_q ||
+            node->str > ctx->old_q + ctx->old_len)
+    {
+        return 0;
+    }
+
+    start = node->str - ctx->old_q;
+    end = start + node->len;
+
+    for (size_t i = 0; i < ctx->n; i++)
+    {
+        lit = ctx->old_lits + i;
+        if (lit->pos < end && lit->pos + lit->len > start)
+        {
+            if (lit->pos < start || lit->pos + lit->len > end)
+            {
+                return -1;  /* the node contains part of a literal */
+            }
+            has_lit = 1;
+        }
+    }
+
+    if (has_lit && node->children == NULL)
+    {
+        if (node->cl_obj->tp != CLERI_TP_REGEX)
+        {
+            return -1;
+        }
+
+        /* the regular expression must match exactly the new literal */
+        start = QPLAN_map(ctx, start);
+        end = QPLAN_map(ctx, end);
+
+        if (    pcre_exec(
+                    node->cl_obj->via.regex->regex,
+                    node->cl_obj->via.regex->regex_extra,
+                    ctx->new_q + start,
+                    ctx->new_len - start,
+                    0,
+                    0,
+                    ovector,
+                    3) < 0 ||
+                (size_t) ovector[1] != end - start)
+        {
+            return -1;
+        }
+    }
+
+    for (   current = node->children;
+            current != NULL && current->node != NULL;
+            current = current->next)
+    {
+        if (QPLAN_check(ctx, current->node))
+        {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * Point all nodes in the tree to the new query. Nodes which do not point to
+ * the old query, for example when already moved, are skipped.
+ */
+static void QPLAN_rebase(qplan_ctx_t * ctx, cleri_node_t * node)
+{
+    cleri_children_t * current;
+    size_t start, end;
+
+    if (    node->str >= ctx->old_q &&
+            node->str <= ctx->old_q + ctx->old_len)
+    {
+        start = node->str - ctx->old_q;
+        end = start + node->len;
+
+        start = QPLAN_map(ctx, start);
+        node->str = ctx->new_q + start;
+        node->len = QPLAN_map(ctx, end) - start;
+    }
+
+    for (   current = node->children;
+            current != NULL && current->node != NULL;
+            current = current->next)
+    {
+        QPLAN_rebase(ctx, current->node);
+    }
+}
+
+/*
+ * Remove a plan from the lookup and the list but do not free the plan.
+ */
+static void QPLAN_unlink(siridb_qplans_t * qplans, siridb_qplan_t * plan)
+{
+    ct_pop(qplans->plans, plan->key);
+
+    if (plan->prev == NULL)
+    {
+        qplans->head = plan->next;
+    }
+    else
+    {
+        plan->prev->next = plan->next;
+    }
+
+    if (plan->next == NULL)
+    {
+        qplans->tail = plan->prev;
+    }
+    else
+    {
+        plan->next->prev = plan->prev;
+    }
+
+    qplans->len--;
+}
+
+static void QPLAN_free(siridb_qplan_t * plan)
+{
+    if (plan->pr != NULL)
+    {
+        cleri_parse_free(plan->pr);
+    }
+    free(plan->key);
+    free(plan->q);
+    free(plan->lits);
+    free(plan);
+}
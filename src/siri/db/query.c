@@ -18,19 +18,26 @@
 #include <siri/db/nodes.h>
 #include <siri/db/query.h>
 #include <siri/db/replicate.h>
+#include <siri/db/server.h>
 #include <siri/db/servers.h>
 #include <siri/db/time.h>
+#include <siri/db/user.h>
 #include <siri/db/walker.h>
+#include <siri/loop.h>
 #include <siri/net/clserver.h>
 #include <siri/net/pkg.h>
+#include <siri/net/promises.h>
 #include <siri/net/socket.h>
 #include <siri/parser/listener.h>
 #include <siri/parser/queries.h>
 #include <siri/siri.h>
+#include <siri/trace.h>
 #include <strextra/strextra.h>
 #include <string.h>
 #include <sys/time.h>
 #include <siri/err.h>
+#include <siri/mem.h>
+#include <timeit/timeit.h>
 
 #ifdef DEBUG
 #include <motd/motd.h>
@@ -39,10 +46,25 @@
 #define QUERY_TOO_LONG -1
 #define QUERY_MAX_LENGTH 8192
 #define QUERY_EXTRA_ALLOC_SIZE 200
+#define QUERY_SLOW_STATS_SZ 512
+#define QUERY_SLOW_WAITS_SZ 512
+
+/*
+ * Trace id for a query which is not forwarded. The pool and server id make
+ * the trace id unique within a database.
+ */
+#define QUERY_TRACE_ID(siridb, query)                               \
+    (((uint64_t) (siridb)->server->pool << 48) |                    \
+    ((uint64_t) (siridb)->server->id << 47) |                       \
+    ((query)->id & 0x7fffffffffffULL))
 #define SIRIDB_FWD_SERVERS_TIMEOUT 5000  // 5 seconds
+#define SIRIDB_KILL_QUERY_TIMEOUT 5000  // 5 seconds
 
 static void QUERY_send_invalid_error(uv_async_t * handle);
 static void QUERY_parse(uv_async_t * handle);
+static void QUERY_parse_step(uv_async_t * handle);
+static void QUERY_resume(uv_async_t * handle);
+static cleri_parse_t * QUERY_get_pr(siridb_query_t * query);
 static int QUERY_walk(cleri_node_t * node, siridb_walker_t * walker);
 static int QUERY_to_packer(qp_packer_t * packer, siridb_query_t * query);
 static int QUERY_time_expr(
@@ -58,6 +80,13 @@ static int QUERY_rebuild(
         size_t * size,
         const size_t max_size);
 static void QUERY_send_no_query(uv_async_t * handle);
+static int QUERY_kill_client(siridb_query_t * query, uv_stream_t * client);
+static void QUERY_on_kill_response(
+        slist_t * promises,
+        void * data __attribute__((unused)));
+static siri_latency_tp_t QUERY_latency_tp(siridb_query_t * query);
+static void QUERY_log_slow(siridb_query_t * query);
+static void QUERY_waits_str(siridb_query_t * query, char * buf, size_t size);
 
 /*
  * This function can raise a SIGNAL.
@@ -68,8 +97,12 @@ void siridb_query_run(
         const char * q,
         size_t q_len,
         float factor,
-        int flags)
+        int flags,
+        uint8_t fmt,
+        uint64_t origin_id,
+        uint64_t trace_id)
 {
+    siridb_t * siridb;
     uv_async_t * handle = (uv_async_t *) malloc(sizeof(uv_async_t));
     if (handle == NULL)
     {
@@ -93,12 +126,16 @@ void siridb_query_run(
         return;
     }
 
+    siri_mem_add(SIRI_MEM_QUERY, sizeof(siridb_query_t) + strlen(query->q));
+
     /*
      * Set start time.
      * (must be real time since we translate now with this value)
      */
     clock_gettime(CLOCK_REALTIME, &query->start);
 
+    SIRI_TRACE2(query__start, query, query->q);
+
     /* bind pid, client and flags so we can send back the result */
     query->pid = pid;
 
@@ -108,8 +145,9 @@ void siridb_query_run(
     query->client = client;
     query->flags = flags;
 
-    /* bind time precision factor */
+    /* bind time precision factor and the format for points */
     query->factor = factor;
+    query->fmt = fmt;
 
     /* set the default callback, this might change when custom
      * data is linked to the query handle
@@ -120,11 +158,18 @@ void siridb_query_run(
     /* We should initialize the packer based on query type */
     query->packer = NULL;
     query->timeit = NULL;
+    query->waits = NULL;
 
     /* make sure all *other* pointers are set to NULL */
     query->data = NULL;
     query->pr = NULL;
+    query->plan = NULL;
     query->nodes = NULL;
+    query->arena = NULL;
+
+    memset(&query->stages, 0, sizeof(siridb_query_stages_t));
+    query->slice = 0;
+    siri_latency_start(&query->latency);
 
     if (Logger.level == LOGGER_DEBUG && strstr(query->q, "password") == NULL)
     {
@@ -132,22 +177,45 @@ void siridb_query_run(
     }
 
     /* increment active tasks */
-    ((sirinet_socket_t *) query->client->data)->siridb->active_tasks++;
+    siridb = ((sirinet_socket_t *) query->client->data)->siridb;
+    siridb->active_tasks++;
+
+    /* register the query so it can be killed, this is not critical */
+    query->id = ++siridb->query_id;
+    query->origin_id = origin_id;
+    query->trace_id = (trace_id) ? trace_id : QUERY_TRACE_ID(siridb, query);
+    if (imap_add(siridb->queries, query->id, query))
+    {
+        log_error("Cannot register query (%" PRIu64 ")", query->id);
+    }
 
     /* send next call */
     uv_async_init(siri.loop, handle, (uv_async_cb) QUERY_parse);
     handle->data = query;
+    siri_latency_queue(&query->latency);
     uv_async_send(handle);
 }
 
 void siridb_query_free(uv_handle_t * handle)
 {
     siridb_query_t * query = (siridb_query_t *) handle->data;
+    siridb_t * siridb = ((sirinet_socket_t *) query->client->data)->siridb;
+
+    /* record latency for the request type and for the statement */
+    siri_latency_done(
+            &query->latency,
+            (query->flags & SIRIDB_QUERY_FLAG_MASTER) ?
+                    SIRI_LATENCY_QUERY : SIRI_LATENCY_BACKEND_QUERY);
+    siri_latency_done(&query->latency, QUERY_latency_tp(query));
+
+    SIRI_TRACE2(query__done, query, query->q);
 
-    /* decrement active tasks */
-    ((sirinet_socket_t *) query->client->data)->siridb->active_tasks--;
+    /* decrement active tasks and remove the query from the running queries */
+    siridb->active_tasks--;
+    imap_pop(siridb->queries, query->id);
 
     /* free query */
+    siri_mem_sub(SIRI_MEM_QUERY, sizeof(siridb_query_t) + strlen(query->q));
     free(query->q);
 
     /* free qpack buffers */
@@ -161,15 +229,27 @@ void siridb_query_free(uv_handle_t * handle)
         qp_packer_free(query->timeit);
     }
 
+    if (query->waits != NULL)
+    {
+        qp_packer_free(query->waits);
+    }
+
     /* free node list */
     siridb_nodes_free(query->nodes);
 
-    /* free query result */
-    if (query->pr != NULL)
+    /* free query result or give it back to the plan cache */
+    if (query->plan != NULL)
+    {
+        siridb_qplans_release(siri.qplans, query->plan);
+    }
+    else if (query->pr != NULL)
     {
         cleri_parse_free(query->pr);
     }
 
+    /* free memory allocated for points during the query */
+    siridb_arena_free(query->arena);
+
     /* decrement client reference counter */
     sirinet_socket_decref(query->client);
 
@@ -203,6 +283,11 @@ void siridb_send_query_result(uv_async_t * handle)
             query->pid,
             CPROTO_RES_QUERY);
 
+    if (siri.cfg->slow_query_threshold)
+    {
+        QUERY_log_slow(query);
+    }
+
     sirinet_pkg_send((uv_stream_t *) query->client, pkg);
 
     query->packer = NULL;
@@ -247,6 +332,20 @@ void siridb_query_forward(
         siridb_query_fwd_t fwd,
         sirinet_promises_cb cb,
         int flags)
+{
+    siridb_query_forward_each(handle, fwd, cb, NULL, flags);
+}
+
+/*
+ * Like siridb_query_forward() but 'each' is called with each response as
+ * soon as it is received. (only used when forwarding to pools)
+ */
+void siridb_query_forward_each(
+        uv_async_t * handle,
+        siridb_query_fwd_t fwd,
+        sirinet_promises_cb cb,
+        sirinet_promises_each_cb each,
+        int flags)
 {
     siridb_query_t * query = (siridb_query_t *) handle->data;
     siridb_t * siridb = ((sirinet_socket_t *) query->client->data)->siridb;
@@ -268,12 +367,25 @@ void siridb_query_forward(
      * For backwards compatibility with SiriDB version < 2.0.24 we send an
      * extra value SIRIDB_TIME_DEFAULT.
      */
-    qp_add_type(packer, QP_ARRAY2);
+    qp_add_type(packer, QP_ARRAY4);
 
     /* add the query to the packer */
     QUERY_to_packer(packer, query);
     qp_add_int8(packer, SIRIDB_TIME_DEFAULT);  /* Only for version < 2.0.24 */
 
+    /* older versions ignore the id, it is used to kill the forwarded query */
+    qp_add_int64(packer, (int64_t) query->id);
+    query->flags |= SIRIDB_QUERY_FLAG_FORWARDED;
+
+    /* the trace id is used for finding the query in timeit and logs */
+    qp_add_int64(packer, (int64_t) query->trace_id);
+
+    /* the wait stage ends when the promises are handled */
+    if (SIRIDB_QUERY_HAS_STATS(query))
+    {
+        query->stages.mark = timeit_ns();
+    }
+
 
     sirinet_pkg_t * pkg = sirinet_pkg_new(0, packer->len, 0, packer->buffer);
 
@@ -313,22 +425,19 @@ void siridb_query_forward(
                     pkg,
                     0,
                     cb,
+                    each,
                     handle,
                     flags);
             break;
 
         case SIRIDB_QUERY_FWD_SOME_POOLS:
 #ifdef DEBUG
-
-            assert (((query_select_t *) ((siridb_query_t *)
-                    handle->data)->data)->tp == QUERIES_SELECT);
-            assert (((query_select_t *) ((siridb_query_t *)
-                    handle->data)->data)->pmap != NULL);
+            assert (((query_wrapper_t *) query->data)->pmap != NULL);
 #endif
             pkg->tp = BPROTO_QUERY_SERVER;
             {
-                slist_t * borrow_list = imap_slist(((query_select_t *) (
-                        (siridb_query_t *) handle->data)->data)->pmap);
+                slist_t * borrow_list = imap_slist(
+                        ((query_wrapper_t *) query->data)->pmap);
                 if (borrow_list != NULL)
                 {
                     /* if slist is NULL, a signal is raised */
@@ -337,6 +446,7 @@ void siridb_query_forward(
                             pkg,
                             0,
                             cb,
+                            each,
                             handle,
                             flags);
                 }
@@ -359,6 +469,7 @@ void siridb_query_forward(
                     pkg,
                     0,
                     cb,
+                    each,
                     handle,
                     flags);
             break;
@@ -378,6 +489,47 @@ void siridb_query_forward(
  *
  * Returns 0 if successful or -1 in case the package data is not valid.
  */
+/*
+ * Returns the arena for the query. The arena is created on the first call
+ * and is released when the query is freed.
+ *
+ * Returns NULL and raises a SIGNAL in case an error has occurred.
+ */
+siridb_arena_t * siridb_query_arena(siridb_query_t * query)
+{
+    if (query->arena == NULL)
+    {
+        query->arena = siridb_arena_new();
+    }
+    return query->arena;
+}
+
+/*
+ * Write the query to 'buf' with all time and integer expressions replaced by
+ * their values. The result is terminated by a null character.
+ *
+ * Returns 0 if successful or -1 when the query does not fit in 'buf'.
+ */
+int siridb_query_normalize(siridb_query_t * query, char * buf, size_t size)
+{
+    size_t n = size;
+
+    if (QUERY_rebuild(
+            ((sirinet_socket_t *) query->client->data)->siridb,
+            query->pr->tree->children->node,
+            buf,
+            &n,
+            size))
+    {
+        return -1;
+    }
+
+    /* each part ends with a space, replace the last one */
+    buf[size - n - 1] = '\0';
+
+    return 0;
+}
+
 int siridb_query_err_from_pkg(siridb_query_t * query, sirinet_pkg_t * pkg)
 {
     qp_unpacker_t unpacker;
@@ -423,6 +575,158 @@ void siridb_query_timeit_from_unpacker(
     }
 }
 
+/*
+ * Add the time each server took to respond to 'waits'. Nothing is done when
+ * the query does not collect statistics.
+ *
+ * This function can raise a SIGNAL.
+ */
+void siridb_query_add_waits(siridb_query_t * query, slist_t * promises)
+{
+    sirinet_promise_t * promise;
+
+    if (!SIRIDB_QUERY_HAS_STATS(query))
+    {
+        return;
+    }
+
+    if (query->waits == NULL && (query->waits = qp_packer_new(256)) == NULL)
+    {
+        ERR_ALLOC
+        return;
+    }
+
+    for (size_t i = 0; i < promises->len; i++)
+    {
+        promise = (sirinet_promise_t *) promises->data[i];
+        if (promise == NULL)
+        {
+            continue;
+        }
+
+        qp_add_type(query->waits, QP_ARRAY2);
+        qp_add_string(query->waits, promise->server->name);
+        qp_add_double(
+                query->waits,
+                (double) (promise->received - promise->sent) / 1000.0);
+    }
+}
+
+/*
+ * Returns 1 when the query must stop and 0 otherwise. A query stops when it
+ * is killed, when the client connection is closed or when the query timeout
+ * is reached. In case the query must stop, 'err_msg' is set.
+ *
+ * This function is called between series and is safe to use from worker
+ * threads since it only reads the query and socket state.
+ */
+int siridb_query_is_cancelled(siridb_query_t * query, char * err_msg)
+{
+    struct timespec now;
+
+    if (query->flags & SIRIDB_QUERY_FLAG_KILLED)
+    {
+        sprintf(err_msg, "Query (%" PRIu64 ") is killed.", query->id);
+        return 1;
+    }
+
+    if (((sirinet_socket_t *) query->client->data)->on_data == NULL)
+    {
+        sprintf(err_msg, "Client connection is closed.");
+        return 1;
+    }
+
+    if (siri.cfg->query_timeout)
+    {
+        clock_gettime(CLOCK_REALTIME, &now);
+        if (now.tv_sec - query->start.tv_sec >= siri.cfg->query_timeout)
+        {
+            sprintf(err_msg,
+                    "Query has reached the timeout of %u seconds.",
+                    siri.cfg->query_timeout);
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * Mark a query as killed. The query stops at the next check between series.
+ * When the query was forwarded, all other servers are asked to kill their
+ * part of the query too.
+ *
+ * This function can raise a SIGNAL.
+ */
+void siridb_query_kill(siridb_query_t * query)
+{
+    if (query->flags & SIRIDB_QUERY_FLAG_KILLED)
+    {
+        return;
+    }
+
+    query->flags |= SIRIDB_QUERY_FLAG_KILLED;
+
+    siridb_query_kill_forwarded(query);
+}
+
+/*
+ * Ask all other servers to kill their part of a forwarded query, for example
+ * when the responses which are received are enough for the result. The
+ * query itself continues and the other servers respond with an error.
+ *
+ * This function can raise a SIGNAL.
+ */
+void siridb_query_kill_forwarded(siridb_query_t * query)
+{
+    siridb_t * siridb = ((sirinet_socket_t *) query->client->data)->siridb;
+    qp_packer_t * packer;
+    sirinet_pkg_t * pkg;
+    slist_t * servers;
+
+    if (~query->flags & SIRIDB_QUERY_FLAG_FORWARDED)
+    {
+        return;
+    }
+
+    packer = sirinet_packer_new(sizeof(sirinet_pkg_t) + 9);
+    if (packer == NULL)
+    {
+        return;  /* signal is raised */
+    }
+
+    qp_add_int64(packer, (int64_t) query->id);
+    pkg = sirinet_packer2pkg(packer, 0, BPROTO_KILL_QUERY);
+
+    servers = siridb_servers_other2slist(siridb);
+    if (servers == NULL)
+    {
+        free(pkg);
+        ERR_ALLOC
+        return;
+    }
+
+    siridb_servers_send_pkg(
+            servers,
+            pkg,
+            SIRIDB_KILL_QUERY_TIMEOUT,
+            QUERY_on_kill_response,
+            NULL);
+
+    slist_free(servers);
+}
+
+/*
+ * Kill all running queries for 'client'. This is used when the connection
+ * to a client is closed so abandoned queries do not keep using resources.
+ *
+ * This function can raise a SIGNAL.
+ */
+void siridb_query_kill_client(siridb_t * siridb, uv_stream_t * client)
+{
+    imap_walk(siridb->queries, (imap_cb) QUERY_kill_client, client);
+}
+
 static void QUERY_send_invalid_error(uv_async_t * handle)
 {
     size_t len;
@@ -557,18 +861,62 @@ static void QUERY_send_no_query(uv_async_t * handle)
     siridb_send_query_result(handle);
 }
 
+/*
+ * Returns the parse result for the query, either from the plan cache or by
+ * parsing the query. NULL is returned in case of an error.
+ */
+static cleri_parse_t * QUERY_get_pr(siridb_query_t * query)
+{
+    cleri_parse_t * pr;
+
+    if (siri.qplans == NULL)
+    {
+        return cleri_parse(siri.grammar, query->q);
+    }
+
+    query->plan = siridb_qplans_get(siri.qplans, query->q);
+    if (query->plan != NULL)
+    {
+        return query->plan->pr;
+    }
+
+    pr = cleri_parse(siri.grammar, query->q);
+    if (pr != NULL && pr->is_valid)
+    {
+        query->plan = siridb_qplans_add(siri.qplans, query->q, pr);
+    }
+
+    return pr;
+}
+
 static void QUERY_parse(uv_async_t * handle)
+{
+    siri_loop_frame_t frame;
+
+    siri_loop_enter(&frame);
+    QUERY_parse_step(handle);
+    siri_loop_done(SIRI_LOOP_LISTENER, &frame);
+}
+
+static void QUERY_parse_step(uv_async_t * handle)
 {
     int rc;
     siridb_query_t * query = (siridb_query_t *) handle->data;
     siridb_t * siridb = ((sirinet_socket_t *) query->client->data)->siridb;
-    siridb_walker_t * walker = siridb_walker_new(
+    uint64_t ns = timeit_ns();
+    siridb_walker_t * walker;
+
+    query->slice = ns;
+
+    siri_latency_dequeue(&query->latency);
+
+    walker = siridb_walker_new(
             siridb,
             siridb_time_now(siridb, query->start),
             &query->flags);
 
     if (    walker == NULL ||
-            (query->pr = cleri_parse(siri.grammar, query->q)) == NULL)
+            (query->pr = QUERY_get_pr(query)) == NULL)
     {
         if (walker != NULL)
         {
@@ -635,11 +983,59 @@ static void QUERY_parse(uv_async_t * handle)
         return;
     }
 
-    uv_async_t * forward = (uv_async_t *) malloc(sizeof(uv_async_t));
-    uv_async_init(siri.loop, forward, (uv_async_cb) query->nodes->cb);
-    forward->data = handle->data;
-    uv_async_send(forward);
+    query->stages.parse = timeit_ns() - ns;
+
+    siridb_query_next_node(handle);
+}
+
+/*
+ * Call the listener for the current node of the query. The listener runs
+ * directly while the query has used the event loop for less than
+ * query_step_budget micro seconds, otherwise the query yields so other
+ * clients are handled first. When yielding, the listener is called from a
+ * new handle and the given handle is closed.
+ *
+ * Listeners which continue from their own handle, like those iterating over
+ * series, do not reset the slice so the next node after such a listener
+ * always yields.
+ *
+ * This function can raise a SIGNAL.
+ */
+void siridb_query_next_node(uv_async_t * handle)
+{
+    siridb_query_t * query = (siridb_query_t *) handle->data;
+    uint64_t budget = (uint64_t) siri.cfg->query_step_budget * 1000;
+    uv_async_t * next;
+
+    if (budget && timeit_ns() - query->slice < budget)
+    {
+        query->nodes->cb(handle);
+        return;
+    }
+
     uv_close((uv_handle_t *) handle, (uv_close_cb) free);
+
+    next = (uv_async_t *) malloc(sizeof(uv_async_t));
+    if (next == NULL)
+    {
+        ERR_ALLOC
+        return;
+    }
+
+    next->data = query;
+    uv_async_init(siri.loop, next, (uv_async_cb) QUERY_resume);
+    uv_async_send(next);
+}
+
+static void QUERY_resume(uv_async_t * handle)
+{
+    siridb_query_t * query = (siridb_query_t *) handle->data;
+    siri_loop_frame_t frame;
+
+    siri_loop_enter(&frame);
+    query->slice = frame.start;
+    query->nodes->cb(handle);
+    siri_loop_done(SIRI_LOOP_LISTENER, &frame);
 }
 
 static int QUERY_to_packer(qp_packer_t * packer, siridb_query_t * query)
@@ -1037,3 +1433,224 @@ static int QUERY_rebuild(
     }
     return 0;
 }
+
+/*
+ * Call-back function: imap_cb
+ */
+static int QUERY_kill_client(siridb_query_t * query, uv_stream_t * client)
+{
+    if (query->client == client)
+    {
+        siridb_query_kill(query);
+    }
+    return 0;
+}
+
+/*
+ * Call-back function: sirinet_promises_cb
+ *
+ * Killing a query on other servers is not critical, servers which did not
+ * receive the request stop the query on their own timeout.
+ */
+static void QUERY_on_kill_response(
+        slist_t * promises,
+        void * data __attribute__((unused)))
+{
+    if (promises != NULL)
+    {
+        sirinet_promises_llist_free(promises);
+    }
+}
+
+/*
+ * Returns the latency type for the statement of a query, invalid queries
+ * and statements not listed below are counted as 'other'.
+ */
+static siri_latency_tp_t QUERY_latency_tp(siridb_query_t * query)
+{
+    cleri_children_t * current;
+    cleri_node_t * node;
+
+    if (query->pr == NULL || !query->pr->is_valid)
+    {
+        return SIRI_LATENCY_STMT_OTHER;
+    }
+
+    /* the statement is an optional choice after an optional timeit */
+    for (   current = query->pr->tree->children->node->children;
+            current != NULL && current->node != NULL;
+            current = current->next)
+    {
+        node = current->node;
+
+        while (     node->cl_obj->gid == CLERI_NONE &&
+                    node->children != NULL &&
+                    node->children->node != NULL)
+        {
+            node = node->children->node;
+        }
+
+        switch (node->cl_obj->gid)
+        {
+        case CLERI_GID_SELECT_STMT:
+            return SIRI_LATENCY_STMT_SELECT;
+        case CLERI_GID_LIST_STMT:
+            return SIRI_LATENCY_STMT_LIST;
+        case CLERI_GID_COUNT_STMT:
+            return SIRI_LATENCY_STMT_COUNT;
+        case CLERI_GID_DROP_STMT:
+            return SIRI_LATENCY_STMT_DROP;
+        case CLERI_GID_TIMEIT_STMT:
+            break;
+        default:
+            return SIRI_LATENCY_STMT_OTHER;
+        }
+    }
+
+    return SIRI_LATENCY_STMT_OTHER;
+}
+
+/*
+ * Write the query to the slow query log when it took at least the slow
+ * query threshold to get the result. Passwords are not written to the log.
+ */
+static void QUERY_log_slow(siridb_query_t * query)
+{
+    struct timespec now;
+    uint64_t ms;
+    siridb_query_stages_t * stages = &query->stages;
+    sirinet_socket_t * ssocket = (sirinet_socket_t *) query->client->data;
+    char buf[QUERY_MAX_LENGTH];
+    char stats[QUERY_SLOW_STATS_SZ];
+    char waits[QUERY_SLOW_WAITS_SZ];
+    const char * q = query->q;
+    const char * origin;
+
+    clock_gettime(CLOCK_REALTIME, &now);
+
+    ms = (uint64_t) (now.tv_sec - query->start.tv_sec) * 1000 +
+            (now.tv_nsec - query->start.tv_nsec) / 1000000;
+
+    if (ms < siri.cfg->slow_query_threshold)
+    {
+        return;
+    }
+
+    if (    query->pr != NULL &&
+            siridb_query_normalize(query, buf, QUERY_MAX_LENGTH) == 0)
+    {
+        q = buf;
+    }
+
+    if (strstr(q, "password") != NULL)
+    {
+        q = "<hidden>";
+    }
+
+    if (ssocket->origin == NULL)
+    {
+        origin = "unknown";
+    }
+    else if (ssocket->tp == SOCKET_CLIENT)
+    {
+        origin = ((siridb_user_t *) ssocket->origin)->name;
+    }
+    else
+    {
+        origin = ((siridb_server_t *) ssocket->origin)->name;
+    }
+
+    /* stage times are in milliseconds */
+    snprintf(stats, QUERY_SLOW_STATS_SZ,
+            "series: %" PRIu64 ", points: %" PRIu64 ", chunks: %" PRIu64
+            ", shards: %" PRIu64 ", bytes: %" PRIu64 ", parse: %.3f"
+            ", match: %.3f, io: %.3f, decode: %.3f, aggregate: %.3f"
+            ", merge: %.3f, pack: %.3f, wait: %.3f",
+            stages->series,
+            stages->shards.points,
+            stages->shards.chunks,
+            stages->shards.shards,
+            stages->shards.bytes,
+            (double) stages->parse / 1e6,
+            (double) stages->match / 1e6,
+            (double) stages->shards.io / 1e6,
+            (double) stages->shards.decode / 1e6,
+            (double) stages->aggregate / 1e6,
+            (double) stages->merge / 1e6,
+            (double) stages->pack / 1e6,
+            (double) stages->wait / 1e6);
+
+    QUERY_waits_str(query, waits, QUERY_SLOW_WAITS_SZ);
+
+    if (siri.slowlog != NULL)
+    {
+        logger_file_write(
+                siri.slowlog,
+                LOGGER_WARNING,
+                "Slow query %016" PRIx64 " (%" PRIu64 "ms) by '%s' on '%s': "
+                "%s (%s, remote: [%s])",
+                query->trace_id,
+                ms,
+                origin,
+                ssocket->siridb->dbname,
+                q,
+                stats,
+                waits);
+    }
+    else
+    {
+        log_warning(
+                "Slow query %016" PRIx64 " (%" PRIu64 "ms) by '%s' on '%s': "
+                "%s (%s, remote: [%s])",
+                query->trace_id,
+                ms,
+                origin,
+                ssocket->siridb->dbname,
+                q,
+                stats,
+                waits);
+    }
+}
+
+/*
+ * Write the response time in milliseconds of each server to 'buf', for
+ * example: "server1:9010 12.000, server2:9010 3.000". The result is
+ * truncated when it does not fit in 'buf'.
+ */
+static void QUERY_waits_str(siridb_query_t * query, char * buf, size_t size)
+{
+    qp_unpacker_t unpacker;
+    qp_obj_t qp_name;
+    qp_obj_t qp_wait;
+    size_t len = 0;
+    int n;
+
+    *buf = '\0';
+
+    if (query->waits == NULL)
+    {
+        return;
+    }
+
+    qp_unpacker_init(&unpacker, query->waits->buffer, query->waits->len);
+
+    while (     len < size &&
+                qp_next(&unpacker, NULL) == QP_ARRAY2 &&
+                qp_next(&unpacker, &qp_name) == QP_RAW &&
+                qp_next(&unpacker, &qp_wait) == QP_DOUBLE)
+    {
+        n = snprintf(
+                buf + len,
+                size - len,
+                "%s%.*s %.3f",
+                (len) ? ", " : "",
+                (int) qp_name.len,
+                qp_name.via.raw,
+                qp_wait.via.real * 1000.0);
+        if (n < 0)
+        {
+            break;
+        }
+        len += n;
+    }
+}
@@ -0,0 +1,185 @@
+/*
+ * ratelimit.c - Token bucket rate limits for database users.
+ *
+ * author       : Jeroen van der Heijden
+ * email        : jeroen@transceptor.technology
+ * copyright    : 2016, Transceptor Technology
+ *
+ * Limits are configured per user in the [ratelimit] section of database.conf
+ * and apply to all connections of the user on 'this' server. The buckets
+ * are only used from the event loop so no locking is required.
+ *
+ * changes
+ *  - initial version, 14-10-2016
+ *
+ */
+#include <math.h>
+#include <siri/db/ratelimit.h>
+#include <siri/siri.h>
+#include <stdlib.h>
+#include <uv.h>
+
+static void RATELIMIT_init(siridb_ratelimit_t * rl, double rate);
+static void RATELIMIT_refill(siridb_ratelimit_t * rl, uint64_t now);
+static uint32_t RATELIMIT_check(siridb_ratelimit_t * rl, uint64_t now);
+static void RATELIMIT_take(siridb_ratelimit_t * rl, uint64_t now, double n);
+
+/*
+ * Parse limits in the format '<points/s> <queries/s> <selected points/s>'
+ * where 0 means no limit, for example: '100000 50 5000000'.
+ *
+ * Returns 0 if successful or -1 when the string is invalid.
+ */
+int siridb_ratelimits_parse(siridb_ratelimits_t * limits, const char * str)
+{
+    double rates[3];
+    char * end;
+
+    for (int i = 0; i < 3; i++)
+    {
+        rates[i] = strtod(str, &end);
+        if (end == str || !isfinite(rates[i]) || rates[i] < 0.0)
+        {
+            return -1;
+        }
+        str = end;
+    }
+
+    while (*str == ' ' || *str == '\t')
+    {
+        str++;
+    }
+
+    if (*str)
+    {
+        return -1;
+    }
+
+    RATELIMIT_init(&limits->points, rates[0]);
+    RATELIMIT_init(&limits->queries, rates[1]);
+    RATELIMIT_init(&limits->selected, rates[2]);
+
+    return 0;
+}
+
+/*
+ * Take a query token. The query is refused as long as the selected points
+ * of earlier queries exceed the limit.
+ *
+ * Returns 0 when the query is accepted or the time in milliseconds after
+ * which the query can be retried, in which case 'limit' is set to the name
+ * of the exceeded limit.
+ */
+uint32_t siridb_ratelimits_query(
+        siridb_ratelimits_t * limits,
+        const char ** limit)
+{
+    uint64_t now = uv_now(siri.loop);
+    uint32_t retry_after;
+
+    if ((retry_after = RATELIMIT_check(&limits->queries, now)))
+    {
+        *limit = "queries";
+        return retry_after;
+    }
+
+    if ((retry_after = RATELIMIT_check(&limits->selected, now)))
+    {
+        *limit = "selected points";
+        return retry_after;
+    }
+
+    RATELIMIT_take(&limits->queries, now, 1.0);
+
+    return 0;
+}
+
+/*
+ * Returns 0 when an insert is accepted or the time in milliseconds after
+ * which the insert can be retried, in which case 'limit' is set to the name
+ * of the exceeded limit. The points are taken by siridb_ratelimits_points()
+ * once the insert is read.
+ */
+uint32_t siridb_ratelimits_insert(
+        siridb_ratelimits_t * limits,
+        const char ** limit)
+{
+    uint32_t retry_after = RATELIMIT_check(&limits->points, uv_now(siri.loop));
+
+    if (retry_after)
+    {
+        *limit = "inserted points";
+    }
+
+    return retry_after;
+}
+
+/*
+ * Take tokens for 'n' inserted points.
+ */
+void siridb_ratelimits_points(siridb_ratelimits_t * limits, size_t n)
+{
+    RATELIMIT_take(&limits->points, uv_now(siri.loop), (double) n);
+}
+
+/*
+ * Take tokens for 'n' selected points.
+ */
+void siridb_ratelimits_selected(siridb_ratelimits_t * limits, size_t n)
+{
+    RATELIMIT_take(&limits->selected, uv_now(siri.loop), (double) n);
+}
+
+static void RATELIMIT_init(siridb_ratelimit_t * rl, double rate)
+{
+    rl->rate = rate;
+    rl->tokens = rate;
+    rl->last = 0;
+}
+
+static void RATELIMIT_refill(siridb_ratelimit_t * rl, uint64_t now)
+{
+    if (now > rl->last)
+    {
+        rl->tokens += (double) (now - rl->last) * rl->rate / 1000.0;
+        if (rl->tokens > rl->rate)
+        {
+            rl->tokens = rl->rate;
+        }
+        rl->last = now;
+    }
+}
+
+/*
+ * Returns 0 when tokens are available or the time in milliseconds until
+ * the bucket is refilled.
+ */
+static uint32_t RATELIMIT_check(siridb_ratelimit_t * rl, uint64_t now)
+{
+    double ms;
+
+    if (rl->rate == 0.0)
+    {
+        return 0;
+    }
+
+    RATELIMIT_refill(rl, now);
+
+    if (rl->tokens > 0.0)
+    {
+        return 0;
+    }
+
+    ms = ceil(-rl->tokens * 1000.0 / rl->rate) + 1.0;
+
+    return (ms < (double) UINT32_MAX) ? (uint32_t) ms : UINT32_MAX;
+}
+
+static void RATELIMIT_take(siridb_ratelimit_t * rl, uint64_t now, double n)
+{
+    if (rl->rate != 0.0)
+    {
+        RATELIMIT_refill(rl, now);
+        rl->tokens -= n;
+    }
+}
@@ -5,13 +5,47 @@
  * email        : jeroen@transceptor.technology
  * copyright    : 2016, Transceptor Technology
  *
+ * Expressions are compiled using the pcre JIT compiler when available. The
+ * same expressions are often used by many queries, for example by dashboards,
+ * so compiled expressions are kept in a cache which is shared by queries,
+ * groups and rollups. Cached expressions are identified by their source,
+ * like /series.*name/i, and are reference counted so an expression which is
+ * removed from the cache can still be used. When the cache is full the least
+ * recently used expression is removed.
+ *
+ * The cache is protected by its own mutex since groups are updated by the
+ * groups thread.
+ *
  * changes
  *  - initial version, 04-08-2016
  *
  */
 #include <assert.h>
+#include <ctype.h>
+#include <logger/logger.h>
 #include <siri/db/db.h>
 #include <siri/db/re.h>
+#include <siri/err.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef PCRE_STUDY_JIT_COMPILE
+#define RE_STUDY_OPTIONS PCRE_STUDY_JIT_COMPILE
+#else
+#define RE_STUDY_OPTIONS 0
+#endif
+
+/* escaped letters which match a single character or nothing at all */
+#define RE_ESC_ATOMS "dDwWsShHvVbBAzZG"
+
+static siridb_re_t * RE_new(
+        const char * source,
+        size_t len,
+        char * err_msg);
+static void RE_free(siridb_re_t * re);
+static void RE_unlink(siridb_re_cache_t * re_cache, siridb_re_t * re);
+static const char * RE_skip_class(const char * pt, const char * end);
+static const char * RE_skip_group(const char * pt, const char * end);
 
 /*
  * Compiles both a 'pcre' regular expression and 'pcre_extra' optimization if
@@ -71,7 +105,7 @@ int siridb_re_compile(
         return -1;
     }
 
-    *regex_extra = pcre_study(*regex, 0, &pcre_error_str);
+    *regex_extra = pcre_study(*regex, RE_STUDY_OPTIONS, &pcre_error_str);
 
     /*
      * pcre_study() returns NULL for both errors and when it can not
@@ -96,3 +130,555 @@ int siridb_re_compile(
 
     return 0;
 }
+
+/*
+ * Free the 'pcre_extra' from siridb_re_compile(). This must be used since
+ * the extra can hold JIT compiled code. (NULL is allowed)
+ */
+void siridb_re_free_extra(pcre_extra * regex_extra)
+{
+    if (regex_extra != NULL)
+    {
+        pcre_free_study(regex_extra);
+    }
+}
+
+/*
+ * Returns 0 when 'subject' matches the expression and a negative value
+ * otherwise. (PCRE_ERROR_NOMATCH when not matching)
+ *
+ * The JIT compiled code uses a small stack and might fail on complex
+ * expressions. In this case the expression is matched without JIT.
+ */
+int siridb_re_exec(
+        pcre * regex,
+        pcre_extra * regex_extra,
+        const char * subject,
+        size_t len)
+{
+    int rc = pcre_exec(
+            regex,
+            regex_extra,
+            subject,
+            (int) len,
+            0,                     // start looking at this point
+            0,                     // OPTIONS
+            NULL,
+            0);                    // length of sub_str_vec
+
+#ifdef PCRE_STUDY_JIT_COMPILE
+    if (rc == PCRE_ERROR_JIT_STACKLIMIT && regex_extra != NULL)
+    {
+        pcre_extra extra = *regex_extra;
+        extra.flags &= ~PCRE_EXTRA_EXECUTABLE_JIT;
+        rc = pcre_exec(regex, &extra, subject, (int) len, 0, 0, NULL, 0);
+    }
+#endif
+
+    return rc;
+}
+
+/*
+ * Returns NULL and raises a SIGNAL in case an error has occurred.
+ */
+siridb_re_cache_t * siridb_re_cache_new(size_t max_len)
+{
+    siridb_re_cache_t * re_cache =
+            (siridb_re_cache_t *) calloc(1, sizeof(siridb_re_cache_t));
+    if (re_cache == NULL)
+    {
+        ERR_ALLOC
+    }
+    else
+    {
+        re_cache->max_len = max_len;
+        re_cache->entries = ct_new();
+        if (re_cache->entries == NULL)
+        {
+            ERR_ALLOC
+            free(re_cache);
+            re_cache = NULL;
+        }
+        else
+        {
+            uv_mutex_init(&re_cache->mutex);
+        }
+    }
+    return re_cache;
+}
+
+/*
+ * Free the cache. Expressions which are still in use are not freed.
+ */
+void siridb_re_cache_free(siridb_re_cache_t * re_cache)
+{
+    siridb_re_t * re;
+
+    if (re_cache == NULL)
+    {
+        return;
+    }
+
+    while ((re = re_cache->head) != NULL)
+    {
+        RE_unlink(re_cache, re);
+        if (!--re->ref)
+        {
+            RE_free(re);
+        }
+    }
+
+    ct_free(re_cache->entries, NULL);
+    uv_mutex_destroy(&re_cache->mutex);
+    free(re_cache);
+}
+
+/*
+ * Returns a compiled expression for 'source' with an incremented reference
+ * counter. Use siridb_re_decref() when the expression is no longer used.
+ * Argument 're_cache' may be NULL in which case the expression is compiled.
+ *
+ * In case of an error, NULL is returned and 'err_msg' is set. A signal is
+ * raised in case of a memory error.
+ */
+siridb_re_t * siridb_re_get(
+        siridb_re_cache_t * re_cache,
+        const char * source,
+        size_t len,
+        char * err_msg)
+{
+    siridb_re_t * re;
+    siridb_re_t * tmp;
+
+    if (re_cache == NULL)
+    {
+        return RE_new(source, len, err_msg);
+    }
+
+    char key[len + 1];
+    memcpy(key, source, len);
+    key[len] = '\0';
+
+    uv_mutex_lock(&re_cache->mutex);
+
+    re = (siridb_re_t *) ct_get(re_cache->entries, key);
+
+    if (re != NULL)
+    {
+        re_cache->hits++;
+        re->ref++;
+
+        /* move the expression to the head of the list */
+        if (re != re_cache->head)
+        {
+            re->prev->next = re->next;
+            if (re->next == NULL)
+            {
+                re_cache->tail = re->prev;
+            }
+            else
+            {
+                re->next->prev = re->prev;
+            }
+            re->prev = NULL;
+            re->next = re_cache->head;
+            re_cache->head->prev = re;
+            re_cache->head = re;
+        }
+
+        uv_mutex_unlock(&re_cache->mutex);
+        return re;
+    }
+
+    re_cache->misses++;
+
+    re = RE_new(source, len, err_msg);
+
+    if (re == NULL || re_cache->max_len == 0)
+    {
+        uv_mutex_unlock(&re_cache->mutex);
+        return re;
+    }
+
+    if (ct_add(re_cache->entries, re->key, re))
+    {
+        /* not critical, the expression is just not cached */
+        log_error("Cannot add regular expression to the cache");
+        uv_mutex_unlock(&re_cache->mutex);
+        return re;
+    }
+
+    re->ref++;  /* reference for the cache */
+    re->next = re_cache->head;
+    if (re_cache->head == NULL)
+    {
+        re_cache->tail = re;
+    }
+    else
+    {
+        re_cache->head->prev = re;
+    }
+    re_cache->head = re;
+    re_cache->len++;
+
+    while (re_cache->len > re_cache->max_len)
+    {
+        tmp = re_cache->tail;
+        RE_unlink(re_cache, tmp);
+        if (!--tmp->ref)
+        {
+            RE_free(tmp);
+        }
+    }
+
+    uv_mutex_unlock(&re_cache->mutex);
+    return re;
+}
+
+/*
+ * Decrement the reference counter and free the expression when no longer
+ * used. The 're_cache' must be the cache used to get the expression.
+ */
+void siridb_re_decref(siridb_re_cache_t * re_cache, siridb_re_t * re)
+{
+    uint32_t ref;
+
+    if (re_cache == NULL)
+    {
+        ref = --re->ref;
+    }
+    else
+    {
+        uv_mutex_lock(&re_cache->mutex);
+        ref = --re->ref;
+        uv_mutex_unlock(&re_cache->mutex);
+    }
+
+    if (!ref)
+    {
+        RE_free(re);
+    }
+}
+
+/*
+ * Call 'cb' for each literal text which is required for a match of the
+ * regular expression 'source', like '/host-42.*cpu/'. Groups and character
+ * classes are skipped and a quantifier which allows zero repetitions removes
+ * the last character from the text. Argument 'flags' for the call-back tells
+ * if the text starts at the start (SIRIDB_RE_LITERAL_START) or ends at the
+ * end (SIRIDB_RE_LITERAL_END) of the subject since expressions are anchored.
+ *
+ * Returns 0 if successful or -1 when the required text cannot be determined,
+ * for example for case insensitive expressions or alternations. Text which
+ * is already passed to 'cb' must be ignored in this case.
+ */
+int siridb_re_literals(
+        const char * source,
+        size_t len,
+        siridb_re_literal_cb cb,
+        void * args)
+{
+    const char * pt = source + 1;
+    const char * end = source + len - 1;
+    char text[len];
+    size_t n = 0;
+    int flags = SIRIDB_RE_LITERAL_START;
+    unsigned long min;
+    char * tmp;
+
+    if (len < 2 || *end != '/')
+    {
+        return -1;  /* a case insensitive expression */
+    }
+
+#define RE_FLUSH                                        \
+    if (n)                                              \
+    {                                                   \
+        cb(text, n, flags, args);                       \
+    }                                                   \
+    n = 0;                                              \
+    flags = 0;
+
+    while (pt < end)
+    {
+        switch (*pt)
+        {
+        case '\\':
+            if (++pt == end)
+            {
+                return -1;
+            }
+            if (isalnum((unsigned char) *pt))
+            {
+                /* escapes like \Q, \x or back references are not used */
+                if (strchr(RE_ESC_ATOMS, *pt) == NULL)
+                {
+                    return -1;
+                }
+                RE_FLUSH
+            }
+            else
+            {
+                text[n++] = *pt;
+            }
+            pt++;
+            break;
+        case '.':
+        case '^':
+        case '$':
+        case '+':
+            RE_FLUSH
+            pt++;
+            break;
+        case '*':
+        case '?':
+            if (n)
+            {
+                n--;  /* the last character is optional */
+            }
+            RE_FLUSH
+            pt++;
+            break;
+        case '{':
+            if (!isdigit((unsigned char) pt[1]))
+            {
+                return -1;
+            }
+            min = strtoul(pt + 1, &tmp, 10);
+            if (*tmp == ',')
+            {
+                for (tmp++; isdigit((unsigned char) *tmp); tmp++);
+            }
+            if (tmp >= end || *tmp != '}')
+            {
+                return -1;
+            }
+            if (min == 0 && n)
+            {
+                n--;
+            }
+            RE_FLUSH
+            pt = tmp + 1;
+            break;
+        case '[':
+            RE_FLUSH
+            if ((pt = RE_skip_class(pt, end)) == NULL)
+            {
+                return -1;
+            }
+            break;
+        case '(':
+            /* option settings like (?i) change the rest of the pattern */
+            if (    pt + 2 < end &&
+                    pt[1] == '?' &&
+                    (isalpha((unsigned char) pt[2]) ||
+                            pt[2] == '-' ||
+                            pt[2] == '^'))
+            {
+                return -1;
+            }
+            RE_FLUSH
+            if ((pt = RE_skip_group(pt, end)) == NULL)
+            {
+                return -1;
+            }
+            break;
+        case ')':
+        case '|':
+            return -1;
+        default:
+            text[n++] = *pt;
+            pt++;
+        }
+    }
+
+    flags |= SIRIDB_RE_LITERAL_END;
+    RE_FLUSH
+
+#undef RE_FLUSH
+
+    return 0;
+}
+
+/*
+ * Returns NULL when the expression cannot be compiled in which case
+ * 'err_msg' is set, a signal is raised in case of a memory error.
+ */
+static siridb_re_t * RE_new(
+        const char * source,
+        size_t len,
+        char * err_msg)
+{
+    siridb_re_t * re = (siridb_re_t *) malloc(sizeof(siridb_re_t));
+
+    if (re == NULL)
+    {
+        ERR_ALLOC
+        sprintf(err_msg, "Memory allocation error.");
+        return NULL;
+    }
+
+    re->ref = 1;
+    re->prev = NULL;
+    re->next = NULL;
+    re->regex = NULL;
+    re->regex_extra = NULL;
+    re->key = strndup(source, len);
+
+    if (re->key == NULL)
+    {
+        ERR_ALLOC
+        sprintf(err_msg, "Memory allocation error.");
+        free(re);
+        return NULL;
+    }
+
+    if (siridb_re_compile(&re->regex, &re->regex_extra, source, len, err_msg))
+    {
+        free(re->key);
+        free(re);
+        return NULL;  /* err_msg is set */
+    }
+
+    return re;
+}
+
+static void RE_free(siridb_re_t * re)
+{
+    free(re->key);
+    free(re->regex);
+    siridb_re_free_extra(re->regex_extra);
+    free(re);
+}
+
+/*
+ * Remove an expression from the lookup and the list but do not decrement
+ * the reference counter.
+ */
+static void RE_unlink(siridb_re_cache_t * re_cache, siridb_re_t * re)
+{
+    ct_pop(re_cache->entries, re->key);
+
+    if (re->prev == NULL)
+    {
+        re_cache->head = re->next;
+    }
+    else
+    {
+        re->prev->next = re->next;
+    }
+
+    if (re->next == NULL)
+    {
+        re_cache->tail = re->prev;
+    }
+    else
+    {
+        re->next->prev = re->prev;
+    }
+
+    re->prev = NULL;
+    re->next = NULL;
+    re_cache->len--;
+}
+
+/*
+ * Returns a pointer after the character class starting at 'pt' or NULL when
+ * the class is not closed.
+ */
+static const char * RE_skip_class(const char * pt, const char * end)
+{
+    pt++;
+
+    if (pt < end && *pt == '^')
+    {
+        pt++;
+    }
+
+    if (pt < end && *pt == ']')
+    {
+        pt++;
+    }
+
+    while (pt < end)
+    {
+        switch (*pt)
+        {
+        case '\\':
+            if (pt + 1 < end && pt[1] == 'Q')
+            {
+                return NULL;
+            }
+            pt += 2;
+            break;
+        case '[':
+            if (pt + 1 < end && pt[1] == ':')
+            {
+                /* posix class like [:alpha:] */
+                for (pt += 2; pt + 1 < end; pt++)
+                {
+                    if (pt[0] == ':' && pt[1] == ']')
+                    {
+                        break;
+                    }
+                }
+                pt += 2;
+            }
+            else
+            {
+                pt++;
+            }
+            break;
+        case ']':
+            return pt + 1;
+        default:
+            pt++;
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * Returns a pointer after the group starting at 'pt' or NULL when the group
+ * is not closed.
+ */
+static const char * RE_skip_group(const char * pt, const char * end)
+{
+    size_t depth = 0;
+
+    while (pt < end)
+    {
+        switch (*pt)
+        {
+        case '\\':
+            if (pt + 1 < end && pt[1] == 'Q')
+            {
+                return NULL;
+            }
+            pt += 2;
+            break;
+        case '[':
+            if ((pt = RE_skip_class(pt, end)) == NULL)
+            {
+                return NULL;
+            }
+            break;
+        case '(':
+            depth++;
+            pt++;
+            break;
+        case ')':
+            pt++;
+            if (!--depth)
+            {
+                return pt;
+            }
+            break;
+        default:
+            pt++;
+        }
+    }
+
+    return NULL;
+}
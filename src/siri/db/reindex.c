@@ -35,29 +35,44 @@
 #include <siri/err.h>
 #include <siri/net/protocol.h>
 #include <siri/optimize.h>
+#include <siri/throttle.h>
 #include <stddef.h>
 #include <stdio.h>
 #include <unistd.h>
 
+/*
+ * Series are moved in batches. A batch reads at most REINDEX_BATCH_IDS series
+ * ids from the end of the re-index file and packs the series which should be
+ * moved in a single insert package of about REINDEX_BATCH_SIZE bytes.
+ *
+ * Up to 'window' batches can be in progress. The window grows by one for each
+ * batch which is finished within REINDEX_LATENCY_HIGH milliseconds and is
+ * halved, and the next batch is delayed, when the new server responds slower.
+ * The re-index file is truncated in order so a restart never skips series.
+ */
 #define REINDEX_SLEEP 100           // 100 milliseconds * active tasks
 #define REINDEX_RETRY 5000          // 5 seconds
 #define REINDEX_INITWAIT 20000      // 20 seconds
 #define REINDEX_TIMEOUT 300000      // 5 minutes
+#define REINDEX_BATCH_IDS 1024      // series ids read for one batch
+#define REINDEX_BATCH_SIZE 1048576  // 1 MB
+#define REINDEX_WINDOW_MAX 4        // batches in progress
+#define REINDEX_LATENCY_HIGH 1000   // 1 second
 
-#define NEXT_SERIES_ERR -1
-#define NEXT_SERIES_SET 0
-#define NEXT_SERIES_END 1
-
-static const long int SIZE2 = 2 * sizeof(uint32_t);
 static const size_t PCKSZ = sizeof(sirinet_pkg_t) + 5;
 
 static inline int REINDEX_fn(siridb_t * siridb, siridb_reindex_t * reindex);
 static int REINDEX_create_cb(siridb_series_t * series, FILE * fp);
 static int REINDEX_unlink(siridb_reindex_t * reindex);
-static int REINDEX_next_series_id(siridb_reindex_t * reindex);
+static siridb_reindex_batch_t * REINDEX_batch(siridb_t * siridb);
+static void REINDEX_batch_free(siridb_reindex_batch_t * batch);
+static void REINDEX_send(siridb_t * siridb, siridb_reindex_batch_t * batch);
 static void REINDEX_next(siridb_t * siridb);
 static void REINDEX_work(uv_timer_t * timer);
-static void REINDEX_commit_series(siridb_t * siridb);
+static void REINDEX_commit_batch(
+        siridb_t * siridb,
+        siridb_reindex_batch_t * batch);
+static void REINDEX_commit_series(siridb_t * siridb, siridb_series_t * series);
 static void REINDEX_on_insert_response(
         sirinet_promise_t * promise,
         sirinet_pkg_t * pkg,
@@ -83,8 +98,14 @@ siridb_reindex_t * siridb_reindex_open(siridb_t * siridb, int create_new)
     {
         reindex->fn = NULL;
         reindex->fp = NULL;
-        reindex->next_series_id = NULL;
-        reindex->pkg = NULL;
+        reindex->window = 1;
+        reindex->batches_n = 0;
+        reindex->delay = 0;
+        reindex->throttle = 0;
+        reindex->start_size = 0;
+        reindex->start = 0;
+        reindex->first = NULL;
+        reindex->last = NULL;
         reindex->timer = NULL;
         reindex->server = NULL;
         if (REINDEX_fn(siridb, reindex) < 0)
@@ -105,7 +126,7 @@ siridb_reindex_t * siridb_reindex_open(siridb_t * siridb, int create_new)
 
                 if (create_new)
                 {
-                    if (imap_walk(
+                    if (dmap_walk(
                                 siridb->series_map,
                                 (imap_cb) REINDEX_create_cb,
                                 reindex->fp) || fflush(reindex->fp))
@@ -117,7 +138,9 @@ siridb_reindex_t * siridb_reindex_open(siridb_t * siridb, int create_new)
                 else
                 {
                     siridb->pools->prev_lookup =
-                            siridb_lookup_new(siridb->pools->len - 1);
+                            siridb_lookup_new(
+                                    siridb->pools->len - 1,
+                                    siridb->pool_hash);
                     if (siridb->pools->prev_lookup == NULL)
                     {
                         siridb_reindex_free(&reindex);  /* signal is raised */
@@ -134,51 +157,32 @@ siridb_reindex_t * siridb_reindex_open(siridb_t * siridb, int create_new)
                     }
                     else if (reindex->size)
                     {
-                        reindex->next_series_id =
-                                (uint32_t *) malloc(sizeof(uint32_t));
-
-                        if (reindex->next_series_id == NULL)
+                        reindex->timer =
+                                (uv_timer_t *) malloc(sizeof(uv_timer_t));
+                        if (reindex->timer == NULL)
                         {
                             ERR_ALLOC
                             siridb_reindex_free(&reindex);
                         }
-                        else if (
-                            fseeko(reindex->fp, -sizeof(uint32_t), SEEK_END) ||
-                            fread(  reindex->next_series_id,
-                                    sizeof(uint32_t),
-                                    1,
-                                    reindex->fp) != 1)
-                        {
-                            ERR_FILE
-                            siridb_reindex_free(&reindex);
-                        }
                         else
                         {
-                            reindex->timer =
-                                    (uv_timer_t *) malloc(sizeof(uv_timer_t));
-                            if (reindex->timer == NULL)
+                            reindex->server = siridb->pools->pool[
+                                      siridb->pools->len -1].server[0];
+                            siridb->server->flags |= SERVER_FLAG_REINDEXING;
+                            reindex->timer->data = siridb;
+                            reindex->start_size = reindex->size;
+                            reindex->start = uv_now(siri.loop);
+                            siri_optimize_pause();
+
+                            uv_timer_init(siri.loop, reindex->timer);
+                            if (create_new)
                             {
-                                ERR_ALLOC
-                                siridb_reindex_free(&reindex);
-                            }
-                            else
-                            {
-                                reindex->server = siridb->pools->pool[
-                                          siridb->pools->len -1].server[0];
-                                siridb->server->flags |= SERVER_FLAG_REINDEXING;
-                                reindex->timer->data = siridb;
-                                siri_optimize_pause();
-
-                                uv_timer_init(siri.loop, reindex->timer);
-                                if (create_new)
-                                {
-                                    /*
-                                     * Sending the flags is only needed when
-                                     * the re-index was just created. Otherwise
-                                     * the flags are send when we authenticate.
-                                     */
-                                    siridb_servers_send_flags(siridb->servers);
-                                }
+                                /*
+                                 * Sending the flags is only needed when
+                                 * the re-index was just created. Otherwise
+                                 * the flags are send when we authenticate.
+                                 */
+                                siridb_servers_send_flags(siridb->servers);
                             }
                         }
                     }
@@ -248,8 +252,12 @@ void siridb_reindex_free(siridb_reindex_t ** reindex)
         ERR_FILE
     }
     free((*reindex)->fn);
-    free((*reindex)->next_series_id);
-    free((*reindex)->pkg);
+    while ((*reindex)->first != NULL)
+    {
+        siridb_reindex_batch_t * batch = (*reindex)->first;
+        (*reindex)->first = batch->next;
+        REINDEX_batch_free(batch);
+    }
     free(*reindex);
     *reindex = NULL;
 }
@@ -331,107 +339,202 @@ void siridb_reindex_start(uv_timer_t * timer)
 }
 
 /*
- * Type: uv_timer_cb
- *
- * This function sends a packed series to the new (pool) server.
+ * Send a batch to the new (pool) server. When sending fails the batch is
+ * sent again by the next REINDEX_work().
  */
-static void REINDEX_send(uv_timer_t * timer)
+static void REINDEX_send(siridb_t * siridb, siridb_reindex_batch_t * batch)
 {
-    siridb_t * siridb = (siridb_t *) timer->data;
-#ifdef DEBUG
-    assert (siridb->reindex->pkg != NULL);
-#endif
-    /* actually 'available' is sufficient since the destination server has
-     * never status 're-indexing' unless one day we support down-scaling.
-     */
-    if (siridb_server_is_accessible(siridb->reindex->server))
-    {
-        siridb_server_send_pkg(
-                siridb->reindex->server,
-                siridb->reindex->pkg,
-                REINDEX_TIMEOUT,
-                REINDEX_on_insert_response,
-                siridb,
-                FLAG_KEEP_PKG);
-    }
-    else
+    batch->sent = uv_now(siri.loop);
+
+    if (siridb_server_send_pkg(
+            siridb->reindex->server,
+            batch->pkg,
+            REINDEX_TIMEOUT,
+            REINDEX_on_insert_response,
+            batch,
+            FLAG_KEEP_PKG))
     {
-        log_info("Cannot send re-index package to '%s' "
-                "(try again in %d seconds)",
-                siridb->reindex->server->name,
-                REINDEX_RETRY / 1000);
-        uv_timer_start(
-                siridb->reindex->timer,
-                REINDEX_send,
-                REINDEX_RETRY,
-                0);
+        batch->resend = 1;  /* signal is raised */
     }
 }
 
 /*
- * Return values:
- *  NEXT_SERIES_SET: Successful set the next series id and removes the previous
- *                   series id
- *  NEXT_SERIES_END: End of the file is reached, re-indexing has finished.
- *  NEXT_SERIES_ERR: An error occurred and a SIGNAL is raised
+ * Returns a new batch which is not yet added to the re-index. The batch has
+ * no package in case none of the series ids must be moved.
+ *
+ * In case of an error NULL is returned and a SIGNAL is raised.
  */
-static int REINDEX_next_series_id(siridb_reindex_t * reindex)
+static siridb_reindex_batch_t * REINDEX_batch(siridb_t * siridb)
 {
-#ifdef DEUBUG
-    assert (reindex->size == fseeko(reindex->fp, 0, SEEK_END);
-#endif
-
-    /* free re-index package */
-    free(reindex->pkg);
-    reindex->pkg = NULL;
+    siridb_reindex_t * reindex = siridb->reindex;
+    uint32_t ids[REINDEX_BATCH_IDS];
+    size_t n = reindex->size / sizeof(uint32_t);
+    size_t consumed = 0;
+    siridb_series_t * series;
+    siridb_points_t * points;
+    qp_packer_t * packer = NULL;
+    siridb_reindex_batch_t * batch;
+
+    if (n > REINDEX_BATCH_IDS)
+    {
+        n = REINDEX_BATCH_IDS;
+    }
 
-    int rc;
-    reindex->size -= sizeof(uint32_t);
+    if (fseeko(reindex->fp, reindex->size - n * sizeof(uint32_t), SEEK_SET) ||
+        fread(ids, sizeof(uint32_t), n, reindex->fp) != n)
+    {
+        ERR_FILE
+        log_critical("Reading next series ids has failed");
+        return NULL;
+    }
 
-    if (!reindex->size)
+    batch = (siridb_reindex_batch_t *) malloc(sizeof(siridb_reindex_batch_t));
+    if (batch == NULL || (batch->series = slist_new(n)) == NULL)
     {
-        rc = NEXT_SERIES_END;
+        ERR_ALLOC
+        free(batch);
+        return NULL;
     }
-    else
+
+    batch->done = 0;
+    batch->resend = 0;
+    batch->siridb = siridb;
+    batch->pkg = NULL;
+    batch->next = NULL;
+
+    /* read the ids from the end, like they are removed from the file */
+    while (n-- && !siri_err)
     {
-        if (fseeko(reindex->fp, -SIZE2, SEEK_END) ||
-            fread(  reindex->next_series_id,
-                    sizeof(uint32_t),
-                    1,
-                    reindex->fp) != 1)
+        consumed++;
+        series = dmap_get(siridb->series_map, ids[n]);
+
+        if (    series == NULL ||
+                siridb_lookup_sn(
+                        siridb->pools->lookup,
+                        series->name) == siridb->server->pool ||
+                (siridb->replica != NULL &&
+                 siridb_series_server_id(series) != siridb->server->id))
+        {
+            continue;
+        }
+
+        /*
+         * lock is not needed since we are sure the optimize task is
+         * not running
+         */
+#ifdef DEBUG
+        assert (siridb_lookup_sn(
+                    siridb->pools->prev_lookup,
+                    series->name) == siridb->server->pool);
+#endif
+        if (packer == NULL)
+        {
+            packer = sirinet_packer_new(QP_SUGGESTED_SIZE);
+            if (packer == NULL)
+            {
+                break;  /* signal is raised */
+            }
+            qp_add_type(packer, QP_MAP_OPEN);
+        }
+
+        points = siridb_series_get_points(siridb, series, NULL, NULL);
+        if (points == NULL)
         {
-            ERR_FILE
-            log_critical("Reading next series id has failed");
-            return NEXT_SERIES_ERR;
+            break;  /* signal is raised */
         }
-        rc = NEXT_SERIES_SET;
+
+        /*
+         * Prepare drop, increasing the reference counter is not needed
+         * since the series can only be decremented when dropped. since
+         * the series is not member of the siridb->series_map it will not
+         * be decremented there either.
+         */
+        siridb_series_drop_prepare(siridb, series);
+        slist_append(batch->series, series);
+
+        /* add series name including terminator char */
+        if (    qp_add_raw(packer, series->name, series->name_len + 1) == 0 &&
+                siridb_points_pack(points, packer) == 0 &&
+                packer->len >= REINDEX_BATCH_SIZE)
+        {
+            n = 0;
+        }
+
+        siridb_points_free(points);
     }
 
-    if (ftruncate(reindex->fd, reindex->size))
+    reindex->size -= consumed * sizeof(uint32_t);
+    batch->offset = reindex->size;
+
+    if (packer != NULL)
     {
-        ERR_FILE
-        log_critical("Reading next series id has failed");
-        return NEXT_SERIES_ERR;
+        if (batch->series->len)
+        {
+            batch->pkg = sirinet_packer2pkg(
+                    packer,
+                    0,
+                    BPROTO_INSERT_TESTED_SERVER);
+        }
+        else
+        {
+            qp_packer_free(packer);
+        }
     }
-    return rc;
+
+    return batch;
+}
+
+static void REINDEX_batch_free(siridb_reindex_batch_t * batch)
+{
+    free(batch->pkg);
+    slist_free(batch->series);
+    free(batch);
 }
 
 /*
+ * Remove finished batches in file order and truncate the re-index file, then
+ * schedule the next batch or finish re-indexing.
+ *
+ * Warning: siridb->reindex might be destroyed by this function.
+ *
  * This function can raise a SIGNAL
  */
 static void REINDEX_next(siridb_t * siridb)
 {
-    switch (REINDEX_next_series_id(siridb->reindex))
+    siridb_reindex_t * reindex = siridb->reindex;
+    siridb_reindex_batch_t * batch;
+    int truncate = 0;
+    long int offset = 0;
+
+    while (reindex->first != NULL && reindex->first->done)
     {
-    case NEXT_SERIES_SET:
-        uv_timer_start(
-                siridb->reindex->timer,
-                REINDEX_work,
-                REINDEX_SLEEP * siridb->active_tasks,
-                0);
-        break;
+        batch = reindex->first;
+        reindex->first = batch->next;
+        offset = batch->offset;
+        truncate = 1;
+        REINDEX_batch_free(batch);
+    }
 
-    case NEXT_SERIES_END:
+    if (reindex->first == NULL)
+    {
+        reindex->last = NULL;
+    }
+
+    if (truncate && ftruncate(reindex->fd, offset))
+    {
+        ERR_FILE
+        log_critical("Truncating the re-index file has failed");
+        return;
+    }
+
+    /* the timer is closed when SiriDB is closing */
+    if (reindex->timer == NULL)
+    {
+        return;
+    }
+
+    if (!reindex->size && reindex->first == NULL)
+    {
         /* update and send the flags */
         siridb->server->flags &= ~SERVER_FLAG_REINDEXING;
         siridb_servers_send_flags(siridb->servers);
@@ -440,16 +543,20 @@ static void REINDEX_next(siridb_t * siridb)
                 siridb->server->name);
 
         /* we can close the timer */
-        siridb_reindex_close(siridb->reindex);
+        siridb_reindex_close(reindex);
 
         /* check if everyone is finished and if so destroy re-index */
         siridb_reindex_status_update(siridb);
 
         siri_optimize_continue();
-        break;
-
-    case NEXT_SERIES_ERR:
-        break; /* signal is raised */
+    }
+    else if (reindex->size && reindex->batches_n < reindex->window)
+    {
+        uv_timer_start(
+                reindex->timer,
+                REINDEX_work,
+                reindex->delay + REINDEX_SLEEP * siridb->active_tasks,
+                0);
     }
 }
 
@@ -457,90 +564,112 @@ static void REINDEX_work(uv_timer_t * timer)
 {
     siridb_t * siridb = (siridb_t *) timer->data;
     siridb_reindex_t * reindex = siridb->reindex;
+    siridb_reindex_batch_t * batch;
+    uint64_t now;
 
 #ifdef DEBUG
     assert (SIRI_OPTIMZE_IS_PAUSED);
     assert (reindex != NULL);
-    assert (siridb->reindex->pkg == NULL);
 #endif
 
-    reindex->series = imap_get(siridb->series_map, *reindex->next_series_id);
+    /* actually 'available' is sufficient since the destination server has
+     * never status 're-indexing' unless one day we support down-scaling.
+     */
+    if (!siridb_server_is_accessible(reindex->server))
+    {
+        log_info("Cannot send re-index package to '%s' "
+                "(try again in %d seconds)",
+                reindex->server->name,
+                REINDEX_RETRY / 1000);
+        uv_timer_start(timer, REINDEX_work, REINDEX_RETRY, 0);
+        return;
+    }
 
-    if (    reindex->series == NULL ||
-            siridb_lookup_sn(
-                    siridb->pools->lookup,
-                    reindex->series->name) == siridb->server->pool ||
-            (siridb->replica != NULL &&
-             siridb_series_server_id(reindex->series) != siridb->server->id))
+    for (batch = reindex->first; batch != NULL; batch = batch->next)
     {
-        REINDEX_next(siridb);
+        if (batch->resend)
+        {
+            batch->resend = 0;
+            REINDEX_send(siridb, batch);
+        }
     }
-    else
+
+    if (reindex->size && reindex->batches_n < reindex->window)
     {
-        /*
-         * lock is not needed since we are sure the optimize task is
-         * not running
-         */
-#ifdef DEBUG
-        assert (siridb_lookup_sn(
-                    siridb->pools->prev_lookup,
-                    reindex->series->name) == siridb->server->pool);
-#endif
-        siridb_points_t * points = siridb_series_get_points(
-                reindex->series,
-                NULL,
-                NULL);
+        now = uv_now(siri.loop);
 
-        if (points != NULL)  /* signal is raised in case NULL */
+        if (now < reindex->throttle)
         {
-            /*
-             * Prepare drop, increasing the reference counter is not needed
-             * since the series can only be decremented when dropped. since
-             * the series is not member of the siridb->series_map it will not
-             * be decremented there either.
-             */
-
-            siridb_series_drop_prepare(siridb, reindex->series);
+            /* the reindex_io_limit is reached */
+            uv_timer_start(timer, REINDEX_work, reindex->throttle - now, 0);
+            return;
+        }
 
-            qp_packer_t * packer = sirinet_packer_new(QP_SUGGESTED_SIZE);
-            if (packer != NULL)
-            {
-                qp_add_type(packer, QP_MAP1);
+        batch = REINDEX_batch(siridb);
+        if (batch == NULL)
+        {
+            return;  /* signal is raised */
+        }
 
-                /* add series name including terminator char */
-                qp_add_raw(
-                        packer,
-                        reindex->series->name,
-                        reindex->series->name_len + 1);
+        if (reindex->last == NULL)
+        {
+            reindex->first = batch;
+        }
+        else
+        {
+            reindex->last->next = batch;
+        }
+        reindex->last = batch;
 
-                if (siridb_points_pack(points, packer) == 0)
-                {
-                    reindex->pkg = sirinet_packer2pkg(
-                            packer,
-                            0,
-                            BPROTO_INSERT_TESTED_SERVER);
-                    uv_timer_start(
-                            reindex->timer,
-                            REINDEX_send,
-                            0,
-                            0);
-                }
-                else
-                {
-                    qp_packer_free(packer);  /* signal raised */
-                }
-            }
-            siridb_points_free(points);
+        if (batch->pkg == NULL)
+        {
+            /* none of the series must be moved */
+            batch->done = 1;
+        }
+        else
+        {
+            reindex->batches_n++;
+            reindex->throttle = now + siri_throttle_delay(
+                    SIRI_THROTTLE_REINDEX,
+                    sizeof(sirinet_pkg_t) + batch->pkg->len);
+            REINDEX_send(siridb, batch);
         }
     }
+
+    REINDEX_next(siridb);
+}
+
+/*
+ * Commit the drops of the series in a batch and mark the batch as done.
+ *
+ * This function can raise an ALLOC error but file errors are only logged.
+ */
+static void REINDEX_commit_batch(
+        siridb_t * siridb,
+        siridb_reindex_batch_t * batch)
+{
+    for (size_t i = 0; i < batch->series->len; i++)
+    {
+        REINDEX_commit_series(
+                siridb,
+                (siridb_series_t *) batch->series->data[i]);
+    }
+    siridb_series_flush_dropped(siridb);
+
+    free(batch->pkg);
+    batch->pkg = NULL;
+    batch->done = 1;
+    siridb->reindex->batches_n--;
 }
 
 /*
  * Sends 'dropped series' to the replica and commit the drop.
  *
  * This function can raise an ALLOC error but file errors are only logged.
+ *
+ * Warning: do not forget to call 'siridb_series_flush_dropped()'
  */
-static void REINDEX_commit_series(siridb_t * siridb)
+static void REINDEX_commit_series(siridb_t * siridb, siridb_series_t * series)
 {
     /*
      * Send the dropped series to the replica. The replica server might have
@@ -551,12 +680,12 @@ static void REINDEX_commit_series(siridb_t * siridb)
      */
     if (siridb->replica != NULL)
     {
-        size_t len = siridb->reindex->series->name_len + 1;
+        size_t len = series->name_len + 1;
         qp_packer_t * packer = sirinet_packer_new(PCKSZ + len);
         if (packer != NULL)
         {
             /* no need for testing, fits for sure */
-            qp_add_raw(packer, siridb->reindex->series->name, len);
+            qp_add_raw(packer, series->name, len);
             sirinet_pkg_t * pkg = sirinet_packer2pkg(
                     packer,
                     0,
@@ -567,11 +696,9 @@ static void REINDEX_commit_series(siridb_t * siridb)
     }
 
     /* commit the drop */
-    if (siridb_series_drop_commit(siridb, siridb->reindex->series) == 0)
-    {
-        siridb_series_flush_dropped(siridb);
-    }
+    siridb_series_drop_commit(siridb, series);
 }
+
 /*
  * Call-back function: sirinet_promise_cb
  */
@@ -580,7 +707,10 @@ static void REINDEX_on_insert_response(
         sirinet_pkg_t * pkg,
         int status)
 {
-    siridb_t * siridb = (siridb_t *) promise->data;
+    siridb_reindex_batch_t * batch = (siridb_reindex_batch_t *) promise->data;
+    siridb_t * siridb = batch->siridb;
+    siridb_reindex_t * reindex = siridb->reindex;
+    uint64_t latency;
 
     switch ((sirinet_promise_status_t) status)
     {
@@ -588,11 +718,11 @@ static void REINDEX_on_insert_response(
         /*
          * Write to socket error, data is not send so we should not commit.
          */
-        uv_timer_start(
-                siridb->reindex->timer,
-                REINDEX_send,
-                REINDEX_RETRY,
-                0);
+        batch->resend = 1;
+        if (reindex->timer != NULL)
+        {
+            uv_timer_start(reindex->timer, REINDEX_work, REINDEX_RETRY, 0);
+        }
         break;
     case PROMISE_TIMEOUT_ERROR:
         /*
@@ -611,7 +741,9 @@ static void REINDEX_on_insert_response(
          */
         log_error("Error occurred while sending series to the replica (%d)",
                 status);
-        REINDEX_commit_series(siridb);
+        reindex->window = 1;
+        reindex->delay = REINDEX_RETRY;
+        REINDEX_commit_batch(siridb, batch);
         REINDEX_next(siridb);
         break;
     case PROMISE_SUCCESS:
@@ -621,7 +753,25 @@ static void REINDEX_on_insert_response(
                     "Error occurred while processing data on the replica: "
                     "(response type: %u)", pkg->tp);
         }
-        REINDEX_commit_series(siridb);
+
+        /* adjust the window to the response time of the new server */
+        latency = uv_now(siri.loop) - batch->sent;
+        if (latency > REINDEX_LATENCY_HIGH)
+        {
+            reindex->window = (reindex->window > 1) ? reindex->window / 2 : 1;
+            reindex->delay = (latency > REINDEX_RETRY) ?
+                    REINDEX_RETRY : (uint32_t) latency;
+        }
+        else
+        {
+            if (reindex->window < REINDEX_WINDOW_MAX)
+            {
+                reindex->window++;
+            }
+            reindex->delay = 0;
+        }
+
+        REINDEX_commit_batch(siridb, batch);
         REINDEX_next(siridb);
         break;
     default:
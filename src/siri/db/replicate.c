@@ -23,11 +23,17 @@
 #include <siri/net/protocol.h>
 #include <siri/siri.h>
 #include <stddef.h>
+#include <string.h>
 
 #define REPLICATE_SLEEP 10          // 10 milliseconds * active tasks
 #define REPLICATE_TIMEOUT 300000    // 5 minutes
+#define REPLICATE_MERGE_MAX 256     // fifo packages in one package
+#define REPLICATE_MERGE_SIZE 1048576    // 1 MB
 
 static void REPLICATE_work(uv_timer_t * handle);
+static sirinet_pkg_t * REPLICATE_pop(siridb_t * siridb);
+static int REPLICATE_can_merge(sirinet_pkg_t * pkg, uint8_t tp);
+static void REPLICATE_commit(siridb_t * siridb, int err);
 static void REPLICATE_on_repl_response(
         sirinet_promise_t * promise,
         sirinet_pkg_t * pkg,
@@ -57,6 +63,7 @@ int siridb_replicate_init(siridb_t * siridb, siridb_initsync_t * initsync)
     }
 
     siridb->replicate->initsync = initsync;
+    siridb->replicate->pending = 0;
 
     siridb->replicate->timer = (uv_timer_t *) malloc(sizeof(uv_timer_t));
     if (siridb->replicate->timer == NULL)
@@ -227,7 +234,7 @@ static void REPLICATE_work(uv_timer_t * handle)
             siridb_fifo_has_data(siridb->fifo) &&
             (   siridb_server_is_accessible(siridb->replica) ||
                 siridb_server_is_synchronizing(siridb->replica)) &&
-            (pkg = siridb_fifo_pop(siridb->fifo)) != NULL)
+            (pkg = REPLICATE_pop(siridb)) != NULL)
     {
         if (siridb_server_send_pkg(
                 siridb->replica,
@@ -263,6 +270,94 @@ static void REPLICATE_work(uv_timer_t * handle)
     }
 }
 
+/*
+ * Returns the next package for the replica. Inserts of the same type which
+ * follow each other in the fifo are merged into one insert so the replica
+ * can process them with a single response. The number of fifo packages
+ * which must be committed is set to replicate->pending.
+ *
+ * In case of an error, NULL is returned. (signal is set in case of a malloc
+ * error, not in case of a file error)
+ */
+static sirinet_pkg_t * REPLICATE_pop(siridb_t * siridb)
+{
+    sirinet_pkg_t * pkg = siridb_fifo_pop(siridb->fifo);
+    sirinet_pkg_t * next;
+    sirinet_pkg_t * tmp;
+
+    siridb->replicate->pending = 1;
+
+    if (pkg == NULL || !REPLICATE_can_merge(pkg, pkg->tp))
+    {
+        return pkg;
+    }
+
+    while ( siridb->replicate->pending < REPLICATE_MERGE_MAX &&
+            pkg->len < REPLICATE_MERGE_SIZE &&
+            (next = siridb_fifo_pop_next(siridb->fifo)) != NULL)
+    {
+        if (!REPLICATE_can_merge(next, pkg->tp))
+        {
+            free(next);
+            break;
+        }
+
+        /* skip the QP_MAP_OPEN of the next insert */
+        tmp = (sirinet_pkg_t *) realloc(
+                pkg,
+                sizeof(sirinet_pkg_t) + pkg->len + next->len - 1);
+
+        if (tmp == NULL)
+        {
+            /* send what we have, the next package is popped again later */
+            free(next);
+            break;
+        }
+
+        pkg = tmp;
+        memcpy(pkg->data + pkg->len, next->data + 1, next->len - 1);
+        pkg->len += next->len - 1;
+        siridb->replicate->pending++;
+
+        free(next);
+    }
+
+    return pkg;
+}
+
+/*
+ * Returns 1 when the package is an insert of type 'tp' which can be merged
+ * with other inserts, or 0 if not.
+ */
+static int REPLICATE_can_merge(sirinet_pkg_t * pkg, uint8_t tp)
+{
+    return  pkg->tp == tp &&
+            (   tp == BPROTO_INSERT_SERVER ||
+                tp == BPROTO_INSERT_TEST_SERVER ||
+                tp == BPROTO_INSERT_TESTED_SERVER) &&
+            pkg->len &&
+            (unsigned char) pkg->data[0] == QP_MAP_OPEN;
+}
+
+/*
+ * Commit the fifo packages which are sent with the last package.
+ *
+ * This function can raise a SIGNAL.
+ */
+static void REPLICATE_commit(siridb_t * siridb, int err)
+{
+    for (; siridb->replicate->pending; siridb->replicate->pending--)
+    {
+        if ((err) ?
+                siridb_fifo_commit_err(siridb->fifo) :
+                siridb_fifo_commit(siridb->fifo))
+        {
+            siridb->replicate->pending = 0;
+            break;
+        }
+    }
+}
+
 /*
  * Return a pkg without series which are scheduled for initial synchronization.
  *
@@ -361,7 +456,7 @@ static void REPLICATE_on_repl_response(
          * Commit with error since this package has result in an unknown
          * package type.
          */
-        siridb_fifo_commit_err(siridb->fifo);
+        REPLICATE_commit(siridb, 1);
         break;
     case PROMISE_SUCCESS:
         if (sirinet_protocol_is_error(pkg->tp))
@@ -369,11 +464,11 @@ static void REPLICATE_on_repl_response(
             log_error(
                     "Error occurred while processing data on the replica: "
                     "(response type: %u)", pkg->tp);
-            siridb_fifo_commit_err(siridb->fifo);
+            REPLICATE_commit(siridb, 1);
         }
         else
         {
-            siridb_fifo_commit(siridb->fifo);
+            REPLICATE_commit(siridb, 0);
         }
         break;
     }
@@ -0,0 +1,892 @@
+/*
+ * rollup.c - Downsampled statistics for series.
+ *
+ * author       : Jeroen van der Heijden
+ * email        : jeroen@transceptor.technology
+ * copyright    : 2016, Transceptor Technology
+ *
+ * A rollup keeps the count, min, max and sum per interval for the series
+ * matching a regular expression or a group. Rollups are defined in the
+ * [rollup] section of database.conf, for example:
+ *
+ *      [rollup]
+ *      cpu = 5m /^cpu.*$/
+ *      web = 1h web_servers
+ *
+ * Buckets are updated when points are inserted. A select with count, max,
+ * mean, min or sum and a group by which is a multiple of the interval uses the
+ * buckets instead of reading the points.
+ *
+ * When a rollup is attached to an existing series, only points newer than the
+ * series are included. The buckets are written to disk when the database is
+ * closed and the file is removed when loaded, so after a crash the rollup
+ * starts again from the end of a series.
+ *
+ * changes
+ *  - initial version, 14-10-2016
+ *
+ */
+#include <assert.h>
+#include <limits.h>
+#include <logger/logger.h>
+#include <siri/db/db.h>
+#include <siri/db/group.h>
+#include <siri/db/groups.h>
+#include <siri/db/misc.h>
+#include <siri/db/re.h>
+#include <siri/db/rollup.h>
+#include <siri/db/series.h>
+#include <siri/db/time.h>
+#include <siri/err.h>
+#include <siri/siri.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <xpath/xpath.h>
+
+#define SIRIDB_ROLLUP_FN "rollup.dat"
+#define SIRIDB_ROLLUP_SCHEMA 1
+
+static siridb_rollup_t * ROLLUP_new(
+        siridb_t * siridb,
+        const char * name,
+        const char * val);
+static void ROLLUP_free(siridb_rollup_t * rollup);
+static int ROLLUP_compile(siridb_t * siridb, siridb_rollup_t * rollup);
+static int ROLLUP_load(siridb_t * siridb);
+static int ROLLUP_write(siridb_series_t * series, qp_fpacker_t * fpacker);
+static siridb_rollup_bucket_t * ROLLUP_bucket(
+        siridb_rollup_data_t * data,
+        uint64_t ts);
+static size_t ROLLUP_find(siridb_rollup_data_t * data, uint64_t ts);
+static inline void ROLLUP_update(
+        siridb_rollup_bucket_t * bucket,
+        points_tp tp,
+        qp_via_t * val);
+
+/*
+ * Read the rollup definitions from the [rollup] section in database.conf.
+ * Invalid definitions are logged and ignored.
+ *
+ * Returns 0 if successful or -1 and a SIGNAL is raised in case of an error.
+ */
+int siridb_rollups_read(siridb_t * siridb, cfgparser_t * cfgparser)
+{
+    cfgparser_section_t * section;
+    cfgparser_option_t * option;
+    siridb_rollup_t * rollup;
+
+    if (cfgparser_get_section(
+            &section,
+            cfgparser,
+            SIRIDB_ROLLUP_SECTION) != CFGPARSER_SUCCESS)
+    {
+        return 0;  /* no rollups */
+    }
+
+    for (option = section->options; option != NULL; option = option->next)
+    {
+        if (option->tp != CFGPARSER_TP_STRING)
+        {
+            log_error(
+                    "Invalid rollup '%s', expecting an interval and a "
+                    "regular expression or group name",
+                    option->name);
+            continue;
+        }
+
+        rollup = ROLLUP_new(siridb, option->name, option->val->string);
+
+        if (rollup == NULL)
+        {
+            continue;  /* logging is done or a signal is raised */
+        }
+
+        if (siridb->rollups == NULL &&
+            (siridb->rollups = slist_new(SLIST_DEFAULT_SIZE)) == NULL)
+        {
+            ROLLUP_free(rollup);
+            ERR_ALLOC
+            return -1;
+        }
+
+        if (slist_append_safe(&siridb->rollups, rollup))
+        {
+            ROLLUP_free(rollup);
+            ERR_ALLOC
+            return -1;
+        }
+    }
+
+    return siri_err;
+}
+
+/*
+ * Compile the rollups, attach them to all series and restore the buckets
+ * written when the database was closed. Must be called after the groups are
+ * loaded.
+ *
+ * Returns 0 if successful or -1 and a SIGNAL is raised in case of an error.
+ */
+int siridb_rollups_init(siridb_t * siridb)
+{
+    siridb_rollup_t * rollup;
+    slist_t * slist;
+    size_t i;
+
+    if (siridb->rollups == NULL)
+    {
+        return 0;
+    }
+
+    for (i = 0; i < siridb->rollups->len;)
+    {
+        rollup = (siridb_rollup_t *) siridb->rollups->data[i];
+
+        if (ROLLUP_compile(siridb, rollup))
+        {
+            /* the order of rollups is preserved */
+            memmove(siridb->rollups->data + i,
+                    siridb->rollups->data + i + 1,
+                    (--siridb->rollups->len - i) * sizeof(void *));
+            ROLLUP_free(rollup);
+            continue;
+        }
+
+        log_info(
+                "Using rollup '%s' for series matching '%s'",
+                rollup->name,
+                rollup->source);
+        i++;
+    }
+
+    slist = dmap_2slist(siridb->series_map);
+
+    if (slist == NULL)
+    {
+        return -1;  /* signal is raised */
+    }
+
+    for (i = 0; i < slist->len; i++)
+    {
+        siridb_rollups_add_series(siridb, (siridb_series_t *) slist->data[i]);
+    }
+
+    slist_free(slist);
+
+    return ROLLUP_load(siridb);
+}
+
+/*
+ * Write the buckets of all series to disk.
+ *
+ * Returns 0 if successful or EOF in case of an error.
+ */
+int siridb_rollups_save(siridb_t * siridb)
+{
+    SIRIDB_GET_FN(fn, siridb->dbpath, SIRIDB_ROLLUP_FN)
+    qp_fpacker_t * fpacker;
+
+    log_debug("Write rollups to file: '%s'", fn);
+
+    return (
+        (fpacker = qp_open(fn, "w")) == NULL ||
+
+        /* open a new array */
+        qp_fadd_type(fpacker, QP_ARRAY_OPEN) ||
+
+        /* write the current schema */
+        qp_fadd_int16(fpacker, SIRIDB_ROLLUP_SCHEMA) ||
+
+        dmap_walk(siridb->series_map, (imap_cb) ROLLUP_write, fpacker) ||
+
+        /* close file pointer */
+        qp_close(fpacker)) ? EOF : 0;
+}
+
+/*
+ * Destroy rollup definitions. (parsing NULL is allowed)
+ */
+void siridb_rollups_free(slist_t * rollups)
+{
+    if (rollups != NULL)
+    {
+        for (size_t i = 0; i < rollups->len; i++)
+        {
+            ROLLUP_free((siridb_rollup_t *) rollups->data[i]);
+        }
+        slist_free(rollups);
+    }
+}
+
+/*
+ * Attach the first matching rollup to a series. The rollup starts after
+ * the last point of the series.
+ *
+ * This function is not critical, errors are logged.
+ */
+void siridb_rollups_add_series(siridb_t * siridb, siridb_series_t * series)
+{
+    siridb_rollup_t * rollup;
+
+    if (    siridb->rollups == NULL ||
+            series->rollup != NULL ||
+            !siridb_series_isnum(series))
+    {
+        return;
+    }
+
+    for (size_t i = 0; i < siridb->rollups->len; i++)
+    {
+        rollup = (siridb_rollup_t *) siridb->rollups->data[i];
+
+        if (siridb_re_match(rollup->re, series->name, series->name_len) == 0)
+        {
+            series->rollup = siridb_rollup_data_new(
+                    rollup,
+                    (series->length) ?
+                        SIRIDB_ROLLUP_TS(rollup->interval, series->end) + 1 :
+                        0);
+
+            if (series->rollup == NULL)
+            {
+                log_error(
+                        "Cannot create rollup '%s' for series '%s'",
+                        rollup->name,
+                        series->name);
+            }
+            return;
+        }
+    }
+}
+
+/*
+ * Returns NULL in case of an error.
+ */
+siridb_rollup_data_t * siridb_rollup_data_new(
+        siridb_rollup_t * rollup,
+        uint64_t start)
+{
+    siridb_rollup_data_t * data =
+            (siridb_rollup_data_t *) malloc(sizeof(siridb_rollup_data_t));
+
+    if (data != NULL)
+    {
+        data->rollup = rollup;
+        data->start = start;
+        data->len = 0;
+        data->size = 0;
+        data->buckets = NULL;
+    }
+
+    return data;
+}
+
+void siridb_rollup_data_free(siridb_rollup_data_t * data)
+{
+    free(data->buckets);
+    free(data);
+}
+
+/*
+ * Add a point to the rollup. Points older than the start of the rollup are
+ * ignored.
+ */
+void siridb_rollup_add_point(
+        siridb_rollup_data_t * data,
+        points_tp tp,
+        uint64_t ts,
+        qp_via_t * val)
+{
+    siridb_rollup_bucket_t * bucket;
+
+    if (ts < data->start)
+    {
+        return;
+    }
+
+    bucket = ROLLUP_bucket(
+            data,
+            SIRIDB_ROLLUP_TS(data->rollup->interval, ts));
+
+    if (bucket != NULL)
+    {
+        ROLLUP_update(bucket, tp, val);
+    }
+}
+
+/*
+ * Add points to the rollup, the points are expected to be sorted.
+ */
+void siridb_rollup_add_points(
+        siridb_rollup_data_t * data,
+        points_tp tp,
+        siridb_point_t * points,
+        size_t len)
+{
+    siridb_rollup_bucket_t * bucket = NULL;
+    uint64_t ts;
+
+    for (size_t i = 0; i < len; i++)
+    {
+        if (points[i].ts < data->start)
+        {
+            continue;
+        }
+
+        ts = SIRIDB_ROLLUP_TS(data->rollup->interval, points[i].ts);
+
+        if (bucket == NULL || bucket->ts != ts)
+        {
+            bucket = ROLLUP_bucket(data, ts);
+            if (bucket == NULL)
+            {
+                continue;  /* the start of the rollup has changed */
+            }
+        }
+
+        ROLLUP_update(bucket, tp, &points[i].val);
+    }
+}
+
+/*
+ * Points up to 'end_ts' are removed from the series. We cannot tell which
+ * buckets are affected so the rollup continues after 'end_ts'.
+ */
+void siridb_rollup_remove(siridb_rollup_data_t * data, uint64_t end_ts)
+{
+    uint64_t start = SIRIDB_ROLLUP_TS(data->rollup->interval, end_ts) + 1;
+    size_t n;
+
+    if (start <= data->start)
+    {
+        return;
+    }
+
+    data->start = start;
+    n = ROLLUP_find(data, start);
+    data->len -= n;
+    memmove(data->buckets,
+            data->buckets + n,
+            data->len * sizeof(siridb_rollup_bucket_t));
+}
+
+/*
+ * Returns 1 (true) when the rollup can be used for 'aggr' for the points
+ * in [lo, hi), or 0 (false) if not. The points in [start_ts, lo) and
+ * [hi, end_ts) still need to be read. Argument 'hi' is set to UINT64_MAX
+ * when the rollup covers all points after 'lo'.
+ *
+ * Argument 'aggr' must be an aggregate for which
+ * siridb_aggregate_can_use_stats() is true.
+ */
+int siridb_rollup_range(
+        siridb_rollup_data_t * data,
+        siridb_aggr_t * aggr,
+        uint64_t * start_ts,
+        uint64_t * end_ts,
+        uint64_t * lo,
+        uint64_t * hi)
+{
+    uint64_t interval = data->rollup->interval;
+    uint64_t ts;
+    size_t i;
+
+    if (aggr->offset || aggr->group_by % interval)
+    {
+        return 0;
+    }
+
+    ts = (start_ts == NULL || *start_ts < data->start) ?
+            data->start : *start_ts;
+
+    /* the first time-stamp of a bucket is always 1 after a multiple */
+    *lo = (ts) ? (ts + interval - 2) / interval * interval + 1 : 0;
+
+    if (end_ts == NULL)
+    {
+        *hi = UINT64_MAX;
+    }
+    else
+    {
+        if (!*end_ts)
+        {
+            return 0;
+        }
+        *hi = (*end_ts - 1) / interval * interval + 1;
+    }
+
+    if (*lo >= *hi)
+    {
+        return 0;
+    }
+
+    for (   i = ROLLUP_find(data, *lo);
+            i < data->len && data->buckets[i].ts < *hi;
+            i++)
+    {
+        if (!siridb_points_stats_ok(&data->buckets[i].stats))
+        {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+/*
+ * Set 'points' with the result of 'aggr' for the buckets in [lo, hi), see
+ * siridb_rollup_range(). When 'counts' is not NULL, it is set with the number
+ * of points for each group. Argument 'tp' is the type of the series.
+ *
+ * Returns 0 if successful or -1 and err_msg is set in case of an error.
+ * (a SIGNAL might be raised)
+ */
+int siridb_rollup_get(
+        siridb_rollup_data_t * data,
+        siridb_aggr_t * aggr,
+        points_tp tp,
+        uint64_t lo,
+        uint64_t hi,
+        siridb_points_t ** points,
+        siridb_points_t ** counts,
+        char * err_msg)
+{
+    siridb_rollup_bucket_t * bucket;
+    siridb_point_t * point;
+    uint64_t group_ts;
+    qp_via_t val;
+    size_t first, last;
+
+    first = ROLLUP_find(data, lo);
+    last = (hi == UINT64_MAX) ? data->len : ROLLUP_find(data, hi);
+
+    *points = siridb_points_new(
+            last - first,
+            (aggr->gid == CLERI_GID_F_COUNT) ? TP_INT : tp);
+
+    if (counts != NULL)
+    {
+        *counts = siridb_points_new(last - first, TP_INT);
+    }
+
+    if (*points == NULL || (counts != NULL && *counts == NULL))
+    {
+        sprintf(err_msg, "Memory allocation error.");
+        if (*points != NULL)
+        {
+            siridb_points_free(*points);
+        }
+        if (counts != NULL && *counts != NULL)
+        {
+            siridb_points_free(*counts);
+        }
+        return -1;  /* signal is raised */
+    }
+
+    for (bucket = data->buckets + first; first < last; first++, bucket++)
+    {
+        group_ts = SIRIDB_AGGR_GROUP_TS(aggr, bucket->ts);
+
+        siridb_aggregate_stats_val(&val, &bucket->stats, bucket->len, aggr->gid);
+
+        if ((*points)->len && (*points)->data[(*points)->len - 1].ts == group_ts)
+        {
+            if (siridb_aggregate_combine_val(
+                    &(*points)->data[(*points)->len - 1].val,
+                    &val,
+                    aggr->gid,
+                    (*points)->tp,
+                    err_msg))
+            {
+                siridb_points_free(*points);
+                if (counts != NULL)
+                {
+                    siridb_points_free(*counts);
+                }
+                return -1;  /* err_msg is set */
+            }
+
+            if (counts != NULL)
+            {
+                (*counts)->data[(*counts)->len - 1].val.int64 += bucket->len;
+            }
+        }
+        else
+        {
+            point = (*points)->data + (*points)->len;
+            point->ts = group_ts;
+            point->val = val;
+            (*points)->len++;
+
+            if (counts != NULL)
+            {
+                point = (*counts)->data + (*counts)->len;
+                point->ts = group_ts;
+                point->val.int64 = bucket->len;
+                (*counts)->len++;
+            }
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * Returns NULL in case of an error. (the error is logged)
+ *
+ * The value is expected like "<interval> <regex or group name>" where the
+ * interval is a number followed by s, m, h, d or w.
+ */
+static siridb_rollup_t * ROLLUP_new(
+        siridb_t * siridb,
+        const char * name,
+        const char * val)
+{
+    siridb_rollup_t * rollup;
+    const char * pt = val;
+    uint64_t interval;
+
+    for (; *pt >= '0' && *pt <= '9'; pt++);
+
+    if (pt == val || strchr("smhdw", *pt) == NULL || *pt == '\0' ||
+            (pt[1] != ' ' && pt[1] != '\t'))
+    {
+        log_error(
+                "Invalid interval for rollup '%s': '%s' (expecting for "
+                "example '5m')",
+                name,
+                val);
+        return NULL;
+    }
+
+    interval = siridb_time_parse(val, pt - val + 1) * siridb->time->factor;
+
+    if (!interval)
+    {
+        log_error("Interval for rollup '%s' must be greater than zero", name);
+        return NULL;
+    }
+
+    for (pt++; *pt == ' ' || *pt == '\t'; pt++);
+
+    if (*pt == '\0')
+    {
+        log_error(
+                "Missing a regular expression or group name for rollup '%s'",
+                name);
+        return NULL;
+    }
+
+    rollup = (siridb_rollup_t *) malloc(sizeof(siridb_rollup_t));
+
+    if (rollup == NULL)
+    {
+        ERR_ALLOC
+        return NULL;
+    }
+
+    rollup->interval = interval;
+    rollup->re = NULL;
+    rollup->name = strdup(name);
+    rollup->source = strdup(pt);
+
+    if (rollup->name == NULL || rollup->source == NULL)
+    {
+        ERR_ALLOC
+        ROLLUP_free(rollup);
+        return NULL;
+    }
+
+    return rollup;
+}
+
+static void ROLLUP_free(siridb_rollup_t * rollup)
+{
+    free(rollup->name);
+    free(rollup->source);
+    if (rollup->re != NULL)
+    {
+        siridb_re_decref(siri.re_cache, rollup->re);
+    }
+    free(rollup);
+}
+
+/*
+ * A source starting with a slash is a regular expression, otherwise the
+ * expression of the group with that name is used. Changes to the group are
+ * used after a restart.
+ *
+ * Returns 0 if successful or -1 in case of an error. (the error is logged)
+ */
+static int ROLLUP_compile(siridb_t * siridb, siridb_rollup_t * rollup)
+{
+    char err_msg[SIRIDB_MAX_SIZE_ERR_MSG];
+    siridb_group_t * group;
+    const char * source = rollup->source;
+
+    if (*source != '/')
+    {
+        group = (siridb_group_t *) ct_get(siridb->groups->groups, source);
+
+        if (group == NULL)
+        {
+            log_error(
+                    "Cannot find group '%s' for rollup '%s'",
+                    source,
+                    rollup->name);
+            return -1;
+        }
+
+        source = group->source;
+    }
+
+    if ((rollup->re = siridb_re_get(
+            siri.re_cache,
+            source,
+            strlen(source),
+            err_msg)) == NULL)
+    {
+        log_error("Invalid rollup '%s': %s", rollup->name, err_msg);
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Restore the buckets written when the database was closed. The file is
+ * removed since the buckets would be incomplete after a crash.
+ *
+ * Returns 0 if successful or -1 in case of an error.
+ */
+static int ROLLUP_load(siridb_t * siridb)
+{
+    SIRIDB_GET_FN(fn, siridb->dbpath, SIRIDB_ROLLUP_FN)
+    qp_unpacker_t * unpacker;
+    qp_obj_t qp_id, qp_name, qp_start, qp_buckets;
+    siridb_series_t * series;
+    siridb_rollup_data_t * data;
+    size_t n = 0;
+
+    if (!xpath_file_exist(fn))
+    {
+        return 0;
+    }
+
+    if ((unpacker = siridb_misc_open_schema_file(
+            SIRIDB_ROLLUP_SCHEMA,
+            fn)) == NULL)
+    {
+        return -1;
+    }
+
+    while ( qp_is_array(qp_next(unpacker, NULL)) &&
+            qp_next(unpacker, &qp_id) == QP_INT64 &&
+            qp_next(unpacker, &qp_name) == QP_RAW &&
+            qp_is_raw_term(&qp_name) &&
+            qp_next(unpacker, &qp_start) == QP_INT64 &&
+            qp_next(unpacker, &qp_buckets) == QP_RAW)
+    {
+        series = (siridb_series_t *) dmap_get(
+                siridb->series_map,
+                (uint64_t) qp_id.via.int64);
+
+        /* skip when the series or the definition of the rollup is changed */
+        if (    series == NULL ||
+                (data = series->rollup) == NULL ||
+                strcmp(data->rollup->name, qp_name.via.raw) ||
+                (uint64_t) qp_start.via.int64 < data->start ||
+                qp_buckets.len % sizeof(siridb_rollup_bucket_t) ||
+                (  qp_buckets.len &&
+                   ((siridb_rollup_bucket_t *) qp_buckets.via.raw)->ts %
+                        data->rollup->interval))
+        {
+            continue;
+        }
+
+        data->buckets = (siridb_rollup_bucket_t *) malloc(qp_buckets.len);
+
+        if (data->buckets == NULL && qp_buckets.len)
+        {
+            log_error("Cannot restore rollup for series '%s'", series->name);
+            continue;
+        }
+
+        memcpy(data->buckets, qp_buckets.via.raw, qp_buckets.len);
+        data->len = data->size =
+                qp_buckets.len / sizeof(siridb_rollup_bucket_t);
+        data->start = (uint64_t) qp_start.via.int64;
+        n++;
+    }
+
+    qp_unpacker_ff_free(unpacker);
+
+    if (unlink(fn))
+    {
+        log_error("Cannot remove file: '%s'", fn);
+        return -1;
+    }
+
+    log_info("Restored rollups for %zu series", n);
+
+    return 0;
+}
+
+static int ROLLUP_write(siridb_series_t * series, qp_fpacker_t * fpacker)
+{
+    siridb_rollup_data_t * data = series->rollup;
+
+    return (data == NULL) ? 0 : (
+            qp_fadd_type(fpacker, QP_ARRAY4) ||
+            qp_fadd_int32(fpacker, (int32_t) series->id) ||
+            qp_fadd_raw(
+                    fpacker,
+                    data->rollup->name,
+                    strlen(data->rollup->name) + 1) ||
+            qp_fadd_int64(fpacker, (int64_t) data->start) ||
+            qp_fadd_raw(
+                    fpacker,
+                    (const char *) data->buckets,
+                    data->len * sizeof(siridb_rollup_bucket_t)));
+}
+
+/*
+ * Returns the bucket for 'ts', a new bucket is created when needed. Points
+ * are usually added in order, so the last bucket is checked first.
+ *
+ * In case of an allocation error, the buckets are cleared and NULL is
+ * returned. The rollup will then only include newer buckets.
+ */
+static siridb_rollup_bucket_t * ROLLUP_bucket(
+        siridb_rollup_data_t * data,
+        uint64_t ts)
+{
+    siridb_rollup_bucket_t * bucket;
+    size_t i;
+
+    if (data->len && data->buckets[data->len - 1].ts == ts)
+    {
+        return data->buckets + data->len - 1;
+    }
+
+    i = (data->len && data->buckets[data->len - 1].ts < ts) ?
+            data->len : ROLLUP_find(data, ts);
+
+    if (i < data->len && data->buckets[i].ts == ts)
+    {
+        return data->buckets + i;
+    }
+
+    if (data->len == data->size)
+    {
+        size_t size = (data->size) ? data->size * 2 : 8;
+
+        bucket = (siridb_rollup_bucket_t *) realloc(
+                data->buckets,
+                size * sizeof(siridb_rollup_bucket_t));
+
+        if (bucket == NULL)
+        {
+            log_error("Cannot allocate a rollup bucket");
+            free(data->buckets);
+            data->buckets = NULL;
+            data->len = data->size = 0;
+            data->start = ts + 1;
+            return NULL;
+        }
+
+        data->buckets = bucket;
+        data->size = size;
+    }
+
+    bucket = data->buckets + i;
+
+    memmove(bucket + 1,
+            bucket,
+            (data->len - i) * sizeof(siridb_rollup_bucket_t));
+
+    bucket->ts = ts;
+    bucket->len = 0;
+    data->len++;
+
+    return bucket;
+}
+
+/*
+ * Returns the index of the first bucket with a time-stamp of at least 'ts'.
+ */
+static size_t ROLLUP_find(siridb_rollup_data_t * data, uint64_t ts)
+{
+    size_t lo = 0, hi = data->len, mid;
+
+    while (lo < hi)
+    {
+        mid = lo + (hi - lo) / 2;
+        if (data->buckets[mid].ts < ts)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+
+    return lo;
+}
+
+static inline void ROLLUP_update(
+        siridb_rollup_bucket_t * bucket,
+        points_tp tp,
+        qp_via_t * val)
+{
+    siridb_points_stats_t * stats = &bucket->stats;
+
+    if (!bucket->len++)
+    {
+        stats->min = stats->max = stats->sum = *val;
+        return;
+    }
+
+    if (!siridb_points_stats_ok(stats))
+    {
+        return;
+    }
+
+    if (tp == TP_INT)
+    {
+        int64_t tmp = val->int64;
+
+        if ((tmp > 0 && stats->sum.int64 > LLONG_MAX - tmp) ||
+                (tmp < 0 && stats->sum.int64 < LLONG_MIN - tmp))
+        {
+            siridb_points_stats_invalidate(stats);
+            return;
+        }
+
+        stats->sum.int64 += tmp;
+
+        if (tmp < stats->min.int64)
+        {
+            stats->min.int64 = tmp;
+        }
+        if (tmp > stats->max.int64)
+        {
+            stats->max.int64 = tmp;
+        }
+    }
+    else
+    {
+        stats->sum.real += val->real;
+
+        if (val->real < stats->min.real)
+        {
+            stats->min.real = val->real;
+        }
+        if (val->real > stats->max.real)
+        {
+            stats->max.real = val->real;
+        }
+    }
+}
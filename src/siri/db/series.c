@@ -22,51 +22,315 @@
  *          since they only run when no other references to the object exist.
  */
 #include <assert.h>
+#include <fcntl.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include <logger/logger.h>
+#include <siri/db/acache.h>
+#include <siri/db/aggregate.h>
 #include <siri/db/buffer.h>
+#include <siri/db/ccache.h>
 #include <siri/db/db.h>
+#include <siri/db/downsample.h>
+#include <siri/db/durations.h>
+#include <siri/db/hotlog.h>
+#include <siri/db/names.h>
 #include <siri/db/series.h>
 #include <siri/db/shard.h>
 #include <siri/db/shards.h>
+#include <siri/db/shash.h>
+#include <siri/db/tokens.h>
+#include <siri/db/trigrams.h>
 #include <siri/err.h>
+#include <siri/fsync.h>
+#include <siri/mem.h>
+#include <siri/optimize.h>
 #include <siri/siri.h>
 #include <string.h>
 #include <xpath/xpath.h>
 
-#define SIRIDB_SERIES_FN "series.dat"
 #define SIRIDB_DROPPED_FN ".dropped"
 #define SIRIDB_MAX_SERIES_ID_FN ".max_series_id"
+#define SIRIDB_SERIES_SNAPSHOT_FN ".series_snapshot"
 #define SIRIDB_SERIES_SCHEMA 1
+#define SIRIDB_SERIES_SNAPSHOT_SCHEMA 1
 #define BEND series->buffer->points->data[series->buffer->points->len - 1].ts
 #define DROPPED_DUMMY 1
 
+/* fields which are added to the hot part must replace others */
+_Static_assert(
+        offsetof(siridb_series_t, version) == SIRIDB_SERIES_HOT_SZ,
+        "the hot fields of siridb_series_t must fill SIRIDB_SERIES_HOT_SZ");
+
+/* narrow selects are counted up to this value, see SERIES_track_read() */
+#define SERIES_NARROW_READS_MAX 16
+#define SERIES_NARROW_READS 8
+
+/*
+ * Minimal number of points read at once by siridb_series_get_aggr(). Must be
+ * at least the max size of a chunk. (65535)
+ */
+#define SERIES_STREAM_BATCH 65536
+
+/*
+ * The series file is read in parts of this size. A part must be able to hold
+ * at least one record of the largest size.
+ */
+#define SERIES_LOAD_WINDOW_SZ 1048576
+#define SERIES_LOAD_RECORD_SZ (SIRIDB_SERIES_NAME_LEN_MAX + 32)
+
+/* memory used by the last points cache of a series */
+#define SERIES_LAST_MEM                                     \
+        (sizeof(siridb_points_t) +                          \
+        siri.cfg->last_points_cache * sizeof(siridb_point_t))
+
+/*
+ * Creates an array with two call-back functions, the first for reading
+ * uncompressed chunks and the second for compressed chunks. Use
+ * SERIES_IDX_POINTS_CB() to select the function for an index.
+ */
 #define SERIES_GET_POINTS_CB(get_points_cb, series)       \
-    siridb_shard_get_points_cb get_points_cb =          \
+    siridb_shard_get_points_cb get_points_cb[2] = {     \
         (series->flags & SIRIDB_SERIES_IS_32BIT_TS) ?    \
             (series->flags & SIRIDB_SERIES_IS_LOG) ?    \
                     siridb_shard_get_points_log32 :        \
                     siridb_shard_get_points_num32 :        \
             (series->flags & SIRIDB_SERIES_IS_LOG) ?    \
                     siridb_shard_get_points_log64 :        \
-                    siridb_shard_get_points_num64;
+                    siridb_shard_get_points_num64,         \
+        (series->flags & SIRIDB_SERIES_IS_32BIT_TS) ?    \
+            (series->flags & SIRIDB_SERIES_IS_LOG) ?    \
+                    siridb_shard_get_points_log32 :        \
+                    siridb_shard_get_points_cnum32 :       \
+            (series->flags & SIRIDB_SERIES_IS_LOG) ?    \
+                    siridb_shard_get_points_log64 :        \
+                    siridb_shard_get_points_cnum64};
+
+#define SERIES_IDX_POINTS_CB(get_points_cb, idx)          \
+    get_points_cb[!!(idx->shard->flags & SIRIDB_SHARD_IS_COMPRESSED)]
+
+/*
+ * Chunks are only merged while reading when the runs are not used.
+ */
+#define SERIES_RUNS_OVERLAP(runs, series)                   \
+    ((runs)->offsets == NULL &&                             \
+        ((series)->flags & SIRIDB_SERIES_HAS_OVERLAP))
+
+/*
+ * Header of the series snapshot. The header is followed by a record for
+ * each series:
+ *
+ *  (uint32_t)  SERIES_ID
+ *  (uint8_t)   TP
+ *  (uint16_t)  NAME_LEN
+ *  (char[])    NAME, including the terminator
+ *
+ * The snapshot is only valid for the series and dropped file from which the
+ * series were loaded at the time the snapshot was written.
+ */
+typedef struct series_snapshot_s
+{
+    uint32_t schema;
+    uint32_t n;                 /* number of series */
+    uint32_t max_series_id;
+    uint32_t checksum;          /* FNV-1a hash of the records */
+    uint64_t size;              /* size of the records */
+    uint64_t series_sz;         /* size of the series file */
+    uint64_t series_mtime;      /* modification time of the series file */
+    uint64_t dropped_sz;        /* size of the dropped file */
+} series_snapshot_t;
+
+#define SERIES_SNAPSHOT_RECORD_SZ 7  /* record size without the name */
+#define SERIES_FNV1A_BASIS 2166136261u
+
+typedef struct series_snapshot_w_s
+{
+    FILE * fp;
+    series_snapshot_t * header;
+} series_snapshot_w_t;
+
+/*
+ * The series file is compacted when the dropped file contains at least this
+ * number of series ids.
+ */
+#define SERIES_COMPACT_DROPPED 10000
+
+typedef struct series_compact_s
+{
+    uv_work_t work;
+    siridb_t * siridb;
+    slist_t * series;           /* series with a reference */
+    uint32_t max_series_id;     /* series created later are appended */
+    long int dropped_offset;    /* drops after this offset are kept */
+    int rc;
+} series_compact_t;
+
+/*
+ * Sorted runs of points which are read from overlapping chunks. The runs
+ * are merged at once instead of inserting each point, see SERIES_runs_add().
+ */
+typedef struct series_runs_s
+{
+    size_t * offsets;   /* start of each run, NULL without overlap */
+    size_t n;           /* number of runs */
+    uint64_t end_ts;    /* last time-stamp of the chunks which are read */
+} series_runs_t;
 
 static int SERIES_save(siridb_t * siridb);
 static int SERIES_load(siridb_t * siridb, imap_t * dropped);
 static int SERIES_read_dropped(siridb_t * siridb, imap_t * dropped);
+static int SERIES_load_snapshot(siridb_t * siridb);
+static int SERIES_read_snapshot(
+        siridb_t * siridb,
+        series_snapshot_t * header,
+        const char * pt);
+static int SERIES_snapshot_stat(
+        siridb_t * siridb,
+        series_snapshot_t * header);
+static int SERIES_snapshot_pack(
+        siridb_series_t * series,
+        series_snapshot_w_t * w);
+static inline uint32_t SERIES_fnv1a(
+        uint32_t hash,
+        const char * data,
+        size_t n);
 static int SERIES_open_new_dropped_file(siridb_t * siridb);
+static int SERIES_compact_ref(siridb_series_t * series, slist_t * slist);
+static void SERIES_compact_work(uv_work_t * work);
+static void SERIES_compact_finish(uv_work_t * work, int status);
+static int SERIES_compact_swap(series_compact_t * compact);
+static int SERIES_compact_dropped(siridb_t * siridb, long int offset);
 static int SERIES_open_dropped_file(siridb_t * siridb);
 static int SERIES_update_max_id(siridb_t * siridb);
+static void SERIES_removed_idx(
+        siridb_t *__restrict siridb,
+        siridb_series_t *__restrict series,
+        uint_fast32_t offset,
+        uint64_t start,
+        uint64_t end);
 static void SERIES_update_start(siridb_series_t *__restrict series);
 static void SERIES_update_end(siridb_series_t *__restrict series);
 static void SERIES_update_overlap(siridb_series_t *__restrict series);
 static inline int SERIES_pack(siridb_series_t * series, qp_fpacker_t * fpacker);
-static void SERIES_idx_sort(
+static inline uint32_t SERIES_idx_size(uint32_t n);
+static inline void SERIES_idx_mem(uint32_t old_len, uint32_t new_len);
+static void SERIES_idx_merge(
         idx_t * idx,
         uint_fast32_t start,
-        uint_fast32_t end);
+        uint_fast32_t end,
+        idx_t * chunks,
+        uint_fast32_t num_chunks,
+        siridb_shard_t * shard);
+static uint_fast32_t SERIES_optimize_range(
+        siridb_series_t *__restrict series,
+        siridb_shard_t *__restrict shard,
+        uint_fast32_t * start,
+        uint_fast32_t * end,
+        uint64_t * bytes_read,
+        siridb_series_optimize_t * optimize);
+static siridb_points_t * SERIES_optimize_points(
+        siridb_series_t *__restrict series,
+        siridb_shard_t *__restrict shard,
+        uint_fast32_t start,
+        uint_fast32_t end,
+        size_t * size);
+static siridb_points_t * SERIES_get_points(
+        siridb_series_t *__restrict series,
+        uint64_t *__restrict start_ts,
+        uint64_t *__restrict end_ts,
+        size_t limit,
+        siridb_aggr_t * filter);
+static void SERIES_idx_range(
+        siridb_series_t *__restrict series,
+        uint64_t *__restrict start_ts,
+        uint64_t *__restrict end_ts,
+        uint32_t * first,
+        uint32_t * last);
+static uint32_t SERIES_idx_last(
+        siridb_series_t *__restrict series,
+        uint32_t first,
+        uint32_t last,
+        uint64_t *__restrict start_ts,
+        uint64_t *__restrict end_ts,
+        size_t limit);
+static void SERIES_track_read(
+        siridb_series_t *__restrict series,
+        uint32_t first,
+        uint32_t last,
+        uint64_t *__restrict start_ts,
+        uint64_t *__restrict end_ts);
+static uint16_t SERIES_chunk_points(
+        siridb_series_t *__restrict series,
+        siridb_shard_t *__restrict shard,
+        size_t size,
+        uint_fast32_t max_chunks);
+static void SERIES_runs_init(
+        series_runs_t * runs,
+        siridb_series_t * series,
+        size_t n);
+static void SERIES_runs_add(
+        series_runs_t * runs,
+        siridb_points_t * points,
+        idx_t * idx);
+static int SERIES_runs_merge(series_runs_t * runs, siridb_points_t * points);
+static int SERIES_stream(
+        siridb_points_t ** points,
+        siridb_points_t ** counts,
+        siridb_points_t * tmp,
+        siridb_aggr_t * base,
+        series_runs_t * runs,
+        char * err_msg);
+static void SERIES_free_aggr(siridb_points_t * a, siridb_points_t * b);
+static int SERIES_get_aggr(
+        siridb_t *__restrict siridb,
+        siridb_series_t *__restrict series,
+        siridb_aggr_t *__restrict base,
+        int is_mean,
+        uint64_t *__restrict start_ts,
+        uint64_t *__restrict end_ts,
+        siridb_points_t ** points_,
+        siridb_points_t ** counts_,
+        char * err_msg);
+static int SERIES_merge_aggr(
+        siridb_t *__restrict siridb,
+        siridb_series_t *__restrict series,
+        siridb_aggr_t *__restrict base,
+        int is_mean,
+        uint64_t *__restrict start_ts,
+        uint64_t *__restrict end_ts,
+        siridb_points_t ** points,
+        siridb_points_t ** counts,
+        char * err_msg);
+static inline void SERIES_load_cold(
+        siridb_t *__restrict siridb,
+        siridb_series_t *__restrict series,
+        uint64_t *__restrict start_ts,
+        uint64_t *__restrict end_ts);
+static void SERIES_last_add(
+        siridb_series_t *__restrict series,
+        uint64_t * ts,
+        qp_via_t * val);
+static void SERIES_last_add_points(
+        siridb_series_t *__restrict series,
+        siridb_point_t * points,
+        size_t len);
+static void SERIES_last_clear(siridb_series_t * series);
+static void SERIES_stats_add(
+        siridb_series_t *__restrict series,
+        const siridb_points_stats_t *__restrict stats);
+static void SERIES_stats_update(siridb_series_t * series);
+static int SERIES_last_fill(siridb_series_t * series);
+static int SERIES_last_get(
+        siridb_series_t *__restrict series,
+        uint64_t *__restrict start_ts,
+        uint64_t *__restrict end_ts,
+        size_t limit,
+        siridb_points_t ** points);
 
 static siridb_series_t * SERIES_new(
         siridb_t * siridb,
@@ -74,6 +338,8 @@ static siridb_series_t * SERIES_new(
         uint8_t tp,
         uint16_t pool,
         const char * name);
+static void SERIES_tp_add(siridb_t * siridb, siridb_series_t * series);
+static void SERIES_tp_remove(siridb_t * siridb, siridb_series_t * series);
 
 const char series_type_map[3][8] = {
         "integer",
@@ -104,6 +370,18 @@ int siridb_series_cexpr_cb(siridb_series_t * series, cexpr_condition_t * cond)
         return cexpr_int_cmp(cond->operator, series->tp, cond->int64);
     case CLERI_GID_K_NAME:
         return cexpr_str_cmp(cond->operator, series->name, cond->str);
+    case CLERI_GID_K_MIN:
+    case CLERI_GID_K_MAX:
+    case CLERI_GID_K_SUM:
+        {
+            qp_via_t * val = siridb_series_stat(series, cond->prop);
+            return (val == NULL) ? 0 : (series->tp == TP_INT) ?
+                    cexpr_int_cmp(cond->operator, val->int64, cond->int64) :
+                    cexpr_double_cmp(
+                            cond->operator,
+                            val->real,
+                            (double) cond->int64);
+        }
     }
     /* we must NEVER get here */
     log_critical("Unexpected series property received: %d", cond->prop);
@@ -111,6 +389,83 @@ int siridb_series_cexpr_cb(siridb_series_t * series, cexpr_condition_t * cond)
     return -1;
 }
 
+/*
+ * Returns a list with a reference to each series which might match
+ * 'where_expr'. Argument 'where_expr' can be NULL in which case all series
+ * are returned. Only the type index and the pool of this server are used to
+ * narrow the list so the expression must still be tested for each series.
+ *
+ * This function should be called while holding siridb->series_mutex.
+ *
+ * Returns NULL in case an error has occurred.
+ */
+slist_t * siridb_series_candidates(siridb_t * siridb, cexpr_t * where_expr)
+{
+    int tp, n = 0, match = 0;
+
+    if (where_expr == NULL)
+    {
+        return dmap_2slist_ref(siridb->series_map);
+    }
+
+    /* only while re-indexing series can have a pool other than ours */
+    if (    !siridb_is_reindexing(siridb) &&
+            !cexpr_can_match(
+                    where_expr,
+                    CLERI_GID_K_POOL,
+                    siridb->server->pool))
+    {
+        return slist_new(0);
+    }
+
+    for (tp = 0; tp < SIRIDB_SERIES_TP_NUM; tp++)
+    {
+        if (cexpr_can_match(where_expr, CLERI_GID_K_TYPE, tp))
+        {
+            match = tp;
+            n++;
+        }
+    }
+
+    return (n == 0) ? slist_new(0) :
+            (n == 1 && siridb->series_tp[match] != NULL) ?
+            dmap_2slist_ref(siridb->series_tp[match]) :
+            dmap_2slist_ref(siridb->series_map);
+}
+
+/*
+ * Returns the minimum (CLERI_GID_K_MIN), maximum (CLERI_GID_K_MAX) or sum
+ * (CLERI_GID_K_SUM) of all points in 'series', or NULL when not available.
+ *
+ * The statistics are kept up-to-date while inserting and optimizing so this
+ * does not read any points. They are not available for string series, when
+ * a chunk has no statistics, when the sum of integer values overflows, or
+ * for series with points in a cold shard which is not loaded.
+ */
+qp_via_t * siridb_series_stat(siridb_series_t * series, uint32_t prop)
+{
+    siridb_t * siridb = series->siridb;
+
+    if (    !siridb_points_stats_ok(&series->stats) ||
+            (siridb->cold_shards &&
+                siridb_shards_has_cold(siridb, series, NULL, NULL)))
+    {
+        return NULL;
+    }
+
+    switch (prop)
+    {
+    case CLERI_GID_K_MIN:
+        return &series->stats.min;
+    case CLERI_GID_K_MAX:
+        return &series->stats.max;
+    case CLERI_GID_K_SUM:
+        return &series->stats.sum;
+    }
+
+    return NULL;
+}
+
 /*
  * Returns 0 if successful; -1 and a SIGNAL is raised in case an error occurred.
  *
@@ -134,15 +489,37 @@ int siridb_series_add_point(
     int rc = 0;
 
     series->length++;
+    series->version = ++siridb->data_version;
+
+    if (series->rollup != NULL)
+    {
+        siridb_rollup_add_point(series->rollup, series->tp, *ts, val);
+    }
+
+    if (series->last != NULL)
+    {
+        SERIES_last_add(series, ts, val);
+    }
+
+    if (siridb_series_isnum(series))
+    {
+        siridb_points_stats_t stats = {.min=*val, .max=*val, .sum=*val};
+        SERIES_stats_add(series, &stats);
+    }
 
     if (series->buffer != NULL)
     {
         /* add point in memory
          * (memory can hold 1 more point than we can hold on disk)
          */
+        if (siridb_buffer_reserve(siridb, series, 1))
+        {
+            return -1;  /* signal is raised */
+        }
+
         siridb_points_add_point(series->buffer, ts, val);
 
-        if (series->buffer->len == siridb->buffer_len)
+        if (series->buffer->len == siridb_buffer_len(siridb, series))
         {
             if (siridb_shards_add_points(
                     siridb,
@@ -153,14 +530,27 @@ int siridb_series_add_point(
             }
             else
             {
-                series->buffer->len = 0;
-                if (siridb_buffer_write_len(siridb, series))
+                if (siridb_buffer_reset(siridb, series))
                 {
-                    ERR_FILE
-                    rc = -1;
+                    rc = -1;  /* signal is raised */
                 }
             }
         }
+        else if (series->bf_hot)
+        {
+            siridb_point_t point = {.ts=*ts, .val=*val};
+
+            if (siridb_hotlog_write(siridb->hotlog, series->id, &point, 1))
+            {
+                ERR_FILE
+                log_critical("Cannot write new point to hot log");
+                rc = -1;
+            }
+            else
+            {
+                siri_fsync_add(NULL, sizeof(siridb_point_t));
+            }
+        }
         else
         {
             if (siridb_buffer_write_point(siridb, series, ts, val))
@@ -169,6 +559,10 @@ int siridb_series_add_point(
                 log_critical("Cannot write new point to buffer");
                 rc = -1;
             }
+            else
+            {
+                siri_fsync_add(NULL, sizeof(uint64_t) + sizeof(qp_via_t));
+            }
         }
     }
     return rc;
@@ -184,13 +578,44 @@ int siridb_series_add_point(
  *
  * -    This method will update the series->length but updating the time-stamps
  *      (series->start and series->end) should be done outside this function.
+ *
+ * The points in pcache are allowed to be unsorted and will be sorted here.
  */
 int siridb_series_add_pcache(
         siridb_t *__restrict siridb,
         siridb_series_t *__restrict series,
         siridb_pcache_t *__restrict pcache)
 {
-    if (pcache->len > siridb->buffer_len)
+    siridb_pcache_sort(pcache);
+
+    series->version = ++siridb->data_version;
+
+    if (series->rollup != NULL)
+    {
+        siridb_rollup_add_points(
+                series->rollup,
+                series->tp,
+                pcache->data,
+                pcache->len);
+    }
+
+    if (series->last != NULL)
+    {
+        SERIES_last_add_points(series, pcache->data, pcache->len);
+    }
+
+    if (siridb_series_isnum(series) && pcache->len)
+    {
+        siridb_points_stats_t stats;
+        siridb_points_stats(
+                &stats,
+                (siridb_points_t *) pcache,
+                0,
+                pcache->len);
+        SERIES_stats_add(series, &stats);
+    }
+
+    if (pcache->len > siridb_buffer_len(siridb, series))
     {
         series->length += pcache->len;
 
@@ -202,21 +627,14 @@ int siridb_series_add_pcache(
             return -1;  /* signal is raised */
         }
     }
-    else if (pcache->len + series->buffer->len > siridb->buffer_len)
+    else if (pcache->len + series->buffer->len >
+            siridb_buffer_len(siridb, series))
     {
         series->length += pcache->len;
 
-        siridb_points_t *__restrict points = series->buffer;
-        size_t i = points->len;
-        siridb_point_t *__restrict point;
-
-        while (i--)
+        if (siridb_pcache_add_points(pcache, series->buffer))
         {
-            point = points->data + i;
-            if (siridb_pcache_add_point(pcache, &point->ts, &point->val))
-            {
-                return -1;  /* signal is raised */
-            }
+            return -1;  /* signal is raised */
         }
 
         if (siridb_shards_add_points(
@@ -228,39 +646,209 @@ int siridb_series_add_pcache(
         }
         else
         {
-            series->buffer->len = 0;
-            if (siridb_buffer_write_len(siridb, series))
+            if (siridb_buffer_reset(siridb, series))
             {
-                ERR_FILE
-                return -1;
+                return -1;  /* signal is raised */
             }
         }
     }
-    else
+    else if (pcache->len)
     {
-        siridb_point_t *__restrict point;
+        series->length += pcache->len;
 
-        for (size_t i = 0; i < pcache->len; i++)
+        if (siridb_buffer_reserve(siridb, series, pcache->len))
         {
-            point = pcache->data + i;
+            return -1;  /* signal is raised */
+        }
 
-            if (siridb_series_add_point(
+        siridb_points_add_sorted(series->buffer, pcache->data, pcache->len);
+
+        if (series->buffer->len == siridb_buffer_len(siridb, series))
+        {
+            if (siridb_shards_add_points(
                     siridb,
                     series,
-                    &point->ts,
-                    &point->val))
+                    series->buffer))
+            {
+                return -1;  /* signal is raised */
+            }
+
+            if (siridb_buffer_reset(siridb, series))
             {
                 return -1;  /* signal is raised */
             }
         }
+        else
+        {
+            /* the new points are written at once, in order of the pcache */
+            if (series->bf_hot ?
+                    siridb_hotlog_write(
+                            siridb->hotlog,
+                            series->id,
+                            pcache->data,
+                            pcache->len) :
+                    siridb_buffer_write_points(
+                            siridb,
+                            series,
+                            pcache->data,
+                            pcache->len))
+            {
+                ERR_FILE
+                log_critical("Cannot write new points to buffer");
+                return -1;
+            }
+
+            siri_fsync_add(NULL, pcache->len * 16);
+        }
     }
     return 0;
 }
 
+/*
+ * Write sorted points directly to the shards, without using the buffer.
+ * This is used by bulk imports which usually add many points at once.
+ *
+ * Unlike siridb_series_add_pcache(), the series->start and series->end
+ * time-stamps are updated by this function.
+ *
+ * Returns 0 if successful or -1 and a SIGNAL is raised in case of an error.
+ */
+int siridb_series_import(
+        siridb_t *__restrict siridb,
+        siridb_series_t *__restrict series,
+        siridb_points_t *__restrict points)
+{
+    if (!points->len)
+    {
+        return 0;
+    }
+
+    series->version = ++siridb->data_version;
+
+    if (series->rollup != NULL)
+    {
+        siridb_rollup_add_points(
+                series->rollup,
+                series->tp,
+                points->data,
+                points->len);
+    }
+
+    if (series->last != NULL)
+    {
+        SERIES_last_add_points(series, points->data, points->len);
+    }
+
+    if (siridb_series_isnum(series))
+    {
+        siridb_points_stats_t stats;
+        siridb_points_stats(&stats, points, 0, points->len);
+        SERIES_stats_add(series, &stats);
+    }
+
+    if (points->data[0].ts < series->start)
+    {
+        series->start = points->data[0].ts;
+    }
+
+    if (points->data[points->len - 1].ts > series->end)
+    {
+        series->end = points->data[points->len - 1].ts;
+    }
+
+    series->length += points->len;
+
+    return siridb_shards_add_points(siridb, series, points);
+}
+
+/*
+ * Add the points in pcache to the series buffer when this does not fill the
+ * buffer, so nothing needs to be written to the shards.
+ *
+ * Returns 1 when the points are added or 0 when the points must be added
+ * using siridb_series_add_pcache(). In case of an error -1 is returned and a
+ * SIGNAL is raised.
+ *
+ * Multiple threads can use this function at the same time for different
+ * series since only the series and its region in the mapped buffer file are
+ * changed. (the buffer must be mapped, otherwise 0 is returned)
+ *
+ * Hot series are not handled here since the hot log is shared.
+ */
+int siridb_series_add_pcache_buffered(
+        siridb_t *__restrict siridb,
+        siridb_series_t *__restrict series,
+        siridb_pcache_t *__restrict pcache)
+{
+    if (    siridb->buffer_map == NULL ||
+            series->buffer == NULL ||
+            series->bf_hot ||
+            pcache->len + series->buffer->len >=
+                    siridb_buffer_len(siridb, series) ||
+            pcache->len + series->buffer->len > series->bf_cap)
+    {
+        /* growing the buffer is left to the main thread */
+        return 0;
+    }
+
+    siridb_pcache_sort(pcache);
+
+    series->version = __atomic_add_fetch(
+            &siridb->data_version,
+            1,
+            __ATOMIC_RELAXED);
+
+    if (series->rollup != NULL)
+    {
+        siridb_rollup_add_points(
+                series->rollup,
+                series->tp,
+                pcache->data,
+                pcache->len);
+    }
+
+    if (series->last != NULL)
+    {
+        SERIES_last_add_points(series, pcache->data, pcache->len);
+    }
+
+    if (siridb_series_isnum(series) && pcache->len)
+    {
+        siridb_points_stats_t stats;
+        siridb_points_stats(
+                &stats,
+                (siridb_points_t *) pcache,
+                0,
+                pcache->len);
+        SERIES_stats_add(series, &stats);
+    }
+
+    series->length += pcache->len;
+
+    siridb_points_add_sorted(series->buffer, pcache->data, pcache->len);
+
+    if (siridb_buffer_write_points(
+            siridb,
+            series,
+            pcache->data,
+            pcache->len))
+    {
+        ERR_FILE
+        log_critical("Cannot write new points to buffer");
+        return -1;
+    }
+
+    siri_fsync_add(NULL, pcache->len * 16);
+
+    return 1;
+}
+
 /*
  * Returns NULL and raises a SIGNAL in case an error has occurred.
  *
  * This function adds the new series to siridb->series_map and siridb->series.
+ * The series is written to the store but siridb_series_commit() must be
+ * called to flush the store, which is done once for each insert.
  */
 siridb_series_t * siridb_series_new(
         siridb_t * siridb,
@@ -289,14 +877,14 @@ siridb_series_t * siridb_series_new(
     if (qp_fadd_type(siridb->store, QP_ARRAY3) ||
         qp_fadd_raw(siridb->store, series_name, series->name_len + 1) ||
         qp_fadd_int32(siridb->store, (int32_t) series->id) ||
-        qp_fadd_int8(siridb->store, (int8_t) series->tp) ||
-        qp_flush(siridb->store))
+        qp_fadd_int8(siridb->store, (int8_t) series->tp))
     {
         ERR_FILE
         log_critical("Cannot write series '%s' to store.", series_name);
         siridb__series_free(series);
         return NULL;
     }
+    siridb->store_pending++;
 
     /* create a buffer for series (except string series) */
     if (tp != TP_STRING && siridb_buffer_new_series(siridb, series))
@@ -308,7 +896,7 @@ siridb_series_t * siridb_series_new(
         return NULL;
     }
 
-    if (imap_add(siridb->series_map, series->id, series))
+    if (dmap_add(siridb->series_map, series->id, series))
     {
         log_critical("Error adding series '%s' to the internal imap.",
                 series_name);
@@ -321,17 +909,29 @@ siridb_series_t * siridb_series_new(
     {
         log_critical("Error adding series '%s' to the internal smap.",
                 series_name);
-        imap_pop(siridb->series_map, series->id);
+        dmap_pop(siridb->series_map, series->id);
         siridb__series_free(series);
         ERR_ALLOC
         return NULL;
     }
 
+    /* not critical, the index is no longer used when this fails */
+    siridb_trigrams_add(siridb->trigrams, series);
+    siridb_tokens_add(siridb->tokens, series);
+    siridb_shash_add(siridb->shash, series);
+    SERIES_tp_add(siridb, series);
+
+    /* cached regular expression matches are no longer valid */
+    siridb->series_gen++;
+
     /* we can ignore the result code since this is not critical and logging
      * is done by the function.
      */
     siridb_groups_add_series(siridb->groups, series);
 
+    siridb_rollups_add_series(siridb, series);
+    siridb_durations_add_series(siridb, series);
+
     return series;
 }
 
@@ -351,30 +951,72 @@ void siridb__series_free(siridb_series_t *__restrict series)
 
     siridb_shard_t * shard;
 
-    /* mark shards with dropped series flag */
-    for (uint_fast32_t i = 0; i < series->idx_len; i++)
+    if (series->flags & SIRIDB_SERIES_IS_DROPPED && series->idx_len)
     {
-        shard = series->idx[i].shard;
-        shard->flags |= SIRIDB_SHARD_HAS_DROPPED_SERIES;
-        siridb_shard_decref(shard);
-    }
+        /* the chunks are marked as dead by the next optimize cycle */
+        siri_mutex_lock(&series->siridb->shards_mutex);
+        for (uint_fast32_t i = 0; i < series->idx_len; i++)
+        {
+            shard = series->idx[i].shard;
+            if (siridb_shard_drop_chunk(shard, &series->idx[i]))
+            {
+                shard->flags |= SIRIDB_SHARD_HAS_DROPPED_SERIES;
+            }
+        }
+        siri_mutex_unlock(&series->siridb->shards_mutex);
 
-    if (series->buffer != NULL)
-    {
-        siridb_points_free(series->buffer);
-        if (series->flags & SIRIDB_SERIES_IS_DROPPED)
+        for (uint_fast32_t i = 0; i < series->idx_len; i++)
         {
-            slist_append_safe(
-                &series->siridb->empty_buffers,
-                (void *) series->bf_offset);
+            siridb_shard_decref(series->idx[i].shard);
         }
     }
+    else
+    {
+        /* mark shards with dropped series flag */
+        for (uint_fast32_t i = 0; i < series->idx_len; i++)
+        {
+            shard = series->idx[i].shard;
+            shard->flags |= SIRIDB_SHARD_HAS_DROPPED_SERIES;
+            siridb_shard_decref(shard);
+        }
+    }
+
+    if (series->bf_hot && series->siridb->hotlog != NULL)
+    {
+        siridb_hotlog_remove(series->siridb->hotlog, series);
+    }
+
+    if (series->buffer != NULL)
+    {
+        siri_mem_sub(
+                SIRI_MEM_BUFFER,
+                siridb_buffer_mem(series->siridb, series));
+        siridb_points_free(series->buffer);
+        if (series->flags & SIRIDB_SERIES_IS_DROPPED)
+        {
+            slist_append_safe(
+                &series->siridb->empty_buffers[series->bf_class],
+                (void *) series->bf_offset);
+        }
+    }
+
+    if (series->rollup != NULL)
+    {
+        siridb_rollup_data_free(series->rollup);
+    }
+
+    SERIES_last_clear(series);
+
+    siri_mem_sub(
+            SIRI_MEM_SERIES,
+            sizeof(siridb_series_t) + series->name_len + 1);
+    SERIES_idx_mem(series->idx_len, 0);
+
+    free(series->idx);
+    siridb_names_release(series->name);
+    siridb_slab_release(siri.series_slab, series);
+}
 
-    free(series->idx);
-    free(series->name);
-    free(series);
-}
-
 /*
  * Returns 0 if successful or -1 in case or an error.
  * (a SIGNAL might be raised)
@@ -387,22 +1029,32 @@ int siridb_series_load(siridb_t * siridb)
 #endif
     log_info("Loading series");
 
-    imap_t * dropped = imap_new();
+    int rc = SERIES_load_snapshot(siridb);
 
-    if (dropped == NULL)
+    if (rc == -1)
     {
         return -1;
     }
 
-    if (SERIES_read_dropped(siridb, dropped) ||
-        SERIES_load(siridb, dropped))
+    if (rc)
     {
+        imap_t * dropped = imap_new();
+
+        if (dropped == NULL)
+        {
+            return -1;
+        }
+
+        if (SERIES_read_dropped(siridb, dropped) ||
+            SERIES_load(siridb, dropped))
+        {
+            imap_free(dropped, NULL);
+            return -1;
+        }
+
         imap_free(dropped, NULL);
-        return -1;
     }
 
-    imap_free(dropped, NULL);
-
     if (SERIES_update_max_id(siridb) ||
         SERIES_open_new_dropped_file(siridb) ||
         siridb_series_open_store(siridb))
@@ -413,6 +1065,71 @@ int siridb_series_load(siridb_t * siridb)
     return 0;
 }
 
+/*
+ * Write a snapshot of the series so the next start does not need to read
+ * the series file. This function should be called at a clean shutdown,
+ * after the series and dropped files are closed.
+ *
+ * Returns 0 if successful or -1 in case of an error.
+ */
+int siridb_series_save_snapshot(siridb_t * siridb)
+{
+    series_snapshot_t header;
+    series_snapshot_w_t w;
+    int rc = 0;
+
+    SIRIDB_GET_FN(fn, siridb->dbpath, SIRIDB_SERIES_SNAPSHOT_FN)
+    SIRIDB_GET_FN(tmp, siridb->dbpath, SIRIDB_SERIES_SNAPSHOT_FN "_")
+
+    log_debug("Write series snapshot");
+
+    memset(&header, 0, sizeof(series_snapshot_t));
+    header.schema = SIRIDB_SERIES_SNAPSHOT_SCHEMA;
+    header.max_series_id = siridb->max_series_id;
+    header.checksum = SERIES_FNV1A_BASIS;
+
+    if (SERIES_snapshot_stat(siridb, &header))
+    {
+        log_error("Cannot read the series files for writing a snapshot");
+        return -1;
+    }
+
+    if ((w.fp = fopen(tmp, "w")) == NULL)
+    {
+        log_error("Cannot open file '%s' for writing", tmp);
+        return -1;
+    }
+
+    w.header = &header;
+
+    /* the header is written again when the records are written */
+    if (    fwrite(&header, sizeof(series_snapshot_t), 1, w.fp) != 1 ||
+            dmap_walk(
+                    siridb->series_map,
+                    (imap_cb) &SERIES_snapshot_pack,
+                    &w) ||
+            fseeko(w.fp, 0, SEEK_SET) ||
+            fwrite(&header, sizeof(series_snapshot_t), 1, w.fp) != 1)
+    {
+        log_error("Cannot write series snapshot to file '%s'", tmp);
+        rc = -1;
+    }
+
+    if (fclose(w.fp))
+    {
+        log_error("Cannot close series snapshot file '%s'", tmp);
+        rc = -1;
+    }
+
+    if (rc || rename(tmp, fn))
+    {
+        unlink(tmp);
+        return -1;
+    }
+
+    return 0;
+}
+
 /*
  * This function should only be called when new values are added.
  * For example, during optimization we do not use this function for
@@ -426,23 +1143,50 @@ int siridb_series_add_idx(
         uint64_t start_ts,
         uint64_t end_ts,
         uint32_t pos,
-        uint16_t len)
+        uint16_t len,
+        uint16_t chunk_sz,
+        const siridb_points_stats_t * stats)
 {
     idx_t * idx;
     uint32_t i = series->idx_len;
-    series->idx_len++;
 
-    /* never zero */
-    idx = (idx_t *) realloc(
-            series->idx,
-            series->idx_len * sizeof(idx_t));
-    if (idx == NULL)
+    /* the shard is dropped without walking all series, see shard.c */
+    if (siridb_shard_add_series(shard, series->id))
     {
         ERR_ALLOC
-        series->idx_len--;
         return -1;
     }
-    series->idx = idx;
+
+    /* points of a cold shard are not in the statistics until loaded */
+    if (shard->is_cold && siridb_series_isnum(series))
+    {
+        siridb_points_stats_t tmp;
+
+        if (stats == NULL)
+        {
+            siridb_points_stats_invalidate(&tmp);
+            stats = &tmp;
+        }
+        SERIES_stats_add(series, stats);
+    }
+
+    /* the index is full when the length has reached the allocated size */
+    if (SERIES_idx_size(i) == i)
+    {
+        /* never zero */
+        idx = (idx_t *) realloc(
+                series->idx,
+                SERIES_idx_size(i + 1) * sizeof(idx_t));
+        if (idx == NULL)
+        {
+            ERR_ALLOC
+            return -1;
+        }
+        series->idx = idx;
+        SERIES_idx_mem(i, i + 1);
+    }
+
+    series->idx_len++;
 
     for (; i && start_ts < series->idx[i - 1].start_ts; i--)
     {
@@ -457,12 +1201,28 @@ int siridb_series_add_idx(
         shard->flags |= SIRIDB_SHARD_HAS_NEW_VALUES;
     }
 
+    if (~shard->flags & SIRIDB_SHARD_IS_LOADING)
+    {
+        shard->new_chunks++;
+        shard->new_size += chunk_sz;
+    }
+
     idx->start_ts = start_ts;
     idx->end_ts = end_ts;
     idx->len = len;
+    idx->chunk_sz = chunk_sz;
     idx->shard = shard;
     idx->pos = pos;
 
+    if (stats == NULL)
+    {
+        siridb_points_stats_invalidate(&idx->stats);
+    }
+    else
+    {
+        idx->stats = *stats;
+    }
+
     /* We do not have to save an overlap since it will be detected again when
      * reading the shard at startup.
      */
@@ -473,6 +1233,7 @@ int siridb_series_add_idx(
     {
         shard->flags |= SIRIDB_SHARD_HAS_OVERLAP;
         series->flags |= SIRIDB_SERIES_HAS_OVERLAP;
+        shard->overlaps++;
     }
 
     siridb_shard_incref(shard);
@@ -488,12 +1249,32 @@ int siridb_series_add_idx(
 void siridb_series_drop_prepare(siridb_t * siridb, siridb_series_t * series)
 {
     /* remove series from map */
-    imap_pop(siridb->series_map, series->id);
+    dmap_pop(siridb->series_map, series->id);
 
     /* remove series from tree */
     ct_pop(siridb->series, series->name);
 
+    /* remove series from the name index */
+    siridb_trigrams_remove(siridb->trigrams, series);
+    siridb_tokens_remove(siridb->tokens, series);
+    siridb_shash_remove(siridb->shash, series);
+    SERIES_tp_remove(siridb, series);
+
     series->flags |= SIRIDB_SERIES_IS_DROPPED;
+
+    /* cached regular expression matches are no longer valid */
+    siridb->series_gen++;
+
+    if (siridb->acache != NULL)
+    {
+        siridb_acache_drop(siridb->acache, series->id, 0, UINT64_MAX);
+    }
+
+    /* the groups thread removes the series from the groups */
+    if (siridb->groups != NULL)
+    {
+        siridb_groups_drop_series(siridb->groups, series);
+    }
 }
 
 /*
@@ -558,6 +1339,60 @@ int siridb_series_drop(siridb_t * siridb, siridb_series_t * series)
     return 0;
 }
 
+/*
+ * Drop a list of series at once. Series which are already dropped are
+ * skipped. The ids of the dropped series are written to the dropped file
+ * using a single write.
+ *
+ * Warning: do not forget to call 'siridb_series_flush_dropped()'
+ *
+ * Return 0 if successful or -1 in case the dropped series are not written
+ * to file. The series are still dropped from memory in the case.
+ */
+int siridb_series_drop_n(
+        siridb_t * siridb,
+        siridb_series_t ** series,
+        size_t n)
+{
+    uint32_t * ids = (uint32_t *) malloc(n * sizeof(uint32_t));
+    size_t m = 0;
+    int rc = 0;
+
+    if (ids == NULL)
+    {
+        /* not critical, drop the series one by one */
+        for (size_t i = 0; i < n; i++)
+        {
+            rc |= siridb_series_drop(siridb, series[i]);
+        }
+        return rc;
+    }
+
+    for (size_t i = 0; i < n; i++)
+    {
+        if (~series[i]->flags & SIRIDB_SERIES_IS_DROPPED)
+        {
+            siridb_series_drop_prepare(siridb, series[i]);
+            ids[m++] = series[i]->id;
+
+            /* the series is still referenced by the caller */
+            siridb_series_decref(series[i]);
+        }
+    }
+
+    if (m && (
+            (siridb->dropped_fp == NULL && SERIES_open_dropped_file(siridb)) ||
+            fwrite(ids, sizeof(uint32_t), m, siridb->dropped_fp) != m))
+    {
+        log_critical("Cannot write %zu dropped series to file.", m);
+        rc = -1;
+    }
+
+    free(ids);
+
+    return rc;
+}
+
 /*
  * Return 0 if successful or EOF if not.
  *
@@ -580,12 +1415,84 @@ int siridb_series_flush_dropped(siridb_t * siridb)
         log_critical("Could not flush dropped file: '%s'", fn);
         rc = -1;
     }
-
-    siridb->groups->flags |= GROUPS_FLAG_DROPPED_SERIES;
+    else if (ftello(siridb->dropped_fp) >=
+            (off_t) (SERIES_COMPACT_DROPPED * sizeof(uint32_t)))
+    {
+        siridb_series_compact(siridb);
+    }
 
     return rc;
 }
 
+/*
+ * Start compacting the series file in the background. The file is written
+ * from a copy of the series, series which are created while the file is
+ * written are appended when the new file replaces the old one. The dropped
+ * file then only keeps the series which are dropped while writing, so the
+ * next start does not need to read a long history of created and dropped
+ * series.
+ *
+ * Nothing is done while a re-index is in progress since series which are
+ * prepared for a drop are removed from the series map before the drop is
+ * committed.
+ *
+ * This function can raise a SIGNAL.
+ */
+void siridb_series_compact(siridb_t * siridb)
+{
+    series_compact_t * compact;
+
+    if (    (siridb->flags & SIRIDB_FLAG_COMPACTING) ||
+            siridb->reindex != NULL ||
+            siridb->dropped_fp == NULL)
+    {
+        return;
+    }
+
+    compact = (series_compact_t *) malloc(sizeof(series_compact_t));
+    if (compact == NULL)
+    {
+        ERR_ALLOC
+        return;
+    }
+
+    compact->series = slist_new(siridb->series_map->len);
+    if (compact->series == NULL)
+    {
+        free(compact);
+        ERR_ALLOC
+        return;
+    }
+
+    /* drops up to this offset are in the map, the file is flushed */
+    compact->dropped_offset = ftello(siridb->dropped_fp);
+    compact->max_series_id = siridb->max_series_id;
+    compact->siridb = siridb;
+    compact->rc = 0;
+    compact->work.data = compact;
+
+    dmap_walk(
+            siridb->series_map,
+            (imap_cb) SERIES_compact_ref,
+            compact->series);
+
+    siridb->flags |= SIRIDB_FLAG_COMPACTING;
+    siridb_incref(siridb);
+
+    log_info(
+            "Start compacting the series file for database '%s' "
+            "(%zu series)",
+            siridb->dbname,
+            compact->series->len);
+
+    siri_sched_queue(
+            SIRI_SCHED_BACKGROUND,
+            NULL,
+            &compact->work,
+            SERIES_compact_work,
+            SERIES_compact_finish);
+}
+
 /*
  * Re-allocations in this function can fail but are not critical.
  *
@@ -597,7 +1504,8 @@ void siridb_series_remove_shard(
         siridb_shard_t *__restrict shard)
 {
 #ifdef DEBUG
-    assert (shard->id % siridb->duration_num == series->mask);
+    assert (siridb_durations_mask(siridb, shard->tp, shard->id) ==
+            series->mask);
 #endif
 
     idx_t *__restrict idx;
@@ -611,6 +1519,7 @@ void siridb_series_remove_shard(
     {
         if (idx->shard == shard)
         {
+            siridb_ccache_drop(siri.ccache, shard, idx->pos);
             siridb_shard_decref(shard);
             offset++;
             series->length -= idx->len;
@@ -623,480 +1532,2052 @@ void siridb_series_remove_shard(
 
     if (offset)
     {
-        if (!series->length)
-        {
-            series->idx_len = 0;
+        uint64_t start = SIRIDB_SHARD_START(shard);
 
-            if (siridb_series_drop(siridb, series))
-            {
-                siridb_series_flush_dropped(siridb);
-            }
-        }
-        else
-        {
-            series->idx_len -= offset;
-            idx = (idx_t *) realloc(
-                        series->idx,
-                        series->idx_len * sizeof(idx_t));
-            if (idx == NULL && series->idx_len)
-            {
-                log_error("Re-allocation failed while removing series from "
-                        "shard index");
-            }
-            else
-            {
-                series->idx = idx;
-            }
-            uint64_t start = shard->id - series->mask;
-            uint64_t end = start + siridb->duration_num;
-            if (series->start >= start && series->start < end)
-            {
-                SERIES_update_start(series);
-            }
-            if (series->end < end && series->end > start)
-            {
-                SERIES_update_end(series);
-            }
-        }
+        SERIES_removed_idx(
+                siridb,
+                series,
+                offset,
+                start,
+                start + shard->duration);
     }
 }
 
 /*
- * Update series properties.
- *
- * (series might be destroyed if series->length is zero)
+ * Remove the indexes of 'shard' which start before position 'size' in the
+ * shard file. This is used when an optimize is resumed, the points of these
+ * chunks are already written to the new shard.
  */
-void siridb_series_update_props(siridb_t * siridb, siridb_series_t * series)
+void siridb_series_remove_replaced(
+        siridb_t *__restrict siridb,
+        siridb_series_t *__restrict series,
+        siridb_shard_t *__restrict shard,
+        size_t size)
 {
-    if (series->buffer == NULL)
+    idx_t *__restrict idx;
+    uint_fast32_t i, offset;
+
+    i = offset = 0;
+
+    for (   idx = series->idx;
+            i < series->idx_len;
+            i++, idx++)
     {
-        log_error(
-            "Drop '%s' (%" PRIu32 ") since nu buffer is found for this series",
-            series->name,
-            series->id);
-        siridb_series_drop(siridb, series);
+        if (idx->shard == shard && idx->pos < size)
+        {
+            siridb_ccache_drop(siri.ccache, shard, idx->pos);
+            siridb_shard_decref(shard);
+            offset++;
+            series->length -= idx->len;
+        }
+        else if (offset)
+        {
+            series->idx[i - offset] = series->idx[i];
+        }
     }
-    else
+
+    if (offset)
     {
-        SERIES_update_start(series);
-        SERIES_update_end(series);
+        uint64_t start = SIRIDB_SHARD_START(shard);
 
-        if (!series->length)
-        {
-            log_warning(
-                "Drop '%s' (%" PRIu32 ") since no data is found for this series",
-                series->name,
-                series->id);
-            siridb_series_drop(siridb, series);
-        }
+        SERIES_removed_idx(
+                siridb,
+                series,
+                offset,
+                start,
+                start + shard->duration);
     }
 }
 
 /*
- * Returns NULL and raises a SIGNAL in case an error has occurred.
+ * Remove the indexes of all shards in 'shards' from the series. The map
+ * must contain the shards by their id so both the old and new shard of a
+ * shard which is optimized are removed.
+ *
+ * Re-allocations in this function can fail but are not critical.
+ *
+ * Note that 'series' can be destroyed when series->length has reached zero.
  */
-siridb_points_t * siridb_series_get_points(
+void siridb_series_remove_shards(
+        siridb_t *__restrict siridb,
         siridb_series_t *__restrict series,
-        uint64_t *__restrict start_ts,
-        uint64_t *__restrict end_ts)
+        imap_t *__restrict shards)
 {
     idx_t *__restrict idx;
-    siridb_points_t *__restrict points;
-    siridb_point_t *__restrict point;
-    size_t len, size;
-    uint32_t i;
-    uint32_t indexes[series->idx_len];
-    len = i = size = 0;
+    uint_fast32_t i, offset;
+    uint64_t shard_start, start = UINT64_MAX, end = 0;
+
+    i = offset = 0;
 
     for (   idx = series->idx;
             i < series->idx_len;
             i++, idx++)
     {
-        if (    (start_ts == NULL || idx->end_ts >= *start_ts) &&
-                (end_ts == NULL || idx->start_ts < *end_ts))
+        if (imap_get(shards, idx->shard->id) != NULL)
         {
-            size += idx->len;
-            indexes[len] = i;
-            len++;
+            shard_start = SIRIDB_SHARD_START(idx->shard);
+            if (shard_start < start)
+            {
+                start = shard_start;
+            }
+            if (shard_start + idx->shard->duration > end)
+            {
+                end = shard_start + idx->shard->duration;
+            }
+            siridb_ccache_drop(siri.ccache, idx->shard, idx->pos);
+            siridb_shard_decref(idx->shard);
+            offset++;
+            series->length -= idx->len;
+        }
+        else if (offset)
+        {
+            series->idx[i - offset] = series->idx[i];
         }
     }
 
-    size += series->buffer->len;
-    points = siridb_points_new(size, series->tp);
-
-    if (points == NULL)
+    if (offset)
     {
-        return NULL;  /* signal is raised */
+        SERIES_removed_idx(siridb, series, offset, start, end);
+    }
+}
+
+/*
+ * Remove the indexes which point to a cold shard. This is used when the index
+ * of a shard is released, see siridb_shards_evict(). The indexes are added
+ * again when the cold shard is loaded so we leave the start and end
+ * properties and the series version unchanged.
+ *
+ * Re-allocations in this function can fail but are not critical.
+ *
+ * Returns the number of removed indexes. (can be used with dmap_walk)
+ */
+int siridb_series_evict_cold(
+        siridb_series_t * series,
+        void * args __attribute__((unused)))
+{
+    idx_t * idx;
+    uint_fast32_t i, offset;
+
+    for (i = offset = 0, idx = series->idx; i < series->idx_len; i++, idx++)
+    {
+        if (idx->shard->is_cold)
+        {
+            series->length -= idx->len;
+            siridb_shard_decref(idx->shard);
+            offset++;
+        }
+        else if (offset)
+        {
+            series->idx[i - offset] = series->idx[i];
+        }
+    }
+
+    if (offset)
+    {
+        SERIES_idx_mem(series->idx_len, series->idx_len - offset);
+        series->idx_len -= offset;
+        idx = (idx_t *) realloc(
+                    series->idx,
+                    SERIES_idx_size(series->idx_len) * sizeof(idx_t));
+        if (idx != NULL || !series->idx_len)
+        {
+            series->idx = idx;
+        }
+
+        /* the statistics are for loaded points only */
+        SERIES_stats_update(series);
+    }
+
+    return (int) offset;
+}
+
+/*
+ * Update series properties.
+ *
+ * (series might be destroyed if series->length is zero)
+ */
+void siridb_series_update_props(siridb_t * siridb, siridb_series_t * series)
+{
+    if (series->buffer == NULL)
+    {
+        log_error(
+            "Drop '%s' (%" PRIu32 ") since nu buffer is found for this series",
+            series->name,
+            series->id);
+        siridb_series_drop(siridb, series);
+    }
+    else
+    {
+        SERIES_update_start(series);
+        SERIES_update_end(series);
+        SERIES_stats_update(series);
+
+        /* the series might still have points in a cold shard */
+        if (!series->length && !siridb->cold_shards)
+        {
+            log_warning(
+                "Drop '%s' (%" PRIu32 ") since no data is found for this series",
+                series->name,
+                series->id);
+            siridb_series_drop(siridb, series);
+        }
+    }
+}
+
+/*
+ * Returns NULL and raises a SIGNAL in case an error has occurred.
+ *
+ * Cold shards for the time range are loaded first.
+ */
+siridb_points_t * siridb_series_get_points(
+        siridb_t *__restrict siridb,
+        siridb_series_t *__restrict series,
+        uint64_t *__restrict start_ts,
+        uint64_t *__restrict end_ts)
+{
+    SERIES_load_cold(siridb, series, start_ts, end_ts);
+    return SERIES_get_points(series, start_ts, end_ts, 0, NULL);
+}
+
+/*
+ * Returns the points between 'start_ts' and 'end_ts' which are required
+ * for filter aggregate 'filter'. Chunks for which the statistics tell that
+ * none of the points pass the filter are not read, the filter must still be
+ * applied to the returned points.
+ *
+ * Returns NULL and raises a SIGNAL in case an error has occurred.
+ *
+ * This function can be used by multiple threads at the same time while holding
+ * the series_mutex for reading.
+ */
+siridb_points_t * siridb_series_get_filtered(
+        siridb_t *__restrict siridb,
+        siridb_series_t *__restrict series,
+        siridb_aggr_t *__restrict filter,
+        uint64_t *__restrict start_ts,
+        uint64_t *__restrict end_ts)
+{
+    SERIES_load_cold(siridb, series, start_ts, end_ts);
+    return SERIES_get_points(series, start_ts, end_ts, 0, filter);
+}
+
+/*
+ * Returns at most the newest 'limit' points between 'start_ts' and 'end_ts'
+ * or NULL and raises a SIGNAL in case an error has occurred.
+ *
+ * Indexes are walked from the end so only the chunks which are required for
+ * the newest points are read. When 'limit' is at most last_points_cache, the
+ * points of numeric series are returned from the last points cache.
+ *
+ * This function can be used by multiple threads at the same time while holding
+ * the series_mutex for reading, see SERIES_last_fill().
+ */
+siridb_points_t * siridb_series_get_last(
+        siridb_t *__restrict siridb,
+        siridb_series_t *__restrict series,
+        uint64_t *__restrict start_ts,
+        uint64_t *__restrict end_ts,
+        size_t limit)
+{
+    siridb_points_t * points;
+
+    SERIES_load_cold(siridb, series, start_ts, end_ts);
+
+    if (    limit &&
+            limit <= siri.cfg->last_points_cache &&
+            siridb_series_isnum(series))
+    {
+        /* the cache is only created when all points are loaded */
+        int loaded = !siridb->cold_shards || (
+                start_ts == NULL && end_ts == NULL);
+
+        if (    loaded &&
+                __atomic_load_n(&series->last, __ATOMIC_ACQUIRE) == NULL &&
+                SERIES_last_fill(series))
+        {
+            return NULL;  /* signal is raised */
+        }
+
+        switch (SERIES_last_get(series, start_ts, end_ts, limit, &points))
+        {
+        case 1:
+            return points;
+        case -1:
+            return NULL;  /* signal is raised */
+        }
+    }
+
+    return SERIES_get_points(series, start_ts, end_ts, limit, NULL);
+}
+
+/*
+ * Prefetch the first chunks in the time range for each of the 'n' series.
+ * The chunks for all series are advised at once so they are grouped by
+ * shard file. The remaining chunks are prefetched while reading the series.
+ *
+ * This function must be called while holding the series_mutex.
+ */
+void siridb_series_prefetch(
+        siridb_series_t ** series,
+        size_t n,
+        uint64_t * start_ts,
+        uint64_t * end_ts)
+{
+    idx_t * list[SIRIDB_SHARD_PREFETCH_BATCH];
+    uint32_t i, first, last, len = 0;
+
+    for (; n-- && len < SIRIDB_SHARD_PREFETCH_BATCH; series++)
+    {
+        if ((*series)->flags & SIRIDB_SERIES_IS_DROPPED)
+        {
+            continue;
+        }
+
+        SERIES_idx_range(*series, start_ts, end_ts, &first, &last);
+
+        for (   i = first;
+                i < last &&
+                i - first < SIRIDB_SHARD_PREFETCH &&
+                len < SIRIDB_SHARD_PREFETCH_BATCH;
+                i++)
+        {
+            list[len++] = (*series)->idx + i;
+        }
+    }
+
+    siridb_shard_prefetch_list(list, len);
+}
+
+/*
+ * Returns aggregated points for a series using aggregate 'aggr'. The
+ * statistics of chunks which fit completely in both the time range and one
+ * group are used instead of reading the points. Only the remaining chunks
+ * and the buffer are read, in batches which are aggregated one at a time so
+ * the points for the whole time range are never in memory at once.
+ *
+ * When the series has a rollup which can be used for the group by, the
+ * buckets of the rollup are used and only points outside the range of the
+ * rollup are read.
+ *
+ * Use this function only when siridb_aggregate_can_use_stats() is true.
+ *
+ * Returns NULL in case of an error. (err_msg is set and a SIGNAL might be
+ * raised)
+ */
+siridb_points_t * siridb_series_get_aggr(
+        siridb_t *__restrict siridb,
+        siridb_series_t *__restrict series,
+        siridb_aggr_t *__restrict aggr,
+        uint64_t *__restrict start_ts,
+        uint64_t *__restrict end_ts,
+        char * err_msg)
+{
+    siridb_aggr_t base;
+    siridb_points_t * points, * counts = NULL;
+    uint64_t lo, hi;
+    int is_mean = aggr->gid == CLERI_GID_F_MEAN;
+
+    /* the mean is calculated from the sum and count */
+    base = *aggr;
+    base.gid = is_mean ? CLERI_GID_F_SUM : aggr->gid;
+
+    if (    series->rollup == NULL ||
+            !siridb_rollup_range(
+                    series->rollup,
+                    aggr,
+                    start_ts,
+                    end_ts,
+                    &lo,
+                    &hi))
+    {
+        if (SERIES_get_aggr(
+                siridb,
+                series,
+                &base,
+                is_mean,
+                start_ts,
+                end_ts,
+                &points,
+                &counts,
+                err_msg))
+        {
+            return NULL;  /* err_msg is set */
+        }
+    }
+    else if (siridb_rollup_get(
+                series->rollup,
+                &base,
+                series->tp,
+                lo,
+                hi,
+                &points,
+                is_mean ? &counts : NULL,
+                err_msg) ||
+            ((start_ts == NULL ? lo > 0 : *start_ts < lo) &&
+                SERIES_merge_aggr(
+                    siridb,
+                    series,
+                    &base,
+                    is_mean,
+                    start_ts,
+                    &lo,
+                    &points,
+                    &counts,
+                    err_msg)) ||
+            (hi != UINT64_MAX && *end_ts > hi &&
+                SERIES_merge_aggr(
+                    siridb,
+                    series,
+                    &base,
+                    is_mean,
+                    &hi,
+                    end_ts,
+                    &points,
+                    &counts,
+                    err_msg)))
+    {
+        return NULL;  /* err_msg is set */
+    }
+
+    return is_mean ?
+            siridb_aggregate_stream_mean(points, counts, err_msg) : points;
+}
+
+/*
+ * Add the estimated cost for reading the points of a series between
+ * 'start_ts' and 'end_ts' to 'cost'. Only the index is used so nothing is
+ * read from disk. (start_ts and end_ts may be NULL)
+ *
+ * The number of points is an upper bound since chunks which are partly in
+ * range are counted as a whole. Points in chunks which are completely in
+ * range are also counted as 'min_points'. Shards which are not loaded, like
+ * cold shards, are not included.
+ *
+ * This function should be called while holding the series mutex.
+ */
+void siridb_series_cost(
+        siridb_series_t *__restrict series,
+        uint64_t *__restrict start_ts,
+        uint64_t *__restrict end_ts,
+        siridb_series_cost_t *__restrict cost)
+{
+    idx_t *__restrict idx;
+    siridb_shard_t * shard = NULL;
+    siridb_point_t * point;
+    uint32_t i, first, last;
+    size_t n;
+
+    cost->series++;
+
+    SERIES_idx_range(series, start_ts, end_ts, &first, &last);
+
+    for (i = first, idx = series->idx + first; i < last; i++, idx++)
+    {
+        if (    (start_ts != NULL && idx->end_ts < *start_ts) ||
+                (end_ts != NULL && idx->start_ts >= *end_ts))
+        {
+            continue;
+        }
+
+        /* shards do not overlap in time so each shard is found once */
+        if (idx->shard != shard)
+        {
+            shard = idx->shard;
+            cost->shards++;
+        }
+
+        cost->chunks++;
+        cost->points += idx->len;
+
+        if (    (start_ts == NULL || idx->start_ts >= *start_ts) &&
+                (end_ts == NULL || idx->end_ts < *end_ts))
+        {
+            cost->min_points += idx->len;
+        }
+    }
+
+    if (series->buffer == NULL)
+    {
+        return;
+    }
+
+    /* points in the buffer are sorted and counted exactly */
+    for (   n = series->buffer->len, point = series->buffer->data;
+            n--;
+            point++)
+    {
+        if (end_ts != NULL && point->ts >= *end_ts)
+        {
+            break;
+        }
+        if (start_ts == NULL || point->ts >= *start_ts)
+        {
+            cost->points++;
+            cost->min_points++;
+        }
+    }
+}
+
+/*
+ * Aggregate the points in a time range using the chunk statistics where
+ * possible. Argument 'base' must be the aggregate with sum instead of mean
+ * and when 'is_mean' is true, 'counts_' is set with the number of points per
+ * group. (see siridb_series_get_aggr())
+ *
+ * Returns 0 if successful or -1 in case of an error. (err_msg is set and a
+ * SIGNAL might be raised)
+ */
+static int SERIES_get_aggr(
+        siridb_t *__restrict siridb,
+        siridb_series_t *__restrict series,
+        siridb_aggr_t *__restrict base,
+        int is_mean,
+        uint64_t *__restrict start_ts,
+        uint64_t *__restrict end_ts,
+        siridb_points_t ** points_,
+        siridb_points_t ** counts_,
+        char * err_msg)
+{
+    idx_t * idx;
+    uint64_t group_ts;
+    qp_via_t val;
+    siridb_points_t * points, * counts, * tmp;
+    siridb_point_t * point;
+    series_runs_t runs;
+    uint32_t first, last;
+    size_t n = 0;
+    size_t batch_sz;
+
+    SERIES_load_cold(siridb, series, start_ts, end_ts);
+
+    SERIES_idx_range(series, start_ts, end_ts, &first, &last);
+    SERIES_track_read(series, first, last, start_ts, end_ts);
+
+    /* skip[i] is set for index 'first + i' */
+    uint8_t skip[last - first + 1];
+
+    for (uint32_t i = first; i < last; i++)
+    {
+        idx = series->idx + i;
+        skip[i - first] = (
+            siridb_points_stats_ok(&idx->stats) &&
+            (start_ts == NULL || idx->start_ts >= *start_ts) &&
+            (end_ts == NULL || idx->end_ts < *end_ts) &&
+            SIRIDB_AGGR_GROUP_TS(base, idx->start_ts) ==
+                    SIRIDB_AGGR_GROUP_TS(base, idx->end_ts));
+        n += skip[i - first];
+    }
+
+    points = siridb_points_new(n, (base->gid == CLERI_GID_F_COUNT) ?
+            TP_INT : series->tp);
+
+    if (points == NULL)
+    {
+        sprintf(err_msg, "Memory allocation error.");
+        return -1;  /* signal is raised */
+    }
+
+    counts = is_mean ? siridb_points_new(n, TP_INT) : NULL;
+
+    if (is_mean && counts == NULL)
+    {
+        sprintf(err_msg, "Memory allocation error.");
+        siridb_points_free(points);
+        return -1;  /* signal is raised */
+    }
+
+    /*
+     * The index is sorted by start time-stamp so the group time-stamps for
+     * chunks which fit in one group are sorted too.
+     */
+    for (uint32_t i = first; i < last; i++)
+    {
+        if (!skip[i - first])
+        {
+            continue;
+        }
+
+        idx = series->idx + i;
+        group_ts = SIRIDB_AGGR_GROUP_TS(base, idx->start_ts);
+
+        siridb_aggregate_stats_val(&val, &idx->stats, idx->len, base->gid);
+
+        if (points->len && points->data[points->len - 1].ts == group_ts)
+        {
+            if (siridb_aggregate_combine_val(
+                    &points->data[points->len - 1].val,
+                    &val,
+                    base->gid,
+                    points->tp,
+                    err_msg))
+            {
+                SERIES_free_aggr(points, counts);
+                return -1;  /* err_msg is set */
+            }
+            if (is_mean)
+            {
+                counts->data[counts->len - 1].val.int64 += idx->len;
+            }
+        }
+        else
+        {
+            point = points->data + points->len;
+            point->ts = group_ts;
+            point->val = val;
+            points->len++;
+
+            if (is_mean)
+            {
+                point = counts->data + counts->len;
+                point->ts = group_ts;
+                point->val.int64 = idx->len;
+                counts->len++;
+            }
+        }
+    }
+
+    /*
+     * The points which are not covered by statistics are read and aggregated
+     * in batches so only a limited number of points is kept in memory.
+     */
+    batch_sz = siridb_buffer_len(siridb, series);
+    if (batch_sz < SERIES_STREAM_BATCH)
+    {
+        batch_sz = SERIES_STREAM_BATCH;
+    }
+
+    tmp = siridb_points_new(batch_sz, series->tp);
+
+    if (tmp == NULL)
+    {
+        sprintf(err_msg, "Memory allocation error.");
+        SERIES_free_aggr(points, counts);
+        return -1;  /* signal is raised */
+    }
+
+    SERIES_GET_POINTS_CB(get_points_cb, series)
+    SERIES_runs_init(&runs, series, last - first);
+
+    for (uint32_t i = first; i < last; i++)
+    {
+        idx = series->idx + i;
+
+        if ((i - first) % SIRIDB_SHARD_PREFETCH == 0)
+        {
+            /* start reading the next chunks before they are decoded */
+            siridb_shard_prefetch(idx, last - i, skip + (i - first));
+        }
+
+        if (    skip[i - first] ||
+                (start_ts != NULL && idx->end_ts < *start_ts) ||
+                (end_ts != NULL && idx->start_ts >= *end_ts))
+        {
+            continue;
+        }
+
+        /* a chunk has at most 65535 points and always fits in a batch */
+        if (    tmp->len + idx->len > batch_sz &&
+                SERIES_stream(&points, &counts, tmp, base, &runs, err_msg))
+        {
+            free(runs.offsets);
+            siridb_points_free(tmp);
+            return -1;  /* err_msg is set */
+        }
+
+        SERIES_runs_add(&runs, tmp, idx);
+
+        SERIES_IDX_POINTS_CB(get_points_cb, idx)(
+                tmp,
+                idx,
+                start_ts,
+                end_ts,
+                SERIES_RUNS_OVERLAP(&runs, series));
+        /* errors can be ignored here */
+    }
+
+    /* buffer points are added to the last batch */
+    if (    tmp->len + series->buffer->len > batch_sz &&
+            SERIES_stream(&points, &counts, tmp, base, &runs, err_msg))
+    {
+        free(runs.offsets);
+        siridb_points_free(tmp);
+        return -1;  /* err_msg is set */
+    }
+
+    if (SERIES_runs_merge(&runs, tmp))
+    {
+        sprintf(err_msg, "Memory allocation error.");
+        SERIES_free_aggr(points, counts);
+        free(runs.offsets);
+        siridb_points_free(tmp);
+        return -1;  /* signal is raised */
+    }
+
+    free(runs.offsets);
+
+    for (size_t i = 0; i < series->buffer->len; i++)
+    {
+        point = series->buffer->data + i;
+        if (    (start_ts == NULL || point->ts >= *start_ts) &&
+                (end_ts == NULL || point->ts < *end_ts))
+        {
+            siridb_points_add_point(tmp, &point->ts, &point->val);
+        }
+    }
+
+    if (siridb_aggregate_stream(&points, &counts, tmp, base, err_msg))
+    {
+        siridb_points_free(tmp);
+        return -1;  /* err_msg is set */
+    }
+
+    siridb_points_free(tmp);
+
+    *points_ = points;
+    *counts_ = counts;
+
+    return 0;
+}
+
+
+
+/*
+ * Aggregate the points in a time range and merge the result with 'points'
+ * (and with 'counts' for a mean).
+ *
+ * Returns 0 if successful or -1 in case of an error, in which case 'points'
+ * and 'counts' are destroyed. (err_msg is set and a SIGNAL might be raised)
+ */
+static int SERIES_merge_aggr(
+        siridb_t *__restrict siridb,
+        siridb_series_t *__restrict series,
+        siridb_aggr_t *__restrict base,
+        int is_mean,
+        uint64_t *__restrict start_ts,
+        uint64_t *__restrict end_ts,
+        siridb_points_t ** points,
+        siridb_points_t ** counts,
+        char * err_msg)
+{
+    siridb_points_t * a, * b = NULL, * merged;
+
+    if (SERIES_get_aggr(
+            siridb,
+            series,
+            base,
+            is_mean,
+            start_ts,
+            end_ts,
+            &a,
+            &b,
+            err_msg))
+    {
+        SERIES_free_aggr(*points, *counts);
+        return -1;  /* err_msg is set */
+    }
+
+    merged = siridb_aggregate_combine(*points, a, base->gid, err_msg);
+    siridb_points_free(*points);
+    siridb_points_free(a);
+    *points = merged;
+
+    if (is_mean)
+    {
+        merged = siridb_aggregate_combine(
+                *counts,
+                b,
+                CLERI_GID_F_COUNT,
+                err_msg);
+        siridb_points_free(*counts);
+        siridb_points_free(b);
+        *counts = merged;
+    }
+
+    if (*points == NULL || (is_mean && *counts == NULL))
+    {
+        if (*points != NULL)
+        {
+            siridb_points_free(*points);
+        }
+        if (is_mean && *counts != NULL)
+        {
+            siridb_points_free(*counts);
+        }
+        return -1;  /* err_msg is set */
+    }
+
+    return 0;
+}
+
+/*
+ * Destroy points used by siridb_series_get_aggr(). ('b' may be NULL)
+ */
+static void SERIES_free_aggr(siridb_points_t * a, siridb_points_t * b)
+{
+    siridb_points_free(a);
+    if (b != NULL)
+    {
+        siridb_points_free(b);
+    }
+}
+
+/*
+ * Returns NULL and raises a SIGNAL in case an error has occurred.
+ *
+ * When 'limit' is not 0, only the newest 'limit' points are returned. When
+ * 'filter' is not NULL, chunks without points which pass the filter are
+ * skipped. (a filter cannot be combined with a limit)
+ */
+static siridb_points_t * SERIES_get_points(
+        siridb_series_t *__restrict series,
+        uint64_t *__restrict start_ts,
+        uint64_t *__restrict end_ts,
+        size_t limit,
+        siridb_aggr_t * filter)
+{
+    idx_t *__restrict idx;
+    siridb_points_t *__restrict points;
+    siridb_point_t *__restrict point;
+    series_runs_t runs;
+    size_t len, size;
+    uint32_t i, first, last;
+    size = 0;
+
+    SERIES_idx_range(series, start_ts, end_ts, &first, &last);
+
+    if (limit)
+    {
+        first = SERIES_idx_last(series, first, last, start_ts, end_ts, limit);
+    }
+
+    SERIES_track_read(series, first, last, start_ts, end_ts);
+
+#define SERIES_USE_IDX(idx__)                                       \
+        ((start_ts == NULL || idx__->end_ts >= *start_ts) &&        \
+        (end_ts == NULL || idx__->start_ts < *end_ts) &&            \
+        (filter == NULL || siridb_aggregate_filter_stats(           \
+                filter,                                             \
+                series->tp,                                         \
+                &idx__->stats)))
+
+    for (i = first, idx = series->idx + first; i < last; i++, idx++)
+    {
+        if (SERIES_USE_IDX(idx))
+        {
+            size += idx->len;
+        }
+    }
+
+    size += series->buffer->len;
+    points = siridb_points_new(size, series->tp);
+
+    if (points == NULL)
+    {
+        return NULL;  /* signal is raised */
     }
 
     SERIES_GET_POINTS_CB(get_points_cb, series)
+    SERIES_runs_init(&runs, series, last - first);
+
+    for (i = first, idx = series->idx + first; i < last; i++, idx++)
+    {
+        if ((i - first) % SIRIDB_SHARD_PREFETCH == 0)
+        {
+            /* start reading the next chunks before they are decoded */
+            siridb_shard_prefetch(idx, last - i, NULL);
+        }
+
+        if (SERIES_USE_IDX(idx))
+        {
+            SERIES_runs_add(&runs, points, idx);
+            SERIES_IDX_POINTS_CB(get_points_cb, idx)(
+                    points,
+                    idx,
+                    start_ts,
+                    end_ts,
+                    SERIES_RUNS_OVERLAP(&runs, series));
+            /* errors can be ignored here */
+        }
+    }
+
+#undef SERIES_USE_IDX
+
+    if (SERIES_runs_merge(&runs, points))
+    {
+        free(runs.offsets);
+        siridb_points_free(points);
+        return NULL;  /* signal is raised */
+    }
+    free(runs.offsets);
+
+    /* create pointer to buffer and get current length */
+    point = series->buffer->data;
+    len = series->buffer->len;
+
+    /* crop start buffer if needed */
+    if (start_ts != NULL)
+    {
+        for (; len && point->ts < *start_ts; point++, len--);
+    }
+
+    /* crop end buffer if needed */
+    if (end_ts != NULL && len)
+    {
+        siridb_point_t *__restrict p;
+
+        for (   p = point + len - 1;
+                len && p->ts >= *end_ts;
+                p--, len--);
+    }
+
+    /* add buffer points, these are mostly newer than the chunks */
+    siridb_points_add_sorted(points, point, len);
+
+    if (limit && points->len > limit)
+    {
+        /* keep the newest points */
+        memmove(points->data,
+                points->data + points->len - limit,
+                limit * sizeof(siridb_point_t));
+        points->len = limit;
+    }
+
+    if (points->len < size)
+    {
+        /* shrink allocation size */
+        point = (siridb_point_t *)
+                realloc(points->data, points->len * sizeof(siridb_point_t));
+        if (point == NULL && points->len)
+        {
+            log_error("Re-allocation points has failed");
+        }
+        else
+        {
+            points->data = point;
+        }
+    }
+#ifdef DEBUG
+    else
+    {
+        /* size must be equal if not smaller */
+        assert (points->len == size);
+    }
+#endif
+
+    return points;
+}
+
+/*
+ * Can be used instead of the macro function when need as callback function.
+ */
+void siridb__series_decref(siridb_series_t * series)
+{
+    if (!--series->ref)
+    {
+        siridb__series_free(series);
+    }
+}
+
+/*
+ * Calculate the server id.
+ * Returns 0 or 1, representing a server in a pool)
+ */
+uint8_t siridb_series_server_id_by_name(const char * name)
+{
+    uint32_t n;
+
+    /* get sum series name to calculate series mask (for sharding) */
+    for (n = 0; *name; name++)
+    {
+        n += *name;
+    }
+
+   return (uint8_t) ((n / 11) % 2);
+}
+
+/*
+ * Returns the shard mask for a series with 'name' and type 'tp'. A series is
+ * only written to shards where siridb_durations_mask() is equal to the mask.
+ */
+uint16_t siridb_series_mask(siridb_t * siridb, const char * name, uint8_t tp)
+{
+    uint32_t n;
+
+    /* get sum series name to calculate series mask (for sharding) */
+    for (n = 0; *name; name++)
+    {
+        n += *name;
+    }
+
+    return (uint16_t) (n / 11) % ((tp == TP_STRING) ?
+            siridb->shard_mask_log : siridb->shard_mask_num);
+}
+
+/*
+ * Must be called for a series after shards with points for the series are
+ * attached. Caches which might not include the new points are cleared and
+ * the series properties are updated.
+ *
+ * This function requires the series_mutex for writing. (the series might be
+ * destroyed if it has no points)
+ */
+void siridb_series_attached(siridb_t * siridb, siridb_series_t * series)
+{
+    series->version = ++siridb->data_version;
+    SERIES_last_clear(series);
+    siridb_series_update_props(siridb, series);
+
+    if (siridb->acache != NULL)
+    {
+        siridb_acache_drop(siridb->acache, series->id, 0, UINT64_MAX);
+    }
+}
+
+/*
+ * Read the points of the chunks which are replaced by 'shard' while holding
+ * the series_mutex for reading, with siridb_shard_shared set. This way
+ * selects and the event loop do not wait for reading the chunks.
+ * The points are written by siridb_series_optimize_shard().
+ *
+ * Returns 0 if successful or -1 and a SIGNAL is raised in case of a critical
+ * error.
+ */
+int siridb_series_optimize_read(
+        siridb_series_t *__restrict series,
+        siridb_shard_t *__restrict shard,
+        siridb_series_optimize_t * optimize)
+{
+    uint_fast32_t start, end;
+    uint64_t bytes_read;
+
+    optimize->points = NULL;
+
+    if (!SERIES_optimize_range(
+            series,
+            shard,
+            &start,
+            &end,
+            &bytes_read,
+            optimize))
+    {
+        return 0;
+    }
+
+    optimize->points = SERIES_optimize_points(
+            series,
+            shard,
+            start,
+            end,
+            &optimize->size);
+
+    return (optimize->points == NULL) ? -1 : 0;  /* signal is raised */
+}
+
+/*
+ * Returns 0 if successful or -1 and a SIGNAL is raised in case of a critical
+ * error.
+ * Note that we also return 0 if we had to recover a shard. In this case you
+ * can find the errors we had to recover in the log file. (log level should
+ * be at least 'ERROR' for all error logs)
+ *
+ * When 'downsample' is not NULL, the points are written with one point per
+ * downsample interval.
+ *
+ * Points which are read by siridb_series_optimize_read() are used when the
+ * replaced indexes have not changed since, otherwise the chunks are read
+ * again. The points in 'optimize' are always consumed.
+ */
+int siridb_series_optimize_shard(
+        siridb_t *__restrict siridb,
+        siridb_series_t *__restrict series,
+        siridb_shard_t *__restrict shard,
+        siridb_downsample_t * downsample,
+        siridb_series_optimize_t * optimize)
+{
+#ifdef DEBUG
+    assert (siridb_durations_mask(siridb, shard->tp, shard->id) ==
+            series->mask);
+#endif
+
+    idx_t *__restrict idx;
+    idx_t * chunks;
+
+    uint_fast32_t i, start, end, new_idx, max_chunks;
+    uint64_t max_ts, bytes_read;
+    size_t size, shard_size = shard->size;
+    siridb_points_t *__restrict points = optimize->points;
+    siridb_series_optimize_t current;
+    int rc = 0;
+
+    max_ts = SIRIDB_SHARD_START(shard) + shard->duration;
+    optimize->points = NULL;
+
+    /* the number of chunks cannot grow */
+    max_chunks = SERIES_optimize_range(
+            series,
+            shard,
+            &start,
+            &end,
+            &bytes_read,
+            &current);
+
+    if (    points != NULL &&
+            (!max_chunks || current.check != optimize->check))
+    {
+        /* the replaced chunks have changed after the points are read */
+        siridb_points_free(points);
+        points = NULL;
+    }
+
+    if (!max_chunks)
+    {
+        /* no data for this series is found in the shard */
+        return rc;
+    }
+
+    new_idx = end - start - max_chunks;
 
-    for (i = 0; i < len; i++)
+    long int pos;
+    uint16_t chunk_sz;
+    uint_fast32_t num_chunks, pstart, pend, diff;
+    siridb_points_stats_t stats;
+
+    size = (points != NULL) ? optimize->size : current.size;
+
+    if (points == NULL && (points = SERIES_optimize_points(
+            series,
+            shard,
+            start,
+            end,
+            &size)) == NULL)
     {
-        get_points_cb(
-                points,
-                series->idx + indexes[i],
-                start_ts,
-                end_ts,
-                series->flags & SIRIDB_SERIES_HAS_OVERLAP);
-        /* errors can be ignored here */
+        return -1;  /* signal is raised */
     }
 
-    /* create pointer to buffer and get current length */
-    point = series->buffer->data;
-    len = series->buffer->len;
+    if (siridb_shard_add_series(shard, series->id))
+    {
+        ERR_ALLOC
+        siridb_points_free(points);
+        return -1;
+    }
 
-    /* crop start buffer if needed */
-    if (start_ts != NULL)
+    /* the written chunks are collected and merged into the index at once */
+    chunks = (idx_t *) malloc(max_chunks * sizeof(idx_t));
+    if (chunks == NULL)
     {
-        for (; len && point->ts < *start_ts; point++, len--);
+        ERR_ALLOC
+        siridb_points_free(points);
+        return -1;
     }
 
-    /* crop end buffer if needed */
-    if (end_ts != NULL && len)
+    /* the replaced indexes are removed from the index */
+    for (i = start; i < end; i++)
     {
-        siridb_point_t *__restrict p;
+        if (series->idx[i].shard == shard->replacing)
+        {
+#ifdef DEBUG
+            /*
+             * we have at least 2 references to the shard so we never
+             * reach 0 here.  (this ref + optimize ref)
+             */
+            assert(shard->replacing->ref >= 2);
+#endif
+            siridb_shard_decref(shard->replacing);
+        }
+    }
 
-        for (   p = point + len - 1;
-                len && p->ts >= *end_ts;
-                p--, len--);
+    if (downsample != NULL && size)
+    {
+        size_t n = siridb_downsample_points(downsample, points);
+        series->length -= size - n;
+        size = n;
+
+        /* downsampled points might be cached */
+        SERIES_last_clear(series);
     }
 
-    /* add buffer points */
-    for (; len; point++, len--)
+    num_chunks = (size - 1) / SERIES_chunk_points(
+            series,
+            shard,
+            size,
+            max_chunks) + 1;
+    chunk_sz = size / num_chunks + (size % num_chunks != 0);
+    idx = chunks;
+
+    for (pstart = 0; pstart < size; pstart += chunk_sz)
     {
-        siridb_points_add_point(points, &point->ts, &point->val);
+        pend = pstart + chunk_sz;
+        if (pend > size)
+        {
+            pend = size;
+        }
+
+        siridb_points_stats(&stats, points, pstart, pend);
+
+        if ((pos = siridb_shard_write_points(
+                siridb,
+                series,
+                shard,
+                points,
+                pstart,
+                pend,
+                &stats,
+                siri_optimize_idx_fp())) == EOF)
+        {
+            log_critical(
+                    "Cannot write points to shard id '%" PRIu64 "'",
+                    shard->id);
+            rc = -1;  /* signal is raised */
+            num_chunks--;
+        }
+        else
+        {
+            idx->shard = shard;
+            idx->start_ts = points->data[pstart].ts;
+            idx->end_ts = points->data[pend - 1].ts;
+            idx->len = pend - pstart;
+            idx->chunk_sz = (uint16_t) (shard->size - pos);
+            idx->stats = stats;
+            idx->pos = pos;
+            idx++;
+            siridb_shard_incref(shard);
+        }
     }
 
-    if (points->len < size)
+    siridb_points_free(points);
+
+    SERIES_idx_merge(series->idx, start, end, chunks, num_chunks, shard);
+    free(chunks);
+
+    /* new indexes and written chunks replace the indexes [start, end) */
+    i = start + new_idx + num_chunks;
+
+    if (i < end)
     {
-        /* shrink allocation size */
-        point = (siridb_point_t *)
-                realloc(points->data, points->len * sizeof(siridb_point_t));
-        if (point == NULL && points->len)
+        /* get the difference */
+        diff = end - i;
+
+        /* new length is current length minus difference */
+        SERIES_idx_mem(series->idx_len, series->idx_len - diff);
+        series->idx_len -= diff;
+
+        memmove(series->idx + i,
+                series->idx + end,
+                (series->idx_len - i) * sizeof(idx_t));
+
+        /* shrink memory to the new size */
+        idx = (idx_t *) realloc(
+                series->idx,
+                SERIES_idx_size(series->idx_len) * sizeof(idx_t));
+        if (idx == NULL && series->idx_len)
         {
-            log_error("Re-allocation points has failed");
+            /* this is not critical since the original allocated block still
+             * works.
+             */
+            log_error("Shrinking memory for one series has failed!");
         }
         else
         {
-            points->data = point;
+            series->idx = idx;
         }
     }
 #ifdef DEBUG
     else
     {
-        /* size must be equal if not smaller */
-        assert (points->len == size);
+        /* start must be equal to end if not smaller */
+        assert (i == end);
+    }
+#endif
+
+    if (series->flags & SIRIDB_SERIES_HAS_OVERLAP)
+    {
+        SERIES_update_overlap(series);
+    }
+
+    /* the first point of the series might be merged into a later point */
+    if (downsample != NULL && series->start < max_ts)
+    {
+        SERIES_update_start(series);
+    }
+
+    /* points can be downsampled and rewritten chunks have statistics */
+    SERIES_stats_update(series);
+
+    siri_optimize_count(bytes_read, shard->size - shard_size);
+
+    return rc;
+}
+
+/*
+ * Returns 1 (true) when the chunks for 'series' in 'shard' overlap or when
+ * the points fit in less than half the number of chunks which are used.
+ * In both cases the chunks should be merged by an incremental optimize.
+ */
+int siridb_series_need_merge(
+        siridb_series_t * series,
+        siridb_shard_t * shard)
+{
+    idx_t * idx;
+    idx_t * prev = NULL;
+    uint_fast32_t i, n;
+    size_t size;
+
+    n = size = 0;
+
+    for (i = 0, idx = series->idx; i < series->idx_len; i++, idx++)
+    {
+        if (idx->shard != shard)
+        {
+            continue;
+        }
+
+        if (prev != NULL && idx->start_ts < prev->end_ts)
+        {
+            return 1;
+        }
+
+        prev = idx;
+        size += idx->len;
+        n++;
+    }
+
+    return n && n > 2 * ((size - 1) / SERIES_chunk_points(
+            series,
+            shard,
+            size,
+            n) + 1);
+}
+
+/*
+ * Merge the chunks for 'series' in 'shard' and append the merged chunks to
+ * the same shard. This function is used by an incremental optimize and must
+ * be called while holding the series_mutex.
+ *
+ * Argument 'dead' is set to an allocated array with the indexes for chunks
+ * which are no longer used and 'n' to the number of indexes in this array.
+ * These chunks must be marked as dead by the caller and 'dead' must be
+ * freed. In case writing fails, the old chunks are kept and the chunks which
+ * are written are returned as dead chunks.
+ *
+ * Returns 0 if successful or -1 and a SIGNAL is raised in case of a critical
+ * error.
+ */
+int siridb_series_merge_shard(
+        siridb_t *__restrict siridb,
+        siridb_series_t *__restrict series,
+        siridb_shard_t *__restrict shard,
+        idx_t ** dead,
+        uint_fast32_t * n)
+{
+    idx_t * idx;
+    idx_t * merged;
+    siridb_points_t * points;
+    siridb_points_stats_t stats;
+    uint_fast32_t i, start, end, num_old, num_chunks, pstart, pend, diff;
+    uint16_t chunk_sz;
+    size_t size = 0, shard_size = shard->size;
+    uint64_t bytes_read = 0;
+    long int pos;
+    series_runs_t runs;
+
+    *dead = NULL;
+    *n = 0;
+
+    /*
+     * Shards do not overlap in time so the indexes for one shard are stored
+     * next to each other.
+     */
+    for (   start = 0;
+            start < series->idx_len && series->idx[start].shard != shard;
+            start++);
+
+    for (   end = start;
+            end < series->idx_len && series->idx[end].shard == shard;
+            end++)
+    {
+        size += series->idx[end].len;
+        bytes_read += series->idx[end].chunk_sz;
+    }
+
+    if (start == end)
+    {
+        /* no data for this series is found in the shard */
+        return 0;
+    }
+
+    num_old = end - start;
+    num_chunks = (size - 1) / SERIES_chunk_points(
+            series,
+            shard,
+            size,
+            num_old) + 1;
+    chunk_sz = size / num_chunks + (size % num_chunks != 0);
+
+    /*
+     * Allocate space for both the old and the merged indexes before
+     * anything is written. This way we can always return the dead chunks.
+     */
+    *dead = (idx_t *) malloc((num_old + num_chunks) * sizeof(idx_t));
+    if (*dead == NULL)
+    {
+        ERR_ALLOC
+        return -1;
+    }
+    memcpy(*dead, series->idx + start, num_old * sizeof(idx_t));
+    merged = *dead + num_old;
+
+    SERIES_GET_POINTS_CB(get_points_cb, series)
+
+    points = siridb_points_new(size, series->tp);
+    if (points == NULL)
+    {
+        free(*dead);
+        *dead = NULL;
+        return -1;  /* signal is raised */
+    }
+
+    SERIES_runs_init(&runs, series, num_old);
+
+    for (i = start; i < end; i++)
+    {
+        idx = series->idx + i;
+        SERIES_runs_add(&runs, points, idx);
+
+        if (SERIES_IDX_POINTS_CB(get_points_cb, idx)(
+                points,
+                idx,
+                NULL,
+                NULL,
+                SERIES_RUNS_OVERLAP(&runs, series)))
+        {
+            /*
+             * The shard is marked as corrupt and will be rewritten by the
+             * next optimize cycle so we leave this series alone.
+             */
+            free(runs.offsets);
+            siridb_points_free(points);
+            free(*dead);
+            *dead = NULL;
+            return 0;
+        }
+    }
+
+    if (SERIES_runs_merge(&runs, points))
+    {
+        free(runs.offsets);
+        siridb_points_free(points);
+        free(*dead);
+        *dead = NULL;
+        return -1;  /* signal is raised */
+    }
+    free(runs.offsets);
+
+    for (i = 0, pstart = 0; pstart < size; i++, pstart += chunk_sz)
+    {
+        pend = pstart + chunk_sz;
+        if (pend > size)
+        {
+            pend = size;
+        }
+
+        siridb_points_stats(&stats, points, pstart, pend);
+
+        if ((pos = siridb_shard_write_points(
+                siridb,
+                series,
+                shard,
+                points,
+                pstart,
+                pend,
+                &stats,
+                NULL)) == EOF)
+        {
+            log_critical(
+                    "Cannot write points to shard id '%" PRIu64 "'",
+                    shard->id);
+            siridb_points_free(points);
+
+            /* the chunks written so far are dead */
+            memmove(*dead, merged, i * sizeof(idx_t));
+            *n = i;
+            return -1;  /* signal is raised */
+        }
+
+        idx = merged + i;
+        idx->shard = shard;
+        idx->start_ts = points->data[pstart].ts;
+        idx->end_ts = points->data[pend - 1].ts;
+        idx->len = pend - pstart;
+        idx->chunk_sz = (uint16_t) (shard->size - pos);
+        idx->stats = stats;
+        idx->pos = pos;
+    }
+
+    siridb_points_free(points);
+
+    /* replace the old indexes, each index holds a reference to the shard */
+    memcpy(series->idx + start, merged, num_chunks * sizeof(idx_t));
+
+    diff = num_old - num_chunks;
+
+    if (diff)
+    {
+        for (i = 0; i < diff; i++)
+        {
+            siridb_shard_decref(shard);
+        }
+
+        SERIES_idx_mem(series->idx_len, series->idx_len - diff);
+        series->idx_len -= diff;
+
+        for (i = start + num_chunks; i < series->idx_len; i++)
+        {
+            series->idx[i] = series->idx[i + diff];
+        }
+
+        /* shrink memory to the new size */
+        idx = (idx_t *) realloc(
+                series->idx,
+                SERIES_idx_size(series->idx_len) * sizeof(idx_t));
+        if (idx == NULL && series->idx_len)
+        {
+            /* this is not critical since the original allocated block still
+             * works.
+             */
+            log_error("Shrinking memory for one series has failed!");
+        }
+        else
+        {
+            series->idx = idx;
+        }
+    }
+
+    if (series->flags & SIRIDB_SERIES_HAS_OVERLAP)
+    {
+        SERIES_update_overlap(series);
     }
-#endif
 
-    return points;
+    /* merged chunks have statistics */
+    SERIES_stats_update(series);
+
+    siri_optimize_count(bytes_read, shard->size - shard_size);
+
+    *n = num_old;
+
+    return 0;
 }
 
 /*
- * Can be used instead of the macro function when need as callback function.
+ * Open SiriDB series store file.
+ *
+ * Returns 0 if successful or -1 in case of an error.
  */
-void siridb__series_decref(siridb_series_t * series)
+int siridb_series_open_store(siridb_t * siridb)
 {
-    if (!--series->ref)
+    /* macro get series file name */
+    SIRIDB_GET_FN(fn, siridb->dbpath, SIRIDB_SERIES_FN)
+
+    if ((siridb->store = qp_open(fn, "a")) == NULL)
     {
-        siridb__series_free(series);
+        log_critical("Cannot open file '%s' for appending", fn);
+        return -1;
     }
+    return 0;
 }
 
 /*
- * Calculate the server id.
- * Returns 0 or 1, representing a server in a pool)
+ * Flush the series which are written to the store by siridb_series_new()
+ * since the last commit. A burst of new series in one insert is flushed
+ * using a single write.
+ *
+ * Returns 0 if successful or -1 and a SIGNAL is raised in case of an error.
  */
-uint8_t siridb_series_server_id_by_name(const char * name)
+int siridb_series_commit(siridb_t * siridb)
 {
-    uint32_t n;
+    if (!siridb->store_pending)
+    {
+        return 0;
+    }
 
-    /* get sum series name to calculate series mask (for sharding) */
-    for (n = 0; *name; name++)
+    siridb->store_pending = 0;
+
+    if (qp_flush(siridb->store))
     {
-        n += *name;
+        ERR_FILE
+        log_critical("Cannot flush new series to the store");
+        return -1;
     }
 
-   return (uint8_t) ((n / 11) % 2);
+    return 0;
 }
 
 /*
- * Returns 0 if successful or -1 and a SIGNAL is raised in case of a critical
- * error.
- * Note that we also return 0 if we had to recover a shard. In this case you
- * can find the errors we had to recover in the log file. (log level should
- * be at least 'ERROR' for all error logs)
+ * Merge the written 'chunks' with the indexes for 'shard' in range 'start' to
+ * 'end'. The other indexes in this range are replaced so the result is
+ * written to 'start' and has the length of the 'shard' indexes plus
+ * 'num_chunks'. Both the indexes and the chunks are ordered by start
+ * time-stamp which makes one pass from back to front enough.
  */
-int siridb_series_optimize_shard(
-        siridb_t *__restrict siridb,
-        siridb_series_t *__restrict series,
-        siridb_shard_t *__restrict shard)
+static void SERIES_idx_merge(
+        idx_t * idx,
+        uint_fast32_t start,
+        uint_fast32_t end,
+        idx_t * chunks,
+        uint_fast32_t num_chunks,
+        siridb_shard_t * shard)
 {
-#ifdef DEBUG
-    assert (shard->id % siridb->duration_num == series->mask);
-#endif
+    uint_fast32_t i, n = start;
 
-    idx_t *__restrict idx;
+    /* move the 'shard' indexes to the front of the range */
+    for (i = start; i < end; i++)
+    {
+        if (idx[i].shard == shard)
+        {
+            idx[n++] = idx[i];
+        }
+    }
 
-    uint_fast32_t i, start, end, new_idx;
-    uint64_t max_ts;
-    size_t size;
-    siridb_points_t *__restrict points;
-    int rc;
+    /* 'i' is the position to write, 'n' is after the last 'shard' index */
+    for (i = n + num_chunks; num_chunks; )
+    {
+        idx[--i] = (n > start &&
+                idx[n - 1].start_ts > chunks[num_chunks - 1].start_ts) ?
+                idx[--n] : chunks[--num_chunks];
+    }
+}
 
-    max_ts = (shard->id + siridb->duration_num) - series->mask;
+/*
+ * Set 'start' and 'end' to the range with the indexes which are replaced by
+ * 'shard' and the indexes for 'shard' between them. The number of points,
+ * the bytes to read and a check of the replaced indexes are set too.
+ *
+ * Returns the number of replaced indexes.
+ */
+static uint_fast32_t SERIES_optimize_range(
+        siridb_series_t *__restrict series,
+        siridb_shard_t *__restrict shard,
+        uint_fast32_t * start,
+        uint_fast32_t * end,
+        uint64_t * bytes_read,
+        siridb_series_optimize_t * optimize)
+{
+    idx_t * idx;
+    uint_fast32_t i, n = 0, last = 0;
+    uint64_t max_ts = SIRIDB_SHARD_START(shard) + shard->duration;
 
-    rc = new_idx = end = i = size = start = 0;
+    *start = *end = 0;
+    *bytes_read = 0;
+    optimize->size = 0;
+    optimize->check = 0;
 
-    for (   idx = series->idx;
+    for (   i = 0, idx = series->idx;
             i < series->idx_len && idx->start_ts < max_ts;
             i++, idx++)
     {
         if (idx->shard == shard->replacing)
         {
-            if (!end)
+            if (!n)
             {
-                end = start = i;
+                *start = i;
             }
-            size += idx->len;
-            end++;
-
-#ifdef DEBUG
-            /*
-             * we have at least 2 references to the shard so we never
-             * reach 0 here.  (this ref + optimize ref)
-             */
-            assert(shard->replacing->ref >= 2);
-#endif
-            siridb_shard_decref(shard->replacing);
+            n++;
+            last = i + 1;
+            optimize->size += idx->len;
+            *bytes_read += idx->chunk_sz;
+            optimize->check = optimize->check * 31 + idx->pos;
+            optimize->check = optimize->check * 31 + idx->len;
         }
-        else if (idx->shard == shard && end)
+        else if (idx->shard == shard && n)
         {
-            new_idx++;
+            last = i + 1;
         }
     }
 
-    if (!end)
-    {
-        /* no data for this series is found in the shard */
-        return rc;
-    }
+    *end = last;
+    optimize->check = optimize->check * 31 + n;
 
-    end += new_idx;
+    return n;
+}
 
-    long int pos;
-    uint16_t chunk_sz;
-    uint_fast32_t num_chunks, pstart, pend, diff;
+/*
+ * Read and merge the points of the indexes for shard->replacing in range
+ * 'start' to 'end'. Argument 'size' must be set to the number of points in
+ * these indexes and is decreased for chunks which cannot be read.
+ *
+ * Returns NULL and raises a SIGNAL in case an error has occurred.
+ */
+static siridb_points_t * SERIES_optimize_points(
+        siridb_series_t *__restrict series,
+        siridb_shard_t *__restrict shard,
+        uint_fast32_t start,
+        uint_fast32_t end,
+        size_t * size)
+{
+    siridb_points_t * points;
+    series_runs_t runs;
+    idx_t * idx;
+    int rc;
 
     SERIES_GET_POINTS_CB(get_points_cb, series)
 
-    points = siridb_points_new(size, series->tp);
+    points = siridb_points_new(*size, series->tp);
     if (points == NULL)
     {
-        return -1;  /* signal is raised */
+        return NULL;  /* signal is raised */
     }
 
-    for (i = start; i < end; i++)
+    SERIES_runs_init(&runs, series, end - start);
+
+    for (uint_fast32_t i = start; i < end; i++)
     {
         idx = series->idx + i;
+
         /* we can have indexes for this 'new' shard which we should skip */
-        if (idx->shard == shard->replacing && get_points_cb(
+        if (idx->shard != shard->replacing)
+        {
+            continue;
+        }
+
+        SERIES_runs_add(&runs, points, idx);
+
+        if (SERIES_IDX_POINTS_CB(get_points_cb, idx)(
                     points,
                     idx,
                     NULL,
                     NULL,
-                    series->flags & SIRIDB_SERIES_HAS_OVERLAP))
+                    SERIES_RUNS_OVERLAP(&runs, series)))
         {
             /* an error occurred while reading points, logging is done */
-            size -= idx->len;
+            *size -= idx->len;
         }
     }
 
-    num_chunks = (size - 1) / shard->max_chunk_sz + 1;
-    chunk_sz = size / num_chunks + (size % num_chunks != 0);
-    i = start;
+    rc = SERIES_runs_merge(&runs, points);
+    free(runs.offsets);
 
-    for (pstart = 0; pstart < size; pstart += chunk_sz)
+    if (rc)
     {
-        pend = pstart + chunk_sz;
-        if (pend > size)
-        {
-            pend = size;
-        }
+        siridb_points_free(points);
+        return NULL;  /* signal is raised */
+    }
 
-        if ((pos = siridb_shard_write_points(
-                siridb,
-                series,
-                shard,
-                points,
-                pstart,
-                pend,
-                siri.optimize->idx_fp)) == EOF)
-        {
-            log_critical(
-                    "Cannot write points to shard id '%" PRIu64 "'",
-                    shard->id);
-            rc = -1;  /* signal is raised */
-            num_chunks--;
-        }
-        else
+    return points;
+}
+
+/*
+ * Load cold shards which are required to read points for 'series'. Errors
+ * are logged and the shards which cannot be loaded are marked as corrupt,
+ * we continue with the points we have.
+ */
+static inline void SERIES_load_cold(
+        siridb_t *__restrict siridb,
+        siridb_series_t *__restrict series,
+        uint64_t *__restrict start_ts,
+        uint64_t *__restrict end_ts)
+{
+    if (    siridb->cold_shards &&
+            siridb_shards_load_cold(siridb, series, start_ts, end_ts))
+    {
+        log_error(
+                "Cannot load all cold shards for series '%s'",
+                series->name);
+    }
+}
+
+/*
+ * Set 'first' and 'last' so all indexes which might have points between
+ * 'start_ts' and 'end_ts' are within the range [first, last). (start_ts and
+ * end_ts may be NULL)
+ *
+ * Indexes are sorted by start time-stamp so both are found using a binary
+ * search. Indexes in the range must still be checked since chunks within one
+ * shard can overlap. Shards do not overlap in time, so at most one shard needs
+ * to be scanned for chunks which start before 'start_ts'.
+ */
+static void SERIES_idx_range(
+        siridb_series_t *__restrict series,
+        uint64_t *__restrict start_ts,
+        uint64_t *__restrict end_ts,
+        uint32_t * first,
+        uint32_t * last)
+{
+    idx_t * idx = series->idx;
+    siridb_shard_t * shard;
+    uint32_t lo, hi, mid;
+
+    /* find the first index which starts at or after end_ts */
+    lo = 0;
+    hi = series->idx_len;
+    if (end_ts != NULL)
+    {
+        while (lo < hi)
         {
-            /*
-             * We should always find a spot for this index since the number
-             * of chunks cannot grow.
-             */
-            do
+            mid = lo + (hi - lo) / 2;
+            if (idx[mid].start_ts < *end_ts)
             {
-                idx = series->idx + i;
-                i++;
+                lo = mid + 1;
+            }
+            else
+            {
+                hi = mid;
             }
-            while (idx->shard == shard);
-
-#ifdef DEBUG
-            assert (idx->shard == shard->replacing);
-#endif
-
-            idx->shard = shard;
-            idx->start_ts = points->data[pstart].ts;
-            idx->end_ts = points->data[pend - 1].ts;
-            idx->len = pend - pstart;
-            idx->pos = pos;
-            siridb_shard_incref(shard);
         }
     }
+    *last = hi;
 
-    siridb_points_free(points);
-
-    if (new_idx)
+    if (start_ts == NULL)
     {
-        /*
-         * We might have skipped new_indexes while writing new blocks and
-         * possible some new_indexes exist at the wrong place in the index.
-         *
-         * Therefore we must sort the series index part containing data
-         * for this shard.
-         */
-        SERIES_idx_sort(series->idx, start, end - 1);
-
-        /*
-         * We need to set 'i' to the correct value since 'i' has possible
-         * not walked over all 'new indexes'.
-         *
-         * (in case new_idx is 0, i is already equal to the value set below)
-         */
-        i = start + new_idx + num_chunks;
+        *first = 0;
+        return;
     }
 
-    if (i < end)
+    /* find the first index which starts at or after start_ts */
+    lo = 0;
+    while (lo < hi)
     {
-        /* get the difference */
-        diff = end - i;
-
-        /* new length is current length minus difference */
-        series->idx_len -= diff;
-
-        for (; i < series->idx_len; i++)
+        mid = lo + (hi - lo) / 2;
+        if (idx[mid].start_ts < *start_ts)
         {
-            series->idx[i] = series->idx[i + diff];
+            lo = mid + 1;
         }
+        else
+        {
+            hi = mid;
+        }
+    }
 
-        /* shrink memory to the new size */
-        idx = (idx_t *) realloc(
-                series->idx,
-                series->idx_len * sizeof(idx_t));
-        if (idx == NULL && series->idx_len)
+    /* include previous chunks which might end after start_ts */
+    if (lo)
+    {
+        if (series->flags & SIRIDB_SERIES_HAS_OVERLAP)
         {
-            /* this is not critical since the original allocated block still
-             * works.
-             */
-            log_error("Shrinking memory for one series has failed!");
+            shard = idx[lo - 1].shard;
+            for (; lo && idx[lo - 1].shard == shard; lo--);
         }
         else
         {
-            series->idx = idx;
+            /* without overlap the end time-stamps are sorted too */
+            for (; lo && idx[lo - 1].end_ts >= *start_ts; lo--);
         }
     }
-#ifdef DEBUG
-    else
+
+    *first = lo;
+}
+
+/*
+ * Returns the first index in [first, last) which must be read to get the
+ * newest 'limit' points between 'start_ts' and 'end_ts'.
+ *
+ * Indexes are walked from the end and only chunks which are completely
+ * within the range are counted. Chunks without overlap are sorted by time, so
+ * older chunks cannot contain any of the newest points. Chunks within one
+ * shard can overlap but shards do not, so with overlap the whole shard of the
+ * last chunk is read. Buffer points are always read and can only replace
+ * points from the chunks.
+ */
+static uint32_t SERIES_idx_last(
+        siridb_series_t *__restrict series,
+        uint32_t first,
+        uint32_t last,
+        uint64_t *__restrict start_ts,
+        uint64_t *__restrict end_ts,
+        size_t limit)
+{
+    idx_t * idx = series->idx;
+    siridb_shard_t * shard;
+    size_t n = 0;
+    uint32_t i = last;
+
+    while (i > first && n < limit)
     {
-        /* start must be equal to end if not smaller */
-        assert (i == end);
+        i--;
+        if (    (start_ts == NULL || idx[i].start_ts >= *start_ts) &&
+                (end_ts == NULL || idx[i].end_ts < *end_ts))
+        {
+            n += idx[i].len;
+        }
     }
-#endif
 
-    if (series->flags & SIRIDB_SERIES_HAS_OVERLAP)
+    if (n >= limit && (series->flags & SIRIDB_SERIES_HAS_OVERLAP))
+    {
+        shard = idx[i].shard;
+        for (; i > first && idx[i - 1].shard == shard; i--);
+    }
+
+    return (n >= limit) ? i : first;
+}
+
+/*
+ * Prepare 'runs' for reading at most 'n' chunks of 'series'. Runs are only
+ * used for series with overlapping chunks. When the offsets cannot be
+ * allocated, chunks are merged while reading like before. (no SIGNAL is
+ * raised since this is not critical)
+ */
+static void SERIES_runs_init(
+        series_runs_t * runs,
+        siridb_series_t * series,
+        size_t n)
+{
+    runs->offsets = (series->flags & SIRIDB_SERIES_HAS_OVERLAP) ?
+            (size_t *) malloc((n + 1) * sizeof(size_t)) : NULL;
+    runs->n = 0;
+    runs->end_ts = 0;
+}
+
+/*
+ * Must be called before the points of chunk 'idx' are added to 'points'.
+ * Chunks are sorted by their start time-stamp so a chunk which starts at or
+ * after the end of all chunks before extends the last run. Other chunks
+ * overlap and start a new run.
+ */
+static void SERIES_runs_add(
+        series_runs_t * runs,
+        siridb_points_t * points,
+        idx_t * idx)
+{
+    if (runs->offsets == NULL)
+    {
+        return;
+    }
+
+    if (!runs->n || idx->start_ts < runs->end_ts)
+    {
+        runs->offsets[runs->n++] = points->len;
+    }
+
+    if (idx->end_ts > runs->end_ts)
+    {
+        runs->end_ts = idx->end_ts;
+    }
+}
+
+/*
+ * Merge the runs in 'points'. New runs can be added afterwards.
+ *
+ * Returns 0 if successful or -1 and a SIGNAL is raised in case of an
+ * allocation error.
+ */
+static int SERIES_runs_merge(series_runs_t * runs, siridb_points_t * points)
+{
+    size_t n = runs->n;
+
+    runs->n = 0;
+
+    return siridb_points_merge_runs(points, runs->offsets, n);
+}
+
+/*
+ * Merge the runs in batch 'tmp' and aggregate the batch.
+ *
+ * Returns 0 if successful or -1 in case of an error, in which case 'points'
+ * and 'counts' are destroyed. (err_msg is set)
+ */
+static int SERIES_stream(
+        siridb_points_t ** points,
+        siridb_points_t ** counts,
+        siridb_points_t * tmp,
+        siridb_aggr_t * base,
+        series_runs_t * runs,
+        char * err_msg)
+{
+    if (SERIES_runs_merge(runs, tmp))
     {
-        SERIES_update_overlap(series);
+        sprintf(err_msg, "Memory allocation error.");
+        SERIES_free_aggr(*points, *counts);
+        return -1;  /* signal is raised */
     }
 
-    return rc;
+    return siridb_aggregate_stream(points, counts, tmp, base, err_msg);
 }
 
 /*
- * Open SiriDB series store file.
+ * Keep track of selects which use only a small part of a chunk. A select is
+ * narrow when it uses a single chunk for less than a quarter of the time
+ * range of the chunk and wide when it uses at least three chunks. Optimize
+ * writes smaller chunks for series which are mostly read by narrow selects.
  *
- * Returns 0 if successful or -1 in case of an error.
+ * Selects hold the series_mutex for reading so the counter is updated with
+ * atomics. A lost update is harmless.
  */
-int siridb_series_open_store(siridb_t * siridb)
+static void SERIES_track_read(
+        siridb_series_t *__restrict series,
+        uint32_t first,
+        uint32_t last,
+        uint64_t *__restrict start_ts,
+        uint64_t *__restrict end_ts)
 {
-    /* macro get series file name */
-    SIRIDB_GET_FN(fn, siridb->dbpath, SIRIDB_SERIES_FN)
+    uint8_t narrow;
+    uint64_t lo, hi;
+    idx_t * idx;
 
-    if ((siridb->store = qp_open(fn, "a")) == NULL)
+    if (start_ts == NULL || end_ts == NULL || first == last)
     {
-        log_critical("Cannot open file '%s' for appending", fn);
-        return -1;
+        return;
+    }
+
+    narrow = __atomic_load_n(&series->narrow_reads, __ATOMIC_RELAXED);
+
+    if (last - first >= 3)
+    {
+        if (narrow)
+        {
+            __atomic_store_n(
+                    &series->narrow_reads,
+                    narrow - 1,
+                    __ATOMIC_RELAXED);
+        }
+        return;
+    }
+
+    if (last - first != 1 || narrow == SERIES_NARROW_READS_MAX)
+    {
+        return;
+    }
+
+    idx = series->idx + first;
+    lo = (*start_ts > idx->start_ts) ? *start_ts : idx->start_ts;
+    hi = (*end_ts < idx->end_ts) ? *end_ts : idx->end_ts;
+
+    if (hi > lo && hi - lo < (idx->end_ts - idx->start_ts) / 4)
+    {
+        __atomic_store_n(&series->narrow_reads, narrow + 1, __ATOMIC_RELAXED);
     }
-    return 0;
 }
 
 /*
- * Will sort an index to its correct order. The start of idx should be correct
- * with a valid shard. All replaced shard indexes are sorted towards the end.
+ * Returns the maximum number of points in a chunk when optimize writes
+ * 'size' points for 'series' to 'shard'. Dense series use larger chunks so
+ * less indexes are needed and more points are decoded at once. Series which
+ * are mostly read by narrow selects use smaller chunks. The points are never
+ * written to more than 'max_chunks' chunks since the index cannot grow.
  */
-static void SERIES_idx_sort(
-        idx_t * idx,
-        uint_fast32_t start,
-        uint_fast32_t end)
+static uint16_t SERIES_chunk_points(
+        siridb_series_t *__restrict series,
+        siridb_shard_t *__restrict shard,
+        size_t size,
+        uint_fast32_t max_chunks)
 {
-    siridb_shard_t * shard = idx[start].shard;
-    idx_t * a, * b;
-    uint_fast32_t i = start;
-    uint_fast32_t n, m;
-    idx_t tmp;
+    size_t n = shard->max_chunk_sz;
 
-    /*
-     * Since the first position is always correct we can leave this one alone.
-     */
-    while (++i < end)
+    if (shard->tp == SIRIDB_SHARD_TP_NUMBER)
     {
-        a = idx + i;
-        b = idx + i + 1;
-        /*
-         * We only need to swap if at least the last position is of the correct
-         * shard and if the time-stamps should be swapped.
-         */
-        if (    b->shard == shard &&
-                (a->shard != shard || a->start_ts > b->start_ts))
+        if (__atomic_load_n(&series->narrow_reads, __ATOMIC_RELAXED) >=
+                SERIES_NARROW_READS)
         {
-            /*
-             * Swap at least a and b but also check if we can swap a - 1 with b
-             */
-            n = i - start;
-            m = i + 1;
-            tmp = idx[m];
-            do
-            {
-                idx[m] = idx[m - 1];
-                m--;  /* we must decrement here */
-            }
-            while (--n && (
-                    idx[m - 1].shard != tmp.shard ||
-                    idx[m - 1].start_ts > tmp.start_ts));
-            idx[m] = tmp;
+            n = siri.cfg->optimize_min_chunk_points;
         }
+        else if (size >= 4 * n && siri.cfg->optimize_max_chunk_points > n)
+        {
+            n = siri.cfg->optimize_max_chunk_points;
+        }
+    }
+
+    if (max_chunks && n * max_chunks < size)
+    {
+        n = (size - 1) / max_chunks + 1;
     }
+
+    return (uint16_t) n;
 }
 
 /*
@@ -1122,6 +3603,32 @@ static void SERIES_update_overlap(siridb_series_t *__restrict series)
 /*
  * Returns NULL and raises a SIGNAL in case an error has occurred.
  */
+/*
+ * Add a series to the type index. This is not critical, the index for the
+ * type of the series is no longer used when this fails.
+ */
+static void SERIES_tp_add(siridb_t * siridb, siridb_series_t * series)
+{
+    dmap_t ** dmap = &siridb->series_tp[series->tp];
+
+    if (*dmap != NULL && dmap_add(*dmap, series->id, series))
+    {
+        log_error(
+                "Cannot add series '%s' to the type index",
+                series->name);
+        dmap_free(*dmap, NULL);
+        *dmap = NULL;
+    }
+}
+
+static void SERIES_tp_remove(siridb_t * siridb, siridb_series_t * series)
+{
+    if (siridb->series_tp[series->tp] != NULL)
+    {
+        dmap_pop(siridb->series_tp[series->tp], series->id);
+    }
+}
+
 static siridb_series_t * SERIES_new(
         siridb_t * siridb,
         uint32_t id,
@@ -1131,36 +3638,50 @@ static siridb_series_t * SERIES_new(
 {
     uint32_t n;
     siridb_series_t * series;
-    series = (siridb_series_t *) malloc(sizeof(siridb_series_t));
-    if (series == NULL)
-    {
-        ERR_ALLOC
-    }
-    else
+    series = (siridb_series_t *) siridb_slab_alloc(siri.series_slab);
+    if (series != NULL)
     {
-        series->name = strdup(name);
+        /* we use the length a lot and we have room so store this info */
+        series->name_len = strlen(name);
+        series->name = siridb_names_add(
+                siridb->names,
+                name,
+                series->name_len);
         if (series->name == NULL)
         {
-            ERR_ALLOC
-            free(series);
-            series = NULL;
+            siridb_slab_release(siri.series_slab, series);
+            series = NULL;  /* signal is raised */
         }
         else
         {
-            /* we use the length a lot and we have room so store this info */
-            series->name_len = strlen(series->name);
+            siri_mem_add(
+                    SIRI_MEM_SERIES,
+                    sizeof(siridb_series_t) + series->name_len + 1);
+
             series->id = id;
             series->tp = tp;
             series->ref = 1;
             series->length = 0;
             series->start = -1;
             series->end = 0;
+            series->version = 0;
             series->buffer = NULL;
+            series->bf_class = 0;
+            series->narrow_reads = 0;
+            series->bf_hot = 0;
+            series->bf_flush_ts = 0;
+            series->bf_cap = 0;
+            series->shard = NULL;
+            series->shard_gen = 0;
             series->pool = pool;
             series->flags = 0;
             series->idx_len = 0;
             series->idx = NULL;
+            series->rollup = NULL;
+            series->dclass = 0;
+            series->last = NULL;
             series->siridb = siridb;
+            siridb_points_stats_invalidate(&series->stats);
 
             /* get sum series name to calculate series mask (for sharding) */
             for (n = 0; *name; name++)
@@ -1243,7 +3764,7 @@ static int SERIES_save(siridb_t * siridb)
     }
     else
     {
-        if (imap_walk(siridb->series_map, (imap_cb) &SERIES_pack, fpacker))
+        if (dmap_walk(siridb->series_map, (imap_cb) &SERIES_pack, fpacker))
         {
             ERR_FILE
         }
@@ -1329,7 +3850,9 @@ static int SERIES_read_dropped(siridb_t * siridb, imap_t * dropped)
 
 static int SERIES_load(siridb_t * siridb, imap_t * dropped)
 {
+    qp_funpacker_t * funpacker;
     qp_unpacker_t * unpacker;
+    qp_obj_t qp_schema;
     qp_obj_t qp_series_name;
     qp_obj_t qp_series_id;
     qp_obj_t qp_series_tp;
@@ -1349,15 +3872,26 @@ static int SERIES_load(siridb_t * siridb, imap_t * dropped)
         return SERIES_save(siridb);
     }
 
-    if ((unpacker = qp_unpacker_ff(fn)) == NULL)
+    /* the file is read in parts so a large file does not need much memory */
+    if ((funpacker = qp_funpacker_new(fn, SERIES_LOAD_WINDOW_SZ)) == NULL)
     {
         return -1;
     }
+    unpacker = &funpacker->unpacker;
 
-    /* unpacker will be freed in case schema check fails */
-    siridb_schema_check(SIRIDB_SERIES_SCHEMA)
+    if (    qp_funpacker_fill(funpacker, SERIES_LOAD_RECORD_SZ) ||
+            !qp_is_array(qp_next(unpacker, NULL)) ||
+            qp_next(unpacker, &qp_schema) != QP_INT64 ||
+            qp_schema.via.int64 != SIRIDB_SERIES_SCHEMA)
+    {
+        log_critical("Invalid schema detected in '%s'", fn);
+        qp_funpacker_free(funpacker);
+        return -1;
+    }
 
-    while (qp_next(unpacker, NULL) == QP_ARRAY3 &&
+    /* each record is in the window after filling, so its name stays valid */
+    while (!qp_funpacker_fill(funpacker, SERIES_LOAD_RECORD_SZ) &&
+            qp_next(unpacker, NULL) == QP_ARRAY3 &&
             qp_next(unpacker, &qp_series_name) == QP_RAW &&
             qp_next(unpacker, &qp_series_id) == QP_INT64 &&
             qp_next(unpacker, &qp_series_tp) == QP_INT64)
@@ -1382,53 +3916,508 @@ static int SERIES_load(siridb_t * siridb, imap_t * dropped)
             {
                 /* add series to c-tree */
                 if (ct_add(siridb->series, series->name, series) ||
-                    imap_add(siridb->series_map, series->id, series))
+                    dmap_add(siridb->series_map, series->id, series))
                 {
+                    qp_funpacker_free(funpacker);
                     return -1;
                 }
+                siridb_trigrams_add(siridb->trigrams, series);
+                siridb_tokens_add(siridb->tokens, series);
+                siridb_shash_add(siridb->shash, series);
+                SERIES_tp_add(siridb, series);
             }
         }
     }
 
-    /* save last object, should be QP_END */
-    tp = qp_next(unpacker, NULL);
+    /* save last object, should be QP_END */
+    tp = qp_funpacker_fill(funpacker, SERIES_LOAD_RECORD_SZ) ?
+            QP_ERR : qp_next(unpacker, NULL);
+
+    /* free unpacker */
+    qp_funpacker_free(funpacker);
+
+    if (tp != QP_END)
+    {
+        log_critical("Expected end of file '%s'", fn);
+        return -1;
+    }
+
+    /*
+     * In case of a siri_err we should not overwrite series because the
+     * file then might be incomplete.
+     */
+    if (siri_err || SERIES_save(siridb))
+    {
+        log_critical("Cannot write series index to disk");
+        return -1;  /* signal is raised */
+    }
+
+    return siri_err;
+}
+
+/*
+ * Load the series from the snapshot which is written at a clean shutdown.
+ * The snapshot is removed once the series are loaded so it cannot be used
+ * after a crash.
+ *
+ * Returns 0 if successful, 1 when no valid snapshot exists in which case the
+ * series must be loaded from the series file, or -1 in case of an error.
+ */
+static int SERIES_load_snapshot(siridb_t * siridb)
+{
+    series_snapshot_t header, current;
+    struct stat st;
+    const char * records;
+    char * map;
+    int fd, rc = 1;
+
+    /* we should not have any series at this moment */
+    assert(siridb->max_series_id == 0);
+
+    SIRIDB_GET_FN(fn, siridb->dbpath, SIRIDB_SERIES_SNAPSHOT_FN)
+
+    if ((fd = open(fn, O_RDONLY)) == -1)
+    {
+        /* no snapshot, the series file must be loaded */
+        return 1;
+    }
+
+    if (    fstat(fd, &st) ||
+            (size_t) st.st_size < sizeof(series_snapshot_t) ||
+            (map = (char *) mmap(
+                    NULL,
+                    st.st_size,
+                    PROT_READ,
+                    MAP_PRIVATE,
+                    fd,
+                    0)) == MAP_FAILED)
+    {
+        log_warning("Cannot read series snapshot '%s'", fn);
+        close(fd);
+        unlink(fn);
+        return 1;
+    }
+
+    memcpy(&header, map, sizeof(series_snapshot_t));
+    memset(&current, 0, sizeof(series_snapshot_t));
+
+    records = map + sizeof(series_snapshot_t);
+
+    if (    header.schema != SIRIDB_SERIES_SNAPSHOT_SCHEMA ||
+            header.size != (uint64_t) st.st_size - sizeof(series_snapshot_t) ||
+            SERIES_snapshot_stat(siridb, &current) ||
+            header.series_sz != current.series_sz ||
+            header.series_mtime != current.series_mtime ||
+            header.dropped_sz != current.dropped_sz ||
+            header.checksum != SERIES_fnv1a(
+                    SERIES_FNV1A_BASIS,
+                    records,
+                    header.size))
+    {
+        log_info("Series snapshot is stale, loading the series file");
+    }
+    else if ((rc = SERIES_read_snapshot(siridb, &header, records)))
+    {
+        log_critical("Error while reading series snapshot '%s'", fn);
+    }
+
+    munmap(map, st.st_size);
+    close(fd);
+    unlink(fn);
+
+    return rc;
+}
+
+/*
+ * Add the series from the records of a valid snapshot.
+ *
+ * Returns 0 if successful or -1 in case of an error.
+ * (a SIGNAL might be raised)
+ */
+static int SERIES_read_snapshot(
+        siridb_t * siridb,
+        series_snapshot_t * header,
+        const char * pt)
+{
+    siridb_series_t * series;
+    const char * end = pt + header->size;
+    const char * name;
+    uint32_t series_id;
+    uint16_t name_len;
+
+    log_debug("Loading %" PRIu32 " series from snapshot", header->n);
+
+    while (pt < end)
+    {
+        if (end - pt < SERIES_SNAPSHOT_RECORD_SZ)
+        {
+            return -1;
+        }
+
+        memcpy(&series_id, pt, sizeof(uint32_t));
+        memcpy(&name_len, pt + 5, sizeof(uint16_t));
+        name = pt + SERIES_SNAPSHOT_RECORD_SZ;
+
+        if (name + name_len >= end || name[name_len] != '\0')
+        {
+            return -1;
+        }
+
+        series = SERIES_new(
+                siridb,
+                series_id,
+                (uint8_t) pt[4],
+                siridb->server->pool,
+                name);
+
+        /* add series to c-tree */
+        if (    series == NULL ||
+                ct_add(siridb->series, series->name, series) ||
+                dmap_add(siridb->series_map, series->id, series))
+        {
+            return -1;
+        }
+        siridb_trigrams_add(siridb->trigrams, series);
+        siridb_tokens_add(siridb->tokens, series);
+        siridb_shash_add(siridb->shash, series);
+        SERIES_tp_add(siridb, series);
+
+        pt = name + name_len + 1;
+    }
+
+    siridb->max_series_id = header->max_series_id;
+
+    /*
+     * The series file still contains the dropped series and the dropped file
+     * will be replaced, so the series file is written once again.
+     */
+    if (header->dropped_sz && SERIES_save(siridb))
+    {
+        log_critical("Cannot write series index to disk");
+        return -1;  /* signal is raised */
+    }
+
+    return siri_err;
+}
+
+/*
+ * Set the size and modification time of the series and dropped file.
+ *
+ * Returns 0 if successful or -1 when the series file cannot be read.
+ */
+static int SERIES_snapshot_stat(
+        siridb_t * siridb,
+        series_snapshot_t * header)
+{
+    struct stat st;
+
+    SIRIDB_GET_FN(series_fn, siridb->dbpath, SIRIDB_SERIES_FN)
+    SIRIDB_GET_FN(dropped_fn, siridb->dbpath, SIRIDB_DROPPED_FN)
+
+    if (stat(series_fn, &st))
+    {
+        return -1;
+    }
+
+    header->series_sz = (uint64_t) st.st_size;
+    header->series_mtime =
+            (uint64_t) st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+    header->dropped_sz = stat(dropped_fn, &st) ? 0 : (uint64_t) st.st_size;
+
+    return 0;
+}
+
+/*
+ * Returns 0 if successful or -1 in case of a write error. (this function is
+ * used in dmap_walk())
+ */
+static int SERIES_snapshot_pack(
+        siridb_series_t * series,
+        series_snapshot_w_t * w)
+{
+    char record[SERIES_SNAPSHOT_RECORD_SZ];
+    size_t len = series->name_len + 1;
+
+    memcpy(record, &series->id, sizeof(uint32_t));
+    record[4] = (char) series->tp;
+    memcpy(record + 5, &series->name_len, sizeof(uint16_t));
+
+    w->header->checksum = SERIES_fnv1a(
+            SERIES_fnv1a(w->header->checksum, record, sizeof(record)),
+            series->name,
+            len);
+    w->header->size += sizeof(record) + len;
+    w->header->n++;
+
+    return (fwrite(record, sizeof(record), 1, w->fp) != 1 ||
+            fwrite(series->name, len, 1, w->fp) != 1) ? -1 : 0;
+}
+
+static inline uint32_t SERIES_fnv1a(
+        uint32_t hash,
+        const char * data,
+        size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        hash = (hash ^ (uint8_t) data[i]) * 16777619u;
+    }
+    return hash;
+}
+
+/*
+ * Open a new SiriDB drop series file.
+ *
+ * Returns 0 if successful or -1 in case of an error.
+ */
+static int SERIES_open_new_dropped_file(siridb_t * siridb)
+{
+    SIRIDB_GET_FN(fn, siridb->dbpath, SIRIDB_DROPPED_FN)
+
+    if ((siridb->dropped_fp = fopen(fn, "w")) == NULL)
+    {
+        log_critical("Cannot open '%s' for writing", fn);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Add a reference to the list of series for compacting. The list has room
+ * for all series. (this function is used in dmap_walk())
+ */
+static int SERIES_compact_ref(siridb_series_t * series, slist_t * slist)
+{
+    siridb_series_incref(series);
+    slist_append(slist, series);
+    return 0;
+}
+
+/*
+ * Write the new series file. The names, ids and types of series do not
+ * change so they can be read without a lock.
+ */
+static void SERIES_compact_work(uv_work_t * work)
+{
+    series_compact_t * compact = (series_compact_t *) work->data;
+    siridb_t * siridb = compact->siridb;
+    qp_fpacker_t * fpacker;
+    int rc;
+
+    SIRIDB_GET_FN(tmp, siridb->dbpath, SIRIDB_SERIES_FN "_")
+
+    if ((fpacker = qp_open(tmp, "w")) == NULL)
+    {
+        log_error("Cannot open file '%s' for writing", tmp);
+        compact->rc = -1;
+        return;
+    }
+
+    siri_throttle_background(1);
+
+    rc = qp_fadd_type(fpacker, QP_ARRAY_OPEN) ||
+         qp_fadd_int16(fpacker, SIRIDB_SERIES_SCHEMA);
+
+    for (size_t i = 0; !rc && i < compact->series->len; i++)
+    {
+        rc = SERIES_pack(
+                (siridb_series_t *) compact->series->data[i],
+                fpacker);
+    }
+
+    /* the new file must be on disk before it replaces the old one */
+    rc = rc || qp_flush(fpacker) || fsync(fileno(fpacker));
+
+    if (qp_close(fpacker) || rc)
+    {
+        log_error("Cannot write series to file '%s'", tmp);
+        compact->rc = -1;
+    }
+
+    siri_throttle_background(0);
+}
+
+static void SERIES_compact_finish(uv_work_t * work, int status)
+{
+    /*
+     * Main Thread
+     */
+    series_compact_t * compact = (series_compact_t *) work->data;
+    siridb_t * siridb = compact->siridb;
+    siridb_series_t * series;
+
+    SIRIDB_GET_FN(tmp, siridb->dbpath, SIRIDB_SERIES_FN "_")
+
+    for (size_t i = 0; i < compact->series->len; i++)
+    {
+        series = (siridb_series_t *) compact->series->data[i];
+        siridb_series_decref(series);
+    }
+
+    if (status || compact->rc || SERIES_compact_swap(compact))
+    {
+        log_error(
+                "Compacting the series file for database '%s' has failed",
+                siridb->dbname);
+        unlink(tmp);
+    }
+    else
+    {
+        log_info(
+                "Finished compacting the series file for database '%s'",
+                siridb->dbname);
+    }
+
+    /* the flag is cleared at the end since swapping flushes the drops */
+    siridb->flags &= ~SIRIDB_FLAG_COMPACTING;
+
+    slist_free(compact->series);
+    free(compact);
+    siridb_decref(siridb);
+}
+
+/*
+ * Append the series which are created while compacting and replace the
+ * series and dropped file. A crash between replacing the two files is not a
+ * problem since the old dropped file contains all dropped series ids.
+ *
+ * Returns 0 if successful or -1 in case of an error. When one of the files
+ * cannot be opened again a SIGNAL is raised.
+ */
+static int SERIES_compact_swap(series_compact_t * compact)
+{
+    siridb_t * siridb = compact->siridb;
+    siridb_series_t * series;
+    qp_fpacker_t * fpacker;
+    int rc = 0;
+
+    SIRIDB_GET_FN(fn, siridb->dbpath, SIRIDB_SERIES_FN)
+    SIRIDB_GET_FN(tmp, siridb->dbpath, SIRIDB_SERIES_FN "_")
+    SIRIDB_GET_FN(dropped_fn, siridb->dbpath, SIRIDB_DROPPED_FN)
+    SIRIDB_GET_FN(dropped_tmp, siridb->dbpath, SIRIDB_DROPPED_FN "_")
+
+    if (siri_err || (fpacker = qp_open(tmp, "a")) == NULL)
+    {
+        return -1;
+    }
+
+    /* series ids are always incremented so new series have a higher id */
+    for (   uint32_t id = compact->max_series_id + 1;
+            !rc && id <= siridb->max_series_id;
+            id++)
+    {
+        series = (siridb_series_t *) dmap_get(siridb->series_map, id);
+        if (series != NULL)
+        {
+            rc = SERIES_pack(series, fpacker);
+        }
+    }
+
+    if (qp_close(fpacker) || rc ||
+        siridb_series_flush_dropped(siridb) ||
+        SERIES_compact_dropped(siridb, compact->dropped_offset))
+    {
+        return -1;
+    }
 
-    /* free unpacker */
-    qp_unpacker_ff_free(unpacker);
+    if (qp_close(siridb->store))
+    {
+        log_error("Cannot close file '%s'", fn);
+    }
+    siridb->store = NULL;
+    siridb->store_pending = 0;
 
-    if (tp != QP_END)
+    rc = rename(tmp, fn);
+    if (rc)
     {
-        log_critical("Expected end of file '%s'", fn);
-        return -1;
+        log_error("Cannot rename '%s' to '%s'", tmp, fn);
     }
 
-    /*
-     * In case of a siri_err we should not overwrite series because the
-     * file then might be incomplete.
-     */
-    if (siri_err || SERIES_save(siridb))
+    if (siridb_series_open_store(siridb))
     {
-        log_critical("Cannot write series index to disk");
-        return -1;  /* signal is raised */
+        ERR_FILE
+        rc = -1;
     }
 
-    return siri_err;
+    if (rc)
+    {
+        unlink(dropped_tmp);
+    }
+    else if (rename(dropped_tmp, dropped_fn))
+    {
+        /* not critical, the old file contains all dropped series */
+        log_error("Cannot rename '%s' to '%s'", dropped_tmp, dropped_fn);
+    }
+
+    if (SERIES_open_dropped_file(siridb))
+    {
+        ERR_FILE
+        rc = -1;
+    }
+
+    return rc;
 }
 
 /*
- * Open a new SiriDB drop series file.
+ * Write a new dropped file which only contains the series ids after
+ * 'offset' and close the current dropped file. The dropped file must be
+ * flushed.
  *
  * Returns 0 if successful or -1 in case of an error.
  */
-static int SERIES_open_new_dropped_file(siridb_t * siridb)
+static int SERIES_compact_dropped(siridb_t * siridb, long int offset)
 {
+    char * buffer = NULL;
+    long int size;
+    FILE * fp;
+    int rc = 0;
+
     SIRIDB_GET_FN(fn, siridb->dbpath, SIRIDB_DROPPED_FN)
+    SIRIDB_GET_FN(tmp, siridb->dbpath, SIRIDB_DROPPED_FN "_")
 
-    if ((siridb->dropped_fp = fopen(fn, "w")) == NULL)
+    if ((size = ftello(siridb->dropped_fp) - offset) < 0)
     {
-        log_critical("Cannot open '%s' for writing", fn);
         return -1;
     }
+
+    if (size && (buffer = (char *) malloc(size)) == NULL)
+    {
+        ERR_ALLOC
+        return -1;
+    }
+
+    if ((fp = fopen(fn, "r")) == NULL)
+    {
+        free(buffer);
+        return -1;
+    }
+
+    rc = (fseeko(fp, offset, SEEK_SET) ||
+            (size && fread(buffer, size, 1, fp) != 1));
+
+    fclose(fp);
+
+    if (rc || (fp = fopen(tmp, "w")) == NULL)
+    {
+        free(buffer);
+        return -1;
+    }
+
+    rc = (size && fwrite(buffer, size, 1, fp) != 1);
+
+    free(buffer);
+
+    if (fclose(fp) || rc)
+    {
+        log_error("Cannot write dropped series to file '%s'", tmp);
+        unlink(tmp);
+        return -1;
+    }
+
+    /* the new file replaces the current one after the series file */
+    fclose(siridb->dropped_fp);
+    siridb->dropped_fp = NULL;
+
     return 0;
 }
 
@@ -1521,6 +4510,104 @@ static int SERIES_update_max_id(siridb_t * siridb)
     return rc;
 }
 
+/*
+ * Returns the number of idx which are allocated for an index of length 'n'.
+ * The index grows to the next power of two so adding chunks to a series
+ * takes only a few re-allocations.
+ */
+static inline uint32_t SERIES_idx_size(uint32_t n)
+{
+    return (n <= 1) ? n : 1u << (32 - __builtin_clz(n - 1));
+}
+
+/*
+ * Update the shard memory counter when the index length changes from
+ * 'old_len' to 'new_len'. The counter uses the allocated size so it should
+ * be called for each re-allocation, even when shrinking the index fails.
+ */
+static inline void SERIES_idx_mem(uint32_t old_len, uint32_t new_len)
+{
+    uint32_t old_sz = SERIES_idx_size(old_len);
+    uint32_t new_sz = SERIES_idx_size(new_len);
+
+    if (new_sz > old_sz)
+    {
+        siri_mem_add(SIRI_MEM_SHARD, (new_sz - old_sz) * sizeof(idx_t));
+    }
+    else
+    {
+        siri_mem_sub(SIRI_MEM_SHARD, (old_sz - new_sz) * sizeof(idx_t));
+    }
+}
+
+/*
+ * Shrink the index after 'offset' indexes are removed for shards in the range
+ * 'start' to 'end' and update the series properties. The series is dropped
+ * when no points are left.
+ */
+static void SERIES_removed_idx(
+        siridb_t *__restrict siridb,
+        siridb_series_t *__restrict series,
+        uint_fast32_t offset,
+        uint64_t start,
+        uint64_t end)
+{
+    idx_t * idx;
+
+    series->version = ++siridb->data_version;
+
+    /* removed points might be cached */
+    SERIES_last_clear(series);
+    SERIES_stats_update(series);
+
+    if (siridb->acache != NULL)
+    {
+        siridb_acache_drop(siridb->acache, series->id, start, end);
+    }
+
+    /* the series might still have points in a cold shard */
+    if (!series->length && !siridb->cold_shards)
+    {
+        SERIES_idx_mem(series->idx_len, 0);
+        series->idx_len = 0;
+
+        if (siridb_series_drop(siridb, series))
+        {
+            siridb_series_flush_dropped(siridb);
+        }
+        return;
+    }
+
+    SERIES_idx_mem(series->idx_len, series->idx_len - offset);
+    series->idx_len -= offset;
+    idx = (idx_t *) realloc(
+                series->idx,
+                SERIES_idx_size(series->idx_len) * sizeof(idx_t));
+    if (idx == NULL && series->idx_len)
+    {
+        log_error("Re-allocation failed while removing series from "
+                "shard index");
+    }
+    else
+    {
+        series->idx = idx;
+    }
+
+    /* the buckets might include points from the removed shards */
+    if (series->rollup != NULL)
+    {
+        siridb_rollup_remove(series->rollup, end - 1);
+    }
+    if (series->start >= start && series->start < end)
+    {
+        SERIES_update_start(series);
+    }
+    if (series->end < end && series->end > start)
+    {
+        SERIES_update_end(series);
+    }
+}
+
 /*
  * Update series 'start' property.
  */
@@ -1580,3 +4667,245 @@ static void SERIES_update_end(siridb_series_t *__restrict series)
 }
 
 
+
+/*
+ * Add a point to the last points cache of 'series', which must exist. A full
+ * cache holds the newest points of the series so older points are ignored.
+ * A cache which is not full holds all points of the series.
+ */
+static void SERIES_last_add(
+        siridb_series_t *__restrict series,
+        uint64_t * ts,
+        qp_via_t * val)
+{
+    siridb_points_t * last = series->last;
+
+    if (last->len == siri.cfg->last_points_cache)
+    {
+        if (*ts < last->data->ts)
+        {
+            return;
+        }
+
+        /* drop the oldest point */
+        last->len--;
+        memmove(last->data,
+                last->data + 1,
+                last->len * sizeof(siridb_point_t));
+    }
+
+    siridb_points_add_point(last, ts, val);
+}
+
+/*
+ * Add 'len' points to the last points cache of 'series', which must exist.
+ */
+static void SERIES_last_add_points(
+        siridb_series_t *__restrict series,
+        siridb_point_t * points,
+        size_t len)
+{
+    for (; len--; points++)
+    {
+        SERIES_last_add(series, &points->ts, &points->val);
+    }
+}
+
+/*
+ * Destroy the last points cache of 'series', if any. This must be called when
+ * points are removed or changed and requires the series_mutex for writing.
+ */
+static void SERIES_last_clear(siridb_series_t * series)
+{
+    if (series->last != NULL)
+    {
+        siri_mem_sub(SIRI_MEM_SERIES, SERIES_LAST_MEM);
+        siridb_points_free(series->last);
+        series->last = NULL;
+    }
+}
+
+/*
+ * Create the last points cache of 'series' with the newest points of the
+ * series. All points of the series must be loaded. Other threads can create
+ * the cache at the same time so the first cache is kept.
+ *
+ * Returns 0 if successful or -1 and a SIGNAL is raised in case of an error.
+ * Failing to re-allocate the cache is not critical, the cache is then not
+ * created.
+ */
+static int SERIES_last_fill(siridb_series_t * series)
+{
+    siridb_points_t * expected = NULL;
+    siridb_points_t * points;
+    siridb_point_t * data;
+
+    points = SERIES_get_points(
+            series,
+            NULL,
+            NULL,
+            siri.cfg->last_points_cache,
+            NULL);
+
+    if (points == NULL)
+    {
+        return -1;  /* signal is raised */
+    }
+
+    /* new points are added to the cache so make room for a full cache */
+    data = (siridb_point_t *) realloc(
+            points->data,
+            siri.cfg->last_points_cache * sizeof(siridb_point_t));
+    if (data == NULL)
+    {
+        log_error("Re-allocation last points cache has failed");
+        siridb_points_free(points);
+        return 0;
+    }
+    points->data = data;
+
+    if (__atomic_compare_exchange_n(
+            &series->last,
+            &expected,
+            points,
+            0,
+            __ATOMIC_RELEASE,
+            __ATOMIC_RELAXED))
+    {
+        siri_mem_add(SIRI_MEM_SERIES, SERIES_LAST_MEM);
+    }
+    else
+    {
+        siridb_points_free(points);
+    }
+
+    return 0;
+}
+
+/*
+ * Set 'points' to the newest 'limit' points between 'start_ts' and 'end_ts'
+ * using the last points cache of 'series'. (start_ts and end_ts may be NULL)
+ *
+ * Returns 1 when 'points' is set, 0 when the points cannot be read from the
+ * cache or -1 and a SIGNAL is raised in case of an allocation error.
+ */
+static int SERIES_last_get(
+        siridb_series_t *__restrict series,
+        uint64_t *__restrict start_ts,
+        uint64_t *__restrict end_ts,
+        size_t limit,
+        siridb_points_t ** points)
+{
+    siridb_points_t * last = __atomic_load_n(&series->last, __ATOMIC_ACQUIRE);
+    siridb_point_t * point, * end;
+    size_t len;
+
+    if (last == NULL)
+    {
+        return 0;
+    }
+
+    point = last->data;
+    end = last->data + last->len;
+
+    if (end_ts != NULL)
+    {
+        for (; end > point && (end - 1)->ts >= *end_ts; end--);
+    }
+
+    len = end - point;
+
+    if (len > limit)
+    {
+        point = end - limit;
+        len = limit;
+    }
+    else if (   len < limit &&
+                last->len == siri.cfg->last_points_cache &&
+                (start_ts == NULL || *start_ts <= last->data->ts))
+    {
+        /* older points which are not cached can be in range */
+        return 0;
+    }
+
+    if (start_ts != NULL)
+    {
+        for (; len && point->ts < *start_ts; point++, len--);
+    }
+
+    *points = siridb_points_new(len, series->tp);
+    if (*points == NULL)
+    {
+        return -1;  /* signal is raised */
+    }
+
+    memcpy((*points)->data, point, len * sizeof(siridb_point_t));
+    (*points)->len = len;
+
+    return 1;
+}
+
+/*
+ * Add 'stats' for new points to the statistics of 'series'. This must be
+ * called before the points are added to the buffer or the index.
+ */
+static void SERIES_stats_add(
+        siridb_series_t *__restrict series,
+        const siridb_points_stats_t *__restrict stats)
+{
+    if (!series->idx_len && (series->buffer == NULL || !series->buffer->len))
+    {
+        series->stats = *stats;
+    }
+    else
+    {
+        siridb_points_stats_merge(&series->stats, stats, series->tp);
+    }
+}
+
+/*
+ * Set the statistics of 'series' for all points in the index and buffer.
+ * The statistics are not available when a chunk has no statistics.
+ */
+static void SERIES_stats_update(siridb_series_t * series)
+{
+    siridb_points_stats_t stats;
+    siridb_points_t * buffer = series->buffer;
+    uint32_t i;
+
+    siridb_points_stats_invalidate(&series->stats);
+
+    if (!siridb_series_isnum(series))
+    {
+        return;
+    }
+
+    for (i = 0; i < series->idx_len; i++)
+    {
+        if (i)
+        {
+            siridb_points_stats_merge(
+                    &series->stats,
+                    &series->idx[i].stats,
+                    series->tp);
+        }
+        else
+        {
+            series->stats = series->idx->stats;
+        }
+    }
+
+    if (buffer != NULL && buffer->len)
+    {
+        siridb_points_stats(&stats, buffer, 0, buffer->len);
+
+        if (series->idx_len)
+        {
+            siridb_points_stats_merge(&series->stats, &stats, series->tp);
+        }
+        else
+        {
+            series->stats = stats;
+        }
+    }
+}
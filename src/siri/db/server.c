@@ -15,8 +15,11 @@
 #include <siri/db/query.h>
 #include <siri/db/server.h>
 #include <siri/db/servers.h>
+#include <siri/db/shard.h>
+#include <siri/db/startup.h>
 #include <siri/db/fifo.h>
 #include <siri/err.h>
+#include <siri/loop.h>
 #include <siri/net/promise.h>
 #include <siri/net/socket.h>
 #include <siri/siri.h>
@@ -28,15 +31,22 @@
 #define SIRIDB_SERVERS_SCHEMA 1
 #define SIRIDB_SERVER_FLAGS_TIMEOUT 5000        // 5 seconds
 #define SIRIDB_SERVER_PROMISES_QUEUE_SIZE 250   // max concurrent promises
+#define SIRIDB_SERVER_LATENCY_MAX 60000         // 1 minute
+#define SIRIDB_SERVER_LATENCY_UP 19             // 19 up for 1 down = p95
+#define SIRIDB_SERVER_BULK_SIZE 65536           // always bulk from 64 KiB
 #define FMT_AS_IPV6(addr) (strchr(addr, ':') != NULL)
 
 static int SERVER_update_name(siridb_server_t * server);
-static void SERVER_timeout_pkg(uv_timer_t * handle);
+static void SERVER_timeout_pkg(sirinet_promise_t * promise);
 static void SERVER_write_cb(uv_write_t * req, int status);
 static void SERVER_on_auth_response(
         sirinet_promise_t * promise,
         sirinet_pkg_t * pkg,
         int status);
+static void SERVER_on_bulk_auth_response(
+        sirinet_promise_t * promise,
+        sirinet_pkg_t * pkg,
+        int status);
 static void SERVER_on_flags_update_response(
         sirinet_promise_t * promise,
         sirinet_pkg_t * pkg,
@@ -47,12 +57,30 @@ static void SERVER_on_resolved(
         int status,
         struct addrinfo * res);
 static int SERVER_resolve_dns(
-        siridb_server_t * server,
+        uv_tcp_t * lane,
         int ai_family,
         uv_getaddrinfo_cb getaddrinfo_cb);
+static void SERVER_connect(
+        siridb_t * siridb,
+        siridb_server_t * server,
+        uv_tcp_t * lane);
+static int SERVER_send(
+        siridb_server_t * server,
+        uv_stream_t * lane,
+        sirinet_pkg_t * pkg,
+        uint64_t timeout,
+        sirinet_promise_cb cb,
+        void * data,
+        int flags);
+static uv_stream_t * SERVER_lane(
+        siridb_server_t * server,
+        sirinet_pkg_t * pkg);
 static void SERVER_on_data(uv_stream_t * client, sirinet_pkg_t * pkg);
 static void SERVER_cancel_promise(sirinet_promise_t * promise);
 static void SERVER_upd_flag_queue_full(siridb_server_t * server);
+static void SERVER_upd_response_time(sirinet_promise_t * promise);
+static void SERVER_p95(uint32_t * estimate, uint64_t value);
+static int SERVER_add_shard_size(siridb_shard_t * shard, uint64_t * size);
 
 /*
  * In case of an error the return value is NULL and a SIGNAL is raised.
@@ -99,10 +127,16 @@ siridb_server_t * siridb_server_new(
     server->buffer_path = NULL;
     server->buffer_size = 0;
     server->startup_time = 0;
+    server->latency = 0;
+    server->rtt = 0;
+    server->counts_ts = 0;
+    memset(server->counts, 0, sizeof(server->counts));
 
     /* we set the promises later because we don't need one for self */
     server->promises = NULL;
     server->socket = NULL;
+    server->bulk = NULL;
+    server->bulk_ready = 0;
 
     /* sets address:port to name property */
     if (SERVER_update_name(server))
@@ -125,6 +159,8 @@ siridb_server_t * siridb_server_new(
  *
  * (default timeout PROMISE_DEFAULT_TIMEOUT is used when timeout 0 is set)
  *
+ * Queries and inserts are sent on the bulk lane when it is authenticated so
+ * large packages do not delay small packages like flag updates.
  */
 int siridb_server_send_pkg(
         siridb_server_t * server,
@@ -133,9 +169,31 @@ int siridb_server_send_pkg(
         sirinet_promise_cb cb,
         void * data,
         int flags)
+{
+    return SERVER_send(
+            server,
+            SERVER_lane(server, pkg),
+            pkg,
+            timeout,
+            cb,
+            data,
+            flags);
+}
+
+/*
+ * Send a package on the given lane. (see siridb_server_send_pkg())
+ */
+static int SERVER_send(
+        siridb_server_t * server,
+        uv_stream_t * lane,
+        sirinet_pkg_t * pkg,
+        uint64_t timeout,
+        sirinet_promise_cb cb,
+        void * data,
+        int flags)
 {
 #ifdef DEBUG
-    assert (server->socket != NULL);
+    assert (lane != NULL);
     assert (server->promises != NULL);
     assert (cb != NULL);
 #endif
@@ -149,14 +207,6 @@ int siridb_server_send_pkg(
         return -1;
     }
 
-    promise->timer = (uv_timer_t *) malloc(sizeof(uv_timer_t));
-    if (promise->timer == NULL)
-    {
-        ERR_ALLOC
-        free(promise);
-        return -1;
-    }
-    promise->timer->data = promise;
     promise->cb = cb;
     promise->pkg = (flags & FLAG_KEEP_PKG) ? NULL : pkg;
     promise->ref = 2;
@@ -166,12 +216,12 @@ int siridb_server_send_pkg(
      */
     promise->server = server;
     promise->data = data;
+    promise->sent = uv_now(siri.loop);
 
     uv_write_t * req = (uv_write_t *) malloc(sizeof(uv_write_t));
     if (req == NULL)
     {
         ERR_ALLOC
-        free(promise->timer);
         free(promise);
         return -1;
     }
@@ -194,7 +244,6 @@ int siridb_server_send_pkg(
         if (rc == -1)
         {
             /* memory allocation error */
-            free(promise->timer);
             free(promise);
             free(req);
             ERR_ALLOC
@@ -213,7 +262,6 @@ int siridb_server_send_pkg(
          */
         log_critical("Cannot add promise to queue for '%s'", server->name);
         ERR_C
-        free(promise->timer);
         free(promise);
         free(req);
         return -1;
@@ -221,12 +269,17 @@ int siridb_server_send_pkg(
 
     pkg->pid = promise->pid;
 
-    uv_timer_init(siri.loop, promise->timer);
-    uv_timer_start(
-            promise->timer,
-            SERVER_timeout_pkg,
+    if (sirinet_promise_timeout_start(
+            promise,
             (timeout) ? timeout : PROMISE_DEFAULT_TIMEOUT,
-            0);
+            SERVER_timeout_pkg))
+    {
+        imap_pop(server->promises, promise->pid);
+        SERVER_upd_flag_queue_full(server);
+        free(promise);
+        free(req);
+        return -1;  /* signal is raised */
+    }
 
     log_debug("Sending (pid: %" PRIu16 ", len: %" PRIu32 ", tp: %s) to '%s'",
             pkg->pid,
@@ -239,20 +292,61 @@ int siridb_server_send_pkg(
     /* set the correct check bit */
     pkg->checkbit = pkg->tp ^ 255;
 
+    sirinet_pkg_t * cpkg = sirinet_pkg_compress(lane, pkg);
+
+    if (cpkg != NULL)
+    {
+        /* the compressed copy is written and freed by the write call-back */
+        free(promise->pkg);
+        promise->pkg = pkg = cpkg;
+    }
+
     uv_buf_t wrbuf = uv_buf_init(
             (char *) pkg,
             sizeof(sirinet_pkg_t) + pkg->len);
 
-    uv_write(
-            req,
-            (uv_stream_t *) server->socket,
-            &wrbuf,
-            1,
-            SERVER_write_cb);
+    uv_write(req, lane, &wrbuf, 1, SERVER_write_cb);
 
     return 0;
 }
 
+/*
+ * Returns the lane for a package. Packages which are small and do not depend
+ * on the order of queries and inserts use the control lane, like flag
+ * updates and authentication. All others use the bulk lane, if it is
+ * authenticated, so the order between them is kept.
+ */
+static uv_stream_t * SERVER_lane(
+        siridb_server_t * server,
+        sirinet_pkg_t * pkg)
+{
+    if (!server->bulk_ready)
+    {
+        return (uv_stream_t *) server->socket;
+    }
+
+    switch ((bproto_client_t) pkg->tp)
+    {
+    case BPROTO_AUTH_REQUEST:
+    case BPROTO_FLAGS_UPDATE:
+    case BPROTO_LOG_LEVEL_UPDATE:
+    case BPROTO_REQ_GROUPS:
+    case BPROTO_REGISTER_SERVER:
+    case BPROTO_ENABLE_BACKUP_MODE:
+    case BPROTO_DISABLE_BACKUP_MODE:
+    case BPROTO_KILL_QUERY:
+        if (pkg->len < SIRIDB_SERVER_BULK_SIZE)
+        {
+            return (uv_stream_t *) server->socket;
+        }
+        break;
+    default:
+        break;
+    }
+
+    return (uv_stream_t *) server->bulk;
+}
+
 /*
  * Register and return a new server from qpack data.
  * The qpack data should contain: [uuid, address, port, pool]
@@ -319,10 +413,25 @@ void siridb_server_send_flags(siridb_server_t * server)
     assert (ssocket->siridb != NULL);
 #endif
 
-    int16_t n = ssocket->siridb->server->flags;
-    QP_PACK_INT16(buffer, n)
+    siridb_server_t * self = ssocket->siridb->server;
+    qp_packer_t * packer = sirinet_packer_new(64);
+    sirinet_pkg_t * pkg;
+
+    if (packer == NULL)
+    {
+        return;  /* signal is raised */
+    }
+
+    /* older versions only read the flags and ignore the counters */
+    qp_add_int16(packer, (int16_t) self->flags);
+    qp_add_type(packer, QP_ARRAY_OPEN);
+    for (int tp = 0; tp < SIRIDB_SERVER_COUNT_END; tp++)
+    {
+        qp_add_int64(packer, (int64_t) self->counts[tp]);
+    }
+    qp_add_type(packer, QP_ARRAY_CLOSE);
 
-    sirinet_pkg_t * pkg = sirinet_pkg_new(0, 3, BPROTO_FLAGS_UPDATE, buffer);
+    pkg = sirinet_packer2pkg(packer, 0, BPROTO_FLAGS_UPDATE);
     if (pkg != NULL && siridb_server_send_pkg(
             server,
             pkg,
@@ -335,6 +444,59 @@ void siridb_server_send_flags(siridb_server_t * server)
     }
 }
 
+/*
+ * Update the counters of 'this' server which are sent with the next flags
+ * update. The series and shards are counted in constant time, the size of
+ * the shards is summed once for each heart-beat.
+ */
+void siridb_server_counts_update(siridb_t * siridb)
+{
+    siridb_server_t * server = siridb->server;
+    uint64_t size = 0;
+
+    siri_mutex_lock(&siridb->shards_mutex);
+
+    server->counts[SIRIDB_SERVER_COUNT_SHARDS] = siridb->shards->len;
+    imap_walk(siridb->shards, (imap_cb) SERVER_add_shard_size, &size);
+
+    siri_mutex_unlock(&siridb->shards_mutex);
+
+    server->counts[SIRIDB_SERVER_COUNT_SERIES] = siridb->series_map->len;
+    server->counts[SIRIDB_SERVER_COUNT_SHARDS_SIZE] = size;
+    server->counts[SIRIDB_SERVER_COUNT_RECEIVED] = siridb->received_points;
+    server->counts[SIRIDB_SERVER_COUNT_SELECTED] = siridb->selected_points;
+    server->counts_ts = uv_now(siri.loop);
+}
+
+/*
+ * Read the counters which are sent after the flags. The counters are kept
+ * unknown when they are not sent, for example by an older version.
+ */
+void siridb_server_counts_read(
+        siridb_server_t * server,
+        qp_unpacker_t * unpacker)
+{
+    uint64_t counts[SIRIDB_SERVER_COUNT_END];
+    qp_obj_t qp_count;
+
+    if (!qp_is_array(qp_next(unpacker, NULL)))
+    {
+        return;
+    }
+
+    for (int tp = 0; tp < SIRIDB_SERVER_COUNT_END; tp++)
+    {
+        if (qp_next(unpacker, &qp_count) != QP_INT64)
+        {
+            return;
+        }
+        counts[tp] = (uint64_t) qp_count.via.int64;
+    }
+
+    memcpy(server->counts, counts, sizeof(counts));
+    server->counts_ts = uv_now(siri.loop);
+}
+
 /*
  * Returns 0 if successful or -1 in case of an error.
  * (a SIGNAL might be raises)
@@ -397,7 +559,8 @@ int siridb_server_update_address(
 }
 
 /*
- * Connect to a SiriDB Server.
+ * Connect to a SiriDB Server. This is the control lane, the bulk lane is
+ * connected when the control lane is authenticated.
  */
 void siridb_server_connect(siridb_t * siridb, siridb_server_t * server)
 {
@@ -410,68 +573,129 @@ void siridb_server_connect(siridb_t * siridb, siridb_server_t * server)
 
     if (server->socket != NULL)
     {
-        struct in_addr sa;
-        struct in6_addr sa6;
-        sirinet_socket_t * ssocket = (sirinet_socket_t *) server->socket->data;
-        ssocket->origin = server;
-        ssocket->siridb = siridb;
-        siridb_server_incref(server);
-        uv_tcp_init(siri.loop, server->socket);
+        SERVER_connect(siridb, server, server->socket);
+    }
+}
+
+/*
+ * Connect the bulk lane to a SiriDB Server when backend_lanes is set to 2 and
+ * the bulk lane is not connected.
+ */
+void siridb_server_connect_bulk(siridb_t * siridb, siridb_server_t * server)
+{
+    if (    siri.cfg->backend_lanes < 2 ||
+            server->socket == NULL ||
+            server->bulk != NULL)
+    {
+        return;
+    }
+
+    server->bulk = sirinet_socket_new(SOCKET_SERVER, &SERVER_on_data);
+
+    if (server->bulk != NULL)
+    {
+        SERVER_connect(siridb, server, server->bulk);
+    }
+}
+
+/*
+ * Called when a lane of the server is destroyed. The bulk lane is closed
+ * when the control lane is closed.
+ */
+void siridb_server_lane_closed(siridb_server_t * server, uv_tcp_t * lane)
+{
+    if (lane == server->bulk)
+    {
+        server->bulk = NULL;
+        server->bulk_ready = 0;
+        return;
+    }
 
-        if (inet_pton(AF_INET, server->address, &sa))
+    server->socket = NULL;
+    server->flags = 0;
+
+    if (server->bulk != NULL)
+    {
+        lane = server->bulk;
+        server->bulk = NULL;
+        server->bulk_ready = 0;
+
+        if (!uv_is_closing((uv_handle_t *) lane))
         {
-            /* IPv4 */
-            struct sockaddr_in dest;
+            sirinet_socket_decref(lane);
+        }
+    }
+}
 
-            uv_connect_t * req = (uv_connect_t *) malloc(sizeof(uv_connect_t));
-            if (req == NULL)
-            {
-                ERR_ALLOC
-                sirinet_socket_decref(server->socket);
-            }
-            else
-            {
-                log_debug("Trying to connect to '%s'...", server->name);
-                uv_ip4_addr(server->address, server->port, &dest);
-                uv_tcp_connect(
-                        req,
-                        server->socket,
-                        (const struct sockaddr *) &dest,
-                        SERVER_on_connect);
-            }
+/*
+ * Connect a lane which is created with sirinet_socket_new().
+ */
+static void SERVER_connect(
+        siridb_t * siridb,
+        siridb_server_t * server,
+        uv_tcp_t * lane)
+{
+    struct in_addr sa;
+    struct in6_addr sa6;
+    sirinet_socket_t * ssocket = (sirinet_socket_t *) lane->data;
+    ssocket->origin = server;
+    ssocket->siridb = siridb;
+    siridb_server_incref(server);
+    uv_tcp_init(siri.loop, lane);
+
+    if (inet_pton(AF_INET, server->address, &sa))
+    {
+        /* IPv4 */
+        struct sockaddr_in dest;
+
+        uv_connect_t * req = (uv_connect_t *) malloc(sizeof(uv_connect_t));
+        if (req == NULL)
+        {
+            ERR_ALLOC
+            sirinet_socket_decref(lane);
         }
-        else if (inet_pton(AF_INET6, server->address, &sa6))
+        else
         {
-            /* IPv6 */
-            struct sockaddr_in6 dest6;
+            log_debug("Trying to connect to '%s'...", server->name);
+            uv_ip4_addr(server->address, server->port, &dest);
+            uv_tcp_connect(
+                    req,
+                    lane,
+                    (const struct sockaddr *) &dest,
+                    SERVER_on_connect);
+        }
+    }
+    else if (inet_pton(AF_INET6, server->address, &sa6))
+    {
+        /* IPv6 */
+        struct sockaddr_in6 dest6;
 
-            uv_connect_t * req = (uv_connect_t *) malloc(sizeof(uv_connect_t));
-            if (req == NULL)
-            {
-                ERR_ALLOC
-                sirinet_socket_decref(server->socket);
-            }
-            else
-            {
-                log_debug("Trying to connect to '%s'...", server->name);
-                uv_ip6_addr(server->address, server->port, &dest6);
-                uv_tcp_connect(
-                        req,
-                        server->socket,
-                        (const struct sockaddr *) &dest6,
-                        SERVER_on_connect);
-            }
+        uv_connect_t * req = (uv_connect_t *) malloc(sizeof(uv_connect_t));
+        if (req == NULL)
+        {
+            ERR_ALLOC
+            sirinet_socket_decref(lane);
         }
         else
         {
-            /* Try DNS */
-            if (SERVER_resolve_dns(
-                    server,
-                    dns_req_family_map[siri.cfg->ip_support],
-                    SERVER_on_resolved))
-            {
-                sirinet_socket_decref(server->socket);
-            }
+            log_debug("Trying to connect to '%s'...", server->name);
+            uv_ip6_addr(server->address, server->port, &dest6);
+            uv_tcp_connect(
+                    req,
+                    lane,
+                    (const struct sockaddr *) &dest6,
+                    SERVER_on_connect);
+        }
+    }
+    else
+    {
+        /* Try DNS */
+        if (SERVER_resolve_dns(
+                lane,
+                dns_req_family_map[siri.cfg->ip_support],
+                SERVER_on_resolved))
+        {
+            sirinet_socket_decref(lane);
         }
     }
 }
@@ -484,10 +708,12 @@ void siridb_server_connect(siridb_t * siridb, siridb_server_t * server)
  * callback will not be called.
  */
 static int SERVER_resolve_dns(
-        siridb_server_t * server,
+        uv_tcp_t * lane,
         int ai_family,
         uv_getaddrinfo_cb getaddrinfo_cb)
 {
+    siridb_server_t * server =
+            (siridb_server_t *) ((sirinet_socket_t *) lane->data)->origin;
 
     struct addrinfo hints;
     hints.ai_family = ai_family;
@@ -505,7 +731,7 @@ static int SERVER_resolve_dns(
     }
 
     int result;
-    resolver->data = server;
+    resolver->data = lane;
 
     char port[6]= {'\0'};
     sprintf(port, "%u", server->port);
@@ -535,7 +761,9 @@ static void SERVER_on_resolved(
         int status,
         struct addrinfo * res)
 {
-    siridb_server_t * server = (siridb_server_t *) resolver->data;
+    uv_tcp_t * lane = (uv_tcp_t *) resolver->data;
+    siridb_server_t * server =
+            (siridb_server_t *) ((sirinet_socket_t *) lane->data)->origin;
 
     if (status < 0)
     {
@@ -543,7 +771,7 @@ static void SERVER_on_resolved(
                 server->name,
                 uv_err_name(status));
 
-        sirinet_socket_decref(server->socket);
+        sirinet_socket_decref(lane);
     }
     else
     {
@@ -580,7 +808,7 @@ static void SERVER_on_resolved(
         {
             uv_tcp_connect(
                     req,
-                    server->socket,
+                    lane,
                     (const struct sockaddr *) res->ai_addr,
                     SERVER_on_connect);
         }
@@ -605,9 +833,57 @@ static void SERVER_upd_flag_queue_full(siridb_server_t * server)
     }
 }
 
+/*
+ * Update the estimated response times of the server for a promise which is
+ * answered or timed-out. Flag updates are sent on each heart-beat and are
+ * answered without doing any work, so they measure the round-trip time. All
+ * packages, including flag updates, are used for the response time so the
+ * estimate also recovers for a server which is avoided because it was slow.
+ */
+static void SERVER_upd_response_time(sirinet_promise_t * promise)
+{
+    uint64_t ms = uv_now(siri.loop) - promise->sent;
+    siridb_server_t * server = promise->server;
+
+    if (promise->cb == SERVER_on_flags_update_response)
+    {
+        SERVER_p95(&server->rtt, ms);
+    }
+
+    SERVER_p95(&server->latency, ms);
+}
+
+/*
+ * Update an estimate of the 95th percentile. The estimate moves up 19 times
+ * faster than down so it settles where 5% of the values are higher.
+ */
+static void SERVER_p95(uint32_t * estimate, uint64_t value)
+{
+    uint32_t step = *estimate / 64 + 1;
+
+    if (value > *estimate)
+    {
+        *estimate += SIRIDB_SERVER_LATENCY_UP * step;
+        if (*estimate > SIRIDB_SERVER_LATENCY_MAX)
+        {
+            *estimate = SIRIDB_SERVER_LATENCY_MAX;
+        }
+    }
+    else
+    {
+        *estimate = (*estimate > step) ? *estimate - step : 0;
+    }
+}
+
 /*
  * Write call-back.
  */
+static int SERVER_add_shard_size(siridb_shard_t * shard, uint64_t * size)
+{
+    *size += shard->size;
+    return 0;
+}
+
 static void SERVER_write_cb(uv_write_t * req, int status)
 {
     sirinet_promise_t * promise = (sirinet_promise_t *) req->data;
@@ -630,8 +906,7 @@ static void SERVER_write_cb(uv_write_t * req, int status)
         }
         SERVER_upd_flag_queue_full(promise->server);
 
-        uv_timer_stop(promise->timer);
-        uv_close((uv_handle_t *) promise->timer, (uv_close_cb) free);
+        sirinet_promise_timeout_stop(promise);
 
         promise->cb(promise, NULL, PROMISE_WRITE_ERROR);
     }
@@ -645,9 +920,9 @@ static void SERVER_write_cb(uv_write_t * req, int status)
 /*
  * Timeout received.
  */
-static void SERVER_timeout_pkg(uv_timer_t * handle)
+static void SERVER_timeout_pkg(sirinet_promise_t * promise)
 {
-    sirinet_promise_t * promise = handle->data;
+    siri_loop_frame_t frame;
 
     if (imap_pop(promise->server->promises, promise->pid) == NULL)
     {
@@ -662,14 +937,15 @@ static void SERVER_timeout_pkg(uv_timer_t * handle)
     else
     {
         SERVER_upd_flag_queue_full(promise->server);
+        SERVER_upd_response_time(promise);
         log_warning("Timeout on package (PID %" PRIu16 ") for server '%s'",
                 promise->pid,
                 promise->server->name);
     }
-    /* the timer is stopped but we still need to close the timer */
-    uv_close((uv_handle_t *) promise->timer, (uv_close_cb) free);
-
+    /* the promise is already removed from the timeout wheel */
+    siri_loop_enter(&frame);
     promise->cb(promise, NULL, PROMISE_TIMEOUT_ERROR);
+    siri_loop_done(SIRI_LOOP_PROMISE, &frame);
 }
 
 /*
@@ -713,7 +989,8 @@ static void SERVER_on_connect(uv_connect_t * req, int status)
                 qp_add_int64(packer, (int64_t) ssocket->siridb->buffer_size) ||
                 qp_add_int32(packer, (int32_t) siri.startup_time) ||
                 qp_add_string_term(packer, ssocket->siridb->server->address) ||
-                qp_add_int32(packer, (int32_t) ssocket->siridb->server->port))
+                qp_add_int32(packer, (int32_t) ssocket->siridb->server->port) ||
+                qp_add_int8(packer, 1))  /* can read compressed packages */
             {
                 qp_packer_free(packer);
             }
@@ -721,12 +998,16 @@ static void SERVER_on_connect(uv_connect_t * req, int status)
             {
                 pkg = sirinet_packer2pkg(packer, 0, BPROTO_AUTH_REQUEST);
 
-                if (siridb_server_send_pkg(
+                /* each lane authenticates, the data is the bulk lane */
+                if (SERVER_send(
                         server,
+                        (uv_stream_t *) req->handle,
                         pkg,
                         0,
-                        SERVER_on_auth_response,
-                        NULL,
+                        (req->handle == (uv_stream_t *) server->socket) ?
+                                SERVER_on_auth_response :
+                                SERVER_on_bulk_auth_response,
+                        req->handle,
                         0))
                 {
                     free(pkg);
@@ -754,6 +1035,7 @@ static void SERVER_on_data(uv_stream_t * client, sirinet_pkg_t * pkg)
     sirinet_socket_t * ssocket = client->data;
     siridb_server_t * server = ssocket->origin;
     sirinet_promise_t * promise = imap_pop(server->promises, pkg->pid);
+    siri_loop_frame_t frame;
 
     log_debug(
             "Response received (pid: %" PRIu16
@@ -774,9 +1056,11 @@ static void SERVER_on_data(uv_stream_t * client, sirinet_pkg_t * pkg)
     else
     {
         SERVER_upd_flag_queue_full(promise->server);
-        uv_timer_stop(promise->timer);
-        uv_close((uv_handle_t *) promise->timer, (uv_close_cb) free);
+        SERVER_upd_response_time(promise);
+        sirinet_promise_timeout_stop(promise);
+        siri_loop_enter(&frame);
         promise->cb(promise, pkg, PROMISE_SUCCESS);
+        siri_loop_done(SIRI_LOOP_PROMISE, &frame);
     }
 }
 
@@ -979,11 +1263,13 @@ int siridb_server_is_remote_prop(uint32_t prop)
     case CLERI_GID_K_BUFFER_SIZE:
     case CLERI_GID_K_DBPATH:
     case CLERI_GID_K_IP_SUPPORT:
+    case CLERI_GID_K_LATENCY:
     case CLERI_GID_K_LIBUV:
     case CLERI_GID_K_NAME:
     case CLERI_GID_K_ONLINE:
     case CLERI_GID_K_POOL:
     case CLERI_GID_K_PORT:
+    case CLERI_GID_K_RTT:
     case CLERI_GID_K_STARTUP_TIME:
     case CLERI_GID_K_STATUS:
     case CLERI_GID_K_UUID:
@@ -1040,6 +1326,12 @@ int siridb_server_cexpr_cb(
                                 wserver->server->ip_support),
                 cond->str);
 
+    case CLERI_GID_K_LATENCY:
+        return cexpr_int_cmp(
+                cond->operator,
+                wserver->server->latency,
+                cond->int64);
+
     case CLERI_GID_K_LIBUV:
         return cexpr_str_cmp(
                 cond->operator,
@@ -1074,6 +1366,12 @@ int siridb_server_cexpr_cb(
                 wserver->server->port,
                 cond->int64);
 
+    case CLERI_GID_K_RTT:
+        return cexpr_int_cmp(
+                cond->operator,
+                wserver->server->rtt,
+                cond->int64);
+
     case CLERI_GID_K_STARTUP_TIME:
         return cexpr_int_cmp(
                 cond->operator,
@@ -1187,11 +1485,7 @@ int siridb_server_cexpr_cb(
  */
 static void SERVER_cancel_promise(sirinet_promise_t * promise)
 {
-    if (!uv_is_closing((uv_handle_t *) promise->timer))
-    {
-        uv_timer_stop(promise->timer);
-        uv_close((uv_handle_t *) promise->timer, (uv_close_cb) free);
-    }
+    sirinet_promise_timeout_stop(promise);
     promise->cb(promise, NULL, PROMISE_CANCELLED_ERROR);
 }
 
@@ -1267,6 +1561,26 @@ static void SERVER_on_auth_response(
                 promise->server->name);
 
         promise->server->flags |= SERVER_FLAG_AUTHENTICATED;
+
+        /* older servers do not respond if they can read compressed data */
+        qp_unpacker_t unpacker;
+        qp_obj_t qp_compress;
+        qp_unpacker_init(&unpacker, pkg->data, pkg->len);
+
+        if (    promise->server->socket != NULL &&
+                qp_next(&unpacker, &qp_compress) == QP_INT64 &&
+                qp_compress.via.int64)
+        {
+            ((sirinet_socket_t *) promise->server->socket->data)->compress = 1;
+        }
+
+        if (promise->server->socket != NULL)
+        {
+            siridb_t * siridb =
+                ((sirinet_socket_t *) promise->server->socket->data)->siridb;
+            siridb_startup_peers(siridb);
+            siridb_server_connect_bulk(siridb, promise->server);
+        }
     }
     else
     {
@@ -1285,6 +1599,67 @@ static void SERVER_on_auth_response(
     sirinet_promise_decref(promise);
 }
 
+/*
+ * The bulk lane is used when it is authenticated. On failure the lane is
+ * closed and the control lane is used until the next connect attempt.
+ */
+static void SERVER_on_bulk_auth_response(
+        sirinet_promise_t * promise,
+        sirinet_pkg_t * pkg,
+        int status)
+{
+    siridb_server_t * server = promise->server;
+    uv_tcp_t * lane = (uv_tcp_t *) promise->data;
+
+    /* the lane might be closed and replaced while waiting for a response */
+    if (lane != server->bulk)
+    {
+        sirinet_promise_decref(promise);
+        return;
+    }
+
+    if (status)
+    {
+        log_debug(
+                "Error while authenticating the bulk lane to '%s' (%s)",
+                server->name,
+                sirinet_promise_strstatus(status));
+    }
+    else if (pkg->tp == BPROTO_AUTH_SUCCESS)
+    {
+        log_debug("Bulk lane authenticated to server '%s'", server->name);
+
+        server->bulk_ready = 1;
+
+        qp_unpacker_t unpacker;
+        qp_obj_t qp_compress;
+        qp_unpacker_init(&unpacker, pkg->data, pkg->len);
+
+        if (    qp_next(&unpacker, &qp_compress) == QP_INT64 &&
+                qp_compress.via.int64)
+        {
+            ((sirinet_socket_t *) lane->data)->compress = 1;
+        }
+    }
+    else
+    {
+        log_error(
+                "Authentication of the bulk lane with server '%s' failed, "
+                "error code: %d",
+                server->name,
+                pkg->tp);
+    }
+
+    if (    (status || pkg->tp != BPROTO_AUTH_SUCCESS) &&
+            !uv_is_closing((uv_handle_t *) lane))
+    {
+        sirinet_socket_decref(lane);
+    }
+
+    /* we must free the promise */
+    sirinet_promise_decref(promise);
+}
+
 static void SERVER_on_flags_update_response(
         sirinet_promise_t * promise,
         sirinet_pkg_t * pkg,
@@ -15,6 +15,7 @@
 #include <procinfo/procinfo.h>
 #include <qpack/qpack.h>
 #include <siri/db/db.h>
+#include <siri/db/pools.h>
 #include <siri/db/query.h>
 #include <siri/db/server.h>
 #include <siri/db/servers.h>
@@ -30,6 +31,10 @@
 
 static void SERVERS_walk_free(siridb_server_t * server, void * args);
 static int SERVERS_walk_save(siridb_server_t * server, qp_fpacker_t * fpacker);
+static int SERVERS_counts_fresh(
+        siridb_server_t * server,
+        uint64_t now,
+        uint64_t age);
 
 /*
  * Returns 0 if successful or -1 in case of an error.
@@ -190,19 +195,13 @@ void siridb_servers_free(llist_t * servers)
 }
 
 /*
- * Typedef: sirinet_clserver_get_file
- *
- * Returns the length of the content for a file and set buffer with the file
- * content. Note that malloc is used to allocate memory for the buffer.
+ * Typedef: sirinet_clserver_getfn
  *
- * In case of an error -1 is returned and buffer will be set to NULL.
+ * Writes the file name to 'fn' which has at least PATH_MAX bytes.
  */
-ssize_t siridb_servers_get_file(char ** buffer, siridb_t * siridb)
+void siridb_servers_get_fn(char * fn, siridb_t * siridb)
 {
-    /* get servers file name */
-    SIRIDB_GET_FN(fn, siridb->dbpath, SIRIDB_SERVERS_FN)
-
-    return xpath_get_content(buffer, fn);
+    snprintf(fn, PATH_MAX, "%s%s", siridb->dbpath, SIRIDB_SERVERS_FN);
 }
 
 /*
@@ -533,6 +532,88 @@ int siridb_servers_available(siridb_t * siridb)
     return 1;
 }
 
+/*
+ * Add the counters of type 'tp' which are received from the other servers
+ * with the heart-beat to 'n'. Both servers in a pool have the same series,
+ * so for series only one server of each other pool is used and the pool of
+ * 'this' server is skipped.
+ *
+ * Returns 0 if successful or -1 when cached counters cannot be used, either
+ * because count_cache_age is 0 or the counters of at least one server are
+ * unknown or too old. In this case 'n' is not changed.
+ */
+int siridb_servers_cached_count(
+        siridb_t * siridb,
+        siridb_server_count_tp_t tp,
+        size_t * n)
+{
+    uint64_t age = (uint64_t) siri.cfg->count_cache_age * 1000;
+    uint64_t now = uv_now(siri.loop);
+    uint64_t total = 0;
+    siridb_server_t * server;
+
+    if (!age)
+    {
+        return -1;
+    }
+
+    if (tp == SIRIDB_SERVER_COUNT_SERIES)
+    {
+        for (uint16_t pid = 0; pid < siridb->pools->len; pid++)
+        {
+            siridb_pool_t * pool = siridb->pools->pool + pid;
+
+            if (pid == siridb->server->pool)
+            {
+                continue;
+            }
+
+            server = NULL;
+            for (uint16_t i = 0; i < pool->len; i++)
+            {
+                if (    SERVERS_counts_fresh(pool->server[i], now, age) &&
+                        (server == NULL ||
+                         pool->server[i]->counts_ts > server->counts_ts))
+                {
+                    server = pool->server[i];
+                }
+            }
+
+            if (server == NULL)
+            {
+                return -1;
+            }
+
+            total += server->counts[tp];
+        }
+    }
+    else
+    {
+        for (   llist_node_t * node = siridb->servers->first;
+                node != NULL;
+                node = node->next)
+        {
+            server = (siridb_server_t *) node->data;
+
+            if (server == siridb->server)
+            {
+                continue;
+            }
+
+            if (!SERVERS_counts_fresh(server, now, age))
+            {
+                return -1;
+            }
+
+            total += server->counts[tp];
+        }
+    }
+
+    *n += total;
+
+    return 0;
+}
+
 int siridb_servers_list(siridb_server_t * server, uv_async_t * handle)
 {
     siridb_query_t * query = (siridb_query_t *) handle->data;
@@ -591,6 +672,9 @@ int siridb_servers_list(siridb_server_t * server, uv_async_t * handle)
                     sirinet_socket_ip_support_str((siridb->server == server) ?
                             siri.cfg->ip_support : server->ip_support));
             break;
+        case CLERI_GID_K_LATENCY:
+            qp_add_int32(query->packer, (int32_t) server->latency);
+            break;
         case CLERI_GID_K_LIBUV:
             qp_add_string(
                     query->packer,
@@ -614,6 +698,9 @@ int siridb_servers_list(siridb_server_t * server, uv_async_t * handle)
         case CLERI_GID_K_PORT:
             qp_add_int32(query->packer, server->port);
             break;
+        case CLERI_GID_K_RTT:
+            qp_add_int32(query->packer, (int32_t) server->rtt);
+            break;
         case CLERI_GID_K_STARTUP_TIME:
             qp_add_int32(
                     query->packer,
@@ -789,3 +876,17 @@ static int SERVERS_walk_save(siridb_server_t * server, qp_fpacker_t * fpacker)
     return rc;
 }
 
+/*
+ * Returns 1 (true) when the server is online and the counters are received
+ * at most 'age' milliseconds ago.
+ */
+static int SERVERS_counts_fresh(
+        siridb_server_t * server,
+        uint64_t now,
+        uint64_t age)
+{
+    return (
+        siridb_server_is_online(server) &&
+        server->counts_ts &&
+        now - server->counts_ts <= age);
+}
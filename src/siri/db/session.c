@@ -0,0 +1,248 @@
+/*
+ * session.c - Short-lived session tokens for client authentication.
+ *
+ * author       : Jeroen van der Heijden
+ * email        : jeroen@transceptor.technology
+ * copyright    : 2016, Transceptor Technology
+ *
+ * A client can ask for a token when it authenticates with a password and
+ * present the token when it reconnects, which does not need the expensive
+ * password hashing. Each token can be used once; a new token is returned
+ * with each successful authentication so the client can reconnect again.
+ *
+ * A token expires after auth_session_ttl seconds and is no longer valid
+ * when the user is dropped, renamed or has a new password. The tokens only
+ * exist in memory, a restart of the server invalidates all tokens.
+ *
+ * changes
+ *  - initial version, 14-10-2016
+ *
+ */
+#include <logger/logger.h>
+#include <siri/db/session.h>
+#include <siri/db/users.h>
+#include <siri/err.h>
+#include <siri/siri.h>
+#include <slist/slist.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SESSION_VCHARS "./0123456789" \
+    "abcdefghijklmnopqrstuvwxyz"  \
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+
+/* each token character uses 6 random bits */
+#define SESSION_RANDOM_SZ (SIRIDB_SESSION_SZ * 6 / 8)
+
+static void SESSION_free(siridb_session_t * session);
+static int SESSION_is_valid(siridb_t * siridb, siridb_session_t * session);
+static int SESSION_expired(
+        const char * key,
+        size_t len,
+        siridb_session_t * session,
+        slist_t * expired);
+
+/*
+ * Create a new session for 'user' and write the token to 'token', which must
+ * be able to hold at least SIRIDB_SESSION_SZ + 1 chars.
+ *
+ * Returns 0 if successful or -1 when no token is created, a signal is only
+ * raised in case of an allocation error.
+ */
+int siridb_session_new(siridb_t * siridb, siridb_user_t * user, char * token)
+{
+    unsigned char rnd[SESSION_RANDOM_SZ];
+    siridb_session_t * session;
+    uint32_t bits = 0;
+    int nbits = 0;
+    size_t i, n = 0;
+
+    if (!siri.cfg->auth_session_ttl)
+    {
+        return -1;
+    }
+
+    if (siridb->sessions == NULL)
+    {
+        siridb->sessions = ct_new();
+        if (siridb->sessions == NULL)
+        {
+            ERR_ALLOC
+            return -1;
+        }
+    }
+    else if (siridb->sessions->len >= SIRIDB_SESSIONS_MAX)
+    {
+        siridb_sessions_cleanup(siridb);
+        if (siridb->sessions->len >= SIRIDB_SESSIONS_MAX)
+        {
+            log_warning(
+                    "Maximum number of session tokens (%d) reached",
+                    SIRIDB_SESSIONS_MAX);
+            return -1;
+        }
+    }
+
+    if (uv_random(NULL, NULL, rnd, sizeof(rnd), 0, NULL))
+    {
+        log_error("Cannot read random bytes for a session token");
+        return -1;
+    }
+
+    for (i = 0; i < sizeof(rnd); i++)
+    {
+        bits = (bits << 8) | rnd[i];
+        nbits += 8;
+        while (nbits >= 6)
+        {
+            nbits -= 6;
+            token[n++] = SESSION_VCHARS[(bits >> nbits) & 0x3f];
+        }
+    }
+    token[n] = '\0';
+
+    session = (siridb_session_t *) malloc(sizeof(siridb_session_t));
+    if (session == NULL)
+    {
+        ERR_ALLOC
+        return -1;
+    }
+
+    session->password = strdup(user->password);
+    if (session->password == NULL)
+    {
+        free(session);
+        ERR_ALLOC
+        return -1;
+    }
+
+    session->expire =
+            uv_now(siri.loop) + (uint64_t) siri.cfg->auth_session_ttl * 1000;
+    memcpy(session->token, token, SIRIDB_SESSION_SZ + 1);
+    session->user = user;
+    siridb_user_incref(user);
+
+    switch (ct_add(siridb->sessions, session->token, session))
+    {
+    case CT_EXISTS:
+        /* a collision is not expected with 192 random bits */
+        log_error("Session token already exists");
+        SESSION_free(session);
+        return -1;
+    case CT_ERR:
+        SESSION_free(session);
+        ERR_ALLOC
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Remove a session and return the user when the token was valid, or NULL
+ * if not. The returned user is still in the users list so the caller must
+ * increment the reference counter when the user is kept.
+ */
+siridb_user_t * siridb_session_pop(siridb_t * siridb, const char * token)
+{
+    siridb_session_t * session;
+    siridb_user_t * user;
+
+    if (    siridb->sessions == NULL ||
+            strlen(token) != SIRIDB_SESSION_SZ ||
+            (session = ct_pop(siridb->sessions, token)) == NULL)
+    {
+        return NULL;
+    }
+
+    user = SESSION_is_valid(siridb, session) ? session->user : NULL;
+
+    SESSION_free(session);
+
+    return user;
+}
+
+/*
+ * Remove expired sessions, called from the heart-beat.
+ *
+ * This function can raise a SIGNAL.
+ */
+void siridb_sessions_cleanup(siridb_t * siridb)
+{
+    siridb_session_t * session;
+    slist_t * expired;
+
+    if (siridb->sessions == NULL || !siridb->sessions->len)
+    {
+        return;
+    }
+
+    expired = slist_new(siridb->sessions->len);
+    if (expired == NULL)
+    {
+        ERR_ALLOC
+        return;
+    }
+
+    ct_items(siridb->sessions, (ct_item_cb) SESSION_expired, expired);
+
+    for (size_t i = 0; i < expired->len; i++)
+    {
+        session = (siridb_session_t *) expired->data[i];
+        ct_pop(siridb->sessions, session->token);
+        SESSION_free(session);
+    }
+
+    if (expired->len)
+    {
+        log_debug(
+                "Removed %zu expired session token(s) from database '%s'",
+                expired->len,
+                siridb->dbname);
+    }
+
+    slist_free(expired);
+}
+
+void siridb_sessions_free(ct_t * sessions)
+{
+    if (sessions != NULL)
+    {
+        ct_free(sessions, (ct_free_cb) SESSION_free);
+    }
+}
+
+static void SESSION_free(siridb_session_t * session)
+{
+    siridb_user_decref(session->user);
+    free(session->password);
+    free(session);
+}
+
+/*
+ * Returns 1 (true) when the session is not expired and the user exists with
+ * the same name and password as when the token was created.
+ */
+static int SESSION_is_valid(siridb_t * siridb, siridb_session_t * session)
+{
+    return (
+        session->expire > uv_now(siri.loop) &&
+        siridb_users_get_user(
+                siridb->users,
+                session->user->name,
+                NULL) == session->user &&
+        strcmp(session->password, session->user->password) == 0);
+}
+
+static int SESSION_expired(
+        const char * key __attribute__((unused)),
+        size_t len __attribute__((unused)),
+        siridb_session_t * session,
+        slist_t * expired)
+{
+    if (session->expire <= uv_now(siri.loop))
+    {
+        slist_append(expired, session);
+    }
+    return 0;
+}
@@ -15,25 +15,51 @@
 #endif
 #include <assert.h>
 #include <ctree/ctree.h>
+#include <fcntl.h>
 #include <imap/imap.h>
+#include <iset/iset.h>
 #include <limits.h>
 #include <logger/logger.h>
+#include <qpack/qpack.h>
+#include <siri/db/attach.h>
+#include <siri/db/ccache.h>
+#include <siri/db/compress.h>
+#include <siri/db/crc32c.h>
+#include <siri/db/downsample.h>
+#include <siri/db/durations.h>
+#include <siri/db/misc.h>
 #include <siri/db/series.h>
 #include <siri/db/shard.h>
 #include <siri/db/shards.h>
 #include <siri/err.h>
 #include <siri/file/pointer.h>
+#include <siri/fsync.h>
+#include <siri/mem.h>
 #include <siri/siri.h>
+#include <siri/throttle.h>
+#include <siri/trace.h>
 #include <slist/slist.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <timeit/timeit.h>
 #include <unistd.h>
+#include <xpath/xpath.h>
 
 /* max read buffer size used for reading from index file */
 #define SIRIDB_SHARD_MAX_CHUNK_SZ 65536
 
 /* shard schema (schemas below 20 are reserved for Python SiriDB) */
-#define SIRIDB_SHARD_SHEMA 20
+#define SIRIDB_SHARD_SHEMA 22
+
+/* oldest schema which can be loaded */
+#define SHARD_SHEMA_MIN 20
+
+/* compressed chunks start with the encoding since this schema */
+#define SHARD_SHEMA_ENCODING 21
+
+/* chunk headers end with a CRC32C of the chunk since this schema */
+#define SHARD_SHEMA_CRC 22
 
 /*
  * Header schema layout
@@ -87,19 +113,86 @@
  */
 #define IDX_LOG64_SZ 24
 
-#define SHARD_STATUS_SIZE 7
+/* 0    (uint32_t)  SERIES_ID
+ * 4    (uint32_t)  START_TS
+ * 8    (uint32_t)  END_TS
+ * 12   (uint16_t)  LEN
+ * 14   (uint16_t)  CHUNK_SZ
+ * 16   (qp_via_t)  MIN
+ * 24   (qp_via_t)  MAX
+ * 32   (qp_via_t)  SUM
+ */
+#define IDX_CNUM32_SZ 40
+
+/* 0    (uint32_t)  SERIES_ID
+ * 4    (uint64_t)  START_TS
+ * 12   (uint64_t)  END_TS
+ * 20   (uint16_t)  LEN
+ * 22   (uint16_t)  CHUNK_SZ
+ * 24   (qp_via_t)  MIN
+ * 32   (qp_via_t)  MAX
+ * 40   (qp_via_t)  SUM
+ */
+#define IDX_CNUM64_SZ 48
 
 /*
- * Once a shard is created the chunk_size is saved (and after a restart loaded)
- * from the shard. Its not possible to shrink the chunk size for an existing
- * shard since we assume the index will not grow when optimizing. It is
- * possible to set a larger chunk size for an existing shard.
- *
- * New shards can be created using a lower max_chunk size.
+ * Since SHARD_SHEMA_CRC each header above is followed by:
  *
- * Max 65535 since uint16_t is used to store this value
+ * 0    (uint32_t)  CRC     (CRC32C of the chunk)
  */
-#define DEFAULT_MAX_CHUNK_SZ_NUM 800
+#define IDX_CRC_SZ 4
+
+/* size of a chunk header in a shard or index file */
+#define SHARD_IDX_SZ(shard, is_num64)                       \
+    ((((shard)->tp == SIRIDB_SHARD_TP_LOG) ?                \
+        ((is_num64) ? IDX_LOG64_SZ : IDX_LOG32_SZ) :        \
+    ((shard)->flags & SIRIDB_SHARD_IS_COMPRESSED) ?         \
+        ((is_num64) ? IDX_CNUM64_SZ : IDX_CNUM32_SZ) :      \
+        ((is_num64) ? IDX_NUM64_SZ : IDX_NUM32_SZ)) +       \
+    (SHARD_HAS_CRC(shard) ? IDX_CRC_SZ : 0))
+
+/* chunk headers have a checksum, see SHARD_SHEMA_CRC */
+#define SHARD_HAS_CRC(shard)                                \
+    ((shard)->schema >= SHARD_SHEMA_CRC)
+
+/* compressed chunks are written with siridb_compress_chunk() */
+#define SHARD_HAS_ENCODING(shard)                           \
+    ((shard)->schema >= SHARD_SHEMA_ENCODING)
+
+/* log and compressed chunks have the size of the chunk in the header, at
+ * the same position as CHUNK_SZ */
+#define SHARD_HAS_CHUNK_SZ(shard)                           \
+    ((shard)->tp == SIRIDB_SHARD_TP_LOG ||                  \
+    ((shard)->flags & SIRIDB_SHARD_IS_COMPRESSED))
+
+#define SHARD_STATUS_SIZE 7
+
+/* one overlapping chunk costs about the same as this number of reads */
+#define SHARD_OVERLAP_WEIGHT 4
+
+/* dead bytes which are counted as one read */
+#define SHARD_DEAD_UNIT 65536
+
+/* chunks which are verified at once, see siridb_shard_verify() */
+#define SHARD_VERIFY_BATCH 64
+
+/* chunks which are at most this number of bytes apart are read at once */
+#define SHARD_PREFETCH_GAP 65536
+
+/* set the access time which is used for releasing the index of a shard */
+#define SHARD_TOUCH(shard) (shard)->accessed = (uint32_t) time(NULL)
+
+#define SHARD_CHECKPOINT_SCHEMA 1
+
+/* bytes written to the new shard between two optimize checkpoints */
+#define SHARD_CHECKPOINT_SIZE 67108864
+
+/* the checkpoint file name for a temporary (__) shard file name */
+#define SHARD_checkpoint_file(Name__, Fn__)         \
+        size_t Len__ = strlen(Fn__);                \
+        char Name__[Len__ + 1];                     \
+        memcpy(Name__, Fn__, Len__ - 3);            \
+        memcpy(Name__ + Len__ - 3, "chk", 4)
 
 static const siridb_shard_flags_repr_t flags_map[SHARD_STATUS_SIZE] = {
         {.repr="indexed", .flag=SIRIDB_SHARD_HAS_INDEX},
@@ -116,6 +209,50 @@ const char shard_type_map[2][7] = {
         "log"
 };
 
+/* arguments for removing dropped shards from the series */
+typedef struct shard_drop_s
+{
+    siridb_t * siridb;
+    siridb_shard_t * shard;
+    siridb_shard_t * new_shard;     /* new shard when optimizing or NULL */
+    imap_t * expired;               /* expired shards by id */
+} shard_drop_t;
+
+/*
+ * Progress of a full optimize. The new shard and the temporary index file
+ * are valid up to these sizes and contain all chunks of the old shard before
+ * 'old_size' for the series which are found in the new shard.
+ */
+typedef struct shard_checkpoint_s
+{
+    size_t old_size;    /* size of the old shard when optimize has started */
+    size_t size;        /* size of the new shard */
+    off_t idx_size;     /* size of the temporary index file */
+} shard_checkpoint_t;
+
+/* a range in a shard file which is read ahead */
+typedef struct shard_range_s
+{
+    siridb_shard_t * shard;
+    off_t pos;
+    off_t end;
+} shard_range_t;
+
+/* arguments for removing chunks from the old shard when resuming */
+typedef struct shard_resume_s
+{
+    siridb_t * siridb;
+    siridb_shard_t * shard;
+    size_t size;
+} shard_resume_t;
+
+__thread siridb_shard_stats_t * siridb_shard_stats = NULL;
+__thread int siridb_shard_shared = 0;
+
+/* file handler and mappings are shared by readers, see siridb_shard_shared */
+static uv_mutex_t shard_read_mutex;
+static uv_once_t shard_read_once = UV_ONCE_INIT;
+
 static int SHARD_apply_idx_num(
         siridb_t * siridb,
         siridb_shard_t * shard,
@@ -125,12 +262,29 @@ static int SHARD_apply_idx_num(
 static int SHARD_get_idx_num(
         siridb_t * siridb,
         siridb_shard_t * shard,
-        int is_num64);
+        int is_num64,
+        int has_lock);
 static int SHARD_load_idx_num(
         siridb_t * siridb,
         siridb_shard_t * shard,
         FILE * fp,
-        int is_num64);
+        int is_num64,
+        int has_lock);
+static int SHARD_load_num(
+        siridb_t * siridb,
+        siridb_shard_t * shard,
+        FILE * fp,
+        int has_lock);
+static int SHARD_attach_file(
+        siridb_t * siridb,
+        siridb_shard_t * shard,
+        FILE * fp,
+        int has_chunks,
+        imap_t * ids,
+        int write,
+        size_t * data_sz,
+        char * err_msg);
+static int SHARD_is_cold(siridb_t * siridb, siridb_shard_t * shard);
 static inline int SHARD_init_fn(siridb_t * siridb, siridb_shard_t * shard);
 static int SHARD_truncate(siridb_shard_t * shard);
 static int SHARD_write_header(
@@ -139,18 +293,100 @@ static int SHARD_write_header(
         siridb_points_t * points,
         uint_fast32_t start,
         uint_fast32_t end,
+        const uint16_t * chunk_sz,
+        const siridb_points_stats_t * stats,
+        const uint32_t * crc,
         FILE * fp);
+static int SHARD_get_points_compressed(
+        siridb_points_t * points,
+        idx_t * idx,
+        uint64_t * start_ts,
+        uint64_t * end_ts,
+        uint8_t has_overlap,
+        size_t ts_sz);
+static int SHARD_get_points_log(
+        siridb_points_t * points,
+        idx_t * idx,
+        uint64_t * start_ts,
+        uint64_t * end_ts,
+        uint8_t has_overlap,
+        size_t ts_sz);
+static siridb_point_t * SHARD_points_dest(
+        siridb_points_t * points,
+        idx_t * idx,
+        uint8_t has_overlap);
+static void SHARD_points_done(
+        siridb_points_t * points,
+        siridb_point_t * dest,
+        size_t n,
+        uint64_t * start_ts,
+        uint64_t * end_ts);
+static size_t SHARD_points_search(
+        const siridb_point_t * points,
+        size_t n,
+        uint64_t ts);
+static const char * SHARD_read_chunk(idx_t * idx, size_t size, void * buf);
+#ifdef POSIX_FADV_WILLNEED
+static void SHARD_prefetch_ranges(shard_range_t * ranges, uint32_t n);
+static int SHARD_cmp_range(const void * a, const void * b);
+#endif
+static const char * SHARD_read_data(idx_t * idx, size_t size, void * buf);
+static void SHARD_read_init(void);
+static void SHARD_read_error(siridb_shard_t * shard);
+static int SHARD_can_merge(siridb_shard_t * shard);
+static int SHARD_optimize_incremental(
+        siridb_shard_t * shard,
+        siridb_t * siridb);
+static int SHARD_read_idx_pos(
+        siridb_shard_t * shard,
+        int is_num64,
+        uint32_t ** idx_pos,
+        size_t * idx_len);
+static int SHARD_mark_dead(
+        siridb_shard_t * shard,
+        const idx_t * dead,
+        uint_fast32_t n,
+        const uint32_t * idx_pos,
+        size_t idx_len,
+        int is_num64);
 static int SHARD_remove(siridb_shard_t * shard);
+static int SHARD_drop_series(uint32_t id, shard_drop_t * drop);
+static int SHARD_collect_series(uint32_t id, iset_t * series);
+static int SHARD_drop_expired_series(uint32_t id, shard_drop_t * drop);
+static siridb_shard_t * SHARD_resume(
+        siridb_t * siridb,
+        siridb_shard_t * shard,
+        size_t * old_size);
+static int SHARD_resume_load(
+        siridb_t * siridb,
+        siridb_shard_t * new_shard,
+        const shard_checkpoint_t * chk);
+static int SHARD_resume_series(uint32_t id, shard_resume_t * resume);
+static int SHARD_checkpoint_write(siridb_shard_t * new_shard, size_t old_size);
+static int SHARD_checkpoint_read(
+        siridb_shard_t * new_shard,
+        shard_checkpoint_t * chk);
+static void SHARD_checkpoint_remove(const char * shard_fn);
+static int SHARD_sweep_dropped(siridb_shard_t * shard, siridb_t * siridb);
+static long int SHARD_verify_chunk(
+        siridb_shard_t * shard,
+        const char * header,
+        size_t pos,
+        int is_num64,
+        char ** buf,
+        size_t * buf_sz);
 
 /*
  * Returns 0 if successful or -1 in case of an error.
  * When an error occurs, a SIGNAL can be raised in some cases but not for sure.
+ *
+ * Shards can be loaded by multiple threads at the same time. Indexes are
+ * added to series while holding the series_mutex.
  */
 int siridb_shard_load(siridb_t * siridb, uint64_t id)
 {
-    int is_num64;
+    int rc;
     FILE * fp;
-    off_t shard_sz;
     siridb_shard_t * shard = (siridb_shard_t *) malloc(sizeof(siridb_shard_t));
 
     if (shard == NULL)
@@ -164,10 +400,24 @@ int siridb_shard_load(siridb_t * siridb, uint64_t id)
         free(shard);
         return -1;  /* signal is raised */
     }
+    siri_mem_add(SIRI_MEM_SHARD, sizeof(siridb_shard_t));
     shard->id = id;
     shard->ref = 1;
     shard->size = HEADER_SIZE;
+    shard->dead_size = 0;
     shard->replacing = NULL;
+    shard->is_cold = 0;
+    shard->nidx = 0;
+    shard->new_chunks = 0;
+    shard->overlaps = 0;
+    shard->new_size = 0;
+    shard->series = NULL;
+    shard->dropped = NULL;
+    shard->dropped_n = 0;
+    shard->dropped_sz = 0;
+    shard->verified = HEADER_SIZE;
+    shard->verified_idx = 0;
+    SHARD_TOUCH(shard);
     if (SHARD_init_fn(siridb, shard) < 0)
     {
         ERR_ALLOC
@@ -176,7 +426,7 @@ int siridb_shard_load(siridb_t * siridb, uint64_t id)
     }
 
 
-    log_info("Loading shard %" PRIu64, id);
+    log_debug("Loading shard %" PRIu64, id);
 
     if ((fp = fopen(shard->fn, "r")) == NULL)
     {
@@ -199,9 +449,11 @@ int siridb_shard_load(siridb_t * siridb, uint64_t id)
     }
 
     /* set shard type, flags and max_chunk_sz */
+    shard->schema = (uint8_t) header[HEADER_SCHEMA];
     shard->tp = (uint8_t) header[HEADER_TP];
     shard->flags = (uint8_t) header[HEADER_FLAGS] | SIRIDB_SHARD_IS_LOADING;
     shard->max_chunk_sz = *((uint16_t *) (header + HEADER_MAX_CHUNK_SZ));
+    shard->duration = *((uint64_t *) (header + HEADER_DURATION));
 
     siridb_timep_t time_precision = (uint8_t) header[HEADER_TIME_PRECISION];
 
@@ -218,50 +470,39 @@ int siridb_shard_load(siridb_t * siridb, uint64_t id)
         return -1;
     }
 
+    if (    !shard->duration ||
+            shard->duration != siridb_durations_by_id(
+                siridb,
+                shard->tp,
+                shard->id))
+    {
+        fclose(fp);
+        log_critical(
+                "Duration from shard (%" PRIu64 ") does not match the shard "
+                "id. Skip loading '%s'",
+                shard->duration,
+                shard->fn);
+        siridb_shard_decref(shard);
+        return -1;
+    }
+
     switch (shard->tp)
     {
     case SIRIDB_SHARD_TP_NUMBER:
-        is_num64 = time_precision > SIRIDB_TIME_SECONDS;
-
-        if (SHARD_get_idx_num(siridb, shard, is_num64))
+    case SIRIDB_SHARD_TP_LOG:
+        if (SHARD_is_cold(siridb, shard))
         {
-            fclose(fp);
-            log_critical("Cannot read index for shard: '%s'", shard->fn);
-            siridb_shard_decref(shard);
-            return -1;
+            /* the index is read by siridb_shard_load_cold() */
+            shard->is_cold = 1;
+            break;
         }
 
-        if (fseeko(fp, 0, SEEK_END) ||
-            (shard_sz = ftello(fp)) < (off_t) shard->size)
+        if (SHARD_load_num(siridb, shard, fp, 0))
         {
             fclose(fp);
-            log_critical("Index and/or shard corrupt: '%s'", shard->fn);
             siridb_shard_decref(shard);
             return -1;
         }
-
-        if (shard_sz > (off_t) shard->size)
-        {
-            shard->flags |= SIRIDB_SHARD_HAS_NEW_VALUES;
-
-            if (fseeko(fp, (off_t) shard->size, SEEK_SET))
-            {
-                fclose(fp);
-                log_critical("Seek error in: '%s'", shard->fn);
-                siridb_shard_decref(shard);
-                return -1;
-            }
-
-            if (SHARD_load_idx_num(siridb, shard, fp, is_num64))
-            {
-                SHARD_truncate(shard);
-            }
-        }
-        break;
-
-    case SIRIDB_SHARD_TP_LOG:
-        /* TODO: implement string type */
-        assert (0);
         break;
 
     default:
@@ -278,7 +519,20 @@ int siridb_shard_load(siridb_t * siridb, uint64_t id)
         return -1;
     }
 
-    if (imap_set(siridb->shards, id, shard) == -1)
+    siri_mutex_lock(&siridb->shards_mutex);
+    rc = imap_set(siridb->shards, id, shard);
+    siridb->shards_gen++;
+    if (rc != -1 && shard->is_cold)
+    {
+        siridb->cold_shards++;
+    }
+    if (rc != -1 && shard->tp == SIRIDB_SHARD_TP_NUMBER)
+    {
+        siridb->shard_dclasses |= 1 << siridb_durations_class(siridb, id);
+    }
+    siri_mutex_unlock(&siridb->shards_mutex);
+
+    if (rc == -1)
     {
         siridb_shard_decref(shard);
         return -1;
@@ -291,153 +545,496 @@ int siridb_shard_load(siridb_t * siridb, uint64_t id)
 }
 
 /*
- * Create a new shard file and return a siridb_shard_t object.
+ * Check a shard file 'fn' which is produced outside the server before it is
+ * attached as shard 'id'. Argument 'ids' maps the series ids which are used
+ * in the file to siridb_attach_series_t. When 'write' is set, the series ids
+ * in the chunk headers are replaced with the ids of the local series. The
+ * index file, if the shard has one, is checked and changed the same way.
  *
- * In case of an error the return value is NULL and a SIGNAL is raised.
+ * Only call this function with 'write' set after the files are checked
+ * without 'write', so the files are not half changed because of an invalid
+ * chunk header.
+ *
+ * Returns 0 if successful or -1 and 'err_msg' is set in case of an error.
  */
-siridb_shard_t *  siridb_shard_create(
+int siridb_shard_attach(
         siridb_t * siridb,
+        const char * fn,
         uint64_t id,
-        uint64_t duration,
-        uint8_t tp,
-        siridb_shard_t * replacing)
+        imap_t * ids,
+        int write,
+        char * err_msg)
 {
-    siridb_shard_t * shard = (siridb_shard_t *) malloc(sizeof(siridb_shard_t));
-    if (shard == NULL)
-    {
-        ERR_ALLOC
-        return NULL;
-    }
-    if ((shard->fp = siri_fp_new()) == NULL)
+    char header[HEADER_SIZE];
+    siridb_shard_t shard;
+    size_t data_sz = 0;
+    off_t size;
+    FILE * fp;
+    int rc;
+
+    if ((fp = fopen(fn, write ? "r+" : "r")) == NULL)
     {
-        free(shard);
-        return NULL;  /* signal is raised */
+        snprintf(err_msg, SIRIDB_MAX_SIZE_ERR_MSG,
+                "Cannot open shard file: '%s'", fn);
+        return -1;
     }
-    shard->id = id;
-    shard->ref = 1;
-    shard->tp = tp;
-    shard->replacing = replacing;
-    shard->size = HEADER_SIZE;
-    shard->max_chunk_sz = (replacing == NULL) ?
-            DEFAULT_MAX_CHUNK_SZ_NUM : replacing->max_chunk_sz;
 
-    FILE * fp;
-    if (SHARD_init_fn(siridb, shard) < 0)
+    if (    fread(&header, HEADER_SIZE, 1, fp) != 1 ||
+            (uint8_t) header[HEADER_SCHEMA] < SHARD_SHEMA_MIN ||
+            (uint8_t) header[HEADER_SCHEMA] > SIRIDB_SHARD_SHEMA ||
+            *((uint64_t *) (header + HEADER_ID)) != id ||
+            (uint8_t) header[HEADER_TIME_PRECISION] !=
+                siridb->time->precision ||
+            ((uint8_t) header[HEADER_FLAGS] & (
+                SIRIDB_SHARD_IS_REMOVED |
+                SIRIDB_SHARD_IS_LOADING |
+                SIRIDB_SHARD_IS_CORRUPT)) ||
+            *((uint16_t *) (header + HEADER_MAX_CHUNK_SZ)) == 0)
     {
-        ERR_ALLOC
-        siridb_shard_decref(shard);
-        return NULL;
+        snprintf(err_msg, SIRIDB_MAX_SIZE_ERR_MSG,
+                "Invalid header in shard file: '%s'", fn);
+        fclose(fp);
+        return -1;
     }
 
-    shard->flags = (replacing == NULL || siri_optimize_create_idx(shard->fn)) ?
-            SIRIDB_SHARD_OK : SIRIDB_SHARD_HAS_INDEX;
+    shard.id = id;
+    shard.schema = (uint8_t) header[HEADER_SCHEMA];
+    shard.tp = (uint8_t) header[HEADER_TP];
+    shard.flags = (uint8_t) header[HEADER_FLAGS];
+    shard.duration = *((uint64_t *) (header + HEADER_DURATION));
 
-    if ((fp = fopen(shard->fn, "w")) == NULL)
+    if (    (shard.tp != SIRIDB_SHARD_TP_NUMBER &&
+                shard.tp != SIRIDB_SHARD_TP_LOG) ||
+            !shard.duration ||
+            shard.duration != siridb_durations_by_id(siridb, shard.tp, id))
     {
-        ERR_FILE
-        siridb_shard_decref(shard);
-        log_critical("Cannot create shard file: '%s'", shard->fn);
-        return NULL;
+        snprintf(err_msg, SIRIDB_MAX_SIZE_ERR_MSG,
+                "Shard file has another type or duration than the "
+                "database: '%s'", fn);
+        fclose(fp);
+        return -1;
     }
 
-    /* 0    (uint8_t)   SHEMA
-     * 1    (uint64_t)  ID
-     * 9    (uint64_t)  DURATION
-     * 17   (uint16_t)  MAX_CHUNK_SZ
-     * 19   (uint8_t)   TP
-     * 20   (uint8_t)   TIME_PRECISION
-     * 21   (uint8_t)   FLAGS
-     */
-    if (    fputc(SIRIDB_SHARD_SHEMA, fp) == EOF ||
-            fwrite(&id, sizeof(uint64_t), 1, fp) != 1 ||
-            fwrite(&duration, sizeof(uint64_t), 1, fp) != 1 ||
-            fwrite(&shard->max_chunk_sz, sizeof(uint16_t), 1, fp) != 1 ||
-            fputc(tp, fp) == EOF ||
-            fputc(siridb->time->precision, fp) == EOF ||
-            fputc(shard->flags, fp) == EOF)
+    if (shard.flags & SIRIDB_SHARD_HAS_INDEX)
     {
-        ERR_FILE
-        fclose(fp);
-        siridb_shard_decref(shard);
-        log_critical("Cannot write to shard file: '%s'", shard->fn);
-        return NULL;
+        siridb_shard_idx_file(idx_fn, fn);
+        FILE * idx_fp = fopen(idx_fn, write ? "r+" : "r");
+
+        if (idx_fp == NULL)
+        {
+            snprintf(err_msg, SIRIDB_MAX_SIZE_ERR_MSG,
+                    "Cannot open index file: '%s'", idx_fn);
+            fclose(fp);
+            return -1;
+        }
+
+        /* the index file has the chunk headers for the first chunks */
+        rc = SHARD_attach_file(
+                siridb,
+                &shard,
+                idx_fp,
+                0,
+                ids,
+                write,
+                &data_sz,
+                err_msg);
+
+        if (fclose(idx_fp) && !rc)
+        {
+            snprintf(err_msg, SIRIDB_MAX_SIZE_ERR_MSG,
+                    "Cannot write index file: '%s'", idx_fn);
+            rc = -1;
+        }
+
+        if (rc)
+        {
+            fclose(fp);
+            return -1;
+        }
     }
 
-    if (fclose(fp))
+    /* other chunks start with a chunk header */
+    if (    fseeko(fp, 0, SEEK_END) ||
+            (size = ftello(fp)) < 0 ||
+            (size_t) size < HEADER_SIZE + data_sz ||
+            fseeko(fp, HEADER_SIZE + data_sz, SEEK_SET))
     {
-        ERR_FILE
-        siridb_shard_decref(shard);
-        log_critical("Cannot close shard file: '%s'", shard->fn);
-        return NULL;
+        snprintf(err_msg, SIRIDB_MAX_SIZE_ERR_MSG,
+                "Index does not match shard file: '%s'", fn);
+        fclose(fp);
+        return -1;
     }
 
-    if (imap_set(siridb->shards, id, shard) == -1)
+    rc = SHARD_attach_file(
+            siridb,
+            &shard,
+            fp,
+            1,
+            ids,
+            write,
+            &data_sz,
+            err_msg);
+
+    if (fclose(fp) && !rc)
     {
-        siridb_shard_decref(shard);
-        ERR_ALLOC
-        return NULL;
+        snprintf(err_msg, SIRIDB_MAX_SIZE_ERR_MSG,
+                "Cannot write shard file: '%s'", fn);
+        rc = -1;
     }
 
-    /*
-     * This is not critical at this point and it's hard to imagine this
-     * fails if all the above was successful
-     */
-    siri_fopen(siri.fh, shard->fp, shard->fn, "r+");
-
-    return shard;
+    return rc;
 }
 
 /*
- * Call-back function used to validate shards in a where expression.
+ * Read the index for a cold shard. This function must be called while holding
+ * the series_mutex.
  *
- * Returns 0 or 1 (false or true).
+ * Returns 0 if successful or -1 in case of an error. When reading the index
+ * fails, the shard is marked as corrupt and will be rewritten by the next
+ * optimize cycle.
  */
-int siridb_shard_cexpr_cb(
-        siridb_shard_view_t * vshard,
-        cexpr_condition_t * cond)
+int siridb_shard_load_cold(siridb_t * siridb, siridb_shard_t * shard)
 {
-    switch (cond->prop)
+    FILE * fp;
+    int rc;
+
+#ifdef DEBUG
+    assert (shard->is_cold);
+#endif
+
+    log_info("Loading cold shard %" PRIu64, shard->id);
+
+    /* do not mark the shard as having new values while reading the index */
+    shard->flags |= SIRIDB_SHARD_IS_LOADING;
+
+    if ((fp = fopen(shard->fn, "r")) == NULL)
     {
-    case CLERI_GID_K_SID:
-        return cexpr_int_cmp(cond->operator, vshard->shard->id, cond->int64);
-    case CLERI_GID_K_POOL:
-        return cexpr_int_cmp(cond->operator, vshard->server->pool, cond->int64);
-    case CLERI_GID_K_SIZE:
-        return cexpr_int_cmp(cond->operator, vshard->shard->size, cond->int64);
-    case CLERI_GID_K_START:
-        return cexpr_int_cmp(cond->operator, vshard->start, cond->int64);
-    case CLERI_GID_K_END:
-        return cexpr_int_cmp(cond->operator, vshard->end, cond->int64);
-    case CLERI_GID_K_TYPE:
-        return cexpr_int_cmp(cond->operator, vshard->shard->tp, cond->int64);
-    case CLERI_GID_K_SERVER:
-        return cexpr_str_cmp(cond->operator, vshard->server->name, cond->str);
-    case CLERI_GID_K_STATUS:
+        log_error("Cannot open shard file for reading: '%s'", shard->fn);
+        rc = -1;
+    }
+    else
+    {
+        rc = SHARD_load_num(siridb, shard, fp, 1);
+
+        if (fclose(fp))
         {
-            char buffer[SIRIDB_SHARD_STATUS_STR_MAX];
-            siridb_shard_status(buffer, vshard->shard);
-            return cexpr_str_cmp(cond->operator, buffer, cond->str);
+            log_critical("Cannot close shard file: '%s'", shard->fn);
+            rc = -1;
         }
     }
-    log_critical("Unexpected shard property received: %d", cond->prop);
-    assert (0);
-    return -1;
-}
 
-/*
- * Make sure 'str' is a pointer to a string which can hold at least
- * SIRIDB_SHARD_STR_MAX.
- */
-int siridb_shard_status(char * str, siridb_shard_t * shard)
-{
-    char * pt = str;
+    shard->flags &= ~SIRIDB_SHARD_IS_LOADING;
 
-    if (shard->replacing != NULL)
+    if (rc)
     {
-        pt += sprintf(pt, "optimizing");
+        shard->flags |= SIRIDB_SHARD_IS_CORRUPT;
     }
 
-    uint8_t flags = shard->flags;
+    siri_mutex_lock(&siridb->shards_mutex);
+    shard->is_cold = 0;
+    siridb->cold_shards--;
+    siri_mutex_unlock(&siridb->shards_mutex);
+
+    return rc;
+}
+
+/*
+ * Returns 1 (true) when the index of the shard can be released. Only number
+ * shards with an index file which do not need to be optimized are released
+ * so the index can be read again with siridb_shard_load_cold().
+ */
+int siridb_shard_can_evict(siridb_shard_t * shard)
+{
+    return (shard->tp == SIRIDB_SHARD_TP_NUMBER &&
+            !shard->is_cold &&
+            shard->replacing == NULL &&
+            (shard->flags & SIRIDB_SHARD_HAS_INDEX) &&
+            !(shard->flags & (
+                    SIRIDB_SHARD_NEED_OPTIMIZE |
+                    SIRIDB_SHARD_IS_LOADING |
+                    SIRIDB_SHARD_IS_REMOVED)));
+}
+
+/*
+ * Mark the shard as cold. The indexes must be removed from the series with
+ * siridb_series_evict_cold() while holding the series_mutex, and the caller
+ * is responsible for updating siridb->cold_shards.
+ */
+void siridb_shard_evict(siridb_shard_t * shard)
+{
+#ifdef DEBUG
+    assert (siridb_shard_can_evict(shard));
+#endif
+    shard->is_cold = 1;
+
+    /* the size is set again while reading the index */
+    shard->size = HEADER_SIZE;
+    shard->dead_size = 0;
+}
+
+/*
+ * Read the index for a number or log shard. Argument 'has_lock' must be set
+ * when the series_mutex is already locked by the caller.
+ *
+ * Returns 0 if successful or -1 in case of an error.
+ */
+static int SHARD_load_num(
+        siridb_t * siridb,
+        siridb_shard_t * shard,
+        FILE * fp,
+        int has_lock)
+{
+    int is_num64 = siridb->time->precision > SIRIDB_TIME_SECONDS;
+    off_t shard_sz;
+
+    if (SHARD_get_idx_num(siridb, shard, is_num64, has_lock))
+    {
+        log_critical("Cannot read index for shard: '%s'", shard->fn);
+        return -1;
+    }
+
+    if (fseeko(fp, 0, SEEK_END) ||
+        (shard_sz = ftello(fp)) < (off_t) shard->size)
+    {
+        log_critical("Index and/or shard corrupt: '%s'", shard->fn);
+        return -1;
+    }
+
+    if (shard_sz > (off_t) shard->size)
+    {
+        shard->flags |= SIRIDB_SHARD_HAS_NEW_VALUES;
+
+        if (fseeko(fp, (off_t) shard->size, SEEK_SET))
+        {
+            log_critical("Seek error in: '%s'", shard->fn);
+            return -1;
+        }
+
+        if (SHARD_load_idx_num(siridb, shard, fp, is_num64, has_lock))
+        {
+            /* the file handler is shared so we need the lock here */
+            if (!has_lock)
+            {
+                siri_rwlock_wrlock(&siridb->series_mutex);
+            }
+            SHARD_truncate(shard);
+            if (!has_lock)
+            {
+                siri_rwlock_wrunlock(&siridb->series_mutex);
+            }
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * Returns 1 (true) when all points in the shard are older than
+ * cold_shard_age. Only number shards can be cold.
+ */
+static int SHARD_is_cold(siridb_t * siridb, siridb_shard_t * shard)
+{
+    struct timespec now;
+    uint64_t age, end;
+
+    if (!siri.cfg->cold_shard_age || shard->tp != SIRIDB_SHARD_TP_NUMBER)
+    {
+        return 0;
+    }
+
+    clock_gettime(CLOCK_REALTIME, &now);
+
+    age = (uint64_t) siri.cfg->cold_shard_age * siridb->time->factor;
+    end = SIRIDB_SHARD_START(shard) + shard->duration;
+
+    return end + age < siridb_time_now(siridb, now);
+}
+
+/*
+ * Create a new shard file and return a siridb_shard_t object.
+ *
+ * In case of an error the return value is NULL and a SIGNAL is raised.
+ */
+siridb_shard_t *  siridb_shard_create(
+        siridb_t * siridb,
+        uint64_t id,
+        uint64_t duration,
+        uint8_t tp,
+        siridb_shard_t * replacing)
+{
+    siridb_shard_t * shard = (siridb_shard_t *) malloc(sizeof(siridb_shard_t));
+    if (shard == NULL)
+    {
+        ERR_ALLOC
+        return NULL;
+    }
+    if ((shard->fp = siri_fp_new()) == NULL)
+    {
+        free(shard);
+        return NULL;  /* signal is raised */
+    }
+    siri_mem_add(SIRI_MEM_SHARD, sizeof(siridb_shard_t));
+    shard->id = id;
+    shard->duration = duration;
+    shard->ref = 1;
+    shard->schema = SIRIDB_SHARD_SHEMA;
+    shard->tp = tp;
+    shard->replacing = replacing;
+    shard->size = HEADER_SIZE;
+    shard->dead_size = 0;
+    shard->is_cold = 0;
+    shard->nidx = 0;
+    shard->new_chunks = 0;
+    shard->overlaps = 0;
+    shard->new_size = 0;
+    shard->series = NULL;
+    shard->dropped = NULL;
+    shard->dropped_n = 0;
+    shard->dropped_sz = 0;
+    shard->verified = HEADER_SIZE;
+    shard->verified_idx = 0;
+    SHARD_TOUCH(shard);
+    shard->max_chunk_sz = (replacing != NULL) ? replacing->max_chunk_sz :
+            (tp == SIRIDB_SHARD_TP_LOG) ?
+            DEFAULT_MAX_CHUNK_SZ_LOG : DEFAULT_MAX_CHUNK_SZ_NUM;
+
+    FILE * fp;
+    if (SHARD_init_fn(siridb, shard) < 0)
+    {
+        ERR_ALLOC
+        siridb_shard_decref(shard);
+        return NULL;
+    }
+
+    shard->flags = (replacing == NULL || siri_optimize_create_idx(shard->fn)) ?
+            SIRIDB_SHARD_OK : SIRIDB_SHARD_HAS_INDEX;
+
+    /*
+     * New number shards are compressed, the compressed size of a chunk must
+     * fit in the uint16_t CHUNK_SZ field of the index.
+     */
+    if (    tp == SIRIDB_SHARD_TP_NUMBER &&
+            SIRIDB_COMPRESS_MAX_SZ(shard->max_chunk_sz) <= UINT16_MAX)
+    {
+        shard->flags |= SIRIDB_SHARD_IS_COMPRESSED;
+    }
+
+    if ((fp = fopen(shard->fn, "w")) == NULL)
+    {
+        ERR_FILE
+        siridb_shard_decref(shard);
+        log_critical("Cannot create shard file: '%s'", shard->fn);
+        return NULL;
+    }
+
+    /* 0    (uint8_t)   SHEMA
+     * 1    (uint64_t)  ID
+     * 9    (uint64_t)  DURATION
+     * 17   (uint16_t)  MAX_CHUNK_SZ
+     * 19   (uint8_t)   TP
+     * 20   (uint8_t)   TIME_PRECISION
+     * 21   (uint8_t)   FLAGS
+     */
+    if (    fputc(SIRIDB_SHARD_SHEMA, fp) == EOF ||
+            fwrite(&id, sizeof(uint64_t), 1, fp) != 1 ||
+            fwrite(&duration, sizeof(uint64_t), 1, fp) != 1 ||
+            fwrite(&shard->max_chunk_sz, sizeof(uint16_t), 1, fp) != 1 ||
+            fputc(tp, fp) == EOF ||
+            fputc(siridb->time->precision, fp) == EOF ||
+            fputc(shard->flags, fp) == EOF)
+    {
+        ERR_FILE
+        fclose(fp);
+        siridb_shard_decref(shard);
+        log_critical("Cannot write to shard file: '%s'", shard->fn);
+        return NULL;
+    }
+
+    if (fclose(fp))
+    {
+        ERR_FILE
+        siridb_shard_decref(shard);
+        log_critical("Cannot close shard file: '%s'", shard->fn);
+        return NULL;
+    }
+
+    if (imap_set(siridb->shards, id, shard) == -1)
+    {
+        siridb_shard_decref(shard);
+        ERR_ALLOC
+        return NULL;
+    }
+    siridb->shards_gen++;
+
+    if (tp == SIRIDB_SHARD_TP_NUMBER)
+    {
+        siridb->shard_dclasses |= 1 << siridb_durations_class(siridb, id);
+    }
+
+    /*
+     * This is not critical at this point and it's hard to imagine this
+     * fails if all the above was successful
+     */
+    siri_fopen(siri.fh, shard->fp, shard->fn, "r+");
+
+    return shard;
+}
+
+/*
+ * Call-back function used to validate shards in a where expression.
+ *
+ * Returns 0 or 1 (false or true).
+ */
+int siridb_shard_cexpr_cb(
+        siridb_shard_view_t * vshard,
+        cexpr_condition_t * cond)
+{
+    switch (cond->prop)
+    {
+    case CLERI_GID_K_SID:
+        return cexpr_int_cmp(cond->operator, vshard->shard->id, cond->int64);
+    case CLERI_GID_K_POOL:
+        return cexpr_int_cmp(cond->operator, vshard->server->pool, cond->int64);
+    case CLERI_GID_K_SIZE:
+        return cexpr_int_cmp(cond->operator, vshard->shard->size, cond->int64);
+    case CLERI_GID_K_START:
+        return cexpr_int_cmp(cond->operator, vshard->start, cond->int64);
+    case CLERI_GID_K_END:
+        return cexpr_int_cmp(cond->operator, vshard->end, cond->int64);
+    case CLERI_GID_K_TYPE:
+        return cexpr_int_cmp(cond->operator, vshard->shard->tp, cond->int64);
+    case CLERI_GID_K_SERVER:
+        return cexpr_str_cmp(cond->operator, vshard->server->name, cond->str);
+    case CLERI_GID_K_STATUS:
+        {
+            char buffer[SIRIDB_SHARD_STATUS_STR_MAX];
+            siridb_shard_status(buffer, vshard->shard);
+            return cexpr_str_cmp(cond->operator, buffer, cond->str);
+        }
+    }
+    log_critical("Unexpected shard property received: %d", cond->prop);
+    assert (0);
+    return -1;
+}
+
+/*
+ * Make sure 'str' is a pointer to a string which can hold at least
+ * SIRIDB_SHARD_STR_MAX.
+ */
+int siridb_shard_status(char * str, siridb_shard_t * shard)
+{
+    char * pt = str;
+
+    if (shard->replacing != NULL)
+    {
+        pt += sprintf(pt, "optimizing");
+    }
+    else if (shard->is_cold)
+    {
+        pt += sprintf(pt, "cold");
+    }
+
+    uint8_t flags = shard->flags;
 
     for (int i = 1; i < SHARD_STATUS_SIZE && flags; i++)
     {
@@ -460,6 +1057,9 @@ int siridb_shard_status(char * str, siridb_shard_t * shard)
  * Writes an index and points to a shard. The return value is the position
  * where the points start in the shard file.
  *
+ * Argument 'stats' must contain the statistics for the points which are
+ * written. (stats are only saved in the index header of compressed shards)
+ *
  * If an error has occurred, EOF will be returned and a SIGNAL will be raised.
  */
 long int siridb_shard_write_points(
@@ -469,6 +1069,7 @@ long int siridb_shard_write_points(
         siridb_points_t * points,
         uint_fast32_t start,
         uint_fast32_t end,
+        const siridb_points_stats_t * stats,
         FILE * idx_fp)
 {
     FILE * fp;
@@ -476,46 +1077,137 @@ long int siridb_shard_write_points(
     uint_fast32_t i;
     long int pos = EOF;
     int header_sz;
-
-    if (shard->fp->fp == NULL)
+    int is_compressed = shard->flags & SIRIDB_SHARD_IS_COMPRESSED;
+    int is_log = shard->tp == SIRIDB_SHARD_TP_LOG;
+    int has_chunk_sz = is_compressed || is_log;
+    size_t cdata_sz = is_log ? SIRIDB_COMPRESS_LOG_MAX_SZ(
+                len,
+                siridb->time->ts_sz,
+                siridb_compress_log_values_sz(points, start, end)) :
+            is_compressed ? (size_t) SIRIDB_COMPRESS_MAX_SZ(len) : 1;
+    size_t size;
+    uint16_t chunk_sz = 0;
+    uint32_t crc = 0;
+    unsigned char cdata[cdata_sz];
+
+    SHARD_TOUCH(shard);
+    SIRI_TRACE2(chunk__write__start, shard->id, len);
+
+    if (siri_fh_open(siri.fh, shard->fp, shard->fn, "r+"))
     {
-        if (siri_fopen(siri.fh, shard->fp, shard->fn, "r+"))
-        {
-            ERR_FILE
-            log_critical("Cannot open file '%s'", shard->fn);
-            return EOF;
-        }
+        ERR_FILE
+        log_critical("Cannot open file '%s'", shard->fn);
+        return EOF;
     }
     fp = shard->fp->fp;
 
-    if (idx_fp == NULL || (shard->flags & SIRIDB_SHARD_HAS_NEW_VALUES))
+    /*
+     * Chunks are always appended. The file position might have been changed
+     * by reading from the shard or by marking chunks as dead.
+     */
+    if (fseeko(fp, 0, SEEK_END))
     {
-        header_sz = SHARD_write_header(
-                siridb,
-                series,
-                points,
-                start,
-                end,
-                fp);
-        pos = shard->size + header_sz;
+        ERR_FILE
+        log_critical("Seek error in shard id %" PRIu64, shard->id);
+        return EOF;
     }
-    else
+
+    if (is_log)
     {
-        header_sz = SHARD_write_header(
-                siridb,
-                series,
+        /* a log chunk must fit the uint16_t LOG_SZ field of the header */
+        size = siridb_compress_log(
+                cdata,
                 points,
                 start,
                 end,
-                idx_fp);
-        pos = shard->size;
-        /* in this case we need to set the file pointer still to the end */
-        if (fseeko(fp, 0, SEEK_END))
+                siridb->time->ts_sz);
+
+        if (!size || size > UINT16_MAX)
         {
-            ERR_FILE
-            log_critical("Seek error in shard id %" PRIu64, shard->id);
-            return EOF;
+            if (size)
+            {
+                ERR_FILE
+                log_critical(
+                        "Log chunk of %zu bytes does not fit in shard "
+                        "id %" PRIu64,
+                        size,
+                        shard->id);
+            }
+            return EOF;  /* signal is raised */
         }
+        chunk_sz = (uint16_t) size;
+    }
+    else if (is_compressed)
+    {
+        /* the header contains the chunk size so we must compress first */
+        chunk_sz = (uint16_t) (SHARD_HAS_ENCODING(shard) ?
+                siridb_compress_chunk(
+                        cdata,
+                        points,
+                        start,
+                        end,
+                        siridb->time->ts_sz) :
+                siridb_compress_num(
+                        cdata,
+                        points,
+                        start,
+                        end,
+                        siridb->time->ts_sz));
+    }
+
+    size = has_chunk_sz ? chunk_sz : (siridb->time->ts_sz + 8) * len;
+
+    /* the checksum is over the bytes of the chunk as they are written */
+    if (SHARD_HAS_CRC(shard))
+    {
+        if (has_chunk_sz)
+        {
+            crc = siridb_crc32c(0, cdata, chunk_sz);
+        }
+        else for (i = start; i < end; i++)
+        {
+            crc = siridb_crc32c(crc, &points->data[i].ts, siridb->time->ts_sz);
+            crc = siridb_crc32c(crc, &points->data[i].val, 8);
+        }
+    }
+
+    /* reserve space ahead so the shard file grows in large extents */
+    if (siri.cfg->shard_prealloc_size)
+    {
+        (void) siri_fp_prealloc(
+                shard->fp,
+                shard->size,
+                IDX_CNUM64_SZ + IDX_CRC_SZ + size,
+                (size_t) siri.cfg->shard_prealloc_size * 1024);
+    }
+
+    if (idx_fp == NULL || (shard->flags & SIRIDB_SHARD_HAS_NEW_VALUES))
+    {
+        header_sz = SHARD_write_header(
+                siridb,
+                series,
+                points,
+                start,
+                end,
+                has_chunk_sz ? &chunk_sz : NULL,
+                is_compressed ? stats : NULL,
+                SHARD_HAS_CRC(shard) ? &crc : NULL,
+                fp);
+        pos = shard->size + header_sz;
+    }
+    else
+    {
+        header_sz = SHARD_write_header(
+                siridb,
+                series,
+                points,
+                start,
+                end,
+                has_chunk_sz ? &chunk_sz : NULL,
+                is_compressed ? stats : NULL,
+                SHARD_HAS_CRC(shard) ? &crc : NULL,
+                idx_fp);
+        pos = shard->size;
     }
 
     if (header_sz < 0)
@@ -527,10 +1219,17 @@ long int siridb_shard_write_points(
         return EOF;
     }
 
-    /* TODO: this works for both double and integer.
-     * Add size values for strings and write string using 'old' way
-     */
-    for (i = start; i < end; i++)
+    if (has_chunk_sz)
+    {
+        if (fwrite(cdata, chunk_sz, 1, fp) != 1)
+        {
+            ERR_FILE
+            log_critical("Cannot write points to file '%s'", shard->fn);
+            return EOF;
+        }
+    }
+    /* this works for both double and integer */
+    else for (i = start; i < end; i++)
     {
         if (fwrite(&points->data[i].ts, siridb->time->ts_sz, 1, fp) != 1 ||
             fwrite(&points->data[i].val, 8, 1, fp) != 1)
@@ -548,12 +1247,16 @@ long int siridb_shard_write_points(
         return EOF;
     }
 
-    shard->size = pos + (siridb->time->ts_sz + 8) * len;
+    siri_fsync_add(shard->fn, (pos - shard->size) + size);
+
+    shard->size = pos + size;
 
 #ifdef DEBUG
     assert (shard->size == (size_t) ftello(fp));
 #endif
 
+    SIRI_TRACE2(chunk__write__done, shard->id, pos);
+
     return pos;
 }
 
@@ -568,941 +1271,3052 @@ int siridb_shard_get_points_num32(
         uint64_t * end_ts,
         uint8_t has_overlap)
 {
-    size_t len = points->len + idx->len;
+    siridb_point_t * dest = SHARD_points_dest(points, idx, has_overlap);
+    const char * data, * pt;
+    uint32_t ts;
+    qp_via_t val;
+
+    if (dest == NULL)
+    {
+        return -1;  /* signal is raised */
+    }
+
     /*
-     * Index length is limited to max_chunk_points so we are able to store
-     * one chunk in stack memory.
+     * A NUM32 point uses 12 bytes so the chunk is read at the end of the
+     * destination. Each point is moved to the front before it is overwritten.
      */
-    uint32_t temp[idx->len * 3];
-    uint32_t * pt;
+    data = SHARD_read_chunk(
+            idx,
+            idx->len * 12,  // NUM32 point size
+            (char *) dest + idx->len * 4);
+
+    SHARD_TOUCH(idx->shard);
+
+    if (data == NULL)
+    {
+        SHARD_points_done(points, dest, 0, NULL, NULL);
+        return -1;
+    }
+
+    /* time-stamps and values in the chunk might not be aligned */
+    for (uint16_t i = 0; i < idx->len; i++)
+    {
+        pt = data + i * 12;
+        memcpy(&ts, pt, sizeof(uint32_t));
+        memcpy(&val, pt + sizeof(uint32_t), sizeof(qp_via_t));
+        dest[i].ts = (uint64_t) ts;
+        dest[i].val = val;
+    }
+
+    SHARD_points_done(points, dest, idx->len, start_ts, end_ts);
+
+    return 0;
+}
+
+/*
+ * Read points from a chunk with 64 bit time-stamps. The points in the chunk
+ * are stored like siridb_point_t so they are read without conversion.
+ *
+ * Returns 0 if successful or -1 in case of an error. SiriDB might recover
+ * from this error so we do not consider this critical.
+ */
+int siridb_shard_get_points_num64(
+        siridb_points_t * points,
+        idx_t * idx,
+        uint64_t * start_ts,
+        uint64_t * end_ts,
+        uint8_t has_overlap)
+{
+    siridb_point_t * dest = SHARD_points_dest(points, idx, has_overlap);
+    const char * data;
+
+    if (dest == NULL)
+    {
+        return -1;  /* signal is raised */
+    }
+
+    data = SHARD_read_chunk(
+            idx,
+            idx->len * 16,  // NUM64 point size
+            dest);
+
+    SHARD_TOUCH(idx->shard);
+
+    if (data == NULL)
+    {
+        SHARD_points_done(points, dest, 0, NULL, NULL);
+        return -1;
+    }
+
+    if (data != (const char *) dest)
+    {
+        /* copy from the mapping to have aligned time-stamps */
+        memcpy(dest, data, idx->len * 16);
+    }
+
+    SHARD_points_done(points, dest, idx->len, start_ts, end_ts);
+
+    return 0;
+}
+
+/*
+ * Read points from a compressed chunk with 32 bit time-stamps.
+ *
+ * Returns 0 if successful or -1 in case of an error. SiriDB might recover
+ * from this error so we do not consider this critical.
+ */
+int siridb_shard_get_points_cnum32(
+        siridb_points_t * points,
+        idx_t * idx,
+        uint64_t * start_ts,
+        uint64_t * end_ts,
+        uint8_t has_overlap)
+{
+    return SHARD_get_points_compressed(
+            points,
+            idx,
+            start_ts,
+            end_ts,
+            has_overlap,
+            sizeof(uint32_t));
+}
+
+/*
+ * Read points from a compressed chunk with 64 bit time-stamps.
+ *
+ * Returns 0 if successful or -1 in case of an error. SiriDB might recover
+ * from this error so we do not consider this critical.
+ */
+int siridb_shard_get_points_cnum64(
+        siridb_points_t * points,
+        idx_t * idx,
+        uint64_t * start_ts,
+        uint64_t * end_ts,
+        uint8_t has_overlap)
+{
+    return SHARD_get_points_compressed(
+            points,
+            idx,
+            start_ts,
+            end_ts,
+            has_overlap,
+            sizeof(uint64_t));
+}
+
+/*
+ * Read points from a log chunk with 32 bit time-stamps. The string values
+ * are kept in a content block of 'points'.
+ *
+ * Returns 0 if successful or -1 in case of an error. SiriDB might recover
+ * from this error so we do not consider this critical.
+ */
+int siridb_shard_get_points_log32(
+        siridb_points_t * points,
+        idx_t * idx,
+        uint64_t * start_ts,
+        uint64_t * end_ts,
+        uint8_t has_overlap)
+{
+    return SHARD_get_points_log(
+            points,
+            idx,
+            start_ts,
+            end_ts,
+            has_overlap,
+            sizeof(uint32_t));
+}
+
+/*
+ * Read points from a log chunk with 64 bit time-stamps. The string values
+ * are kept in a content block of 'points'.
+ *
+ * Returns 0 if successful or -1 in case of an error. SiriDB might recover
+ * from this error so we do not consider this critical.
+ */
+int siridb_shard_get_points_log64(
+        siridb_points_t * points,
+        idx_t * idx,
+        uint64_t * start_ts,
+        uint64_t * end_ts,
+        uint8_t has_overlap)
+{
+    return SHARD_get_points_log(
+            points,
+            idx,
+            start_ts,
+            end_ts,
+            has_overlap,
+            sizeof(uint64_t));
+}
+
+/*
+ * This function will be called from the 'optimize' thread.
+ *
+ * Returns 0 if successful or -1 and a SIGNAL is raised in case of an error.
+ */
+/*
+ * Returns 1 (true) when the shard should be optimized. This is the case when
+ * one of the SIRIDB_SHARD_NEED_OPTIMIZE flags is set, when chunks of dropped
+ * series must be marked as dead or when the dead chunks use more than
+ * optimize_compact_threshold percent of the shard.
+ */
+int siridb_shard_need_optimize(siridb_shard_t * shard)
+{
+    return (shard->flags & SIRIDB_SHARD_NEED_OPTIMIZE) ||
+            shard->dropped_n || (
+            shard->dead_size &&
+            shard->dead_size * 100 >
+                (size_t) siri.cfg->optimize_compact_threshold * shard->size);
+}
+
+/*
+ * Returns the number of chunk reads which are saved by optimizing the shard
+ * when all points in the shard are read once. Each added chunk is an extra
+ * read and a chunk which overlaps must be merged while reading as well. Dead
+ * chunks are not read but take space in the file and page cache, every
+ * SHARD_DEAD_UNIT bytes are counted as one read.
+ */
+uint64_t siridb_shard_optimize_benefit(siridb_shard_t * shard)
+{
+    return  (uint64_t) shard->new_chunks +
+            (uint64_t) shard->overlaps * SHARD_OVERLAP_WEIGHT +
+            shard->dead_size / SHARD_DEAD_UNIT;
+}
+
+/*
+ * Returns the estimated chunk bytes which are read and rewritten by
+ * optimizing the shard. An incremental optimize rewrites the added chunks
+ * together with the chunks they are merged with, otherwise all chunks which
+ * are not dead are rewritten.
+ */
+uint64_t siridb_shard_optimize_bytes(siridb_shard_t * shard)
+{
+    return SHARD_can_merge(shard) ?
+            2 * (uint64_t) shard->new_size :
+            (uint64_t) (shard->size - shard->dead_size);
+}
+
+/*
+ * Returns the priority for optimizing the shard which is the benefit for
+ * each MiB which must be rewritten, or 0 when the shard does not need to be
+ * optimized. See siridb_shard_optimize_bytes() for the rewritten bytes.
+ *
+ * A shard with dropped series or which is corrupt always goes first, next
+ * are shards with chunks of dropped series which are only marked as dead.
+ * Added chunks are not counted when a shard is loaded so after a restart
+ * such a shard gets the lowest priority until new values are added.
+ */
+uint64_t siridb_shard_optimize_score(siridb_shard_t * shard)
+{
+    uint64_t rewrite, score;
+
+    if (shard->is_cold || !siridb_shard_need_optimize(shard))
+    {
+        return 0;
+    }
+
+    if (shard->flags & (
+            SIRIDB_SHARD_HAS_DROPPED_SERIES | SIRIDB_SHARD_IS_CORRUPT))
+    {
+        return UINT64_MAX;
+    }
+
+    if (shard->dropped_n)
+    {
+        return UINT64_MAX - 1;
+    }
+
+    rewrite = siridb_shard_optimize_bytes(shard);
+
+    score = (siridb_shard_optimize_benefit(shard) << 20) / (rewrite + 1);
+
+    return score ? score : 1;
+}
+
+/*
+ * Add a chunk of a dropped series. The chunk is marked as dead by the next
+ * optimize cycle instead of rewriting the shard. This function must be
+ * called while holding the shards_mutex.
+ *
+ * Returns 0 if successful or -1 in case of an allocation error, in which
+ * case the shard must be flagged with SIRIDB_SHARD_HAS_DROPPED_SERIES.
+ */
+int siridb_shard_drop_chunk(siridb_shard_t * shard, const idx_t * idx)
+{
+    idx_t * tmp;
+    size_t sz;
 
-    if (idx->shard->fp->fp == NULL)
+    if (shard->dropped_n == shard->dropped_sz)
     {
-        if (siri_fopen(siri.fh, idx->shard->fp, idx->shard->fn, "r+"))
+        sz = shard->dropped_sz ? shard->dropped_sz * 2 : 64;
+        tmp = (idx_t *) realloc(shard->dropped, sz * sizeof(idx_t));
+        if (tmp == NULL)
         {
-            log_critical(
-                    "Cannot open file '%s', skip reading points",
-                    idx->shard->fn);
             return -1;
         }
+        shard->dropped = tmp;
+        shard->dropped_sz = sz;
     }
 
-    if (fseeko(idx->shard->fp->fp, idx->pos, SEEK_SET) ||
-        fread(
-            temp,
-            12,  // NUM32 point size
-            idx->len,
-            idx->shard->fp->fp) != idx->len)
+    shard->dropped[shard->dropped_n++] = *idx;
+
+    return 0;
+}
+
+/*
+ * Verify the checksums of at most SHARD_VERIFY_BATCH chunks after the part
+ * of the shard which is verified. Shard files only grow, so chunks which are
+ * verified are not read again until optimize replaces the shard. The chunks
+ * in the index file are verified first since the other chunks start after
+ * the data for these chunks.
+ *
+ * When a chunk does not match its checksum, the shard is marked as corrupt
+ * so the next optimize cycle rewrites it. Shards without checksums, cold
+ * shards and shards which are being optimized are skipped.
+ *
+ * This function must be called while holding the series_mutex for reading
+ * and with siridb_shard_shared set.
+ *
+ * Returns the number of bytes read, 0 when nothing is left to verify.
+ */
+size_t siridb_shard_verify(siridb_shard_t * shard, siridb_t * siridb)
+{
+    int is_num64 = siridb->time->precision > SIRIDB_TIME_SECONDS;
+    const unsigned int idx_sz = SHARD_IDX_SZ(shard, is_num64);
+    char header[idx_sz];
+    const char * pt;
+    char * buf = NULL;
+    size_t buf_sz = 0;
+    size_t size = 0;
+    long int chunk_sz;
+    idx_t idx;
+    FILE * fp;
+    int n = 0;
+
+    if (    !SHARD_HAS_CRC(shard) ||
+            shard->is_cold ||
+            shard->fn == NULL ||
+            shard->replacing != NULL ||
+            (shard->flags & (
+                SIRIDB_SHARD_IS_LOADING |
+                SIRIDB_SHARD_IS_REMOVED |
+                SIRIDB_SHARD_IS_CORRUPT)))
+    {
+        return 0;
+    }
+
+    if (shard->verified_idx >= 0 && (shard->flags & SIRIDB_SHARD_HAS_INDEX))
     {
-        if (idx->shard->flags & SIRIDB_SHARD_IS_CORRUPT)
+        siridb_shard_idx_file(fn, shard->fn);
+
+        fp = fopen(fn, "r");
+        if (fp == NULL || fseeko(fp, shard->verified_idx, SEEK_SET))
         {
-            log_error("Cannot read from shard id %" PRIu64, idx->shard->id);
+            /* the other chunks cannot be found without the index */
+            log_error("Cannot verify index file: '%s'", fn);
+            if (fp != NULL)
+            {
+                fclose(fp);
+            }
+            return 0;
         }
-        else
+
+        for (; n < SHARD_VERIFY_BATCH; n++)
         {
-            log_critical(
-                    "Cannot read from shard id %" PRIu64
-                    ". The next optimize cycle "
-                    "will fix this shard but you might loose some data.",
-                    idx->shard->id);
-            idx->shard->flags |= SIRIDB_SHARD_IS_CORRUPT;
+            if (fread(header, idx_sz, 1, fp) != 1)
+            {
+                shard->verified_idx = -1;
+                break;
+            }
+
+            chunk_sz = SHARD_verify_chunk(
+                    shard,
+                    header,
+                    shard->verified,
+                    is_num64,
+                    &buf,
+                    &buf_sz);
+
+            if (chunk_sz < 0)
+            {
+                break;
+            }
+
+            shard->verified += chunk_sz;
+            shard->verified_idx += idx_sz;
+            size += idx_sz + chunk_sz;
+        }
+
+        fclose(fp);
+    }
+    else
+    {
+        shard->verified_idx = -1;
+    }
+
+    /* the other chunks start with the chunk header */
+    idx.shard = shard;
+
+    for (; n < SHARD_VERIFY_BATCH &&
+            shard->verified_idx < 0 &&
+            shard->verified + idx_sz <= shard->size; n++)
+    {
+        idx.pos = (uint32_t) shard->verified;
+        idx.len = 0;
+
+        pt = SHARD_read_chunk(&idx, idx_sz, header);
+        if (pt == NULL)
+        {
+            break;
+        }
+
+        /* a mapped header is not aligned */
+        if (pt != header)
+        {
+            memcpy(header, pt, idx_sz);
+        }
+
+        chunk_sz = SHARD_verify_chunk(
+                shard,
+                header,
+                shard->verified + idx_sz,
+                is_num64,
+                &buf,
+                &buf_sz);
+
+        if (chunk_sz < 0)
+        {
+            break;
+        }
+
+        shard->verified += idx_sz + chunk_sz;
+        size += idx_sz + chunk_sz;
+    }
+
+    free(buf);
+
+    return size;
+}
+
+int siridb_shard_optimize(siridb_shard_t * shard, siridb_t * siridb)
+{
+    int rc = 0;
+    siridb_shard_t * new_shard = NULL;
+    uint64_t duration = shard->duration;
+    siridb_series_t * series;
+    siridb_series_optimize_t optimize = SIRIDB_SERIES_OPTIMIZE_INIT;
+    siridb_downsample_t * downsample = siridb_downsample_shard(siridb, shard) ?
+            siridb->downsample : NULL;
+    size_t size, old_size, checkpoint;
+
+    /* an optimize which was interrupted by a restart is continued */
+    new_shard = SHARD_resume(siridb, shard, &old_size);
+
+    if (siri_err)
+    {
+        return siri_err;
+    }
+
+    /* mark chunks of dropped series as dead, this might be sufficient */
+    if (new_shard == NULL && shard->dropped_n)
+    {
+        if (SHARD_sweep_dropped(shard, siridb))
+        {
+            return -1;
+        }
+        if (!siridb_shard_need_optimize(shard))
+        {
+            return 0;
+        }
+    }
+
+    /* downsampling always rewrites all points */
+    if (new_shard == NULL && downsample == NULL && SHARD_can_merge(shard))
+    {
+        return SHARD_optimize_incremental(shard, siridb);
+    }
+
+    siri_mutex_lock(&siridb->shards_mutex);
+
+    /* In case the shard is not removed, it must be the shard inside the imap
+     * because we check and replace the shard within the shards_mutex lock.
+     * If the shard is marked as removed we can simply skip the optimize.
+     * A resumed optimize has already replaced the shard.
+     */
+    if (new_shard != NULL)
+    {
+        log_info("Continue optimizing shard id %" PRIu64, shard->id);
+    }
+    else if (~shard->flags & SIRIDB_SHARD_IS_REMOVED)
+    {
+        /* chunks which are added from now on are copied to the new shard */
+        old_size = shard->size;
+
+        if ((new_shard = siridb_shard_create(
+            siridb,
+            shard->id,
+            duration,
+            shard->tp,
+            shard)) == NULL)
+        {
+            /* signal is raised */
+            log_critical(
+                    "Cannot create shard id '%" PRIu64 "' for optimizing.",
+                    shard->id);
+            rc = -1;
+        }
+        else
+        {
+            siridb_shard_incref(new_shard);
+        }
+    }
+    else
+    {
+        log_warning(
+                "Skip optimizing shard id '%" PRIu64 "' "
+                "because the shard is probably dropped.",
+                shard->id);
+    }
+
+    siri_mutex_unlock(&siridb->shards_mutex);
+
+    if (new_shard == NULL)
+    {
+        /*
+         * Creating the new shard has failed or the shard is dropped.
+         * We exit here so the mutex is is unlocked.
+         * (a signal might have been raised)
+         */
+        return rc;
+    }
+
+    /* at this point the references should be as following (unless dropped):
+     *  shard->ref (=>2)
+     *      - simple list
+     *      - new_shard->replacing
+     *  new_shard->ref (=>2)
+     *      - siridb->shards
+     *      - this method
+     */
+
+    sleep(1);
+
+    siri_rwlock_wrlock(&siridb->series_mutex);
+
+    slist_t * slist = dmap_2slist_ref(siridb->series_map);
+
+    siri_rwlock_wrunlock(&siridb->series_mutex);
+
+    if (slist == NULL)
+    {
+        ERR_ALLOC
+        return -1;
+    }
+
+    sleep(1);
+
+    checkpoint = new_shard->size;
+
+    for (size_t i = 0; i < slist->len; i++)
+    {
+        /* its possible that another database is paused, but we wait anyway */
+        if (siri.optimize->pause)
+        {
+            siri_optimize_wait();
+        }
+
+        series = slist->data[i];
+
+        if (    !siri_err &&
+                siri.optimize->status != SIRI_OPTIMIZE_CANCELLED &&
+                siridb_durations_mask(siridb, shard->tp, shard->id) ==
+                    series->mask &&
+                (~series->flags & SIRIDB_SERIES_IS_DROPPED) &&
+                (~new_shard->flags & SIRIDB_SHARD_IS_REMOVED))
+        {
+            /*
+             * Reading the chunks only requires the lock for reading so
+             * selects and inserts do not wait for reading from disk. The
+             * lock for writing is only taken to write and swap the chunks.
+             */
+            siri_rwlock_rdlock(&siridb->series_mutex);
+            siridb_shard_shared = 1;
+
+            if (    (~new_shard->flags & SIRIDB_SHARD_IS_REMOVED) &&
+                    siridb_series_optimize_read(series, new_shard, &optimize))
+            {
+                log_critical(
+                        "Reading shard '%s' for optimizing has failed due to "
+                        "a critical error", shard->fn);
+            }
+
+            siridb_shard_shared = 0;
+            siri_rwlock_rdunlock(&siridb->series_mutex);
+
+            siri_rwlock_wrlock(&siridb->series_mutex);
+
+            size = new_shard->size;
+
+            if (    !siri_err &&
+                    (~new_shard->flags & SIRIDB_SHARD_IS_REMOVED) &&
+                    siridb_series_optimize_shard(
+                        siridb,
+                        series,
+                        new_shard,
+                        downsample,
+                        &optimize))
+            {
+                log_critical(
+                        "Optimizing shard '%s' has failed due to a critical "
+                        "error", shard->fn);
+            }
+
+            if (optimize.points != NULL)
+            {
+                /* the shard is dropped after the points are read */
+                siridb_points_free(optimize.points);
+                optimize.points = NULL;
+            }
+
+            size = new_shard->size - size;
+
+            /*
+             * Points which are inserted while optimizing are written to the
+             * end of the new shard so we can only save progress until the
+             * first insert.
+             */
+            if (    new_shard->size - checkpoint >= SHARD_CHECKPOINT_SIZE &&
+                    (~new_shard->flags & (
+                        SIRIDB_SHARD_HAS_NEW_VALUES |
+                        SIRIDB_SHARD_IS_REMOVED)) &&
+                    SHARD_checkpoint_write(new_shard, old_size) == 0)
+            {
+                checkpoint = new_shard->size;
+            }
+
+            siri_rwlock_wrunlock(&siridb->series_mutex);
+
+            /* make this sleep depending on the active_tasks
+             * (50ms per active task) */
+            usleep( 50000 * siridb->active_tasks + 100 );
+
+            siri_throttle_wait(SIRI_THROTTLE_OPTIMIZE, size);
+            siri_throttle_wait_bucket(&siridb->optimize_throttle, size);
+        }
+
+        /* other optimize threads might hold a reference to this series */
+        siri_rwlock_wrlock(&siridb->series_mutex);
+        siridb_series_decref(series);
+        siri_rwlock_wrunlock(&siridb->series_mutex);
+    }
+
+    slist_free(slist);
+
+    if (new_shard->flags & SIRIDB_SHARD_IS_REMOVED)
+    {
+        log_warning(
+                "Cancel optimizing shard '%s' because the shard is dropped",
+                new_shard->fn);
+        siridb_shard_decref(new_shard);
+        return siri_err;
+    }
+
+    if (siri_err || siri.optimize->status == SIRI_OPTIMIZE_CANCELLED)
+    {
+        /*
+         * Error occurred or the optimize task is cancelled. By decrementing
+         * only the reference counter for the new_shard we keep this shard as
+         * if it is still optimizing so remaining points can still be written.
+         */
+        if (!siri_err)
+        {
+            /* save the progress so the optimize is continued at startup */
+            siri_rwlock_wrlock(&siridb->series_mutex);
+            if (    new_shard->size != checkpoint &&
+                    (~new_shard->flags & (
+                        SIRIDB_SHARD_HAS_NEW_VALUES |
+                        SIRIDB_SHARD_IS_REMOVED)))
+            {
+                SHARD_checkpoint_write(new_shard, old_size);
+            }
+            siri_rwlock_wrunlock(&siridb->series_mutex);
+        }
+        siridb_shard_decref(new_shard);
+        return siri_err;
+    }
+
+    sleep(1);
+
+    siri_rwlock_wrlock(&siridb->series_mutex);
+
+    /* make sure both shards files are closed */
+    siri_fp_close(new_shard->replacing->fp);
+    siri_fp_close(new_shard->fp);
+
+    /*
+     * Closing files or writing to the new shard might have produced
+     * critical errors. This seems to be a good point to check for errors.
+     */
+    if (siri_err || (new_shard->flags & SIRIDB_SHARD_IS_REMOVED))
+    {
+        if (new_shard->flags & SIRIDB_SHARD_IS_REMOVED)
+        {
+            log_warning(
+                    "Cancel optimizing shard '%s' because the shard is dropped",
+                    new_shard->fn);
+        }
+    }
+    else
+    {
+        /* a checkpoint without the temporary files is ignored at startup */
+        SHARD_checkpoint_remove(new_shard->fn);
+
+        /* remove the old shard file, this is not critical */
+        unlink(new_shard->replacing->fn);
+
+        /* rename the temporary files to the correct file names */
+        if (rename(new_shard->fn, new_shard->replacing->fn) ||
+            siri_optimize_finish_idx(
+                new_shard->replacing->fn,
+                new_shard->replacing->flags & SIRIDB_SHARD_HAS_INDEX))
+        {
+            log_critical(
+                    "Could not rename file '%s' to '%s'",
+                    new_shard->fn,
+                    new_shard->replacing->fn);
+            ERR_FILE
+        }
+        else
+        {
+            /* free the original allocated memory and set the new filename */
+            free(new_shard->fn);
+            new_shard->fn = new_shard->replacing->fn;
+            new_shard->replacing->fn = NULL;
+
+            /* cached chunks for the old shard are no longer valid */
+            siridb_ccache_drop_shard(siri.ccache, new_shard->replacing);
+
+            /* decrement reference to old shard and set
+             * new_shard->replacing to NULL
+             */
+            siridb_shard_decref(new_shard->replacing);
+            new_shard->replacing = NULL;
+        }
+    }
+
+    siri_rwlock_wrunlock(&siridb->series_mutex);
+
+    /* can raise an error only if the shard is dropped, in any other case we
+     * still have a reference left and an error cannot be raised.
+     */
+    siridb_shard_decref(new_shard);
+
+    sleep(1);
+
+    return siri_err;
+}
+
+/*
+ * This function can be used instead of the macro function when needed as
+ * callback.
+ *
+ * Decrement the reference counter, when 0 the shard will be destroyed.
+ *
+ * In case the shard will be destroyed and flag SIRIDB_SHARD_WILL_BE_REMOVED
+ * is set, the file will be removed.
+ *
+ * A signal can be raised in case closing the shard file fails.
+ */
+void siridb__shard_decref(siridb_shard_t * shard)
+{
+    if (!--shard->ref)
+    {
+        siridb__shard_free(shard);
+    }
+}
+
+/*
+ * Remember that series 'series_id' has chunks in the shard. Ids are never
+ * removed from the set so the set might contain series which are dropped
+ * or have no chunks in the shard anymore.
+ *
+ * Returns 0 if successful or -1 in case of an allocation error.
+ */
+int siridb_shard_add_series(siridb_shard_t * shard, uint32_t series_id)
+{
+    if (shard->series == NULL && (shard->series = iset_new()) == NULL)
+    {
+        return -1;
+    }
+    return (iset_add(shard->series, series_id) < 0) ? -1 : 0;
+}
+
+void siridb_shard_drop(siridb_shard_t * shard, siridb_t * siridb)
+{
+    siridb_shard_t * pop_shard;
+    shard_drop_t drop;
+    int optimizing = 0;
+
+    siri_rwlock_wrlock(&siridb->series_mutex);
+    siri_mutex_lock(&siridb->shards_mutex);
+
+    pop_shard = (siridb_shard_t *) imap_pop(siridb->shards, shard->id);
+    siridb->shards_gen++;
+
+    /*
+     * When optimizing, 'pop_shard' is always the new shard and 'shard'
+     * will be set to the old one.
+     */
+    if (pop_shard != NULL && (~pop_shard->flags & SIRIDB_SHARD_IS_REMOVED))
+    {
+        if (pop_shard->is_cold)
+        {
+            siridb->cold_shards--;
+        }
+        pop_shard->flags |= SIRIDB_SHARD_IS_REMOVED;
+        SHARD_remove(pop_shard);
+
+        if (shard != pop_shard)
+        {
+            optimizing = 1;
+        }
+        else if (shard->replacing != NULL)
+        {
+            optimizing = 1;
+            shard = shard->replacing;
+        }
+    }
+    else
+    {
+        log_warning("Shard id '%" PRIu64 "' is already dropped", shard->id);
+    }
+
+    siri_mutex_unlock(&siridb->shards_mutex);
+
+    /*
+     * We need the series mutex here since we depend on the series index.
+     * Only the series which have chunks in the shard are visited, and when
+     * optimizing we need to remove indexes for both the old and new shard.
+     */
+    drop.siridb = siridb;
+    drop.shard = shard;
+    drop.new_shard = optimizing ? pop_shard : NULL;
+
+    if (shard->series != NULL)
+    {
+        iset_walk(shard->series, (iset_cb) SHARD_drop_series, &drop);
+    }
+    if (optimizing && pop_shard->series != NULL)
+    {
+        iset_walk(pop_shard->series, (iset_cb) SHARD_drop_series, &drop);
+    }
+
+    if (pop_shard != NULL)
+    {
+        siridb_shard_decref(pop_shard);
+    }
+
+    siri_rwlock_wrunlock(&siridb->series_mutex);
+}
+
+/*
+ * Drop all number shards which end before 'num_ts' and all log shards which
+ * end before 'log_ts'. A value of 0 drops no shards of the type.
+ *
+ * Only the series which have chunks in one of the expired shards are
+ * visited, and each of them only once. The shards mutex is only locked while
+ * the shards are removed from the map.
+ *
+ * Returns the number of dropped shards or -1 in case of an error.
+ * (a SIGNAL is raised in case of an error)
+ */
+int siridb_shard_drop_expired(
+        siridb_t * siridb,
+        uint64_t num_ts,
+        uint64_t log_ts)
+{
+    siridb_shard_t * shard;
+    slist_t * slshards;
+    imap_t * expired;
+    iset_t * series;
+    uint64_t end_ts;
+    shard_drop_t drop;
+    int n = 0;
+
+    if (!num_ts && !log_ts)
+    {
+        return 0;
+    }
+
+    expired = imap_new();
+    series = iset_new();
+    if (expired == NULL || series == NULL)
+    {
+        ERR_ALLOC
+        if (expired != NULL)
+        {
+            imap_free(expired, NULL);
+        }
+        iset_free(series);
+        return -1;
+    }
+
+    siri_rwlock_wrlock(&siridb->series_mutex);
+    siri_mutex_lock(&siridb->shards_mutex);
+
+    slshards = imap_2slist(siridb->shards);
+
+    if (slshards != NULL)
+    {
+        for (size_t i = 0; i < slshards->len; i++)
+        {
+            shard = (siridb_shard_t *) slshards->data[i];
+
+            end_ts = (shard->tp == SIRIDB_SHARD_TP_NUMBER) ? num_ts : log_ts;
+
+            if (    (shard->flags & SIRIDB_SHARD_IS_REMOVED) ||
+                    SIRIDB_SHARD_START(shard) + shard->duration > end_ts)
+            {
+                continue;
+            }
+
+            /* the reference from the map is moved to 'expired' */
+            imap_pop(siridb->shards, shard->id);
+            siridb->shards_gen++;
+
+            if (shard->is_cold)
+            {
+                siridb->cold_shards--;
+            }
+            shard->flags |= SIRIDB_SHARD_IS_REMOVED;
+            SHARD_remove(shard);
+
+            if (imap_add(expired, shard->id, shard))
+            {
+                ERR_ALLOC
+                siridb_shard_decref(shard);
+                continue;
+            }
+            n++;
+
+            /* collect the series of both the new and old shard */
+            for (; shard != NULL; shard = shard->replacing)
+            {
+                if (shard->series != NULL && iset_walk(
+                        shard->series,
+                        (iset_cb) SHARD_collect_series,
+                        series) < 0)
+                {
+                    ERR_ALLOC
+                }
+            }
+        }
+        slist_free(slshards);
+    }
+    else
+    {
+        ERR_ALLOC
+        n = -1;
+    }
+
+    siri_mutex_unlock(&siridb->shards_mutex);
+
+    if (n > 0)
+    {
+        drop.siridb = siridb;
+        drop.expired = expired;
+        iset_walk(series, (iset_cb) SHARD_drop_expired_series, &drop);
+    }
+
+    iset_free(series);
+    imap_free(expired, (imap_free_cb) &siridb__shard_decref);
+
+    siri_rwlock_wrunlock(&siridb->series_mutex);
+
+    return n;
+}
+
+/*
+ * NEVER call this function but call siridb_shard_decref instead.
+ *
+ * Destroys a shard.
+ * When flag SIRIDB_SHARD_WILL_BE_REMOVED is set, the file will be removed.
+ *
+ * A signal can be raised in case closing the shard file fails.
+ */
+void siridb__shard_free(siridb_shard_t * shard)
+{
+    if (shard->replacing != NULL)
+    {
+        /* in case shard->replacing is set we also need to free this shard */
+        siridb_shard_decref(shard->replacing);
+    }
+
+    /* this will close the file, even when other references exist */
+    siri_fp_decref(shard->fp);
+
+    /* entries are identified by the shard so they must be removed */
+    siridb_ccache_drop_shard(siri.ccache, shard);
+
+    iset_free(shard->series);
+    free(shard->dropped);
+
+#ifdef DEBUG
+    log_debug("Free shard id: %" PRIu64, shard->id);
+#endif
+
+    siri_mem_sub(SIRI_MEM_SHARD, sizeof(siridb_shard_t));
+    free(shard->fn);
+    free(shard);
+}
+
+/*
+ * Returns 0 when successful or a negative value in case of an error.
+ */
+static int SHARD_remove(siridb_shard_t * shard)
+{
+    int rc = 0;
+
+    if (shard->replacing != NULL)
+    {
+        SHARD_checkpoint_remove(shard->fn);
+        rc = SHARD_remove(shard->replacing);
+    }
+    else if (shard->flags & SIRIDB_SHARD_HAS_INDEX)
+    {
+        /* We never have to delete the temporary (__) index file since this is
+         * the responsibility for the optimize task. This index file can never
+         * be in use by SiriDB. In case deletion has failed, nothing will
+         * happen because the file will not be read at startup.
+         */
+        siridb_shard_idx_file(buffer, shard->fn);
+
+        /* unlink the index file */
+        if (unlink(buffer))
+        {
+            /* not a real issue, only a warning since this is not expected */
+            log_warning("Removing index file failed: %s", buffer);
+        }
+        else
+        {
+            log_info("Index file removed: %s", buffer);
+        }
+    }
+
+    siri_fp_close(shard->fp);
+
+    rc += unlink(shard->fn);
+
+    if (rc == 0)
+    {
+        log_info("Shard file removed: %s", shard->fn);
+    }
+    else if (shard->fn != NULL)
+    {
+        log_critical(
+                "Removing shard file failed: %s (error code: %d)",
+                shard->fn,
+                rc);
+    }
+
+    return rc;
+}
+
+/*
+ * Remove the indexes for a dropped shard from series 'id'. (used with
+ * iset_walk)
+ */
+static int SHARD_drop_series(uint32_t id, shard_drop_t * drop)
+{
+    siridb_t * siridb = drop->siridb;
+    siridb_series_t * series = dmap_get(siridb->series_map, id);
+
+    if (    series == NULL ||
+            siridb_durations_mask(
+                    siridb,
+                    drop->shard->tp,
+                    drop->shard->id) != series->mask)
+    {
+        return 0;
+    }
+
+    /* the series might be dropped by the first call to remove shard */
+    siridb_series_incref(series);
+
+    siridb_series_remove_shard(siridb, series, drop->shard);
+    if (drop->new_shard != NULL)
+    {
+        siridb_series_remove_shard(siridb, series, drop->new_shard);
+    }
+
+    siridb_series_decref(series);
+
+    return 1;
+}
+
+/*
+ * Add series 'id' to the set. Returns -1 in case of an allocation error.
+ * (used with iset_walk)
+ */
+static int SHARD_collect_series(uint32_t id, iset_t * series)
+{
+    return (iset_add(series, id) < 0) ? -1 : 0;
+}
+
+/*
+ * Remove the indexes for all expired shards from series 'id'. (used with
+ * iset_walk)
+ */
+static int SHARD_drop_expired_series(uint32_t id, shard_drop_t * drop)
+{
+    siridb_series_t * series = dmap_get(drop->siridb->series_map, id);
+
+    if (series == NULL)
+    {
+        return 0;
+    }
+
+    siridb_series_incref(series);
+    siridb_series_remove_shards(drop->siridb, series, drop->expired);
+    siridb_series_decref(series);
+
+    return 1;
+}
+
+/*
+ * Continue the optimize of 'shard' from the last checkpoint when the optimize
+ * was interrupted by a restart. The new shard replaces the shard in the imap
+ * in the same way as a new shard which is created for optimizing.
+ *
+ * Returns the new shard with an extra reference for the caller, or NULL when
+ * there is nothing to continue. A checkpoint which cannot be used is removed
+ * so the optimize starts again. In case of an error the return value is
+ * NULL and a SIGNAL might be raised.
+ */
+static siridb_shard_t * SHARD_resume(
+        siridb_t * siridb,
+        siridb_shard_t * shard,
+        size_t * old_size)
+{
+    shard_checkpoint_t chk;
+    int rc;
+    siridb_shard_t * new_shard;
+
+    if (shard->tp != SIRIDB_SHARD_TP_NUMBER)
+    {
+        return NULL;
+    }
+
+    new_shard = (siridb_shard_t *) malloc(sizeof(siridb_shard_t));
+    if (new_shard == NULL)
+    {
+        ERR_ALLOC
+        return NULL;
+    }
+    if ((new_shard->fp = siri_fp_new()) == NULL)
+    {
+        free(new_shard);
+        return NULL;  /* signal is raised */
+    }
+    siri_mem_add(SIRI_MEM_SHARD, sizeof(siridb_shard_t));
+    new_shard->id = shard->id;
+    new_shard->duration = shard->duration;
+    new_shard->ref = 1;
+    new_shard->schema = SIRIDB_SHARD_SHEMA;
+    new_shard->tp = shard->tp;
+    new_shard->replacing = shard;
+    new_shard->size = HEADER_SIZE;
+    new_shard->dead_size = 0;
+    new_shard->is_cold = 0;
+    new_shard->nidx = 0;
+    new_shard->new_chunks = 0;
+    new_shard->overlaps = 0;
+    new_shard->new_size = 0;
+    new_shard->series = NULL;
+    new_shard->dropped = NULL;
+    new_shard->dropped_n = 0;
+    new_shard->dropped_sz = 0;
+    new_shard->verified = HEADER_SIZE;
+    new_shard->verified_idx = 0;
+    new_shard->flags = SIRIDB_SHARD_IS_LOADING;
+    new_shard->max_chunk_sz = shard->max_chunk_sz;
+    SHARD_TOUCH(new_shard);
+
+    if (SHARD_init_fn(siridb, new_shard) < 0)
+    {
+        ERR_ALLOC
+        /* the old shard is still owned by siridb->shards */
+        new_shard->replacing = NULL;
+        new_shard->fn = NULL;
+        siridb_shard_decref(new_shard);
+        return NULL;
+    }
+
+    rc = SHARD_checkpoint_read(new_shard, &chk);
+
+    if (rc == 0)
+    {
+        rc = SHARD_resume_load(siridb, new_shard, &chk);
+    }
+
+    if (rc)
+    {
+        if (rc < 0 && !siri_err)
+        {
+            log_warning(
+                    "Cannot continue optimizing shard id %" PRIu64 ", "
+                    "the optimize starts again",
+                    shard->id);
+            SHARD_checkpoint_remove(new_shard->fn);
+        }
+        new_shard->replacing = NULL;
+        siridb_shard_decref(new_shard);
+        return NULL;
+    }
+
+    /*
+     * This is not critical at this point and it's hard to imagine this
+     * fails if all the above was successful
+     */
+    siri_fopen(siri.fh, new_shard->fp, new_shard->fn, "r+");
+
+    *old_size = chk.old_size;
+    siridb_shard_incref(new_shard);
+
+    return new_shard;
+}
+
+/*
+ * Truncate the new shard and index file to the checkpoint, read the index
+ * and replace the shard in the imap. The series_mutex protects the series
+ * and the flags of the old shard while doing this.
+ *
+ * Returns 0 if successful, 1 when the shard is dropped or -1 when the files
+ * do not match the checkpoint. (a SIGNAL might be raised)
+ */
+static int SHARD_resume_load(
+        siridb_t * siridb,
+        siridb_shard_t * new_shard,
+        const shard_checkpoint_t * chk)
+{
+    siridb_shard_t * shard = new_shard->replacing;
+    siridb_shard_idx_file(idx_fn, new_shard->fn);
+    char header[HEADER_SIZE];
+    shard_resume_t resume;
+    shard_drop_t drop;
+    struct stat st;
+    FILE * fp;
+    int rc = -1;
+
+    if ((fp = fopen(new_shard->fn, "r+")) == NULL)
+    {
+        log_error("Cannot open shard file: '%s'", new_shard->fn);
+        return -1;
+    }
+
+    if (    fread(&header, HEADER_SIZE, 1, fp) != 1 ||
+            (uint8_t) header[HEADER_SCHEMA] != SIRIDB_SHARD_SHEMA ||
+            *((uint64_t *) (header + HEADER_ID)) != shard->id ||
+            (uint8_t) header[HEADER_TP] != shard->tp ||
+            (uint8_t) header[HEADER_TIME_PRECISION] !=
+                siridb->time->precision ||
+            chk->old_size > shard->size ||
+            chk->size < HEADER_SIZE ||
+            fstat(fileno(fp), &st) ||
+            st.st_size < (off_t) chk->size)
+    {
+        log_error("Shard file does not match checkpoint: '%s'", new_shard->fn);
+        fclose(fp);
+        return -1;
+    }
+
+    new_shard->flags |= (uint8_t) header[HEADER_FLAGS];
+    new_shard->max_chunk_sz = *((uint16_t *) (header + HEADER_MAX_CHUNK_SZ));
+
+    /* the index is only written to the index file before the first insert */
+    if (    ftruncate(fileno(fp), (off_t) chk->size) ||
+            ((new_shard->flags & SIRIDB_SHARD_HAS_INDEX) ? (
+                stat(idx_fn, &st) ||
+                st.st_size < chk->idx_size ||
+                truncate(idx_fn, chk->idx_size)) : chk->idx_size != 0))
+    {
+        log_error("Cannot truncate to checkpoint: '%s'", new_shard->fn);
+        fclose(fp);
+        return -1;
+    }
+
+    siri_rwlock_wrlock(&siridb->series_mutex);
+
+    if (shard->flags & SIRIDB_SHARD_IS_REMOVED)
+    {
+        rc = 1;
+    }
+    else if (SHARD_load_num(siridb, new_shard, fp, 1) == 0)
+    {
+        rc = (  new_shard->size == chk->size &&
+                (~new_shard->flags & SIRIDB_SHARD_HAS_NEW_VALUES) &&
+                ((~new_shard->flags & SIRIDB_SHARD_HAS_INDEX) ||
+                 siri_optimize_resume_idx(new_shard->fn) == 0)) ? 0 : -1;
+    }
+
+    if (rc == 0)
+    {
+        resume.siridb = siridb;
+        resume.shard = shard;
+        resume.size = chk->old_size;
+
+        /* these chunks are already written to the new shard */
+        if (new_shard->series != NULL)
+        {
+            iset_walk(
+                    new_shard->series,
+                    (iset_cb) SHARD_resume_series,
+                    &resume);
+        }
+
+        siri_mutex_lock(&siridb->shards_mutex);
+        if (imap_set(siridb->shards, shard->id, new_shard) == -1)
+        {
+            ERR_ALLOC
+        }
+        siridb->shards_gen++;
+        siri_mutex_unlock(&siridb->shards_mutex);
+    }
+    else if (new_shard->series != NULL)
+    {
+        /* remove the indexes which are read from the new shard */
+        drop.siridb = siridb;
+        drop.shard = new_shard;
+        drop.new_shard = NULL;
+        drop.expired = NULL;
+        iset_walk(new_shard->series, (iset_cb) SHARD_drop_series, &drop);
+    }
+
+    new_shard->flags &= ~SIRIDB_SHARD_IS_LOADING;
+
+    siri_rwlock_wrunlock(&siridb->series_mutex);
+
+    if (fclose(fp))
+    {
+        log_critical("Cannot close shard file: '%s'", new_shard->fn);
+    }
+
+    return siri_err ? -1 : rc;
+}
+
+/*
+ * Remove the chunks which are written to the new shard from series 'id'.
+ * (used with iset_walk)
+ */
+static int SHARD_resume_series(uint32_t id, shard_resume_t * resume)
+{
+    siridb_series_t * series = dmap_get(resume->siridb->series_map, id);
+
+    if (    series == NULL ||
+            siridb_durations_mask(
+                    resume->siridb,
+                    resume->shard->tp,
+                    resume->shard->id) != series->mask)
+    {
+        return 0;
+    }
+
+    siridb_series_remove_replaced(
+            resume->siridb,
+            series,
+            resume->shard,
+            resume->size);
+
+    return 1;
+}
+
+/*
+ * Save the progress of a full optimize. The data of the new shard and the
+ * index file are synced to disk first, otherwise the checkpoint might point
+ * to data which is lost.
+ *
+ * Returns 0 if successful or -1 in case of an error.
+ */
+static int SHARD_checkpoint_write(siridb_shard_t * new_shard, size_t old_size)
+{
+    SHARD_checkpoint_file(fn, new_shard->fn);
+    FILE * idx_fp = siri_optimize_idx_fp();
+    FILE * fp = new_shard->fp->fp;
+    qp_fpacker_t * fpacker;
+    off_t idx_size = 0;
+
+    if (    (fp != NULL && (fflush(fp) || fsync(fileno(fp)))) ||
+            ((new_shard->flags & SIRIDB_SHARD_HAS_INDEX) && (
+                idx_fp == NULL ||
+                fflush(idx_fp) ||
+                fsync(fileno(idx_fp)) ||
+                (idx_size = ftello(idx_fp)) < 0)))
+    {
+        log_warning("Cannot write optimize checkpoint: '%s'", fn);
+        return -1;
+    }
+
+    log_debug("Write optimize checkpoint: '%s'", fn);
+
+    return (
+        (fpacker = qp_open(fn, "w")) == NULL ||
+
+        /* open a new array */
+        qp_fadd_type(fpacker, QP_ARRAY_OPEN) ||
+
+        /* write the current schema */
+        qp_fadd_int16(fpacker, SHARD_CHECKPOINT_SCHEMA) ||
+
+        qp_fadd_int64(fpacker, (int64_t) old_size) ||
+        qp_fadd_int64(fpacker, (int64_t) new_shard->size) ||
+        qp_fadd_int64(fpacker, (int64_t) idx_size) ||
+
+        /* close file pointer */
+        qp_close(fpacker)) ? -1 : 0;
+}
+
+/*
+ * Read the checkpoint for a new shard.
+ *
+ * Returns 0 if successful, 1 when there is no checkpoint or -1 when the
+ * checkpoint cannot be read.
+ */
+static int SHARD_checkpoint_read(
+        siridb_shard_t * new_shard,
+        shard_checkpoint_t * chk)
+{
+    SHARD_checkpoint_file(fn, new_shard->fn);
+    qp_unpacker_t * unpacker;
+    qp_obj_t qp_old_size, qp_size, qp_idx_size;
+    int rc;
+
+    if (!xpath_file_exist(fn))
+    {
+        return 1;
+    }
+
+    if ((unpacker = siridb_misc_open_schema_file(
+            SHARD_CHECKPOINT_SCHEMA,
+            fn)) == NULL)
+    {
+        log_error("Cannot read optimize checkpoint: '%s'", fn);
+        return -1;
+    }
+
+    rc = (  qp_next(unpacker, &qp_old_size) == QP_INT64 &&
+            qp_old_size.via.int64 >= 0 &&
+            qp_next(unpacker, &qp_size) == QP_INT64 &&
+            qp_size.via.int64 >= 0 &&
+            qp_next(unpacker, &qp_idx_size) == QP_INT64 &&
+            qp_idx_size.via.int64 >= 0) ? 0 : -1;
+
+    if (rc == 0)
+    {
+        chk->old_size = (size_t) qp_old_size.via.int64;
+        chk->size = (size_t) qp_size.via.int64;
+        chk->idx_size = (off_t) qp_idx_size.via.int64;
+    }
+    else
+    {
+        log_error("Invalid optimize checkpoint: '%s'", fn);
+    }
+
+    qp_unpacker_ff_free(unpacker);
+
+    return rc;
+}
+
+/*
+ * Remove the checkpoint for a temporary (__) shard file name, if any.
+ */
+static void SHARD_checkpoint_remove(const char * shard_fn)
+{
+    SHARD_checkpoint_file(fn, shard_fn);
+
+    if (xpath_file_exist(fn) && unlink(fn))
+    {
+        log_warning("Cannot remove optimize checkpoint: '%s'", fn);
+    }
+}
+
+/*
+ * Truncates a shard file to its current size.
+ *
+ * Returns 0 when successful or -1 in case of an error.
+ */
+static int SHARD_truncate(siridb_shard_t * shard)
+{
+    if (siri_fh_open(siri.fh, shard->fp, shard->fn, "r+"))
+    {
+        log_critical(
+                "Cannot open file '%s', skip reading points",
+                shard->fn);
+        return -1;
+    }
+
+    int buffer_fd = fileno(shard->fp->fp);
+
+    if (buffer_fd == -1)
+    {
+        log_critical("Cannot get file descriptor for '%s'", shard->fn);
+        return -1;
+    }
+
+    if (ftruncate(buffer_fd, shard->size))
+    {
+        log_critical("Cannot truncate shard file: '%s'", shard->fn);
+        return -1;
+    }
+
+    /* truncating also releases the preallocated space */
+    shard->fp->alloc_sz = 0;
+
+    log_warning("Truncated shard file '%s' to %zu bytes",
+            shard->fn, shard->size);
+
+    return fsync(buffer_fd);
+}
+
+/*
+ * This function applies the index on the appropriate series. In case the
+ * series is not found, a log line will be displayed if this is the first
+ * one in the shard which is not found. The next series which cannot be found
+ * is simply ignored. In case the series id is not possible (invalid id),
+ * then an log error is displayed and the return value will be -1.
+ *
+ * When successful the return value is the size in bytes of the points
+ * in the chunk.
+ *
+ * This function must be called while holding the series_mutex.
+ */
+static int SHARD_apply_idx_num(
+        siridb_t * siridb,
+        siridb_shard_t * shard,
+        char * pt,
+        size_t pos,
+        int is_num64)
+{
+    uint16_t len, chunk_sz;
+    uint32_t series_id;
+    uint64_t start_ts, end_ts;
+    siridb_series_t * series;
+    siridb_points_stats_t stats;
+    int is_compressed = shard->flags & SIRIDB_SHARD_IS_COMPRESSED;
+
+    series_id = *((uint32_t *) pt);
+    len = *((uint16_t *) (pt + (is_num64 ? 20 : 12)));  // LEN POS IN INDEX
+    chunk_sz = SHARD_HAS_CHUNK_SZ(shard) ?
+            *((uint16_t *) (pt + (is_num64 ? 22 : 14))) :  // CHUNK_SZ POS
+            len * (is_num64 ? 16 : 12);
+
+    if (is_compressed)
+    {
+        // MIN, MAX AND SUM POS
+        memcpy(&stats, pt + (is_num64 ? 24 : 16), sizeof(stats));
+    }
+
+    if (!series_id)
+    {
+        /* series id 0 is used to mark a chunk as dead */
+        shard->dead_size += chunk_sz;
+        return (int) chunk_sz;
+    }
+
+    series = dmap_get(siridb->series_map, series_id);
+
+    if (series == NULL)
+    {
+        if (series_id > siridb->max_series_id)
+        {
+            log_error(
+                    "Unexpected Series ID %" PRIu32
+                    " is found in shard %" PRIu64 " (%s) at "
+                    "position %ld. This indicates that this shard is "
+                    "probably corrupt. The next optimize cycle will most "
+                    "likely fix this shard but you might loose some data.",
+                    series_id,
+                    shard->id,
+                    shard->fn,
+                    pos);
+            shard->flags |= SIRIDB_SHARD_IS_CORRUPT;
+            return -1;
+        }
+
+        /* this shard has remove series, make sure the flag is set */
+        if (!(shard->flags & SIRIDB_SHARD_HAS_DROPPED_SERIES))
+        {
+            log_debug(
+                    "At least Series ID %" PRIu32
+                    " is found in shard %" PRIu64 " (%s) but "
+                    "does not exist anymore. We will remove the series on "
+                    "the next optimize cycle.",
+                    series_id,
+                    shard->id,
+                    shard->fn);
+            shard->flags |= SIRIDB_SHARD_HAS_DROPPED_SERIES;
+        }
+    }
+    else
+    {
+        start_ts = is_num64 ? // START_TS IN HEADER
+                (uint64_t) *((uint64_t *) (pt + 4)) :
+                (uint64_t) *((uint32_t *) (pt + 4));
+        end_ts = is_num64 ? // END_TS IN HEADER
+                (uint64_t) *((uint64_t *) (pt + 12)) :
+                (uint64_t) *((uint32_t *) (pt + 8));
+
+        if (siridb_series_add_idx(
+                series,
+                shard,
+                start_ts,
+                end_ts,
+                (uint32_t) pos,
+                len,
+                chunk_sz,
+                is_compressed ? &stats : NULL) == 0)
+        {
+            /* update the series length property */
+            series->length += len;
+
+            /*
+             * Series properties are set after all shards are loaded but
+             * a cold shard is loaded later so we update them here.
+             */
+            if (shard->is_cold)
+            {
+                if (start_ts < series->start)
+                {
+                    series->start = start_ts;
+                }
+                if (end_ts > series->end)
+                {
+                    series->end = end_ts;
+                }
+            }
+        }
+        else
+        {
+            /* signal is raised */
+            log_critical("Cannot load index for Series ID %u", series->id);
+        }
+    }
+
+    return (int) chunk_sz;
+}
+
+/*
+ * Check the chunk headers in 'fp', from the current position up to the end
+ * of the file, and replace the series ids when 'write' is set. Argument
+ * 'has_chunks' must be set when each header is followed by the chunk, like
+ * in a shard file, or 0 for an index file. The chunk sizes are added to
+ * 'data_sz'.
+ *
+ * Returns 0 if successful or -1 and 'err_msg' is set in case of an error.
+ */
+static int SHARD_attach_file(
+        siridb_t * siridb,
+        siridb_shard_t * shard,
+        FILE * fp,
+        int has_chunks,
+        imap_t * ids,
+        int write,
+        size_t * data_sz,
+        char * err_msg)
+{
+    int is_num64 = siridb->time->precision > SIRIDB_TIME_SECONDS;
+    const unsigned int idx_sz = SHARD_IDX_SZ(shard, is_num64);
+    uint64_t duration = shard->duration;
+    uint64_t shard_start = SIRIDB_SHARD_START(shard);
+    uint64_t start_ts, end_ts;
+    siridb_attach_series_t * aseries;
+    char idx[idx_sz];
+    uint32_t series_id;
+    uint16_t len, chunk_sz;
+    struct stat st;
+    size_t size = 0;
+    off_t pos;
+
+    if (fstat(fileno(fp), &st))
+    {
+        sprintf(err_msg, "Cannot read the size of shard %" PRIu64, shard->id);
+        return -1;
+    }
+
+    while ( (pos = ftello(fp)) >= 0 &&
+            (size = fread(&idx, 1, idx_sz, fp)) == idx_sz)
+    {
+        series_id = *((uint32_t *) idx);
+        len = *((uint16_t *) (idx + (is_num64 ? 20 : 12)));  // LEN POS
+        chunk_sz = SHARD_HAS_CHUNK_SZ(shard) ?
+                *((uint16_t *) (idx + (is_num64 ? 22 : 14))) :  // CHUNK_SZ
+                len * (is_num64 ? 16 : 12);
+        start_ts = is_num64 ?
+                (uint64_t) *((uint64_t *) (idx + 4)) :
+                (uint64_t) *((uint32_t *) (idx + 4));
+        end_ts = is_num64 ?
+                (uint64_t) *((uint64_t *) (idx + 12)) :
+                (uint64_t) *((uint32_t *) (idx + 8));
+
+        /* series id 0 is used to mark a chunk as dead */
+        if (series_id)
+        {
+            aseries = (siridb_attach_series_t *) imap_get(ids, series_id);
+
+            if (    aseries == NULL ||
+                    aseries->mask != siridb_durations_mask(
+                        siridb,
+                        shard->tp,
+                        shard->id) ||
+                    (aseries->tp == TP_STRING) !=
+                        (shard->tp == SIRIDB_SHARD_TP_LOG) ||
+                    !len ||
+                    start_ts > end_ts ||
+                    start_ts < shard_start ||
+                    end_ts >= shard_start + duration)
+            {
+                snprintf(err_msg, SIRIDB_MAX_SIZE_ERR_MSG,
+                        "Shard %" PRIu64 " has an invalid chunk header for "
+                        "series id %" PRIu32 " at position %lld",
+                        shard->id,
+                        series_id,
+                        (long long int) pos);
+                return -1;
+            }
+
+            if (write && (
+                    fseeko(fp, pos, SEEK_SET) ||
+                    fwrite(&aseries->id, sizeof(uint32_t), 1, fp) != 1 ||
+                    fseeko(fp, pos + idx_sz, SEEK_SET)))
+            {
+                sprintf(err_msg,
+                        "Cannot write to the files of shard %" PRIu64,
+                        shard->id);
+                return -1;
+            }
+        }
+
+        *data_sz += chunk_sz;
+
+        if (has_chunks && (
+                pos + idx_sz + chunk_sz > st.st_size ||
+                fseeko(fp, chunk_sz, SEEK_CUR)))
+        {
+            sprintf(err_msg,
+                    "Shard %" PRIu64 " has a truncated chunk at position "
+                    "%lld",
+                    shard->id,
+                    (long long int) pos);
+            return -1;
+        }
+    }
+
+    if (pos < 0 || size)
+    {
+        sprintf(err_msg,
+                "Shard %" PRIu64 " has more bytes than expected",
+                shard->id);
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Read an index file for a shard in case the shard has flag
+ * SIRIDB_SHARD_HAS_INDEX set. Returns 0 in case the index was read successful
+ * and if the flag was not set. Returns a negative value in case of an error.
+ *
+ * Member shard->size will be updated according the index.
+ */
+static int SHARD_get_idx_num(
+        siridb_t * siridb,
+        siridb_shard_t * shard,
+        int is_num64,
+        int has_lock)
+{
+    const int idx_sz = SHARD_IDX_SZ(shard, is_num64);
+
+    size_t i, n;
+    char * data, * pt;
+    int chunk_sz;
+    FILE * fp;
+
+    if (~shard->flags & SIRIDB_SHARD_HAS_INDEX)
+    {
+        return 0;
+    }
+
+    n = SIRIDB_SHARD_MAX_CHUNK_SZ / idx_sz;
+    data = (char *) malloc(n * idx_sz);
+
+    if (data == NULL)
+    {
+        log_critical("Memory allocation error");
+        free(data);
+        return -1;
+    }
+
+    /* get the index file name */
+    siridb_shard_idx_file(fn, shard->fn);
+
+    fp = fopen(fn, "r");
+    if (fp == NULL)
+    {
+        log_critical("Cannot open index file for reading: '%s'", fn);
+        free(data);
+        return -1;
+    }
+
+    while ((n = fread(data, idx_sz, n, fp)))
+    {
+        pt = data;
+
+        /* shards might be loaded in parallel, lock once for each block */
+        if (!has_lock)
+        {
+            siri_rwlock_wrlock(&siridb->series_mutex);
+        }
+
+        for (i = 0; i < n; i++, pt += idx_sz)
+        {
+            chunk_sz = SHARD_apply_idx_num(
+                    siridb,
+                    shard,
+                    pt,
+                    shard->size,
+                    is_num64);
+
+            if (chunk_sz < 0)
+            {
+                if (!has_lock)
+                {
+                    siri_rwlock_wrunlock(&siridb->series_mutex);
+                }
+                log_critical("Error while reading index file: '%s'", fn);
+                fclose(fp);
+                free(data);
+                return -1;
+            }
+
+            shard->size += chunk_sz;
+        }
+
+        if (!has_lock)
+        {
+            siri_rwlock_wrunlock(&siridb->series_mutex);
+        }
+    }
+
+    fclose(fp);
+    free(data);
+
+    return 0;
+}
+
+/*
+ * Returns 0 if successful or -1 in case of an error.
+ *
+ * A SIGNAL might be raised in case of memory errors. We mark the shard as
+ * corrupt in case of disk errors and try to recover on the next optimize
+ * cycle.
+ */
+static int SHARD_load_idx_num(
+        siridb_t * siridb,
+        siridb_shard_t * shard,
+        FILE * fp,
+        int is_num64,
+        int has_lock)
+{
+    const unsigned int idx_sz = SHARD_IDX_SZ(shard, is_num64);
+
+    char idx[idx_sz];
+    int chunk_sz, rc;
+    size_t size, pos;
+
+    while ((size = fread(&idx, 1, idx_sz, fp)) == idx_sz)
+    {
+        pos = shard->size + idx_sz;
+
+        if (!has_lock)
+        {
+            siri_rwlock_wrlock(&siridb->series_mutex);
+        }
+        chunk_sz = SHARD_apply_idx_num(siridb, shard, idx, pos, is_num64);
+        if (!has_lock)
+        {
+            siri_rwlock_wrunlock(&siridb->series_mutex);
+        }
+
+        if (chunk_sz < 0)
+        {
+            return -1;
+        }
+
+        rc = fseeko(fp, chunk_sz, SEEK_CUR);
+        if (rc != 0)
+        {
+            log_error(
+                "Seek error in shard %" PRIu64 " (%s) at position %ld. "
+                "Mark this shard as corrupt. The next optimize cycle will "
+                "most likely fix this shard but you might loose some data.",
+                shard->id,
+                shard->fn,
+                pos);
+            shard->flags |= SIRIDB_SHARD_IS_CORRUPT;
+            return -1;
+        }
+
+        shard->size = pos + chunk_sz;
+    }
+
+    if (size)
+    {
+        log_error(
+            "Shard %" PRIu64 " (%s) has %zu more bytes than expected. "
+            "Mark this shard as corrupt. The next optimize cycle will "
+            "most likely fix this shard but you might loose some data.",
+            shard->id,
+            shard->fn,
+            size);
+        shard->flags |= SIRIDB_SHARD_IS_CORRUPT;
+        return -1;
+    }
+
+    return siri_err;
+}
+
+/*
+ * Set shard->fn to the correct file name.
+ *
+ * Returns the length of 'fn' or a negative value in case of an error.
+ */
+static inline int SHARD_init_fn(siridb_t * siridb, siridb_shard_t * shard)
+{
+     return asprintf(
+             &shard->fn,
+             "%s%s%s%" PRIu64 "%s",
+             siridb->dbpath,
+             SIRIDB_SHARDS_PATH,
+             (shard->replacing == NULL) ? "" : "__",
+             shard->id,
+             ".sdb");
+}
+
+/*
+ * Write a header for a chunk of points. The header can be written to argument
+ * fp which should be a pointer to the index, or the shard file.
+ *
+ * In case of an error the function return EOF, otherwise the size which is
+ * written.
+ */
+static int SHARD_write_header(
+        siridb_t * siridb,
+        siridb_series_t * series,
+        siridb_points_t * points,
+        uint_fast32_t start,
+        uint_fast32_t end,
+        const uint16_t * chunk_sz,
+        const siridb_points_stats_t * stats,
+        const uint32_t * crc,
+        FILE * fp)
+{
+    uint16_t len = end - start;
+    int size = EOF;
+
+    if (fseeko(fp, 0, SEEK_END) ||
+        fwrite(&series->id, sizeof(uint32_t), 1, fp) != 1)
+    {
+        return EOF;
+    }
+
+    switch (siridb->time->ts_sz)
+    {
+    case sizeof(uint32_t):
+        {
+            uint32_t start_ts = (uint32_t) points->data[start].ts;
+            uint32_t end_ts = (uint32_t) points->data[end - 1].ts;
+            if (fwrite(&start_ts, sizeof(uint32_t), 1, fp) != 1 ||
+                fwrite(&end_ts, sizeof(uint32_t), 1, fp) != 1)
+            {
+                return EOF;
+            }
         }
-        return -1;
-    }
+        size = IDX_NUM32_SZ;
+        break;
 
-    /* set pointer to start */
-    pt = temp;
+    case sizeof(uint64_t):
+        if (fwrite(&points->data[start].ts, sizeof(uint64_t), 1, fp) != 1 ||
+            fwrite(&points->data[end - 1].ts, sizeof(uint64_t), 1, fp) != 1)
+        {
+            return EOF;
+        }
+        size = IDX_NUM64_SZ;
+        break;
 
-    /* crop from start if needed */
-    if (start_ts != NULL)
-    {
-        for (; *pt < *start_ts; pt += 3, len--);
+    default:
+        assert (0);
+        break;
     }
 
-    /* crop from end if needed */
-    if (end_ts != NULL)
+    if (fwrite(&len, sizeof(uint16_t), 1, fp) != 1)
     {
-        for (   uint32_t * p = temp + 3 * (idx->len - 1);
-                *p >= *end_ts;
-                p -= 3, len--);
+        return EOF;
     }
 
-    if (    has_overlap &&
-            points->len &&
-            (idx->shard->flags & SIRIDB_SHARD_HAS_OVERLAP))
+    if (chunk_sz != NULL)
     {
-        for (uint64_t ts; points->len < len; pt += 3)
+        /* log and compressed chunks have the chunk size at the end of the
+         * header, for compressed chunks followed by the statistics */
+        if (fwrite(chunk_sz, sizeof(uint16_t), 1, fp) != 1 || (
+                stats != NULL &&
+                fwrite(stats, sizeof(siridb_points_stats_t), 1, fp) != 1))
+        {
+            return EOF;
+        }
+        size += sizeof(uint16_t);
+        if (stats != NULL)
         {
-            ts = (uint64_t) *pt;
-            siridb_points_add_point(points, &ts, ((qp_via_t *) (pt + 1)));
+            size += sizeof(siridb_points_stats_t);
         }
     }
-    else
+
+    /* the checksum is always at the end of the header */
+    if (crc != NULL)
     {
-        for (; points->len < len; points->len++, pt += 3)
+        if (fwrite(crc, sizeof(uint32_t), 1, fp) != 1)
         {
-            points->data[points->len].ts = (uint64_t) *pt;
-            points->data[points->len].val = *((qp_via_t *) (pt + 1));
+            return EOF;
         }
+        size += sizeof(uint32_t);
     }
 
-    return 0;
+    return size;
 }
 
 /*
- * COPY from siridb_shard_get_points_num32
+ * Read and decode a compressed chunk. This function is used by both
+ * siridb_shard_get_points_cnum32() and siridb_shard_get_points_cnum64().
+ *
+ * Returns 0 if successful or -1 in case of an error.
  */
-int siridb_shard_get_points_num64(
+static int SHARD_get_points_compressed(
         siridb_points_t * points,
         idx_t * idx,
         uint64_t * start_ts,
         uint64_t * end_ts,
-        uint8_t has_overlap)
+        uint8_t has_overlap,
+        size_t ts_sz)
 {
-    size_t len = points->len + idx->len;
     /*
-     * Index length is limited to max_chunk_points so we are able to store
-     * one chunk in stack memory.
+     * The chunk size is limited to an uint16_t so we are able to use stack
+     * memory. Points are decoded straight into the destination.
      */
-    uint64_t temp[idx->len * 2];  // CHANGED
-    uint64_t * pt;                // CHANGED
+    unsigned char cdata[idx->chunk_sz];
+    siridb_point_t * dest = SHARD_points_dest(points, idx, has_overlap);
+    const char * data;
+    uint64_t ns;
+    int rc;
 
-    if (idx->shard->fp->fp == NULL)
+    if (dest == NULL)
     {
-        if (siri_fopen(siri.fh, idx->shard->fp, idx->shard->fn, "r+"))
-        {
-            log_critical(
-                    "Cannot open file '%s', skip reading points",
-                    idx->shard->fn);
-            return -1;
-        }
+        return -1;  /* signal is raised */
     }
 
-    if (fseeko(idx->shard->fp->fp, idx->pos, SEEK_SET) ||
-        fread(
-            temp,
-            16,  // NUM64 point size   CHANGED
-            idx->len,
-            idx->shard->fp->fp) != idx->len)
+    if (siridb_ccache_get(siri.ccache, idx->shard, idx->pos, dest, idx->len))
     {
-        if (idx->shard->flags & SIRIDB_SHARD_IS_CORRUPT)
-        {
-            log_error("Cannot read from shard id %" PRIu64, idx->shard->id);
-        }
-        else
+        /* when the shard is mapped, we decode straight from the mapping */
+        data = SHARD_read_chunk(idx, idx->chunk_sz, cdata);
+
+        if (data == NULL)
         {
-            log_critical(
-                    "Cannot read from shard id %" PRIu64
-                    ". The next optimize cycle "
-                    "will fix this shard but you might loose some data.",
-                    idx->shard->id);
-            idx->shard->flags |= SIRIDB_SHARD_IS_CORRUPT;
+            SHARD_points_done(points, dest, 0, NULL, NULL);
+            return -1;
         }
-        return -1;
-    }
-
-    /* set pointer to start */
-    pt = temp;
-
-    /* crop from start if needed */
-    if (start_ts != NULL)
-    {
-        for (; *pt < *start_ts; pt += 2, len--);
-    }
-
-    /* crop from end if needed */
-    if (end_ts != NULL)
-    {
-        for (   uint64_t * p = temp + 2 * (idx->len - 1);  // CHANGED
-                *p >= *end_ts;
-                p -= 2, len--);    // CHANGED
-    }
 
-    if (    has_overlap &&
-            points->len &&
-            (idx->shard->flags & SIRIDB_SHARD_HAS_OVERLAP))
-    {
-        for (; points->len < len; pt += 2)   // CHANGED
+        ns = (siridb_shard_stats == NULL) ? 0 : timeit_ns();
+
+        rc = SHARD_HAS_ENCODING(idx->shard) ?
+                siridb_compress_chunk_decode(
+                        dest,
+                        (const unsigned char *) data,
+                        idx->chunk_sz,
+                        idx->len,
+                        ts_sz) :
+                siridb_compress_num_decode(
+                        dest,
+                        (const unsigned char *) data,
+                        idx->chunk_sz,
+                        idx->len,
+                        ts_sz);
+
+        if (rc)
         {
-            // CHANGED
-            siridb_points_add_point(points, pt, ((qp_via_t *) (pt + 1)));
+            SHARD_points_done(points, dest, 0, NULL, NULL);
+            SHARD_read_error(idx->shard);
+            return -1;
         }
-    }
-    else
-    {
-        for (; points->len < len; points->len++, pt += 2)  // CHANGED
+
+        if (siridb_shard_stats != NULL)
         {
-            points->data[points->len].ts = *pt;  //CHANGED
-            points->data[points->len].val = *((qp_via_t *) (pt + 1));
+            siridb_shard_stats->decode += timeit_ns() - ns;
         }
-    }
 
-    return 0;
-}
+        siridb_ccache_set(siri.ccache, idx->shard, idx->pos, dest, idx->len);
+    }
 
-/*
- * COPY from siridb_shard_get_points_num32
- */
-int siridb_shard_get_points_log32(
-        siridb_points_t * points __attribute__((unused)),
-        idx_t * idx __attribute__((unused)),
-        uint64_t * start_ts __attribute__((unused)),
-        uint64_t * end_ts __attribute__((unused)),
-        uint8_t has_overlap __attribute__((unused)))
-{
-    return -1;  /* dummy function */
-}
+    SHARD_points_done(points, dest, idx->len, start_ts, end_ts);
 
-/*
- * COPY from siridb_shard_get_points_num32
- */
-int siridb_shard_get_points_log64(
-        siridb_points_t * points __attribute__((unused)),
-        idx_t * idx __attribute__((unused)),
-        uint64_t * start_ts __attribute__((unused)),
-        uint64_t * end_ts __attribute__((unused)),
-        uint8_t has_overlap __attribute__((unused)))
-{
-    return -1;  /* dummy function */
+    return 0;
 }
 
 /*
- * This function will be called from the 'optimize' thread.
+ * Read and decode a log chunk. This function is used by both
+ * siridb_shard_get_points_log32() and siridb_shard_get_points_log64().
  *
- * Returns 0 if successful or -1 and a SIGNAL is raised in case of an error.
+ * Log chunks are not kept in the chunk cache since the cache holds no
+ * string content.
+ *
+ * Returns 0 if successful or -1 in case of an error.
  */
-int siridb_shard_optimize(siridb_shard_t * shard, siridb_t * siridb)
+static int SHARD_get_points_log(
+        siridb_points_t * points,
+        idx_t * idx,
+        uint64_t * start_ts,
+        uint64_t * end_ts,
+        uint8_t has_overlap,
+        size_t ts_sz)
 {
-    int rc = 0;
-    siridb_shard_t * new_shard = NULL;
-    uint64_t duration = (shard->tp == SIRIDB_SHARD_TP_NUMBER) ?
-            siridb->duration_num : siridb->duration_log;
-    siridb_series_t * series;
-
-    uv_mutex_lock(&siridb->shards_mutex);
-
-    /* In case the shard is not removed, it must be the shard inside the imap
-     * because we check and replace the shard within the shards_mutex lock.
-     * If the shard is marked as removed we can simply skip the optimize.
-     */
-    if (~shard->flags & SIRIDB_SHARD_IS_REMOVED)
-    {
-        if ((new_shard = siridb_shard_create(
-            siridb,
-            shard->id,
-            duration,
-            shard->tp,
-            shard)) == NULL)
-        {
-            /* signal is raised */
-            log_critical(
-                    "Cannot create shard id '%" PRIu64 "' for optimizing.",
-                    shard->id);
-            rc = -1;
-        }
-        else
-        {
-            siridb_shard_incref(new_shard);
-        }
-    }
-    else
-    {
-        log_warning(
-                "Skip optimizing shard id '%" PRIu64 "' "
-                "because the shard is probably dropped.",
-                shard->id);
-    }
-
-    uv_mutex_unlock(&siridb->shards_mutex);
+    /* the chunk size is limited to an uint16_t like compressed chunks */
+    unsigned char cdata[idx->chunk_sz];
+    siridb_point_t * dest = SHARD_points_dest(points, idx, has_overlap);
+    const char * data;
+    uint64_t ns;
 
-    if (new_shard == NULL)
+    if (dest == NULL)
     {
-        /*
-         * Creating the new shard has failed or the shard is dropped.
-         * We exit here so the mutex is is unlocked.
-         * (a signal might have been raised)
-         */
-        return rc;
+        return -1;  /* signal is raised */
     }
 
-    /* at this point the references should be as following (unless dropped):
-     *  shard->ref (=>2)
-     *      - simple list
-     *      - new_shard->replacing
-     *  new_shard->ref (=>2)
-     *      - siridb->shards
-     *      - this method
-     */
-
-    sleep(1);
-
-    uv_mutex_lock(&siridb->series_mutex);
-
-    slist_t * slist = imap_2slist_ref(siridb->series_map);
+    data = SHARD_read_chunk(idx, idx->chunk_sz, cdata);
 
-    uv_mutex_unlock(&siridb->series_mutex);
+    SHARD_TOUCH(idx->shard);
 
-    if (slist == NULL)
+    if (data == NULL)
     {
-        ERR_ALLOC
+        SHARD_points_done(points, dest, 0, NULL, NULL);
         return -1;
     }
 
-    sleep(1);
-
-    for (size_t i = 0; i < slist->len; i++)
-    {
-        /* its possible that another database is paused, but we wait anyway */
-        if (siri.optimize->pause)
-        {
-            siri_optimize_wait();
-        }
-
-        series = slist->data[i];
-
-        if (    !siri_err &&
-                siri.optimize->status != SIRI_OPTIMIZE_CANCELLED &&
-                shard->id % siridb->duration_num == series->mask &&
-                (~series->flags & SIRIDB_SERIES_IS_DROPPED) &&
-                (~new_shard->flags & SIRIDB_SHARD_IS_REMOVED))
-        {
-            uv_mutex_lock(&siridb->series_mutex);
-
-            if (    (~new_shard->flags & SIRIDB_SHARD_IS_REMOVED) &&
-                    siridb_series_optimize_shard(
-                        siridb,
-                        series,
-                        new_shard))
-            {
-                log_critical(
-                        "Optimizing shard '%s' has failed due to a critical "
-                        "error", shard->fn);
-            }
-
-            uv_mutex_unlock(&siridb->series_mutex);
-
-            /* make this sleep depending on the active_tasks
-             * (50ms per active task) */
-            usleep( 50000 * siridb->active_tasks + 100 );
-        }
-
-        siridb_series_decref(series);
-    }
-
-    slist_free(slist);
-
-    if (new_shard->flags & SIRIDB_SHARD_IS_REMOVED)
-    {
-        log_warning(
-                "Cancel optimizing shard '%s' because the shard is dropped",
-                new_shard->fn);
-        siridb_shard_decref(new_shard);
-        return siri_err;
-    }
+    ns = (siridb_shard_stats == NULL) ? 0 : timeit_ns();
 
-    if (siri_err || siri.optimize->status == SIRI_OPTIMIZE_CANCELLED)
+    if (siridb_compress_log_decode(
+            points,
+            dest,
+            (const unsigned char *) data,
+            idx->chunk_sz,
+            idx->len,
+            ts_sz))
     {
-        /*
-         * Error occurred or the optimize task is cancelled. By decrementing
-         * only the reference counter for the new_shard we keep this shard as
-         * if it is still optimizing so remaining points can still be written.
-         */
-        siridb_shard_decref(new_shard);
-        return siri_err;
+        SHARD_points_done(points, dest, 0, NULL, NULL);
+        SHARD_read_error(idx->shard);
+        return -1;
     }
 
-    sleep(1);
-
-    uv_mutex_lock(&siridb->series_mutex);
-
-    /* make sure both shards files are closed */
-    siri_fp_close(new_shard->replacing->fp);
-    siri_fp_close(new_shard->fp);
-
-    /*
-     * Closing files or writing to the new shard might have produced
-     * critical errors. This seems to be a good point to check for errors.
-     */
-    if (siri_err || (new_shard->flags & SIRIDB_SHARD_IS_REMOVED))
-    {
-        if (new_shard->flags & SIRIDB_SHARD_IS_REMOVED)
-        {
-            log_warning(
-                    "Cancel optimizing shard '%s' because the shard is dropped",
-                    new_shard->fn);
-        }
-    }
-    else
+    if (siridb_shard_stats != NULL)
     {
-        /* remove the old shard file, this is not critical */
-        unlink(new_shard->replacing->fn);
-
-        /* rename the temporary files to the correct file names */
-        if (rename(new_shard->fn, new_shard->replacing->fn) ||
-            siri_optimize_finish_idx(
-                new_shard->replacing->fn,
-                new_shard->replacing->flags & SIRIDB_SHARD_HAS_INDEX))
-        {
-            log_critical(
-                    "Could not rename file '%s' to '%s'",
-                    new_shard->fn,
-                    new_shard->replacing->fn);
-            ERR_FILE
-        }
-        else
-        {
-            /* free the original allocated memory and set the new filename */
-            free(new_shard->fn);
-            new_shard->fn = new_shard->replacing->fn;
-            new_shard->replacing->fn = NULL;
-
-            /* decrement reference to old shard and set
-             * new_shard->replacing to NULL
-             */
-            siridb_shard_decref(new_shard->replacing);
-            new_shard->replacing = NULL;
-        }
+        siridb_shard_stats->decode += timeit_ns() - ns;
     }
 
-    uv_mutex_unlock(&siridb->series_mutex);
-
-    /* can raise an error only if the shard is dropped, in any other case we
-     * still have a reference left and an error cannot be raised.
-     */
-    siridb_shard_decref(new_shard);
+    SHARD_points_done(points, dest, idx->len, start_ts, end_ts);
 
-    sleep(1);
-
-    return siri_err;
+    return 0;
 }
 
 /*
- * This function can be used instead of the macro function when needed as
- * callback.
- *
- * Decrement the reference counter, when 0 the shard will be destroyed.
+ * Returns the destination for the points of a chunk. Without overlap this
+ * is the free space after the points which are already read. Overlapping
+ * chunks are decoded into a separate run which is merged with the points
+ * by SHARD_points_done().
  *
- * In case the shard will be destroyed and flag SIRIDB_SHARD_WILL_BE_REMOVED
- * is set, the file will be removed.
+ * Warning: 'points' must have space for the points of the chunk.
  *
- * A signal can be raised in case closing the shard file fails.
+ * Returns NULL and raises a SIGNAL in case of an allocation error.
  */
-void siridb__shard_decref(siridb_shard_t * shard)
+static siridb_point_t * SHARD_points_dest(
+        siridb_points_t * points,
+        idx_t * idx,
+        uint8_t has_overlap)
 {
-    if (!--shard->ref)
+    siridb_point_t * run;
+
+    SIRI_TRACE2(chunk__read__start, idx->shard->id, idx->len);
+
+    if (    !has_overlap ||
+            !points->len ||
+            (~idx->shard->flags & SIRIDB_SHARD_HAS_OVERLAP))
     {
-        siridb__shard_free(shard);
+        return points->data + points->len;
+    }
+
+    run = (siridb_point_t *) malloc(idx->len * sizeof(siridb_point_t));
+    if (run == NULL)
+    {
+        ERR_ALLOC
     }
+    return run;
 }
 
-void siridb_shard_drop(siridb_shard_t * shard, siridb_t * siridb)
+/*
+ * Add the 'n' sorted points in 'dest' which are inside the time range to
+ * 'points' and release 'dest' when it is a separate run. Argument 'dest'
+ * must be returned by SHARD_points_dest().
+ */
+static void SHARD_points_done(
+        siridb_points_t * points,
+        siridb_point_t * dest,
+        size_t n,
+        uint64_t * start_ts,
+        uint64_t * end_ts)
 {
-    siridb_series_t * series;
-    siridb_shard_t * pop_shard;
-    int optimizing = 0;
-
-    uv_mutex_lock(&siridb->series_mutex);
-    uv_mutex_lock(&siridb->shards_mutex);
-
-    pop_shard = (siridb_shard_t *) imap_pop(siridb->shards, shard->id);
+    siridb_point_t * pt = dest;
+    size_t i;
 
     /*
-     * When optimizing, 'pop_shard' is always the new shard and 'shard'
-     * will be set to the old one.
+     * The first and last point tell if the chunk must be cropped so a chunk
+     * which is fully inside the range is added without a search.
      */
-    if (pop_shard != NULL && (~pop_shard->flags & SIRIDB_SHARD_IS_REMOVED))
+    if (start_ts != NULL && n && pt->ts < *start_ts)
     {
-        pop_shard->flags |= SIRIDB_SHARD_IS_REMOVED;
-        SHARD_remove(pop_shard);
-
-        if (shard != pop_shard)
-        {
-            optimizing = 1;
-        }
-        else if (shard->replacing != NULL)
-        {
-            optimizing = 1;
-            shard = shard->replacing;
-        }
+        i = SHARD_points_search(pt, n, *start_ts);
+        pt += i;
+        n -= i;
     }
-    else
+
+    if (end_ts != NULL && n && pt[n - 1].ts >= *end_ts)
     {
-        log_warning("Shard id '%" PRIu64 "' is already dropped", shard->id);
+        n = SHARD_points_search(pt, n, *end_ts);
     }
 
-    uv_mutex_unlock(&siridb->shards_mutex);
+    SIRI_TRACE1(chunk__read__done, n);
 
-    /*
-     * We need a series mutex here since we depend on the series index
-     * and we create a copy since series might be removed when the length
-     * of series is zero after removing the shard
-     */
+    if (dest != points->data + points->len)
+    {
+        /* merge the run, existing points are kept in front */
+        siridb_points_add_sorted(points, pt, n);
+        free(dest);
+        return;
+    }
 
-    /*
-     * Create a copy since series might be removed and when optimizing we need
-     * to remove indexes for both the old and new shard. Since a series might
-     * be dropped by the first call to remove shard, we need an extra reference
-     * for each series.
-     */
-    if (optimizing)
+    if (pt != dest)
     {
-        slist_t * slist = imap_2slist_ref(siridb->series_map);
+        memmove(dest, pt, n * sizeof(siridb_point_t));
+    }
+    points->len += n;
+}
 
-        if (slist == NULL)
+/*
+ * Returns the position of the first of the 'n' sorted points with a
+ * time-stamp equal to or after 'ts', or 'n' when there is no such point.
+ */
+static size_t SHARD_points_search(
+        const siridb_point_t * points,
+        size_t n,
+        uint64_t ts)
+{
+    size_t lo = 0, hi = n, mid;
+
+    while (lo < hi)
+    {
+        mid = lo + (hi - lo) / 2;
+        if (points[mid].ts < ts)
         {
-            ERR_ALLOC
+            lo = mid + 1;
         }
-        else for (size_t i = 0; i < slist->len; i++)
+        else
         {
-            series = (siridb_series_t *) slist->data[i];
-            if (shard->id % siridb->duration_num == series->mask)
-            {
-                siridb_series_remove_shard(siridb, series, shard);
-                siridb_series_remove_shard(siridb, series, pop_shard);
-            }
-            siridb_series_decref(series);
+            hi = mid;
         }
-
-        slist_free(slist);
     }
-    else
+    return lo;
+}
+
+/*
+ * Returns a pointer to 'size' bytes of chunk data for the given index. The
+ * data is taken from the memory mapped shard file, or when the shard cannot
+ * be mapped, the data is read into 'buf'.
+ *
+ * Returns NULL in case of an error.
+ */
+static const char * SHARD_read_chunk(idx_t * idx, size_t size, void * buf)
+{
+    siridb_shard_t * shard = idx->shard;
+    siridb_shard_stats_t * stats = siridb_shard_stats;
+    uint64_t ns = (stats == NULL) ? 0 : timeit_ns();
+    const char * data;
+
+    if (stats != NULL)
     {
-        slist_t * slist = imap_2slist(siridb->series_map);
+        stats->chunks++;
+        stats->bytes += size;
+        stats->points += idx->len;
 
-        if (slist == NULL)
+        if (stats->shard != shard)
         {
-            ERR_ALLOC
+            stats->shard = shard;
+            stats->shards++;
         }
-        else for (size_t i = 0; i < slist->len; i++)
+    }
+
+    if (siridb_shard_shared)
+    {
+        uv_once(&shard_read_once, SHARD_read_init);
+        uv_mutex_lock(&shard_read_mutex);
+
+        data = SHARD_read_data(idx, size, buf);
+
+        /* another reader can replace the mapping after the unlock */
+        if (data != NULL && data != buf)
         {
-            series = (siridb_series_t *) slist->data[i];
-            if (shard->id % siridb->duration_num == series->mask)
-            {
-                siridb_series_remove_shard(siridb, series, shard);
-            }
+            memcpy(buf, data, size);
+            data = buf;
         }
-        slist_free(slist);
+
+        uv_mutex_unlock(&shard_read_mutex);
+    }
+    else
+    {
+        data = SHARD_read_data(idx, size, buf);
     }
 
-    if (pop_shard != NULL)
+    if (stats != NULL)
     {
-        siridb_shard_decref(pop_shard);
+        stats->io += timeit_ns() - ns;
     }
 
-    uv_mutex_unlock(&siridb->series_mutex);
+    return data;
 }
 
 /*
- * NEVER call this function but call siridb_shard_decref instead.
- *
- * Destroys a shard.
- * When flag SIRIDB_SHARD_WILL_BE_REMOVED is set, the file will be removed.
- *
- * A signal can be raised in case closing the shard file fails.
+ * Tell the kernel that the chunks for at most SIRIDB_SHARD_PREFETCH indexes
+ * starting at 'idx' will be read soon, except for the indexes for which
+ * 'skip' is true. (skip may be NULL) The reads for these chunks can then
+ * run in parallel instead of one at a time while the chunks are decoded.
  */
-void siridb__shard_free(siridb_shard_t * shard)
+void siridb_shard_prefetch(idx_t * idx, uint32_t n, const uint8_t * skip)
 {
-    if (shard->replacing != NULL)
+    idx_t * list[SIRIDB_SHARD_PREFETCH];
+    uint32_t i, len = 0;
+
+    if (n < 2)
     {
-        /* in case shard->replacing is set we also need to free this shard */
-        siridb_shard_decref(shard->replacing);
+        return;
     }
 
-    /* this will close the file, even when other references exist */
-    siri_fp_decref(shard->fp);
+    if (n > SIRIDB_SHARD_PREFETCH)
+    {
+        n = SIRIDB_SHARD_PREFETCH;
+    }
 
-#ifdef DEBUG
-    log_debug("Free shard id: %" PRIu64, shard->id);
-#endif
+    for (i = 0; i < n; i++, idx++)
+    {
+        if (skip == NULL || !skip[i])
+        {
+            list[len++] = idx;
+        }
+    }
 
-    free(shard->fn);
-    free(shard);
+    siridb_shard_prefetch_list(list, len);
 }
 
 /*
- * Returns 0 when successful or a negative value in case of an error.
+ * Tell the kernel that the chunks for at most SIRIDB_SHARD_PREFETCH_BATCH
+ * indexes in 'list' will be read soon. The indexes may belong to different
+ * series. Chunks are grouped for each shard file and chunks which are close
+ * to each other are advised as one range, ordered by position.
+ *
+ * Shard files which are not open are opened when the file handler has room
+ * for at least twice the number of prefetched files.
  */
-static int SHARD_remove(siridb_shard_t * shard)
+void siridb_shard_prefetch_list(idx_t ** list, uint32_t n)
 {
-    int rc = 0;
+#ifdef POSIX_FADV_WILLNEED
+    shard_range_t ranges[SIRIDB_SHARD_PREFETCH_BATCH];
+    uint32_t i, len = 0;
+    idx_t * idx;
 
-    if (shard->replacing != NULL)
+    if (n > SIRIDB_SHARD_PREFETCH_BATCH)
     {
-        rc = SHARD_remove(shard->replacing);
+        n = SIRIDB_SHARD_PREFETCH_BATCH;
     }
-    else if (shard->flags & SIRIDB_SHARD_HAS_INDEX)
+
+    for (i = 0; i < n; i++)
     {
-        /* We never have to delete the temporary (__) index file since this is
-         * the responsibility for the optimize task. This index file can never
-         * be in use by SiriDB. In case deletion has failed, nothing will
-         * happen because the file will not be read at startup.
-         */
-        siridb_shard_idx_file(buffer, shard->fn);
+        idx = list[i];
 
-        /* unlink the index file */
-        if (unlink(buffer))
+        if (    idx->shard->fp->fp != NULL ||
+                siri.fh->size >= 2 * SIRIDB_SHARD_PREFETCH)
         {
-            /* not a real issue, only a warning since this is not expected */
-            log_warning("Removing index file failed: %s", buffer);
-        }
-        else
-        {
-            log_info("Index file removed: %s", buffer);
+            ranges[len].shard = idx->shard;
+            ranges[len].pos = (off_t) idx->pos;
+            ranges[len].end = (off_t) idx->pos + idx->chunk_sz;
+            len++;
         }
     }
 
-    siri_fp_close(shard->fp);
+    if (!len)
+    {
+        return;
+    }
 
-    rc += unlink(shard->fn);
+    qsort(ranges, len, sizeof(shard_range_t), SHARD_cmp_range);
 
-    if (rc == 0)
+    if (siridb_shard_shared)
     {
-        log_info("Shard file removed: %s", shard->fn);
+        uv_once(&shard_read_once, SHARD_read_init);
+        uv_mutex_lock(&shard_read_mutex);
+        SHARD_prefetch_ranges(ranges, len);
+        uv_mutex_unlock(&shard_read_mutex);
     }
-    else if (shard->fn != NULL)
+    else
     {
-        log_critical(
-                "Removing shard file failed: %s (error code: %d)",
-                shard->fn,
-                rc);
+        SHARD_prefetch_ranges(ranges, len);
     }
-
-    return rc;
+#else
+    (void) list;
+    (void) n;
+#endif
 }
 
+#ifdef POSIX_FADV_WILLNEED
 /*
- * Truncates a shard file to its current size.
- *
- * Returns 0 when successful or -1 in case of an error.
+ * Merge and advise sorted ranges. Errors are ignored since the chunks are
+ * read anyway.
  */
-static int SHARD_truncate(siridb_shard_t * shard)
+static void SHARD_prefetch_ranges(shard_range_t * ranges, uint32_t n)
 {
-    if (shard->fp->fp == NULL)
+    shard_range_t * range = ranges;
+    shard_range_t * end = ranges + n;
+    shard_range_t cur;
+
+    while (range < end)
     {
-        if (siri_fopen(siri.fh, shard->fp, shard->fn, "r+"))
+        cur = *range;
+
+        for (   range++;
+                range < end &&
+                range->shard == cur.shard &&
+                range->pos <= cur.end + SHARD_PREFETCH_GAP;
+                range++)
         {
-            log_critical(
-                    "Cannot open file '%s', skip reading points",
-                    shard->fn);
-            return -1;
+            if (range->end > cur.end)
+            {
+                cur.end = range->end;
+            }
+        }
+
+        if (siri_fh_open(siri.fh, cur.shard->fp, cur.shard->fn, "r+") == 0)
+        {
+            (void) posix_fadvise(
+                    fileno(cur.shard->fp->fp),
+                    cur.pos,
+                    cur.end - cur.pos,
+                    POSIX_FADV_WILLNEED);
         }
     }
+}
 
-    int buffer_fd = fileno(shard->fp->fp);
+static int SHARD_cmp_range(const void * a, const void * b)
+{
+    const shard_range_t * ra = (const shard_range_t *) a;
+    const shard_range_t * rb = (const shard_range_t *) b;
 
-    if (buffer_fd == -1)
+    if (ra->shard != rb->shard)
     {
-        log_critical("Cannot get file descriptor for '%s'", shard->fn);
-        return -1;
+        return (ra->shard->id > rb->shard->id) -
+                (ra->shard->id < rb->shard->id);
     }
+    return (ra->pos > rb->pos) - (ra->pos < rb->pos);
+}
+#endif
 
-    if (ftruncate(buffer_fd, shard->size))
+/*
+ * Returns a pointer to the chunk in the mapping of the shard file, or the
+ * chunk is read into 'buf' when the file cannot be mapped. Returns NULL in
+ * case of an error.
+ */
+static const char * SHARD_read_data(idx_t * idx, size_t size, void * buf)
+{
+    siridb_shard_t * shard = idx->shard;
+    const char * data;
+
+    if (siri_fh_open(siri.fh, shard->fp, shard->fn, "r+"))
     {
-        log_critical("Cannot truncate shard file: '%s'", shard->fn);
-        return -1;
+        log_critical(
+                "Cannot open file '%s', skip reading points",
+                shard->fn);
+        return NULL;
     }
 
-    log_warning("Truncated shard file '%s' to %zu bytes",
-            shard->fn, shard->size);
+    data = siri_fp_map(shard->fp, idx->pos, size, shard->size);
 
-    return fsync(buffer_fd);
+    if (data == NULL)
+    {
+        if (fseeko(shard->fp->fp, idx->pos, SEEK_SET) ||
+            fread(buf, size, 1, shard->fp->fp) != 1)
+        {
+            SHARD_read_error(shard);
+            return NULL;
+        }
+        data = buf;
+    }
+
+    return data;
+}
+
+static void SHARD_read_init(void)
+{
+    uv_mutex_init(&shard_read_mutex);
 }
 
 /*
- * This function applies the index on the appropriate series. In case the
- * series is not found, a log line will be displayed if this is the first
- * one in the shard which is not found. The next series which cannot be found
- * is simply ignored. In case the series id is not possible (invalid id),
- * then an log error is displayed and the return value will be -1.
+ * Log a read error and mark the shard as corrupt.
  */
-static int SHARD_apply_idx_num(
-        siridb_t * siridb,
+static void SHARD_read_error(siridb_shard_t * shard)
+{
+    if (shard->flags & SIRIDB_SHARD_IS_CORRUPT)
+    {
+        log_error("Cannot read from shard id %" PRIu64, shard->id);
+    }
+    else
+    {
+        log_critical(
+                "Cannot read from shard id %" PRIu64
+                ". The next optimize cycle "
+                "will fix this shard but you might loose some data.",
+                shard->id);
+        shard->flags |= SIRIDB_SHARD_IS_CORRUPT;
+    }
+}
+
+/*
+ * Returns 1 (true) when the shard can be optimized by merging only the
+ * chunks for series which need it, instead of rewriting the complete shard.
+ *
+ * Merging marks chunks as dead in place which is not allowed when the file
+ * is hard-linked by a snapshot, since the snapshot must stay unchanged.
+ */
+static int SHARD_can_merge(siridb_shard_t * shard)
+{
+    struct stat st;
+
+    return (siri.cfg->optimize_compact_threshold &&
+            shard->tp == SIRIDB_SHARD_TP_NUMBER &&
+            shard->replacing == NULL &&
+            (~shard->flags & SIRIDB_SHARD_IS_CORRUPT) &&
+            (~shard->flags & SIRIDB_SHARD_HAS_DROPPED_SERIES) &&
+            shard->dead_size * 100 <=
+                (size_t) siri.cfg->optimize_compact_threshold * shard->size &&
+            stat(shard->fn, &st) == 0 &&
+            st.st_nlink == 1);
+}
+
+/*
+ * Incremental optimize. Chunks for series which overlap, or which use too
+ * many chunks, are merged and appended to the shard. The old chunks are
+ * marked as dead afterwards. Dead chunks are removed when the complete shard
+ * is rewritten, which happens once the optimize_compact_threshold is reached.
+ *
+ * New chunks are written and flushed before the old ones are marked as dead.
+ * When SiriDB stops in between, the points are loaded twice and the shard
+ * will be flagged as having overlap so the next optimize cycle fixes it.
+ *
+ * Returns 0 if successful or a negative value and a SIGNAL is raised in case
+ * of a critical error.
+ */
+static int SHARD_optimize_incremental(
         siridb_shard_t * shard,
-        char * pt,
-        size_t pos,
-        int is_num64)
+        siridb_t * siridb)
 {
-    uint16_t len;
-    uint32_t series_id;
     siridb_series_t * series;
+    slist_t * slist;
+    idx_t * dead;
+    uint_fast32_t n;
+    uint32_t * idx_pos = NULL;
+    size_t idx_len = 0;
+    size_t size;
+    size_t written;
+    int is_num64 = siridb->time->precision > SIRIDB_TIME_SECONDS;
+    int modified = 0;
+    int rc = 0;
+    size_t num_merged = 0;
 
-    series_id = *((uint32_t *) pt);
-    len = *((uint16_t *) (pt + (is_num64 ? 20 : 12)));  // LEN POS IN INDEX
-    series = imap_get(siridb->series_map, series_id);
+    if (    (shard->flags & SIRIDB_SHARD_HAS_INDEX) &&
+            SHARD_read_idx_pos(shard, is_num64, &idx_pos, &idx_len))
+    {
+        log_error(
+                "Cannot read index file for shard id %" PRIu64 ", the "
+                "complete shard will be rewritten by the next optimize cycle",
+                shard->id);
+        shard->flags |= SIRIDB_SHARD_IS_CORRUPT;
+        return 0;
+    }
 
-    if (series == NULL)
+    siri_rwlock_wrlock(&siridb->series_mutex);
+
+    slist = dmap_2slist_ref(siridb->series_map);
+
+    /* values which are added from now on are detected by a size change */
+    size = shard->size;
+    shard->flags &= ~SIRIDB_SHARD_HAS_NEW_VALUES;
+    shard->new_chunks = 0;
+    shard->new_size = 0;
+
+    siri_rwlock_wrunlock(&siridb->series_mutex);
+
+    if (slist == NULL)
     {
-        if (!series_id || series_id > siridb->max_series_id)
-        {
-            log_error(
-                    "Unexpected Series ID %" PRIu32
-                    " is found in shard %" PRIu64 " (%s) at "
-                    "position %ld. This indicates that this shard is "
-                    "probably corrupt. The next optimize cycle will most "
-                    "likely fix this shard but you might loose some data.",
-                    series_id,
-                    shard->id,
-                    shard->fn,
-                    pos);
-            shard->flags |= SIRIDB_SHARD_IS_CORRUPT;
-            return -1;
+        ERR_ALLOC
+        free(idx_pos);
+        return -1;
+    }
+
+    for (size_t i = 0; i < slist->len; i++)
+    {
+        /* its possible that another database is paused, but we wait anyway */
+        if (siri.optimize->pause)
+        {
+            siri_optimize_wait();
         }
 
-        /* this shard has remove series, make sure the flag is set */
-        if (!(shard->flags & SIRIDB_SHARD_HAS_DROPPED_SERIES))
+        series = slist->data[i];
+
+        if (    !siri_err &&
+                !rc &&
+                siri.optimize->status != SIRI_OPTIMIZE_CANCELLED &&
+                siridb_durations_mask(siridb, shard->tp, shard->id) ==
+                    series->mask &&
+                (~series->flags & SIRIDB_SERIES_IS_DROPPED) &&
+                (~shard->flags & SIRIDB_SHARD_IS_REMOVED))
         {
-            log_debug(
-                    "At least Series ID %" PRIu32
-                    " is found in shard %" PRIu64 " (%s) but "
-                    "does not exist anymore. We will remove the series on "
-                    "the next optimize cycle.",
-                    series_id,
-                    shard->id,
-                    shard->fn);
-            shard->flags |= SIRIDB_SHARD_HAS_DROPPED_SERIES;
+            siri_rwlock_wrlock(&siridb->series_mutex);
+
+            if (shard->size != size)
+            {
+                modified = 1;
+            }
+
+            if (    (~shard->flags & SIRIDB_SHARD_IS_REMOVED) &&
+                    siridb_series_need_merge(series, shard))
+            {
+                written = shard->size;
+
+                rc = siridb_series_merge_shard(
+                        siridb,
+                        series,
+                        shard,
+                        &dead,
+                        &n);
+
+                if (n && SHARD_mark_dead(
+                        shard,
+                        dead,
+                        n,
+                        idx_pos,
+                        idx_len,
+                        is_num64))
+                {
+                    rc = -1;
+                }
+
+                if (rc)
+                {
+                    log_critical(
+                            "Optimizing shard '%s' has failed due to a "
+                            "critical error", shard->fn);
+                }
+                else
+                {
+                    num_merged++;
+                }
+
+                free(dead);
+                written = shard->size - written;
+                size = shard->size;
+
+                siri_rwlock_wrunlock(&siridb->series_mutex);
+
+                /* make this sleep depending on the active_tasks
+                 * (50ms per active task) */
+                usleep( 50000 * siridb->active_tasks + 100 );
+
+                siri_throttle_wait(SIRI_THROTTLE_OPTIMIZE, written);
+                siri_throttle_wait_bucket(
+                        &siridb->optimize_throttle,
+                        written);
+            }
+            else
+            {
+                siri_rwlock_wrunlock(&siridb->series_mutex);
+            }
         }
+
+        /* other optimize threads might hold a reference to this series */
+        siri_rwlock_wrlock(&siridb->series_mutex);
+        siridb_series_decref(series);
+        siri_rwlock_wrunlock(&siridb->series_mutex);
+    }
+
+    slist_free(slist);
+    free(idx_pos);
+
+    siri_rwlock_wrlock(&siridb->series_mutex);
+
+    if (    !rc &&
+            !siri_err &&
+            !modified &&
+            shard->size == size &&
+            siri.optimize->status != SIRI_OPTIMIZE_CANCELLED &&
+            (~shard->flags & SIRIDB_SHARD_IS_REMOVED))
+    {
+        /* all series are checked and no new values are added meanwhile */
+        shard->flags &= ~SIRIDB_SHARD_HAS_OVERLAP;
+        shard->overlaps = 0;
     }
     else
     {
-        if (siridb_series_add_idx(
-                series,
-                shard,
-                is_num64 ? // START_TS IN HEADER
-                        (uint64_t) *((uint64_t *) (pt + 4)) :
-                        (uint64_t) *((uint32_t *) (pt + 4)),
-                is_num64 ? // END_TS IN HEADER
-                        (uint64_t) *((uint64_t *) (pt + 12)) :
-                        (uint64_t) *((uint32_t *) (pt + 8)),
-                (uint32_t) pos,
-                len) == 0)
-        {
-            /* update the series length property */
-            series->length += len;
-        }
-        else
-        {
-            /* signal is raised */
-            log_critical("Cannot load index for Series ID %u", series->id);
-        }
+        /* make sure this shard will be optimized again */
+        shard->flags |= SIRIDB_SHARD_HAS_NEW_VALUES;
     }
 
-    return (int) len;
+    siri_rwlock_wrunlock(&siridb->series_mutex);
+
+    log_info(
+            "Finished incremental optimize for shard id %" PRIu64
+            " (%zu series merged, %zu dead bytes)",
+            shard->id,
+            num_merged,
+            shard->dead_size);
+
+    return rc ? rc : siri_err;
 }
 
 /*
- * Read an index file for a shard in case the shard has flag
- * SIRIDB_SHARD_HAS_INDEX set. Returns 0 in case the index was read successful
- * and if the flag was not set. Returns a negative value in case of an error.
+ * Mark the chunks of dropped series as dead, like an incremental optimize
+ * marks merged chunks. When this is not possible, for example because the
+ * shard is hard-linked by a snapshot, the shard is flagged with
+ * SIRIDB_SHARD_HAS_DROPPED_SERIES so it will be rewritten.
  *
- * Member shard->size will be updated according the index.
+ * Returns 0 if successful or -1 and a SIGNAL is raised in case of an error.
  */
-static int SHARD_get_idx_num(
-        siridb_t * siridb,
-        siridb_shard_t * shard,
-        int is_num64)
+static int SHARD_sweep_dropped(siridb_shard_t * shard, siridb_t * siridb)
 {
-    const int idx_sz = is_num64 ? IDX_NUM64_SZ : IDX_NUM32_SZ;
-    const int tv_sz = is_num64 ? 16 : 12;
-
-    size_t i, n;
-    char * data, * pt;
-    int len;
-    FILE * fp;
+    int is_num64 = siridb->time->precision > SIRIDB_TIME_SECONDS;
+    uint32_t * idx_pos = NULL;
+    size_t idx_len = 0;
+    idx_t * dropped;
+    size_t n;
+    struct stat st;
+    int rc = 0;
 
-    if (~shard->flags & SIRIDB_SHARD_HAS_INDEX)
+    siri_mutex_lock(&siridb->shards_mutex);
+    dropped = shard->dropped;
+    n = shard->dropped_n;
+    shard->dropped = NULL;
+    shard->dropped_n = 0;
+    shard->dropped_sz = 0;
+    siri_mutex_unlock(&siridb->shards_mutex);
+
+    if (    shard->tp != SIRIDB_SHARD_TP_NUMBER ||
+            shard->replacing != NULL ||
+            (shard->flags & (
+                    SIRIDB_SHARD_IS_CORRUPT |
+                    SIRIDB_SHARD_HAS_DROPPED_SERIES)) ||
+            stat(shard->fn, &st) ||
+            st.st_nlink != 1 ||
+            (   (shard->flags & SIRIDB_SHARD_HAS_INDEX) &&
+                SHARD_read_idx_pos(shard, is_num64, &idx_pos, &idx_len)))
     {
+        shard->flags |= SIRIDB_SHARD_HAS_DROPPED_SERIES;
+        free(dropped);
         return 0;
     }
 
-    n = SIRIDB_SHARD_MAX_CHUNK_SZ / idx_sz;
-    data = (char *) malloc(n * idx_sz);
+    siri_rwlock_wrlock(&siridb->series_mutex);
 
-    if (data == NULL)
+    if (~shard->flags & SIRIDB_SHARD_IS_REMOVED)
     {
-        log_critical("Memory allocation error");
-        free(data);
-        return -1;
+        rc = SHARD_mark_dead(shard, dropped, n, idx_pos, idx_len, is_num64);
     }
 
-    /* get the index file name */
+    siri_rwlock_wrunlock(&siridb->series_mutex);
+
+    if (rc == 0)
+    {
+        log_info(
+                "Marked %zu chunk(s) of dropped series as dead in shard "
+                "id %" PRIu64 " (%zu dead bytes)",
+                n,
+                shard->id,
+                shard->dead_size);
+    }
+
+    free(idx_pos);
+    free(dropped);
+
+    return rc;
+}
+
+/*
+ * Read the positions of all chunks which have their header in the index
+ * file of the shard. The positions are stored in ascending order to
+ * 'idx_pos' which must be freed by the caller.
+ *
+ * Returns 0 if successful or -1 in case of an error.
+ */
+static int SHARD_read_idx_pos(
+        siridb_shard_t * shard,
+        int is_num64,
+        uint32_t ** idx_pos,
+        size_t * idx_len)
+{
+    const int idx_sz = SHARD_IDX_SZ(shard, is_num64);
+    char idx[idx_sz];
+    uint32_t * tmp;
+    size_t pos = HEADER_SIZE;
+    size_t n = 0;
+    size_t sz = 0;
+    FILE * fp;
+
     siridb_shard_idx_file(fn, shard->fn);
 
     fp = fopen(fn, "r");
     if (fp == NULL)
     {
-        log_critical("Cannot open index file for reading: '%s'", fn);
-        free(data);
+        log_error("Cannot open index file for reading: '%s'", fn);
         return -1;
     }
 
-    while ((n = fread(data, idx_sz, n, fp)))
+    *idx_pos = NULL;
+
+    while (fread(idx, idx_sz, 1, fp) == 1)
     {
-        pt = data;
-        for (i = 0; i < n; i++, pt += idx_sz)
+        if (n == sz)
         {
-            len = SHARD_apply_idx_num(
-                    siridb,
-                    shard,
-                    pt,
-                    shard->size,
-                    is_num64);
-
-            if (len < 0)
+            sz = sz ? sz * 2 : 1024;
+            tmp = (uint32_t *) realloc(*idx_pos, sz * sizeof(uint32_t));
+            if (tmp == NULL)
             {
-                log_critical("Error while reading index file: '%s'", fn);
+                log_critical("Memory allocation error");
                 fclose(fp);
-                free(data);
+                free(*idx_pos);
+                *idx_pos = NULL;
                 return -1;
             }
-
-            shard->size += len * tv_sz;
+            *idx_pos = tmp;
         }
+
+        (*idx_pos)[n++] = (uint32_t) pos;
+
+        pos += SHARD_HAS_CHUNK_SZ(shard) ?
+                *((uint16_t *) (idx + (is_num64 ? 22 : 14))) :  // CHUNK_SZ
+                *((uint16_t *) (idx + (is_num64 ? 20 : 12))) *  // LEN
+                    (is_num64 ? 16 : 12);
     }
 
     fclose(fp);
-    free(data);
+
+    *idx_len = n;
 
     return 0;
 }
 
 /*
- * Returns 0 if successful or -1 in case of an error.
+ * Mark chunks as dead by setting the series id in the chunk header to 0.
+ * The header of a chunk is either in the index file (see SHARD_read_idx_pos)
+ * or it is written in the shard file, just before the points.
  *
- * A SIGNAL might be raised in case of memory errors. We mark the shard as
- * corrupt in case of disk errors and try to recover on the next optimize
- * cycle.
+ * Returns 0 if successful or -1 and a SIGNAL is raised in case of an error.
  */
-static int SHARD_load_idx_num(
-        siridb_t * siridb,
+static int SHARD_mark_dead(
         siridb_shard_t * shard,
-        FILE * fp,
+        const idx_t * dead,
+        uint_fast32_t n,
+        const uint32_t * idx_pos,
+        size_t idx_len,
         int is_num64)
 {
-    const unsigned int idx_sz = is_num64 ? IDX_NUM64_SZ : IDX_NUM32_SZ;
-    const unsigned int tv_sz = is_num64 ? 16 : 12;
+    const int idx_sz = SHARD_IDX_SZ(shard, is_num64);
+    const uint32_t dead_id = 0;
+    size_t lo, hi, mid;
+    FILE * idx_fp = NULL;
+    FILE * fp;
+    off_t offset;
+    int rc = 0;
 
-    char idx[idx_sz];
-    int len, rc;
-    size_t size, pos;
+    if (siri_fh_open(siri.fh, shard->fp, shard->fn, "r+"))
+    {
+        ERR_FILE
+        log_critical("Cannot open file '%s'", shard->fn);
+        return -1;
+    }
 
-    while ((size = fread(&idx, 1, idx_sz, fp)) == idx_sz)
+    for (; n--; dead++)
     {
-        pos = shard->size + idx_sz;
+        /* binary search for the chunk in the index file */
+        for (lo = 0, hi = idx_len; lo < hi;)
+        {
+            mid = lo + (hi - lo) / 2;
+            if (idx_pos[mid] < dead->pos)
+            {
+                lo = mid + 1;
+            }
+            else
+            {
+                hi = mid;
+            }
+        }
 
-        if ((len = SHARD_apply_idx_num(siridb, shard, idx, pos, is_num64)) < 0)
+        if (lo < idx_len && idx_pos[lo] == dead->pos)
         {
-            return -1;
+            if (idx_fp == NULL)
+            {
+                siridb_shard_idx_file(fn, shard->fn);
+                if ((idx_fp = fopen(fn, "r+")) == NULL)
+                {
+                    log_critical("Cannot open index file '%s'", fn);
+                    rc = -1;
+                    break;
+                }
+            }
+            fp = idx_fp;
+            offset = (off_t) lo * idx_sz;
+        }
+        else
+        {
+            fp = shard->fp->fp;
+            offset = (off_t) dead->pos - idx_sz;
         }
 
-        rc = fseeko(fp, len * tv_sz, SEEK_CUR);  // 16 = NUM64 point size
-        if (rc != 0)
+        if (    fseeko(fp, offset, SEEK_SET) ||
+                fwrite(&dead_id, sizeof(uint32_t), 1, fp) != 1)
         {
-            log_error(
-                "Seek error in shard %" PRIu64 " (%s) at position %ld. "
-                "Mark this shard as corrupt. The next optimize cycle will "
-                "most likely fix this shard but you might loose some data.",
-                shard->id,
-                shard->fn,
-                pos);
-            shard->flags |= SIRIDB_SHARD_IS_CORRUPT;
-            return -1;
+            log_critical(
+                    "Cannot mark chunk at position %" PRIu32 " in shard "
+                    "id %" PRIu64 " as dead",
+                    dead->pos,
+                    shard->id);
+            rc = -1;
+            break;
         }
 
-        shard->size = pos + len * tv_sz;
+        shard->dead_size += dead->chunk_sz;
+        siridb_ccache_drop(siri.ccache, shard, dead->pos);
     }
 
-    if (size)
+    if (fflush(shard->fp->fp))
     {
-        log_error(
-            "Shard %" PRIu64 " (%s) has %zu more bytes than expected. "
-            "Mark this shard as corrupt. The next optimize cycle will "
-            "most likely fix this shard but you might loose some data.",
-            shard->id,
-            shard->fn,
-            size);
-        shard->flags |= SIRIDB_SHARD_IS_CORRUPT;
-        return -1;
+        log_critical("Cannot write flush file '%s'", shard->fn);
+        rc = -1;
     }
 
-    return siri_err;
-}
+    if (idx_fp != NULL && fclose(idx_fp))
+    {
+        log_critical("Cannot close index file for shard '%s'", shard->fn);
+        rc = -1;
+    }
 
-/*
- * Set shard->fn to the correct file name.
- *
- * Returns the length of 'fn' or a negative value in case of an error.
- */
-static inline int SHARD_init_fn(siridb_t * siridb, siridb_shard_t * shard)
-{
-     return asprintf(
-             &shard->fn,
-             "%s%s%s%" PRIu64 "%s",
-             siridb->dbpath,
-             SIRIDB_SHARDS_PATH,
-             (shard->replacing == NULL) ? "" : "__",
-             shard->id,
-             ".sdb");
+    if (rc)
+    {
+        ERR_FILE
+    }
+
+    return rc;
 }
 
 /*
- * Write a header for a chunk of points. The header can be written to argument
- * fp which should be a pointer to the index, or the shard file.
+ * Read the chunk at 'pos' for the chunk header 'header' and compare the
+ * checksum. Chunks which are marked as dead are not checked.
  *
- * In case of an error the function return EOF, otherwise the size which is
- * written.
+ * Returns the chunk size, or -1 when the chunk cannot be read or does not
+ * match the checksum. In both cases the shard is marked as corrupt.
  */
-static int SHARD_write_header(
-        siridb_t * siridb,
-        siridb_series_t * series,
-        siridb_points_t * points,
-        uint_fast32_t start,
-        uint_fast32_t end,
-        FILE * fp)
+static long int SHARD_verify_chunk(
+        siridb_shard_t * shard,
+        const char * header,
+        size_t pos,
+        int is_num64,
+        char ** buf,
+        size_t * buf_sz)
 {
-    uint16_t len = end - start;
-    int size = EOF;
+    const unsigned int idx_sz = SHARD_IDX_SZ(shard, is_num64);
+    uint32_t series_id = *((uint32_t *) header);
+    uint32_t crc;
+    size_t chunk_sz = SHARD_HAS_CHUNK_SZ(shard) ?
+            *((uint16_t *) (header + (is_num64 ? 22 : 14))) :  // CHUNK_SZ
+            *((uint16_t *) (header + (is_num64 ? 20 : 12))) *  // LEN
+                (is_num64 ? 16 : 12);
+    const char * data;
+    char * tmp;
+    idx_t idx;
+
+    /* the checksum is not aligned in all headers */
+    memcpy(&crc, header + idx_sz - IDX_CRC_SZ, sizeof(uint32_t));
+
+    if (pos + chunk_sz > shard->size)
+    {
+        log_error(
+                "Chunk at position %zu in shard %" PRIu64 " (%s) ends after "
+                "the end of the shard. Mark this shard as corrupt. The next "
+                "optimize cycle will most likely fix this shard but you "
+                "might loose some data.",
+                pos,
+                shard->id,
+                shard->fn);
+        shard->flags |= SIRIDB_SHARD_IS_CORRUPT;
+        return -1;
+    }
 
-    if (fseeko(fp, 0, SEEK_END) ||
-        fwrite(&series->id, sizeof(uint32_t), 1, fp) != 1)
+    /* series id 0 is used to mark a chunk as dead */
+    if (!series_id)
     {
-        return EOF;
+        return (long int) chunk_sz;
     }
 
-    switch (siridb->time->ts_sz)
+    if (chunk_sz > *buf_sz)
     {
-    case sizeof(uint32_t):
+        tmp = (char *) realloc(*buf, chunk_sz);
+        if (tmp == NULL)
         {
-            uint32_t start_ts = (uint32_t) points->data[start].ts;
-            uint32_t end_ts = (uint32_t) points->data[end - 1].ts;
-            if (fwrite(&start_ts, sizeof(uint32_t), 1, fp) != 1 ||
-                fwrite(&end_ts, sizeof(uint32_t), 1, fp) != 1)
-            {
-                return EOF;
-            }
+            log_critical("Memory allocation error");
+            return -1;
         }
-        /* TODO: this is not LOG compatible */
-        size = IDX_NUM32_SZ;
-        break;
+        *buf = tmp;
+        *buf_sz = chunk_sz;
+    }
 
-    case sizeof(uint64_t):
-        if (fwrite(&points->data[start].ts, sizeof(uint64_t), 1, fp) != 1 ||
-            fwrite(&points->data[end - 1].ts, sizeof(uint64_t), 1, fp) != 1)
-        {
-            return EOF;
-        }
-        /* TODO: this is not LOG compatible */
-        size = IDX_NUM64_SZ;
-        break;
+    idx.shard = shard;
+    idx.pos = (uint32_t) pos;
+    idx.len = 0;
 
-    default:
-        assert (0);
-        break;
+    data = SHARD_read_chunk(&idx, chunk_sz, *buf);
+    if (data == NULL)
+    {
+        return -1;  /* the shard is marked as corrupt */
     }
 
-    if (fwrite(&len, sizeof(uint16_t), 1, fp) != 1)
+    if (siridb_crc32c(0, data, chunk_sz) != crc)
     {
-        return EOF;
+        log_error(
+                "Checksum mismatch for the chunk at position %zu in shard "
+                "%" PRIu64 " (%s). Mark this shard as corrupt. The next "
+                "optimize cycle will most likely fix this shard but you "
+                "might loose some data.",
+                pos,
+                shard->id,
+                shard->fn);
+        shard->flags |= SIRIDB_SHARD_IS_CORRUPT;
+        return -1;
     }
 
-    return size;
+    return (long int) chunk_sz;
 }
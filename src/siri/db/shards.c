@@ -22,23 +22,57 @@
 #include <ctype.h>
 #include <dirent.h>
 #include <logger/logger.h>
+#include <siri/db/acache.h>
+#include <siri/db/durations.h>
+#include <siri/db/series.h>
 #include <siri/db/shard.h>
 #include <siri/db/shards.h>
+#include <siri/db/time.h>
 #include <siri/siri.h>
+#include <siri/trace.h>
+#include <slist/slist.h>
 #include <stdbool.h>
 #include <string.h>
 #include <sys/stat.h>
+#include <time.h>
 #include <unistd.h>
+#include <xpath/xpath.h>
 #include <siri/db/db.h>
 
 #define SIRIDB_MAX_SHARD_FN_LEN 23
 
+/* log the loading progress at least every 10 percent */
+#define SHARDS_LOAD_PROGRESS 10
+
+typedef struct shards_load_s
+{
+    siridb_t * siridb;
+    uint64_t * ids;
+    size_t len;
+    size_t next;
+    int rc;
+    uv_mutex_t lock;
+} shards_load_t;
+
 static bool is_shard_fn(const char * fn, const char * ext);
 static bool is_temp_fn(const char * fn);
+static bool SHARDS_can_resume(const char * path, const char * fn);
+static int SHARDS_cmp_id(const void * a, const void * b);
+static int SHARDS_cmp_accessed(const void * a, const void * b);
+static int SHARDS_count_idx(siridb_series_t * series, void * args);
+static void SHARDS_load_worker(void * arg);
+static int SHARDS_cold(
+        siridb_t * siridb,
+        siridb_series_t * series,
+        uint64_t * start_ts,
+        uint64_t * end_ts,
+        int load);
 
 /*
  * Returns 0 if successful or -1 in case of an error.
  * (a SIGNAL might be raised in case of an error)
+ *
+ * Shards are loaded using siri.cfg->shard_load_threads threads.
  */
 int siridb_shards_load(siridb_t * siridb)
 {
@@ -46,6 +80,14 @@ int siridb_shards_load(siridb_t * siridb)
     struct dirent ** shard_list;
     char buffer[PATH_MAX];
     int n, total, rc = 0;
+    uint16_t nthreads = siri.cfg->shard_load_threads;
+    uv_thread_t threads[nthreads];
+    shards_load_t load = {
+            .siridb=siridb,
+            .ids=NULL,
+            .len=0,
+            .next=0,
+            .rc=0};
 
     log_info("Loading shards");
 
@@ -78,9 +120,18 @@ int siridb_shards_load(siridb_t * siridb)
         return -1;
     }
 
-    for (n = 0; n < total; n++)
+    /* never zero so we do not have to check for NULL in case of no shards */
+    load.ids = (uint64_t *) malloc((total + 1) * sizeof(uint64_t));
+    if (load.ids == NULL)
     {
-        if (is_temp_fn(shard_list[n]->d_name))
+        ERR_ALLOC
+        rc = -1;
+    }
+
+    for (n = 0; !rc && n < total; n++)
+    {
+        if (    is_temp_fn(shard_list[n]->d_name) &&
+                !SHARDS_can_resume(path, shard_list[n]->d_name))
         {
             snprintf(buffer, PATH_MAX, "%s%s",
                    path, shard_list[n]->d_name);
@@ -101,12 +152,7 @@ int siridb_shards_load(siridb_t * siridb)
         }
 
         /* we are sure this fits since the filename is checked */
-        if (siridb_shard_load(siridb, (uint64_t) atoll(shard_list[n]->d_name)))
-        {
-           log_error("Error while loading shard: '%s'", shard_list[n]->d_name);
-           rc = -1;
-           break;
-        }
+        load.ids[load.len++] = (uint64_t) atoll(shard_list[n]->d_name);
     }
 
     while (total--)
@@ -115,7 +161,49 @@ int siridb_shards_load(siridb_t * siridb)
     }
     free(shard_list);
 
-    return rc;
+    if (rc)
+    {
+        free(load.ids);
+        return rc;
+    }
+
+    /*
+     * Load the shards in order so indexes are mostly appended to the series
+     * instead of being inserted.
+     */
+    qsort(load.ids, load.len, sizeof(uint64_t), SHARDS_cmp_id);
+
+    /* never start more threads than we have shards */
+    if (nthreads > load.len)
+    {
+        nthreads = (load.len) ? load.len : 1;
+    }
+
+    uv_mutex_init(&load.lock);
+
+    for (n = 0; n < nthreads - 1; n++)
+    {
+        if (uv_thread_create(&threads[n], SHARDS_load_worker, &load))
+        {
+            log_error(
+                    "Cannot create thread for loading shards, "
+                    "continue with %d thread(s)", n + 1);
+            break;
+        }
+    }
+
+    /* this thread loads shards as well */
+    SHARDS_load_worker(&load);
+
+    while (n--)
+    {
+        uv_thread_join(&threads[n]);
+    }
+
+    uv_mutex_destroy(&load.lock);
+    free(load.ids);
+
+    return load.rc;
 }
 
 /*
@@ -128,21 +216,61 @@ int siridb_shards_add_points(
         siridb_points_t * points)
 {
     siridb_shard_t * shard;
-    uint64_t duration = siridb_series_isnum(series) ?
-            siridb->duration_num : siridb->duration_log;
-    uint64_t shard_start, shard_end, shard_id;
+    uint64_t duration, shard_end, shard_id;
     uint_fast32_t start, end, num_chunks, pstart, pend;
     uint16_t chunk_sz;
     size_t size;
     long int pos;
+    siridb_points_stats_t stats;
+
+    SIRI_TRACE2(buffer__flush__start, series->id, points->len);
+
+    /* the shards receive new values, cached groups for these are outdated */
+    if (siridb->acache != NULL && points->len)
+    {
+        siridb_acache_drop(
+                siridb->acache,
+                series->id,
+                points->data[0].ts,
+                points->data[points->len - 1].ts);
+    }
 
     for (end = 0; end < points->len;)
     {
-        shard_start = points->data[end].ts / duration * duration;
-        shard_end = shard_start + duration;
-        shard_id = shard_start + series->mask;
+        shard_id = siridb_durations_shard_id(
+                siridb,
+                series,
+                points->data[end].ts,
+                &duration);
+        shard_end = points->data[end].ts -
+                points->data[end].ts % duration + duration;
 
-        if ((shard = imap_get(siridb->shards, shard_id)) == NULL)
+        /*
+         * Points are mostly added to the same shard as the last time. The
+         * shard is still in the map when no shard is added or removed since.
+         */
+        if (    series->shard_gen == siridb->shards_gen &&
+                series->shard != NULL &&
+                series->shard->id == shard_id)
+        {
+            shard = series->shard;
+        }
+        else
+        {
+            shard = imap_get(siridb->shards, shard_id);
+        }
+
+        if (shard != NULL &&
+            shard->is_cold &&
+            siridb_shard_load_cold(siridb, shard))
+        {
+            log_error(
+                    "Failed to load cold shard id %" PRIu64 ", points are "
+                    "added anyway",
+                    shard->id);
+        }
+
+        if (shard == NULL)
         {
             shard = siridb_shard_create(
                     siridb,
@@ -157,6 +285,9 @@ int siridb_shards_add_points(
             }
         }
 
+        series->shard = shard;
+        series->shard_gen = siridb->shards_gen;
+
         for (   start = end;
                 end < points->len && points->data[end].ts < shard_end;
                 end++);
@@ -176,6 +307,8 @@ int siridb_shards_add_points(
                     pend = end;
                 }
 
+                siridb_points_stats(&stats, points, pstart, pend);
+
                 if ((pos = siridb_shard_write_points(
                         siridb,
                         series,
@@ -183,6 +316,7 @@ int siridb_shards_add_points(
                         points,
                         pstart,
                         pend,
+                        &stats,
                         NULL)) < 0)
                 {
                     log_critical(
@@ -197,7 +331,9 @@ int siridb_shards_add_points(
                             points->data[pstart].ts,
                             points->data[pend - 1].ts,
                             pos,
-                            pend - pstart);
+                            pend - pstart,
+                            (uint16_t) (shard->size - pos),
+                            &stats);
                     if (shard->replacing != NULL)
                     {
                         siridb_shard_write_points(
@@ -207,12 +343,16 @@ int siridb_shards_add_points(
                                points,
                                pstart,
                                pend,
+                               &stats,
                                NULL);
                     }
                 }
             }
         }
     }
+
+    SIRI_TRACE2(buffer__flush__done, series->id, siri_err);
+
     return siri_err;
 }
 
@@ -237,7 +377,8 @@ static bool is_shard_fn(const char * fn, const char * ext)
 }
 
 /*
- * Returns true if fn is a temp shard or index filename, false if not.
+ * Returns true if fn is a temp shard, index or checkpoint filename, false if
+ * not.
  */
 static bool is_temp_fn(const char * fn)
 {
@@ -248,5 +389,405 @@ static bool is_temp_fn(const char * fn)
             return false;
         }
     }
-    return is_shard_fn(fn, ".sdb") || is_shard_fn(fn, ".idx");
+    return (is_shard_fn(fn, ".sdb") ||
+            is_shard_fn(fn, ".idx") ||
+            is_shard_fn(fn, ".chk"));
+}
+
+/*
+ * Returns true when temporary file 'fn' belongs to an optimize which can be
+ * continued. This requires a checkpoint, the temporary shard file and the
+ * shard which is optimized. Temporary files are sorted as .chk, .idx and
+ * .sdb so removing one of them never leaves a checkpoint without a shard.
+ */
+static bool SHARDS_can_resume(const char * path, const char * fn)
+{
+    char buffer[PATH_MAX];
+    uint64_t id = (uint64_t) atoll(fn + 2);
+
+    snprintf(buffer, PATH_MAX, "%s__%" PRIu64 ".chk", path, id);
+    if (!xpath_file_exist(buffer))
+    {
+        return false;
+    }
+
+    snprintf(buffer, PATH_MAX, "%s__%" PRIu64 ".sdb", path, id);
+    if (!xpath_file_exist(buffer))
+    {
+        return false;
+    }
+
+    snprintf(buffer, PATH_MAX, "%s%" PRIu64 ".sdb", path, id);
+    return xpath_file_exist(buffer);
+}
+
+/*
+ * Load cold shards which might contain points for 'series' between 'start_ts'
+ * and 'end_ts'. (start_ts and end_ts may be NULL) This function must be called
+ * while holding the series_mutex for writing.
+ *
+ * Returns 0 if successful or -1 when one of the shards could not be loaded or
+ * in case of a memory error. (a SIGNAL might be raised)
+ */
+int siridb_shards_load_cold(
+        siridb_t * siridb,
+        siridb_series_t * series,
+        uint64_t * start_ts,
+        uint64_t * end_ts)
+{
+    return SHARDS_cold(siridb, series, start_ts, end_ts, 1);
+}
+
+/*
+ * Returns 1 when siridb_shards_load_cold() has cold shards to load for the
+ * same arguments, 0 if not or -1 in case of a memory error. This function
+ * must be called while holding the series_mutex. (a SIGNAL might be raised)
+ */
+int siridb_shards_has_cold(
+        siridb_t * siridb,
+        siridb_series_t * series,
+        uint64_t * start_ts,
+        uint64_t * end_ts)
+{
+    return SHARDS_cold(siridb, series, start_ts, end_ts, 0);
+}
+
+/*
+ * Release the index of the least recently used shards when the indexes of all
+ * series use more than index_memory_limit. Indexes are released until they
+ * use less than 3/4 of the limit. The shards become cold and are loaded again
+ * as soon as they are used.
+ *
+ * Returns the number of released shards or -1 in case of an error.
+ * (a SIGNAL is raised in case of an error)
+ */
+int siridb_shards_evict(siridb_t * siridb)
+{
+    slist_t * slshards;
+    siridb_shard_t * shard;
+    size_t limit, total, n = 0;
+
+    /* a limit for the database replaces the global limit */
+    limit = (siridb->index_memory_limit) ?
+            siridb->index_memory_limit : siri.cfg->index_memory_limit;
+
+    if (!limit)
+    {
+        return 0;
+    }
+
+    /* limit as number of indexes */
+    limit = limit * 1048576 / sizeof(idx_t);
+
+    siri_mutex_lock(&siridb->shards_mutex);
+    slshards = imap_2slist_ref(siridb->shards);
+    siri_mutex_unlock(&siridb->shards_mutex);
+
+    if (slshards == NULL)
+    {
+        ERR_ALLOC
+        return -1;
+    }
+
+    siri_rwlock_wrlock(&siridb->series_mutex);
+
+    for (size_t i = 0; i < slshards->len; i++)
+    {
+        shard = (siridb_shard_t *) slshards->data[i];
+        shard->nidx = 0;
+    }
+
+    total = (size_t) dmap_walk(
+            siridb->series_map,
+            (imap_cb) SHARDS_count_idx,
+            NULL);
+
+    if (total > limit)
+    {
+        qsort(  slshards->data,
+                slshards->len,
+                sizeof(void *),
+                SHARDS_cmp_accessed);
+
+        for (   size_t i = 0;
+                i < slshards->len && total > limit / 4 * 3;
+                i++)
+        {
+            shard = (siridb_shard_t *) slshards->data[i];
+
+            if (shard->nidx && siridb_shard_can_evict(shard))
+            {
+                siridb_shard_evict(shard);
+                total -= shard->nidx;
+                n++;
+            }
+        }
+
+        if (n)
+        {
+            dmap_walk(
+                    siridb->series_map,
+                    (imap_cb) siridb_series_evict_cold,
+                    NULL);
+
+            siri_mutex_lock(&siridb->shards_mutex);
+            siridb->cold_shards += n;
+            siri_mutex_unlock(&siridb->shards_mutex);
+        }
+    }
+
+    siri_rwlock_wrunlock(&siridb->series_mutex);
+
+    for (size_t i = 0; i < slshards->len; i++)
+    {
+        shard = (siridb_shard_t *) slshards->data[i];
+        siridb_shard_decref(shard);
+    }
+
+    slist_free(slshards);
+
+    if (n)
+    {
+        log_info(
+                "Released the index of %zu shard(s) for database '%s'",
+                n,
+                siridb->dbname);
+    }
+
+    return (int) n;
+}
+
+/*
+ * Drop the shards which only contain points older than the expiration
+ * settings of the database. Shards are only dropped as a whole, so points
+ * are kept until the last point of a shard has expired.
+ *
+ * Returns the number of dropped shards or -1 in case of an error.
+ * (a SIGNAL is raised in case of an error)
+ */
+int siridb_shards_expire(siridb_t * siridb)
+{
+    struct timespec now;
+    uint64_t ts, num_ts = 0, log_ts = 0;
+    int n;
+
+    if (!siridb->expiration_num && !siridb->expiration_log)
+    {
+        return 0;
+    }
+
+    clock_gettime(CLOCK_REALTIME, &now);
+    ts = siridb_time_now(siridb, now);
+
+    if (siridb->expiration_num && siridb->expiration_num < ts)
+    {
+        num_ts = ts - siridb->expiration_num;
+    }
+    if (siridb->expiration_log && siridb->expiration_log < ts)
+    {
+        log_ts = ts - siridb->expiration_log;
+    }
+
+    n = siridb_shard_drop_expired(siridb, num_ts, log_ts);
+
+    if (n > 0)
+    {
+        log_info(
+                "Dropped %d expired shard(s) for database '%s'",
+                n,
+                siridb->dbname);
+    }
+
+    return n;
+}
+
+static int SHARDS_cmp_id(const void * a, const void * b)
+{
+    uint64_t ia = *((const uint64_t *) a);
+    uint64_t ib = *((const uint64_t *) b);
+    return (ia > ib) - (ia < ib);
+}
+
+static int SHARDS_cmp_accessed(const void * a, const void * b)
+{
+    uint32_t ia = (*((siridb_shard_t * const *) a))->accessed;
+    uint32_t ib = (*((siridb_shard_t * const *) b))->accessed;
+    return (ia > ib) - (ia < ib);
+}
+
+/*
+ * Count the indexes for each shard. Returns the number of indexes for the
+ * series. (used with dmap_walk)
+ */
+static int SHARDS_count_idx(
+        siridb_series_t * series,
+        void * args __attribute__((unused)))
+{
+    for (uint32_t i = 0; i < series->idx_len; i++)
+    {
+        series->idx[i].shard->nidx++;
+    }
+    return (int) series->idx_len;
+}
+
+/*
+ * Thread for loading shards. Each thread takes the next shard from the list
+ * until all shards are loaded or an error has occurred.
+ */
+static void SHARDS_load_worker(void * arg)
+{
+    shards_load_t * load = (shards_load_t *) arg;
+    size_t step = load->len / SHARDS_LOAD_PROGRESS + 1;
+    size_t i;
+    uint64_t id;
+
+    while (1)
+    {
+        uv_mutex_lock(&load->lock);
+
+        if (load->rc || siri_err || load->next == load->len)
+        {
+            uv_mutex_unlock(&load->lock);
+            return;
+        }
+
+        i = load->next++;
+        id = load->ids[i];
+
+        if (i && i % step == 0)
+        {
+            log_info(
+                    "Loading shards for database '%s': %zu of %zu",
+                    load->siridb->dbname,
+                    i,
+                    load->len);
+        }
+
+        uv_mutex_unlock(&load->lock);
+
+        if (siridb_shard_load(load->siridb, id))
+        {
+            log_error("Error while loading shard: '%" PRIu64 "'", id);
+
+            uv_mutex_lock(&load->lock);
+            load->rc = -1;
+            uv_mutex_unlock(&load->lock);
+        }
+    }
+}
+
+/*
+ * Load the cold shards for siridb_shards_load_cold(), or when 'load' is 0,
+ * return 1 as soon as a shard is found which would be loaded.
+ */
+static int SHARDS_cold(
+        siridb_t * siridb,
+        siridb_series_t * series,
+        uint64_t * start_ts,
+        uint64_t * end_ts,
+        int load)
+{
+    siridb_shard_t * shard;
+    slist_t * slist;
+    uint64_t duration, ts, id, lookups = 0;
+    uint8_t dclass;
+    int rc = 0;
+
+    if (!siridb->cold_shards || !siridb_series_isnum(series))
+    {
+        return 0;
+    }
+
+    if (start_ts != NULL && end_ts != NULL && *start_ts < *end_ts)
+    {
+        /* a series can have shards of each duration which is used */
+        for (dclass = 0; dclass <= SIRIDB_DURATIONS_SZ; dclass++)
+        {
+            if (siridb->shard_dclasses & (1 << dclass))
+            {
+                duration = siridb_durations_get(siridb, dclass);
+                lookups += (*end_ts - *start_ts) / duration + 1;
+            }
+        }
+    }
+
+    if (lookups && lookups <= siridb->shards->len)
+    {
+        /* look up the shards in the time range */
+        for (dclass = 0; dclass <= SIRIDB_DURATIONS_SZ; dclass++)
+        {
+            if (~siridb->shard_dclasses & (1 << dclass))
+            {
+                continue;
+            }
+
+            duration = siridb_durations_get(siridb, dclass);
+            id = series->mask + (uint64_t) dclass * siridb->shard_mask_num;
+
+            for (   ts = *start_ts - *start_ts % duration;
+                    ts < *end_ts;
+                    ts += duration)
+            {
+                siri_mutex_lock(&siridb->shards_mutex);
+                shard = imap_get(siridb->shards, ts + id);
+                siri_mutex_unlock(&siridb->shards_mutex);
+
+                if (shard == NULL || !shard->is_cold)
+                {
+                    continue;
+                }
+
+                if (!load)
+                {
+                    return 1;
+                }
+
+                if (siridb_shard_load_cold(siridb, shard))
+                {
+                    rc = -1;
+                }
+            }
+        }
+        return rc;
+    }
+
+    siri_mutex_lock(&siridb->shards_mutex);
+    slist = imap_2slist(siridb->shards);
+    siri_mutex_unlock(&siridb->shards_mutex);
+
+    if (slist == NULL)
+    {
+        return -1;  /* signal is raised */
+    }
+
+    for (size_t i = 0; i < slist->len; i++)
+    {
+        shard = (siridb_shard_t *) slist->data[i];
+        ts = SIRIDB_SHARD_START(shard);
+
+        if (    !shard->is_cold ||
+                shard->tp != SIRIDB_SHARD_TP_NUMBER ||
+                siridb_durations_mask(siridb, shard->tp, shard->id) !=
+                    series->mask ||
+                (start_ts != NULL && ts + shard->duration <= *start_ts) ||
+                (end_ts != NULL && ts >= *end_ts))
+        {
+            continue;
+        }
+
+        if (!load)
+        {
+            rc = 1;
+            break;
+        }
+
+        if (siridb_shard_load_cold(siridb, shard))
+        {
+            rc = -1;
+        }
+    }
+
+    slist_free(slist);
+
+    return rc;
 }
@@ -0,0 +1,280 @@
+/*
+ * shash.c - Hash index on series names.
+ *
+ * author       : Jeroen van der Heijden
+ * email        : jeroen@transceptor.technology
+ * copyright    : 2016, Transceptor Technology
+ *
+ * The index is an open addressing table with linear probing which maps a
+ * series name to the series. Each entry holds the hash of the name so most
+ * entries can be skipped without comparing the name and the table can grow
+ * without hashing the names again.
+ *
+ * The key of a name also contains the sum used for the pool lookup so the
+ * insert path only needs to read a series name once to find both the pool
+ * and the series.
+ *
+ * changes
+ *  - initial version, 14-10-2016
+ *
+ */
+#include <assert.h>
+#include <logger/logger.h>
+#include <siri/db/shash.h>
+#include <siri/err.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SHASH_INITIAL_SIZE 1024
+
+/* FNV-1a */
+#define SHASH_FNV_OFFSET 2166136261U
+#define SHASH_FNV_PRIME 16777619U
+
+static int SHASH_grow(siridb_shash_t * shash);
+static uint32_t SHASH_find(
+        siridb_shash_t * shash,
+        uint32_t hash,
+        const char * name,
+        size_t len);
+
+/*
+ * Returns NULL and raises a SIGNAL in case an error has occurred.
+ */
+siridb_shash_t * siridb_shash_new(void)
+{
+    siridb_shash_t * shash =
+            (siridb_shash_t *) malloc(sizeof(siridb_shash_t));
+    if (shash == NULL)
+    {
+        ERR_ALLOC
+    }
+    else
+    {
+        shash->is_valid = 1;
+        shash->len = 0;
+        shash->mask = SHASH_INITIAL_SIZE - 1;
+        shash->entries = (siridb_shash_entry_t *) calloc(
+                SHASH_INITIAL_SIZE,
+                sizeof(siridb_shash_entry_t));
+        if (shash->entries == NULL)
+        {
+            ERR_ALLOC
+            free(shash);
+            shash = NULL;
+        }
+    }
+    return shash;
+}
+
+void siridb_shash_free(siridb_shash_t * shash)
+{
+    if (shash != NULL)
+    {
+        free(shash->entries);
+        free(shash);
+    }
+}
+
+/*
+ * Set the hash and pool lookup sum for a series name.
+ */
+void siridb_shash_key(
+        siridb_shash_key_t * key,
+        const char * name,
+        size_t len)
+{
+    uint32_t hash = SHASH_FNV_OFFSET;
+    uint32_t sum = 0;
+
+    for (; len--; name++)
+    {
+        /* the pool lookup uses the (signed) char value */
+        sum += *name;
+        hash = (hash ^ (uint8_t) *name) * SHASH_FNV_PRIME;
+    }
+
+    key->hash = hash;
+    key->sum = sum;
+}
+
+/*
+ * Add a series to the index. When this fails the index is no longer used
+ * since it would miss the series. This is logged but no signal is raised.
+ */
+void siridb_shash_add(siridb_shash_t * shash, siridb_series_t * series)
+{
+    siridb_shash_key_t key;
+    uint32_t i;
+
+    if (shash == NULL || !shash->is_valid)
+    {
+        return;
+    }
+
+    /* keep the load factor at most 0.75 */
+    if (    (shash->len + 1) * 4 > (shash->mask + 1) * 3 &&
+            SHASH_grow(shash))
+    {
+        log_error(
+                "Cannot add series '%s' to the hash index, the index is no "
+                "longer used",
+                series->name);
+        shash->is_valid = 0;
+        free(shash->entries);
+        shash->entries = NULL;
+        return;
+    }
+
+    siridb_shash_key(&key, series->name, series->name_len);
+
+    i = SHASH_find(shash, key.hash, series->name, series->name_len);
+
+#ifdef DEBUG
+    assert (shash->entries[i].series == NULL);
+#endif
+
+    shash->entries[i].hash = key.hash;
+    shash->entries[i].series = series;
+    shash->len++;
+}
+
+void siridb_shash_remove(siridb_shash_t * shash, siridb_series_t * series)
+{
+    siridb_shash_key_t key;
+    siridb_shash_entry_t * entries;
+    uint32_t i, j, k;
+
+    if (shash == NULL || !shash->is_valid)
+    {
+        return;
+    }
+
+    entries = shash->entries;
+    siridb_shash_key(&key, series->name, series->name_len);
+
+    i = SHASH_find(shash, key.hash, series->name, series->name_len);
+
+    if (entries[i].series == NULL)
+    {
+        return;
+    }
+
+    /*
+     * Shift following entries back so no entry is found after an empty
+     * entry. An entry stays when its position is between the empty entry
+     * and the entry itself.
+     */
+    for (j = i;;)
+    {
+        j = (j + 1) & shash->mask;
+
+        if (entries[j].series == NULL)
+        {
+            break;
+        }
+
+        k = entries[j].hash & shash->mask;
+
+        if ((i <= j) ? (i < k && k <= j) : (i < k || k <= j))
+        {
+            continue;
+        }
+
+        entries[i] = entries[j];
+        i = j;
+    }
+
+    entries[i].series = NULL;
+    shash->len--;
+}
+
+/*
+ * Returns the series or NULL when not found. The key must be created from
+ * the same name.
+ *
+ * Note: 'name' does not need to be terminated.
+ */
+siridb_series_t * siridb_shash_get(
+        siridb_shash_t * shash,
+        siridb_shash_key_t * key,
+        const char * name,
+        size_t len)
+{
+    return shash->entries[SHASH_find(shash, key->hash, name, len)].series;
+}
+
+/*
+ * Returns the position of the series name or the empty position where the
+ * name should be added.
+ */
+static uint32_t SHASH_find(
+        siridb_shash_t * shash,
+        uint32_t hash,
+        const char * name,
+        size_t len)
+{
+    siridb_shash_entry_t * entry;
+    uint32_t i = hash & shash->mask;
+
+    for (;; i = (i + 1) & shash->mask)
+    {
+        entry = shash->entries + i;
+
+        if (    entry->series == NULL || (
+                entry->hash == hash &&
+                entry->series->name_len == len &&
+                memcmp(entry->series->name, name, len) == 0))
+        {
+            return i;
+        }
+    }
+}
+
+/*
+ * Double the size of the index.
+ *
+ * Returns 0 if successful or -1 in case of an error. (in case of an error
+ * the index is unchanged)
+ */
+static int SHASH_grow(siridb_shash_t * shash)
+{
+    siridb_shash_entry_t * entries = shash->entries;
+    uint32_t mask = shash->mask;
+    uint32_t i, j;
+
+    if (mask == UINT32_MAX >> 1)
+    {
+        return -1;
+    }
+
+    shash->entries = (siridb_shash_entry_t *) calloc(
+            (size_t) mask + 1,
+            2 * sizeof(siridb_shash_entry_t));
+
+    if (shash->entries == NULL)
+    {
+        shash->entries = entries;
+        return -1;
+    }
+
+    shash->mask = mask * 2 + 1;
+
+    for (i = 0; i <= mask; i++)
+    {
+        if (entries[i].series == NULL)
+        {
+            continue;
+        }
+
+        for (j = entries[i].hash & shash->mask;
+             shash->entries[j].series != NULL;
+             j = (j + 1) & shash->mask);
+
+        shash->entries[j] = entries[i];
+    }
+
+    free(entries);
+
+    return 0;
+}
@@ -0,0 +1,147 @@
+/*
+ * slab.c - Allocate objects of a fixed size from large blocks.
+ *
+ * author       : Jeroen van der Heijden
+ * email        : jeroen@transceptor.technology
+ * copyright    : 2016, Transceptor Technology
+ *
+ * Series objects are created and dropped during the whole life time of the
+ * process. With a malloc() for each series, the heap gets fragmented by the
+ * small objects between the larger index and buffer allocations. A slab
+ * keeps the objects together in blocks and re-uses released objects before
+ * a new block is allocated.
+ *
+ * Blocks are only freed with the slab. Objects can be allocated and released
+ * by any thread.
+ *
+ * changes
+ *  - initial version, 14-10-2016
+ *
+ */
+#include <siri/db/slab.h>
+#include <siri/err.h>
+#include <stdlib.h>
+
+/* objects are aligned so they can contain any type of member */
+#define SLAB_ALIGN 16
+#define SLAB_ALIGNED(sz) (((sz) + (SLAB_ALIGN - 1)) & ~(SLAB_ALIGN - 1))
+
+struct siridb_slab_block_s
+{
+    siridb_slab_block_t * prev;
+    size_t len;         /* number of objects which are handed out */
+    char data[] __attribute__((aligned(SLAB_ALIGN)));
+};
+
+/*
+ * Returns a slab for objects of 'size' bytes, which are allocated in blocks
+ * of 'n' objects.
+ *
+ * Returns NULL and raises a SIGNAL in case an error has occurred.
+ */
+siridb_slab_t * siridb_slab_new(size_t size, size_t n)
+{
+    siridb_slab_t * slab = (siridb_slab_t *) malloc(sizeof(siridb_slab_t));
+    if (slab == NULL)
+    {
+        ERR_ALLOC
+    }
+    else
+    {
+        /* a released object must fit the pointer to the next one */
+        slab->size = SLAB_ALIGNED(size < sizeof(void *) ?
+                sizeof(void *) : size);
+        slab->n = n;
+        slab->len = 0;
+        slab->free = NULL;
+        slab->block = NULL;
+        uv_mutex_init(&slab->lock);
+    }
+    return slab;
+}
+
+/*
+ * Destroy the slab and all objects allocated from it. (parsing NULL is
+ * allowed)
+ */
+void siridb_slab_free(siridb_slab_t * slab)
+{
+    siridb_slab_block_t * block;
+    siridb_slab_block_t * prev;
+
+    if (slab == NULL)
+    {
+        return;
+    }
+
+    for (block = slab->block; block != NULL; block = prev)
+    {
+        prev = block->prev;
+        free(block);
+    }
+
+    uv_mutex_destroy(&slab->lock);
+    free(slab);
+}
+
+/*
+ * Returns an object from the slab. The object is not initialized.
+ *
+ * Returns NULL and raises a SIGNAL in case an error has occurred.
+ */
+void * siridb_slab_alloc(siridb_slab_t * slab)
+{
+    siridb_slab_block_t * block;
+    void * obj;
+
+    uv_mutex_lock(&slab->lock);
+
+    if (slab->free != NULL)
+    {
+        obj = slab->free;
+        slab->free = *((void **) obj);
+    }
+    else
+    {
+        block = slab->block;
+
+        if (block == NULL || block->len == slab->n)
+        {
+            block = (siridb_slab_block_t *) malloc(
+                    sizeof(siridb_slab_block_t) + slab->n * slab->size);
+            if (block == NULL)
+            {
+                uv_mutex_unlock(&slab->lock);
+                ERR_ALLOC
+                return NULL;
+            }
+            block->prev = slab->block;
+            block->len = 0;
+            slab->block = block;
+        }
+
+        obj = block->data + block->len * slab->size;
+        block->len++;
+    }
+
+    slab->len++;
+
+    uv_mutex_unlock(&slab->lock);
+
+    return obj;
+}
+
+/*
+ * Return an object to the slab. The object is re-used by the next call to
+ * siridb_slab_alloc().
+ */
+void siridb_slab_release(siridb_slab_t * slab, void * obj)
+{
+    uv_mutex_lock(&slab->lock);
+
+    *((void **) obj) = slab->free;
+    slab->free = obj;
+    slab->len--;
+
+    uv_mutex_unlock(&slab->lock);
+}
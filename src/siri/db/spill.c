@@ -0,0 +1,259 @@
+/*
+ * spill.c - Move select results to a temporary file.
+ *
+ * author       : Jeroen van der Heijden
+ * email        : jeroen@transceptor.technology
+ * copyright    : 2016, Transceptor Technology
+ *
+ * When a select has reached its memory budget (see query_memory_limit and
+ * query_memory_total in siridb.conf), the points for each next series are
+ * written to a temporary file which is mapped back in memory. The pages of
+ * a mapped file are only read when they are used and can be dropped again
+ * by the kernel, so spilled results do not count as memory. All code which
+ * reads points works with spilled points, they are only destroyed by
+ * siridb_points_free() since the data is not allocated with malloc().
+ *
+ * The mapping is private so changing a point only changes the copy in
+ * memory. Each result starts at a page with a small header which holds the
+ * size of the mapping. The file is deleted once it is created and disappears
+ * when the query is finished and the last mapping is released.
+ *
+ * The temporary file is created in TMPDIR or in /tmp.
+ *
+ * changes
+ *  - initial version, 14-10-2016
+ *
+ */
+#include <errno.h>
+#include <limits.h>
+#include <logger/logger.h>
+#include <siri/db/spill.h>
+#include <siri/err.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+/* keeps the points after the header aligned at 16 bytes */
+typedef struct spill_head_s
+{
+    size_t size;            /* size of the mapping */
+    size_t pad_;
+} spill_head_t;
+
+static int SPILL_open(void);
+static int SPILL_write(int fd, const void * data, size_t size, off_t offset);
+
+/*
+ * Returns NULL and raises a SIGNAL in case an error has occurred.
+ *
+ * The file is only created when points are spilled.
+ */
+siridb_spill_t * siridb_spill_new(void)
+{
+    siridb_spill_t * spill = (siridb_spill_t *) malloc(sizeof(siridb_spill_t));
+    if (spill == NULL)
+    {
+        ERR_ALLOC
+        return NULL;
+    }
+
+    spill->fd = -1;
+    spill->size = 0;
+    uv_mutex_init(&spill->lock);
+
+    return spill;
+}
+
+/*
+ * Close the file. Points which are spilled to the file remain valid. (parsing
+ * NULL is allowed)
+ */
+void siridb_spill_free(siridb_spill_t * spill)
+{
+    if (spill == NULL)
+    {
+        return;
+    }
+
+    if (spill->fd != -1)
+    {
+        close(spill->fd);
+    }
+
+    uv_mutex_destroy(&spill->lock);
+    free(spill);
+}
+
+/*
+ * Returns 1 (true) when points of type 'tp' and length 'len' can be spilled.
+ * Points with string content and small results are not spilled.
+ */
+int siridb_spill_can_use(points_tp tp, size_t len)
+{
+    return tp != TP_STRING &&
+            len * sizeof(siridb_point_t) >= SIRIDB_SPILL_MIN_SIZE;
+}
+
+/*
+ * Returns new points with a copy of 'len' points from 'data' which are
+ * stored in the file of 'spill'. This function can be called by multiple
+ * threads at the same time.
+ *
+ * Returns NULL in case of an error. A SIGNAL is raised when an allocation
+ * has failed, other errors are logged.
+ */
+siridb_points_t * siridb_spill_points(
+        siridb_spill_t * spill,
+        points_tp tp,
+        size_t len,
+        const void * data)
+{
+    size_t page = (size_t) sysconf(_SC_PAGESIZE);
+    size_t size = len * sizeof(siridb_point_t);
+    spill_head_t head;
+    siridb_points_t * points;
+    off_t offset;
+    char * map;
+    int fd;
+
+    head.size = (sizeof(spill_head_t) + size + page - 1) / page * page;
+    head.pad_ = 0;
+
+    /* reserve the space in the file, the points are written without lock */
+    uv_mutex_lock(&spill->lock);
+    if (spill->fd == -1)
+    {
+        spill->fd = SPILL_open();
+    }
+    fd = spill->fd;
+    offset = (off_t) spill->size;
+    if (fd != -1)
+    {
+        spill->size += head.size;
+    }
+    uv_mutex_unlock(&spill->lock);
+
+    if (fd == -1)
+    {
+        return NULL;  /* logging is done */
+    }
+
+    if (    SPILL_write(fd, &head, sizeof(spill_head_t), offset) ||
+            SPILL_write(fd, data, size, offset + sizeof(spill_head_t)))
+    {
+        log_error("Cannot write select results to a temporary file (%s)",
+                strerror(errno));
+        return NULL;
+    }
+
+    map = (char *) mmap(
+            NULL,
+            head.size,
+            PROT_READ | PROT_WRITE,
+            MAP_PRIVATE,
+            fd,
+            offset);
+
+    if (map == MAP_FAILED)
+    {
+        log_error("Cannot map select results from a temporary file (%s)",
+                strerror(errno));
+        return NULL;
+    }
+
+    points = (siridb_points_t *) malloc(sizeof(siridb_points_t));
+    if (points == NULL)
+    {
+        ERR_ALLOC
+        munmap(map, head.size);
+        return NULL;
+    }
+
+    points->len = len;
+    points->tp = tp;
+    points->flags = SIRIDB_POINTS_FLAG_SPILLED;
+    points->content = NULL;
+    points->data = (siridb_point_t *) (map + sizeof(spill_head_t));
+
+    return points;
+}
+
+/*
+ * Release the mapping of spilled points. (see siridb_points_free())
+ */
+void siridb_spill_unmap(siridb_point_t * data)
+{
+    spill_head_t * head =
+            (spill_head_t *) ((char *) data - sizeof(spill_head_t));
+
+    munmap(head, head->size);
+}
+
+/*
+ * Returns a file descriptor or -1 in case of an error. (the error is logged)
+ */
+static int SPILL_open(void)
+{
+    const char * tmpdir = getenv("TMPDIR");
+    char path[PATH_MAX];
+    int fd;
+
+    if (tmpdir == NULL || !*tmpdir)
+    {
+        tmpdir = P_tmpdir;
+    }
+
+    if (snprintf(
+            path,
+            PATH_MAX,
+            "%s/siridb-spill-XXXXXX",
+            tmpdir) >= PATH_MAX)
+    {
+        log_error("Temporary directory is too long: '%s'", tmpdir);
+        return -1;
+    }
+
+    if ((fd = mkstemp(path)) == -1)
+    {
+        log_error("Cannot create a temporary file in '%s' (%s)",
+                tmpdir,
+                strerror(errno));
+        return -1;
+    }
+
+    /* the file is deleted when the last mapping is released */
+    unlink(path);
+
+    log_debug("Select results are moved to a temporary file in '%s'", tmpdir);
+
+    return fd;
+}
+
+/*
+ * Returns 0 if successful or -1 in case of an error. (errno is set)
+ */
+static int SPILL_write(int fd, const void * data, size_t size, off_t offset)
+{
+    const char * pt = (const char *) data;
+    ssize_t n;
+
+    while (size)
+    {
+        n = pwrite(fd, pt, size, offset);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return -1;
+        }
+        pt += n;
+        size -= n;
+        offset += n;
+    }
+
+    return 0;
+}
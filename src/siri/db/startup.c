@@ -0,0 +1,250 @@
+/*
+ * startup.c - Time, bytes and objects for each phase of loading a database.
+ *
+ * author       : Jeroen van der Heijden
+ * email        : jeroen@transceptor.technology
+ * copyright    : 2016, Transceptor Technology
+ *
+ * siridb_new() calls siridb_startup_phase() at the end of each phase. The
+ * bytes of a phase are the sizes of the files which are read in that phase
+ * so they are taken from the file system and not counted while reading.
+ *
+ * changes
+ *  - initial version, 14-10-2016
+ *
+ */
+#include <logger/logger.h>
+#include <siri/db/buffer.h>
+#include <siri/db/db.h>
+#include <siri/db/hotlog.h>
+#include <siri/db/series.h>
+#include <siri/db/shard.h>
+#include <siri/db/startup.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <timeit/timeit.h>
+
+#define STARTUP_LINE_SZ 96
+
+static uint64_t STARTUP_fsize(const char * path, const char * fn);
+static int STARTUP_shard_size(siridb_shard_t * shard, uint64_t * bytes);
+
+static const char * startup_str[SIRIDB_STARTUP_END] = {
+        "database",
+        "users",
+        "servers",
+        "series",
+        "buffer",
+        "shards",
+        "hotlog",
+        "groups",
+        "props",
+        "pools",
+        "peers"
+};
+
+/* files in the database path which are read by each phase */
+static const char * startup_files[SIRIDB_STARTUP_END][4] = {
+        {"database.dat", "database.conf", NULL},
+        {"users.dat", NULL},
+        {"servers.dat", NULL},
+        {SIRIDB_SERIES_FN, ".dropped", ".series_snapshot", NULL},
+        {NULL},
+        {NULL},
+        {NULL},
+        {"groups.dat", "rollup.dat", NULL},
+        {NULL},
+        {NULL},
+        {NULL}
+};
+
+void siridb_startup_init(siridb_startup_t * startup, uint64_t start)
+{
+    memset(startup, 0, sizeof(siridb_startup_t));
+    startup->start = start;
+}
+
+/*
+ * Finish a phase with the number of objects which are loaded. The next
+ * phase starts now.
+ */
+void siridb_startup_phase(
+        siridb_t * siridb,
+        siridb_startup_phase_t phase,
+        size_t objects)
+{
+    siridb_startup_t * startup = &siridb->startup;
+    siridb_startup_stat_t * stat = startup->phase + phase;
+    uint64_t now = timeit_ns();
+
+    stat->ns = now - startup->start;
+    stat->objects = objects;
+
+    for (const char ** fn = startup_files[phase]; *fn != NULL; fn++)
+    {
+        stat->bytes += STARTUP_fsize(siridb->dbpath, *fn);
+    }
+
+    switch (phase)
+    {
+    case SIRIDB_STARTUP_BUFFER:
+        stat->bytes = STARTUP_fsize(siridb->buffer_path, SIRIDB_BUFFER_FN);
+        break;
+    case SIRIDB_STARTUP_SHARDS:
+        imap_walk(
+                siridb->shards,
+                (imap_cb) STARTUP_shard_size,
+                &stat->bytes);
+        break;
+    case SIRIDB_STARTUP_HOTLOG:
+        stat->bytes = STARTUP_fsize(siridb->buffer_path, SIRIDB_HOTLOG_FN);
+        break;
+    default:
+        break;
+    }
+
+    startup->start = timeit_ns();
+}
+
+/*
+ * Log the phases when the database is loaded. The peers phase starts now and
+ * finishes when siridb_startup_peers() finds all servers authenticated.
+ */
+void siridb_startup_loaded(siridb_t * siridb)
+{
+    siridb_startup_t * startup = &siridb->startup;
+    siridb_startup_stat_t * stat;
+    uint64_t total = 0;
+
+    startup->loaded = timeit_ns();
+
+    for (int phase = 0; phase < SIRIDB_STARTUP_PEERS; phase++)
+    {
+        total += startup->phase[phase].ns;
+    }
+
+    log_info(
+            "Loaded database '%s' in %.3f seconds:",
+            siridb->dbname,
+            total / 1e9);
+
+    for (int phase = 0; phase < SIRIDB_STARTUP_PEERS; phase++)
+    {
+        stat = startup->phase + phase;
+        log_info(
+                "    %-9s %10.3f ms %5.1f%% %12" PRIu64 " bytes %10zu "
+                "objects",
+                startup_str[phase],
+                stat->ns / 1e6,
+                total ? 100.0 * stat->ns / total : 0.0,
+                stat->bytes,
+                stat->objects);
+    }
+
+    siridb_startup_peers(siridb);
+}
+
+/*
+ * Finish the peers phase when all other servers are authenticated. This is
+ * called each time a server is authenticated.
+ */
+void siridb_startup_peers(siridb_t * siridb)
+{
+    siridb_startup_t * startup = &siridb->startup;
+    siridb_startup_stat_t * stat = startup->phase + SIRIDB_STARTUP_PEERS;
+    siridb_server_t * server;
+
+    if (!startup->loaded || stat->ns)
+    {
+        return;
+    }
+
+    for (llist_node_t * node = siridb->servers->first;
+         node != NULL;
+         node = node->next)
+    {
+        server = (siridb_server_t *) node->data;
+        if (    server != siridb->server &&
+                (~server->flags & SERVER_FLAG_AUTHENTICATED))
+        {
+            return;
+        }
+    }
+
+    /* at least 1 ns so the phase is finished only once */
+    stat->ns = timeit_ns() - startup->loaded + 1;
+    stat->objects = siridb->servers->len - 1;
+
+    if (stat->objects)
+    {
+        log_info(
+                "Authenticated with %zu server(s) of database '%s' "
+                "in %.3f seconds",
+                stat->objects,
+                siridb->dbname,
+                stat->ns / 1e9);
+    }
+}
+
+/*
+ * Returns a string with a line for each phase or NULL in case of an
+ * allocation error. The peers phase is empty when not finished.
+ */
+char * siridb_startup_summary(siridb_t * siridb)
+{
+    char * buf = (char *) malloc(SIRIDB_STARTUP_END * STARTUP_LINE_SZ + 1);
+    char * pt = buf;
+    siridb_startup_stat_t * stat;
+    int n;
+
+    if (buf == NULL)
+    {
+        return NULL;
+    }
+
+    *pt = '\0';
+
+    for (int phase = 0; phase < SIRIDB_STARTUP_END; phase++)
+    {
+        stat = siridb->startup.phase + phase;
+
+        if (phase == SIRIDB_STARTUP_PEERS && !stat->ns)
+        {
+            continue;
+        }
+
+        n = snprintf(
+                pt,
+                STARTUP_LINE_SZ,
+                "%s%s: ms=%.3f bytes=%" PRIu64 " objects=%zu",
+                (pt == buf) ? "" : "\n",
+                startup_str[phase],
+                stat->ns / 1e6,
+                stat->bytes,
+                stat->objects);
+
+        /* snprintf() returns the length without truncating */
+        pt += (n < STARTUP_LINE_SZ) ? n : STARTUP_LINE_SZ - 1;
+    }
+
+    return buf;
+}
+
+/*
+ * Returns the size of a file or 0 when the file does not exist.
+ */
+static uint64_t STARTUP_fsize(const char * path, const char * fn)
+{
+    struct stat st;
+    SIRIDB_GET_FN(full, path, fn)
+
+    return stat(full, &st) ? 0 : (uint64_t) st.st_size;
+}
+
+static int STARTUP_shard_size(siridb_shard_t * shard, uint64_t * bytes)
+{
+    *bytes += shard->size;
+    return 0;
+}
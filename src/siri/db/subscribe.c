@@ -0,0 +1,670 @@
+/*
+ * subscribe.c - Push newly inserted points to subscribed clients.
+ *
+ * author       : Jeroen van der Heijden
+ * email        : jeroen@transceptor.technology
+ * copyright    : 2016, Transceptor Technology
+ *
+ * Live dashboards can subscribe to a series name, a regular expression or a
+ * group instead of polling with selects. Points which are inserted by 'this'
+ * server are collected per subscription and pushed to the client every
+ * SIRIDB_SUBSCRIBE_INTERVAL milliseconds using the pid of the subscribe
+ * request:
+ *
+ *  {"points": [[name, [[ts, val], ...]], ...], "dropped": n}
+ *
+ * A subscription buffers at most SIRIDB_SUBSCRIBE_BUF_SZ bytes. When a client
+ * cannot keep up, no new package is pushed while the socket has queued
+ * packages and points which do not fit in the buffer are dropped and counted.
+ *
+ * Only points for series in the pool of 'this' server are pushed, so a client
+ * should subscribe to a server in each pool to receive all points.
+ *
+ * The matching subscriptions for a series are cached by series id and the
+ * cache is cleared when a subscription is added or removed. A group is
+ * translated to its expression when the subscription is made.
+ *
+ * changes
+ *  - initial version, 14-10-2016
+ *
+ */
+#include <logger/logger.h>
+#include <siri/db/db.h>
+#include <siri/db/group.h>
+#include <siri/db/groups.h>
+#include <siri/db/series.h>
+#include <siri/db/subscribe.h>
+#include <siri/err.h>
+#include <siri/net/pkg.h>
+#include <siri/net/protocol.h>
+#include <siri/net/socket.h>
+#include <siri/siri.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* marks a series without subscriptions in the matches cache */
+static char SUBSCRIBE_no_match;
+
+static void SUBSCRIBE_push_cb(uv_timer_t * timer);
+static void SUBSCRIBE_add(
+        siridb_subscription_t * subscription,
+        siridb_series_t * series,
+        char * pt,
+        char * end);
+static slist_t * SUBSCRIBE_matches(
+        siridb_subscriptions_t * subscriptions,
+        siridb_series_t * series);
+static void SUBSCRIBE_clear_matches(siridb_subscriptions_t * subscriptions);
+static int SUBSCRIBE_free_match(slist_t * match);
+static void SUBSCRIBE_remove(
+        siridb_subscriptions_t * subscriptions,
+        size_t i);
+static void SUBSCRIBE_free(siridb_subscription_t * subscription);
+
+/*
+ * Returns NULL and raises a SIGNAL in case an error has occurred.
+ */
+siridb_subscriptions_t * siridb_subscriptions_new(void)
+{
+    siridb_subscriptions_t * subscriptions =
+            (siridb_subscriptions_t *) malloc(sizeof(siridb_subscriptions_t));
+    if (subscriptions == NULL)
+    {
+        ERR_ALLOC
+        return NULL;
+    }
+
+    subscriptions->slist = slist_new(SLIST_DEFAULT_SIZE);
+    subscriptions->matches = imap_new();
+    subscriptions->timer = (uv_timer_t *) malloc(sizeof(uv_timer_t));
+
+    if (    subscriptions->slist == NULL ||
+            subscriptions->matches == NULL ||
+            subscriptions->timer == NULL)
+    {
+        ERR_ALLOC
+        free(subscriptions->timer);
+        subscriptions->timer = NULL;
+        siridb_subscriptions_free(subscriptions);
+        return NULL;
+    }
+
+    subscriptions->timer->data = subscriptions;
+    uv_timer_init(siri.loop, subscriptions->timer);
+
+    return subscriptions;
+}
+
+/*
+ * Remove all subscriptions and close the timer. This must be called before
+ * siridb_subscriptions_free() since the subscriptions keep a reference to
+ * the client.
+ */
+void siridb_subscriptions_close(siridb_subscriptions_t * subscriptions)
+{
+    while (subscriptions->slist->len)
+    {
+        SUBSCRIBE_remove(subscriptions, subscriptions->slist->len - 1);
+    }
+
+    SUBSCRIBE_clear_matches(subscriptions);
+
+    if (subscriptions->timer != NULL)
+    {
+        /* we can use uv_timer_stop() even if the timer is not scheduled */
+        uv_timer_stop(subscriptions->timer);
+        uv_close((uv_handle_t *) subscriptions->timer, (uv_close_cb) free);
+        subscriptions->timer = NULL;
+    }
+}
+
+/*
+ * Destroy the subscriptions. Make sure to call siridb_subscriptions_close()
+ * first. (parsing NULL is allowed)
+ */
+void siridb_subscriptions_free(siridb_subscriptions_t * subscriptions)
+{
+    if (subscriptions == NULL)
+    {
+        return;
+    }
+
+    if (subscriptions->slist != NULL)
+    {
+        for (size_t i = 0; i < subscriptions->slist->len; i++)
+        {
+            SUBSCRIBE_free(
+                    (siridb_subscription_t *) subscriptions->slist->data[i]);
+        }
+        slist_free(subscriptions->slist);
+    }
+
+    if (subscriptions->matches != NULL)
+    {
+        imap_free(subscriptions->matches, (imap_free_cb) SUBSCRIBE_free_match);
+    }
+
+    free(subscriptions);
+}
+
+/*
+ * Subscribe 'client' to a series set. The unpacker should contain
+ * (tp, source) where 'tp' is one of the SIRIDB_SUBSCRIBE_* types. Points are
+ * pushed using 'pid', which can be used to unsubscribe.
+ *
+ * Returns 0 if successful or -1 and 'err_msg' is set in case of an error.
+ * (a SIGNAL might be raised)
+ */
+int siridb_subscribe(
+        siridb_t * siridb,
+        uv_stream_t * client,
+        uint16_t pid,
+        qp_unpacker_t * unpacker,
+        char * err_msg)
+{
+    siridb_subscriptions_t * subscriptions;
+    siridb_subscription_t * subscription;
+    siridb_group_t * group;
+    qp_obj_t qp_tp, qp_source;
+
+    if (    !qp_is_array(qp_next(unpacker, NULL)) ||
+            qp_next(unpacker, &qp_tp) != QP_INT64 ||
+            qp_next(unpacker, &qp_source) != QP_RAW ||
+            qp_tp.via.int64 < SIRIDB_SUBSCRIBE_SERIES ||
+            qp_tp.via.int64 > SIRIDB_SUBSCRIBE_GROUP)
+    {
+        sprintf(err_msg, "Expecting an array with (type, series set).");
+        return -1;
+    }
+
+    /* the length of a terminated raw source includes the terminator */
+    if (qp_is_raw_term(&qp_source))
+    {
+        qp_source.len--;
+    }
+
+    if (!qp_source.len || qp_source.len >= SIRIDB_SERIES_NAME_LEN_MAX)
+    {
+        sprintf(err_msg, "Expecting a series name, expression or group.");
+        return -1;
+    }
+
+    if (    siridb->subscriptions == NULL &&
+            (siridb->subscriptions = siridb_subscriptions_new()) == NULL)
+    {
+        sprintf(err_msg, "Memory allocation error.");
+        return -1;  /* signal is raised */
+    }
+
+    subscriptions = siridb->subscriptions;
+
+    if (subscriptions->timer == NULL)
+    {
+        sprintf(err_msg, "Subscriptions are closed.");
+        return -1;
+    }
+
+    if (subscriptions->slist->len >= SIRIDB_SUBSCRIBE_MAX)
+    {
+        snprintf(err_msg, SIRIDB_MAX_SIZE_ERR_MSG,
+                "Too many subscriptions, the maximum is %d.",
+                SIRIDB_SUBSCRIBE_MAX);
+        return -1;
+    }
+
+    for (size_t i = 0; i < subscriptions->slist->len; i++)
+    {
+        subscription = (siridb_subscription_t *) subscriptions->slist->data[i];
+        if (subscription->client == client && subscription->pid == pid)
+        {
+            snprintf(err_msg, SIRIDB_MAX_SIZE_ERR_MSG,
+                    "A subscription with pid %" PRIu16 " already exists.",
+                    pid);
+            return -1;
+        }
+    }
+
+    char source[qp_source.len + 1];
+    memcpy(source, qp_source.via.raw, qp_source.len);
+    source[qp_source.len] = '\0';
+
+    subscription = (siridb_subscription_t *) calloc(
+            1,
+            sizeof(siridb_subscription_t));
+    if (subscription == NULL)
+    {
+        ERR_ALLOC
+        sprintf(err_msg, "Memory allocation error.");
+        return -1;
+    }
+
+    subscription->pid = pid;
+    subscription->tp = (uint8_t) qp_tp.via.int64;
+    subscription->client = client;
+
+    switch (subscription->tp)
+    {
+    case SIRIDB_SUBSCRIBE_SERIES:
+        subscription->name = strdup(source);
+        if (subscription->name == NULL)
+        {
+            ERR_ALLOC
+            sprintf(err_msg, "Memory allocation error.");
+        }
+        break;
+
+    case SIRIDB_SUBSCRIBE_REGEX:
+        subscription->re = siridb_re_get(
+                siri.re_cache,
+                source,
+                qp_source.len,
+                err_msg);
+        break;
+
+    case SIRIDB_SUBSCRIBE_GROUP:
+        group = (siridb->groups == NULL) ? NULL :
+                (siridb_group_t *) ct_get(siridb->groups->groups, source);
+        if (group == NULL)
+        {
+            snprintf(err_msg, SIRIDB_MAX_SIZE_ERR_MSG,
+                    "Cannot find group: '%s'", source);
+        }
+        else
+        {
+            subscription->re = siridb_re_get(
+                    siri.re_cache,
+                    group->source,
+                    strlen(group->source),
+                    err_msg);
+        }
+        break;
+    }
+
+    if (    (subscription->name == NULL && subscription->re == NULL) ||
+            slist_append_safe(&subscriptions->slist, subscription))
+    {
+        /* the client is not referenced yet */
+        subscription->client = NULL;
+        SUBSCRIBE_free(subscription);
+        if (siri_err)
+        {
+            sprintf(err_msg, "Memory allocation error.");
+        }
+        return -1;
+    }
+
+    sirinet_socket_incref(client);
+    SUBSCRIBE_clear_matches(subscriptions);
+
+    if (subscriptions->slist->len == 1)
+    {
+        uv_timer_start(
+                subscriptions->timer,
+                SUBSCRIBE_push_cb,
+                SIRIDB_SUBSCRIBE_INTERVAL,
+                SIRIDB_SUBSCRIBE_INTERVAL);
+    }
+
+    return 0;
+}
+
+/*
+ * Remove the subscription which is made by 'client' with 'pid'. Points which
+ * are not pushed yet are discarded.
+ *
+ * Returns 0 if successful or -1 when the subscription is not found.
+ */
+int siridb_unsubscribe(
+        siridb_t * siridb,
+        uv_stream_t * client,
+        uint16_t pid)
+{
+    siridb_subscriptions_t * subscriptions = siridb->subscriptions;
+    siridb_subscription_t * subscription;
+
+    if (subscriptions == NULL)
+    {
+        return -1;
+    }
+
+    for (size_t i = 0; i < subscriptions->slist->len; i++)
+    {
+        subscription = (siridb_subscription_t *) subscriptions->slist->data[i];
+        if (subscription->client == client && subscription->pid == pid)
+        {
+            SUBSCRIBE_remove(subscriptions, i);
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
+/*
+ * Remove all subscriptions for 'client'. This is used when the connection
+ * to a client is closed.
+ */
+void siridb_subscribe_kill_client(siridb_t * siridb, uv_stream_t * client)
+{
+    siridb_subscriptions_t * subscriptions = siridb->subscriptions;
+    siridb_subscription_t * subscription;
+
+    if (subscriptions == NULL)
+    {
+        return;
+    }
+
+    for (size_t i = subscriptions->slist->len; i--;)
+    {
+        subscription = (siridb_subscription_t *) subscriptions->slist->data[i];
+        if (subscription->client == client)
+        {
+            SUBSCRIBE_remove(subscriptions, i);
+        }
+    }
+}
+
+/*
+ * Add the points which are added to 'series' to the subscriptions for the
+ * series. Argument 'pt' should point to the array with points for the series
+ * in an insert package which ends at 'end'.
+ *
+ * Use siridb_subscribe_has() to check if the database has subscriptions
+ * before calling this function.
+ */
+void siridb_subscribe_points(
+        siridb_t * siridb,
+        siridb_series_t * series,
+        char * pt,
+        char * end)
+{
+    siridb_subscriptions_t * subscriptions = siridb->subscriptions;
+    slist_t * match = SUBSCRIBE_matches(subscriptions, series);
+
+    if (match == NULL)
+    {
+        return;
+    }
+
+    for (size_t i = 0; i < match->len; i++)
+    {
+        SUBSCRIBE_add(
+                (siridb_subscription_t *) match->data[i],
+                series,
+                pt,
+                end);
+    }
+
+    /* the match is not cached in case of an error */
+    if (    subscriptions->matches == NULL ||
+            imap_get(subscriptions->matches, series->id) != match)
+    {
+        slist_free(match);
+    }
+}
+
+/*
+ * Call-back function: uv_timer_cb
+ *
+ * Push the collected points to the clients which are not busy.
+ */
+static void SUBSCRIBE_push_cb(uv_timer_t * timer)
+{
+    siridb_subscriptions_t * subscriptions =
+            (siridb_subscriptions_t *) timer->data;
+    siridb_subscription_t * subscription;
+    sirinet_socket_t * ssocket;
+    sirinet_pkg_t * pkg;
+
+    for (size_t i = 0; i < subscriptions->slist->len; i++)
+    {
+        subscription = (siridb_subscription_t *) subscriptions->slist->data[i];
+        ssocket = (sirinet_socket_t *) subscription->client->data;
+
+        if (    (subscription->packer == NULL && !subscription->dropped) ||
+                (   ssocket->out != NULL &&
+                    ssocket->out->len >= SIRIDB_SUBSCRIBE_MAX_QUEUED))
+        {
+            continue;
+        }
+
+        if (subscription->packer == NULL)
+        {
+            /* only points are dropped */
+            SUBSCRIBE_add(subscription, NULL, NULL, NULL);
+            if (subscription->packer == NULL)
+            {
+                return;  /* signal is raised */
+            }
+        }
+
+        qp_add_type(subscription->packer, QP_ARRAY_CLOSE);
+        qp_add_raw(subscription->packer, "dropped", 7);
+        qp_add_int64(subscription->packer, (int64_t) subscription->dropped);
+
+        if (subscription->dropped)
+        {
+            log_warning(
+                    "Dropped %zu point(s) for a subscription since the "
+                    "client cannot keep up",
+                    subscription->dropped);
+        }
+
+        pkg = sirinet_packer2pkg(
+                subscription->packer,
+                subscription->pid,
+                CPROTO_RES_SUBSCRIBE);
+
+        subscription->packer = NULL;
+        subscription->dropped = 0;
+
+        /* ignore result code, signal can be raised */
+        sirinet_pkg_send(subscription->client, pkg);
+    }
+}
+
+/*
+ * Add the points at 'pt' for 'series' to a subscription. When 'series' is
+ * NULL only the packer is created.
+ *
+ * This function can raise a SIGNAL.
+ */
+static void SUBSCRIBE_add(
+        siridb_subscription_t * subscription,
+        siridb_series_t * series,
+        char * pt,
+        char * end)
+{
+    qp_packer_t * packer = subscription->packer;
+    qp_unpacker_t unpacker;
+    qp_obj_t qp_ts, qp_val;
+    size_t n = 0;
+
+    if (packer == NULL)
+    {
+        packer = subscription->packer = sirinet_packer_new(QP_SUGGESTED_SIZE);
+        if (packer == NULL)
+        {
+            return;  /* signal is raised */
+        }
+        qp_add_type(packer, QP_MAP_OPEN);
+        qp_add_raw(packer, "points", 6);
+        qp_add_type(packer, QP_ARRAY_OPEN);
+    }
+
+    if (series == NULL)
+    {
+        return;
+    }
+
+    qp_unpacker_init(&unpacker, pt, end - pt);
+    qp_next(&unpacker, NULL);  // array open
+
+    if (packer->len >= SIRIDB_SUBSCRIBE_BUF_SZ)
+    {
+        while (qp_next(&unpacker, NULL) == QP_ARRAY2)
+        {
+            qp_next(&unpacker, NULL);  // ts
+            qp_next(&unpacker, NULL);  // val
+            n++;
+        }
+        subscription->dropped += n;
+        return;
+    }
+
+    qp_add_type(packer, QP_ARRAY2);
+    qp_add_raw(packer, series->name, series->name_len);
+    qp_add_type(packer, QP_ARRAY_OPEN);
+
+    while (qp_next(&unpacker, NULL) == QP_ARRAY2)
+    {
+        qp_next(&unpacker, &qp_ts);
+        qp_next(&unpacker, &qp_val);
+
+        qp_add_type(packer, QP_ARRAY2);
+        qp_add_int64(packer, qp_ts.via.int64);
+
+        switch (qp_val.tp)
+        {
+        case QP_INT64:
+            qp_add_int64(packer, qp_val.via.int64);
+            break;
+        case QP_DOUBLE:
+            qp_add_double(packer, qp_val.via.real);
+            break;
+        default:
+            /* the length of a terminated raw value includes the terminator */
+            qp_add_raw(
+                    packer,
+                    qp_val.via.raw,
+                    qp_is_raw_term(&qp_val) ? qp_val.len - 1 : qp_val.len);
+        }
+    }
+
+    qp_add_type(packer, QP_ARRAY_CLOSE);
+}
+
+/*
+ * Returns the subscriptions for 'series' or NULL when there are none. The
+ * result is cached when possible, see siridb_subscribe_points().
+ *
+ * This function can raise a SIGNAL.
+ */
+static slist_t * SUBSCRIBE_matches(
+        siridb_subscriptions_t * subscriptions,
+        siridb_series_t * series)
+{
+    siridb_subscription_t * subscription;
+    slist_t * match = NULL;
+    void * cached = (subscriptions->matches == NULL) ?
+            NULL : imap_get(subscriptions->matches, series->id);
+
+    if (cached != NULL)
+    {
+        return (cached == &SUBSCRIBE_no_match) ? NULL : (slist_t *) cached;
+    }
+
+    for (size_t i = 0; i < subscriptions->slist->len; i++)
+    {
+        subscription = (siridb_subscription_t *) subscriptions->slist->data[i];
+
+        if ((subscription->name != NULL) ?
+                strcmp(subscription->name, series->name) == 0 :
+                siridb_re_match(
+                        subscription->re,
+                        series->name,
+                        series->name_len) >= 0)
+        {
+            if (    (match == NULL &&
+                    (match = slist_new(SLIST_DEFAULT_SIZE)) == NULL) ||
+                    slist_append_safe(&match, subscription))
+            {
+                ERR_ALLOC
+                slist_free(match);
+                return NULL;
+            }
+        }
+    }
+
+    if (    subscriptions->matches != NULL &&
+            imap_add(
+                subscriptions->matches,
+                series->id,
+                (match == NULL) ? (void *) &SUBSCRIBE_no_match : match))
+    {
+        /* not critical, the match is not cached */
+        log_error("Cannot cache the subscriptions for a series");
+    }
+
+    return match;
+}
+
+static void SUBSCRIBE_clear_matches(siridb_subscriptions_t * subscriptions)
+{
+    if (subscriptions->matches != NULL)
+    {
+        imap_free(subscriptions->matches, (imap_free_cb) SUBSCRIBE_free_match);
+    }
+
+    /* without a matches cache the subscriptions still work */
+    subscriptions->matches = imap_new();
+}
+
+/*
+ * Call-back function: imap_free_cb
+ */
+static int SUBSCRIBE_free_match(slist_t * match)
+{
+    if ((void *) match != (void *) &SUBSCRIBE_no_match)
+    {
+        slist_free(match);
+    }
+    return 0;
+}
+
+/*
+ * Remove the subscription at position 'i'.
+ */
+static void SUBSCRIBE_remove(
+        siridb_subscriptions_t * subscriptions,
+        size_t i)
+{
+    slist_t * slist = subscriptions->slist;
+    siridb_subscription_t * subscription =
+            (siridb_subscription_t *) slist->data[i];
+
+    /* the order of the subscriptions is not important */
+    slist->data[i] = slist->data[slist->len - 1];
+    slist->len--;
+
+    SUBSCRIBE_clear_matches(subscriptions);
+
+    if (!slist->len && subscriptions->timer != NULL)
+    {
+        uv_timer_stop(subscriptions->timer);
+    }
+
+    if (subscription->client != NULL)
+    {
+        sirinet_socket_decref(subscription->client);
+    }
+    subscription->client = NULL;
+    SUBSCRIBE_free(subscription);
+}
+
+/*
+ * Destroy a subscription. The client must be released before.
+ */
+static void SUBSCRIBE_free(siridb_subscription_t * subscription)
+{
+    if (subscription->re != NULL)
+    {
+        siridb_re_decref(siri.re_cache, subscription->re);
+    }
+    if (subscription->packer != NULL)
+    {
+        qp_packer_free(subscription->packer);
+    }
+    free(subscription->name);
+    free(subscription);
+}
@@ -0,0 +1,249 @@
+/*
+ * tdigest.c - Approximate percentiles using a t-digest.
+ *
+ * author       : Jeroen van der Heijden
+ * email        : jeroen@transceptor.technology
+ * copyright    : 2016, Transceptor Technology
+ *
+ * A t-digest summarizes values using a limited number of centroids (a mean
+ * with a weight). Centroids near the tails hold only a few values so
+ * extreme percentiles remain accurate. This is the merging variant: new
+ * values are collected in a buffer which is merged with the centroids when
+ * full, so memory is fixed no matter how many values are added. Digests can
+ * be merged which makes them usable for partial results.
+ *
+ * As long as no values are merged into the same centroid, which is the case
+ * for up to SIRIDB_TDIGEST_BUFFER values, the percentiles are exact.
+ *
+ * Reference: Computing Extremely Accurate Quantiles Using t-Digests,
+ * Ted Dunning and Otmar Ertl.
+ *
+ * changes
+ *  - initial version, 14-10-2016
+ *
+ */
+#include <math.h>
+#include <siri/db/tdigest.h>
+#include <stdlib.h>
+
+static void TDIGEST_compress(siridb_tdigest_t * td);
+static int TDIGEST_cmp(const void * a, const void * b);
+static inline double TDIGEST_q_limit(double q);
+
+void siridb_tdigest_init(siridb_tdigest_t * td)
+{
+    td->n = 0;
+    td->nbuf = 0;
+    td->min = INFINITY;
+    td->max = -INFINITY;
+}
+
+/*
+ * Add a value with a given weight. (use weight 1.0 for a single value)
+ */
+void siridb_tdigest_add(siridb_tdigest_t * td, double val, double weight)
+{
+    if (td->nbuf == SIRIDB_TDIGEST_BUFFER)
+    {
+        TDIGEST_compress(td);
+    }
+
+    if (val < td->min)
+    {
+        td->min = val;
+    }
+    if (val > td->max)
+    {
+        td->max = val;
+    }
+
+    td->buf[td->nbuf].mean = val;
+    td->buf[td->nbuf].weight = weight;
+    td->nbuf++;
+}
+
+/*
+ * Add all values from 'other' to 'td'. Argument 'other' is not changed.
+ */
+void siridb_tdigest_merge(siridb_tdigest_t * td, siridb_tdigest_t * other)
+{
+    size_t i;
+
+    for (i = 0; i < other->n; i++)
+    {
+        siridb_tdigest_add(td, other->c[i].mean, other->c[i].weight);
+    }
+
+    for (i = 0; i < other->nbuf; i++)
+    {
+        siridb_tdigest_add(td, other->buf[i].mean, other->buf[i].weight);
+    }
+
+    /* the extremes might be part of a centroid */
+    if (other->min < td->min)
+    {
+        td->min = other->min;
+    }
+    if (other->max > td->max)
+    {
+        td->max = other->max;
+    }
+}
+
+/*
+ * Returns the value at quantile 'q' (0.0 to 1.0). Values are interpolated
+ * linear between the ranks of the centroids, which for a digest where each
+ * centroid holds one value gives the same result as an exact percentile.
+ *
+ * Returns NAN if no values are added.
+ */
+double siridb_tdigest_quantile(siridb_tdigest_t * td, double q)
+{
+    siridb_tdigest_c_t * c;
+    size_t n;
+    double total = 0.0;
+    double rank, prev_rank, prev_mean, center;
+    size_t i;
+
+    if (td->n)
+    {
+        TDIGEST_compress(td);
+        c = td->c;
+        n = td->n;
+    }
+    else
+    {
+        /* all values are still in the buffer, no need to merge them */
+        qsort(td->buf, td->nbuf, sizeof(siridb_tdigest_c_t), TDIGEST_cmp);
+        c = td->buf;
+        n = td->nbuf;
+    }
+
+    if (!n)
+    {
+        return NAN;
+    }
+
+    for (i = 0; i < n; i++)
+    {
+        total += c[i].weight;
+    }
+
+    /* rank of the requested value, the first value has rank 0 */
+    rank = q * (total - 1.0);
+    prev_rank = 0.0;
+    prev_mean = td->min;
+    total = 0.0;
+
+    for (i = 0; i < n; i++, c++)
+    {
+        /* a centroid is located at the center of the ranks it holds */
+        center = total + (c->weight - 1.0) / 2.0;
+
+        if (rank <= center)
+        {
+            return (center == prev_rank) ? c->mean : prev_mean +
+                    (c->mean - prev_mean) *
+                    (rank - prev_rank) / (center - prev_rank);
+        }
+
+        prev_rank = center;
+        prev_mean = c->mean;
+        total += c->weight;
+    }
+
+    /* between the last centroid and the maximum */
+    return (total - 1.0 == prev_rank) ? td->max : prev_mean +
+            (td->max - prev_mean) *
+            (rank - prev_rank) / (total - 1.0 - prev_rank);
+}
+
+/*
+ * Merge the buffer with the centroids.
+ */
+static void TDIGEST_compress(siridb_tdigest_t * td)
+{
+    siridb_tdigest_c_t merged[SIRIDB_TDIGEST_CENTROIDS];
+    siridb_tdigest_c_t * c;
+    siridb_tdigest_c_t * cur;
+    size_t i = 0, j = 0, n = 0;
+    double total = 0.0;
+    double sofar = 0.0;
+    double limit;
+
+    if (!td->nbuf)
+    {
+        return;
+    }
+
+    qsort(td->buf, td->nbuf, sizeof(siridb_tdigest_c_t), TDIGEST_cmp);
+
+    for (i = 0; i < td->n; i++)
+    {
+        total += td->c[i].weight;
+    }
+    for (i = 0; i < td->nbuf; i++)
+    {
+        total += td->buf[i].weight;
+    }
+
+    cur = NULL;
+    limit = 0.0;
+    i = 0;
+
+    while (i < td->n || j < td->nbuf)
+    {
+        c = (j == td->nbuf || (i < td->n && td->c[i].mean < td->buf[j].mean))
+                ? td->c + i++ : td->buf + j++;
+
+        if (    cur != NULL && (
+                (sofar + c->weight) / total <= limit ||
+                n == SIRIDB_TDIGEST_CENTROIDS))
+        {
+            /* merge into the current centroid */
+            cur->weight += c->weight;
+            cur->mean += (c->mean - cur->mean) * c->weight / cur->weight;
+        }
+        else
+        {
+            cur = merged + n++;
+            *cur = *c;
+            limit = TDIGEST_q_limit(sofar / total);
+        }
+
+        sofar += c->weight;
+    }
+
+    for (i = 0; i < n; i++)
+    {
+        td->c[i] = merged[i];
+    }
+
+    td->n = n;
+    td->nbuf = 0;
+}
+
+/*
+ * Returns the largest quantile a centroid which starts at quantile 'q' can
+ * reach. This is the k1 scale function: k(q) = d / (2 pi) * asin(2q - 1)
+ * where each centroid may span one unit of k.
+ */
+static inline double TDIGEST_q_limit(double q)
+{
+    double k = SIRIDB_TDIGEST_COMPRESSION / (2.0 * M_PI) *
+            asin(2.0 * q - 1.0) + 1.0;
+
+    if (k >= SIRIDB_TDIGEST_COMPRESSION / 4.0)
+    {
+        return 1.0;
+    }
+
+    return (sin(k * 2.0 * M_PI / SIRIDB_TDIGEST_COMPRESSION) + 1.0) / 2.0;
+}
+
+static int TDIGEST_cmp(const void * a, const void * b)
+{
+    double ma = ((const siridb_tdigest_c_t *) a)->mean;
+    double mb = ((const siridb_tdigest_c_t *) b)->mean;
+    return (ma > mb) - (ma < mb);
+}
@@ -0,0 +1,380 @@
+/*
+ * tokens.c - Token index on series name components.
+ *
+ * author       : Jeroen van der Heijden
+ * email        : jeroen@transceptor.technology
+ * copyright    : 2016, Transceptor Technology
+ *
+ * Series names are often structured, like 'dc1.host42.cpu', where the name
+ * components are split by separator characters. For each component, a token,
+ * the index holds a map with the series having this token in their name.
+ *
+ * A regular expression requiring a token, for example /.*\.cpu/ or
+ * /dc1\.host[0-9]+/ when the separator is a dot, can only match series in
+ * the map of this token and when more tokens are required, only series in
+ * all maps.
+ * The index is used before the trigram index since a token is usually more
+ * selective than the trigrams of the same text.
+ *
+ * changes
+ *  - initial version, 14-10-2016
+ *
+ */
+#include <imap/imap.h>
+#include <logger/logger.h>
+#include <siri/db/re.h>
+#include <siri/db/tokens.h>
+#include <siri/err.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct
+{
+    siridb_tokens_t * tokens;
+    imap_t ** lists;
+    size_t n;
+    int missing;
+    slist_t * slist;
+} tokens_required_t;
+
+static void TOKENS_invalidate(siridb_tokens_t * tokens);
+static int TOKENS_free_list(imap_t * list, void * args);
+static void TOKENS_required(
+        const char * text,
+        size_t n,
+        int flags,
+        tokens_required_t * required);
+static int TOKENS_intersect(
+        siridb_series_t * series,
+        tokens_required_t * required);
+
+/*
+ * Returns NULL and raises a SIGNAL in case an error has occurred.
+ */
+siridb_tokens_t * siridb_tokens_new(const char * separators)
+{
+    siridb_tokens_t * tokens =
+            (siridb_tokens_t *) malloc(sizeof(siridb_tokens_t));
+    if (tokens == NULL)
+    {
+        ERR_ALLOC
+    }
+    else
+    {
+        tokens->is_valid = 1;
+        tokens->separators = strdup(separators);
+        tokens->lists = ct_new();
+        if (tokens->separators == NULL || tokens->lists == NULL)
+        {
+            ERR_ALLOC
+            siridb_tokens_free(tokens);
+            tokens = NULL;
+        }
+    }
+    return tokens;
+}
+
+void siridb_tokens_free(siridb_tokens_t * tokens)
+{
+    if (tokens == NULL)
+    {
+        return;
+    }
+
+    if (tokens->lists != NULL)
+    {
+        ct_values(tokens->lists, (ct_val_cb) TOKENS_free_list, NULL);
+        ct_free(tokens->lists, NULL);
+    }
+    free(tokens->separators);
+    free(tokens);
+}
+
+/*
+ * Add a series to the index. When this fails the index is no longer used
+ * since it would miss the series. This is logged but no signal is raised.
+ */
+void siridb_tokens_add(siridb_tokens_t * tokens, siridb_series_t * series)
+{
+    imap_t * list;
+    char * token;
+    char * pt;
+    char name[series->name_len + 1];
+
+    if (tokens == NULL || !tokens->is_valid)
+    {
+        return;
+    }
+
+    memcpy(name, series->name, series->name_len + 1);
+
+    for (token = pt = name;; pt++)
+    {
+        if (*pt && strchr(tokens->separators, *pt) == NULL)
+        {
+            continue;
+        }
+
+        if (pt > token)
+        {
+            int is_end = *pt == '\0';
+            *pt = '\0';
+
+            list = (imap_t *) ct_get(tokens->lists, token);
+
+            if (list == NULL)
+            {
+                if ((list = imap_new()) == NULL)
+                {
+                    break;
+                }
+
+                if (ct_add(tokens->lists, token, list))
+                {
+                    imap_free(list, NULL);
+                    break;
+                }
+            }
+
+            /* -2 is returned when the token is used more than once */
+            if (imap_add(list, series->id, series) == -1)
+            {
+                break;
+            }
+
+            if (is_end)
+            {
+                return;
+            }
+        }
+        else if (*pt == '\0')
+        {
+            return;
+        }
+
+        token = pt + 1;
+    }
+
+    log_error(
+            "Cannot add series '%s' to the token index, the index is no "
+            "longer used",
+            series->name);
+    TOKENS_invalidate(tokens);
+}
+
+void siridb_tokens_remove(
+        siridb_tokens_t * tokens,
+        siridb_series_t * series)
+{
+    imap_t * list;
+    char * token;
+    char * pt;
+    int is_end;
+    char name[series->name_len + 1];
+
+    if (tokens == NULL || !tokens->is_valid)
+    {
+        return;
+    }
+
+    memcpy(name, series->name, series->name_len + 1);
+
+    for (token = pt = name;; pt++)
+    {
+        if (*pt && strchr(tokens->separators, *pt) == NULL)
+        {
+            continue;
+        }
+
+        is_end = *pt == '\0';
+
+        if (pt > token)
+        {
+            *pt = '\0';
+
+            /* the list is removed when a token is used more than once */
+            list = (imap_t *) ct_get(tokens->lists, token);
+
+            if (list != NULL)
+            {
+                imap_pop(list, series->id);
+
+                if (!list->len)
+                {
+                    ct_pop(tokens->lists, token);
+                    imap_free(list, NULL);
+                }
+            }
+        }
+
+        if (is_end)
+        {
+            return;
+        }
+
+        token = pt + 1;
+    }
+}
+
+/*
+ * Returns a list with the series which can match the regular expression
+ * 'source', like '/.*\.cpu/', or NULL when the expression does not require
+ * a token and all series must be matched. Other series do not match the
+ * expression for sure. The reference counter is incremented for each series
+ * in the returned list.
+ *
+ * In case of a memory error, NULL is returned and the error is logged.
+ *
+ * Warning: the series_mutex must be locked.
+ */
+slist_t * siridb_tokens_match(
+        siridb_tokens_t * tokens,
+        const char * source,
+        size_t len)
+{
+    imap_t * list;
+    size_t i;
+
+    if (tokens == NULL || !tokens->is_valid)
+    {
+        return NULL;
+    }
+
+    imap_t * lists[len];
+    tokens_required_t required = {
+            .tokens=tokens,
+            .lists=lists,
+            .n=0,
+            .missing=0,
+            .slist=NULL};
+
+    if (siridb_re_literals(
+                source,
+                len,
+                (siridb_re_literal_cb) TOKENS_required,
+                &required) || (!required.n && !required.missing))
+    {
+        return NULL;
+    }
+
+    if (required.missing)
+    {
+        /* no series has a required token so no series can match */
+        required.slist = slist_new(0);
+    }
+    else
+    {
+        /* walk the smallest list and test the series in the other lists */
+        for (i = 1, list = lists[0]; i < required.n; i++)
+        {
+            if (lists[i]->len < list->len)
+            {
+                list = lists[i];
+            }
+        }
+
+        required.slist = slist_new(list->len);
+
+        if (required.slist != NULL)
+        {
+            imap_walk(list, (imap_cb) TOKENS_intersect, &required);
+        }
+    }
+
+    if (required.slist == NULL)
+    {
+        log_error("Cannot allocate series for the token index");
+    }
+
+    return required.slist;
+}
+
+/*
+ * Free the index lists, from now on the index is not used.
+ */
+static void TOKENS_invalidate(siridb_tokens_t * tokens)
+{
+    tokens->is_valid = 0;
+    ct_values(tokens->lists, (ct_val_cb) TOKENS_free_list, NULL);
+    ct_free(tokens->lists, NULL);
+    tokens->lists = NULL;
+}
+
+static int TOKENS_free_list(
+        imap_t * list,
+        void * args __attribute__((unused)))
+{
+    imap_free(list, NULL);
+    return 0;
+}
+
+/*
+ * Add the lists of the tokens in required text to 'required'. Only complete
+ * tokens can be used so a token must have a separator or the start or end of
+ * the subject on both sides.
+ */
+static void TOKENS_required(
+        const char * text,
+        size_t n,
+        int flags,
+        tokens_required_t * required)
+{
+    const char * separators = required->tokens->separators;
+    imap_t * list;
+    size_t i, start;
+    int bounded = flags & SIRIDB_RE_LITERAL_START;
+
+    for (i = 0, start = 0; i <= n; i++)
+    {
+        if (i < n && strchr(separators, text[i]) == NULL)
+        {
+            continue;
+        }
+
+        if (i == n && (~flags & SIRIDB_RE_LITERAL_END))
+        {
+            break;
+        }
+
+        if (bounded && i > start)
+        {
+            list = (imap_t *) ct_getn(
+                    required->tokens->lists,
+                    text + start,
+                    i - start);
+
+            if (list == NULL)
+            {
+                required->missing = 1;
+            }
+            else
+            {
+                required->lists[required->n++] = list;
+            }
+        }
+
+        bounded = 1;
+        start = i + 1;
+    }
+}
+
+/*
+ * Append the series when found in all required lists.
+ */
+static int TOKENS_intersect(
+        siridb_series_t * series,
+        tokens_required_t * required)
+{
+    for (size_t i = 0; i < required->n; i++)
+    {
+        if (imap_get(required->lists[i], series->id) == NULL)
+        {
+            return 0;
+        }
+    }
+
+    siridb_series_incref(series);
+    slist_append(required->slist, series);
+
+    return 1;
+}
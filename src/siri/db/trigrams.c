@@ -0,0 +1,393 @@
+/*
+ * trigrams.c - Trigram index on series names.
+ *
+ * author       : Jeroen van der Heijden
+ * email        : jeroen@transceptor.technology
+ * copyright    : 2016, Transceptor Technology
+ *
+ * For each sequence of three bytes found in a series name the index holds a
+ * sorted list with the ids of the series having this sequence in their name.
+ * A regular expression consisting of literal text for some part, for example
+ * /host-42.*cpu/, can only match a series which contains all trigrams of
+ * that text, so only those series need to be matched using pcre.
+ *
+ * Only text which is required for a match is used. When this cannot be
+ * determined, for example when the expression contains an alternation or is
+ * case insensitive, the index is not used and all series must be matched.
+ *
+ * changes
+ *  - initial version, 14-10-2016
+ *
+ */
+#include <logger/logger.h>
+#include <siri/db/re.h>
+#include <siri/db/trigrams.h>
+#include <siri/err.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TRIGRAMS_INITIAL_SIZE 4
+
+#define TRIGRAMS_KEY(s)                             \
+    (((uint32_t) (unsigned char) (s)[0] << 16) |    \
+    ((uint32_t) (unsigned char) (s)[1] << 8) |      \
+    (uint32_t) (unsigned char) (s)[2])
+
+typedef struct
+{
+    uint32_t * keys;
+    size_t nkeys;
+} trigrams_keys_t;
+
+static int TRIGRAMS_insert(
+        siridb_trigrams_t * trigrams,
+        uint32_t key,
+        uint32_t id);
+static void TRIGRAMS_invalidate(siridb_trigrams_t * trigrams);
+static size_t TRIGRAMS_find(siridb_trigrams_ids_t * list, uint32_t id);
+static int TRIGRAMS_has(siridb_trigrams_ids_t * list, uint32_t id);
+static void TRIGRAMS_required(
+        const char * text,
+        size_t n,
+        int flags,
+        trigrams_keys_t * keys);
+
+/*
+ * Returns NULL and raises a SIGNAL in case an error has occurred.
+ */
+siridb_trigrams_t * siridb_trigrams_new(void)
+{
+    siridb_trigrams_t * trigrams =
+            (siridb_trigrams_t *) malloc(sizeof(siridb_trigrams_t));
+    if (trigrams == NULL)
+    {
+        ERR_ALLOC
+    }
+    else
+    {
+        trigrams->is_valid = 1;
+        trigrams->lists = imap_new();
+        if (trigrams->lists == NULL)
+        {
+            ERR_ALLOC
+            free(trigrams);
+            trigrams = NULL;
+        }
+    }
+    return trigrams;
+}
+
+void siridb_trigrams_free(siridb_trigrams_t * trigrams)
+{
+    if (trigrams == NULL)
+    {
+        return;
+    }
+
+    if (trigrams->lists != NULL)
+    {
+        imap_free(trigrams->lists, (imap_free_cb) &free);
+    }
+    free(trigrams);
+}
+
+/*
+ * Add a series to the index. When this fails the index is no longer used
+ * since it would miss the series. This is logged but no signal is raised.
+ */
+void siridb_trigrams_add(
+        siridb_trigrams_t * trigrams,
+        siridb_series_t * series)
+{
+    if (trigrams == NULL || !trigrams->is_valid)
+    {
+        return;
+    }
+
+    for (size_t i = 0; i + 3 <= series->name_len; i++)
+    {
+        if (TRIGRAMS_insert(
+                trigrams,
+                TRIGRAMS_KEY(series->name + i),
+                series->id))
+        {
+            log_error(
+                    "Cannot add series '%s' to the name index, regular "
+                    "expressions are matched against all series",
+                    series->name);
+            TRIGRAMS_invalidate(trigrams);
+            return;
+        }
+    }
+}
+
+void siridb_trigrams_remove(
+        siridb_trigrams_t * trigrams,
+        siridb_series_t * series)
+{
+    siridb_trigrams_ids_t * list;
+    uint32_t key;
+    size_t pos;
+
+    if (trigrams == NULL || !trigrams->is_valid)
+    {
+        return;
+    }
+
+    for (size_t i = 0; i + 3 <= series->name_len; i++)
+    {
+        key = TRIGRAMS_KEY(series->name + i);
+        list = (siridb_trigrams_ids_t *) imap_get(trigrams->lists, key);
+
+        if (list == NULL)
+        {
+            continue;  /* the trigram was already used by this name */
+        }
+
+        if (!TRIGRAMS_has(list, series->id))
+        {
+            continue;
+        }
+
+        pos = TRIGRAMS_find(list, series->id);
+
+        if (--list->len)
+        {
+            memmove(list->ids + pos,
+                    list->ids + pos + 1,
+                    (list->len - pos) * sizeof(uint32_t));
+        }
+        else
+        {
+            imap_pop(trigrams->lists, key);
+            free(list);
+        }
+    }
+}
+
+/*
+ * Returns the sorted ids of the series which can match the regular
+ * expression 'source', like '/host-42.*cpu/' or '/.../i', or NULL when the
+ * index cannot be used and all series must be matched. Other series do not
+ * match the expression for sure. The returned ids must be freed.
+ *
+ * In case of a memory error, NULL is returned and the error is logged.
+ */
+siridb_trigrams_ids_t * siridb_trigrams_match(
+        siridb_trigrams_t * trigrams,
+        const char * source,
+        size_t len)
+{
+    siridb_trigrams_ids_t * ids;
+    siridb_trigrams_ids_t * list = NULL;
+    size_t i, j, n;
+
+    if (trigrams == NULL || !trigrams->is_valid)
+    {
+        return NULL;
+    }
+
+    uint32_t keys[len];
+    siridb_trigrams_ids_t * lists[len];
+    trigrams_keys_t required = {.keys=keys, .nkeys=0};
+
+    if (siridb_re_literals(
+                source,
+                len,
+                (siridb_re_literal_cb) TRIGRAMS_required,
+                &required) || !required.nkeys)
+    {
+        return NULL;
+    }
+
+    for (i = 0, n = 0; i < required.nkeys; i++)
+    {
+        lists[i] = (siridb_trigrams_ids_t *) imap_get(
+                trigrams->lists,
+                keys[i]);
+
+        if (lists[i] == NULL)
+        {
+            /* no series has this trigram so no series can match */
+            n = 0;
+            break;
+        }
+
+        if (i == 0 || lists[i]->len < n)
+        {
+            n = lists[i]->len;
+            list = lists[i];
+        }
+    }
+
+    ids = (siridb_trigrams_ids_t *) malloc(
+            sizeof(siridb_trigrams_ids_t) + n * sizeof(uint32_t));
+
+    if (ids == NULL)
+    {
+        log_error("Cannot allocate series ids for the name index");
+        return NULL;
+    }
+
+    ids->len = n;
+    ids->size = n;
+
+    if (!n)
+    {
+        return ids;
+    }
+
+    memcpy(ids->ids, list->ids, n * sizeof(uint32_t));
+
+    /* intersect with the other lists, all lists are sorted */
+    for (i = 0; i < required.nkeys && ids->len; i++)
+    {
+        if (lists[i] == list)
+        {
+            continue;
+        }
+
+        for (j = 0, n = 0; j < ids->len; j++)
+        {
+            if (TRIGRAMS_has(lists[i], ids->ids[j]))
+            {
+                ids->ids[n++] = ids->ids[j];
+            }
+        }
+        ids->len = n;
+    }
+
+    return ids;
+}
+
+/*
+ * Returns 0 if successful or -1 in case of a memory error.
+ */
+static int TRIGRAMS_insert(
+        siridb_trigrams_t * trigrams,
+        uint32_t key,
+        uint32_t id)
+{
+    siridb_trigrams_ids_t * list =
+            (siridb_trigrams_ids_t *) imap_get(trigrams->lists, key);
+    siridb_trigrams_ids_t * tmp;
+    size_t pos;
+
+    if (list == NULL)
+    {
+        list = (siridb_trigrams_ids_t *) malloc(
+                sizeof(siridb_trigrams_ids_t) +
+                TRIGRAMS_INITIAL_SIZE * sizeof(uint32_t));
+
+        if (list == NULL)
+        {
+            return -1;
+        }
+
+        list->len = 0;
+        list->size = TRIGRAMS_INITIAL_SIZE;
+
+        if (imap_add(trigrams->lists, key, list))
+        {
+            free(list);
+            return -1;
+        }
+    }
+
+    /* series ids are increasing so in most cases the id is appended */
+    pos = (list->len == 0 || list->ids[list->len - 1] < id) ?
+            list->len : TRIGRAMS_find(list, id);
+
+    if (pos < list->len && list->ids[pos] == id)
+    {
+        return 0;  /* the trigram is used more than once in the name */
+    }
+
+    if (list->len == list->size)
+    {
+        tmp = (siridb_trigrams_ids_t *) realloc(
+                list,
+                sizeof(siridb_trigrams_ids_t) +
+                list->size * 2 * sizeof(uint32_t));
+
+        if (tmp == NULL)
+        {
+            return -1;
+        }
+
+        list = tmp;
+        list->size *= 2;
+
+        /* returns 0 since the trigram is overwritten */
+        imap_set(trigrams->lists, key, list);
+    }
+
+    memmove(list->ids + pos + 1,
+            list->ids + pos,
+            (list->len - pos) * sizeof(uint32_t));
+    list->ids[pos] = id;
+    list->len++;
+
+    return 0;
+}
+
+/*
+ * Free the index lists, from now on all series are matched.
+ */
+static void TRIGRAMS_invalidate(siridb_trigrams_t * trigrams)
+{
+    trigrams->is_valid = 0;
+    imap_free(trigrams->lists, (imap_free_cb) &free);
+    trigrams->lists = NULL;
+}
+
+/*
+ * Returns the position of 'id' in the list or the position where the id
+ * should be inserted. (which is equal to list->len when larger than all ids)
+ */
+static size_t TRIGRAMS_find(siridb_trigrams_ids_t * list, uint32_t id)
+{
+    size_t lo = 0;
+    size_t hi = list->len;
+    size_t mid;
+
+    while (lo < hi)
+    {
+        mid = lo + (hi - lo) / 2;
+        if (list->ids[mid] < id)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+
+    return lo;
+}
+
+/*
+ * Returns 1 when 'id' is in the list or 0 if not.
+ */
+static int TRIGRAMS_has(siridb_trigrams_ids_t * list, uint32_t id)
+{
+    size_t pos = TRIGRAMS_find(list, id);
+    return pos < list->len && list->ids[pos] == id;
+}
+
+/*
+ * Add the trigrams of required text to 'keys'. The text is never longer
+ * than the expression so 'keys' has enough room.
+ */
+static void TRIGRAMS_required(
+        const char * text,
+        size_t n,
+        int flags __attribute__((unused)),
+        trigrams_keys_t * keys)
+{
+    for (size_t i = 0; i + 3 <= n; i++)
+    {
+        keys->keys[keys->nkeys++] = TRIGRAMS_KEY(text + i);
+    }
+}
@@ -18,6 +18,7 @@
 #include <siri/db/db.h>
 #include <siri/db/user.h>
 #include <siri/db/users.h>
+#include <siri/sched.h>
 #include <siri/err.h>
 #include <siri/grammar/grammar.h>
 #include <strextra/strextra.h>
@@ -45,8 +46,10 @@ siridb_user_t * siridb_user_new(void)
     else
     {
         user->access_bit = 0;
+        user->sched = SIRI_SCHED_INTERACTIVE;
         user->password = NULL;
         user->name = NULL;
+        user->ratelimits = NULL;
         user->ref = 1;
     }
     return user;
@@ -243,5 +246,6 @@ void siridb__user_free(siridb_user_t * user)
 #endif
     free(user->name);
     free(user->password);
+    free(user->ratelimits);
     free(user);
 }
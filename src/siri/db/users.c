@@ -18,6 +18,7 @@
 #include <siri/db/query.h>
 #include <siri/db/users.h>
 #include <siri/err.h>
+#include <siri/sched.h>
 #include <stdlib.h>
 #include <strextra/strextra.h>
 #include <string.h>
@@ -143,19 +144,141 @@ int siridb_users_load(siridb_t * siridb)
 }
 
 /*
- * Typedef: sirinet_clserver_get_file
+ * Read the scheduler class for users from the [scheduler] section in
+ * database.conf, for example:
  *
- * Returns the length of the content for a file and set buffer with the file
- * content. Note that malloc is used to allocate memory for the buffer.
+ *      [scheduler]
+ *      analytics = heavy
+ *      reports = background
  *
- * In case of an error -1 is returned and buffer will be set to NULL.
+ * Users which are not in the section use the interactive class. The section
+ * is read when the database is loaded, invalid options are logged.
  */
-ssize_t siridb_users_get_file(char ** buffer, siridb_t * siridb)
+void siridb_users_read_sched(siridb_t * siridb, cfgparser_t * cfgparser)
 {
-    /* get users file name */
-    SIRIDB_GET_FN(fn, siridb->dbpath, SIRIDB_USERS_FN)
+    cfgparser_section_t * section;
+    cfgparser_option_t * option;
+    siridb_user_t * user;
+    int cls;
+
+    if (cfgparser_get_section(
+            &section,
+            cfgparser,
+            SIRIDB_USERS_SCHED_SECTION) != CFGPARSER_SUCCESS)
+    {
+        return;
+    }
+
+    for (option = section->options; option != NULL; option = option->next)
+    {
+        cls = (option->tp == CFGPARSER_TP_STRING) ?
+                siri_sched_class_by_name(option->val->string) : -1;
+
+        if (    cls != SIRI_SCHED_INTERACTIVE &&
+                cls != SIRI_SCHED_HEAVY &&
+                cls != SIRI_SCHED_BACKGROUND)
+        {
+            log_error(
+                    "Invalid scheduler class for user '%s', expecting "
+                    "interactive, heavy or background",
+                    option->name);
+            continue;
+        }
+
+        user = (siridb_user_t *) llist_get(
+                siridb->users,
+                (llist_cb) USERS_cmp,
+                (void *) option->name);
+
+        if (user == NULL)
+        {
+            log_warning(
+                    "Cannot find user '%s' in section [%s]",
+                    option->name,
+                    SIRIDB_USERS_SCHED_SECTION);
+            continue;
+        }
+
+        user->sched = (uint8_t) cls;
+    }
+}
+
+/*
+ * Read rate limits for users from the [ratelimit] section in database.conf.
+ * The value is '<points/s> <queries/s> <selected points/s>' where 0 means
+ * no limit, for example:
+ *
+ *      [ratelimit]
+ *      dashboard = 0 20 1000000
+ *      collector = 50000 0 0
+ *
+ * Users which are not in the section are not limited. The section is read
+ * when the database is loaded, invalid options are logged.
+ */
+void siridb_users_read_ratelimit(siridb_t * siridb, cfgparser_t * cfgparser)
+{
+    cfgparser_section_t * section;
+    cfgparser_option_t * option;
+    siridb_ratelimits_t limits;
+    siridb_user_t * user;
+
+    if (cfgparser_get_section(
+            &section,
+            cfgparser,
+            SIRIDB_USERS_RATELIMIT_SECTION) != CFGPARSER_SUCCESS)
+    {
+        return;
+    }
+
+    for (option = section->options; option != NULL; option = option->next)
+    {
+        if (    option->tp != CFGPARSER_TP_STRING ||
+                siridb_ratelimits_parse(&limits, option->val->string))
+        {
+            log_error(
+                    "Invalid rate limits for user '%s', expecting "
+                    "'<points/s> <queries/s> <selected points/s>'",
+                    option->name);
+            continue;
+        }
+
+        user = (siridb_user_t *) llist_get(
+                siridb->users,
+                (llist_cb) USERS_cmp,
+                (void *) option->name);
+
+        if (user == NULL)
+        {
+            log_warning(
+                    "Cannot find user '%s' in section [%s]",
+                    option->name,
+                    SIRIDB_USERS_RATELIMIT_SECTION);
+            continue;
+        }
 
-    return xpath_get_content(buffer, fn);
+        if (user->ratelimits == NULL)
+        {
+            user->ratelimits = (siridb_ratelimits_t *) malloc(
+                    sizeof(siridb_ratelimits_t));
+            if (user->ratelimits == NULL)
+            {
+                ERR_ALLOC
+                return;
+            }
+        }
+
+        *user->ratelimits = limits;
+    }
+}
+
+/*
+ * Typedef: sirinet_clserver_getfn
+ *
+ * Writes the file name to 'fn' which has at least PATH_MAX bytes.
+ */
+void siridb_users_get_fn(char * fn, siridb_t * siridb)
+{
+    snprintf(fn, PATH_MAX, "%s%s", siridb->dbpath, SIRIDB_USERS_FN);
 }
 
 /*
@@ -210,14 +333,6 @@ siridb_user_t * siridb_users_get_user(
         const char * password)
 {
     siridb_user_t * user;
-    char pw[OWCRYPT_SZ];
-
-#ifndef __APPLE__
-    /* Required for compatibility with version < 2.0.14 */
-    char * fallback_pw;
-    struct crypt_data fallback_data;
-#endif
-
 
     if ((user = llist_get(
             users,
@@ -232,21 +347,44 @@ siridb_user_t * siridb_users_get_user(
         return user;
     }
 
-    owcrypt(password, user->password, pw);
-    if (strcmp(pw, user->password) == 0)
+    return siridb_users_check_password(password, user->password) ?
+            user : NULL;
+}
+
+/*
+ * Returns 1 (true) when 'password' matches the 'encrypted' password of a
+ * user or 0 (false) if not.
+ *
+ * This function does not use the user so it can be called from a worker
+ * thread with a copy of the encrypted password.
+ */
+int siridb_users_check_password(
+        const char * password,
+        const char * encrypted)
+{
+    char pw[OWCRYPT_SZ];
+
+#ifndef __APPLE__
+    /* Required for compatibility with version < 2.0.14 */
+    char * fallback_pw;
+    struct crypt_data fallback_data;
+#endif
+
+    owcrypt(password, encrypted, pw);
+    if (strcmp(pw, encrypted) == 0)
     {
-        return user;
+        return 1;
     }
 #ifndef __APPLE__
     /* Required for compatibility with version < 2.0.14 */
-    else if (user->password[0] == '$')
+    else if (encrypted[0] == '$')
     {
         fallback_data.initialized = 0;
-        fallback_pw = crypt_r(password, user->password, &fallback_data);
-        return (strcmp(fallback_pw, user->password) == 0) ? user : NULL;
+        fallback_pw = crypt_r(password, encrypted, &fallback_data);
+        return fallback_pw != NULL && strcmp(fallback_pw, encrypted) == 0;
     }
 #endif
-    return NULL;
+    return 0;
 }
 
 /*
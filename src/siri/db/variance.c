@@ -5,56 +5,346 @@
  * email        : jeroen@transceptor.technology
  * copyright    : 2016, Transceptor Technology
  *
+ * The variance of a range is kept as a count, mean and m2 (the sum of the
+ * squared differences from the mean) so the state of two ranges can be
+ * merged without the points. (Chan et al.) Values are processed in blocks
+ * of SIRIDB_VARIANCE_BLOCK: the mean and m2 of a block are calculated in two
+ * passes while the block is in the cache and the block is merged with the
+ * state. This reads the points once and is as accurate as the two-pass
+ * algorithm for each block.
+ *
+ * Merged series use a partial variance with a count, mean and m2 point for
+ * each group which is combined with the partial variance of other pools.
+ *
  * changes
  *  - initial version, 10-08-2016
  *
  */
 #include <assert.h>
-#include <math.h>
+#include <siri/db/aggregate.h>
 #include <siri/db/points.h>
 #include <siri/db/variance.h>
+#include <siri/grammar/grammar.h>
+#include <stdio.h>
+
+/*
+ * Add the values of 'points' in range 'start' to 'end' to 'state'. The
+ * points must be of type integer or double.
+ */
+void siridb_variance_points(
+        siridb_variance_t * state,
+        siridb_points_t * points,
+        size_t start,
+        size_t end)
+{
+    siridb_variance_t block;
+    siridb_point_t * point;
+    siridb_point_t * last;
+    double d;
+
+    for (; start < end; start += block.n)
+    {
+        block.n = (end - start < SIRIDB_VARIANCE_BLOCK) ?
+                end - start : SIRIDB_VARIANCE_BLOCK;
+        block.mean = 0.0;
+        block.m2 = 0.0;
+        last = points->data + start + block.n;
+
+        switch (points->tp)
+        {
+        case TP_INT:
+            for (point = points->data + start; point < last; point++)
+            {
+                block.mean += point->val.int64;
+            }
+            block.mean /= block.n;
+            for (point = points->data + start; point < last; point++)
+            {
+                d = (double) point->val.int64 - block.mean;
+                block.m2 += d * d;
+            }
+            break;
+        case TP_DOUBLE:
+            for (point = points->data + start; point < last; point++)
+            {
+                block.mean += point->val.real;
+            }
+            block.mean /= block.n;
+            for (point = points->data + start; point < last; point++)
+            {
+                d = point->val.real - block.mean;
+                block.m2 += d * d;
+            }
+            break;
+        default:
+            assert (0);
+            return;
+        }
+
+        siridb_variance_merge(state, &block);
+    }
+}
+
+/*
+ * Merge the state 'other' for another range of values into 'state'.
+ */
+void siridb_variance_merge(
+        siridb_variance_t *__restrict state,
+        const siridb_variance_t *__restrict other)
+{
+    double n, delta;
+
+    if (!other->n)
+    {
+        return;
+    }
+
+    if (!state->n)
+    {
+        *state = *other;
+        return;
+    }
+
+    n = (double) (state->n + other->n);
+    delta = other->mean - state->mean;
 
-double siridb_variance(siridb_points_t * points)
+    state->mean += delta * other->n / n;
+    state->m2 += other->m2 + delta * delta * state->n * other->n / n;
+    state->n += other->n;
+}
+
+/*
+ * Returns the sample variance, or 0.0 for less than two values.
+ */
+double siridb_variance_sample(const siridb_variance_t * state)
 {
-    double mean = 0.0;
-    double variance = 0.0;
+    return (state->n > 1) ? state->m2 / (state->n - 1) : 0.0;
+}
+
+/*
+ * Returns the population variance, or 0.0 without values.
+ */
+double siridb_variance_population(const siridb_variance_t * state)
+{
+    return (state->n) ? state->m2 / state->n : 0.0;
+}
+
+/*
+ * Returns 1 (true) if 'gid' is variance or pvariance.
+ */
+int siridb_variance_is_gid(uint32_t gid)
+{
+    return gid == CLERI_GID_F_VARIANCE || gid == CLERI_GID_F_PVARIANCE;
+}
+
+/*
+ * Create empty parts for a partial variance with room for 'size' groups.
+ * The parts are the counts, means and m2 for each group.
+ *
+ * Returns 0 if successful or -1 and a SIGNAL is raised in case of an error.
+ */
+int siridb_variance_parts_new(siridb_points_t ** parts, size_t size)
+{
+    parts[0] = siridb_points_new(size, TP_INT);
+    parts[1] = siridb_points_new(size, TP_DOUBLE);
+    parts[2] = siridb_points_new(size, TP_DOUBLE);
+
+    if (parts[0] == NULL || parts[1] == NULL || parts[2] == NULL)
+    {
+        siridb_variance_parts_free(parts);
+        return -1;
+    }
+
+    return 0;
+}
 
-    switch (points->tp)
+/*
+ * Destroy the parts of a partial variance. (parts may be NULL)
+ */
+void siridb_variance_parts_free(siridb_points_t ** parts)
+{
+    for (int i = 0; i < SIRIDB_VARIANCE_PARTS; i++)
     {
-    case TP_INT:
-        for (size_t i = 0; i < points->len; i++)
+        if (parts[i] != NULL)
         {
-           mean += (points->data + i)->val.int64;
+            siridb_points_free(parts[i]);
+            parts[i] = NULL;
         }
+    }
+}
+
+/*
+ * Add the groups of a sorted batch of points to 'parts'. The first group of
+ * the batch may be the last group in 'parts', later batches cannot have
+ * earlier time-stamps. The parts must have room for the groups in the batch
+ * and the batch must be of type integer or double.
+ */
+void siridb_variance_parts_add(
+        siridb_points_t ** parts,
+        siridb_points_t * batch,
+        siridb_aggr_t * aggr)
+{
+    siridb_variance_t state, other;
+    uint64_t group_ts;
+    size_t start, end, last;
+
+    for (start = 0; start < batch->len; start = end)
+    {
+        group_ts = SIRIDB_AGGR_GROUP_TS(aggr, batch->data[start].ts);
+
+        for (end = start + 1;
+                end < batch->len &&
+                SIRIDB_AGGR_GROUP_TS(aggr, batch->data[end].ts) == group_ts;
+                end++);
+
+        state = (siridb_variance_t) SIRIDB_VARIANCE_INIT;
+        siridb_variance_points(&state, batch, start, end);
 
-        mean /= points->len;
+        last = parts[0]->len;
 
-        for (size_t i = 0; i < points->len; i++)
+        if (last && parts[0]->data[last - 1].ts == group_ts)
         {
-            variance += pow(
-                   (double) (points->data + i)->val.int64 - mean,
-                   2);
+            last--;
+            other = state;
+            state.n = parts[0]->data[last].val.int64;
+            state.mean = parts[1]->data[last].val.real;
+            state.m2 = parts[2]->data[last].val.real;
+            siridb_variance_merge(&state, &other);
         }
-        break;\
-    case TP_DOUBLE:
-        for (size_t i = 0; i < points->len; i++)
+        else
         {
-           mean += (points->data + i)->val.real;
+            parts[0]->len++;
+            parts[1]->len++;
+            parts[2]->len++;
         }
 
-        mean /= points->len;
+        parts[0]->data[last].ts = group_ts;
+        parts[1]->data[last].ts = group_ts;
+        parts[2]->data[last].ts = group_ts;
+        parts[0]->data[last].val.int64 = (int64_t) state.n;
+        parts[1]->data[last].val.real = state.mean;
+        parts[2]->data[last].val.real = state.m2;
+    }
+}
+
+/*
+ * Combine the partial variance 'other' into 'parts'. Groups with equal
+ * time-stamps are merged. Argument 'other' remains owned by the caller and
+ * can be received from another pool so it is checked.
+ *
+ * Returns 0 if successful or -1 in case of an error. (err_msg is set)
+ */
+int siridb_variance_parts_combine(
+        siridb_points_t ** parts,
+        siridb_points_t ** other,
+        char * err_msg)
+{
+    siridb_points_t * combined[SIRIDB_VARIANCE_PARTS];
+    siridb_variance_t state, ostate;
+    size_t a = 0, b = 0, n;
+    size_t alen = parts[0]->len;
+    size_t blen = other[0]->len;
+
+    if (    other[0]->tp != TP_INT ||
+            other[1]->tp != TP_DOUBLE ||
+            other[2]->tp != TP_DOUBLE ||
+            other[1]->len != blen ||
+            other[2]->len != blen)
+    {
+        sprintf(err_msg, "Invalid partial variance received.");
+        return -1;
+    }
+
+    if (siridb_variance_parts_new(combined, alen + blen))
+    {
+        sprintf(err_msg, "Memory allocation error.");
+        return -1;  /* signal is raised */
+    }
 
-        for (size_t i = 0; i < points->len; i++)
+    for (n = 0; a < alen || b < blen; n++)
+    {
+        if (    b == blen ||
+                (a < alen && parts[0]->data[a].ts < other[0]->data[b].ts))
+        {
+            for (int i = 0; i < SIRIDB_VARIANCE_PARTS; i++)
+            {
+                combined[i]->data[n] = parts[i]->data[a];
+            }
+            a++;
+        }
+        else if (a == alen || other[0]->data[b].ts < parts[0]->data[a].ts)
         {
-            variance += pow(
-                   (points->data + i)->val.real - mean,
-                   2);
+            for (int i = 0; i < SIRIDB_VARIANCE_PARTS; i++)
+            {
+                combined[i]->data[n] = other[i]->data[b];
+            }
+            b++;
         }
-        break;
-    default:
-        assert (0);
-        break;
+        else
+        {
+            state.n = parts[0]->data[a].val.int64;
+            state.mean = parts[1]->data[a].val.real;
+            state.m2 = parts[2]->data[a].val.real;
+            ostate.n = other[0]->data[b].val.int64;
+            ostate.mean = other[1]->data[b].val.real;
+            ostate.m2 = other[2]->data[b].val.real;
+
+            siridb_variance_merge(&state, &ostate);
+
+            for (int i = 0; i < SIRIDB_VARIANCE_PARTS; i++)
+            {
+                combined[i]->data[n].ts = parts[0]->data[a].ts;
+            }
+            combined[0]->data[n].val.int64 = (int64_t) state.n;
+            combined[1]->data[n].val.real = state.mean;
+            combined[2]->data[n].val.real = state.m2;
+            a++;
+            b++;
+        }
+    }
+
+    siridb_variance_parts_free(parts);
+
+    for (int i = 0; i < SIRIDB_VARIANCE_PARTS; i++)
+    {
+        combined[i]->len = n;
+        parts[i] = combined[i];
+    }
+
+    return 0;
+}
+
+/*
+ * Returns the variance or pvariance for each group in 'parts'. The parts
+ * remain owned by the caller.
+ *
+ * Returns NULL and raises a SIGNAL in case an error has occurred.
+ * (err_msg is set)
+ */
+siridb_points_t * siridb_variance_parts_finish(
+        siridb_points_t ** parts,
+        uint32_t gid,
+        char * err_msg)
+{
+    siridb_points_t * points = siridb_points_new(parts[0]->len, TP_DOUBLE);
+    siridb_variance_t state;
+
+    if (points == NULL)
+    {
+        sprintf(err_msg, "Memory allocation error.");
+        return NULL;  /* signal is raised */
+    }
+
+    for (; points->len < parts[0]->len; points->len++)
+    {
+        state.n = parts[0]->data[points->len].val.int64;
+        state.m2 = parts[2]->data[points->len].val.real;
+        points->data[points->len].ts = parts[0]->data[points->len].ts;
+        points->data[points->len].val.real =
+                (gid == CLERI_GID_F_PVARIANCE) ?
+                siridb_variance_population(&state) :
+                siridb_variance_sample(&state);
     }
 
-    return variance;
+    return points;
 }
@@ -5,6 +5,11 @@
  * email        : jeroen@transceptor.technology
  * copyright    : 2016, Transceptor Technology
  *
+ * Open files are kept at a fixed number of positions which are replaced
+ * using the CLOCK algorithm. A file which is used while it is open gets a
+ * second chance, so shards which are read often stay open while a file
+ * which is opened only once is closed first.
+ *
  * changes
  *  - initial version, 08-04-2016
  *
@@ -14,6 +19,9 @@
 #include <siri/file/handler.h>
 #include <stdlib.h>
 
+static siri_fp_t ** FH_next(siri_fh_t * fh);
+static void FH_release(siri_fh_t * fh, siri_fp_t * fp);
+
 siri_fh_t * siri_fh_new(uint16_t size)
 {
     siri_fh_t * fh = (siri_fh_t *) malloc(sizeof(siri_fh_t));
@@ -25,6 +33,9 @@ siri_fh_t * siri_fh_new(uint16_t size)
     {
         fh->size = size;
         fh->idx = 0;
+        fh->opens = 0;
+        fh->evictions = 0;
+        fh->hits = 0;
         fh->fpointers = (siri_fp_t **) calloc(size, sizeof(siri_fp_t *));
         if (fh->fpointers == NULL)
         {
@@ -63,6 +74,9 @@ void siri_fh_free(siri_fh_t * fh)
 }
 
 /*
+ * Open a file at the next free position of the file handler. The file at
+ * this position is closed when it is still open.
+ *
  * Returns 0 if successful or -1 in case of an error.
  */
 int siri_fopen(
@@ -71,12 +85,12 @@ int siri_fopen(
         const char * fn,
         const char * modes)
 {
-    siri_fp_t ** dest = fh->fpointers + fh->idx;
+    siri_fp_t ** dest = FH_next(fh);
 
-    /* close and possible free file pointer at next position */
+    /* close and possible free file pointer at this position */
     if (*dest != NULL)
     {
-        siri_fp_decref(*dest);
+        FH_release(fh, *dest);
     }
 
     /* assign file pointer */
@@ -84,6 +98,10 @@ int siri_fopen(
 
     /* increment reference counter (must be done even if open fails) */
     fp->ref++;
+    fp->used = 0;
+    fp->slot = fh->idx;
+
+    fh->opens++;
 
     if ((fp->fp = fopen(fn, modes)) == NULL)
     {
@@ -97,4 +115,72 @@ int siri_fopen(
     return 0;
 }
 
+/*
+ * Make sure the file is open. Using a file which is already open counts as
+ * a hit and gives the file a second chance.
+ *
+ * Returns 0 if successful or -1 in case of an error.
+ */
+int siri_fh_open(
+        siri_fh_t * fh,
+        siri_fp_t * fp,
+        const char * fn,
+        const char * modes)
+{
+    if (fp->fp != NULL)
+    {
+        fp->used = 1;
+        fh->hits++;
+        return 0;
+    }
+    return siri_fopen(fh, fp, fn, modes);
+}
+
+/*
+ * Move the clock hand to the first position without a file which is used
+ * since the hand has passed. Such files lose their second chance, so after
+ * one round the hand always stops.
+ */
+static siri_fp_t ** FH_next(siri_fh_t * fh)
+{
+    siri_fp_t * fp;
+
+    for (uint16_t i = 0; i < fh->size; i++)
+    {
+        fp = fh->fpointers[fh->idx];
+
+        if (    fp == NULL ||
+                fp->fp == NULL ||
+                fp->slot != fh->idx ||
+                !fp->used)
+        {
+            break;
+        }
+
+        fp->used = 0;
+        fh->idx = (fh->idx + 1) % fh->size;
+    }
+
+    return fh->fpointers + fh->idx;
+}
+
+/*
+ * Release the file at the position of the clock hand.
+ */
+static void FH_release(siri_fh_t * fh, siri_fp_t * fp)
+{
+    if (fp->fp != NULL && fp->slot != fh->idx)
+    {
+        /* the file is closed and opened again at another position which
+         * holds a reference too, so the file must stay open */
+        fp->ref--;
+        return;
+    }
 
+    if (fp->fp != NULL)
+    {
+        fh->evictions++;
+    }
+
+    siri_fp_decref(fp);
+}
@@ -5,14 +5,33 @@
  * email        : jeroen@transceptor.technology
  * copyright    : 2016, Transceptor Technology
  *
+ * Files which grow by small appends can be preallocated in larger extents
+ * with siri_fp_prealloc(). The space is reserved beyond the end of the file
+ * so the file size stays the logical end and readers are not affected. The
+ * space which is not used is released when the file is closed.
+ *
  * changes
  *  - initial version, 08-04-2016
  *
  */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <errno.h>
+#include <fcntl.h>
 #include <logger/logger.h>
 #include <siri/err.h>
 #include <siri/file/pointer.h>
 #include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* set when the file system does not support preallocation */
+static int fp_prealloc_unsupported = 0;
+
+static void FP_unmap(siri_fp_t * fp);
+static void FP_trim(siri_fp_t * fp);
 
 /*
  * Returns NULL and raises a SIGNAL in case an error has occurred.
@@ -28,6 +47,11 @@ siri_fp_t * siri_fp_new(void)
     {
         fp->fp = NULL;
         fp->ref = 1;
+        fp->used = 0;
+        fp->slot = 0;
+        fp->map_sz = 0;
+        fp->map = NULL;
+        fp->alloc_sz = 0;
     }
     return fp;
 }
@@ -40,8 +64,10 @@ siri_fp_t * siri_fp_new(void)
  */
 void siri_fp_decref(siri_fp_t * fp)
 {
+    FP_unmap(fp);
     if (fp->fp != NULL)
     {
+        FP_trim(fp);
         if (fclose(fp->fp))
         {
             ERR_FILE
@@ -59,8 +85,10 @@ void siri_fp_decref(siri_fp_t * fp)
  */
 void siri_fp_close(siri_fp_t * fp)
 {
+    FP_unmap(fp);
     if (fp->fp != NULL)
     {
+        FP_trim(fp);
         if (fclose(fp->fp))
         {
             ERR_FILE
@@ -68,3 +96,138 @@ void siri_fp_close(siri_fp_t * fp)
         fp->fp = NULL;
     }
 }
+
+/*
+ * Returns a pointer to 'len' bytes at position 'pos' in a read-only mapping
+ * of the file. The file must be open and argument 'size' must not exceed the
+ * actual file size. When the requested range is not inside the current
+ * mapping, the file is mapped again using 'size' so the mapping grows
+ * together with the file.
+ *
+ * The mapping is released when the file is closed, so a file which is
+ * replaced by another file (for example by optimize) is never read using an
+ * old mapping.
+ *
+ * Returns NULL when the file cannot be mapped. In this case the caller
+ * should fall back to reading from the file. (no SIGNAL is raised)
+ */
+const char * siri_fp_map(
+        siri_fp_t * fp,
+        size_t pos,
+        size_t len,
+        size_t size)
+{
+    if (pos + len > fp->map_sz)
+    {
+        int fd;
+
+        FP_unmap(fp);
+
+        if (pos + len > size || (fd = fileno(fp->fp)) == -1)
+        {
+            return NULL;
+        }
+
+        fp->map = (char *) mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+
+        if (fp->map == MAP_FAILED)
+        {
+            log_warning("Cannot create a memory mapping for a file");
+            fp->map = NULL;
+            return NULL;
+        }
+
+        fp->map_sz = size;
+    }
+
+    return fp->map + pos;
+}
+
+/*
+ * Make sure 'len' bytes after the logical end 'size' of the file are
+ * allocated. When they are not, the space up to the next multiple of
+ * 'extent' is allocated at once so the file grows in large extents instead
+ * of many small ones. The file must be open and the size of the file does
+ * not change.
+ *
+ * Returns 0 if successful or -1 when the space cannot be allocated. This is
+ * not critical since the file still grows while writing. (no SIGNAL is
+ * raised)
+ */
+int siri_fp_prealloc(siri_fp_t * fp, size_t size, size_t len, size_t extent)
+{
+#ifdef FALLOC_FL_KEEP_SIZE
+    size_t end = size + len;
+    int fd;
+
+    if (end <= fp->alloc_sz || !extent || fp_prealloc_unsupported)
+    {
+        return fp_prealloc_unsupported ? -1 : 0;
+    }
+
+    end += extent - end % extent;
+
+    if ((fd = fileno(fp->fp)) == -1)
+    {
+        return -1;
+    }
+
+    if (fallocate(
+            fd,
+            FALLOC_FL_KEEP_SIZE,
+            (off_t) size,
+            (off_t) (end - size)))
+    {
+        if (errno == EOPNOTSUPP)
+        {
+            log_info("File system does not support preallocating files");
+            fp_prealloc_unsupported = 1;
+        }
+        return -1;
+    }
+
+    fp->alloc_sz = end;
+    return 0;
+#else
+    (void) fp;
+    (void) size;
+    (void) len;
+    (void) extent;
+    return -1;
+#endif
+}
+
+static void FP_unmap(siri_fp_t * fp)
+{
+    if (fp->map != NULL)
+    {
+        munmap(fp->map, fp->map_sz);
+        fp->map = NULL;
+        fp->map_sz = 0;
+    }
+}
+
+/*
+ * Release preallocated space beyond the end of the file. Truncating to the
+ * current size frees the blocks which are allocated beyond the end.
+ */
+static void FP_trim(siri_fp_t * fp)
+{
+    struct stat st;
+    int fd;
+
+    if (!fp->alloc_sz)
+    {
+        return;
+    }
+
+    fp->alloc_sz = 0;
+
+    if (    fflush(fp->fp) ||
+            (fd = fileno(fp->fp)) == -1 ||
+            fstat(fd, &st) ||
+            ftruncate(fd, st.st_size))
+    {
+        log_warning("Cannot release preallocated space of a file");
+    }
+}
@@ -0,0 +1,236 @@
+/*
+ * fsync.c - Group commit for shard and buffer files.
+ *
+ * author       : Jeroen van der Heijden
+ * email        : jeroen@transceptor.technology
+ * copyright    : 2016, Transceptor Technology
+ *
+ * Shard files are flushed after each chunk, but without fsync() the data
+ * might still be lost when the machine crashes. Calling fsync() for each
+ * chunk is too expensive, so shard files which are written are collected and
+ * synced together with the buffer files, either on an interval or after a
+ * number of bytes is written. (see fsync_mode in siridb.conf)
+ *
+ * Files are registered by name. The descriptor used for writing might be
+ * closed by the file handler before the sync runs but fsync() on a new
+ * descriptor for the same file writes the same data.
+ *
+ * Syncing is done by the main thread, registering files is thread safe since
+ * the optimize task writes shards too.
+ *
+ * changes
+ *  - initial version, 14-10-2016
+ *
+ */
+#include <fcntl.h>
+#include <llist/llist.h>
+#include <logger/logger.h>
+#include <siri/db/buffer.h>
+#include <siri/db/db.h>
+#include <siri/fsync.h>
+#include <siri/loop.h>
+#include <slist/slist.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <uv.h>
+
+static uv_timer_t fsync_timer;
+static uv_mutex_t fsync_lock;
+static slist_t * fsync_fns = NULL;
+static size_t fsync_bytes = 0;
+
+static void FSYNC_cb(uv_timer_t * handle);
+static void FSYNC_run(void);
+
+void siri_fsync_init(siri_t * siri)
+{
+    uv_mutex_init(&fsync_lock);
+
+    if (siri->cfg->fsync_mode == SIRI_FSYNC_INTERVAL)
+    {
+        siri->fsync = &fsync_timer;
+        uv_timer_init(siri->loop, &fsync_timer);
+        uv_timer_start(
+                &fsync_timer,
+                FSYNC_cb,
+                siri->cfg->fsync_interval,
+                siri->cfg->fsync_interval);
+    }
+
+    log_info(
+            "Using fsync mode: %s",
+            siri_fsync_mode_str(siri->cfg->fsync_mode));
+}
+
+/*
+ * Stop the timer (if running) and sync for the last time.
+ */
+void siri_fsync_stop(siri_t * siri)
+{
+    if (siri->fsync != NULL)
+    {
+        uv_timer_stop(&fsync_timer);
+        uv_close((uv_handle_t *) &fsync_timer, NULL);
+        siri->fsync = NULL;
+    }
+
+    if (siri->cfg->fsync_mode != SIRI_FSYNC_NONE)
+    {
+        FSYNC_run();
+    }
+
+    free(fsync_fns);
+    fsync_fns = NULL;
+}
+
+/*
+ * Register 'size' bytes which are written to file 'fn'. The name is copied.
+ * Argument 'fn' can be NULL for writes to a buffer file since buffer files
+ * are synced anyway.
+ *
+ * Memory errors are logged but not raised since the file will still be
+ * written by the OS.
+ */
+void siri_fsync_add(const char * fn, size_t size)
+{
+    char * dup = NULL;
+    size_t i;
+
+    if (siri.cfg->fsync_mode == SIRI_FSYNC_NONE)
+    {
+        return;
+    }
+
+    uv_mutex_lock(&fsync_lock);
+
+    fsync_bytes += size;
+
+    if (fn != NULL && fsync_fns == NULL)
+    {
+        fsync_fns = slist_new(SLIST_DEFAULT_SIZE);
+    }
+
+    if (fn != NULL)
+    {
+        /* only a few files are written between two sync operations */
+        for (i = 0; fsync_fns != NULL && i < fsync_fns->len; i++)
+        {
+            if (strcmp(fsync_fns->data[i], fn) == 0)
+            {
+                break;
+            }
+        }
+
+        if (    fsync_fns == NULL || (
+                i == fsync_fns->len && (
+                    (dup = strdup(fn)) == NULL ||
+                    slist_append_safe(&fsync_fns, dup))))
+        {
+            log_error("Cannot register file '%s' for fsync", fn);
+            free(dup);
+        }
+    }
+
+    uv_mutex_unlock(&fsync_lock);
+}
+
+/*
+ * Should be called when an insert is finished. In 'bytes' mode, this is
+ * where we sync when enough bytes are written.
+ */
+void siri_fsync_insert_done(void)
+{
+    size_t bytes;
+
+    if (siri.cfg->fsync_mode != SIRI_FSYNC_BYTES)
+    {
+        return;
+    }
+
+    uv_mutex_lock(&fsync_lock);
+    bytes = fsync_bytes;
+    uv_mutex_unlock(&fsync_lock);
+
+    if (bytes >= siri.cfg->fsync_bytes)
+    {
+        FSYNC_run();
+    }
+}
+
+const char * siri_fsync_mode_str(siri_fsync_mode_t mode)
+{
+    switch (mode)
+    {
+    case SIRI_FSYNC_NONE: return "NONE";
+    case SIRI_FSYNC_INTERVAL: return "INTERVAL";
+    case SIRI_FSYNC_BYTES: return "BYTES";
+    }
+    return "UNKNOWN";
+}
+
+static void FSYNC_cb(uv_timer_t * handle __attribute__((unused)))
+{
+    siri_loop_frame_t frame;
+
+    siri_loop_enter(&frame);
+    FSYNC_run();
+    siri_loop_done(SIRI_LOOP_TIMER, &frame);
+}
+
+/*
+ * Sync all registered shard files and the buffer files of all databases.
+ */
+static void FSYNC_run(void)
+{
+    slist_t * fns;
+    llist_node_t * siridb_node;
+    siridb_t * siridb;
+    char * fn;
+    int fd;
+
+    uv_mutex_lock(&fsync_lock);
+
+    fns = fsync_fns;
+    fsync_fns = NULL;
+    fsync_bytes = 0;
+
+    uv_mutex_unlock(&fsync_lock);
+
+    for (size_t i = 0; fns != NULL && i < fns->len; i++)
+    {
+        fn = (char *) fns->data[i];
+
+        /* the shard might be removed or replaced by optimize meanwhile */
+        if ((fd = open(fn, O_RDONLY)) != -1)
+        {
+            if (fsync(fd))
+            {
+                log_error("Cannot fsync file: '%s'", fn);
+            }
+            close(fd);
+        }
+
+        free(fn);
+    }
+
+    free(fns);
+
+    for (   siridb_node = siri.siridb_list->first;
+            siridb_node != NULL;
+            siridb_node = siridb_node->next)
+    {
+        siridb = (siridb_t *) siridb_node->data;
+
+        siri_rwlock_wrlock(&siridb->series_mutex);
+
+        if (siridb->buffer_fp != NULL && siridb_buffer_sync(siridb))
+        {
+            log_error(
+                    "Cannot fsync buffer file for database '%s'",
+                    siridb->dbname);
+        }
+
+        siri_rwlock_wrunlock(&siridb->series_mutex);
+    }
+}
@@ -33,6 +33,7 @@ cleri_grammar_t * compile_grammar(void)
     cleri_t * k_active_handles = cleri_keyword(CLERI_GID_K_ACTIVE_HANDLES, "active_handles", CLERI_CASE_SENSITIVE);
     cleri_t * k_address = cleri_keyword(CLERI_GID_K_ADDRESS, "address", CLERI_CASE_SENSITIVE);
     cleri_t * k_after = cleri_keyword(CLERI_GID_K_AFTER, "after", CLERI_CASE_SENSITIVE);
+    cleri_t * k_allocator = cleri_keyword(CLERI_GID_K_ALLOCATOR, "allocator", CLERI_CASE_SENSITIVE);
     cleri_t * k_alter = cleri_keyword(CLERI_GID_K_ALTER, "alter", CLERI_CASE_SENSITIVE);
     cleri_t * k_and = cleri_keyword(CLERI_GID_K_AND, "and", CLERI_CASE_SENSITIVE);
     cleri_t * k_as = cleri_keyword(CLERI_GID_K_AS, "as", CLERI_CASE_SENSITIVE);
@@ -40,7 +41,11 @@ cleri_grammar_t * compile_grammar(void)
     cleri_t * k_before = cleri_keyword(CLERI_GID_K_BEFORE, "before", CLERI_CASE_SENSITIVE);
     cleri_t * k_buffer_size = cleri_keyword(CLERI_GID_K_BUFFER_SIZE, "buffer_size", CLERI_CASE_SENSITIVE);
     cleri_t * k_buffer_path = cleri_keyword(CLERI_GID_K_BUFFER_PATH, "buffer_path", CLERI_CASE_SENSITIVE);
+    cleri_t * k_chunk_cache_hits = cleri_keyword(CLERI_GID_K_CHUNK_CACHE_HITS, "chunk_cache_hits", CLERI_CASE_SENSITIVE);
+    cleri_t * k_chunk_cache_misses = cleri_keyword(CLERI_GID_K_CHUNK_CACHE_MISSES, "chunk_cache_misses", CLERI_CASE_SENSITIVE);
+    cleri_t * k_chunk_cache_usage = cleri_keyword(CLERI_GID_K_CHUNK_CACHE_USAGE, "chunk_cache_usage", CLERI_CASE_SENSITIVE);
     cleri_t * k_between = cleri_keyword(CLERI_GID_K_BETWEEN, "between", CLERI_CASE_SENSITIVE);
+    cleri_t * k_bottom = cleri_keyword(CLERI_GID_K_BOTTOM, "bottom", CLERI_CASE_SENSITIVE);
     cleri_t * k_count = cleri_keyword(CLERI_GID_K_COUNT, "count", CLERI_CASE_SENSITIVE);
     cleri_t * k_create = cleri_keyword(CLERI_GID_K_CREATE, "create", CLERI_CASE_SENSITIVE);
     cleri_t * k_critical = cleri_keyword(CLERI_GID_K_CRITICAL, "critical", CLERI_CASE_SENSITIVE);
@@ -56,9 +61,15 @@ cleri_grammar_t * compile_grammar(void)
     cleri_t * k_duration_num = cleri_keyword(CLERI_GID_K_DURATION_NUM, "duration_num", CLERI_CASE_SENSITIVE);
     cleri_t * k_end = cleri_keyword(CLERI_GID_K_END, "end", CLERI_CASE_SENSITIVE);
     cleri_t * k_error = cleri_keyword(CLERI_GID_K_ERROR, "error", CLERI_CASE_SENSITIVE);
+    cleri_t * k_expiration_log = cleri_keyword(CLERI_GID_K_EXPIRATION_LOG, "expiration_log", CLERI_CASE_SENSITIVE);
+    cleri_t * k_expiration_num = cleri_keyword(CLERI_GID_K_EXPIRATION_NUM, "expiration_num", CLERI_CASE_SENSITIVE);
+    cleri_t * k_explain = cleri_keyword(CLERI_GID_K_EXPLAIN, "explain", CLERI_CASE_SENSITIVE);
     cleri_t * k_expression = cleri_keyword(CLERI_GID_K_EXPRESSION, "expression", CLERI_CASE_SENSITIVE);
     cleri_t * k_false = cleri_keyword(CLERI_GID_K_FALSE, "false", CLERI_CASE_SENSITIVE);
     cleri_t * k_fifo_files = cleri_keyword(CLERI_GID_K_FIFO_FILES, "fifo_files", CLERI_CASE_SENSITIVE);
+    cleri_t * k_file_handle_evictions = cleri_keyword(CLERI_GID_K_FILE_HANDLE_EVICTIONS, "file_handle_evictions", CLERI_CASE_SENSITIVE);
+    cleri_t * k_file_handle_hits = cleri_keyword(CLERI_GID_K_FILE_HANDLE_HITS, "file_handle_hits", CLERI_CASE_SENSITIVE);
+    cleri_t * k_file_handle_opens = cleri_keyword(CLERI_GID_K_FILE_HANDLE_OPENS, "file_handle_opens", CLERI_CASE_SENSITIVE);
     cleri_t * k_filter = cleri_keyword(CLERI_GID_K_FILTER, "filter", CLERI_CASE_SENSITIVE);
     cleri_t * k_float = cleri_keyword(CLERI_GID_K_FLOAT, "float", CLERI_CASE_SENSITIVE);
     cleri_t * k_for = cleri_keyword(CLERI_GID_K_FOR, "for", CLERI_CASE_SENSITIVE);
@@ -74,9 +85,12 @@ cleri_grammar_t * compile_grammar(void)
         cleri_keyword(CLERI_NONE, "help", CLERI_CASE_SENSITIVE),
         cleri_token(CLERI_NONE, "?")
     );
+    cleri_t * k_hot_series = cleri_keyword(CLERI_GID_K_HOT_SERIES, "hot_series", CLERI_CASE_SENSITIVE);
     cleri_t * k_info = cleri_keyword(CLERI_GID_K_INFO, "info", CLERI_CASE_SENSITIVE);
     cleri_t * k_ignore_threshold = cleri_keyword(CLERI_GID_K_IGNORE_THRESHOLD, "ignore_threshold", CLERI_CASE_SENSITIVE);
     cleri_t * k_insert = cleri_keyword(CLERI_GID_K_INSERT, "insert", CLERI_CASE_SENSITIVE);
+    cleri_t * k_insert_queue = cleri_keyword(CLERI_GID_K_INSERT_QUEUE, "insert_queue", CLERI_CASE_SENSITIVE);
+    cleri_t * k_insert_queue_size = cleri_keyword(CLERI_GID_K_INSERT_QUEUE_SIZE, "insert_queue_size", CLERI_CASE_SENSITIVE);
     cleri_t * k_integer = cleri_keyword(CLERI_GID_K_INTEGER, "integer", CLERI_CASE_SENSITIVE);
     cleri_t * k_intersection = cleri_choice(
         CLERI_GID_K_INTERSECTION,
@@ -86,40 +100,59 @@ cleri_grammar_t * compile_grammar(void)
         cleri_keyword(CLERI_NONE, "intersection", CLERI_CASE_SENSITIVE)
     );
     cleri_t * k_ip_support = cleri_keyword(CLERI_GID_K_IP_SUPPORT, "ip_support", CLERI_CASE_SENSITIVE);
+    cleri_t * k_join = cleri_keyword(CLERI_GID_K_JOIN, "join", CLERI_CASE_SENSITIVE);
+    cleri_t * k_kill = cleri_keyword(CLERI_GID_K_KILL, "kill", CLERI_CASE_SENSITIVE);
+    cleri_t * k_latency = cleri_keyword(CLERI_GID_K_LATENCY, "latency", CLERI_CASE_SENSITIVE);
     cleri_t * k_length = cleri_keyword(CLERI_GID_K_LENGTH, "length", CLERI_CASE_SENSITIVE);
     cleri_t * k_libuv = cleri_keyword(CLERI_GID_K_LIBUV, "libuv", CLERI_CASE_SENSITIVE);
     cleri_t * k_limit = cleri_keyword(CLERI_GID_K_LIMIT, "limit", CLERI_CASE_SENSITIVE);
     cleri_t * k_list = cleri_keyword(CLERI_GID_K_LIST, "list", CLERI_CASE_SENSITIVE);
     cleri_t * k_list_limit = cleri_keyword(CLERI_GID_K_LIST_LIMIT, "list_limit", CLERI_CASE_SENSITIVE);
+    cleri_t * k_lock_contention = cleri_keyword(CLERI_GID_K_LOCK_CONTENTION, "lock_contention", CLERI_CASE_SENSITIVE);
     cleri_t * k_log = cleri_keyword(CLERI_GID_K_LOG, "log", CLERI_CASE_SENSITIVE);
     cleri_t * k_log_level = cleri_keyword(CLERI_GID_K_LOG_LEVEL, "log_level", CLERI_CASE_SENSITIVE);
+    cleri_t * k_loop = cleri_keyword(CLERI_GID_K_LOOP, "loop", CLERI_CASE_SENSITIVE);
+    cleri_t * k_lttb = cleri_keyword(CLERI_GID_K_LTTB, "lttb", CLERI_CASE_SENSITIVE);
     cleri_t * k_max = cleri_keyword(CLERI_GID_K_MAX, "max", CLERI_CASE_SENSITIVE);
     cleri_t * k_max_open_files = cleri_keyword(CLERI_GID_K_MAX_OPEN_FILES, "max_open_files", CLERI_CASE_SENSITIVE);
     cleri_t * k_mean = cleri_keyword(CLERI_GID_K_MEAN, "mean", CLERI_CASE_SENSITIVE);
     cleri_t * k_median = cleri_keyword(CLERI_GID_K_MEDIAN, "median", CLERI_CASE_SENSITIVE);
     cleri_t * k_median_low = cleri_keyword(CLERI_GID_K_MEDIAN_LOW, "median_low", CLERI_CASE_SENSITIVE);
     cleri_t * k_median_high = cleri_keyword(CLERI_GID_K_MEDIAN_HIGH, "median_high", CLERI_CASE_SENSITIVE);
+    cleri_t * k_mem_buffer = cleri_keyword(CLERI_GID_K_MEM_BUFFER, "mem_buffer", CLERI_CASE_SENSITIVE);
+    cleri_t * k_mem_groups = cleri_keyword(CLERI_GID_K_MEM_GROUPS, "mem_groups", CLERI_CASE_SENSITIVE);
+    cleri_t * k_mem_insert = cleri_keyword(CLERI_GID_K_MEM_INSERT, "mem_insert", CLERI_CASE_SENSITIVE);
+    cleri_t * k_mem_net = cleri_keyword(CLERI_GID_K_MEM_NET, "mem_net", CLERI_CASE_SENSITIVE);
+    cleri_t * k_mem_query = cleri_keyword(CLERI_GID_K_MEM_QUERY, "mem_query", CLERI_CASE_SENSITIVE);
+    cleri_t * k_mem_series = cleri_keyword(CLERI_GID_K_MEM_SERIES, "mem_series", CLERI_CASE_SENSITIVE);
+    cleri_t * k_mem_shard = cleri_keyword(CLERI_GID_K_MEM_SHARD, "mem_shard", CLERI_CASE_SENSITIVE);
     cleri_t * k_mem_usage = cleri_keyword(CLERI_GID_K_MEM_USAGE, "mem_usage", CLERI_CASE_SENSITIVE);
     cleri_t * k_merge = cleri_keyword(CLERI_GID_K_MERGE, "merge", CLERI_CASE_SENSITIVE);
     cleri_t * k_min = cleri_keyword(CLERI_GID_K_MIN, "min", CLERI_CASE_SENSITIVE);
+    cleri_t * k_minmax = cleri_keyword(CLERI_GID_K_MINMAX, "minmax", CLERI_CASE_SENSITIVE);
     cleri_t * k_modify = cleri_keyword(CLERI_GID_K_MODIFY, "modify", CLERI_CASE_SENSITIVE);
     cleri_t * k_name = cleri_keyword(CLERI_GID_K_NAME, "name", CLERI_CASE_SENSITIVE);
     cleri_t * k_now = cleri_keyword(CLERI_GID_K_NOW, "now", CLERI_CASE_SENSITIVE);
     cleri_t * k_number = cleri_keyword(CLERI_GID_K_NUMBER, "number", CLERI_CASE_SENSITIVE);
     cleri_t * k_online = cleri_keyword(CLERI_GID_K_ONLINE, "online", CLERI_CASE_SENSITIVE);
     cleri_t * k_open_files = cleri_keyword(CLERI_GID_K_OPEN_FILES, "open_files", CLERI_CASE_SENSITIVE);
+    cleri_t * k_optimize_progress = cleri_keyword(CLERI_GID_K_OPTIMIZE_PROGRESS, "optimize_progress", CLERI_CASE_SENSITIVE);
     cleri_t * k_or = cleri_keyword(CLERI_GID_K_OR, "or", CLERI_CASE_SENSITIVE);
     cleri_t * k_password = cleri_keyword(CLERI_GID_K_PASSWORD, "password", CLERI_CASE_SENSITIVE);
+    cleri_t * k_percentile = cleri_keyword(CLERI_GID_K_PERCENTILE, "percentile", CLERI_CASE_SENSITIVE);
     cleri_t * k_points = cleri_keyword(CLERI_GID_K_POINTS, "points", CLERI_CASE_SENSITIVE);
     cleri_t * k_pool = cleri_keyword(CLERI_GID_K_POOL, "pool", CLERI_CASE_SENSITIVE);
     cleri_t * k_pools = cleri_keyword(CLERI_GID_K_POOLS, "pools", CLERI_CASE_SENSITIVE);
     cleri_t * k_port = cleri_keyword(CLERI_GID_K_PORT, "port", CLERI_CASE_SENSITIVE);
     cleri_t * k_prefix = cleri_keyword(CLERI_GID_K_PREFIX, "prefix", CLERI_CASE_SENSITIVE);
     cleri_t * k_pvariance = cleri_keyword(CLERI_GID_K_PVARIANCE, "pvariance", CLERI_CASE_SENSITIVE);
+    cleri_t * k_queries = cleri_keyword(CLERI_GID_K_QUERIES, "queries", CLERI_CASE_SENSITIVE);
+    cleri_t * k_query = cleri_keyword(CLERI_GID_K_QUERY, "query", CLERI_CASE_SENSITIVE);
     cleri_t * k_read = cleri_keyword(CLERI_GID_K_READ, "read", CLERI_CASE_SENSITIVE);
     cleri_t * k_received_points = cleri_keyword(CLERI_GID_K_RECEIVED_POINTS, "received_points", CLERI_CASE_SENSITIVE);
     cleri_t * k_reindex_progress = cleri_keyword(CLERI_GID_K_REINDEX_PROGRESS, "reindex_progress", CLERI_CASE_SENSITIVE);
     cleri_t * k_revoke = cleri_keyword(CLERI_GID_K_REVOKE, "revoke", CLERI_CASE_SENSITIVE);
+    cleri_t * k_rtt = cleri_keyword(CLERI_GID_K_RTT, "rtt", CLERI_CASE_SENSITIVE);
     cleri_t * k_select = cleri_keyword(CLERI_GID_K_SELECT, "select", CLERI_CASE_SENSITIVE);
     cleri_t * k_select_points_limit = cleri_keyword(CLERI_GID_K_SELECT_POINTS_LIMIT, "select_points_limit", CLERI_CASE_SENSITIVE);
     cleri_t * k_selected_points = cleri_keyword(CLERI_GID_K_SELECTED_POINTS, "selected_points", CLERI_CASE_SENSITIVE);
@@ -131,7 +164,9 @@ cleri_grammar_t * compile_grammar(void)
     cleri_t * k_shards = cleri_keyword(CLERI_GID_K_SHARDS, "shards", CLERI_CASE_SENSITIVE);
     cleri_t * k_show = cleri_keyword(CLERI_GID_K_SHOW, "show", CLERI_CASE_SENSITIVE);
     cleri_t * k_size = cleri_keyword(CLERI_GID_K_SIZE, "size", CLERI_CASE_SENSITIVE);
+    cleri_t * k_snapshot = cleri_keyword(CLERI_GID_K_SNAPSHOT, "snapshot", CLERI_CASE_SENSITIVE);
     cleri_t * k_start = cleri_keyword(CLERI_GID_K_START, "start", CLERI_CASE_SENSITIVE);
+    cleri_t * k_startup_profile = cleri_keyword(CLERI_GID_K_STARTUP_PROFILE, "startup_profile", CLERI_CASE_SENSITIVE);
     cleri_t * k_startup_time = cleri_keyword(CLERI_GID_K_STARTUP_TIME, "startup_time", CLERI_CASE_SENSITIVE);
     cleri_t * k_status = cleri_keyword(CLERI_GID_K_STATUS, "status", CLERI_CASE_SENSITIVE);
     cleri_t * k_string = cleri_keyword(CLERI_GID_K_STRING, "string", CLERI_CASE_SENSITIVE);
@@ -149,6 +184,7 @@ cleri_grammar_t * compile_grammar(void)
     cleri_t * k_timezone = cleri_keyword(CLERI_GID_K_TIMEZONE, "timezone", CLERI_CASE_SENSITIVE);
     cleri_t * k_time_precision = cleri_keyword(CLERI_GID_K_TIME_PRECISION, "time_precision", CLERI_CASE_SENSITIVE);
     cleri_t * k_to = cleri_keyword(CLERI_GID_K_TO, "to", CLERI_CASE_SENSITIVE);
+    cleri_t * k_top = cleri_keyword(CLERI_GID_K_TOP, "top", CLERI_CASE_SENSITIVE);
     cleri_t * k_true = cleri_keyword(CLERI_GID_K_TRUE, "true", CLERI_CASE_SENSITIVE);
     cleri_t * k_type = cleri_keyword(CLERI_GID_K_TYPE, "type", CLERI_CASE_SENSITIVE);
     cleri_t * k_union = cleri_choice(
@@ -263,13 +299,16 @@ cleri_grammar_t * compile_grammar(void)
     cleri_t * series_columns = cleri_list(CLERI_GID_SERIES_COLUMNS, cleri_choice(
         CLERI_NONE,
         CLERI_FIRST_MATCH,
-        6,
+        9,
         k_name,
         k_type,
         k_length,
         k_start,
         k_end,
-        k_pool
+        k_pool,
+        k_min,
+        k_max,
+        k_sum
     ), cleri_token(CLERI_NONE, ","), 1, 0, 0);
     cleri_t * shard_columns = cleri_list(CLERI_GID_SHARD_COLUMNS, cleri_choice(
         CLERI_NONE,
@@ -287,7 +326,7 @@ cleri_grammar_t * compile_grammar(void)
     cleri_t * server_columns = cleri_list(CLERI_GID_SERVER_COLUMNS, cleri_choice(
         CLERI_NONE,
         CLERI_FIRST_MATCH,
-        25,
+        27,
         k_address,
         k_buffer_path,
         k_buffer_size,
@@ -302,6 +341,8 @@ cleri_grammar_t * compile_grammar(void)
         k_online,
         k_startup_time,
         k_status,
+        k_latency,
+        k_rtt,
         k_active_handles,
         k_fifo_files,
         k_log_level,
@@ -441,9 +482,12 @@ cleri_grammar_t * compile_grammar(void)
                 cleri_choice(
                     CLERI_NONE,
                     CLERI_FIRST_MATCH,
-                    2,
+                    5,
                     k_length,
-                    k_pool
+                    k_pool,
+                    k_min,
+                    k_max,
+                    k_sum
                 ),
                 int_operator,
                 int_expr
@@ -518,12 +562,14 @@ cleri_grammar_t * compile_grammar(void)
                 cleri_choice(
                     CLERI_NONE,
                     CLERI_FIRST_MATCH,
-                    12,
+                    14,
                     k_active_handles,
                     k_buffer_size,
                     k_fifo_files,
+                    k_latency,
                     k_port,
                     k_pool,
+                    k_rtt,
                     k_startup_time,
                     k_max_open_files,
                     k_mem_usage,
@@ -749,12 +795,38 @@ cleri_grammar_t * compile_grammar(void)
         group_match,
         series_re
     ), series_sep, 1, 0, 0);
+    cleri_t * series_after = cleri_sequence(
+        CLERI_GID_SERIES_AFTER,
+        2,
+        k_after,
+        string
+    );
     cleri_t * limit_expr = cleri_sequence(
         CLERI_GID_LIMIT_EXPR,
         2,
         k_limit,
         int_expr
     );
+    cleri_t * top_expr = cleri_sequence(
+        CLERI_GID_TOP_EXPR,
+        2,
+        cleri_choice(
+            CLERI_NONE,
+            CLERI_MOST_GREEDY,
+            2,
+            k_top,
+            k_bottom
+        ),
+        r_uinteger
+    );
+    cleri_t * join_expr = cleri_sequence(
+        CLERI_GID_JOIN_EXPR,
+        4,
+        k_join,
+        cleri_list(CLERI_NONE, string, cleri_tokens(CLERI_NONE, "+ - * /"), 2, 0, 0),
+        k_as,
+        string
+    );
     cleri_t * before_expr = cleri_sequence(
         CLERI_GID_BEFORE_EXPR,
         2,
@@ -843,6 +915,16 @@ cleri_grammar_t * compile_grammar(void)
         time_expr,
         cleri_token(CLERI_NONE, ")")
     );
+    cleri_t * f_percentile = cleri_sequence(
+        CLERI_GID_F_PERCENTILE,
+        6,
+        k_percentile,
+        cleri_token(CLERI_NONE, "("),
+        time_expr,
+        cleri_token(CLERI_NONE, ","),
+        r_float,
+        cleri_token(CLERI_NONE, ")")
+    );
     cleri_t * f_sum = cleri_sequence(
         CLERI_GID_F_SUM,
         4,
@@ -931,17 +1013,36 @@ cleri_grammar_t * compile_grammar(void)
         ),
         cleri_token(CLERI_NONE, ")")
     );
+    cleri_t * f_lttb = cleri_sequence(
+        CLERI_GID_F_LTTB,
+        4,
+        k_lttb,
+        cleri_token(CLERI_NONE, "("),
+        int_expr,
+        cleri_token(CLERI_NONE, ")")
+    );
+    cleri_t * f_minmax = cleri_sequence(
+        CLERI_GID_F_MINMAX,
+        4,
+        k_minmax,
+        cleri_token(CLERI_NONE, "("),
+        int_expr,
+        cleri_token(CLERI_NONE, ")")
+    );
     cleri_t * aggregate_functions = cleri_list(CLERI_GID_AGGREGATE_FUNCTIONS, cleri_choice(
         CLERI_NONE,
         CLERI_FIRST_MATCH,
-        15,
+        18,
         f_points,
         f_limit,
+        f_lttb,
+        f_minmax,
         f_mean,
         f_sum,
         f_median,
         f_median_low,
         f_median_high,
+        f_percentile,
         f_min,
         f_max,
         f_count,
@@ -992,6 +1093,20 @@ cleri_grammar_t * compile_grammar(void)
         k_drop_threshold,
         r_float
     );
+    cleri_t * set_expiration_log = cleri_sequence(
+        CLERI_GID_SET_EXPIRATION_LOG,
+        3,
+        k_set,
+        k_expiration_log,
+        r_time_str
+    );
+    cleri_t * set_expiration_num = cleri_sequence(
+        CLERI_GID_SET_EXPIRATION_NUM,
+        3,
+        k_set,
+        k_expiration_num,
+        r_time_str
+    );
     cleri_t * set_expression = cleri_sequence(
         CLERI_GID_SET_EXPRESSION,
         3,
@@ -1062,8 +1177,10 @@ cleri_grammar_t * compile_grammar(void)
         cleri_choice(
             CLERI_NONE,
             CLERI_FIRST_MATCH,
-            4,
+            6,
             set_drop_threshold,
+            set_expiration_log,
+            set_expiration_num,
             set_list_limit,
             set_select_points_limit,
             set_timezone
@@ -1191,6 +1308,11 @@ cleri_grammar_t * compile_grammar(void)
         k_for,
         r_regex
     );
+    cleri_t * create_snapshot = cleri_sequence(
+        CLERI_GID_CREATE_SNAPSHOT,
+        1,
+        k_snapshot
+    );
     cleri_t * create_user = cleri_sequence(
         CLERI_GID_CREATE_USER,
         3,
@@ -1252,13 +1374,19 @@ cleri_grammar_t * compile_grammar(void)
         cleri_optional(CLERI_NONE, pool_columns),
         cleri_optional(CLERI_NONE, where_pool)
     );
+    cleri_t * list_queries = cleri_sequence(
+        CLERI_GID_LIST_QUERIES,
+        1,
+        k_queries
+    );
     cleri_t * list_series = cleri_sequence(
         CLERI_GID_LIST_SERIES,
-        4,
+        5,
         k_series,
         cleri_optional(CLERI_NONE, series_columns),
         cleri_optional(CLERI_NONE, series_match),
-        cleri_optional(CLERI_NONE, where_series)
+        cleri_optional(CLERI_NONE, where_series),
+        cleri_optional(CLERI_NONE, series_after)
     );
     cleri_t * list_servers = cleri_sequence(
         CLERI_GID_LIST_SERVERS,
@@ -1330,8 +1458,9 @@ cleri_grammar_t * compile_grammar(void)
         cleri_choice(
             CLERI_NONE,
             CLERI_MOST_GREEDY,
-            2,
+            3,
             create_group,
+            create_snapshot,
             create_user
         )
     );
@@ -1363,6 +1492,13 @@ cleri_grammar_t * compile_grammar(void)
             grant_user
         )
     );
+    cleri_t * kill_stmt = cleri_sequence(
+        CLERI_GID_KILL_STMT,
+        3,
+        k_kill,
+        k_query,
+        r_uinteger
+    );
     cleri_t * list_stmt = cleri_sequence(
         CLERI_GID_LIST_STMT,
         3,
@@ -1370,13 +1506,14 @@ cleri_grammar_t * compile_grammar(void)
         cleri_choice(
             CLERI_NONE,
             CLERI_FIRST_MATCH,
-            6,
+            7,
             list_series,
             list_users,
             list_shards,
             list_groups,
             list_servers,
-            list_pools
+            list_pools,
+            list_queries
         ),
         cleri_optional(CLERI_NONE, limit_expr)
     );
@@ -1395,7 +1532,7 @@ cleri_grammar_t * compile_grammar(void)
     );
     cleri_t * select_stmt = cleri_sequence(
         CLERI_GID_SELECT_STMT,
-        7,
+        8,
         k_select,
         cleri_list(CLERI_NONE, select_aggregate, cleri_token(CLERI_NONE, ","), 1, 0, 0),
         k_from,
@@ -1409,7 +1546,21 @@ cleri_grammar_t * compile_grammar(void)
             between_expr,
             before_expr
         )),
-        cleri_optional(CLERI_NONE, merge_as)
+        cleri_optional(CLERI_NONE, limit_expr),
+        cleri_optional(CLERI_NONE, cleri_choice(
+            CLERI_NONE,
+            CLERI_FIRST_MATCH,
+            3,
+            top_expr,
+            merge_as,
+            join_expr
+        ))
+    );
+    cleri_t * explain_stmt = cleri_sequence(
+        CLERI_GID_EXPLAIN_STMT,
+        2,
+        k_explain,
+        select_stmt
     );
     cleri_t * show_stmt = cleri_sequence(
         CLERI_GID_SHOW_STMT,
@@ -1418,29 +1569,53 @@ cleri_grammar_t * compile_grammar(void)
         cleri_list(CLERI_NONE, cleri_choice(
             CLERI_NONE,
             CLERI_FIRST_MATCH,
-            31,
+            55,
             k_active_handles,
+            k_allocator,
             k_buffer_path,
             k_buffer_size,
+            k_chunk_cache_hits,
+            k_chunk_cache_misses,
+            k_chunk_cache_usage,
             k_dbname,
             k_dbpath,
             k_drop_threshold,
             k_duration_log,
             k_duration_num,
+            k_expiration_log,
+            k_expiration_num,
             k_fifo_files,
+            k_file_handle_evictions,
+            k_file_handle_hits,
+            k_file_handle_opens,
+            k_hot_series,
+            k_insert_queue,
+            k_insert_queue_size,
             k_ip_support,
+            k_latency,
             k_libuv,
             k_list_limit,
+            k_lock_contention,
             k_log_level,
+            k_loop,
             k_max_open_files,
+            k_mem_buffer,
+            k_mem_groups,
+            k_mem_insert,
+            k_mem_net,
+            k_mem_query,
+            k_mem_series,
+            k_mem_shard,
             k_mem_usage,
             k_open_files,
+            k_optimize_progress,
             k_pool,
             k_received_points,
             k_reindex_progress,
             k_selected_points,
             k_select_points_limit,
             k_server,
+            k_startup_profile,
             k_startup_time,
             k_status,
             k_sync_progress,
@@ -1525,6 +1700,7 @@ cleri_grammar_t * compile_grammar(void)
     );
     cleri_t * help_select = cleri_keyword(CLERI_GID_HELP_SELECT, "select", CLERI_CASE_SENSITIVE);
     cleri_t * help_create_group = cleri_keyword(CLERI_GID_HELP_CREATE_GROUP, "group", CLERI_CASE_SENSITIVE);
+    cleri_t * help_create_snapshot = cleri_keyword(CLERI_GID_HELP_CREATE_SNAPSHOT, "snapshot", CLERI_CASE_SENSITIVE);
     cleri_t * help_create_user = cleri_keyword(CLERI_GID_HELP_CREATE_USER, "user", CLERI_CASE_SENSITIVE);
     cleri_t * help_create = cleri_sequence(
         CLERI_GID_HELP_CREATE,
@@ -1533,8 +1709,9 @@ cleri_grammar_t * compile_grammar(void)
         cleri_optional(CLERI_NONE, cleri_choice(
             CLERI_NONE,
             CLERI_MOST_GREEDY,
-            2,
+            3,
             help_create_group,
+            help_create_snapshot,
             help_create_user
         ))
     );
@@ -1591,8 +1768,9 @@ cleri_grammar_t * compile_grammar(void)
         cleri_optional(CLERI_NONE, cleri_choice(
             CLERI_NONE,
             CLERI_FIRST_MATCH,
-            11,
+            13,
             select_stmt,
+            explain_stmt,
             list_stmt,
             count_stmt,
             alter_stmt,
@@ -1600,6 +1778,7 @@ cleri_grammar_t * compile_grammar(void)
             drop_stmt,
             grant_stmt,
             revoke_stmt,
+            kill_stmt,
             show_stmt,
             calc_stmt,
             help
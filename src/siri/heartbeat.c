@@ -14,8 +14,13 @@
  *
  */
 #include <logger/logger.h>
+#include <siri/alloc.h>
+#include <siri/db/continuous.h>
+#include <siri/db/hot.h>
 #include <siri/db/server.h>
+#include <siri/db/session.h>
 #include <siri/heartbeat.h>
+#include <siri/loop.h>
 #include <uv.h>
 
 #ifdef DEBUG
@@ -23,6 +28,7 @@
 #endif
 
 static uv_timer_t heartbeat;
+static uint64_t heartbeat_purged = 0;  /* ms, last allocator purge */
 
 #define HEARTBEAT_INIT_TIMEOUT 1000
 
@@ -62,17 +68,23 @@ static void HEARTBEAT_cb(uv_timer_t * handle __attribute__((unused)))
 
     llist_node_t * siridb_node;
     llist_node_t * server_node;
+    siri_loop_frame_t frame;
 
 #ifdef DEBUG
     log_debug("Start heart-beat task");
 #endif
 
+    siri_loop_enter(&frame);
+
     siridb_node = siri.siridb_list->first;
 
     while (siridb_node != NULL)
     {
         siridb = (siridb_t *) siridb_node->data;
 
+        /* counters which are sent with the flags update */
+        siridb_server_counts_update(siridb);
+
         server_node = siridb->servers->first;
         while (server_node != NULL)
         {
@@ -85,12 +97,38 @@ static void HEARTBEAT_cb(uv_timer_t * handle __attribute__((unused)))
             else if (siridb_server_is_online(server))
             {
                 siridb_server_send_flags(server);
+                siridb_server_connect_bulk(siridb, server);
             }
 
             server_node = server_node->next;
         }
 
+        /* run continuous queries for the intervals which are closed */
+        siridb_continuous_run(siridb);
+
+        siridb_sessions_cleanup(siridb);
+
+        /* halve the counts so the hot series follow a changing load */
+        if (    siridb->hot != NULL &&
+                uv_now(siri.loop) - siridb->hot->decayed >=
+                    (uint64_t) SIRIDB_HOT_DECAY * 1000)
+        {
+            siridb->hot->decayed = uv_now(siri.loop);
+            siridb_hot_decay(siridb->hot);
+        }
+
         siridb_node = siridb_node->next;
     }
+
+    /* return memory which is not in use to the system */
+    if (    siri.cfg->alloc_purge_interval &&
+            uv_now(siri.loop) - heartbeat_purged >=
+                (uint64_t) siri.cfg->alloc_purge_interval * 1000)
+    {
+        heartbeat_purged = uv_now(siri.loop);
+        siri_alloc_purge();
+    }
+
+    siri_loop_done(SIRI_LOOP_TIMER, &frame);
 }
 
@@ -0,0 +1,295 @@
+/*
+ * latency.c - Latency histograms for each request type.
+ *
+ * author       : Jeroen van der Heijden
+ * email        : jeroen@transceptor.technology
+ * copyright    : 2016, Transceptor Technology
+ *
+ * Latency is recorded in micro seconds in log-linear histograms, like
+ * HdrHistogram. Each power of two is split in SIRI_LATENCY_SUB buckets so
+ * a percentile has a relative error of at most 1 / SIRI_LATENCY_SUB while
+ * recording a value costs only a few instructions.
+ *
+ * Wait time is the time a request was queued in the event loop before it
+ * was handled. Requests which are handled directly when they are received
+ * have no wait time. All histograms are updated from the event loop so no
+ * locking is required.
+ *
+ * changes
+ *  - initial version, 14-10-2016
+ *
+ */
+#include <siri/latency.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define LATENCY_LINE_SZ 160
+
+siri_latency_t siri_latency[SIRI_LATENCY_END];
+
+static const char * latency_str[SIRI_LATENCY_END] = {
+        "query",
+        "insert",
+        "auth",
+        "ping",
+        "info",
+        "loaddb",
+        "register_server",
+        "file",
+        "admin",
+        "fetch",
+        "backend_auth",
+        "backend_flags",
+        "backend_log_level",
+        "backend_repl_finished",
+        "backend_query",
+        "backend_insert",
+        "backend_register_server",
+        "backend_drop_series",
+        "backend_groups",
+        "backend_backup_mode",
+        "backend_kill_query",
+        "backend_fetch",
+        "select",
+        "list",
+        "count",
+        "drop",
+        "other"};
+
+static const double latency_percentiles[] = {50.0, 99.0, 99.9};
+
+#define LATENCY_NPERCENTILES \
+    (sizeof(latency_percentiles) / sizeof(latency_percentiles[0]))
+
+static void LATENCY_record(siri_latency_hist_t * hist, uint64_t ns);
+static uint64_t LATENCY_high(uint32_t i);
+static int LATENCY_pack_hist(
+        qp_packer_t * packer,
+        siri_latency_hist_t * hist);
+
+const char * siri_latency_str(siri_latency_tp_t tp)
+{
+    return latency_str[tp];
+}
+
+void siri_latency_add(siri_latency_tp_t tp, uint64_t wait, uint64_t exec)
+{
+    LATENCY_record(&siri_latency[tp].wait, wait);
+    LATENCY_record(&siri_latency[tp].exec, exec);
+}
+
+/*
+ * Returns the number of values in buckets which have their highest value
+ * less than or equal to 'us' micro seconds. Values in the bucket which
+ * contains 'us' are not counted, unless 'us' is the highest value of the
+ * bucket.
+ */
+uint64_t siri_latency_count_le(siri_latency_hist_t * hist, uint64_t us)
+{
+    uint64_t count = 0;
+
+    for (uint32_t i = 0; i < SIRI_LATENCY_BUCKETS - 1; i++)
+    {
+        if (LATENCY_high(i) > us)
+        {
+            break;
+        }
+
+        count += hist->buckets[i];
+    }
+
+    return count;
+}
+
+/*
+ * Returns the highest value in micro seconds of the bucket which contains
+ * percentile 'p' (0..100) or 0 when nothing is recorded.
+ */
+uint64_t siri_latency_percentile(siri_latency_hist_t * hist, double p)
+{
+    uint64_t rank = (uint64_t) (hist->n * p / 100.0 + 0.5);
+    uint64_t seen = 0;
+    uint64_t high;
+
+    if (!hist->n)
+    {
+        return 0;
+    }
+
+    if (!rank)
+    {
+        rank = 1;
+    }
+
+    for (uint32_t i = 0; i < SIRI_LATENCY_BUCKETS; i++)
+    {
+        if ((seen += hist->buckets[i]) < rank)
+        {
+            continue;
+        }
+
+        if (i == SIRI_LATENCY_BUCKETS - 1)
+        {
+            /* the last bucket also counts values which are out of range */
+            return hist->max;
+        }
+
+        high = LATENCY_high(i);
+
+        return (high < hist->max) ? high : hist->max;
+    }
+
+    return hist->max;
+}
+
+/*
+ * Returns a summary with a line for each request type which has received at
+ * least one request, or NULL in case of an allocation error.
+ *
+ * The return value must be freed by the caller.
+ */
+char * siri_latency_summary(void)
+{
+    char * buf = (char *) malloc(SIRI_LATENCY_END * LATENCY_LINE_SZ + 1);
+    char * pt = buf;
+    siri_latency_t * latency;
+    int n;
+
+    if (buf == NULL)
+    {
+        return NULL;
+    }
+
+    *pt = '\0';
+
+    for (int tp = 0; tp < SIRI_LATENCY_END; tp++)
+    {
+        latency = siri_latency + tp;
+
+        if (!latency->exec.n)
+        {
+            continue;
+        }
+
+        n = snprintf(
+                pt,
+                LATENCY_LINE_SZ,
+                "%s%s: n=%" PRIu64 " wait_p99=%" PRIu64 "us exec_p50=%"
+                PRIu64 "us exec_p99=%" PRIu64 "us exec_p999=%" PRIu64
+                "us exec_max=%" PRIu64 "us",
+                (pt == buf) ? "" : "\n",
+                latency_str[tp],
+                latency->exec.n,
+                siri_latency_percentile(&latency->wait, 99.0),
+                siri_latency_percentile(&latency->exec, 50.0),
+                siri_latency_percentile(&latency->exec, 99.0),
+                siri_latency_percentile(&latency->exec, 99.9),
+                latency->exec.max);
+
+        /* snprintf() returns the length without truncating */
+        pt += (n < LATENCY_LINE_SZ) ? n : LATENCY_LINE_SZ - 1;
+    }
+
+    return buf;
+}
+
+/*
+ * Add a map with the percentiles in micro seconds for each request type
+ * which has received at least one request to 'packer'.
+ *
+ * Returns 0 if successful or -1 in case of an error.
+ */
+int siri_latency_pack(qp_packer_t * packer)
+{
+    int rc = qp_add_type(packer, QP_MAP_OPEN);
+    siri_latency_t * latency;
+
+    for (int tp = 0; tp < SIRI_LATENCY_END; tp++)
+    {
+        latency = siri_latency + tp;
+
+        if (!latency->exec.n)
+        {
+            continue;
+        }
+
+        rc += qp_add_string(packer, latency_str[tp]);
+        rc += qp_add_type(packer, QP_MAP3);
+        rc += qp_add_raw(packer, "n", 1);
+        rc += qp_add_int64(packer, (int64_t) latency->exec.n);
+        rc += qp_add_raw(packer, "wait", 4);
+        rc += LATENCY_pack_hist(packer, &latency->wait);
+        rc += qp_add_raw(packer, "exec", 4);
+        rc += LATENCY_pack_hist(packer, &latency->exec);
+    }
+
+    return (rc + qp_add_type(packer, QP_MAP_CLOSE)) ? -1 : 0;
+}
+
+static void LATENCY_record(siri_latency_hist_t * hist, uint64_t ns)
+{
+    uint64_t us = ns / 1000;
+    uint32_t i;
+
+    if (us < 2 * SIRI_LATENCY_SUB)
+    {
+        i = (uint32_t) us;
+    }
+    else
+    {
+        uint32_t shift = 64 - __builtin_clzll(us) - SIRI_LATENCY_SUB_BITS - 1;
+
+        i = (shift >= SIRI_LATENCY_MAX_BITS - SIRI_LATENCY_SUB_BITS) ?
+                SIRI_LATENCY_BUCKETS - 1 :
+                (shift + 1) * SIRI_LATENCY_SUB +
+                (uint32_t) (us >> shift) - SIRI_LATENCY_SUB;
+    }
+
+    hist->buckets[i]++;
+    hist->n++;
+    hist->sum += us;
+
+    if (us > hist->max)
+    {
+        hist->max = us;
+    }
+}
+
+/*
+ * Returns the highest value in micro seconds which is counted in bucket 'i'.
+ */
+static uint64_t LATENCY_high(uint32_t i)
+{
+    uint32_t shift;
+
+    if (i < 2 * SIRI_LATENCY_SUB)
+    {
+        return i;
+    }
+
+    shift = i / SIRI_LATENCY_SUB - 1;
+
+    return ((uint64_t) (i % SIRI_LATENCY_SUB + SIRI_LATENCY_SUB + 1)
+            << shift) - 1;
+}
+
+static int LATENCY_pack_hist(
+        qp_packer_t * packer,
+        siri_latency_hist_t * hist)
+{
+    static const char * names[] = {"p50", "p99", "p999"};
+    int rc = qp_add_type(packer, QP_MAP_OPEN);
+
+    for (size_t i = 0; i < LATENCY_NPERCENTILES; i++)
+    {
+        rc += qp_add_string(packer, names[i]);
+        rc += qp_add_int64(packer, (int64_t) siri_latency_percentile(
+                hist,
+                latency_percentiles[i]));
+    }
+
+    rc += qp_add_raw(packer, "max", 3);
+    rc += qp_add_int64(packer, (int64_t) hist->max);
+
+    return rc + qp_add_type(packer, QP_MAP_CLOSE);
+}
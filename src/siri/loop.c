@@ -0,0 +1,210 @@
+/*
+ * loop.c - Event loop lag and time spent per callback category.
+ *
+ * author       : Jeroen van der Heijden
+ * email        : jeroen@transceptor.technology
+ * copyright    : 2016, Transceptor Technology
+ *
+ * All client, back-end, insert and query work shares the event loop, so a
+ * single slow callback delays every client. A probe timer runs each
+ * SIRI_LOOP_PROBE_INTERVAL milliseconds and the lag is the time it runs
+ * later than expected. The callbacks which do most of the work are timed
+ * with siri_loop_enter() and siri_loop_done() so a stall can be traced to
+ * its category. The busy percentage is the time in those callbacks compared
+ * to the time since the statistics are started.
+ *
+ * Warnings are written at most once per SIRI_LOOP_WARN_INTERVAL seconds
+ * so a stalling loop does not flood the log. Everything is updated from
+ * the event loop so no locking is required.
+ *
+ * changes
+ *  - initial version, 14-10-2016
+ *
+ */
+#include <logger/logger.h>
+#include <siri/loop.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LOOP_LINE_SZ 128
+
+siri_loop_t siri_loop;
+
+static uv_timer_t loop_probe;
+
+static const char * loop_str[SIRI_LOOP_END] = {
+        "read",
+        "insert",
+        "listener",
+        "promise",
+        "timer"};
+
+static void LOOP_probe_cb(uv_timer_t * handle);
+static int LOOP_may_warn(uint64_t now);
+
+void siri_loop_init(siri_t * siri)
+{
+    /*
+     * Main Thread
+     */
+
+    memset(&siri_loop, 0, sizeof(siri_loop_t));
+    siri_loop.start = timeit_ns();
+    siri_loop.probe = siri_loop.start + SIRI_LOOP_PROBE_INTERVAL * 1000000;
+
+    uv_timer_init(siri->loop, &loop_probe);
+    uv_timer_start(
+            &loop_probe,
+            LOOP_probe_cb,
+            SIRI_LOOP_PROBE_INTERVAL,
+            SIRI_LOOP_PROBE_INTERVAL);
+}
+
+void siri_loop_stop(void)
+{
+    /*
+     * Main Thread
+     */
+
+    uv_timer_stop(&loop_probe);
+    uv_close((uv_handle_t *) &loop_probe, NULL);
+}
+
+/*
+ * Finish a frame which is started with siri_loop_enter(). Time spent in
+ * nested frames is not counted for 'tp' but is added to the outer frame.
+ */
+void siri_loop_done(siri_loop_tp_t tp, siri_loop_frame_t * frame)
+{
+    siri_loop_stat_t * stat = siri_loop.stat + tp;
+    uint64_t now = timeit_ns();
+    uint64_t total = now - frame->start;
+    uint64_t ns = total - siri_loop.inner;
+
+    siri_loop.inner = frame->inner + total;
+
+    stat->n++;
+    stat->ns += ns;
+
+    if (ns > stat->max_ns)
+    {
+        stat->max_ns = ns;
+    }
+
+    if (ns >= (uint64_t) SIRI_LOOP_SLOW_CB * 1000000)
+    {
+        stat->slow++;
+
+        if (LOOP_may_warn(now))
+        {
+            log_warning(
+                    "Event loop was blocked for %.3f ms by a %s callback",
+                    ns / 1e6,
+                    loop_str[tp]);
+        }
+    }
+}
+
+/*
+ * Returns a string with the lag and a line for each category which has run
+ * at least once, or NULL in case of an allocation error.
+ *
+ * The return value must be freed by the caller.
+ */
+char * siri_loop_summary(void)
+{
+    char * buf = (char *) malloc((SIRI_LOOP_END + 1) * LOOP_LINE_SZ + 1);
+    char * pt = buf;
+    siri_loop_stat_t * stat;
+    uint64_t elapsed = timeit_ns() - siri_loop.start;
+    int n;
+
+    if (buf == NULL)
+    {
+        return NULL;
+    }
+
+    if (!elapsed)
+    {
+        elapsed = 1;
+    }
+
+    n = snprintf(
+            pt,
+            LOOP_LINE_SZ,
+            "lag: n=%" PRIu64 " avg=%.3fms max=%.3fms slow=%" PRIu64,
+            siri_loop.lag_n,
+            siri_loop.lag_n ? siri_loop.lag_ns / 1e6 / siri_loop.lag_n : 0.0,
+            siri_loop.lag_max_ns / 1e6,
+            siri_loop.lag_slow);
+
+    /* snprintf() returns the length without truncating */
+    pt += (n < LOOP_LINE_SZ) ? n : LOOP_LINE_SZ - 1;
+
+    for (int tp = 0; tp < SIRI_LOOP_END; tp++)
+    {
+        stat = siri_loop.stat + tp;
+
+        if (!stat->n)
+        {
+            continue;
+        }
+
+        n = snprintf(
+                pt,
+                LOOP_LINE_SZ,
+                "\n%s: n=%" PRIu64 " busy=%.2f%% avg=%.3fms max=%.3fms "
+                "slow=%" PRIu64,
+                loop_str[tp],
+                stat->n,
+                100.0 * stat->ns / elapsed,
+                stat->ns / 1e6 / stat->n,
+                stat->max_ns / 1e6,
+                stat->slow);
+
+        pt += (n < LOOP_LINE_SZ) ? n : LOOP_LINE_SZ - 1;
+    }
+
+    return buf;
+}
+
+static void LOOP_probe_cb(uv_timer_t * handle __attribute__((unused)))
+{
+    uint64_t now = timeit_ns();
+    uint64_t lag = (now > siri_loop.probe) ? now - siri_loop.probe : 0;
+
+    siri_loop.probe = now + SIRI_LOOP_PROBE_INTERVAL * 1000000;
+    siri_loop.lag_n++;
+    siri_loop.lag_ns += lag;
+
+    if (lag > siri_loop.lag_max_ns)
+    {
+        siri_loop.lag_max_ns = lag;
+    }
+
+    if (lag >= (uint64_t) SIRI_LOOP_SLOW_LAG * 1000000)
+    {
+        siri_loop.lag_slow++;
+
+        if (LOOP_may_warn(now))
+        {
+            log_warning("Event loop is lagging %.3f ms behind", lag / 1e6);
+        }
+    }
+}
+
+/*
+ * Returns 1 (true) when a warning may be written to the log.
+ */
+static int LOOP_may_warn(uint64_t now)
+{
+    uint64_t interval = (uint64_t) SIRI_LOOP_WARN_INTERVAL * 1000000000;
+
+    if (siri_loop.warned && now - siri_loop.warned < interval)
+    {
+        return 0;
+    }
+    siri_loop.warned = now;
+    return 1;
+}
@@ -0,0 +1,52 @@
+/*
+ * mem.c - Memory usage counters for each subsystem.
+ *
+ * author       : Jeroen van der Heijden
+ * email        : jeroen@transceptor.technology
+ * copyright    : 2016, Transceptor Technology
+ *
+ * The process memory usage does not tell which part of SiriDB is using the
+ * memory. Modules therefore add the size of the objects they allocate to a
+ * counter for their subsystem and subtract it again when the objects are
+ * destroyed. The counters are approximate, allocator overhead is not
+ * included, but they show which subsystem grows.
+ *
+ * changes
+ *  - initial version, 14-10-2016
+ *
+ */
+#include <siri/mem.h>
+
+size_t siri_mem[SIRI_MEM_END] = {0};
+
+static const char * mem_str[SIRI_MEM_END] = {
+        "series",
+        "shard",
+        "buffer",
+        "insert",
+        "query",
+        "net",
+        "groups"};
+
+const char * siri_mem_str(siri_mem_tp_t tp)
+{
+    return mem_str[tp];
+}
+
+/*
+ * Add a map with the counters in bytes to 'packer'.
+ *
+ * Returns 0 if successful or -1 in case of an error.
+ */
+int siri_mem_pack(qp_packer_t * packer)
+{
+    int rc = qp_add_type(packer, QP_MAP_OPEN);
+
+    for (int tp = 0; tp < SIRI_MEM_END; tp++)
+    {
+        rc += qp_add_string(packer, mem_str[tp]);
+        rc += qp_add_int64(packer, (int64_t) siri_mem_get(tp));
+    }
+
+    return (rc + qp_add_type(packer, QP_MAP_CLOSE)) ? -1 : 0;
+}
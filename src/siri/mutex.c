@@ -0,0 +1,379 @@
+/*
+ * mutex.c - Mutex and reader-writer lock which record wait and hold time for
+ *           each call site.
+ *
+ * author       : Jeroen van der Heijden
+ * email        : jeroen@transceptor.technology
+ * copyright    : 2016, Transceptor Technology
+ *
+ * Statistics are only recorded when enabled with 'lock_stats' in the
+ * configuration file. A lock is first tried without waiting so only
+ * contended locks need the time before locking.
+ *
+ * Call sites are static in the function which takes the lock and are added
+ * to a list the first time they are used. Locks are taken by the event loop
+ * and the worker threads so the statistics are updated with atomics. The
+ * hold time is added to the site which has taken the lock.
+ *
+ * changes
+ *  - initial version, 14-10-2016
+ *
+ */
+#include <siri/mutex.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <timeit/timeit.h>
+
+#define MUTEX_LINE_SZ 200
+
+static int mutex_enabled = 0;
+static siri_mutex_site_t * mutex_sites = NULL;
+
+static void MUTEX_register(siri_mutex_site_t * site);
+static uint64_t MUTEX_wait(siri_mutex_site_t * site, uint64_t start);
+static const char * MUTEX_name(const char * name);
+static int MUTEX_cmp(const void * a, const void * b);
+
+/*
+ * Enable or disable recording statistics. Must be called before any mutex
+ * is locked.
+ */
+void siri_mutex_enable(int enable)
+{
+    mutex_enabled = enable;
+}
+
+/*
+ * Returns 0 if successful or a libuv error code.
+ */
+int siri_mutex_init(siri_mutex_t * mutex)
+{
+    mutex->site = NULL;
+    mutex->locked = 0;
+    return uv_mutex_init(&mutex->mutex);
+}
+
+void siri_mutex_destroy(siri_mutex_t * mutex)
+{
+    uv_mutex_destroy(&mutex->mutex);
+}
+
+/*
+ * Use siri_mutex_lock() which creates the site.
+ */
+void siri_mutex_lock_site(siri_mutex_t * mutex, siri_mutex_site_t * site)
+{
+    uint64_t ns;
+
+    if (!mutex_enabled)
+    {
+        uv_mutex_lock(&mutex->mutex);
+        return;
+    }
+
+    if (!site->registered)
+    {
+        MUTEX_register(site);
+    }
+
+    if (uv_mutex_trylock(&mutex->mutex) == 0)
+    {
+        ns = timeit_ns();
+    }
+    else
+    {
+        ns = timeit_ns();
+        uv_mutex_lock(&mutex->mutex);
+        ns = MUTEX_wait(site, ns);
+    }
+
+    __atomic_add_fetch(&site->n, 1, __ATOMIC_RELAXED);
+
+    mutex->site = site;
+    mutex->locked = ns;
+}
+
+void siri_mutex_unlock(siri_mutex_t * mutex)
+{
+    siri_mutex_site_t * site = mutex->site;
+
+    if (site != NULL)
+    {
+        __atomic_add_fetch(
+                &site->hold,
+                timeit_ns() - mutex->locked,
+                __ATOMIC_RELAXED);
+        mutex->site = NULL;
+    }
+
+    uv_mutex_unlock(&mutex->mutex);
+}
+
+/*
+ * Returns 0 if successful or a libuv error code.
+ */
+int siri_rwlock_init(siri_rwlock_t * rwlock)
+{
+    rwlock->site = NULL;
+    rwlock->locked = 0;
+    return uv_rwlock_init(&rwlock->rwlock);
+}
+
+void siri_rwlock_destroy(siri_rwlock_t * rwlock)
+{
+    uv_rwlock_destroy(&rwlock->rwlock);
+}
+
+/*
+ * Use siri_rwlock_rdlock() which creates the site. More than one thread can
+ * hold the read lock so only the wait time is recorded.
+ */
+void siri_rwlock_rdlock_site(siri_rwlock_t * rwlock, siri_mutex_site_t * site)
+{
+    if (!mutex_enabled)
+    {
+        uv_rwlock_rdlock(&rwlock->rwlock);
+        return;
+    }
+
+    if (!site->registered)
+    {
+        MUTEX_register(site);
+    }
+
+    if (uv_rwlock_tryrdlock(&rwlock->rwlock))
+    {
+        uint64_t ns = timeit_ns();
+        uv_rwlock_rdlock(&rwlock->rwlock);
+        MUTEX_wait(site, ns);
+    }
+
+    __atomic_add_fetch(&site->n, 1, __ATOMIC_RELAXED);
+}
+
+void siri_rwlock_rdunlock(siri_rwlock_t * rwlock)
+{
+    uv_rwlock_rdunlock(&rwlock->rwlock);
+}
+
+/*
+ * Use siri_rwlock_wrlock() which creates the site.
+ */
+void siri_rwlock_wrlock_site(siri_rwlock_t * rwlock, siri_mutex_site_t * site)
+{
+    uint64_t ns;
+
+    if (!mutex_enabled)
+    {
+        uv_rwlock_wrlock(&rwlock->rwlock);
+        return;
+    }
+
+    if (!site->registered)
+    {
+        MUTEX_register(site);
+    }
+
+    if (uv_rwlock_trywrlock(&rwlock->rwlock) == 0)
+    {
+        ns = timeit_ns();
+    }
+    else
+    {
+        ns = timeit_ns();
+        uv_rwlock_wrlock(&rwlock->rwlock);
+        ns = MUTEX_wait(site, ns);
+    }
+
+    __atomic_add_fetch(&site->n, 1, __ATOMIC_RELAXED);
+
+    rwlock->site = site;
+    rwlock->locked = ns;
+}
+
+void siri_rwlock_wrunlock(siri_rwlock_t * rwlock)
+{
+    siri_mutex_site_t * site = rwlock->site;
+
+    if (site != NULL)
+    {
+        __atomic_add_fetch(
+                &site->hold,
+                timeit_ns() - rwlock->locked,
+                __ATOMIC_RELAXED);
+        rwlock->site = NULL;
+    }
+
+    uv_rwlock_wrunlock(&rwlock->rwlock);
+}
+
+/*
+ * Fill 'sites' with at most 'n' call sites which have spent the most time
+ * waiting for a lock, or holding the lock when no site had to wait.
+ *
+ * Returns the number of sites.
+ */
+size_t siri_mutex_top(siri_mutex_site_t ** sites, size_t n)
+{
+    siri_mutex_site_t * site;
+    siri_mutex_site_t ** all;
+    size_t count = 0;
+
+    site = __atomic_load_n(&mutex_sites, __ATOMIC_ACQUIRE);
+    for (; site != NULL; site = site->next)
+    {
+        count++;
+    }
+
+    if (!count || (all = malloc(count * sizeof(siri_mutex_site_t *))) == NULL)
+    {
+        return 0;
+    }
+
+    /* sites are only added to the front so the first count sites are the
+     * same, even when sites are added meanwhile */
+    site = __atomic_load_n(&mutex_sites, __ATOMIC_ACQUIRE);
+    for (size_t i = 0; i < count; i++, site = site->next)
+    {
+        all[i] = site;
+    }
+
+    qsort(all, count, sizeof(siri_mutex_site_t *), MUTEX_cmp);
+
+    if (n > count)
+    {
+        n = count;
+    }
+
+    memcpy(sites, all, n * sizeof(siri_mutex_site_t *));
+    free(all);
+
+    return n;
+}
+
+/*
+ * Returns a line for each of the top SIRI_MUTEX_TOP call sites, or NULL in
+ * case of an allocation error. Times are in micro seconds.
+ *
+ * The return value must be freed by the caller.
+ */
+char * siri_mutex_summary(void)
+{
+    siri_mutex_site_t * sites[SIRI_MUTEX_TOP];
+    size_t n = siri_mutex_top(sites, SIRI_MUTEX_TOP);
+    char * buf = (char *) malloc(SIRI_MUTEX_TOP * MUTEX_LINE_SZ + 1);
+    char * pt = buf;
+    const char * fn;
+    int len;
+
+    if (buf == NULL)
+    {
+        return NULL;
+    }
+
+    *pt = '\0';
+
+    for (size_t i = 0; i < n; i++)
+    {
+        fn = strrchr(sites[i]->file, '/');
+
+        len = snprintf(
+                pt,
+                MUTEX_LINE_SZ,
+                "%s%s %s:%d: n=%" PRIu64 " contended=%" PRIu64 " wait=%"
+                PRIu64 "us max_wait=%" PRIu64 "us hold=%" PRIu64 "us",
+                (pt == buf) ? "" : "\n",
+                MUTEX_name(sites[i]->name),
+                (fn == NULL) ? sites[i]->file : fn + 1,
+                sites[i]->line,
+                __atomic_load_n(&sites[i]->n, __ATOMIC_RELAXED),
+                __atomic_load_n(&sites[i]->contended, __ATOMIC_RELAXED),
+                __atomic_load_n(&sites[i]->wait, __ATOMIC_RELAXED) / 1000,
+                __atomic_load_n(&sites[i]->max_wait, __ATOMIC_RELAXED) / 1000,
+                __atomic_load_n(&sites[i]->hold, __ATOMIC_RELAXED) / 1000);
+
+        /* snprintf() returns the length without truncating */
+        pt += (len < MUTEX_LINE_SZ) ? len : MUTEX_LINE_SZ - 1;
+    }
+
+    return buf;
+}
+
+/*
+ * Add a site to the front of the list. The site can be used by more than
+ * one thread at the same time so only the first one adds the site.
+ */
+static void MUTEX_register(siri_mutex_site_t * site)
+{
+    if (__atomic_exchange_n(&site->registered, 1, __ATOMIC_ACQ_REL))
+    {
+        return;
+    }
+
+    site->next = __atomic_load_n(&mutex_sites, __ATOMIC_RELAXED);
+
+    while (!__atomic_compare_exchange_n(
+            &mutex_sites,
+            &site->next,
+            site,
+            0,
+            __ATOMIC_RELEASE,
+            __ATOMIC_RELAXED));
+}
+
+/*
+ * Record a contended lock which started waiting at 'start'. Returns the
+ * current time in nanoseconds.
+ */
+static uint64_t MUTEX_wait(siri_mutex_site_t * site, uint64_t start)
+{
+    uint64_t ns = timeit_ns();
+    uint64_t wait = ns - start;
+
+    __atomic_add_fetch(&site->contended, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&site->wait, wait, __ATOMIC_RELAXED);
+
+    /* a race with another lock which is taken from the same site is
+     * harmless, at worst a lower maximum is kept */
+    if (wait > __atomic_load_n(&site->max_wait, __ATOMIC_RELAXED))
+    {
+        __atomic_store_n(&site->max_wait, wait, __ATOMIC_RELAXED);
+    }
+
+    return ns;
+}
+
+/*
+ * Returns the last member in a lock expression.
+ */
+static const char * MUTEX_name(const char * name)
+{
+    const char * pt;
+
+    for (pt = name; *pt; pt++)
+    {
+        if (*pt == '>' || *pt == '.' || *pt == '&')
+        {
+            name = pt + 1;
+        }
+    }
+
+    return name;
+}
+
+static int MUTEX_cmp(const void * a, const void * b)
+{
+    const siri_mutex_site_t * sa = *((const siri_mutex_site_t **) a);
+    const siri_mutex_site_t * sb = *((const siri_mutex_site_t **) b);
+    uint64_t va = __atomic_load_n(&sa->wait, __ATOMIC_RELAXED);
+    uint64_t vb = __atomic_load_n(&sb->wait, __ATOMIC_RELAXED);
+
+    if (va == vb)
+    {
+        va = __atomic_load_n(&sa->hold, __ATOMIC_RELAXED);
+        vb = __atomic_load_n(&sb->hold, __ATOMIC_RELAXED);
+    }
+
+    return (va < vb) - (va > vb);
+}
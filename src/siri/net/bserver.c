@@ -11,14 +11,17 @@
  *
  */
 #include <assert.h>
+#include <imap/imap.h>
 #include <logger/logger.h>
 #include <siri/db/auth.h>
+#include <siri/db/fetch.h>
 #include <siri/db/groups.h>
 #include <siri/db/insert.h>
 #include <siri/db/query.h>
 #include <siri/db/replicate.h>
 #include <siri/db/server.h>
 #include <siri/db/servers.h>
+#include <siri/latency.h>
 #include <siri/net/bserver.h>
 #include <siri/net/pkg.h>
 #include <siri/net/protocol.h>
@@ -39,10 +42,20 @@ if (!(server->flags & SERVER_FLAG_AUTHENTICATED))                             \
     return;                                                                   \
 }
 
+/* used to find forwarded queries which must be killed */
+typedef struct bserver_kill_s
+{
+    uv_stream_t * client;
+    uint64_t origin_id;
+} bserver_kill_t;
+
 static void BSERVER_flags_update(
         siridb_t * siridb,
         siridb_server_t * server,
         int64_t flags);
+static int BSERVER_kill_query(
+        siridb_query_t * query,
+        bserver_kill_t * kill);
 static void on_new_connection(uv_stream_t * server, int status);
 static void on_data(uv_stream_t * client, sirinet_pkg_t * pkg);
 static void on_auth_request(uv_stream_t * client, sirinet_pkg_t * pkg);
@@ -56,6 +69,8 @@ static void on_drop_series(uv_stream_t * client, sirinet_pkg_t * pkg);
 static void on_req_groups(uv_stream_t * client, sirinet_pkg_t * pkg);
 static void on_enable_backup_mode(uv_stream_t * client, sirinet_pkg_t * pkg);
 static void on_disable_backup_mode(uv_stream_t * client, sirinet_pkg_t * pkg);
+static void on_kill_query(uv_stream_t * client, sirinet_pkg_t * pkg);
+static void on_fetch(uv_stream_t * client, sirinet_pkg_t * pkg);
 
 static uv_loop_t * loop = NULL;
 static struct sockaddr_storage server_addr;
@@ -196,19 +211,27 @@ static void on_data(uv_stream_t * client, sirinet_pkg_t * pkg)
         }
     }
 
+    /* queries and inserts record their latency when they are finished */
+    siri_latency_tp_t tp = SIRI_LATENCY_END;
+    uint64_t ns = timeit_ns();
+
     switch ((bproto_client_t) pkg->tp)
     {
     case BPROTO_AUTH_REQUEST:
         on_auth_request(client, pkg);
+        tp = SIRI_LATENCY_BACKEND_AUTH;
         break;
     case BPROTO_FLAGS_UPDATE:
         on_flags_update(client, pkg);
+        tp = SIRI_LATENCY_BACKEND_FLAGS;
         break;
     case BPROTO_LOG_LEVEL_UPDATE:
         on_log_level_update(client, pkg);
+        tp = SIRI_LATENCY_BACKEND_LOG_LEVEL;
         break;
     case BPROTO_REPL_FINISHED:
         on_repl_finished(client, pkg);
+        tp = SIRI_LATENCY_BACKEND_REPL_FINISHED;
         break;
     case BPROTO_QUERY_SERVER:
         on_query(client, pkg, 0);
@@ -236,21 +259,38 @@ static void on_data(uv_stream_t * client, sirinet_pkg_t * pkg)
         break;
     case BPROTO_REGISTER_SERVER:
         on_register_server(client, pkg);
+        tp = SIRI_LATENCY_BACKEND_REGISTER_SERVER;
         break;
     case BPROTO_DROP_SERIES:
         on_drop_series(client, pkg);
+        tp = SIRI_LATENCY_BACKEND_DROP_SERIES;
         break;
     case BPROTO_REQ_GROUPS:
         on_req_groups(client, pkg);
+        tp = SIRI_LATENCY_BACKEND_GROUPS;
         break;
     case BPROTO_ENABLE_BACKUP_MODE:
         on_enable_backup_mode(client, pkg);
+        tp = SIRI_LATENCY_BACKEND_BACKUP_MODE;
         break;
     case BPROTO_DISABLE_BACKUP_MODE:
         on_disable_backup_mode(client, pkg);
+        tp = SIRI_LATENCY_BACKEND_BACKUP_MODE;
+        break;
+    case BPROTO_KILL_QUERY:
+        on_kill_query(client, pkg);
+        tp = SIRI_LATENCY_BACKEND_KILL_QUERY;
+        break;
+    case BPROTO_FETCH_SERVER:
+        on_fetch(client, pkg);
+        tp = SIRI_LATENCY_BACKEND_FETCH;
         break;
     }
 
+    if (tp != SIRI_LATENCY_END)
+    {
+        siri_latency_add(tp, 0, timeit_ns() - ns);
+    }
 }
 
 static void on_auth_request(uv_stream_t * client, sirinet_pkg_t * pkg)
@@ -272,6 +312,7 @@ static void on_auth_request(uv_stream_t * client, sirinet_pkg_t * pkg)
     qp_obj_t qp_startup_time;
     qp_obj_t qp_address;
     qp_obj_t qp_port;
+    qp_obj_t qp_compress;
 
     if (    qp_is_array(qp_next(&unpacker, NULL)) &&
             qp_next(&unpacker, &qp_uuid) == QP_RAW &&
@@ -309,6 +350,7 @@ static void on_auth_request(uv_stream_t * client, sirinet_pkg_t * pkg)
 
             /* check and update flags */
             BSERVER_flags_update(siridb, server, qp_flags.via.int64);
+        siridb_server_counts_read(server, &unpacker);
 
             /* update server address if needed */
             siridb_server_update_address(
@@ -328,18 +370,39 @@ static void on_auth_request(uv_stream_t * client, sirinet_pkg_t * pkg)
             server->startup_time = (uint32_t) qp_startup_time.via.int64;
             server->ip_support = (uint8_t) qp_ip_support.via.int64;
 
+            /* older servers do not send if they can read compressed data */
+            if (    qp_next(&unpacker, &qp_compress) == QP_INT64 &&
+                    qp_compress.via.int64)
+            {
+                ((sirinet_socket_t * ) client->data)->compress = 1;
+            }
+
             log_info("Accepting back-end server connection: '%s'",
                     server->name);
+
+            /* respond that this server can read compressed packages */
+            qp_packer_t * packer = sirinet_packer_new(32);
+            if (packer == NULL)
+            {
+                package = NULL;  /* signal is raised */
+            }
+            else
+            {
+                qp_add_int8(packer, 1);
+                package = sirinet_packer2pkg(packer, pkg->pid, rc);
+            }
         }
         else
         {
             log_warning("Refusing back-end connection (error code: %d)", rc);
+            package = sirinet_pkg_new(pkg->pid, 0, rc, NULL);
         }
 
-        package = sirinet_pkg_new(pkg->pid, 0, rc, NULL);
-
-        /* ignore result code, signal can be raised */
-        sirinet_pkg_send(client, package);
+        if (package != NULL)
+        {
+            /* ignore result code, signal can be raised */
+            sirinet_pkg_send(client, package);
+        }
     }
     else
     {
@@ -444,6 +507,8 @@ static void on_query(uv_stream_t * client, sirinet_pkg_t * pkg, int flags)
     qp_unpacker_init(&unpacker, pkg->data, pkg->len);
 
     qp_obj_t qp_query;
+    qp_obj_t qp_id;
+    qp_obj_t qp_trace_id;
 
     if (flags & SIRIDB_QUERY_FLAG_UPDATE_REPLICA)
     {
@@ -458,13 +523,31 @@ static void on_query(uv_stream_t * client, sirinet_pkg_t * pkg, int flags)
     if (    qp_is_array(qp_next(&unpacker, NULL)) &&
             qp_next(&unpacker, &qp_query) == QP_RAW)
     {
+        /* skip the time precision, the query id is not sent by versions
+         * without support for killing queries and the trace id is not sent
+         * by versions without support for tracing */
+        qp_next(&unpacker, NULL);
+
+        if (qp_next(&unpacker, &qp_id) != QP_INT64)
+        {
+            qp_id.via.int64 = 0;
+        }
+
+        if (qp_next(&unpacker, &qp_trace_id) != QP_INT64)
+        {
+            qp_trace_id.via.int64 = 0;
+        }
+
         siridb_query_run(
                 pkg->pid,
                 client,
                 qp_query.via.raw,
                 qp_query.len,
                 0.0,
-                0);
+                0,
+                SIRIDB_QUERY_FMT_ROWS,
+                (uint64_t) qp_id.via.int64,
+                (uint64_t) qp_trace_id.via.int64);
     }
     else
     {
@@ -611,11 +694,11 @@ static void on_drop_series(uv_stream_t * client, sirinet_pkg_t * pkg)
             series = ct_get(siridb->series, qp_series_name.via.raw);
             if (series != NULL)
             {
-                uv_mutex_lock(&siridb->series_mutex);
+                siri_rwlock_wrlock(&siridb->series_mutex);
 
                 siridb_series_drop(siridb, series);
 
-                uv_mutex_unlock(&siridb->series_mutex);
+                siri_rwlock_wrunlock(&siridb->series_mutex);
 
                 siridb_series_flush_dropped(siridb);
             }
@@ -741,3 +824,90 @@ static void on_disable_backup_mode(uv_stream_t * client, sirinet_pkg_t * pkg)
     }
 }
 
+static void on_kill_query(uv_stream_t * client, sirinet_pkg_t * pkg)
+{
+    SERVER_CHECK_AUTHENTICATED(server)
+
+    siridb_t * siridb = ((sirinet_socket_t * ) client->data)->siridb;
+    sirinet_pkg_t * package;
+    qp_unpacker_t unpacker;
+    qp_obj_t qp_id;
+    bserver_kill_t kill;
+
+    qp_unpacker_init(&unpacker, pkg->data, pkg->len);
+
+    if (qp_next(&unpacker, &qp_id) == QP_INT64)
+    {
+        /* forwarded queries are only killed for the server which sent them */
+        kill.client = client;
+        kill.origin_id = (uint64_t) qp_id.via.int64;
+        imap_walk(siridb->queries, (imap_cb) BSERVER_kill_query, &kill);
+    }
+    else
+    {
+        log_error("Invalid back-end 'on_kill_query' received.");
+    }
+
+    package = sirinet_pkg_new(pkg->pid, 0, BPROTO_ACK_KILL_QUERY, NULL);
+
+    if (package != NULL)
+    {
+        sirinet_pkg_send(client, package);
+    }
+}
+
+static void on_fetch(uv_stream_t * client, sirinet_pkg_t * pkg)
+{
+    SERVER_CHECK_AUTHENTICATED(server)
+
+    char err_msg[SIRIDB_MAX_SIZE_ERR_MSG];
+    siridb_t * siridb = ((sirinet_socket_t * ) client->data)->siridb;
+    sirinet_pkg_t * package = NULL;
+    qp_packer_t * packer;
+    qp_unpacker_t unpacker;
+
+    if (~siridb->server->flags & SERVER_FLAG_RUNNING)
+    {
+        log_error(
+                "Cannot fetch points for server '%s' because of "
+                "having status %d",
+                server->name,
+                siridb->server->flags);
+    }
+    else if ((packer = sirinet_packer_new(QP_SUGGESTED_SIZE)) != NULL)
+    {
+        qp_unpacker_init(&unpacker, pkg->data, pkg->len);
+
+        if (siridb_fetch_local(siridb, &unpacker, packer, err_msg))
+        {
+            log_error("Fetch error: '%s'", err_msg);
+            qp_packer_free(packer);
+        }
+        else
+        {
+            package = sirinet_packer2pkg(packer, pkg->pid, BPROTO_RES_FETCH);
+        }
+    }
+
+    if (package == NULL)
+    {
+        package = sirinet_pkg_new(pkg->pid, 0, BPROTO_ERR_FETCH, NULL);
+    }
+
+    if (package != NULL)
+    {
+        sirinet_pkg_send(client, package);
+    }
+}
+
+/*
+ * Call-back function: imap_cb
+ */
+static int BSERVER_kill_query(siridb_query_t * query, bserver_kill_t * kill)
+{
+    if (query->client == kill->client && query->origin_id == kill->origin_id)
+    {
+        siridb_query_kill(query);
+    }
+    return 0;
+}
@@ -0,0 +1,204 @@
+/*
+ * capture.c - Capture client packages so they can be replayed.
+ *
+ * author       : Jeroen van der Heijden
+ * email        : jeroen@transceptor.technology
+ * copyright    : 2016, Transceptor Technology
+ *
+ * Queries and inserts are written to the capture file by the main thread
+ * when they are received. The file is written through a stdio buffer so
+ * capturing adds only a copy to the request path. Use siridb-replay to send
+ * the packages to a server.
+ *
+ * changes
+ *  - initial version, 14-10-2016
+ *
+ */
+#include <logger/logger.h>
+#include <qpack/qpack.h>
+#include <siri/net/capture.h>
+#include <siri/net/protocol.h>
+#include <siri/net/socket.h>
+#include <stdio.h>
+#include <string.h>
+#include <timeit/timeit.h>
+
+#define CAPTURE_BUFFER_SZ 1048576
+
+static int CAPTURE_write(
+        uint32_t conn,
+        sirinet_pkg_t * pkg,
+        const char * data);
+
+static FILE * capture_fp = NULL;
+static size_t capture_size;
+static size_t capture_max_size;
+static uint64_t capture_start;
+static uint32_t capture_conn;
+
+/*
+ * Open the capture file, an existing file is overwritten. Capturing stops
+ * when the file would exceed 'max_size' bytes, 0 for no limit.
+ *
+ * Returns 0 if successful or -1 in case of an error.
+ */
+int sirinet_capture_init(const char * fn, size_t max_size)
+{
+    char header[SIRINET_CAPTURE_HEADER_SZ];
+
+    capture_fp = fopen(fn, "w");
+    if (capture_fp == NULL)
+    {
+        log_error("Cannot open capture file: '%s'", fn);
+        return -1;
+    }
+
+    /* the buffer is allocated by setvbuf() */
+    setvbuf(capture_fp, NULL, _IOFBF, CAPTURE_BUFFER_SZ);
+
+    memcpy(header, SIRINET_CAPTURE_MAGIC, SIRINET_CAPTURE_MAGIC_SZ);
+    header[SIRINET_CAPTURE_MAGIC_SZ] = SIRINET_CAPTURE_VERSION;
+
+    if (fwrite(header, sizeof(header), 1, capture_fp) != 1)
+    {
+        log_error("Cannot write to capture file: '%s'", fn);
+        fclose(capture_fp);
+        capture_fp = NULL;
+        return -1;
+    }
+
+    capture_size = sizeof(header);
+    capture_max_size = max_size;
+    capture_start = timeit_ns();
+    capture_conn = 0;
+
+    log_info("Capturing client packages to: '%s'", fn);
+
+    return 0;
+}
+
+/*
+ * Write a package to the capture file. Only queries, inserts and
+ * authentication requests are captured, other packages are ignored.
+ */
+void sirinet_capture_pkg(uv_stream_t * client, sirinet_pkg_t * pkg)
+{
+    sirinet_socket_t * ssocket;
+    int rc;
+
+    if (capture_fp == NULL)
+    {
+        return;
+    }
+
+    ssocket = (sirinet_socket_t *) client->data;
+
+    switch ((cproto_client_t) pkg->tp)
+    {
+    case CPROTO_REQ_QUERY:
+    case CPROTO_REQ_QUERY_STREAM:
+    case CPROTO_REQ_INSERT:
+    case CPROTO_REQ_INSERT_COLUMNS:
+        if (!ssocket->capture_id)
+        {
+            ssocket->capture_id = ++capture_conn;
+        }
+        rc = CAPTURE_write(ssocket->capture_id, pkg, pkg->data);
+        break;
+    case CPROTO_REQ_AUTH:
+        {
+            /* the user name and password are never written */
+            qp_unpacker_t unpacker;
+            qp_obj_t qp_dbname;
+            sirinet_pkg_t auth = *pkg;
+            qp_unpacker_init(&unpacker, pkg->data, pkg->len);
+
+            if (!(  qp_is_array(qp_next(&unpacker, NULL)) &&
+                    qp_next(&unpacker, NULL) == QP_RAW &&
+                    qp_next(&unpacker, NULL) == QP_RAW &&
+                    qp_next(&unpacker, &qp_dbname) == QP_RAW))
+            {
+                return;
+            }
+
+            /* a new authentication is replayed as a new connection */
+            ssocket->capture_id = ++capture_conn;
+            auth.len = (uint32_t) qp_dbname.len;
+            rc = CAPTURE_write(ssocket->capture_id, &auth, qp_dbname.via.raw);
+        }
+        break;
+    default:
+        return;
+    }
+
+    if (rc)
+    {
+        sirinet_capture_close();
+    }
+}
+
+/*
+ * Flush and close the capture file. (if open)
+ */
+void sirinet_capture_close(void)
+{
+    if (capture_fp == NULL)
+    {
+        return;
+    }
+
+    if (fclose(capture_fp))
+    {
+        log_error("Error while closing the capture file");
+    }
+    else
+    {
+        log_info(
+                "Capture file closed after %" PRIu32 " connection(s) and "
+                "%zu bytes",
+                capture_conn,
+                capture_size);
+    }
+
+    capture_fp = NULL;
+}
+
+/*
+ * Returns 0 if successful or -1 when capturing must be stopped.
+ */
+static int CAPTURE_write(
+        uint32_t conn,
+        sirinet_pkg_t * pkg,
+        const char * data)
+{
+    char rec[SIRINET_CAPTURE_REC_SZ];
+    uint64_t ns = timeit_ns() - capture_start;
+    size_t size = sizeof(rec) + pkg->len;
+    char * pt = rec;
+
+    if (capture_max_size && capture_size + size > capture_max_size)
+    {
+        log_warning(
+                "Capture file has reached the maximum size of %zu bytes, "
+                "capturing is stopped",
+                capture_max_size);
+        return -1;
+    }
+
+    memcpy(pt, &ns, sizeof(uint64_t));
+    pt += sizeof(uint64_t);
+    memcpy(pt, &conn, sizeof(uint32_t));
+    pt += sizeof(uint32_t);
+    memcpy(pt, pkg, sizeof(sirinet_pkg_t));
+
+    if (    fwrite(rec, sizeof(rec), 1, capture_fp) != 1 ||
+            (pkg->len && fwrite(data, pkg->len, 1, capture_fp) != 1))
+    {
+        log_error("Cannot write to capture file, capturing is stopped");
+        return -1;
+    }
+
+    capture_size += size;
+
+    return 0;
+}
@@ -14,6 +14,7 @@
 #define _GNU_SOURCE
 #endif
 #include <assert.h>
+#include <limits.h>
 #include <lock/lock.h>
 #include <math.h>
 #include <logger/logger.h>
@@ -21,14 +22,22 @@
 #include <siri/siri.h>
 #include <siri/admin/account.h>
 #include <siri/admin/request.h>
+#include <siri/db/attach.h>
 #include <siri/db/auth.h>
+#include <siri/db/export.h>
+#include <siri/db/fetch.h>
 #include <siri/db/insert.h>
 #include <siri/db/query.h>
+#include <siri/db/ratelimit.h>
 #include <siri/db/replicate.h>
 #include <siri/db/servers.h>
+#include <siri/db/subscribe.h>
 #include <siri/db/users.h>
 #include <siri/err.h>
+#include <siri/latency.h>
+#include <siri/net/capture.h>
 #include <siri/net/clserver.h>
+#include <siri/net/fsend.h>
 #include <siri/net/promises.h>
 #include <siri/net/protocol.h>
 #include <siri/net/socket.h>
@@ -40,6 +49,8 @@
 #include <string.h>
 #include <siri/db/server.h>
 #include <siri/db/access.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 const unsigned long int WARNING_PKG_SIZE = RESET_BUF_SIZE;
 
@@ -70,21 +81,34 @@ static const int SERVER_RUNNING_REINDEXING =
 static uv_loop_t * loop = NULL;
 static struct sockaddr_storage client_addr;
 static uv_tcp_t client_server;
+static uv_pipe_t client_pipe;
 
 static void on_data(uv_stream_t * client, sirinet_pkg_t * pkg);
 static void on_new_connection(uv_stream_t * server, int status);
+static int CLSERVER_listen_socket(const char * path);
 static void on_auth_request(uv_stream_t * client, sirinet_pkg_t * pkg);
+static void on_auth_session(uv_stream_t * client, sirinet_pkg_t * pkg);
 static void on_query(uv_stream_t * client, sirinet_pkg_t * pkg);
 static void on_insert(uv_stream_t * client, sirinet_pkg_t * pkg);
+static void on_export(uv_stream_t * client, sirinet_pkg_t * pkg);
+static void on_import(uv_stream_t * client, sirinet_pkg_t * pkg);
+static void on_attach(uv_stream_t * client, sirinet_pkg_t * pkg);
+static void on_subscribe(uv_stream_t * client, sirinet_pkg_t * pkg);
+static void on_unsubscribe(uv_stream_t * client, sirinet_pkg_t * pkg);
+static void on_fetch(uv_stream_t * client, sirinet_pkg_t * pkg);
 static void on_ping(uv_stream_t * client, sirinet_pkg_t * pkg);
 static void on_info(uv_stream_t * client, sirinet_pkg_t * pkg);
 static void on_loaddb(uv_stream_t * client, sirinet_pkg_t * pkg);
 static void on_reqfile(
         uv_stream_t * client,
         sirinet_pkg_t * pkg,
-        sirinet_clserver_getfile getfile);
+        sirinet_clserver_getfn getfn);
 static void on_register_server(uv_stream_t * client, sirinet_pkg_t * pkg);
 static void on_req_admin(uv_stream_t * client, sirinet_pkg_t * pkg);
+static int CLSERVER_check_access(
+        uv_stream_t * client,
+        sirinet_pkg_t * pkg,
+        uint32_t access_bit);
 static void CLSERVER_send_server_error(
         siridb_t * siridb,
         uv_stream_t * stream,
@@ -92,6 +116,23 @@ static void CLSERVER_send_server_error(
 static void CLSERVER_send_pool_error(
         uv_stream_t * stream,
         sirinet_pkg_t * pkg);
+static void CLSERVER_send_busy_error(
+        siridb_t * siridb,
+        uv_stream_t * stream,
+        sirinet_pkg_t * pkg,
+        uint32_t retry_after);
+static void CLSERVER_send_throttle_error(
+        uv_stream_t * stream,
+        sirinet_pkg_t * pkg,
+        const char * limit,
+        uint32_t retry_after);
+static void CLSERVER_send_retry_error(
+        uv_stream_t * stream,
+        sirinet_pkg_t * pkg,
+        cproto_server_t tp,
+        char * err_msg,
+        int len,
+        uint32_t retry_after);
 static int CLSERVER_on_info_cb(siridb_t * siridb, qp_packer_t * packer);
 static void CLSERVER_on_register_server_response(
         slist_t * promises,
@@ -154,6 +195,55 @@ int sirinet_clserver_init(siri_t * siri)
     log_info("Start listening for client connections on port %d",
             siri->cfg->listen_client_port);
 
+    if (    *siri->cfg->listen_client_socket &&
+            CLSERVER_listen_socket(siri->cfg->listen_client_socket))
+    {
+        return 1;
+    }
+
+    return 0;
+}
+
+/*
+ * Listen for client connections on a unix domain socket. Clients connected
+ * to this socket are handled exactly like tcp clients.
+ *
+ * Returns 0 if successful or -1 in case of an error.
+ */
+static int CLSERVER_listen_socket(const char * path)
+{
+    struct stat st;
+    int rc;
+
+    /* a socket from a previous run cannot be re-used so we remove it */
+    if (stat(path, &st) == 0 && S_ISSOCK(st.st_mode) && unlink(path))
+    {
+        log_error("Cannot remove existing unix socket: '%s'", path);
+        return -1;
+    }
+
+    uv_pipe_init(loop, &client_pipe, 0);
+
+    /* make sure data is set to NULL so we later on can check this value. */
+    client_pipe.data = NULL;
+
+    if (    (rc = uv_pipe_bind(&client_pipe, path)) ||
+            (rc = uv_listen(
+                    (uv_stream_t *) &client_pipe,
+                    DEFAULT_BACKLOG,
+                    on_new_connection)))
+    {
+        log_error(
+                "Error listening for client connections on unix socket "
+                "'%s': %s",
+                path,
+                uv_strerror(rc));
+        return -1;
+    }
+
+    log_info("Start listening for client connections on unix socket '%s'",
+            path);
+
     return 0;
 }
 
@@ -171,7 +261,14 @@ static void on_new_connection(uv_stream_t * server, int status)
 
     if (client != NULL)
     {
-        uv_tcp_init(loop, client);
+        if (server->type == UV_NAMED_PIPE)
+        {
+            uv_pipe_init(loop, (uv_pipe_t *) client, 0);
+        }
+        else
+        {
+            uv_tcp_init(loop, client);
+        }
 
         if (uv_accept(server, (uv_stream_t *) client) == 0)
         {
@@ -221,45 +318,90 @@ static void on_data(uv_stream_t * client, sirinet_pkg_t * pkg)
     /* in case the online flag is not set, we cannot perform any request */
     if (siri.status == SIRI_STATUS_RUNNING)
     {
+        /* queries and inserts record their latency when they are finished */
+        siri_latency_tp_t tp = SIRI_LATENCY_END;
+        uint64_t ns = timeit_ns();
+
+        sirinet_capture_pkg(client, pkg);
+
         switch ((cproto_client_t) pkg->tp)
         {
         case CPROTO_REQ_QUERY:
+        case CPROTO_REQ_QUERY_STREAM:
             on_query(client, pkg);
             break;
         case CPROTO_REQ_INSERT:
+        case CPROTO_REQ_INSERT_COLUMNS:
             on_insert(client, pkg);
             break;
+        case CPROTO_REQ_EXPORT:
+            on_export(client, pkg);
+            break;
+        case CPROTO_REQ_IMPORT:
+            on_import(client, pkg);
+            break;
+        case CPROTO_REQ_ATTACH_SHARDS:
+            on_attach(client, pkg);
+            break;
+        case CPROTO_REQ_SUBSCRIBE:
+            on_subscribe(client, pkg);
+            break;
+        case CPROTO_REQ_UNSUBSCRIBE:
+            on_unsubscribe(client, pkg);
+            break;
+        case CPROTO_REQ_FETCH:
+            on_fetch(client, pkg);
+            break;
         case CPROTO_REQ_AUTH:
             on_auth_request(client, pkg);
+            tp = SIRI_LATENCY_AUTH;
+            break;
+        case CPROTO_REQ_AUTH_SESSION:
+            on_auth_session(client, pkg);
+            tp = SIRI_LATENCY_AUTH;
             break;
         case CPROTO_REQ_PING:
             on_ping(client, pkg);
+            tp = SIRI_LATENCY_PING;
             break;
         case CPROTO_REQ_INFO:
             on_info(client, pkg);
+            tp = SIRI_LATENCY_INFO;
             break;
         case CPROTO_REQ_LOADDB:
             on_loaddb(client, pkg);
+            tp = SIRI_LATENCY_LOADDB;
             break;
         case CPROTO_REQ_REGISTER_SERVER:
             on_register_server(client, pkg);
+            tp = SIRI_LATENCY_REGISTER_SERVER;
             break;
         case CPROTO_REQ_FILE_SERVERS:
-            on_reqfile(client, pkg, siridb_servers_get_file);
+            on_reqfile(client, pkg, siridb_servers_get_fn);
+            tp = SIRI_LATENCY_FILE;
             break;
         case CPROTO_REQ_FILE_USERS:
-            on_reqfile(client, pkg, siridb_users_get_file);
+            on_reqfile(client, pkg, siridb_users_get_fn);
+            tp = SIRI_LATENCY_FILE;
             break;
         case CPROTO_REQ_FILE_GROUPS:
-            on_reqfile(client, pkg, siridb_groups_get_file);
+            on_reqfile(client, pkg, siridb_groups_get_fn);
+            tp = SIRI_LATENCY_FILE;
             break;
         case CPROTO_REQ_FILE_DATABASE:
-            on_reqfile(client, pkg, siridb_get_file);
+            on_reqfile(client, pkg, siridb_get_fn);
+            tp = SIRI_LATENCY_FILE;
             break;
         case CPROTO_REQ_ADMIN:
             on_req_admin(client, pkg);
+            tp = SIRI_LATENCY_ADMIN;
             break;
         }
+
+        if (tp != SIRI_LATENCY_END)
+        {
+            siri_latency_add(tp, 0, timeit_ns() - ns);
+        }
     }
     else
     {
@@ -271,10 +413,12 @@ static void on_data(uv_stream_t * client, sirinet_pkg_t * pkg)
     }
 }
 
+/*
+ * The response is sent when the password is verified, the optional fourth
+ * value asks for a session token.
+ */
 static void on_auth_request(uv_stream_t * client, sirinet_pkg_t * pkg)
 {
-    cproto_server_t rc;
-    sirinet_pkg_t * package;
     qp_unpacker_t unpacker;
     qp_unpacker_init(&unpacker, pkg->data, pkg->len);
     qp_obj_t qp_username;
@@ -286,17 +430,13 @@ static void on_auth_request(uv_stream_t * client, sirinet_pkg_t * pkg)
             qp_next(&unpacker, &qp_password) == QP_RAW &&
             qp_next(&unpacker, &qp_dbname) == QP_RAW)
     {
-        rc = siridb_auth_user_request(
+        siridb_auth_user_request(
                 client,
+                pkg,
                 &qp_username,
                 &qp_password,
-                &qp_dbname);
-        package = sirinet_pkg_new(pkg->pid, 0, rc, NULL);
-        if (package != NULL)
-        {
-            /* ignore result code, signal can be raised */
-            sirinet_pkg_send(client, package);
-        }
+                &qp_dbname,
+                qp_next(&unpacker, NULL) == QP_TRUE);
     }
     else
     {
@@ -304,9 +444,66 @@ static void on_auth_request(uv_stream_t * client, sirinet_pkg_t * pkg)
     }
 }
 
+static void on_auth_session(uv_stream_t * client, sirinet_pkg_t * pkg)
+{
+    qp_unpacker_t unpacker;
+    qp_unpacker_init(&unpacker, pkg->data, pkg->len);
+    qp_obj_t qp_token;
+    qp_obj_t qp_dbname;
+
+    if (    qp_is_array(qp_next(&unpacker, NULL)) &&
+            qp_next(&unpacker, &qp_token) == QP_RAW &&
+            qp_next(&unpacker, &qp_dbname) == QP_RAW)
+    {
+        siridb_auth_session_request(client, pkg, &qp_token, &qp_dbname);
+    }
+    else
+    {
+        log_error("Invalid 'on_auth_session' received.");
+    }
+}
+
 /*
  * A signal is raised in case an allocation error occurred.
  */
+/*
+ * Returns 1 when the user has 'access_bit' or 0 when not, in which case an
+ * error is sent to the client.
+ */
+static int CLSERVER_check_access(
+        uv_stream_t * client,
+        sirinet_pkg_t * pkg,
+        uint32_t access_bit)
+{
+    sirinet_socket_t * ssocket = client->data;
+    char err_msg[SIRIDB_MAX_SIZE_ERR_MSG];
+
+    if (siridb_user_check_access(
+            (siridb_user_t *) ssocket->origin,
+            access_bit,
+            err_msg))
+    {
+        return 1;
+    }
+
+    log_warning("(%s) %s",
+            sirinet_cproto_server_str(CPROTO_ERR_USER_ACCESS),
+            err_msg);
+    sirinet_pkg_t * package = sirinet_pkg_err(
+            pkg->pid,
+            strlen(err_msg),
+            CPROTO_ERR_USER_ACCESS,
+            err_msg);
+
+    if (package != NULL)
+    {
+        /* ignore result code, signal can be raised */
+        sirinet_pkg_send(client, package);
+    }
+
+    return 0;
+}
+
 static void CLSERVER_send_server_error(
         siridb_t * siridb,
         uv_stream_t * stream,
@@ -372,6 +569,100 @@ static void CLSERVER_send_pool_error(
     }
 }
 
+/*
+ * The response includes the time in milliseconds after which a client should
+ * retry the insert. A signal is raised in case an allocation error occurred.
+ */
+static void CLSERVER_send_busy_error(
+        siridb_t * siridb,
+        uv_stream_t * stream,
+        sirinet_pkg_t * pkg,
+        uint32_t retry_after)
+{
+    char err_msg[SIRIDB_MAX_SIZE_ERR_MSG];
+    int len = snprintf(
+            err_msg,
+            SIRIDB_MAX_SIZE_ERR_MSG,
+            "Server '%s' is too busy to accept the insert, "
+            "retry after %" PRIu32 " ms",
+            siridb->server->name,
+            retry_after);
+
+    CLSERVER_send_retry_error(
+            stream,
+            pkg,
+            CPROTO_ERR_BUSY,
+            err_msg,
+            len,
+            retry_after);
+}
+
+/*
+ * Send a throttle error when a request exceeds a rate limit of the user.
+ * A signal is raised in case an allocation error occurred.
+ */
+static void CLSERVER_send_throttle_error(
+        uv_stream_t * stream,
+        sirinet_pkg_t * pkg,
+        const char * limit,
+        uint32_t retry_after)
+{
+    char err_msg[SIRIDB_MAX_SIZE_ERR_MSG];
+    sirinet_socket_t * ssocket = stream->data;
+    int len = snprintf(
+            err_msg,
+            SIRIDB_MAX_SIZE_ERR_MSG,
+            "User '%s' exceeds the rate limit for %s, "
+            "retry after %" PRIu32 " ms",
+            ((siridb_user_t *) ssocket->origin)->name,
+            limit,
+            retry_after);
+
+    CLSERVER_send_retry_error(
+            stream,
+            pkg,
+            CPROTO_ERR_THROTTLED,
+            err_msg,
+            len,
+            retry_after);
+}
+
+/*
+ * Send an error with an 'error_msg' and 'retry_after' in milliseconds.
+ * A signal is raised in case an allocation error occurred.
+ */
+static void CLSERVER_send_retry_error(
+        uv_stream_t * stream,
+        sirinet_pkg_t * pkg,
+        cproto_server_t tp,
+        char * err_msg,
+        int len,
+        uint32_t retry_after)
+{
+    if (len >= SIRIDB_MAX_SIZE_ERR_MSG)
+    {
+        len = SIRIDB_MAX_SIZE_ERR_MSG - 1;
+    }
+
+    log_warning(err_msg);
+
+    qp_packer_t * packer = sirinet_packer_new(64 + len);
+
+    if (packer != NULL)
+    {
+        qp_add_type(packer, QP_MAP2);
+        qp_add_raw(packer, "error_msg", 9);
+        qp_add_raw(packer, err_msg, len);
+        qp_add_raw(packer, "retry_after", 11);
+        qp_add_int64(packer, (int64_t) retry_after);
+
+        sirinet_pkg_t * package = sirinet_packer2pkg(packer, pkg->pid, tp);
+
+        /* ignore result code, signal can be raised */
+        sirinet_pkg_send(stream, package);
+    }
+}
+
 static void on_query(uv_stream_t * client, sirinet_pkg_t * pkg)
 {
     CHECK_SIRIDB(ssocket)
@@ -400,11 +691,29 @@ static void on_query(uv_stream_t * client, sirinet_pkg_t * pkg)
         return;
     }
 
+    siridb_user_t * user = (siridb_user_t *) ssocket->origin;
+
+    if (user->ratelimits != NULL)
+    {
+        const char * limit;
+        uint32_t retry_after = siridb_ratelimits_query(
+                user->ratelimits,
+                &limit);
+
+        if (retry_after)
+        {
+            CLSERVER_send_throttle_error(client, pkg, limit, retry_after);
+            return;
+        }
+    }
+
     qp_unpacker_t unpacker;
     qp_obj_t qp_query;
     qp_obj_t qp_time_precision;
+    qp_obj_t qp_fmt;
     float factor;
     siridb_timep_t tp = SIRIDB_TIME_DEFAULT;
+    uint8_t fmt = SIRIDB_QUERY_FMT_ROWS;
 
     qp_unpacker_init(&unpacker, pkg->data, pkg->len);
 
@@ -422,13 +731,26 @@ static void on_query(uv_stream_t * client, sirinet_pkg_t * pkg)
         factor = (tp == SIRIDB_TIME_DEFAULT) ? 0.0 :
                 pow(1000.0, tp - ssocket->siridb->time->precision);
 
+        /* the format is optional, clients which do not send it get rows */
+        if (    qp_next(&unpacker, &qp_fmt) == QP_INT64 &&
+                qp_fmt.via.int64 > 0 &&
+                qp_fmt.via.int64 < SIRIDB_QUERY_FMT_END)
+        {
+            fmt = (uint8_t) qp_fmt.via.int64;
+        }
+
         siridb_query_run(
                 pkg->pid,
                 client,
                 qp_query.via.raw,
                 qp_query.len,
                 factor,
-                SIRIDB_QUERY_FLAG_MASTER);
+                (pkg->tp == CPROTO_REQ_QUERY_STREAM) ?
+                        SIRIDB_QUERY_FLAG_MASTER | SIRIDB_QUERY_FLAG_STREAM :
+                        SIRIDB_QUERY_FLAG_MASTER,
+                fmt,
+                0,
+                0);
     }
     else
     {
@@ -440,28 +762,8 @@ static void on_insert(uv_stream_t * client, sirinet_pkg_t * pkg)
 {
     CHECK_SIRIDB(ssocket)
 
-    char err_msg[SIRIDB_MAX_SIZE_ERR_MSG];
-
-    if (!siridb_user_check_access(
-            (siridb_user_t *) ssocket->origin,
-            SIRIDB_ACCESS_INSERT,
-            err_msg))
+    if (!CLSERVER_check_access(client, pkg, SIRIDB_ACCESS_INSERT))
     {
-        log_warning("(%s) %s",
-                sirinet_cproto_server_str(CPROTO_ERR_USER_ACCESS),
-                err_msg);
-        sirinet_pkg_t * package = sirinet_pkg_err(
-                pkg->pid,
-                strlen(err_msg),
-                CPROTO_ERR_USER_ACCESS,
-                err_msg);
-
-        if (package != NULL)
-        {
-            /* ignore result code, signal can be raised */
-            sirinet_pkg_send(client, package);
-        }
-
         return;
     }
 
@@ -482,6 +784,25 @@ static void on_insert(uv_stream_t * client, sirinet_pkg_t * pkg)
         return;
     }
 
+    /* refuse new inserts instead of queueing until memory runs out */
+    uint32_t retry_after = siridb_insert_busy(siridb);
+
+    if (retry_after)
+    {
+        CLSERVER_send_busy_error(siridb, client, pkg, retry_after);
+        return;
+    }
+
+    siridb_user_t * user = (siridb_user_t *) ssocket->origin;
+    const char * limit;
+
+    if (    user->ratelimits != NULL &&
+            (retry_after = siridb_ratelimits_insert(user->ratelimits, &limit)))
+    {
+        CLSERVER_send_throttle_error(client, pkg, limit, retry_after);
+        return;
+    }
+
     qp_unpacker_t unpacker;
     qp_unpacker_init(&unpacker, pkg->data, pkg->len);
 
@@ -492,13 +813,30 @@ static void on_insert(uv_stream_t * client, sirinet_pkg_t * pkg)
 
     if (insert != NULL)
     {
-        ssize_t rc = siridb_insert_assign_pools(
-                siridb,
-                &unpacker,
-                insert->packer);
+        /* the response is sent after the responses of earlier inserts */
+        insert->pending = sirinet_socket_pending_new(
+                client,
+                siri.cfg->insert_window);
+
+        if (insert->pending == NULL)
+        {
+            siridb_insert_free(insert);  /* signal is raised */
+            return;
+        }
+
+        ssize_t rc = (pkg->tp == CPROTO_REQ_INSERT_COLUMNS) ?
+                siridb_insert_assign_columns(
+                        siridb,
+                        &unpacker,
+                        insert->packer) :
+                siridb_insert_assign_pools(
+                        siridb,
+                        &unpacker,
+                        insert->packer);
 
         switch ((siridb_insert_err_t) rc)
         {
+        case ERR_EXPECTING_COLUMNS:
         case ERR_EXPECTING_ARRAY:
         case ERR_EXPECTING_SERIES_NAME:
         case ERR_EXPECTING_MAP_OR_ARRAY:
@@ -522,11 +860,8 @@ static void on_insert(uv_stream_t * client, sirinet_pkg_t * pkg)
                         CPROTO_ERR_INSERT,
                         err_msg);
 
-                if (package != NULL)
-                {
-                    /* ignore result code, signal can be raised */
-                    sirinet_pkg_send(client, package);
-                }
+                sirinet_socket_pending_done(client, insert->pending, package);
+                insert->pending = NULL;
             }
 
             /* error, free insert */
@@ -534,6 +869,11 @@ static void on_insert(uv_stream_t * client, sirinet_pkg_t * pkg)
             break;
 
         default:
+            if (user->ratelimits != NULL)
+            {
+                siridb_ratelimits_points(user->ratelimits, (size_t) rc);
+            }
+
             if (siridb_insert_points_to_pools(insert, (size_t) rc))
             {
                 siridb_insert_free(insert);  /* signal is raised */
@@ -543,6 +883,304 @@ static void on_insert(uv_stream_t * client, sirinet_pkg_t * pkg)
     }
 }
 
+static void on_export(uv_stream_t * client, sirinet_pkg_t * pkg)
+{
+    CHECK_SIRIDB(ssocket)
+
+    char err_msg[SIRIDB_MAX_SIZE_ERR_MSG];
+    siridb_t * siridb = ssocket->siridb;
+    sirinet_pkg_t * package;
+    qp_packer_t * packer;
+    qp_unpacker_t unpacker;
+
+    if (!CLSERVER_check_access(client, pkg, SIRIDB_ACCESS_SELECT))
+    {
+        return;
+    }
+
+    if (    siridb->server->flags != SERVER_FLAG_RUNNING &&
+            siridb->server->flags != SERVER_RUNNING_REINDEXING)
+    {
+        CLSERVER_send_server_error(siridb, client, pkg);
+        return;
+    }
+
+    packer = sirinet_packer_new(QP_SUGGESTED_SIZE);
+    if (packer == NULL)
+    {
+        return;  /* signal is raised */
+    }
+
+    qp_unpacker_init(&unpacker, pkg->data, pkg->len);
+
+    if (siridb_export(siridb, &unpacker, packer, err_msg))
+    {
+        log_error("Export error: '%s'", err_msg);
+        qp_packer_free(packer);
+        package = sirinet_pkg_err(
+                pkg->pid,
+                strlen(err_msg),
+                CPROTO_ERR_MSG,
+                err_msg);
+    }
+    else
+    {
+        package = sirinet_packer2pkg(packer, pkg->pid, CPROTO_RES_EXPORT);
+    }
+
+    if (package != NULL)
+    {
+        /* ignore result code, signal can be raised */
+        sirinet_pkg_send(client, package);
+    }
+}
+
+static void on_import(uv_stream_t * client, sirinet_pkg_t * pkg)
+{
+    CHECK_SIRIDB(ssocket)
+
+    char err_msg[SIRIDB_MAX_SIZE_ERR_MSG];
+    siridb_t * siridb = ssocket->siridb;
+    sirinet_pkg_t * package = NULL;
+    qp_packer_t * packer;
+    qp_unpacker_t unpacker;
+    ssize_t count;
+
+    if (!CLSERVER_check_access(client, pkg, SIRIDB_ACCESS_INSERT))
+    {
+        return;
+    }
+
+    if (siridb->server->flags != SERVER_FLAG_RUNNING)
+    {
+        CLSERVER_send_server_error(siridb, client, pkg);
+        return;
+    }
+
+    qp_unpacker_init(&unpacker, pkg->data, pkg->len);
+
+    count = siridb_import(siridb, &unpacker, err_msg);
+
+    if (count < 0)
+    {
+        log_error("Import error: '%s'", err_msg);
+        package = sirinet_pkg_err(
+                pkg->pid,
+                strlen(err_msg),
+                CPROTO_ERR_INSERT,
+                err_msg);
+    }
+    else if ((packer = sirinet_packer_new(256)) != NULL)
+    {
+        snprintf(err_msg,
+                SIRIDB_MAX_SIZE_ERR_MSG,
+                "Successfully imported %zd point(s).",
+                count);
+        log_info(err_msg);
+        siridb->received_points += count;
+
+        qp_add_type(packer, QP_MAP_OPEN);
+        qp_add_raw(packer, "success_msg", 11);
+        qp_add_string(packer, err_msg);
+
+        package = sirinet_packer2pkg(packer, pkg->pid, CPROTO_RES_INSERT);
+    }
+
+    if (package != NULL)
+    {
+        /* ignore result code, signal can be raised */
+        sirinet_pkg_send(client, package);
+    }
+}
+
+static void on_attach(uv_stream_t * client, sirinet_pkg_t * pkg)
+{
+    CHECK_SIRIDB(ssocket)
+
+    char err_msg[SIRIDB_MAX_SIZE_ERR_MSG];
+    siridb_t * siridb = ssocket->siridb;
+    sirinet_pkg_t * package = NULL;
+    qp_packer_t * packer;
+    qp_unpacker_t unpacker;
+    qp_obj_t qp_path;
+    ssize_t count;
+
+    if (!CLSERVER_check_access(
+            client,
+            pkg,
+            SIRIDB_ACCESS_INSERT | SIRIDB_ACCESS_ALTER))
+    {
+        return;
+    }
+
+    if (siridb->server->flags != SERVER_FLAG_RUNNING)
+    {
+        CLSERVER_send_server_error(siridb, client, pkg);
+        return;
+    }
+
+    qp_unpacker_init(&unpacker, pkg->data, pkg->len);
+
+    if (qp_next(&unpacker, &qp_path) == QP_RAW && qp_path.len < PATH_MAX)
+    {
+        char path[qp_path.len + 1];
+        memcpy(path, qp_path.via.raw, qp_path.len);
+        path[qp_path.len] = '\0';
+
+        count = siridb_attach(siridb, path, err_msg);
+    }
+    else
+    {
+        sprintf(err_msg, "Expecting the path to a directory with shards.");
+        count = -1;
+    }
+
+    if (count < 0)
+    {
+        log_error("Attach error: '%s'", err_msg);
+        package = sirinet_pkg_err(
+                pkg->pid,
+                strlen(err_msg),
+                CPROTO_ERR_INSERT,
+                err_msg);
+    }
+    else if ((packer = sirinet_packer_new(256)) != NULL)
+    {
+        snprintf(err_msg,
+                SIRIDB_MAX_SIZE_ERR_MSG,
+                "Successfully attached %zd shard(s).",
+                count);
+
+        qp_add_type(packer, QP_MAP_OPEN);
+        qp_add_raw(packer, "success_msg", 11);
+        qp_add_string(packer, err_msg);
+
+        package = sirinet_packer2pkg(packer, pkg->pid, CPROTO_RES_INSERT);
+    }
+
+    if (package != NULL)
+    {
+        /* ignore result code, signal can be raised */
+        sirinet_pkg_send(client, package);
+    }
+}
+
+static void on_subscribe(uv_stream_t * client, sirinet_pkg_t * pkg)
+{
+    CHECK_SIRIDB(ssocket)
+
+    char err_msg[SIRIDB_MAX_SIZE_ERR_MSG];
+    sirinet_pkg_t * package;
+    qp_unpacker_t unpacker;
+
+    if (!CLSERVER_check_access(client, pkg, SIRIDB_ACCESS_SELECT))
+    {
+        return;
+    }
+
+    qp_unpacker_init(&unpacker, pkg->data, pkg->len);
+
+    if (siridb_subscribe(
+            ssocket->siridb,
+            client,
+            pkg->pid,
+            &unpacker,
+            err_msg))
+    {
+        log_error("Subscribe error: '%s'", err_msg);
+        package = sirinet_pkg_err(
+                pkg->pid,
+                strlen(err_msg),
+                CPROTO_ERR_MSG,
+                err_msg);
+    }
+    else
+    {
+        package = sirinet_pkg_new(pkg->pid, 0, CPROTO_RES_ACK, NULL);
+    }
+
+    if (package != NULL)
+    {
+        /* ignore result code, signal can be raised */
+        sirinet_pkg_send(client, package);
+    }
+}
+
+static void on_unsubscribe(uv_stream_t * client, sirinet_pkg_t * pkg)
+{
+    CHECK_SIRIDB(ssocket)
+
+    sirinet_pkg_t * package;
+    qp_unpacker_t unpacker;
+    qp_obj_t qp_pid;
+
+    qp_unpacker_init(&unpacker, pkg->data, pkg->len);
+
+    if (    qp_next(&unpacker, &qp_pid) != QP_INT64 ||
+            qp_pid.via.int64 < 0 ||
+            qp_pid.via.int64 > UINT16_MAX ||
+            siridb_unsubscribe(
+                    ssocket->siridb,
+                    client,
+                    (uint16_t) qp_pid.via.int64))
+    {
+        const char * err_msg = "Cannot find the subscription.";
+        package = sirinet_pkg_err(
+                pkg->pid,
+                strlen(err_msg),
+                CPROTO_ERR_MSG,
+                err_msg);
+    }
+    else
+    {
+        package = sirinet_pkg_new(pkg->pid, 0, CPROTO_RES_ACK, NULL);
+    }
+
+    if (package != NULL)
+    {
+        /* ignore result code, signal can be raised */
+        sirinet_pkg_send(client, package);
+    }
+}
+
+static void on_fetch(uv_stream_t * client, sirinet_pkg_t * pkg)
+{
+    CHECK_SIRIDB(ssocket)
+
+    char err_msg[SIRIDB_MAX_SIZE_ERR_MSG];
+    siridb_t * siridb = ssocket->siridb;
+    sirinet_pkg_t * package;
+
+    if (!CLSERVER_check_access(client, pkg, SIRIDB_ACCESS_SELECT))
+    {
+        return;
+    }
+
+    if (    siridb->server->flags != SERVER_FLAG_RUNNING &&
+            siridb->server->flags != SERVER_RUNNING_REINDEXING)
+    {
+        CLSERVER_send_server_error(siridb, client, pkg);
+        return;
+    }
+
+    /* the response is sent by the fetch when successful */
+    if (siridb_fetch(siridb, client, pkg, err_msg))
+    {
+        log_error("Fetch error: '%s'", err_msg);
+        package = sirinet_pkg_err(
+                pkg->pid,
+                strlen(err_msg),
+                CPROTO_ERR_MSG,
+                err_msg);
+
+        if (package != NULL)
+        {
+            /* ignore result code, signal can be raised */
+            sirinet_pkg_send(client, package);
+        }
+    }
+}
+
 static void on_ping(uv_stream_t * client, sirinet_pkg_t * pkg)
 {
     sirinet_pkg_t * package;
@@ -636,7 +1274,7 @@ static void on_loaddb(uv_stream_t * client, sirinet_pkg_t * pkg)
 static void on_reqfile(
         uv_stream_t * client,
         sirinet_pkg_t * pkg,
-        sirinet_clserver_getfile getfile)
+        sirinet_clserver_getfn getfn)
 {
     CHECK_SIRIDB(ssocket)
 
@@ -670,20 +1308,14 @@ static void on_reqfile(
     }
     else
     {
-        char * content = NULL;
-        ssize_t size = getfile(&content, siridb);
-        package = (content == NULL) ?
-            sirinet_pkg_new(
-                    pkg->pid,
-                    0,
-                    CPROTO_ERR_FILE,
-                    NULL) :
-            sirinet_pkg_new(
-                    pkg->pid,
-                    size,
-                    CPROTO_RES_FILE,
-                    content);
-        free(content);
+        /* the file is streamed so it is never completely in memory */
+        char fn[PATH_MAX];
+        getfn(fn, siridb);
+
+        if (sirinet_fsend(client, pkg->pid, CPROTO_RES_FILE, fn))
+        {
+            package = sirinet_pkg_new(pkg->pid, 0, CPROTO_ERR_FILE, NULL);
+        }
     }
 
     if (package != NULL)
@@ -0,0 +1,259 @@
+/*
+ * fsend.c - Send a file as the data of a package in chunks.
+ *
+ * author       : Jeroen van der Heijden
+ * email        : jeroen@transceptor.technology
+ * copyright    : 2016, Transceptor Technology
+ *
+ * The package header is written first and the file follows in chunks of
+ * SIRINET_FSEND_CHUNK bytes. Each chunk is read in the thread pool and the
+ * next chunk is read when the previous write is finished, so a large file is
+ * never completely in memory and a slow client limits the transfer.
+ *
+ * Other packages for the client are queued in 'out' during the transfer and
+ * are written when the transfer is finished.
+ *
+ * changes
+ *  - initial version, 14-10-2016
+ *
+ */
+#include <fcntl.h>
+#include <logger/logger.h>
+#include <siri/err.h>
+#include <siri/net/fsend.h>
+#include <siri/net/socket.h>
+#include <siri/siri.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static void FSEND_read(sirinet_fsend_t * fsend);
+static void FSEND_read_cb(uv_fs_t * req);
+static void FSEND_write(sirinet_fsend_t * fsend, uint32_t n);
+static void FSEND_write_cb(uv_write_t * req, int status);
+static void FSEND_done(sirinet_fsend_t * fsend, int status);
+static void FSEND_shutdown_cb(
+        uv_shutdown_t * req,
+        int status __attribute__((unused)));
+
+/*
+ * Start to send file 'fn' as the data of a package to the client.
+ *
+ * Returns 0 when the transfer is started or -1 when the file cannot be read.
+ * (a SIGNAL is raised in case of an allocation error)
+ */
+int sirinet_fsend(
+        uv_stream_t * client,
+        uint16_t pid,
+        uint8_t tp,
+        const char * fn)
+{
+    sirinet_socket_t * ssocket = (sirinet_socket_t *) client->data;
+    sirinet_fsend_t * fsend;
+    sirinet_pkg_t pkg;
+    struct stat st;
+    int fd;
+
+    if (ssocket->fsend != NULL)
+    {
+        log_error("A file transfer to this client is already in progress");
+        return -1;
+    }
+
+    fd = open(fn, O_RDONLY);
+    if (fd < 0)
+    {
+        log_critical("Cannot open file: '%s'", fn);
+        return -1;
+    }
+
+    if (fstat(fd, &st) || (uint64_t) st.st_size > UINT32_MAX)
+    {
+        log_critical("Cannot send file: '%s'", fn);
+        close(fd);
+        return -1;
+    }
+
+    fsend = (sirinet_fsend_t *) malloc(sizeof(sirinet_fsend_t));
+    if (fsend == NULL)
+    {
+        ERR_ALLOC
+        close(fd);
+        return -1;
+    }
+
+    pkg.len = (uint32_t) st.st_size;
+    pkg.pid = pid;
+    pkg.tp = tp;
+    pkg.checkbit = tp ^ 255;
+    memcpy(fsend->header, &pkg, sizeof(sirinet_pkg_t));
+
+    fsend->client = client;
+    fsend->fd = fd;
+    fsend->size = pkg.len;
+    fsend->offset = 0;
+    fsend->header_sent = 0;
+    fsend->req.data = fsend;
+    fsend->wreq.data = fsend;
+
+    /* a write which is already in progress is finished first by libuv */
+    sirinet_socket_incref(client);
+    ssocket->fsend = fsend;
+    ssocket->is_writing = 1;
+
+    FSEND_read(fsend);
+
+    return 0;
+}
+
+static void FSEND_read(sirinet_fsend_t * fsend)
+{
+    uint32_t n = fsend->size - fsend->offset;
+    uv_buf_t buf;
+    int rc;
+
+    if (n == 0)
+    {
+        /* an empty file, only the header is written */
+        FSEND_write(fsend, 0);
+        return;
+    }
+
+    buf = uv_buf_init(
+            fsend->buf,
+            (n < SIRINET_FSEND_CHUNK) ? n : SIRINET_FSEND_CHUNK);
+
+    rc = uv_fs_read(
+            siri.loop,
+            &fsend->req,
+            fsend->fd,
+            &buf,
+            1,
+            fsend->offset,
+            FSEND_read_cb);
+
+    if (rc)
+    {
+        uv_fs_req_cleanup(&fsend->req);
+        FSEND_done(fsend, rc);
+    }
+}
+
+static void FSEND_read_cb(uv_fs_t * req)
+{
+    sirinet_fsend_t * fsend = (sirinet_fsend_t *) req->data;
+    ssize_t nread = req->result;
+
+    uv_fs_req_cleanup(req);
+
+    if (uv_is_closing((uv_handle_t *) fsend->client))
+    {
+        FSEND_done(fsend, UV_ECANCELED);
+    }
+    else if (nread <= 0)
+    {
+        /* the file is truncated while sending */
+        FSEND_done(fsend, nread ? (int) nread : UV_EIO);
+    }
+    else
+    {
+        FSEND_write(fsend, (uint32_t) nread);
+    }
+}
+
+static void FSEND_write(sirinet_fsend_t * fsend, uint32_t n)
+{
+    uv_buf_t wrbufs[2];
+    unsigned int nbufs = 0;
+    int rc;
+
+    if (!fsend->header_sent)
+    {
+        wrbufs[nbufs++] = uv_buf_init(fsend->header, sizeof(sirinet_pkg_t));
+        fsend->header_sent = 1;
+    }
+
+    if (n)
+    {
+        wrbufs[nbufs++] = uv_buf_init(fsend->buf, n);
+        fsend->offset += n;
+    }
+
+    rc = uv_write(
+            &fsend->wreq,
+            fsend->client,
+            wrbufs,
+            nbufs,
+            FSEND_write_cb);
+
+    if (rc)
+    {
+        FSEND_done(fsend, rc);
+    }
+}
+
+static void FSEND_write_cb(uv_write_t * req, int status)
+{
+    sirinet_fsend_t * fsend = (sirinet_fsend_t *) req->data;
+
+    if (status || fsend->offset == fsend->size)
+    {
+        FSEND_done(fsend, status);
+    }
+    else
+    {
+        FSEND_read(fsend);
+    }
+}
+
+/*
+ * Finish the transfer. When the package is not complete the connection is
+ * shut down since the client cannot read any package after this one.
+ */
+static void FSEND_done(sirinet_fsend_t * fsend, int status)
+{
+    uv_stream_t * client = fsend->client;
+    sirinet_socket_t * ssocket = (sirinet_socket_t *) client->data;
+
+    close(fsend->fd);
+    ssocket->fsend = NULL;
+
+    if (status)
+    {
+        log_error(
+                "File transfer stopped after %" PRIu32 " of %" PRIu32
+                " bytes (%s)",
+                fsend->offset,
+                fsend->size,
+                uv_strerror(status));
+
+        if (!uv_is_closing((uv_handle_t *) client))
+        {
+            uv_shutdown_t * req =
+                    (uv_shutdown_t *) malloc(sizeof(uv_shutdown_t));
+            if (req == NULL)
+            {
+                ERR_ALLOC
+            }
+            else if (uv_shutdown(req, client, FSEND_shutdown_cb))
+            {
+                free(req);
+            }
+        }
+    }
+
+    free(fsend);
+    sirinet_pkg_flush(client, status);
+    sirinet_socket_decref(client);
+}
+
+/*
+ * The client closes the connection when the shutdown is received.
+ */
+static void FSEND_shutdown_cb(
+        uv_shutdown_t * req,
+        int status __attribute__((unused)))
+{
+    free(req);
+}
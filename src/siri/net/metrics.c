@@ -0,0 +1,730 @@
+/*
+ * metrics.c - HTTP listener serving metrics in the OpenMetrics text format.
+ *
+ * author       : Jeroen van der Heijden
+ * email        : jeroen@transceptor.technology
+ * copyright    : 2016, Transceptor Technology
+ *
+ * The listener is started when listen_metrics_port is set and answers
+ * 'GET /metrics' with the counters of this server. Each connection handles
+ * one request and is closed after the response is written.
+ *
+ * Metrics are read in the event loop. Counters which are updated by other
+ * threads are read with an atomic load so serving metrics never takes a lock
+ * which is used by inserts or queries.
+ *
+ * Connections keep 'data' set to NULL, like the listening sockets, so they
+ * are closed without a call-back when SiriDB stops.
+ *
+ * changes
+ *  - initial version, 14-10-2016
+ *
+ */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <logger/logger.h>
+#include <siri/alloc.h>
+#include <siri/db/db.h>
+#include <siri/db/fifo.h>
+#include <siri/latency.h>
+#include <siri/mem.h>
+#include <siri/net/metrics.h>
+#include <siri/net/socket.h>
+#include <siri/optimize.h>
+#include <siri/siri.h>
+#include <siri/version.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define METRICS_BACKLOG 128
+#define METRICS_REQUEST_SZ 4096
+#define METRICS_INIT_SZ 8192
+
+#define METRICS_CONTENT_TYPE \
+    "application/openmetrics-text; version=1.0.0; charset=utf-8"
+
+typedef struct metrics_client_s
+{
+    uv_tcp_t tcp;           /* must be on top */
+    uv_write_t req;
+    char * response;
+    size_t len;
+    char buf[METRICS_REQUEST_SZ + 1];  /* room for a terminator */
+} metrics_client_t;
+
+typedef struct metrics_buf_s
+{
+    char * data;
+    size_t len;
+    size_t size;
+} metrics_buf_t;
+
+typedef enum
+{
+    METRICS_DB_RECEIVED_POINTS,
+    METRICS_DB_SELECTED_POINTS,
+    METRICS_DB_SERIES,
+    METRICS_DB_SHARDS,
+    METRICS_DB_COLD_SHARDS,
+    METRICS_DB_BUFFER_SIZE,
+    METRICS_DB_FIFO_FILES,
+    METRICS_DB_INSERT_QUEUE,
+    METRICS_DB_INSERT_QUEUE_SIZE,
+    METRICS_DB_END
+} metrics_db_tp_t;
+
+/* name, type and help for each metric with a value for each database */
+static const char * metrics_db[METRICS_DB_END][3] = {
+        {"siridb_received_points", "counter",
+                "Points received by this server."},
+        {"siridb_selected_points", "counter",
+                "Points selected by this server."},
+        {"siridb_series", "gauge",
+                "Series on this server."},
+        {"siridb_shards", "gauge",
+                "Shards on this server."},
+        {"siridb_cold_shards", "gauge",
+                "Shards with an index which is not loaded."},
+        {"siridb_buffer_size_bytes", "gauge",
+                "Size of the buffer for each series."},
+        {"siridb_fifo_files", "gauge",
+                "Fifo files used for updating the replica server."},
+        {"siridb_insert_queue", "gauge",
+                "Inserts from clients which are in progress."},
+        {"siridb_insert_queue_bytes", "gauge",
+                "Size of the inserts from clients which are in progress."}};
+
+/* upper bounds for the latency histograms in micro seconds */
+static const uint64_t metrics_le[] = {
+        100, 500, 1000, 5000, 10000, 50000,
+        100000, 500000, 1000000, 5000000, 10000000};
+
+#define METRICS_NLE (sizeof(metrics_le) / sizeof(metrics_le[0]))
+
+static uv_loop_t * loop = NULL;
+static struct sockaddr_storage metrics_addr;
+static uv_tcp_t metrics_server;
+
+static void METRICS_on_connection(uv_stream_t * server, int status);
+static void METRICS_alloc_buffer(
+        uv_handle_t * handle,
+        size_t suggested_size,
+        uv_buf_t * buf);
+static void METRICS_on_data(
+        uv_stream_t * stream,
+        ssize_t nread,
+        const uv_buf_t * buf);
+static int METRICS_is_metrics_path(const char * path);
+static void METRICS_respond(metrics_client_t * client);
+static void METRICS_write_cb(uv_write_t * req, int status);
+static void METRICS_close(metrics_client_t * client);
+static void METRICS_close_cb(uv_handle_t * handle);
+static int METRICS_append(metrics_buf_t * buf, const char * fmt, ...);
+static int METRICS_family(
+        metrics_buf_t * buf,
+        const char * name,
+        const char * type,
+        const char * help);
+static uint64_t METRICS_db_value(siridb_t * siridb, metrics_db_tp_t tp);
+static int METRICS_databases(metrics_buf_t * buf);
+static int METRICS_optimize(metrics_buf_t * buf);
+static int METRICS_memory(metrics_buf_t * buf);
+static int METRICS_allocator(metrics_buf_t * buf);
+static int METRICS_latency(
+        metrics_buf_t * buf,
+        const char * name,
+        const char * help,
+        int exec);
+
+/*
+ * Start the metrics listener when listen_metrics_port is set.
+ *
+ * Returns 0 if successful or -1 in case of an error.
+ */
+int sirinet_metrics_init(siri_t * siri)
+{
+    int rc;
+
+    if (!siri->cfg->listen_metrics_port)
+    {
+        return 0;
+    }
+
+    loop = siri->loop;
+
+    uv_tcp_init(loop, &metrics_server);
+
+    /* make sure data is set to NULL so we later on can check this value. */
+    metrics_server.data = NULL;
+
+    if (siri->cfg->ip_support == IP_SUPPORT_IPV4ONLY)
+    {
+        uv_ip4_addr(
+                "0.0.0.0",
+                siri->cfg->listen_metrics_port,
+                (struct sockaddr_in *) &metrics_addr);
+    }
+    else
+    {
+        uv_ip6_addr(
+                "::",
+                siri->cfg->listen_metrics_port,
+                (struct sockaddr_in6 *) &metrics_addr);
+    }
+
+    if (    (rc = uv_tcp_bind(
+                    &metrics_server,
+                    (const struct sockaddr *) &metrics_addr,
+                    (siri->cfg->ip_support == IP_SUPPORT_IPV6ONLY) ?
+                            UV_TCP_IPV6ONLY : 0)) ||
+            (rc = uv_listen(
+                    (uv_stream_t *) &metrics_server,
+                    METRICS_BACKLOG,
+                    METRICS_on_connection)))
+    {
+        log_error("Error listening metrics server: %s", uv_strerror(rc));
+        return -1;
+    }
+
+    log_info("Start listening for metrics requests on port %d",
+            siri->cfg->listen_metrics_port);
+
+    return 0;
+}
+
+/*
+ * Returns the metrics in the OpenMetrics text format and set 'size' to the
+ * length of the text, or NULL in case of an allocation error.
+ *
+ * The return value must be freed by the caller.
+ */
+char * sirinet_metrics_text(size_t * size)
+{
+    metrics_buf_t buf;
+    int rc;
+
+    buf.len = 0;
+    buf.size = METRICS_INIT_SZ;
+    buf.data = (char *) malloc(buf.size);
+
+    if (buf.data == NULL)
+    {
+        return NULL;
+    }
+
+    rc = METRICS_family(&buf, "siridb_build", "info",
+            "Version of this server.");
+    rc += METRICS_append(&buf, "siridb_build_info{version=\"%s\"} 1\n",
+            SIRIDB_VERSION);
+    rc += METRICS_databases(&buf);
+    rc += METRICS_optimize(&buf);
+    rc += METRICS_memory(&buf);
+    rc += METRICS_allocator(&buf);
+    rc += METRICS_latency(
+            &buf,
+            "siridb_request_wait_seconds",
+            "Time a request was queued before it was handled.",
+            0);
+    rc += METRICS_latency(
+            &buf,
+            "siridb_request_exec_seconds",
+            "Time it took to handle a request.",
+            1);
+    rc += METRICS_append(&buf, "# EOF\n");
+
+    if (rc)
+    {
+        free(buf.data);
+        return NULL;
+    }
+
+    *size = buf.len;
+    return buf.data;
+}
+
+static void METRICS_on_connection(uv_stream_t * server, int status)
+{
+    metrics_client_t * client;
+
+    if (status < 0)
+    {
+        log_error("Metrics connection error: %s", uv_strerror(status));
+        return;
+    }
+
+    client = (metrics_client_t *) malloc(sizeof(metrics_client_t));
+    if (client == NULL)
+    {
+        log_error("Cannot allocate a metrics connection");
+        return;
+    }
+
+    client->response = NULL;
+    client->len = 0;
+
+    uv_tcp_init(loop, &client->tcp);
+    client->tcp.data = NULL;
+
+    if (uv_accept(server, (uv_stream_t *) &client->tcp) == 0)
+    {
+        uv_read_start(
+                (uv_stream_t *) &client->tcp,
+                METRICS_alloc_buffer,
+                METRICS_on_data);
+    }
+    else
+    {
+        METRICS_close(client);
+    }
+}
+
+static void METRICS_alloc_buffer(
+        uv_handle_t * handle,
+        size_t suggested_size __attribute__((unused)),
+        uv_buf_t * buf)
+{
+    metrics_client_t * client = (metrics_client_t *) handle;
+
+    buf->base = client->buf + client->len;
+    buf->len = METRICS_REQUEST_SZ - client->len;
+}
+
+static void METRICS_on_data(
+        uv_stream_t * stream,
+        ssize_t nread,
+        const uv_buf_t * buf __attribute__((unused)))
+{
+    metrics_client_t * client = (metrics_client_t *) stream;
+
+    if (nread < 0)
+    {
+        /* the connection is closed or the request is too large */
+        METRICS_close(client);
+        return;
+    }
+
+    client->len += nread;
+
+    /* wait until the request headers are received */
+    if (    memmem(client->buf, client->len, "\r\n\r\n", 4) == NULL &&
+            memmem(client->buf, client->len, "\n\n", 2) == NULL)
+    {
+        if (client->len == METRICS_REQUEST_SZ)
+        {
+            METRICS_close(client);
+        }
+        return;
+    }
+
+    uv_read_stop(stream);
+    METRICS_respond(client);
+}
+
+/*
+ * Returns 1 when the path is '/metrics' or '/', ignoring a query string.
+ */
+static int METRICS_is_metrics_path(const char * path)
+{
+    size_t n = strcspn(path, " ?\r\n");
+
+    return ((n == 1 && *path == '/') ||
+            (n == 8 && memcmp(path, "/metrics", 8) == 0));
+}
+
+static void METRICS_respond(metrics_client_t * client)
+{
+    const char * status = "200 OK";
+    const char * content_type = METRICS_CONTENT_TYPE;
+    char * body = NULL;
+    size_t body_sz = 0;
+    size_t header_sz;
+    char header[256];
+    uv_buf_t wrbuf;
+
+    client->buf[client->len] = '\0';
+
+    if (strncmp(client->buf, "GET ", 4))
+    {
+        status = "405 Method Not Allowed";
+    }
+    else if (!METRICS_is_metrics_path(client->buf + 4))
+    {
+        status = "404 Not Found";
+    }
+    else if ((body = sirinet_metrics_text(&body_sz)) == NULL)
+    {
+        log_error("Cannot create metrics response");
+        status = "500 Internal Server Error";
+    }
+
+    if (body == NULL)
+    {
+        content_type = "text/plain";
+    }
+
+    header_sz = (size_t) snprintf(
+            header,
+            sizeof(header),
+            "HTTP/1.1 %s\r\n"
+            "Content-Type: %s\r\n"
+            "Content-Length: %zu\r\n"
+            "Connection: close\r\n"
+            "\r\n",
+            status,
+            content_type,
+            body_sz);
+
+    client->response = (char *) malloc(header_sz + body_sz);
+    if (client->response == NULL)
+    {
+        free(body);
+        METRICS_close(client);
+        return;
+    }
+
+    memcpy(client->response, header, header_sz);
+    if (body != NULL)
+    {
+        memcpy(client->response + header_sz, body, body_sz);
+        free(body);
+    }
+
+    wrbuf = uv_buf_init(client->response, header_sz + body_sz);
+
+    if (uv_write(
+            &client->req,
+            (uv_stream_t *) &client->tcp,
+            &wrbuf,
+            1,
+            METRICS_write_cb))
+    {
+        METRICS_close(client);
+    }
+}
+
+static void METRICS_write_cb(uv_write_t * req, int status)
+{
+    metrics_client_t * client = (metrics_client_t *) req->handle;
+
+    if (status)
+    {
+        log_debug("Cannot write metrics response: %s", uv_strerror(status));
+    }
+
+    METRICS_close(client);
+}
+
+static void METRICS_close(metrics_client_t * client)
+{
+    /* the handle is already closing when SiriDB stops */
+    if (!uv_is_closing((uv_handle_t *) &client->tcp))
+    {
+        uv_close((uv_handle_t *) &client->tcp, METRICS_close_cb);
+    }
+}
+
+static void METRICS_close_cb(uv_handle_t * handle)
+{
+    metrics_client_t * client = (metrics_client_t *) handle;
+
+    free(client->response);
+    free(client);
+}
+
+/*
+ * Returns 0 if successful or -1 in case of an allocation error.
+ */
+static int METRICS_append(metrics_buf_t * buf, const char * fmt, ...)
+{
+    va_list args;
+    size_t avail;
+    char * tmp;
+    int n;
+
+    while (1)
+    {
+        avail = buf->size - buf->len;
+
+        va_start(args, fmt);
+        n = vsnprintf(buf->data + buf->len, avail, fmt, args);
+        va_end(args);
+
+        if (n < 0)
+        {
+            return -1;
+        }
+
+        if ((size_t) n < avail)
+        {
+            buf->len += n;
+            return 0;
+        }
+
+        tmp = (char *) realloc(buf->data, buf->size * 2);
+        if (tmp == NULL)
+        {
+            return -1;
+        }
+        buf->data = tmp;
+        buf->size *= 2;
+    }
+}
+
+static int METRICS_family(
+        metrics_buf_t * buf,
+        const char * name,
+        const char * type,
+        const char * help)
+{
+    return METRICS_append(
+            buf,
+            "# TYPE %s %s\n"
+            "# HELP %s %s\n",
+            name,
+            type,
+            name,
+            help);
+}
+
+/*
+ * Counters which are updated by other threads are read with an atomic load.
+ */
+static uint64_t METRICS_db_value(siridb_t * siridb, metrics_db_tp_t tp)
+{
+    switch (tp)
+    {
+    case METRICS_DB_RECEIVED_POINTS:
+        return siridb->received_points;
+    case METRICS_DB_SELECTED_POINTS:
+        return siridb->selected_points;
+    case METRICS_DB_SERIES:
+        return __atomic_load_n(&siridb->series_map->len, __ATOMIC_RELAXED);
+    case METRICS_DB_SHARDS:
+        return __atomic_load_n(&siridb->shards->len, __ATOMIC_RELAXED);
+    case METRICS_DB_COLD_SHARDS:
+        return __atomic_load_n(&siridb->cold_shards, __ATOMIC_RELAXED);
+    case METRICS_DB_BUFFER_SIZE:
+        return siridb->buffer_size;
+    case METRICS_DB_FIFO_FILES:
+        return siridb_fifo_size(siridb->fifo);
+    case METRICS_DB_INSERT_QUEUE:
+        return siridb->insert_queue;
+    case METRICS_DB_INSERT_QUEUE_SIZE:
+        return siridb->insert_queue_size;
+    default:
+        return 0;
+    }
+}
+
+static int METRICS_databases(metrics_buf_t * buf)
+{
+    llist_node_t * siridb_node;
+    siridb_t * siridb;
+    int rc = 0;
+
+    if (siri.siridb_list == NULL)
+    {
+        return 0;
+    }
+
+    for (int tp = 0; tp < METRICS_DB_END; tp++)
+    {
+        rc += METRICS_family(
+                buf,
+                metrics_db[tp][0],
+                metrics_db[tp][1],
+                metrics_db[tp][2]);
+
+        for (   siridb_node = siri.siridb_list->first;
+                siridb_node != NULL;
+                siridb_node = siridb_node->next)
+        {
+            siridb = (siridb_t *) siridb_node->data;
+
+            rc += METRICS_append(
+                    buf,
+                    "%s%s{database=\"%s\"} %" PRIu64 "\n",
+                    metrics_db[tp][0],
+                    (*metrics_db[tp][1] == 'c') ? "_total" : "",
+                    siridb->dbname,
+                    METRICS_db_value(siridb, tp));
+        }
+    }
+
+    return rc;
+}
+
+static int METRICS_optimize(metrics_buf_t * buf)
+{
+    siri_optimize_stats_t total;
+    uint64_t tasks;
+    size_t queued, done;
+    double eta = siri_optimize_eta();
+    int rc;
+
+    siri_optimize_progress(&queued, &done);
+
+    rc = METRICS_family(buf, "siridb_optimize_shards_queued", "gauge",
+            "Shards queued by the running or last optimize task.");
+    rc += METRICS_append(buf, "siridb_optimize_shards_queued %zu\n", queued);
+    rc += METRICS_family(buf, "siridb_optimize_shards_done", "gauge",
+            "Queued shards which are handled by the optimize task.");
+    rc += METRICS_append(buf, "siridb_optimize_shards_done %zu\n", done);
+    rc += METRICS_family(buf, "siridb_optimize_eta_seconds", "gauge",
+            "Estimated time to finish the running optimize task.");
+    rc += METRICS_append(
+            buf,
+            "siridb_optimize_eta_seconds %g\n",
+            (eta < 0.0) ? 0.0 : eta);
+
+    siri_optimize_totals(&total, &tasks);
+
+    rc += METRICS_family(buf, "siridb_optimize_tasks_total", "counter",
+            "Optimize tasks which have handled the queued shards.");
+    rc += METRICS_append(
+            buf,
+            "siridb_optimize_tasks_total %" PRIu64 "\n",
+            tasks);
+    rc += METRICS_family(buf, "siridb_optimize_series_total", "counter",
+            "Series which are rewritten in an optimized shard.");
+    rc += METRICS_append(
+            buf,
+            "siridb_optimize_series_total %" PRIu64 "\n",
+            total.series);
+    rc += METRICS_family(buf, "siridb_optimize_read_bytes_total", "counter",
+            "Chunk bytes read for optimizing shards.");
+    rc += METRICS_append(
+            buf,
+            "siridb_optimize_read_bytes_total %" PRIu64 "\n",
+            total.bytes_read);
+    rc += METRICS_family(buf, "siridb_optimize_written_bytes_total", "counter",
+            "Chunk bytes written for optimizing shards.");
+    rc += METRICS_append(
+            buf,
+            "siridb_optimize_written_bytes_total %" PRIu64 "\n",
+            total.bytes_written);
+    rc += METRICS_family(buf, "siridb_optimize_seconds_total", "counter",
+            "Time spent for optimizing shards.");
+    rc += METRICS_append(
+            buf,
+            "siridb_optimize_seconds_total %.6f\n",
+            total.ns / 1e9);
+    rc += METRICS_family(buf, "siridb_optimize_shards_total", "counter",
+            "Optimized shards for each reason, a shard can have more.");
+
+    for (int reason = 0; reason < SIRI_OPTIMIZE_REASON_END; reason++)
+    {
+        rc += METRICS_append(
+                buf,
+                "siridb_optimize_shards_total{reason=\"%s\"} %" PRIu64 "\n",
+                siri_optimize_reason_str(reason),
+                total.reasons[reason]);
+    }
+
+    return rc;
+}
+
+static int METRICS_memory(metrics_buf_t * buf)
+{
+    int rc = METRICS_family(buf, "siridb_memory_bytes", "gauge",
+            "Memory used by each subsystem.");
+
+    for (int tp = 0; tp < SIRI_MEM_END; tp++)
+    {
+        rc += METRICS_append(
+                buf,
+                "siridb_memory_bytes{subsystem=\"%s\"} %zu\n",
+                siri_mem_str(tp),
+                siri_mem_get(tp));
+    }
+
+    return rc;
+}
+
+static int METRICS_allocator(metrics_buf_t * buf)
+{
+    siri_alloc_stats_t stats;
+    const char * name = siri_alloc_name();
+    int rc;
+
+    siri_alloc_stats(&stats);
+
+    rc = METRICS_family(buf, "siridb_allocator_bytes", "gauge",
+            "Memory of the allocator by kind.");
+    rc += METRICS_append(
+            buf,
+            "siridb_allocator_bytes{allocator=\"%s\",kind=\"allocated\"} %zu\n"
+            "siridb_allocator_bytes{allocator=\"%s\",kind=\"active\"} %zu\n"
+            "siridb_allocator_bytes{allocator=\"%s\",kind=\"resident\"} %zu\n"
+            "siridb_allocator_bytes{allocator=\"%s\",kind=\"mapped\"} %zu\n"
+            "siridb_allocator_bytes{allocator=\"%s\",kind=\"retained\"} %zu\n",
+            name, stats.allocated,
+            name, stats.active,
+            name, stats.resident,
+            name, stats.mapped,
+            name, stats.retained);
+    rc += METRICS_family(buf, "siridb_allocator_arenas", "gauge",
+            "Number of allocator arenas, 0 when not known.");
+    rc += METRICS_append(buf, "siridb_allocator_arenas %" PRIu32 "\n",
+            stats.arenas);
+    rc += METRICS_family(buf, "siridb_allocator_fragmentation", "gauge",
+            "Part of the active bytes which is not allocated.");
+    rc += METRICS_append(buf, "siridb_allocator_fragmentation %.4f\n",
+            siri_alloc_fragmentation(&stats));
+
+    return rc;
+}
+
+static int METRICS_latency(
+        metrics_buf_t * buf,
+        const char * name,
+        const char * help,
+        int exec)
+{
+    siri_latency_hist_t * hist;
+    const char * tp_str;
+    int rc = METRICS_family(buf, name, "histogram", help);
+
+    for (int tp = 0; tp < SIRI_LATENCY_END; tp++)
+    {
+        hist = (exec) ? &siri_latency[tp].exec : &siri_latency[tp].wait;
+
+        if (!hist->n)
+        {
+            continue;
+        }
+
+        tp_str = siri_latency_str(tp);
+
+        for (size_t i = 0; i < METRICS_NLE; i++)
+        {
+            rc += METRICS_append(
+                    buf,
+                    "%s_bucket{type=\"%s\",le=\"%g\"} %" PRIu64 "\n",
+                    name,
+                    tp_str,
+                    (double) metrics_le[i] / 1e6,
+                    siri_latency_count_le(hist, metrics_le[i]));
+        }
+
+        rc += METRICS_append(
+                buf,
+                "%s_bucket{type=\"%s\",le=\"+Inf\"} %" PRIu64 "\n"
+                "%s_count{type=\"%s\"} %" PRIu64 "\n"
+                "%s_sum{type=\"%s\"} %.6f\n",
+                name,
+                tp_str,
+                hist->n,
+                name,
+                tp_str,
+                hist->n,
+                name,
+                tp_str,
+                (double) hist->sum / 1e6);
+    }
+
+    return rc;
+}
@@ -11,19 +11,41 @@
  */
 #include <assert.h>
 #include <logger/logger.h>
+#include <lz4.h>
 #include <siri/err.h>
 #include <siri/net/pkg.h>
 #include <siri/net/socket.h>
+#include <siri/siri.h>
+#include <siri/trace.h>
 #include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
 
-typedef struct pkg_send_s
+/*
+ * Packages which are sent while a write to the same socket is in progress are
+ * queued and written together with a single uv_write() when the write has
+ * finished. Write requests are kept for re-use.
+ */
+#define PKG_WRITE_MAX 64    // maximum number of packages in one write
+#define PKG_WRITE_KEEP 32   // free write requests kept for re-use
+
+typedef struct pkg_write_s
 {
-    sirinet_pkg_t * pkg;
+    uv_write_t req;
     uv_stream_t * client;
-} pkg_send_t;
+    uint32_t n;
+    sirinet_pkg_t * pkgs[PKG_WRITE_MAX];
+    struct pkg_write_s * next;  /* next free write request */
+} pkg_write_t;
 
+/* only used from the main loop so no lock is required */
+static pkg_write_t * pkg_write_pool = NULL;
+static uint32_t pkg_write_pool_n = 0;
+
+static void PKG_write(
+        uv_stream_t * client,
+        sirinet_pkg_t ** pkgs,
+        uint32_t n);
 static void PKG_write_cb(uv_write_t * req, int status);
 
 /*
@@ -147,41 +169,36 @@ sirinet_pkg_t * sirinet_pkg_err(
  */
 int sirinet_pkg_send(uv_stream_t * client, sirinet_pkg_t * pkg)
 {
-    uv_write_t * req = (uv_write_t *) malloc(sizeof(uv_write_t));
+    sirinet_socket_t * ssocket = (sirinet_socket_t *) client->data;
+
+    /* set the correct check bit */
+    pkg->checkbit = pkg->tp ^ 255;
 
-    if (req == NULL)
+    SIRI_TRACE3(pkg__sent, pkg->pid, pkg->tp, pkg->len);
+
+    sirinet_pkg_t * cpkg = sirinet_pkg_compress(client, pkg);
+    if (cpkg != NULL)
     {
-        ERR_ALLOC
         free(pkg);
-        return -1;
+        pkg = cpkg;
     }
 
-    pkg_send_t * data = (pkg_send_t *) malloc(sizeof(pkg_send_t));
+    if (!ssocket->is_writing)
+    {
+        PKG_write(client, &pkg, 1);
+        return 0;
+    }
 
-    if (data == NULL)
+    /* a write is in progress, the package is sent when the write is done */
+    if (    (ssocket->out == NULL &&
+            (ssocket->out = slist_new(SLIST_DEFAULT_SIZE)) == NULL) ||
+            slist_append_safe(&ssocket->out, pkg))
     {
         ERR_ALLOC
         free(pkg);
-        free(req);
         return -1;
     }
 
-    /* increment client reference counter */
-    sirinet_socket_incref(client);
-
-    data->client = client;
-    data->pkg = pkg;
-    req->data = data;
-
-    /* set the correct check bit */
-    pkg->checkbit = pkg->tp ^ 255;
-
-    uv_buf_t wrbuf = uv_buf_init(
-            (char *) pkg,
-            sizeof(sirinet_pkg_t) + pkg->len);
-
-    uv_write(req, client, &wrbuf, 1, PKG_write_cb);
-
     return 0;
 }
 
@@ -204,18 +221,232 @@ sirinet_pkg_t * sirinet_pkg_dup(sirinet_pkg_t * pkg)
     return dup;
 }
 
+/*
+ * Write the packages which are queued while a write was in progress. The
+ * packages are dropped when 'status' is an error or the client is closing.
+ */
+void sirinet_pkg_flush(uv_stream_t * client, int status)
+{
+    sirinet_socket_t * ssocket = (sirinet_socket_t *) client->data;
+    slist_t * out = ssocket->out;
+
+    ssocket->is_writing = 0;
+
+    if (out != NULL && out->len)
+    {
+        if (status || uv_is_closing((uv_handle_t *) client))
+        {
+            /* the client is gone so queued packages cannot be sent */
+            while (out->len)
+            {
+                free(slist_pop(out));
+            }
+        }
+        else
+        {
+            sirinet_pkg_t * pkgs[PKG_WRITE_MAX];
+            uint32_t n = (out->len < PKG_WRITE_MAX) ?
+                    (uint32_t) out->len : PKG_WRITE_MAX;
+
+            memcpy(pkgs, out->data, n * sizeof(void *));
+            out->len -= n;
+            memmove(out->data, out->data + n, out->len * sizeof(void *));
+
+            PKG_write(client, pkgs, n);
+        }
+    }
+}
+
+/*
+ * Write 'n' packages to the client using a single write request. The
+ * packages are freed when the write is done.
+ */
+static void PKG_write(
+        uv_stream_t * client,
+        sirinet_pkg_t ** pkgs,
+        uint32_t n)
+{
+    sirinet_socket_t * ssocket = (sirinet_socket_t *) client->data;
+    uv_buf_t wrbufs[PKG_WRITE_MAX];
+    pkg_write_t * wr;
+    int rc;
+
+    if (pkg_write_pool != NULL)
+    {
+        wr = pkg_write_pool;
+        pkg_write_pool = wr->next;
+        pkg_write_pool_n--;
+    }
+    else if ((wr = (pkg_write_t *) malloc(sizeof(pkg_write_t))) == NULL)
+    {
+        ERR_ALLOC
+        while (n--)
+        {
+            free(pkgs[n]);
+        }
+        return;
+    }
+
+    for (uint32_t i = 0; i < n; i++)
+    {
+        wr->pkgs[i] = pkgs[i];
+        wrbufs[i] = uv_buf_init(
+                (char *) pkgs[i],
+                sizeof(sirinet_pkg_t) + pkgs[i]->len);
+    }
+
+    /* increment client reference counter */
+    sirinet_socket_incref(client);
+
+    wr->client = client;
+    wr->n = n;
+    wr->req.data = wr;
+    ssocket->is_writing = 1;
+
+    /* libuv copies the buffer array so wrbufs can be on the stack */
+    rc = uv_write(&wr->req, client, wrbufs, n, PKG_write_cb);
+
+    if (rc)
+    {
+        PKG_write_cb(&wr->req, rc);
+    }
+}
+
 static void PKG_write_cb(uv_write_t * req, int status)
 {
+    pkg_write_t * wr = (pkg_write_t *) req->data;
+    uv_stream_t * client = wr->client;
+    sirinet_socket_t * ssocket = (sirinet_socket_t *) client->data;
+
     if (status)
     {
         log_error("Socket write error: %s", uv_strerror(status));
     }
 
-    pkg_send_t * data = (pkg_send_t *) req->data;
+    for (uint32_t i = 0; i < wr->n; i++)
+    {
+        free(wr->pkgs[i]);
+    }
+
+    if (pkg_write_pool_n < PKG_WRITE_KEEP)
+    {
+        wr->next = pkg_write_pool;
+        pkg_write_pool = wr;
+        pkg_write_pool_n++;
+    }
+    else
+    {
+        free(wr);
+    }
+
+    /* the file transfer writes the queued packages when it is finished */
+    if (ssocket->fsend == NULL)
+    {
+        sirinet_pkg_flush(client, status);
+    }
+
+    sirinet_socket_decref(client);
+}
+
+/*
+ * Returns a compressed copy of the package, with the check bit set, when the
+ * peer of 'client' can read compressed packages and the package is at least
+ * backend_compression_threshold bytes. In other cases, or when compression
+ * does not make the package smaller, NULL is returned.
+ *
+ * The data of a compressed package starts with the length of the original
+ * data followed by an LZ4 block. No signal is raised since the original
+ * package can always be sent instead.
+ */
+sirinet_pkg_t * sirinet_pkg_compress(
+        uv_stream_t * client,
+        sirinet_pkg_t * pkg)
+{
+    sirinet_pkg_t * cpkg;
+    int bound, n;
+
+    if (    !((sirinet_socket_t *) client->data)->compress ||
+            !siri.cfg->backend_compression_threshold ||
+            pkg->len < siri.cfg->backend_compression_threshold ||
+            pkg->len > LZ4_MAX_INPUT_SIZE)
+    {
+        return NULL;
+    }
+
+    bound = LZ4_compressBound((int) pkg->len);
+    cpkg = (sirinet_pkg_t *) malloc(
+            sizeof(sirinet_pkg_t) + sizeof(uint32_t) + bound);
+
+    if (cpkg == NULL)
+    {
+        return NULL;
+    }
+
+    n = LZ4_compress_default(
+            pkg->data,
+            cpkg->data + sizeof(uint32_t),
+            (int) pkg->len,
+            bound);
+
+    if (n <= 0 || n + sizeof(uint32_t) >= pkg->len)
+    {
+        free(cpkg);
+        return NULL;
+    }
+
+    memcpy(cpkg->data, &pkg->len, sizeof(uint32_t));
+    cpkg->len = n + sizeof(uint32_t);
+    cpkg->pid = pkg->pid;
+    cpkg->tp = pkg->tp;
+    cpkg->checkbit = (pkg->tp ^ 255) ^ SIRINET_PKG_COMPRESSED;
+
+    return cpkg;
+}
+
+/*
+ * Returns a new package with the decompressed data of 'pkg' or NULL when
+ * the package cannot be decompressed. (a signal is raised only in case of
+ * an allocation error)
+ */
+sirinet_pkg_t * sirinet_pkg_decompress(sirinet_pkg_t * pkg)
+{
+    sirinet_pkg_t * dpkg;
+    uint32_t len;
+
+    if (pkg->len < sizeof(uint32_t))
+    {
+        return NULL;
+    }
+
+    memcpy(&len, pkg->data, sizeof(uint32_t));
+
+    if (len > LZ4_MAX_INPUT_SIZE)
+    {
+        return NULL;
+    }
+
+    dpkg = (sirinet_pkg_t *) malloc(sizeof(sirinet_pkg_t) + len);
+
+    if (dpkg == NULL)
+    {
+        ERR_ALLOC
+        return NULL;
+    }
+
+    if (LZ4_decompress_safe(
+            pkg->data + sizeof(uint32_t),
+            dpkg->data,
+            (int) (pkg->len - sizeof(uint32_t)),
+            (int) len) != (int) len)
+    {
+        free(dpkg);
+        return NULL;
+    }
 
-    sirinet_socket_decref(data->client);
+    dpkg->len = len;
+    dpkg->pid = pkg->pid;
+    dpkg->tp = pkg->tp;
+    dpkg->checkbit = pkg->tp ^ 255;
 
-    free(data->pkg);
-    free(data);
-    free(req);
+    return dpkg;
 }
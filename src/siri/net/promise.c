@@ -13,7 +13,29 @@
 #include <assert.h>
 #include <logger/logger.h>
 #include <siri/err.h>
+#include <siri/loop.h>
 #include <siri/net/promise.h>
+#include <siri/siri.h>
+#include <stdlib.h>
+
+/*
+ * Promises are not given a timer each. Instead they are added to a hashed
+ * timer wheel with PROMISE_WHEEL_SIZE slots of PROMISE_WHEEL_TICK
+ * milliseconds. A single timer runs while the wheel has promises and checks
+ * one slot each tick. Timeouts longer than one round stay in their slot until
+ * the tick is reached, so adding and removing a promise is O(1).
+ */
+#define PROMISE_WHEEL_TICK 100      // milliseconds
+#define PROMISE_WHEEL_SIZE 1024     // slots, a round is about 100 seconds
+
+static void PROMISE_wheel_cb(uv_timer_t * timer);
+static void PROMISE_wheel_unlink(sirinet_promise_t * promise);
+
+/* only used from the main loop so no lock is required */
+static sirinet_promise_t * promise_wheel[PROMISE_WHEEL_SIZE];
+static uv_timer_t * promise_wheel_timer = NULL;
+static uint64_t promise_wheel_tick = 0;  /* last tick which is checked */
+static size_t promise_wheel_n = 0;
 
 const char * sirinet_promise_strstatus(sirinet_promise_status_t status)
 {
@@ -34,4 +56,136 @@ const char * sirinet_promise_strstatus(sirinet_promise_status_t status)
  * Creating a new promise is done in 'siridb_server_send_pkg'.
  */
 
+/*
+ * Add the promise to the timeout wheel. The 'on_timeout' call-back is called
+ * when the promise is not stopped within 'timeout' milliseconds, after the
+ * promise is removed from the wheel.
+ *
+ * Returns 0 if successful or -1 and a SIGNAL is raised in case of an error.
+ */
+int sirinet_promise_timeout_start(
+        sirinet_promise_t * promise,
+        uint64_t timeout,
+        sirinet_promise_timeout_cb on_timeout)
+{
+    uint64_t now = uv_now(siri.loop);
+    sirinet_promise_t ** slot;
+
+    if (promise_wheel_timer == NULL)
+    {
+        promise_wheel_timer = (uv_timer_t *) malloc(sizeof(uv_timer_t));
+        if (promise_wheel_timer == NULL)
+        {
+            ERR_ALLOC
+            return -1;
+        }
+        promise_wheel_tick = now / PROMISE_WHEEL_TICK;
+        uv_timer_init(siri.loop, promise_wheel_timer);
+        uv_timer_start(
+                promise_wheel_timer,
+                PROMISE_wheel_cb,
+                PROMISE_WHEEL_TICK,
+                PROMISE_WHEEL_TICK);
+    }
+
+    /* round up so a promise never times out too early */
+    promise->expire =
+            (now + timeout + PROMISE_WHEEL_TICK - 1) / PROMISE_WHEEL_TICK;
+
+    if (promise->expire <= promise_wheel_tick)
+    {
+        promise->expire = promise_wheel_tick + 1;
+    }
+
+    promise->on_timeout = on_timeout;
+
+    slot = promise_wheel + promise->expire % PROMISE_WHEEL_SIZE;
+    promise->prev = NULL;
+    promise->next = *slot;
+    if (*slot != NULL)
+    {
+        (*slot)->prev = promise;
+    }
+    *slot = promise;
+
+    promise_wheel_n++;
+
+    return 0;
+}
+
+/*
+ * Remove the promise from the timeout wheel. It is safe to call this function
+ * on a promise which is not in the wheel.
+ */
+void sirinet_promise_timeout_stop(sirinet_promise_t * promise)
+{
+    if (promise->expire)
+    {
+        PROMISE_wheel_unlink(promise);
+    }
+}
+
+static void PROMISE_wheel_unlink(sirinet_promise_t * promise)
+{
+    if (promise->prev != NULL)
+    {
+        promise->prev->next = promise->next;
+    }
+    else
+    {
+        promise_wheel[promise->expire % PROMISE_WHEEL_SIZE] = promise->next;
+    }
+
+    if (promise->next != NULL)
+    {
+        promise->next->prev = promise->prev;
+    }
+
+    promise->expire = 0;
 
+    if (!--promise_wheel_n)
+    {
+        /* an open timer would keep SiriDB from closing */
+        uv_timer_stop(promise_wheel_timer);
+        uv_close((uv_handle_t *) promise_wheel_timer, (uv_close_cb) free);
+        promise_wheel_timer = NULL;
+    }
+}
+
+static void PROMISE_wheel_cb(uv_timer_t * timer)
+{
+    uint64_t now = uv_now(timer->loop) / PROMISE_WHEEL_TICK;
+    sirinet_promise_t * promise;
+    siri_loop_frame_t frame;
+
+    siri_loop_enter(&frame);
+
+    while (promise_wheel_timer == timer && promise_wheel_tick < now)
+    {
+        promise_wheel_tick++;
+
+        /*
+         * A call-back can stop other promises in this slot so we start at
+         * the head of the slot after each call-back.
+         */
+        do
+        {
+            promise = promise_wheel[promise_wheel_tick % PROMISE_WHEEL_SIZE];
+
+            while (promise != NULL && promise->expire > promise_wheel_tick)
+            {
+                promise = promise->next;
+            }
+
+            if (promise != NULL)
+            {
+                sirinet_promise_timeout_cb on_timeout = promise->on_timeout;
+                PROMISE_wheel_unlink(promise);
+                (*on_timeout)(promise);
+            }
+        }
+        while (promise != NULL && promise_wheel_timer == timer);
+    }
+
+    siri_loop_done(SIRI_LOOP_TIMER, &frame);
+}
@@ -15,6 +15,7 @@
 #include <siri/err.h>
 #include <siri/net/promise.h>
 #include <siri/net/promises.h>
+#include <siri/siri.h>
 
 /*
  * Returns NULL and raises a SIGNAL in case an error has occurred.
@@ -35,6 +36,7 @@ sirinet_promises_t * sirinet_promises_new(
     {
 
         promises->cb = cb;
+        promises->each = NULL;
         promises->data = data;
         promises->promises = slist_new(size);
         promises->pkg = pkg;
@@ -71,7 +73,9 @@ void sirinet_promises_llist_free(slist_t * promises)
 /*
  * This function will clean the promises type and list. The promises->cb
  * is responsible for calling 'sirinet_promise_decref' on each promise and
- * free promise->data.
+ * free promise->data. When promises->each is set, it is called with the
+ * promise as soon as the response is received and may already free and
+ * reset promise->data.
  *
  * A promise reference count will be incremented by one.
  */
@@ -82,6 +86,8 @@ void sirinet_promises_on_response(
 {
     sirinet_promises_t * promises = (sirinet_promises_t *) promise->data;
 
+    promise->received = uv_now(siri.loop);
+
     if (status)
     {
         /* we already have a log entry so this can be a debug log */
@@ -97,6 +103,12 @@ void sirinet_promises_on_response(
         promise->data = (void *) sirinet_pkg_dup(pkg);
     }
 
+    if (promises->each != NULL)
+    {
+        /* the response can be handled before all responses are received */
+        (*promises->each)(promise, promises->data);
+    }
+
     slist_append(promises->promises, (void *) promise);
 
     SIRINET_PROMISES_CHECK(promises)
@@ -29,6 +29,15 @@ const char * sirinet_cproto_client_str(cproto_client_t n)
     case CPROTO_REQ_FILE_USERS: return "CPROTO_REQ_FILE_USERS";
     case CPROTO_REQ_FILE_GROUPS: return "CPROTO_REQ_FILE_GROUPS";
     case CPROTO_REQ_FILE_DATABASE: return "CPROTO_REQ_FILE_DATABASE";
+    case CPROTO_REQ_QUERY_STREAM: return "CPROTO_REQ_QUERY_STREAM";
+    case CPROTO_REQ_INSERT_COLUMNS: return "CPROTO_REQ_INSERT_COLUMNS";
+    case CPROTO_REQ_EXPORT: return "CPROTO_REQ_EXPORT";
+    case CPROTO_REQ_IMPORT: return "CPROTO_REQ_IMPORT";
+    case CPROTO_REQ_ATTACH_SHARDS: return "CPROTO_REQ_ATTACH_SHARDS";
+    case CPROTO_REQ_SUBSCRIBE: return "CPROTO_REQ_SUBSCRIBE";
+    case CPROTO_REQ_UNSUBSCRIBE: return "CPROTO_REQ_UNSUBSCRIBE";
+    case CPROTO_REQ_FETCH: return "CPROTO_REQ_FETCH";
+    case CPROTO_REQ_AUTH_SESSION: return "CPROTO_REQ_AUTH_SESSION";
     case CPROTO_REQ_ADMIN: return "CPROTO_REQ_ADMIN";
     default:
         sprintf(protocol_str, "CPROTO_CLIENT_TYPE_UNKNOWN (%d)", n);
@@ -46,6 +55,10 @@ const char * sirinet_cproto_server_str(cproto_server_t n)
     case CPROTO_RES_ACK: return "CPROTO_RES_ACK";
     case CPROTO_RES_INFO: return "CPROTO_RES_INFO";
     case CPROTO_RES_FILE: return "CPROTO_RES_FILE";
+    case CPROTO_RES_QUERY_PART: return "CPROTO_RES_QUERY_PART";
+    case CPROTO_RES_EXPORT: return "CPROTO_RES_EXPORT";
+    case CPROTO_RES_SUBSCRIBE: return "CPROTO_RES_SUBSCRIBE";
+    case CPROTO_RES_FETCH: return "CPROTO_RES_FETCH";
     case CPROTO_ACK_ADMIN: return "CPROTO_ACK_ADMIN";
     case CPROTO_ACK_ADMIN_DATA: return "CPROTO_ACK_ADMIN_DATA";
     case CPROTO_ERR_MSG: return "CPROTO_ERR_MSG";
@@ -60,6 +73,8 @@ const char * sirinet_cproto_server_str(cproto_server_t n)
     case CPROTO_ERR_AUTH_UNKNOWN_DB: return "CPROTO_ERR_AUTH_UNKNOWN_DB";
     case CPROTO_ERR_LOADING_DB: return "CPROTO_ERR_LOADING_DB";
     case CPROTO_ERR_FILE: return "CPROTO_ERR_FILE";
+    case CPROTO_ERR_BUSY: return "CPROTO_ERR_BUSY";
+    case CPROTO_ERR_THROTTLED: return "CPROTO_ERR_THROTTLED";
     case CPROTO_ERR_ADMIN: return "CPROTO_ERR_ADMIN";
     case CPROTO_ERR_ADMIN_INVALID_REQUEST: return "CPROTO_ERR_ADMIN_INVALID_REQUEST";
     default:
@@ -89,6 +104,8 @@ const char * sirinet_bproto_client_str(bproto_client_t n)
     case BPROTO_REQ_GROUPS: return "BPROTO_REQ_GROUPS";
     case BPROTO_ENABLE_BACKUP_MODE: return "BPROTO_ENABLE_BACKUP_MODE";
     case BPROTO_DISABLE_BACKUP_MODE: return "BPROTO_DISABLE_BACKUP_MODE";
+    case BPROTO_KILL_QUERY: return "BPROTO_KILL_QUERY";
+    case BPROTO_FETCH_SERVER: return "BPROTO_FETCH_SERVER";
     default:
         sprintf(protocol_str, "BPROTO_CLIENT_TYPE_UNKNOWN (%d)", n);
         return protocol_str;
@@ -100,6 +117,7 @@ const char * sirinet_bproto_server_str(bproto_server_t n)
     switch (n)
     {
     case BPROTO_RES_QUERY: return "BPROTO_RES_QUERY";
+    case BPROTO_RES_FETCH: return "BPROTO_RES_FETCH";
     case BPROTO_ERR_QUERY: return "BPROTO_ERR_QUERY";
     case BPROTO_ERR_SERVER: return "BPROTO_ERR_SERVER";
     case BPROTO_ERR_POOL: return "BPROTO_ERR_POOL";
@@ -114,6 +132,7 @@ const char * sirinet_bproto_server_str(bproto_server_t n)
     case BPROTO_ERR_DROP_SERIES: return "BPROTO_ERR_DROP_SERIES";
     case BPROTO_ERR_ENABLE_BACKUP_MODE: return "BPROTO_ERR_ENABLE_BACKUP_MODE";
     case BPROTO_ERR_DISABLE_BACKUP_MODE: return "BPROTO_ERR_DISABLE_BACKUP_MODE";
+    case BPROTO_ERR_FETCH: return "BPROTO_ERR_FETCH";
     case BPROTO_AUTH_SUCCESS: return "BPROTO_AUTH_SUCCESS";
     case BPROTO_ACK_FLAGS: return "BPROTO_ACK_FLAGS";
     case BPROTO_ACK_LOG_LEVEL: return "BPROTO_ACK_LOG_LEVEL";
@@ -124,6 +143,7 @@ const char * sirinet_bproto_server_str(bproto_server_t n)
     case BPROTO_ACK_ENABLE_BACKUP_MODE: return "BPROTO_ACK_ENABLE_BACKUP_MODE";
     case BPROTO_ACK_DISABLE_BACKUP_MODE: return "BPROTO_ACK_DISABLE_BACKUP_MODE";
     case BPROTO_RES_GROUPS: return "BPROTO_RES_GROUPS";
+    case BPROTO_ACK_KILL_QUERY: return "BPROTO_ACK_KILL_QUERY";
     default:
         sprintf(protocol_str, "BPROTO_SERVER_TYPE_UNKNOWN (%d)", n);
         return protocol_str;
@@ -12,27 +12,58 @@
 #include <assert.h>
 #include <logger/logger.h>
 #include <siri/admin/client.h>
+#include <siri/db/query.h>
+#include <siri/db/server.h>
+#include <siri/db/subscribe.h>
 #include <siri/err.h>
+#include <siri/loop.h>
+#include <siri/mem.h>
 #include <siri/net/protocol.h>
 #include <siri/net/socket.h>
 #include <siri/siri.h>
+#include <siri/trace.h>
 #include <stdlib.h>
 #include <string.h>
 
 #define MAX_ALLOWED_PKG_SIZE 20971520      // 20 MB
 
+/*
+ * Receive buffers have a size class which is a power of two between 64 KB
+ * and 32 MB. Free buffers are kept for re-use so a large package, or a new
+ * connection, does not need a new allocation.
+ */
+#define SOCKET_BUF_MIN_SIZE 65536           // 64 KB
+#define SOCKET_BUF_CLASSES 10               // 64 KB, 128 KB ... 32 MB
+#define SOCKET_BUF_KEEP 8                   // free buffers kept per class
+
 #define QUIT_SOCKET                     \
-    free(ssocket->buf);                    \
+    SOCKET_buf_put(ssocket->buf, ssocket->size);    \
     ssocket->buf = NULL;                \
     ssocket->len = 0;                    \
     ssocket->size = 0;                    \
     ssocket->on_data = NULL;            \
+    if (ssocket->siridb != NULL)        \
+    {                                   \
+        siridb_query_kill_client(ssocket->siridb, client);  \
+        siridb_subscribe_kill_client(ssocket->siridb, client);  \
+    }                                   \
     sirinet_socket_decref(client);        \
     return;
 
 /* dns_req_family_map maps to IP_SUPPORT values defined in socket.h */
 int dns_req_family_map[3] = {AF_UNSPEC, AF_INET, AF_INET6};
 
+/* only used from the main loop so no lock is required */
+static char * socket_bufs[SOCKET_BUF_CLASSES][SOCKET_BUF_KEEP];
+static uint8_t socket_bufs_n[SOCKET_BUF_CLASSES];
+
+static char * SOCKET_buf_get(size_t * size);
+static void SOCKET_buf_put(char * buf, size_t size);
+static void SOCKET_on_data(
+        uv_stream_t * client,
+        ssize_t nread,
+        const uv_buf_t * buf);
+
 const char * sirinet_socket_ip_support_str(uint8_t ip_support)
 {
     switch (ip_support)
@@ -56,15 +87,16 @@ void sirinet_socket_alloc_buffer(
 
     if (!ssocket->len && ssocket->size > RESET_BUF_SIZE)
     {
-        free(ssocket->buf);
-        ssocket->buf = (char *) malloc(suggested_size);
+        SOCKET_buf_put(ssocket->buf, ssocket->size);
+        ssocket->size = suggested_size;
+        ssocket->buf = SOCKET_buf_get(&ssocket->size);
         if (ssocket->buf == NULL)
         {
             ERR_ALLOC
+            ssocket->size = 0;
             buf->len = 0;
             return;
         }
-        ssocket->size = suggested_size;
         ssocket->len = 0;
     }
     buf->base = ssocket->buf + ssocket->len;
@@ -81,6 +113,17 @@ int sirinet_addr_and_port(char * buffer, uv_stream_t * client)
     struct sockaddr_storage name;
     int namelen = sizeof(name);
 
+    if (client->type == UV_NAMED_PIPE)
+    {
+        /* the peer of a unix socket has no address */
+        snprintf(
+                buffer,
+                ADDR_BUF_SZ,
+                "unix:%s",
+                siri.cfg->listen_client_socket);
+        return 0;
+    }
+
     if (uv_tcp_getpeername(
             (uv_tcp_t *) client,
             (struct sockaddr *) &name,
@@ -139,11 +182,25 @@ void sirinet_socket_on_data(
         uv_stream_t * client,
         ssize_t nread,
         const uv_buf_t * buf)
+{
+    siri_loop_frame_t frame;
+
+    siri_loop_enter(&frame);
+    SOCKET_on_data(client, nread, buf);
+    siri_loop_done(SIRI_LOOP_READ, &frame);
+}
+
+static void SOCKET_on_data(
+        uv_stream_t * client,
+        ssize_t nread,
+        const uv_buf_t * buf __attribute__((unused)))
 {
     sirinet_socket_t * ssocket = (sirinet_socket_t *) client->data;
     sirinet_pkg_t * pkg;
     size_t total_sz;
+    size_t offset;
     uint8_t check;
+    int is_compressed;
 
     /*
      * ssocket->on_data is NULL when 'sirinet_socket_decref' is called from
@@ -174,34 +231,93 @@ void sirinet_socket_on_data(
 
     ssocket->len += nread;
 
-    if (ssocket->len < sizeof(sirinet_pkg_t))
+    /*
+     * Packages which are received completely are handled from the read
+     * buffer, only the start of an incomplete package is moved to the front
+     * of the buffer when all others are handled.
+     */
+    for (offset = 0;; offset += total_sz)
     {
-        return;
-    }
+        if (ssocket->len - offset < sizeof(sirinet_pkg_t))
+        {
+            break;
+        }
 
-    pkg = (sirinet_pkg_t *) ssocket->buf;
-    check = pkg->tp ^ 255;
-    if (    check != pkg->checkbit ||
-            (ssocket->tp == SOCKET_CLIENT && pkg->len > MAX_ALLOWED_PKG_SIZE))
-    {
-        char addr_port[ADDR_BUF_SZ];
-        if (sirinet_addr_and_port(addr_port, client) == 0)
+        pkg = (sirinet_pkg_t *) (ssocket->buf + offset);
+        check = pkg->tp ^ 255;
+
+        /* only servers send compressed packages */
+        is_compressed = (
+                (   ssocket->tp == SOCKET_BACKEND ||
+                    ssocket->tp == SOCKET_SERVER) &&
+                pkg->checkbit == (check ^ SIRINET_PKG_COMPRESSED));
+
+        if (    (check != pkg->checkbit && !is_compressed) ||
+                (   ssocket->tp == SOCKET_CLIENT &&
+                    pkg->len > MAX_ALLOWED_PKG_SIZE))
         {
-            log_error(
-                "Got an illegal package or size too large from '%s', "
-                "closing connection "
-                "(pid: %" PRIu16 ", len: %" PRIu32 ", tp: %" PRIu8 ")",
-                addr_port, pkg->pid, pkg->len, pkg->tp);
+            char addr_port[ADDR_BUF_SZ];
+            if (sirinet_addr_and_port(addr_port, client) == 0)
+            {
+                log_error(
+                    "Got an illegal package or size too large from '%s', "
+                    "closing connection "
+                    "(pid: %" PRIu16 ", len: %" PRIu32 ", tp: %" PRIu8 ")",
+                    addr_port, pkg->pid, pkg->len, pkg->tp);
+            }
+            QUIT_SOCKET
+        }
+
+        total_sz = sizeof(sirinet_pkg_t) + pkg->len;
+
+        if (ssocket->len - offset < total_sz)
+        {
+            break;
+        }
+
+        SIRI_TRACE3(pkg__received, pkg->pid, pkg->tp, pkg->len);
+
+        if (is_compressed)
+        {
+            sirinet_pkg_t * dpkg = sirinet_pkg_decompress(pkg);
+
+            if (dpkg == NULL)
+            {
+                log_error(
+                    "Cannot decompress package, closing connection "
+                    "(pid: %" PRIu16 ", len: %" PRIu32 ", tp: %" PRIu8 ")",
+                    pkg->pid, pkg->len, pkg->tp);
+                QUIT_SOCKET
+            }
+
+            /* call on-data function */
+            (*ssocket->on_data)(client, dpkg);
+
+            free(dpkg);
+        }
+        else
+        {
+            /* call on-data function */
+            (*ssocket->on_data)(client, pkg);
         }
-        QUIT_SOCKET
     }
 
-    total_sz = sizeof(sirinet_pkg_t) + pkg->len;
-    if (ssocket->len < total_sz)
+    if (offset)
     {
+        ssocket->len -= offset;
+        memmove(ssocket->buf, ssocket->buf + offset, ssocket->len);
+    }
+
+    if (ssocket->len >= sizeof(sirinet_pkg_t))
+    {
+        pkg = (sirinet_pkg_t *) ssocket->buf;
+        total_sz = sizeof(sirinet_pkg_t) + pkg->len;
+
         if (ssocket->size < total_sz)
         {
-            char * tmp = realloc(ssocket->buf, total_sz);
+            /* the package does not fit, use a buffer of a larger class */
+            size_t size = total_sz;
+            char * tmp = SOCKET_buf_get(&size);
             if (tmp == NULL)
             {
                 log_critical(
@@ -210,22 +326,11 @@ void sirinet_socket_on_data(
                     pkg->pid, pkg->len, pkg->tp);
                 QUIT_SOCKET
             }
+            memcpy(tmp, ssocket->buf, ssocket->len);
+            SOCKET_buf_put(ssocket->buf, ssocket->size);
             ssocket->buf = tmp;
-            ssocket->size = total_sz;
+            ssocket->size = size;
         }
-        return;
-    }
-
-    /* call on-data function */
-    (*ssocket->on_data)(client, pkg);
-
-    ssocket->len -= total_sz;
-
-    if (ssocket->len > 0)
-    {
-        /* move data and call sirinet_socket_on_data() function again */
-        memmove(ssocket->buf, ssocket->buf + total_sz, ssocket->len);
-        sirinet_socket_on_data(client, 0, buf);
     }
 }
 
@@ -245,6 +350,7 @@ uv_tcp_t * sirinet_socket_new(sirinet_socket_tp_t tp, on_data_cb_t cb)
         return NULL;
     }
 
+    siri_mem_add(SIRI_MEM_NET, sizeof(sirinet_socket_t));
     ssocket->tp = tp;
     ssocket->on_data = cb;
     ssocket->buf = NULL;
@@ -253,9 +359,120 @@ uv_tcp_t * sirinet_socket_new(sirinet_socket_tp_t tp, on_data_cb_t cb)
     ssocket->origin = NULL;
     ssocket->siridb = NULL;
     ssocket->ref = 1;
-    ssocket->tcp.data = ssocket;
+    ssocket->capture_id = 0;
+    ssocket->pending_n = 0;
+    ssocket->is_paused = 0;
+    ssocket->compress = 0;
+    ssocket->is_writing = 0;
+    ssocket->fsend = NULL;
+    ssocket->pending_first = NULL;
+    ssocket->pending_last = NULL;
+    ssocket->out = NULL;
+    ssocket->handle.tcp.data = ssocket;
+
+    return &ssocket->handle.tcp;
+}
+
+/*
+ * Reserve a response slot for a request in progress. Responses are sent in
+ * the order of the slots so a client can send requests without waiting for
+ * the responses. When 'window' slots are in progress, reading from the
+ * client is stopped until a slot is done. A window of 0 has no limit.
+ *
+ * Each slot must be passed to sirinet_socket_pending_done() exactly once.
+ *
+ * Returns NULL and raises a SIGNAL in case an error has occurred.
+ */
+sirinet_socket_pending_t * sirinet_socket_pending_new(
+        uv_stream_t * client,
+        uint16_t window)
+{
+    sirinet_socket_t * ssocket = (sirinet_socket_t *) client->data;
+    sirinet_socket_pending_t * pending =
+            (sirinet_socket_pending_t *) malloc(
+                    sizeof(sirinet_socket_pending_t));
+
+    if (pending == NULL)
+    {
+        ERR_ALLOC
+        return NULL;
+    }
+
+    pending->pkg = NULL;
+    pending->done = 0;
+    pending->next = NULL;
+
+    if (ssocket->pending_last == NULL)
+    {
+        ssocket->pending_first = pending;
+    }
+    else
+    {
+        ssocket->pending_last->next = pending;
+    }
+    ssocket->pending_last = pending;
+    ssocket->pending_n++;
+
+    if (    window &&
+            ssocket->pending_n >= window &&
+            !ssocket->is_paused &&
+            !uv_is_closing((uv_handle_t *) client))
+    {
+        /* packages which are already received are still handled */
+        uv_read_stop(client);
+        ssocket->is_paused = 1;
+    }
+
+    return pending;
+}
+
+/*
+ * Mark a slot as done with an optional response package. The responses of
+ * all done slots which are not behind a slot in progress are sent and
+ * reading from the client is resumed when it was stopped.
+ *
+ * Note: pkg will be freed after calling this function.
+ */
+void sirinet_socket_pending_done(
+        uv_stream_t * client,
+        sirinet_socket_pending_t * pending,
+        sirinet_pkg_t * pkg)
+{
+    sirinet_socket_t * ssocket = (sirinet_socket_t *) client->data;
+    uint16_t pending_n = ssocket->pending_n;
 
-    return &ssocket->tcp;
+    pending->pkg = pkg;
+    pending->done = 1;
+
+    while (ssocket->pending_first != NULL && ssocket->pending_first->done)
+    {
+        pending = ssocket->pending_first;
+        ssocket->pending_first = pending->next;
+        ssocket->pending_n--;
+
+        if (pending->pkg != NULL)
+        {
+            /* ignore result code, signal can be raised */
+            sirinet_pkg_send(client, pending->pkg);
+        }
+        free(pending);
+    }
+
+    if (ssocket->pending_first == NULL)
+    {
+        ssocket->pending_last = NULL;
+    }
+
+    if (    ssocket->is_paused &&
+            ssocket->pending_n < pending_n &&
+            !uv_is_closing((uv_handle_t *) client))
+    {
+        ssocket->is_paused = 0;
+        uv_read_start(
+                client,
+                sirinet_socket_alloc_buffer,
+                sirinet_socket_on_data);
+    }
 }
 
 /*
@@ -297,8 +514,7 @@ void sirinet__socket_free(uv_stream_t * client)
     case SOCKET_SERVER:  // a server connection
         {
             siridb_server_t * server = (siridb_server_t *) ssocket->origin;
-            server->socket = NULL;
-            server->flags = 0;
+            siridb_server_lane_closed(server, (uv_tcp_t *) client);
             siridb_server_decref(server);
         }
         break;
@@ -307,10 +523,101 @@ void sirinet__socket_free(uv_stream_t * client)
         siri.socket = NULL;
         break;
     }
-    free(ssocket->buf);
+
+    /* normally all responses are sent before the socket is destroyed */
+    while (ssocket->pending_first != NULL)
+    {
+        sirinet_socket_pending_t * pending = ssocket->pending_first;
+        ssocket->pending_first = pending->next;
+        free(pending->pkg);
+        free(pending);
+    }
+
+    if (ssocket->out != NULL)
+    {
+        while (ssocket->out->len)
+        {
+            free(slist_pop(ssocket->out));
+        }
+        slist_free(ssocket->out);
+    }
+
+    SOCKET_buf_put(ssocket->buf, ssocket->size);
+    siri_mem_sub(SIRI_MEM_NET, sizeof(sirinet_socket_t));
     free(ssocket);
 }
 
+/*
+ * Returns a buffer with at least 'size' bytes and sets 'size' to the actual
+ * size of the buffer. Buffers larger than the largest class are allocated
+ * with exactly the requested size.
+ *
+ * In case of an error, NULL is returned. (no signal is raised)
+ */
+static char * SOCKET_buf_get(size_t * size)
+{
+    size_t sz = SOCKET_BUF_MIN_SIZE;
+    uint_fast8_t cls = 0;
+    char * buf;
+
+    while (sz < *size && cls < SOCKET_BUF_CLASSES)
+    {
+        sz <<= 1;
+        cls++;
+    }
+
+    if (cls < SOCKET_BUF_CLASSES)
+    {
+        *size = sz;
+
+        if (socket_bufs_n[cls])
+        {
+            return socket_bufs[cls][--socket_bufs_n[cls]];
+        }
+    }
+
+    /* kept buffers are counted as well, they are only moved by put/get */
+    if ((buf = (char *) malloc(*size)) != NULL)
+    {
+        siri_mem_add(SIRI_MEM_NET, *size);
+    }
+
+    return buf;
+}
+
+/*
+ * Return a buffer for re-use. The buffer is destroyed when it has no size
+ * class or when enough buffers of the class are kept.
+ */
+static void SOCKET_buf_put(char * buf, size_t size)
+{
+    size_t sz = SOCKET_BUF_MIN_SIZE;
+    uint_fast8_t cls = 0;
+
+    if (buf == NULL)
+    {
+        return;
+    }
+
+    while (sz < size && cls < SOCKET_BUF_CLASSES)
+    {
+        sz <<= 1;
+        cls++;
+    }
+
+    if (    cls < SOCKET_BUF_CLASSES &&
+            sz == size &&
+            socket_bufs_n[cls] < SOCKET_BUF_KEEP)
+    {
+        socket_bufs[cls][socket_bufs_n[cls]++] = buf;
+    }
+    else
+    {
+        siri_mem_sub(SIRI_MEM_NET, size);
+        free(buf);
+    }
+}
+
 
 
 
@@ -0,0 +1,243 @@
+/*
+ * numa.c - NUMA nodes and thread placement.
+ *
+ * author       : Jeroen van der Heijden
+ * email        : jeroen@transceptor.technology
+ * copyright    : 2016, Transceptor Technology
+ *
+ * On hosts with more than one NUMA node, memory of another node is slower
+ * and traffic between the nodes grows with the number of threads. When
+ * 'sched_numa' is enabled, the threads of the scheduler pool are spread over
+ * the nodes and each thread is pinned to the processors of its node. Linux
+ * allocates a page on the node of the thread which touches it first, so the
+ * scratch memory of a select worker, like the query arena and the points it
+ * reads, is local to the processors which use it.
+ *
+ * When SiriDB is linked with jemalloc, each node has its own arena so freed
+ * memory of one node is not re-used by threads on another node. Other
+ * allocators already use an arena for each thread.
+ *
+ * The nodes are read from sysfs, without sysfs there is a single node and
+ * threads are not pinned.
+ *
+ * changes
+ *  - initial version, 14-10-2016
+ *
+ */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <logger/logger.h>
+#include <siri/numa.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#ifdef SIRI_JEMALLOC
+#include <jemalloc/jemalloc.h>
+#endif
+
+#define NUMA_PATH "/sys/devices/system/node/node%u/cpulist"
+#define NUMA_LINE_SZ 4096
+
+static siri_numa_node_t numa_nodes[SIRI_NUMA_MAX_NODES];
+static uint16_t numa_len = 0;
+
+/*
+ * Read the nodes with processors. Must be called before threads are bound
+ * to a node.
+ */
+void siri_numa_init(void)
+{
+    char path[sizeof(NUMA_PATH) + 8];
+    char line[NUMA_LINE_SZ];
+    siri_numa_node_t * node;
+    FILE * fp;
+
+    numa_len = 0;
+
+#ifdef __linux__
+    for (unsigned int i = 0; i < SIRI_NUMA_MAX_NODES; i++)
+    {
+        sprintf(path, NUMA_PATH, i);
+
+        if ((fp = fopen(path, "r")) == NULL)
+        {
+            continue;  /* node ids may have gaps */
+        }
+
+        node = numa_nodes + numa_len;
+
+        if (    fgets(line, NUMA_LINE_SZ, fp) != NULL &&
+                siri_numa_parse_cpus(line, node) == 0 &&
+                node->ncpus)
+        {
+            numa_len++;  /* nodes with only memory are skipped */
+        }
+        else
+        {
+            log_debug("Skip NUMA node %u without processors", i);
+        }
+
+        fclose(fp);
+    }
+#else
+    (void) path;
+    (void) line;
+    (void) fp;
+#endif
+
+    if (numa_len < 2)
+    {
+        /* a single node without processors, threads are not pinned */
+        memset(numa_nodes, 0, sizeof(siri_numa_node_t));
+        numa_len = 1;
+        return;
+    }
+
+#ifdef SIRI_JEMALLOC
+    for (uint16_t i = 0; i < numa_len; i++)
+    {
+        unsigned int arena;
+        size_t sz = sizeof(arena);
+
+        node = numa_nodes + i;
+
+        if (mallctl("arenas.create", &arena, &sz, NULL, 0) == 0)
+        {
+            node->arena = arena;
+        }
+        else
+        {
+            log_warning("Cannot create a jemalloc arena for NUMA node %u", i);
+        }
+    }
+#endif
+
+    log_info("Found %u NUMA nodes", numa_len);
+}
+
+/*
+ * Returns the number of nodes, at least 1.
+ */
+uint16_t siri_numa_nodes(void)
+{
+    return numa_len ? numa_len : 1;
+}
+
+/*
+ * Pin the calling thread to the processors of 'node' and use the arena of
+ * the node. Argument 'node' wraps around the number of nodes.
+ *
+ * Returns 0 if successful or -1 in case of an error.
+ */
+int siri_numa_bind(uint16_t node)
+{
+    siri_numa_node_t * n = numa_nodes + node % siri_numa_nodes();
+
+    if (!n->ncpus)
+    {
+        return 0;
+    }
+
+#ifdef __linux__
+    cpu_set_t set;
+
+    CPU_ZERO(&set);
+
+    for (uint32_t cpu = 0; cpu < SIRI_NUMA_MAX_CPUS; cpu++)
+    {
+        if (cpu >= CPU_SETSIZE)
+        {
+            break;
+        }
+
+        if (n->cpus[cpu / 64] & ((uint64_t) 1 << (cpu % 64)))
+        {
+            CPU_SET(cpu, &set);
+        }
+    }
+
+    if (pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &set))
+    {
+        return -1;
+    }
+#endif
+
+#ifdef SIRI_JEMALLOC
+    if (n->arena)
+    {
+        unsigned int arena = n->arena;
+
+        if (mallctl("thread.arena", NULL, NULL, &arena, sizeof(arena)))
+        {
+            return -1;
+        }
+    }
+#endif
+
+    return 0;
+}
+
+/*
+ * Parse a list of processors like '0-3,8-11' and set the processors and
+ * number of processors of 'node'. The arena of the node is set to 0.
+ *
+ * Returns 0 if successful or -1 when the list is invalid.
+ */
+int siri_numa_parse_cpus(const char * list, siri_numa_node_t * node)
+{
+    unsigned long first, last;
+    char * end;
+
+    memset(node, 0, sizeof(siri_numa_node_t));
+
+    for (;;)
+    {
+        if (*list < '0' || *list > '9')
+        {
+            break;
+        }
+
+        first = last = strtoul(list, &end, 10);
+
+        if (*end == '-')
+        {
+            list = end + 1;
+            if (*list < '0' || *list > '9')
+            {
+                return -1;
+            }
+            last = strtoul(list, &end, 10);
+        }
+
+        if (first > last || last >= SIRI_NUMA_MAX_CPUS)
+        {
+            return -1;
+        }
+
+        for (; first <= last; first++)
+        {
+            if (!(node->cpus[first / 64] & ((uint64_t) 1 << (first % 64))))
+            {
+                node->cpus[first / 64] |= (uint64_t) 1 << (first % 64);
+                node->ncpus++;
+            }
+        }
+
+        list = end;
+
+        if (*list != ',')
+        {
+            break;
+        }
+        list++;
+    }
+
+    return (*list == '\0' || *list == '\n') ? 0 : -1;
+}
@@ -5,9 +5,23 @@
  * email        : jeroen@transceptor.technology
  * copyright    : 2016, Transceptor Technology
  *
- * There is one and only one optimize task thread running for SiriDB. For this
- * reason we do not need to parse data but we should only take care for locks
- * while writing data.
+ * There is one and only one optimize task running for SiriDB. The task
+ * collects all shards in a queue and starts 'optimize_threads' threads
+ * (including the task thread itself) which take shards from this queue.
+ * Each thread has its own temporary index file, other optimize data is
+ * protected by optimize.lock.
+ *
+ * Only shards which need to be optimized are queued, ordered by the number
+ * of chunk reads saved for each MiB which is rewritten so the shards which
+ * speed up queries the most are done first. The task runs each
+ * optimize_interval seconds, or earlier when a shard has at least
+ * OPTIMIZE_EARLY_BENEFIT chunk reads to save. This is checked each
+ * OPTIMIZE_CHECK_INTERVAL seconds.
+ *
+ * The cost of each shard (chunk bytes read and written, series, time and
+ * the reasons for optimizing) is logged and added to the totals. Progress of
+ * a running task is based on the estimated bytes to read for each queued
+ * shard, which is what the ETA is calculated from.
  *
  *
  * Thread debugging:
@@ -19,22 +33,97 @@
  */
 #include <assert.h>
 #include <logger/logger.h>
+#include <siri/db/downsample.h>
 #include <siri/db/shard.h>
+#include <siri/db/shards.h>
 #include <siri/optimize.h>
+#include <siri/sched.h>
 #include <siri/siri.h>
+#include <siri/throttle.h>
+#include <siri/trace.h>
 #include <slist/slist.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <timeit/timeit.h>
 #include <unistd.h>
 
+#define OPTIMIZE_CHECK_INTERVAL 60      /* seconds */
+#define OPTIMIZE_EARLY_BENEFIT 10000    /* chunk reads, see optimize_benefit */
+#define OPTIMIZE_SUMMARY_SZ 512
+
+typedef struct optimize_job_s
+{
+    siridb_t * siridb;
+    siridb_shard_t * shard;
+    uint64_t score;
+    uint64_t bytes;     /* estimated bytes to read */
+} optimize_job_t;
+
+typedef struct optimize_queue_s
+{
+    size_t len;
+    size_t next;
+    optimize_job_t * jobs;
+} optimize_queue_t;
+
 static siri_optimize_t optimize = {
         .pause=0,
         .status=SIRI_OPTIMIZE_PENDING,
-        .idx_fp=NULL,
-        .idx_fn=NULL
+        .running=0,
+        .waiting=0,
+        .shards_queued=0,
+        .shards_done=0,
+        .task_start=0,
+        .bytes_queued=0,
+        .bytes_done=0,
+        .tasks=0,
+        .total={0}
+};
+
+static const char * optimize_reason_str[SIRI_OPTIMIZE_REASON_END] = {
+        "overlap",
+        "new_values",
+        "dropped_series",
+        "corrupt",
+        "dropped_chunks",
+        "dead",
+        "downsample"
 };
 
+/* protected by optimize.lock */
+static optimize_queue_t queue = {
+        .len=0,
+        .next=0,
+        .jobs=NULL
+};
+
+/* each optimize thread uses its own temporary index file */
+static __thread FILE * idx_fp = NULL;
+static __thread char * idx_fn = NULL;
+
+/* cost of the shard which is optimized by this thread */
+static __thread siri_optimize_stats_t * shard_stats = NULL;
+
 static void OPTIMIZE_work(uv_work_t * work);
+static int OPTIMIZE_queue_shards(siridb_t * siridb);
+static void OPTIMIZE_worker(void * arg);
+static void OPTIMIZE_shard(siridb_t * siridb, siridb_shard_t * shard);
+static void OPTIMIZE_reasons(
+        siri_optimize_stats_t * stats,
+        siridb_t * siridb,
+        siridb_shard_t * shard);
+static void OPTIMIZE_add_stats(siri_optimize_stats_t * stats);
+static void OPTIMIZE_append(
+        char * buf,
+        size_t * size,
+        const char * fmt,
+        ...);
+static int OPTIMIZE_open_idx(const char * fn, const char * mode);
 static void OPTIMIZE_cleanup(slist_t * slsiridb);
 static void OPTIMIZE_work_finish(uv_work_t * work, int status);
+static int OPTIMIZE_cmp_score(const void * a, const void * b);
+static int OPTIMIZE_is_urgent(siridb_shard_t * shard, void * args);
+static int OPTIMIZE_has_urgent(void);
 static void OPTIMIZE_cb(uv_timer_t * handle);
 
 void siri_optimize_init(siri_t * siri)
@@ -45,8 +134,17 @@ void siri_optimize_init(siri_t * siri)
 
     uint64_t timeout = siri->cfg->optimize_interval * 1000;
     siri->optimize = &optimize;
+    uv_mutex_init(&optimize.lock);
     uv_timer_init(siri->loop, &optimize.timer);
 
+    /* the interval is counted from the start of the last task */
+    optimize.start = time(NULL);
+
+    if (timeout > OPTIMIZE_CHECK_INTERVAL * 1000)
+    {
+        timeout = OPTIMIZE_CHECK_INTERVAL * 1000;
+    }
+
     /* do not start with optimize_interval zero */
     if (timeout)
     {
@@ -70,7 +168,7 @@ void siri_optimize_stop(void)
     /* uv_cancel will only be successful when the task is not started yet */
     optimize.status = SIRI_OPTIMIZE_CANCELLED;
     optimize.pause = 0;
-    uv_cancel((uv_req_t *) &optimize.work);
+    siri_sched_cancel(&optimize.work);
 
     /* stop the timer so it will not run again */
     uv_timer_stop(&optimize.timer);
@@ -109,33 +207,43 @@ void siri_optimize_continue(void)
 }
 
 /*
- * This function should only be called from the optimize thread and waits
+ * This function should only be called from an optimize thread and waits
  * if the optimize task is paused. The optimize status after the pause is
  * returned.
+ *
+ * The status is set to SIRI_OPTIMIZE_PAUSED once all running optimize
+ * threads are waiting.
  */
 int siri_optimize_wait(void)
 {
+    int status;
+
     /* its possible that another database is paused, but we wait anyway */
     if (optimize.pause)
     {
-#ifdef DEBUG
-        assert (optimize.status == SIRI_OPTIMIZE_RUNNING);
-#endif
-        optimize.status = SIRI_OPTIMIZE_PAUSED;
-
         /* close open index file in case this is required */
-        if (optimize.idx_fp != NULL)
+        if (idx_fp != NULL)
         {
-            log_info("Closing index file: '%s'", optimize.idx_fn);
-            if (fclose(optimize.idx_fp))
+            log_info("Closing index file: '%s'", idx_fn);
+            if (fclose(idx_fp))
             {
-                log_critical(
-                        "Closing index file failed: '%s'",
-                        optimize.idx_fn);
+                log_critical("Closing index file failed: '%s'", idx_fn);
             }
-            optimize.idx_fp = NULL;
+            idx_fp = NULL;
         }
 
+        uv_mutex_lock(&optimize.lock);
+
+#ifdef DEBUG
+        assert (optimize.status == SIRI_OPTIMIZE_RUNNING);
+#endif
+        if (++optimize.waiting == optimize.running)
+        {
+            optimize.status = SIRI_OPTIMIZE_PAUSED;
+        }
+
+        uv_mutex_unlock(&optimize.lock);
+
         log_info("Optimize task is paused, wait until we can continue...");
 
         sleep(5);
@@ -146,18 +254,29 @@ int siri_optimize_wait(void)
             sleep(5);
         }
 
-        switch (optimize.status)
+        uv_mutex_lock(&optimize.lock);
+
+        optimize.waiting--;
+
+        /* the first thread which continues sets the status to running */
+        if (optimize.status == SIRI_OPTIMIZE_PAUSED)
         {
-        case SIRI_OPTIMIZE_PAUSED:
-            log_info("Continue optimize task...");
             optimize.status = SIRI_OPTIMIZE_RUNNING;
+        }
+        status = optimize.status;
+
+        uv_mutex_unlock(&optimize.lock);
+
+        switch (status)
+        {
+        case SIRI_OPTIMIZE_RUNNING:
+            log_info("Continue optimize task...");
 
-            if (optimize.idx_fn != NULL &&
-                (optimize.idx_fp = fopen(optimize.idx_fn, "a")) == NULL)
+            if (idx_fn != NULL && (idx_fp = fopen(idx_fn, "a")) == NULL)
             {
-                log_error("Cannot re-open index file: '%s'", optimize.idx_fn);
-                free(optimize.idx_fn);
-                optimize.idx_fn = NULL;
+                log_error("Cannot re-open index file: '%s'", idx_fn);
+                free(idx_fn);
+                idx_fn = NULL;
             }
 
             break;
@@ -181,37 +300,24 @@ int siri_optimize_wait(void)
  * be changed to .idx
  *
  * Returns 0 if successful and -1 in case of an error. In case of an error
- * both optimize.idx_fn and optimize.idx_fp will be NULL.
+ * both idx_fn and idx_fp will be NULL.
  */
 int siri_optimize_create_idx(const char * fn)
 {
-#ifdef DEBUG
-    assert (optimize.idx_fn == NULL && strlen(fn) > 3);
-#endif
-    /* copy file name */
-    optimize.idx_fn = strdup(fn);
-    if (optimize.idx_fn == NULL)
-    {
-        log_error("Memory allocation error");
-        return -1;
-    }
-
-    /* replace last three characters from sdb to idx */
-    memcpy(optimize.idx_fn + strlen(fn) - 3, "idx", 3);
-
-    /* open file for writing */
-    optimize.idx_fp = fopen(optimize.idx_fn, "w");
-    if (optimize.idx_fp == NULL)
-    {
-        log_error(
-                "Cannot open index file for writing: '%s'",
-                optimize.idx_fn);
-        free(optimize.idx_fn);
-        optimize.idx_fn = NULL;
-        return -1;
-    }
+    return OPTIMIZE_open_idx(fn, "w");
+}
 
-    return 0;
+/*
+ * Open an existing index file for the given file name, in the same way as
+ * siri_optimize_create_idx(), so an optimize which was interrupted can add
+ * to the index.
+ *
+ * Returns 0 if successful and -1 in case of an error. In case of an error
+ * both idx_fn and idx_fp will be NULL.
+ */
+int siri_optimize_resume_idx(const char * fn)
+{
+    return OPTIMIZE_open_idx(fn, "a");
 }
 
 /*
@@ -229,15 +335,15 @@ int siri_optimize_finish_idx(const char * fn, int remove_old)
 
     siridb_shard_idx_file(buffer, fn);
 
-    if (optimize.idx_fn == NULL)
+    if (idx_fn == NULL)
     {
         log_warning("No index file was created");
         return 0;
     }
 
-    if (fclose(optimize.idx_fp))
+    if (fclose(idx_fp))
     {
-        log_critical("Closing index file failed: '%s'", optimize.idx_fn);
+        log_critical("Closing index file failed: '%s'", idx_fn);
         rc = -1;
     }
 
@@ -246,23 +352,167 @@ int siri_optimize_finish_idx(const char * fn, int remove_old)
         log_warning("Cannot remove file: '%s'", buffer);
     }
 
-    optimize.idx_fp = NULL;
+    idx_fp = NULL;
 
-    if (rename(optimize.idx_fn, buffer))
+    if (rename(idx_fn, buffer))
     {
         log_critical(
                 "Rename failed: '%s' to '%s'",
-                optimize.idx_fn,
+                idx_fn,
                 buffer);
         rc = -1;
     }
 
-    free(optimize.idx_fn);
-    optimize.idx_fn = NULL;
+    free(idx_fn);
+    idx_fn = NULL;
 
     return rc;
 }
 
+/*
+ * Returns the temporary index file for the calling optimize thread or NULL
+ * if no index file is open.
+ */
+FILE * siri_optimize_idx_fp(void)
+{
+    return idx_fp;
+}
+
+/*
+ * Set the number of shards queued by the running or last optimize task and
+ * how many of these shards are handled. The counters are atomic so they can
+ * be read without the optimize lock.
+ */
+void siri_optimize_progress(size_t * queued, size_t * done)
+{
+    *queued = __atomic_load_n(&optimize.shards_queued, __ATOMIC_RELAXED);
+    *done = __atomic_load_n(&optimize.shards_done, __ATOMIC_RELAXED);
+}
+
+/*
+ * Returns the estimated seconds until the running optimize task has handled
+ * the queued shards, or -1 when the task is not running or has not handled
+ * a shard yet.
+ */
+double siri_optimize_eta(void)
+{
+    uint64_t done = __atomic_load_n(&optimize.bytes_done, __ATOMIC_RELAXED);
+    uint64_t queued = optimize.bytes_queued;
+    double elapsed;
+
+    if (optimize.status == SIRI_OPTIMIZE_PENDING || !done)
+    {
+        return -1.0;
+    }
+
+    if (done >= queued)
+    {
+        return 0.0;
+    }
+
+    elapsed = (timeit_ns() - optimize.task_start) / 1e9;
+
+    return elapsed * (queued - done) / done;
+}
+
+/*
+ * Add one series with the chunk bytes which are read and written to the
+ * shard which is optimized by the calling thread. Nothing is counted when
+ * the calling thread is not an optimize thread.
+ */
+void siri_optimize_count(uint64_t bytes_read, uint64_t bytes_written)
+{
+    if (shard_stats != NULL)
+    {
+        shard_stats->series++;
+        shard_stats->bytes_read += bytes_read;
+        shard_stats->bytes_written += bytes_written;
+    }
+}
+
+/*
+ * Copy the totals for all optimized shards and set the number of optimize
+ * tasks since the start of SiriDB.
+ */
+void siri_optimize_totals(siri_optimize_stats_t * total, uint64_t * tasks)
+{
+    uv_mutex_lock(&optimize.lock);
+
+    *total = optimize.total;
+    *tasks = optimize.tasks;
+
+    uv_mutex_unlock(&optimize.lock);
+}
+
+const char * siri_optimize_reason_str(siri_optimize_reason_t reason)
+{
+    return optimize_reason_str[reason];
+}
+
+/*
+ * Returns a string with the progress of the running task and the totals,
+ * or NULL in case of an allocation error.
+ */
+char * siri_optimize_summary(void)
+{
+    char * buf = (char *) malloc(OPTIMIZE_SUMMARY_SZ);
+    siri_optimize_stats_t total;
+    uint64_t tasks;
+    size_t queued, done, size = 0;
+    double eta = siri_optimize_eta();
+
+    if (buf == NULL)
+    {
+        return NULL;
+    }
+
+    siri_optimize_progress(&queued, &done);
+    siri_optimize_totals(&total, &tasks);
+
+    OPTIMIZE_append(
+            buf,
+            &size,
+            "task: status=%s shards=%zu/%zu bytes=%" PRIu64 "/%" PRIu64,
+            (optimize.status == SIRI_OPTIMIZE_PENDING) ? "pending" :
+            (optimize.status == SIRI_OPTIMIZE_RUNNING) ? "running" :
+            (optimize.status == SIRI_OPTIMIZE_CANCELLED) ? "cancelled" :
+            "paused",
+            done,
+            queued,
+            __atomic_load_n(&optimize.bytes_done, __ATOMIC_RELAXED),
+            optimize.bytes_queued);
+
+    if (eta >= 0.0)
+    {
+        OPTIMIZE_append(buf, &size, " eta=%.0fs", eta);
+    }
+
+    OPTIMIZE_append(
+            buf,
+            &size,
+            "\ntotal: tasks=%" PRIu64 " shards=%" PRIu64 " series=%" PRIu64
+            " bytes_read=%" PRIu64 " bytes_written=%" PRIu64 " sec=%.3f"
+            "\nreasons:",
+            tasks,
+            total.shards,
+            total.series,
+            total.bytes_read,
+            total.bytes_written,
+            total.ns / 1e9);
+
+    for (int reason = 0; reason < SIRI_OPTIMIZE_REASON_END; reason++)
+    {
+        OPTIMIZE_append(
+                buf,
+                &size,
+                " %s=%" PRIu64,
+                optimize_reason_str[reason],
+                total.reasons[reason]);
+    }
+
+    return buf;
+}
+
 static void OPTIMIZE_work(uv_work_t * work  __attribute__((unused)))
 {
     /*
@@ -270,12 +520,18 @@ static void OPTIMIZE_work(uv_work_t * work  __attribute__((unused)))
      */
 
     slist_t * slsiridb;
-    slist_t * slshards;
     siridb_t * siridb;
-    siridb_shard_t * shard;
+    uint16_t nthreads = siri.cfg->optimize_threads;
+    uv_thread_t threads[nthreads];
+    uint16_t n;
 
     log_info("Start optimize task");
 
+    /* this thread is the first running optimize thread */
+    uv_mutex_lock(&optimize.lock);
+    optimize.running = 1;
+    uv_mutex_unlock(&optimize.lock);
+
     if (siri_optimize_wait() == SIRI_OPTIMIZE_CANCELLED)
     {
         return;
@@ -301,92 +557,430 @@ static void OPTIMIZE_work(uv_work_t * work  __attribute__((unused)))
         return;
     }
 
+    __atomic_store_n(&optimize.shards_done, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&optimize.bytes_done, 0, __ATOMIC_RELAXED);
+    optimize.bytes_queued = 0;
+
     for (size_t i = 0; i < slsiridb->len; i++)
     {
         siridb = (siridb_t *) slsiridb->data[i];
 
-#ifdef DEBUG
-        log_debug("Start optimizing database '%s'", siridb->dbname);
-#endif
+        /* expired shards are dropped and not optimized */
+        siridb_shards_expire(siridb);
 
-        uv_mutex_lock(&siridb->shards_mutex);
+        if (OPTIMIZE_queue_shards(siridb))
+        {
+            log_error("Error creating reference list for shards.");
+            break;
+        }
+    }
+
+    /* shards from all databases are handled in order of priority */
+    if (queue.len)
+    {
+        qsort(  queue.jobs,
+                queue.len,
+                sizeof(optimize_job_t),
+                OPTIMIZE_cmp_score);
+    }
+
+    for (size_t i = 0; i < queue.len; i++)
+    {
+        optimize.bytes_queued += queue.jobs[i].bytes;
+    }
 
-        slshards = imap_2slist_ref(siridb->shards);
+    __atomic_store_n(&optimize.shards_queued, queue.len, __ATOMIC_RELAXED);
+    optimize.task_start = timeit_ns();
 
-        uv_mutex_unlock(&siridb->shards_mutex);
+    uv_mutex_lock(&optimize.lock);
+    optimize.tasks++;
+    uv_mutex_unlock(&optimize.lock);
 
-        if (slshards == NULL)
+    /* never start more threads than we have shards */
+    if (nthreads > queue.len)
+    {
+        nthreads = (queue.len) ? queue.len : 1;
+    }
+
+    for (n = 0; n < nthreads - 1; n++)
+    {
+        uv_mutex_lock(&optimize.lock);
+        optimize.running++;
+        uv_mutex_unlock(&optimize.lock);
+
+        if (uv_thread_create(&threads[n], OPTIMIZE_worker, NULL))
         {
-            log_error("Error creating reference list for shards.");
-            OPTIMIZE_cleanup(slsiridb);
-            return;
+            log_error(
+                    "Cannot create optimize thread, continue with %d thread(s)",
+                    n + 1);
+
+            uv_mutex_lock(&optimize.lock);
+            optimize.running--;
+            uv_mutex_unlock(&optimize.lock);
+            break;
         }
+    }
+
+    /* this thread works on the queue as well */
+    OPTIMIZE_worker(NULL);
+
+    while (n--)
+    {
+        uv_thread_join(&threads[n]);
+    }
+
+    free(queue.jobs);
+    queue.jobs = NULL;
+    queue.len = queue.next = 0;
+
+    /* release indexes when the index memory limit is reached */
+    for (   size_t i = 0;
+            !siri_err &&
+            optimize.status != SIRI_OPTIMIZE_CANCELLED &&
+            i < slsiridb->len;
+            i++)
+    {
+        siridb = (siridb_t *) slsiridb->data[i];
+
+        /* all shards before the cutoff are downsampled now */
+        if (siridb_downsample_commit(siridb))
+        {
+            log_error(
+                    "Cannot write the downsample state for database '%s'",
+                    siridb->dbname);
+        }
+
+        siridb_shards_evict(siridb);
+    }
+
+    /* all workers have finished, this thread is the last one running */
+    uv_mutex_lock(&optimize.lock);
+    optimize.running = 1;
+    uv_mutex_unlock(&optimize.lock);
+
+    siri_optimize_wait();
+
+    OPTIMIZE_cleanup(slsiridb);
+}
+
+/*
+ * Add the shards which need to be optimized for the given database to the
+ * queue. A reference to each shard is taken and released by the optimize
+ * thread handling the shard.
+ *
+ * Returns 0 if successful or -1 in case of an error.
+ */
+static int OPTIMIZE_queue_shards(siridb_t * siridb)
+{
+    slist_t * slshards;
+    optimize_job_t * jobs;
+    siridb_shard_t * shard;
+    uint64_t score;
+
+    siri_mutex_lock(&siridb->shards_mutex);
 
-        sleep(1);
+    slshards = imap_2slist_ref(siridb->shards);
+
+    siri_mutex_unlock(&siridb->shards_mutex);
+
+    if (slshards == NULL)
+    {
+        return -1;
+    }
 
+    if (!slshards->len)
+    {
+        slist_free(slshards);
+        return 0;
+    }
+
+    jobs = (optimize_job_t *) realloc(
+            queue.jobs,
+            (queue.len + slshards->len) * sizeof(optimize_job_t));
+
+    if (jobs == NULL)
+    {
         for (size_t i = 0; i < slshards->len; i++)
         {
             shard = (siridb_shard_t *) slshards->data[i];
-#ifdef DEBUG
-            /* SIRIDB_SHARD_IS_LOADING cannot be set at this point */
-            assert (~shard->flags & SIRIDB_SHARD_IS_LOADING);
-#endif
-            if (    !siri_err &&
-                    optimize.status != SIRI_OPTIMIZE_CANCELLED &&
-                    (shard->flags & SIRIDB_SHARD_NEED_OPTIMIZE) &&
-                    (~shard->flags & SIRIDB_SHARD_IS_REMOVED))
-            {
-                log_info("Start optimizing shard id %" PRIu64 " (%" PRIu8 ")",
-                        shard->id, shard->flags);
-                if (siridb_shard_optimize(shard, siridb) == 0)
-                {
-                    log_info("Finished optimizing shard id %" PRIu64,
-                            shard->id);
-                }
-                else
-                {
-                    /* signal is raised */
-                    log_critical(
-                        "Optimizing shard id %" PRIu64 " has failed with a "
-                        "critical error", shard->id);
-                }
-
-                if (optimize.idx_fn != NULL)
-                {
-                    log_debug(
-                            "Cleanup temporary index file: '%s'",
-                            optimize.idx_fn);
-                    if (optimize.idx_fp != NULL)
-                    {
-                        fclose(optimize.idx_fp);
-                        optimize.idx_fp = NULL;
-                    }
-                    if (unlink(optimize.idx_fn))
-                    {
-                        log_error(
-                                "Failed to remove file: '%s'",
-                                optimize.idx_fn);
-                    }
-                    free(optimize.idx_fn);
-                    optimize.idx_fn = NULL;
-                }
-            }
+            siridb_shard_decref(shard);
+        }
+        slist_free(slshards);
+        return -1;
+    }
+
+    queue.jobs = jobs;
+
+    /* the fragmentation counters are updated while holding the lock */
+    siri_rwlock_rdlock(&siridb->series_mutex);
+
+    siridb_downsample_prepare(siridb, slshards);
+
+    for (size_t i = 0; i < slshards->len; i++)
+    {
+        shard = (siridb_shard_t *) slshards->data[i];
 
-            /* decrement ref for the shard which was incremented earlier */
+        score = siridb_shard_optimize_score(shard);
+
+        /* shards which are downsampled need no other reason */
+        if (!score && siridb_downsample_shard(siridb, shard))
+        {
+            score = 1;
+        }
+
+        if (!score)
+        {
             siridb_shard_decref(shard);
+            continue;
         }
 
-        slist_free(slshards);
+        queue.jobs[queue.len].siridb = siridb;
+        queue.jobs[queue.len].shard = shard;
+        queue.jobs[queue.len].score = score;
+        queue.jobs[queue.len].bytes = siridb_shard_optimize_bytes(shard);
+        queue.len++;
+    }
+
+    siri_rwlock_rdunlock(&siridb->series_mutex);
+
+    slist_free(slshards);
+
+    return 0;
+}
+
+/*
+ * Optimize thread which takes shards from the queue until the queue is
+ * empty.
+ */
+static void OPTIMIZE_worker(void * arg __attribute__((unused)))
+{
+    optimize_job_t * job;
+
+    /* restored before the end since this might be a thread from the pool */
+    siri_throttle_background(1);
+
+    while (1)
+    {
+        uv_mutex_lock(&optimize.lock);
+
+        job = (queue.next < queue.len) ? queue.jobs + queue.next++ : NULL;
+
+        uv_mutex_unlock(&optimize.lock);
 
-        if (siri_optimize_wait() == SIRI_OPTIMIZE_CANCELLED)
+        if (job == NULL)
         {
             break;
         }
+
+        OPTIMIZE_shard(job->siridb, job->shard);
+
+        /* decrement ref for the shard which was incremented earlier */
+        siridb_shard_decref(job->shard);
+
+        __atomic_add_fetch(&optimize.shards_done, 1, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&optimize.bytes_done, job->bytes, __ATOMIC_RELAXED);
+    }
+
+    siri_throttle_background(0);
+
+    uv_mutex_lock(&optimize.lock);
+
+    /* when the other threads are all waiting, the task is paused */
+    if (    --optimize.running &&
+            optimize.waiting == optimize.running &&
+            optimize.status == SIRI_OPTIMIZE_RUNNING)
+    {
+        optimize.status = SIRI_OPTIMIZE_PAUSED;
+    }
+
+    uv_mutex_unlock(&optimize.lock);
+}
+
+static void OPTIMIZE_shard(siridb_t * siridb, siridb_shard_t * shard)
+{
+    siri_optimize_stats_t stats = {0};
+    uint64_t start;
+    int rc;
+
+    if (shard->is_cold)
+    {
+        /* cold shards are optimized after they are loaded */
+        return;
+    }
+
 #ifdef DEBUG
-        log_debug("Finished optimizing database '%s'", siridb->dbname);
+    /* SIRIDB_SHARD_IS_LOADING cannot be set at this point */
+    assert (~shard->flags & SIRIDB_SHARD_IS_LOADING);
 #endif
+    if (    siri_err ||
+            optimize.status == SIRI_OPTIMIZE_CANCELLED ||
+            (   !siridb_shard_need_optimize(shard) &&
+                !siridb_downsample_shard(siridb, shard)) ||
+            (shard->flags & SIRIDB_SHARD_IS_REMOVED))
+    {
+        return;
     }
-    OPTIMIZE_cleanup(slsiridb);
+
+    log_info("Start optimizing shard id %" PRIu64 " (%" PRIu8 ", %" PRIu32
+            " new chunks, %" PRIu32 " overlaps, %zu dead bytes)",
+            shard->id,
+            shard->flags,
+            shard->new_chunks,
+            shard->overlaps,
+            shard->dead_size);
+
+    /* the reasons must be read before the flags are cleared */
+    OPTIMIZE_reasons(&stats, siridb, shard);
+    start = timeit_ns();
+    shard_stats = &stats;
+
+    SIRI_TRACE1(optimize__start, shard->id);
+
+    rc = siridb_shard_optimize(shard, siridb);
+
+    SIRI_TRACE2(optimize__done, shard->id, rc);
+
+    if (rc == 0)
+    {
+        shard_stats = NULL;
+        stats.ns = timeit_ns() - start;
+        stats.shards = 1;
+
+        log_info("Finished optimizing shard id %" PRIu64 " in %.3f seconds "
+                "(%" PRIu64 " series, %" PRIu64 " bytes read, %" PRIu64
+                " bytes written)",
+                shard->id,
+                stats.ns / 1e9,
+                stats.series,
+                stats.bytes_read,
+                stats.bytes_written);
+
+        OPTIMIZE_add_stats(&stats);
+    }
+    else
+    {
+        /* signal is raised */
+        shard_stats = NULL;
+        log_critical(
+            "Optimizing shard id %" PRIu64 " has failed with a "
+            "critical error", shard->id);
+    }
+
+    if (idx_fn != NULL)
+    {
+        log_debug("Cleanup temporary index file: '%s'", idx_fn);
+        if (idx_fp != NULL)
+        {
+            fclose(idx_fp);
+            idx_fp = NULL;
+        }
+        /* a cancelled optimize keeps the index so it can be resumed */
+        if (    (siri_err || optimize.status != SIRI_OPTIMIZE_CANCELLED) &&
+                unlink(idx_fn))
+        {
+            log_error("Failed to remove file: '%s'", idx_fn);
+        }
+        free(idx_fn);
+        idx_fn = NULL;
+    }
+}
+
+/*
+ * Set the reasons for optimizing the shard. A shard can have more than one
+ * reason.
+ */
+static void OPTIMIZE_reasons(
+        siri_optimize_stats_t * stats,
+        siridb_t * siridb,
+        siridb_shard_t * shard)
+{
+    uint64_t * reasons = stats->reasons;
+
+    reasons[SIRI_OPTIMIZE_REASON_OVERLAP] =
+            !!(shard->flags & SIRIDB_SHARD_HAS_OVERLAP);
+    reasons[SIRI_OPTIMIZE_REASON_NEW_VALUES] =
+            !!(shard->flags & SIRIDB_SHARD_HAS_NEW_VALUES);
+    reasons[SIRI_OPTIMIZE_REASON_DROPPED_SERIES] =
+            !!(shard->flags & SIRIDB_SHARD_HAS_DROPPED_SERIES);
+    reasons[SIRI_OPTIMIZE_REASON_CORRUPT] =
+            !!(shard->flags & SIRIDB_SHARD_IS_CORRUPT);
+    reasons[SIRI_OPTIMIZE_REASON_DROPPED_CHUNKS] = !!shard->dropped_n;
+    reasons[SIRI_OPTIMIZE_REASON_DEAD] =
+            shard->dead_size * 100 >
+            (size_t) siri.cfg->optimize_compact_threshold * shard->size;
+    reasons[SIRI_OPTIMIZE_REASON_DOWNSAMPLE] =
+            !!siridb_downsample_shard(siridb, shard);
+}
+
+static void OPTIMIZE_add_stats(siri_optimize_stats_t * stats)
+{
+    siri_optimize_stats_t * total = &optimize.total;
+
+    uv_mutex_lock(&optimize.lock);
+
+    total->shards += stats->shards;
+    total->series += stats->series;
+    total->bytes_read += stats->bytes_read;
+    total->bytes_written += stats->bytes_written;
+    total->ns += stats->ns;
+
+    for (int reason = 0; reason < SIRI_OPTIMIZE_REASON_END; reason++)
+    {
+        total->reasons[reason] += stats->reasons[reason];
+    }
+
+    uv_mutex_unlock(&optimize.lock);
+}
+
+/*
+ * Append to a summary of OPTIMIZE_SUMMARY_SZ bytes, the summary is
+ * truncated when it does not fit.
+ */
+static void OPTIMIZE_append(char * buf, size_t * size, const char * fmt, ...)
+{
+    size_t avail = OPTIMIZE_SUMMARY_SZ - *size;
+    va_list args;
+    int n;
+
+    va_start(args, fmt);
+    n = vsnprintf(buf + *size, avail, fmt, args);
+    va_end(args);
+
+    /* vsnprintf() returns the length without truncating */
+    if (n > 0)
+    {
+        *size += ((size_t) n < avail) ? (size_t) n : avail - 1;
+    }
+}
+
+static int OPTIMIZE_open_idx(const char * fn, const char * mode)
+{
+#ifdef DEBUG
+    assert (idx_fn == NULL && strlen(fn) > 3);
+#endif
+    /* copy file name */
+    idx_fn = strdup(fn);
+    if (idx_fn == NULL)
+    {
+        log_error("Memory allocation error");
+        return -1;
+    }
+
+    /* replace last three characters from sdb to idx */
+    memcpy(idx_fn + strlen(fn) - 3, "idx", 3);
+
+    idx_fp = fopen(idx_fn, mode);
+    if (idx_fp == NULL)
+    {
+        log_error(
+                "Cannot open index file for writing: '%s'",
+                idx_fn);
+        free(idx_fn);
+        idx_fn = NULL;
+        return -1;
+    }
+
+    return 0;
 }
 
 static void OPTIMIZE_cleanup(slist_t * slsiridb)
@@ -426,9 +1020,61 @@ static void OPTIMIZE_work_finish(
     }
 }
 
+/*
+ * Sort jobs by score, highest first.
+ */
+static int OPTIMIZE_cmp_score(const void * a, const void * b)
+{
+    uint64_t sa = ((const optimize_job_t *) a)->score;
+    uint64_t sb = ((const optimize_job_t *) b)->score;
+
+    return (sa < sb) - (sa > sb);
+}
+
+static int OPTIMIZE_is_urgent(
+        siridb_shard_t * shard,
+        void * args __attribute__((unused)))
+{
+    return  siridb_shard_optimize_score(shard) &&
+            siridb_shard_optimize_benefit(shard) >= OPTIMIZE_EARLY_BENEFIT;
+}
 
 /*
- * Start the optimize task. (will start a new thread performing the work)
+ * Returns 1 (true) when at least one shard should be optimized before the
+ * optimize_interval is reached.
+ *
+ * Values are added by the main thread so the counters are read without the
+ * series_mutex, a counter which is reset by an optimize thread meanwhile can
+ * only start or skip a task once.
+ */
+static int OPTIMIZE_has_urgent(void)
+{
+    llist_node_t * siridb_node;
+    siridb_t * siridb;
+    int rc = 0;
+
+    for (   siridb_node = siri.siridb_list->first;
+            siridb_node != NULL && !rc;
+            siridb_node = siridb_node->next)
+    {
+        siridb = (siridb_t *) siridb_node->data;
+
+        siri_mutex_lock(&siridb->shards_mutex);
+
+        rc = imap_walk(
+                siridb->shards,
+                (imap_cb) OPTIMIZE_is_urgent,
+                NULL);
+
+        siri_mutex_unlock(&siridb->shards_mutex);
+    }
+
+    return rc;
+}
+
+/*
+ * Start the optimize task when the optimize_interval is reached or when a
+ * shard is urgent. (will start a new thread performing the work)
  */
 static void OPTIMIZE_cb(uv_timer_t * handle  __attribute__((unused)))
 {
@@ -442,14 +1088,24 @@ static void OPTIMIZE_cb(uv_timer_t * handle  __attribute__((unused)))
         return;
     }
 
+    if (time(NULL) - optimize.start < (time_t) siri.cfg->optimize_interval)
+    {
+        if (!OPTIMIZE_has_urgent())
+        {
+            return;
+        }
+        log_info("Start optimize task early for fragmented shards");
+    }
+
     /* set status to RUNNING */
     optimize.status = SIRI_OPTIMIZE_RUNNING;
 
     /* set start time */
     optimize.start = time(NULL);
 
-    uv_queue_work(
-            siri.loop,
+    siri_sched_queue(
+            SIRI_SCHED_BACKGROUND,
+            NULL,
             &optimize.work,
             OPTIMIZE_work,
             OPTIMIZE_work_finish);
@@ -15,40 +15,68 @@
 #include <logger/logger.h>
 #include <qpack/qpack.h>
 #include <siri/async.h>
+#include <siri/db/acache.h>
 #include <siri/db/aggregate.h>
 #include <siri/db/group.h>
 #include <siri/db/groups.h>
+#include <siri/db/hot.h>
+#include <siri/db/mcache.h>
 #include <siri/db/nodes.h>
 #include <siri/db/presuf.h>
 #include <siri/db/props.h>
 #include <siri/db/props.h>
+#include <siri/db/qcache.h>
 #include <siri/db/query.h>
 #include <siri/db/re.h>
 #include <siri/db/series.h>
 #include <siri/db/server.h>
 #include <siri/db/servers.h>
 #include <siri/db/shard.h>
+#include <siri/db/shards.h>
+#include <siri/db/spill.h>
+#include <siri/db/tokens.h>
+#include <siri/db/trigrams.h>
 #include <siri/db/user.h>
 #include <siri/db/users.h>
+#include <siri/db/variance.h>
 #include <siri/err.h>
 #include <siri/grammar/gramp.h>
 #include <siri/help/help.h>
+#include <siri/mem.h>
 #include <siri/net/promises.h>
 #include <siri/net/protocol.h>
 #include <siri/net/socket.h>
 #include <siri/parser/listener.h>
 #include <siri/parser/queries.h>
+#include <siri/sched.h>
 #include <siri/siri.h>
 #include <strextra/strextra.h>
+#include <string.h>
 #include <sys/time.h>
+#include <timeit/timeit.h>
 
 
 #define MAX_ITERATE_COUNT 1000      // thousand
+#define SERIES_SET_MIN_SIZE 1024    // filter using a set from this size
 
 #define QP_ADD_SUCCESS qp_add_raw(query->packer, "success_msg", 11);
 #define DEFAULT_ALLOC_COLUMNS 6
 #define IS_MASTER (query->flags & SIRIDB_QUERY_FLAG_MASTER)
 
+/*
+ * Queries with a pool map only use the pools in the map, other queries use
+ * all pools. (see enter_series_name)
+ */
+#define NEED_POOLS(q_wrapper) \
+    ((q_wrapper)->pmap == NULL || (q_wrapper)->pmap->len)
+#define FWD_POOLS(q_wrapper)                \
+    (((q_wrapper)->pmap == NULL) ?          \
+            SIRIDB_QUERY_FWD_POOLS :        \
+            SIRIDB_QUERY_FWD_SOME_POOLS)
+#define SELECT_STREAM_PART_SIZE 65536  // flush a streamed part at this size
+#define SELECT_PREFETCH_SERIES 16      // series prefetched by a select worker
+#define SELECT_PART_POINTS 1048576     // minimal points for a series segment
+
 #define MASTER_CHECK_ONLINE(siridb)                                         \
 if (IS_MASTER && !siridb_server_self_online(siridb->server))                \
 {                                                                           \
@@ -122,7 +150,125 @@ if (IS_MASTER && siridb_is_reindexing(siridb))                              \
     {                                                           \
         sirinet_promises_llist_free(promises);                  \
         return;  /* signal is raised when handle is NULL */     \
-    }
+    }                                                           \
+    stage_end((siridb_query_t *) handle->data,                  \
+            &((siridb_query_t *) handle->data)->stages.wait);   \
+    siridb_query_add_waits((siridb_query_t *) handle->data, promises);
+
+/* first and last segment of a series use the range of the select */
+#define SELECT_PART_FIRST 1
+#define SELECT_PART_LAST 2
+
+/*
+ * A segment of a series which is split for aggregating on multiple workers.
+ * Segments start at a group so each group is in one segment. The segments
+ * of a series are stored in order and the first segment counts the segments
+ * which are not finished.
+ */
+typedef struct select_part_s
+{
+    size_t series;                      /* index in q_select->slist */
+    size_t first;                       /* index of the first segment */
+    size_t n;                           /* number of segments */
+    size_t left;                        /* only used by the first segment */
+    uint8_t flags;
+    uint64_t start_ts;
+    uint64_t end_ts;
+    siridb_points_t * points;           /* first aggregate of the segment */
+} select_part_t;
+
+/*
+ * A select job is used to read and aggregate the series of a select by
+ * worker threads. Workers take the next series from the list until all
+ * series are processed or an error has occurred. When series are split,
+ * workers take the next segment instead.
+ */
+typedef struct select_job_s
+{
+    uv_async_t * handle;
+    uv_mutex_t lock;
+    size_t len;                         /* number of series */
+    size_t items;                       /* number of series or segments */
+    size_t next;                        /* index of the next item */
+    size_t prefetched;                  /* series before are prefetched */
+    size_t pending;                     /* running workers */
+    size_t n;                           /* number of selected points */
+    int err;
+    char err_msg[SIRIDB_MAX_SIZE_ERR_MSG];
+    uint64_t aggregate;                 /* summed over the workers (timeit) */
+    siridb_shard_stats_t shards;        /* summed over the workers (timeit) */
+    siridb_points_t ** results;         /* result for each series or NULL */
+    select_part_t * parts;              /* segments or NULL when not split */
+    uv_work_t works[];
+} select_job_t;
+
+/*
+ * Candidates for a top or bottom select. The score is the highest value of
+ * a series for top and the negated lowest value for bottom, so a higher
+ * score is always better. The items are a min-heap with the worst candidate
+ * on top until the candidates are sorted for looking them up.
+ */
+typedef struct select_top_item_s
+{
+    double score;
+    siridb_points_t * points;
+} select_top_item_t;
+
+typedef struct select_top_s
+{
+    size_t size;                        /* maximum number of candidates */
+    size_t len;                         /* number of candidates */
+    int8_t sign;
+    int err;
+    ct_t * result;                      /* result with the candidates */
+    select_top_item_t items[];
+} select_top_t;
+
+/*
+ * A row of a list series result, used by the master to merge the rows of
+ * all pools in name order when a list series has an 'after' name.
+ */
+typedef struct list_row_s
+{
+    const char * name;
+    size_t name_len;
+    const char * data;                  /* packed row */
+    size_t size;
+} list_row_t;
+
+typedef struct list_rows_s
+{
+    size_t n;
+    size_t size;
+    list_row_t * row;
+} list_rows_t;
+
+/*
+ * A stream is used when a client requests the select result in parts. The
+ * select work on another thread creates the parts and the event loop sends
+ * them to the client.
+ *
+ * Without a merge, the series of a pool are complete when the pool has
+ * responded. These results are added to 'ready' and are packed one at a time
+ * while waiting for the other pools.
+ */
+struct query_stream_s
+{
+    uv_async_t async;                   /* must be on top */
+    uv_mutex_t lock;
+    uv_stream_t * client;
+    slist_t * parts;                    /* packages waiting to be sent */
+    slist_t * ready;                    /* results (ct_t) waiting to be packed */
+    ct_t * result;                      /* result which is being packed */
+    uint8_t busy;                       /* set while packing 'result' */
+    uint8_t wait;                       /* all pools have responded */
+};
+
+#define SELECT_STREAM_EARLY(q_select) \
+    ((q_select)->stream != NULL && \
+     (q_select)->merge_as == NULL && \
+     (q_select)->join == NULL && \
+     !(q_select)->top)
 
 #define MEM_ERR_RET                                             \
         sprintf(query->err_msg, "Memory allocation error.");    \
@@ -146,12 +292,16 @@ if (IS_MASTER && siridb_is_reindexing(siridb))                              \
     "Successfully revoked permissions from user '%s'."
 #define MSG_SUCCESS_CREATE_GROUP \
     "Successfully created group '%s'."
+#define MSG_SUCCESS_CREATE_SNAPSHOT \
+    "Successfully created a snapshot on '%s'."
 #define MSG_SUCCESS_DROP_GROUP \
     "Successfully dropped group '%s'."
 #define MSG_SUCCESS_ALTER_GROUP \
     "Successfully updated group '%s'."
 #define MSG_SUCCESS_SET_DROP_THRESHOLD \
     "Successfully changed drop_threshold from %g to %g."
+#define MSG_SUCCESS_SET_EXPIRATION \
+    "Successfully changed %s from %" PRIu32 " to %" PRIu32 " seconds."
 #define MSG_SUCCESS_SET_LIST_LIMIT \
     "Successfully changed list limit from %" PRIu32 " to %" PRIu32 "."
 #define MSG_SUCCESS_SET_ADDR_PORT \
@@ -171,6 +321,8 @@ if (IS_MASTER && siridb_is_reindexing(siridb))                              \
     "shards which are dropped on replica servers)"
 #define MSG_SUCCES_SET_BACKUP_MODE \
     "Successfully %s backup mode on '%s'."
+#define MSG_SUCCESS_KILL_QUERY \
+    "Successfully killed query %" PRIu64 "."
 #define MSG_SUCCES_SET_TIMEZONE \
     "Successfully changed timezone from '%s' to '%s'."
 #define MSG_ERR_SERVER_ADDRESS \
@@ -188,9 +340,11 @@ static void enter_count_stmt(uv_async_t * handle);
 static void enter_create_stmt(uv_async_t * handle);
 static void enter_create_user(uv_async_t * handle);
 static void enter_drop_stmt(uv_async_t * handle);
+static void enter_explain_stmt(uv_async_t * handle);
 static void enter_grant_user(uv_async_t * handle);
 static void enter_group_match(uv_async_t * handle);
 static void enter_help(uv_async_t * handle);
+static void enter_join_expr(uv_async_t * handle);
 static void enter_limit_expr(uv_async_t * handle);
 static void enter_list_stmt(uv_async_t * handle);
 static void enter_merge_as(uv_async_t * handle);
@@ -200,11 +354,13 @@ static void enter_set_expression(uv_async_t * handle);
 static void enter_set_ignore_threshold(uv_async_t * handle);
 static void enter_set_name(uv_async_t * handle);
 static void enter_set_password(uv_async_t * handle);
+static void enter_series_after(uv_async_t * handle);
 static void enter_series_name(uv_async_t * handle);
 static void enter_series_match(uv_async_t * handle);
 static void enter_series_re(uv_async_t * handle);
 static void enter_series_sep(uv_async_t * handle);
 static void enter_timeit_stmt(uv_async_t * handle);
+static void enter_top_expr(uv_async_t * handle);
 static void enter_where_xxx(uv_async_t * handle);
 static void enter_xxx_columns(uv_async_t * handle);
 
@@ -225,6 +381,7 @@ static void exit_count_shards(uv_async_t * handle);
 static void exit_count_shards_size(uv_async_t * handle);
 static void exit_count_users(uv_async_t * handle);
 static void exit_create_group(uv_async_t * handle);
+static void exit_create_snapshot(uv_async_t * handle);
 static void exit_create_user(uv_async_t * handle);
 static void exit_drop_group(uv_async_t * handle);
 static void exit_drop_series(uv_async_t * handle);
@@ -233,8 +390,10 @@ static void exit_drop_shards(uv_async_t * handle);
 static void exit_drop_user(uv_async_t * handle);
 static void exit_grant_user(uv_async_t * handle);
 static void exit_help_xxx(uv_async_t * handle);
+static void exit_kill_stmt(uv_async_t * handle);
 static void exit_list_groups(uv_async_t * handle);
 static void exit_list_pools(uv_async_t * handle);
+static void exit_list_queries(uv_async_t * handle);
 static void exit_list_series(uv_async_t * handle);
 static void exit_list_servers(uv_async_t * handle);
 static void exit_list_shards(uv_async_t * handle);
@@ -245,6 +404,8 @@ static void exit_select_stmt(uv_async_t * handle);
 static void exit_set_address(uv_async_t * handle);
 static void exit_set_backup_mode(uv_async_t * handle);
 static void exit_set_drop_threshold(uv_async_t * handle);
+static void exit_set_expiration_log(uv_async_t * handle);
+static void exit_set_expiration_num(uv_async_t * handle);
 static void exit_set_list_limit(uv_async_t * handle);
 static void exit_set_log_level(uv_async_t * handle);
 static void exit_set_port(uv_async_t * handle);
@@ -272,14 +433,125 @@ static void on_alter_xxx_response(slist_t * promises, uv_async_t * handle);
 static void on_count_xxx_response(slist_t * promises, uv_async_t * handle);
 static void on_drop_series_response(slist_t * promises, uv_async_t * handle);
 static void on_drop_shards_response(slist_t * promises, uv_async_t * handle);
+static void on_explain_response(slist_t * promises, uv_async_t * handle);
 static void on_groups_response(slist_t * promises, uv_async_t * handle);
 static void on_list_xxx_response(slist_t * promises, uv_async_t * handle);
+static void on_list_series_response(slist_t * promises, uv_async_t * handle);
+static void on_list_series_promise(
+        sirinet_promise_t * promise,
+        uv_async_t * handle);
+static void on_list_series_done(slist_t * promises, uv_async_t * handle);
 static void on_select_response(slist_t * promises, uv_async_t * handle);
+static void on_select_promise(sirinet_promise_t * promise, uv_async_t * handle);
 static void on_update_xxx_response(slist_t * promises, uv_async_t * handle);
 
 /* helper functions */
+static int select_estimate(uv_async_t * handle);
+static int select_pack_cost(qp_packer_t * packer, siridb_series_cost_t * cost);
+static int master_select_cached(uv_async_t * handle);
+static int select_pack_points(
+        siridb_query_t * query,
+        siridb_points_t * points);
+static void select_aggregate_start(uv_async_t * handle);
+static void select_aggregate_work(uv_work_t * work);
+static void select_aggregate_work_finish(uv_work_t * work, int status);
+static void select_aggregate_done(uv_async_t * handle, select_job_t * job);
+static int select_parts_init(
+        select_job_t * job,
+        query_select_t * q_select,
+        size_t nworkers);
+static size_t select_parts_count(
+        query_select_t * q_select,
+        siridb_series_t * series,
+        size_t nworkers,
+        uint64_t * start,
+        uint64_t * width);
+static int select_part_work(
+        select_job_t * job,
+        siridb_t * siridb,
+        query_select_t * q_select,
+        size_t i,
+        uint64_t * aggregate,
+        char * err_msg);
+static siridb_points_t * select_parts_join(
+        select_part_t * first,
+        char * err_msg);
+static void select_job_result(
+        select_job_t * job,
+        siridb_t * siridb,
+        size_t i,
+        siridb_points_t * points);
+static int select_unpack_response(
+        siridb_query_t * query,
+        sirinet_promise_t * promise,
+        ct_t * result);
+static void select_response_done(uv_async_t * handle);
+static void select_job_free(select_job_t * job);
+static int select_over_budget(size_t mem);
+static siridb_points_t * select_spill(
+        query_select_t * q_select,
+        siridb_points_t * points,
+        char * err_msg);
+static siridb_points_t * select_unpack_new(
+        query_select_t * q_select,
+        siridb_arena_t * arena,
+        qp_obj_t * qp_tp,
+        qp_obj_t * qp_len,
+        qp_obj_t * qp_points);
+static void set_expiration(
+        uv_async_t * handle,
+        uint64_t * expiration,
+        const char * name);
+static int select_lock(
+        siridb_t * siridb,
+        siridb_series_t * series,
+        query_select_t * q_select);
+static void select_unlock(siridb_t * siridb, int exclusive);
+static void stage_end(siridb_query_t * query, uint64_t * stage);
+static slist_t * series_re_candidates(
+        siridb_t * siridb,
+        siridb_trigrams_ids_t * ids);
+static slist_t * series_re_cached(
+        siridb_t * siridb,
+        siridb_mcache_entry_t * entry);
+static int series_re_is_full(query_wrapper_t * q_wrapper);
+static int series_set_update(query_wrapper_t * q_wrapper);
+static int series_set_pop(uint32_t id, imap_t * series_map);
+static void list_series_after(siridb_t * siridb, query_list_t * q_list);
+static int list_series_after_cb(
+        siridb_series_t * series,
+        query_list_t * q_list);
+static int list_series_cmp(
+        siridb_series_t ** series_a,
+        siridb_series_t ** series_b);
+static ssize_t list_name_column(query_list_t * q_list);
+static int list_rows_add(
+        list_rows_t * rows,
+        qp_unpacker_t * unpacker,
+        size_t column);
+static int list_rows_cmp(const list_row_t * row_a, const list_row_t * row_b);
+static void list_rows_merge(
+        qp_packer_t * packer,
+        list_rows_t * rows,
+        size_t * runs,
+        size_t nruns,
+        size_t limit);
+static int select_add_points(
+        siridb_query_t * query,
+        siridb_series_t * series,
+        siridb_points_t * points);
+static void select_stream_init(siridb_query_t * query);
+static int select_stream_part(siridb_query_t * query);
+static void select_stream_next(uv_async_t * handle);
+static void select_stream_work(uv_work_t * work);
+static void select_stream_work_finish(uv_work_t * work, int status);
+static void select_stream_send(uv_async_t * async);
+static void select_stream_close(query_select_t * q_select);
+static void select_stream_free(uv_handle_t * handle);
 static void master_select_work(uv_work_t * handle);
 static void master_select_work_finish(uv_work_t * work, int status);
+static siri_sched_class_t select_sched_class(siridb_query_t * query);
+static siri_sched_limit_t * select_sched_limit(siridb_query_t * query);
 static int items_select_master(
         const char * name,
         size_t len,
@@ -290,6 +562,11 @@ static int items_select_master_merge(
         size_t len,
         slist_t * plist,
         uv_async_t * handle);
+static int items_select_stream(
+        const char * name,
+        size_t len,
+        void * data,
+        uv_async_t * handle);
 static int items_select_other(
         const char * name,
         size_t len,
@@ -300,9 +577,26 @@ static int items_select_other_merge(
         size_t len,
         slist_t * plist,
         uv_async_t * handle);
+static siridb_points_t * select_merge_variance(
+        slist_t * plist,
+        slist_t * partial,
+        siridb_aggr_t * aggr,
+        char * err_msg);
+static int items_select_other_partial(
+        const char * name,
+        size_t len,
+        slist_t * plist,
+        uv_async_t * handle);
+static siridb_points_t * select_merge_partial(
+        slist_t * plist,
+        slist_t * partial,
+        siridb_aggr_t * aggr,
+        char * err_msg);
 static void on_select_unpack_points(
         qp_unpacker_t * unpacker,
         query_select_t * q_select,
+        ct_t * result,
+        siridb_arena_t * arena,
         qp_obj_t * qp_name,
         qp_obj_t * qp_tp,
         qp_obj_t * qp_len,
@@ -311,11 +605,36 @@ static void on_select_unpack_points(
 static void on_select_unpack_merged_points(
         qp_unpacker_t * unpacker,
         query_select_t * q_select,
+        siridb_arena_t * arena,
         qp_obj_t * qp_name,
         qp_obj_t * qp_tp,
         qp_obj_t * qp_len,
         qp_obj_t * qp_points,
         uint32_t select_points_limit);
+static void on_select_unpack_partial(
+        qp_unpacker_t * unpacker,
+        query_select_t * q_select,
+        qp_obj_t * qp_name,
+        qp_obj_t * qp_tp,
+        qp_obj_t * qp_len,
+        qp_obj_t * qp_points);
+static int select_top(query_select_t * q_select);
+static int select_join(
+        query_select_t * q_select,
+        int is_master,
+        char * err_msg);
+static int items_select_top_score(
+        const char * name,
+        size_t len,
+        siridb_points_t * points,
+        select_top_t * top);
+static int items_select_top_keep(
+        const char * name,
+        size_t len,
+        siridb_points_t * points,
+        select_top_t * top);
+static void select_top_sift(select_top_t * top, size_t i);
+static int select_top_cmp(const void * a, const void * b);
 
 static int values_list_groups(siridb_group_t * group, uv_async_t * handle);
 static int values_count_groups(siridb_group_t * group, uv_async_t * handle);
@@ -346,18 +665,8 @@ if (query->nodes == NULL)                                                   \
 }                                                                           \
 else                                                                        \
 {                                                                           \
-    uv_close((uv_handle_t *) handle, (uv_close_cb) free);                   \
-    handle = (uv_async_t *) malloc(sizeof(uv_async_t));                     \
-    if (handle == NULL)                                                     \
-    {                                                                       \
-        ERR_ALLOC                                                           \
-    }                                                                       \
-    else                                                                    \
-    {                                                                       \
-        handle->data = query;                                               \
-        uv_async_init(siri.loop, handle, (uv_async_cb) query->nodes->cb);   \
-        uv_async_send(handle);                                              \
-    }                                                                       \
+    /* yields when the query_step_budget is used */                         \
+    siridb_query_next_node(handle);                                         \
 }
 
 #define SIRIPARSER_NEXT_NODE            \
@@ -405,10 +714,12 @@ void siriparser_init_listener(void)
     siriparser_listen_enter[CLERI_GID_CREATE_STMT] = enter_create_stmt;
     siriparser_listen_enter[CLERI_GID_CREATE_USER] = enter_create_user;
     siriparser_listen_enter[CLERI_GID_DROP_STMT] = enter_drop_stmt;
+    siriparser_listen_enter[CLERI_GID_EXPLAIN_STMT] = enter_explain_stmt;
     siriparser_listen_enter[CLERI_GID_GRANT_USER] = enter_grant_user;
     siriparser_listen_enter[CLERI_GID_GROUP_COLUMNS] = enter_xxx_columns;
     siriparser_listen_enter[CLERI_GID_GROUP_MATCH] = enter_group_match;
     siriparser_listen_enter[CLERI_GID_HELP] = enter_help;
+    siriparser_listen_enter[CLERI_GID_JOIN_EXPR] = enter_join_expr;
     siriparser_listen_enter[CLERI_GID_LIMIT_EXPR] = enter_limit_expr;
     siriparser_listen_enter[CLERI_GID_LIST_STMT] = enter_list_stmt;
     siriparser_listen_enter[CLERI_GID_MERGE_AS] = enter_merge_as;
@@ -419,6 +730,7 @@ void siriparser_init_listener(void)
     siriparser_listen_enter[CLERI_GID_SET_IGNORE_THRESHOLD] = enter_set_ignore_threshold;
     siriparser_listen_enter[CLERI_GID_SET_NAME] = enter_set_name;
     siriparser_listen_enter[CLERI_GID_SET_PASSWORD] = enter_set_password;
+    siriparser_listen_enter[CLERI_GID_SERIES_AFTER] = enter_series_after;
     siriparser_listen_enter[CLERI_GID_SERIES_COLUMNS] = enter_xxx_columns;
     siriparser_listen_enter[CLERI_GID_SERVER_COLUMNS] = enter_xxx_columns;
     siriparser_listen_enter[CLERI_GID_SERIES_NAME] = enter_series_name;
@@ -427,6 +739,7 @@ void siriparser_init_listener(void)
     siriparser_listen_enter[CLERI_GID_SERIES_SEP] = enter_series_sep;
     siriparser_listen_enter[CLERI_GID_SHARD_COLUMNS] = enter_xxx_columns;
     siriparser_listen_enter[CLERI_GID_TIMEIT_STMT] = enter_timeit_stmt;
+    siriparser_listen_enter[CLERI_GID_TOP_EXPR] = enter_top_expr;
     siriparser_listen_enter[CLERI_GID_USER_COLUMNS] = enter_xxx_columns;
     siriparser_listen_enter[CLERI_GID_WHERE_GROUP] = enter_where_xxx;
     siriparser_listen_enter[CLERI_GID_WHERE_POOL] = enter_where_xxx;
@@ -453,6 +766,7 @@ void siriparser_init_listener(void)
     siriparser_listen_exit[CLERI_GID_COUNT_SHARDS_SIZE] = exit_count_shards_size;
     siriparser_listen_exit[CLERI_GID_COUNT_USERS] = exit_count_users;
     siriparser_listen_exit[CLERI_GID_CREATE_GROUP] = exit_create_group;
+    siriparser_listen_exit[CLERI_GID_CREATE_SNAPSHOT] = exit_create_snapshot;
     siriparser_listen_exit[CLERI_GID_CREATE_USER] = exit_create_user;
     siriparser_listen_exit[CLERI_GID_DROP_GROUP] = exit_drop_group;
     siriparser_listen_exit[CLERI_GID_DROP_SERIES] = exit_drop_series;
@@ -460,8 +774,10 @@ void siriparser_init_listener(void)
     siriparser_listen_exit[CLERI_GID_DROP_SHARDS] = exit_drop_shards;
     siriparser_listen_exit[CLERI_GID_DROP_USER] = exit_drop_user;
     siriparser_listen_exit[CLERI_GID_GRANT_USER] = exit_grant_user;
+    siriparser_listen_exit[CLERI_GID_KILL_STMT] = exit_kill_stmt;
     siriparser_listen_exit[CLERI_GID_LIST_GROUPS] = exit_list_groups;
     siriparser_listen_exit[CLERI_GID_LIST_POOLS] = exit_list_pools;
+    siriparser_listen_exit[CLERI_GID_LIST_QUERIES] = exit_list_queries;
     siriparser_listen_exit[CLERI_GID_LIST_SERIES] = exit_list_series;
     siriparser_listen_exit[CLERI_GID_LIST_SERVERS] = exit_list_servers;
     siriparser_listen_exit[CLERI_GID_LIST_SHARDS] = exit_list_shards;
@@ -472,6 +788,8 @@ void siriparser_init_listener(void)
     siriparser_listen_exit[CLERI_GID_SET_ADDRESS] = exit_set_address;
     siriparser_listen_exit[CLERI_GID_SET_BACKUP_MODE] = exit_set_backup_mode;
     siriparser_listen_exit[CLERI_GID_SET_DROP_THRESHOLD] = exit_set_drop_threshold;
+    siriparser_listen_exit[CLERI_GID_SET_EXPIRATION_LOG] = exit_set_expiration_log;
+    siriparser_listen_exit[CLERI_GID_SET_EXPIRATION_NUM] = exit_set_expiration_num;
     siriparser_listen_exit[CLERI_GID_SET_LIST_LIMIT] = exit_set_list_limit;
     siriparser_listen_exit[CLERI_GID_SET_LOG_LEVEL] = exit_set_log_level;
     siriparser_listen_exit[CLERI_GID_SET_PORT] = exit_set_port;
@@ -726,6 +1044,16 @@ static void enter_drop_stmt(uv_async_t * handle)
     SIRIPARSER_NEXT_NODE
 }
 
+static void enter_explain_stmt(uv_async_t * handle)
+{
+    siridb_query_t * query = (siridb_query_t *) handle->data;
+
+    /* the select statement will only estimate the cost */
+    query->flags |= SIRIDB_QUERY_FLAG_EXPLAIN;
+
+    SIRIPARSER_NEXT_NODE
+}
+
 static void enter_grant_user(uv_async_t * handle)
 {
     siridb_query_t * query = (siridb_query_t *) handle->data;
@@ -796,6 +1124,38 @@ static void enter_group_match(uv_async_t * handle)
                 group_name);
         siridb_query_send_error(handle, CPROTO_ERR_QUERY);
     }
+    else if (   group->series->len >= SERIES_SET_MIN_SIZE && (
+                q_wrapper->update_cb == &imap_intersection_ref ||
+                q_wrapper->update_cb == &imap_difference_ref))
+    {
+        siridb_series_t * series;
+
+        /* the group is only used to filter the series map */
+        if ((q_wrapper->series_set = iset_new()) == NULL)
+        {
+            MEM_ERR_RET
+        }
+
+        uv_mutex_lock(&siridb->groups->mutex);
+
+        for (size_t i = 0; i < group->series->len; i++)
+        {
+            series = (siridb_series_t *) group->series->data[i];
+            if (iset_add(q_wrapper->series_set, series->id) < 0)
+            {
+                log_critical("Cannot add series to temporary set.");
+            }
+        }
+
+        uv_mutex_unlock(&siridb->groups->mutex);
+
+        if (series_set_update(q_wrapper))
+        {
+            MEM_ERR_RET
+        }
+
+        SIRIPARSER_ASYNC_NEXT_NODE
+    }
     else
     {
         siridb_series_t * series;
@@ -857,27 +1217,98 @@ static void enter_help(uv_async_t * handle)
     SIRIPARSER_ASYNC_NEXT_NODE
 }
 
+static void enter_join_expr(uv_async_t * handle)
+{
+    siridb_query_t * query = (siridb_query_t *) handle->data;
+    query_select_t * q_select = (query_select_t *) query->data;
+    cleri_children_t * children = query->nodes->node->children->next;
+    cleri_children_t * current;
+    cleri_node_t * node = children->next->next->node;
+    char * name;
+    size_t n = 0;
+
+    q_select->join_as = (char *) malloc(node->len - 1);
+    q_select->join = slist_new(SLIST_DEFAULT_SIZE);
+
+    if (q_select->join_as == NULL || q_select->join == NULL)
+    {
+        MEM_ERR_RET
+    }
+
+    strx_extract_string(q_select->join_as, node->str, node->len);
+
+    /* the list has a series name followed by an operator for each next one */
+    for (   current = children->node->children;
+            current != NULL;
+            current = current->next->next)
+    {
+        node = current->node;
+        name = (char *) malloc(node->len - 1);
+
+        if (name == NULL || slist_append_safe(&q_select->join, name))
+        {
+            free(name);
+            MEM_ERR_RET
+        }
+
+        strx_extract_string(name, node->str, node->len);
+
+        if (current->next == NULL)
+        {
+            break;
+        }
+        n++;
+    }
+
+    q_select->join_ops = (char *) malloc(n);
+
+    if (q_select->join_ops == NULL)
+    {
+        MEM_ERR_RET
+    }
+
+    for (   n = 0, current = children->node->children;
+            current->next != NULL;
+            current = current->next->next)
+    {
+        q_select->join_ops[n++] = *current->next->node->str;
+    }
+
+    SIRIPARSER_ASYNC_NEXT_NODE
+}
+
 static void enter_limit_expr(uv_async_t * handle)
 {
     siridb_query_t * query = (siridb_query_t *) handle->data;
     siridb_t * siridb = ((sirinet_socket_t *) query->client->data)->siridb;
-    query_list_t * qlist = (query_list_t *) query->data;
+    query_wrapper_t * q_wrapper = (query_wrapper_t *) query->data;
     int64_t limit = query->nodes->node->children->next->node->result;
 
-    if (limit <= 0 || limit > siridb->list_limit)
+    /* a select limit is the number of newest points for each series */
+    uint32_t max_limit = (q_wrapper->tp == QUERIES_SELECT) ?
+            siridb->select_points_limit : siridb->list_limit;
+
+    if (limit <= 0 || limit > max_limit)
     {
         snprintf(query->err_msg, SIRIDB_MAX_SIZE_ERR_MSG,
                 "Limit must be a value between 0 and %" PRIu32
                 " but received: %" PRId64
                 " (optionally the limit can be changed, "
                 "see 'help alter database')",
-                siridb->list_limit,
+                max_limit,
                 limit);
         siridb_query_send_error(handle, CPROTO_ERR_QUERY);
     }
     else
     {
-        qlist->limit = limit;
+        if (q_wrapper->tp == QUERIES_SELECT)
+        {
+            ((query_select_t *) q_wrapper)->limit = (size_t) limit;
+        }
+        else
+        {
+            ((query_list_t *) q_wrapper)->limit = limit;
+        }
         SIRIPARSER_NEXT_NODE
     }
 }
@@ -930,7 +1361,11 @@ static void enter_merge_as(uv_async_t * handle)
 
     strx_extract_string(q_select->merge_as, node->str, node->len);
 
-    if (IS_MASTER && query->nodes->node->children->next->next->next != NULL)
+    /*
+     * Other pools use the merge aggregation list for sending partial
+     * aggregates, see items_select_other_partial().
+     */
+    if (query->nodes->node->children->next->next->next != NULL)
     {
         q_select->mlist = siridb_aggregate_list(
                 query->nodes->node->children->next->next->next->node->
@@ -1033,6 +1468,13 @@ static void enter_select_stmt(uv_async_t * handle)
     }
 
     query->free_cb = (uv_close_cb) query_select_free;
+
+    /* points are moved to a temporary file when over the memory budget */
+    if (    (siri.cfg->query_memory_limit || siri.cfg->query_memory_total) &&
+            (q_select->spill = siridb_spill_new()) == NULL)
+    {
+        MEM_ERR_RET
+    }
     query->packer = sirinet_packer_new(QP_SUGGESTED_SIZE);
 
     if (query->packer == NULL)
@@ -1293,15 +1735,54 @@ static void enter_series_name(uv_async_t * handle)
     SIRIPARSER_ASYNC_NEXT_NODE
 }
 
+static void enter_series_after(uv_async_t * handle)
+{
+    siridb_query_t * query = (siridb_query_t *) handle->data;
+    query_list_t * q_list = (query_list_t *) query->data;
+    cleri_node_t * node = query->nodes->node->children->next->node;
+
+    q_list->after = (char *) malloc(node->len - 1);
+
+    if (q_list->after == NULL)
+    {
+        MEM_ERR_RET
+    }
+
+    strx_extract_string(q_list->after, node->str, node->len);
+
+    SIRIPARSER_NEXT_NODE
+}
+
 static void enter_series_match(uv_async_t * handle)
 {
     siridb_query_t * query = (siridb_query_t *) handle->data;
+    siridb_t * siridb = ((sirinet_socket_t *) query->client->data)->siridb;
+    query_wrapper_t * q_wrapper = (query_wrapper_t *) query->data;
 
-    if ((((query_wrapper_t *) query->data)->series_map = imap_new()) == NULL)
+    if ((q_wrapper->series_map = imap_new()) == NULL)
     {
         MEM_ERR_RET
     }
 
+    /*
+     * Like select, list and count queries on series names only need the
+     * pools owning the series. This is not critical since pmap is allowed
+     * to be NULL.
+     */
+    if (    IS_MASTER &&
+            q_wrapper->pmap == NULL &&
+            (   q_wrapper->tp == QUERIES_LIST ||
+                q_wrapper->tp == QUERIES_COUNT) &&
+            !siridb_is_reindexing(siridb))
+    {
+        q_wrapper->pmap = imap_new();
+    }
+
+    if (SIRIDB_QUERY_HAS_STATS(query))
+    {
+        query->stages.mark = timeit_ns();
+    }
+
     SIRIPARSER_NEXT_NODE
 }
 
@@ -1311,6 +1792,12 @@ static void enter_series_re(uv_async_t * handle)
     siridb_t * siridb = ((sirinet_socket_t *) query->client->data)->siridb;
     cleri_node_t * node = query->nodes->node;
     query_wrapper_t * q_wrapper = (query_wrapper_t *) query->data;
+    siridb_mcache_entry_t * entry = (siridb->mcache == NULL) ?
+            NULL : siridb_mcache_get(
+                    siridb->mcache,
+                    node->str,
+                    node->len,
+                    siridb->series_gen);
 
     /* we must send this query to all pools */
     if (q_wrapper->pmap != NULL)
@@ -1319,55 +1806,96 @@ static void enter_series_re(uv_async_t * handle)
         q_wrapper->pmap = NULL;
     }
 
-    /* extract and compile regular expression */
-    if (siridb_re_compile(
-            &q_wrapper->regex,
-            &q_wrapper->regex_extra,
+    if (entry != NULL)
+    {
+        /* the cached series all match so 're' is left NULL */
+        q_wrapper->slist = series_re_cached(siridb, entry);
+    }
+    /* get the compiled regular expression */
+    else if ((q_wrapper->re = siridb_re_get(
+            siri.re_cache,
             node->str,
             node->len,
-            query->err_msg))
+            query->err_msg)) == NULL)
     {
         siridb_query_send_error(handle, CPROTO_ERR_QUERY);
+        return;
     }
     else
     {
-        uv_mutex_lock(&siridb->series_mutex);
+        q_wrapper->series_gen = siridb->series_gen;
+
+        siri_rwlock_wrlock(&siridb->series_mutex);
 
-        q_wrapper->slist = imap_2slist_ref(
-                (   q_wrapper->update_cb == NULL ||
-                    q_wrapper->update_cb == &imap_union_ref ||
-                    q_wrapper->update_cb == &imap_symmetric_difference_ref) ?
-                        siridb->series_map : q_wrapper->series_map);
+        if (series_re_is_full(q_wrapper))
+        {
+            /* only series found by the name indexes can match */
+            q_wrapper->slist = siridb_tokens_match(
+                    siridb->tokens,
+                    node->str,
+                    node->len);
 
-        uv_mutex_unlock(&siridb->series_mutex);
+            if (q_wrapper->slist == NULL)
+            {
+                siridb_trigrams_ids_t * ids = siridb_trigrams_match(
+                        siridb->trigrams,
+                        node->str,
+                        node->len);
 
-        q_wrapper->series_tmp = (q_wrapper->update_cb == NULL) ?
-                q_wrapper->series_map : imap_new();
+                q_wrapper->slist = (ids == NULL) ?
+                        dmap_2slist_ref(siridb->series_map) :
+                        series_re_candidates(siridb, ids);
 
-        if (q_wrapper->slist == NULL || q_wrapper->series_tmp == NULL)
+                free(ids);
+            }
+        }
+        else
         {
-            MEM_ERR_RET
+            q_wrapper->slist = imap_2slist_ref(q_wrapper->series_map);
         }
 
-        uv_async_t * next =
-                (uv_async_t *) malloc(sizeof(uv_async_t));
+        siri_rwlock_wrunlock(&siridb->series_mutex);
+    }
 
-        if (next == NULL)
+    if (q_wrapper->slist == NULL)
+    {
+        MEM_ERR_RET
+    }
+
+    if (    q_wrapper->slist->len >= SERIES_SET_MIN_SIZE && (
+            q_wrapper->update_cb == &imap_intersection_ref ||
+            q_wrapper->update_cb == &imap_difference_ref))
+    {
+        /* matching series are only used to filter the series map */
+        if ((q_wrapper->series_set = iset_new()) == NULL)
         {
             MEM_ERR_RET
         }
+    }
+    else if ((q_wrapper->series_tmp = (q_wrapper->update_cb == NULL) ?
+            q_wrapper->series_map : imap_new()) == NULL)
+    {
+        MEM_ERR_RET
+    }
 
-        next->data = handle->data;
-
-        uv_async_init(
-                siri.loop,
-                next,
-                (uv_async_cb) async_series_re);
-        uv_async_send(next);
+    uv_async_t * next =
+            (uv_async_t *) malloc(sizeof(uv_async_t));
 
-        uv_close((uv_handle_t *) handle, (uv_close_cb) free);
+    if (next == NULL)
+    {
+        MEM_ERR_RET
     }
 
+    next->data = handle->data;
+
+    uv_async_init(
+            siri.loop,
+            next,
+            (uv_async_cb) async_series_re);
+    uv_async_send(next);
+
+    uv_close((uv_handle_t *) handle, (uv_close_cb) free);
+
     /* handle is handled or a signal is raised */
 }
 
@@ -1414,6 +1942,35 @@ static void enter_timeit_stmt(uv_async_t * handle)
     SIRIPARSER_NEXT_NODE
 }
 
+static void enter_top_expr(uv_async_t * handle)
+{
+    siridb_query_t * query = (siridb_query_t *) handle->data;
+    siridb_t * siridb = ((sirinet_socket_t *) query->client->data)->siridb;
+    query_select_t * q_select = (query_select_t *) query->data;
+    cleri_children_t * children = query->nodes->node->children;
+    cleri_node_t * node = children->next->node;
+    uint64_t top = strx_to_uint64(node->str, node->len);
+
+    if (top == 0 || top > siridb->list_limit)
+    {
+        snprintf(query->err_msg, SIRIDB_MAX_SIZE_ERR_MSG,
+                "Top and bottom must be a value between 1 and %" PRIu32
+                " but received: %" PRIu64
+                " (optionally the limit can be changed, "
+                "see 'help alter database')",
+                siridb->list_limit,
+                top);
+        siridb_query_send_error(handle, CPROTO_ERR_QUERY);
+    }
+    else
+    {
+        q_select->top = (size_t) top;
+        q_select->top_sign = (children->node->children->node->
+                cl_obj->gid == CLERI_GID_K_TOP) ? 1 : -1;
+        SIRIPARSER_NEXT_NODE
+    }
+}
+
 static void enter_where_xxx(uv_async_t * handle)
 {
     siridb_query_t * query = (siridb_query_t *) handle->data;
@@ -1633,6 +2190,7 @@ static void exit_count_groups(uv_async_t * handle)
                     pkg,
                     0,
                     (sirinet_promises_cb) on_groups_response,
+                    NULL,
                     handle,
                     0);
         }
@@ -1699,11 +2257,17 @@ static void exit_count_series(uv_async_t * handle)
         q_count->n = (q_count->series_map == NULL) ?
                 siridb->series_map->len : q_count->series_map->len;
 
-        if (IS_MASTER)
+        if (IS_MASTER && NEED_POOLS(q_count) && (
+                q_count->series_map != NULL ||
+                q_count->pmap != NULL ||
+                siridb_servers_cached_count(
+                        siridb,
+                        SIRIDB_SERVER_COUNT_SERIES,
+                        &q_count->n)))
         {
             siridb_query_forward(
                     handle,
-                    SIRIDB_QUERY_FWD_POOLS,
+                    FWD_POOLS(q_count),
                     (sirinet_promises_cb) on_count_xxx_response,
                     0);
         }
@@ -1716,13 +2280,13 @@ static void exit_count_series(uv_async_t * handle)
     }
     else
     {
-        uv_mutex_lock(&siridb->series_mutex);
+        siri_rwlock_wrlock(&siridb->series_mutex);
 
-        q_count->slist = imap_2slist_ref(
-                (q_count->series_map == NULL) ?
-                        siridb->series_map : q_count->series_map);
+        q_count->slist = (q_count->series_map == NULL) ?
+                siridb_series_candidates(siridb, q_count->where_expr) :
+                imap_2slist_ref(q_count->series_map);
 
-        uv_mutex_unlock(&siridb->series_mutex);
+        siri_rwlock_wrunlock(&siridb->series_mutex);
 
         if (q_count->slist == NULL)
         {
@@ -1760,12 +2324,13 @@ static void exit_count_series_length(uv_async_t * handle)
 
     if (q_count->where_expr == NULL)
     {
-        uv_mutex_lock(&siridb->series_mutex);
+        siri_rwlock_wrlock(&siridb->series_mutex);
 
-        slist_t * slist = imap_2slist((q_count->series_map == NULL) ?
-                siridb->series_map : q_count->series_map);
+        slist_t * slist = (q_count->series_map == NULL) ?
+                dmap_2slist(siridb->series_map) :
+                imap_2slist(q_count->series_map);
 
-        uv_mutex_unlock(&siridb->series_mutex);
+        siri_rwlock_wrunlock(&siridb->series_mutex);
 
         if (slist == NULL)
         {
@@ -1782,11 +2347,11 @@ static void exit_count_series_length(uv_async_t * handle)
 
         slist_free(slist);
 
-        if (IS_MASTER)
+        if (IS_MASTER && NEED_POOLS(q_count))
         {
             siridb_query_forward(
                     handle,
-                    SIRIDB_QUERY_FWD_POOLS,
+                    FWD_POOLS(q_count),
                     (sirinet_promises_cb) on_count_xxx_response,
                     0);
         }
@@ -1799,13 +2364,13 @@ static void exit_count_series_length(uv_async_t * handle)
     }
     else
     {
-        uv_mutex_lock(&siridb->series_mutex);
+        siri_rwlock_wrlock(&siridb->series_mutex);
 
-        q_count->slist = imap_2slist_ref(
-                (q_count->series_map == NULL) ?
-                        siridb->series_map : q_count->series_map);
+        q_count->slist = (q_count->series_map == NULL) ?
+                siridb_series_candidates(siridb, q_count->where_expr) :
+                imap_2slist_ref(q_count->series_map);
 
-        uv_mutex_unlock(&siridb->series_mutex);
+        siri_rwlock_wrunlock(&siridb->series_mutex);
 
         if (q_count->slist == NULL)
         {
@@ -1903,7 +2468,12 @@ static void exit_count_servers_received(uv_async_t * handle)
         q_count->n += siridb->received_points;
     }
 
-    if (IS_MASTER)
+    if (IS_MASTER && (
+            q_count->where_expr != NULL ||
+            siridb_servers_cached_count(
+                    siridb,
+                    SIRIDB_SERVER_COUNT_RECEIVED,
+                    &q_count->n)))
     {
         siridb_query_forward(
                 handle,
@@ -1934,7 +2504,12 @@ static void exit_count_servers_selected(uv_async_t * handle)
         q_count->n += siridb->selected_points;
     }
 
-    if (IS_MASTER)
+    if (IS_MASTER && (
+            q_count->where_expr != NULL ||
+            siridb_servers_cached_count(
+                    siridb,
+                    SIRIDB_SERVER_COUNT_SELECTED,
+                    &q_count->n)))
     {
         siridb_query_forward(
                 handle,
@@ -1963,16 +2538,15 @@ static void exit_count_shards(uv_async_t * handle)
     }
     else
     {
-        uint64_t duration;
         siridb_shard_view_t vshard = {
                 .server=siridb->server
         };
 
-        uv_mutex_lock(&siridb->shards_mutex);
+        siri_mutex_lock(&siridb->shards_mutex);
 
         slist_t * shards_list = imap_2slist_ref(siridb->shards);
 
-        uv_mutex_unlock(&siridb->shards_mutex);
+        siri_mutex_unlock(&siridb->shards_mutex);
 
         if (shards_list == NULL)
         {
@@ -1984,10 +2558,8 @@ static void exit_count_shards(uv_async_t * handle)
             vshard.shard = (siridb_shard_t *) shards_list->data[i];
 
             /* set start and end properties */
-            duration = (vshard.shard->tp == SIRIDB_SHARD_TP_NUMBER) ?
-                    siridb->duration_num : siridb->duration_log;
-            vshard.start = vshard.shard->id - vshard.shard->id % duration;
-            vshard.end = vshard.start + duration;
+            vshard.start = SIRIDB_SHARD_START(vshard.shard);
+            vshard.end = vshard.start + vshard.shard->duration;
 
             if (cexpr_run(
                     q_count->where_expr,
@@ -2003,7 +2575,12 @@ static void exit_count_shards(uv_async_t * handle)
         slist_free(shards_list);
     }
 
-    if (IS_MASTER)
+    if (IS_MASTER && (
+            q_count->where_expr != NULL ||
+            siridb_servers_cached_count(
+                    siridb,
+                    SIRIDB_SERVER_COUNT_SHARDS,
+                    &q_count->n)))
     {
         siridb_query_forward(
                 handle,
@@ -2023,7 +2600,6 @@ static void exit_count_shards_size(uv_async_t * handle)
     siridb_query_t * query = (siridb_query_t *) handle->data;
     siridb_t * siridb = ((sirinet_socket_t *) query->client->data)->siridb;
     query_count_t * q_count = (query_count_t *) query->data;
-    uint64_t duration;
 
     qp_add_raw(query->packer, "shards_size", 11);
 
@@ -2031,11 +2607,11 @@ static void exit_count_shards_size(uv_async_t * handle)
             .server=siridb->server
     };
 
-    uv_mutex_lock(&siridb->shards_mutex);
+    siri_mutex_lock(&siridb->shards_mutex);
 
     slist_t * shards_list = imap_2slist_ref(siridb->shards);
 
-    uv_mutex_unlock(&siridb->shards_mutex);
+    siri_mutex_unlock(&siridb->shards_mutex);
 
     if (shards_list == NULL)
     {
@@ -2047,10 +2623,8 @@ static void exit_count_shards_size(uv_async_t * handle)
         vshard.shard = (siridb_shard_t *) shards_list->data[i];
 
         /* set start and end properties */
-        duration = (vshard.shard->tp == SIRIDB_SHARD_TP_NUMBER) ?
-                siridb->duration_num : siridb->duration_log;
-        vshard.start = vshard.shard->id - vshard.shard->id % duration;
-        vshard.end = vshard.start + duration;
+        vshard.start = SIRIDB_SHARD_START(vshard.shard);
+        vshard.end = vshard.start + vshard.shard->duration;
 
         if (q_count->where_expr == NULL || cexpr_run(
                 q_count->where_expr,
@@ -2065,7 +2639,12 @@ static void exit_count_shards_size(uv_async_t * handle)
 
     slist_free(shards_list);
 
-    if (IS_MASTER)
+    if (IS_MASTER && (
+            q_count->where_expr != NULL ||
+            siridb_servers_cached_count(
+                    siridb,
+                    SIRIDB_SERVER_COUNT_SHARDS_SIZE,
+                    &q_count->n)))
     {
         siridb_query_forward(
                 handle,
@@ -2169,22 +2748,56 @@ static void exit_create_group(uv_async_t * handle)
     }
 }
 
-static void exit_create_user(uv_async_t * handle)
+static void exit_create_snapshot(uv_async_t * handle)
 {
     siridb_query_t * query = (siridb_query_t *) handle->data;
     siridb_t * siridb = ((sirinet_socket_t *) query->client->data)->siridb;
-    siridb_user_t * user = ((query_alter_t *) query->data)->via.user;
-    cleri_node_t * user_node =
-            query->nodes->node->children->next->node;
 
 #ifdef DEBUG
-    /* both name and packer should be NULL at this point */
-    assert(user->name == NULL);
-    assert(query->packer == NULL);
+    assert (query->packer == NULL);
 #endif
 
-    MASTER_CHECK_ACCESSIBLE(siridb)
-
+    /* a snapshot is made with the files of this server only */
+    if (siri_backup_snapshot(siridb, query->err_msg))
+    {
+        log_error("%s", query->err_msg);
+        siridb_query_send_error(handle, CPROTO_ERR_QUERY);
+        return;
+    }
+
+    query->packer = sirinet_packer_new(1024);
+    if (query->packer == NULL)
+    {
+        MEM_ERR_RET
+    }
+
+    qp_add_type(query->packer, QP_MAP_OPEN);
+
+    QP_ADD_SUCCESS
+    qp_add_fmt_safe(
+            query->packer,
+            MSG_SUCCESS_CREATE_SNAPSHOT,
+            siridb->server->name);
+
+    SIRIPARSER_ASYNC_NEXT_NODE
+}
+
+static void exit_create_user(uv_async_t * handle)
+{
+    siridb_query_t * query = (siridb_query_t *) handle->data;
+    siridb_t * siridb = ((sirinet_socket_t *) query->client->data)->siridb;
+    siridb_user_t * user = ((query_alter_t *) query->data)->via.user;
+    cleri_node_t * user_node =
+            query->nodes->node->children->next->node;
+
+#ifdef DEBUG
+    /* both name and packer should be NULL at this point */
+    assert(user->name == NULL);
+    assert(query->packer == NULL);
+#endif
+
+    MASTER_CHECK_ACCESSIBLE(siridb)
+
     char name[user_node->len - 1];
     strx_extract_string(name, user_node->str, user_node->len);
 
@@ -2288,13 +2901,13 @@ static void exit_drop_series(uv_async_t * handle)
      * We transform or copy the references from imap to slist because we need
      * this list for both filtering or performing the actual drop.
      */
-    uv_mutex_lock(&siridb->series_mutex);
+    siri_rwlock_wrlock(&siridb->series_mutex);
 
     q_drop->slist = (q_drop->series_map == NULL) ?
-        imap_2slist_ref(siridb->series_map) :
+        siridb_series_candidates(siridb, q_drop->where_expr) :
         imap_slist_pop(q_drop->series_map);
 
-    uv_mutex_unlock(&siridb->series_mutex);
+    siri_rwlock_wrunlock(&siridb->series_mutex);
 
     if (q_drop->slist == NULL)
     {
@@ -2464,11 +3077,11 @@ static void exit_drop_shards(uv_async_t * handle)
 
     MASTER_CHECK_ACCESSIBLE(siridb)
 
-    uv_mutex_lock(&siridb->shards_mutex);
+    siri_mutex_lock(&siridb->shards_mutex);
 
     q_drop->shards_list = imap_2slist_ref(siridb->shards);
 
-    uv_mutex_unlock(&siridb->shards_mutex);
+    siri_mutex_unlock(&siridb->shards_mutex);
 
     if (q_drop->shards_list == NULL)
     {
@@ -2477,7 +3090,6 @@ static void exit_drop_shards(uv_async_t * handle)
 
     if (q_drop->where_expr != NULL)
     {
-        uint64_t duration;
         siridb_shard_view_t vshard = {
                 .server=siridb->server
         };
@@ -2489,11 +3101,8 @@ static void exit_drop_shards(uv_async_t * handle)
             vshard.shard = (siridb_shard_t *) q_drop->shards_list->data[i];
 
             /* set start and end properties */
-            duration = (vshard.shard->tp == SIRIDB_SHARD_TP_NUMBER) ?
-                    siridb->duration_num : siridb->duration_log;
-
-            vshard.start = vshard.shard->id - vshard.shard->id % duration;
-            vshard.end = vshard.start + duration;
+            vshard.start = SIRIDB_SHARD_START(vshard.shard);
+            vshard.end = vshard.start + vshard.shard->duration;
 
             if (!cexpr_run(
                     q_drop->where_expr,
@@ -2678,6 +3287,62 @@ static void exit_help_xxx(uv_async_t * handle)
     SIRIPARSER_ASYNC_NEXT_NODE
 }
 
+static void exit_kill_stmt(uv_async_t * handle)
+{
+    siridb_query_t * query = (siridb_query_t *) handle->data;
+    siridb_t * siridb = ((sirinet_socket_t *) query->client->data)->siridb;
+    siridb_user_t * user = (siridb_user_t *)
+            ((sirinet_socket_t *) query->client->data)->origin;
+    cleri_node_t * node = query->nodes->node->children->next->next->node;
+    uint64_t id = strx_to_uint64(node->str, node->len);
+    siridb_query_t * target = (siridb_query_t *) imap_get(siridb->queries, id);
+
+    /* only queries from clients can be killed, not forwarded queries */
+    if (    target == NULL ||
+            target == query ||
+            (~target->flags & SIRIDB_QUERY_FLAG_MASTER))
+    {
+        snprintf(query->err_msg,
+                SIRIDB_MAX_SIZE_ERR_MSG,
+                "Cannot find query: %" PRIu64,
+                id);
+        siridb_query_send_error(handle, CPROTO_ERR_QUERY);
+        return;
+    }
+
+    /* users can kill their own queries, others require 'drop' access */
+    if (    ((sirinet_socket_t *) target->client->data)->origin != user &&
+            !siridb_user_check_access(
+                    user,
+                    SIRIDB_ACCESS_DROP,
+                    query->err_msg))
+    {
+        siridb_query_send_error(handle, CPROTO_ERR_USER_ACCESS);
+        return;
+    }
+
+    siridb_query_kill(target);
+
+#ifdef DEBUG
+    assert (query->packer == NULL);
+#endif
+
+    query->packer = sirinet_packer_new(1024);
+
+    if (query->packer == NULL)
+    {
+        MEM_ERR_RET
+    }
+
+    qp_add_type(query->packer, QP_MAP_OPEN);
+
+    QP_ADD_SUCCESS
+    log_info(MSG_SUCCESS_KILL_QUERY, id);
+    qp_add_fmt_safe(query->packer, MSG_SUCCESS_KILL_QUERY, id);
+
+    SIRIPARSER_NEXT_NODE
+}
+
 static void exit_list_groups(uv_async_t * handle)
 {
     siridb_query_t * query = (siridb_query_t *) handle->data;
@@ -2728,6 +3393,7 @@ static void exit_list_groups(uv_async_t * handle)
                     pkg,
                     0,
                     (sirinet_promises_cb) on_groups_response,
+                    NULL,
                     handle,
                     0);
         }
@@ -2815,12 +3481,72 @@ static void exit_list_pools(uv_async_t * handle)
     }
 }
 
+static void exit_list_queries(uv_async_t * handle)
+{
+    siridb_query_t * query = (siridb_query_t *) handle->data;
+    siridb_t * siridb = ((sirinet_socket_t *) query->client->data)->siridb;
+    query_list_t * q_list = (query_list_t *) query->data;
+    slist_t * queries = imap_slist(siridb->queries);
+    siridb_query_t * q;
+    siridb_user_t * user;
+    struct timespec now;
+
+    if (queries == NULL)
+    {
+        MEM_ERR_RET
+    }
+
+    clock_gettime(CLOCK_REALTIME, &now);
+
+    qp_add_raw(query->packer, "id", 2);
+    qp_add_raw(query->packer, "user", 4);
+    qp_add_raw(query->packer, "query", 5);
+    qp_add_raw(query->packer, "time", 4);
+    qp_add_type(query->packer, QP_ARRAY_CLOSE);
+
+    qp_add_raw(query->packer, "queries", 7);
+    qp_add_type(query->packer, QP_ARRAY_OPEN);
+
+    for (size_t i = 0; q_list->limit && i < queries->len; i++)
+    {
+        q = (siridb_query_t *) queries->data[i];
+
+        /* forwarded queries are listed by the server which received them */
+        if (~q->flags & SIRIDB_QUERY_FLAG_MASTER)
+        {
+            continue;
+        }
+
+        user = (siridb_user_t *)
+                ((sirinet_socket_t *) q->client->data)->origin;
+
+        qp_add_type(query->packer, QP_ARRAY_OPEN);
+        qp_add_int64(query->packer, (int64_t) q->id);
+        qp_add_string(query->packer, user->name);
+        qp_add_string(
+                query->packer,
+                (strstr(q->q, "password") == NULL) ? q->q : "<hidden>");
+        qp_add_double(query->packer,
+                (double) (now.tv_sec - q->start.tv_sec) +
+                (double) (now.tv_nsec - q->start.tv_nsec) / 1000000000.0f);
+        qp_add_type(query->packer, QP_ARRAY_CLOSE);
+
+        q_list->limit--;
+    }
+
+    qp_add_type(query->packer, QP_ARRAY_CLOSE);
+
+    SIRIPARSER_NEXT_NODE
+}
+
 static void exit_list_series(uv_async_t * handle)
 {
     siridb_query_t * query = (siridb_query_t *) handle->data;
     query_list_t * q_list = (query_list_t *) query->data;
     siridb_t * siridb = ((sirinet_socket_t *) query->client->data)->siridb;
 
+    stage_end(query, &query->stages.match);
+
     if (q_list->props == NULL)
     {
         q_list->props = slist_new(1);
@@ -2834,17 +3560,37 @@ static void exit_list_series(uv_async_t * handle)
         qp_add_raw(query->packer, "name", 4);
     }
 
+    /* the master merges the pages of the pools by name */
+    if (q_list->after != NULL && list_name_column(q_list) < 0)
+    {
+        snprintf(query->err_msg,
+                SIRIDB_MAX_SIZE_ERR_MSG,
+                "Listing series after a name requires the 'name' column");
+        siridb_query_send_error(handle, CPROTO_ERR_QUERY);
+        return;
+    }
+
     qp_add_type(query->packer, QP_ARRAY_CLOSE);
 
     qp_add_raw(query->packer, "series", 6);
     qp_add_type(query->packer, QP_ARRAY_OPEN);
 
-    uv_mutex_lock(&siridb->series_mutex);
+    q_list->offset = query->packer->len;
+
+    siri_rwlock_wrlock(&siridb->series_mutex);
 
-    q_list->slist = imap_2slist_ref((q_list->series_map == NULL) ?
-                    siridb->series_map : q_list->series_map);
+    if (q_list->after != NULL)
+    {
+        list_series_after(siridb, q_list);
+    }
+    else
+    {
+        q_list->slist = (q_list->series_map == NULL) ?
+                siridb_series_candidates(siridb, q_list->where_expr) :
+                imap_2slist_ref(q_list->series_map);
+    }
 
-    uv_mutex_unlock(&siridb->series_mutex);
+    siri_rwlock_wrunlock(&siridb->series_mutex);
 
     if (q_list->slist == NULL)
     {
@@ -2958,17 +3704,16 @@ static void exit_list_shards(uv_async_t * handle)
     siridb_t * siridb = ((sirinet_socket_t *) query->client->data)->siridb;
     query_list_t * q_list = (query_list_t *) query->data;
     uint_fast16_t prop;
-    uint64_t duration;
     cexpr_t * where_expr = q_list->where_expr;
     siridb_shard_view_t vshard = {
             .server=siridb->server
     };
 
-    uv_mutex_lock(&siridb->shards_mutex);
+    siri_mutex_lock(&siridb->shards_mutex);
 
     slist_t * shards_list = imap_2slist_ref(siridb->shards);
 
-    uv_mutex_unlock(&siridb->shards_mutex);
+    siri_mutex_unlock(&siridb->shards_mutex);
 
     if (shards_list == NULL)
     {
@@ -3006,10 +3751,8 @@ static void exit_list_shards(uv_async_t * handle)
         vshard.shard = (siridb_shard_t *) shards_list->data[i];
 
         /* set start and end properties */
-        duration = (vshard.shard->tp == SIRIDB_SHARD_TP_NUMBER) ?
-                siridb->duration_num : siridb->duration_log;
-        vshard.start = vshard.shard->id - vshard.shard->id % duration;
-        vshard.end = vshard.start + duration;
+        vshard.start = SIRIDB_SHARD_START(vshard.shard);
+        vshard.end = vshard.start + vshard.shard->duration;
 
         if (q_list->limit && (where_expr == NULL || cexpr_run(
                 where_expr,
@@ -3236,6 +3979,8 @@ static void exit_select_aggregate(uv_async_t * handle)
     }
     else
     {
+        stage_end(query, &query->stages.match);
+
         q_select->nselects--;
 
         if (!siridb_presuf_is_unique(q_select->presuf))
@@ -3285,6 +4030,29 @@ static void exit_select_aggregate(uv_async_t * handle)
                     MEM_ERR_RET
                 }
 
+                query->stages.series = q_select->slist->len;
+
+                if (select_estimate(handle))
+                {
+                    return;  /* explained or rejected */
+                }
+
+                if (master_select_cached(handle))
+                {
+                    return;  /* the result is sent */
+                }
+
+                /*
+                 * Without a points cache the series are read and aggregated
+                 * by worker threads. The cache is used when having multiple
+                 * select methods and requires series to be read in order.
+                 */
+                if (q_select->points_map == NULL)
+                {
+                    select_aggregate_start(handle);
+                    return;
+                }
+
                 uv_async_t * next =
                         (uv_async_t *) malloc(sizeof(uv_async_t));
 
@@ -3316,17 +4084,63 @@ static void exit_select_stmt(uv_async_t * handle)
     siridb_query_t * query = (siridb_query_t *) handle->data;
     query_select_t * q_select = (query_select_t *) query->data;
 
-    if (IS_MASTER)
+    if (query->flags & SIRIDB_QUERY_FLAG_EXPLAIN)
     {
-        if (q_select->pmap == NULL || q_select->pmap->len)
+        if (IS_MASTER && NEED_POOLS(q_select))
         {
-            /* we have not reached the limit, send the query to other pools */
             siridb_query_forward(
                     handle,
-                    (q_select->pmap == NULL) ?
-                            SIRIDB_QUERY_FWD_POOLS :
-                            SIRIDB_QUERY_FWD_SOME_POOLS,
+                    FWD_POOLS(q_select),
+                    (sirinet_promises_cb) on_explain_response,
+                    0);
+        }
+        else if (select_pack_cost(query->packer, &q_select->cost))
+        {
+            MEM_ERR_RET
+        }
+        else
+        {
+            SIRIPARSER_ASYNC_NEXT_NODE
+        }
+    }
+    else if (IS_MASTER)
+    {
+        if (NEED_POOLS(q_select))
+        {
+            /* not critical, without a stream the result is sent at once */
+            select_stream_init(query);
+
+            /*
+             * The local series are complete so they can be streamed while
+             * waiting for the other pools.
+             */
+            if (SELECT_STREAM_EARLY(q_select))
+            {
+                ct_t * result = ct_new();
+
+                if (    result == NULL ||
+                        slist_append_safe(
+                                &q_select->stream->ready,
+                                q_select->result))
+                {
+                    if (result != NULL)
+                    {
+                        ct_free(result, NULL);
+                    }
+                    select_stream_close(q_select);
+                    MEM_ERR_RET
+                }
+
+                q_select->result = result;
+                select_stream_next(handle);
+            }
+
+            /* we have not reached the limit, send the query to other pools */
+            siridb_query_forward_each(
+                    handle,
+                    FWD_POOLS(q_select),
                     (sirinet_promises_cb) on_select_response,
+                    (sirinet_promises_each_cb) on_select_promise,
                     0);
         }
         else
@@ -3357,10 +4171,14 @@ static void exit_select_stmt(uv_async_t * handle)
                             (uv_async_cb) siridb_send_query_result :
                             (uv_async_cb) query->nodes->cb);
 
+            /* not critical, without a stream the result is sent at once */
+            select_stream_init(query);
+
             siri_async_incref(handle);
             work->data = handle;
-            uv_queue_work(
-                        siri.loop,
+            siri_sched_queue(
+                        select_sched_class(query),
+                        select_sched_limit(query),
                         work,
                         &master_select_work,
                         &master_select_work_finish);
@@ -3368,7 +4186,18 @@ static void exit_select_stmt(uv_async_t * handle)
     }
     else
     {
-        if (    qp_add_raw(query->packer, "select", 6) ||
+        query->stages.mark = timeit_ns();
+
+        if (    q_select->join != NULL &&
+                select_join(q_select, 0, query->err_msg))
+        {
+            siridb_query_send_error(handle, CPROTO_ERR_QUERY);
+            return;
+        }
+
+        /* only the best series of this pool are sent to the master */
+        if (    (q_select->top && select_top(q_select)) ||
+                qp_add_raw(query->packer, "select", 6) ||
                 qp_add_type(query->packer, QP_MAP_OPEN) ||
                 ct_items(
                         q_select->result,
@@ -3383,6 +4212,7 @@ static void exit_select_stmt(uv_async_t * handle)
         }
         else
         {
+            stage_end(query, &query->stages.pack);
             SIRIPARSER_ASYNC_NEXT_NODE
         }
     }
@@ -3594,6 +4424,22 @@ static void exit_set_drop_threshold(uv_async_t * handle)
     }
 }
 
+static void exit_set_expiration_log(uv_async_t * handle)
+{
+    siridb_query_t * query = (siridb_query_t *) handle->data;
+    siridb_t * siridb = ((sirinet_socket_t *) query->client->data)->siridb;
+
+    set_expiration(handle, &siridb->expiration_log, "expiration_log");
+}
+
+static void exit_set_expiration_num(uv_async_t * handle)
+{
+    siridb_query_t * query = (siridb_query_t *) handle->data;
+    siridb_t * siridb = ((sirinet_socket_t *) query->client->data)->siridb;
+
+    set_expiration(handle, &siridb->expiration_num, "expiration_num");
+}
+
 static void exit_set_list_limit(uv_async_t * handle)
 {
     siridb_query_t * query = (siridb_query_t *) handle->data;
@@ -4056,19 +4902,63 @@ static void exit_show_stmt(uv_async_t * handle)
 static void exit_timeit_stmt(uv_async_t * handle)
 {
     siridb_query_t * query = (siridb_query_t *) handle->data;
+    siridb_query_stages_t * stages = &query->stages;
     struct timespec end;
     char * name =
             ((sirinet_socket_t *) query->client->data)->siridb->server->name;
     clock_gettime(CLOCK_REALTIME, &end);
 
-    qp_add_type(query->timeit, QP_MAP2);
+    qp_add_type(query->timeit, QP_MAP_OPEN);
     qp_add_raw(query->timeit, "server", 6);
     qp_add_string(query->timeit, name);
+    qp_add_raw(query->timeit, "trace", 5);
+    qp_add_int64(query->timeit, (int64_t) query->trace_id);
     qp_add_raw(query->timeit, "time", 4);
     qp_add_double(query->timeit,
             (double) (end.tv_sec - query->start.tv_sec) +
             (double) (end.tv_nsec - query->start.tv_nsec) / 1000000000.0f);
 
+    /* stage times are in seconds, aggregate and shard stages are summed over
+     * the select threads */
+    qp_add_raw(query->timeit, "stages", 6);
+    qp_add_type(query->timeit, QP_MAP_OPEN);
+    qp_add_raw(query->timeit, "parse", 5);
+    qp_add_double(query->timeit, (double) stages->parse / 1e9);
+    qp_add_raw(query->timeit, "match", 5);
+    qp_add_double(query->timeit, (double) stages->match / 1e9);
+    qp_add_raw(query->timeit, "io", 2);
+    qp_add_double(query->timeit, (double) stages->shards.io / 1e9);
+    qp_add_raw(query->timeit, "decode", 6);
+    qp_add_double(query->timeit, (double) stages->shards.decode / 1e9);
+    qp_add_raw(query->timeit, "aggregate", 9);
+    qp_add_double(query->timeit, (double) stages->aggregate / 1e9);
+    qp_add_raw(query->timeit, "merge", 5);
+    qp_add_double(query->timeit, (double) stages->merge / 1e9);
+    qp_add_raw(query->timeit, "pack", 4);
+    qp_add_double(query->timeit, (double) stages->pack / 1e9);
+    qp_add_raw(query->timeit, "wait", 4);
+    qp_add_double(query->timeit, (double) stages->wait / 1e9);
+    qp_add_raw(query->timeit, "chunks", 6);
+    qp_add_int64(query->timeit, (int64_t) stages->shards.chunks);
+    qp_add_raw(query->timeit, "bytes", 5);
+    qp_add_int64(query->timeit, (int64_t) stages->shards.bytes);
+    qp_add_raw(query->timeit, "points", 6);
+    qp_add_int64(query->timeit, (int64_t) stages->shards.points);
+    qp_add_raw(query->timeit, "shards", 6);
+    qp_add_int64(query->timeit, (int64_t) stages->shards.shards);
+    qp_add_type(query->timeit, QP_MAP_CLOSE);
+
+    /* time in seconds until each server has responded, the timeit of the
+     * server with the same trace id shows where the time is spent */
+    qp_add_raw(query->timeit, "remote", 6);
+    qp_add_type(query->timeit, QP_ARRAY_OPEN);
+    if (query->waits != NULL)
+    {
+        qp_packer_extend(query->timeit, query->waits);
+    }
+    qp_add_type(query->timeit, QP_ARRAY_CLOSE);
+    qp_add_type(query->timeit, QP_MAP_CLOSE);
+
     if (query->packer == NULL)
     {
         /* lets give the new packer the exact size so we do not
@@ -4128,11 +5018,11 @@ static void async_count_series(uv_async_t * handle)
     {
         uv_async_send(handle);
     }
-    else if (IS_MASTER)
+    else if (IS_MASTER && NEED_POOLS(q_count))
     {
         siridb_query_forward(
                 handle,
-                SIRIDB_QUERY_FWD_POOLS,
+                FWD_POOLS(q_count),
                 (sirinet_promises_cb) on_count_xxx_response,
                 0);
     }
@@ -4181,11 +5071,11 @@ static void async_count_series_length(uv_async_t * handle)
     {
         uv_async_send(handle);
     }
-    else if (IS_MASTER)
+    else if (IS_MASTER && NEED_POOLS(q_count))
     {
         siridb_query_forward(
                 handle,
-                SIRIDB_QUERY_FWD_POOLS,
+                FWD_POOLS(q_count),
                 (sirinet_promises_cb) on_count_xxx_response,
                 0);
     }
@@ -4217,16 +5107,21 @@ static void async_drop_series(uv_async_t * handle)
         async_more = 1;
     }
 
-    uv_mutex_lock(&siridb->series_mutex);
+    siri_rwlock_wrlock(&siridb->series_mutex);
+
+    /* the series in this step are dropped at once */
+    siridb_series_drop_n(
+            siridb,
+            (siridb_series_t **) q_drop->slist->data + q_drop->slist_index,
+            index_end - q_drop->slist_index);
 
     for (; q_drop->slist_index < index_end; q_drop->slist_index++)
     {
         series = (siridb_series_t *) q_drop->slist->data[q_drop->slist_index];
-        siridb_series_drop(siridb, series);
         siridb_series_decref(series);
     }
 
-    uv_mutex_unlock(&siridb->series_mutex);
+    siri_rwlock_wrunlock(&siridb->series_mutex);
 
     /* flush dropped file change to disk */
     if (q_drop->slist->len)
@@ -4372,6 +5267,12 @@ static void async_list_series(uv_async_t * handle)
     size_t i;
     size_t index_end = q_list->slist_index + MAX_ITERATE_COUNT;
 
+    if (siridb_query_is_cancelled(query, query->err_msg))
+    {
+        siridb_query_send_error(handle, CPROTO_ERR_QUERY);
+        return;
+    }
+
     if (index_end >= q_list->slist->len)
     {
         index_end = q_list->slist->len;
@@ -4420,6 +5321,27 @@ static void async_list_series(uv_async_t * handle)
                 case CLERI_GID_K_END:
                     qp_add_int64(query->packer, series->end);
                     break;
+                case CLERI_GID_K_MIN:
+                case CLERI_GID_K_MAX:
+                case CLERI_GID_K_SUM:
+                    {
+                        qp_via_t * val = siridb_series_stat(
+                                series,
+                                *((uint32_t *) props->data[i]));
+                        if (val == NULL)
+                        {
+                            qp_add_null(query->packer);
+                        }
+                        else if (series->tp == TP_INT)
+                        {
+                            qp_add_int64(query->packer, val->int64);
+                        }
+                        else
+                        {
+                            qp_add_double(query->packer, val->real);
+                        }
+                    }
+                    break;
                 }
             }
 
@@ -4433,13 +5355,27 @@ static void async_list_series(uv_async_t * handle)
     {
         uv_async_send(handle);
     }
-    else if (IS_MASTER && q_list->limit)
+    else if (IS_MASTER && q_list->after != NULL && NEED_POOLS(q_list))
     {
-        /* we have not reached the limit, send the query to other pools */
+        /* other pools can have names before the last name of this pool */
         siridb_query_forward(
                 handle,
-                SIRIDB_QUERY_FWD_POOLS,
-                (sirinet_promises_cb) on_list_xxx_response,
+                FWD_POOLS(q_list),
+                (sirinet_promises_cb) on_list_series_response,
+                0);
+    }
+    else if (IS_MASTER && q_list->limit && NEED_POOLS(q_list))
+    {
+        /*
+         * We have not reached the limit, send the query to other pools. The
+         * rows are added as soon as a pool responds and the other pools are
+         * asked to stop when the limit is reached.
+         */
+        siridb_query_forward_each(
+                handle,
+                FWD_POOLS(q_list),
+                (sirinet_promises_cb) on_list_series_done,
+                (sirinet_promises_each_cb) on_list_series_promise,
                 0);
     }
     else
@@ -4458,7 +5394,8 @@ static void async_select_aggregate(uv_async_t * handle)
     uint8_t async_more = 0;
     siridb_series_t * series;
     siridb_points_t * points;
-    siridb_points_t * aggr_points;
+    uint64_t ns;
+    int exclusive;
 
     if (q_select->n > siridb->select_points_limit)
     {
@@ -4474,6 +5411,17 @@ static void async_select_aggregate(uv_async_t * handle)
         return;
     }
 
+    if (siridb_query_is_cancelled(query, query->err_msg))
+    {
+        siridb_query_send_error(handle, CPROTO_ERR_QUERY);
+        return;
+    }
+
+    if (SIRIDB_QUERY_HAS_STATS(query))
+    {
+        siridb_shard_stats = &query->stages.shards;
+    }
+
     series = (siridb_series_t *)
             q_select->slist->data[q_select->slist_index];
 
@@ -4502,19 +5450,27 @@ static void async_select_aggregate(uv_async_t * handle)
 
     if (points == NULL)
     {
-        uv_mutex_lock(&siridb->series_mutex);
+        exclusive = select_lock(siridb, series, q_select);
 
         points = (series->flags & SIRIDB_SERIES_IS_DROPPED) ?
-                NULL : siridb_series_get_points(
+                NULL : siridb_series_get_last(
+                        siridb,
                         series,
                         q_select->start_ts,
-                        q_select->end_ts);
-        uv_mutex_unlock(&siridb->series_mutex);
+                        q_select->end_ts,
+                        q_select->limit);
+        select_unlock(siridb, exclusive);
+
+        siridb_shard_stats = NULL;
 
         /* when having a cache and points, add a copy of points to the cache */
         if (q_select->points_map != NULL && points != NULL)
         {
-            siridb_points_t * cpoints = siridb_points_copy(points);
+            siridb_points_t * cpoints = (points->tp == TP_STRING) ?
+                    siridb_points_copy(points) :
+                    siridb_points_arena_copy(
+                            siridb_query_arena(query),
+                            points);
             if (cpoints != NULL &&
                 imap_add(q_select->points_map, series->id, cpoints))
             {
@@ -4523,85 +5479,43 @@ static void async_select_aggregate(uv_async_t * handle)
         }
     }
 
+    siridb_shard_stats = NULL;
+
     if (points != NULL)
     {
-        const char * name;
+        siridb_hot_add(
+                siridb->hot,
+                SIRIDB_HOT_SELECT,
+                series->id,
+                points->len);
+
+        ns = timeit_ns();
+        points = siridb_aggregate_run_list(
+                points,
+                q_select->alist,
+                0,
+                query->err_msg);
+        query->stages.aggregate += timeit_ns() - ns;
 
-        for (size_t i = 0; points->len && i < q_select->alist->len; i++)
+        if (points == NULL || select_add_points(query, series, points))
         {
-            aggr_points = siridb_aggregate_run(
-                    points,
-                    (siridb_aggr_t *) q_select->alist->data[i],
-                    query->err_msg);
-
-            if (aggr_points != points)
-            {
-                siridb_points_free(points);
-            }
-
-            if (aggr_points == NULL)
-            {
-                siridb_query_send_error(handle, CPROTO_ERR_QUERY);
-                return;
-            }
-
-            points = aggr_points;
+            siridb_query_send_error(handle, CPROTO_ERR_QUERY);
+            return;
         }
+    }
 
-        q_select->n += points->len;
+    if (async_more)
+    {
+        uv_async_send(handle);
+    }
+    else
+    {
+        siridb_aggregate_list_free(q_select->alist);
+        q_select->alist = NULL;
 
-        if (q_select->merge_as == NULL)
-        {
-            name = siridb_presuf_name(
-                    q_select->presuf,
-                    series->name,
-                    series->name_len);
-
-            if (name == NULL || ct_add(q_select->result, name, points))
-            {
-                sprintf(query->err_msg, "Error adding points to map.");
-                siridb_points_free(points);
-                log_critical("Critical error adding points");
-                siridb_query_send_error(handle, CPROTO_ERR_QUERY);
-                return;
-            }
-        }
-        else
-        {
-            slist_t ** plist;
-
-            name = siridb_presuf_name(
-                    q_select->presuf,
-                    q_select->merge_as,
-                    strlen(q_select->merge_as));
-
-            plist = (slist_t **) ct_getaddr(q_select->result, name);
-
-            if (    name == NULL ||
-                    plist == NULL ||
-                    slist_append_safe(plist, points))
-            {
-                sprintf(query->err_msg, "Error adding points to map.");
-                siridb_points_free(points);
-                log_critical("Critical error adding points");
-                siridb_query_send_error(handle, CPROTO_ERR_QUERY);
-                return;
-            }
-        }
-    }
-
-    if (async_more)
-    {
-        uv_async_send(handle);
-    }
-    else
-    {
-        siridb_aggregate_list_free(q_select->alist);
-        q_select->alist = NULL;
-
-        slist_free(q_select->slist);
-        q_select->slist = NULL;
-        q_select->slist_index = 0;
+        slist_free(q_select->slist);
+        q_select->slist = NULL;
+        q_select->slist_index = 0;
 
         SIRIPARSER_ASYNC_NEXT_NODE
     }
@@ -4631,18 +5545,22 @@ static void async_series_re(uv_async_t * handle)
         series = (siridb_series_t *)
                 q_wrapper->slist->data[q_wrapper->slist_index];
 
-        pcre_exec_ret = pcre_exec(
-                q_wrapper->regex,
-                q_wrapper->regex_extra,
+        pcre_exec_ret = (q_wrapper->re == NULL) ? 0 : siridb_re_match(
+                q_wrapper->re,
                 series->name,
-                series->name_len,
-                0,                     // start looking at this point
-                0,                     // OPTIONS
-                NULL,
-                0);                    // length of sub_str_vec
+                series->name_len);
 
-        if (    pcre_exec_ret ||
-                imap_add(q_wrapper->series_tmp, series->id, series))
+        if (q_wrapper->series_set != NULL)
+        {
+            if (    !pcre_exec_ret &&
+                    iset_add(q_wrapper->series_set, series->id) < 0)
+            {
+                log_critical("Cannot add series to temporary set.");
+            }
+            siridb_series_decref(series);
+        }
+        else if (   pcre_exec_ret ||
+                    imap_add(q_wrapper->series_tmp, series->id, series))
         {
             siridb_series_decref(series);
         }
@@ -4654,19 +5572,48 @@ static void async_series_re(uv_async_t * handle)
     }
     else
     {
+        siridb_t * siridb =
+                ((sirinet_socket_t *) query->client->data)->siridb;
+
         /* free the s-list object and reset index */
         slist_free(q_wrapper->slist);
 
-        free(q_wrapper->regex);
-        free(q_wrapper->regex_extra);
-
-        q_wrapper->regex = NULL;
-        q_wrapper->regex_extra = NULL;
-
         q_wrapper->slist = NULL;
         q_wrapper->slist_index = 0;
 
-        if (q_wrapper->update_cb != NULL)
+        if (q_wrapper->re != NULL)
+        {
+            siridb_re_decref(siri.re_cache, q_wrapper->re);
+            q_wrapper->re = NULL;
+
+            /* series_tmp holds all matches when all series were matched and
+             * no series is created or dropped meanwhile */
+            if (    siridb->mcache != NULL &&
+                    q_wrapper->series_set == NULL &&
+                    q_wrapper->series_gen == siridb->series_gen &&
+                    series_re_is_full(q_wrapper))
+            {
+                slist_t * slist = imap_slist(q_wrapper->series_tmp);
+                if (slist != NULL)
+                {
+                    siridb_mcache_set(
+                            siridb->mcache,
+                            query->nodes->node->str,
+                            query->nodes->node->len,
+                            q_wrapper->series_gen,
+                            slist);
+                }
+            }
+        }
+
+        if (q_wrapper->series_set != NULL)
+        {
+            if (series_set_update(q_wrapper))
+            {
+                MEM_ERR_RET
+            }
+        }
+        else if (q_wrapper->update_cb != NULL)
         {
             (*q_wrapper->update_cb)(
                     q_wrapper->series_map,
@@ -4991,6 +5938,102 @@ static void on_drop_shards_response(slist_t * promises, uv_async_t * handle)
     SIRIPARSER_ASYNC_NEXT_NODE
 }
 
+/*
+ * Call-back function: sirinet_promises_cb
+ *
+ * Make sure to run siri_async_incref() on the handle
+ */
+static void on_explain_response(slist_t * promises, uv_async_t * handle)
+{
+    ON_PROMISES
+
+    uint8_t error_tp = 0;
+    siridb_query_t * query = (siridb_query_t *) handle->data;
+    sirinet_pkg_t * pkg;
+    sirinet_promise_t * promise;
+    qp_unpacker_t unpacker;
+    qp_obj_t qp_val;
+    size_t n;
+
+    query_select_t * q_select = (query_select_t *) query->data;
+    uint64_t * fields[] = {
+            &q_select->cost.series,
+            &q_select->cost.shards,
+            &q_select->cost.chunks,
+            &q_select->cost.points,
+            &q_select->cost.min_points};
+
+    for (size_t i = 0; i < promises->len; i++)
+    {
+        promise = promises->data[i];
+
+        if (promise == NULL)
+        {
+            if (!error_tp)
+            {
+                snprintf(query->err_msg,
+                        SIRIDB_MAX_SIZE_ERR_MSG,
+                        "Error occurred while sending the select query to at "
+                        "least one required server");
+                error_tp = CPROTO_ERR_QUERY;
+            }
+            continue;
+        }
+
+        pkg = (sirinet_pkg_t *) promise->data;
+
+        if (pkg != NULL && pkg->tp == BPROTO_RES_QUERY)
+        {
+            qp_unpacker_init(&unpacker, pkg->data, pkg->len);
+
+            if (    qp_is_map(qp_next(&unpacker, NULL)) &&
+                    qp_is_raw(qp_next(&unpacker, NULL)) &&  // explain
+                    qp_is_map(qp_next(&unpacker, NULL)))
+            {
+                /* the fields are packed in a fixed order */
+                for (   n = 0;
+                        n < sizeof(fields) / sizeof(uint64_t *) &&
+                        qp_is_raw(qp_next(&unpacker, NULL)) &&
+                        qp_is_int(qp_next(&unpacker, &qp_val));
+                        n++)
+                {
+                    *fields[n] += (uint64_t) qp_val.via.int64;
+                }
+
+                /* extract time-it info if needed */
+                if (query->timeit != NULL)
+                {
+                    siridb_query_timeit_from_unpacker(query, &unpacker);
+                }
+            }
+        }
+        else if (pkg != NULL &&
+                !error_tp &&
+                sirinet_protocol_is_error_msg(pkg->tp) &&
+                siridb_query_err_from_pkg(query, pkg) == 0)
+        {
+            error_tp = pkg->tp;
+        }
+
+        /* make sure we free the promise and data */
+        free(promise->data);
+        sirinet_promise_decref(promise);
+    }
+
+    if (error_tp)
+    {
+        siridb_query_send_error(handle, error_tp);
+    }
+    else if (select_pack_cost(query->packer, &q_select->cost))
+    {
+        MEM_ERR_RET
+    }
+    else
+    {
+        SIRIPARSER_ASYNC_NEXT_NODE
+    }
+}
+
 /*
  * Call-back function: sirinet_promises_cb
  *
@@ -5136,236 +6179,2108 @@ static void on_list_xxx_response(slist_t * promises, uv_async_t * handle)
 /*
  * Call-back function: sirinet_promises_cb
  *
- * Make sure to run siri_async_incref() on the handle
+ * Each pool responds with the first series after the name in name order, so
+ * the sorted rows of this server and the pools are merged with a k-way merge
+ * which stops when the limit is reached.
  */
-static void on_select_response(slist_t * promises, uv_async_t * handle)
+static void on_list_series_response(slist_t * promises, uv_async_t * handle)
 {
     ON_PROMISES
 
+    int error_tp = 0;
     sirinet_pkg_t * pkg;
     sirinet_promise_t * promise;
     qp_unpacker_t unpacker;
     siridb_query_t * query = (siridb_query_t *) handle->data;
-    siridb_t * siridb = ((sirinet_socket_t *) query->client->data)->siridb;
-    size_t err_count = 0;
-    query_select_t * q_select = (query_select_t *) query->data;
-    qp_obj_t qp_name;
-    qp_obj_t qp_tp;
-    qp_obj_t qp_len;
-    qp_obj_t qp_points;
-    qp_obj_t qp_err_msg;
+    query_list_t * q_list = (query_list_t *) query->data;
+    size_t column = (size_t) list_name_column(q_list);
+    size_t size = query->packer->len - q_list->offset;
+    list_rows_t rows = {0};
+    size_t i, limit, nruns = 0;
+    size_t runs[promises->len + 1];     /* start of the rows by source */
+    char * local;
 
-    for (size_t i = 0; i < promises->len; i++)
+    runs[nruns++] = 0;
+
+    /* the packer is rewritten so the rows of this server are copied */
+    local = (char *) malloc(size);
+    if (local == NULL && size)
+    {
+        error_tp = -1;
+    }
+    else
+    {
+        memcpy(local, query->packer->buffer + q_list->offset, size);
+        qp_unpacker_init(&unpacker, local, size);
+        if (list_rows_add(&rows, &unpacker, column))
+        {
+            error_tp = -1;
+        }
+    }
+
+    /* the limit is decremented by the rows of this server */
+    limit = q_list->limit + rows.n;
+
+    for (i = 0; !error_tp && i < promises->len; i++)
     {
         promise = promises->data[i];
 
         if (promise == NULL)
         {
-            err_count++;
-            snprintf(query->err_msg,
-                    SIRIDB_MAX_SIZE_ERR_MSG,
-                    "Error occurred while sending the select query to at "
-                    "least one required server");
+            continue;
         }
-        else
+
+        pkg = (sirinet_pkg_t *) promise->data;
+
+        if (pkg != NULL && pkg->tp == BPROTO_RES_QUERY)
         {
-            pkg = (sirinet_pkg_t *) promise->data;
+            qp_unpacker_init(&unpacker, pkg->data, pkg->len);
 
-            if (pkg == NULL || pkg->tp != BPROTO_RES_QUERY)
+            if (    qp_is_map(qp_next(&unpacker, NULL)) &&
+                    qp_is_raw(qp_next(&unpacker, NULL)) && // columns
+                    qp_is_array(qp_skip_next(&unpacker)) &&
+                    qp_is_raw(qp_next(&unpacker, NULL)) && // series
+                    qp_is_array(qp_next(&unpacker, NULL)))  // results
             {
-                err_count++;
+                runs[nruns++] = rows.n;
 
-                if (pkg != NULL && pkg->tp == BPROTO_ERR_QUERY)
+                if (list_rows_add(&rows, &unpacker, column))
                 {
-                    qp_unpacker_init(&unpacker, pkg->data, pkg->len);
-
-                    if (    qp_is_map(qp_next(&unpacker, NULL)) &&
-                            qp_is_raw(qp_next(&unpacker, NULL)) &&
-                            qp_is_raw(qp_next(&unpacker, &qp_err_msg)))
-                    {
-                        snprintf(query->err_msg,
-                                SIRIDB_MAX_SIZE_ERR_MSG,
-                                "%.*s",
-                                (int) qp_err_msg.len,
-                                qp_err_msg.via.raw);
-                    }
-                    else
-                    {
-                        snprintf(query->err_msg,
-                                SIRIDB_MAX_SIZE_ERR_MSG,
-                                "Error occurred while sending request to "
-                                "at least '%s'",
-                                promise->server->name);
-                    }
+                    error_tp = -1;
                 }
-                else
+
+                /* extract time-it info if needed */
+                else if (query->timeit != NULL)
                 {
-                    snprintf(query->err_msg,
-                            SIRIDB_MAX_SIZE_ERR_MSG,
-                            "Error occurred while sending request to "
-                            "at least '%s'",
-                            promise->server->name);
+                    siridb_query_timeit_from_unpacker(query, &unpacker);
                 }
             }
-            else
-            {
-                qp_unpacker_init(&unpacker, pkg->data, pkg->len);
+        }
+        else if (pkg != NULL &&
+                sirinet_protocol_is_error_msg(pkg->tp) &&
+                siridb_query_err_from_pkg(query, pkg) == 0)
+        {
+            error_tp = pkg->tp;
+        }
+    }
 
-                if (    qp_is_map(qp_next(&unpacker, NULL)) &&
-                        qp_is_raw(qp_next(&unpacker, NULL)) && // select
-                        qp_is_map(qp_next(&unpacker, NULL)))
-                {
-                    if (q_select->merge_as == NULL)
-                    {
-                        on_select_unpack_points(
-                                &unpacker,
-                                q_select,
-                                &qp_name,
-                                &qp_tp,
-                                &qp_len,
-                                &qp_points,
-                                siridb->select_points_limit);
-                    }
-                    else
-                    {
-                        on_select_unpack_merged_points(
-                                &unpacker,
-                                q_select,
-                                &qp_name,
-                                &qp_tp,
-                                &qp_len,
-                                &qp_points,
-                                siridb->select_points_limit);
-                    }
+    if (!error_tp)
+    {
+        query->packer->len = q_list->offset;
+        list_rows_merge(query->packer, &rows, runs, nruns, limit);
+    }
 
+    free(rows.row);
+    free(local);
 
-                    /* extract time-it info if needed */
-                    if (query->timeit != NULL)
-                    {
-                        siridb_query_timeit_from_unpacker(query, &unpacker);
-                    }
-                }
-            }
+    /* make sure we free the promises and data */
+    for (i = 0; i < promises->len; i++)
+    {
+        promise = promises->data[i];
 
-            /* make sure we free the promise and data */
+        if (promise != NULL)
+        {
             free(promise->data);
             sirinet_promise_decref(promise);
         }
     }
 
-    if (q_select->n > siridb->select_points_limit)
+    if (error_tp < 0)
     {
-        snprintf(query->err_msg,
-                SIRIDB_MAX_SIZE_ERR_MSG,
-                "Query has reached the maximum number of selected points "
-                "(%u). Please use another time window, an aggregation "
-                "function or select less series to reduce the number of "
-                "points.",
-                siridb->select_points_limit);
-        siridb_query_send_error(handle, CPROTO_ERR_QUERY);
+        MEM_ERR_RET
     }
-    else if (err_count)
+
+    if (error_tp)
     {
-        siridb_query_send_error(handle, CPROTO_ERR_QUERY);
+        siridb_query_send_error(handle, error_tp);
     }
     else
     {
-        uv_work_t * work = (uv_work_t *) malloc(sizeof(uv_work_t));
-        if (work == NULL)
-        {
-            MEM_ERR_RET
-        }
-
-        uv_async_t * next = (uv_async_t *) malloc(sizeof(uv_async_t));
-        if (next == NULL)
-        {
-            free(work);
-            MEM_ERR_RET
-        }
-
-        uv_close((uv_handle_t *) handle, (uv_close_cb) free);
-
-        handle = next;
-        handle->data = query;
-        siridb_nodes_next(&query->nodes);
-
-        uv_async_init(
-                siri.loop,
-                handle,
-                (query->nodes == NULL) ?
-                        (uv_async_cb) siridb_send_query_result :
-                        (uv_async_cb) query->nodes->cb);
-
-        siri_async_incref(handle);
-        work->data = handle;
-        uv_queue_work(
-                    siri.loop,
-                    work,
-                    &master_select_work,
-                    &master_select_work_finish);
-
+        qp_add_type(query->packer, QP_ARRAY_CLOSE);
+        SIRIPARSER_ASYNC_NEXT_NODE
     }
 }
 
 /*
- * Call-back function: sirinet_promises_cb
+ * Call-back function: sirinet_promises_each_cb
  *
- * Make sure to run siri_async_incref() on the handle
+ * Add the rows of a pool as soon as the pool responds. When the limit is
+ * reached, the pools which are still listing series are asked to stop since
+ * their rows are not used.
  */
-static void on_update_xxx_response(slist_t * promises, uv_async_t * handle)
+static void on_list_series_promise(
+        sirinet_promise_t * promise,
+        uv_async_t * handle)
 {
-    ON_PROMISES
-
-    sirinet_pkg_t * pkg;
+    siridb_query_t * query = (siridb_query_t *) handle->data;
+    query_list_t * q_list = (query_list_t *) query->data;
+    sirinet_pkg_t * pkg = (sirinet_pkg_t *) promise->data;
+    qp_unpacker_t unpacker;
+    size_t limit = q_list->limit;
+
+    if (pkg != NULL && pkg->tp == BPROTO_RES_QUERY)
+    {
+        qp_unpacker_init(&unpacker, pkg->data, pkg->len);
+
+        if (    qp_is_map(qp_next(&unpacker, NULL)) &&
+                qp_is_raw(qp_next(&unpacker, NULL)) && // columns
+                qp_is_array(qp_skip_next(&unpacker)) &&
+                qp_is_raw(qp_next(&unpacker, NULL)) && // series
+                qp_is_array(qp_next(&unpacker, NULL)))  // results
+        {
+            while (q_list->limit && qp_is_array(qp_current(&unpacker)))
+            {
+                qp_packer_extend_fu(query->packer, &unpacker);
+                q_list->limit--;
+            }
+
+            /* time-it info is after the rows which are not used */
+            if (query->timeit != NULL)
+            {
+                while (qp_is_array(qp_current(&unpacker)))
+                {
+                    qp_skip_next(&unpacker);
+                }
+                siridb_query_timeit_from_unpacker(query, &unpacker);
+            }
+        }
+    }
+    else if (pkg != NULL &&
+            !q_list->error_tp &&
+            sirinet_protocol_is_error_msg(pkg->tp) &&
+            siridb_query_err_from_pkg(query, pkg) == 0)
+    {
+        q_list->error_tp = pkg->tp;
+    }
+
+    /* the package is not needed anymore */
+    free(promise->data);
+    promise->data = NULL;
+
+    if (limit && !q_list->limit)
+    {
+        siridb_query_kill_forwarded(query);
+    }
+}
+
+/*
+ * Call-back function: sirinet_promises_cb
+ *
+ * All pools have responded or are stopped. Errors are ignored when the limit
+ * is reached since pools which are asked to stop respond with an error.
+ */
+static void on_list_series_done(slist_t * promises, uv_async_t * handle)
+{
+    ON_PROMISES
+
+    sirinet_promise_t * promise;
+    siridb_query_t * query = (siridb_query_t *) handle->data;
+    query_list_t * q_list = (query_list_t *) query->data;
+
+    for (size_t i = 0; i < promises->len; i++)
+    {
+        promise = promises->data[i];
+
+        if (promise != NULL)
+        {
+            sirinet_promise_decref(promise);
+        }
+    }
+
+    if (q_list->error_tp && q_list->limit)
+    {
+        siridb_query_send_error(handle, q_list->error_tp);
+    }
+    else
+    {
+        qp_add_type(query->packer, QP_ARRAY_CLOSE);
+        SIRIPARSER_ASYNC_NEXT_NODE
+    }
+}
+
+/*
+ * Call-back function: sirinet_promises_each_cb
+ *
+ * Unpack the response of a pool as soon as it is received so the package is
+ * not kept in memory until all pools have responded. The series of a pool
+ * are complete, so when the result is streamed and not merged, they are
+ * streamed to the client without waiting for the other pools.
+ */
+static void on_select_promise(sirinet_promise_t * promise, uv_async_t * handle)
+{
+    siridb_query_t * query = (siridb_query_t *) handle->data;
+    query_select_t * q_select = (query_select_t *) query->data;
+    query_stream_t * stream = q_select->stream;
+    ct_t * result = q_select->result;
+    uint64_t ns = timeit_ns();
+
+    if (SELECT_STREAM_EARLY(q_select) && (result = ct_new()) == NULL)
+    {
+        ERR_ALLOC
+    }
+
+    q_select->err_count += (result == NULL) ?
+            1 : select_unpack_response(query, promise, result);
+
+    /* the package is not needed anymore */
+    free(promise->data);
+    promise->data = NULL;
+
+    query->stages.merge += timeit_ns() - ns;
+
+    if (result != NULL && result != q_select->result)
+    {
+        if (slist_append_safe(&stream->ready, result))
+        {
+            ERR_ALLOC
+            ct_free(result, (ct_free_cb) &siridb_points_free);
+        }
+        else
+        {
+            select_stream_next(handle);
+        }
+    }
+}
+
+/*
+ * Unpack the select response in 'promise' to 'result'.
+ *
+ * Returns 0 if successful or 1 when the response has failed, in which case
+ * the error message is set.
+ */
+static int select_unpack_response(
+        siridb_query_t * query,
+        sirinet_promise_t * promise,
+        ct_t * result)
+{
+    sirinet_pkg_t * pkg = (sirinet_pkg_t *) promise->data;
+    siridb_t * siridb = ((sirinet_socket_t *) query->client->data)->siridb;
+    query_select_t * q_select = (query_select_t *) query->data;
+    siridb_arena_t * arena = siridb_query_arena(query);
+    qp_unpacker_t unpacker;
+    qp_obj_t qp_name;
+    qp_obj_t qp_tp;
+    qp_obj_t qp_len;
+    qp_obj_t qp_points;
+    qp_obj_t qp_err_msg;
+
+    if (pkg == NULL || pkg->tp != BPROTO_RES_QUERY)
+    {
+        if (pkg != NULL && pkg->tp == BPROTO_ERR_QUERY)
+        {
+            qp_unpacker_init(&unpacker, pkg->data, pkg->len);
+
+            if (    qp_is_map(qp_next(&unpacker, NULL)) &&
+                    qp_is_raw(qp_next(&unpacker, NULL)) &&
+                    qp_is_raw(qp_next(&unpacker, &qp_err_msg)))
+            {
+                snprintf(query->err_msg,
+                        SIRIDB_MAX_SIZE_ERR_MSG,
+                        "%.*s",
+                        (int) qp_err_msg.len,
+                        qp_err_msg.via.raw);
+                return 1;
+            }
+        }
+
+        snprintf(query->err_msg,
+                SIRIDB_MAX_SIZE_ERR_MSG,
+                "Error occurred while sending request to at least '%s'",
+                promise->server->name);
+        return 1;
+    }
+
+    qp_unpacker_init(&unpacker, pkg->data, pkg->len);
+
+    if (    qp_is_map(qp_next(&unpacker, NULL)) &&
+            qp_is_raw(qp_next(&unpacker, NULL)) && // select
+            qp_is_map(qp_next(&unpacker, NULL)))
+    {
+        if (q_select->merge_as == NULL)
+        {
+            on_select_unpack_points(
+                    &unpacker,
+                    q_select,
+                    result,
+                    arena,
+                    &qp_name,
+                    &qp_tp,
+                    &qp_len,
+                    &qp_points,
+                    siridb->select_points_limit);
+        }
+        else
+        {
+            on_select_unpack_merged_points(
+                    &unpacker,
+                    q_select,
+                    arena,
+                    &qp_name,
+                    &qp_tp,
+                    &qp_len,
+                    &qp_points,
+                    siridb->select_points_limit);
+        }
+
+        /* extract time-it info if needed */
+        if (query->timeit != NULL)
+        {
+            siridb_query_timeit_from_unpacker(query, &unpacker);
+        }
+    }
+
+    if (q_select->spill_err)
+    {
+        snprintf(query->err_msg,
+                SIRIDB_MAX_SIZE_ERR_MSG,
+                "Query has reached the memory budget and the selected points "
+                "cannot be moved to a temporary file. Please use another "
+                "time window, an aggregation function or select less series "
+                "to reduce the number of points.");
+        return 1;
+    }
+
+    return 0;
+}
+
+/*
+ * Call-back function: sirinet_promises_cb
+ *
+ * Make sure to run siri_async_incref() on the handle
+ *
+ * The responses are already unpacked by on_select_promise().
+ */
+static void on_select_response(slist_t * promises, uv_async_t * handle)
+{
+    ON_PROMISES
+
+    sirinet_promise_t * promise;
+    siridb_query_t * query = (siridb_query_t *) handle->data;
+    query_select_t * q_select = (query_select_t *) query->data;
+
+    for (size_t i = 0; i < promises->len; i++)
+    {
+        promise = promises->data[i];
+
+        if (promise == NULL)
+        {
+            q_select->err_count++;
+            snprintf(query->err_msg,
+                    SIRIDB_MAX_SIZE_ERR_MSG,
+                    "Error occurred while sending the select query to at "
+                    "least one required server");
+        }
+        else
+        {
+            sirinet_promise_decref(promise);
+        }
+    }
+
+    if (q_select->stream != NULL && q_select->stream->busy)
+    {
+        /* continue when the series which are ready are streamed */
+        q_select->stream->wait = 1;
+        return;
+    }
+
+    select_response_done(handle);
+}
+
+/*
+ * Continue with the select when all pools have responded and the streamed
+ * series, if any, are sent.
+ */
+static void select_response_done(uv_async_t * handle)
+{
+    siridb_query_t * query = (siridb_query_t *) handle->data;
+    siridb_t * siridb = ((sirinet_socket_t *) query->client->data)->siridb;
+    query_select_t * q_select = (query_select_t *) query->data;
+
+    if (q_select->n > siridb->select_points_limit)
+    {
+        snprintf(query->err_msg,
+                SIRIDB_MAX_SIZE_ERR_MSG,
+                "Query has reached the maximum number of selected points "
+                "(%u). Please use another time window, an aggregation "
+                "function or select less series to reduce the number of "
+                "points.",
+                siridb->select_points_limit);
+        select_stream_close(q_select);
+        siridb_query_send_error(handle, CPROTO_ERR_QUERY);
+    }
+    else if (   q_select->err_count ||
+                (query->flags & SIRIDB_QUERY_FLAG_ERR) ||
+                siridb_query_is_cancelled(query, query->err_msg))
+    {
+        select_stream_close(q_select);
+        siridb_query_send_error(handle, CPROTO_ERR_QUERY);
+    }
+    else
+    {
+        uv_work_t * work = (uv_work_t *) malloc(sizeof(uv_work_t));
+        if (work == NULL)
+        {
+            MEM_ERR_RET
+        }
+
+        uv_async_t * next = (uv_async_t *) malloc(sizeof(uv_async_t));
+        if (next == NULL)
+        {
+            free(work);
+            MEM_ERR_RET
+        }
+
+        uv_close((uv_handle_t *) handle, (uv_close_cb) free);
+
+        handle = next;
+        handle->data = query;
+        siridb_nodes_next(&query->nodes);
+
+        uv_async_init(
+                siri.loop,
+                handle,
+                (query->nodes == NULL) ?
+                        (uv_async_cb) siridb_send_query_result :
+                        (uv_async_cb) query->nodes->cb);
+
+        /* not critical, without a stream the result is sent at once */
+        select_stream_init(query);
+
+        siri_async_incref(handle);
+        work->data = handle;
+        siri_sched_queue(
+                    select_sched_class(query),
+                    select_sched_limit(query),
+                    work,
+                    &master_select_work,
+                    &master_select_work_finish);
+
+    }
+}
+
+/*
+ * Call-back function: sirinet_promises_cb
+ *
+ * Make sure to run siri_async_incref() on the handle
+ */
+static void on_update_xxx_response(slist_t * promises, uv_async_t * handle)
+{
+    ON_PROMISES
+
+    sirinet_pkg_t * pkg;
     sirinet_promise_t * promise;
     siridb_query_t * query = (siridb_query_t *) handle->data;
-    size_t err_count = 0;
+    size_t err_count = 0;
+
+    for (size_t i = 0; i < promises->len; i++)
+    {
+        promise = promises->data[i];
+
+        if (promise == NULL)
+        {
+            err_count++;
+            snprintf(query->err_msg,
+                    SIRIDB_MAX_SIZE_ERR_MSG,
+                    "Error occurred while sending the database change to at "
+                    "least one required server");
+        }
+        else
+        {
+            pkg = (sirinet_pkg_t *) promise->data;
+
+            if (pkg == NULL || pkg->tp != BPROTO_RES_QUERY)
+            {
+                err_count++;
+                snprintf(query->err_msg,
+                        SIRIDB_MAX_SIZE_ERR_MSG,
+                        "Error occurred while sending the database change to "
+                        "at least '%s'", promise->server->name);
+            }
+
+            /* make sure we free the promise and data */
+            free(promise->data);
+            sirinet_promise_decref(promise);
+        }
+    }
+
+    if (err_count)
+    {
+        siridb_query_send_error(handle, CPROTO_ERR_QUERY);
+    }
+    else
+    {
+        SIRIPARSER_ASYNC_NEXT_NODE
+    }
+}
+
+/******************************************************************************
+ * Helper functions
+ *****************************************************************************/
+
+
+/*
+ * Send the result from the query cache when a valid entry exists for this
+ * query and the selected series. Returns 1 in this case. Otherwise 0 is
+ * returned and when the query can be cached, a new entry is prepared which
+ * is stored with the result in master_select_work_finish().
+ *
+ * Only queries with one select method are cached and only when this is the
+ * single pool since the series versions of other pools are not known.
+ */
+/*
+ * Estimate the cost for the series in q_select->slist before reading any
+ * points. Returns 1 when the query is handled, either because the cost is
+ * requested using explain or because the query is rejected, and 0 when the
+ * select should continue.
+ *
+ * Without an aggregate function every point in range is returned so a query
+ * which is sure to reach the select points limit is rejected before reading.
+ * Queries reading many points are aggregated by a single worker so they
+ * cannot occupy all select threads.
+ */
+static int select_estimate(uv_async_t * handle)
+{
+    siridb_query_t * query = (siridb_query_t *) handle->data;
+    query_select_t * q_select = (query_select_t *) query->data;
+    siridb_t * siridb = ((sirinet_socket_t *) query->client->data)->siridb;
+    siridb_series_cost_t cost;
+    siridb_series_t * series;
+
+    memset(&cost, 0, sizeof(siridb_series_cost_t));
+
+    siri_rwlock_wrlock(&siridb->series_mutex);
+
+    for (size_t i = 0; i < q_select->slist->len; i++)
+    {
+        series = (siridb_series_t *) q_select->slist->data[i];
+        if (~series->flags & SIRIDB_SERIES_IS_DROPPED)
+        {
+            siridb_series_cost(
+                    series,
+                    q_select->start_ts,
+                    q_select->end_ts,
+                    &cost);
+        }
+    }
+
+    siri_rwlock_wrunlock(&siridb->series_mutex);
+
+    if (query->flags & SIRIDB_QUERY_FLAG_EXPLAIN)
+    {
+        q_select->cost.series += cost.series;
+        q_select->cost.shards += cost.shards;
+        q_select->cost.chunks += cost.chunks;
+        q_select->cost.points += cost.points;
+        q_select->cost.min_points += cost.min_points;
+
+        for (; q_select->slist_index < q_select->slist->len;
+                q_select->slist_index++)
+        {
+            series = (siridb_series_t *)
+                    q_select->slist->data[q_select->slist_index];
+            siridb_series_decref(series);
+        }
+
+        siridb_aggregate_list_free(q_select->alist);
+        q_select->alist = NULL;
+
+        slist_free(q_select->slist);
+        q_select->slist = NULL;
+        q_select->slist_index = 0;
+
+        SIRIPARSER_ASYNC_NEXT_NODE
+
+        return 1;
+    }
+
+    if (q_select->limit && cost.points > q_select->limit * cost.series)
+    {
+        /* each series returns at most the newest 'limit' points */
+        cost.points = q_select->limit * cost.series;
+        if (cost.min_points > cost.points)
+        {
+            cost.min_points = cost.points;
+        }
+    }
+
+    if (    !q_select->alist->len &&
+            q_select->n + cost.min_points > siridb->select_points_limit)
+    {
+        snprintf(query->err_msg,
+                SIRIDB_MAX_SIZE_ERR_MSG,
+                "Query has reached the maximum number of selected points "
+                "(%u). Please use another time window, an aggregation "
+                "function or select less series to reduce the number of "
+                "points.",
+                siridb->select_points_limit);
+
+        siridb_query_send_error(handle, CPROTO_ERR_QUERY);
+        return 1;
+    }
+
+    q_select->is_heavy = siri.cfg->select_heavy_points &&
+            cost.points >= siri.cfg->select_heavy_points;
+
+    return 0;
+}
+
+static int select_pack_cost(qp_packer_t * packer, siridb_series_cost_t * cost)
+{
+    return (qp_add_raw(packer, "explain", 7) ||
+            qp_add_type(packer, QP_MAP_OPEN) ||
+            qp_add_raw(packer, "series", 6) ||
+            qp_add_int64(packer, (int64_t) cost->series) ||
+            qp_add_raw(packer, "shards", 6) ||
+            qp_add_int64(packer, (int64_t) cost->shards) ||
+            qp_add_raw(packer, "chunks", 6) ||
+            qp_add_int64(packer, (int64_t) cost->chunks) ||
+            qp_add_raw(packer, "points", 6) ||
+            qp_add_int64(packer, (int64_t) cost->points) ||
+            qp_add_raw(packer, "min_points", 10) ||
+            qp_add_int64(packer, (int64_t) cost->min_points) ||
+            qp_add_type(packer, QP_MAP_CLOSE));
+}
+
+static int master_select_cached(uv_async_t * handle)
+{
+    siridb_query_t * query = (siridb_query_t *) handle->data;
+    query_select_t * q_select = (query_select_t *) query->data;
+    siridb_t * siridb = ((sirinet_socket_t *) query->client->data)->siridb;
+    siridb_qcache_entry_t * entry;
+    qp_packer_t * packer;
+    char key[SIRIDB_QCACHE_MAX_KEY];
+
+    if (    siridb->qcache == NULL ||
+            !IS_MASTER ||
+            query->timeit != NULL ||
+            (query->flags & SIRIDB_QUERY_FLAG_STREAM) ||
+            query->fmt != SIRIDB_QUERY_FMT_ROWS ||
+            q_select->presuf->prev != NULL ||
+            siridb->pools->len != 1 ||
+            siridb_query_normalize(query, key, SIRIDB_QCACHE_MAX_KEY))
+    {
+        return 0;
+    }
+
+    entry = siridb_qcache_get(
+            siridb->qcache,
+            key,
+            query->factor,
+            q_select->slist);
+
+    if (entry == NULL)
+    {
+        /* not critical, the result is not cached when this fails */
+        q_select->qentry = siridb_qcache_entry_new(
+                key,
+                query->factor,
+                siridb->data_version,
+                q_select->slist);
+        return 0;
+    }
+
+    packer = sirinet_packer_new(sizeof(sirinet_pkg_t) + entry->len);
+
+    if (packer == NULL)
+    {
+        sprintf(query->err_msg, "Memory allocation error.");
+        siridb_query_send_error(handle, CPROTO_ERR_QUERY);
+        return 1;  /* signal is raised */
+    }
+
+    memcpy(packer->buffer + packer->len, entry->data, entry->len);
+    packer->len += entry->len;
+
+    qp_packer_free(query->packer);
+    query->packer = packer;
+
+    siridb_send_query_result(handle);
+
+    return 1;
+}
+
+/*
+ * Pack the points for a series in the select response using the format
+ * which is requested by the client.
+ *
+ * Returns 0 if successful or -1 and a signal might be raised in case of an
+ * error.
+ */
+static int select_pack_points(
+        siridb_query_t * query,
+        siridb_points_t * points)
+{
+    switch (query->fmt)
+    {
+    case SIRIDB_QUERY_FMT_COLUMNS:
+        return siridb_points_pack_columns(points, query->packer, 0);
+    case SIRIDB_QUERY_FMT_COLUMNS_LZ4:
+        return siridb_points_pack_columns(points, query->packer, 1);
+    }
+    return siridb_points_pack(points, query->packer);
+}
+
+/*
+ * Start a select job for the series in q_select->slist. When the job is
+ * finished, select_aggregate_done() continues with the query.
+ *
+ * Series are read while holding the series mutex, like the optimize task
+ * does, but aggregating is done in parallel and the event loop is free to
+ * handle inserts and other clients while the workers are busy.
+ */
+static void select_aggregate_start(uv_async_t * handle)
+{
+    siridb_query_t * query = (siridb_query_t *) handle->data;
+    query_select_t * q_select = (query_select_t *) query->data;
+    size_t nworkers = siri.cfg->select_threads;
+    siri_sched_class_t cls;
+    select_job_t * job;
+
+    /* a heavy select should not occupy all select threads */
+    if (q_select->is_heavy)
+    {
+        nworkers = 1;
+    }
+
+    job = (select_job_t *) malloc(
+            sizeof(select_job_t) + nworkers * sizeof(uv_work_t));
+
+    if (job == NULL)
+    {
+        MEM_ERR_RET
+    }
+
+    job->results = (siridb_points_t **) calloc(
+            q_select->slist->len,
+            sizeof(siridb_points_t *));
+
+    if (job->results == NULL)
+    {
+        free(job);
+        MEM_ERR_RET
+    }
+
+    /* with less series than workers, long series are split in segments */
+    if (select_parts_init(job, q_select, nworkers))
+    {
+        free(job->results);
+        free(job);
+        MEM_ERR_RET
+    }
+
+    /* never start more workers than we have series or segments */
+    if (nworkers > job->items)
+    {
+        nworkers = job->items;
+    }
+
+    job->handle = handle;
+    job->len = q_select->slist->len;
+    job->next = 0;
+    job->prefetched = 0;
+    job->pending = nworkers;
+    job->n = q_select->n;
+    job->err = 0;
+    *job->err_msg = '\0';
+    job->aggregate = 0;
+    memset(&job->shards, 0, sizeof(siridb_shard_stats_t));
+
+    uv_mutex_init(&job->lock);
+
+    siri_async_incref(handle);
+
+    cls = select_sched_class(query);
+
+    for (size_t i = 0; i < nworkers; i++)
+    {
+        job->works[i].data = job;
+        siri_sched_queue(
+                cls,
+                select_sched_limit(query),
+                &job->works[i],
+                &select_aggregate_work,
+                &select_aggregate_work_finish);
+    }
+}
+
+/*
+ * Lock the series_mutex for reading points of 'series'. Selects only need
+ * the lock for reading so they run at the same time, unless cold shards must
+ * be loaded which changes the indexes of other series.
+ *
+ * Returns 1 when the lock is taken for writing. The return value must be
+ * passed to select_unlock().
+ */
+static int select_lock(
+        siridb_t * siridb,
+        siridb_series_t * series,
+        query_select_t * q_select)
+{
+    siri_rwlock_rdlock(&siridb->series_mutex);
+
+    if (    siridb->cold_shards &&
+            siridb_shards_has_cold(
+                    siridb,
+                    series,
+                    q_select->start_ts,
+                    q_select->end_ts))
+    {
+        siri_rwlock_rdunlock(&siridb->series_mutex);
+        siri_rwlock_wrlock(&siridb->series_mutex);
+        return 1;
+    }
+
+    siridb_shard_shared = 1;
+    return 0;
+}
+
+static void select_unlock(siridb_t * siridb, int exclusive)
+{
+    if (exclusive)
+    {
+        siri_rwlock_wrunlock(&siridb->series_mutex);
+        return;
+    }
+
+    siridb_shard_shared = 0;
+    siri_rwlock_rdunlock(&siridb->series_mutex);
+}
+
+static void select_aggregate_work(uv_work_t * work)
+{
+    select_job_t * job = (select_job_t *) work->data;
+    siridb_query_t * query = (siridb_query_t *) job->handle->data;
+    query_select_t * q_select = (query_select_t *) query->data;
+    siridb_t * siridb = ((sirinet_socket_t *) query->client->data)->siridb;
+    siridb_aggr_t * aggr = (q_select->alist->len) ?
+            (siridb_aggr_t *) q_select->alist->data[0] : NULL;
+    int use_stats = aggr != NULL && !q_select->limit &&
+            siridb_aggregate_can_use_stats(aggr);
+    int use_filter = aggr != NULL && !q_select->limit &&
+            aggr->gid == CLERI_GID_F_FILTER;
+    int use_acache = aggr != NULL && !q_select->limit &&
+            siridb->acache != NULL &&
+            siridb_acache_can_use(aggr);
+    char err_msg[SIRIDB_MAX_SIZE_ERR_MSG];
+    siridb_shard_stats_t shards = {0, 0, 0, 0, 0, 0, NULL};
+    siridb_series_t * series;
+    siridb_points_t * points;
+    uint64_t aggregate = 0;
+    uint64_t ns;
+    size_t aggr_start;
+    size_t i, pf_start, pf_end;
+    int exclusive;
+    int rc;
+
+    if (SIRIDB_QUERY_HAS_STATS(query))
+    {
+        siridb_shard_stats = &shards;
+    }
+
+    for (;;)
+    {
+        rc = siridb_query_is_cancelled(query, err_msg);
+
+        uv_mutex_lock(&job->lock);
+        if (rc && !job->err)
+        {
+            job->err = 1;
+            strcpy(job->err_msg, err_msg);
+        }
+        i = job->next++;
+        rc = job->err || i >= job->items;
+
+        /* one worker claims the chunks of the upcoming series to prefetch
+         * before the other workers reach them */
+        pf_start = pf_end = 0;
+        if (    !rc &&
+                job->parts == NULL &&
+                i + SELECT_PREFETCH_SERIES / 2 >= job->prefetched)
+        {
+            pf_start = (job->prefetched > i) ? job->prefetched : i + 1;
+            pf_end = i + 1 + SELECT_PREFETCH_SERIES;
+            if (pf_end > job->len)
+            {
+                pf_end = job->len;
+            }
+            job->prefetched = pf_end;
+        }
+        uv_mutex_unlock(&job->lock);
+
+        if (rc)
+        {
+            break;
+        }
+
+        if (job->parts != NULL)
+        {
+            if (select_part_work(
+                    job,
+                    siridb,
+                    q_select,
+                    i,
+                    &aggregate,
+                    err_msg))
+            {
+                uv_mutex_lock(&job->lock);
+                if (!job->err)
+                {
+                    job->err = 1;
+                    strcpy(job->err_msg, err_msg);
+                }
+                uv_mutex_unlock(&job->lock);
+            }
+            continue;
+        }
+
+        series = (siridb_series_t *) q_select->slist->data[i];
+        aggr_start = 0;
+
+        exclusive = select_lock(siridb, series, q_select);
+
+        /* a limit reads the newest chunks, not the first ones */
+        if (!use_stats && !q_select->limit && pf_start < pf_end)
+        {
+            siridb_series_prefetch(
+                    (siridb_series_t **) q_select->slist->data + pf_start,
+                    pf_end - pf_start,
+                    q_select->start_ts,
+                    q_select->end_ts);
+        }
+
+        if (series->flags & SIRIDB_SERIES_IS_DROPPED)
+        {
+            points = NULL;
+        }
+        else if (use_acache && siridb_series_isnum(series))
+        {
+            /* the first aggregate can use cached groups */
+            points = siridb_acache_select(
+                    siridb,
+                    series,
+                    aggr,
+                    q_select->start_ts,
+                    q_select->end_ts,
+                    err_msg);
+            rc = points == NULL;
+            aggr_start = 1;
+        }
+        else if (use_stats && siridb_series_isnum(series))
+        {
+            /* the first aggregate can use chunk statistics */
+            points = siridb_series_get_aggr(
+                    siridb,
+                    series,
+                    aggr,
+                    q_select->start_ts,
+                    q_select->end_ts,
+                    err_msg);
+            rc = points == NULL;
+            aggr_start = 1;
+        }
+        else if (use_filter && siridb_series_isnum(series))
+        {
+            /* chunks without points which pass the filter are skipped, the
+             * filter is still applied to the points which are read */
+            points = siridb_series_get_filtered(
+                    siridb,
+                    series,
+                    aggr,
+                    q_select->start_ts,
+                    q_select->end_ts);
+        }
+        else
+        {
+            points = siridb_series_get_last(
+                    siridb,
+                    series,
+                    q_select->start_ts,
+                    q_select->end_ts,
+                    q_select->limit);
+        }
+
+        select_unlock(siridb, exclusive);
+
+        if (points != NULL)
+        {
+            siridb_hot_add(
+                    siridb->hot,
+                    SIRIDB_HOT_SELECT,
+                    series->id,
+                    points->len);
+
+            ns = timeit_ns();
+            points = siridb_aggregate_run_list(
+                    points,
+                    q_select->alist,
+                    aggr_start,
+                    err_msg);
+            aggregate += timeit_ns() - ns;
+            rc = points == NULL;
+
+            if (!rc && q_select->spill != NULL)
+            {
+                points = select_spill(q_select, points, err_msg);
+                rc = points == NULL;
+            }
+        }
+
+        if (rc)
+        {
+            uv_mutex_lock(&job->lock);
+            if (!job->err)
+            {
+                job->err = 1;
+                strcpy(job->err_msg, err_msg);
+            }
+            uv_mutex_unlock(&job->lock);
+        }
+        else if (points != NULL)
+        {
+            select_job_result(job, siridb, i, points);
+        }
+    }
+
+    siridb_shard_stats = NULL;
+
+    uv_mutex_lock(&job->lock);
+    job->aggregate += aggregate;
+    job->shards.chunks += shards.chunks;
+    job->shards.bytes += shards.bytes;
+    job->shards.io += shards.io;
+    job->shards.decode += shards.decode;
+    job->shards.points += shards.points;
+    job->shards.shards += shards.shards;
+    uv_mutex_unlock(&job->lock);
+}
+
+static void select_aggregate_work_finish(uv_work_t * work, int status)
+{
+    select_job_t * job = (select_job_t *) work->data;
+    uv_async_t * handle = job->handle;
+
+    if (status)
+    {
+        log_error("Select work failed (error: %s)", uv_strerror(status));
+
+        uv_mutex_lock(&job->lock);
+        if (!job->err)
+        {
+            job->err = 1;
+            sprintf(job->err_msg, "Select work failed.");
+        }
+        uv_mutex_unlock(&job->lock);
+    }
+
+    /* wait for the other workers */
+    if (--job->pending)
+    {
+        return;
+    }
+
+    siri_async_decref(&handle);
+
+    /*
+     * We need to check for SiriDB errors because the workers have run in
+     * another thread. In case a siri_err is set, this means we are in forced
+     * closing state and we should not use the handle but let siri close it.
+     */
+    if (handle != NULL && !siri_err)
+    {
+        select_aggregate_done(handle, job);
+    }
+
+    select_job_free(job);
+}
+
+/*
+ * Called on the main thread when all workers have finished.
+ */
+static void select_aggregate_done(uv_async_t * handle, select_job_t * job)
+{
+    siridb_query_t * query = (siridb_query_t *) handle->data;
+    query_select_t * q_select = (query_select_t *) query->data;
+    siridb_series_t * series;
+    siridb_points_t * points;
+
+    query->stages.aggregate += job->aggregate;
+    query->stages.shards.chunks += job->shards.chunks;
+    query->stages.shards.bytes += job->shards.bytes;
+    query->stages.shards.io += job->shards.io;
+    query->stages.shards.decode += job->shards.decode;
+    query->stages.shards.points += job->shards.points;
+    query->stages.shards.shards += job->shards.shards;
+
+    if (job->err)
+    {
+        strcpy(query->err_msg, job->err_msg);
+        siridb_query_send_error(handle, CPROTO_ERR_QUERY);
+        return;
+    }
+
+    for (size_t i = 0; i < q_select->slist->len; i++)
+    {
+        points = job->results[i];
+
+        if (points == NULL)
+        {
+            continue;
+        }
+
+        job->results[i] = NULL;
+
+        series = (siridb_series_t *) q_select->slist->data[i];
+
+        if (select_add_points(query, series, points))
+        {
+            siridb_query_send_error(handle, CPROTO_ERR_QUERY);
+            return;
+        }
+    }
+
+    /* the series map still has a reference to each series */
+    for (; q_select->slist_index < q_select->slist->len;
+            q_select->slist_index++)
+    {
+        series = (siridb_series_t *)
+                q_select->slist->data[q_select->slist_index];
+        siridb_series_decref(series);
+    }
+
+    siridb_aggregate_list_free(q_select->alist);
+    q_select->alist = NULL;
+
+    slist_free(q_select->slist);
+    q_select->slist = NULL;
+    q_select->slist_index = 0;
+
+    SIRIPARSER_ASYNC_NEXT_NODE
+}
+
+/*
+ * Set a retention setting from the time string in the query. The setting is
+ * stored in the database precision, zero disables expiration.
+ */
+static void set_expiration(
+        uv_async_t * handle,
+        uint64_t * expiration,
+        const char * name)
+{
+    siridb_query_t * query = (siridb_query_t *) handle->data;
+    siridb_t * siridb = ((sirinet_socket_t *) query->client->data)->siridb;
+
+    MASTER_CHECK_ACCESSIBLE(siridb)
+
+    cleri_node_t * node = query->nodes->node->children->next->next->node;
+
+    uint64_t seconds = siridb_time_parse(node->str, node->len);
+
+    if (seconds >= 4294967296)
+    {
+        snprintf(query->err_msg,
+                SIRIDB_MAX_SIZE_ERR_MSG,
+                "Expiration should be a value smaller than 4294967296 "
+                "seconds but got %" PRIu64,
+                seconds);
+        siridb_query_send_error(handle, CPROTO_ERR_QUERY);
+        return;
+    }
+
+    uint32_t old = siridb_time_in_seconds(siridb, *expiration);
+    *expiration = seconds * siridb->time->factor;
+
+    if (siridb_save(siridb))
+    {
+        snprintf(query->err_msg,
+                SIRIDB_MAX_SIZE_ERR_MSG,
+                "Error while saving database changes!");
+        siridb_query_send_error(handle, CPROTO_ERR_QUERY);
+        return;
+    }
+
+    QP_ADD_SUCCESS
+
+    log_info(MSG_SUCCESS_SET_EXPIRATION, name, old, (uint32_t) seconds);
+
+    qp_add_fmt_safe(query->packer,
+            MSG_SUCCESS_SET_EXPIRATION,
+            name,
+            old,
+            (uint32_t) seconds);
+
+    if (IS_MASTER)
+    {
+        siridb_query_forward(
+                handle,
+                SIRIDB_QUERY_FWD_UPDATE,
+                (sirinet_promises_cb) on_update_xxx_response,
+                0);
+    }
+    else
+    {
+        SIRIPARSER_ASYNC_NEXT_NODE
+    }
+}
+
+static void select_job_free(select_job_t * job)
+{
+    for (size_t i = 0; i < job->len; i++)
+    {
+        if (job->results[i] != NULL)
+        {
+            siridb_points_free(job->results[i]);
+        }
+    }
+
+    if (job->parts != NULL)
+    {
+        for (size_t i = 0; i < job->items; i++)
+        {
+            if (job->parts[i].points != NULL)
+            {
+                siridb_points_free(job->parts[i].points);
+            }
+        }
+        free(job->parts);
+    }
+
+    uv_mutex_destroy(&job->lock);
+    free(job->results);
+    free(job);
+}
+
+/*
+ * Store 'points' as the result for series 'i' of a select job and check the
+ * maximum number of selected points.
+ */
+static void select_job_result(
+        select_job_t * job,
+        siridb_t * siridb,
+        size_t i,
+        siridb_points_t * points)
+{
+    uv_mutex_lock(&job->lock);
+
+    job->results[i] = points;
+    job->n += points->len;
+
+    if (!job->err && job->n > siridb->select_points_limit)
+    {
+        job->err = 1;
+        snprintf(job->err_msg,
+                SIRIDB_MAX_SIZE_ERR_MSG,
+                "Query has reached the maximum number of selected "
+                "points (%u). Please use another time window, an "
+                "aggregation function or select less series to "
+                "reduce the number of points.",
+                siridb->select_points_limit);
+    }
+
+    uv_mutex_unlock(&job->lock);
+}
+
+/*
+ * Split long series in segments when a select has less series than workers
+ * and the first aggregate has a group by for which each group only depends
+ * on its own points. Each segment is read and aggregated by one worker and
+ * the segments are joined before the other aggregates run. Sets job->items
+ * and job->parts, where parts remains NULL when no series is split.
+ *
+ * Returns 0 if successful or -1 and a SIGNAL is raised in case of an error.
+ */
+static int select_parts_init(
+        select_job_t * job,
+        query_select_t * q_select,
+        size_t nworkers)
+{
+    siridb_series_t * series;
+    select_part_t * part;
+    uint64_t start, width;
+    size_t i, k, n, first, items = 0;
+
+    job->items = q_select->slist->len;
+    job->parts = NULL;
+
+    if (    nworkers <= q_select->slist->len ||
+            q_select->limit ||
+            !q_select->alist->len ||
+            !siridb_acache_can_use(
+                    (siridb_aggr_t *) q_select->alist->data[0]))
+    {
+        return 0;
+    }
+
+    for (i = 0; i < q_select->slist->len; i++)
+    {
+        series = (siridb_series_t *) q_select->slist->data[i];
+        items += select_parts_count(
+                q_select,
+                series,
+                nworkers,
+                &start,
+                &width);
+    }
+
+    if (items == q_select->slist->len)
+    {
+        return 0;  /* no series is split */
+    }
+
+    job->parts = (select_part_t *) calloc(items, sizeof(select_part_t));
+    if (job->parts == NULL)
+    {
+        ERR_ALLOC
+        return -1;
+    }
+
+    part = job->parts;
+
+    for (i = 0; i < q_select->slist->len; i++)
+    {
+        series = (siridb_series_t *) q_select->slist->data[i];
+        n = select_parts_count(q_select, series, nworkers, &start, &width);
+        first = part - job->parts;
+
+        for (k = 0; k < n; k++, part++)
+        {
+            part->series = i;
+            part->first = first;
+            part->n = n;
+            part->left = n;
+            part->flags =
+                    ((k == 0) ? SELECT_PART_FIRST : 0) |
+                    ((k == n - 1) ? SELECT_PART_LAST : 0);
+            part->start_ts = start + k * width;
+            part->end_ts = start + (k + 1) * width;
+        }
+    }
+
+    job->items = items;
+    return 0;
+}
+
+/*
+ * Returns the number of segments for 'series', which is 1 when the series is
+ * not split. A split series has segments of at least SELECT_PART_POINTS
+ * points, assuming the points are evenly spread over time, and at most one
+ * segment for each worker. When the series is split, 'start' is set to the
+ * first time-stamp of the first group and 'width' to the time range of each
+ * segment which is a multiple of the group by. (only the first and last
+ * segment use the start and end of the select)
+ */
+static size_t select_parts_count(
+        query_select_t * q_select,
+        siridb_series_t * series,
+        size_t nworkers,
+        uint64_t * start,
+        uint64_t * width)
+{
+    siridb_aggr_t * aggr = (siridb_aggr_t *) q_select->alist->data[0];
+    uint64_t start_ts = series->start;
+    uint64_t end_ts = series->end;  /* inclusive */
+    uint64_t groups, est, size;
+    size_t n;
+
+    if (    !siridb_series_isnum(series) ||
+            (series->flags & SIRIDB_SERIES_IS_DROPPED) ||
+            series->length < 2 * SELECT_PART_POINTS)
+    {
+        return 1;
+    }
+
+    if (q_select->start_ts != NULL && *q_select->start_ts > start_ts)
+    {
+        start_ts = *q_select->start_ts;
+    }
+
+    if (q_select->end_ts != NULL && *q_select->end_ts <= end_ts)
+    {
+        if (!*q_select->end_ts)
+        {
+            return 1;
+        }
+        end_ts = *q_select->end_ts - 1;
+    }
+
+    if (start_ts > end_ts)
+    {
+        return 1;
+    }
+
+    est = (uint64_t) ((double) series->length * (end_ts - start_ts) /
+            ((double) (series->end - series->start) + 1.0));
+    n = est / SELECT_PART_POINTS;
+
+    if (n > nworkers)
+    {
+        n = nworkers;
+    }
+
+    groups = (SIRIDB_AGGR_GROUP_TS(aggr, end_ts) -
+            SIRIDB_AGGR_GROUP_TS(aggr, start_ts)) / aggr->group_by + 1;
+
+    if (n > groups)
+    {
+        n = groups;
+    }
+
+    if (n < 2)
+    {
+        return 1;
+    }
+
+    /* groups for each segment, the last segment might have less groups */
+    size = (groups + n - 1) / n;
+
+    *start = SIRIDB_AGGR_GROUP_TS(aggr, start_ts) - aggr->group_by + 1;
+    *width = size * aggr->group_by;
+
+    return (groups + size - 1) / size;
+}
+
+/*
+ * Read segment 'i' of a split series and run the first aggregate. The worker
+ * which finishes the last segment of a series joins the segments, runs the
+ * other aggregates and stores the result for the series.
+ *
+ * Returns 0 if successful or -1 in case of an error. (err_msg is set)
+ */
+static int select_part_work(
+        select_job_t * job,
+        siridb_t * siridb,
+        query_select_t * q_select,
+        size_t i,
+        uint64_t * aggregate,
+        char * err_msg)
+{
+    select_part_t * part = job->parts + i;
+    select_part_t * first = job->parts + part->first;
+    siridb_series_t * series =
+            (siridb_series_t *) q_select->slist->data[part->series];
+    siridb_aggr_t * aggr = (siridb_aggr_t *) q_select->alist->data[0];
+    uint64_t * start_ts = (part->flags & SELECT_PART_FIRST) ?
+            q_select->start_ts : &part->start_ts;
+    uint64_t * end_ts = (part->flags & SELECT_PART_LAST) ?
+            q_select->end_ts : &part->end_ts;
+    siridb_points_t * points;
+    siridb_points_t * tmp;
+    int is_aggr = 1;
+    int exclusive;
+    size_t left;
+    uint64_t ns;
+
+    exclusive = select_lock(siridb, series, q_select);
+
+    if (series->flags & SIRIDB_SERIES_IS_DROPPED)
+    {
+        points = NULL;
+    }
+    else if (siridb->acache != NULL)
+    {
+        points = siridb_acache_select(
+                siridb,
+                series,
+                aggr,
+                start_ts,
+                end_ts,
+                err_msg);
+    }
+    else if (siridb_aggregate_can_use_stats(aggr))
+    {
+        points = siridb_series_get_aggr(
+                siridb,
+                series,
+                aggr,
+                start_ts,
+                end_ts,
+                err_msg);
+    }
+    else
+    {
+        points = siridb_series_get_points(siridb, series, start_ts, end_ts);
+        if (points == NULL)
+        {
+            sprintf(err_msg, "Memory allocation error.");
+        }
+        is_aggr = 0;
+    }
+
+    select_unlock(siridb, exclusive);
+
+    if (points == NULL && (~series->flags & SIRIDB_SERIES_IS_DROPPED))
+    {
+        return -1;  /* err_msg is set */
+    }
+
+    if (points != NULL)
+    {
+        siridb_hot_add(
+                siridb->hot,
+                SIRIDB_HOT_SELECT,
+                series->id,
+                points->len);
+
+        if (!is_aggr && points->len)
+        {
+            ns = timeit_ns();
+            tmp = siridb_aggregate_run(points, aggr, err_msg);
+            *aggregate += timeit_ns() - ns;
+            siridb_points_free(points);
+            if ((points = tmp) == NULL)
+            {
+                return -1;  /* err_msg is set */
+            }
+        }
+    }
+
+    uv_mutex_lock(&job->lock);
+    part->points = points;
+    left = --first->left;
+    uv_mutex_unlock(&job->lock);
+
+    if (left)
+    {
+        return 0;
+    }
+
+    /* this is the last segment, a series which is dropped has no result */
+    for (part = first; part < first + first->n; part++)
+    {
+        if (part->points == NULL)
+        {
+            return 0;
+        }
+    }
+
+    if ((points = select_parts_join(first, err_msg)) == NULL)
+    {
+        return -1;  /* err_msg is set */
+    }
+
+    ns = timeit_ns();
+    points = siridb_aggregate_run_list(points, q_select->alist, 1, err_msg);
+    *aggregate += timeit_ns() - ns;
+
+    if (    points == NULL ||
+            (q_select->spill != NULL &&
+            (points = select_spill(q_select, points, err_msg)) == NULL))
+    {
+        return -1;  /* err_msg is set */
+    }
+
+    select_job_result(job, siridb, first->series, points);
+    return 0;
+}
+
+/*
+ * Returns new points with the points of the segments, starting at 'first'.
+ * The points of the segments are destroyed.
+ *
+ * Returns NULL and raises a SIGNAL in case an error has occurred.
+ * (err_msg is set)
+ */
+static siridb_points_t * select_parts_join(
+        select_part_t * first,
+        char * err_msg)
+{
+    select_part_t * part, * end = first + first->n;
+    siridb_points_t * points;
+    points_tp tp = first->points->tp;
+    size_t len = 0;
+
+    /* segments without points may have the type of the series */
+    for (part = first; part < end; part++)
+    {
+        if (part->points->len && !len)
+        {
+            tp = part->points->tp;
+        }
+        len += part->points->len;
+    }
+
+    points = siridb_points_new(len, tp);
+    if (points == NULL)
+    {
+        sprintf(err_msg, "Memory allocation error.");
+        return NULL;  /* signal is raised */
+    }
+
+    for (part = first; part < end; part++)
+    {
+        if (part->points->len)
+        {
+            memcpy(points->data + points->len,
+                    part->points->data,
+                    part->points->len * sizeof(siridb_point_t));
+            points->len += part->points->len;
+        }
+        siridb_points_free(part->points);
+        part->points = NULL;
+    }
+
+    return points;
+}
+
+/*
+ * Returns 1 (true) when a select which holds 'mem' bytes has reached the
+ * memory budget for a single query, or when all queries together have
+ * reached the budget for all queries.
+ */
+static int select_over_budget(size_t mem)
+{
+    return (siri.cfg->query_memory_limit &&
+            mem > (size_t) siri.cfg->query_memory_limit * 1048576) ||
+           (siri.cfg->query_memory_total &&
+            siri_mem_get(SIRI_MEM_QUERY) >
+                (size_t) siri.cfg->query_memory_total * 1048576);
+}
+
+/*
+ * Count the memory of the points for a series and move the points to the
+ * temporary file of the select when the memory budget is reached. This
+ * function is called by the select workers and must only be used when the
+ * select has a spill file.
+ *
+ * Returns the points, which might be replaced by spilled points, or NULL in
+ * which case 'err_msg' is set and the points are destroyed.
+ */
+static siridb_points_t * select_spill(
+        query_select_t * q_select,
+        siridb_points_t * points,
+        char * err_msg)
+{
+    siridb_points_t * spilled;
+    size_t size = siridb_points_size(points);
+    size_t mem = __atomic_add_fetch(&q_select->mem, size, __ATOMIC_RELAXED);
+
+    siri_mem_add(SIRI_MEM_QUERY, size);
+
+    if (!select_over_budget(mem) || (
+            points->tp != TP_STRING &&
+            !siridb_spill_can_use(points->tp, points->len)))
+    {
+        return points;  /* small results stay in memory */
+    }
+
+    spilled = (points->tp == TP_STRING) ? NULL : siridb_spill_points(
+            q_select->spill,
+            points->tp,
+            points->len,
+            points->data);
+
+    if (spilled == NULL)
+    {
+        snprintf(err_msg,
+                SIRIDB_MAX_SIZE_ERR_MSG,
+                "Query has reached the memory budget and the %s points "
+                "cannot be moved to a temporary file. Please use another "
+                "time window, an aggregation function or select less series "
+                "to reduce the number of points.",
+                (points->tp == TP_STRING) ? "string" : "selected");
+        siridb_points_free(points);
+        return NULL;
+    }
+
+    /* only the points object itself stays in memory */
+    size -= sizeof(siridb_points_t);
+    __atomic_sub_fetch(&q_select->mem, size, __ATOMIC_RELAXED);
+    siri_mem_sub(SIRI_MEM_QUERY, size);
+
+    siridb_points_free(points);
+
+    return spilled;
+}
+
+/*
+ * Returns new points with the points of a series in a select response from
+ * another pool. The points are allocated from 'arena', or are moved to the
+ * temporary file of the select when the memory budget is reached. The
+ * memory of the arena is counted as query memory.
+ *
+ * Returns NULL in case of an error. When moving the points has failed,
+ * 'spill_err' of the select is set.
+ */
+static siridb_points_t * select_unpack_new(
+        query_select_t * q_select,
+        siridb_arena_t * arena,
+        qp_obj_t * qp_tp,
+        qp_obj_t * qp_len,
+        qp_obj_t * qp_points)
+{
+    siridb_points_t * points;
+
+    if (    q_select->spill != NULL &&
+            siridb_spill_can_use(qp_tp->via.int64, qp_len->via.int64) &&
+            select_over_budget(arena->size + __atomic_load_n(
+                    &q_select->mem,
+                    __ATOMIC_RELAXED)))
+    {
+        points = siridb_spill_points(
+                q_select->spill,
+                qp_tp->via.int64,
+                qp_len->via.int64,
+                qp_points->via.raw);
+        if (points == NULL)
+        {
+            q_select->spill_err = 1;
+        }
+        return points;
+    }
+
+    points = siridb_points_arena_new(
+            arena,
+            qp_len->via.int64,
+            qp_tp->via.int64);
+
+    if (points != NULL)
+    {
+        points->len = qp_len->via.int64;
+        memcpy(points->data, qp_points->via.raw, qp_points->len);
+    }
+
+    return points;
+}
+
+/*
+ * Add the points for a series to the result of a select query. The points
+ * are always consumed, even when an error is returned.
+ *
+ * Returns 0 if successful or -1 and an error message is set in case of an
+ * error.
+ */
+static int select_add_points(
+        siridb_query_t * query,
+        siridb_series_t * series,
+        siridb_points_t * points)
+{
+    query_select_t * q_select = (query_select_t *) query->data;
+    siridb_points_t * aggr_points;
+    const char * name;
+
+    /*
+     * The result is kept until the query is finished so we move it to
+     * the arena of the query. This releases the allocation, which is
+     * often much larger than the result, and all results are released
+     * at once when the query is freed.
+     */
+    if (    points->tp != TP_STRING &&
+            (~points->flags & SIRIDB_POINTS_FLAG_ARENA))
+    {
+        aggr_points = siridb_points_arena_copy(
+                siridb_query_arena(query),
+                points);
+
+        siridb_points_free(points);
+
+        if (aggr_points == NULL)
+        {
+            sprintf(query->err_msg, "Memory allocation error.");
+            return -1;
+        }
+
+        points = aggr_points;
+    }
+
+    q_select->n += points->len;
+
+    if (q_select->merge_as == NULL)
+    {
+        name = siridb_presuf_name(
+                q_select->presuf,
+                series->name,
+                series->name_len);
+
+        if (name == NULL || ct_add(q_select->result, name, points))
+        {
+            sprintf(query->err_msg, "Error adding points to map.");
+            siridb_points_free(points);
+            log_critical("Critical error adding points");
+            return -1;
+        }
+    }
+    else
+    {
+        slist_t ** plist;
+
+        name = siridb_presuf_name(
+                q_select->presuf,
+                q_select->merge_as,
+                strlen(q_select->merge_as));
+
+        plist = (slist_t **) ct_getaddr(q_select->result, name);
+
+        if (    name == NULL ||
+                plist == NULL ||
+                slist_append_safe(plist, points))
+        {
+            sprintf(query->err_msg, "Error adding points to map.");
+            siridb_points_free(points);
+            log_critical("Critical error adding points");
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * Create a stream when the client has requested the result in parts. When
+ * creating the stream fails, the result is simply sent in one package.
+ */
+static void select_stream_init(siridb_query_t * query)
+{
+    query_select_t * q_select = (query_select_t *) query->data;
+    query_stream_t * stream;
+
+    if (    (~query->flags & SIRIDB_QUERY_FLAG_STREAM) ||
+            q_select->stream != NULL)
+    {
+        return;
+    }
+
+    stream = (query_stream_t *) malloc(sizeof(query_stream_t));
+    if (stream == NULL)
+    {
+        return;
+    }
+
+    stream->parts = slist_new(SLIST_DEFAULT_SIZE);
+    stream->ready = slist_new(SLIST_DEFAULT_SIZE);
+    if (stream->parts == NULL || stream->ready == NULL)
+    {
+        slist_free(stream->parts);
+        slist_free(stream->ready);
+        free(stream);
+        return;
+    }
+
+    stream->client = query->client;
+    stream->result = NULL;
+    stream->busy = 0;
+    stream->wait = 0;
+    uv_mutex_init(&stream->lock);
+    uv_async_init(siri.loop, &stream->async, select_stream_send);
+
+    q_select->stream = stream;
+}
+
+/*
+ * Move the packed points to a new part for the stream and continue with a
+ * new packer. This function is called by the select work thread.
+ *
+ * Returns 0 if successful or -1 in case of an error.
+ */
+static int select_stream_part(siridb_query_t * query)
+{
+    query_select_t * q_select = (query_select_t *) query->data;
+    query_stream_t * stream = q_select->stream;
+    qp_packer_t * packer = sirinet_packer_new(QP_SUGGESTED_SIZE);
+    sirinet_pkg_t * pkg;
+    int rc;
+
+    if (packer == NULL)
+    {
+        return -1;  /* signal is raised */
+    }
+
+    qp_add_type(packer, QP_MAP_OPEN);
+
+    pkg = sirinet_packer2pkg(query->packer, query->pid, CPROTO_RES_QUERY_PART);
+    query->packer = packer;
+
+    uv_mutex_lock(&stream->lock);
+    rc = slist_append_safe(&stream->parts, pkg);
+    uv_mutex_unlock(&stream->lock);
+
+    if (rc)
+    {
+        free(pkg);
+        return -1;  /* signal is raised */
+    }
+
+    uv_async_send(&stream->async);
+
+    return 0;
+}
+
+/*
+ * Pack the next result which is ready, if any. Only one result is packed at
+ * a time so the parts are sent in order.
+ */
+static void select_stream_next(uv_async_t * handle)
+{
+    siridb_query_t * query = (siridb_query_t *) handle->data;
+    siridb_t * siridb = ((sirinet_socket_t *) query->client->data)->siridb;
+    query_select_t * q_select = (query_select_t *) query->data;
+    query_stream_t * stream = q_select->stream;
+    uv_work_t * work;
 
-    for (size_t i = 0; i < promises->len; i++)
+    if (    stream->busy ||
+            !stream->ready->len ||
+            q_select->n > siridb->select_points_limit ||
+            (query->flags & SIRIDB_QUERY_FLAG_ERR))
     {
-        promise = promises->data[i];
+        return;
+    }
 
-        if (promise == NULL)
+    work = (uv_work_t *) malloc(sizeof(uv_work_t));
+    if (work == NULL)
+    {
+        ERR_ALLOC
+        return;
+    }
+
+    stream->result = (ct_t *) slist_pop(stream->ready);
+    stream->busy = 1;
+
+    siri_async_incref(handle);
+    work->data = handle;
+    siri_sched_queue(
+                select_sched_class(query),
+                select_sched_limit(query),
+                work,
+                &select_stream_work,
+                &select_stream_work_finish);
+}
+
+static void select_stream_work(uv_work_t * work)
+{
+    uv_async_t * handle = (uv_async_t *) work->data;
+    siridb_query_t * query = (siridb_query_t *) handle->data;
+    query_stream_t * stream = ((query_select_t *) query->data)->stream;
+    uint64_t ns = timeit_ns();
+    int rc = ct_items(
+            stream->result,
+            (ct_item_cb) &items_select_stream,
+            handle);
+
+    /* the series of this result are complete, send what is left */
+    if (!rc && query->packer->len > sizeof(sirinet_pkg_t) + 1)
+    {
+        rc = select_stream_part(query);
+    }
+
+    query->stages.pack += timeit_ns() - ns;
+
+    /* rc 1 means the error message is set */
+    switch (rc)
+    {
+    case -1:
+        sprintf(query->err_msg, "Memory allocation error.");
+        /* no break */
+    case 1:
+        query->flags |= SIRIDB_QUERY_FLAG_ERR;
+    }
+}
+
+static void select_stream_work_finish(uv_work_t * work, int status)
+{
+    uv_async_t * handle = (uv_async_t *) work->data;
+    siridb_query_t * query = (siridb_query_t *) handle->data;
+    query_stream_t * stream = ((query_select_t *) query->data)->stream;
+
+    free(work);
+
+    ct_free(stream->result, (ct_free_cb) &siridb_points_free);
+    stream->result = NULL;
+    stream->busy = 0;
+
+    if (status)
+    {
+        log_error("Select stream work failed (error: %s)", uv_strerror(status));
+        query->flags |= SIRIDB_QUERY_FLAG_ERR;
+    }
+
+    siri_async_decref(&handle);
+
+    if (handle == NULL)
+    {
+        /* the query is destroyed so the stream is not closed otherwise */
+        if (!siri_err)
         {
-            err_count++;
-            snprintf(query->err_msg,
-                    SIRIDB_MAX_SIZE_ERR_MSG,
-                    "Error occurred while sending the database change to at "
-                    "least one required server");
+            uv_close((uv_handle_t *) &stream->async, select_stream_free);
         }
-        else
-        {
-            pkg = (sirinet_pkg_t *) promise->data;
+        return;
+    }
 
-            if (pkg == NULL || pkg->tp != BPROTO_RES_QUERY)
-            {
-                err_count++;
-                snprintf(query->err_msg,
-                        SIRIDB_MAX_SIZE_ERR_MSG,
-                        "Error occurred while sending the database change to "
-                        "at least '%s'", promise->server->name);
-            }
+    if (siri_err)
+    {
+        return;
+    }
 
-            /* make sure we free the promise and data */
-            free(promise->data);
-            sirinet_promise_decref(promise);
-        }
+    select_stream_next(handle);
+
+    if (stream->wait && !stream->busy)
+    {
+        select_response_done(handle);
     }
+}
 
-    if (err_count)
+/*
+ * Send the parts which are ready to the client.
+ */
+static void select_stream_send(uv_async_t * async)
+{
+    query_stream_t * stream = (query_stream_t *) async;
+
+    uv_mutex_lock(&stream->lock);
+
+    for (size_t i = 0; i < stream->parts->len; i++)
     {
-        siridb_query_send_error(handle, CPROTO_ERR_QUERY);
+        /* ignore result code, signal can be raised */
+        sirinet_pkg_send(
+                stream->client,
+                (sirinet_pkg_t *) stream->parts->data[i]);
     }
-    else
+    stream->parts->len = 0;
+
+    uv_mutex_unlock(&stream->lock);
+}
+
+/*
+ * Send the remaining parts before the final result is sent and close the
+ * stream. In case of a forced shutdown the parts are not sent.
+ */
+static void select_stream_close(query_select_t * q_select)
+{
+    query_stream_t * stream = q_select->stream;
+
+    if (stream == NULL)
     {
-        SIRIPARSER_ASYNC_NEXT_NODE
+        return;
+    }
+
+    q_select->stream = NULL;
+
+    if (!siri_err)
+    {
+        select_stream_send(&stream->async);
     }
+
+    uv_close((uv_handle_t *) &stream->async, select_stream_free);
 }
 
-/******************************************************************************
- * Helper functions
- *****************************************************************************/
+static void select_stream_free(uv_handle_t * handle)
+{
+    query_stream_t * stream = (query_stream_t *) handle;
+
+    for (size_t i = 0; i < stream->parts->len; i++)
+    {
+        free(stream->parts->data[i]);
+    }
+
+    for (size_t i = 0; i < stream->ready->len; i++)
+    {
+        ct_free(
+                (ct_t *) stream->ready->data[i],
+                (ct_free_cb) &siridb_points_free);
+    }
 
+    uv_mutex_destroy(&stream->lock);
+    slist_free(stream->parts);
+    slist_free(stream->ready);
+    free(stream);
+}
 
 static void master_select_work(uv_work_t * work)
 {
@@ -5374,14 +8289,30 @@ static void master_select_work(uv_work_t * work)
     query_select_t * q_select = (query_select_t *) query->data;
     siridb_t * siridb = ((sirinet_socket_t *) query->client->data)->siridb;
     siridb->selected_points += q_select->n;
-    int rc = ct_items(
+    query->stages.mark = timeit_ns();
+
+    /* series which are joined by other pools are joined already */
+    if (    q_select->join != NULL &&
+            select_join(q_select, 1, query->err_msg))
+    {
+        query->flags |= SIRIDB_QUERY_FLAG_ERR;
+        return;
+    }
+
+    /* the result holds the best series of each pool, select the best */
+    int rc = (q_select->top && select_top(q_select)) ? -1 : ct_items(
             q_select->result,
+            (q_select->stream != NULL) ?
+                    (ct_item_cb) &items_select_stream
+                    :
             (q_select->merge_as == NULL) ?
                     (ct_item_cb) &items_select_master
                     :
                     (ct_item_cb) &items_select_master_merge,
             handle);
 
+    stage_end(query, &query->stages.pack);
+
     /* Do not set an error message when rc==1 since in that case the message
      * is already set.
      */
@@ -5397,6 +8328,9 @@ static void master_select_work(uv_work_t * work)
 
 static void master_select_work_finish(uv_work_t * work, int status)
 {
+    select_stream_close((query_select_t *)
+            ((siridb_query_t *) ((uv_async_t *) work->data)->data)->data);
+
     if (status)
     {
         log_error("Select work failed (error: %s)", uv_strerror(status));
@@ -5411,6 +8345,9 @@ static void master_select_work_finish(uv_work_t * work, int status)
 
         uv_async_t * handle = (uv_async_t *) work->data;
         siridb_query_t * query = (siridb_query_t *) handle->data;
+        query_select_t * q_select = (query_select_t *) query->data;
+        siridb_t * siridb =
+                ((sirinet_socket_t *) query->client->data)->siridb;
 
         if (query->flags & SIRIDB_QUERY_FLAG_ERR)
         {
@@ -5418,6 +8355,16 @@ static void master_select_work_finish(uv_work_t * work, int status)
         }
         else
         {
+            /* store the result when prepared by master_select_cached() */
+            if (q_select->qentry != NULL && query->nodes == NULL)
+            {
+                siridb_qcache_set(
+                        siridb->qcache,
+                        q_select->qentry,
+                        query->packer->buffer + sizeof(sirinet_pkg_t),
+                        query->packer->len - sizeof(sirinet_pkg_t));
+                q_select->qentry = NULL;
+            }
             uv_async_send(handle);
         }
     }
@@ -5427,6 +8374,33 @@ static void master_select_work_finish(uv_work_t * work, int status)
     free(work);
 }
 
+/*
+ * Returns the scheduler class for the workers of a select query. The class
+ * is set for the user or heavy when the select reads many points.
+ */
+static siri_sched_class_t select_sched_class(siridb_query_t * query)
+{
+    query_select_t * q_select = (query_select_t *) query->data;
+    sirinet_socket_t * ssocket = (sirinet_socket_t *) query->client->data;
+    siri_sched_class_t cls = SIRI_SCHED_INTERACTIVE;
+
+    if (ssocket->tp == SOCKET_CLIENT && ssocket->origin != NULL)
+    {
+        cls = (siri_sched_class_t) ((siridb_user_t *) ssocket->origin)->sched;
+    }
+
+    return (cls == SIRI_SCHED_INTERACTIVE && q_select->is_heavy) ?
+            SIRI_SCHED_HEAVY : cls;
+}
+
+/*
+ * Returns the scheduler threads limit for the database of a select query.
+ */
+static siri_sched_limit_t * select_sched_limit(siridb_query_t * query)
+{
+    return &((sirinet_socket_t *) query->client->data)->siridb->sched_limit;
+}
+
 static int items_select_master(
         const char * name,
         size_t len,
@@ -5435,13 +8409,19 @@ static int items_select_master(
 {
     siridb_query_t * query = (siridb_query_t *) handle->data;
 
+    /* rc 1 means the error message is set */
+    if (siridb_query_is_cancelled(query, query->err_msg))
+    {
+        return 1;
+    }
+
     if (query->factor)
     {
         siridb_points_ts_correction(points, (double) query->factor);
     }
 
     if (    qp_add_raw(query->packer, name, len) ||
-            siridb_points_pack(points, query->packer))
+            select_pack_points(query, points))
     {
         sprintf(query->err_msg, "Memory allocation error.");
         return -1;
@@ -5450,6 +8430,26 @@ static int items_select_master(
     return 0;
 }
 
+/*
+ * Pack the points like items_select_master() or items_select_master_merge()
+ * and create a new part for the stream when enough data is packed.
+ */
+static int items_select_stream(
+        const char * name,
+        size_t len,
+        void * data,
+        uv_async_t * handle)
+{
+    siridb_query_t * query = (siridb_query_t *) handle->data;
+    query_select_t * q_select = (query_select_t *) query->data;
+    int rc = (q_select->merge_as == NULL) ?
+            items_select_master(name, len, (siridb_points_t *) data, handle) :
+            items_select_master_merge(name, len, (slist_t *) data, handle);
+
+    return (rc || query->packer->len < SELECT_STREAM_PART_SIZE) ?
+            rc : select_stream_part(query);
+}
+
 static int items_select_master_merge(
         const char * name,
         size_t len,
@@ -5459,6 +8459,9 @@ static int items_select_master_merge(
     siridb_query_t * query = (siridb_query_t *) handle->data;
     query_select_t * q_select = (query_select_t *) query->data;
     siridb_points_t * points;
+    size_t aggr_start = 0;
+    slist_t * partial = (q_select->partial == NULL) ?
+            NULL : (slist_t *) ct_getn(q_select->partial, name, len);
 
     if (qp_add_raw(query->packer, name, len))
     {
@@ -5466,7 +8469,17 @@ static int items_select_master_merge(
         return -1;
     }
 
-    switch (plist->len)
+    if (partial != NULL && partial->len && q_select->mlist != NULL)
+    {
+        /* other pools have sent partial aggregates */
+        points = select_merge_partial(
+                plist,
+                partial,
+                (siridb_aggr_t *) q_select->mlist->data[0],
+                query->err_msg);
+        aggr_start = 1;
+    }
+    else switch (plist->len)
     {
     case 0:
         points = siridb_points_new(0, TP_INT);
@@ -5479,31 +8492,35 @@ static int items_select_master_merge(
         points = slist_pop(plist);
         break;
     default:
-        points = siridb_points_merge(plist, query->err_msg);
+        if (    q_select->mlist != NULL &&
+                siridb_aggregate_can_merge(
+                    (siridb_aggr_t *) q_select->mlist->data[0]))
+        {
+            /* merge and aggregate without creating all merged points */
+            points = siridb_points_merge_aggr(
+                    plist,
+                    (siridb_aggr_t *) q_select->mlist->data[0],
+                    query->err_msg);
+            aggr_start = 1;
+        }
+        else
+        {
+            points = siridb_points_merge(plist, query->err_msg);
+        }
         break;
     }
 
     if (q_select->mlist != NULL && points != NULL)
     {
-        siridb_points_t * aggr_points;
-        for (size_t i = 0; points->len && i < q_select->mlist->len; i++)
-        {
-            aggr_points = siridb_aggregate_run(
-                    points,
-                    (siridb_aggr_t *) q_select->mlist->data[i],
-                    query->err_msg);
-
-            if (aggr_points != points)
-            {
-                siridb_points_free(points);
-            }
-
-            if (aggr_points == NULL)
-            {
-                return -1;  // (error message is set)
-            }
+        points = siridb_aggregate_run_list(
+                points,
+                q_select->mlist,
+                aggr_start,
+                query->err_msg);
 
-            points = aggr_points;
+        if (points == NULL)
+        {
+            return -1;  // (error message is set)
         }
     }
 
@@ -5516,21 +8533,150 @@ static int items_select_master_merge(
         return -1;
     }
 
-    if (query->factor)
+    if (query->factor)
+    {
+        siridb_points_ts_correction(points, (double) query->factor);
+    }
+
+    if (select_pack_points(query, points))
+    {
+        sprintf(query->err_msg, "Memory allocation error.");
+        siridb_points_free(points);
+        return -1;
+    }
+
+    siridb_points_free(points);
+
+    return 0;
+}
+
+/*
+ * Returns the merge aggregate for 'plist' combined with the partial
+ * aggregates from other pools. (see items_select_other_partial())
+ *
+ * Returns NULL in case an error has occurred. (err_msg is set)
+ */
+static siridb_points_t * select_merge_partial(
+        slist_t * plist,
+        slist_t * partial,
+        siridb_aggr_t * aggr,
+        char * err_msg)
+{
+    siridb_points_t * points;
+    siridb_points_t * counts = NULL;
+    siridb_points_t * tmp;
+    int is_mean = aggr->gid == CLERI_GID_F_MEAN;
+    uint32_t gid = is_mean ? CLERI_GID_F_SUM : aggr->gid;
+    size_t step = is_mean ? 2 : 1;
+
+    if (siridb_variance_is_gid(aggr->gid))
+    {
+        return select_merge_variance(plist, partial, aggr, err_msg);
+    }
+
+    if (plist->len)
+    {
+        points = siridb_points_merge_partial(plist, aggr, &counts, err_msg);
+    }
+    else
+    {
+        points = siridb_points_new(0, TP_INT);
+        counts = is_mean ? siridb_points_new(0, TP_INT) : NULL;
+        if (points == NULL || (is_mean && counts == NULL))
+        {
+            sprintf(err_msg, "Memory allocation error.");
+        }
+    }
+
+    for (size_t i = 0;
+            points != NULL && (!is_mean || counts != NULL) &&
+            i + step <= partial->len;
+            i += step)
+    {
+        tmp = siridb_aggregate_combine_partial(
+                points,
+                (siridb_points_t *) partial->data[i],
+                gid,
+                err_msg);
+        siridb_points_free(points);
+        points = tmp;
+
+        if (is_mean && points != NULL)
+        {
+            tmp = siridb_aggregate_combine_partial(
+                    counts,
+                    (siridb_points_t *) partial->data[i + 1],
+                    CLERI_GID_F_COUNT,
+                    err_msg);
+            siridb_points_free(counts);
+            counts = tmp;
+        }
+    }
+
+    if (points == NULL || (is_mean && counts == NULL))
+    {
+        if (points != NULL)
+        {
+            siridb_points_free(points);
+        }
+        if (counts != NULL)
+        {
+            siridb_points_free(counts);
+        }
+        return NULL;
+    }
+
+    return is_mean ?
+            siridb_aggregate_stream_mean(points, counts, err_msg) : points;
+}
+
+/*
+ * Like select_merge_partial() but for a variance or pvariance, each pool
+ * sends the count, mean and m2 for each group.
+ * (see siridb_variance_parts_combine())
+ *
+ * Returns NULL in case an error has occurred. (err_msg is set)
+ */
+static siridb_points_t * select_merge_variance(
+        slist_t * plist,
+        slist_t * partial,
+        siridb_aggr_t * aggr,
+        char * err_msg)
+{
+    siridb_points_t * parts[SIRIDB_VARIANCE_PARTS];
+    siridb_points_t * points;
+
+    if (plist->len)
     {
-        siridb_points_ts_correction(points, (double) query->factor);
+        if (siridb_points_merge_variance(plist, aggr, parts, err_msg))
+        {
+            return NULL;  /* err_msg is set */
+        }
+    }
+    else if (siridb_variance_parts_new(parts, 0))
+    {
+        sprintf(err_msg, "Memory allocation error.");
+        return NULL;  /* signal is raised */
     }
 
-    if (siridb_points_pack(points, query->packer))
+    for (size_t i = 0;
+            i + SIRIDB_VARIANCE_PARTS <= partial->len;
+            i += SIRIDB_VARIANCE_PARTS)
     {
-        sprintf(query->err_msg, "Memory allocation error.");
-        siridb_points_free(points);
-        return -1;
+        if (siridb_variance_parts_combine(
+                parts,
+                (siridb_points_t **) partial->data + i,
+                err_msg))
+        {
+            siridb_variance_parts_free(parts);
+            return NULL;  /* err_msg is set */
+        }
     }
 
-    siridb_points_free(points);
+    points = siridb_variance_parts_finish(parts, aggr->gid, err_msg);
+    siridb_variance_parts_free(parts);
 
-    return 0;
+    return points;
 }
 
 /*
@@ -5560,7 +8706,19 @@ static int items_select_other_merge(
         uv_async_t * handle)
 {
     siridb_query_t * query = (siridb_query_t *) handle->data;
-    int rc = qp_add_raw_term(query->packer, name, len) ||
+    query_select_t * q_select = (query_select_t *) query->data;
+    int rc;
+
+    if (    plist->len &&
+            q_select->mlist != NULL &&
+            siridb_aggregate_can_merge(
+                (siridb_aggr_t *) q_select->mlist->data[0]) &&
+            (rc = items_select_other_partial(name, len, plist, handle)) <= 0)
+    {
+        return rc;
+    }
+
+    rc = qp_add_raw_term(query->packer, name, len) ||
             qp_add_type(query->packer, QP_ARRAY_OPEN);
 
     for (size_t i = 0; !rc && i < plist->len; i++)
@@ -5573,9 +8731,80 @@ static int items_select_other_merge(
     return -(rc || qp_add_type(query->packer, QP_ARRAY_CLOSE));
 }
 
+/*
+ * Pack the partial merge aggregate for 'plist' instead of all the points so
+ * the master only needs to combine the partial aggregates of each pool. The
+ * name is followed by the number of packed points, for a mean the sums are
+ * followed by the counts.
+ *
+ * Returns 0 when successful and -1 in case of an error. (a SIGNAL is raised
+ * in case of an error) When the partial aggregate cannot be created, 1 is
+ * returned and the points are still in 'plist'. The points should be sent
+ * instead so the master can report the error.
+ */
+static int items_select_other_partial(
+        const char * name,
+        size_t len,
+        slist_t * plist,
+        uv_async_t * handle)
+{
+    siridb_query_t * query = (siridb_query_t *) handle->data;
+    query_select_t * q_select = (query_select_t *) query->data;
+    siridb_aggr_t * aggr = (siridb_aggr_t *) q_select->mlist->data[0];
+    siridb_points_t * parts[SIRIDB_VARIANCE_PARTS];
+    siridb_points_t * counts;
+    siridb_points_t * points;
+    int rc;
+
+    if (siridb_variance_is_gid(aggr->gid))
+    {
+        if (siridb_points_merge_variance(plist, aggr, parts, query->err_msg))
+        {
+            *query->err_msg = '\0';
+            return 1;
+        }
+
+        rc = qp_add_raw_term(query->packer, name, len) ||
+                qp_add_int8(query->packer, SIRIDB_VARIANCE_PARTS);
+
+        for (int i = 0; !rc && i < SIRIDB_VARIANCE_PARTS; i++)
+        {
+            rc = siridb_points_raw_pack(parts[i], query->packer);
+        }
+
+        siridb_variance_parts_free(parts);
+
+        return -rc;
+    }
+
+    points = siridb_points_merge_partial(plist, aggr, &counts, query->err_msg);
+
+    if (points == NULL)
+    {
+        *query->err_msg = '\0';
+        return 1;
+    }
+
+    rc = qp_add_raw_term(query->packer, name, len) ||
+            qp_add_int8(query->packer, (counts == NULL) ? 1 : 2) ||
+            siridb_points_raw_pack(points, query->packer) ||
+            (counts != NULL && siridb_points_raw_pack(counts, query->packer));
+
+    siridb_points_free(points);
+
+    if (counts != NULL)
+    {
+        siridb_points_free(counts);
+    }
+
+    return -rc;
+}
+
 static void on_select_unpack_points(
         qp_unpacker_t * unpacker,
         query_select_t * q_select,
+        ct_t * result,
+        siridb_arena_t * arena,
         qp_obj_t * qp_name,
         qp_obj_t * qp_tp,
         qp_obj_t * qp_len,
@@ -5584,13 +8813,163 @@ static void on_select_unpack_points(
 {
     siridb_points_t * points;
 
-    while ( q_select->n <= select_points_limit &&
+    while ( arena != NULL &&
+            q_select->n <= select_points_limit &&
+            !q_select->spill_err &&
             qp_is_raw(qp_next(unpacker, qp_name)) &&
             qp_is_raw_term(qp_name) &&
             qp_is_array(qp_next(unpacker, NULL)) &&
             qp_is_int(qp_next(unpacker, qp_tp)) &&
             qp_is_int(qp_next(unpacker, qp_len)) &&
             qp_is_raw(qp_next(unpacker, qp_points)))
+    {
+        points = select_unpack_new(
+                q_select,
+                arena,
+                qp_tp,
+                qp_len,
+                qp_points);
+
+        if (points != NULL)
+        {
+            if (ct_add(result, qp_name->via.raw, points))
+            {
+                siridb_points_free(points);
+            }
+            else
+            {
+                q_select->n += points->len;
+            }
+        }
+
+        qp_next(unpacker, NULL);  // QP_ARRAY_CLOSE
+    }
+}
+
+static void on_select_unpack_merged_points(
+        qp_unpacker_t * unpacker,
+        query_select_t * q_select,
+        siridb_arena_t * arena,
+        qp_obj_t * qp_name,
+        qp_obj_t * qp_tp,
+        qp_obj_t * qp_len,
+        qp_obj_t * qp_points,
+        uint32_t select_points_limit)
+{
+    siridb_points_t * points;
+    qp_types_t tp;
+
+    while ( arena != NULL &&
+            qp_is_raw(qp_next(unpacker, qp_name)) &&
+#ifdef DEBUG
+            qp_is_raw_term(qp_name) &&
+#endif
+            (qp_is_array(tp = qp_next(unpacker, qp_len)) || qp_is_int(tp)))
+
+    {
+        if (qp_is_int(tp))
+        {
+            on_select_unpack_partial(
+                    unpacker,
+                    q_select,
+                    qp_name,
+                    qp_tp,
+                    qp_len,
+                    qp_points);
+            continue;
+        }
+
+        slist_t ** plist = (slist_t **) ct_getaddr(
+                q_select->result,
+                qp_name->via.raw);
+
+        while ( q_select->n <= select_points_limit &&
+                !q_select->spill_err &&
+                qp_is_array(qp_next(unpacker, NULL)) &&
+                qp_is_int(qp_next(unpacker, qp_tp)) &&
+                qp_is_int(qp_next(unpacker, qp_len)) &&
+                qp_is_raw(qp_next(unpacker, qp_points)))
+        {
+
+    #ifdef DEBUG
+            assert (qp_len->via.int64 * sizeof(siridb_point_t) ==
+                    qp_points->len);
+    #endif
+            points = select_unpack_new(
+                    q_select,
+                    arena,
+                    qp_tp,
+                    qp_len,
+                    qp_points);
+
+            if (points != NULL)
+            {
+                if (slist_append_safe(plist, points))
+                {
+                    siridb_points_free(points);
+                }
+                else
+                {
+                    q_select->n += points->len;
+                }
+            }
+
+            qp_next(unpacker, NULL);  // QP_ARRAY_CLOSE
+        }
+    }
+}
+
+/*
+ * Unpack the partial merge aggregate from another pool. When called, the
+ * number of points which follow the name is unpacked in 'qp_len'.
+ * (see items_select_other_partial())
+ */
+static void on_select_unpack_partial(
+        qp_unpacker_t * unpacker,
+        query_select_t * q_select,
+        qp_obj_t * qp_name,
+        qp_obj_t * qp_tp,
+        qp_obj_t * qp_len,
+        qp_obj_t * qp_points)
+{
+    siridb_points_t * points;
+    slist_t ** plist = NULL;
+    slist_t * partial;
+    int64_t n = qp_len->via.int64;
+
+    if (q_select->partial == NULL)
+    {
+        q_select->partial = ct_new();
+    }
+
+    if (    q_select->partial != NULL &&
+            (plist = (slist_t **) ct_getaddr(
+                q_select->partial,
+                qp_name->via.raw)) == NULL &&
+            (partial = slist_new(SLIST_DEFAULT_SIZE)) != NULL)
+    {
+        if (ct_add(q_select->partial, qp_name->via.raw, partial) == 0)
+        {
+            plist = (slist_t **) ct_getaddr(
+                    q_select->partial,
+                    qp_name->via.raw);
+        }
+        else
+        {
+            slist_free(partial);
+        }
+    }
+
+    if (plist == NULL)
+    {
+        ERR_ALLOC
+    }
+
+    for (; n > 0 &&
+            qp_is_array(qp_next(unpacker, NULL)) &&
+            qp_is_int(qp_next(unpacker, qp_tp)) &&
+            qp_is_int(qp_next(unpacker, qp_len)) &&
+            qp_is_raw(qp_next(unpacker, qp_points)); n--)
     {
         points = siridb_points_new(qp_len->via.int64, qp_tp->via.int64);
 
@@ -5600,7 +8979,7 @@ static void on_select_unpack_points(
 
             memcpy(points->data, qp_points->via.raw, qp_points->len);
 
-            if (ct_add(q_select->result, qp_name->via.raw, points))
+            if (plist == NULL || slist_append_safe(plist, points))
             {
                 siridb_points_free(points);
             }
@@ -5614,61 +8993,298 @@ static void on_select_unpack_points(
     }
 }
 
-static void on_select_unpack_merged_points(
-        qp_unpacker_t * unpacker,
-        query_select_t * q_select,
-        qp_obj_t * qp_name,
-        qp_obj_t * qp_tp,
-        qp_obj_t * qp_len,
-        qp_obj_t * qp_points,
-        uint32_t select_points_limit)
+/*
+ * Replace the series in q_select->result with the series joined by
+ * q_select->join_ops. The operators are applied from left to right.
+ *
+ * A pool which has all series for the join sends only the joined series to
+ * the master. Other pools send only the series which are used by the join,
+ * the master joins them or uses the series joined by a pool.
+ *
+ * Returns 0 if successful or -1 in case of an error. (err_msg is set)
+ */
+static int select_join(
+        query_select_t * q_select,
+        int is_master,
+        char * err_msg)
+{
+    slist_t * join = q_select->join;
+    siridb_points_t * points;
+    siridb_points_t * joined;
+    const char * missing = NULL;
+    ct_t * result;
+    size_t i, found = 0;
+
+    for (i = 0; i < join->len; i++)
+    {
+        if (ct_get(q_select->result, join->data[i]) != NULL)
+        {
+            found++;
+        }
+        else if (missing == NULL)
+        {
+            missing = join->data[i];
+        }
+    }
+
+    if (    missing != NULL &&
+            is_master &&
+            !found &&
+            ct_get(q_select->result, q_select->join_as) != NULL)
+    {
+        return 0;  /* joined by another pool */
+    }
+
+    if (missing != NULL && is_master)
+    {
+        snprintf(err_msg,
+                SIRIDB_MAX_SIZE_ERR_MSG,
+                "Cannot find series '%s' for the join.",
+                missing);
+        return -1;
+    }
+
+    result = ct_new();
+    if (result == NULL)
+    {
+        sprintf(err_msg, "Memory allocation error.");
+        return -1;
+    }
+
+    if (missing != NULL)
+    {
+        /* the master needs only the series for the join */
+        for (i = 0; i < join->len; i++)
+        {
+            points = (siridb_points_t *) ct_pop(
+                    q_select->result,
+                    join->data[i]);
+
+            if (points != NULL && ct_add(result, join->data[i], points))
+            {
+                siridb_points_free(points);
+                ct_free(result, (ct_free_cb) &siridb_points_free);
+                sprintf(err_msg, "Memory allocation error.");
+                return -1;
+            }
+        }
+    }
+    else
+    {
+        points = siridb_points_join(
+                (siridb_points_t *) ct_get(q_select->result, join->data[0]),
+                (siridb_points_t *) ct_get(q_select->result, join->data[1]),
+                q_select->join_ops[0],
+                err_msg);
+
+        for (i = 2; points != NULL && i < join->len; i++)
+        {
+            joined = siridb_points_join(
+                    points,
+                    (siridb_points_t *) ct_get(
+                            q_select->result,
+                            join->data[i]),
+                    q_select->join_ops[i - 1],
+                    err_msg);
+            siridb_points_free(points);
+            points = joined;
+        }
+
+        if (points == NULL || ct_add(result, q_select->join_as, points))
+        {
+            if (points != NULL)
+            {
+                siridb_points_free(points);
+                sprintf(err_msg, "Memory allocation error.");
+            }
+            ct_free(result, NULL);
+            return -1;
+        }
+    }
+
+    ct_free(q_select->result, (ct_free_cb) &siridb_points_free);
+    q_select->result = result;
+
+    return 0;
+}
+
+/*
+ * Keep only the 'top' best series in q_select->result. The other points are
+ * released. Series without points in range or with string values are not
+ * ranked and are removed too.
+ *
+ * Returns 0 if successful or -1 in case of an allocation error. The result
+ * might be incomplete after an error so the query must fail.
+ */
+static int select_top(query_select_t * q_select)
+{
+    size_t size = (q_select->top < q_select->result->len) ?
+            q_select->top : q_select->result->len;
+    select_top_t * top = (select_top_t *) malloc(
+            sizeof(select_top_t) + size * sizeof(select_top_item_t));
+
+    if (top == NULL)
+    {
+        return -1;
+    }
+
+    top->size = size;
+    top->len = 0;
+    top->sign = q_select->top_sign;
+    top->err = 0;
+    top->result = ct_new();
+
+    if (top->result == NULL)
+    {
+        free(top);
+        return -1;
+    }
+
+    ct_items(q_select->result, (ct_item_cb) items_select_top_score, top);
+
+    /* sorted by points for bsearch() in items_select_top_keep() */
+    qsort(top->items, top->len, sizeof(select_top_item_t), select_top_cmp);
+
+    /* all points are moved or released, even when an error occurs */
+    ct_items(q_select->result, (ct_item_cb) items_select_top_keep, top);
+    ct_free(q_select->result, NULL);
+    q_select->result = top->result;
+
+    if (top->err)
+    {
+        free(top);
+        return -1;
+    }
+
+    free(top);
+    return 0;
+}
+
+/*
+ * Call-back function: ct_item_cb
+ *
+ * Add the series to the candidates when the heap is not full or when it is
+ * better than the worst candidate, which is then replaced.
+ */
+static int items_select_top_score(
+        const char * name __attribute__((unused)),
+        size_t len __attribute__((unused)),
+        siridb_points_t * points,
+        select_top_t * top)
+{
+    double val, score;
+    size_t i;
+
+    if (!points->len || points->tp == TP_STRING || !top->size)
+    {
+        return 0;
+    }
+
+    for (i = 0; i < points->len; i++)
+    {
+        val = top->sign * ((points->tp == TP_INT) ?
+                (double) points->data[i].val.int64 :
+                points->data[i].val.real);
+        if (i == 0 || val > score)
+        {
+            score = val;
+        }
+    }
+
+    if (top->len < top->size)
+    {
+        /* sift up the new candidate */
+        for (i = top->len++; i && top->items[(i - 1) / 2].score > score;)
+        {
+            top->items[i] = top->items[(i - 1) / 2];
+            i = (i - 1) / 2;
+        }
+        top->items[i].score = score;
+        top->items[i].points = points;
+    }
+    else if (score > top->items[0].score)
+    {
+        top->items[0].score = score;
+        top->items[0].points = points;
+        select_top_sift(top, 0);
+    }
+
+    return 0;
+}
+
+/*
+ * Call-back function: ct_item_cb
+ *
+ * Move the points of a candidate to the new result and release the others.
+ */
+static int items_select_top_keep(
+        const char * name,
+        size_t len,
+        siridb_points_t * points,
+        select_top_t * top)
 {
-    siridb_points_t * points;
+    select_top_item_t item;
+    char key[len + 1];
 
-    while ( qp_is_raw(qp_next(unpacker, qp_name)) &&
-#ifdef DEBUG
-            qp_is_raw_term(qp_name) &&
-#endif
-            qp_is_array(qp_next(unpacker, NULL)))
+    item.points = points;
 
+    if (!bsearch(
+            &item,
+            top->items,
+            top->len,
+            sizeof(select_top_item_t),
+            select_top_cmp))
     {
-        slist_t ** plist = (slist_t **) ct_getaddr(
-                q_select->result,
-                qp_name->via.raw);
-
-        while ( q_select->n <= select_points_limit &&
-                qp_is_array(qp_next(unpacker, NULL)) &&
-                qp_is_int(qp_next(unpacker, qp_tp)) &&
-                qp_is_int(qp_next(unpacker, qp_len)) &&
-                qp_is_raw(qp_next(unpacker, qp_points)))
-        {
+        siridb_points_free(points);
+        return 0;
+    }
 
-            points = siridb_points_new(qp_len->via.int64, qp_tp->via.int64);
+    memcpy(key, name, len);
+    key[len] = '\0';
 
-            if (points != NULL)
-            {
-    #ifdef DEBUG
-                assert (qp_len->via.int64 * sizeof(siridb_point_t) ==
-                        qp_points->len);
-    #endif
-                points->len = qp_len->via.int64;
+    if (ct_add(top->result, key, points))
+    {
+        siridb_points_free(points);
+        top->err = 1;
+    }
 
-                memcpy(points->data, qp_points->via.raw, qp_points->len);
+    return 0;
+}
 
+/*
+ * Sift the candidate at position 'i' down the min-heap.
+ */
+static void select_top_sift(select_top_t * top, size_t i)
+{
+    select_top_item_t item = top->items[i];
+    size_t child;
 
-                if (slist_append_safe(plist, points))
-                {
-                    siridb_points_free(points);
-                }
-                else
-                {
-                    q_select->n += points->len;
-                }
-            }
+    while ((child = 2 * i + 1) < top->len)
+    {
+        if (    child + 1 < top->len &&
+                top->items[child + 1].score < top->items[child].score)
+        {
+            child++;
+        }
 
-            qp_next(unpacker, NULL);  // QP_ARRAY_CLOSE
+        if (top->items[child].score >= item.score)
+        {
+            break;
         }
+
+        top->items[i] = top->items[child];
+        i = child;
     }
+
+    top->items[i] = item;
+}
+
+static int select_top_cmp(const void * a, const void * b)
+{
+    uintptr_t pa = (uintptr_t) ((const select_top_item_t *) a)->points;
+    uintptr_t pb = (uintptr_t) ((const select_top_item_t *) b)->points;
+
+    return (pa > pb) - (pa < pb);
 }
 
 static int values_list_groups(siridb_group_t * group, uv_async_t * handle)
@@ -5763,3 +9379,375 @@ static void finish_count_groups(uv_async_t * handle)
 
     SIRIPARSER_ASYNC_NEXT_NODE
 }
+
+/*
+ * Add the time since the start of the running stage to 'stage'. Nothing is
+ * added when no stage is running.
+ */
+static void stage_end(siridb_query_t * query, uint64_t * stage)
+{
+    if (query->stages.mark)
+    {
+        *stage += timeit_ns() - query->stages.mark;
+        query->stages.mark = 0;
+    }
+}
+
+/*
+ * Returns a list with the series for 'ids' and increments the reference
+ * counter for each series or NULL in case of a memory error.
+ *
+ * Warning: the series_mutex must be locked.
+ */
+static slist_t * series_re_candidates(
+        siridb_t * siridb,
+        siridb_trigrams_ids_t * ids)
+{
+    siridb_series_t * series;
+    slist_t * slist = slist_new(ids->len);
+
+    if (slist == NULL)
+    {
+        return NULL;
+    }
+
+    for (size_t i = 0; i < ids->len; i++)
+    {
+        series = (siridb_series_t *) dmap_get(siridb->series_map, ids->ids[i]);
+        if (series != NULL)
+        {
+            siridb_series_incref(series);
+            slist_append(slist, series);
+        }
+    }
+
+    return slist;
+}
+
+/*
+ * Returns a list with the series from a match cache entry. References are
+ * counted for the series in the list. All series exist since no series is
+ * created or dropped after the entry was made.
+ *
+ * Returns NULL in case of a memory error.
+ */
+static slist_t * series_re_cached(
+        siridb_t * siridb,
+        siridb_mcache_entry_t * entry)
+{
+    siridb_series_t * series;
+    slist_t * slist = slist_new(entry->n);
+
+    if (slist == NULL)
+    {
+        return NULL;
+    }
+
+    for (size_t i = 0; i < entry->n; i++)
+    {
+        series = (siridb_series_t *) dmap_get(
+                siridb->series_map,
+                entry->ids[i]);
+        if (series != NULL)
+        {
+            siridb_series_incref(series);
+            slist_append(slist, series);
+        }
+    }
+
+    return slist;
+}
+
+/*
+ * Returns 1 when a regular expression is matched against all series in the
+ * database or 0 when only the series map of the query is filtered.
+ */
+static int series_re_is_full(query_wrapper_t * q_wrapper)
+{
+    return (q_wrapper->update_cb == NULL ||
+            q_wrapper->update_cb == &imap_union_ref ||
+            q_wrapper->update_cb == &imap_symmetric_difference_ref);
+}
+
+/*
+ * Apply the intersection or difference with 'series_set' to the series map.
+ * Unlike the imap update functions, the set holds no series so no reference
+ * counters need to be changed for the set. The set is destroyed.
+ *
+ * Returns 0 if successful or -1 in case of a memory error.
+ */
+static int series_set_update(query_wrapper_t * q_wrapper)
+{
+    siridb_series_t * series;
+    iset_t * series_set = q_wrapper->series_set;
+    int rc = 0;
+
+    q_wrapper->series_set = NULL;
+
+    if (q_wrapper->update_cb == &imap_intersection_ref)
+    {
+        slist_t * slist = imap_slist_pop(q_wrapper->series_map);
+
+        if (slist == NULL)
+        {
+            rc = -1;
+        }
+        else
+        {
+            for (size_t i = 0; i < slist->len; i++)
+            {
+                series = (siridb_series_t *) slist->data[i];
+                if (!iset_has(series_set, series->id))
+                {
+                    imap_pop(q_wrapper->series_map, series->id);
+                    siridb_series_decref(series);
+                }
+            }
+            slist_free(slist);
+        }
+    }
+    else
+    {
+        assert (q_wrapper->update_cb == &imap_difference_ref);
+        iset_walk(series_set, (iset_cb) series_set_pop, q_wrapper->series_map);
+    }
+
+    iset_free(series_set);
+
+    return rc;
+}
+
+/*
+ * Call-back function used to remove a series from the series map.
+ */
+static int series_set_pop(uint32_t id, imap_t * series_map)
+{
+    siridb_series_t * series = (siridb_series_t *) imap_pop(series_map, id);
+
+    if (series != NULL)
+    {
+        siridb_series_decref(series);
+        return 1;
+    }
+
+    return 0;
+}
+
+/*
+ * Set 'q_list->slist' to the series after 'q_list->after' in name order.
+ * Without a series match, the walk through the series tree starts at the
+ * name and stops at the limit so only the series of the page are visited.
+ *
+ * This function should be called while holding siridb->series_mutex.
+ *
+ * The list is NULL in case an allocation error has occurred.
+ */
+static void list_series_after(siridb_t * siridb, query_list_t * q_list)
+{
+    siridb_series_t * series;
+    size_t i, n;
+
+    if (q_list->series_map != NULL)
+    {
+        q_list->slist = imap_2slist_ref(q_list->series_map);
+
+        if (q_list->slist == NULL)
+        {
+            return;
+        }
+
+        for (i = 0, n = 0; i < q_list->slist->len; i++)
+        {
+            series = (siridb_series_t *) q_list->slist->data[i];
+
+            if (strcmp(series->name, q_list->after) > 0)
+            {
+                q_list->slist->data[n++] = series;
+            }
+            else
+            {
+                siridb_series_decref(series);
+            }
+        }
+
+        q_list->slist->len = n;
+
+        qsort(q_list->slist->data,
+                q_list->slist->len,
+                sizeof(void *),
+                (int (*)(const void *, const void *)) list_series_cmp);
+        return;
+    }
+
+    n = (q_list->limit < siridb->series->len) ?
+            q_list->limit : siridb->series->len;
+
+    q_list->slist = slist_new(n);
+
+    if (q_list->slist != NULL)
+    {
+        ct_valuesn_after(
+                siridb->series,
+                q_list->after,
+                &n,
+                (ct_val_cb) list_series_after_cb,
+                q_list);
+    }
+}
+
+/*
+ * Call-back function used to add a series to the page of a list series.
+ * Returns 1 when the series is added or 0 when it does not match.
+ */
+static int list_series_after_cb(
+        siridb_series_t * series,
+        query_list_t * q_list)
+{
+    if (q_list->where_expr == NULL || cexpr_run(
+            q_list->where_expr,
+            (cexpr_cb_t) siridb_series_cexpr_cb,
+            series))
+    {
+        siridb_series_incref(series);
+        slist_append(q_list->slist, series);
+        return 1;
+    }
+    return 0;
+}
+
+static int list_series_cmp(
+        siridb_series_t ** series_a,
+        siridb_series_t ** series_b)
+{
+    return strcmp((*series_a)->name, (*series_b)->name);
+}
+
+/*
+ * Returns the index of the name column or -1 if there is no name column.
+ */
+static ssize_t list_name_column(query_list_t * q_list)
+{
+    for (size_t i = 0; i < q_list->props->len; i++)
+    {
+        if (*((uint32_t *) q_list->props->data[i]) == CLERI_GID_K_NAME)
+        {
+            return (ssize_t) i;
+        }
+    }
+    return -1;
+}
+
+/*
+ * Add the rows from 'unpacker' to 'rows' until the end of the result array.
+ * The rows refer to the data of the unpacker, 'column' is the index of the
+ * name column.
+ *
+ * Returns 0 if successful or -1 in case of an allocation error.
+ */
+static int list_rows_add(
+        list_rows_t * rows,
+        qp_unpacker_t * unpacker,
+        size_t column)
+{
+    qp_unpacker_t row_unpacker;
+    qp_obj_t qp_name;
+    char * start;
+    list_row_t * row;
+    size_t i;
+
+    while (qp_is_array(qp_current(unpacker)))
+    {
+        start = unpacker->pt;
+        qp_skip_next(unpacker);
+
+        qp_unpacker_init(&row_unpacker, start, unpacker->pt - start);
+
+        /* the array and the columns before the name */
+        for (i = 0; i <= column; i++)
+        {
+            qp_next(&row_unpacker, NULL);
+        }
+
+        if (!qp_is_raw(qp_next(&row_unpacker, &qp_name)))
+        {
+            continue;
+        }
+
+        if (rows->n == rows->size)
+        {
+            size_t size = rows->size ? rows->size * 2 : 64;
+            row = (list_row_t *) realloc(rows->row, size * sizeof(list_row_t));
+            if (row == NULL)
+            {
+                return -1;
+            }
+            rows->row = row;
+            rows->size = size;
+        }
+
+        row = rows->row + rows->n++;
+        row->name = qp_name.via.raw;
+        row->name_len = qp_name.len;
+        row->data = start;
+        row->size = unpacker->pt - start;
+    }
+    return 0;
+}
+
+static int list_rows_cmp(const list_row_t * row_a, const list_row_t * row_b)
+{
+    size_t len = (row_a->name_len < row_b->name_len) ?
+            row_a->name_len : row_b->name_len;
+    int rc = memcmp(row_a->name, row_b->name, len);
+
+    return rc ? rc :
+            (row_a->name_len > row_b->name_len) -
+            (row_a->name_len < row_b->name_len);
+}
+
+/*
+ * Add at most 'limit' rows to 'packer' in name order. The rows of each
+ * source are sorted and start at 'runs', the last run ends at rows->n, so
+ * only the first row of each run must be compared.
+ */
+static void list_rows_merge(
+        qp_packer_t * packer,
+        list_rows_t * rows,
+        size_t * runs,
+        size_t nruns,
+        size_t limit)
+{
+    size_t pos[nruns];
+    size_t end[nruns];
+    size_t i, k;
+
+    for (i = 0; i < nruns; i++)
+    {
+        pos[i] = runs[i];
+        end[i] = (i + 1 < nruns) ? runs[i + 1] : rows->n;
+    }
+
+    for (; limit; limit--)
+    {
+        for (i = 0, k = nruns; i < nruns; i++)
+        {
+            if (    pos[i] < end[i] && (k == nruns || list_rows_cmp(
+                        rows->row + pos[i],
+                        rows->row + pos[k]) < 0))
+            {
+                k = i;
+            }
+        }
+
+        if (k == nruns)
+        {
+            break;  /* all rows are added */
+        }
+
+        qp_packer_extend_mem(
+                packer,
+                rows->row[pos[k]].data,
+                rows->row[pos[k]].size);
+        pos[k]++;
+    }
+}
@@ -14,22 +14,28 @@
 #include <siri/db/aggregate.h>
 #include <siri/db/query.h>
 #include <siri/db/shard.h>
+#include <siri/db/user.h>
+#include <siri/mem.h>
+#include <siri/net/socket.h>
 #include <siri/parser/queries.h>
+#include <siri/siri.h>
 #include <stddef.h>
 #include <stdlib.h>
+#include <string.h>
 
 #define DEFAULT_LIST_LIMIT 1000
 
 #define QUERIES_NEW(q)              \
 q->series_map = NULL;               \
 q->series_tmp = NULL;               \
+q->series_set = NULL;               \
 q->slist = NULL;                    \
 q->slist_index = 0;                 \
 q->pmap = NULL;                     \
 q->update_cb = NULL;                \
 q->where_expr = NULL;               \
-q->regex = NULL;                    \
-q->regex_extra = NULL;
+q->re = NULL;                       \
+q->series_gen = 0;
 
 
 #define QUERIES_FREE(q, handle)                                 \
@@ -45,6 +51,7 @@ if (q->series_tmp != NULL)                                      \
             q->series_tmp,                                      \
             (imap_free_cb) &siridb__series_decref);             \
 }                                                               \
+iset_free(q->series_set);                                       \
 if (q->slist != NULL)                                           \
 {                                                               \
     siridb_series_t * series;                                   \
@@ -63,8 +70,10 @@ if (q->pmap != NULL)                                            \
 {                                                               \
     imap_free(q->pmap, NULL);                                   \
 }                                                               \
-free(q->regex);                                                 \
-free(q->regex_extra);                                           \
+if (q->re != NULL)                                              \
+{                                                               \
+    siridb_re_decref(siri.re_cache, q->re);                     \
+}                                                               \
 free(q);                                                        \
 siridb_query_free(handle);
 
@@ -91,6 +100,21 @@ query_select_t * query_select_new(void)
     q_select->points_map = NULL;
     q_select->alist = NULL;
     q_select->mlist = NULL;
+    q_select->qentry = NULL;
+    q_select->is_heavy = 0;
+    q_select->stream = NULL;
+    q_select->partial = NULL;
+    q_select->err_count = 0;
+    q_select->limit = 0;
+    q_select->top = 0;
+    q_select->top_sign = 1;
+    q_select->join_as = NULL;
+    q_select->join = NULL;
+    q_select->join_ops = NULL;
+    q_select->spill = NULL;
+    q_select->mem = 0;
+    q_select->spill_err = 0;
+    memset(&q_select->cost, 0, sizeof(siridb_series_cost_t));
     q_select->result = ct_new();
 
     if (q_select->result == NULL)
@@ -175,6 +199,9 @@ query_list_t * query_list_new(void)
     q_list->tp = QUERIES_LIST;
     q_list->props = NULL;
     q_list->limit = DEFAULT_LIST_LIMIT;
+    q_list->after = NULL;
+    q_list->offset = 0;
+    q_list->error_tp = 0;
 
     return q_list;
 }
@@ -244,13 +271,26 @@ void query_list_free(uv_handle_t * handle)
         slist_free(q_list->props);
     }
 
+    free(q_list->after);
+
     QUERIES_FREE(q_list, handle)
 }
 
 void query_select_free(uv_handle_t * handle)
 {
-    query_select_t * q_select =
-            (query_select_t *) ((siridb_query_t *) handle->data)->data;
+    siridb_query_t * query = (siridb_query_t *) handle->data;
+    query_select_t * q_select = (query_select_t *) query->data;
+    sirinet_socket_t * ssocket = (sirinet_socket_t *) query->client->data;
+
+    /* selected points count for the rate limit of the user */
+    if (    (query->flags & SIRIDB_QUERY_FLAG_MASTER) &&
+            ssocket->tp == SOCKET_CLIENT &&
+            ((siridb_user_t *) ssocket->origin)->ratelimits != NULL)
+    {
+        siridb_ratelimits_selected(
+                ((siridb_user_t *) ssocket->origin)->ratelimits,
+                q_select->n);
+    }
 
     siridb_presuf_free(q_select->presuf);
 
@@ -271,6 +311,11 @@ void query_select_free(uv_handle_t * handle)
         }
     }
 
+    if (q_select->partial != NULL)
+    {
+        ct_free(q_select->partial, (ct_free_cb) &QUERIES_free_merge_result);
+    }
+
     free(q_select->merge_as);
 
     if (q_select->alist != NULL)
@@ -283,6 +328,24 @@ void query_select_free(uv_handle_t * handle)
         siridb_aggregate_list_free(q_select->mlist);
     }
 
+    siridb_qcache_entry_free(q_select->qentry);
+
+    if (q_select->join != NULL)
+    {
+        for (size_t i = 0; i < q_select->join->len; i++)
+        {
+            free(q_select->join->data[i]);
+        }
+        slist_free(q_select->join);
+    }
+
+    free(q_select->join_as);
+    free(q_select->join_ops);
+
+    /* spilled points remain valid until they are destroyed */
+    siridb_spill_free(q_select->spill);
+    siri_mem_sub(SIRI_MEM_QUERY, q_select->mem);
+
     QUERIES_FREE(q_select, handle)
 }
 
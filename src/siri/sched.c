@@ -0,0 +1,640 @@
+/*
+ * sched.c - Scheduler and thread pool for background work.
+ *
+ * author       : Jeroen van der Heijden
+ * email        : jeroen@transceptor.technology
+ * copyright    : 2016, Transceptor Technology
+ *
+ * Select workers and the optimize task run on a pool of 'sched_threads'
+ * threads owned by SiriDB instead of the libuv thread pool, so file system
+ * requests on the libuv pool never wait for a long select or optimize task.
+ * Work is queued per priority class and each class has a limit on the works
+ * it may run. When a thread is available the next work is taken from the
+ * class with the lowest pass, the pass of a class is incremented with
+ * SCHED_STRIDE / weight for each work, so waiting classes share the threads
+ * by their weight and a class with many works does not starve the others.
+ *
+ * Works are only handed to the pool when a thread is available, so the pool
+ * uses a single ready queue. Service work, like the groups loop which runs
+ * until the database is closed, gets its own thread and never occupies a
+ * pool thread.
+ *
+ * Inserts run on the event loop and only mark when they are in progress.
+ * While inserts are in progress, only one heavy work runs at the same time
+ * so an analytic workload cannot hold the series mutex long enough to starve
+ * inserts.
+ *
+ * With 'sched_numa' the threads are spread over the NUMA nodes and pinned to
+ * the processors of their node, see numa.c.
+ *
+ * The class for a select depends on the user (see the [scheduler] section in
+ * database.conf) and the cost of the select, see select_heavy_points.
+ *
+ * A work can have a limit which is shared by all works of a database (see
+ * the [resources] section in database.conf). Works are skipped while their
+ * database uses the maximum number of threads, so one database cannot claim
+ * all threads of the pool while other databases are waiting.
+ *
+ * Each work has an async handle which is used to call the after work
+ * callback on the event loop, like a handle for a query it counts as a
+ * running task while SiriDB is closing.
+ *
+ * changes
+ *  - initial version, 14-10-2016
+ *
+ */
+#include <assert.h>
+#include <logger/logger.h>
+#include <siri/async.h>
+#include <siri/err.h>
+#include <siri/numa.h>
+#include <siri/sched.h>
+#include <siri/siri.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define SCHED_STRIDE 65536
+#define SCHED_MIN_THREADS 2
+
+/* queue in which a work is waiting */
+enum
+{
+    SCHED_QUEUE_NONE,
+    SCHED_QUEUE_CLASS,
+    SCHED_QUEUE_POOL
+};
+
+typedef struct sched_work_s sched_work_t;
+
+struct sched_work_s
+{
+    uv_close_cb free_cb;            /* must be on top */
+    uint8_t ref;
+    uint8_t cls;
+    uint8_t queue;                  /* protected by the pool lock */
+    int status;                     /* 0 or an error, like UV_ECANCELED */
+    siri_sched_limit_t * limit;     /* NULL when not limited */
+    uv_async_t * handle;            /* called when the work is finished */
+    uv_work_t * orig;               /* work of the caller */
+    uv_work_cb work_cb;
+    uv_after_work_cb after_work_cb;
+    sched_work_t * next;
+    uv_thread_t thread;             /* only used for service work */
+};
+
+typedef struct sched_class_s
+{
+    uint32_t weight;
+    uint32_t running;
+    uint64_t pass;
+    sched_work_t * first;
+    sched_work_t * last;
+} sched_class_t;
+
+typedef struct sched_pool_s
+{
+    uv_mutex_t lock;
+    uv_cond_t cond;
+    uint8_t stop;
+    uint16_t nthreads;
+    uv_thread_t * threads;
+    sched_work_t * first;           /* ready queue */
+    sched_work_t * last;
+} sched_pool_t;
+
+static const char * sched_class_names[SIRI_SCHED_CLASSES] = {
+        "ingest",
+        "interactive",
+        "heavy",
+        "background",
+        "service"
+};
+
+static sched_class_t sched_classes[SIRI_SCHED_CLASSES] = {
+        {.weight=1},    /* ingest is not queued */
+        {.weight=8},
+        {.weight=2},
+        {.weight=1},
+        {.weight=1}     /* service work has its own thread */
+};
+
+static sched_pool_t sched_pool;
+static uint32_t sched_running = 0;
+static uint32_t sched_ingest = 0;
+static uint64_t sched_vtime = 0;
+
+static uint32_t SCHED_limit(siri_sched_class_t cls);
+static sched_work_t * SCHED_first(sched_class_t * sclass);
+static sched_class_t * SCHED_next(sched_work_t ** swork);
+static void SCHED_dispatch(void);
+static void SCHED_worker(void * arg);
+static void SCHED_service(void * arg);
+static void SCHED_work_finish(uv_async_t * handle);
+static void SCHED_free(uv_handle_t * handle);
+static int SCHED_unlink(
+        sched_work_t ** first,
+        sched_work_t ** last,
+        sched_work_t * swork);
+
+/*
+ * Start the threads of the pool. When 'sched_threads' is 0, the pool has a
+ * thread for each processor.
+ *
+ * Returns 0 if successful or -1 in case of an error.
+ */
+int siri_sched_init(void)
+{
+    long nproc;
+    uint16_t n;
+
+    if (siri.cfg->sched_threads)
+    {
+        sched_pool.nthreads = siri.cfg->sched_threads;
+    }
+    else
+    {
+        nproc = sysconf(_SC_NPROCESSORS_ONLN);
+        sched_pool.nthreads = (nproc < SCHED_MIN_THREADS) ?
+                SCHED_MIN_THREADS : (nproc > UINT16_MAX) ?
+                UINT16_MAX : (uint16_t) nproc;
+    }
+
+    sched_pool.stop = 0;
+    sched_pool.first = NULL;
+    sched_pool.last = NULL;
+    sched_pool.threads = (uv_thread_t *) malloc(
+            sched_pool.nthreads * sizeof(uv_thread_t));
+
+    if (sched_pool.threads == NULL)
+    {
+        ERR_ALLOC
+        return -1;
+    }
+
+    uv_mutex_init(&sched_pool.lock);
+    uv_cond_init(&sched_pool.cond);
+
+    if (siri.cfg->sched_numa)
+    {
+        siri_numa_init();
+    }
+
+    for (n = 0; n < sched_pool.nthreads; n++)
+    {
+        if (uv_thread_create(
+                &sched_pool.threads[n],
+                SCHED_worker,
+                (void *) (uintptr_t) n))
+        {
+            log_critical("Cannot create scheduler thread");
+            sched_pool.nthreads = n;
+            siri_sched_free();
+            return -1;
+        }
+    }
+
+    log_debug("Started scheduler with %u thread(s) on %u NUMA node(s)",
+            sched_pool.nthreads,
+            siri.cfg->sched_numa ? siri_numa_nodes() : 1);
+
+    return 0;
+}
+
+/*
+ * Stop and join the threads of the pool. Works which are not started are
+ * not executed.
+ */
+void siri_sched_free(void)
+{
+    if (sched_pool.threads == NULL)
+    {
+        return;
+    }
+
+    uv_mutex_lock(&sched_pool.lock);
+    sched_pool.stop = 1;
+    uv_cond_broadcast(&sched_pool.cond);
+    uv_mutex_unlock(&sched_pool.lock);
+
+    /* when closing is enforced a thread might still run a work */
+    if (siri_err != ERR_CLOSE_ENFORCED &&
+        siri_err != ERR_CLOSE_TIMEOUT_REACHED)
+    {
+        for (uint16_t n = 0; n < sched_pool.nthreads; n++)
+        {
+            uv_thread_join(&sched_pool.threads[n]);
+        }
+
+        uv_cond_destroy(&sched_pool.cond);
+        uv_mutex_destroy(&sched_pool.lock);
+    }
+
+    free(sched_pool.threads);
+    sched_pool.threads = NULL;
+}
+
+/*
+ * Returns the class for a name or -1 when the name is not a class.
+ */
+int siri_sched_class_by_name(const char * name)
+{
+    for (int i = 0; i < SIRI_SCHED_CLASSES; i++)
+    {
+        if (strcmp(name, sched_class_names[i]) == 0)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+const char * siri_sched_class_str(siri_sched_class_t cls)
+{
+    return (cls < SIRI_SCHED_CLASSES) ? sched_class_names[cls] : "unknown";
+}
+
+/*
+ * Queue work like uv_queue_work(), the work starts when the class and the
+ * optional limit allow to use a thread. The callbacks are called with
+ * 'work', the after work callback is called on the event loop. The limit
+ * must exist until the after work callback is called.
+ *
+ * This function can raise a SIGNAL.
+ */
+void siri_sched_queue(
+        siri_sched_class_t cls,
+        siri_sched_limit_t * limit,
+        uv_work_t * work,
+        uv_work_cb work_cb,
+        uv_after_work_cb after_work_cb)
+{
+#ifdef DEBUG
+    assert (cls > SIRI_SCHED_INGEST && cls < SIRI_SCHED_CLASSES);
+#endif
+
+    sched_class_t * sclass = &sched_classes[cls];
+    sched_work_t * swork = (sched_work_t *) malloc(sizeof(sched_work_t));
+    uv_async_t * handle = (uv_async_t *) malloc(sizeof(uv_async_t));
+
+    if (swork == NULL || handle == NULL)
+    {
+        free(swork);
+        free(handle);
+        ERR_ALLOC
+        return;
+    }
+
+    swork->free_cb = SCHED_free;
+    swork->ref = 1;
+    swork->cls = (uint8_t) cls;
+    swork->queue = SCHED_QUEUE_NONE;
+    swork->status = 0;
+    swork->limit = limit;
+    swork->handle = handle;
+    swork->orig = work;
+    swork->work_cb = work_cb;
+    swork->after_work_cb = after_work_cb;
+    swork->next = NULL;
+
+    handle->data = swork;
+    uv_async_init(siri.loop, handle, SCHED_work_finish);
+
+    if (cls == SIRI_SCHED_SERVICE)
+    {
+        if (uv_thread_create(&swork->thread, SCHED_service, swork))
+        {
+            log_critical("Cannot create thread for service work");
+            swork->status = UV_EAGAIN;
+            uv_async_send(handle);
+        }
+        return;
+    }
+
+    swork->queue = SCHED_QUEUE_CLASS;
+
+    if (sclass->first == NULL)
+    {
+        /* an idle class cannot claim the threads for the time it was idle */
+        if (sclass->pass < sched_vtime)
+        {
+            sclass->pass = sched_vtime;
+        }
+        sclass->first = swork;
+    }
+    else
+    {
+        sclass->last->next = swork;
+    }
+    sclass->last = swork;
+
+    SCHED_dispatch();
+}
+
+/*
+ * Cancel work which is not started, like uv_cancel(). The after work
+ * callback is called with status UV_ECANCELED.
+ *
+ * Returns 0 if successful or UV_EBUSY when the work is started or finished.
+ */
+int siri_sched_cancel(uv_work_t * work)
+{
+    sched_class_t * sclass;
+    sched_work_t * swork;
+
+    for (int i = SIRI_SCHED_INTERACTIVE; i < SIRI_SCHED_CLASSES; i++)
+    {
+        sclass = &sched_classes[i];
+
+        for (swork = sclass->first; swork != NULL; swork = swork->next)
+        {
+            if (swork->orig == work)
+            {
+                SCHED_unlink(&sclass->first, &sclass->last, swork);
+                swork->queue = SCHED_QUEUE_NONE;
+                swork->status = UV_ECANCELED;
+                uv_async_send(swork->handle);
+                return 0;
+            }
+        }
+    }
+
+    return UV_EBUSY;
+}
+
+/*
+ * Mark an insert in progress.
+ */
+void siri_sched_ingest_start(void)
+{
+    sched_ingest++;
+}
+
+/*
+ * Mark an insert as finished, heavy work might be started.
+ */
+void siri_sched_ingest_done(void)
+{
+#ifdef DEBUG
+    assert (sched_ingest);
+#endif
+    sched_ingest--;
+
+    if (!sched_ingest)
+    {
+        SCHED_dispatch();
+    }
+}
+
+/*
+ * Returns the maximum number of works for a class which may run at the same
+ * time.
+ */
+static uint32_t SCHED_limit(siri_sched_class_t cls)
+{
+    switch (cls)
+    {
+    case SIRI_SCHED_INTERACTIVE:
+        return sched_pool.nthreads;
+    case SIRI_SCHED_HEAVY:
+        return (sched_ingest) ? 1 : siri.cfg->sched_heavy_threads;
+    case SIRI_SCHED_BACKGROUND:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+/*
+ * Returns the first work in a class which is not at the limit of its
+ * database or NULL if no such work exists.
+ */
+static sched_work_t * SCHED_first(sched_class_t * sclass)
+{
+    sched_work_t * swork;
+
+    for (swork = sclass->first; swork != NULL; swork = swork->next)
+    {
+        if (    swork->limit == NULL ||
+                !swork->limit->threads ||
+                swork->limit->running < swork->limit->threads)
+        {
+            break;
+        }
+    }
+
+    return swork;
+}
+
+/*
+ * Returns the class which is allowed to start a work or NULL if no work
+ * can be started. When a class is returned, 'swork' is set to the work.
+ */
+static sched_class_t * SCHED_next(sched_work_t ** swork)
+{
+    sched_class_t * next = NULL;
+    sched_class_t * sclass;
+    sched_work_t * first;
+
+    for (int i = SIRI_SCHED_INTERACTIVE; i < SIRI_SCHED_CLASSES; i++)
+    {
+        sclass = &sched_classes[i];
+
+        if (    sclass->first != NULL &&
+                sclass->running < SCHED_limit((siri_sched_class_t) i) &&
+                (next == NULL || sclass->pass < next->pass) &&
+                (first = SCHED_first(sclass)) != NULL)
+        {
+            next = sclass;
+            *swork = first;
+        }
+    }
+
+    return next;
+}
+
+/*
+ * Hand works to the pool while threads are available.
+ */
+static void SCHED_dispatch(void)
+{
+    sched_class_t * sclass;
+    sched_work_t * swork;
+
+    while ( sched_running < sched_pool.nthreads &&
+            (sclass = SCHED_next(&swork)) != NULL)
+    {
+        SCHED_unlink(&sclass->first, &sclass->last, swork);
+        swork->next = NULL;
+
+        sched_vtime = sclass->pass;
+        sclass->pass += SCHED_STRIDE / sclass->weight;
+        sclass->running++;
+        sched_running++;
+
+        if (swork->limit != NULL)
+        {
+            swork->limit->running++;
+        }
+
+        uv_mutex_lock(&sched_pool.lock);
+
+        swork->queue = SCHED_QUEUE_POOL;
+
+        if (sched_pool.first == NULL)
+        {
+            sched_pool.first = swork;
+        }
+        else
+        {
+            sched_pool.last->next = swork;
+        }
+        sched_pool.last = swork;
+
+        uv_cond_signal(&sched_pool.cond);
+        uv_mutex_unlock(&sched_pool.lock);
+    }
+}
+
+static void SCHED_worker(void * arg)
+{
+    sched_work_t * swork;
+    uint16_t n = (uint16_t) (uintptr_t) arg;
+
+    /* threads are spread over the nodes, n % nodes is the node */
+    if (siri.cfg->sched_numa && siri_numa_bind(n))
+    {
+        log_warning("Cannot bind scheduler thread %u to a NUMA node", n);
+    }
+
+    uv_mutex_lock(&sched_pool.lock);
+
+    while (!sched_pool.stop)
+    {
+        if ((swork = sched_pool.first) == NULL)
+        {
+            uv_cond_wait(&sched_pool.cond, &sched_pool.lock);
+            continue;
+        }
+
+        sched_pool.first = swork->next;
+        if (sched_pool.first == NULL)
+        {
+            sched_pool.last = NULL;
+        }
+        swork->queue = SCHED_QUEUE_NONE;
+
+        uv_mutex_unlock(&sched_pool.lock);
+
+        swork->work_cb(swork->orig);
+
+        /* swork might be destroyed after this call */
+        uv_async_send(swork->handle);
+
+        uv_mutex_lock(&sched_pool.lock);
+    }
+
+    uv_mutex_unlock(&sched_pool.lock);
+}
+
+static void SCHED_service(void * arg)
+{
+    sched_work_t * swork = (sched_work_t *) arg;
+
+    swork->work_cb(swork->orig);
+
+    uv_async_send(swork->handle);
+}
+
+static void SCHED_work_finish(uv_async_t * handle)
+{
+    /*
+     * Main Thread
+     */
+    sched_work_t * swork = (sched_work_t *) handle->data;
+
+    if (swork->cls == SIRI_SCHED_SERVICE)
+    {
+        if (!swork->status)
+        {
+            uv_thread_join(&swork->thread);
+        }
+    }
+    else if (swork->status != UV_ECANCELED)
+    {
+        sched_classes[swork->cls].running--;
+        sched_running--;
+
+        if (swork->limit != NULL)
+        {
+            swork->limit->running--;
+        }
+    }
+
+    swork->after_work_cb(swork->orig, swork->status);
+
+    uv_close((uv_handle_t *) handle, siri_async_close);
+
+    SCHED_dispatch();
+}
+
+/*
+ * Destroy the work and handle. The work is removed from the queues since
+ * the handle might be closed before the work is started, when closing
+ * SiriDB is enforced.
+ */
+static void SCHED_free(uv_handle_t * handle)
+{
+    sched_work_t * swork = (sched_work_t *) handle->data;
+    sched_class_t * sclass = &sched_classes[swork->cls];
+
+    if (swork->queue == SCHED_QUEUE_CLASS)
+    {
+        SCHED_unlink(&sclass->first, &sclass->last, swork);
+    }
+    else if (sched_pool.threads != NULL)
+    {
+        uv_mutex_lock(&sched_pool.lock);
+        if (swork->queue == SCHED_QUEUE_POOL)
+        {
+            SCHED_unlink(&sched_pool.first, &sched_pool.last, swork);
+        }
+        uv_mutex_unlock(&sched_pool.lock);
+    }
+
+    free(swork);
+    free(handle);
+}
+
+/*
+ * Returns 1 when the work is removed from the queue or 0 if not found.
+ */
+static int SCHED_unlink(
+        sched_work_t ** first,
+        sched_work_t ** last,
+        sched_work_t * swork)
+{
+    sched_work_t * prev = NULL;
+
+    for (sched_work_t * w = *first; w != NULL; prev = w, w = w->next)
+    {
+        if (w == swork)
+        {
+            if (prev == NULL)
+            {
+                *first = w->next;
+            }
+            else
+            {
+                prev->next = w->next;
+            }
+            if (*last == w)
+            {
+                *last = prev;
+            }
+            return 1;
+        }
+    }
+
+    return 0;
+}
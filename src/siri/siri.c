@@ -25,21 +25,31 @@
 #include <siri/async.h>
 #include <siri/cfg/cfg.h>
 #include <siri/db/aggregate.h>
+#include <siri/db/cpoints.h>
 #include <siri/db/buffer.h>
+#include <siri/db/crc32c.h>
 #include <siri/db/groups.h>
 #include <siri/db/pools.h>
 #include <siri/db/props.h>
 #include <siri/db/series.h>
 #include <siri/db/server.h>
 #include <siri/db/servers.h>
+#include <siri/db/subscribe.h>
 #include <siri/db/users.h>
 #include <siri/err.h>
+#include <siri/fsync.h>
 #include <siri/help/help.h>
+#include <siri/loop.h>
+#include <siri/mutex.h>
 #include <siri/net/bserver.h>
+#include <siri/net/capture.h>
 #include <siri/net/clserver.h>
+#include <siri/net/metrics.h>
 #include <siri/net/socket.h>
 #include <siri/parser/listener.h>
+#include <siri/sched.h>
 #include <siri/siri.h>
+#include <siri/verify.h>
 #include <siri/version.h>
 #include <stddef.h>
 #include <stdio.h>
@@ -79,8 +89,14 @@ siri_t siri = {
         .loop=NULL,
         .siridb_list=NULL,
         .fh=NULL,
+        .ccache=NULL,
+        .series_slab=NULL,
+        .qplans=NULL,
+        .re_cache=NULL,
+        .slowlog=NULL,
         .optimize=NULL,
         .heartbeat=NULL,
+        .fsync=NULL,
         .cfg=NULL,
         .args=NULL,
         .status=SIRI_STATUS_LOADING,
@@ -138,6 +154,11 @@ int siri_start(void)
 
     /* initialize aggregation */
     siridb_init_aggregates();
+    log_debug("Using %s kernels for aggregates", siridb_cpoints_kernels());
+
+    /* select the checksum implementation for shard chunks */
+    siridb_crc32c_init();
+    log_debug("Using %s for chunk checksums", siridb_crc32c_impl());
 
     /* load SiriDB grammar */
     siri.grammar = compile_grammar();
@@ -152,6 +173,68 @@ int siri_start(void)
     /* initialize file handler for shards */
     siri.fh = siri_fh_new(siri.cfg->max_open_files);
 
+    /* initialize cache for decoded shard chunks (size is set in MB) */
+    siri.ccache = siridb_ccache_new(
+            (size_t) siri.cfg->chunk_cache_size * 1024 * 1024);
+    if (siri.ccache == NULL)
+    {
+        return -1;
+    }
+
+    /* initialize the allocator for series objects */
+    siri.series_slab = siridb_slab_new(
+            sizeof(siridb_series_t),
+            SIRIDB_SERIES_SLAB_SZ);
+    if (siri.series_slab == NULL)
+    {
+        return -1;
+    }
+
+    /* initialize cache for parsed queries */
+    if (siri.cfg->plan_cache_size)
+    {
+        siri.qplans = siridb_qplans_new(siri.cfg->plan_cache_size);
+        if (siri.qplans == NULL)
+        {
+            return -1;
+        }
+    }
+
+    /* initialize cache for compiled regular expressions */
+    siri.re_cache = siridb_re_cache_new(SIRIDB_RE_CACHE_SIZE);
+    if (siri.re_cache == NULL)
+    {
+        return -1;
+    }
+
+    /* must be set before the databases are loaded */
+    siri_mutex_enable(siri.cfg->lock_stats);
+
+    /* open the slow query log, 4 rotated files are kept */
+    if (siri.cfg->slow_query_threshold && *siri.cfg->slow_query_log)
+    {
+        siri.slowlog = logger_file_new(
+                siri.cfg->slow_query_log,
+                (size_t) siri.cfg->slow_query_log_size * 1024 * 1024,
+                4);
+        if (siri.slowlog == NULL)
+        {
+            log_error(
+                    "Cannot open slow query log: '%s'",
+                    siri.cfg->slow_query_log);
+            return -1;
+        }
+    }
+
+    /* capture client packages, the file is closed by siri_free() */
+    if (    *siri.cfg->capture_file &&
+            sirinet_capture_init(
+                    siri.cfg->capture_file,
+                    (size_t) siri.cfg->capture_max_size * 1024 * 1024))
+    {
+        return -1;
+    }
+
     /* initialize the default event loop */
     siri.loop = (uv_loop_t *) malloc(sizeof(uv_loop_t));
     if (siri.loop == NULL)
@@ -160,11 +243,14 @@ int siri_start(void)
     }
     uv_loop_init(siri.loop);
 
-    /* initialize the back-end-, client- server and load databases */
-    if (    (rc = siri_admin_account_init(&siri)) ||
+    /* initialize the scheduler, the back-end-, client- server and load
+     * databases */
+    if (    (rc = siri_sched_init()) ||
+            (rc = siri_admin_account_init(&siri)) ||
             (rc = siri_admin_request_init()) ||
             (rc = sirinet_bserver_init(&siri)) ||
             (rc = sirinet_clserver_init(&siri)) ||
+            (rc = sirinet_metrics_init(&siri)) ||
             (rc = SIRI_load_databases()))
     {
         SIRI_destroy();
@@ -186,6 +272,15 @@ int siri_start(void)
     /* initialize heart-beat task (bind siri.heartbeat) */
     siri_heartbeat_init(&siri);
 
+    /* initialize verify task */
+    siri_verify_init(&siri);
+
+    /* initialize fsync task (bind siri.fsync) */
+    siri_fsync_init(&siri);
+
+    /* initialize the event loop lag probe */
+    siri_loop_init(&siri);
+
     /* initialize backup (bind siri.backup) */
     if (siri_backup_init(&siri))
     {
@@ -221,12 +316,33 @@ void siri_free(void)
         }
     }
 
+    /* stop the scheduler threads, all work is finished at this point */
+    siri_sched_free();
+
     /* first free the File Handler. (this will close all open shard files) */
     siri_fh_free(siri.fh);
 
     /* this will free each SiriDB database and the list */
     llist_free_cb(siri.siridb_list, (llist_cb) siridb_decref_cb, NULL);
 
+    /* free the chunk cache (must be done after the shards are destroyed) */
+    siridb_ccache_free(siri.ccache);
+
+    /* free the series objects (must be done after the databases) */
+    siridb_slab_free(siri.series_slab);
+
+    /* free the parsed queries */
+    siridb_qplans_free(siri.qplans);
+
+    /* free the compiled regular expressions (after the databases) */
+    siridb_re_cache_free(siri.re_cache);
+
+    /* close the slow query log */
+    logger_file_free(siri.slowlog);
+
+    /* flush and close the capture file */
+    sirinet_capture_close();
+
     /* free siridb grammar */
     cleri_grammar_free(siri.grammar);
 
@@ -356,6 +472,10 @@ static void SIRI_set_closing_state(void)
         {
             siridb_groups_destroy(siridb->groups);
         }
+        if (siridb->subscriptions != NULL)
+        {
+            siridb_subscriptions_close(siridb->subscriptions);
+        }
         siridb->server->flags &= ~SERVER_FLAG_RUNNING;
         siridb_servers_send_flags(siridb->servers);
 
@@ -432,6 +552,15 @@ static void SIRI_signal_handler(
         /* stop heart-beat task */
         siri_heartbeat_stop(&siri);
 
+        /* stop verify task */
+        siri_verify_stop();
+
+        /* stop fsync task and sync for the last time */
+        siri_fsync_stop(&siri);
+
+        /* stop the event loop lag probe */
+        siri_loop_stop();
+
         /* destroy backup (mode) task */
         siri_backup_destroy(&siri);
 
@@ -476,16 +605,15 @@ static void SIRI_walk_close_handlers(
 
     switch (handle->type)
     {
-    case UV_WORK:
-        break;
     case UV_SIGNAL:
         /* this is where we cleanup the signal handlers */
         uv_close(handle, NULL);
         break;
 
     case UV_TCP:
-        /* This can be a TCP server with data set to NULL or a SiriDB socket
-         * which should be destroyed.
+    case UV_NAMED_PIPE:
+        /* This can be a TCP or unix socket server with data set to NULL or a
+         * SiriDB socket which should be destroyed.
          */
         if (handle->data == NULL)
         {
@@ -0,0 +1,199 @@
+/*
+ * throttle.c - Disk bandwidth limits for background tasks.
+ *
+ * author       : Jeroen van der Heijden
+ * email        : jeroen@transceptor.technology
+ * copyright    : 2016, Transceptor Technology
+ *
+ * Each background task type has a token bucket which is filled with the
+ * limit from the configuration file each second and holds at most one
+ * second of tokens. The bucket is kept as the time at which it would be
+ * full again so taking tokens is a single compare and swap, the optimize
+ * threads share the same bucket.
+ *
+ * A database can have its own bucket for the optimize task, which is used
+ * in addition to the bucket for all databases.
+ *
+ * Threads of the optimize task sleep until they are allowed to continue.
+ * Re-index and the initial replica synchronization run in the event loop
+ * and use the delay for starting their next timer instead.
+ *
+ * changes
+ *  - initial version, 14-10-2016
+ *
+ */
+#include <logger/logger.h>
+#include <siri/siri.h>
+#include <siri/throttle.h>
+#include <time.h>
+#include <timeit/timeit.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#define THROTTLE_BURST 1000000000UL     // one second in nanoseconds
+
+/* see ioprio_set(2) */
+#define THROTTLE_IOPRIO_WHO_PROCESS 1
+#define THROTTLE_IOPRIO_CLASS_SHIFT 13
+#define THROTTLE_IOPRIO_CLASS_BE 2
+#define THROTTLE_IOPRIO_LOWEST 7
+
+/* time in nanoseconds at which the bucket is full again, atomic */
+static uint64_t throttle_full[SIRI_THROTTLE_END];
+
+/* I/O priority of the thread before siri_throttle_background() */
+static __thread int throttle_ioprio = -1;
+
+static uint32_t THROTTLE_limit(siri_throttle_tp_t tp);
+static uint64_t THROTTLE_take(uint64_t * bucket, uint32_t limit, size_t bytes);
+static void THROTTLE_sleep(uint64_t ns);
+
+/*
+ * Take 'bytes' from the bucket for task type 'tp' and return the number of
+ * milliseconds to wait before the bytes may be used. Returns 0 when there is
+ * no limit for the task type.
+ */
+uint64_t siri_throttle_delay(siri_throttle_tp_t tp, size_t bytes)
+{
+    uint64_t ns = THROTTLE_take(&throttle_full[tp], THROTTLE_limit(tp), bytes);
+
+    /* round up so a timer never starts too early */
+    return (ns + 999999) / 1000000;
+}
+
+/*
+ * Take 'bytes' from the bucket for task type 'tp' and sleep until the bytes
+ * may be used. This function should not be called from the main thread.
+ */
+void siri_throttle_wait(siri_throttle_tp_t tp, size_t bytes)
+{
+    THROTTLE_sleep(THROTTLE_take(
+            &throttle_full[tp],
+            THROTTLE_limit(tp),
+            bytes));
+}
+
+/*
+ * Like siri_throttle_wait() but takes the bytes from the given bucket.
+ */
+void siri_throttle_wait_bucket(siri_throttle_t * throttle, size_t bytes)
+{
+    THROTTLE_sleep(THROTTLE_take(&throttle->full, throttle->limit, bytes));
+}
+
+/*
+ * When background_io_priority is enabled, give the calling thread the lowest
+ * best-effort I/O priority (enable=1) or restore the priority it had before
+ * (enable=0). Threads from the libuv pool must restore the priority before
+ * they finish their work since the pool also runs foreground work.
+ */
+void siri_throttle_background(int enable)
+{
+#ifdef __linux__
+    int ioprio;
+
+    if (!siri.cfg->background_io_priority)
+    {
+        return;
+    }
+
+    if (!enable)
+    {
+        if (    throttle_ioprio >= 0 &&
+                syscall(
+                    SYS_ioprio_set,
+                    THROTTLE_IOPRIO_WHO_PROCESS,
+                    0,
+                    throttle_ioprio))
+        {
+            log_warning("Cannot restore the I/O priority of a thread");
+        }
+        throttle_ioprio = -1;
+        return;
+    }
+
+    /* thread id 0 is the calling thread */
+    ioprio = (int) syscall(SYS_ioprio_get, THROTTLE_IOPRIO_WHO_PROCESS, 0);
+
+    if (ioprio < 0 || syscall(
+            SYS_ioprio_set,
+            THROTTLE_IOPRIO_WHO_PROCESS,
+            0,
+            THROTTLE_IOPRIO_CLASS_BE << THROTTLE_IOPRIO_CLASS_SHIFT |
+            THROTTLE_IOPRIO_LOWEST))
+    {
+        log_debug("Cannot set a background I/O priority");
+        return;
+    }
+
+    throttle_ioprio = ioprio;
+#else
+    (void) enable;
+#endif
+}
+
+static uint32_t THROTTLE_limit(siri_throttle_tp_t tp)
+{
+    switch (tp)
+    {
+    case SIRI_THROTTLE_OPTIMIZE:
+        return siri.cfg->optimize_io_limit;
+    case SIRI_THROTTLE_REINDEX:
+        return siri.cfg->reindex_io_limit;
+    case SIRI_THROTTLE_INITSYNC:
+        return siri.cfg->initsync_io_limit;
+    case SIRI_THROTTLE_VERIFY:
+        return siri.cfg->verify_io_limit;
+    case SIRI_THROTTLE_END:
+        break;
+    }
+    return 0;
+}
+
+/*
+ * Returns the number of nanoseconds to wait before 'bytes' may be used.
+ */
+static uint64_t THROTTLE_take(uint64_t * bucket, uint32_t limit, size_t bytes)
+{
+    uint64_t now, cost, full, next;
+
+    if (!limit || !bytes)
+    {
+        return 0;
+    }
+
+    /* limit is in MB/s so one byte takes 1000 / limit nanoseconds */
+    cost = (uint64_t) bytes * 1000 / limit;
+    now = timeit_ns();
+    full = __atomic_load_n(bucket, __ATOMIC_RELAXED);
+
+    do
+    {
+        /* a bucket which is full does not save more than one second */
+        next = ((full > now) ? full : now) + cost;
+    }
+    while (!__atomic_compare_exchange_n(
+            bucket,
+            &full,
+            next,
+            0,
+            __ATOMIC_RELAXED,
+            __ATOMIC_RELAXED));
+
+    return (next > now + THROTTLE_BURST) ? next - now - THROTTLE_BURST : 0;
+}
+
+static void THROTTLE_sleep(uint64_t ns)
+{
+    struct timespec ts;
+
+    if (ns)
+    {
+        ts.tv_sec = (time_t) (ns / 1000000000);
+        ts.tv_nsec = (long) (ns % 1000000000);
+
+        while (nanosleep(&ts, &ts));
+    }
+}
@@ -0,0 +1,229 @@
+/*
+ * verify.c - Background verification of shard checksums.
+ *
+ * author       : Jeroen van der Heijden
+ * email        : jeroen@transceptor.technology
+ * copyright    : 2016, Transceptor Technology
+ *
+ * Each verify_interval seconds one task in the background scheduling class
+ * reads the chunks which are added to the shards since the last task and
+ * compares them with the checksums in the chunk headers. Shards are only
+ * appended to, so after the first task only new chunks, and shards which
+ * are rewritten by optimize, are read. The bytes which are read are limited
+ * by verify_io_limit.
+ *
+ * A shard with a corrupt chunk is marked as corrupt so the next optimize
+ * cycle rewrites it, before the chunk is read by a query.
+ *
+ * changes
+ *  - initial version, 14-10-2016
+ *
+ */
+#include <logger/logger.h>
+#include <siri/db/shard.h>
+#include <siri/mutex.h>
+#include <siri/sched.h>
+#include <siri/siri.h>
+#include <siri/throttle.h>
+#include <siri/verify.h>
+#include <slist/slist.h>
+
+#define VERIFY_PENDING 0
+#define VERIFY_RUNNING 1
+#define VERIFY_CANCELLED 2
+
+static uv_timer_t verify_timer;
+static uv_work_t verify_work;
+static int verify_status = VERIFY_PENDING;     /* atomic */
+
+/* statistics for the running or last task, only used by the task */
+static size_t verify_bytes = 0;
+static size_t verify_corrupt = 0;
+
+static void VERIFY_cb(uv_timer_t * handle);
+static void VERIFY_work(uv_work_t * work);
+static void VERIFY_siridb(siridb_t * siridb);
+static void VERIFY_work_finish(uv_work_t * work, int status);
+
+void siri_verify_init(siri_t * siri)
+{
+    /*
+     * Main Thread
+     */
+
+    uint64_t timeout = siri->cfg->verify_interval * 1000;
+
+    uv_timer_init(siri->loop, &verify_timer);
+
+    /* do not start with verify_interval zero */
+    if (timeout)
+    {
+        uv_timer_start(&verify_timer, VERIFY_cb, timeout, timeout);
+    }
+}
+
+void siri_verify_stop(void)
+{
+    /*
+     * Main Thread
+     */
+
+    /* a running task stops after the shard it is verifying */
+    __atomic_store_n(&verify_status, VERIFY_CANCELLED, __ATOMIC_RELAXED);
+    siri_sched_cancel(&verify_work);
+
+    uv_timer_stop(&verify_timer);
+    uv_close((uv_handle_t *) &verify_timer, NULL);
+}
+
+static void VERIFY_cb(uv_timer_t * handle __attribute__((unused)))
+{
+    /*
+     * Main Thread
+     */
+
+    if (verify_status != VERIFY_PENDING)
+    {
+        log_debug("Skip verify task because the last task is still running");
+        return;
+    }
+
+    verify_status = VERIFY_RUNNING;
+
+    siri_sched_queue(
+            SIRI_SCHED_BACKGROUND,
+            NULL,
+            &verify_work,
+            VERIFY_work,
+            VERIFY_work_finish);
+}
+
+static void VERIFY_work(uv_work_t * work __attribute__((unused)))
+{
+    /*
+     * Verify Thread
+     */
+
+    slist_t * slsiridb;
+    siridb_t * siridb;
+
+    uv_mutex_lock(&siri.siridb_mutex);
+
+    slsiridb = llist2slist(siri.siridb_list);
+    if (slsiridb != NULL)
+    {
+        for (size_t i = 0; i < slsiridb->len; i++)
+        {
+            siridb = (siridb_t *) slsiridb->data[i];
+            siridb_incref(siridb);
+        }
+    }
+
+    uv_mutex_unlock(&siri.siridb_mutex);
+
+    if (slsiridb == NULL)
+    {
+        log_error("Cannot create a list of databases for the verify task");
+        return;
+    }
+
+    verify_bytes = 0;
+    verify_corrupt = 0;
+
+    /* restored before the end since this is a thread from the pool */
+    siri_throttle_background(1);
+
+    for (size_t i = 0; i < slsiridb->len; i++)
+    {
+        siridb = (siridb_t *) slsiridb->data[i];
+        VERIFY_siridb(siridb);
+        siridb_decref(siridb);
+    }
+
+    siri_throttle_background(0);
+
+    slist_free(slsiridb);
+}
+
+static void VERIFY_siridb(siridb_t * siridb)
+{
+    slist_t * slshards;
+    siridb_shard_t * shard;
+    size_t size;
+
+    siri_mutex_lock(&siridb->shards_mutex);
+
+    slshards = imap_2slist_ref(siridb->shards);
+
+    siri_mutex_unlock(&siridb->shards_mutex);
+
+    if (slshards == NULL)
+    {
+        log_error("Cannot create a list of shards for the verify task");
+        return;
+    }
+
+    for (size_t i = 0; i < slshards->len; i++)
+    {
+        shard = (siridb_shard_t *) slshards->data[i];
+
+        while ( !siri_err &&
+                __atomic_load_n(&verify_status, __ATOMIC_RELAXED) ==
+                    VERIFY_RUNNING)
+        {
+            /* chunks are read in the same way as for a select */
+            siri_rwlock_rdlock(&siridb->series_mutex);
+            siridb_shard_shared = 1;
+
+            size = siridb_shard_verify(shard, siridb);
+
+            if (size && (shard->flags & SIRIDB_SHARD_IS_CORRUPT))
+            {
+                verify_corrupt++;
+            }
+
+            siridb_shard_shared = 0;
+            siri_rwlock_rdunlock(&siridb->series_mutex);
+
+            if (!size)
+            {
+                break;
+            }
+
+            verify_bytes += size;
+            siri_throttle_wait(SIRI_THROTTLE_VERIFY, size);
+        }
+
+        siridb_shard_decref(shard);
+    }
+
+    slist_free(slshards);
+}
+
+static void VERIFY_work_finish(
+        uv_work_t * work __attribute__((unused)),
+        int status)
+{
+    /*
+     * Main Thread
+     */
+
+    if (verify_corrupt)
+    {
+        log_error(
+                "Verify task has found %zu corrupt shard(s) which will be "
+                "rewritten by the next optimize cycle",
+                verify_corrupt);
+    }
+
+    log_debug(
+            "Finished verify task, %zu bytes are verified (status: %d)",
+            verify_bytes,
+            status);
+
+    /* the task is not started again once it is cancelled */
+    if (verify_status == VERIFY_RUNNING)
+    {
+        verify_status = VERIFY_PENDING;
+    }
+}
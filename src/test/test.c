@@ -11,26 +11,81 @@
  */
 #include <test/test.h>
 #include <inttypes.h>
+#include <math.h>
 #include <string.h>
 #include <stdio.h>
 #include <time.h>
 #include <assert.h>
 #include <stdlib.h>
+#include <unistd.h>
+#include <sys/stat.h>
 #include <qpack/qpack.h>
 #include <motd/motd.h>
+#include <owcrypt/owcrypt.h>
 #include <cleri/cleri.h>
 #include <ctree/ctree.h>
 #include <timeit/timeit.h>
+#include <imap/dmap.h>
 #include <imap/imap.h>
+#include <iset/iset.h>
 #include <iso8601/iso8601.h>
+#include <cexpr/cexpr.h>
 #include <expr/expr.h>
+#include <logger/logger.h>
+#include <lz4.h>
 #include <siri/grammar/grammar.h>
 #include <siri/grammar/gramp.h>
+#include <siri/alloc.h>
 #include <siri/db/aggregate.h>
+#include <siri/db/buffer.h>
 #include <siri/db/db.h>
 #include <siri/db/pools.h>
 #include <siri/db/points.h>
+#include <siri/db/pcache.h>
+#include <siri/db/arena.h>
+#include <siri/db/names.h>
+#include <siri/db/tdigest.h>
+#include <siri/db/compress.h>
+#include <siri/db/crc32c.h>
+#include <siri/db/downsample.h>
+#include <siri/db/durations.h>
+#include <siri/db/export.h>
+#include <siri/db/hot.h>
+#include <siri/db/hotlog.h>
+#include <siri/db/acache.h>
+#include <siri/db/ccache.h>
+#include <siri/db/mcache.h>
+#include <siri/db/qcache.h>
+#include <siri/db/qplan.h>
+#include <siri/db/query.h>
+#include <siri/db/ratelimit.h>
+#include <siri/db/re.h>
+#include <siri/db/tokens.h>
+#include <siri/db/trigrams.h>
+#include <siri/db/rollup.h>
+#include <siri/db/series.h>
+#include <siri/db/server.h>
+#include <siri/db/servers.h>
+#include <siri/db/shard.h>
+#include <siri/db/session.h>
+#include <siri/db/shash.h>
+#include <siri/db/slab.h>
+#include <siri/db/spill.h>
+#include <siri/db/startup.h>
 #include <siri/db/access.h>
+#include <siri/db/users.h>
+#include <siri/db/variance.h>
+#include <siri/file/handler.h>
+#include <siri/latency.h>
+#include <siri/loop.h>
+#include <siri/mutex.h>
+#include <siri/net/capture.h>
+#include <siri/net/metrics.h>
+#include <siri/net/protocol.h>
+#include <siri/net/socket.h>
+#include <siri/numa.h>
+#include <siri/siri.h>
+#include <siri/throttle.h>
 #include <siri/version.h>
 #include <siri/db/lookup.h>
 #include <strextra/strextra.h>
@@ -122,11 +177,128 @@ static int test_qpack(void)
         assert (qpi.via.int64 == i);
     }
 
+    /* copy the packed values, without the array, to a new packer */
+    qp_packer_t * copy = qp_packer_new(16);
+    qp_add_type(copy, QP_ARRAY_OPEN);
+    assert (qp_packer_extend_mem(
+            copy,
+            packer->buffer + 1,
+            unpacker.pt - packer->buffer - 1) == 0);
+    qp_add_type(copy, QP_ARRAY_CLOSE);
+    assert (copy->len == packer->len);
+    assert (memcmp(copy->buffer, packer->buffer, packer->len) == 0);
+    qp_packer_free(copy);
+
+    qp_packer_free(packer);
+
+    /* packing arrays of pairs must equal packing the values one by one */
+    int64_t pairs[] = {0, 1, -1, -61, 127, -128, 32767, -32769, INT64_MAX, 5};
+    double reals[] = {0.0, 1.0, -1.0, 0.5};
+    int64_t real_pairs[8];
+    qp_packer_t * bulk = qp_packer_new(4);
+    packer = qp_packer_new(4);
+
+    for (i = 0; i < 4; i++)
+    {
+        real_pairs[2 * i] = i * 1000;
+        memcpy(&real_pairs[2 * i + 1], &reals[i], sizeof(double));
+    }
+
+    assert (qp_packer_reserve(bulk, 64) == 0);
+    assert (bulk->buffer_size >= 64);
+    assert (qp_add_array2_int64(bulk, pairs, 5) == 0);
+    assert (qp_add_array2_int64_double(bulk, real_pairs, 4) == 0);
+
+    for (i = 0; i < 5; i++)
+    {
+        qp_add_type(packer, QP_ARRAY2);
+        qp_add_int64(packer, pairs[2 * i]);
+        qp_add_int64(packer, pairs[2 * i + 1]);
+    }
+    for (i = 0; i < 4; i++)
+    {
+        qp_add_type(packer, QP_ARRAY2);
+        qp_add_int64(packer, i * 1000);
+        qp_add_double(packer, reals[i]);
+    }
+    assert (bulk->len == packer->len);
+    assert (memcmp(bulk->buffer, packer->buffer, packer->len) == 0);
+
+    /* unpacking stops at the first object which is not a pair of numbers */
+    int64_t unpacked[20];
+    qp_add_type(bulk, QP_ARRAY2);
+    qp_add_int64(bulk, 1);
+    qp_add_raw(bulk, "x", 1);
+    qp_unpacker_init(&unpacker, bulk->buffer, bulk->len);
+
+    assert (qp_unpack_array2_numbers(&unpacker, unpacked, 3) == 3);
+    assert (memcmp(unpacked, pairs, 3 * 2 * sizeof(int64_t)) == 0);
+    assert (qp_unpack_array2_numbers(&unpacker, unpacked + 6, 10) == 6);
+    assert (memcmp(unpacked + 6, pairs + 6, 2 * 2 * sizeof(int64_t)) == 0);
+    assert (memcmp(unpacked + 10, real_pairs, 8 * sizeof(int64_t)) == 0);
+    assert (qp_unpack_array2_numbers(&unpacker, unpacked, 10) == 0);
+    assert (qp_next(&unpacker, NULL) == QP_ARRAY2);
+
+    qp_packer_free(bulk);
     qp_packer_free(packer);
 
     return test_end(TEST_OK);
 }
 
+static int test_qpack_funpacker(void)
+{
+    test_start("Testing qpack file unpacker");
+
+    char fn[] = "/tmp/siridb-test-funpacker-XXXXXX";
+    char name[24];
+    qp_fpacker_t * fpacker;
+    qp_funpacker_t * funpacker;
+    qp_obj_t qp_name, qp_val;
+    int64_t i;
+    int fd = mkstemp(fn);
+
+    assert (fd >= 0);
+    close(fd);
+
+    fpacker = qp_open(fn, "w");
+    assert (fpacker != NULL);
+    qp_fadd_type(fpacker, QP_ARRAY_OPEN);
+    for (i = 0; i < 1000; i++)
+    {
+        snprintf(name, sizeof(name), "series-%" PRId64, i * i);
+        qp_fadd_type(fpacker, QP_ARRAY2);
+        qp_fadd_string(fpacker, name);
+        qp_fadd_int64(fpacker, i * 1000);
+    }
+    assert (qp_close(fpacker) == 0);
+
+    /* a small window which is moved many times while reading */
+    funpacker = qp_funpacker_new(fn, 64);
+    assert (funpacker != NULL);
+    assert (qp_funpacker_fill(funpacker, 32) == 0);
+    assert (qp_is_array(qp_next(&funpacker->unpacker, NULL)));
+
+    for (i = 0; i < 1000; i++)
+    {
+        snprintf(name, sizeof(name), "series-%" PRId64, i * i);
+        assert (qp_funpacker_fill(funpacker, 32) == 0);
+        assert (qp_next(&funpacker->unpacker, NULL) == QP_ARRAY2);
+        assert (qp_next(&funpacker->unpacker, &qp_name) == QP_RAW);
+        assert (qp_next(&funpacker->unpacker, &qp_val) == QP_INT64);
+        assert (qp_name.len == strlen(name));
+        assert (memcmp(qp_name.via.raw, name, qp_name.len) == 0);
+        assert (qp_val.via.int64 == i * 1000);
+    }
+
+    assert (qp_funpacker_fill(funpacker, 32) == 0);
+    assert (qp_next(&funpacker->unpacker, NULL) == QP_END);
+
+    qp_funpacker_free(funpacker);
+    unlink(fn);
+
+    return test_end(TEST_OK);
+}
+
 
 static int test_cleri(void)
 {
@@ -145,6 +317,32 @@ static int test_cleri(void)
 
     cleri_parse_free(pr);
 
+    /* limit goes before merge */
+    pr = cleri_parse(grammar,
+            "select * from \"series-001\" after now - 1d limit 10 "
+            "merge as \"series\"");
+
+    /* is_valid should be true (1) */
+    assert(pr->is_valid == 1);
+
+    cleri_parse_free(pr);
+
+    /* top and bottom cannot be combined with merge */
+    pr = cleri_parse(grammar,
+            "select max(1h) from /cpu.*/ after now - 1h top 10");
+    assert(pr->is_valid == 1);
+    cleri_parse_free(pr);
+
+    pr = cleri_parse(grammar,
+            "select min(1h) from /cpu.*/ bottom 5 merge as \"cpu\"");
+    assert(pr->is_valid == 0);
+    cleri_parse_free(pr);
+
+    pr = cleri_parse(grammar,
+            "select lttb(1000) => minmax(500) from \"series-001\"");
+    assert(pr->is_valid == 1);
+    cleri_parse_free(pr);
+
     /* should not break on empty grammar */
     pr = cleri_parse(grammar, "");
 
@@ -186,6 +384,33 @@ static int test_cleri(void)
     return test_end(TEST_OK);
 }
 
+static int test__ctree_cb(char * data, char * cmp)
+{
+    return strcmp(data, cmp) == 0;
+}
+
+static int test__ctree_after_cb(char * data, const char *** expected)
+{
+    assert (**expected != NULL && strcmp(data, **expected) == 0);
+    (*expected)++;
+    return 1;
+}
+
+static void test__ctree_after(
+        ct_t * ct,
+        const char * key,
+        size_t n,
+        const char ** expected)
+{
+    ct_valuesn_after(
+            ct,
+            key,
+            &n,
+            (ct_val_cb) &test__ctree_after_cb,
+            &expected);
+    assert (*expected == NULL || n == 0);
+}
+
 static int test_ctree(void)
 {
     test_start("Testing ctree");
@@ -225,6 +450,42 @@ static int test_ctree(void)
     /* Hits a recursive CT_add */
     assert (ct_add(ct, "Iri!!", "Hoi Ir!") == CT_OK);
 
+    /* More than CT_SMALL_SZ children converts a node to blocks */
+    char key[] = "Sasientje?";
+    for (char c = 'z'; c >= 'A'; c--)
+    {
+        key[9] = c;
+        assert (ct_add(ct, key, "Sasientje") == CT_OK);
+    }
+    key[9] = 'M';
+    assert (ct_add(ct, key, "Sasientje?") == CT_EXISTS);
+    assert (strcmp(ct_get(ct, key), "Sasientje") == 0);
+    assert (ct_get(ct, "Sasientje") == NULL);
+    assert (ct_values(ct, (ct_val_cb) &test__ctree_cb, "Sasientje") == 58);
+    for (char c = 'A'; c < 'z'; c++)
+    {
+        key[9] = c;
+        assert (strcmp(ct_pop(ct, key), "Sasientje") == 0);
+    }
+    /* the last child is merged with its parent */
+    assert (strcmp(ct_get(ct, "Sasientjez"), "Sasientje") == 0);
+    assert (ct_pop(ct, "SasientjeA") == NULL);
+
+    ct_free(ct, NULL);
+
+    /* values after a key are visited in the order of the keys */
+    const char * keys[] = {"a", "ab", "abc", "abd", "b", "ba", "c", NULL};
+    ct = ct_new();
+    for (size_t i = 0; keys[i] != NULL; i++)
+    {
+        assert (ct_add(ct, keys[i], (void *) keys[i]) == CT_OK);
+    }
+    test__ctree_after(ct, "", 10, keys);
+    test__ctree_after(ct, "ab", 3, keys + 2);
+    test__ctree_after(ct, "abb", 10, keys + 2);
+    test__ctree_after(ct, "aa", 10, keys + 1);
+    test__ctree_after(ct, "b", 1, keys + 5);
+    test__ctree_after(ct, "c", 10, keys + 7);
 
     ct_free(ct, NULL);
 
@@ -344,6 +605,42 @@ static void test__imap_setup(void)
     series_e.ref++;
 }
 
+static int test_dmap(void)
+{
+    test_start("Testing dmap");
+    dmap_t * dmap = dmap_new();
+    slist_t * slist;
+
+    assert (dmap_add(dmap, 14, "Sasientje") == 0);
+    assert (dmap_add(dmap, 20130602, "Iriske") == 0);
+    assert (dmap_add(dmap, 14, "Jip") == -2);
+    assert (dmap_add(dmap, 0, "Joente") == 0);
+
+    assert (dmap->len == 3);
+    assert (strcmp(dmap_get(dmap, 14), "Sasientje") == 0);
+    assert (strcmp(dmap_get(dmap, 20130602), "Iriske") == 0);
+    assert (dmap_get(dmap, 123) == NULL);
+    assert (dmap_get(dmap, 1ULL << 40) == NULL);
+
+    /* the cached list is updated when an item is added */
+    slist = dmap_slist(dmap);
+    assert (slist != NULL && slist->len == 3);
+    assert (dmap_add(dmap, 2011, "Tijs") == 0);
+    assert (dmap->slist != NULL && dmap->slist->len == 4);
+
+    assert (strcmp(dmap_pop(dmap, 20130602), "Iriske") == 0);
+    assert (dmap_pop(dmap, 20130602) == NULL);
+    assert (dmap->len == 3 && dmap->slist == NULL);
+    assert (dmap->chunks[20130602 >> DMAP_CHUNK_BITS] == NULL);
+
+    assert (dmap_pop(dmap, 0) != NULL && dmap_pop(dmap, 14) != NULL);
+    assert (dmap_walk(dmap, (imap_cb) &test__imap_cb, "Tijs") == 1);
+
+    dmap_free(dmap, NULL);
+
+    return test_end(TEST_OK);
+}
+
 static int test_imap_union(void)
 {
     test_start("Testing imap union");
@@ -462,19 +759,95 @@ static int test_imap_symmetric_difference(void)
     return test_end(TEST_OK);
 }
 
+static int test__iset_sum_cb(uint32_t id, uint64_t * sum)
+{
+    *sum += id;
+    return 1;
+}
+
+static int test_iset(void)
+{
+    test_start("Testing iset");
+
+    iset_t * iset = iset_new();
+    uint64_t sum = 0;
+
+    assert (iset_add(iset, 70000) == 1);
+    assert (iset_add(iset, 5) == 1);
+    assert (iset_add(iset, 5) == 0);
+    assert (iset_has(iset, 5) && iset_has(iset, 70000));
+    assert (!iset_has(iset, 6) && !iset_has(iset, 65541));
+
+    /* more ids than ISET_ARRAY_MAX result in a bitmap container */
+    for (uint32_t id = 1 << 17; id < (1 << 17) + 3 * ISET_ARRAY_MAX; id += 2)
+    {
+        assert (iset_add(iset, id) == 1);
+    }
+
+    assert (iset->len == 2 + 3 * ISET_ARRAY_MAX / 2);
+    assert (iset->n == 3 && iset->containers[2].size == 0);
+    assert (iset_has(iset, (1 << 17) + 2) && !iset_has(iset, (1 << 17) + 3));
+    assert (iset_add(iset, (1 << 17) + 2) == 0);
+
+    assert (iset_walk(
+            iset,
+            (iset_cb) test__iset_sum_cb,
+            &sum) == (int) iset->len);
+
+    /* sum of 5, 70000 and the even numbers from 1 << 17 */
+    assert (sum == 70005 + (uint64_t) (3 * ISET_ARRAY_MAX / 2) * (1 << 17) +
+            (uint64_t) (3 * ISET_ARRAY_MAX / 2) *
+            (3 * ISET_ARRAY_MAX / 2 - 1));
+
+    iset_free(iset);
+
+    return test_end(TEST_OK);
+}
+
 static int test_gen_pool_lookup(void)
 {
     test_start("Testing test_gen_pool_lookup");
 
-    siridb_lookup_t * lookup = siridb_lookup_new(4);
+    siridb_lookup_t * lookup = siridb_lookup_new(4, SIRIDB_LOOKUP_HASH_SUM);
     uint16_t match[30] = {
             0, 1, 0, 2, 3, 1, 0, 3, 3, 2, 2, 1, 0, 1, 0,
             2, 3, 1, 0, 3, 3, 2, 2, 1, 0, 1, 0, 2, 3, 1};
 
     for (int i = 0; i < 30; i++)
-        assert(match[i] == (*lookup)[i]);
+        assert(match[i] == lookup->pool[i]);
 
     free(lookup);
+
+    /* adding a pool only moves slots to the new pool */
+    siridb_lookup_t * prev = siridb_lookup_new(4, SIRIDB_LOOKUP_HASH_FNV);
+    lookup = siridb_lookup_new(5, SIRIDB_LOOKUP_HASH_FNV);
+    size_t moved = 0;
+
+    for (int i = 0; i < SIRIDB_LOOKUP_SZ; i++)
+    {
+        if (prev->pool[i] != lookup->pool[i])
+        {
+            assert (lookup->pool[i] == 4);
+            moved++;
+        }
+    }
+    assert (moved > SIRIDB_LOOKUP_SZ / 6 && moved < SIRIDB_LOOKUP_SZ / 4);
+
+    /* similar names are spread over the pools */
+    size_t counters[5] = {0};
+    char name[16];
+    for (int i = 0; i < 5000; i++)
+    {
+        sprintf(name, "series-%d", i);
+        counters[siridb_lookup_sn(lookup, name)]++;
+    }
+    for (int i = 0; i < 5; i++)
+    {
+        assert (counters[i] > 800 && counters[i] < 1200);
+    }
+
+    free(prev);
+    free(lookup);
     return test_end(TEST_OK);
 }
 
@@ -500,430 +873,3671 @@ static int test_points(void)
         assert (i == (size_t) point->val.int64);
     }
 
+    /* the factor of a query is a float, 0.001f is not exactly 0.001 */
+    points->data[0].ts = 1700000000123;
+    siridb_points_ts_correction(points, (double) 0.001f);
+    assert (points->data[0].ts == 1700000000);
+    siridb_points_ts_correction(points, (double) 1e9f);
+    assert (points->data[0].ts == 1700000000000000000);
+    siridb_points_ts_correction(points, (double) 1e-6f);
+    assert (points->data[0].ts == 1700000000000);
+
     siridb_points_free(points);
 
     return test_end(TEST_OK);
 }
 
-static int test_aggr_count(void)
+static int test_points_pack_columns(void)
 {
-    test_start("Testing aggregation count");
-
-    siridb_aggr_t aggr;
-    siridb_points_t * result;
-    char err_msg[SIRIDB_MAX_SIZE_ERR_MSG];
-    siridb_points_t * points = prepare_points();
+    test_start("Testing points pack columns");
 
-    aggr.gid = CLERI_GID_F_COUNT;
-    aggr.group_by = 6;
-    aggr.limit = 0;
-    aggr.offset = 0;
+    siridb_points_t * points = siridb_points_new(100, TP_DOUBLE);
+    qp_packer_t * packer = qp_packer_new(64);
+    qp_unpacker_t unpacker;
+    qp_obj_t qp_obj, qp_ts, qp_values;
+    char buf[800];
+    uint64_t ts, delta;
+    qp_via_t val;
+    double value;
+    size_t i;
 
-    result = siridb_aggregate_run(points, &aggr, err_msg);
+    for (i = 0; i < 100; i++)
+    {
+        ts = 1500000000 + i * 10;
+        val.real = i * 0.5;
+        siridb_points_add_point(points, &ts, &val);
+    }
 
-    assert (result != NULL);
-    assert (result->len == 4);
-    assert (result->tp == TP_INT);
-    assert (result->data->ts == 6 && result->data->val.int64 == 2);
-    assert ((result->data + 3)->ts == 30 &&
-            (result->data + 3)->val.int64 == 2);
+    /* equal to the columns for an insert, time-stamps are deltas */
+    assert (siridb_points_pack_columns(points, packer, 0) == 0);
+    qp_unpacker_init(&unpacker, packer->buffer, packer->len);
+    assert (qp_next(&unpacker, NULL) == QP_ARRAY3);
+    assert (qp_next(&unpacker, &qp_obj) == QP_INT64);
+    assert (qp_obj.via.int64 == TP_DOUBLE);
+    assert (qp_next(&unpacker, &qp_ts) == QP_RAW && qp_ts.len == 800);
+    assert (qp_next(&unpacker, &qp_values) == QP_RAW && qp_values.len == 800);
+
+    memcpy(&delta, qp_ts.via.raw, 8);
+    assert (delta == 1500000000);
+    memcpy(&delta, qp_ts.via.raw + 99 * 8, 8);
+    assert (delta == 10);
+    memcpy(&value, qp_values.via.raw + 99 * 8, 8);
+    assert (value == 49.5);
+
+    /* compressed columns include the number of points */
+    packer->len = 0;
+    assert (siridb_points_pack_columns(points, packer, 1) == 0);
+    qp_unpacker_init(&unpacker, packer->buffer, packer->len);
+    assert (qp_next(&unpacker, NULL) == QP_ARRAY4);
+    assert (qp_next(&unpacker, &qp_obj) == QP_INT64);
+    assert (qp_next(&unpacker, &qp_obj) == QP_INT64);
+    assert (qp_obj.via.int64 == 100);
+    assert (qp_next(&unpacker, &qp_ts) == QP_RAW && qp_ts.len < 800);
+    assert (LZ4_decompress_safe(
+            qp_ts.via.raw,
+            buf,
+            (int) qp_ts.len,
+            sizeof(buf)) == 800);
+    memcpy(&delta, buf + 50 * 8, 8);
+    assert (delta == 10);
+    assert (qp_next(&unpacker, &qp_values) == QP_RAW);
+    assert (LZ4_decompress_safe(
+            qp_values.via.raw,
+            buf,
+            (int) qp_values.len,
+            sizeof(buf)) == 800);
+    memcpy(&value, buf + 10 * 8, 8);
+    assert (value == 5.0);
 
-    siridb_points_free(result);
     siridb_points_free(points);
+    qp_packer_free(packer);
 
     return test_end(TEST_OK);
 }
 
-static int test_aggr_max(void)
+static int test_pcache(void)
 {
-    test_start("Testing aggregation max");
+    test_start("Testing pcache");
 
-    siridb_aggr_t aggr;
-    siridb_points_t * result;
-    char err_msg[SIRIDB_MAX_SIZE_ERR_MSG];
-    siridb_points_t * points = prepare_points();
+    siridb_pcache_t * pcache = siridb_pcache_new(TP_INT);
+    siridb_points_t * points = siridb_points_new(3, TP_INT);
+    qp_via_t val;
+    uint64_t ts;
 
-    aggr.gid = CLERI_GID_F_MAX;
-    aggr.group_by = 10;
-    aggr.limit = 0;
-    aggr.offset = 0;
+    /* enough points for a radix sort, unsorted with duplicate timestamps */
+    for (int i = 0; i < 1000; i++)
+    {
+        ts = 1400000000 + (i * 7919) % 500;
+        val.int64 = i;
+        assert (siridb_pcache_append_point(pcache, &ts, &val) == 0);
+    }
 
-    result = siridb_aggregate_run(points, &aggr, err_msg);
+    siridb_pcache_sort(pcache);
 
-    assert (result != NULL);
-    assert (result->len == 3);
-    assert (result->tp == TP_INT);
-    assert (result->data->ts == 10 && result->data->val.int64 == 3);
-    assert ((result->data + 2)->ts == 30 &&
-            (result->data + 2)->val.int64 == 6);
+    for (size_t i = 1; i < pcache->len; i++)
+    {
+        assert (pcache->data[i - 1].ts <= pcache->data[i].ts);
+
+        /* points with equal timestamps must keep their order */
+        assert (pcache->data[i - 1].ts < pcache->data[i].ts ||
+                pcache->data[i - 1].val.int64 < pcache->data[i].val.int64);
+    }
+
+    /* merge older points, they must end up in front */
+    for (int i = 0; i < 3; i++)
+    {
+        ts = 1300000000 + i;
+        val.int64 = -1;
+        siridb_points_add_point(points, &ts, &val);
+    }
+
+    assert (siridb_pcache_add_points(pcache, points) == 0);
+    assert (pcache->len == 1003);
+    assert (pcache->data[2].ts == 1300000002);
+    assert (pcache->data[3].ts == 1400000000);
 
-    siridb_points_free(result);
     siridb_points_free(points);
+    siridb_pcache_free(pcache);
 
     return test_end(TEST_OK);
 }
 
-static int test_aggr_mean(void)
+static int test_arena(void)
 {
-    test_start("Testing aggregation mean");
+    test_start("Testing arena");
 
-    siridb_aggr_t aggr;
-    siridb_points_t * result;
-    char err_msg[SIRIDB_MAX_SIZE_ERR_MSG];
-    siridb_points_t * points = prepare_points();
+    siridb_arena_t * arena = siridb_arena_new();
+    siridb_points_t * points = siridb_points_new(10, TP_INT);
+    siridb_points_t * apoints;
+    qp_via_t val;
+    uint64_t ts;
 
-    aggr.gid = CLERI_GID_F_MEAN;
-    aggr.group_by = 4;
-    aggr.limit = 0;
-    aggr.offset = 0;
+    for (int i = 0; i < 10; i++)
+    {
+        ts = 1400000000 + i;
+        val.int64 = i * i;
+        siridb_points_add_point(points, &ts, &val);
+    }
 
-    result = siridb_aggregate_run(points, &aggr, err_msg);
+    /* small and large copies, all must be aligned and keep their data */
+    for (int i = 0; i < 100; i++)
+    {
+        apoints = siridb_points_arena_copy(arena, points);
+        assert (apoints != NULL);
+        assert (((uintptr_t) apoints->data) % sizeof(siridb_point_t) == 0);
+        assert (apoints->len == 10);
+        assert (apoints->data[9].val.int64 == 81);
+
+        /* does nothing, the points are released with the arena */
+        siridb_points_free(apoints);
+
+        apoints = siridb_points_arena_new(
+                arena,
+                SIRIDB_ARENA_BLOCK_SZ / sizeof(siridb_point_t),
+                TP_DOUBLE);
+        assert (apoints != NULL);
+        assert (apoints->len == 0);
+    }
 
-    assert (result != NULL);
-    assert (result->len == 5);
-    assert (result->tp == TP_DOUBLE);
-    assert (result->data->ts == 4 && result->data->val.real == 1.0);
-    assert ((result->data + 4)->ts == 28 &&
-            (result->data + 4)->val.real == 4.5);
+    assert (siridb_points_arena_new(NULL, 10, TP_INT) == NULL);
 
-    siridb_points_free(result);
     siridb_points_free(points);
+    siridb_arena_free(arena);
 
     return test_end(TEST_OK);
 }
 
-static int test_aggr_median(void)
+static int test_names(void)
 {
-    test_start("Testing aggregation median");
+    test_start("Testing series names");
 
-    siridb_aggr_t aggr;
-    siridb_points_t * result;
-    char err_msg[SIRIDB_MAX_SIZE_ERR_MSG];
-    siridb_points_t * points = prepare_points();
+    siridb_names_t * names = siridb_names_new();
+    char * list[5000];
+    char buf[32];
+    char * large = (char *) malloc(SIRIDB_SERIES_NAME_LEN_MAX);
+    char * name;
+    int n;
 
-    aggr.gid = CLERI_GID_F_MEDIAN;
-    aggr.group_by = 7;
-    aggr.limit = 0;
-    aggr.offset = 0;
+    for (int i = 0; i < 5000; i++)
+    {
+        n = sprintf(buf, "series-%d", i);
+        list[i] = siridb_names_add(names, buf, n);
+        assert (list[i] != NULL);
+        assert (strcmp(list[i], buf) == 0);
+    }
 
-    result = siridb_aggregate_run(points, &aggr, err_msg);
+    /* names from previous chunks must be kept */
+    memset(large, 'x', SIRIDB_SERIES_NAME_LEN_MAX);
+    for (int i = 0; i < 2; i++)
+    {
+        name = siridb_names_add(names, large, SIRIDB_SERIES_NAME_LEN_MAX);
+        assert (name != NULL);
+        assert (strlen(name) == SIRIDB_SERIES_NAME_LEN_MAX);
+        siridb_names_release(name);
+    }
 
-    assert (result != NULL);
-    assert (result->len == 4);
-    assert (result->tp == TP_DOUBLE);
-    assert (result->data->ts == 7 && result->data->val.real == 1.0);
-    assert ((result->data + 1)->ts == 14 &&
-            (result->data + 1)->val.real == 3.5);
+    for (int i = 0; i < 5000; i += 2)
+    {
+        siridb_names_release(list[i]);
+    }
 
-    siridb_points_free(result);
-    siridb_points_free(points);
+    assert (strcmp(list[4999], "series-4999") == 0);
+
+    /* names are allowed to outlive the storage */
+    siridb_names_free(names);
+
+    for (int i = 1; i < 5000; i += 2)
+    {
+        sprintf(buf, "series-%d", i);
+        assert (strcmp(list[i], buf) == 0);
+        siridb_names_release(list[i]);
+    }
+
+    free(large);
 
     return test_end(TEST_OK);
 }
 
-static int test_aggr_median_high(void)
+static int test_slab(void)
 {
-    test_start("Testing aggregation median_high");
+    test_start("Testing slab");
 
-    siridb_aggr_t aggr;
-    siridb_points_t * result;
-    char err_msg[SIRIDB_MAX_SIZE_ERR_MSG];
-    siridb_points_t * points = prepare_points();
+    siridb_slab_t * slab = siridb_slab_new(sizeof(siridb_points_t), 8);
+    siridb_points_t * list[20];
+    siridb_points_t * points;
 
-    aggr.gid = CLERI_GID_F_MEDIAN_HIGH;
-    aggr.group_by = 7;
-    aggr.limit = 0;
-    aggr.offset = 0;
+    for (int i = 0; i < 20; i++)
+    {
+        list[i] = (siridb_points_t *) siridb_slab_alloc(slab);
+        assert (list[i] != NULL);
+        assert (((uintptr_t) list[i]) % 16 == 0);
+        list[i]->len = i;
+    }
 
-    result = siridb_aggregate_run(points, &aggr, err_msg);
+    assert (slab->len == 20);
 
-    assert (result != NULL);
-    assert (result->len == 4);
-    assert (result->tp == TP_INT);
-    assert (result->data->ts == 7 && result->data->val.int64 == 1);
-    assert ((result->data + 1)->ts == 14 &&
-            (result->data + 1)->val.int64 == 4);
+    for (int i = 0; i < 20; i++)
+    {
+        assert (list[i]->len == (size_t) i);
+    }
 
-    siridb_points_free(result);
-    siridb_points_free(points);
+    /* released objects must be re-used */
+    points = list[5];
+    siridb_slab_release(slab, list[5]);
+    assert (slab->len == 19);
+    list[5] = (siridb_points_t *) siridb_slab_alloc(slab);
+    assert (list[5] == points);
+    assert (list[19]->len == 19);
+
+    siridb_slab_free(slab);
 
     return test_end(TEST_OK);
 }
 
-static int test_aggr_median_low(void)
+static int test_compress(void)
 {
-    test_start("Testing aggregation median_low");
-
-    siridb_aggr_t aggr;
-    siridb_points_t * result;
-    char err_msg[SIRIDB_MAX_SIZE_ERR_MSG];
-    siridb_points_t * points = prepare_points();
+    test_start("Testing compress");
 
-    aggr.gid = CLERI_GID_F_MEDIAN_LOW;
-    aggr.group_by = 7;
-    aggr.limit = 0;
-    aggr.offset = 0;
+    siridb_points_t * points = siridb_points_new(100, TP_DOUBLE);
+    siridb_point_t decoded[100];
+    unsigned char buf[SIRIDB_COMPRESS_MAX_SZ(100)];
+    size_t size;
+    uint64_t ts;
+    qp_via_t val;
 
-    result = siridb_aggregate_run(points, &aggr, err_msg);
+    for (int i = 0; i < 100; i++)
+    {
+        /* mostly a regular interval with some gaps and repeated values */
+        ts = 1400000000 + i * 10 + ((i % 17) ? 0 : i * 1000);
+        val.real = (i % 3) ? 21.5 : i * 0.25;
+        siridb_points_add_point(points, &ts, &val);
+    }
 
-    assert (result != NULL);
-    assert (result->len == 4);
-    assert (result->tp == TP_INT);
-    assert (result->data->ts == 7 && result->data->val.int64 == 1);
-    assert ((result->data + 1)->ts == 14 &&
-            (result->data + 1)->val.int64 == 3);
+    for (size_t ts_sz = 4; ts_sz <= 8; ts_sz += 4)
+    {
+        size = siridb_compress_num(buf, points, 0, 100, ts_sz);
+        assert (size < 100 * (ts_sz + 8));
+        assert (siridb_compress_num_decode(
+                decoded, buf, size, 100, ts_sz) == 0);
+        assert (memcmp(
+                decoded, points->data, 100 * sizeof(siridb_point_t)) == 0);
+
+        /* a truncated chunk must be detected */
+        assert (siridb_compress_num_decode(
+                decoded, buf, size / 2, 100, ts_sz) == -1);
+    }
 
-    siridb_points_free(result);
     siridb_points_free(points);
 
     return test_end(TEST_OK);
 }
 
-static int test_aggr_min(void)
+static int test_compress_chunk(void)
 {
-    test_start("Testing aggregation min");
+    test_start("Testing compress chunk");
 
-    siridb_aggr_t aggr;
-    siridb_points_t * result;
-    char err_msg[SIRIDB_MAX_SIZE_ERR_MSG];
-    siridb_points_t * points = prepare_points();
+    siridb_points_t * points = siridb_points_new(200, TP_INT);
+    siridb_point_t decoded[200];
+    unsigned char buf[SIRIDB_COMPRESS_MAX_SZ(200)];
+    size_t size, len;
+    uint64_t ts;
+    qp_via_t val;
 
-    aggr.gid = CLERI_GID_F_MIN;
-    aggr.group_by = 2;
-    aggr.limit = 0;
-    aggr.offset = 0;
+    /* a counter with a small range uses a frame of reference */
+    for (int i = 0; i < 200; i++)
+    {
+        ts = 1400000000 + i * 10 + ((i % 17) ? 0 : i * 1000);
+        val.int64 = -5000 + (i * 7) % 300;
+        siridb_points_add_point(points, &ts, &val);
+    }
 
-    result = siridb_aggregate_run(points, &aggr, err_msg);
+    for (size_t ts_sz = 4; ts_sz <= 8; ts_sz += 4)
+    {
+        /* odd lengths make sure the last values are read byte by byte */
+        for (len = 1; len <= 200; len += 37)
+        {
+            size = siridb_compress_chunk(buf, points, 0, len, ts_sz);
+            assert (len == 1 || buf[0] == SIRIDB_COMPRESS_ENC_FOR);
+            assert (siridb_compress_chunk_decode(
+                    decoded, buf, size, len, ts_sz) == 0);
+            assert (memcmp(
+                    decoded,
+                    points->data,
+                    len * sizeof(siridb_point_t)) == 0);
+        }
+
+        /* a truncated chunk must be detected */
+        size = siridb_compress_chunk(buf, points, 0, 200, ts_sz);
+        assert (size < siridb_compress_num(buf, points, 0, 200, ts_sz));
+        size = siridb_compress_chunk(buf, points, 0, 200, ts_sz);
+        assert (siridb_compress_chunk_decode(
+                decoded, buf, size / 2, 200, ts_sz) == -1);
+    }
 
-    assert (result != NULL);
-    assert (result->len == 9);
-    assert (result->tp == TP_INT);
-    assert (result->data->ts == 4 && result->data->val.int64 == 1);
-    assert ((result->data + 5)->ts == 14 &&
-            (result->data + 5)->val.int64 == 3);
+    /* a constant value requires no bits for the values */
+    for (int i = 0; i < 200; i++)
+    {
+        points->data[i].val.int64 = 42;
+    }
+    size = siridb_compress_chunk(buf, points, 0, 200, 8);
+    assert (buf[0] == SIRIDB_COMPRESS_ENC_FOR);
+    assert (siridb_compress_chunk_decode(decoded, buf, size, 200, 8) == 0);
+    assert (decoded[199].val.int64 == 42);
+
+    /* a large range uses the XOR encoding */
+    points->data[100].val.int64 = INT64_MIN;
+    points->data[101].val.int64 = INT64_MAX;
+    size = siridb_compress_chunk(buf, points, 0, 200, 8);
+    assert (buf[0] == SIRIDB_COMPRESS_ENC_XOR);
+    assert (siridb_compress_chunk_decode(decoded, buf, size, 200, 8) == 0);
+    assert (memcmp(
+            decoded, points->data, 200 * sizeof(siridb_point_t)) == 0);
+
+    /* an unknown encoding is not valid */
+    buf[0] = 0xff;
+    assert (siridb_compress_chunk_decode(decoded, buf, size, 200, 8) == -1);
 
-    siridb_points_free(result);
     siridb_points_free(points);
 
     return test_end(TEST_OK);
 }
 
-static int test_aggr_pvariance(void)
+static int test_compress_log(void)
 {
-    test_start("Testing pvariance");
-
-    siridb_aggr_t aggr;
-    siridb_points_t * result;
-    char err_msg[SIRIDB_MAX_SIZE_ERR_MSG];
-    siridb_points_t * points = prepare_points();
-
-    aggr.gid = CLERI_GID_F_PVARIANCE;
-    aggr.group_by = 5;
-    aggr.limit = 0;
-    aggr.offset = 0;
+    test_start("Testing compress log");
+
+    siridb_points_t * points = siridb_points_new(64, TP_STRING);
+    siridb_points_t * decoded = siridb_points_new(64, TP_STRING);
+    const char * values[] = {"ok", "warning", "ok", "", "critical"};
+    unsigned char buf[SIRIDB_COMPRESS_LOG_MAX_SZ(64, 8, 64 * 9)];
+    char * content = siridb_points_content(points, 5 * 64);
+    size_t size;
+    uint64_t ts;
+    qp_via_t val;
 
-    result = siridb_aggregate_run(points, &aggr, err_msg);
+    for (int i = 0; i < 64; i++)
+    {
+        ts = 1400000000 + i * 10;
+        val.raw = content + i * 5;
+        strcpy(val.raw, values[i % 5]);
+        siridb_points_add_point(points, &ts, &val);
+    }
 
-    assert (result != NULL);
-    assert (result->len == 5);
-    assert (result->tp == TP_DOUBLE);
-    assert (result->data->ts == 5 && result->data->val.real == 0.0);
-    assert ((result->data + 2)->ts == 15 &&
-            (result->data + 2)->val.real == 3.5);
+    for (size_t ts_sz = 4; ts_sz <= 8; ts_sz += 4)
+    {
+        size = siridb_compress_log(buf, points, 0, 64, ts_sz);
+
+        /* only four distinct values are stored */
+        assert (size == 64 * (ts_sz + 1) + 2 + 21);
+        assert (siridb_compress_log_decode(
+                decoded, decoded->data, buf, size, 64, ts_sz) == 0);
+
+        for (int i = 0; i < 64; i++)
+        {
+            assert (decoded->data[i].ts == points->data[i].ts);
+            assert (strcmp(
+                    decoded->data[i].val.raw,
+                    points->data[i].val.raw) == 0);
+        }
+
+        /* a truncated chunk must be detected */
+        assert (siridb_compress_log_decode(
+                decoded, decoded->data, buf, size - 1, 64, ts_sz) == -1);
+        assert (siridb_compress_log_decode(
+                decoded, decoded->data, buf, size / 2, 64, ts_sz) == -1);
+    }
 
-    siridb_points_free(result);
     siridb_points_free(points);
+    siridb_points_free(decoded);
 
     return test_end(TEST_OK);
 }
 
-static int test_aggr_sum(void)
+static int test_export(void)
 {
-    test_start("Testing aggregation sum");
+    test_start("Testing export");
 
-    siridb_aggr_t aggr;
+    siridb_time_t * time = siridb_time_new(SIRIDB_TIME_MILLISECONDS);
+    siridb_points_t * points = siridb_points_new(2000, TP_INT);
     siridb_points_t * result;
+    qp_packer_t * packer = qp_packer_new(1024);
+    qp_unpacker_t unpacker;
+    qp_obj_t qp_data;
     char err_msg[SIRIDB_MAX_SIZE_ERR_MSG];
-    siridb_points_t * points = prepare_points();
+    uint64_t ts;
+    qp_via_t val;
 
-    aggr.gid = CLERI_GID_F_SUM;
-    aggr.group_by = 5;
-    aggr.limit = 0;
-    aggr.offset = 0;
+    /* more points than fit in one chunk */
+    for (int i = 0; i < 2000; i++)
+    {
+        ts = 1400000000000 + i * 1000;
+        val.int64 = (i % 7) ? i : -i;
+        siridb_points_add_point(points, &ts, &val);
+    }
 
-    result = siridb_aggregate_run(points, &aggr, err_msg);
+    assert (siridb_export_points(packer, points, time) == 0);
 
+    qp_unpacker_init(&unpacker, packer->buffer, packer->len);
+    assert (qp_next(&unpacker, &qp_data) == QP_RAW);
+
+    result = siridb_export_unpack(
+            qp_data.via.raw,
+            qp_data.len,
+            time,
+            err_msg);
     assert (result != NULL);
-    assert (result->len == 5);
     assert (result->tp == TP_INT);
-    assert (result->data->ts == 5 && result->data->val.int64 == 1);
-    assert ((result->data + 2)->ts == 15 &&
-            (result->data + 2)->val.int64 == 20);
-
+    assert (result->len == 2000);
+    assert (memcmp(
+            result->data, points->data, 2000 * sizeof(siridb_point_t)) == 0);
     siridb_points_free(result);
+
+    /* truncated data, another precision and an unknown version */
+    assert (siridb_export_unpack(
+            qp_data.via.raw, qp_data.len - 1, time, err_msg) == NULL);
+    time->precision = SIRIDB_TIME_MICROSECONDS;
+    assert (siridb_export_unpack(
+            qp_data.via.raw, qp_data.len, time, err_msg) == NULL);
+    time->precision = SIRIDB_TIME_MILLISECONDS;
+    qp_data.via.raw[0] = SIRIDB_EXPORT_VERSION + 1;
+    assert (siridb_export_unpack(
+            qp_data.via.raw, qp_data.len, time, err_msg) == NULL);
+
+    /* points must be sorted */
+    points->data[1500].ts = 0;
+    packer->len = 0;
+    assert (siridb_export_points(packer, points, time) == 0);
+    qp_unpacker_init(&unpacker, packer->buffer, packer->len);
+    assert (qp_next(&unpacker, &qp_data) == QP_RAW);
+    assert (siridb_export_unpack(
+            qp_data.via.raw, qp_data.len, time, err_msg) == NULL);
+
     siridb_points_free(points);
+    qp_packer_free(packer);
+    free(time);
 
     return test_end(TEST_OK);
 }
 
-static int test_aggr_variance(void)
+static int test_ccache(void)
 {
-    test_start("Testing variance");
+    test_start("Testing chunk cache");
 
-    siridb_aggr_t aggr;
-    siridb_points_t * result;
-    char err_msg[SIRIDB_MAX_SIZE_ERR_MSG];
-    siridb_points_t * points = prepare_points();
+    siridb_ccache_t * ccache = siridb_ccache_new(1024 * 1024);
+    siridb_shard_t shard_a = {.id=1};
+    siridb_shard_t shard_b = {.id=2};
+    siridb_point_t points[4];
+    siridb_point_t dest[4];
+    size_t size;
 
-    aggr.gid = CLERI_GID_F_VARIANCE;
-    aggr.group_by = 6;
-    aggr.limit = 0;
-    aggr.offset = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        points[i].ts = 1400000000 + i;
+        points[i].val.int64 = i * 10;
+    }
 
-    result = siridb_aggregate_run(points, &aggr, err_msg);
+    assert (siridb_ccache_get(ccache, &shard_a, 22, dest, 4) == -1);
 
-    assert (result != NULL);
-    assert (result->len == 4);
-    assert (result->tp == TP_DOUBLE);
-    assert (result->data->ts == 6 && result->data->val.real == 2.0);
-    assert ((result->data + 1)->ts == 12 &&
-            (result->data + 1)->val.real == 4.0);
+    siridb_ccache_set(ccache, &shard_a, 22, points, 4);
+    assert (siridb_ccache_get(ccache, &shard_a, 22, dest, 4) == 0);
+    assert (memcmp(dest, points, sizeof(points)) == 0);
+
+    /* same position in another shard should not be found */
+    assert (siridb_ccache_get(ccache, &shard_b, 22, dest, 4) == -1);
+
+    /* make room for exactly two entries */
+    size = ccache->size;
+    ccache->max_size = 2 * size;
+
+    siridb_ccache_set(ccache, &shard_b, 22, points, 4);
+    assert (siridb_ccache_get(ccache, &shard_a, 22, dest, 4) == 0);
+
+    /* shard_b is now the least recently used and must be removed */
+    siridb_ccache_set(ccache, &shard_a, 86, points, 4);
+    assert (ccache->size == 2 * size);
+    assert (siridb_ccache_get(ccache, &shard_b, 22, dest, 4) == -1);
+    assert (siridb_ccache_get(ccache, &shard_a, 86, dest, 4) == 0);
+
+    siridb_ccache_drop(ccache, &shard_a, 86);
+    assert (siridb_ccache_get(ccache, &shard_a, 86, dest, 4) == -1);
+    assert (siridb_ccache_get(ccache, &shard_a, 22, dest, 4) == 0);
+
+    siridb_ccache_drop_shard(ccache, &shard_a);
+    assert (siridb_ccache_get(ccache, &shard_a, 22, dest, 4) == -1);
+    assert (ccache->size == 0);
+
+    assert (ccache->hits == 4);
+    assert (ccache->misses == 5);
+
+    siridb_ccache_free(ccache);
+
+    return test_end(TEST_OK);
+}
+
+static int test_acache(void)
+{
+    test_start("Testing aggregate cache");
+
+    siridb_acache_t * acache = siridb_acache_new(1024 * 1024);
+    siridb_points_t * points = siridb_points_new(4, TP_DOUBLE);
+    siridb_points_t * cached;
+    siridb_aggr_t mean = {.gid=CLERI_GID_F_MEAN, .group_by=10};
+    siridb_aggr_t max = {.gid=CLERI_GID_F_MAX, .group_by=10};
+    siridb_aggr_t limit = {.gid=CLERI_GID_F_MEAN, .group_by=10, .limit=5};
+    uint64_t lo, hi;
+    size_t size;
+
+    assert (siridb_acache_can_use(&mean));
+    assert (!siridb_acache_can_use(&limit));
+
+    /* group 30 has no points, group 60 is outside the range */
+    points->data[0].ts = 10;
+    points->data[1].ts = 20;
+    points->data[2].ts = 40;
+    points->data[3].ts = 60;
+    for (int i = 0; i < 4; i++)
+    {
+        points->data[i].val.real = i * 1.5;
+    }
+    points->len = 4;
+
+    siridb_acache_set(acache, 1, &mean, 10, 50, points);
+
+    lo = 20;
+    hi = 100;
+    cached = siridb_acache_get(acache, 1, &mean, &lo, &hi);
+    assert (cached != NULL);
+    assert (lo == 20 && hi == 50);
+    assert (cached->len == 2);
+    assert (cached->data[0].ts == 20 && cached->data[0].val.real == 1.5);
+    assert (cached->data[1].ts == 40 && cached->data[1].val.real == 3.0);
+    siridb_points_free(cached);
+
+    /* another aggregate or series is not found */
+    lo = 0;
+    hi = 100;
+    assert (siridb_acache_get(acache, 1, &max, &lo, &hi) == NULL);
+    assert (siridb_acache_get(acache, 2, &mean, &lo, &hi) == NULL);
+
+    /* an adjoining range extends the entry */
+    siridb_acache_set(acache, 1, &mean, 60, 70, points);
+
+    lo = 0;
+    hi = 1000;
+    cached = siridb_acache_get(acache, 1, &mean, &lo, &hi);
+    assert (lo == 10 && hi == 70);
+    assert (cached->len == 4);
+    assert (cached->data[3].ts == 60);
+    siridb_points_free(cached);
+
+    /* new points after the last group keep the entry */
+    siridb_acache_drop(acache, 1, 71, 90);
+    lo = 0;
+    hi = 1000;
+    cached = siridb_acache_get(acache, 1, &mean, &lo, &hi);
+    assert (cached != NULL);
+    siridb_points_free(cached);
+
+    /* a new point in group 30 removes the entry */
+    siridb_acache_drop(acache, 1, 25, 25);
+    lo = 0;
+    hi = 1000;
+    assert (siridb_acache_get(acache, 1, &mean, &lo, &hi) == NULL);
+    assert (acache->size == 0);
+
+    /* make room for exactly two entries */
+    siridb_acache_set(acache, 1, &mean, 10, 50, points);
+    size = acache->size;
+    acache->max_size = 2 * size;
+
+    siridb_acache_set(acache, 2, &mean, 10, 50, points);
+    lo = 0;
+    hi = 100;
+    cached = siridb_acache_get(acache, 1, &mean, &lo, &hi);
+    siridb_points_free(cached);
+
+    /* series 2 is now the least recently used and must be removed */
+    siridb_acache_set(acache, 3, &mean, 10, 50, points);
+    assert (acache->size == 2 * size);
+    lo = 0;
+    hi = 100;
+    assert (siridb_acache_get(acache, 2, &mean, &lo, &hi) == NULL);
+    lo = 0;
+    hi = 100;
+    cached = siridb_acache_get(acache, 3, &mean, &lo, &hi);
+    assert (cached != NULL && cached->len == 3);
+    siridb_points_free(cached);
 
-    siridb_points_free(result);
     siridb_points_free(points);
+    siridb_acache_free(acache);
 
     return test_end(TEST_OK);
 }
 
-static int test_iso8601(void)
+static int test_qcache(void)
 {
-    test_start("Testing iso8601");
+    test_start("Testing query cache");
 
-    iso8601_tz_t amsterdam = iso8601_tz("Europe/Amsterdam");
-    assert(amsterdam > 0);
+    siridb_qcache_t * qcache = siridb_qcache_new(1024 * 1024);
+    siridb_qcache_entry_t * entry;
+    siridb_series_t series_a = {.id=3, .version=10};
+    siridb_series_t series_b = {.id=7, .version=12};
+    slist_t * slist = slist_new(2);
+    const char * q = "select * from 'a' , 'b' between 100 and 200";
+    const char * other = "select * from 'a' , 'b' between 110 and 210";
+    char data[] = "packed result";
+    size_t size;
 
-    iso8601_tz_t utc = iso8601_tz("UTC");
-    assert(utc > 0);
+    slist_append(slist, &series_a);
+    slist_append(slist, &series_b);
 
-    /* Some extra time zone test for case sensitivity etc. */
-    assert(iso8601_tz("NAIVE") == 0);
-    assert(iso8601_tz("europe/KIEV") > 0);
-    assert(iso8601_tz("Ams") < 0);
+    assert (siridb_qcache_get(qcache, q, 1.0, slist) == NULL);
 
-    /* Test parsing a year with time-zone information */
-    assert(iso8601_parse_date("2013", amsterdam) == 1356994800);
+    entry = siridb_qcache_entry_new(q, 1.0, 12, slist);
+    siridb_qcache_set(qcache, entry, data, sizeof(data));
 
-    /* Customer offset should be preferred over UTC */
-    assert(iso8601_parse_date("2013+01", utc) == 1356994800);
+    entry = siridb_qcache_get(qcache, q, 1.0, slist);
+    assert (entry != NULL);
+    assert (entry->len == sizeof(data));
+    assert (memcmp(entry->data, data, sizeof(data)) == 0);
 
-    /* UTC should be preferred over given time-zone (Amsterdam) */
-    assert(iso8601_parse_date("2013Z", amsterdam) == 1356998400);
+    /* another time precision factor is a miss and removes the entry */
+    assert (siridb_qcache_get(qcache, q, 1000.0, slist) == NULL);
+    assert (qcache->size == 0);
 
-    /* Test with minute precision */
-    assert(iso8601_parse_date("2013-02-06T13:01:12", utc) == 1360155672);
+    entry = siridb_qcache_entry_new(q, 1.0, 12, slist);
+    siridb_qcache_set(qcache, entry, data, sizeof(data));
+    size = qcache->size;
 
-    /* Test short written */
-    assert(iso8601_parse_date("2013-2-6 13:1:12", utc) == 1360155672);
+    /* a write to one of the series must invalidate the entry */
+    series_b.version = 13;
+    assert (siridb_qcache_get(qcache, q, 1.0, slist) == NULL);
+    assert (qcache->size == 0);
 
-    /* Test summer time */
-    assert(iso8601_parse_date("2016-04-21", amsterdam) == 1461189600);
+    /* room for exactly one entry, the least recently used is removed */
+    qcache->max_size = size;
 
-    /* Test error */
-    assert(iso8601_parse_date("2016 04 21", amsterdam) == -1);
+    entry = siridb_qcache_entry_new(q, 1.0, 13, slist);
+    siridb_qcache_set(qcache, entry, data, sizeof(data));
+    entry = siridb_qcache_entry_new(other, 1.0, 13, slist);
+    siridb_qcache_set(qcache, entry, data, sizeof(data));
+    assert (qcache->size == size);
+    assert (siridb_qcache_get(qcache, q, 1.0, slist) == NULL);
+    assert (siridb_qcache_get(qcache, other, 1.0, slist) != NULL);
 
-    /* Test last day in year */
-    assert(iso8601_parse_date("2013-12-31", utc) == 1388448000);
+    /* a different set of series must be a miss */
+    slist_pop(slist);
+    assert (siridb_qcache_get(qcache, other, 1.0, slist) == NULL);
+
+    assert (qcache->hits == 2);
+    assert (qcache->misses == 5);
+
+    slist_free(slist);
+    siridb_qcache_free(qcache);
 
     return test_end(TEST_OK);
 }
 
-static int test_expr(void)
+static int test_mcache(void)
 {
-    test_start("Testing expressions");
-    int64_t result;
+    test_start("Testing match cache");
 
-    assert(expr_parse(&result, "5+37") == 0 && result == 42);
-    assert(expr_parse(&result, "2+2*20") == 0 && result == 42);
-    assert(expr_parse(&result, "(2+4)*7") == 0 && result == 42);
-    assert(expr_parse(&result, "16%10*7") == 0 && result == 42);
-    assert(expr_parse(&result, "7*14%56") == 0 && result == 42);
-    assert(expr_parse(&result, "21/3*6") == 0 && result == 42);
-    assert(expr_parse(&result, "22/3*6") == 0 && result == 42);
+    siridb_mcache_t * mcache = siridb_mcache_new(1024 * 1024);
+    siridb_mcache_entry_t * entry;
+    siridb_series_t series_a = {.id=3};
+    siridb_series_t series_b = {.id=7};
+    slist_t * slist = slist_new(2);
+    const char * q = "/cpu.*/ - /other/";
+    size_t size;
 
-    /* division by zero is not a good idea */
-    assert(expr_parse(&result, "42/(2-2)") == EXPR_DIVISION_BY_ZERO);
+    slist_append(slist, &series_a);
+    slist_append(slist, &series_b);
 
-    /* module by zero is not a good idea either */
-    assert(expr_parse(&result, "42%(2-2)") == EXPR_MODULO_BY_ZERO);
+    /* only the expression is used as key, not the rest of the query */
+    assert (siridb_mcache_get(mcache, q, 7, 4) == NULL);
+
+    siridb_mcache_set(mcache, q, 7, 4, slist);
+
+    entry = siridb_mcache_get(mcache, q, 7, 4);
+    assert (entry != NULL);
+    assert (entry->n == 2);
+    assert (entry->ids[0] == 3 && entry->ids[1] == 7);
+    assert (strcmp(entry->key, "/cpu.*/") == 0);
+    assert (siridb_mcache_get(mcache, q, 6, 4) == NULL);
+
+    /* a created or dropped series invalidates the entry */
+    size = mcache->size;
+    assert (siridb_mcache_get(mcache, q, 7, 5) == NULL);
+    assert (mcache->size == 0);
+
+    /* room for exactly one entry, the least recently used is removed */
+    mcache->max_size = size;
+
+    siridb_mcache_set(mcache, q, 7, 5, slist);
+    siridb_mcache_set(mcache, q + 10, 7, 5, slist);
+    assert (mcache->size == size);
+    assert (siridb_mcache_get(mcache, q, 7, 5) == NULL);
+    assert (siridb_mcache_get(mcache, q + 10, 7, 5) != NULL);
+
+    assert (mcache->hits == 2);
+    assert (mcache->misses == 4);
+
+    slist_free(slist);
+    siridb_mcache_free(mcache);
 
     return test_end(TEST_OK);
 }
 
-static int test_access(void)
+static int test_rollup(void)
 {
-    test_start("Testing access");
-    char buffer[SIRIDB_ACCESS_STR_MAX];
-    uint32_t access_bit = 0;
+    test_start("Testing rollup");
 
-    siridb_access_to_str(buffer, access_bit);
-    assert (strcmp(buffer, "no access") == 0);
+    siridb_rollup_t rollup = {.name="test", .interval=10};
+    siridb_rollup_data_t * data = siridb_rollup_data_new(&rollup, 0);
+    siridb_points_t * points, * counts;
+    siridb_point_t batch[10];
+    char err_msg[SIRIDB_MAX_SIZE_ERR_MSG];
+    siridb_aggr_t aggr;
+    uint64_t start_ts = 5, end_ts = 35;
+    uint64_t lo, hi;
+    qp_via_t val;
 
-    access_bit |= SIRIDB_ACCESS_SHOW;
-    siridb_access_to_str(buffer, access_bit);
-    assert (strcmp(buffer, "show") == 0);
+    siridb_init_aggregates();
 
-    access_bit |= SIRIDB_ACCESS_SELECT;
-    siridb_access_to_str(buffer, access_bit);
-    assert (strcmp(buffer, "select and show") == 0);
+    /* time-stamps 1..30 one by one, 31..40 at once */
+    for (uint64_t ts = 30; ts; ts--)
+    {
+        val.int64 = (int64_t) ts;
+        siridb_rollup_add_point(data, TP_INT, ts, &val);
+    }
 
-    access_bit |= SIRIDB_ACCESS_LIST;
-    siridb_access_to_str(buffer, access_bit);
-    assert (strcmp(buffer, "list, select and show") == 0);
+    for (int i = 0; i < 10; i++)
+    {
+        batch[i].ts = 31 + i;
+        batch[i].val.int64 = 31 + i;
+    }
 
-    access_bit |= SIRIDB_ACCESS_PROFILE_WRITE;
-    siridb_access_to_str(buffer, access_bit);
-    assert (strcmp(buffer, "write") == 0);
+    siridb_rollup_add_points(data, TP_INT, batch, 10);
 
-    access_bit &= ~SIRIDB_ACCESS_INSERT;
-    siridb_access_to_str(buffer, access_bit);
-    assert (strcmp(buffer, "read and create") == 0);
+    assert (data->len == 4);
+    assert (data->buckets[0].ts == 10 && data->buckets[0].len == 10);
+    assert (data->buckets[1].stats.sum.int64 == 155);
+    assert (data->buckets[3].stats.max.int64 == 40);
 
-    assert (siridb_access_from_strn("read", 4) == (SIRIDB_ACCESS_PROFILE_READ));
-    assert (siridb_access_from_strn("list", 4) == SIRIDB_ACCESS_LIST);
+    aggr.gid = CLERI_GID_F_SUM;
+    aggr.group_by = 20;
+    aggr.limit = 0;
+    aggr.offset = 0;
+
+    /* only buckets within the time range can be used */
+    assert (siridb_rollup_range(data, &aggr, &start_ts, &end_ts, &lo, &hi));
+    assert (lo == 11 && hi == 31);
+
+    assert (siridb_rollup_get(
+            data, &aggr, TP_INT, lo, hi, &points, &counts, err_msg) == 0);
+    assert (points->len == 2 && counts->len == 2);
+    assert (points->data[0].ts == 20 && points->data[0].val.int64 == 155);
+    assert (points->data[1].ts == 40 && points->data[1].val.int64 == 255);
+    assert (counts->data[1].val.int64 == 10);
+
+    siridb_points_free(points);
+    siridb_points_free(counts);
+
+    /* the group by must be a multiple of the interval */
+    aggr.group_by = 15;
+    assert (!siridb_rollup_range(data, &aggr, NULL, NULL, &lo, &hi));
+
+    /* removed points are no longer in the range of the rollup */
+    siridb_rollup_remove(data, 15);
+    assert (data->start == 21 && data->len == 2);
+
+    aggr.group_by = 10;
+    assert (siridb_rollup_range(data, &aggr, &start_ts, NULL, &lo, &hi));
+    assert (lo == 21 && hi == UINT64_MAX);
+
+    /* older points are ignored */
+    val.int64 = 1;
+    siridb_rollup_add_point(data, TP_INT, 3, &val);
+    assert (data->len == 2);
+
+    siridb_rollup_data_free(data);
 
     return test_end(TEST_OK);
 }
 
-static int test_version(void)
+static int test_aggr_stats(void)
 {
-    test_start("Testing version");
+    test_start("Testing aggregation statistics");
 
-    assert (siri_version_cmp("1.0.0", "2.0.0") < 0);
-    assert (siri_version_cmp("2.0.0", "1.0.0") > 0);
-    assert (siri_version_cmp("2.2.0", "2.32.0") < 0);
-    assert (siri_version_cmp("2.32.0", "2.2.0") > 0);
-    assert (siri_version_cmp("2.0.5", "2.0.22") < 0);
-    assert (siri_version_cmp("2.0.22", "2.0.5") > 0);
-    assert (siri_version_cmp("2.0", "2.0.0") < 0);
-    assert (siri_version_cmp("2.0.2", "2.0") > 0);
-    assert (siri_version_cmp("a", "") > 0);
-    assert (siri_version_cmp("", "b") < 0);
-    assert (siri_version_cmp("", "") == 0);
-    assert (siri_version_cmp("2.0.0", "2.0.0") == 0);
+    siridb_points_stats_t stats, stats_a, stats_b;
+    siridb_points_t * points = prepare_points();
+    siridb_points_t * a, * b, * result;
+    char err_msg[SIRIDB_MAX_SIZE_ERR_MSG];
+    siridb_aggr_t aggr;
+
+    siridb_points_stats(&stats, points, 0, 10);
+    assert (siridb_points_stats_ok(&stats));
+    assert (stats.min.int64 == 0);
+    assert (stats.max.int64 == 8);
+    assert (stats.sum.int64 == 35);
+
+    /* statistics for two parts must combine to the total */
+    siridb_points_stats(&stats_a, points, 0, 4);
+    siridb_points_stats(&stats_b, points, 4, 10);
+    assert (siridb_aggregate_combine_val(
+            &stats_a.sum, &stats_b.sum, CLERI_GID_F_SUM, TP_INT, err_msg) == 0);
+    assert (siridb_aggregate_combine_val(
+            &stats_a.max, &stats_b.max, CLERI_GID_F_MAX, TP_INT, err_msg) == 0);
+    assert (stats_a.sum.int64 == stats.sum.int64);
+    assert (stats_a.max.int64 == stats.max.int64);
+
+    aggr.gid = CLERI_GID_F_SUM;
+    aggr.group_by = 6;
+    aggr.limit = 0;
+    aggr.offset = 0;
+
+    assert (siridb_aggregate_can_use_stats(&aggr));
+
+    /* aggregate two parts, both parts have points in group 12 */
+    points->len = 4;
+    a = siridb_aggregate_run(points, &aggr, err_msg);
+    assert (a->len == 2);
+
+    points->data += 4;
+    points->len = 6;
+    b = siridb_aggregate_run(points, &aggr, err_msg);
+    assert (b->len == 3);
+
+    points->data -= 4;
+    points->len = 10;
+
+    result = siridb_aggregate_combine(a, b, CLERI_GID_F_SUM, err_msg);
+    assert (result->len == 4);
+    assert (result->data[0].ts == 6 && result->data[0].val.int64 == 4);
+    assert (result->data[1].ts == 12 && result->data[1].val.int64 == 6);
+    assert (result->data[2].ts == 18 && result->data[2].val.int64 == 16);
+    assert (result->data[3].ts == 30 && result->data[3].val.int64 == 9);
+
+    siridb_points_free(result);
+    siridb_points_free(a);
+    siridb_points_free(b);
+    siridb_points_free(points);
 
     return test_end(TEST_OK);
 }
 
-int test_strx_to_double(void)
+static int test_aggr_filter_stats(void)
 {
-    test_start("Testing strx_to_double");
+    test_start("Testing filter with statistics");
+
+    siridb_points_stats_t stats;
+    siridb_aggr_t aggr;
+
+    aggr.gid = CLERI_GID_F_FILTER;
+    aggr.filter_tp = TP_INT;
+    aggr.filter_via.int64 = 10;
+
+    stats.min.int64 = 2;
+    stats.max.int64 = 8;
+    stats.sum.int64 = 20;
+
+    aggr.filter_opr = CEXPR_EQ;
+    assert (siridb_aggregate_filter_stats(&aggr, TP_INT, &stats) == 0);
+    aggr.filter_opr = CEXPR_GT;
+    assert (siridb_aggregate_filter_stats(&aggr, TP_INT, &stats) == 0);
+    aggr.filter_opr = CEXPR_GE;
+    assert (siridb_aggregate_filter_stats(&aggr, TP_INT, &stats) == 0);
+    aggr.filter_opr = CEXPR_LT;
+    assert (siridb_aggregate_filter_stats(&aggr, TP_INT, &stats) == 1);
+    aggr.filter_opr = CEXPR_NE;
+    assert (siridb_aggregate_filter_stats(&aggr, TP_INT, &stats) == 1);
+
+    /* all points are equal to the filter value */
+    stats.min.int64 = stats.max.int64 = 10;
+    assert (siridb_aggregate_filter_stats(&aggr, TP_INT, &stats) == 0);
+    aggr.filter_opr = CEXPR_LE;
+    assert (siridb_aggregate_filter_stats(&aggr, TP_INT, &stats) == 1);
+
+    /* a double filter on integer points is truncated like the filter */
+    aggr.filter_tp = TP_DOUBLE;
+    aggr.filter_via.real = 10.5;
+    aggr.filter_opr = CEXPR_EQ;
+    assert (siridb_aggregate_filter_stats(&aggr, TP_INT, &stats) == 1);
+
+    stats.min.real = 1.5;
+    stats.max.real = 9.5;
+    assert (siridb_aggregate_filter_stats(&aggr, TP_DOUBLE, &stats) == 0);
+    aggr.filter_opr = CEXPR_LE;
+    assert (siridb_aggregate_filter_stats(&aggr, TP_DOUBLE, &stats) == 1);
+    aggr.filter_opr = CEXPR_GT;
+    assert (siridb_aggregate_filter_stats(&aggr, TP_DOUBLE, &stats) == 0);
+
+    /* chunks without statistics must be read */
+    siridb_points_stats_invalidate(&stats);
+    assert (siridb_aggregate_filter_stats(&aggr, TP_DOUBLE, &stats) == 1);
+
+    return test_end(TEST_OK);
+}
+
+static int test_qplans(void)
+{
+    test_start("Testing query plans");
+
+    cleri_grammar_t * grammar = compile_grammar();
+    siridb_qplans_t * qplans = siridb_qplans_new(1);
+    siridb_qplan_t * plan;
+    cleri_parse_t * pr;
+    const char * q =
+            "select mean(1h) from 'series-001' between 100 and 200";
+    const char * other =
+            "select mean(30m) from 'series-001' between 1000 and now";
+
+    pr = cleri_parse(grammar, q);
+    assert (pr->is_valid == 1);
+    plan = siridb_qplans_add(qplans, q, pr);
+    assert (plan != NULL);
+    assert (plan->n == 3);
+
+    /* a plan cannot be used while in use */
+    assert (siridb_qplans_get(qplans, q) == NULL);
+    siridb_qplans_release(qplans, plan);
+
+    /* only integer values are different */
+    assert (siridb_qplans_get(qplans,
+            "select mean(2h) from 'series-001' between 10 and 20") == plan);
+    assert (strcmp(plan->pr->str,
+            "select mean(2h) from 'series-001' between 10 and 20") == 0);
+    assert (plan->pr->tree->str == plan->q);
+    siridb_qplans_release(qplans, plan);
+
+    /* different shape, values in strings are not a parameter */
+    assert (siridb_qplans_get(qplans, other) == NULL);
+    assert (siridb_qplans_get(qplans,
+            "select mean(1h) from 'series-002' between 100 and 200") == NULL);
+
+    /* the time unit is not a parameter */
+    assert (siridb_qplans_get(qplans,
+            "select mean(1m) from 'series-001' between 100 and 200") == NULL);
+
+    /* the cache is full, the unused plan is replaced */
+    pr = cleri_parse(grammar, other);
+    plan = siridb_qplans_add(qplans, other, pr);
+    assert (plan != NULL);
+    assert (qplans->len == 1);
+    siridb_qplans_release(qplans, plan);
+
+    /* only select, list and count queries are cached */
+    pr = cleri_parse(grammar, "show version");
+    assert (siridb_qplans_add(qplans, "show version", pr) == NULL);
+    cleri_parse_free(pr);
+
+    assert (qplans->hits == 1);
+    assert (qplans->misses == 4);
+
+    siridb_qplans_free(qplans);
+    cleri_grammar_free(grammar);
+
+    return test_end(TEST_OK);
+}
+
+static int test_series_cost(void)
+{
+    test_start("Testing series cost");
+
+    siridb_series_t series;
+    siridb_series_cost_t cost;
+    idx_t idx[3];
+    qp_via_t val = {.int64=1};
+    uint64_t ts, start_ts = 5, end_ts = 25;
+
+    memset(&series, 0, sizeof(siridb_series_t));
+    memset(idx, 0, sizeof(idx));
+
+    /* two chunks in the first shard and one in the second */
+    idx[0] = (idx_t) {.shard=(siridb_shard_t *) 1, .len=10, .end_ts=9};
+    idx[1] = (idx_t) {
+            .shard=(siridb_shard_t *) 1, .len=10, .start_ts=10, .end_ts=19};
+    idx[2] = (idx_t) {
+            .shard=(siridb_shard_t *) 2, .len=10, .start_ts=20, .end_ts=29};
+
+    series.idx = idx;
+    series.idx_len = 3;
+    series.buffer = siridb_points_new(3, TP_INT);
+
+    for (ts = 30; ts < 33; ts++)
+    {
+        siridb_points_add_point(series.buffer, &ts, &val);
+    }
+
+    /* only the middle chunk is completely in range */
+    memset(&cost, 0, sizeof(siridb_series_cost_t));
+    siridb_series_cost(&series, &start_ts, &end_ts, &cost);
+    assert (cost.series == 1);
+    assert (cost.shards == 2);
+    assert (cost.chunks == 3);
+    assert (cost.points == 30);
+    assert (cost.min_points == 10);
+
+    /* without a range all chunks and the buffer are counted */
+    memset(&cost, 0, sizeof(siridb_series_cost_t));
+    siridb_series_cost(&series, NULL, NULL, &cost);
+    assert (cost.chunks == 3);
+    assert (cost.points == 33);
+    assert (cost.min_points == 33);
+
+    /* buffer points are counted exactly */
+    start_ts = 31;
+    end_ts = 40;
+    memset(&cost, 0, sizeof(siridb_series_cost_t));
+    siridb_series_cost(&series, &start_ts, &end_ts, &cost);
+    assert (cost.shards == 0);
+    assert (cost.chunks == 0);
+    assert (cost.points == 2);
+
+    siridb_points_free(series.buffer);
+
+    return test_end(TEST_OK);
+}
+
+static void test_on_data(
+        uv_stream_t * client __attribute__((unused)),
+        sirinet_pkg_t * pkg __attribute__((unused)))
+{
+}
+
+static int test_query_cancel(void)
+{
+    test_start("Testing query cancellation");
+
+    cleri_grammar_t * grammar = compile_grammar();
+    siri_cfg_t * cfg = siri.cfg;
+    siri_cfg_t tmp_cfg;
+    sirinet_socket_t ssocket;
+    siridb_query_t query;
+    char err_msg[SIRIDB_MAX_SIZE_ERR_MSG];
+    cleri_parse_t * pr;
+
+    pr = cleri_parse(grammar, "kill query 42");
+    assert (pr->is_valid == 1);
+    cleri_parse_free(pr);
+
+    pr = cleri_parse(grammar, "list queries limit 5");
+    assert (pr->is_valid == 1);
+    cleri_parse_free(pr);
+
+    memset(&tmp_cfg, 0, sizeof(siri_cfg_t));
+    memset(&ssocket, 0, sizeof(sirinet_socket_t));
+    memset(&query, 0, sizeof(siridb_query_t));
+
+    siri.cfg = &tmp_cfg;
+    ssocket.on_data = test_on_data;
+    ssocket.handle.tcp.data = &ssocket;
+    query.client = (uv_stream_t *) &ssocket.handle.tcp;
+    query.id = 42;
+    clock_gettime(CLOCK_REALTIME, &query.start);
+
+    assert (siridb_query_is_cancelled(&query, err_msg) == 0);
+
+    /* killed */
+    query.flags |= SIRIDB_QUERY_FLAG_KILLED;
+    assert (siridb_query_is_cancelled(&query, err_msg) == 1);
+    assert (strcmp(err_msg, "Query (42) is killed.") == 0);
+    query.flags = 0;
+
+    /* client connection is closed */
+    ssocket.on_data = NULL;
+    assert (siridb_query_is_cancelled(&query, err_msg) == 1);
+    ssocket.on_data = test_on_data;
+
+    /* timeout */
+    tmp_cfg.query_timeout = 10;
+    assert (siridb_query_is_cancelled(&query, err_msg) == 0);
+    query.start.tv_sec -= 10;
+    assert (siridb_query_is_cancelled(&query, err_msg) == 1);
+    tmp_cfg.query_timeout = 0;
+    assert (siridb_query_is_cancelled(&query, err_msg) == 0);
+
+    siri.cfg = cfg;
+
+    cleri_grammar_free(grammar);
+
+    return test_end(TEST_OK);
+}
+
+static int test_re_cache(void)
+{
+    test_start("Testing regular expression cache");
+
+    siridb_re_cache_t * re_cache = siridb_re_cache_new(1);
+    char err_msg[SIRIDB_MAX_SIZE_ERR_MSG];
+    siridb_re_t * re_a;
+    siridb_re_t * re_b;
+
+    re_a = siridb_re_get(re_cache, "/cpu.*/i", 8, err_msg);
+    assert (re_a != NULL && re_a->ref == 2);
+    assert (siridb_re_match(re_a, "CPU-01", 6) == 0);
+    assert (siridb_re_match(re_a, "mem-01", 6) < 0);
+
+    /* the same source returns the cached expression */
+    re_b = siridb_re_get(re_cache, "/cpu.*/i", 8, err_msg);
+    assert (re_b == re_a && re_a->ref == 3);
+    assert (re_cache->hits == 1 && re_cache->misses == 1);
+    siridb_re_decref(re_cache, re_b);
+
+    /* the least recently used expression is removed but still usable */
+    re_b = siridb_re_get(re_cache, "/mem.*/", 7, err_msg);
+    assert (re_b != NULL && re_cache->len == 1 && re_a->ref == 1);
+    assert (siridb_re_match(re_a, "cpu", 3) == 0);
+    siridb_re_decref(re_cache, re_a);
+
+    assert (siridb_re_get(re_cache, "/(cpu/", 6, err_msg) == NULL);
+
+    siridb_re_decref(re_cache, re_b);
+    siridb_re_cache_free(re_cache);
+
+    return test_end(TEST_OK);
+}
+
+static int test_trigrams(void)
+{
+    test_start("Testing series name index");
+
+    siridb_trigrams_t * trigrams = siridb_trigrams_new();
+    siridb_trigrams_ids_t * ids;
+    siridb_series_t series[4];
+    char * names[4] = {"host-42.cpu", "host-42.mem", "host-7.cpu", "ab"};
+
+    memset(series, 0, sizeof(series));
+
+    for (size_t i = 0; i < 4; i++)
+    {
+        series[i].id = i + 1;
+        series[i].name = names[i];
+        series[i].name_len = strlen(names[i]);
+        siridb_trigrams_add(trigrams, &series[i]);
+    }
+
+    ids = siridb_trigrams_match(trigrams, "/host-42.*cpu/", 14);
+    assert (ids != NULL && ids->len == 1 && ids->ids[0] == 1);
+    free(ids);
+
+    ids = siridb_trigrams_match(trigrams, "/host-.*/", 9);
+    assert (ids != NULL && ids->len == 3);
+    free(ids);
+
+    /* optional characters and groups are not required */
+    ids = siridb_trigrams_match(trigrams, "/hostx?-42(abc)*.*/", 19);
+    assert (ids != NULL && ids->len == 2);
+    assert (ids->ids[0] == 1 && ids->ids[1] == 2);
+    free(ids);
+
+    ids = siridb_trigrams_match(trigrams, "/xyz.*/", 7);
+    assert (ids != NULL && ids->len == 0);
+    free(ids);
+
+    /* the index cannot be used */
+    assert (siridb_trigrams_match(trigrams, "/host-42.cpu|ab/", 16) == NULL);
+    assert (siridb_trigrams_match(trigrams, "/host-42.*/i", 12) == NULL);
+    assert (siridb_trigrams_match(trigrams, "/(?i)host.*/", 12) == NULL);
+    assert (siridb_trigrams_match(trigrams, "/a.*/", 5) == NULL);
+
+    siridb_trigrams_remove(trigrams, &series[0]);
+
+    ids = siridb_trigrams_match(trigrams, "/host-42.*cpu/", 14);
+    assert (ids != NULL && ids->len == 0);
+    free(ids);
+
+    ids = siridb_trigrams_match(trigrams, "/host-.*/", 9);
+    assert (ids != NULL && ids->len == 2);
+    assert (ids->ids[0] == 2 && ids->ids[1] == 3);
+    free(ids);
+
+    siridb_trigrams_free(trigrams);
+
+    return test_end(TEST_OK);
+}
+
+static int test_tokens(void)
+{
+    test_start("Testing series token index");
+
+    siridb_tokens_t * tokens = siridb_tokens_new(".-");
+    slist_t * slist;
+    siridb_series_t series[4];
+    char * names[4] = {"dc1.host42.cpu", "dc1.host42.mem", "dc2-host7.cpu",
+            "cpu"};
+
+    memset(series, 0, sizeof(series));
+
+    for (size_t i = 0; i < 4; i++)
+    {
+        series[i].ref = 1;
+        series[i].id = i + 1;
+        series[i].name = names[i];
+        series[i].name_len = strlen(names[i]);
+        siridb_tokens_add(tokens, &series[i]);
+    }
+
+    /* series 'cpu' has the token but cannot match, which is allowed */
+    slist = siridb_tokens_match(tokens, "/.*\\.cpu/", 9);
+    assert (slist != NULL && slist->len == 3);
+    assert (series[0].ref == 2 && series[1].ref == 1);
+    for (size_t i = 0; i < slist->len; i++)
+    {
+        siridb_series_t * tmp = (siridb_series_t *) slist->data[i];
+        siridb_series_decref(tmp);
+    }
+    slist_free(slist);
+
+    slist = siridb_tokens_match(tokens, "/dc1\\.host42\\.m.*/", 18);
+    assert (slist != NULL && slist->len == 2);
+    series[0].ref--;
+    series[1].ref--;
+    slist_free(slist);
+
+    slist = siridb_tokens_match(tokens, "/dc2-.*cpu/", 11);
+    assert (slist != NULL && slist->len == 1);
+    assert (slist->data[0] == &series[2]);
+    series[2].ref--;
+    slist_free(slist);
+
+    slist = siridb_tokens_match(tokens, "/.*-xyz-.*/", 11);
+    assert (slist != NULL && slist->len == 0);
+    slist_free(slist);
+
+    /* the index cannot be used */
+    assert (siridb_tokens_match(tokens, "/.*\\.cp.*/", 10) == NULL);
+    assert (siridb_tokens_match(tokens, "/.*\\.cpu|dc1/", 13) == NULL);
+    assert (siridb_tokens_match(tokens, "/.*\\.cpu/i", 10) == NULL);
+
+    siridb_tokens_remove(tokens, &series[0]);
+
+    slist = siridb_tokens_match(tokens, "/dc1\\..*/", 9);
+    assert (slist != NULL && slist->len == 1);
+    assert (slist->data[0] == &series[1]);
+    series[1].ref--;
+    slist_free(slist);
+
+    assert (series[0].ref == 1 && series[1].ref == 1 && series[2].ref == 1);
+
+    siridb_tokens_free(tokens);
+
+    return test_end(TEST_OK);
+}
+
+static int test_shash(void)
+{
+    test_start("Testing series hash index");
+
+    siridb_shash_t * shash = siridb_shash_new();
+    siridb_lookup_t * lookup = siridb_lookup_new(3, SIRIDB_LOOKUP_HASH_SUM);
+    siridb_shash_key_t key;
+    siridb_series_t series[3000];
+    char names[3000][16];
+
+    memset(series, 0, sizeof(series));
+
+    /* enough series to grow the index a few times */
+    for (size_t i = 0; i < 3000; i++)
+    {
+        series[i].name = names[i];
+        series[i].name_len = sprintf(names[i], "series-%zu", i);
+        siridb_shash_add(shash, &series[i]);
+    }
+    assert (shash->is_valid && shash->len == 3000);
+
+    for (size_t i = 0; i < 3000; i++)
+    {
+        siridb_shash_key(&key, names[i], series[i].name_len);
+        assert (siridb_shash_get(
+                shash, &key, names[i], series[i].name_len) == &series[i]);
+        assert (siridb_lookup_key(lookup, &key) ==
+                siridb_lookup_sn(lookup, names[i]));
+    }
+
+    /* only the given length is used */
+    siridb_shash_key(&key, "series-42!", 9);
+    assert (siridb_shash_get(shash, &key, "series-42!", 9) == &series[42]);
+    siridb_shash_key(&key, "series-3000", 11);
+    assert (siridb_shash_get(shash, &key, "series-3000", 11) == NULL);
+
+    for (size_t i = 0; i < 3000; i += 2)
+    {
+        siridb_shash_remove(shash, &series[i]);
+    }
+    assert (shash->len == 1500);
+
+    for (size_t i = 0; i < 3000; i++)
+    {
+        siridb_shash_key(&key, names[i], series[i].name_len);
+        assert (siridb_shash_get(
+                shash, &key, names[i], series[i].name_len) ==
+                        ((i % 2) ? &series[i] : NULL));
+    }
+
+    siridb_lookup_free(lookup);
+    siridb_shash_free(shash);
+
+    return test_end(TEST_OK);
+}
+
+static int test_aggr_count(void)
+{
+    test_start("Testing aggregation count");
+
+    siridb_aggr_t aggr;
+    siridb_points_t * result;
+    char err_msg[SIRIDB_MAX_SIZE_ERR_MSG];
+    siridb_points_t * points = prepare_points();
+
+    aggr.gid = CLERI_GID_F_COUNT;
+    aggr.group_by = 6;
+    aggr.limit = 0;
+    aggr.offset = 0;
+
+    result = siridb_aggregate_run(points, &aggr, err_msg);
+
+    assert (result != NULL);
+    assert (result->len == 4);
+    assert (result->tp == TP_INT);
+    assert (result->data->ts == 6 && result->data->val.int64 == 2);
+    assert ((result->data + 3)->ts == 30 &&
+            (result->data + 3)->val.int64 == 2);
+
+    siridb_points_free(result);
+    siridb_points_free(points);
+
+    return test_end(TEST_OK);
+}
+
+static int test_aggr_max(void)
+{
+    test_start("Testing aggregation max");
+
+    siridb_aggr_t aggr;
+    siridb_points_t * result;
+    char err_msg[SIRIDB_MAX_SIZE_ERR_MSG];
+    siridb_points_t * points = prepare_points();
+
+    aggr.gid = CLERI_GID_F_MAX;
+    aggr.group_by = 10;
+    aggr.limit = 0;
+    aggr.offset = 0;
+
+    result = siridb_aggregate_run(points, &aggr, err_msg);
+
+    assert (result != NULL);
+    assert (result->len == 3);
+    assert (result->tp == TP_INT);
+    assert (result->data->ts == 10 && result->data->val.int64 == 3);
+    assert ((result->data + 2)->ts == 30 &&
+            (result->data + 2)->val.int64 == 6);
+
+    siridb_points_free(result);
+    siridb_points_free(points);
+
+    return test_end(TEST_OK);
+}
+
+static int test_aggr_limit(void)
+{
+    test_start("Testing aggregation limit");
+
+    siridb_aggr_t aggr;
+    siridb_points_t * result;
+    char err_msg[SIRIDB_MAX_SIZE_ERR_MSG];
+    siridb_points_t * points = prepare_points();
+
+    aggr.gid = CLERI_GID_F_MEAN;
+    aggr.group_by = 0;
+    aggr.limit = 3;
+    aggr.offset = 0;
+
+    result = siridb_aggregate_run(points, &aggr, err_msg);
+
+    assert (result != NULL);
+    assert (result->len == 3);
+    assert (result->tp == TP_DOUBLE);
+    assert ((result->data + 2)->val.real == 4.5);
+
+    /* the aggregate is shared between series so it may not change */
+    assert (aggr.group_by == 0 && aggr.offset == 0);
+
+    siridb_points_free(result);
+    siridb_points_free(points);
+
+    return test_end(TEST_OK);
+}
+
+static int test_aggr_lttb(void)
+{
+    test_start("Testing aggregation lttb and minmax");
+
+    siridb_aggr_t aggr;
+    siridb_points_t * result;
+    char err_msg[SIRIDB_MAX_SIZE_ERR_MSG];
+    siridb_points_t * points = prepare_points();
+
+    aggr.gid = CLERI_GID_F_LTTB;
+    aggr.group_by = 0;
+    aggr.limit = 0;
+    aggr.offset = 0;
+    aggr.target = 10;
+
+    /* not more points than the target */
+    assert (siridb_aggregate_run(points, &aggr, err_msg) == points);
+
+    aggr.target = 4;
+    result = siridb_aggregate_run(points, &aggr, err_msg);
+
+    assert (result != NULL);
+    assert (result->len == 4);
+    assert (result->tp == TP_INT);
+    assert (result->data->ts == 3 && result->data->val.int64 == 1);
+    assert ((result->data + 1)->ts == 7 &&
+            (result->data + 1)->val.int64 == 0);
+    assert ((result->data + 2)->ts == 13 &&
+            (result->data + 2)->val.int64 == 8);
+    assert ((result->data + 3)->ts == 27 &&
+            (result->data + 3)->val.int64 == 3);
+
+    siridb_points_free(result);
+
+    aggr.gid = CLERI_GID_F_MINMAX;
+    result = siridb_aggregate_run(points, &aggr, err_msg);
+
+    /* min and max of two buckets, in time order */
+    assert (result != NULL);
+    assert (result->len == 4);
+    assert (result->data->ts == 7 && result->data->val.int64 == 0);
+    assert ((result->data + 1)->ts == 11 &&
+            (result->data + 1)->val.int64 == 4);
+    assert ((result->data + 2)->ts == 13 &&
+            (result->data + 2)->val.int64 == 8);
+    assert ((result->data + 3)->ts == 14 &&
+            (result->data + 3)->val.int64 == 3);
+
+    siridb_points_free(result);
+    siridb_points_free(points);
+
+    return test_end(TEST_OK);
+}
+
+static int test_aggr_mean(void)
+{
+    test_start("Testing aggregation mean");
+
+    siridb_aggr_t aggr;
+    siridb_points_t * result;
+    char err_msg[SIRIDB_MAX_SIZE_ERR_MSG];
+    siridb_points_t * points = prepare_points();
+
+    aggr.gid = CLERI_GID_F_MEAN;
+    aggr.group_by = 4;
+    aggr.limit = 0;
+    aggr.offset = 0;
+
+    result = siridb_aggregate_run(points, &aggr, err_msg);
+
+    assert (result != NULL);
+    assert (result->len == 5);
+    assert (result->tp == TP_DOUBLE);
+    assert (result->data->ts == 4 && result->data->val.real == 1.0);
+    assert ((result->data + 4)->ts == 28 &&
+            (result->data + 4)->val.real == 4.5);
+
+    siridb_points_free(result);
+    siridb_points_free(points);
+
+    return test_end(TEST_OK);
+}
+
+static int test_aggr_median(void)
+{
+    test_start("Testing aggregation median");
+
+    siridb_aggr_t aggr;
+    siridb_points_t * result;
+    char err_msg[SIRIDB_MAX_SIZE_ERR_MSG];
+    siridb_points_t * points = prepare_points();
+
+    aggr.gid = CLERI_GID_F_MEDIAN;
+    aggr.group_by = 7;
+    aggr.limit = 0;
+    aggr.offset = 0;
+
+    result = siridb_aggregate_run(points, &aggr, err_msg);
+
+    assert (result != NULL);
+    assert (result->len == 4);
+    assert (result->tp == TP_DOUBLE);
+    assert (result->data->ts == 7 && result->data->val.real == 1.0);
+    assert ((result->data + 1)->ts == 14 &&
+            (result->data + 1)->val.real == 3.5);
+
+    siridb_points_free(result);
+    siridb_points_free(points);
+
+    return test_end(TEST_OK);
+}
+
+static int test_aggr_fused(void)
+{
+    test_start("Testing fused aggregation");
+
+    siridb_aggr_t difference, filter, mean;
+    siridb_points_t * points = prepare_points();
+    siridb_points_t * expected, * tmp, * result;
+    char err_msg[SIRIDB_MAX_SIZE_ERR_MSG];
+    slist_t * alist = slist_new(3);
+
+    difference.gid = CLERI_GID_F_DIFFERENCE;
+    difference.group_by = 0;
+    difference.limit = 0;
+
+    filter.gid = CLERI_GID_F_FILTER;
+    filter.group_by = 0;
+    filter.limit = 0;
+    filter.filter_opr = CEXPR_GT;
+    filter.filter_tp = TP_INT;
+    filter.filter_via.int64 = 0;
+
+    mean.gid = CLERI_GID_F_MEAN;
+    mean.group_by = 6;
+    mean.limit = 0;
+    mean.offset = 0;
+
+    slist_append(alist, &difference);
+    slist_append(alist, &filter);
+    slist_append(alist, &mean);
+
+    /* run the aggregates one by one */
+    expected = siridb_aggregate_run(points, &difference, err_msg);
+    tmp = siridb_aggregate_run(expected, &filter, err_msg);
+    siridb_points_free(expected);
+    expected = siridb_aggregate_run(tmp, &mean, err_msg);
+    siridb_points_free(tmp);
+
+    /* the fused chain consumes the points */
+    result = siridb_aggregate_run_list(points, alist, 0, err_msg);
+
+    assert (result != NULL);
+    assert (result->tp == TP_DOUBLE);
+    assert (result->len == 4);
+    assert (result->len == expected->len);
+
+    for (size_t i = 0; i < result->len; i++)
+    {
+        assert (result->data[i].ts == expected->data[i].ts);
+        assert (result->data[i].val.real == expected->data[i].val.real);
+    }
+
+    assert (result->data[2].ts == 18 && result->data[2].val.real == 3.0);
+
+    siridb_points_free(result);
+    siridb_points_free(expected);
+
+    /* without group by the points are filtered in place */
+    points = prepare_points();
+    alist->len = 2;
+    result = siridb_aggregate_run_list(points, alist, 0, err_msg);
+
+    assert (result == points);
+    assert (result->len == 6);
+    assert (result->data[5].ts == 25 && result->data[5].val.int64 == 1);
+
+    siridb_points_free(result);
+    slist_free(alist);
+
+    return test_end(TEST_OK);
+}
+
+static int test_aggr_percentile(void)
+{
+    test_start("Testing aggregation percentile");
+
+    siridb_aggr_t aggr;
+    siridb_points_t * result;
+    char err_msg[SIRIDB_MAX_SIZE_ERR_MSG];
+    siridb_points_t * points = prepare_points();
+    siridb_tdigest_t td;
+    siridb_tdigest_t other;
+    double val;
+
+    aggr.gid = CLERI_GID_F_PERCENTILE;
+    aggr.group_by = 7;
+    aggr.limit = 0;
+    aggr.offset = 0;
+    aggr.percentile = 50.0;
+
+    result = siridb_aggregate_run(points, &aggr, err_msg);
+
+    /* exact for small groups, the 50th percentile equals the median */
+    assert (result != NULL);
+    assert (result->len == 4);
+    assert (result->tp == TP_DOUBLE);
+    assert (result->data->ts == 7 && result->data->val.real == 1.0);
+    assert ((result->data + 1)->ts == 14 &&
+            (result->data + 1)->val.real == 3.5);
+
+    siridb_points_free(result);
+
+    aggr.percentile = 100.0;
+    result = siridb_aggregate_run(points, &aggr, err_msg);
+
+    assert (result != NULL);
+    assert ((result->data + 1)->ts == 14 &&
+            (result->data + 1)->val.real == 8.0);
+
+    siridb_points_free(result);
+    siridb_points_free(points);
+
+    /* large number of values, merged from two digests */
+    siridb_tdigest_init(&td);
+    siridb_tdigest_init(&other);
+
+    for (int i = 0; i < 100000; i++)
+    {
+        siridb_tdigest_add((i % 2) ? &td : &other, (double) i, 1.0);
+    }
+
+    siridb_tdigest_merge(&td, &other);
+
+    assert (siridb_tdigest_quantile(&td, 0.0) == 0.0);
+    assert (siridb_tdigest_quantile(&td, 1.0) == 99999.0);
+
+    val = siridb_tdigest_quantile(&td, 0.99);
+    assert (val > 98900.0 && val < 99100.0);
+
+    val = siridb_tdigest_quantile(&td, 0.5);
+    assert (val > 49500.0 && val < 50500.0);
+
+    return test_end(TEST_OK);
+}
+
+static int test_aggr_median_high(void)
+{
+    test_start("Testing aggregation median_high");
+
+    siridb_aggr_t aggr;
+    siridb_points_t * result;
+    char err_msg[SIRIDB_MAX_SIZE_ERR_MSG];
+    siridb_points_t * points = prepare_points();
+
+    aggr.gid = CLERI_GID_F_MEDIAN_HIGH;
+    aggr.group_by = 7;
+    aggr.limit = 0;
+    aggr.offset = 0;
+
+    result = siridb_aggregate_run(points, &aggr, err_msg);
+
+    assert (result != NULL);
+    assert (result->len == 4);
+    assert (result->tp == TP_INT);
+    assert (result->data->ts == 7 && result->data->val.int64 == 1);
+    assert ((result->data + 1)->ts == 14 &&
+            (result->data + 1)->val.int64 == 4);
+
+    siridb_points_free(result);
+    siridb_points_free(points);
+
+    return test_end(TEST_OK);
+}
+
+static int test_aggr_median_low(void)
+{
+    test_start("Testing aggregation median_low");
+
+    siridb_aggr_t aggr;
+    siridb_points_t * result;
+    char err_msg[SIRIDB_MAX_SIZE_ERR_MSG];
+    siridb_points_t * points = prepare_points();
+
+    aggr.gid = CLERI_GID_F_MEDIAN_LOW;
+    aggr.group_by = 7;
+    aggr.limit = 0;
+    aggr.offset = 0;
+
+    result = siridb_aggregate_run(points, &aggr, err_msg);
+
+    assert (result != NULL);
+    assert (result->len == 4);
+    assert (result->tp == TP_INT);
+    assert (result->data->ts == 7 && result->data->val.int64 == 1);
+    assert ((result->data + 1)->ts == 14 &&
+            (result->data + 1)->val.int64 == 3);
+
+    siridb_points_free(result);
+    siridb_points_free(points);
+
+    return test_end(TEST_OK);
+}
+
+static int test_aggr_min(void)
+{
+    test_start("Testing aggregation min");
+
+    siridb_aggr_t aggr;
+    siridb_points_t * result;
+    char err_msg[SIRIDB_MAX_SIZE_ERR_MSG];
+    siridb_points_t * points = prepare_points();
+
+    aggr.gid = CLERI_GID_F_MIN;
+    aggr.group_by = 2;
+    aggr.limit = 0;
+    aggr.offset = 0;
+
+    result = siridb_aggregate_run(points, &aggr, err_msg);
+
+    assert (result != NULL);
+    assert (result->len == 9);
+    assert (result->tp == TP_INT);
+    assert (result->data->ts == 4 && result->data->val.int64 == 1);
+    assert ((result->data + 5)->ts == 14 &&
+            (result->data + 5)->val.int64 == 3);
+
+    siridb_points_free(result);
+    siridb_points_free(points);
+
+    return test_end(TEST_OK);
+}
+
+static int test_aggr_pvariance(void)
+{
+    test_start("Testing pvariance");
+
+    siridb_aggr_t aggr;
+    siridb_points_t * result;
+    char err_msg[SIRIDB_MAX_SIZE_ERR_MSG];
+    siridb_points_t * points = prepare_points();
+
+    aggr.gid = CLERI_GID_F_PVARIANCE;
+    aggr.group_by = 5;
+    aggr.limit = 0;
+    aggr.offset = 0;
+
+    result = siridb_aggregate_run(points, &aggr, err_msg);
+
+    assert (result != NULL);
+    assert (result->len == 5);
+    assert (result->tp == TP_DOUBLE);
+    assert (result->data->ts == 5 && result->data->val.real == 0.0);
+    assert ((result->data + 2)->ts == 15 &&
+            (result->data + 2)->val.real == 3.5);
+
+    siridb_points_free(result);
+    siridb_points_free(points);
+
+    return test_end(TEST_OK);
+}
+
+static int test_aggr_sum(void)
+{
+    test_start("Testing aggregation sum");
+
+    siridb_aggr_t aggr;
+    siridb_points_t * result;
+    char err_msg[SIRIDB_MAX_SIZE_ERR_MSG];
+    siridb_points_t * points = prepare_points();
+
+    aggr.gid = CLERI_GID_F_SUM;
+    aggr.group_by = 5;
+    aggr.limit = 0;
+    aggr.offset = 0;
+
+    result = siridb_aggregate_run(points, &aggr, err_msg);
+
+    assert (result != NULL);
+    assert (result->len == 5);
+    assert (result->tp == TP_INT);
+    assert (result->data->ts == 5 && result->data->val.int64 == 1);
+    assert ((result->data + 2)->ts == 15 &&
+            (result->data + 2)->val.int64 == 20);
+
+    siridb_points_free(result);
+    siridb_points_free(points);
+
+    return test_end(TEST_OK);
+}
+
+static int test_points_merge_runs(void)
+{
+    test_start("Testing points merge runs");
+
+    /* five sorted runs, the runs at offset 0 and 6 both have ts 4 */
+    uint64_t ts[] = {1, 4, 9, 2, 3, 8, 4, 5, 7, 7, 0, 6};
+    uint64_t expected[] = {0, 1, 2, 3, 4, 4, 5, 6, 7, 7, 8, 9};
+    size_t offsets[6] = {0, 3, 6, 9, 10};
+    siridb_points_t * points = siridb_points_new(12, TP_INT);
+    size_t i;
+
+    for (i = 0; i < 12; i++)
+    {
+        points->data[i].ts = ts[i];
+        points->data[i].val.int64 = (int64_t) i;
+    }
+    points->len = 12;
+
+    assert (siridb_points_merge_runs(points, offsets, 5) == 0);
+
+    for (i = 0; i < 12; i++)
+    {
+        assert (points->data[i].ts == expected[i]);
+    }
+
+    /* points with the same time-stamp keep the order of their runs */
+    assert (points->data[4].val.int64 == 1);
+    assert (points->data[5].val.int64 == 6);
+    assert (points->data[8].val.int64 == 8);
+    assert (points->data[9].val.int64 == 9);
+
+    /* a single run is not changed */
+    offsets[0] = 0;
+    assert (siridb_points_merge_runs(points, offsets, 1) == 0);
+    assert (points->data[0].ts == 0 && points->data[11].ts == 9);
+
+    siridb_points_free(points);
+
+    return test_end(TEST_OK);
+}
+
+static int test_points_merge(void)
+{
+    test_start("Testing points merge");
+
+    siridb_aggr_t aggr;
+    siridb_points_t * result;
+    siridb_points_t * merged;
+    siridb_points_t * expected;
+    siridb_points_t * partial;
+    siridb_points_t * counts;
+    siridb_points_t * other;
+    siridb_points_t * other_counts;
+    siridb_points_t * sums;
+    siridb_points_t * merged_counts;
+    char err_msg[SIRIDB_MAX_SIZE_ERR_MSG];
+    slist_t * plist;
+
+    aggr.gid = CLERI_GID_F_MEAN;
+    aggr.group_by = 5;
+    aggr.limit = 0;
+    aggr.offset = 0;
+
+    /* plain merge of overlapping points */
+    plist = slist_new(3);
+    slist_append(plist, prepare_points());
+    slist_append(plist, prepare_points());
+    slist_append(plist, siridb_points_new(0, TP_INT));
+
+    merged = siridb_points_merge(plist, err_msg);
+
+    assert (merged != NULL);
+    assert (plist->len == 0);
+    assert (merged->len == 20);
+    for (size_t i = 1; i < merged->len; i++)
+    {
+        assert (merged->data[i - 1].ts <= merged->data[i].ts);
+    }
+
+    /* merge and aggregate must give the same result */
+    slist_append(plist, prepare_points());
+    slist_append(plist, prepare_points());
+
+    result = siridb_points_merge_aggr(plist, &aggr, err_msg);
+
+    assert (result != NULL);
+    assert (plist->len == 0);
+
+    expected = siridb_aggregate_run(merged, &aggr, err_msg);
+
+    assert (expected != NULL);
+    assert (result->len == expected->len);
+    assert (result->tp == TP_DOUBLE);
+    for (size_t i = 0; i < result->len; i++)
+    {
+        assert (result->data[i].ts == expected->data[i].ts);
+        assert (result->data[i].val.real == expected->data[i].val.real);
+    }
+
+    siridb_points_free(result);
+
+    /* combined partial aggregates must give the same result */
+    slist_append(plist, prepare_points());
+    partial = siridb_points_merge_partial(plist, &aggr, &counts, err_msg);
+    slist_append(plist, prepare_points());
+    other = siridb_points_merge_partial(plist, &aggr, &other_counts, err_msg);
+
+    assert (partial != NULL && counts != NULL);
+    assert (other != NULL && other_counts != NULL);
+    assert (plist->len == 0);
+
+    sums = siridb_aggregate_combine_partial(
+            partial,
+            other,
+            CLERI_GID_F_SUM,
+            err_msg);
+    merged_counts = siridb_aggregate_combine_partial(
+            counts,
+            other_counts,
+            CLERI_GID_F_COUNT,
+            err_msg);
+
+    assert (sums != NULL && merged_counts != NULL);
+
+    result = siridb_aggregate_stream_mean(sums, merged_counts, err_msg);
+
+    assert (result != NULL);
+    assert (result->len == expected->len);
+    for (size_t i = 0; i < result->len; i++)
+    {
+        assert (result->data[i].ts == expected->data[i].ts);
+        assert (result->data[i].val.real == expected->data[i].val.real);
+    }
+
+    siridb_points_free(partial);
+    siridb_points_free(counts);
+    siridb_points_free(other);
+    siridb_points_free(other_counts);
+    siridb_points_free(expected);
+    siridb_points_free(result);
+    siridb_points_free(merged);
+    slist_free(plist);
+
+    return test_end(TEST_OK);
+}
+
+static int test_points_join(void)
+{
+    test_start("Testing points join");
+
+    siridb_points_t * points = prepare_points();
+    siridb_points_t * other = siridb_points_new(4, TP_DOUBLE);
+    siridb_points_t * joined;
+    char err_msg[SIRIDB_MAX_SIZE_ERR_MSG];
+    uint64_t timestamps[4] = {3, 7, 8, 13};
+    double values[4] = {2.0, 0.0, 1.0, 4.0};
+    qp_via_t val;
+
+    for (int i = 0; i < 4; i++)
+    {
+        val.real = values[i];
+        siridb_points_add_point(other, &timestamps[i], &val);
+    }
+
+    /* only the time-stamps 3, 7 and 13 are in both */
+    joined = siridb_points_join(points, other, '*', err_msg);
+
+    assert (joined != NULL);
+    assert (joined->tp == TP_DOUBLE);
+    assert (joined->len == 3);
+    assert (joined->data[0].ts == 3 && joined->data[0].val.real == 2.0);
+    assert (joined->data[1].ts == 7 && joined->data[1].val.real == 0.0);
+    assert (joined->data[2].ts == 13 && joined->data[2].val.real == 32.0);
+    siridb_points_free(joined);
+
+    /* a division by zero is skipped */
+    joined = siridb_points_join(points, other, '/', err_msg);
+
+    assert (joined != NULL);
+    assert (joined->len == 2);
+    assert (joined->data[0].ts == 3 && joined->data[0].val.real == 0.5);
+    assert (joined->data[1].ts == 13 && joined->data[1].val.real == 2.0);
+    siridb_points_free(joined);
+
+    joined = siridb_points_join(other, points, '-', err_msg);
+
+    assert (joined != NULL);
+    assert (joined->len == 3);
+    assert (joined->data[2].val.real == -4.0);
+    siridb_points_free(joined);
+
+    siridb_points_free(points);
+    siridb_points_free(other);
+
+    return test_end(TEST_OK);
+}
+
+static int test_spill(void)
+{
+    test_start("Testing spill");
+
+    siridb_spill_t * spill = siridb_spill_new();
+    size_t n = SIRIDB_SPILL_MIN_SIZE / sizeof(siridb_point_t) + 10;
+    siridb_points_t * points = siridb_points_new(n, TP_INT);
+    siridb_points_t * spilled[2];
+
+    assert (spill != NULL && points != NULL);
+    assert (!siridb_spill_can_use(TP_INT, 10));
+    assert (!siridb_spill_can_use(TP_STRING, n));
+    assert (siridb_spill_can_use(TP_DOUBLE, n));
+
+    for (points->len = 0; points->len < n; points->len++)
+    {
+        points->data[points->len].ts = points->len;
+        points->data[points->len].val.int64 = (int64_t) points->len * 3;
+    }
+
+    /* each result starts at a new page in the file */
+    for (int i = 0; i < 2; i++)
+    {
+        spilled[i] = siridb_spill_points(spill, TP_INT, n, points->data);
+        assert (spilled[i] != NULL);
+        assert (spilled[i]->flags & SIRIDB_POINTS_FLAG_SPILLED);
+        assert (spilled[i]->tp == TP_INT && spilled[i]->len == n);
+        assert (memcmp(
+                spilled[i]->data,
+                points->data,
+                n * sizeof(siridb_point_t)) == 0);
+    }
+
+    assert (siridb_points_size(points) >= n * sizeof(siridb_point_t));
+    assert (siridb_points_size(spilled[0]) == sizeof(siridb_points_t));
+
+    /* the mapping is private, a change is not seen by other results */
+    spilled[0]->data[n - 1].val.int64 = -1;
+    assert (spilled[1]->data[n - 1].val.int64 == (int64_t) (n - 1) * 3);
+
+    /* spilled points remain valid when the file is closed */
+    siridb_spill_free(spill);
+    assert (spilled[1]->data[0].val.int64 == 0);
+
+    siridb_points_free(spilled[0]);
+    siridb_points_free(spilled[1]);
+    siridb_points_free(points);
+
+    return test_end(TEST_OK);
+}
+
+static int test_aggr_variance(void)
+{
+    test_start("Testing variance");
+
+    siridb_aggr_t aggr;
+    siridb_points_t * result;
+    char err_msg[SIRIDB_MAX_SIZE_ERR_MSG];
+    siridb_points_t * points = prepare_points();
+
+    aggr.gid = CLERI_GID_F_VARIANCE;
+    aggr.group_by = 6;
+    aggr.limit = 0;
+    aggr.offset = 0;
+
+    result = siridb_aggregate_run(points, &aggr, err_msg);
+
+    assert (result != NULL);
+    assert (result->len == 4);
+    assert (result->tp == TP_DOUBLE);
+    assert (result->data->ts == 6 && result->data->val.real == 2.0);
+    assert ((result->data + 1)->ts == 12 &&
+            (result->data + 1)->val.real == 4.0);
+
+    siridb_points_free(result);
+    siridb_points_free(points);
+
+    return test_end(TEST_OK);
+}
+
+static int test_variance_merge(void)
+{
+    test_start("Testing variance merge");
+
+    siridb_variance_t state = SIRIDB_VARIANCE_INIT;
+    siridb_variance_t other = SIRIDB_VARIANCE_INIT;
+    siridb_variance_t whole = SIRIDB_VARIANCE_INIT;
+    siridb_points_t * parts[SIRIDB_VARIANCE_PARTS];
+    siridb_points_t * oparts[SIRIDB_VARIANCE_PARTS];
+    siridb_points_t * points = prepare_points();
+    siridb_points_t * merged;
+    siridb_points_t * expected;
+    siridb_points_t * result;
+    char err_msg[SIRIDB_MAX_SIZE_ERR_MSG];
+    siridb_aggr_t aggr;
+    slist_t * plist;
+
+    /* merged states for two ranges are equal to the state for all points */
+    siridb_variance_points(&state, points, 0, 4);
+    siridb_variance_points(&other, points, 4, points->len);
+    siridb_variance_points(&whole, points, 0, points->len);
+    siridb_variance_merge(&state, &other);
+
+    assert (state.n == 10 && whole.n == 10);
+    assert (fabs(state.mean - 3.5) < 1e-9 && whole.mean == 3.5);
+    assert (fabs(state.m2 - whole.m2) < 1e-9);
+    assert (fabs(siridb_variance_population(&whole) - 5.05) < 1e-9);
+    assert (siridb_variance_sample(&other) > 0.0);
+
+    state = (siridb_variance_t) SIRIDB_VARIANCE_INIT;
+    assert (siridb_variance_sample(&state) == 0.0);
+    assert (siridb_variance_population(&state) == 0.0);
+
+    aggr.gid = CLERI_GID_F_VARIANCE;
+    aggr.group_by = 5;
+    aggr.limit = 0;
+    aggr.offset = 0;
+
+    assert (siridb_aggregate_can_merge(&aggr));
+
+    /* merge and aggregate must give the same result */
+    plist = slist_new(2);
+    slist_append(plist, prepare_points());
+    slist_append(plist, prepare_points());
+    merged = siridb_points_merge(plist, err_msg);
+    expected = siridb_aggregate_run(merged, &aggr, err_msg);
+
+    assert (expected != NULL && expected->len == 5);
+
+    slist_append(plist, prepare_points());
+    slist_append(plist, prepare_points());
+    result = siridb_points_merge_aggr(plist, &aggr, err_msg);
+
+    assert (result != NULL);
+    assert (plist->len == 0);
+    assert (result->len == expected->len);
+    for (size_t i = 0; i < result->len; i++)
+    {
+        assert (result->data[i].ts == expected->data[i].ts);
+        assert (fabs(result->data[i].val.real -
+                expected->data[i].val.real) < 1e-9);
+    }
+    siridb_points_free(result);
+
+    /* combined partial variances must give the same result */
+    slist_append(plist, prepare_points());
+    assert (siridb_points_merge_variance(plist, &aggr, parts, err_msg) == 0);
+    slist_append(plist, prepare_points());
+    assert (siridb_points_merge_variance(plist, &aggr, oparts, err_msg) == 0);
+    assert (plist->len == 0);
+    assert (parts[0]->len == 5 && parts[0]->data[2].val.int64 == 4);
+
+    assert (siridb_variance_parts_combine(parts, oparts, err_msg) == 0);
+    result = siridb_variance_parts_finish(parts, aggr.gid, err_msg);
+
+    assert (result != NULL);
+    assert (result->len == expected->len);
+    for (size_t i = 0; i < result->len; i++)
+    {
+        assert (result->data[i].ts == expected->data[i].ts);
+        assert (fabs(result->data[i].val.real -
+                expected->data[i].val.real) < 1e-9);
+    }
+
+    /* string points cannot be used */
+    slist_append(plist, siridb_points_new(0, TP_STRING));
+    assert (siridb_points_merge_variance(plist, &aggr, oparts, err_msg) == -1);
+    siridb_points_free(slist_pop(plist));
+
+    siridb_variance_parts_free(parts);
+    siridb_variance_parts_free(oparts);
+    siridb_points_free(result);
+    siridb_points_free(expected);
+    siridb_points_free(merged);
+    siridb_points_free(points);
+    slist_free(plist);
+
+    return test_end(TEST_OK);
+}
+
+static int test_iso8601(void)
+{
+    test_start("Testing iso8601");
+
+    iso8601_tz_t amsterdam = iso8601_tz("Europe/Amsterdam");
+    assert(amsterdam > 0);
+
+    iso8601_tz_t utc = iso8601_tz("UTC");
+    assert(utc > 0);
+
+    /* Some extra time zone test for case sensitivity etc. */
+    assert(iso8601_tz("NAIVE") == 0);
+    assert(iso8601_tz("europe/KIEV") > 0);
+    assert(iso8601_tz("Ams") < 0);
+
+    /* Test parsing a year with time-zone information */
+    assert(iso8601_parse_date("2013", amsterdam) == 1356994800);
+
+    /* Customer offset should be preferred over UTC */
+    assert(iso8601_parse_date("2013+01", utc) == 1356994800);
+
+    /* UTC should be preferred over given time-zone (Amsterdam) */
+    assert(iso8601_parse_date("2013Z", amsterdam) == 1356998400);
+
+    /* Test with minute precision */
+    assert(iso8601_parse_date("2013-02-06T13:01:12", utc) == 1360155672);
+
+    /* Test short written */
+    assert(iso8601_parse_date("2013-2-6 13:1:12", utc) == 1360155672);
+
+    /* Test summer time */
+    assert(iso8601_parse_date("2016-04-21", amsterdam) == 1461189600);
+
+    /* Test error */
+    assert(iso8601_parse_date("2016 04 21", amsterdam) == -1);
+
+    /* Test last day in year */
+    assert(iso8601_parse_date("2013-12-31", utc) == 1388448000);
+
+    /* Test the time-zone offset cache around a change to summer time */
+    assert(iso8601_parse_date("2016-03-26 12:00:00", amsterdam) ==
+            1458990000);
+    assert(iso8601_parse_date("2016-03-27 00:30:00", amsterdam) ==
+            1459035000);
+    assert(iso8601_parse_date("2016-03-27 03:00:00", amsterdam) ==
+            1459040400);
+    assert(iso8601_parse_date("2016-03-26 12:00:00", amsterdam) ==
+            1458990000);
+
+    /* Test values out of range */
+    assert(iso8601_parse_date("2013-13-01", utc) == -1);
+    assert(iso8601_parse_date("2013-12-01 24:00:00", utc) == -1);
+
+    return test_end(TEST_OK);
+}
+
+static int test_expr(void)
+{
+    test_start("Testing expressions");
+    int64_t result;
+
+    assert(expr_parse(&result, "5+37") == 0 && result == 42);
+    assert(expr_parse(&result, "2+2*20") == 0 && result == 42);
+    assert(expr_parse(&result, "(2+4)*7") == 0 && result == 42);
+    assert(expr_parse(&result, "16%10*7") == 0 && result == 42);
+    assert(expr_parse(&result, "7*14%56") == 0 && result == 42);
+    assert(expr_parse(&result, "21/3*6") == 0 && result == 42);
+    assert(expr_parse(&result, "22/3*6") == 0 && result == 42);
+
+    /* division by zero is not a good idea */
+    assert(expr_parse(&result, "42/(2-2)") == EXPR_DIVISION_BY_ZERO);
+
+    /* module by zero is not a good idea either */
+    assert(expr_parse(&result, "42%(2-2)") == EXPR_MODULO_BY_ZERO);
+
+    return test_end(TEST_OK);
+}
+
+static int test__cexpr_calls;
+
+static int test__cexpr_cb(int64_t * values, cexpr_condition_t * cond)
+{
+    test__cexpr_calls++;
+    return (cond->str != NULL) ?
+            cexpr_str_cmp(cond->operator, "cpu-load", cond->str) :
+            cexpr_int_cmp(cond->operator, values[cond->prop], cond->int64);
+}
+
+static cexpr_t * test__cexpr_new(
+        cexpr_operator_t operator,
+        int8_t tp_a,
+        void * a,
+        int8_t tp_b,
+        void * b)
+{
+    cexpr_t * cexpr = (cexpr_t *) malloc(sizeof(cexpr_t));
+    cexpr->operator = operator;
+    cexpr->tp_a = tp_a;
+    cexpr->tp_b = tp_b;
+    cexpr->via_a.cexpr = (cexpr_t *) a;
+    cexpr->via_b.cexpr = (cexpr_t *) b;
+    cexpr->prog = NULL;
+    return cexpr;
+}
+
+static cexpr_condition_t * test__cexpr_cond(
+        uint32_t prop,
+        cexpr_operator_t operator,
+        int64_t int64,
+        const char * str)
+{
+    cexpr_condition_t * cond =
+            (cexpr_condition_t *) malloc(sizeof(cexpr_condition_t));
+    cond->prop = prop;
+    cond->operator = operator;
+    cond->int64 = int64;
+    cond->str = (str == NULL) ? NULL : strdup(str);
+    return cond;
+}
+
+static int test_cexpr(void)
+{
+    test_start("Testing compiled conditional expressions");
+
+    /* (name ~ 'load' and v0 == 1) or (v1 > 5 and v2 < 0) */
+    cexpr_t * cexpr = test__cexpr_new(
+            CEXPR_OR,
+            1,
+            test__cexpr_new(
+                    CEXPR_AND,
+                    2,
+                    test__cexpr_cond(3, CEXPR_IN, 0, "load"),
+                    2,
+                    test__cexpr_cond(0, CEXPR_EQ, 1, NULL)),
+            1,
+            test__cexpr_new(
+                    CEXPR_AND,
+                    2,
+                    test__cexpr_cond(1, CEXPR_GT, 5, NULL),
+                    2,
+                    test__cexpr_cond(2, CEXPR_LT, 0, NULL)));
+    int64_t values[3];
+    int64_t i;
+    int expected, calls;
+
+    /* the tree is used until the expression is compiled */
+    for (i = 0; i < 27; i++)
+    {
+        values[0] = i % 3 - 1;
+        values[1] = (i / 3) % 3 + 4;
+        values[2] = i / 9 - 1;
+        expected = values[0] == 1 || (values[1] > 5 && values[2] < 0);
+
+        assert (cexpr->prog == NULL);
+        assert (cexpr_run(
+                cexpr,
+                (cexpr_cb_t) test__cexpr_cb,
+                values) == expected);
+    }
+
+    assert (cexpr_compile(cexpr) == 0);
+    assert (cexpr->prog != NULL && cexpr->prog->n == 4);
+
+    /* the operands without a string comparison run first */
+    assert (cexpr->prog->instr[0].cond->prop == 1);
+    assert (cexpr->prog->instr[2].cond->prop == 0);
+
+    for (i = 0; i < 27; i++)
+    {
+        values[0] = i % 3 - 1;
+        values[1] = (i / 3) % 3 + 4;
+        values[2] = i / 9 - 1;
+        expected = values[0] == 1 || (values[1] > 5 && values[2] < 0);
+
+        test__cexpr_calls = 0;
+        assert (cexpr_run(
+                cexpr,
+                (cexpr_cb_t) test__cexpr_cb,
+                values) == expected);
+
+        /* each condition is tested at most once, and only when needed */
+        calls = (values[1] > 5) ? 2 : 1;
+        if (values[1] <= 5 || values[2] >= 0)
+        {
+            calls += (values[0] == 1) ? 2 : 1;
+        }
+        assert (test__cexpr_calls == calls);
+    }
+
+    /* conditions below an OR never rule out a value */
+    assert (cexpr_can_match(cexpr, 0, 0) == 1);
+
+    cexpr_free(cexpr);
+
+    /* v0 != 2 and (v1 > 5 or v1 < 0) */
+    cexpr = test__cexpr_new(
+            CEXPR_AND,
+            2,
+            test__cexpr_cond(0, CEXPR_NE, 2, NULL),
+            1,
+            test__cexpr_new(
+                    CEXPR_OR,
+                    2,
+                    test__cexpr_cond(1, CEXPR_GT, 5, NULL),
+                    2,
+                    test__cexpr_cond(1, CEXPR_LT, 0, NULL)));
+
+    assert (cexpr_can_match(cexpr, 0, 2) == 0);
+    assert (cexpr_can_match(cexpr, 0, 1) == 1);
+    assert (cexpr_can_match(cexpr, 1, 3) == 1);
+    assert (cexpr_can_match(cexpr, 2, 2) == 1);
+
+    cexpr_free(cexpr);
+
+    return test_end(TEST_OK);
+}
+
+static int test_access(void)
+{
+    test_start("Testing access");
+    char buffer[SIRIDB_ACCESS_STR_MAX];
+    uint32_t access_bit = 0;
+
+    siridb_access_to_str(buffer, access_bit);
+    assert (strcmp(buffer, "no access") == 0);
+
+    access_bit |= SIRIDB_ACCESS_SHOW;
+    siridb_access_to_str(buffer, access_bit);
+    assert (strcmp(buffer, "show") == 0);
+
+    access_bit |= SIRIDB_ACCESS_SELECT;
+    siridb_access_to_str(buffer, access_bit);
+    assert (strcmp(buffer, "select and show") == 0);
+
+    access_bit |= SIRIDB_ACCESS_LIST;
+    siridb_access_to_str(buffer, access_bit);
+    assert (strcmp(buffer, "list, select and show") == 0);
+
+    access_bit |= SIRIDB_ACCESS_PROFILE_WRITE;
+    siridb_access_to_str(buffer, access_bit);
+    assert (strcmp(buffer, "write") == 0);
+
+    access_bit &= ~SIRIDB_ACCESS_INSERT;
+    siridb_access_to_str(buffer, access_bit);
+    assert (strcmp(buffer, "read and create") == 0);
+
+    assert (siridb_access_from_strn("read", 4) == (SIRIDB_ACCESS_PROFILE_READ));
+    assert (siridb_access_from_strn("list", 4) == SIRIDB_ACCESS_LIST);
+
+    return test_end(TEST_OK);
+}
+
+static int test_version(void)
+{
+    test_start("Testing version");
+
+    assert (siri_version_cmp("1.0.0", "2.0.0") < 0);
+    assert (siri_version_cmp("2.0.0", "1.0.0") > 0);
+    assert (siri_version_cmp("2.2.0", "2.32.0") < 0);
+    assert (siri_version_cmp("2.32.0", "2.2.0") > 0);
+    assert (siri_version_cmp("2.0.5", "2.0.22") < 0);
+    assert (siri_version_cmp("2.0.22", "2.0.5") > 0);
+    assert (siri_version_cmp("2.0", "2.0.0") < 0);
+    assert (siri_version_cmp("2.0.2", "2.0") > 0);
+    assert (siri_version_cmp("a", "") > 0);
+    assert (siri_version_cmp("", "b") < 0);
+    assert (siri_version_cmp("", "") == 0);
+    assert (siri_version_cmp("2.0.0", "2.0.0") == 0);
+
+    return test_end(TEST_OK);
+}
+
+static int test_latency(void)
+{
+    test_start("Testing latency");
+
+    siri_latency_t * latency = siri_latency + SIRI_LATENCY_PING;
+    uint64_t p;
+    char * summary;
+
+    memset(latency, 0, sizeof(siri_latency_t));
+
+    assert (siri_latency_percentile(&latency->exec, 50.0) == 0);
+
+    /* record 1..1000 micro seconds */
+    for (uint64_t us = 1; us <= 1000; us++)
+    {
+        siri_latency_add(SIRI_LATENCY_PING, 0, us * 1000);
+    }
+
+    assert (latency->exec.n == 1000);
+    assert (latency->exec.max == 1000);
+    assert (siri_latency_percentile(&latency->wait, 99.0) == 0);
+
+    /* small values are exact */
+    assert (siri_latency_percentile(&latency->exec, 0.0) == 1);
+    assert (siri_latency_percentile(&latency->exec, 5.0) == 50);
+
+    /* larger values have a relative error within 1 / SIRI_LATENCY_SUB */
+    p = siri_latency_percentile(&latency->exec, 50.0);
+    assert (p >= 500 && p <= 500 + 500 / SIRI_LATENCY_SUB);
+    p = siri_latency_percentile(&latency->exec, 99.0);
+    assert (p >= 990 && p <= 990 + 990 / SIRI_LATENCY_SUB);
+    assert (siri_latency_percentile(&latency->exec, 100.0) == 1000);
+
+    /* values out of range are counted in the last bucket */
+    siri_latency_add(SIRI_LATENCY_PING, 0, (1ULL << 50) * 1000);
+    assert (latency->exec.buckets[SIRI_LATENCY_BUCKETS - 1] == 1);
+    assert (siri_latency_percentile(&latency->exec, 100.0) == 1ULL << 50);
+
+    summary = siri_latency_summary();
+    assert (summary != NULL);
+    assert (strstr(summary, "ping: n=1001 ") != NULL);
+    free(summary);
+
+    memset(latency, 0, sizeof(siri_latency_t));
+
+    return test_end(TEST_OK);
+}
+
+static int test_loop(void)
+{
+    test_start("Testing loop");
+
+    siri_loop_frame_t outer, inner;
+    struct timespec ts = {0, 2000000};
+    char * summary;
+
+    memset(&siri_loop, 0, sizeof(siri_loop_t));
+    siri_loop.start = timeit_ns();
+
+    /* time in a nested callback is only counted for the nested category */
+    siri_loop_enter(&outer);
+    siri_loop_enter(&inner);
+    nanosleep(&ts, NULL);
+    siri_loop_done(SIRI_LOOP_PROMISE, &inner);
+    siri_loop_done(SIRI_LOOP_READ, &outer);
+
+    assert (siri_loop.stat[SIRI_LOOP_PROMISE].n == 1);
+    assert (siri_loop.stat[SIRI_LOOP_PROMISE].ns >= 2000000);
+    assert (siri_loop.stat[SIRI_LOOP_READ].n == 1);
+    assert (siri_loop.stat[SIRI_LOOP_READ].ns <
+            siri_loop.stat[SIRI_LOOP_PROMISE].ns);
+    assert (siri_loop.stat[SIRI_LOOP_INSERT].n == 0);
+
+    /* the outer frame has finished so nothing is nested anymore */
+    assert (siri_loop.inner ==
+            siri_loop.stat[SIRI_LOOP_PROMISE].ns +
+            siri_loop.stat[SIRI_LOOP_READ].ns);
+
+    summary = siri_loop_summary();
+    assert (summary != NULL);
+    assert (strncmp(summary, "lag: n=0 ", 9) == 0);
+    assert (strstr(summary, "\nread: n=1 ") != NULL);
+    assert (strstr(summary, "\npromise: n=1 ") != NULL);
+    assert (strstr(summary, "insert:") == NULL);
+    free(summary);
+
+    memset(&siri_loop, 0, sizeof(siri_loop_t));
+
+    return test_end(TEST_OK);
+}
+
+static int test_alloc(void)
+{
+    test_start("Testing alloc");
+
+    siri_alloc_stats_t stats;
+    char * pt = (char *) malloc(1 << 16);
+    char * summary;
+
+    assert (pt != NULL);
+    memset(pt, 1, 1 << 16);
+
+    siri_alloc_stats(&stats);
+    assert (stats.allocated <= stats.active || !stats.allocated);
+    assert (    siri_alloc_fragmentation(&stats) >= 0.0 &&
+                siri_alloc_fragmentation(&stats) < 1.0);
+
+    free(pt);
+    siri_alloc_purge();
+
+    summary = siri_alloc_summary();
+    assert (summary != NULL);
+    assert (strncmp(
+            summary,
+            siri_alloc_name(),
+            strlen(siri_alloc_name())) == 0);
+    assert (strstr(summary, " fragmentation=") != NULL);
+    free(summary);
+
+    return test_end(TEST_OK);
+}
+
+static int test_session(void)
+{
+    test_start("Testing session");
+
+    siri_cfg_t * cfg = siri.cfg;
+    uv_loop_t * loop = siri.loop;
+    siri_cfg_t tmp_cfg;
+    siridb_t siridb;
+    siridb_user_t * user = siridb_user_new();
+    char salt[OWCRYPT_SALT_SZ];
+    char encrypted[OWCRYPT_SZ];
+    char token[SIRIDB_SESSION_SZ + 1];
+    char other[SIRIDB_SESSION_SZ + 1];
+
+    memset(&tmp_cfg, 0, sizeof(siri_cfg_t));
+    memset(&siridb, 0, sizeof(siridb_t));
+
+    siri.cfg = &tmp_cfg;
+    siri.loop = uv_default_loop();
+    uv_update_time(siri.loop);
+
+    owcrypt_gen_salt(salt);
+    owcrypt("siri", salt, encrypted);
+    assert (siridb_users_check_password("siri", encrypted) == 1);
+    assert (siridb_users_check_password("iris", encrypted) == 0);
+
+    user->name = strdup("iris");
+    user->password = strdup(encrypted);
+    siridb.users = llist_new();
+    llist_append(siridb.users, user);
+
+    /* disabled */
+    assert (siridb_session_new(&siridb, user, token) == -1);
+    assert (siridb.sessions == NULL);
+
+    /* a token can be used once */
+    tmp_cfg.auth_session_ttl = 60;
+    assert (siridb_session_new(&siridb, user, token) == 0);
+    assert (strlen(token) == SIRIDB_SESSION_SZ);
+    assert (siridb_session_new(&siridb, user, other) == 0);
+    assert (strcmp(token, other) != 0);
+    assert (user->ref == 3);
+    assert (siridb_session_pop(&siridb, token) == user);
+    assert (siridb_session_pop(&siridb, token) == NULL);
+    assert (siridb_session_pop(&siridb, "unknown") == NULL);
+
+    /* invalid when the password is changed */
+    free(user->password);
+    owcrypt("other", salt, encrypted);
+    user->password = strdup(encrypted);
+    assert (siridb_session_pop(&siridb, other) == NULL);
+    assert (user->ref == 1);
+
+    /* expired sessions are removed */
+    assert (siridb_session_new(&siridb, user, token) == 0);
+    siridb_sessions_cleanup(&siridb);
+    assert (siridb.sessions->len == 1);
+    ((siridb_session_t *) ct_get(siridb.sessions, token))->expire = 0;
+    siridb_sessions_cleanup(&siridb);
+    assert (siridb.sessions->len == 0);
+    assert (user->ref == 1);
+
+    siridb_sessions_free(siridb.sessions);
+    siridb_users_free(siridb.users);
+
+    siri.cfg = cfg;
+    siri.loop = loop;
+
+    return test_end(TEST_OK);
+}
+
+static int test_numa(void)
+{
+    test_start("Testing numa");
+
+    siri_numa_node_t node;
+
+    assert (siri_numa_parse_cpus("0-3,8-11\n", &node) == 0);
+    assert (node.ncpus == 8);
+    assert (node.cpus[0] == 0xf0f);
+    assert (node.arena == 0);
+
+    assert (siri_numa_parse_cpus("5,64,66-67", &node) == 0);
+    assert (node.ncpus == 4);
+    assert (node.cpus[0] == (uint64_t) 1 << 5);
+    assert (node.cpus[1] == 0xd);
+
+    /* a node with only memory has an empty list */
+    assert (siri_numa_parse_cpus("\n", &node) == 0);
+    assert (node.ncpus == 0);
+
+    assert (siri_numa_parse_cpus("3-1", &node) == -1);
+    assert (siri_numa_parse_cpus("0-", &node) == -1);
+    assert (siri_numa_parse_cpus("0,x", &node) == -1);
+    assert (siri_numa_parse_cpus("0-4096", &node) == -1);
+
+    /* without sched_numa there is one node and threads are not pinned */
+    assert (siri_numa_nodes() == 1);
+    assert (siri_numa_bind(3) == 0);
+
+    return test_end(TEST_OK);
+}
+
+static int test_hot(void)
+{
+    test_start("Testing hot");
+
+    siridb_hot_t * hot = siridb_hot_new();
+    siridb_hot_counter_t top[SIRIDB_HOT_TOP];
+    uint32_t id;
+
+    /* fill all counters, series 1 to 3 get more points */
+    for (id = 1; id <= SIRIDB_HOT_SIZE; id++)
+    {
+        siridb_hot_add(hot, SIRIDB_HOT_INSERT, id, (id <= 3) ? 100 - id : 1);
+    }
+    assert (siridb_hot_top(hot, SIRIDB_HOT_SELECT, top, 3) == 0);
+    assert (siridb_hot_top(hot, SIRIDB_HOT_INSERT, top, 3) == 3);
+    assert (top[0].series_id == 1 && top[0].count == 99);
+    assert (top[1].series_id == 2 && top[2].series_id == 3);
+
+    /* a new series takes over a counter with the lowest count */
+    siridb_hot_add(hot, SIRIDB_HOT_INSERT, 1000, 500);
+    assert (siridb_hot_top(hot, SIRIDB_HOT_INSERT, top, 2) == 2);
+    assert (top[0].series_id == 1000);
+    assert (top[0].count == 501 && top[0].error == 1);
+    assert (top[1].series_id == 1 && top[1].error == 0);
+
+    /* the lowest counters are replaced in turn */
+    for (id = 2000; id < 2000 + SIRIDB_HOT_SIZE; id++)
+    {
+        siridb_hot_add(hot, SIRIDB_HOT_INSERT, id, 1);
+    }
+    assert (siridb_hot_top(hot, SIRIDB_HOT_INSERT, top, 4) == 4);
+    assert (top[0].series_id == 1000);
+    assert (top[1].series_id == 1);
+    assert (top[3].series_id == 3);
+    assert (hot->sketch[SIRIDB_HOT_INSERT].len == SIRIDB_HOT_SIZE);
+    assert (hot->sketch[SIRIDB_HOT_INSERT].counters->len == SIRIDB_HOT_SIZE);
+
+    /* counts and the total are halved */
+    siridb_hot_decay(hot);
+    assert (siridb_hot_top(hot, SIRIDB_HOT_INSERT, top, 1) == 1);
+    assert (top[0].count == 250);
+    assert (hot->sketch[SIRIDB_HOT_INSERT].total ==
+            (99 + 98 + 97 + SIRIDB_HOT_SIZE - 3 + 500 + SIRIDB_HOT_SIZE) / 2);
+
+    siridb_hot_free(hot);
+
+    return test_end(TEST_OK);
+}
+
+static int test_durations(void)
+{
+    test_start("Testing durations");
+
+    siridb_t siridb;
+    siridb_time_t time = {.precision=SIRIDB_TIME_SECONDS, .factor=1};
+    siridb_series_t series;
+    uint64_t id, duration, start = 1500000000;
+
+    memset(&siridb, 0, sizeof(siridb_t));
+    memset(&series, 0, sizeof(siridb_series_t));
+
+    siridb.time = &time;
+    siridb.duration_num = 604800;
+    siridb.duration_log = 86400;
+    siridb.shard_mask_num = 32;     /* sqrt(604800) / 24 */
+    series.tp = TP_DOUBLE;
+    series.mask = 5;
+
+    /* the database duration keeps the shard ids */
+    id = siridb_durations_shard_id(&siridb, &series, start, &duration);
+    assert (duration == 604800);
+    assert (id == start - start % 604800 + 5);
+    assert (siridb_durations_class(&siridb, id) == 0);
+    assert (siridb_durations_by_id(&siridb, SIRIDB_SHARD_TP_NUMBER, id) ==
+            604800);
+    assert (siridb_durations_mask(&siridb, SIRIDB_SHARD_TP_NUMBER, id) == 5);
+
+    /* class 6 is one day and has its own ids */
+    series.dclass = 6;
+    id = siridb_durations_shard_id(&siridb, &series, start, &duration);
+    assert (duration == 86400);
+    assert (id == start - start % 86400 + 6 * 32 + 5);
+    assert (siridb_durations_class(&siridb, id) == 6);
+    assert (siridb_durations_by_id(&siridb, SIRIDB_SHARD_TP_NUMBER, id) ==
+            86400);
+    assert (siridb_durations_mask(&siridb, SIRIDB_SHARD_TP_NUMBER, id) == 5);
+
+    /* class 12 is 52 weeks */
+    series.dclass = SIRIDB_DURATIONS_SZ;
+    id = siridb_durations_shard_id(&siridb, &series, start, &duration);
+    assert (duration == 8736 * 3600);
+    assert (siridb_durations_class(&siridb, id) == SIRIDB_DURATIONS_SZ);
+
+    /* an id above the last class is invalid */
+    id = start - start % 3600 + (SIRIDB_DURATIONS_SZ + 1) * 32;
+    assert (siridb_durations_by_id(&siridb, SIRIDB_SHARD_TP_NUMBER, id) == 0);
+
+    /* log series always use the log duration */
+    series.tp = TP_STRING;
+    series.dclass = 0;
+    id = siridb_durations_shard_id(&siridb, &series, start, &duration);
+    assert (duration == 86400);
+    assert (id == start - start % 86400 + 5);
+    assert (siridb_durations_by_id(&siridb, SIRIDB_SHARD_TP_LOG, id) ==
+            86400);
+
+    return test_end(TEST_OK);
+}
+
+static int test_server_counts(void)
+{
+    test_start("Testing server counts");
+
+    siri_cfg_t * cfg = siri.cfg;
+    uv_loop_t * loop = siri.loop;
+    siri_cfg_t tmp_cfg;
+    siridb_t siridb;
+    siridb_server_t server[4];
+    siridb_pool_t pool[2];
+    siridb_pools_t pools = {.len=2, .pool=pool};
+    qp_packer_t * packer = qp_packer_new(64);
+    qp_unpacker_t unpacker;
+    size_t n;
+
+    memset(&tmp_cfg, 0, sizeof(siri_cfg_t));
+    memset(&siridb, 0, sizeof(siridb_t));
+    memset(server, 0, sizeof(server));
+
+    siri.cfg = &tmp_cfg;
+    siri.loop = uv_default_loop();
+    uv_update_time(siri.loop);
+
+    /* 'this' server and a replica in pool 0 and two servers in pool 1 */
+    siridb.server = server;
+    siridb.pools = &pools;
+    siridb.servers = llist_new();
+    for (int i = 0; i < 4; i++)
+    {
+        server[i].pool = i / 2;
+        server[i].flags = (i) ? SERVER__IS_ONLINE : SERVER__SELF_ONLINE;
+        pool[i / 2].server[i % 2] = server + i;
+        llist_append(siridb.servers, server + i);
+    }
+    pool[0].len = pool[1].len = 2;
+
+    /* counters are read after the flags */
+    qp_add_int16(packer, SERVER__SELF_ONLINE);
+    qp_add_type(packer, QP_ARRAY_OPEN);
+    for (int tp = 0; tp < SIRIDB_SERVER_COUNT_END; tp++)
+    {
+        qp_add_int64(packer, 10 + tp);
+    }
+    qp_add_type(packer, QP_ARRAY_CLOSE);
+
+    for (int i = 1; i < 4; i++)
+    {
+        qp_unpacker_init(&unpacker, packer->buffer, packer->len);
+        assert (qp_next(&unpacker, NULL) == QP_INT64);
+        siridb_server_counts_read(server + i, &unpacker);
+        assert (server[i].counts_ts == uv_now(siri.loop));
+        assert (server[i].counts[SIRIDB_SERVER_COUNT_SELECTED] == 14);
+    }
+
+    /* disabled */
+    n = 1;
+    assert (siridb_servers_cached_count(
+            &siridb, SIRIDB_SERVER_COUNT_SHARDS, &n) == -1);
+    assert (n == 1);
+
+    /* series are counted once for the other pool */
+    tmp_cfg.count_cache_age = 60;
+    assert (siridb_servers_cached_count(
+            &siridb, SIRIDB_SERVER_COUNT_SERIES, &n) == 0);
+    assert (n == 11);
+
+    n = 1;
+    assert (siridb_servers_cached_count(
+            &siridb, SIRIDB_SERVER_COUNT_SHARDS, &n) == 0);
+    assert (n == 1 + 3 * 11);
+
+    /* one server in the other pool is enough for series */
+    server[3].counts_ts = 0;
+    n = 1;
+    assert (siridb_servers_cached_count(
+            &siridb, SIRIDB_SERVER_COUNT_SERIES, &n) == 0);
+    assert (n == 11);
+    assert (siridb_servers_cached_count(
+            &siridb, SIRIDB_SERVER_COUNT_SHARDS, &n) == -1);
+    assert (n == 11);
+
+    /* counters of an offline server are not used */
+    server[2].flags = 0;
+    assert (siridb_servers_cached_count(
+            &siridb, SIRIDB_SERVER_COUNT_SERIES, &n) == -1);
+
+    /* without counters the server keeps unknown counts */
+    qp_packer_free(packer);
+    packer = qp_packer_new(64);
+    qp_add_int16(packer, SERVER__SELF_ONLINE);
+    qp_unpacker_init(&unpacker, packer->buffer, packer->len);
+    assert (qp_next(&unpacker, NULL) == QP_INT64);
+    siridb_server_counts_read(server + 3, &unpacker);
+    assert (server[3].counts_ts == 0);
+
+    qp_packer_free(packer);
+    while (llist_pop(siridb.servers) != NULL);
+    llist_free_cb(siridb.servers, NULL, NULL);
+
+    siri.cfg = cfg;
+    siri.loop = loop;
+
+    return test_end(TEST_OK);
+}
+
+static int test_metrics(void)
+{
+    test_start("Testing metrics");
+
+    siri_latency_t * latency = siri_latency + SIRI_LATENCY_PING;
+    size_t size;
+    char * text;
+
+    memset(latency, 0, sizeof(siri_latency_t));
+
+    /* 700 micro seconds is counted in the bucket for 0.001 seconds */
+    siri_latency_add(SIRI_LATENCY_PING, 0, 700000);
+
+    text = sirinet_metrics_text(&size);
+    assert (text != NULL);
+    assert (size == strlen(text));
+    assert (strncmp(text, "# TYPE siridb_build info\n", 25) == 0);
+    assert (strcmp(text + size - 6, "# EOF\n") == 0);
+    assert (strstr(text, "siridb_memory_bytes{subsystem=\"series\"}"));
+    assert (strstr(text, "siridb_allocator_fragmentation "));
+    assert (strstr(text,
+            "siridb_request_exec_seconds_bucket"
+            "{type=\"ping\",le=\"0.0005\"} 0\n"
+            "siridb_request_exec_seconds_bucket"
+            "{type=\"ping\",le=\"0.001\"} 1\n"));
+    assert (strstr(text,
+            "siridb_request_exec_seconds_count{type=\"ping\"} 1\n"
+            "siridb_request_exec_seconds_sum{type=\"ping\"} 0.000700\n"));
+    free(text);
+
+    memset(latency, 0, sizeof(siri_latency_t));
+
+    return test_end(TEST_OK);
+}
+
+int test_strx_to_double(void)
+{
+    test_start("Testing strx_to_double");
+
+    assert (strx_to_double("0.5", 3) == 0.5);
+    assert (strx_to_double("0.55", 3) == 0.5);
+    assert (strx_to_double("123.456", 7) == 123.456);
+    assert (strx_to_double("123", 3) == 123);
+    assert (strx_to_double("123.", 4) == 123);
+    assert (strx_to_double("123456.", 3) == 123);
+    return test_end(TEST_OK);
+}
+
+static int test_mutex(void)
+{
+    test_start("Testing mutex");
+
+    siri_mutex_t mutex;
+    siri_rwlock_t rwlock;
+    siri_mutex_site_t * sites[SIRI_MUTEX_TOP];
+    char * summary;
+    size_t n;
+
+    assert (siri_mutex_init(&mutex) == 0);
+
+    /* nothing is recorded when disabled */
+    siri_mutex_lock(&mutex);
+    siri_mutex_unlock(&mutex);
+    assert (siri_mutex_top(sites, SIRI_MUTEX_TOP) == 0);
+
+    siri_mutex_enable(1);
+    for (int i = 0; i < 3; i++)
+    {
+        siri_mutex_lock(&mutex);
+        assert (mutex.site != NULL);
+        siri_mutex_unlock(&mutex);
+    }
+    siri_mutex_enable(0);
+
+    n = siri_mutex_top(sites, SIRI_MUTEX_TOP);
+    assert (n == 1);
+    assert (sites[0]->n == 3);
+    assert (sites[0]->contended == 0);
+    assert (sites[0]->wait == 0);
+    assert (strcmp(sites[0]->name, "&mutex") == 0);
+
+    summary = siri_mutex_summary();
+    assert (summary != NULL);
+    assert (strncmp(summary, "mutex test.c:", 13) == 0);
+    assert (strstr(summary, " n=3 contended=0 wait=0us") != NULL);
+    free(summary);
+
+    assert (siri_rwlock_init(&rwlock) == 0);
+
+    siri_mutex_enable(1);
+
+    /* more than one reader can hold the lock */
+    siri_rwlock_rdlock(&rwlock);
+    siri_rwlock_rdlock(&rwlock);
+    assert (rwlock.site == NULL);
+    siri_rwlock_rdunlock(&rwlock);
+    siri_rwlock_rdunlock(&rwlock);
+
+    siri_rwlock_wrlock(&rwlock);
+    assert (rwlock.site != NULL);
+    siri_rwlock_wrunlock(&rwlock);
+    assert (rwlock.site == NULL);
+
+    siri_mutex_enable(0);
+
+    /* each lock above is a site, readers do not record the hold time */
+    n = siri_mutex_top(sites, SIRI_MUTEX_TOP);
+    assert (n == 4);
+    for (size_t i = 0; i < n; i++)
+    {
+        assert (sites[i]->contended == 0);
+        if (strcmp(sites[i]->name, "&rwlock") == 0)
+        {
+            assert (sites[i]->n == 1);
+        }
+    }
+
+    siri_rwlock_destroy(&rwlock);
+    siri_mutex_destroy(&mutex);
+
+    return test_end(TEST_OK);
+}
+
+static int test_shard_optimize_score(void)
+{
+    test_start("Testing shard optimize score");
+
+    siri_cfg_t * cfg = siri.cfg;
+    siri_cfg_t tmp_cfg;
+    siridb_shard_t shard;
+    uint64_t score;
+
+    memset(&tmp_cfg, 0, sizeof(siri_cfg_t));
+    memset(&shard, 0, sizeof(siridb_shard_t));
+
+    tmp_cfg.optimize_compact_threshold = 20;
+    siri.cfg = &tmp_cfg;
+
+    shard.tp = SIRIDB_SHARD_TP_NUMBER;
+    shard.size = 1 << 20;
+
+    assert (siridb_shard_optimize_score(&shard) == 0);
+
+    /* an incremental optimize only rewrites the added chunks */
+    shard.flags = SIRIDB_SHARD_HAS_NEW_VALUES;
+    shard.new_chunks = 100;
+    shard.new_size = 1 << 16;
+    assert (siridb_shard_optimize_benefit(&shard) == 100);
+    score = siridb_shard_optimize_score(&shard);
+    assert (score == (100 << 20) / ((1 << 17) + 1));
+    assert (siridb_shard_optimize_bytes(&shard) == 1 << 17);
+
+    /* chunks which overlap count more than added chunks */
+    shard.flags |= SIRIDB_SHARD_HAS_OVERLAP;
+    shard.overlaps = 10;
+    assert (siridb_shard_optimize_benefit(&shard) == 140);
+    assert (siridb_shard_optimize_score(&shard) > score);
+
+    /* all chunks which are not dead are rewritten */
+    shard.dead_size = 1 << 19;
+    assert (siridb_shard_optimize_benefit(&shard) == 148);
+    assert (siridb_shard_optimize_score(&shard) < score);
+    assert (siridb_shard_optimize_bytes(&shard) == 1 << 19);
+
+    /* nothing is counted after a restart */
+    shard.flags = SIRIDB_SHARD_HAS_NEW_VALUES;
+    shard.new_chunks = shard.overlaps = 0;
+    shard.new_size = shard.dead_size = 0;
+    assert (siridb_shard_optimize_score(&shard) == 1);
+
+    /* chunks of dropped series are only marked as dead */
+    for (size_t i = 0; i < 100; i++)
+    {
+        idx_t idx = {.pos=(uint32_t) i * 64, .chunk_sz=64};
+        assert (siridb_shard_drop_chunk(&shard, &idx) == 0);
+    }
+    assert (shard.dropped_n == 100 && shard.dropped_sz >= 100);
+    assert (shard.dropped[99].pos == 99 * 64);
+    assert (siridb_shard_optimize_score(&shard) == UINT64_MAX - 1);
+
+    shard.flags |= SIRIDB_SHARD_HAS_DROPPED_SERIES;
+    assert (siridb_shard_optimize_score(&shard) == UINT64_MAX);
+
+    /* cold shards are optimized after they are loaded */
+    shard.is_cold = 1;
+    assert (siridb_shard_optimize_score(&shard) == 0);
+
+    free(shard.dropped);
+
+    siri.cfg = cfg;
+
+    return test_end(TEST_OK);
+}
+
+static int test_throttle(void)
+{
+    test_start("Testing throttle");
+
+    siri_cfg_t * cfg = siri.cfg;
+    siri_cfg_t tmp_cfg;
+    siri_throttle_t throttle = {.limit=0, .full=0};
+    uint64_t delay;
+
+    memset(&tmp_cfg, 0, sizeof(siri_cfg_t));
+    siri.cfg = &tmp_cfg;
+
+    /* no limit */
+    assert (siri_throttle_delay(SIRI_THROTTLE_INITSYNC, 1 << 30) == 0);
+
+    /* one second is allowed as a burst */
+    tmp_cfg.initsync_io_limit = 1;
+    assert (siri_throttle_delay(SIRI_THROTTLE_INITSYNC, 500000) == 0);
+    assert (siri_throttle_delay(SIRI_THROTTLE_INITSYNC, 500000) == 0);
+
+    delay = siri_throttle_delay(SIRI_THROTTLE_INITSYNC, 1000000);
+    assert (delay > 900 && delay <= 1000);
+
+    /* each task type has its own bucket */
+    tmp_cfg.reindex_io_limit = 1;
+    assert (siri_throttle_delay(SIRI_THROTTLE_REINDEX, 1000000) == 0);
+
+    /* a bucket for a database without a limit is not used */
+    siri_throttle_wait_bucket(&throttle, 1 << 30);
+    assert (throttle.full == 0);
+
+    /* the burst is not slept */
+    throttle.limit = 1;
+    siri_throttle_wait_bucket(&throttle, 1000000);
+    assert (throttle.full > 0);
+    assert (siri_throttle_delay(SIRI_THROTTLE_OPTIMIZE, 1 << 30) == 0);
+
+    siri.cfg = cfg;
+
+    return test_end(TEST_OK);
+}
+
+static int test_ratelimit(void)
+{
+    test_start("Testing ratelimit");
+
+    uv_loop_t * loop = siri.loop;
+    siridb_ratelimits_t limits;
+    const char * limit = NULL;
+    uint32_t retry_after;
+
+    /* the loop time is not updated so the buckets are not refilled */
+    siri.loop = uv_default_loop();
+
+    assert (siridb_ratelimits_parse(&limits, "") == -1);
+    assert (siridb_ratelimits_parse(&limits, "1 2") == -1);
+    assert (siridb_ratelimits_parse(&limits, "1 2 -3") == -1);
+    assert (siridb_ratelimits_parse(&limits, "1 2 3 4") == -1);
+    assert (siridb_ratelimits_parse(&limits, "100 2 1000 ") == 0);
+
+    /* one second of queries is allowed as a burst */
+    assert (siridb_ratelimits_query(&limits, &limit) == 0);
+    assert (siridb_ratelimits_query(&limits, &limit) == 0);
+    retry_after = siridb_ratelimits_query(&limits, &limit);
+    assert (retry_after > 0 && retry_after <= 501);
+    assert (strcmp(limit, "queries") == 0);
+
+    /* points are taken after the request is accepted */
+    assert (siridb_ratelimits_insert(&limits, &limit) == 0);
+    siridb_ratelimits_points(&limits, 300);
+    retry_after = siridb_ratelimits_insert(&limits, &limit);
+    assert (retry_after > 2000 && retry_after <= 2001);
+    assert (strcmp(limit, "inserted points") == 0);
+
+    /* selected points refuse new queries */
+    assert (siridb_ratelimits_parse(&limits, "0 0 1000") == 0);
+    assert (siridb_ratelimits_query(&limits, &limit) == 0);
+    siridb_ratelimits_selected(&limits, 1000);
+    assert (siridb_ratelimits_query(&limits, &limit) > 0);
+    assert (strcmp(limit, "selected points") == 0);
+
+    /* zero means no limit */
+    siridb_ratelimits_points(&limits, 1 << 30);
+    assert (siridb_ratelimits_insert(&limits, &limit) == 0);
+
+    siri.loop = loop;
+
+    return test_end(TEST_OK);
+}
+
+static int test_hotlog(void)
+{
+    test_start("Testing hotlog");
+
+    siridb_hotlog_t * hotlog = siridb_hotlog_new();
+    siridb_point_t points[3] = {
+            {.ts=1, .val={.int64=10}},
+            {.ts=2, .val={.int64=20}},
+            {.ts=3, .val={.int64=30}}};
+    size_t marker, field;
+
+    assert (hotlog != NULL);
+
+    /* markers keep the generation and position below the buffer class */
+    marker = siridb_hotlog_marker(0x12345, 1234567);
+    field = marker | ((size_t) 3 << 56);
+    assert (marker & SIRIDB_HOTLOG_HOT_BIT);
+    assert (siridb_hotlog_marker_gen(field) == 0x2345);
+    assert (siridb_hotlog_marker_pos(field) == 1234567);
+    assert ((field >> 56) == 3);
+
+    marker = siridb_hotlog_marker(UINT16_MAX, SIRIDB_HOTLOG_POS_MASK);
+    assert (siridb_hotlog_marker_gen(marker) == UINT16_MAX);
+    assert (siridb_hotlog_marker_pos(marker) == SIRIDB_HOTLOG_POS_MASK);
+    assert ((marker >> 56) == 0);
+
+    /* records are appended after the header */
+    hotlog->fp = tmpfile();
+    hotlog->size = SIRIDB_HOTLOG_HEADER_SZ;
+    assert (hotlog->fp != NULL);
+    assert (fseeko(hotlog->fp, SIRIDB_HOTLOG_HEADER_SZ, SEEK_SET) == 0);
+
+    assert (siridb_hotlog_write(hotlog, 7, points, 3) == 0);
+    assert (siridb_hotlog_write(hotlog, 8, points + 1, 1) == 0);
+    assert (hotlog->size == SIRIDB_HOTLOG_HEADER_SZ + 8 + 48 + 8 + 16);
+    assert (siridb_hotlog_sync(hotlog) == 0);
+    assert (ftello(hotlog->fp) == (off_t) hotlog->size);
+
+    siridb_hotlog_free(hotlog);
+
+    return test_end(TEST_OK);
+}
+
+static int test_downsample(void)
+{
+    test_start("Testing downsample");
+
+    siridb_downsample_t downsample = {
+            .interval=10,
+            .tp=SIRIDB_DOWNSAMPLE_MEAN};
+    siridb_points_t * points = siridb_points_new(6, TP_INT);
+    uint64_t ts[] = {1, 5, 9, 10, 25, 29};
+    int64_t val[] = {1, 2, 6, 7, 10, 11};
+
+    for (size_t i = 0; i < 6; i++)
+    {
+        points->data[i].ts = ts[i];
+        points->data[i].val.int64 = val[i];
+    }
+    points->len = 6;
+
+    /* one point per interval with the time-stamp of the last point */
+    assert (siridb_downsample_points(&downsample, points) == 3);
+    assert (points->data[0].ts == 9 && points->data[0].val.int64 == 3);
+    assert (points->data[1].ts == 10 && points->data[1].val.int64 == 7);
+    assert (points->data[2].ts == 29 && points->data[2].val.int64 == 11);
+
+    /* downsampling again gives the same result */
+    downsample.tp = SIRIDB_DOWNSAMPLE_MAX;
+    assert (siridb_downsample_points(&downsample, points) == 3);
+    assert (points->data[0].ts == 9 && points->data[0].val.int64 == 3);
+
+    /* a larger interval includes more points */
+    downsample.interval = 30;
+    downsample.tp = SIRIDB_DOWNSAMPLE_MIN;
+    assert (siridb_downsample_points(&downsample, points) == 1);
+    assert (points->data[0].ts == 29 && points->data[0].val.int64 == 3);
+
+    siridb_points_free(points);
+
+    return test_end(TEST_OK);
+}
+
+static int test_fh(void)
+{
+    test_start("Testing file handler");
+
+    siri_fh_t * fh = siri_fh_new(2);
+    siri_fp_t * a = siri_fp_new();
+    siri_fp_t * b = siri_fp_new();
+    siri_fp_t * c = siri_fp_new();
+
+    assert (siri_fh_open(fh, a, "/dev/null", "r") == 0);
+    assert (siri_fh_open(fh, b, "/dev/null", "r") == 0);
+    assert (fh->opens == 2 && fh->hits == 0);
+
+    /* a is used while open and gets a second chance */
+    assert (siri_fh_open(fh, a, "/dev/null", "r") == 0);
+    assert (fh->hits == 1);
+
+    assert (siri_fh_open(fh, c, "/dev/null", "r") == 0);
+    assert (fh->evictions == 1);
+    assert (a->fp != NULL && b->fp == NULL && c->fp != NULL);
+
+    /* a has lost the second chance, c is never used after opening */
+    assert (siri_fh_open(fh, b, "/dev/null", "r") == 0);
+    assert (a->fp == NULL && b->fp != NULL && c->fp != NULL);
+
+    /* a file which is closed leaves a free position */
+    siri_fp_close(c);
+    assert (siri_fh_open(fh, a, "/dev/null", "r") == 0);
+    assert (fh->evictions == 2 && fh->opens == 5);
+    assert (a->fp != NULL && b->fp != NULL);
+
+    siri_fp_decref(a);
+    siri_fp_decref(b);
+    siri_fp_decref(c);
+    siri_fh_free(fh);
+
+    return test_end(TEST_OK);
+}
+
+static int test_crc32c(void)
+{
+    test_start("Testing crc32c");
+
+    const char * check = "123456789";
+    unsigned char data[1000];
+    uint32_t crc;
+
+    for (size_t i = 0; i < sizeof(data); i++)
+    {
+        data[i] = (unsigned char) (i * 7);
+    }
+
+    siridb_crc32c_init();
+
+    /* check value for CRC-32C */
+    assert (siridb_crc32c(0, check, 9) == 0xe3069283);
+    assert (siridb_crc32c(0, check, 0) == 0);
+
+    /* a checksum can be continued at any position */
+    crc = siridb_crc32c(0, data, sizeof(data));
+    assert (siridb_crc32c(siridb_crc32c(0, data, 13), data + 13, 987) == crc);
+    assert (siridb_crc32c(siridb_crc32c(0, data, 3), data + 3, 997) == crc);
+
+    /* a single changed bit is detected */
+    data[500] ^= 1;
+    assert (siridb_crc32c(0, data, sizeof(data)) != crc);
+
+    return test_end(TEST_OK);
+}
+
+static int test_capture(void)
+{
+    test_start("Testing capture");
+
+    char fn[] = "/tmp/siridb-test-capture-XXXXXX";
+    const char * q = "select * from 'a'";
+    char buf[512];
+    char * pt = buf;
+    uint64_t ns;
+    uint32_t conn;
+    sirinet_pkg_t pkg, * auth, * query, * ping;
+    sirinet_socket_t ssocket = {0};
+    uv_stream_t * client = (uv_stream_t *) &ssocket.handle.tcp;
+    qp_packer_t * packer = sirinet_packer_new(64);
+    FILE * fp;
+    size_t n;
+    int fd = mkstemp(fn);
+
+    assert (fd >= 0);
+    close(fd);
+
+    ssocket.handle.tcp.data = &ssocket;
+
+    qp_add_type(packer, QP_ARRAY3);
+    qp_add_string(packer, "iris");
+    qp_add_string(packer, "siri");
+    qp_add_string(packer, "dbtest");
+    auth = sirinet_packer2pkg(packer, 1, CPROTO_REQ_AUTH);
+    query = sirinet_pkg_new(2, strlen(q), CPROTO_REQ_QUERY, q);
+    ping = sirinet_pkg_new(3, 0, CPROTO_REQ_PING, NULL);
+
+    assert (sirinet_capture_init(fn, 0) == 0);
+    sirinet_capture_pkg(client, auth);
+    sirinet_capture_pkg(client, ping);  /* ignored */
+    sirinet_capture_pkg(client, query);
+    sirinet_capture_close();
+
+    fp = fopen(fn, "r");
+    n = fread(buf, 1, sizeof(buf), fp);
+    fclose(fp);
+
+    assert (n == SIRINET_CAPTURE_HEADER_SZ +
+            2 * SIRINET_CAPTURE_REC_SZ + 6 + strlen(q));
+    assert (memcmp(pt, SIRINET_CAPTURE_MAGIC, SIRINET_CAPTURE_MAGIC_SZ) == 0);
+    assert (pt[SIRINET_CAPTURE_MAGIC_SZ] == SIRINET_CAPTURE_VERSION);
+    pt += SIRINET_CAPTURE_HEADER_SZ;
+
+    /* only the database name of an authentication request is captured */
+    memcpy(&ns, pt, sizeof(uint64_t));
+    memcpy(&conn, pt + sizeof(uint64_t), sizeof(uint32_t));
+    memcpy(&pkg, pt + sizeof(uint64_t) + sizeof(uint32_t), sizeof(pkg));
+    assert (conn == 1 && ssocket.capture_id == 1);
+    assert (pkg.tp == CPROTO_REQ_AUTH && pkg.pid == 1 && pkg.len == 6);
+    pt += SIRINET_CAPTURE_REC_SZ;
+    assert (memcmp(pt, "dbtest", 6) == 0);
+    pt += 6;
+
+    memcpy(&ns, pt, sizeof(uint64_t));
+    memcpy(&conn, pt + sizeof(uint64_t), sizeof(uint32_t));
+    memcpy(&pkg, pt + sizeof(uint64_t) + sizeof(uint32_t), sizeof(pkg));
+    assert (conn == 1);
+    assert (pkg.tp == CPROTO_REQ_QUERY && pkg.len == strlen(q));
+    pt += SIRINET_CAPTURE_REC_SZ;
+    assert (memcmp(pt, q, strlen(q)) == 0);
+
+    /* capturing stops when the next record does not fit */
+    assert (sirinet_capture_init(
+            fn,
+            SIRINET_CAPTURE_HEADER_SZ + SIRINET_CAPTURE_REC_SZ + 6) == 0);
+    sirinet_capture_pkg(client, auth);
+    sirinet_capture_pkg(client, query);
+    sirinet_capture_pkg(client, auth);
+    sirinet_capture_close();
+
+    fp = fopen(fn, "r");
+    n = fread(buf, 1, sizeof(buf), fp);
+    fclose(fp);
+    assert (n == SIRINET_CAPTURE_HEADER_SZ + SIRINET_CAPTURE_REC_SZ + 6);
+
+    free(auth);
+    free(query);
+    free(ping);
+    unlink(fn);
+
+    return test_end(TEST_OK);
+}
+
+static int test_startup(void)
+{
+    test_start("Testing startup");
+
+    char dbpath[] = "/tmp/siridb-test-startup-XXXXXX/";
+    char fn[PATH_MAX];
+    char * summary;
+    siridb_t siridb = {0};
+    FILE * fp;
+
+    dbpath[strlen(dbpath) - 1] = '\0';
+    assert (mkdtemp(dbpath) != NULL);
+    dbpath[strlen(dbpath)] = '/';
+
+    snprintf(fn, PATH_MAX, "%susers.dat", dbpath);
+    fp = fopen(fn, "w");
+    fwrite("users", 1, 5, fp);
+    fclose(fp);
+
+    siridb.dbpath = dbpath;
+    siridb_startup_init(&siridb.startup, timeit_ns());
+    siridb_startup_phase(&siridb, SIRIDB_STARTUP_DATABASE, 1);
+    siridb_startup_phase(&siridb, SIRIDB_STARTUP_USERS, 3);
+
+    assert (siridb.startup.phase[SIRIDB_STARTUP_DATABASE].bytes == 0);
+    assert (siridb.startup.phase[SIRIDB_STARTUP_USERS].bytes == 5);
+    assert (siridb.startup.phase[SIRIDB_STARTUP_USERS].objects == 3);
+
+    /* the peers phase is not included when not finished */
+    siridb.startup.phase[SIRIDB_STARTUP_USERS].ns = 1500000;
+    summary = siridb_startup_summary(&siridb);
+    assert (summary != NULL);
+    assert (strstr(summary, "\nusers: ms=1.500 bytes=5 objects=3\n") != NULL);
+    assert (strstr(summary, "peers") == NULL);
+    free(summary);
+
+    unlink(fn);
+    dbpath[strlen(dbpath) - 1] = '\0';
+    rmdir(dbpath);
+
+    return test_end(TEST_OK);
+}
+
+static int test_buffer_grow(void)
+{
+    test_start("Testing buffer growth");
+
+    siridb_t siridb = {0};
+    siridb_series_t series = {0};
+    uint64_t ts = 1;
+    qp_via_t val = {.int64 = 1};
+
+    siridb.buffer_len = 100;
+    series.buffer = siridb_points_new(0, TP_INT);
+    assert (series.buffer->data == NULL);
+    assert (siridb_buffer_mem(&siridb, &series) == 0);
+
+    /* the first write allocates the minimal capacity */
+    assert (siridb_buffer_reserve(&siridb, &series, 1) == 0);
+    assert (series.bf_cap == SIRIDB_BUFFER_MIN_CAP);
+    siridb_points_add_point(series.buffer, &ts, &val);
+
+    /* the capacity is doubled and limited by the buffer length */
+    series.buffer->len = SIRIDB_BUFFER_MIN_CAP;
+    assert (siridb_buffer_reserve(&siridb, &series, 1) == 0);
+    assert (series.bf_cap == 2 * SIRIDB_BUFFER_MIN_CAP);
+    assert (siridb_buffer_reserve(&siridb, &series, 60) == 0);
+    assert (series.bf_cap == 100);
+    assert (siridb_buffer_mem(&siridb, &series) ==
+            100 * sizeof(siridb_point_t));
+
+    /* a larger class can grow further */
+    series.bf_class = 1;
+    assert (siridb_buffer_reserve(&siridb, &series, 100) == 0);
+    assert (series.bf_cap == 200);
+    assert (series.buffer->data[0].ts == 1);
+
+    siridb_points_free(series.buffer);
+
+    return test_end(TEST_OK);
+}
+
+static int test_fp_prealloc(void)
+{
+    test_start("Testing file preallocation");
+
+    char fn[] = "/tmp/siridb-test-prealloc-XXXXXX";
+    siri_fp_t * fp = siri_fp_new();
+    struct stat st;
+    int fd = mkstemp(fn);
+
+    assert (fd >= 0);
+    close(fd);
+
+    fp->fp = fopen(fn, "r+");
+    assert (fp->fp != NULL);
+    assert (fwrite("abc", 3, 1, fp->fp) == 1);
+    assert (fflush(fp->fp) == 0);
+
+    /* not every file system supports preallocation */
+    if (siri_fp_prealloc(fp, 3, 10, 4096) == 0)
+    {
+        assert (fp->alloc_sz == 4096);
+
+        /* space which is already allocated is not allocated again */
+        assert (siri_fp_prealloc(fp, 3, 4093, 4096) == 0);
+        assert (fp->alloc_sz == 4096);
+        assert (siri_fp_prealloc(fp, 3, 4094, 4096) == 0);
+        assert (fp->alloc_sz == 8192);
+    }
+
+    /* the file size is never changed */
+    assert (stat(fn, &st) == 0 && st.st_size == 3);
+
+    siri_fp_close(fp);
+    assert (fp->alloc_sz == 0);
+    assert (stat(fn, &st) == 0 && st.st_size == 3);
+
+    siri_fp_decref(fp);
+    unlink(fn);
+
+    return test_end(TEST_OK);
+}
+
+static int test_logger_file(void)
+{
+    test_start("Testing logger_file");
+
+    char fn[] = "/tmp/siridb-test-logger-XXXXXX";
+    char fn1[sizeof(fn) + 2];
+    char fn2[sizeof(fn) + 2];
+    logger_file_t * lfile;
+    FILE * fp;
+    int fd = mkstemp(fn);
+
+    assert (fd >= 0);
+    close(fd);
+    sprintf(fn1, "%s.1", fn);
+    sprintf(fn2, "%s.2", fn);
+
+    /* each line is larger than max_size so every line is rotated */
+    lfile = logger_file_new(fn, 16, 1);
+    assert (lfile != NULL);
+    assert (lfile->size == 0);
+
+    logger_file_write(lfile, LOGGER_WARNING, "first %d", 1);
+    assert (lfile->size == 0);
+    logger_file_write(lfile, LOGGER_WARNING, "second %d", 2);
+    logger_file_write(lfile, LOGGER_WARNING, "third %d", 3);
+    logger_file_free(lfile);
+
+    /* only one rotated file is kept */
+    fp = fopen(fn1, "r");
+    assert (fp != NULL);
+    char line[64];
+    assert (fgets(line, sizeof(line), fp) != NULL);
+    assert (line[1] == 'W');
+    assert (strstr(line, "] third 3\n") != NULL);
+    fclose(fp);
+    assert (fopen(fn2, "r") == NULL);
+
+    unlink(fn);
+    unlink(fn1);
+
+    return test_end(TEST_OK);
+}
+
+static int test_logger_async(void)
+{
+    test_start("Testing asynchronous logger");
+
+    char fn[] = "/tmp/siridb-test-async-logger-XXXXXX";
+    FILE * ostream = Logger.ostream;
+    FILE * fp;
+    char line[256];
+    int i, n = 0, dropped = 0;
+    int fd = mkstemp(fn);
+
+    assert (fd >= 0);
+    close(fd);
+
+    fp = fopen(fn, "w");
+    assert (fp != NULL);
+    Logger.ostream = fp;
+
+    /* a small ring buffer, rounded up to four lines */
+    assert (logger_async_start(3) == 0);
+    assert (Logger.flags & LOGGER_FLAG_ASYNC);
+
+    log__warning("async %d", 0);
+
+    /* repeated lines are limited and lines which do not fit are dropped */
+    for (i = 0; i < 100; i++)
+    {
+        log__warning("repeated %d", i);
+    }
+
+    logger_async_stop();
+    assert (!(Logger.flags & LOGGER_FLAG_ASYNC));
+
+    Logger.ostream = ostream;
+    fclose(fp);
+
+    fp = fopen(fn, "r");
+    assert (fp != NULL);
+    assert (fgets(line, sizeof(line), fp) != NULL);
+    assert (strstr(line, " async 0\n") != NULL);
+
+    while (fgets(line, sizeof(line), fp) != NULL)
+    {
+        if (strstr(line, " repeated ") != NULL)
+        {
+            n++;
+        }
+        else if (strstr(line, " log line(s) are dropped\n") != NULL)
+        {
+            dropped++;
+        }
+    }
+    fclose(fp);
+
+    assert (n > 0 && n < 100);
+    assert (dropped > 0);
+
+    unlink(fn);
 
-    assert (strx_to_double("0.5", 3) == 0.5);
-    assert (strx_to_double("0.55", 3) == 0.5);
-    assert (strx_to_double("123.456", 7) == 123.456);
-    assert (strx_to_double("123", 3) == 123);
-    assert (strx_to_double("123.", 4) == 123);
-    assert (strx_to_double("123456.", 3) == 123);
     return test_end(TEST_OK);
 }
 
@@ -933,29 +4547,88 @@ int run_tests(void)
     timeit_start(&start);
     int rc = 0;
     rc += test_qpack();
+    rc += test_qpack_funpacker();
     rc += test_cleri();
     rc += test_ctree();
     rc += test_imap();
+    rc += test_dmap();
     rc += test_imap_union();
     rc += test_imap_intersection();
     rc += test_imap_difference();
     rc += test_imap_symmetric_difference();
+    rc += test_iset();
     rc += test_gen_pool_lookup();
     rc += test_points();
+    rc += test_points_pack_columns();
+    rc += test_pcache();
+    rc += test_arena();
+    rc += test_names();
+    rc += test_slab();
+    rc += test_compress();
+    rc += test_compress_chunk();
+    rc += test_compress_log();
+    rc += test_export();
+    rc += test_ccache();
+    rc += test_acache();
+    rc += test_qcache();
+    rc += test_mcache();
+    rc += test_qplans();
+    rc += test_series_cost();
+    rc += test_query_cancel();
+    rc += test_trigrams();
+    rc += test_tokens();
+    rc += test_shash();
+    rc += test_re_cache();
     rc += test_aggr_count();
     rc += test_aggr_max();
+    rc += test_aggr_limit();
+    rc += test_aggr_lttb();
     rc += test_aggr_mean();
     rc += test_aggr_median();
     rc += test_aggr_median_high();
     rc += test_aggr_median_low();
     rc += test_aggr_min();
+    rc += test_aggr_percentile();
+    rc += test_aggr_fused();
     rc += test_aggr_pvariance();
     rc += test_aggr_sum();
     rc += test_aggr_variance();
+    rc += test_variance_merge();
+    rc += test_points_merge();
+    rc += test_points_join();
+    rc += test_spill();
+    rc += test_points_merge_runs();
+    rc += test_aggr_stats();
+    rc += test_aggr_filter_stats();
+    rc += test_rollup();
     rc += test_iso8601();
     rc += test_expr();
+    rc += test_cexpr();
     rc += test_access();
     rc += test_version();
+    rc += test_latency();
+    rc += test_loop();
+    rc += test_alloc();
+    rc += test_numa();
+    rc += test_session();
+    rc += test_hot();
+    rc += test_durations();
+    rc += test_server_counts();
+    rc += test_metrics();
+    rc += test_logger_file();
+    rc += test_logger_async();
+    rc += test_mutex();
+    rc += test_shard_optimize_score();
+    rc += test_throttle();
+    rc += test_ratelimit();
+    rc += test_hotlog();
+    rc += test_downsample();
+    rc += test_fh();
+    rc += test_fp_prealloc();
+    rc += test_crc32c();
+    rc += test_capture();
+    rc += test_startup();
+    rc += test_buffer_grow();
     rc += test_strx_to_double();
 
     printf("\nSuccesfully performed %d tests in %.3f milliseconds!\n\n",
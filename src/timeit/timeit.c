@@ -9,6 +9,7 @@
  *  - initial version, 16-03-2016
  *
  */
+#include <time.h>
 #include <timeit/timeit.h>
 
 /*
@@ -36,3 +37,15 @@ float timeit_stop(timeit_t * start)
            (end.tv_usec - start->tv_usec) / 1000.0f;
 }
 
+/*
+ * Returns a monotonic time in nanoseconds. Only the difference between two
+ * values has a meaning.
+ */
+uint64_t timeit_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t) ts.tv_sec * 1000000000 + (uint64_t) ts.tv_nsec;
+}
@@ -0,0 +1,287 @@
+#!/usr/bin/python3
+'''Load generator for a running SiriDB node or cluster.
+
+Inserts and selects are sent with a fixed rate according to a mix which can
+be given as arguments or as a JSON profile. (keys are the argument names
+with underscores, for example {"insert_rate": 50000, "series": 10000})
+
+Latency is measured from the moment a request was scheduled, not from the
+moment it was sent, so a slow server does not hide its own queueing.
+
+Example:
+
+    ./load.py --hosts localhost:9000 --dbname dbtest --duration 60 \\
+        --insert-rate 20000 --series 5000 --out-of-order 0.05 \\
+        --select-rate 50 --select-mix range=4,aggregate=2,last=1,multi=1 \\
+        --json result.json
+'''
+import argparse
+import asyncio
+import json
+import logging
+import random
+import sys
+import time
+from siridb.connector import SiriDBClient
+from testing import Histogram
+
+_MAP_TS = {
+    's': 10**0,
+    'ms': 10**3,
+    'us': 10**6,
+    'ns': 10**9
+}
+
+SELECT_SHAPES = {
+    'last': 'select last() from "{name}"',
+    'range': 'select * from "{name}" after now - 1h',
+    'aggregate': 'select mean(1m) from "{name}" after now - 1d',
+    'multi': 'select max(1h) from /{prefix}-{group:03d}.*/ after now - 1d',
+    'count': 'count series /{prefix}-{group:03d}.*/',
+}
+
+PERCENTILES = (50, 99, 99.9)
+
+
+class Stats:
+    def __init__(self):
+        self.hist = Histogram()
+        self.errors = 0
+        self.points = 0
+
+    def as_dict(self, elapsed):
+        hist = self.hist
+        return {
+            'ops': hist.n,
+            'errors': self.errors,
+            'ops_per_sec': hist.n / elapsed,
+            'points_per_sec': self.points / elapsed,
+            'mean_ms': hist.mean() / 1000,
+            'max_ms': hist.max / 1000,
+            **{'p{}_ms'.format(p): hist.percentile(p) / 1000
+               for p in PERCENTILES},
+        }
+
+
+class LoadGenerator:
+    def __init__(self, args):
+        self.args = args
+        self.rnd = random.Random(args.seed)
+        self.factor = _MAP_TS[args.time_precision]
+        self.names = [
+            '{}-{:03d}-{:06d}'.format(args.prefix, i % 1000, i)
+            for i in range(args.series)]
+        self.stats = {}
+        self.mix = []
+        for shape, weight in args.select_mix.items():
+            if shape not in SELECT_SHAPES:
+                raise ValueError('unknown select shape: {}'.format(shape))
+            self.mix.extend([shape] * int(weight))
+        self.client = SiriDBClient(
+            username=args.user,
+            password=args.password,
+            dbname=args.dbname,
+            hostlist=args.hosts)
+
+    def _stats(self, name):
+        if name not in self.stats:
+            self.stats[name] = Stats()
+        return self.stats[name]
+
+    def _gen_batch(self):
+        args = self.args
+        rnd = self.rnd
+        now = time.time()
+        data = {}
+        for _ in range(args.batch):
+            i = rnd.randrange(args.series)
+            ts = now
+            if rnd.random() < args.out_of_order:
+                ts -= rnd.uniform(0, args.out_of_order_window)
+            # even series are float, uneven integer
+            val = rnd.uniform(-100, 100) if i % 2 == 0 else \
+                rnd.randint(-100, 100)
+            data.setdefault(self.names[i], []).append(
+                [int(ts * self.factor), val])
+        return data
+
+    def _gen_select(self):
+        shape = self.rnd.choice(self.mix)
+        return shape, SELECT_SHAPES[shape].format(
+            name=self.rnd.choice(self.names),
+            prefix=self.args.prefix,
+            group=self.rnd.randrange(min(self.args.series, 1000)))
+
+    async def _run(self, rate, end, gen, send):
+        '''Send requests from a worker at 'rate' requests per second.'''
+        if rate <= 0:
+            return
+        interval = 1.0 / rate
+        scheduled = time.time() + self.rnd.uniform(0, interval)
+        while scheduled < end:
+            delay = scheduled - time.time()
+            if delay > 0:
+                await asyncio.sleep(delay)
+            name, req, points = gen()
+            stats = self._stats(name)
+            try:
+                await send(req)
+            except Exception as e:
+                logging.debug('{} failed: {}'.format(name, e))
+                stats.errors += 1
+            else:
+                stats.points += points
+            stats.hist.record((time.time() - scheduled) * 1e6)
+            scheduled += interval
+
+    def _gen_insert(self):
+        data = self._gen_batch()
+        return 'insert', data, sum(map(len, data.values()))
+
+    def _gen_query(self):
+        shape, query = self._gen_select()
+        return 'select_' + shape, query, 0
+
+    async def run(self):
+        args = self.args
+        await self.client.connect()
+
+        if args.prefill:
+            # make sure each series exists before measuring
+            for i in range(0, args.series, args.batch):
+                now = int(time.time() * self.factor)
+                await self.client.insert({
+                    name: [[now, 0.0 if (i + n) % 2 == 0 else 0]]
+                    for n, name in enumerate(self.names[i:i + args.batch])})
+
+        version = (await self.client.query('show version'))['data'][0]
+
+        start = time.time()
+        end = start + args.duration
+        insert_rate = args.insert_rate / args.batch / args.workers
+        select_rate = args.select_rate / args.workers
+
+        await asyncio.gather(*[
+            self._run(insert_rate, end, self._gen_insert, self.client.insert)
+            for _ in range(args.workers)] + [
+            self._run(select_rate, end, self._gen_query, self.client.query)
+            for _ in range(args.workers)])
+
+        elapsed = time.time() - start
+        self.client.close()
+
+        total = Stats()
+        for stats in self.stats.values():
+            total.hist.merge(stats.hist)
+            total.errors += stats.errors
+            total.points += stats.points
+
+        return {
+            'version': version['value'],
+            'profile': {k: v for k, v in vars(args).items() if k != 'password'},
+            'elapsed': elapsed,
+            'total': total.as_dict(elapsed),
+            'requests': {
+                name: stats.as_dict(elapsed)
+                for name, stats in sorted(self.stats.items())},
+        }
+
+
+def print_result(result):
+    print('SiriDB {} ({:.1f} seconds)'.format(
+        result['version'], result['elapsed']))
+    fmt = '{:<20}{:>10}{:>8}{:>12}{:>12}' + '{:>10}' * (len(PERCENTILES) + 1)
+    print(fmt.format(
+        'request', 'ops', 'errors', 'ops/s', 'points/s',
+        *['p{}'.format(p) for p in PERCENTILES], 'max'))
+    rows = list(result['requests'].items()) + [('total', result['total'])]
+    for name, r in rows:
+        print(fmt.format(
+            name,
+            r['ops'],
+            r['errors'],
+            '{:.1f}'.format(r['ops_per_sec']),
+            '{:.1f}'.format(r['points_per_sec']),
+            *['{:.2f}ms'.format(r['p{}_ms'.format(p)]) for p in PERCENTILES],
+            '{:.2f}ms'.format(r['max_ms'])))
+
+
+def parse_hosts(s):
+    hosts = []
+    for host in s.split(','):
+        address, _, port = host.rpartition(':')
+        hosts.append((address or 'localhost', int(port)))
+    return hosts
+
+
+def parse_mix(s):
+    mix = {}
+    for item in filter(None, s.split(',')):
+        shape, _, weight = item.partition('=')
+        mix[shape] = int(weight or 1)
+    return mix
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(description=__doc__.split('\n')[0])
+    parser.add_argument('--profile', type=argparse.FileType('r'),
+                        help='JSON file with defaults for the arguments')
+    parser.add_argument('--hosts', type=parse_hosts,
+                        default=[('localhost', 9000)],
+                        help='comma separated host:port (default: %(default)s)')
+    parser.add_argument('--dbname', default='dbtest')
+    parser.add_argument('--user', default='iris')
+    parser.add_argument('--password', default='siri')
+    parser.add_argument('--time-precision', choices=_MAP_TS, default='s',
+                        help='time precision of the database')
+    parser.add_argument('--duration', type=float, default=60,
+                        help='seconds to run (default: %(default)s)')
+    parser.add_argument('--workers', type=int, default=4,
+                        help='connections sending requests in parallel')
+    parser.add_argument('--series', type=int, default=10000,
+                        help='series cardinality (default: %(default)s)')
+    parser.add_argument('--prefix', default='load',
+                        help='prefix for the series names')
+    parser.add_argument('--prefill', action='store_true',
+                        help='create all series before measuring')
+    parser.add_argument('--insert-rate', type=float, default=10000,
+                        help='points per second (default: %(default)s)')
+    parser.add_argument('--batch', type=int, default=500,
+                        help='points per insert (default: %(default)s)')
+    parser.add_argument('--out-of-order', type=float, default=0.0,
+                        help='ratio of points with an older time-stamp')
+    parser.add_argument('--out-of-order-window', type=float, default=3600,
+                        help='maximum age in seconds of out-of-order points')
+    parser.add_argument('--select-rate', type=float, default=10,
+                        help='selects per second (default: %(default)s)')
+    parser.add_argument('--select-mix', type=parse_mix,
+                        default=parse_mix('range=4,aggregate=2,last=1,multi=1'),
+                        help='shape=weight list, shapes: {}'.format(
+                            ', '.join(sorted(SELECT_SHAPES))))
+    parser.add_argument('--seed', type=int, default=1,
+                        help='seed for generating the load')
+    parser.add_argument('--json', type=argparse.FileType('w'),
+                        help='write the result as JSON to this file')
+    parser.add_argument('--log-level', default='CRITICAL')
+
+    args = parser.parse_args()
+    if args.profile is not None:
+        profile = json.load(args.profile)
+        if 'hosts' in profile:
+            profile['hosts'] = [tuple(h) for h in profile['hosts']]
+        parser.set_defaults(**profile)
+        args = parser.parse_args()
+    args.profile = None
+
+    logging.getLogger().setLevel(args.log_level)
+
+    loop = asyncio.get_event_loop()
+    result = loop.run_until_complete(LoadGenerator(args).run())
+
+    print_result(result)
+    if args.json is not None:
+        result['profile'].pop('json', None)
+        json.dump(result, args.json, indent=2)
+        args.json.close()
+
+    sys.exit(1 if result['total']['errors'] else 0)
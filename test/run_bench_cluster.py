@@ -0,0 +1,53 @@
+#!/usr/bin/python3
+'''Cluster benchmark, not part of run_all.py since the results depend on the
+machine. The results and the metrics of each server are written as JSON to
+--output so runs with different builds or settings can be compared.'''
+import argparse
+import json
+from testing import run_test
+from testing import Server
+from test_bench_cluster import TestBenchCluster
+
+Server.BUILDTYPE = 'Release'
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser()
+    parser.add_argument(
+        '--pools',
+        type=int,
+        default=TestBenchCluster.POOLS,
+        help='number of pools')
+    parser.add_argument(
+        '--replicas',
+        type=int,
+        default=TestBenchCluster.REPLICAS,
+        help='servers per pool, 1 for no replicas')
+    parser.add_argument(
+        '--series',
+        type=int,
+        default=TestBenchCluster.SERIES,
+        help='number of series in the dataset')
+    parser.add_argument(
+        '--points',
+        type=int,
+        default=TestBenchCluster.POINTS,
+        help='points per series for the load and for the inserts')
+    parser.add_argument(
+        '--output',
+        help='write the results and server metrics to this JSON file')
+    args = parser.parse_args()
+
+    TestBenchCluster.POOLS = args.pools
+    TestBenchCluster.REPLICAS = args.replicas
+    TestBenchCluster.SERIES = args.series
+    TestBenchCluster.POINTS = args.points
+    test = TestBenchCluster()
+    try:
+        run_test(test)
+    finally:
+        test.print_results()
+
+    if args.output:
+        with open(args.output, 'w') as f:
+            json.dump(test.report(), f, indent=4, sort_keys=True)
+            f.write('\n')
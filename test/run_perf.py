@@ -0,0 +1,27 @@
+#!/usr/bin/python3
+'''Performance test tier, not part of run_all.py since the results depend
+on the machine. Use --update to store the results as the new baselines.'''
+import argparse
+from testing import run_test
+from testing import Server
+from test_perf import TestPerf
+
+Server.BUILDTYPE = 'Release'
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser()
+    parser.add_argument(
+        '--update',
+        action='store_true',
+        help='store the results in perf_baseline.json')
+    args = parser.parse_args()
+
+    TestPerf.UPDATE = args.update
+    test = TestPerf()
+    try:
+        run_test(test)
+    finally:
+        test.print_results()
+
+    if args.update:
+        test.save_baselines()
@@ -0,0 +1,201 @@
+'''Benchmark for a cluster with a configurable number of pools and replicas.
+
+The database is created on the first server and the dataset is loaded before
+the other pools are added, so the time until all servers are running again
+measures the re-index. Replicas are added after that and are measured in the
+same way for the initial synchronization. Inserts and selects run on the
+complete cluster, with a client connected to all servers.
+
+Each server listens for metrics on BENCH_METRICS_PORT + n and the metrics
+of all servers are collected at the end. The results depend on the machine
+so there are no baselines: use --output to compare runs.
+'''
+import asyncio
+import random
+import statistics
+import time
+from testing import Client
+from testing import Server
+from testing import SiriDB
+from testing import TestBase
+
+BENCH_SEED = 0xbe9c
+BENCH_START = 1500000000    # time-stamp of the first point, in seconds
+BENCH_BATCH = 10000         # points per insert request
+BENCH_RUNS = 10             # each select is repeated, the median is used
+BENCH_METRICS_PORT = 9020
+BENCH_TIMEOUT = 600         # seconds to wait for a re-index or sync
+
+# the series are named so they are spread over all pools
+QUERIES = {
+    'select_one_ms': 'select * from "bench-00000"',
+    'select_mean_ms': 'select mean(1h) from /bench-000.*/',
+    'select_merge_ms':
+        'select mean(1h) from /bench-00.*/ merge as "m" using mean(1h)',
+    'count_series_ms': 'count series',
+    'count_points_ms': 'count series length',
+}
+
+
+def gen_dataset(rnd, series, points, offset=0):
+    '''Returns insert batches, the same for a seed.'''
+    batch = {}
+    n = 0
+    for i in range(offset, offset + points):
+        ts = BENCH_START + i * 60
+        for s in range(series):
+            name = 'bench-{:05d}'.format(s)
+            value = rnd.randrange(1000) if s % 2 else rnd.random() * 1000
+            batch.setdefault(name, []).append([ts, value])
+            n += 1
+            if n == BENCH_BATCH:
+                yield batch
+                batch = {}
+                n = 0
+    if batch:
+        yield batch
+
+
+class TestBenchCluster(TestBase):
+    title = 'Benchmark a cluster with pools and replicas'
+
+    POOLS = 2
+    REPLICAS = 2                # servers per pool, 1 for no replicas
+    SERIES = 1000
+    POINTS = 500                # points per series for each insert step
+
+    def __init__(self, *args, **kwargs):
+        super().__init__(*args, **kwargs)
+        self.results = {}
+        self.metrics = {}
+        self.rnd = random.Random(BENCH_SEED)
+
+    @staticmethod
+    async def _metrics(server):
+        reader, writer = await asyncio.open_connection(
+            server.server_address,
+            server.listen_metrics_port)
+        writer.write(b'GET /metrics HTTP/1.1\r\n\r\n')
+        data = await reader.read()
+        writer.close()
+        metrics = {}
+        for line in data.decode().splitlines():
+            if line and not line.startswith('#') and ' ' in line:
+                key, value = line.rsplit(' ', 1)
+                metrics[key] = float(value)
+        return metrics
+
+    async def wait_running(self, name, client):
+        '''The status is polled so the resolution is the poll interval. The
+        time is added to the result since a pool can only be added when the
+        previous re-index is finished.'''
+        start = time.perf_counter()
+        timeout = BENCH_TIMEOUT
+        while timeout > 0:
+            result = await client.query('list servers name, status')
+            servers = result['servers']
+            if len(servers) == len(self.db.servers) and \
+                    all(status == 'running' for _, status in servers):
+                self.results[name] = self.results.get(name, 0) + \
+                    time.perf_counter() - start
+                return
+            await asyncio.sleep(0.1)
+            timeout -= 0.1
+        raise AssertionError('{} did not finish in time'.format(name))
+
+    async def measure_inserts(self, name, client, offset):
+        n = 0
+        start = time.perf_counter()
+        for batch in gen_dataset(self.rnd, self.SERIES, self.POINTS, offset):
+            await client.insert(batch)
+            n += sum(map(len, batch.values()))
+        self.results[name] = n / (time.perf_counter() - start)
+
+    async def measure_queries(self, client):
+        for name, query in QUERIES.items():
+            durations = []
+            for _ in range(BENCH_RUNS):
+                start = time.perf_counter()
+                await client.query(query)
+                durations.append((time.perf_counter() - start) * 1000)
+            self.results[name] = statistics.median(durations)
+
+    async def collect_metrics(self):
+        for server in self.servers:
+            self.metrics[server.name] = await self._metrics(server)
+
+    def print_results(self):
+        print('{:<34}{:>14}'.format('metric', 'value'))
+        for name, value in self.results.items():
+            print('{:<34}{:>14.3f}'.format(name, value))
+
+    def report(self):
+        return {
+            'topology': {
+                'pools': self.POOLS,
+                'replicas': self.REPLICAS,
+                'series': self.SERIES,
+                'points': self.POINTS,
+            },
+            'results': self.results,
+            'metrics': self.metrics,
+        }
+
+    async def run(self):
+        assert self.POOLS * self.REPLICAS <= 10, \
+            'each server needs a client port below 9010'
+
+        self.db = SiriDB(time_precision='s', duration_num='1w')
+
+        # servers are numbered per pool, the replicas follow the first server
+        self.servers = [
+            Server(
+                n,
+                optimize_interval=0,
+                listen_metrics_port=BENCH_METRICS_PORT + n)
+            for n in range(self.POOLS * self.REPLICAS)]
+        pools = [
+            self.servers[p * self.REPLICAS:(p + 1) * self.REPLICAS]
+            for p in range(self.POOLS)]
+
+        for server in self.servers:
+            server.create()
+            await server.start()
+
+        time.sleep(2.0)
+
+        await self.db.create_on(pools[0][0], sleep=2)
+        client = Client(self.db, pools[0][0])
+        await client.connect()
+
+        await self.measure_inserts('load_points_per_sec', client, 0)
+
+        for pool in pools[1:]:
+            await self.db.add_pool(pool[0], remote_server=pools[0][0])
+            await self.wait_running('reindex_sec', client)
+
+        for pool_id, pool in enumerate(pools):
+            for server in pool[1:]:
+                await self.db.add_replica(
+                    server,
+                    pool_id,
+                    remote_server=pool[0])
+        if self.REPLICAS > 1:
+            await self.wait_running('initsync_sec', client)
+
+        client.close()
+        client = Client(self.db, self.servers)
+        await client.connect()
+
+        await self.measure_inserts(
+            'insert_points_per_sec',
+            client,
+            self.POINTS)
+        await self.measure_queries(client)
+        await self.collect_metrics()
+
+        client.close()
+
+        for server in self.servers:
+            result = await server.stop()
+            self.assertTrue(result, msg='Server did not close correctly')
@@ -0,0 +1,260 @@
+'''Performance tests with a fixed dataset.
+
+Each metric is compared with the baseline stored in perf_baseline.json. A
+metric fails when it is worse than the baseline by more than its tolerance,
+which is relative with a small absolute margin for very fast operations.
+Baselines depend on the machine so they are created (or updated) on the
+machine which runs the tests with: ./run_perf.py --update
+'''
+import asyncio
+import json
+import os
+import random
+import statistics
+import time
+import psutil
+from testing import Client
+from testing import Server
+from testing import SiriDB
+from testing import TestBase
+
+PERF_SEED = 0x5eed
+PERF_START = 1500000000     # time-stamp of the first point, in seconds
+PERF_SERIES = 1000
+PERF_POINTS = 1000          # points per series
+PERF_BATCH = 10000          # points per insert request
+PERF_UNORDERED = 100000     # points inserted in reverse order in one series
+PERF_RUNS = 20              # each select is repeated, the median is used
+PERF_OPTIMIZE_INTERVAL = 15  # after the restart, disabled before
+PERF_METRICS_PORT = 9020
+PERF_BASELINE = os.path.join(os.path.dirname(__file__), 'perf_baseline.json')
+
+# name: (higher is better, relative tolerance, absolute tolerance)
+METRICS = {
+    'insert_points_per_sec': (True, 0.20, 0),
+    'insert_unordered_points_per_sec': (True, 0.20, 0),
+    'select_all_ms': (False, 0.25, 2),
+    'select_mean_ms': (False, 0.25, 2),
+    'select_regex_max_ms': (False, 0.25, 2),
+    'select_merge_ms': (False, 0.25, 2),
+    'list_series_ms': (False, 0.25, 2),
+    'count_series_ms': (False, 0.25, 2),
+    'optimize_sec': (False, 0.25, 0.5),
+    'startup_sec': (False, 0.25, 0.2),
+    'rss_mb': (False, 0.15, 5),
+    'rss_after_startup_mb': (False, 0.15, 5),
+}
+
+# canonical queries, the names map to the select_* metrics
+QUERIES = {
+    'select_all_ms': 'select * from "perf-0000"',
+    'select_mean_ms': 'select mean(1h) from "perf-0000"',
+    'select_regex_max_ms': 'select max(1d) from /perf-00.*/',
+    'select_merge_ms':
+        'select mean(1h) from /perf-0.*/ merge as "m" using mean(1h)',
+    'list_series_ms': 'list series name, length limit 1000',
+    'count_series_ms': 'count series',
+}
+
+
+def gen_dataset():
+    '''Returns the same insert batches for each run.'''
+    rnd = random.Random(PERF_SEED)
+    batch = {}
+    n = 0
+    for i in range(PERF_POINTS):
+        ts = PERF_START + i * 60
+        for s in range(PERF_SERIES):
+            name = 'perf-{:04d}'.format(s)
+            value = rnd.randrange(1000) if s % 2 else rnd.random() * 1000
+            batch.setdefault(name, []).append([ts, value])
+            n += 1
+            if n == PERF_BATCH:
+                yield batch
+                batch = {}
+                n = 0
+    if batch:
+        yield batch
+
+
+def gen_unordered():
+    '''Returns batches with points in reverse order for a single series.'''
+    points = [
+        [PERF_START + i, i]
+        for i in range(PERF_UNORDERED, 0, -1)]
+    for i in range(0, PERF_UNORDERED, PERF_BATCH):
+        yield {'perf-unordered': points[i:i + PERF_BATCH]}
+
+
+def load_baselines():
+    try:
+        with open(PERF_BASELINE, 'r') as f:
+            return json.load(f)
+    except FileNotFoundError:
+        return {}
+
+
+class TestPerf(TestBase):
+    title = 'Test performance against the baselines'
+
+    UPDATE = False
+
+    def __init__(self, *args, **kwargs):
+        super().__init__(*args, **kwargs)
+        self.results = {}
+        self.baselines = load_baselines()
+
+    async def _metrics(self):
+        reader, writer = await asyncio.open_connection(
+            self.server0.server_address,
+            PERF_METRICS_PORT)
+        writer.write(b'GET /metrics HTTP/1.1\r\n\r\n')
+        data = await reader.read()
+        writer.close()
+        metrics = {}
+        for line in data.decode().splitlines():
+            if line and not line.startswith('#') and ' ' in line:
+                key, value = line.rsplit(' ', 1)
+                metrics[key] = value
+        return metrics
+
+    async def _optimize_progress(self):
+        metrics = await self._metrics()
+        return (
+            int(metrics.get('siridb_optimize_shards_queued', 0)),
+            int(metrics.get('siridb_optimize_shards_done', 0)))
+
+    async def measure_inserts(self, name, batches):
+        n = 0
+        start = time.perf_counter()
+        for batch in batches:
+            await self.client0.insert(batch)
+            n += sum(map(len, batch.values()))
+        self.results[name] = n / (time.perf_counter() - start)
+
+    async def measure_queries(self):
+        for name, query in QUERIES.items():
+            durations = []
+            for _ in range(PERF_RUNS):
+                start = time.perf_counter()
+                await self.client0.query(query)
+                durations.append((time.perf_counter() - start) * 1000)
+            self.results[name] = statistics.median(durations)
+
+    async def measure_optimize(self, timeout=120):
+        '''The progress is polled so the resolution is the poll interval.'''
+        last = await self._optimize_progress()
+        start = None
+        while timeout > 0:
+            queued, done = await self._optimize_progress()
+            if start is None and (queued, done) != last and queued:
+                start = time.perf_counter()
+            if start is not None and done >= queued:
+                self.results['optimize_sec'] = time.perf_counter() - start
+                return
+            last = (queued, done)
+            await asyncio.sleep(0.05)
+            timeout -= 0.05
+        raise AssertionError('optimize did not finish in time')
+
+    def measure_rss(self, name):
+        rss = psutil.Process(self.server0.pid).memory_info().rss
+        self.results[name] = rss / 1024 / 1024
+
+    async def measure_startup(self, timeout=60):
+        result = await self.server0.stop()
+        self.assertTrue(result, msg='Server did not close correctly')
+
+        # the shards with new values are optimized after the restart
+        self.server0.optimize_interval = PERF_OPTIMIZE_INTERVAL
+        self.server0.create()
+
+        # includes the start delay of Server.start() when loading is faster
+        await self.server0.start()
+        created = psutil.Process(self.server0.pid).create_time()
+
+        while timeout > 0:
+            client = Client(self.db, self.server0)
+            try:
+                await client.connect()
+                await client.query('show status')
+            except Exception:
+                await asyncio.sleep(0.05)
+                timeout -= 0.05
+            else:
+                self.results['startup_sec'] = time.time() - created
+                return
+            finally:
+                client.close()
+        raise AssertionError('server did not start in time')
+
+    def regressions(self):
+        failed = []
+        for name, (higher, rel, ab) in METRICS.items():
+            value = self.results.get(name)
+            base = self.baselines.get(name)
+            if value is None or base is None:
+                continue
+            if higher:
+                limit = base * (1 - rel) - ab
+                if value < limit:
+                    failed.append((name, value, base, limit))
+            else:
+                limit = base * (1 + rel) + ab
+                if value > limit:
+                    failed.append((name, value, base, limit))
+        return failed
+
+    def print_results(self):
+        print('{:<34}{:>14}{:>14}'.format('metric', 'value', 'baseline'))
+        for name in METRICS:
+            value = self.results.get(name)
+            base = self.baselines.get(name)
+            print('{:<34}{:>14}{:>14}'.format(
+                name,
+                '-' if value is None else '{:.3f}'.format(value),
+                '-' if base is None else '{:.3f}'.format(base)))
+
+    def save_baselines(self):
+        with open(PERF_BASELINE, 'w') as f:
+            json.dump(self.results, f, indent=4, sort_keys=True)
+            f.write('\n')
+
+    async def run(self):
+        self.db = SiriDB(time_precision='s', duration_num='1w')
+        self.server0 = Server(
+            0,
+            optimize_interval=0,
+            listen_metrics_port=PERF_METRICS_PORT)
+        self.client0 = Client(self.db, self.server0)
+        self.server0.create()
+        await self.server0.start()
+
+        time.sleep(2.0)
+
+        await self.db.create_on(self.server0, sleep=2)
+        await self.client0.connect()
+
+        await self.measure_inserts('insert_points_per_sec', gen_dataset())
+        await self.measure_inserts(
+            'insert_unordered_points_per_sec',
+            gen_unordered())
+        await self.measure_queries()
+        self.measure_rss('rss_mb')
+
+        self.client0.close()
+        await self.measure_startup()
+        self.measure_rss('rss_after_startup_mb')
+
+        # the first optimize task starts after PERF_OPTIMIZE_INTERVAL
+        await self.measure_optimize()
+
+        result = await self.server0.stop()
+        self.assertTrue(result, msg='Server did not close correctly')
+
+        if not self.UPDATE:
+            failed = self.regressions()
+            assert not failed, 'Performance regression(s): {}'.format(
+                ', '.join(
+                    '{} = {:.3f} (baseline: {:.3f}, limit: {:.3f})'.format(*f)
+                    for f in failed))
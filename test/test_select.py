@@ -140,6 +140,10 @@ class TestSelect(TestBase):
             await self.client0.query('select median_high(1h) from "aggr"'),
             {'aggr': [[1447250400, 532], [1447254000, 531], [1447257600, 533]]})
 
+        self.assertEqual(
+            await self.client0.query('select percentile(1h, 50) from "aggr"'),
+            {'aggr': [[1447250400, 532.0], [1447254000, 530.5], [1447257600, 533.0]]})
+
         self.assertEqual(
             await self.client0.query('select min(1h) from "aggr"'),
             {'aggr': [[1447250400, 531], [1447254000, 54], [1447257600, 532]]})
@@ -12,6 +12,7 @@ from .helpers import cleanup
 from .helpers import gen_data
 from .helpers import gen_points
 from .helpers import gen_series
+from .histogram import Histogram
 from .server import Server
 from .siridb import SiriDB
 from .testbase import default_test_setup
@@ -0,0 +1,51 @@
+class Histogram:
+    '''Log-linear latency histogram, like a very small HdrHistogram.
+
+    Values are stored in buckets of 2**SUB_BITS sub buckets for each power
+    of two so the relative error is less than 1 / 2**SUB_BITS while memory
+    does not grow with the number of recorded values.
+    '''
+
+    SUB_BITS = 6
+
+    def __init__(self):
+        self.counts = {}
+        self.n = 0
+        self.total = 0
+        self.max = 0
+
+    @classmethod
+    def _shift(cls, value):
+        return max(value.bit_length() - cls.SUB_BITS - 1, 0)
+
+    def record(self, value):
+        value = max(int(value), 0)
+        shift = self._shift(value)
+        key = (value >> shift) << shift
+        self.counts[key] = self.counts.get(key, 0) + 1
+        self.n += 1
+        self.total += value
+        self.max = max(self.max, value)
+
+    def merge(self, other):
+        for key, count in other.counts.items():
+            self.counts[key] = self.counts.get(key, 0) + count
+        self.n += other.n
+        self.total += other.total
+        self.max = max(self.max, other.max)
+
+    def percentile(self, p):
+        '''Returns the highest value in the bucket which contains the value
+        at percentile p (0..100) or 0 when nothing is recorded.'''
+        if not self.n:
+            return 0
+        rank = max(int(self.n * p / 100.0 + 0.5), 1)
+        seen = 0
+        for key in sorted(self.counts):
+            seen += self.counts[key]
+            if seen >= rank:
+                return min(key + (1 << self._shift(key)) - 1, self.max)
+        return self.max
+
+    def mean(self):
+        return self.total / self.n if self.n else 0
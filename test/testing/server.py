@@ -30,7 +30,8 @@ class Server:
     def __init__(self,
                  n,
                  optimize_interval=30,
-                 heartbeat_interval=30):
+                 heartbeat_interval=30,
+                 listen_metrics_port=0):
         self.n = n
         self.listen_client_port = 9000 + n
         self.listen_backend_port = 9010 + n
@@ -41,6 +42,7 @@ class Server:
         self.ip_support = self.IP_SUPPORT
         self.optimize_interval = optimize_interval
         self.heartbeat_interval = heartbeat_interval
+        self.listen_metrics_port = listen_metrics_port
         self.cfgfile = os.path.join(TEST_DIR, 'siridb{}.conf'.format(self.n))
         self.dbpath = os.path.join(TEST_DIR, 'dbpath{}'.format(self.n))
         self.name = 'SiriDB:{}'.format(self.listen_backend_port)
@@ -64,6 +66,11 @@ class Server:
         config.set('siridb', 'heartbeat_interval', self.heartbeat_interval)
         config.set('siridb', 'default_db_path', self.dbpath)
         config.set('siridb', 'max_open_files', MAX_OPEN_FILES)
+        if self.listen_metrics_port:
+            config.set(
+                'siridb',
+                'listen_metrics_port',
+                self.listen_metrics_port)
 
         with open(self.cfgfile, 'w') as configfile:
             config.write(configfile)